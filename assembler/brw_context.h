@@ -69,7 +69,20 @@ struct opcode_desc {
 
 extern const struct opcode_desc opcode_descs[128];
 
+/*
+ * The disassemblers print each instruction into memory first, and only
+ * write the whole line out once it is complete.
+ */
+struct disasm_buffer {
+    char    *data;
+    size_t  size;
+    size_t  len;
+    int	    column;
+};
+
 int brw_disasm (FILE *file, struct brw_instruction *inst, int gen);
+int brw_disasm_to_mem (char *buf, size_t size,
+		       struct brw_instruction *inst, int gen);
 
 #ifdef __cplusplus
 } /* end of extern "C" */
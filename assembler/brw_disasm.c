@@ -392,49 +392,74 @@ static const char * const sampler_target_format[4] = {
 };
 
 
-static int column;
+/* The output is truncated to fit, but always NUL terminated */
+static void append (struct disasm_buffer *buf, const char *str, size_t len)
+{
+    if (len > buf->size - buf->len - 1)
+	len = buf->size - buf->len - 1;
+    memcpy (buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
 
-static int string (FILE *file, const char *string)
+static int string (struct disasm_buffer *file, const char *string)
 {
-    fputs (string, file);
-    column += strlen (string);
+    size_t len = strlen (string);
+
+    append (file, string, len);
+    file->column += len;
     return 0;
 }
 
-static int format (FILE *f, const char *format, ...) PRINTFLIKE(2, 3);
-static int format (FILE *f, const char *format, ...)
+static int format (struct disasm_buffer *f, const char *format, ...) PRINTFLIKE(2, 3);
+static int format (struct disasm_buffer *f, const char *format, ...)
 {
-    char    buf[1024];
+    size_t  avail = f->size - f->len;
     va_list	args;
-    va_start (args, format);
+    int     len;
 
-    vsnprintf (buf, sizeof (buf) - 1, format, args);
+    va_start (args, format);
+    len = vsnprintf (f->data + f->len, avail, format, args);
     va_end (args);
-    string (f, buf);
+
+    if (len < 0)
+	return 0;
+
+    f->column += len;
+    if ((size_t)len >= avail)
+	len = avail - 1;
+    f->len += len;
     return 0;
 }
 
-static int newline (FILE *f)
+static int newline (struct disasm_buffer *f)
 {
-    putc ('\n', f);
-    column = 0;
+    append (f, "\n", 1);
+    f->column = 0;
     return 0;
 }
 
-static int pad (FILE *f, int c)
+static int pad (struct disasm_buffer *f, int c)
 {
-    do
-	string (f, " ");
-    while (column < c);
+    static const char spaces[] = "                                                                ";
+    int len = c > f->column ? c - f->column : 1;
+
+    while (len > 0) {
+	int n = len < (int)sizeof (spaces) - 1 ? len : (int)sizeof (spaces) - 1;
+
+	append (f, spaces, n);
+	f->column += n;
+	len -= n;
+    }
     return 0;
 }
 
-static int control (FILE *file, const char *name, const char * const ctrl[],
+static int control (struct disasm_buffer *file, const char *name, const char * const ctrl[],
                     unsigned id, int *space)
 {
     if (!ctrl[id]) {
-	fprintf (file, "*** invalid %s value %d ",
-		 name, id);
+	format (file, "*** invalid %s value %d ",
+		name, id);
 	return 1;
     }
     if (ctrl[id][0])
@@ -448,7 +473,7 @@ static int control (FILE *file, const char *name, const char * const ctrl[],
     return 0;
 }
 
-static int print_opcode (FILE *file, int id)
+static int print_opcode (struct disasm_buffer *file, int id)
 {
     if (!opcode[id].name) {
 	format (file, "*** invalid opcode value %d ", id);
@@ -458,7 +483,7 @@ static int print_opcode (FILE *file, int id)
     return 0;
 }
 
-static int reg (FILE *file, unsigned _reg_file, unsigned _reg_nr)
+static int reg (struct disasm_buffer *file, unsigned _reg_file, unsigned _reg_nr)
 {
     int	err = 0;
 
@@ -510,7 +535,7 @@ static int reg (FILE *file, unsigned _reg_file, unsigned _reg_nr)
     return err;
 }
 
-static int dest (FILE *file, struct brw_instruction *inst)
+static int dest (struct disasm_buffer *file, struct brw_instruction *inst)
 {
     int	err = 0;
 
@@ -564,7 +589,7 @@ static int dest (FILE *file, struct brw_instruction *inst)
     return 0;
 }
 
-static int dest_3src (FILE *file, struct brw_instruction *inst)
+static int dest_3src (struct disasm_buffer *file, struct brw_instruction *inst)
 {
     int	err = 0;
     uint32_t reg_file;
@@ -586,7 +611,7 @@ static int dest_3src (FILE *file, struct brw_instruction *inst)
     return 0;
 }
 
-static int src_align1_region (FILE *file,
+static int src_align1_region (struct disasm_buffer *file,
 			      unsigned _vert_stride, unsigned _width, unsigned _horiz_stride)
 {
     int err = 0;
@@ -600,7 +625,7 @@ static int src_align1_region (FILE *file,
     return err;
 }
 
-static int src_da1 (FILE *file, unsigned type, unsigned _reg_file,
+static int src_da1 (struct disasm_buffer *file, unsigned type, unsigned _reg_file,
 		    unsigned _vert_stride, unsigned _width, unsigned _horiz_stride,
 		    unsigned reg_num, unsigned sub_reg_num, unsigned __abs, unsigned _negate)
 {
@@ -618,7 +643,7 @@ static int src_da1 (FILE *file, unsigned type, unsigned _reg_file,
     return err;
 }
 
-static int src_ia1 (FILE *file,
+static int src_ia1 (struct disasm_buffer *file,
 		    unsigned type,
 		    unsigned _reg_file,
 		    int _addr_imm,
@@ -645,7 +670,7 @@ static int src_ia1 (FILE *file,
     return err;
 }
 
-static int src_da16 (FILE *file,
+static int src_da16 (struct disasm_buffer *file,
 		     unsigned _reg_type,
 		     unsigned _reg_file,
 		     unsigned _vert_stride,
@@ -702,7 +727,7 @@ static int src_da16 (FILE *file,
     return err;
 }
 
-static int src0_3src (FILE *file, struct brw_instruction *inst)
+static int src0_3src (struct disasm_buffer *file, struct brw_instruction *inst)
 {
     int err = 0;
     unsigned swz_x = (inst->bits2.da3src.src0_swizzle >> 0) & 0x3;
@@ -750,7 +775,7 @@ static int src0_3src (FILE *file, struct brw_instruction *inst)
     return err;
 }
 
-static int src1_3src (FILE *file, struct brw_instruction *inst)
+static int src1_3src (struct disasm_buffer *file, struct brw_instruction *inst)
 {
     int err = 0;
     unsigned swz_x = (inst->bits2.da3src.src1_swizzle >> 0) & 0x3;
@@ -803,7 +828,7 @@ static int src1_3src (FILE *file, struct brw_instruction *inst)
 }
 
 
-static int src2_3src (FILE *file, struct brw_instruction *inst)
+static int src2_3src (struct disasm_buffer *file, struct brw_instruction *inst)
 {
     int err = 0;
     unsigned swz_x = (inst->bits3.da3src.src2_swizzle >> 0) & 0x3;
@@ -853,7 +878,7 @@ static int src2_3src (FILE *file, struct brw_instruction *inst)
     return err;
 }
 
-static int imm (FILE *file, unsigned type, struct brw_instruction *inst) {
+static int imm (struct disasm_buffer *file, unsigned type, struct brw_instruction *inst) {
     switch (type) {
     case BRW_REGISTER_TYPE_UD:
 	format (file, "0x%08xUD", inst->bits3.ud);
@@ -882,7 +907,7 @@ static int imm (FILE *file, unsigned type, struct brw_instruction *inst) {
     return 0;
 }
 
-static int src0 (FILE *file, struct brw_instruction *inst)
+static int src0 (struct disasm_buffer *file, struct brw_instruction *inst)
 {
     if (inst->bits1.da1.src0_reg_file == BRW_IMMEDIATE_VALUE)
 	return imm (file, inst->bits1.da1.src0_reg_type,
@@ -942,7 +967,7 @@ static int src0 (FILE *file, struct brw_instruction *inst)
     }
 }
 
-static int src1 (FILE *file, struct brw_instruction *inst)
+static int src1 (struct disasm_buffer *file, struct brw_instruction *inst)
 {
     if (inst->bits1.da1.src1_reg_file == BRW_IMMEDIATE_VALUE)
 	return imm (file, inst->bits1.da1.src1_reg_type,
@@ -1011,7 +1036,7 @@ int esize[6] = {
 	[5] = 32,
 };
 
-static int qtr_ctrl(FILE *file, struct brw_instruction *inst)
+static int qtr_ctrl(struct disasm_buffer *file, struct brw_instruction *inst)
 {
     int qtr_ctl = inst->header.compression_control;
     int exec_size = esize[inst->header.execution_size];
@@ -1040,7 +1065,7 @@ static int qtr_ctrl(FILE *file, struct brw_instruction *inst)
     return 0;
 }
 
-int brw_disasm (FILE *file, struct brw_instruction *inst, int gen)
+static int disasm (struct disasm_buffer *file, struct brw_instruction *inst, int gen)
 {
     int	err = 0;
     int space = 0;
@@ -1346,3 +1371,34 @@ int brw_disasm (FILE *file, struct brw_instruction *inst, int gen)
     newline (file);
     return err;
 }
+
+/**
+ * brw_disasm_to_mem:
+ * @buf: the buffer to print the instruction into
+ * @size: the size of @buf, truncating the output to fit
+ * @inst: the instruction to disassemble
+ * @gen: the generation of the instruction
+ *
+ * Returns: non-zero if the instruction had invalid fields.
+ */
+int brw_disasm_to_mem (char *buf, size_t size,
+		       struct brw_instruction *inst, int gen)
+{
+    struct disasm_buffer out = { .data = buf, .size = size };
+
+    if (!size)
+	return 0;
+
+    buf[0] = '\0';
+    return disasm (&out, inst, gen);
+}
+
+int brw_disasm (FILE *file, struct brw_instruction *inst, int gen)
+{
+    char    buf[1024];
+    int	    err;
+
+    err = brw_disasm_to_mem (buf, sizeof (buf), inst, gen);
+    fputs (buf, file);
+    return err;
+}
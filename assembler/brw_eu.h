@@ -410,6 +410,8 @@ void brw_uncompact_instruction(struct intel_context *intel,
 bool brw_try_compact_instruction(struct brw_compile *p,
                                  struct brw_compact_instruction *dst,
                                  struct brw_instruction *src);
+bool brw_can_compact_instruction(struct brw_compile *p,
+                                 struct brw_instruction *src);
 
 void brw_debug_compact_uncompact(struct intel_context *intel,
 				 struct brw_instruction *orig,
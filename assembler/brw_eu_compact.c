@@ -328,6 +328,64 @@ static const uint32_t *datatype_table;
 static const uint32_t *subreg_table;
 static const uint32_t *src_index_table;
 
+/* Every table is searched for each instruction we try to compact, so they
+ * are also indexed by value in small open addressed hash tables.
+ */
+#define COMPACTION_HASH_BITS 6
+#define COMPACTION_HASH_SIZE (1 << COMPACTION_HASH_BITS)
+
+struct compaction_hash {
+   uint32_t value[COMPACTION_HASH_SIZE];
+   int8_t index[COMPACTION_HASH_SIZE]; /* -1 if the slot is empty */
+};
+
+static struct compaction_hash control_index_hash;
+static struct compaction_hash datatype_hash;
+static struct compaction_hash subreg_hash;
+static struct compaction_hash src_index_hash;
+
+static unsigned
+compaction_hash_slot(uint32_t value)
+{
+   return (value * 0x9e3779b1u) >> (32 - COMPACTION_HASH_BITS);
+}
+
+static void
+init_compaction_hash(struct compaction_hash *hash, const uint32_t *table)
+{
+   memset(hash->index, -1, sizeof(hash->index));
+
+   for (int i = 0; i < 32; i++) {
+      unsigned slot = compaction_hash_slot(table[i]);
+
+      /* Keep the first of any duplicates, like a linear search would */
+      while (hash->index[slot] != -1 && hash->value[slot] != table[i])
+         slot = (slot + 1) & (COMPACTION_HASH_SIZE - 1);
+
+      if (hash->index[slot] == -1) {
+         hash->value[slot] = table[i];
+         hash->index[slot] = i;
+      }
+   }
+}
+
+static bool
+compaction_hash_lookup(const struct compaction_hash *hash, uint32_t value,
+                       uint32_t *index)
+{
+   unsigned slot = compaction_hash_slot(value);
+
+   while (hash->index[slot] != -1) {
+      if (hash->value[slot] == value) {
+         *index = hash->index[slot];
+         return true;
+      }
+      slot = (slot + 1) & (COMPACTION_HASH_SIZE - 1);
+   }
+
+   return false;
+}
+
 static bool
 set_control_index(struct intel_context *intel,
                   struct brw_compact_instruction *dst,
@@ -335,6 +393,7 @@ set_control_index(struct intel_context *intel,
 {
    uint32_t *src_u32 = (uint32_t *)src;
    uint32_t uncompacted = 0;
+   uint32_t compacted;
 
    uncompacted |= ((src_u32[0] >> 8) & 0xffff) << 0;
    uncompacted |= ((src_u32[0] >> 31) & 0x1) << 16;
@@ -344,67 +403,51 @@ set_control_index(struct intel_context *intel,
    if (intel->gen >= 7)
       uncompacted |= ((src_u32[2] >> 25) & 0x3) << 17;
 
-   for (int i = 0; i < 32; i++) {
-      if (control_index_table[i] == uncompacted) {
-	 dst->dw0.control_index = i;
-	 return true;
-      }
-   }
+   if (!compaction_hash_lookup(&control_index_hash, uncompacted, &compacted))
+      return false;
 
-   return false;
+   dst->dw0.control_index = compacted;
+   return true;
 }
 
 static bool
 set_datatype_index(struct brw_compact_instruction *dst,
                    struct brw_instruction *src)
 {
-   uint32_t uncompacted = 0;
+   uint32_t compacted, uncompacted = 0;
 
    uncompacted |= src->bits1.ud & 0x7fff;
    uncompacted |= (src->bits1.ud >> 29) << 15;
 
-   for (int i = 0; i < 32; i++) {
-      if (datatype_table[i] == uncompacted) {
-	 dst->dw0.data_type_index = i;
-	 return true;
-      }
-   }
+   if (!compaction_hash_lookup(&datatype_hash, uncompacted, &compacted))
+      return false;
 
-   return false;
+   dst->dw0.data_type_index = compacted;
+   return true;
 }
 
 static bool
 set_subreg_index(struct brw_compact_instruction *dst,
                  struct brw_instruction *src)
 {
-   uint32_t uncompacted = 0;
+   uint32_t compacted, uncompacted = 0;
 
    uncompacted |= src->bits1.da1.dest_subreg_nr << 0;
    uncompacted |= src->bits2.da1.src0_subreg_nr << 5;
    uncompacted |= src->bits3.da1.src1_subreg_nr << 10;
 
-   for (int i = 0; i < 32; i++) {
-      if (subreg_table[i] == uncompacted) {
-	 dst->dw0.sub_reg_index = i;
-	 return true;
-      }
-   }
+   if (!compaction_hash_lookup(&subreg_hash, uncompacted, &compacted))
+      return false;
 
-   return false;
+   dst->dw0.sub_reg_index = compacted;
+   return true;
 }
 
 static bool
 get_src_index(uint32_t uncompacted,
               uint32_t *compacted)
 {
-   for (int i = 0; i < 32; i++) {
-      if (src_index_table[i] == uncompacted) {
-	 *compacted = i;
-	 return true;
-      }
-   }
-
-   return false;
+   return compaction_hash_lookup(&src_index_hash, uncompacted, compacted);
 }
 
 static bool
@@ -660,8 +703,30 @@ brw_init_compaction_tables(struct intel_context *intel)
       src_index_table = gen6_src_index_table;
       break;
    default:
+      control_index_table = NULL;
       return;
    }
+
+   init_compaction_hash(&control_index_hash, control_index_table);
+   init_compaction_hash(&datatype_hash, datatype_table);
+   init_compaction_hash(&subreg_hash, subreg_table);
+   init_compaction_hash(&src_index_hash, src_index_table);
+}
+
+/**
+ * Returns whether brw_compact_instructions() would compact src, without
+ * modifying it, or false if there are no compaction tables for this gen.
+ */
+bool
+brw_can_compact_instruction(struct brw_compile *p,
+                            struct brw_instruction *src)
+{
+   struct brw_compact_instruction temp;
+
+   if (!control_index_table || src->header.cmpt_control)
+      return false;
+
+   return brw_try_compact_instruction(p, &temp, src);
 }
 
 void
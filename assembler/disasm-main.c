@@ -29,13 +29,14 @@
 #include "gen4asm.h"
 #include "brw_eu.h"
 #include "gen8_instruction.h"
+#include "ralloc.h"
 
 static const struct option longopts[] = {
 	{ NULL, 0, NULL, 0 }
 };
 
 static struct brw_program *
-read_program (FILE *input)
+read_program (void *mem, FILE *input)
 {
     uint32_t			    inst[4];
     struct brw_program		    *program;
@@ -43,7 +44,7 @@ read_program (FILE *input)
     int			c;
     int			n = 0;
 
-    program = malloc (sizeof (struct brw_program));
+    program = linear_alloc (mem, sizeof (struct brw_program));
     program->first = NULL;
     prev = &program->first;
     while ((c = getc (input)) != EOF) {
@@ -51,7 +52,7 @@ read_program (FILE *input)
 	    if (fscanf (input, "x%x", &inst[n]) == 1) {
 		++n;
 		if (n == 4) {
-		    entry = malloc (sizeof (struct brw_program_instruction));
+		    entry = linear_alloc (mem, sizeof (struct brw_program_instruction));
 		    memcpy (&entry->insn, inst, 4 * sizeof (uint32_t));
 		    entry->next = NULL;
 		    *prev = entry;
@@ -65,7 +66,7 @@ read_program (FILE *input)
 }
 
 static struct brw_program *
-read_program_binary (FILE *input)
+read_program_binary (void *mem, FILE *input)
 {
     uint32_t			    temp;
     uint8_t			    inst[16];
@@ -74,7 +75,7 @@ read_program_binary (FILE *input)
     int			c;
     int			n = 0;
 
-    program = malloc (sizeof (struct brw_program));
+    program = linear_alloc (mem, sizeof (struct brw_program));
     program->first = NULL;
     prev = &program->first;
     while ((c = getc (input)) != EOF) {
@@ -82,7 +83,7 @@ read_program_binary (FILE *input)
 	    if (fscanf (input, "x%2x", &temp) == 1) {
 		inst[n++] = (uint8_t)temp;
 		if (n == 16) {
-		    entry = malloc (sizeof (struct brw_program_instruction));
+		    entry = linear_alloc (mem, sizeof (struct brw_program_instruction));
 		    memcpy (&entry->insn, inst, 16 * sizeof (uint8_t));
 		    entry->next = NULL;
 		    *prev = entry;
@@ -114,6 +115,7 @@ int main(int argc, char **argv)
     int			o;
     int			gen = 4;
     struct brw_program_instruction  *inst;
+    void		*mem_ctx;
 
     while ((o = getopt_long(argc, argv, "o:bg:", longopts, NULL)) != -1) {
 	switch (o) {
@@ -153,10 +155,11 @@ int main(int argc, char **argv)
 	    exit(1);
 	}
     }
+    mem_ctx = ralloc_context (NULL);
     if (byte_array_input)
-	program = read_program_binary (input);
+	program = read_program_binary (linear_context (mem_ctx), input);
     else
-	program = read_program (input);
+	program = read_program (linear_context (mem_ctx), input);
     if (!program)
 	exit (1);
     if (output_file) {
@@ -173,5 +176,6 @@ int main(int argc, char **argv)
 	else
 	    brw_disasm (output, &inst->insn.gen, gen);
 
+    ralloc_free (mem_ctx);
     exit (0);
 }
@@ -50,6 +50,8 @@ extern char *input_filename;
 
 extern struct brw_context genasm_context;
 extern struct brw_compile genasm_compile;
+/* A linear allocator for the program, freed once it has been written */
+extern void *genasm_program_mem;
 
 /* Predicate for Gen X and above */
 #define IS_GENp(x) (gen_level >= (x)*10)
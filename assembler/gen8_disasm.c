@@ -47,6 +47,17 @@ static const char *const m_conditional_modifier[16] = {
    /* [a-f - Reserved]           */
 };
 
+/* The jump offsets printed by each flow control instruction */
+static const uint8_t m_jumps[128] = {
+   [BRW_OPCODE_ENDIF] = 1,
+   [BRW_OPCODE_IF] = 2,
+   [BRW_OPCODE_ELSE] = 2,
+   [BRW_OPCODE_WHILE] = 2,
+   [BRW_OPCODE_BREAK] = 2,
+   [BRW_OPCODE_CONTINUE] = 2,
+   [BRW_OPCODE_HALT] = 2,
+};
+
 static const char *const m_negate[2] = { "", "-" };
 
 static const char *const m_abs[2] = { "", "(abs)" };
@@ -261,52 +272,78 @@ static const char *const m_urb_opcode[16] = {
 
 static const char *const m_urb_interleave[2] = { "", "interleaved" };
 
-static int column;
+/* The output is truncated to fit, but always NUL terminated */
+static void
+append(struct disasm_buffer *buf, const char *str, size_t len)
+{
+   if (len > buf->size - buf->len - 1)
+      len = buf->size - buf->len - 1;
+   memcpy(buf->data + buf->len, str, len);
+   buf->len += len;
+   buf->data[buf->len] = '\0';
+}
 
 static int
-string(FILE *file, const char *string)
+string(struct disasm_buffer *file, const char *string)
 {
-   fputs(string, file);
-   column += strlen(string);
+   size_t len = strlen(string);
+
+   append(file, string, len);
+   file->column += len;
    return 0;
 }
 
 static int
-format(FILE *f, const char *format, ...)
+format(struct disasm_buffer *f, const char *format, ...)
 {
-   char buf[1024];
+   size_t avail = f->size - f->len;
    va_list args;
-   va_start(args, format);
+   int len;
 
-   vsnprintf(buf, sizeof(buf) - 1, format, args);
+   va_start(args, format);
+   len = vsnprintf(f->data + f->len, avail, format, args);
    va_end(args);
-   string(f, buf);
+
+   if (len < 0)
+      return 0;
+
+   f->column += len;
+   if ((size_t)len >= avail)
+      len = avail - 1;
+   f->len += len;
    return 0;
 }
 
 static int
-newline(FILE *f)
+newline(struct disasm_buffer *f)
 {
-   putc('\n', f);
-   column = 0;
+   append(f, "\n", 1);
+   f->column = 0;
    return 0;
 }
 
 static int
-pad(FILE *f, int c)
+pad(struct disasm_buffer *f, int c)
 {
-   do
-      string(f, " ");
-   while (column < c);
+   static const char spaces[] = "                                                                ";
+   int len = c > f->column ? c - f->column : 1;
+
+   while (len > 0) {
+      int n = len < (int)sizeof(spaces) - 1 ? len : (int)sizeof(spaces) - 1;
+
+      append(f, spaces, n);
+      f->column += n;
+      len -= n;
+   }
    return 0;
 }
 
 static int
-control(FILE *file, const char *name, const char *const ctrl[],
+control(struct disasm_buffer *file, const char *name, const char *const ctrl[],
         unsigned id, int *space)
 {
    if (!ctrl[id]) {
-      fprintf(file, "*** invalid %s value %d ", name, id);
+      format(file, "*** invalid %s value %d ", name, id);
       return 1;
    }
    if (ctrl[id][0])
@@ -321,7 +358,7 @@ control(FILE *file, const char *name, const char *const ctrl[],
 }
 
 static int
-print_opcode(FILE *file, int id)
+print_opcode(struct disasm_buffer *file, int id)
 {
    if (!m_opcode[id].name) {
       format(file, "*** invalid opcode value %d ", id);
@@ -332,7 +369,7 @@ print_opcode(FILE *file, int id)
 }
 
 static int
-reg(FILE *file, unsigned reg_file, unsigned _reg_nr)
+reg(struct disasm_buffer *file, unsigned reg_file, unsigned _reg_nr)
 {
    int err = 0;
 
@@ -381,7 +418,7 @@ reg(FILE *file, unsigned reg_file, unsigned _reg_nr)
 }
 
 static int
-dest(FILE *file, struct gen8_instruction *inst)
+dest(struct disasm_buffer *file, struct gen8_instruction *inst)
 {
    int err = 0;
 
@@ -418,7 +455,7 @@ dest(FILE *file, struct gen8_instruction *inst)
 
 #if 0
 static int
-dest_3src(FILE *file, gen8_instruction *inst)
+dest_3src(struct disasm_buffer *file, gen8_instruction *inst)
 {
    int      err = 0;
    uint32_t reg_file;
@@ -442,7 +479,7 @@ dest_3src(FILE *file, gen8_instruction *inst)
 #endif
 
 static int
-src_align1_region(FILE *file, unsigned vert_stride, unsigned _width,
+src_align1_region(struct disasm_buffer *file, unsigned vert_stride, unsigned _width,
                   unsigned horiz_stride)
 {
    int err = 0;
@@ -457,7 +494,7 @@ src_align1_region(FILE *file, unsigned vert_stride, unsigned _width,
 }
 
 static int
-src_da1(FILE *file, unsigned type, unsigned reg_file,
+src_da1(struct disasm_buffer *file, unsigned type, unsigned reg_file,
         unsigned vert_stride, unsigned _width, unsigned horiz_stride,
         unsigned reg_num, unsigned sub_reg_num, unsigned _abs, unsigned negate)
 {
@@ -476,7 +513,7 @@ src_da1(FILE *file, unsigned type, unsigned reg_file,
 }
 
 static int
-src_da16(FILE *file,
+src_da16(struct disasm_buffer *file,
          unsigned _reg_type,
          unsigned reg_file,
          unsigned vert_stride,
@@ -535,7 +572,7 @@ src_da16(FILE *file,
 
 #if 0
 static int
-src0_3src(FILE *file, gen8_instruction *inst)
+src0_3src(struct disasm_buffer *file, gen8_instruction *inst)
 {
    int err = 0;
    unsigned swz_x = (inst->bits2.da3src.src0_swizzle >> 0) & 0x3;
@@ -584,7 +621,7 @@ src0_3src(FILE *file, gen8_instruction *inst)
 }
 
 static int
-src1_3src(FILE *file, gen8_instruction *inst)
+src1_3src(struct disasm_buffer *file, gen8_instruction *inst)
 {
    int err = 0;
    unsigned swz_x = (inst->bits2.da3src.src1_swizzle >> 0) & 0x3;
@@ -638,7 +675,7 @@ src1_3src(FILE *file, gen8_instruction *inst)
 
 
 static int
-src2_3src(FILE *file, gen8_instruction *inst)
+src2_3src(struct disasm_buffer *file, gen8_instruction *inst)
 {
    int err = 0;
    unsigned swz_x = (inst->bits3.da3src.src2_swizzle >> 0) & 0x3;
@@ -690,7 +727,7 @@ src2_3src(FILE *file, gen8_instruction *inst)
 #endif
 
 static int
-imm(FILE *file, unsigned type, struct gen8_instruction *inst)
+imm(struct disasm_buffer *file, unsigned type, struct gen8_instruction *inst)
 {
    switch (type) {
    case BRW_REGISTER_TYPE_UD:
@@ -721,7 +758,7 @@ imm(FILE *file, unsigned type, struct gen8_instruction *inst)
 }
 
 static int
-src0(FILE *file, struct gen8_instruction *inst)
+src0(struct disasm_buffer *file, struct gen8_instruction *inst)
 {
    if (gen8_src0_reg_file(inst) == BRW_IMMEDIATE_VALUE)
       return imm(file, gen8_src0_reg_type(inst), inst);
@@ -759,7 +796,7 @@ src0(FILE *file, struct gen8_instruction *inst)
 }
 
 static int
-src1(FILE *file, struct gen8_instruction *inst)
+src1(struct disasm_buffer *file, struct gen8_instruction *inst)
 {
    if (gen8_src1_reg_file(inst) == BRW_IMMEDIATE_VALUE)
       return imm(file, gen8_src1_reg_type(inst), inst);
@@ -799,7 +836,7 @@ src1(FILE *file, struct gen8_instruction *inst)
 static int esize[6] = { 1, 2, 4, 8, 16, 32 };
 
 static int
-qtr_ctrl(FILE *file, struct gen8_instruction *inst)
+qtr_ctrl(struct disasm_buffer *file, struct gen8_instruction *inst)
 {
    int qtr_ctl = gen8_qtr_control(inst);
    int exec_size = esize[gen8_exec_size(inst)];
@@ -828,8 +865,8 @@ qtr_ctrl(FILE *file, struct gen8_instruction *inst)
    return 0;
 }
 
-int
-gen8_disassemble(FILE *file, struct gen8_instruction *insn, int gen)
+static int
+disassemble(struct disasm_buffer *file, struct gen8_instruction *insn, int gen)
 {
    int err = 0;
    int space = 0;
@@ -897,14 +934,9 @@ gen8_disassemble(FILE *file, struct gen8_instruction *insn, int gen)
       if (m_opcode[opcode].ndst > 0) {
          pad(file, 16);
          err |= dest(file, insn);
-      } else if (opcode == BRW_OPCODE_ENDIF) {
+      } else if (m_jumps[opcode] == 1) {
          format(file, " %d", gen8_jip(insn));
-      } else if (opcode == BRW_OPCODE_IF ||
-                 opcode == BRW_OPCODE_ELSE ||
-                 opcode == BRW_OPCODE_WHILE ||
-                 opcode == BRW_OPCODE_BREAK ||
-                 opcode == BRW_OPCODE_CONTINUE ||
-                 opcode == BRW_OPCODE_HALT) {
+      } else if (m_jumps[opcode] == 2) {
          format(file, " %d %d", gen8_jip(insn), gen8_uip(insn));
       }
 
@@ -986,3 +1018,36 @@ gen8_disassemble(FILE *file, struct gen8_instruction *insn, int gen)
    newline(file);
    return err;
 }
+
+/**
+ * gen8_disassemble_to_mem:
+ * @buf: the buffer to print the instruction into
+ * @size: the size of @buf, truncating the output to fit
+ * @insn: the instruction to disassemble
+ * @gen: the generation of the instruction
+ *
+ * Returns: non-zero if the instruction had invalid fields.
+ */
+int
+gen8_disassemble_to_mem(char *buf, size_t size,
+                        struct gen8_instruction *insn, int gen)
+{
+   struct disasm_buffer out = { .data = buf, .size = size };
+
+   if (!size)
+      return 0;
+
+   buf[0] = '\0';
+   return disassemble(&out, insn, gen);
+}
+
+int
+gen8_disassemble(FILE *file, struct gen8_instruction *insn, int gen)
+{
+   char buf[1024];
+   int err;
+
+   err = gen8_disassemble_to_mem(buf, sizeof(buf), insn, gen);
+   fputs(buf, file);
+   return err;
+}
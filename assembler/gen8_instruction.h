@@ -313,6 +313,8 @@ void gen8_set_dp_message(struct gen8_instruction *insn,
 
 /** Disassemble the instruction. */
 int gen8_disassemble(FILE *file, struct gen8_instruction *insn, int gen);
+int gen8_disassemble_to_mem(char *buf, size_t size,
+                            struct gen8_instruction *insn, int gen);
 
 
 /**
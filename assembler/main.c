@@ -32,6 +32,10 @@
 #include <getopt.h>
 #include <unistd.h>
 #include <assert.h>
+#include <errno.h>
+#include <libgen.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "ralloc.h"
 #include "gen4asm.h"
@@ -50,12 +54,14 @@ int errors;
 
 struct brw_context genasm_brw_context;
 struct brw_compile genasm_compile;
+void *genasm_program_mem;
 
 struct brw_program compiled_program;
 struct program_defaults program_defaults = {.register_type = BRW_REGISTER_TYPE_F};
 
 /* 0: default output style, 1: nice C-style output */
 static int binary_like_output = 0;
+static int compaction_stats = 0;
 static char *export_filename = NULL;
 static const char binary_prepend[] = "static const char gen_eu_bytes[] = {\n";
 
@@ -81,23 +87,32 @@ static struct label_item *label_table;
 static const struct option longopts[] = {
 	{"advanced", no_argument, 0, 'a'},
 	{"binary", no_argument, 0, 'b'},
+	{"compaction-stats", no_argument, 0, 'c'},
 	{"export", required_argument, 0, 'e'},
 	{"input_list", required_argument, 0, 'l'},
 	{"output", required_argument, 0, 'o'},
 	{"gen", required_argument, 0, 'g'},
+	{"jobs", required_argument, 0, 'j'},
 	{ NULL, 0, NULL, 0 }
 };
 
 static void usage(void)
 {
 	fprintf(stderr, "usage: intel-gen4asm [options] inputfile\n");
+	fprintf(stderr, "       intel-gen4asm [options] inputfile...\n");
 	fprintf(stderr, "OPTIONS:\n");
 	fprintf(stderr, "\t-a, --advanced                       Set advanced flag\n");
 	fprintf(stderr, "\t-b, --binary                         C style binary output\n");
+	fprintf(stderr, "\t-c, --compaction-stats               Report how much of the program could be compacted\n");
 	fprintf(stderr, "\t-e, --export {exportfile}            Export label file\n");
 	fprintf(stderr, "\t-l, --input_list {entrytablefile}    Input entry_table_list file\n");
 	fprintf(stderr, "\t-o, --output {outputfile}            Specify output file\n");
 	fprintf(stderr, "\t-g, --gen <4|5|6|7|8|9>              Specify GPU generation\n");
+	fprintf(stderr, "\t-j, --jobs {count}                   Assemble up to count files at once\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "With several input files, each foo.g4a is written to foo.out\n");
+	fprintf(stderr, "and exported to foo.inc in the directory given by -o, which\n");
+	fprintf(stderr, "defaults to the current one.\n");
 }
 
 static int hash(char *key)
@@ -275,86 +290,53 @@ print_instruction(FILE *output, struct brw_instruction *instruction)
 			((int *)instruction)[3]);
 	}
 }
-int main(int argc, char **argv)
+/*
+ * Report how many of the instructions could be encoded in the 8 byte compact
+ * form, and how much smaller the program would be.
+ */
+static void report_compaction(const char *name)
 {
-	char *output_file = NULL;
-	char *entry_table_file = NULL;
-	FILE *output = stdout;
-	FILE *export_file;
-	struct brw_program_instruction *entry, *entry1, *tmp_entry;
-	int err, inst_offset;
-	char o;
-	void *mem_ctx;
-
-	while ((o = getopt_long(argc, argv, "e:l:o:g:abW", longopts, NULL)) != -1) {
-		switch (o) {
-		case 'o':
-			if (strcmp(optarg, "-") != 0)
-				output_file = optarg;
-
-			break;
-
-		case 'g': {
-			char *dec_ptr, *end_ptr;
-			unsigned long decimal;
-
-			gen_level = strtol(optarg, &dec_ptr, 10) * 10;
-
-			if (*dec_ptr == '.') {
-				decimal = strtoul(++dec_ptr, &end_ptr, 10);
-				if (end_ptr != dec_ptr && *end_ptr == '\0') {
-					if (decimal > 10) {
-						fprintf(stderr, "Invalid Gen X decimal version\n");
-						exit(1);
-					}
-					gen_level += decimal;
-				}
-			}
+	struct brw_program_instruction *entry;
+	int count = 0, compactable = 0;
 
-			if (gen_level < 40 || gen_level > 90) {
-				usage();
-				exit(1);
-			}
-
-			break;
-		}
-
-		case 'a':
-			advanced_flag = 1;
-			break;
-		case 'b':
-			binary_like_output = 1;
-			break;
+	if (!IS_GENx(6) && !IS_GENx(7)) {
+		fprintf(stderr, "%s: no instruction compaction on gen%ld\n",
+			name, gen_level / 10);
+		return;
+	}
 
-		case 'e':
-			need_export = 1;
-			if (strcmp(optarg, "-") != 0)
-				export_filename = optarg;
-			break;
+	for (entry = compiled_program.first; entry; entry = entry->next) {
+		if (is_label(entry))
+			continue;
 
-		case 'l':
-			if (strcmp(optarg, "-") != 0)
-				entry_table_file = optarg;
-			break;
+		count++;
+		if (brw_can_compact_instruction(&genasm_compile,
+						&entry->insn.gen))
+			compactable++;
+	}
 
-		case 'W':
-			warning_flags |= WARN_ALL;
-			break;
+	fprintf(stderr, "%s: %d of %d instructions compactable, %d of %d bytes (%d%%) saved\n",
+		name, compactable, count, compactable * 8, count * 16,
+		count ? compactable * 50 / count : 0);
+}
 
-		default:
-			usage();
-			exit(1);
-		}
-	}
-	argc -= optind;
-	argv += optind;
-	if (argc != 1) {
-		usage();
-		exit(1);
-	}
+/*
+ * Assemble a single program, or the standard input if input is NULL.
+ *
+ * The parser, the label tables and the compile context are all global, so
+ * this can only be called once per process.
+ */
+static int assemble(char *input, const char *output_file,
+		    const char *export_file_name)
+{
+	FILE *output = stdout;
+	FILE *export_file;
+	struct brw_program_instruction *entry, *entry1, *tmp_entry;
+	int err, inst_offset;
+	void *mem_ctx;
 
-	if (strcmp(argv[0], "-") != 0) {
-		input_filename = argv[0];
+	if (input) {
+		input_filename = input;
 		yyin = fopen(input_filename, "r");
 		if (yyin == NULL) {
 			perror("Couldn't open input file");
@@ -364,11 +346,12 @@ int main(int argc, char **argv)
 
 	brw_init_context(&genasm_brw_context, gen_level);
 	mem_ctx = ralloc_context(NULL);
+	genasm_program_mem = linear_context(mem_ctx);
 	brw_init_compile(&genasm_brw_context, &genasm_compile, mem_ctx);
 
 	err = yyparse();
 
-	if (strcmp(argv[0], "-"))
+	if (input)
 		fclose(yyin);
 
 	yylex_destroy();
@@ -385,10 +368,6 @@ int main(int argc, char **argv)
 
 	}
 
-	if (read_entry_file(entry_table_file)) {
-		fprintf(stderr, "Read entry file error\n");
-		exit(1);
-	}
 	inst_offset = 0 ;
 	for (entry = compiled_program.first;
 		entry != NULL; entry = entry->next) {
@@ -397,7 +376,8 @@ int main(int argc, char **argv)
 	    if (entry1 && is_label(entry1) && is_entry_point(entry1)) {
 		// insert NOP instructions until (inst_offset+1) % 4 == 0
 		while (((inst_offset+1) % 4) != 0) {
-		    tmp_entry = calloc(sizeof(*tmp_entry), 1);
+		    tmp_entry = linear_zalloc(genasm_program_mem,
+					      sizeof(*tmp_entry));
 		    tmp_entry->insn.gen.header.opcode = BRW_OPCODE_NOP;
 		    entry->next = tmp_entry;
 		    tmp_entry->next = entry1;
@@ -414,10 +394,10 @@ int main(int argc, char **argv)
 		add_label(entry);
 
 	if (need_export) {
-		if (export_filename) {
-			export_file = fopen(export_filename, "w");
-		} else {
-			export_file = fopen("export.inc", "w");
+		export_file = fopen(export_file_name ?: "export.inc", "w");
+		if (export_file == NULL) {
+			perror("Couldn't open export file");
+			exit(1);
 		}
 		for (entry = compiled_program.first;
 			entry != NULL; entry = entry->next) {
@@ -447,25 +427,21 @@ int main(int argc, char **argv)
 	    }
 	}
 
+	if (compaction_stats)
+		report_compaction(input ?: "<stdin>");
+
 	if (binary_like_output)
 		fprintf(output, "%s", binary_prepend);
 
-	for (entry = compiled_program.first;
-		entry != NULL;
-		entry = entry1) {
-	    entry1 = entry->next;
+	for (entry = compiled_program.first; entry; entry = entry->next)
 	    if (!is_label(entry))
 		print_instruction(output, &entry->insn.gen);
-	    else
-		free(entry->insn.label.name);
-	    free(entry);
-	}
 	if (binary_like_output)
 		fprintf(output, "};");
 
-	free_entry_point_table(entry_point_table);
 	free_hash_table(declared_register_table);
 	free_label_table(label_table);
+	ralloc_free(mem_ctx);
 
 	fflush (output);
 	if (ferror (output)) {
@@ -476,3 +452,192 @@ int main(int argc, char **argv)
 	}
 	return err;
 }
+
+/*
+ * Build the name of the output for input in dir, with the extension of the
+ * input replaced by ext.
+ */
+static char *batch_filename(const char *dir, const char *input,
+			    const char *ext)
+{
+	char *copy = strdup(input);
+	char *base = basename(copy);
+	char *dot = strrchr(base, '.');
+	char *name;
+
+	if (dot && dot != base)
+		*dot = '\0';
+
+	if (asprintf(&name, "%s/%s%s", dir ?: ".", base, ext) < 0)
+		name = NULL;
+
+	free(copy);
+	return name;
+}
+
+/*
+ * Assemble every input in its own child, so that the global state of the
+ * parser is private to each, running up to jobs of them at a time.
+ */
+static int assemble_batch(char **inputs, int count, int jobs,
+			  const char *output_dir)
+{
+	int running = 0, failed = 0;
+	int i, status;
+	pid_t pid;
+
+	for (i = 0; i < count || running; ) {
+		if (i < count && running < jobs) {
+			pid = fork();
+			if (pid < 0) {
+				perror("fork");
+				failed++;
+				break;
+			}
+
+			if (pid == 0) {
+				char *output_file = batch_filename(output_dir, inputs[i], ".out");
+				char *export_file = batch_filename(output_dir, inputs[i], ".inc");
+
+				if (!output_file || !export_file)
+					exit(1);
+
+				exit(assemble(inputs[i], output_file, export_file));
+			}
+
+			running++;
+			i++;
+			continue;
+		}
+
+		pid = wait(&status);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("wait");
+			failed++;
+			break;
+		}
+
+		running--;
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed++;
+	}
+
+	while (running && wait(&status) > 0)
+		running--;
+
+	if (failed)
+		fprintf(stderr, "%d of %d files failed to assemble\n",
+			failed, count);
+
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	char *output_file = NULL;
+	char *entry_table_file = NULL;
+	int jobs = 0;
+	int err;
+	char o;
+
+	while ((o = getopt_long(argc, argv, "e:l:o:g:j:abcW", longopts, NULL)) != -1) {
+		switch (o) {
+		case 'o':
+			if (strcmp(optarg, "-") != 0)
+				output_file = optarg;
+
+			break;
+
+		case 'g': {
+			char *dec_ptr, *end_ptr;
+			unsigned long decimal;
+
+			gen_level = strtol(optarg, &dec_ptr, 10) * 10;
+
+			if (*dec_ptr == '.') {
+				decimal = strtoul(++dec_ptr, &end_ptr, 10);
+				if (end_ptr != dec_ptr && *end_ptr == '\0') {
+					if (decimal > 10) {
+						fprintf(stderr, "Invalid Gen X decimal version\n");
+						exit(1);
+					}
+					gen_level += decimal;
+				}
+			}
+
+			if (gen_level < 40 || gen_level > 90) {
+				usage();
+				exit(1);
+			}
+
+			break;
+		}
+
+		case 'a':
+			advanced_flag = 1;
+			break;
+		case 'b':
+			binary_like_output = 1;
+			break;
+
+		case 'c':
+			compaction_stats = 1;
+			break;
+
+		case 'e':
+			need_export = 1;
+			if (strcmp(optarg, "-") != 0)
+				export_filename = optarg;
+			break;
+
+		case 'l':
+			if (strcmp(optarg, "-") != 0)
+				entry_table_file = optarg;
+			break;
+
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs <= 0) {
+				usage();
+				exit(1);
+			}
+			break;
+
+		case 'W':
+			warning_flags |= WARN_ALL;
+			break;
+
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc < 1) {
+		usage();
+		exit(1);
+	}
+
+	if (read_entry_file(entry_table_file)) {
+		fprintf(stderr, "Read entry file error\n");
+		exit(1);
+	}
+
+	if (argc > 1) {
+		if (!jobs)
+			jobs = sysconf(_SC_NPROCESSORS_ONLN);
+		if (jobs <= 0)
+			jobs = 1;
+
+		err = assemble_batch(argv, argc, jobs, output_file);
+	} else {
+		err = assemble(strcmp(argv[0], "-") ? argv[0] : NULL,
+			       output_file, export_filename);
+	}
+
+	free_entry_point_table(entry_point_table);
+	return err;
+}
@@ -475,3 +475,87 @@ ralloc_vasprintf_rewrite_tail(char **str, size_t *start, const char *fmt,
    *start += new_length;
    return true;
 }
+
+/*
+ * Linear allocation
+ *
+ * The allocator only tracks the free space left in its current block; the
+ * blocks themselves are ralloc children of the allocator, so that freeing it
+ * frees them all.
+ */
+
+#define LINEAR_BLOCK_SIZE (64 * 1024)
+#define LINEAR_ALIGN 16
+
+struct linear_ctx
+{
+   char *next;
+   char *end;
+};
+
+void *
+linear_context(const void *ctx)
+{
+   return rzalloc_size(ctx, sizeof(struct linear_ctx));
+}
+
+void *
+linear_alloc(void *lin_ctx, size_t size)
+{
+   struct linear_ctx *lin = lin_ctx;
+   uintptr_t ptr;
+   char *block;
+
+   ptr = ((uintptr_t)lin->next + LINEAR_ALIGN - 1) & ~(uintptr_t)(LINEAR_ALIGN - 1);
+   if (likely(lin->next != NULL && ptr <= (uintptr_t)lin->end &&
+	      size <= (uintptr_t)lin->end - ptr)) {
+      lin->next = (char *)ptr + size;
+      return (void *)ptr;
+   }
+
+   /* Give the large allocations a block of their own, and keep using the
+    * current block for the smaller ones to come.
+    */
+   if (size > LINEAR_BLOCK_SIZE / 4) {
+      block = ralloc_size(lin, size + LINEAR_ALIGN);
+      if (unlikely(block == NULL))
+	 return NULL;
+
+      ptr = ((uintptr_t)block + LINEAR_ALIGN - 1) & ~(uintptr_t)(LINEAR_ALIGN - 1);
+      return (void *)ptr;
+   }
+
+   block = ralloc_size(lin, LINEAR_BLOCK_SIZE);
+   if (unlikely(block == NULL))
+      return NULL;
+
+   ptr = ((uintptr_t)block + LINEAR_ALIGN - 1) & ~(uintptr_t)(LINEAR_ALIGN - 1);
+   lin->next = (char *)ptr + size;
+   lin->end = block + LINEAR_BLOCK_SIZE;
+   return (void *)ptr;
+}
+
+void *
+linear_zalloc(void *lin, size_t size)
+{
+   void *ptr = linear_alloc(lin, size);
+   if (likely(ptr != NULL))
+      memset(ptr, 0, size);
+   return ptr;
+}
+
+char *
+linear_strdup(void *lin, const char *str)
+{
+   size_t n;
+   char *ptr;
+
+   if (unlikely(str == NULL))
+      return NULL;
+
+   n = strlen(str);
+   ptr = linear_alloc(lin, n + 1);
+   if (likely(ptr != NULL))
+      memcpy(ptr, str, n + 1);
+   return ptr;
+}
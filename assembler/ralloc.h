@@ -400,6 +400,37 @@ bool ralloc_asprintf_append (char **str, const char *fmt, ...)
 bool ralloc_vasprintf_append(char **str, const char *fmt, va_list args);
 /// @}
 
+/// \defgroup linear Linear Allocation Functions @{
+/**
+ * Create a linear allocator, owned by the ralloc context \p ctx.
+ *
+ * A linear allocator hands out memory from large blocks by bumping a
+ * pointer, without any per-allocation header.  Its allocations cannot be
+ * resized or freed individually: they are all freed at once when the
+ * allocator, or its ralloc context, is freed with \c ralloc_free.
+ *
+ * This suits the many small objects of a compile that live until its end.
+ */
+void *linear_context(const void *ctx);
+
+/**
+ * Allocate \p size bytes from the linear allocator \p lin.
+ *
+ * The memory is suitably aligned for any type, but not initialized.
+ */
+void *linear_alloc(void *lin, size_t size);
+
+/**
+ * Allocate zero-initialized memory from the linear allocator \p lin.
+ */
+void *linear_zalloc(void *lin, size_t size);
+
+/**
+ * Duplicate a string, allocating the memory from the linear allocator \p lin.
+ */
+char *linear_strdup(void *lin, const char *str);
+/// @}
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
@@ -0,0 +1,382 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures the rate and latency of amdgpu command submission, submitting
+ * small IBs of NOPs from 1, 2, 4, ... threads, each with its own context or
+ * all sharing one, spread over all the rings of the selected engines.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include <amdgpu.h>
+#include <amdgpu_drm.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define GFX_COMPUTE_NOP  0xffff1000
+#define SDMA_NOP  0x0
+
+#define SYNC 0x1
+#define SHARED 0x2
+
+#define MAX_RINGS 64
+
+static const struct engine {
+	const char *name;
+	unsigned int ip_type;
+	uint32_t nop;
+} engines[] = {
+	{ "gfx", AMDGPU_HW_IP_GFX, GFX_COMPUTE_NOP },
+	{ "compute", AMDGPU_HW_IP_COMPUTE, GFX_COMPUTE_NOP },
+	{ "sdma", AMDGPU_HW_IP_DMA, SDMA_NOP },
+	{ }
+};
+
+struct ring {
+	const struct engine *engine;
+	unsigned int ring;
+	amdgpu_bo_handle ib;
+	amdgpu_va_handle va;
+	uint64_t ib_address;
+	amdgpu_bo_list_handle bo_list;
+};
+
+struct thread {
+	pthread_t thread;
+	pthread_barrier_t *barrier;
+	amdgpu_device_handle device;
+	amdgpu_context_handle context;
+	const struct ring *ring;
+	unsigned int flags;
+	double duration;
+
+	unsigned long count;
+	double elapsed;
+	igt_stats_t latency;
+};
+
+static uint64_t gettime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int ring_init(amdgpu_device_handle device, const struct engine *e,
+		     unsigned int index, struct ring *r)
+{
+	struct amdgpu_bo_alloc_request request = {
+		.alloc_size = 4096,
+		.phys_alignment = 4096,
+		.preferred_heap = AMDGPU_GEM_DOMAIN_GTT,
+	};
+	uint32_t *ptr;
+	int err;
+
+	memset(r, 0, sizeof(*r));
+	r->engine = e;
+	r->ring = index;
+
+	err = amdgpu_bo_alloc(device, &request, &r->ib);
+	if (err)
+		return err;
+
+	err = amdgpu_va_range_alloc(device, amdgpu_gpu_va_range_general,
+				    4096, 4096, 0, &r->ib_address, &r->va, 0);
+	if (err)
+		goto err_free;
+
+	err = amdgpu_bo_va_op(r->ib, 0, 4096, r->ib_address, 0,
+			      AMDGPU_VA_OP_MAP);
+	if (err)
+		goto err_va;
+
+	err = amdgpu_bo_cpu_map(r->ib, (void **)&ptr);
+	if (err)
+		goto err_unmap;
+
+	for (int i = 0; i < 16; i++)
+		ptr[i] = e->nop;
+	amdgpu_bo_cpu_unmap(r->ib);
+
+	err = amdgpu_bo_list_create(device, 1, &r->ib, NULL, &r->bo_list);
+	if (err)
+		goto err_unmap;
+
+	return 0;
+
+err_unmap:
+	amdgpu_bo_va_op(r->ib, 0, 4096, r->ib_address, 0, AMDGPU_VA_OP_UNMAP);
+err_va:
+	amdgpu_va_range_free(r->va);
+err_free:
+	amdgpu_bo_free(r->ib);
+	return err;
+}
+
+static void ring_fini(struct ring *r)
+{
+	amdgpu_bo_list_destroy(r->bo_list);
+	amdgpu_bo_va_op(r->ib, 0, 4096, r->ib_address, 0, AMDGPU_VA_OP_UNMAP);
+	amdgpu_va_range_free(r->va);
+	amdgpu_bo_free(r->ib);
+}
+
+static void cs_sync(amdgpu_context_handle context, const struct ring *r,
+		    uint64_t seqno)
+{
+	struct amdgpu_cs_fence fence = {
+		.context = context,
+		.ip_type = r->engine->ip_type,
+		.ring = r->ring,
+		.fence = seqno,
+	};
+	uint32_t expired;
+
+	igt_assert_eq(amdgpu_cs_query_fence_status(&fence,
+						   AMDGPU_TIMEOUT_INFINITE,
+						   0, &expired), 0);
+}
+
+static void *submit_thread(void *arg)
+{
+	struct thread *t = arg;
+	struct amdgpu_cs_ib_info ib_info = {
+		.ib_mc_address = t->ring->ib_address,
+		.size = 16,
+	};
+	struct amdgpu_cs_request request = {
+		.ip_type = t->ring->engine->ip_type,
+		.ring = t->ring->ring,
+		.number_of_ibs = 1,
+		.ibs = &ib_info,
+		.resources = t->ring->bo_list,
+	};
+	uint64_t start, end, now;
+
+	pthread_barrier_wait(t->barrier);
+
+	start = now = gettime_ns();
+	end = start + t->duration * 1e9;
+	do {
+		uint64_t before = now;
+
+		igt_assert_eq(amdgpu_cs_submit(t->context, 0, &request, 1), 0);
+		if (t->flags & SYNC)
+			cs_sync(t->context, t->ring, request.seq_no);
+
+		now = gettime_ns();
+		igt_stats_push(&t->latency, now - before);
+		t->count++;
+	} while (now < end);
+
+	cs_sync(t->context, t->ring, request.seq_no);
+	t->elapsed = (gettime_ns() - start) * 1e-9;
+
+	return NULL;
+}
+
+static void run_one(amdgpu_device_handle device, amdgpu_context_handle shared,
+		    const struct ring *rings, unsigned int nring,
+		    unsigned int nthread, double duration, unsigned int flags)
+{
+	struct thread *threads = calloc(nthread, sizeof(*threads));
+	pthread_barrier_t barrier;
+	igt_stats_t latency;
+	double rate = 0;
+	char name[64];
+
+	igt_assert(threads);
+	pthread_barrier_init(&barrier, NULL, nthread);
+
+	for (unsigned int n = 0; n < nthread; n++) {
+		struct thread *t = &threads[n];
+
+		t->barrier = &barrier;
+		t->device = device;
+		t->ring = &rings[n % nring];
+		t->flags = flags;
+		t->duration = duration;
+		if (flags & SHARED)
+			t->context = shared;
+		else
+			igt_assert_eq(amdgpu_cs_ctx_create(device, &t->context), 0);
+		igt_stats_init(&t->latency);
+
+		pthread_create(&t->thread, NULL, submit_thread, t);
+	}
+
+	igt_stats_init(&latency);
+	for (unsigned int n = 0; n < nthread; n++) {
+		struct thread *t = &threads[n];
+
+		pthread_join(t->thread, NULL);
+		rate += t->count / t->elapsed;
+		igt_stats_push_array(&latency, t->latency.values_u64,
+				     t->latency.n_values);
+		igt_stats_fini(&t->latency);
+		if (!(flags & SHARED))
+			amdgpu_cs_ctx_free(t->context);
+	}
+
+	printf("%7u %12.0f %12.0f %10.2f %10.2f %10.2f\n",
+	       nthread, rate, rate / nthread,
+	       igt_stats_get_median(&latency) / 1000,
+	       igt_stats_get_percentile(&latency, 99) / 1000,
+	       igt_stats_get_max(&latency) / 1000.);
+
+	snprintf(name, sizeof(name), "threads-%u", nthread);
+	igt_bench_value(name, "submits/s", rate);
+	snprintf(name, sizeof(name), "threads-%u-latency", nthread);
+	igt_bench_result(name, "ns", &latency);
+
+	igt_stats_fini(&latency);
+	pthread_barrier_destroy(&barrier);
+	free(threads);
+}
+
+static int run(unsigned int mask, unsigned int max, double duration,
+	       unsigned int flags)
+{
+	struct ring rings[MAX_RINGS];
+	amdgpu_device_handle device;
+	amdgpu_context_handle shared;
+	unsigned int nring = 0;
+	uint32_t major, minor;
+	int fd;
+
+	fd = drm_open_driver(DRIVER_AMDGPU);
+	if (amdgpu_device_initialize(fd, &major, &minor, &device)) {
+		fprintf(stderr, "Unable to initialize the amdgpu device\n");
+		return 77;
+	}
+
+	for (const struct engine *e = engines; e->name; e++) {
+		struct drm_amdgpu_info_hw_ip info = {};
+
+		if (!(mask & (1 << (e - engines))))
+			continue;
+
+		if (amdgpu_query_hw_ip_info(device, e->ip_type, 0, &info))
+			continue;
+
+		for (unsigned int r = 0; r < 32 && nring < MAX_RINGS; r++) {
+			if (!(info.available_rings & (1u << r)))
+				continue;
+
+			if (ring_init(device, e, r, &rings[nring]) == 0)
+				nring++;
+		}
+	}
+	if (!nring) {
+		fprintf(stderr, "No rings available\n");
+		return 77;
+	}
+
+	igt_assert_eq(amdgpu_cs_ctx_create(device, &shared), 0);
+
+	printf("%u rings, %s, %s context%s\n", nring,
+	       flags & SYNC ? "sync" : "async",
+	       flags & SHARED ? "shared" : "per-thread",
+	       flags & SHARED ? "" : "s");
+	printf("%7s %12s %12s %10s %10s %10s\n", "threads",
+	       "submits/s", "per-thread", "median/us", "p99/us", "max/us");
+	for (unsigned int n = 1; n < max; n <<= 1)
+		run_one(device, shared, rings, nring, n, duration, flags);
+	run_one(device, shared, rings, nring, max, duration, flags);
+
+	amdgpu_cs_ctx_free(shared);
+	for (unsigned int n = 0; n < nring; n++)
+		ring_fini(&rings[n]);
+	amdgpu_device_deinitialize(device);
+	close(fd);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int mask = 0;
+	unsigned int max = 0;
+	unsigned int flags = 0;
+	double duration = 2;
+	int c;
+
+	while ((c = getopt (argc, argv, "e:t:d:sS")) != -1) {
+		switch (c) {
+		case 'e':
+			for (const struct engine *e = engines; e->name; e++)
+				if (!strcmp(optarg, e->name) ||
+				    !strcmp(optarg, "all"))
+					mask |= 1 << (e - engines);
+			break;
+
+		case 't':
+			max = atoi(optarg);
+			break;
+
+		case 'd':
+			duration = atof(optarg);
+			if (duration <= 0)
+				duration = 0.1;
+			break;
+
+		case 's':
+			flags |= SYNC;
+			break;
+
+		case 'S':
+			flags |= SHARED;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (!mask)
+		mask = 1 << 0;
+	if (!max)
+		max = sysconf(_SC_NPROCESSORS_ONLN);
+
+	igt_bench_begin("amd_cs_throughput");
+	igt_bench_param("engines", "0x%x", mask);
+	igt_bench_param("threads", "%u", max);
+	igt_bench_param("duration", "%.1f", duration);
+	igt_bench_param("sync", "%d", !!(flags & SYNC));
+	igt_bench_param("shared", "%d", !!(flags & SHARED));
+
+	c = run(mask, max, duration, flags);
+
+	igt_bench_end();
+
+	return c;
+}
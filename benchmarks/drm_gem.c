@@ -0,0 +1,280 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures the basic GEM operations through the driver-agnostic helpers of
+ * gem.h, so that the same numbers can be compared across drivers: the rate
+ * of creating and freeing buffers, of mapping, touching and unmapping them,
+ * of sharing them with another client through a dma-buf, and of submitting
+ * the smallest job the driver can run, waiting for each one or only for the
+ * last of a batch of them.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include "gem.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE 4096
+#define QUEUED 64
+
+#define TEST_CREATE 0x1
+#define TEST_MMAP 0x2
+#define TEST_PRIME 0x4
+#define TEST_NOP 0x8
+
+static const unsigned int sizes[] = {
+	4 << 10, 64 << 10, 1 << 20, 8 << 20, 0
+};
+
+static struct gem_driver *gem;
+
+static uint64_t gettime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t create_bo(int fd, unsigned int size)
+{
+	uint32_t handle;
+
+	igt_assert_eq(gem->create(&handle, fd, size), 0);
+
+	return handle;
+}
+
+static void report(const char *test, unsigned int size,
+		   unsigned long count, uint64_t elapsed)
+{
+	char name[32];
+
+	printf("%-8s %6uKiB %12.0f ops/s\n",
+	       test, size >> 10, count * 1e9 / elapsed);
+	snprintf(name, sizeof(name), "%s-%uKiB", test, size >> 10);
+	igt_bench_value(name, "ops/s", count * 1e9 / elapsed);
+}
+
+static void create(int fd, unsigned int size, double duration)
+{
+	uint64_t start, end, now;
+	unsigned long count = 0;
+
+	start = now = gettime_ns();
+	end = start + duration * 1e9;
+	do {
+		gem_release_handle(fd, create_bo(fd, size));
+		count++;
+		now = gettime_ns();
+	} while (now < end);
+
+	report("create", size, count, now - start);
+}
+
+static void map(int fd, unsigned int size, double duration)
+{
+	uint32_t handle = create_bo(fd, size);
+	uint64_t start, end, now;
+	unsigned long count = 0;
+
+	start = now = gettime_ns();
+	end = start + duration * 1e9;
+	do {
+		volatile uint8_t *ptr;
+
+		igt_assert_eq(gem->mmap((void **)&ptr, fd, handle, size), 0);
+		for (unsigned int offset = 0; offset < size; offset += PAGE)
+			ptr[offset] = offset;
+		igt_assert_eq(gem->munmap(fd, handle, (void *)ptr, size), 0);
+
+		count++;
+		now = gettime_ns();
+	} while (now < end);
+
+	report("mmap", size, count, now - start);
+	gem_release_handle(fd, handle);
+}
+
+static void prime(int fd, unsigned int size, double duration)
+{
+	uint32_t handle = create_bo(fd, size);
+	int importer = drm_reopen_driver(fd);
+	uint64_t start, end, now;
+	unsigned long count = 0;
+
+	start = now = gettime_ns();
+	end = start + duration * 1e9;
+	do {
+		int dmabuf = prime_handle_to_fd(fd, handle);
+
+		gem_release_handle(importer,
+				   prime_fd_to_handle(importer, dmabuf));
+		close(dmabuf);
+
+		count++;
+		now = gettime_ns();
+	} while (now < end);
+
+	report("prime", size, count, now - start);
+	close(importer);
+	gem_release_handle(fd, handle);
+}
+
+static void nop(int fd, bool queued, double duration)
+{
+	uint32_t handle = create_bo(fd, PAGE);
+	uint64_t start, end, now;
+	unsigned long count = 0;
+	void *n;
+
+	igt_assert_eq(gem->nop_init(&n, fd), 0);
+
+	start = now = gettime_ns();
+	end = start + duration * 1e9;
+	do {
+		for (int i = 0; i < (queued ? QUEUED : 1); i++)
+			igt_assert_eq(gem->nop_submit(fd, n, handle), 0);
+		igt_assert_eq(gem->wait(fd, handle, NSEC_PER_SEC), 0);
+
+		count += queued ? QUEUED : 1;
+		now = gettime_ns();
+	} while (now < end);
+
+	report(queued ? "nop-queued" : "nop-sync", PAGE, count, now - start);
+	gem->nop_fini(fd, n);
+	gem_release_handle(fd, handle);
+}
+
+static int run(int fd, unsigned int tests, unsigned int size, double duration)
+{
+	gem = gem_get_driver(fd);
+	if (!gem || !gem->create) {
+		fprintf(stderr, "no gem operations for this driver\n");
+		return 77;
+	}
+
+	printf("%s\n", gem->name);
+
+	for (const unsigned int *s = sizes; *s; s++) {
+		unsigned int sz = size ?: *s;
+
+		if (tests & TEST_CREATE)
+			create(fd, sz, duration);
+		if (tests & TEST_MMAP)
+			map(fd, sz, duration);
+		if (tests & TEST_PRIME)
+			prime(fd, sz, duration);
+
+		if (size)
+			break;
+	}
+
+	if (tests & TEST_NOP) {
+		void *n;
+
+		/* Not every driver can submit a job without more setup */
+		if (gem->nop_init && !gem->nop_init(&n, fd)) {
+			gem->nop_fini(fd, n);
+			nop(fd, false, duration);
+			nop(fd, true, duration);
+		} else {
+			printf("no nop submission for %s\n", gem->name);
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int tests = 0;
+	unsigned int size = 0;
+	double duration = 1;
+	bool vgem = false;
+	int fd, c;
+
+	while ((c = getopt (argc, argv, "cmpns:d:v")) != -1) {
+		switch (c) {
+		case 'c':
+			tests |= TEST_CREATE;
+			break;
+
+		case 'm':
+			tests |= TEST_MMAP;
+			break;
+
+		case 'p':
+			tests |= TEST_PRIME;
+			break;
+
+		case 'n':
+			tests |= TEST_NOP;
+			break;
+
+		case 's':
+			/* In KiB, rounded to whole pages */
+			size = ALIGN(atoi(optarg) << 10, PAGE);
+			if (size < PAGE)
+				size = PAGE;
+			break;
+
+		case 'd':
+			duration = atof(optarg);
+			if (duration < 0.1)
+				duration = 0.1;
+			break;
+
+		case 'v':
+			vgem = true;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (!tests)
+		tests = TEST_CREATE | TEST_MMAP | TEST_PRIME | TEST_NOP;
+
+	fd = vgem ? drm_open_driver(DRIVER_VGEM) : drm_open_driver(DRIVER_ANY);
+
+	igt_bench_begin("drm_gem");
+	igt_bench_param("tests", "0x%x", tests);
+	igt_bench_param("size", "%u", size);
+	igt_bench_param("duration", "%.1f", duration);
+
+	c = run(fd, tests, size, duration);
+
+	igt_bench_end();
+	close(fd);
+
+	return c;
+}
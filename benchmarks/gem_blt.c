@@ -26,6 +26,8 @@
  */
 
 #include "igt.h"
+#include "igt_bench.h"
+#include "igt_freq.h"
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -189,6 +191,7 @@ static int run(int object, int batch, int time, int reps, int ncpus, unsigned fl
 	uint32_t *buf, handle, src, dst;
 	int fd, len, gen, size, nreloc;
 	int ring, count;
+	igt_stats_t stats;
 	double *shared;
 
 	shared = mmap(0, 4096, PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
@@ -197,6 +200,7 @@ static int run(int object, int batch, int time, int reps, int ncpus, unsigned fl
 	reloc = malloc(sizeof(*reloc)*size/32*2);
 
 	fd = drm_open_driver(DRIVER_INTEL);
+	igt_freq_bench_setup(fd);
 	handle = gem_create(fd, size);
 	buf = gem_mmap__cpu(fd, handle, 0, size, PROT_WRITE);
 
@@ -280,6 +284,7 @@ static int run(int object, int batch, int time, int reps, int ncpus, unsigned fl
 		execbuf.batch_len = 0;
 	}
 
+	igt_stats_init_with_size(&stats, reps);
 	while (reps--) {
 		memset(shared, 0, 4096);
 
@@ -308,8 +313,12 @@ static int run(int object, int batch, int time, int reps, int ncpus, unsigned fl
 		for (int child = 0; child < ncpus; child++)
 			shared[ncpus] += shared[child];
 		printf("%7.3f\n", shared[ncpus] / ncpus);
+		igt_stats_push_float(&stats, shared[ncpus] / ncpus);
 	}
 
+	igt_bench_result("throughput", "MiB/s", &stats);
+	igt_stats_fini(&stats);
+
 	close(fd);
 	return 0;
 }
@@ -368,5 +377,18 @@ int main(int argc, char **argv)
 		}
 	}
 
-	return run(size, batch, time, reps, ncpus, flags);
+	igt_bench_begin("gem_blt");
+	igt_bench_param("size", "%d", size);
+	igt_bench_param("batch", "%d", batch);
+	igt_bench_param("time", "%d", time);
+	igt_bench_param("reps", "%d", reps);
+	igt_bench_param("clients", "%d", ncpus);
+	igt_bench_param("sync", "%d", !!(flags & SYNC));
+	igt_bench_param("nocmd", "%d", !!(flags & NOCMD));
+
+	c = run(size, batch, time, reps, ncpus, flags);
+
+	igt_bench_end();
+
+	return c;
 }
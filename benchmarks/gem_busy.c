@@ -36,6 +36,7 @@
 #include <sys/stat.h>
 #include <sys/poll.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -45,6 +46,8 @@
 #include "intel_chipset.h"
 #include "intel_reg.h"
 #include "igt_stats.h"
+#include "igt_dummyload.h"
+#include "igt_syncobj.h"
 #include "i915/gem_mman.h"
 
 #define LOCAL_I915_EXEC_NO_RELOC (1<<11)
@@ -120,48 +123,6 @@ static int sync_merge(int fd1, int fd2)
 	return data.fence;
 }
 
-static uint32_t __syncobj_create(int fd)
-{
-	struct local_syncobj_create {
-		uint32_t handle, flags;
-	} arg;
-#define LOCAL_IOCTL_SYNCOBJ_CREATE        DRM_IOWR(0xBF, struct local_syncobj_create)
-
-	memset(&arg, 0, sizeof(arg));
-	ioctl(fd, LOCAL_IOCTL_SYNCOBJ_CREATE, &arg);
-
-	return arg.handle;
-}
-
-static uint32_t syncobj_create(int fd)
-{
-	uint32_t ret;
-
-	igt_assert_neq((ret = __syncobj_create(fd)), 0);
-
-	return ret;
-}
-
-#define LOCAL_SYNCOBJ_WAIT_FLAGS_WAIT_ALL (1 << 0)
-#define LOCAL_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT (1 << 1)
-struct local_syncobj_wait {
-       __u64 handles;
-       /* absolute timeout */
-       __s64 timeout_nsec;
-       __u32 count_handles;
-       __u32 flags;
-       __u32 first_signaled; /* only valid when not waiting all */
-       __u32 pad;
-};
-#define LOCAL_IOCTL_SYNCOBJ_WAIT	DRM_IOWR(0xC3, struct local_syncobj_wait)
-static int __syncobj_wait(int fd, struct local_syncobj_wait *args)
-{
-	int err = 0;
-	if (drmIoctl(fd, LOCAL_IOCTL_SYNCOBJ_WAIT, args))
-		err = -errno;
-	return err;
-}
-
 static int loop(unsigned ring, int reps, int ncpus, unsigned flags)
 {
 	struct drm_i915_gem_execbuffer2 execbuf;
@@ -205,7 +166,7 @@ static int loop(unsigned ring, int reps, int ncpus, unsigned flags)
 	}
 
 	if (flags & SYNCOBJ) {
-		syncobj.handle = syncobj_create(fd);
+		syncobj.handle = syncobj_create(fd, 0);
 		syncobj.flags = LOCAL_EXEC_FENCE_SIGNAL;
 
 		execbuf.cliprects_ptr = to_user_pointer(&syncobj);
@@ -338,15 +299,219 @@ static int loop(unsigned ring, int reps, int ncpus, unsigned flags)
 	return 0;
 }
 
+enum method {
+	BUSY,
+	GEM_WAIT,
+	SYNCOBJ_EACH,
+	SYNCOBJ_ARRAY,
+	SYNC_FILE_EACH,
+	SYNC_FILE_ARRAY,
+	NUM_METHODS
+};
+
+static const char * const method_names[] = {
+	[BUSY] = "busy",
+	[GEM_WAIT] = "wait",
+	[SYNCOBJ_EACH] = "syncobj",
+	[SYNCOBJ_ARRAY] = "syncobj-array",
+	[SYNC_FILE_EACH] = "sync-file",
+	[SYNC_FILE_ARRAY] = "sync-file-array",
+};
+
+struct many {
+	int fd;
+	int count;
+	uint32_t *handle;
+	uint32_t *syncobj;
+	struct pollfd *pfd;
+};
+
+static void check_once(const struct many *m, enum method method)
+{
+	switch (method) {
+	case BUSY:
+		for (int n = 0; n < m->count; n++)
+			gem_busy(m->fd, m->handle[n]);
+		break;
+
+	case GEM_WAIT:
+		for (int n = 0; n < m->count; n++)
+			gem_wait__busy(m->fd, m->handle[n]);
+		break;
+
+	case SYNCOBJ_EACH:
+		for (int n = 0; n < m->count; n++) {
+			struct local_syncobj_wait arg = {
+				.handles = to_user_pointer(&m->syncobj[n]),
+				.count_handles = 1,
+			};
+
+			__syncobj_wait(m->fd, &arg);
+		}
+		break;
+
+	case SYNCOBJ_ARRAY: {
+		struct local_syncobj_wait arg = {
+			.handles = to_user_pointer(m->syncobj),
+			.count_handles = m->count,
+			.flags = LOCAL_SYNCOBJ_WAIT_FLAGS_WAIT_ALL,
+		};
+
+		__syncobj_wait(m->fd, &arg);
+		break;
+	}
+
+	case SYNC_FILE_EACH:
+		for (int n = 0; n < m->count; n++)
+			poll(&m->pfd[n], 1, 0);
+		break;
+
+	case SYNC_FILE_ARRAY:
+		poll(m->pfd, m->count, 0);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static bool allow_files(unsigned int min)
+{
+	struct rlimit rlim;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim))
+		return false;
+
+	if (rlim.rlim_cur >= min)
+		return true;
+
+	if (rlim.rlim_max < min)
+		rlim.rlim_max = min;
+	rlim.rlim_cur = min;
+	return setrlimit(RLIMIT_NOFILE, &rlim) == 0;
+}
+
+/*
+ * Keeps count objects in flight, each with its own request queued behind a
+ * spinner, and measures the cost per object of finding out they are still
+ * busy with each of the ways of tracking their completion: the busy and
+ * wait ioctls on the objects, waits on the syncobjs their requests signal,
+ * one at a time or all at once, and polls of their sync_files, one at a
+ * time or all at once.
+ */
+static int many(unsigned ring, int count, int reps)
+{
+	struct drm_i915_gem_exec_object2 obj[2];
+	struct drm_i915_gem_execbuffer2 execbuf;
+	struct local_gem_exec_fence fence;
+	uint32_t bbe = MI_BATCH_BUFFER_END;
+	struct many m = { .count = count };
+	igt_spin_t *spin;
+
+	if (!allow_files(count + 64)) {
+		fprintf(stderr, "Unable to relax fd limit for %d fences\n",
+			count);
+		return 77;
+	}
+
+	m.fd = drm_open_driver(DRIVER_INTEL);
+	m.handle = calloc(count, sizeof(*m.handle));
+	m.syncobj = calloc(count, sizeof(*m.syncobj));
+	m.pfd = calloc(count, sizeof(*m.pfd));
+	igt_assert(m.handle && m.syncobj && m.pfd);
+
+	memset(obj, 0, sizeof(obj));
+	obj[1].handle = gem_create(m.fd, 4096);
+	gem_write(m.fd, obj[1].handle, 0, &bbe, sizeof(bbe));
+
+	memset(&execbuf, 0, sizeof(execbuf));
+	execbuf.buffers_ptr = to_user_pointer(obj);
+	execbuf.buffer_count = 2;
+	execbuf.flags = ring | LOCAL_I915_EXEC_FENCE_ARRAY | 1 << 17;
+	execbuf.cliprects_ptr = to_user_pointer(&fence);
+	execbuf.num_cliprects = 1;
+
+	/* Probe for syncobjs and output fences before queuing them all */
+	m.syncobj[0] = syncobj_create(m.fd, 0);
+	fence.handle = m.syncobj[0];
+	fence.flags = LOCAL_EXEC_FENCE_SIGNAL;
+	obj[0].handle = obj[1].handle;
+	execbuf.buffer_count = 1;
+	if (__gem_execbuf_wr(m.fd, &execbuf)) {
+		fprintf(stderr, "No syncobj or output fence support\n");
+		return 77;
+	}
+	close(execbuf.rsvd2 >> 32);
+	execbuf.buffer_count = 2;
+
+	for (int n = 0; n < count; n++) {
+		m.handle[n] = gem_create(m.fd, 4096);
+		if (n)
+			m.syncobj[n] = syncobj_create(m.fd, 0);
+	}
+
+	printf("%d objects\n", count);
+	while (reps--) {
+		/* Rearmed each round, not to be mistaken for a hang */
+		spin = igt_spin_new(m.fd, .engine = ring);
+
+		for (int n = 0; n < count; n++) {
+			obj[0].handle = m.handle[n];
+			obj[0].flags = EXEC_OBJECT_WRITE;
+			fence.handle = m.syncobj[n];
+			gem_execbuf_wr(m.fd, &execbuf);
+
+			m.pfd[n].fd = execbuf.rsvd2 >> 32;
+			m.pfd[n].events = POLLIN;
+		}
+
+		for (enum method method = 0; method < NUM_METHODS; method++) {
+			struct timespec start, end;
+			unsigned long loops = 0;
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			do {
+				check_once(&m, method);
+				loops++;
+				clock_gettime(CLOCK_MONOTONIC, &end);
+			} while (elapsed(&start, &end) < 5e8);
+
+			printf("%-16s %10.1f ns/object\n", method_names[method],
+			       elapsed(&start, &end) / loops / count);
+		}
+
+		/* Everything must still have been in flight */
+		igt_assert(gem_bo_busy(m.fd, m.handle[count - 1]));
+
+		igt_spin_free(m.fd, spin);
+		gem_sync(m.fd, m.handle[count - 1]);
+		for (int n = 0; n < count; n++)
+			close(m.pfd[n].fd);
+	}
+
+	for (int n = 0; n < count; n++) {
+		syncobj_destroy(m.fd, m.syncobj[n]);
+		gem_close(m.fd, m.handle[n]);
+	}
+	gem_close(m.fd, obj[1].handle);
+	free(m.pfd);
+	free(m.syncobj);
+	free(m.handle);
+	close(m.fd);
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	unsigned ring = I915_EXEC_RENDER;
 	unsigned flags = 0;
 	int reps = 1;
 	int ncpus = 1;
+	int count = 0;
 	int c;
 
-	while ((c = getopt (argc, argv, "e:r:dfsSwWI")) != -1) {
+	while ((c = getopt (argc, argv, "e:r:dfsSwWIn:")) != -1) {
 		switch (c) {
 		case 'e':
 			if (strcmp(optarg, "rcs") == 0)
@@ -396,10 +561,22 @@ int main(int argc, char **argv)
 		case 'I':
 			flags |= IDLE;
 			break;
+
+		case 'n':
+			count = atoi(optarg);
+			if (count < 1)
+				count = 1;
+			break;
 		default:
 			break;
 		}
 	}
 
+	if (count) {
+		if (ring == -1)
+			ring = I915_EXEC_RENDER;
+		return many(ring, count, reps);
+	}
+
 	return loop(ring, reps, ncpus, flags);
 }
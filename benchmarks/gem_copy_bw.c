@@ -0,0 +1,381 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures the bandwidth of moving a buffer with each of the engines, the
+ * blitter fast copy, the render copy and the gpgpu fill, across buffer sizes,
+ * tiling and caching modes. The gpgpu fill has no source and only counts the
+ * bytes it writes. Where the GPU energy counter is available the energy
+ * spent per GB moved is reported alongside.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include "igt_freq.h"
+#include <unistd.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* 1024 32bpp pixels */
+#define STRIDE 4096
+#define MIN_SIZE (128 << 10)
+#define MAX_SIZE (64 << 20)
+
+enum engine {
+	BLT,
+	RENDER,
+	COMPUTE,
+	NUM_ENGINES
+};
+
+static const char * const engine_names[] = {
+	[BLT] = "blt",
+	[RENDER] = "render",
+	[COMPUTE] = "compute",
+};
+
+static const struct tiling {
+	const char *name;
+	uint32_t tiling;
+} tilings[] = {
+	{ "linear", I915_TILING_NONE },
+	{ "x", I915_TILING_X },
+	{ "y", I915_TILING_Y },
+	{ "yf", I915_TILING_Yf },
+	{ }
+};
+
+static const struct caching {
+	const char *name;
+	uint32_t caching;
+} cachings[] = {
+	{ "uncached", I915_CACHING_NONE },
+	{ "cached", I915_CACHING_CACHED },
+	{ }
+};
+
+struct copy {
+	int fd;
+	uint32_t devid;
+	drm_intel_bufmgr *bufmgr;
+	struct intel_batchbuffer *batch;
+	struct intel_bb *ibb;
+	igt_render_copyfunc_t render;
+	igt_threaded_fillfunc_t fill;
+	unsigned int threads;
+	struct igt_buf src, dst;
+};
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static bool supported(struct copy *c, enum engine e, uint32_t tiling)
+{
+	switch (e) {
+	case BLT:
+		/* XY_FAST_COPY_BLT */
+		return intel_gen(c->devid) >= 9;
+	case RENDER:
+		if (!c->render)
+			return false;
+		return tiling != I915_TILING_Yf || intel_gen(c->devid) >= 9;
+	case COMPUTE:
+		return c->fill && tiling != I915_TILING_Yf;
+	default:
+		return false;
+	}
+}
+
+static void buf_init(struct copy *c, struct igt_buf *buf, unsigned int size,
+		     uint32_t tiling, uint32_t caching, unsigned int bpp)
+{
+	memset(buf, 0, sizeof(*buf));
+
+	buf->bo = drm_intel_bo_alloc(c->bufmgr, "", size, 4096);
+	igt_assert(buf->bo);
+	gem_set_caching(c->fd, buf->bo->handle, caching);
+	buf->stride = STRIDE;
+	buf->tiling = tiling;
+	buf->size = size;
+	buf->bpp = bpp;
+}
+
+static void buf_fini(struct igt_buf *buf)
+{
+	drm_intel_bo_unreference(buf->bo);
+	buf->bo = NULL;
+}
+
+static void copy_once(struct copy *c, enum engine e, unsigned int height)
+{
+	switch (e) {
+	case BLT:
+		igt_blitter_fast_copy__bb(c->ibb,
+					  c->src.bo->handle, 0, STRIDE,
+					  c->src.tiling, 0, 0,
+					  STRIDE / 4, height, 32,
+					  c->dst.bo->handle, 0, STRIDE,
+					  c->dst.tiling, 0, 0);
+		break;
+	case RENDER:
+		c->render(c->batch, NULL,
+			  &c->src, 0, 0, STRIDE / 4, height,
+			  &c->dst, 0, 0);
+		break;
+	case COMPUTE:
+		c->fill(c->batch, &c->dst, 0, 0, STRIDE, height, 0,
+			c->threads);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Without a CI target measure a fixed number of rounds, otherwise until
+ * the mean is stable to within the target, with reps as the upper bound.
+ */
+static bool more_rounds(igt_stats_t *stats, double target, int reps,
+			struct igt_bench_stability *s)
+{
+	if (target <= 0)
+		return stats->n_values < reps;
+
+	if (!stats->n_values)
+		*s = (struct igt_bench_stability) {
+			.target = target,
+			.min_rounds = 3,
+			.max_rounds = reps,
+		};
+
+	return !stats->n_values || igt_bench_unstable(stats, s);
+}
+
+static void run_one(struct copy *c, enum engine e,
+		    const struct tiling *t, const struct caching *m,
+		    unsigned int size, double target, int reps, int loops)
+{
+	unsigned int height = size / STRIDE;
+	struct igt_bench_stability stable;
+	double mean, half_width;
+	igt_stats_t stats, energy;
+	char name[64];
+
+	/* One byte per pixel for the fill, 32bpp for the copies */
+	if (e != COMPUTE)
+		buf_init(c, &c->src, size, t->tiling, m->caching, 32);
+	buf_init(c, &c->dst, size, t->tiling, m->caching,
+		 e == COMPUTE ? 8 : 32);
+
+	/* Warm up, binding the buffers */
+	copy_once(c, e, height);
+	gem_sync(c->fd, c->dst.bo->handle);
+
+	igt_stats_init_with_size(&stats, reps);
+	igt_stats_init_with_size(&energy, reps);
+	while (more_rounds(&stats, target, reps, &stable)) {
+		struct igt_bench_energy round;
+		struct timespec start, end;
+		double J;
+
+		igt_bench_energy_start(&round);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int n = 0; n < loops; n++)
+			copy_once(c, e, height);
+		gem_sync(c->fd, c->dst.bo->handle);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		igt_stats_push_float(&stats,
+				     1e-9 * loops * size /
+				     elapsed(&start, &end));
+		J = igt_bench_energy_stop(&round);
+		if (!isnan(J))
+			igt_stats_push_float(&energy,
+					     J / (1e-9 * loops * size));
+	}
+
+	mean = igt_bench_ci(&stats, &half_width);
+	printf("%-8s %-7s %-9s %6uKiB %8.3f GB/s +- %.3f",
+	       engine_names[e], t->name, m->name, size >> 10,
+	       mean, half_width);
+	if (energy.n_values)
+		printf(" %8.3f J/GB", igt_stats_get_median(&energy));
+	putchar('\n');
+
+	snprintf(name, sizeof(name), "%s-%s-%s-%uKiB",
+		 engine_names[e], t->name, m->name, size >> 10);
+	igt_bench_result(name, "GB/s", &stats);
+	igt_stats_fini(&stats);
+
+	if (energy.n_values) {
+		strncat(name, "-energy", sizeof(name) - strlen(name) - 1);
+		igt_bench_result(name, "J/GB", &energy);
+	}
+	igt_stats_fini(&energy);
+
+	if (c->src.bo)
+		buf_fini(&c->src);
+	buf_fini(&c->dst);
+}
+
+static int run(unsigned int engines, const char *tiling, const char *caching,
+	       unsigned int size, double target, int reps, int loops)
+{
+	struct copy c = {};
+
+	c.fd = drm_open_driver(DRIVER_INTEL);
+	c.devid = intel_get_drm_devid(c.fd);
+	igt_freq_bench_setup(c.fd);
+
+	c.bufmgr = drm_intel_bufmgr_gem_init(c.fd, 4096);
+	igt_assert(c.bufmgr);
+	c.batch = intel_batchbuffer_alloc(c.bufmgr, c.devid);
+	igt_assert(c.batch);
+	c.ibb = intel_bb_create(c.fd, 4096);
+
+	c.render = igt_get_render_copyfunc(c.devid);
+	c.fill = igt_get_gpgpu_threaded_fillfunc(c.devid);
+	c.threads = igt_gpgpu_max_threads(c.fd);
+
+	for (enum engine e = 0; e < NUM_ENGINES; e++) {
+		if (!(engines & (1 << e)))
+			continue;
+
+		for (const struct tiling *t = tilings; t->name; t++) {
+			if (tiling && strcmp(tiling, t->name))
+				continue;
+
+			if (!supported(&c, e, t->tiling))
+				continue;
+
+			for (const struct caching *m = cachings; m->name; m++) {
+				if (caching && strcmp(caching, m->name))
+					continue;
+
+				if (size) {
+					run_one(&c, e, t, m, size,
+						target, reps, loops);
+					continue;
+				}
+
+				for (unsigned int s = MIN_SIZE;
+				     s <= MAX_SIZE; s <<= 2)
+					run_one(&c, e, t, m, s,
+						target, reps, loops);
+			}
+		}
+	}
+
+	intel_bb_destroy(c.ibb);
+	intel_batchbuffer_free(c.batch);
+	drm_intel_bufmgr_destroy(c.bufmgr);
+	close(c.fd);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int engines = 0;
+	const char *tiling = NULL;
+	const char *caching = NULL;
+	unsigned int size = 0;
+	double target = 0;
+	int reps = 0;
+	int loops = 10;
+	int c;
+
+	while ((c = getopt (argc, argv, "e:t:m:s:c:r:l:")) != -1) {
+		switch (c) {
+		case 'e':
+			for (int e = 0; e < NUM_ENGINES; e++)
+				if (!strcmp(optarg, engine_names[e]))
+					engines |= 1 << e;
+			break;
+
+		case 't':
+			tiling = optarg;
+			break;
+
+		case 'm':
+			caching = optarg;
+			break;
+
+		case 's':
+			/* In KiB, rounded to whole rows */
+			size = ALIGN(atoi(optarg) << 10, 32 * STRIDE);
+			if (size < MIN_SIZE)
+				size = MIN_SIZE;
+			if (size > MAX_SIZE)
+				size = MAX_SIZE;
+			break;
+
+		case 'c':
+			/* Repeat until the 95% CI is within this percentage */
+			target = atof(optarg) / 100;
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		case 'l':
+			loops = atoi(optarg);
+			if (loops < 1)
+				loops = 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (!engines)
+		engines = (1 << NUM_ENGINES) - 1;
+	if (!reps)
+		reps = target > 0 ? 100 : 5;
+
+	igt_bench_begin("gem_copy_bw");
+	igt_bench_param("engines", "0x%x", engines);
+	igt_bench_param("tiling", "%s", tiling ?: "all");
+	igt_bench_param("caching", "%s", caching ?: "all");
+	igt_bench_param("size", "%u", size);
+	igt_bench_param("reps", "%d", reps);
+	igt_bench_param("loops", "%d", loops);
+
+	c = run(engines, tiling, caching, size, target, reps, loops);
+
+	igt_bench_end();
+
+	return c;
+}
@@ -37,11 +37,14 @@
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "drm.h"
 #include "ioctl_wrappers.h"
 #include "drmtest.h"
 #include "igt_aux.h"
+#include "igt_bench.h"
+#include "igt_rand.h"
 #include "igt_stats.h"
 #include "intel_reg.h"
 
@@ -78,17 +81,182 @@ static void make_busy(int fd, uint32_t handle)
 	}
 }
 
+/*
+ * Without a CI target measure a fixed number of rounds, otherwise until
+ * the mean is stable to within the target, with reps as the upper bound.
+ */
+static bool more_rounds(igt_stats_t *stats, double target, int reps,
+			struct igt_bench_stability *s)
+{
+	if (target <= 0)
+		return stats->n_values < reps;
+
+	if (!stats->n_values)
+		*s = (struct igt_bench_stability) {
+			.target = target,
+			.min_rounds = 3,
+			.max_rounds = reps,
+		};
+
+	return !stats->n_values || igt_bench_unstable(stats, s);
+}
+
+static void report_stability(igt_stats_t *stats, double target,
+			     struct igt_bench_stability *s)
+{
+	double half_width, mean;
+
+	if (target <= 0)
+		return;
+
+	mean = igt_bench_ci(stats, &half_width);
+	fprintf(stderr,
+		"%.3f +- %.3f (95%% CI), %u rounds, %u warm-up rejected\n",
+		mean, half_width, stats->n_values, s->rejected);
+}
+
+/*
+ * For the histogram mode: each size twice as likely as the next one up, from
+ * 4KiB to OBJECT_SIZE, so that most objects are small as from a general
+ * purpose allocator, with the odd large one.
+ */
+static int histogram_size(uint32_t *seed)
+{
+	uint32_t r = hars_petruska_f54_1_random(seed);
+	int order = r ? __builtin_ctz(r) : 31;
+
+	return 4096 << min(order, 11);
+}
+
+struct create_thread {
+	pthread_t thread;
+	pthread_barrier_t *barrier;
+	int fd;
+	int size;
+	int busy;
+	uint32_t seed;
+	double rate;
+};
+
+static void *create_thread(void *arg)
+{
+	struct create_thread *t = arg;
+	struct timespec start, end;
+	uint64_t count = 0;
+	int c;
+
+	pthread_barrier_wait(t->barrier);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		for (c = 0; c < 1000; c++) {
+			uint32_t handle;
+
+			handle = gem_create(t->fd,
+					    t->size ?: histogram_size(&t->seed));
+			gem_set_domain(t->fd, handle,
+				       I915_GEM_DOMAIN_GTT,
+				       I915_GEM_DOMAIN_GTT);
+			if (t->busy)
+				make_busy(t->fd, handle);
+			gem_close(t->fd, handle);
+		}
+		count += c;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+	} while (end.tv_sec - start.tv_sec < 2);
+
+	t->rate = count / elapsed(&start, &end);
+	return NULL;
+}
+
+/*
+ * Create and close from 1, 2, 4, ... up to @max_threads threads at once,
+ * all on @fd or each on its own fd, a size of 0 picking each size from
+ * the histogram.
+ */
+static void run_threads(int fd, int max_threads, bool private_fd,
+			int size, int busy, double target, int reps)
+{
+	struct create_thread *threads;
+	struct igt_bench_stability stable;
+	pthread_barrier_t barrier;
+
+	threads = calloc(max_threads, sizeof(*threads));
+	igt_assert(threads);
+
+	for (int nthreads = 1; ; nthreads = min(2 * nthreads, max_threads)) {
+		igt_stats_t stats;
+		char name[32];
+
+		for (int n = 0; n < nthreads; n++) {
+			threads[n].barrier = &barrier;
+			threads[n].fd = private_fd ?
+				drm_open_driver(DRIVER_INTEL) : fd;
+			threads[n].size = size;
+			threads[n].busy = busy;
+			threads[n].seed = n + 1;
+		}
+
+		igt_stats_init_with_size(&stats, reps);
+		while (more_rounds(&stats, target, reps, &stable)) {
+			double total = 0;
+
+			/* Everyone starts creating once all threads are up */
+			pthread_barrier_init(&barrier, NULL, nthreads);
+			for (int n = 0; n < nthreads; n++)
+				pthread_create(&threads[n].thread, NULL,
+					       create_thread, &threads[n]);
+
+			for (int n = 0; n < nthreads; n++) {
+				pthread_join(threads[n].thread, NULL);
+				total += threads[n].rate;
+			}
+			pthread_barrier_destroy(&barrier);
+
+			igt_stats_push_float(&stats, total);
+		}
+
+		printf("%3d threads: %10.0f ops/s, %10.0f ops/s per thread\n",
+		       nthreads, igt_stats_get_trimean(&stats),
+		       igt_stats_get_trimean(&stats) / nthreads);
+		report_stability(&stats, target, &stable);
+
+		snprintf(name, sizeof(name), "threads-%d", nthreads);
+		igt_bench_result(name, "ops/s", &stats);
+		igt_stats_fini(&stats);
+
+		if (private_fd)
+			for (int n = 0; n < nthreads; n++)
+				close(threads[n].fd);
+
+		if (nthreads == max_threads)
+			break;
+	}
+
+	free(threads);
+}
+
 int main(int argc, char **argv)
 {
 	int fd = drm_open_driver(DRIVER_INTEL);
 	int size = 0;
 	int busy = 0;
-	int reps = 13;
+	struct igt_bench_stability stable;
+	double target = 0;
+	int reps = 0;
 	int ncpus = 1;
-	int c, n, s;
+	int threads = 0;
+	bool private_fd = false;
+	bool histogram = false;
+	int c, s;
 
-	while ((c = getopt (argc, argv, "bs:r:f")) != -1) {
+	while ((c = getopt (argc, argv, "bs:r:c:ft:pH")) != -1) {
 		switch (c) {
+		case 'c':
+			/* Repeat until the 95% CI is within this percentage */
+			target = atof(optarg) / 100;
+			break;
+
 		case 's':
 			size = atoi(optarg);
 			break;
@@ -107,17 +275,49 @@ int main(int argc, char **argv)
 			busy = true;
 			break;
 
+		case 't':
+			/* Sweep up to this many threads */
+			threads = atoi(optarg);
+			if (threads < 1)
+				threads = 1;
+			break;
+
+		case 'p':
+			/* Each thread on its own fd */
+			private_fd = true;
+			break;
+
+		case 'H':
+			/* Sizes from the histogram rather than -s */
+			histogram = true;
+			break;
+
 		default:
 			break;
 		}
 	}
 
-	if (size == 0) {
+	if (!reps)
+		reps = target > 0 ? 100 : 13;
+
+	if (threads || histogram) {
+		igt_bench_begin("gem_create");
+		igt_bench_param("threads", "%d", threads ?: 1);
+		igt_bench_param("fd", "%s", private_fd ? "private" : "shared");
+		igt_bench_param("size", "%d", histogram ? 0 : size);
+		igt_bench_param("busy", "%d", busy);
+
+		run_threads(fd, threads ?: 1, private_fd,
+			    histogram ? 0 : (size ?: 4096), busy,
+			    target, reps);
+
+		igt_bench_end();
+	} else if (size == 0) {
 		for (s = 4096; s <=  OBJECT_SIZE; s <<= 1) {
 			igt_stats_t stats;
 
 			igt_stats_init_with_size(&stats, reps);
-			for (n = 0; n < reps; n++) {
+			while (more_rounds(&stats, target, reps, &stable)) {
 				struct timespec start, end;
 				uint64_t count = 0;
 
@@ -141,13 +341,16 @@ int main(int argc, char **argv)
 				igt_stats_push_float(&stats, count / elapsed(&start, &end));
 			}
 			printf("%f\n", igt_stats_get_trimean(&stats));
+			report_stability(&stats, target, &stable);
 			igt_stats_fini(&stats);
 		}
 	} else {
+		igt_stats_t stats;
 		double *shared;
 
 		shared = mmap(0, 4096, PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
-		for (n = 0; n < reps; n++) {
+		igt_stats_init_with_size(&stats, reps);
+		while (more_rounds(&stats, target, reps, &stable)) {
 			memset(shared, 0, 4096);
 
 			igt_fork(child, ncpus) {
@@ -179,7 +382,10 @@ int main(int argc, char **argv)
 				shared[ncpus] += shared[child];
 
 			printf("%7.3f\n", shared[ncpus]);
+			igt_stats_push_float(&stats, shared[ncpus]);
 		}
+		report_stability(&stats, target, &stable);
+		igt_stats_fini(&stats);
 	}
 
 	return 0;
@@ -0,0 +1,253 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures how fast each of the igt_draw methods fills a whole buffer,
+ * including the time for the GPU to complete the methods using it, or with
+ * -n how many small rectangles per second each method draws through
+ * igt_draw_rects(), as for the damage of a frame.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static bool has_userptr(int fd)
+{
+	uint32_t handle;
+	void *ptr;
+	bool ret;
+
+	ptr = mmap(NULL, 4096, PROT_READ | PROT_WRITE,
+		   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	igt_assert(ptr != MAP_FAILED);
+
+	ret = __gem_userptr(fd, ptr, 4096, 0, 0, &handle) == 0;
+	if (ret)
+		gem_close(fd, handle);
+
+	munmap(ptr, 4096);
+
+	return ret;
+}
+
+static bool method_supported(int fd, enum igt_draw_method method,
+			     uint32_t tiling)
+{
+	uint32_t devid = intel_get_drm_devid(fd);
+
+	switch (method) {
+	case IGT_DRAW_MMAP_WC:
+		return gem_mmap__has_wc(fd);
+	case IGT_DRAW_PWRITE:
+		return tiling == I915_TILING_NONE || intel_gen(devid) >= 5;
+	case IGT_DRAW_RENDER:
+		return igt_get_render_copyfunc(devid);
+	case IGT_DRAW_USERPTR:
+		return has_userptr(fd);
+	default:
+		return true;
+	}
+}
+
+/* The rectangles cycle over a grid of cells of the buffer */
+#define RECT_SIZE 64
+
+static drmModeClip *make_rects(int width, int height, int num_rects)
+{
+	int columns = max(width / RECT_SIZE, 1);
+	int rows = max(height / RECT_SIZE, 1);
+	drmModeClip *rects;
+
+	rects = calloc(num_rects, sizeof(*rects));
+	igt_assert(rects);
+
+	for (int i = 0; i < num_rects; i++) {
+		int cell = i % (columns * rows);
+
+		rects[i].x1 = cell % columns * RECT_SIZE;
+		rects[i].y1 = cell / columns * RECT_SIZE;
+		rects[i].x2 = min(rects[i].x1 + RECT_SIZE, width);
+		rects[i].y2 = min(rects[i].y1 + RECT_SIZE, height);
+	}
+
+	return rects;
+}
+
+static int run(int width, int height, uint32_t tiling, int num_rects,
+	       int reps, int loops)
+{
+	drm_intel_bufmgr *bufmgr;
+	uint32_t handle, stride, size;
+	drmModeClip *rects = NULL;
+	int fd;
+
+	fd = drm_open_driver(DRIVER_INTEL);
+
+	bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
+	igt_assert(bufmgr);
+
+	stride = ALIGN(width * 4, 512);
+	size = ALIGN(stride * ALIGN(height, 32), 4096);
+	handle = gem_create(fd, size);
+	if (tiling != I915_TILING_NONE)
+		gem_set_tiling(fd, handle, tiling, stride);
+
+	if (num_rects)
+		rects = make_rects(width, height, num_rects);
+
+	for (enum igt_draw_method method = 0;
+	     method < IGT_DRAW_METHOD_COUNT; method++) {
+		const char *name = igt_draw_get_method_name(method);
+		igt_stats_t stats;
+
+		if (!method_supported(fd, method, tiling)) {
+			printf("%-10s unsupported\n", name);
+			continue;
+		}
+
+		igt_stats_init_with_size(&stats, reps);
+
+		for (int r = 0; r < reps; r++) {
+			struct timespec start, end;
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			for (int n = 0; n < loops; n++) {
+				if (rects)
+					igt_draw_rects(fd, bufmgr, NULL,
+						       handle, size, stride,
+						       method, rects,
+						       num_rects, n << 8, 32);
+				else
+					igt_draw_rect(fd, bufmgr, NULL,
+						      handle, size, stride,
+						      method, 0, 0,
+						      width, height,
+						      n << 8, 32);
+			}
+			gem_sync(fd, handle);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+
+			if (rects)
+				igt_stats_push_float(&stats,
+						     loops * num_rects /
+						     elapsed(&start, &end));
+			else
+				igt_stats_push_float(&stats,
+						     loops * 4. * width * height /
+						     (1024 * 1024) /
+						     elapsed(&start, &end));
+		}
+
+		printf("%-10s %9.1f %s\n", name, igt_stats_get_median(&stats),
+		       rects ? "rects/s" : "MiB/s");
+		igt_bench_result(name, rects ? "rects/s" : "MiB/s", &stats);
+		igt_stats_fini(&stats);
+	}
+
+	free(rects);
+	gem_close(fd, handle);
+	drm_intel_bufmgr_destroy(bufmgr);
+	close(fd);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int width = 1920;
+	int height = 1080;
+	uint32_t tiling = I915_TILING_NONE;
+	int num_rects = 0;
+	int reps = 5;
+	int loops = 10;
+	int c;
+
+	while ((c = getopt (argc, argv, "w:h:xn:r:l:")) != -1) {
+		switch (c) {
+		case 'w':
+			width = atoi(optarg);
+			if (width < 1)
+				width = 1;
+			break;
+
+		case 'h':
+			height = atoi(optarg);
+			if (height < 1)
+				height = 1;
+			break;
+
+		case 'x':
+			tiling = I915_TILING_X;
+			break;
+
+		case 'n':
+			num_rects = atoi(optarg);
+			if (num_rects < 0)
+				num_rects = 0;
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		case 'l':
+			loops = atoi(optarg);
+			if (loops < 1)
+				loops = 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	igt_bench_begin("gem_draw");
+	igt_bench_param("width", "%d", width);
+	igt_bench_param("height", "%d", height);
+	igt_bench_param("tiling", "%s", tiling ? "x" : "none");
+	igt_bench_param("rects", "%d", num_rects);
+	igt_bench_param("reps", "%d", reps);
+	igt_bench_param("loops", "%d", loops);
+
+	c = run(width, height, tiling, num_rects, reps, loops);
+
+	igt_bench_end();
+
+	return c;
+}
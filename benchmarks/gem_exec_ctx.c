@@ -41,11 +41,18 @@
 #include "drm.h"
 #include "ioctl_wrappers.h"
 #include "drmtest.h"
+#include "intel_chipset.h"
 #include "intel_io.h"
 #include "intel_reg.h"
+#include "igt_dummyload.h"
 #include "igt_stats.h"
+#include "i915/gem_caps.h"
+#include "i915/gem_context.h"
+#include "i915/gem_engine_topology.h"
+#include "i915/gem_mman.h"
+#include "i915/gem_vm.h"
 
-enum mode { NOP, CREATE, SWITCH, DEFAULT };
+enum mode { NOP, CREATE, SWITCH, DEFAULT, PINGPONG, SCALE };
 #define SYNC 0x1
 
 #define LOCAL_I915_EXEC_NO_RELOC (1<<11)
@@ -150,6 +157,8 @@ static int loop(unsigned ring,
 					break;
 
 				case NOP:
+				case PINGPONG:
+				case SCALE:
 					break;
 				}
 				gem_execbuf(fd, &execbuf);
@@ -183,18 +192,347 @@ static int loop(unsigned ring,
 	return 0;
 }
 
+enum variant { CONTEXTS, SHARED_VM, QUEUES, NUM_VARIANTS };
+
+static const char * const variant_names[] = {
+	[CONTEXTS] = "create",
+	[SHARED_VM] = "vm",
+	[QUEUES] = "queue",
+};
+
+#define PINGPONG_ROUNDS 64
+#define PINGPONG_SLOT 32
+#define PINGPONG_RESULTS (16 << 20)
+#define PINGPONG_BATCH (32 << 20)
+#define MI_STORE_REGISTER_MEM_GEN8 (0x24 << 23 | 2)
+
+static uint32_t pingpong_context(int fd, enum variant variant, uint32_t vm)
+{
+	struct drm_i915_gem_context_param param = {
+		.param = I915_CONTEXT_PARAM_VM,
+		.value = vm,
+	};
+	uint32_t ctx;
+
+	switch (variant) {
+	case QUEUES:
+		ctx = gem_queue_create(fd);
+		break;
+	case SHARED_VM:
+		ctx = gem_context_create(fd);
+		param.ctx_id = ctx;
+		gem_context_set_param(fd, &param);
+		break;
+	default:
+		ctx = gem_context_create(fd);
+		break;
+	}
+
+	/* Same engine map as the default context, for the engine flags */
+	gem_context_set_all_engines(fd, ctx);
+
+	return ctx;
+}
+
+/*
+ * Queue PINGPONG_ROUNDS batches on each of nctx contexts in turn behind a
+ * spinner, so that the engine runs them back to back once it is released,
+ * switching context between each, each batch storing the engine timestamp.
+ * The difference between consecutive timestamps is the cost of the batch,
+ * next to nothing, and of the switch.
+ */
+static void pingpong_engine(int fd, const struct intel_execution_engine2 *e,
+			    enum variant variant, int nctx, int reps,
+			    double ns_per_tick)
+{
+	const unsigned int slots = nctx * PINGPONG_ROUNDS;
+	uint32_t mmio_base = gem_engine_mmio_base(fd, e->class, e->instance);
+	struct drm_i915_gem_exec_object2 obj[2] = {};
+	struct drm_i915_gem_execbuffer2 execbuf = {};
+	unsigned long hist[24] = {};
+	uint32_t *ctx, *batch, *results;
+	uint32_t spin_ctx, vm = 0;
+	igt_stats_t stats;
+
+	if (!mmio_base) {
+		printf("%s: mmio base unknown, skipping\n", e->name);
+		return;
+	}
+
+	if (variant == SHARED_VM)
+		vm = gem_vm_create(fd);
+
+	ctx = calloc(nctx, sizeof(*ctx));
+	igt_assert(ctx);
+	for (int n = 0; n < nctx; n++)
+		ctx[n] = pingpong_context(fd, variant, vm);
+
+	/* Pinned at the same addresses in every vm, so no relocations */
+	obj[0].handle = gem_create(fd, slots * sizeof(uint32_t));
+	obj[0].offset = PINGPONG_RESULTS;
+	obj[0].flags = EXEC_OBJECT_PINNED | EXEC_OBJECT_WRITE;
+	obj[1].handle = gem_create(fd, slots * PINGPONG_SLOT);
+	obj[1].offset = PINGPONG_BATCH;
+	obj[1].flags = EXEC_OBJECT_PINNED;
+
+	batch = calloc(slots, PINGPONG_SLOT);
+	igt_assert(batch);
+	for (unsigned int i = 0; i < slots; i++) {
+		uint32_t *cs = batch + i * PINGPONG_SLOT / sizeof(*cs);
+
+		*cs++ = MI_STORE_REGISTER_MEM_GEN8;
+		*cs++ = mmio_base + 0x358;
+		*cs++ = PINGPONG_RESULTS + i * sizeof(uint32_t);
+		*cs++ = 0;
+		*cs++ = MI_BATCH_BUFFER_END;
+	}
+	gem_write(fd, obj[1].handle, 0, batch, slots * PINGPONG_SLOT);
+	free(batch);
+
+	execbuf.buffers_ptr = to_user_pointer(obj);
+	execbuf.buffer_count = 2;
+	execbuf.batch_len = PINGPONG_SLOT;
+	execbuf.flags = e->flags;
+	execbuf.flags |= LOCAL_I915_EXEC_HANDLE_LUT;
+	execbuf.flags |= LOCAL_I915_EXEC_NO_RELOC;
+
+	spin_ctx = pingpong_context(fd, CONTEXTS, 0);
+
+	igt_stats_init_with_size(&stats, reps * (slots - 1));
+	for (int r = 0; r < reps; r++) {
+		igt_spin_t *spin = igt_spin_new(fd,
+						.ctx = spin_ctx,
+						.engine = e->flags);
+
+		for (unsigned int i = 0; i < slots; i++) {
+			execbuf.rsvd1 = ctx[i % nctx];
+			execbuf.batch_start_offset = i * PINGPONG_SLOT;
+			gem_execbuf(fd, &execbuf);
+		}
+
+		igt_spin_end(spin);
+		gem_sync(fd, obj[0].handle);
+		igt_spin_free(fd, spin);
+
+		results = gem_mmap__cpu(fd, obj[0].handle, 0,
+					slots * sizeof(uint32_t), PROT_READ);
+		gem_set_domain(fd, obj[0].handle, I915_GEM_DOMAIN_CPU, 0);
+		for (unsigned int i = 1; i < slots; i++) {
+			double ns = (uint32_t)(results[i] - results[i - 1]) *
+				ns_per_tick;
+			int bucket = 0;
+
+			igt_stats_push_float(&stats, ns);
+			while (bucket < ARRAY_SIZE(hist) - 1 &&
+			       ns >= 2 << bucket)
+				bucket++;
+			hist[bucket]++;
+		}
+		munmap(results, slots * sizeof(uint32_t));
+	}
+
+	printf("%s, %d %s contexts: median %.0fns, p99 %.0fns, max %.0fns\n",
+	       e->name, nctx, variant_names[variant],
+	       igt_stats_get_median(&stats),
+	       igt_stats_get_percentile(&stats, 99),
+	       (double)igt_stats_get_max(&stats));
+	for (int b = 0; b < ARRAY_SIZE(hist); b++)
+		if (hist[b])
+			printf("  < %8dns: %lu\n", 2 << b, hist[b]);
+	igt_stats_fini(&stats);
+
+	gem_context_destroy(fd, spin_ctx);
+	gem_close(fd, obj[1].handle);
+	gem_close(fd, obj[0].handle);
+	for (int n = 0; n < nctx; n++)
+		gem_context_destroy(fd, ctx[n]);
+	free(ctx);
+	if (vm)
+		gem_vm_destroy(fd, vm);
+}
+
+static int pingpong(const char *engine, enum variant variant,
+		    int nctx, int reps)
+{
+	const struct intel_execution_engine2 *e;
+	double ns_per_tick;
+	int fd, freq;
+
+	fd = drm_open_driver(DRIVER_INTEL);
+
+	/* Pinning the same addresses in every context needs its own vm */
+	if (intel_gen(intel_get_drm_devid(fd)) < 8 ||
+	    !gem_uses_full_ppgtt(fd) || !gem_has_softpin(fd))
+		return 77;
+
+	if (variant == QUEUES && !gem_has_queues(fd))
+		return 77;
+
+	if (variant == SHARED_VM) {
+		uint32_t vm;
+
+		if (__gem_vm_create(fd, &vm))
+			return 77;
+		gem_vm_destroy(fd, vm);
+	}
+
+	if (__gem_caps_getparam(fd, I915_PARAM_CS_TIMESTAMP_FREQUENCY, &freq) ||
+	    freq <= 0)
+		return 77;
+	ns_per_tick = 1e9 / freq;
+
+	__for_each_physical_engine(fd, e) {
+		/* "vcs" for all the engines of the class, "vcs1" for one */
+		if (engine && strncmp(engine, e->name, strlen(engine)))
+			continue;
+
+		pingpong_engine(fd, e, variant, nctx, reps, ns_per_tick);
+	}
+
+	close(fd);
+	return 0;
+}
+
+#define SCALE_MAX_CONTEXTS (64 << 10)
+
+static int64_t mem_available_kib(void)
+{
+	char line[128];
+	int64_t kib = 0;
+	FILE *file;
+
+	file = fopen("/proc/meminfo", "r");
+	if (!file)
+		return 0;
+
+	while (fgets(line, sizeof(line), file))
+		if (sscanf(line, "MemAvailable: %" SCNd64, &kib) == 1)
+			break;
+
+	fclose(file);
+	return kib;
+}
+
+/*
+ * Grow the number of contexts from 1 to max_ctx, doubling it each step, and
+ * round-robin a nop across all of them for at least a second and a pass
+ * over every context, until the contexts no longer fit and switching
+ * between them means evicting their state. Along with the execbuf latency
+ * report the cost of creating (and first using) each new context and how
+ * much memory each context takes.
+ */
+static int scale(unsigned ring, int max_ctx, int reps)
+{
+	struct drm_i915_gem_execbuffer2 execbuf;
+	struct drm_i915_gem_exec_object2 obj;
+	int64_t mem_base;
+	uint32_t *ctx;
+	int count = 0;
+	int fd;
+
+	fd = drm_open_driver(DRIVER_INTEL);
+	if (!gem_has_contexts(fd))
+		return 77;
+
+	memset(&obj, 0, sizeof(obj));
+	obj.handle = batch(fd);
+
+	memset(&execbuf, 0, sizeof(execbuf));
+	execbuf.buffers_ptr = (uintptr_t)&obj;
+	execbuf.buffer_count = 1;
+	execbuf.flags = ring;
+	execbuf.flags |= LOCAL_I915_EXEC_HANDLE_LUT;
+	execbuf.flags |= LOCAL_I915_EXEC_NO_RELOC;
+	if (__gem_execbuf(fd, &execbuf)) {
+		execbuf.flags = ring;
+		if (__gem_execbuf(fd, &execbuf))
+			return 77;
+	}
+	gem_sync(fd, obj.handle);
+
+	ctx = calloc(max_ctx, sizeof(*ctx));
+	igt_assert(ctx);
+
+	mem_base = mem_available_kib();
+
+	for (int nctx = 1; nctx <= max_ctx; nctx *= 2) {
+		struct timespec start, end;
+		double create;
+		igt_stats_t stats;
+		int64_t mem;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (; count < nctx; count++) {
+			int err;
+
+			err = __gem_context_create(fd, &ctx[count]);
+			if (err) {
+				printf("context creation failed after %d contexts: %s\n",
+				       count, strerror(-err));
+				break;
+			}
+
+			/* The context state is only allocated on first use */
+			execbuf.rsvd1 = ctx[count];
+			gem_execbuf(fd, &execbuf);
+		}
+		gem_sync(fd, obj.handle);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (count < nctx)
+			break;
+
+		create = 1e6 * elapsed(&start, &end) / (nctx - nctx / 2);
+		mem = mem_base - mem_available_kib();
+
+		igt_stats_init_with_size(&stats, reps);
+		for (int r = 0; r < reps; r++) {
+			unsigned long n = 0;
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			do {
+				execbuf.rsvd1 = ctx[n++ % nctx];
+				gem_execbuf(fd, &execbuf);
+
+				clock_gettime(CLOCK_MONOTONIC, &end);
+			} while (n < nctx || elapsed(&start, &end) < 1.);
+			gem_sync(fd, obj.handle);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+
+			igt_stats_push_float(&stats,
+					     1e6 * elapsed(&start, &end) / n);
+		}
+
+		printf("%6d contexts: %8.3fus/execbuf, %8.3fus/create, %8.1fKiB/context\n",
+		       nctx, igt_stats_get_median(&stats), create,
+		       (double)mem / nctx);
+		igt_stats_fini(&stats);
+	}
+
+	for (int n = 0; n < count; n++)
+		gem_context_destroy(fd, ctx[n]);
+	free(ctx);
+
+	gem_close(fd, obj.handle);
+	close(fd);
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	unsigned ring = I915_EXEC_RENDER;
+	const char *engine = NULL;
+	enum variant variant = CONTEXTS;
 	unsigned flags = 0;
 	enum mode mode = NOP;
 	int reps = 1;
 	int ncpus = 1;
+	int nctx = 0;
 	int c;
 
-	while ((c = getopt (argc, argv, "e:r:b:sf")) != -1) {
+	while ((c = getopt (argc, argv, "e:r:b:sfk:v:")) != -1) {
 		switch (c) {
 		case 'e':
+			engine = optarg;
 			if (strcmp(optarg, "rcs") == 0)
 				ring = I915_EXEC_RENDER;
 			else if (strcmp(optarg, "vcs") == 0)
@@ -216,10 +554,29 @@ int main(int argc, char **argv)
 				mode = DEFAULT;
 			else if (strcmp(optarg, "nop") == 0)
 				mode = NOP;
+			else if (strcmp(optarg, "pingpong") == 0)
+				mode = PINGPONG;
+			else if (strcmp(optarg, "scale") == 0)
+				mode = SCALE;
 			else
 				abort();
 			break;
 
+		case 'k':
+			/* Contexts to ping-pong between, or to scale up to */
+			nctx = atoi(optarg);
+			if (nctx < 1)
+				nctx = 1;
+			break;
+
+		case 'v':
+			for (variant = 0; variant < NUM_VARIANTS; variant++)
+				if (strcmp(optarg, variant_names[variant]) == 0)
+					break;
+			if (variant == NUM_VARIANTS)
+				abort();
+			break;
+
 		case 'f':
 			ncpus = sysconf(_SC_NPROCESSORS_ONLN);
 			break;
@@ -239,5 +596,11 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (mode == SCALE)
+		return scale(ring, nctx ?: SCALE_MAX_CONTEXTS, reps);
+
+	if (mode == PINGPONG)
+		return pingpong(engine, variant, nctx ?: 2, reps);
+
 	return loop(ring, reps, mode, ncpus, flags);
 }
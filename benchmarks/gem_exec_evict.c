@@ -0,0 +1,231 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures execbuf as its working set grows past what fits in the GTT, and
+ * then past the RAM, so that each execbuf has to evict the objects of the
+ * previous ones, and then have them swapped back in. Each execbuf binds a
+ * selection of the working set, walked with the stride of the minor
+ * evictions of tests/eviction_common.c so that consecutive execbufs share
+ * few objects.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define MIN_WORKING_SET (64ull << 20)
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+/* Derived from a non-multiple of seven, so that striding by 7 visits all */
+static uint64_t surface_count(uint64_t working_set, uint64_t surface_size)
+{
+	uint64_t count = working_set / surface_size;
+
+	return count / 7 * 7 + 3;
+}
+
+static void run_one(int fd, uint64_t working_set, uint64_t surface_size,
+		    unsigned int per_exec, int reps)
+{
+	const uint64_t count = surface_count(working_set, surface_size);
+	const uint32_t bbe = MI_BATCH_BUFFER_END;
+	struct drm_i915_gem_exec_object2 *obj;
+	struct drm_i915_gem_execbuffer2 execbuf = {};
+	igt_stats_t latency, throughput;
+	uint32_t *bo, batch;
+	uint64_t m = 0;
+	char name[64];
+
+	bo = malloc(count * sizeof(*bo));
+	obj = calloc(per_exec + 1, sizeof(*obj));
+	igt_assert(bo && obj);
+
+	for (uint64_t n = 0; n < count; n++)
+		bo[n] = gem_create(fd, surface_size);
+	batch = gem_create(fd, 4096);
+	gem_write(fd, batch, 0, &bbe, sizeof(bbe));
+
+	execbuf.buffers_ptr = to_user_pointer(obj);
+	execbuf.buffer_count = per_exec + 1;
+	obj[per_exec].handle = batch;
+
+	/* Populate the whole working set once before measuring */
+	for (uint64_t n = 0; n < count; n += per_exec) {
+		for (unsigned int i = 0; i < per_exec; i++)
+			obj[i].handle = bo[(n + i) % count];
+		gem_execbuf(fd, &execbuf);
+	}
+	gem_sync(fd, batch);
+
+	igt_stats_init_with_size(&latency, 1024);
+	igt_stats_init_with_size(&throughput, reps);
+	for (int r = 0; r < reps; r++) {
+		struct timespec start, end;
+		uint64_t execs = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		do {
+			struct timespec before, after;
+
+			for (unsigned int i = 0; i < per_exec; i++, m += 7)
+				obj[i].handle = bo[m % count];
+
+			clock_gettime(CLOCK_MONOTONIC, &before);
+			gem_execbuf(fd, &execbuf);
+			clock_gettime(CLOCK_MONOTONIC, &after);
+			execs++;
+
+			igt_stats_push_float(&latency,
+					     1e6 * elapsed(&before, &after));
+			end = after;
+		} while (elapsed(&start, &end) < 2.);
+		gem_sync(fd, batch);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		igt_stats_push_float(&throughput,
+				     execs / elapsed(&start, &end));
+	}
+
+	printf("%8"PRIu64"MiB %10.1f %10.1f %10.1f %12.1f\n",
+	       working_set >> 20,
+	       igt_stats_get_median(&latency),
+	       igt_stats_get_percentile(&latency, 99),
+	       (double)igt_stats_get_max(&latency),
+	       igt_stats_get_median(&throughput));
+	fflush(stdout);
+
+	snprintf(name, sizeof(name), "latency-%"PRIu64"MiB", working_set >> 20);
+	igt_bench_result(name, "us", &latency);
+	snprintf(name, sizeof(name), "throughput-%"PRIu64"MiB",
+		 working_set >> 20);
+	igt_bench_result(name, "execbuf/s", &throughput);
+
+	igt_stats_fini(&throughput);
+	igt_stats_fini(&latency);
+
+	gem_close(fd, batch);
+	for (uint64_t n = 0; n < count; n++)
+		gem_close(fd, bo[n]);
+	free(obj);
+	free(bo);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t surface_size = 1 << 20;
+	unsigned int per_exec = 64;
+	uint64_t gtt, ram, limit;
+	bool swap = false;
+	int reps = 3;
+	int fd, c;
+
+	while ((c = getopt (argc, argv, "s:n:r:S")) != -1) {
+		switch (c) {
+		case 's':
+			/* In KiB */
+			surface_size = ALIGN(strtoull(optarg, NULL, 0) << 10, 4096);
+			if (surface_size < 4096)
+				surface_size = 4096;
+			break;
+
+		case 'n':
+			/* Objects per execbuf */
+			per_exec = atoi(optarg);
+			if (per_exec < 1)
+				per_exec = 1;
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		case 'S':
+			/* Carry on past the RAM into the swap */
+			swap = true;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	fd = drm_open_driver(DRIVER_INTEL);
+
+	/*
+	 * Without full ppgtt the objects are evicted from the GTT well before
+	 * the RAM runs out, otherwise only the RAM sets the limit. Past the
+	 * RAM, without -S, we stop for the sake of the rest of the system.
+	 */
+	gtt = gem_aperture_size(fd);
+	ram = intel_get_avail_ram_mb() << 20;
+	limit = ram * 3 / 4;
+	if (swap)
+		limit = ram + (intel_get_total_swap_mb() << 20) / 2;
+	limit = min(limit, 2 * gtt);
+
+	igt_bench_begin("gem_exec_evict");
+	igt_bench_param("surface-size", "%"PRIu64, surface_size);
+	igt_bench_param("per-exec", "%u", per_exec);
+	igt_bench_param("gtt", "%"PRIu64, gtt);
+	igt_bench_param("ram", "%"PRIu64, ram);
+
+	printf("# gtt %"PRIu64"MiB, available ram %"PRIu64"MiB\n",
+	       gtt >> 20, ram >> 20);
+	printf("# %11s %10s %10s %10s %12s\n",
+	       "working set", "median us", "p99 us", "max us", "execbuf/s");
+
+	/* Quarter steps, to see where the cliff is */
+	for (uint64_t base = MIN_WORKING_SET; base <= limit; base *= 2) {
+		for (int step = 4; step < 8; step++) {
+			uint64_t working_set = base / 4 * step;
+
+			if (working_set > limit)
+				break;
+
+			/* At least enough objects for one execbuf */
+			if (working_set < per_exec * surface_size)
+				continue;
+
+			run_one(fd, working_set, surface_size, per_exec, reps);
+		}
+	}
+
+	igt_bench_end();
+	close(fd);
+
+	return 0;
+}
@@ -25,6 +25,7 @@
  *
  */
 
+#include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -43,6 +44,10 @@
 #include "drmtest.h"
 #include "intel_io.h"
 #include "intel_reg.h"
+#include "i915/gem_context.h"
+#include "i915/gem_engine_topology.h"
+#include "igt_bench.h"
+#include "igt_freq.h"
 #include "igt_stats.h"
 
 #define LOCAL_I915_EXEC_NO_RELOC (1<<11)
@@ -56,6 +61,7 @@
 #define SYNC 0x1
 #define WRITE 0x2
 #define READ_ALL 0x4
+#define PARALLEL 0x8
 
 static double elapsed(const struct timespec *start,
 		      const struct timespec *end)
@@ -71,7 +77,134 @@ static uint32_t batch(int fd)
 	return handle;
 }
 
-static int loop(unsigned ring, int reps, int ncpus, unsigned flags)
+struct engine_thread {
+	pthread_t thread;
+	int fd;
+	const char *name;
+	unsigned int flags;
+	unsigned int submit;
+	pthread_barrier_t *barrier;
+	double rate;
+};
+
+static void *engine_thread(void *arg)
+{
+	struct engine_thread *t = arg;
+	struct drm_i915_gem_exec_object2 obj[2];
+	struct drm_i915_gem_execbuffer2 execbuf;
+	struct timespec start, end;
+	unsigned long count = 0;
+
+	memset(obj, 0, sizeof(obj));
+	obj[0].handle = gem_create(t->fd, 4096);
+	if (t->submit & WRITE)
+		obj[0].flags = EXEC_OBJECT_WRITE;
+	obj[1].handle = batch(t->fd);
+
+	memset(&execbuf, 0, sizeof(execbuf));
+	execbuf.buffers_ptr = (uintptr_t)obj;
+	execbuf.buffer_count = 2;
+	execbuf.flags = t->flags;
+	execbuf.flags |= LOCAL_I915_EXEC_HANDLE_LUT;
+	execbuf.flags |= LOCAL_I915_EXEC_NO_RELOC;
+	execbuf.rsvd1 = gem_context_create(t->fd);
+	gem_context_set_all_engines(t->fd, execbuf.rsvd1);
+
+	gem_execbuf(t->fd, &execbuf);
+	gem_sync(t->fd, obj[1].handle);
+
+	pthread_barrier_wait(t->barrier);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		for (int inner = 0; inner < 1024; inner++) {
+			gem_execbuf(t->fd, &execbuf);
+			if (t->submit & SYNC)
+				gem_sync(t->fd, obj[1].handle);
+		}
+		count += 1024;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+	} while (elapsed(&start, &end) < 2.);
+
+	gem_sync(t->fd, obj[1].handle);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	t->rate = count / elapsed(&start, &end);
+
+	gem_context_destroy(t->fd, execbuf.rsvd1);
+	gem_close(t->fd, obj[1].handle);
+	gem_close(t->fd, obj[0].handle);
+
+	return NULL;
+}
+
+/*
+ * Submit to all physical engines at the same time, each from its own
+ * thread and context, to see how submission scales across engines.
+ */
+static int parallel(int reps, unsigned flags)
+{
+	struct engine_thread threads[GEM_MAX_ENGINES];
+	const struct intel_execution_engine2 *e;
+	igt_stats_t stats[GEM_MAX_ENGINES + 1];
+	pthread_barrier_t barrier;
+	unsigned nengine = 0;
+	int fd;
+
+	fd = drm_open_driver(DRIVER_INTEL);
+	igt_freq_bench_setup(fd);
+
+	__for_each_physical_engine(fd, e) {
+		threads[nengine].fd = fd;
+		threads[nengine].name = e->name;
+		threads[nengine].flags = e->flags;
+		threads[nengine].submit = flags;
+		threads[nengine].barrier = &barrier;
+		nengine++;
+	}
+	if (!nengine)
+		return 77;
+
+	for (int n = 0; n <= nengine; n++)
+		igt_stats_init_with_size(&stats[n], reps);
+
+	while (reps--) {
+		double total = 0;
+
+		sleep(1); /* wait for the hw to go back to sleep */
+
+		/* Everyone starts submitting once all contexts are set up */
+		pthread_barrier_init(&barrier, NULL, nengine);
+		for (int n = 0; n < nengine; n++)
+			pthread_create(&threads[n].thread, NULL,
+				       engine_thread, &threads[n]);
+
+		for (int n = 0; n < nengine; n++) {
+			pthread_join(threads[n].thread, NULL);
+			printf("%s: %.0f execbuf/s, ",
+			       threads[n].name, threads[n].rate);
+			igt_stats_push_float(&stats[n], threads[n].rate);
+			total += threads[n].rate;
+		}
+		printf("total: %.0f execbuf/s\n", total);
+		igt_stats_push_float(&stats[nengine], total);
+
+		pthread_barrier_destroy(&barrier);
+	}
+
+	for (int n = 0; n < nengine; n++)
+		igt_bench_result(threads[n].name, "execbuf/s", &stats[n]);
+	igt_bench_result("total", "execbuf/s", &stats[nengine]);
+
+	for (int n = 0; n <= nengine; n++)
+		igt_stats_fini(&stats[n]);
+
+	close(fd);
+	return 0;
+}
+
+static int loop(unsigned ring, int reps, int ncpus, unsigned flags,
+		struct igt_bench_stability *stable)
 {
 	struct drm_i915_gem_execbuffer2 execbuf;
 	struct drm_i915_gem_exec_object2 obj[2];
@@ -79,12 +212,14 @@ static int loop(unsigned ring, int reps, int ncpus, unsigned flags)
 	unsigned all_nengine;
 	unsigned engines[16];
 	unsigned nengine;
+	igt_stats_t stats;
 	double *shared;
 	int fd;
 
 	shared = mmap(0, 4096, PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
 
 	fd = drm_open_driver(DRIVER_INTEL);
+	igt_freq_bench_setup(fd);
 
 	memset(obj, 0, sizeof(obj));
 	obj[0].handle = gem_create(fd, 4096);
@@ -122,7 +257,8 @@ static int loop(unsigned ring, int reps, int ncpus, unsigned flags)
 		engines[0] = ring;
 	}
 
-	while (reps--) {
+	igt_stats_init_with_size(&stats, reps);
+	do {
 		memset(shared, 0, 4096);
 
 		gem_set_domain(fd, obj[1].handle, I915_GEM_DOMAIN_GTT, 0);
@@ -170,6 +306,7 @@ static int loop(unsigned ring, int reps, int ncpus, unsigned flags)
 		for (int child = 0; child < ncpus; child++)
 			shared[ncpus] += shared[child];
 		printf("%7.3f\n", shared[ncpus] / ncpus);
+		igt_stats_push_float(&stats, shared[ncpus] / ncpus);
 
 		obj[0].flags = 0;
 		for (int n = 0; n < nengine; n++) {
@@ -179,7 +316,20 @@ static int loop(unsigned ring, int reps, int ncpus, unsigned flags)
 		}
 		if (flags & WRITE)
 			obj[0].flags = EXEC_OBJECT_WRITE;
+	} while (stable ? igt_bench_unstable(&stats, stable) : --reps);
+
+	if (stable) {
+		double half_width, mean = igt_bench_ci(&stats, &half_width);
+
+		fprintf(stderr,
+			"%.3f +- %.3f (95%% CI), %u rounds, %u warm-up rejected\n",
+			mean, half_width, stats.n_values, stable->rejected);
+		igt_bench_value("rejected", "rounds", stable->rejected);
 	}
+
+	igt_bench_result("exec", "us", &stats);
+	igt_stats_fini(&stats);
+
 	return 0;
 }
 
@@ -187,11 +337,12 @@ int main(int argc, char **argv)
 {
 	unsigned ring = I915_EXEC_RENDER;
 	unsigned flags = 0;
-	int reps = 1;
+	struct igt_bench_stability stable = {};
+	int reps = 0;
 	int ncpus = 1;
 	int c;
 
-	while ((c = getopt (argc, argv, "e:r:sf")) != -1) {
+	while ((c = getopt (argc, argv, "e:r:c:sfp")) != -1) {
 		switch (c) {
 		case 'e':
 			if (strcmp(optarg, "rcs") == 0)
@@ -214,6 +365,11 @@ int main(int argc, char **argv)
 				reps = 1;
 			break;
 
+		case 'c':
+			/* Repeat until the 95% CI is within this percentage */
+			stable.target = atof(optarg) / 100;
+			break;
+
 		case 'f':
 			ncpus = sysconf(_SC_NPROCESSORS_ONLN);
 			break;
@@ -222,6 +378,11 @@ int main(int argc, char **argv)
 			flags |= SYNC;
 			break;
 
+		case 'p':
+			/* One thread per physical engine, all at once */
+			flags |= PARALLEL;
+			break;
+
 		case 'W':
 			flags |= WRITE;
 			break;
@@ -235,5 +396,33 @@ int main(int argc, char **argv)
 		}
 	}
 
-	return loop(ring, reps, ncpus, flags);
+	/* With a CI target, reps is the upper bound of rounds to measure */
+	if (stable.target > 0) {
+		stable.min_rounds = 3;
+		stable.max_rounds = reps ?: 100;
+	}
+	if (!reps)
+		reps = 1;
+
+	igt_bench_begin("gem_exec_nop");
+	igt_bench_param("engine", "%d", ring);
+	igt_bench_param("reps", "%d", reps);
+	if (stable.target > 0)
+		igt_bench_param("ci-target", "%g", stable.target);
+	igt_bench_param("clients", "%d", ncpus);
+	igt_bench_param("sync", "%d", !!(flags & SYNC));
+	igt_bench_param("write", "%d", !!(flags & WRITE));
+	igt_bench_param("read-all", "%d", !!(flags & READ_ALL));
+
+	igt_bench_param("parallel", "%d", !!(flags & PARALLEL));
+
+	if (flags & PARALLEL)
+		c = parallel(reps, flags);
+	else
+		c = loop(ring, reps, ncpus, flags,
+			 stable.target > 0 ? &stable : NULL);
+
+	igt_bench_end();
+
+	return c;
 }
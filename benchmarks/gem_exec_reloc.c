@@ -33,12 +33,16 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 #include "drm.h"
 #include "intel_reg.h"
 #include "ioctl_wrappers.h"
+#include "igt_bench.h"
 #include "igt_debugfs.h"
+#include "igt_stats.h"
 #include "drmtest.h"
 #include "i915/gem_mman.h"
 
@@ -181,15 +185,209 @@ static int run(unsigned batch_size,
 	return 0;
 }
 
+/*
+ * The sweep compares the ways of telling the kernel where the objects are,
+ * each execbuf carrying a batch with one address per object:
+ *
+ * reloc:    relocations processed on every execbuf
+ * no-reloc: I915_EXEC_NO_RELOC with the presumed offsets the kernel wrote
+ *           back, so the relocations are skipped
+ * lut:      the same with I915_EXEC_HANDLE_LUT, saving the handle lookups
+ * softpin:  EXEC_OBJECT_PINNED at offsets chosen by userspace, without any
+ *           relocation entries
+ */
+enum sweep_mode {
+	SWEEP_RELOC,
+	SWEEP_NO_RELOC,
+	SWEEP_LUT,
+	SWEEP_SOFTPIN,
+	NUM_SWEEP_MODES
+};
+
+static const char * const sweep_names[] = {
+	[SWEEP_RELOC] = "reloc",
+	[SWEEP_NO_RELOC] = "no-reloc",
+	[SWEEP_LUT] = "lut",
+	[SWEEP_SOFTPIN] = "softpin",
+};
+
+#define SWEEP_MAX_OBJECTS (64 << 10)
+/* Each round submits for at least this long, in ns */
+#define SWEEP_ROUND_TIME (20 * 1000 * 1000)
+
+static uint64_t nsec(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+static uint64_t cpu_nsec(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+	       (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+static void sweep_one(int fd, enum sweep_mode mode, uint32_t *handles,
+		      unsigned int count, int reps)
+{
+	struct drm_i915_gem_relocation_entry *reloc = NULL;
+	struct drm_i915_gem_exec_object2 *obj;
+	struct drm_i915_gem_execbuffer2 execbuf;
+	uint32_t bbe = MI_BATCH_BUFFER_END;
+	igt_stats_t latency, cpu;
+	unsigned int batch_size;
+	char name[64];
+	unsigned int n;
+
+	/* An address for each object after the MI_BATCH_BUFFER_END */
+	batch_size = ALIGN(8 * (count + 1), 4096);
+
+	obj = calloc(count + 1, sizeof(*obj));
+	igt_assert(obj);
+	for (n = 0; n < count; n++)
+		obj[n].handle = handles[n];
+	obj[count].handle = gem_create(fd, batch_size);
+	gem_write(fd, obj[count].handle, 0, &bbe, sizeof(bbe));
+
+	memset(&execbuf, 0, sizeof(execbuf));
+	execbuf.buffers_ptr = to_user_pointer(obj);
+	execbuf.buffer_count = count + 1;
+
+	if (mode == SWEEP_SOFTPIN) {
+		/* The batch first, the objects packed after it */
+		for (n = 0; n <= count; n++) {
+			obj[n].flags = EXEC_OBJECT_PINNED |
+				       EXEC_OBJECT_SUPPORTS_48B_ADDRESS;
+			obj[n].offset = n == count ? 0 :
+				batch_size + 4096ull * n;
+		}
+	} else {
+		reloc = calloc(count, sizeof(*reloc));
+		igt_assert(reloc);
+		for (n = 0; n < count; n++) {
+			reloc[n].target_handle =
+				mode == SWEEP_LUT ? n : handles[n];
+			reloc[n].offset = 8 * (n + 1);
+			reloc[n].presumed_offset = -1;
+			reloc[n].read_domains = I915_GEM_DOMAIN_RENDER;
+		}
+		obj[count].relocs_ptr = to_user_pointer(reloc);
+		obj[count].relocation_count = count;
+
+		if (mode != SWEEP_RELOC)
+			execbuf.flags |= LOCAL_I915_EXEC_NO_RELOC;
+		if (mode == SWEEP_LUT)
+			execbuf.flags |= LOCAL_I915_EXEC_HANDLE_LUT;
+	}
+
+	/* Binds everything and writes back the offsets for NO_RELOC */
+	gem_execbuf(fd, &execbuf);
+	gem_sync(fd, obj[count].handle);
+
+	igt_stats_init_with_size(&latency, reps);
+	igt_stats_init_with_size(&cpu, reps);
+
+	while (reps--) {
+		struct timespec start, end;
+		uint64_t cpu_start, elapsed;
+		unsigned int loops = 0;
+
+		cpu_start = cpu_nsec();
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		do {
+			if (mode == SWEEP_RELOC)
+				for (n = 0; n < count; n++)
+					reloc[n].presumed_offset = -1;
+			gem_execbuf(fd, &execbuf);
+			loops++;
+
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			elapsed = nsec(&end) - nsec(&start);
+		} while (elapsed < SWEEP_ROUND_TIME);
+
+		igt_stats_push_float(&latency, 1e-3 * elapsed / loops);
+		igt_stats_push_float(&cpu,
+				     1e-3 * (cpu_nsec() - cpu_start) / loops);
+
+		gem_sync(fd, obj[count].handle);
+	}
+
+	printf("%-8s %6u objects: %10.1f us/execbuf, %10.1f us CPU\n",
+	       sweep_names[mode], count,
+	       igt_stats_get_median(&latency), igt_stats_get_median(&cpu));
+
+	snprintf(name, sizeof(name), "%s-%u-latency", sweep_names[mode], count);
+	igt_bench_result(name, "us", &latency);
+	snprintf(name, sizeof(name), "%s-%u-cpu", sweep_names[mode], count);
+	igt_bench_result(name, "us", &cpu);
+
+	igt_stats_fini(&latency);
+	igt_stats_fini(&cpu);
+
+	gem_close(fd, obj[count].handle);
+	free(reloc);
+	free(obj);
+}
+
+static int sweep(unsigned int max_objects, int reps)
+{
+	uint32_t *handles;
+	unsigned int n;
+	int fd;
+
+	fd = drm_open_driver(DRIVER_INTEL);
+
+	handles = calloc(max_objects, sizeof(*handles));
+	igt_assert(handles);
+	for (n = 0; n < max_objects; n++)
+		handles[n] = gem_create(fd, 4096);
+
+	igt_bench_begin("gem_exec_reloc");
+	igt_bench_param("max_objects", "%u", max_objects);
+	igt_bench_param("reps", "%d", reps);
+
+	/* Softpin last, the other modes would relocate the pinned objects */
+	for (enum sweep_mode mode = 0; mode < NUM_SWEEP_MODES; mode++) {
+		if (mode == SWEEP_SOFTPIN && !gem_has_softpin(fd)) {
+			printf("softpin not supported\n");
+			continue;
+		}
+
+		for (n = 1; n <= max_objects; n *= 4)
+			sweep_one(fd, mode, handles, n, reps);
+	}
+
+	igt_bench_end();
+
+	for (n = 0; n < max_objects; n++)
+		gem_close(fd, handles[n]);
+	free(handles);
+	close(fd);
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	unsigned num_objects = 1, num_relocs = 0, flags = 0;
+	unsigned max_objects = 0;
 	unsigned size = 4096;
 	int reps = 13;
 	int c;
 
-	while ((c = getopt (argc, argv, "b:r:s:e:l:m:o:")) != -1) {
+	while ((c = getopt (argc, argv, "b:r:s:e:l:m:o:S::")) != -1) {
 		switch (c) {
+		case 'S':
+			/* Sweep the object counts up to the given one */
+			max_objects = optarg ? atoi(optarg) : SWEEP_MAX_OBJECTS;
+			if (max_objects < 1)
+				max_objects = 1;
+			if (max_objects > SWEEP_MAX_OBJECTS)
+				max_objects = SWEEP_MAX_OBJECTS;
+			break;
+
 		case 'l':
 			reps = atoi(optarg);
 			if (reps < 1)
@@ -255,5 +453,8 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (max_objects)
+		return sweep(max_objects, reps);
+
 	return run(size, flags, num_objects, num_relocs, reps);
 }
@@ -38,12 +38,14 @@
 #include <sys/time.h>
 #include <time.h>
 #include <assert.h>
+#include <poll.h>
 
 #include "drm.h"
 #include "ioctl_wrappers.h"
 #include "drmtest.h"
 #include "intel_io.h"
 #include "igt_stats.h"
+#include "sw_sync.h"
 
 enum {
 	ADD_BO = 0,
@@ -52,6 +54,7 @@ enum {
 	DEL_CTX,
 	EXEC,
 	WAIT,
+	COMPLETE,
 };
 
 struct trace_add_bo {
@@ -91,6 +94,26 @@ struct trace_wait {
 	uint32_t handle;
 } __attribute__((packed));
 
+struct trace_complete {
+	uint64_t submitted;
+} __attribute__((packed));
+
+/*
+ * When pacing the replay (-p), every execbuf is timed by its out-fence so
+ * that its latency can be compared against the one recorded at capture.
+ */
+#define MAX_PENDING_FENCES 1024
+
+struct exec_timing {
+	uint64_t captured; /* time of the EXEC record */
+	uint64_t capture_latency;
+	uint64_t submitted;
+	uint64_t replay_latency;
+	int fence;
+};
+
+static double speed;
+
 static uint32_t hars_petruska_f54_1_random(void)
 {
 	static uint32_t state = 0x12345678;
@@ -105,6 +128,106 @@ static double elapsed(const struct timespec *start, const struct timespec *end)
 	return 1e3*(end->tv_sec - start->tv_sec) + 1e-6*(end->tv_nsec - start->tv_nsec);
 }
 
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void pace(uint64_t start, uint64_t time)
+{
+	struct timespec ts;
+	uint64_t target;
+
+	target = start + time / speed;
+	ts.tv_sec = target / 1000000000;
+	ts.tv_nsec = target % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+static uint8_t next_record(uint8_t **ptr, uint32_t version,
+			   uint64_t start, uint64_t *t0, uint64_t *time)
+{
+	uint8_t cmd;
+
+	if (version >= 2) {
+		memcpy(time, *ptr, sizeof(*time));
+		*ptr += sizeof(*time);
+		if (!*t0)
+			*t0 = *time;
+	}
+
+	cmd = *(*ptr)++;
+	if (speed && cmd != COMPLETE)
+		pace(start, *time - *t0);
+
+	return cmd;
+}
+
+static void reap_fences(struct exec_timing *timings, int *pending,
+			int *num_pending, int timeout)
+{
+	struct pollfd pfd[MAX_PENDING_FENCES];
+	int i, j;
+
+	for (i = 0; i < *num_pending; i++) {
+		pfd[i].fd = timings[pending[i]].fence;
+		pfd[i].events = POLLIN;
+	}
+
+	if (poll(pfd, *num_pending, timeout) <= 0)
+		return;
+
+	for (i = j = 0; i < *num_pending; i++) {
+		struct exec_timing *et = &timings[pending[i]];
+		uint64_t done;
+
+		if (!pfd[i].revents) {
+			pending[j++] = pending[i];
+			continue;
+		}
+
+		done = sync_fence_timestamp(et->fence);
+		if (done > et->submitted)
+			et->replay_latency = done - et->submitted;
+		close(et->fence);
+		et->fence = -1;
+	}
+	*num_pending = j;
+}
+
+static void report_latency(const char *filename,
+			   const struct exec_timing *timings, int count)
+{
+	igt_stats_t stats;
+
+	igt_stats_init_with_size(&stats, count);
+	for (int i = 0; i < count; i++) {
+		if (!timings[i].capture_latency || !timings[i].replay_latency)
+			continue;
+
+		igt_stats_push_float(&stats,
+				     1e-3 * ((double)timings[i].replay_latency -
+					     (double)timings[i].capture_latency));
+	}
+
+	if (stats.n_values)
+		printf("%s: %u execbufs, latency deviation median %.1fus, p90 %.1fus, p99 %.1fus, max %.1fus\n",
+		       filename, stats.n_values,
+		       igt_stats_get_median(&stats),
+		       igt_stats_get_percentile(&stats, 90),
+		       igt_stats_get_percentile(&stats, 99),
+		       igt_stats_get_percentile(&stats, 100));
+	else
+		printf("%s: no completion records to compare against\n",
+		       filename);
+
+	igt_stats_fini(&stats);
+}
+
 static uint32_t __gem_context_create_local(int fd)
 {
 	struct drm_i915_gem_context_create arg = {};
@@ -122,11 +245,16 @@ static double replay(const char *filename, long nop, long range)
 	} *tv;
 	const uint32_t bbe = 0xa << 23;
 	struct drm_i915_gem_exec_object2 *exec_objects = NULL;
+	struct exec_timing *timings = NULL;
+	int num_timings = 0, max_timings = 0;
+	int pending[MAX_PENDING_FENCES], num_pending = 0;
+	uint64_t time = 0, t0 = 0, start = 0;
 	uint32_t *bo, *ctx;
 	int num_bo, num_ctx;
 	int max_objects = 0;
 	struct stat st;
 	uint8_t *ptr, *end;
+	uint8_t cmd;
 	int fd;
 
 	fd = open(filename, O_RDONLY);
@@ -152,13 +280,19 @@ static double replay(const char *filename, long nop, long range)
 		fprintf(stderr, "%s: invalid magic\n", filename);
 		return -1;
 	}
-	if (tv->version != 1) {
+	if (tv->version != 1 && tv->version != 2) {
 		fprintf(stderr, "%s: unhandled version %d\n",
 			filename, tv->version);
 		return -1;
 	}
 	ptr = (void *)(tv + 1);
 
+	if (speed && tv->version < 2) {
+		fprintf(stderr, "%s: no timestamps to pace the replay by\n",
+			filename);
+		return -1;
+	}
+
 	ctx = calloc(1024, sizeof(*ctx));
 	num_ctx = 1024;
 
@@ -178,7 +312,8 @@ static double replay(const char *filename, long nop, long range)
 	}
 
 	clock_gettime(CLOCK_MONOTONIC, &t_start);
-	do switch (*ptr++) {
+	start = now();
+	do switch ((cmd = next_record(&ptr, tv->version, start, &t0, &time))) {
 	case ADD_BO:
 		{
 			struct trace_add_bo *t = (void *)ptr;
@@ -281,7 +416,33 @@ static double replay(const char *filename, long nop, long range)
 					((uint64_t)eb.batch_start_offset * range) >> 32;
 				eb.batch_start_offset = ALIGN(eb.batch_start_offset, 64);
 			}
-			gem_execbuf(fd, &eb);
+
+			if (!speed) {
+				gem_execbuf(fd, &eb);
+				break;
+			}
+
+			if (num_timings == max_timings) {
+				max_timings = max_timings ? 2 * max_timings : 4096;
+				timings = realloc(timings,
+						  max_timings * sizeof(*timings));
+				assert(timings);
+			}
+
+			while (num_pending == MAX_PENDING_FENCES)
+				reap_fences(timings, pending, &num_pending, -1);
+
+			eb.flags |= I915_EXEC_FENCE_OUT;
+			eb.rsvd2 = 0;
+			timings[num_timings].captured = time;
+			timings[num_timings].capture_latency = 0;
+			timings[num_timings].replay_latency = 0;
+			timings[num_timings].submitted = now();
+			gem_execbuf_wr(fd, &eb);
+			timings[num_timings].fence = eb.rsvd2 >> 32;
+			pending[num_pending++] = num_timings++;
+
+			reap_fences(timings, pending, &num_pending, 0);
 			break;
 		}
 
@@ -295,12 +456,36 @@ static double replay(const char *filename, long nop, long range)
 			break;
 		}
 
+	case COMPLETE:
+		{
+			struct trace_complete *t = (void *)ptr;
+			ptr = (void *)(t + 1);
+
+			/* Completions are recorded shortly after their exec */
+			for (int i = num_timings; i--; ) {
+				if (timings[i].captured == t->submitted) {
+					if (time > t->submitted)
+						timings[i].capture_latency =
+							time - t->submitted;
+					break;
+				}
+			}
+			break;
+		}
+
 	default:
-		fprintf(stderr, "Unknown cmd: %x\n", *ptr);
+		fprintf(stderr, "Unknown cmd: %x\n", cmd);
 		return -1;
 	} while (ptr < end);
+
+	while (num_pending)
+		reap_fences(timings, pending, &num_pending, -1);
 	clock_gettime(CLOCK_MONOTONIC, &t_end);
 
+	if (speed)
+		report_latency(filename, timings, num_timings);
+	free(timings);
+
 	return elapsed(&t_start, &t_end);
 }
 
@@ -374,8 +559,19 @@ int main(int argc, char **argv)
 	results = mmap(NULL, ALIGN(argc*sizeof(double), 4096),
 		       PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
 
-	while ((c = getopt(argc, argv, "d:n:r:")) != -1) {
+	while ((c = getopt(argc, argv, "d:n:r:ps:")) != -1) {
 		switch (c) {
+		case 'p':
+			if (!speed)
+				speed = 1.;
+			break;
+		case 's':
+			speed = atof(optarg);
+			if (speed <= 0.) {
+				fprintf(stderr, "Invalid speed: %s\n", optarg);
+				return 1;
+			}
+			break;
 		case 'd':
 			delay = atoi(optarg);
 			break;
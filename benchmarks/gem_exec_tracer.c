@@ -34,9 +34,15 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/sync_file.h>
 #include <dlfcn.h>
 #include <i915_drm.h>
 #include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
 
 #include "intel_aub.h"
 #include "intel_chipset.h"
@@ -46,9 +52,75 @@ static int (*libc_ioctl)(int fd, unsigned long request, void *argp);
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Flight recorder.
+ *
+ * With GEM_EXEC_TRACER_RING=<MiB> set, nothing is written out while the
+ * application runs. Instead, each traced fd keeps its latest records in a
+ * memory ring of that size. GEM_EXEC_TRACER_WINDOW=<seconds> also drops
+ * the records older than that, and is enough to enable the recorder on its
+ * own, with a 64 MiB ring.
+ *
+ * The records evicted from a ring are folded into the set of bos and
+ * contexts alive before the oldest record left. A dump recreates those
+ * first, so that it replays with gem_exec_trace like any other trace.
+ *
+ * The rings are dumped to /tmp/trace-<pid>.<fd>.<n> when the process
+ * receives SIGUSR2, when i915 reports a GPU hang through an ERROR uevent,
+ * or when an execbuf or wait takes longer than GEM_EXEC_TRACER_LATENCY=<ms>.
+ */
+struct record {
+	uint64_t time;
+	uint32_t len;
+} __attribute__((packed));
+
+struct ring {
+	pthread_mutex_t lock;
+	char *data;
+	uint64_t size;
+	uint64_t head, tail; /* the next and the oldest record */
+	uint64_t pos; /* write position within the current record */
+	bool skip; /* the current record does not fit */
+
+	/* bos and contexts alive before the oldest record */
+	uint64_t *bo_size;
+	uint32_t num_bo;
+	uint8_t *ctx;
+	uint32_t num_ctx;
+
+	unsigned int dumps;
+};
+
+static struct {
+	uint64_t size;
+	uint64_t window; /* ns */
+	uint64_t latency; /* ns */
+	int trigger[2];
+} recorder;
+
+/*
+ * With GEM_EXEC_TRACER_COMPLETION set, every execbuf also asks for an
+ * out-fence, and the time the fence signaled is recorded as a COMPLETE
+ * record once we notice, so that replays can compare their latencies.
+ */
+#define MAX_PENDING_FENCES 1024
+
+struct pending_fence {
+	int fence;
+	uint64_t submitted;
+};
+
+static bool track_completion;
+
 struct trace {
 	int fd;
 	FILE *file;
+	struct ring *ring;
+
+	pthread_mutex_t fence_lock;
+	struct pending_fence *fences;
+	unsigned int num_fences;
+
 	struct trace *next;
 } *traces;
 
@@ -61,6 +133,7 @@ enum {
 	DEL_CTX,
 	EXEC,
 	WAIT,
+	COMPLETE,
 };
 
 static struct trace_verion {
@@ -68,7 +141,7 @@ static struct trace_verion {
 	uint32_t version;
 } version = {
 	.magic = 0xdeadbeef,
-	.version = 1
+	.version = 2 /* each record is prefixed by its time */
 };
 
 struct trace_add_bo {
@@ -121,6 +194,11 @@ struct trace_wait {
 	uint32_t handle;
 } __attribute__((packed));
 
+struct trace_complete {
+	uint8_t cmd;
+	uint64_t submitted; /* time of the EXEC record */
+} __attribute__((packed));
+
 static void __attribute__ ((format(__printf__, 2, 3)))
 fail_if(int cond, const char *format, ...)
 {
@@ -136,10 +214,186 @@ fail_if(int cond, const char *format, ...)
 	abort();
 }
 
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *
+grow_array(void *ptr, uint32_t *count, uint32_t index, size_t elem)
+{
+	uint32_t new_count;
+
+	if (index < *count)
+		return ptr;
+
+	new_count = (index + 4096) & -4096;
+	ptr = realloc(ptr, new_count * elem);
+	fail_if(ptr == NULL, "out of memory\n");
+	memset((char *)ptr + *count * elem, 0, (new_count - *count) * elem);
+	*count = new_count;
+
+	return ptr;
+}
+
+static void
+ring_write(struct ring *r, uint64_t pos, const void *data, size_t len)
+{
+	while (len) {
+		uint64_t offset = pos % r->size;
+		size_t n = len < r->size - offset ? len : r->size - offset;
+
+		memcpy(r->data + offset, data, n);
+		data = (const char *)data + n;
+		pos += n;
+		len -= n;
+	}
+}
+
+static void
+ring_read(const struct ring *r, uint64_t pos, void *data, size_t len)
+{
+	while (len) {
+		uint64_t offset = pos % r->size;
+		size_t n = len < r->size - offset ? len : r->size - offset;
+
+		memcpy(data, r->data + offset, n);
+		data = (char *)data + n;
+		pos += n;
+		len -= n;
+	}
+}
+
+static void
+ring_evict(struct ring *r)
+{
+	uint8_t cmd[1 + sizeof(uint32_t) + sizeof(uint64_t)] = {};
+	struct record rec;
+	uint32_t handle;
+	uint64_t size;
+
+	ring_read(r, r->tail, &rec, sizeof(rec));
+	ring_read(r, r->tail + sizeof(rec), cmd,
+		  rec.len < sizeof(cmd) ? rec.len : sizeof(cmd));
+	r->tail += sizeof(rec) + rec.len;
+
+	memcpy(&handle, cmd + 1, sizeof(handle));
+	switch (cmd[0]) {
+	case ADD_BO:
+		memcpy(&size, cmd + 5, sizeof(size));
+		r->bo_size = grow_array(r->bo_size, &r->num_bo, handle,
+					sizeof(*r->bo_size));
+		r->bo_size[handle] = size;
+		break;
+	case DEL_BO:
+		if (handle < r->num_bo)
+			r->bo_size[handle] = 0;
+		break;
+	case ADD_CTX:
+		r->ctx = grow_array(r->ctx, &r->num_ctx, handle,
+				    sizeof(*r->ctx));
+		r->ctx[handle] = 1;
+		break;
+	case DEL_CTX:
+		if (handle < r->num_ctx)
+			r->ctx[handle] = 0;
+		break;
+	}
+}
+
+static void
+ring_expire(struct ring *r, uint64_t time)
+{
+	struct record rec;
+
+	if (!recorder.window)
+		return;
+
+	while (r->head != r->tail) {
+		ring_read(r, r->tail, &rec, sizeof(rec));
+		if (rec.time + recorder.window >= time)
+			break;
+
+		ring_evict(r);
+	}
+}
+
+/* Each record is written as a whole, between record_begin() and record_end() */
+static void
+record_begin(struct trace *trace, uint64_t time, size_t len)
+{
+	struct ring *r = trace->ring;
+	struct record rec = { time, len };
+
+	if (!r) {
+		flockfile(trace->file);
+		fwrite(&time, sizeof(time), 1, trace->file);
+		return;
+	}
+
+	pthread_mutex_lock(&r->lock);
+
+	ring_expire(r, rec.time);
+	while (r->head != r->tail &&
+	       r->head - r->tail + sizeof(rec) + len > r->size)
+		ring_evict(r);
+
+	r->skip = sizeof(rec) + len > r->size;
+	if (r->skip)
+		return;
+
+	ring_write(r, r->head, &rec, sizeof(rec));
+	r->pos = r->head + sizeof(rec);
+}
+
+static void
+record_data(struct trace *trace, const void *data, size_t len)
+{
+	struct ring *r = trace->ring;
+
+	if (!r) {
+		fwrite(data, len, 1, trace->file);
+		return;
+	}
+
+	if (r->skip)
+		return;
+
+	ring_write(r, r->pos, data, len);
+	r->pos += len;
+}
+
+static void
+record_end(struct trace *trace)
+{
+	struct ring *r = trace->ring;
+
+	if (!r) {
+		funlockfile(trace->file);
+		return;
+	}
+
+	if (!r->skip)
+		r->head = r->pos;
+
+	pthread_mutex_unlock(&r->lock);
+}
+
+static void
+record(struct trace *trace, const void *data, size_t len)
+{
+	record_begin(trace, now(), len);
+	record_data(trace, data, len);
+	record_end(trace);
+}
+
 #define LOCAL_I915_EXEC_FENCE_IN              (1<<16)
 #define LOCAL_I915_EXEC_FENCE_OUT             (1<<17)
 
-static void
+static uint64_t
 trace_exec(struct trace *trace,
 	   const struct drm_i915_gem_execbuffer2 *execbuffer2)
 {
@@ -147,10 +401,18 @@ trace_exec(struct trace *trace,
 	const struct drm_i915_gem_exec_object2 *exec_objects =
 		to_ptr(typeof(*exec_objects), execbuffer2->buffers_ptr);
 
+	size_t len = sizeof(struct trace_exec);
+	uint64_t time = now();
+
 	fail_if(execbuffer2->flags & (LOCAL_I915_EXEC_FENCE_IN | LOCAL_I915_EXEC_FENCE_OUT),
 		"fences not supported yet\n");
 
-	flockfile(trace->file);
+	for (uint32_t i = 0; i < execbuffer2->buffer_count; i++)
+		len += sizeof(struct trace_exec_object) +
+			exec_objects[i].relocation_count *
+			sizeof(struct drm_i915_gem_relocation_entry);
+
+	record_begin(trace, time, len);
 	{
 		struct trace_exec t = {
 			EXEC,
@@ -158,7 +420,7 @@ trace_exec(struct trace *trace,
 			execbuffer2->flags,
 			execbuffer2->rsvd1,
 		};
-		fwrite(&t, sizeof(t), 1, trace->file);
+		record_data(trace, &t, sizeof(t));
 	}
 
 	for (uint32_t i = 0; i < execbuffer2->buffer_count; i++) {
@@ -175,14 +437,17 @@ trace_exec(struct trace *trace,
 				obj->rsvd1,
 				obj->rsvd2
 			};
-			fwrite(&t, sizeof(t), 1, trace->file);
+			record_data(trace, &t, sizeof(t));
 		}
-		fwrite(relocs, sizeof(*relocs), obj->relocation_count,
-		       trace->file);
+		record_data(trace, relocs,
+			    sizeof(*relocs) * obj->relocation_count);
 	}
 
-	fflush(trace->file);
-	funlockfile(trace->file);
+	if (!trace->ring)
+		fflush(trace->file);
+	record_end(trace);
+
+	return time;
 #undef to_ptr
 }
 
@@ -190,35 +455,359 @@ static void
 trace_wait(struct trace *trace, uint32_t handle)
 {
 	struct trace_wait t = { WAIT, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	record(trace, &t, sizeof(t));
 }
 
 static void
 trace_add(struct trace *trace, uint32_t handle, uint64_t size)
 {
 	struct trace_add_bo t = { ADD_BO, handle, size };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	record(trace, &t, sizeof(t));
 }
 
 static void
 trace_del(struct trace *trace, uint32_t handle)
 {
 	struct trace_del_bo t = { DEL_BO, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	record(trace, &t, sizeof(t));
 }
 
 static void
 trace_add_context(struct trace *trace, uint32_t handle)
 {
 	struct trace_add_ctx t = { ADD_CTX, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	record(trace, &t, sizeof(t));
 }
 
 static void
 trace_del_context(struct trace *trace, uint32_t handle)
 {
 	struct trace_del_ctx t = { DEL_CTX, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	record(trace, &t, sizeof(t));
+}
+
+static void
+ring_dump(struct trace *trace)
+{
+	struct ring *r = trace->ring;
+	char filename[80];
+	char *buf, *ptr;
+	uint64_t start;
+	FILE *file;
+	size_t len;
+
+	/* Copy the trace out first, to hold up the application the least */
+	pthread_mutex_lock(&r->lock);
+	start = now();
+	ring_expire(r, start);
+	if (r->head != r->tail) {
+		struct record rec;
+
+		ring_read(r, r->tail, &rec, sizeof(rec));
+		start = rec.time;
+	}
+
+	/* Each record header in the ring is larger than the time we write */
+	len = sizeof(version) + r->head - r->tail;
+	len += r->num_bo * (sizeof(start) + sizeof(struct trace_add_bo));
+	len += r->num_ctx * (sizeof(start) + sizeof(struct trace_add_ctx));
+	ptr = buf = malloc(len);
+	if (!buf) {
+		pthread_mutex_unlock(&r->lock);
+		return;
+	}
+
+	memcpy(ptr, &version, sizeof(version));
+	ptr += sizeof(version);
+
+	for (uint32_t i = 0; i < r->num_bo; i++) {
+		struct trace_add_bo t = { ADD_BO, i, r->bo_size[i] };
+
+		if (!r->bo_size[i])
+			continue;
+
+		memcpy(ptr, &start, sizeof(start));
+		ptr += sizeof(start);
+		memcpy(ptr, &t, sizeof(t));
+		ptr += sizeof(t);
+	}
+
+	for (uint32_t i = 0; i < r->num_ctx; i++) {
+		struct trace_add_ctx t = { ADD_CTX, i };
+
+		if (!r->ctx[i])
+			continue;
+
+		memcpy(ptr, &start, sizeof(start));
+		ptr += sizeof(start);
+		memcpy(ptr, &t, sizeof(t));
+		ptr += sizeof(t);
+	}
+
+	for (uint64_t pos = r->tail; pos != r->head; ) {
+		struct record rec;
+
+		ring_read(r, pos, &rec, sizeof(rec));
+		memcpy(ptr, &rec.time, sizeof(rec.time));
+		ptr += sizeof(rec.time);
+		ring_read(r, pos + sizeof(rec), ptr, rec.len);
+		ptr += rec.len;
+		pos += sizeof(rec) + rec.len;
+	}
+
+	sprintf(filename, "/tmp/trace-%d.%d.%u",
+		getpid(), trace->fd, r->dumps++);
+	pthread_mutex_unlock(&r->lock);
+
+	file = fopen(filename, "w");
+	if (file) {
+		if (fwrite(buf, ptr - buf, 1, file))
+			fprintf(stderr, "gem_exec_tracer: dumped %s\n",
+				filename);
+		fclose(file);
+	}
+	free(buf);
+}
+
+static void
+recorder_trigger(void)
+{
+	char c = 0;
+
+	/* Never blocks, and a full pipe already has a dump pending */
+	if (write(recorder.trigger[1], &c, 1) < 0)
+		return;
+}
+
+static void
+recorder_signal(int sig)
+{
+	int err = errno;
+
+	recorder_trigger();
+	errno = err;
+}
+
+static int
+uevent_open(void)
+{
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1, /* kernel uevents */
+	};
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -1;
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		libc_close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* i915 sends a "change" uevent with ERROR=1 on its card once it hangs */
+static bool
+uevent_is_hang(const char *msg, size_t len)
+{
+	if (!strstr(msg, "/drm/card"))
+		return false;
+
+	for (size_t i = strlen(msg) + 1; i < len; i += strlen(msg + i) + 1) {
+		if (!strcmp(msg + i, "ERROR=1"))
+			return true;
+	}
+
+	return false;
+}
+
+static void *
+recorder_thread(void *arg)
+{
+	struct pollfd pfd[2] = {
+		{ .fd = recorder.trigger[0], .events = POLLIN },
+		{ .fd = uevent_open(), .events = POLLIN },
+	};
+
+	for (;;) {
+		char buf[4096];
+		bool dump = false;
+		ssize_t len;
+
+		if (poll(pfd, 2, -1) < 0)
+			continue;
+
+		if (pfd[0].revents) {
+			while (read(pfd[0].fd, buf, sizeof(buf)) > 0)
+				;
+			dump = true;
+		}
+
+		if (pfd[1].revents) {
+			while ((len = recv(pfd[1].fd, buf, sizeof(buf) - 1,
+					   MSG_DONTWAIT)) > 0) {
+				buf[len] = '\0';
+				dump |= uevent_is_hang(buf, len);
+			}
+		}
+
+		if (!dump)
+			continue;
+
+		pthread_mutex_lock(&mutex);
+		for (struct trace *t = traces; t; t = t->next)
+			ring_dump(t);
+		pthread_mutex_unlock(&mutex);
+	}
+
+	return NULL;
+}
+
+static void
+recorder_start(void)
+{
+	struct sigaction sa = {
+		.sa_handler = recorder_signal,
+		.sa_flags = SA_RESTART,
+	};
+	pthread_t thread;
+
+	fail_if(pipe2(recorder.trigger, O_NONBLOCK | O_CLOEXEC),
+		"failed to create the flight recorder trigger\n");
+	sigaction(SIGUSR2, &sa, NULL);
+
+	fail_if(pthread_create(&thread, NULL, recorder_thread, NULL),
+		"failed to start the flight recorder\n");
+	pthread_detach(thread);
+}
+
+static struct ring *
+ring_create(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	struct ring *r;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+
+	r->size = recorder.size;
+	r->data = malloc(r->size);
+	if (!r->data) {
+		free(r);
+		return NULL;
+	}
+	pthread_mutex_init(&r->lock, NULL);
+
+	pthread_once(&once, recorder_start);
+
+	return r;
+}
+
+static void
+ring_destroy(struct ring *r)
+{
+	pthread_mutex_destroy(&r->lock);
+	free(r->bo_size);
+	free(r->ctx);
+	free(r->data);
+	free(r);
+}
+
+static uint64_t
+fence_timestamp(int fence)
+{
+	struct sync_fence_info fence_info = {};
+	struct sync_file_info info = {
+		.num_fences = 1,
+		.sync_fence_info = (uintptr_t)&fence_info,
+	};
+
+	if (ioctl(fence, SYNC_IOC_FILE_INFO, &info) || info.status != 1)
+		return 0;
+
+	return fence_info.timestamp_ns;
+}
+
+/* Record the completion of the batches whose out-fence has signaled */
+static void
+reap_fences(struct trace *trace, int timeout)
+{
+	struct pollfd pfd[MAX_PENDING_FENCES];
+	unsigned int i, j;
+
+	for (i = 0; i < trace->num_fences; i++) {
+		pfd[i].fd = trace->fences[i].fence;
+		pfd[i].events = POLLIN;
+	}
+
+	if (poll(pfd, trace->num_fences, timeout) <= 0)
+		return;
+
+	for (i = j = 0; i < trace->num_fences; i++) {
+		struct pending_fence *f = &trace->fences[i];
+		struct trace_complete t = { COMPLETE, f->submitted };
+		uint64_t time;
+
+		if (!pfd[i].revents) {
+			trace->fences[j++] = *f;
+			continue;
+		}
+
+		time = fence_timestamp(f->fence);
+		if (time) {
+			record_begin(trace, time, sizeof(t));
+			record_data(trace, &t, sizeof(t));
+			record_end(trace);
+		}
+		libc_close(f->fence);
+	}
+	trace->num_fences = j;
+}
+
+static void
+track_fence(struct trace *trace, int fence, uint64_t submitted)
+{
+	pthread_mutex_lock(&trace->fence_lock);
+
+	if (!trace->fences) {
+		trace->fences = calloc(MAX_PENDING_FENCES,
+				       sizeof(*trace->fences));
+		fail_if(!trace->fences, "out of memory\n");
+	}
+
+	while (trace->num_fences == MAX_PENDING_FENCES)
+		reap_fences(trace, -1);
+
+	trace->fences[trace->num_fences].fence = fence;
+	trace->fences[trace->num_fences].submitted = submitted;
+	trace->num_fences++;
+
+	reap_fences(trace, 0);
+
+	pthread_mutex_unlock(&trace->fence_lock);
+}
+
+static void
+trace_destroy(struct trace *t)
+{
+	/* Give the batches still in flight a moment to complete */
+	for (int retry = 0; t->num_fences && retry < 10; retry++)
+		reap_fences(t, 100);
+	for (unsigned int i = 0; i < t->num_fences; i++)
+		libc_close(t->fences[i].fence);
+	free(t->fences);
+	pthread_mutex_destroy(&t->fence_lock);
+
+	if (t->ring)
+		ring_destroy(t->ring);
+	else
+		fclose(t->file);
+	free(t);
 }
 
 int
@@ -230,8 +819,7 @@ close(int fd)
 	for (p = &traces; (t = *p); p = &t->next) {
 		if (t->fd == fd) {
 			*p = t->next;
-			fclose(t->file);
-			free(t);
+			trace_destroy(t);
 			break;
 		}
 	}
@@ -276,6 +864,8 @@ int
 ioctl(int fd, unsigned long request, ...)
 {
 	struct trace *t, **p;
+	struct drm_i915_gem_execbuffer2 *eb = NULL;
+	uint64_t submitted = 0, rsvd2 = 0;
 	va_list args;
 	void *argp;
 	int ret;
@@ -312,15 +902,30 @@ ioctl(int fd, unsigned long request, ...)
 			return -ENOMEM;
 		}
 
-		sprintf(filename, "/tmp/trace-%d.%d", getpid(), fd);
-		t->file = fopen(filename, "w+");
 		t->fd = fd;
-
-		if (!fwrite(&version, sizeof(version), 1, t->file)) {
-			pthread_mutex_unlock(&mutex);
-			fclose(t->file);
-			free(t);
-			return -ENOMEM;
+		t->file = NULL;
+		t->ring = NULL;
+		t->fences = NULL;
+		t->num_fences = 0;
+		pthread_mutex_init(&t->fence_lock, NULL);
+
+		if (recorder.size) {
+			t->ring = ring_create();
+			if (!t->ring) {
+				pthread_mutex_unlock(&mutex);
+				free(t);
+				return -ENOMEM;
+			}
+		} else {
+			sprintf(filename, "/tmp/trace-%d.%d", getpid(), fd);
+			t->file = fopen(filename, "w+");
+
+			if (!fwrite(&version, sizeof(version), 1, t->file)) {
+				pthread_mutex_unlock(&mutex);
+				fclose(t->file);
+				free(t);
+				return -ENOMEM;
+			}
 		}
 
 		t->next = traces;
@@ -331,7 +936,13 @@ ioctl(int fd, unsigned long request, ...)
 	switch (request) {
 	case DRM_IOCTL_I915_GEM_EXECBUFFER2:
 	case LOCAL_IOCTL_I915_GEM_EXECBUFFER2_WR:
-		trace_exec(t, argp);
+		submitted = trace_exec(t, argp);
+		if (track_completion) {
+			eb = argp;
+			rsvd2 = eb->rsvd2;
+			eb->flags |= LOCAL_I915_EXEC_FENCE_OUT;
+			request = LOCAL_IOCTL_I915_GEM_EXECBUFFER2_WR;
+		}
 		break;
 
 	case DRM_IOCTL_GEM_CLOSE: {
@@ -359,7 +970,28 @@ ioctl(int fd, unsigned long request, ...)
 	}
 	}
 
-	ret = libc_ioctl(fd, request, argp);
+	if (recorder.latency &&
+	    (request == DRM_IOCTL_I915_GEM_EXECBUFFER2 ||
+	     request == LOCAL_IOCTL_I915_GEM_EXECBUFFER2_WR ||
+	     request == DRM_IOCTL_I915_GEM_WAIT ||
+	     request == DRM_IOCTL_I915_GEM_SET_DOMAIN)) {
+		uint64_t start = now();
+
+		ret = libc_ioctl(fd, request, argp);
+		if (now() - start > recorder.latency)
+			recorder_trigger();
+	} else {
+		ret = libc_ioctl(fd, request, argp);
+	}
+
+	/* Hide our out-fence from the application */
+	if (eb) {
+		eb->flags &= ~LOCAL_I915_EXEC_FENCE_OUT;
+		if (ret == 0)
+			track_fence(t, eb->rsvd2 >> 32, submitted);
+		eb->rsvd2 = rsvd2;
+	}
+
 	if (ret)
 		return ret;
 
@@ -416,4 +1048,17 @@ init(void)
 	libc_ioctl = dlsym(RTLD_NEXT, "ioctl");
 	fail_if(libc_close == NULL || libc_ioctl == NULL,
 		"failed to get libc ioctl or close\n");
+
+	if (getenv("GEM_EXEC_TRACER_WINDOW")) {
+		recorder.window = atof(getenv("GEM_EXEC_TRACER_WINDOW")) * 1e9;
+		recorder.size = 64ull << 20;
+	}
+	if (getenv("GEM_EXEC_TRACER_RING"))
+		recorder.size = atoll(getenv("GEM_EXEC_TRACER_RING")) << 20;
+	if (getenv("GEM_EXEC_TRACER_LATENCY"))
+		recorder.latency = atof(getenv("GEM_EXEC_TRACER_LATENCY")) * 1e6;
+	if (!recorder.size)
+		recorder.latency = 0;
+
+	track_completion = getenv("GEM_EXEC_TRACER_COMPLETION");
 }
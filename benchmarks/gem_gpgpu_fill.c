@@ -0,0 +1,199 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures how fast the gpgpu fill covers a whole buffer depending on how
+ * many hardware threads it may be spread over, doubling them from one up to
+ * all of those of the device.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include "igt_freq.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static void run_threads(int fd, struct intel_batchbuffer *batch,
+			igt_threaded_fillfunc_t fill, struct igt_buf *buf,
+			int width, int height, unsigned int threads,
+			int reps, int loops)
+{
+	char name[32];
+	igt_stats_t stats;
+
+	igt_stats_init_with_size(&stats, reps);
+
+	for (int r = 0; r < reps; r++) {
+		struct timespec start, end;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int n = 0; n < loops; n++)
+			fill(batch, buf, 0, 0, width, height, n, threads);
+		gem_sync(fd, buf->bo->handle);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		igt_stats_push_float(&stats,
+				     loops * 1. * width * height /
+				     (1024 * 1024) /
+				     elapsed(&start, &end));
+	}
+
+	snprintf(name, sizeof(name), "threads-%u", threads);
+	printf("%4u threads %9.1f MiB/s\n",
+	       threads, igt_stats_get_median(&stats));
+	igt_bench_result(name, "MiB/s", &stats);
+	igt_stats_fini(&stats);
+}
+
+static int run(int width, int height, unsigned int threads,
+	       int reps, int loops)
+{
+	igt_threaded_fillfunc_t fill;
+	struct intel_batchbuffer *batch;
+	drm_intel_bufmgr *bufmgr;
+	struct igt_buf buf = {};
+	unsigned int max;
+	uint32_t devid;
+	int fd;
+
+	fd = drm_open_driver(DRIVER_INTEL);
+	devid = intel_get_drm_devid(fd);
+	igt_freq_bench_setup(fd);
+
+	fill = igt_get_gpgpu_threaded_fillfunc(devid);
+	if (!fill) {
+		fprintf(stderr, "no gpgpu fill function\n");
+		return 77;
+	}
+
+	max = igt_gpgpu_max_threads(fd);
+	if (!max && !threads) {
+		fprintf(stderr,
+			"unknown number of EUs, set the threads with -t\n");
+		return 77;
+	}
+
+	bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
+	igt_assert(bufmgr);
+	batch = intel_batchbuffer_alloc(bufmgr, devid);
+	igt_assert(batch);
+
+	/* One byte per pixel, each thread filling a 16x1 block */
+	buf.bo = drm_intel_bo_alloc(bufmgr, "", width * height, 4096);
+	igt_assert(buf.bo);
+	buf.stride = width;
+	buf.tiling = I915_TILING_NONE;
+	buf.size = width * height;
+	buf.bpp = 8;
+
+	if (threads) {
+		run_threads(fd, batch, fill, &buf, width, height, threads,
+			    reps, loops);
+	} else {
+		for (threads = 1; threads < max; threads *= 2)
+			run_threads(fd, batch, fill, &buf, width, height,
+				    threads, reps, loops);
+		run_threads(fd, batch, fill, &buf, width, height, max,
+			    reps, loops);
+	}
+
+	drm_intel_bo_unreference(buf.bo);
+	intel_batchbuffer_free(batch);
+	drm_intel_bufmgr_destroy(bufmgr);
+	close(fd);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int width = 4096;
+	int height = 4096;
+	unsigned int threads = 0;
+	int reps = 5;
+	int loops = 10;
+	int c;
+
+	while ((c = getopt (argc, argv, "w:h:t:r:l:")) != -1) {
+		switch (c) {
+		case 'w':
+			width = ALIGN(atoi(optarg), 16);
+			if (width < 16)
+				width = 16;
+			if (width > 16384)
+				width = 16384;
+			break;
+
+		case 'h':
+			height = atoi(optarg);
+			if (height < 1)
+				height = 1;
+			if (height > 16384)
+				height = 16384;
+			break;
+
+		case 't':
+			threads = atoi(optarg);
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		case 'l':
+			loops = atoi(optarg);
+			if (loops < 1)
+				loops = 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	igt_bench_begin("gem_gpgpu_fill");
+	igt_bench_param("width", "%d", width);
+	igt_bench_param("height", "%d", height);
+	igt_bench_param("threads", "%u", threads);
+	igt_bench_param("reps", "%d", reps);
+	igt_bench_param("loops", "%d", loops);
+
+	c = run(width, height, threads, reps, loops);
+
+	igt_bench_end();
+
+	return c;
+}
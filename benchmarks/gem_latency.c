@@ -28,6 +28,8 @@
 #include <pthread.h>
 
 #include "igt.h"
+#include "igt_bench.h"
+#include "igt_nop.h"
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -54,6 +56,8 @@
 
 static int done;
 static int fd;
+static unsigned int nop_us;
+static uint64_t nop_len = 8;
 static volatile uint32_t *timestamp_reg;
 
 #define REG(x) (volatile uint32_t *)((volatile char *)igt_global_mmio + x)
@@ -137,6 +141,9 @@ struct producer {
 	int nop;
 	int nconsumers;
 	struct consumer *consumers;
+
+	/* From each submission to the wakeup, when not just means are wanted */
+	igt_stats_t *samples;
 };
 
 #define LOCAL_EXEC_NO_RELOC (1<<11)
@@ -282,6 +289,9 @@ static uint32_t create_nop(void)
 	uint32_t buf = MI_BATCH_BUFFER_END;
 	uint32_t handle;
 
+	if (nop_us)
+		return igt_nop_batch(fd, I915_EXEC_BLT, nop_us, &nop_len);
+
 	handle = gem_create(fd, 4096);
 	gem_write(fd, handle, 0, &buf, sizeof(buf));
 
@@ -298,7 +308,7 @@ static void setup_nop(struct producer *p, uint32_t batch, unsigned flags)
 	eb->buffers_ptr = (uintptr_t)p->nop_dispatch.exec;
 	eb->buffer_count = 1;
 	if (flags & CMDPARSER)
-		eb->batch_len = 8;
+		eb->batch_len = nop_len;
 	eb->flags = I915_EXEC_BLT | LOCAL_EXEC_NO_RELOC;
 	eb->rsvd1 = p->ctx;
 }
@@ -309,13 +319,19 @@ static void fence_wait(int fence)
 	poll(&pfd, 1, -1);
 }
 
-static void measure_latency(struct producer *p, struct igt_mean *mean)
+static uint32_t measure_latency(struct producer *p, struct igt_mean *mean)
 {
+	uint32_t latency;
+
 	if (!(p->latency_dispatch.execbuf.flags & LOCAL_I915_EXEC_FENCE_OUT))
 		gem_sync(fd, p->latency_dispatch.exec[0].handle);
 	else
 		fence_wait(p->latency_dispatch.execbuf.rsvd2 >> 32);
-	igt_mean_add(mean, read_timestamp() - *p->last_timestamp);
+
+	latency = read_timestamp() - *p->last_timestamp;
+	igt_mean_add(mean, latency);
+
+	return latency;
 }
 
 static void *producer(void *arg)
@@ -325,6 +341,7 @@ static void *producer(void *arg)
 
 	while (!done) {
 		uint32_t start = read_timestamp();
+		uint32_t latency;
 		int batches;
 
 		/* Control the amount of work we do, similar to submitting
@@ -362,8 +379,11 @@ static void *producer(void *arg)
 		 * and how long it took for the batch to be submitted
 		 * (including the nop delays).
 		 */
-		measure_latency(p, &p->latency);
+		latency = measure_latency(p, &p->latency);
 		igt_mean_add(&p->dispatch, *p->last_timestamp - start);
+		if (p->samples)
+			igt_stats_push(p->samples,
+				       *p->last_timestamp - start + latency);
 
 		/* Tidy up all the extra threads before we submit again. */
 		pthread_mutex_lock(&p->lock);
@@ -422,12 +442,46 @@ static double l_estimate(igt_stats_t *stats)
 		return igt_stats_get_mean(stats);
 }
 
+static void bench_result_us(const char *name, igt_stats_t *cycles)
+{
+	igt_stats_t us;
+	unsigned int n;
+
+	if (!igt_bench_enabled())
+		return;
+
+	igt_stats_init_with_size(&us, cycles->n_values);
+	for (n = 0; n < cycles->n_values; n++)
+		igt_stats_push_float(&us, CYCLES_TO_US(cycles->values_f[n]));
+	igt_bench_result(name, "us", &us);
+	igt_stats_fini(&us);
+}
+
 static double cpu_time(const struct rusage *r)
 {
 	return 10e6*(r->ru_utime.tv_sec + r->ru_stime.tv_sec) +
 		(r->ru_utime.tv_usec + r->ru_stime.tv_usec);
 }
 
+static bool setup_timestamp(int gen)
+{
+	uint32_t t;
+
+	intel_register_access_init(intel_get_pci_device(), false, fd);
+
+	if (gen == 6)
+		timestamp_reg = REG(RCS_TIMESTAMP);
+	else
+		timestamp_reg = REG(BCS_TIMESTAMP);
+
+	if (gen < 8 && !setup_timestamp_locked())
+		return false;
+
+	t = read_timestamp();
+	usleep(1);
+	return read_timestamp() != t;
+}
+
 static int run(int seconds,
 	       int nproducers,
 	       int nconsumers,
@@ -456,19 +510,7 @@ static int run(int seconds,
 	if (gen < 6)
 		return IGT_EXIT_SKIP; /* Needs BCS timestamp */
 
-	intel_register_access_init(intel_get_pci_device(), false, fd);
-
-	if (gen == 6)
-		timestamp_reg = REG(RCS_TIMESTAMP);
-	else
-		timestamp_reg = REG(BCS_TIMESTAMP);
-
-	if (gen < 8 && !setup_timestamp_locked())
-		return IGT_EXIT_SKIP;
-
-	nrun = read_timestamp();
-	usleep(1);
-	if (read_timestamp() == nrun)
+	if (!setup_timestamp(gen))
 		return IGT_EXIT_SKIP;
 
 	scratch = gem_create(fd, 4*WIDTH*HEIGHT);
@@ -574,6 +616,129 @@ static int run(int seconds,
 		break;
 	}
 
+	bench_result_us("dispatch", &dispatch);
+	bench_result_us("latency", &latency);
+	bench_result_us("producer-latency", &platency);
+	igt_bench_value("cpu", "us", cpu_time(&rused) / complete);
+	igt_bench_value("completed", "requests", complete);
+
+	return 0;
+}
+
+static void setup_mixed(struct producer *p, int gen, uint32_t scratch,
+			uint32_t nop_batch, uint32_t workload_batch,
+			int workload, int nop, int prio, unsigned flags)
+{
+	memset(p, 0, sizeof(*p));
+
+	p->ctx = gem_context_create(fd);
+	gem_context_set_priority(fd, p->ctx, prio);
+
+	setup_nop(p, nop_batch, flags);
+	setup_workload(p, gen, scratch, workload_batch, workload, flags);
+	setup_latency(p, gen, flags);
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->p_cond, NULL);
+	pthread_cond_init(&p->c_cond, NULL);
+
+	igt_mean_init(&p->latency);
+	igt_mean_init(&p->dispatch);
+	p->nop = nop;
+}
+
+/*
+ * One latency sensitive client, submitting nothing but the timestamp batch
+ * from a context of the highest priority, or of the default priority to
+ * compare, next to nbackground clients keeping the blitter busy with
+ * workload copies from contexts of the default priority.
+ */
+static void run_mixed_one(int seconds, int gen, int nbackground,
+			  int workload, int nop, bool prioritise,
+			  unsigned flags)
+{
+	uint32_t scratch, nop_batch, workload_batch, idle_batch;
+	struct producer *p;
+	igt_stats_t samples;
+	char name[64];
+	int complete = 0;
+
+	scratch = gem_create(fd, 4*WIDTH*HEIGHT);
+	nop_batch = create_nop();
+	workload_batch = create_workload(gen, workload);
+	idle_batch = create_workload(gen, 0);
+
+	p = calloc(nbackground + 1, sizeof(*p));
+	igt_assert(p);
+
+	setup_mixed(&p[0], gen, scratch, nop_batch, idle_batch, 0, 0,
+		    prioritise ? I915_CONTEXT_MAX_USER_PRIORITY : 0, flags);
+	igt_stats_init(&samples);
+	p[0].samples = &samples;
+
+	for (int n = 1; n <= nbackground; n++)
+		setup_mixed(&p[n], gen, scratch, nop_batch, workload_batch,
+			    workload, nop, 0, flags);
+
+	done = false;
+	for (int n = 0; n <= nbackground; n++)
+		pthread_create(&p[n].thread, NULL, producer, &p[n]);
+
+	sleep(seconds);
+	done = true;
+
+	for (int n = 0; n <= nbackground; n++) {
+		pthread_join(p[n].thread, NULL);
+		if (n)
+			complete += p[n].complete;
+	}
+
+	if (samples.n_values)
+		printf("%10d %8s %12.1f %10.3f %10.3f %10.3f\n",
+		       nbackground, prioritise ? "high" : "default",
+		       (double)complete / seconds,
+		       CYCLES_TO_US(igt_stats_get_median(&samples)),
+		       CYCLES_TO_US(igt_stats_get_percentile(&samples, 99)),
+		       CYCLES_TO_US(igt_stats_get_max(&samples)));
+
+	snprintf(name, sizeof(name), "%s-priority-%d-background",
+		 prioritise ? "high" : "default", nbackground);
+	bench_result_us(name, &samples);
+	igt_stats_fini(&samples);
+
+	for (int n = 0; n <= nbackground; n++)
+		gem_context_destroy(fd, p[n].ctx);
+	free(p);
+
+	gem_close(fd, idle_batch);
+	gem_close(fd, workload_batch);
+	gem_close(fd, nop_batch);
+	gem_close(fd, scratch);
+}
+
+/* The sensitive client against 0, 1, 2, 4, ... up to max background clients */
+static int run_mixed(int seconds, int max, int workload, int nop,
+		     unsigned flags)
+{
+	int gen;
+
+	fd = drm_open_driver(DRIVER_INTEL);
+	gen = intel_gen(intel_get_drm_devid(fd));
+	if (gen < 6 || !gem_scheduler_has_ctx_priority(fd))
+		return IGT_EXIT_SKIP;
+
+	if (!setup_timestamp(gen))
+		return IGT_EXIT_SKIP;
+
+	printf("%10s %8s %12s %10s %10s %10s\n",
+	       "background", "priority", "background/s",
+	       "median us", "p99 us", "max us");
+
+	for (int n = 0; n <= max; n = n ? 2 * n : 1) {
+		run_mixed_one(seconds, gen, n, workload, nop, true, flags);
+		run_mixed_one(seconds, gen, n, workload, nop, false, flags);
+	}
+
 	return 0;
 }
 
@@ -584,10 +749,11 @@ int main(int argc, char **argv)
 	int consumers = 0;
 	int nop = 0;
 	int workload = 0;
+	int mixed = -1;
 	unsigned flags = 0;
 	int c;
 
-	while ((c = getopt(argc, argv, "Cp:c:n:w:t:f:sRF")) != -1) {
+	while ((c = getopt(argc, argv, "Cp:c:n:u:w:t:f:sRFM:")) != -1) {
 		switch (c) {
 		case 'p':
 			/* How many threads generate work? */
@@ -610,6 +776,11 @@ int main(int argc, char **argv)
 				nop = 0;
 			break;
 
+		case 'u':
+			/* Make each of the nops busy the blitter for usecs */
+			nop_us = atoi(optarg);
+			break;
+
 		case 'w':
 			/* Control the amount of real work done */
 			workload = atoi(optarg);
@@ -655,10 +826,37 @@ int main(int argc, char **argv)
 			flags |= FENCE_OUT;
 			break;
 
+		case 'M':
+			/* A high priority client against up to N others */
+			mixed = atoi(optarg);
+			if (mixed < 0)
+				mixed = 0;
+			break;
+
 		default:
 			break;
 		}
 	}
 
-	return run(time, producers, consumers, nop, workload, flags);
+	igt_bench_begin("gem_latency");
+	igt_bench_param("time", "%d", time);
+	igt_bench_param("producers", "%d", producers);
+	igt_bench_param("consumers", "%d", consumers);
+	igt_bench_param("nop", "%d", nop);
+	igt_bench_param("nop-us", "%u", nop_us);
+	igt_bench_param("workload", "%d", workload);
+	igt_bench_param("context", "%d", !!(flags & CONTEXT));
+	igt_bench_param("realtime", "%d", !!(flags & REALTIME));
+	igt_bench_param("fence", "%d", !!(flags & FENCE_OUT));
+
+	if (mixed >= 0) {
+		igt_bench_param("mixed", "%d", mixed);
+		c = run_mixed(time, mixed, workload, nop, flags);
+	} else {
+		c = run(time, producers, consumers, nop, workload, flags);
+	}
+
+	igt_bench_end();
+
+	return c;
 }
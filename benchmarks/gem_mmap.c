@@ -37,6 +37,7 @@
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <time.h>
+#include <sys/mman.h>
 
 #include "drm.h"
 #include "ioctl_wrappers.h"
@@ -46,6 +47,25 @@
 #include "i915/gem_mman.h"
 
 #define OBJECT_SIZE (1<<23)
+#define PROFILE_SIZE (1<<26)
+
+enum map { CPU, GTT, WC, NUM_MAPS };
+
+static const char * const map_names[] = {
+	[CPU] = "cpu",
+	[GTT] = "gtt",
+	[WC] = "wc",
+};
+
+enum pattern { SEQUENTIAL, RANDOM, STRIDED, NUM_PATTERNS };
+
+static const char * const pattern_names[] = {
+	[SEQUENTIAL] = "seq",
+	[RANDOM] = "random",
+	[STRIDED] = "strided",
+};
+
+static const unsigned int granules[] = { 4 << 10, 64 << 10, 2 << 20 };
 
 static double elapsed(const struct timespec *start,
 		const struct timespec *end)
@@ -53,21 +73,183 @@ static double elapsed(const struct timespec *start,
 	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
 }
 
+/*
+ * The cpu and wc mmaps are set up by an ioctl, so they can't be passed
+ * MAP_POPULATE. mlock() prefaults their ptes all the same, and they stay
+ * once unlocked. The gtt mmap is a pfn mapping, which the kernel doesn't
+ * prefault either way, which the comparison then shows.
+ */
+static void *profile_map(int fd, uint32_t handle, enum map map, bool populate)
+{
+	struct drm_i915_gem_mmap_gtt arg = { .handle = handle };
+	void *ptr;
+
+	switch (map) {
+	case CPU:
+		ptr = gem_mmap__cpu(fd, handle, 0, PROFILE_SIZE, PROT_WRITE);
+		break;
+	case GTT:
+		do_ioctl(fd, DRM_IOCTL_I915_GEM_MMAP_GTT, &arg);
+		ptr = mmap64(0, PROFILE_SIZE, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | (populate ? MAP_POPULATE : 0),
+			     fd, arg.offset);
+		igt_assert(ptr != MAP_FAILED);
+		return ptr;
+	case WC:
+		ptr = gem_mmap__wc(fd, handle, 0, PROFILE_SIZE, PROT_WRITE);
+		break;
+	default:
+		abort();
+	}
+
+	if (populate && mlock(ptr, PROFILE_SIZE) == 0)
+		munlock(ptr, PROFILE_SIZE);
+
+	return ptr;
+}
+
+/* The order in which the granules of the object are written */
+static void profile_order(unsigned int *order, unsigned int count,
+			  enum pattern pattern)
+{
+	unsigned int n = 0;
+
+	switch (pattern) {
+	case SEQUENTIAL:
+	case RANDOM:
+		for (n = 0; n < count; n++)
+			order[n] = n;
+		if (pattern == RANDOM)
+			igt_permute_array(order, count, igt_exchange_int);
+		break;
+	case STRIDED:
+		/* Every 8th granule, then the next ones over */
+		for (unsigned int first = 0; first < 8; first++)
+			for (unsigned int i = first; i < count; i += 8)
+				order[n++] = i;
+		break;
+	default:
+		abort();
+	}
+}
+
+static void profile_pass(void *ptr, const unsigned int *order,
+			 unsigned int count, unsigned int granule)
+{
+	for (unsigned int n = 0; n < count; n++)
+		memset((char *)ptr + (size_t)order[n] * granule, 0, granule);
+}
+
+/*
+ * Time writing a fresh object through a fresh mmap, from the mmap() to the
+ * last byte, against rewriting it once mapped. The difference, over the
+ * number of 4KiB pages, is the cost of a fault.
+ */
+static void profile_one(int fd, enum map map, enum pattern pattern,
+			unsigned int granule, const unsigned int *order,
+			bool populate, int reps)
+{
+	const unsigned int pages = PROFILE_SIZE / 4096;
+	const unsigned int count = PROFILE_SIZE / granule;
+	uint32_t domain = map == CPU ? I915_GEM_DOMAIN_CPU : I915_GEM_DOMAIN_GTT;
+	igt_stats_t first, fault, steady;
+
+	igt_stats_init_with_size(&first, reps);
+	igt_stats_init_with_size(&fault, reps);
+	igt_stats_init_with_size(&steady, reps);
+
+	for (int r = 0; r < reps; r++) {
+		struct timespec start, end;
+		double t_first, t_steady;
+		uint32_t handle;
+		void *ptr;
+
+		/* Allocate the pages before the clock starts */
+		handle = gem_create(fd, PROFILE_SIZE);
+		gem_set_domain(fd, handle, domain, domain);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ptr = profile_map(fd, handle, map, populate);
+		profile_pass(ptr, order, count, granule);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		t_first = elapsed(&start, &end);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		profile_pass(ptr, order, count, granule);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		t_steady = elapsed(&start, &end);
+
+		munmap(ptr, PROFILE_SIZE);
+		gem_close(fd, handle);
+
+		igt_stats_push_float(&first, 1e3 * t_first);
+		igt_stats_push_float(&fault, 1e9 * (t_first - t_steady) / pages);
+		igt_stats_push_float(&steady,
+				     PROFILE_SIZE / t_steady / (1024 * 1024));
+	}
+
+	printf("%-4s %-8s %6uKiB %-9s %12.3f %12.1f %12.1f\n",
+	       map_names[map], pattern_names[pattern], granule >> 10,
+	       populate ? "yes" : "no",
+	       igt_stats_get_median(&first),
+	       igt_stats_get_median(&fault),
+	       igt_stats_get_median(&steady));
+
+	igt_stats_fini(&first);
+	igt_stats_fini(&fault);
+	igt_stats_fini(&steady);
+}
+
+/* Every mapping, or only @only_map, against every pattern and granule */
+static void profile(int fd, int only_map, int reps)
+{
+	unsigned int *order = malloc(PROFILE_SIZE / 4096 * sizeof(*order));
+
+	igt_assert(order);
+
+	printf("%-4s %-8s %-9s %-9s %12s %12s %12s\n",
+	       "map", "pattern", "granule", "populate",
+	       "first (ms)", "ns/fault", "steady MiB/s");
+
+	for (enum map map = 0; map < NUM_MAPS; map++) {
+		if (only_map >= 0 && map != only_map)
+			continue;
+
+		if (map == WC && !gem_mmap__has_wc(fd))
+			continue;
+
+		for (enum pattern p = 0; p < NUM_PATTERNS; p++) {
+			for (int g = 0; g < ARRAY_SIZE(granules); g++) {
+				profile_order(order, PROFILE_SIZE / granules[g], p);
+
+				profile_one(fd, map, p, granules[g], order,
+					    false, reps);
+				profile_one(fd, map, p, granules[g], order,
+					    true, reps);
+			}
+		}
+	}
+
+	free(order);
+}
+
 int main(int argc, char **argv)
 {
 	int fd = drm_open_driver(DRIVER_INTEL);
-	enum map {CPU, GTT, WC} map = CPU;
+	enum map map = CPU;
 	enum dir {READ, WRITE, CLEAR, FAULT} dir = READ;
 	int tiling = I915_TILING_NONE;
 	struct timespec start, end;
 	void *buf = malloc(OBJECT_SIZE);
 	uint32_t handle;
 	void *ptr, *src, *dst;
+	bool fault_profile = false;
+	int only_map = -1;
 	int reps = 1;
 	int loops;
 	int c;
 
-	while ((c = getopt (argc, argv, "m:d:r:t:")) != -1) {
+	while ((c = getopt (argc, argv, "m:d:r:t:p")) != -1) {
 		switch (c) {
 		case 'm':
 			if (strcmp(optarg, "cpu") == 0)
@@ -78,6 +260,7 @@ int main(int argc, char **argv)
 				map = WC;
 			else
 				abort();
+			only_map = map;
 			break;
 
 		case 'd':
@@ -110,11 +293,21 @@ int main(int argc, char **argv)
 				reps = 1;
 			break;
 
+		case 'p':
+			/* Split the fault cost from the bandwidth */
+			fault_profile = true;
+			break;
+
 		default:
 			break;
 		}
 	}
 
+	if (fault_profile) {
+		profile(fd, only_map, reps);
+		return 0;
+	}
+
 	handle = gem_create(fd, OBJECT_SIZE);
 	switch (map) {
 	case CPU:
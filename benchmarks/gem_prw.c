@@ -37,14 +37,18 @@
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "drm.h"
 #include "ioctl_wrappers.h"
 #include "drmtest.h"
 #include "igt_aux.h"
 #include "igt_stats.h"
+#include "i915/gem_mman.h"
 
 #define OBJECT_SIZE (1<<23)
+#define MATRIX_MIN_SIZE (4 << 10)
+#define MATRIX_MAX_SIZE (64 << 20)
 
 static uint64_t elapsed(const struct timespec *start,
                         const struct timespec *end)
@@ -52,6 +56,158 @@ static uint64_t elapsed(const struct timespec *start,
 	return 1000000000ULL*(end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec);
 }
 
+enum method { PRW, CPU, WC, NUM_METHODS };
+
+static const char * const method_names[] = {
+	[PRW] = "pread/pwrite",
+	[CPU] = "cpu mmap",
+	[WC] = "wc mmap",
+};
+
+struct prw_thread {
+	pthread_t thread;
+	pthread_barrier_t *barrier;
+	int fd;
+	uint32_t handle;
+	enum method method;
+	bool write;
+	unsigned int size;
+	void *buf;
+	double rate;
+};
+
+/* Transfer size bytes again and again for 100ms, all threads at once */
+static void *prw_thread(void *arg)
+{
+	struct prw_thread *t = arg;
+	struct timespec start, end;
+	uint64_t bytes = 0;
+	void *ptr = NULL;
+
+	switch (t->method) {
+	case CPU:
+		ptr = gem_mmap__cpu(t->fd, t->handle, 0, t->size,
+				    PROT_READ | PROT_WRITE);
+		gem_set_domain(t->fd, t->handle,
+			       I915_GEM_DOMAIN_CPU, I915_GEM_DOMAIN_CPU);
+		break;
+	case WC:
+		ptr = gem_mmap__wc(t->fd, t->handle, 0, t->size,
+				   PROT_READ | PROT_WRITE);
+		gem_set_domain(t->fd, t->handle,
+			       I915_GEM_DOMAIN_GTT, I915_GEM_DOMAIN_GTT);
+		break;
+	default:
+		break;
+	}
+
+	/* Fault in both sides outside of the measurement */
+	memset(t->buf, 0, t->size);
+	if (ptr)
+		memset(ptr, 0, t->size);
+
+	pthread_barrier_wait(t->barrier);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		for (int n = 0; n < 8; n++) {
+			if (t->method == PRW && t->write)
+				gem_write(t->fd, t->handle, 0, t->buf, t->size);
+			else if (t->method == PRW)
+				gem_read(t->fd, t->handle, 0, t->buf, t->size);
+			else if (t->write)
+				memcpy(ptr, t->buf, t->size);
+			else
+				memcpy(t->buf, ptr, t->size);
+		}
+		bytes += 8ull * t->size;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+	} while (elapsed(&start, &end) < 100 * 1000 * 1000);
+
+	t->rate = bytes / (double)elapsed(&start, &end);
+
+	if (ptr)
+		munmap(ptr, t->size);
+
+	return NULL;
+}
+
+/*
+ * Every transfer size from 4KiB to 64MiB against every method, each time
+ * from nthreads threads at once, on their own objects or all on the same.
+ * Prints the total GB/s of all the threads.
+ */
+static void matrix(int fd, int nthreads, bool shared, bool write, int reps)
+{
+	struct prw_thread *threads = calloc(nthreads, sizeof(*threads));
+	pthread_barrier_t barrier;
+
+	igt_assert(threads);
+
+	for (int n = 0; n < nthreads; n++) {
+		threads[n].barrier = &barrier;
+		threads[n].fd = fd;
+		threads[n].handle = shared && n ? threads[0].handle :
+			gem_create(fd, MATRIX_MAX_SIZE);
+		threads[n].write = write;
+		threads[n].buf = malloc(MATRIX_MAX_SIZE);
+		igt_assert(threads[n].buf);
+	}
+
+	printf("%9s", "size");
+	for (enum method m = 0; m < NUM_METHODS; m++)
+		printf(" %14s", method_names[m]);
+	printf("\n");
+
+	for (unsigned int size = MATRIX_MIN_SIZE;
+	     size <= MATRIX_MAX_SIZE; size <<= 1) {
+		printf("%6uKiB", size >> 10);
+
+		for (enum method m = 0; m < NUM_METHODS; m++) {
+			igt_stats_t stats;
+
+			if (m == WC && !gem_mmap__has_wc(fd)) {
+				printf(" %14s", "-");
+				continue;
+			}
+
+			igt_stats_init_with_size(&stats, reps);
+			for (int r = 0; r < reps; r++) {
+				double total = 0;
+
+				pthread_barrier_init(&barrier, NULL, nthreads);
+				for (int n = 0; n < nthreads; n++) {
+					threads[n].method = m;
+					threads[n].size = size;
+					pthread_create(&threads[n].thread, NULL,
+						       prw_thread, &threads[n]);
+				}
+
+				for (int n = 0; n < nthreads; n++) {
+					pthread_join(threads[n].thread, NULL);
+					total += threads[n].rate;
+				}
+				pthread_barrier_destroy(&barrier);
+
+				igt_stats_push_float(&stats, total);
+			}
+
+			printf(" %9.3f GB/s", igt_stats_get_median(&stats));
+			igt_stats_fini(&stats);
+		}
+
+		printf("\n");
+		fflush(stdout);
+	}
+
+	for (int n = 0; n < nthreads; n++) {
+		if (!shared || !n)
+			gem_close(fd, threads[n].handle);
+		free(threads[n].buf);
+	}
+	free(threads);
+}
+
 int main(int argc, char **argv)
 {
 	int fd = drm_open_driver(DRIVER_INTEL);
@@ -60,9 +216,11 @@ int main(int argc, char **argv)
 	void *buf = malloc(OBJECT_SIZE);
 	uint32_t handle;
 	int reps = 13;
+	int threads = 0;
+	bool shared = false;
 	int c, size;
 
-	while ((c = getopt (argc, argv, "D:d:r:")) != -1) {
+	while ((c = getopt (argc, argv, "D:d:r:t:s")) != -1) {
 		switch (c) {
 		case 'd':
 			if (strcmp(optarg, "cpu") == 0)
@@ -85,11 +243,28 @@ int main(int argc, char **argv)
 				reps = 1;
 			break;
 
+		case 't':
+			/* Compare against the mmaps, from this many threads */
+			threads = atoi(optarg);
+			if (threads < 1)
+				threads = 1;
+			break;
+
+		case 's':
+			/* All the threads on the same object */
+			shared = true;
+			break;
+
 		default:
 			break;
 		}
 	}
 
+	if (threads) {
+		matrix(fd, threads, shared, dir == WRITE, reps);
+		return 0;
+	}
+
 	handle = gem_create(fd, OBJECT_SIZE);
 	for (size = 1; size <= OBJECT_SIZE; size <<= 1) {
 		igt_stats_t stats;
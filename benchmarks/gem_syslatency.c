@@ -23,6 +23,7 @@
  */
 
 #include "igt.h"
+#include "igt_bench.h"
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -40,6 +41,7 @@
 #include <sys/time.h>
 #include <time.h>
 #include <limits.h>
+#include <math.h>
 #include "drm.h"
 
 #include <linux/unistd.h>
@@ -58,7 +60,13 @@ struct gem_busyspin {
 
 struct sys_wait {
 	pthread_t thread;
-	struct igt_mean mean;
+	struct igt_thread_stats *stats;
+
+	/* cyclictest style histogram, in microsecond buckets */
+	unsigned long *hist;
+	unsigned long overflow;
+	unsigned int hist_max;
+	double min;
 };
 
 static void force_low_latency(void)
@@ -159,6 +167,23 @@ static double elapsed(const struct timespec *a, const struct timespec *b)
 	return 1e9*(b->tv_sec - a->tv_sec) + (b->tv_nsec - a ->tv_nsec);
 }
 
+static void sys_latency(struct sys_wait *w, double ns)
+{
+	double us;
+
+	igt_thread_stats_add(w->stats, ns);
+	if (!w->hist)
+		return;
+
+	us = (ns - w->min) / 1000;
+	if (us < 0)
+		us = 0;
+	if (us >= w->hist_max)
+		w->overflow++;
+	else
+		w->hist[(unsigned int)us]++;
+}
+
 static void *sys_wait(void *arg)
 {
 	struct sys_wait *w = arg;
@@ -194,7 +219,7 @@ static void *sys_wait(void *arg)
 
 		sigwait(&mask, &sigs);
 		clock_gettime(CLOCK_MONOTONIC, &now);
-		igt_mean_add(&w->mean, elapsed(&its.it_value, &now));
+		sys_latency(w, elapsed(&its.it_value, &now));
 	}
 
 	sigprocmask(SIG_UNBLOCK, &mask, NULL);
@@ -225,7 +250,7 @@ static void *sys_thp_alloc(void *arg)
 		munmap(ptr, sz);
 
 		clock_gettime(CLOCK_MONOTONIC, &now);
-		igt_mean_add(&w->mean, elapsed(&start, &now));
+		sys_latency(w, elapsed(&start, &now));
 	}
 
 	return NULL;
@@ -266,6 +291,21 @@ static double l_estimate(igt_stats_t *stats)
 		return igt_stats_get_mean(stats);
 }
 
+static void bench_result_us(const char *name, igt_stats_t *ns, double min)
+{
+	igt_stats_t us;
+	unsigned int n;
+
+	if (!igt_bench_enabled())
+		return;
+
+	igt_stats_init_with_size(&us, ns->n_values);
+	for (n = 0; n < ns->n_values; n++)
+		igt_stats_push_float(&us, (ns->values_f[n] - min) / 1000);
+	igt_bench_result(name, "us", &us);
+	igt_stats_fini(&us);
+}
+
 static double min_measurement_error(void)
 {
 	struct timespec start, end;
@@ -278,6 +318,160 @@ static double min_measurement_error(void)
 	return elapsed(&start, &end) / n;
 }
 
+static int read_i915_interrupts(unsigned long *count, int ncpus)
+{
+	int column[CPU_SETSIZE];
+	int ncolumn = 0, found = 0;
+	char *line = NULL;
+	size_t len = 0;
+	FILE *file;
+
+	memset(count, 0, ncpus * sizeof(*count));
+
+	file = fopen("/proc/interrupts", "r");
+	if (!file)
+		return 0;
+
+	/* The header names the CPU of each column, offline CPUs are skipped */
+	if (getline(&line, &len, file) > 0) {
+		for (char *s = line; (s = strstr(s, "CPU")); s += 3)
+			if (ncolumn < CPU_SETSIZE)
+				column[ncolumn++] = atoi(s + 3);
+	}
+
+	while (getline(&line, &len, file) > 0) {
+		char *s;
+
+		if (!strstr(line, "i915"))
+			continue;
+
+		s = strchr(line, ':');
+		if (!s)
+			continue;
+		s++;
+
+		for (int i = 0; i < ncolumn; i++) {
+			unsigned long v;
+			char *end;
+
+			v = strtoul(s, &end, 10);
+			if (end == s)
+				break;
+			s = end;
+
+			if (column[i] < ncpus)
+				count[column[i]] += v;
+		}
+		found++;
+	}
+
+	free(line);
+	fclose(file);
+
+	return found;
+}
+
+static double correlation(const double *x, const unsigned long *y, int n)
+{
+	double mx = 0, my = 0, sxy = 0, sxx = 0, syy = 0;
+
+	for (int i = 0; i < n; i++) {
+		mx += x[i];
+		my += y[i];
+	}
+	mx /= n;
+	my /= n;
+
+	for (int i = 0; i < n; i++) {
+		sxy += (x[i] - mx) * (y[i] - my);
+		sxx += (x[i] - mx) * (x[i] - mx);
+		syy += (y[i] - my) * (y[i] - my);
+	}
+
+	if (sxx == 0 || syy == 0)
+		return 0;
+
+	return sxy / sqrt(sxx * syy);
+}
+
+static void print_per_cpu(struct sys_wait *wait, int ncpus, double min,
+			  const unsigned long *irqs)
+{
+	double *mean, *max;
+
+	mean = calloc(ncpus, sizeof(*mean));
+	max = calloc(ncpus, sizeof(*max));
+
+	for (int n = 0; n < ncpus; n++) {
+		mean[n] = (wait[n].stats->mean.mean - min) / 1000;
+		max[n] = (wait[n].stats->mean.max - min) / 1000;
+
+		printf("cpu%d: latency mean=%.3fus max=%.0fus",
+		       n, mean[n], max[n]);
+		if (irqs)
+			printf(", i915 interrupts=%lu", irqs[n]);
+		printf("\n");
+	}
+
+	if (irqs && ncpus > 1)
+		printf("i915 interrupt correlation: latency mean r=%.2f, max r=%.2f\n",
+		       correlation(mean, irqs, ncpus),
+		       correlation(max, irqs, ncpus));
+
+	free(max);
+	free(mean);
+}
+
+/* Mimic the output of cyclictest --histogram for the existing tooling */
+static void print_histogram(struct sys_wait *wait, int ncpus,
+			    unsigned int hist_max, double min)
+{
+	printf("# Histogram\n");
+	for (unsigned int i = 0; i < hist_max; i++) {
+		unsigned long total = 0;
+
+		for (int n = 0; n < ncpus; n++)
+			total += wait[n].hist[i];
+		if (!total)
+			continue;
+
+		printf("%06u ", i);
+		for (int n = 0; n < ncpus; n++)
+			printf("%06lu%s", wait[n].hist[i],
+			       n < ncpus - 1 ? "\t" : "\n");
+	}
+
+	printf("# Total:");
+	for (int n = 0; n < ncpus; n++) {
+		unsigned long total = 0;
+
+		for (unsigned int i = 0; i < hist_max; i++)
+			total += wait[n].hist[i];
+		printf(" %09lu", total);
+	}
+	printf("\n");
+
+	printf("# Min Latencies:");
+	for (int n = 0; n < ncpus; n++)
+		printf(" %05.0f", max(wait[n].stats->mean.min - min, 0.) / 1000);
+	printf("\n");
+
+	printf("# Avg Latencies:");
+	for (int n = 0; n < ncpus; n++)
+		printf(" %05.0f", max(wait[n].stats->mean.mean - min, 0.) / 1000);
+	printf("\n");
+
+	printf("# Max Latencies:");
+	for (int n = 0; n < ncpus; n++)
+		printf(" %05.0f", max(wait[n].stats->mean.max - min, 0.) / 1000);
+	printf("\n");
+
+	printf("# Histogram Overflows:");
+	for (int n = 0; n < ncpus; n++)
+		printf(" %05lu", wait[n].overflow);
+	printf("\n");
+}
+
 static int print_entry(const char *filepath, const struct stat *info,
 		       const int typeflag, struct FTW *pathinfo)
 {
@@ -354,6 +548,8 @@ int main(int argc, char **argv)
 {
 	struct gem_busyspin *busy;
 	struct sys_wait *wait;
+	struct igt_thread_stats *stats;
+	struct igt_histogram wakeup;
 	void *sys_fn = sys_wait;
 	pthread_attr_t attr;
 	pthread_t bg_fs = 0;
@@ -365,10 +561,13 @@ int main(int argc, char **argv)
 	int enable_gem_sysbusy = 1;
 	bool leak = false;
 	bool interrupts = false;
+	bool per_cpu = false;
+	unsigned int hist_max = 0;
+	unsigned long *irqs = NULL;
 	long batch = 0;
 	int n, c;
 
-	while ((c = getopt(argc, argv, "r:t:f:bmni1")) != -1) {
+	while ((c = getopt(argc, argv, "r:t:f:H:bmnpi1")) != -1) {
 		switch (c) {
 		case '1':
 			ncpus = 1;
@@ -402,11 +601,28 @@ int main(int argc, char **argv)
 			sys_fn = sys_thp_alloc;
 			leak = true;
 			break;
+		case 'p':
+			/* Break down latency and i915 interrupts per cpu */
+			per_cpu = true;
+			break;
+		case 'H':
+			/* Dump a cyclictest histogram up to N microseconds */
+			hist_max = atoi(optarg);
+			break;
 		default:
 			break;
 		}
 	}
 
+	igt_bench_begin("gem_syslatency");
+	igt_bench_param("time", "%d", time);
+	igt_bench_param("cpus", "%d", ncpus);
+	igt_bench_param("gem-busy", "%d", enable_gem_sysbusy);
+	igt_bench_param("interrupts", "%d", interrupts);
+	igt_bench_param("batch", "%ld", batch);
+	igt_bench_param("background-fs", "%d", !!bg_fs);
+	igt_bench_param("thp-alloc", "%d", leak);
+
 	/* Prevent CPU sleeps so that busy and idle loads are consistent. */
 	force_low_latency();
 	min = min_measurement_error();
@@ -429,11 +645,25 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (per_cpu) {
+		irqs = calloc(ncpus, sizeof(*irqs));
+		if (!read_i915_interrupts(irqs, ncpus)) {
+			free(irqs);
+			irqs = NULL;
+		}
+	}
+
 	wait = calloc(ncpus, sizeof(*wait));
+	stats = igt_thread_stats_create(ncpus);
 	pthread_attr_init(&attr);
 	rtprio(&attr, 99);
 	for (n = 0; n < ncpus; n++) {
-		igt_mean_init(&wait[n].mean);
+		wait[n].stats = &stats[n];
+		if (hist_max) {
+			wait[n].hist = calloc(hist_max, sizeof(*wait[n].hist));
+			wait[n].hist_max = hist_max;
+			wait[n].min = min;
+		}
 		bind_cpu(&attr, n);
 		pthread_create(&wait[n].thread, &attr, sys_fn, &wait[n]);
 	}
@@ -453,14 +683,23 @@ int main(int argc, char **argv)
 	igt_stats_init_with_size(&max, ncpus);
 	for (n = 0; n < ncpus; n++) {
 		pthread_join(wait[n].thread, NULL);
-		igt_stats_push_float(&mean, wait[n].mean.mean);
-		igt_stats_push_float(&max, wait[n].mean.max);
+		igt_stats_push_float(&mean, wait[n].stats->mean.mean);
+		igt_stats_push_float(&max, wait[n].stats->mean.max);
 	}
 	if (bg_fs) {
 		pthread_cancel(bg_fs);
 		pthread_join(bg_fs, NULL);
 	}
 
+	if (irqs) {
+		unsigned long *end = calloc(ncpus, sizeof(*end));
+
+		read_i915_interrupts(end, ncpus);
+		for (n = 0; n < ncpus; n++)
+			irqs[n] = end[n] - irqs[n];
+		free(end);
+	}
+
 	switch (field) {
 	default:
 		printf("gem_syslatency: cycles=%.0f, latency mean=%.3fus max=%.0fus\n",
@@ -479,6 +718,24 @@ int main(int argc, char **argv)
 		break;
 	}
 
+	if (per_cpu)
+		print_per_cpu(wait, ncpus, min, irqs);
+	if (hist_max)
+		print_histogram(wait, ncpus, hist_max, min);
+
+	igt_bench_result("cycles", "batches", &cycles);
+	bench_result_us("latency-mean", &mean, min);
+	bench_result_us("latency-max", &max, min);
+
+	/* Every wakeup of every cpu, without the measurement error removed */
+	igt_histogram_init(&wakeup);
+	igt_thread_stats_merge(stats, ncpus, NULL, &wakeup);
+	igt_bench_histogram("wakeup", "ns", &wakeup);
+	igt_histogram_fini(&wakeup);
+	igt_bench_end();
+
+	igt_thread_stats_destroy(stats, ncpus);
+
 	return 0;
 
 }
@@ -43,6 +43,9 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "drm.h"
 #include "i915_drm.h"
@@ -453,6 +456,180 @@ static void test_multiple(int fd, unsigned int batch, int random)
 	printf("%8lu iter/s\n", iter * batch / test_duration_sec);
 }
 
+/*
+ * The concurrent tests have threads faulting memory under and around the
+ * live userptr objects, so that with synchronized userptr every fault
+ * racing with an unmap goes through the mmu notifier invalidation, over
+ * objects backed by either 4KiB pages or transparent huge pages.
+ */
+#define CHUNK_SIZE (2 << 20)
+
+enum churn {
+	CHURN_REMAP,
+	CHURN_DONTNEED,
+};
+
+struct churn_thread {
+	pthread_t thread;
+	pthread_barrier_t *barrier;
+	enum churn churn;
+	char *chunk;
+	bool thp;
+	double rate;
+};
+
+static const unsigned int concurrent_duration_sec = 1;
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static void set_backing(void *ptr, size_t size, bool thp)
+{
+	igt_assert(madvise(ptr, size, thp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) == 0);
+}
+
+static bool has_thp(void)
+{
+	void *ptr;
+	bool ret;
+
+	ptr = mmap(NULL, CHUNK_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	igt_assert(ptr != MAP_FAILED);
+	ret = madvise(ptr, CHUNK_SIZE, MADV_HUGEPAGE) == 0;
+	munmap(ptr, CHUNK_SIZE);
+
+	return ret;
+}
+
+static void *churn_thread(void *data)
+{
+	struct churn_thread *t = data;
+	struct timespec start, end;
+	unsigned long iter = 0;
+
+	pthread_barrier_wait(t->barrier);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		for (int n = 0; n < 16; n++) {
+			if (t->churn == CHURN_REMAP) {
+				/* Replacing the mapping unmaps the old one */
+				igt_assert(mmap(t->chunk, CHUNK_SIZE,
+						PROT_READ | PROT_WRITE,
+						MAP_ANONYMOUS | MAP_PRIVATE |
+						MAP_FIXED,
+						-1, 0) == t->chunk);
+				set_backing(t->chunk, CHUNK_SIZE, t->thp);
+			} else {
+				madvise(t->chunk, CHUNK_SIZE, MADV_DONTNEED);
+			}
+
+			for (unsigned long i = 0; i < CHUNK_SIZE; i += PAGE_SIZE)
+				t->chunk[i] = i;
+		}
+		iter += 16;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+	} while (elapsed(&start, &end) < concurrent_duration_sec);
+
+	t->rate = iter / elapsed(&start, &end);
+	return NULL;
+}
+
+static void test_concurrent_churn(enum churn churn, const char *name,
+				  unsigned int n, char *region, bool thp,
+				  int max_threads)
+{
+	struct churn_thread *threads;
+	pthread_barrier_t barrier;
+
+	threads = calloc(max_threads, sizeof(*threads));
+	igt_assert(threads);
+
+	for (int nthreads = 1; ; nthreads = min(2 * nthreads, max_threads)) {
+		double total = 0, lo = 0, hi = 0;
+
+		/* Everyone starts faulting once all threads are up */
+		pthread_barrier_init(&barrier, NULL, nthreads);
+		for (int i = 0; i < nthreads; i++) {
+			threads[i].barrier = &barrier;
+			threads[i].churn = churn;
+			threads[i].chunk = region + (size_t)i * CHUNK_SIZE;
+			threads[i].thp = thp;
+			pthread_create(&threads[i].thread, NULL,
+				       churn_thread, &threads[i]);
+		}
+
+		for (int i = 0; i < nthreads; i++) {
+			double rate;
+
+			pthread_join(threads[i].thread, NULL);
+
+			rate = threads[i].rate;
+			total += rate;
+			if (!i || rate < lo)
+				lo = rate;
+			if (!i || rate > hi)
+				hi = rate;
+		}
+		pthread_barrier_destroy(&barrier);
+
+		printf("%s-%s, %5u bos, %3d threads = %8.0f iter/s, per thread %8.0f (min %8.0f, max %8.0f)\n",
+		       thp ? "thp" : "4k", name, n, nthreads,
+		       total, total / nthreads, lo, hi);
+
+		if (nthreads == max_threads)
+			break;
+	}
+
+	free(threads);
+}
+
+static void test_concurrent(int fd, bool thp)
+{
+	unsigned int total = sizeof(nr_bos) / sizeof(nr_bos[0]);
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t handles[nr_bos[total-1]];
+	unsigned int subtest, i;
+
+	igt_require(!thp || has_thp());
+
+	for (subtest = 0; subtest < total; subtest++) {
+		unsigned int n = nr_bos[subtest];
+		size_t size, map_size;
+		char *ptr, *region;
+
+		/* The threads each fault their own chunk of the objects */
+		size = max((size_t)n * BO_SIZE,
+			   (size_t)max_threads * CHUNK_SIZE);
+		size = ALIGN(size, CHUNK_SIZE);
+
+		/* Aligned so that each chunk may be a single huge page */
+		map_size = size + CHUNK_SIZE;
+		ptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+			   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+		igt_assert(ptr != MAP_FAILED);
+		region = (char *)ALIGN((unsigned long)ptr, CHUNK_SIZE);
+		set_backing(region, size, thp);
+
+		for (i = 0; i < n; i++)
+			gem_userptr(fd, region + (size_t)i * BO_SIZE, BO_SIZE,
+				    0, userptr_flags, &handles[i]);
+
+		test_concurrent_churn(CHURN_REMAP, "remap-fault",
+				      n, region, thp, max_threads);
+		test_concurrent_churn(CHURN_DONTNEED, "dontneed-fault",
+				      n, region, thp, max_threads);
+
+		for (i = 0; i < n; i++)
+			gem_close(fd, handles[i]);
+
+		munmap(ptr, map_size);
+	}
+}
+
 static void test_userptr(int fd)
 {
 	printf("create-destroy                = ");
@@ -492,6 +669,12 @@ int main(int argc, char **argv)
 	igt_subtest("userptr-impact-unsync-overlap")
 		test_impact_overlap(fd, "unsync-");
 
+	igt_subtest("userptr-concurrent-unsync-4k")
+		test_concurrent(fd, false);
+
+	igt_subtest("userptr-concurrent-unsync-thp")
+		test_concurrent(fd, true);
+
 	gem_userptr_test_synchronized();
 
 	igt_subtest("userptr-sync")
@@ -503,6 +686,12 @@ int main(int argc, char **argv)
 	igt_subtest("userptr-impact-sync-overlap")
 		test_impact_overlap(fd, "sync-");
 
+	igt_subtest("userptr-concurrent-sync-4k")
+		test_concurrent(fd, false);
+
+	igt_subtest("userptr-concurrent-sync-thp")
+		test_concurrent(fd, true);
+
 	igt_exit();
 
 	return 0;
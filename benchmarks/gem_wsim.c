@@ -39,6 +39,7 @@
 #include <time.h>
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
 #include <pthread.h>
 
 #include "intel_chipset.h"
@@ -50,9 +51,16 @@
 #include "intel_io.h"
 #include "igt_aux.h"
 #include "igt_rand.h"
+#include "igt_bench.h"
+#include "igt_freq.h"
+#include "igt_engine_monitor.h"
+#include "igt_nop.h"
 #include "igt_perf.h"
+#include "igt_syncobj.h"
 #include "sw_sync.h"
+#include "i915/gem_caps.h"
 #include "i915/gem_mman.h"
+#include "i915/oa.h"
 
 #include "ewma.h"
 
@@ -87,7 +95,8 @@ enum w_type
 	LOAD_BALANCE,
 	BOND,
 	TERMINATE,
-	SSEU
+	SSEU,
+	OA_SAMPLE
 };
 
 struct deps
@@ -138,6 +147,10 @@ struct w_step
 			enum intel_engine_id bond_master;
 		};
 		int sseu;
+		struct {
+			int oa_target;
+			char *oa_metrics;
+		};
 	};
 
 	/* Implementation details */
@@ -148,7 +161,17 @@ struct w_step
 
 	struct drm_i915_gem_execbuffer2 eb;
 	struct drm_i915_gem_exec_object2 *obj;
-	struct drm_i915_gem_relocation_entry reloc[5];
+
+	/* Submission state precomputed by compile_workload() */
+	uint64_t engine_flags[NUM_ENGINES];
+	unsigned int engine_flags_mask;
+	struct w_step *fence_dep;
+	uint64_t fence_dep_flags;
+	uint32_t syncobj;
+	struct drm_i915_gem_exec_fence *fences;
+	unsigned int nr_fences;
+	bool fixed_bb_start;
+	struct drm_i915_gem_relocation_entry reloc[7];
 	unsigned long bb_sz;
 	uint32_t bb_handle;
 	uint32_t *seqno_value;
@@ -159,10 +182,44 @@ struct w_step
 	uint32_t *latch_value;
 	uint32_t *latch_address;
 	uint32_t *recursive_bb_start;
+
+	/* OA reports around the batch, written to obj[0] */
+	bool oa_sample;
+	bool oa_pending;
+	unsigned int oa_reloc;
+	uint32_t *oa_bb;
+	uint32_t *oa_start;
+	uint32_t oa_saved[4];
+	unsigned long oa_batches;
+	struct i915_oa_accumulator oa;
 };
 
 DECLARE_EWMA(uint64_t, rt, 4, 2)
 
+#define COST_HISTORY 64
+
+/*
+ * Latency histogram with logarithmic buckets, each power of two split
+ * into 1 << LATENCY_SUB_BITS linear sub-buckets, in the manner of HDR
+ * histograms. Adding a sample is a couple of bit operations and precision
+ * stays within ~6% over the whole 32-bit range.
+ */
+#define LATENCY_SUB_BITS 4
+#define LATENCY_BUCKETS ((32 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+enum latency_class {
+	LATENCY_RENDER,
+	LATENCY_COPY,
+	LATENCY_VIDEO,
+	LATENCY_VIDEO_ENHANCE,
+	NUM_LATENCY_CLASSES
+};
+
+struct latency_hist {
+	unsigned long count[LATENCY_BUCKETS];
+	unsigned long total;
+};
+
 struct ctx {
 	uint32_t id;
 	int priority;
@@ -198,6 +255,14 @@ struct workload
 
 	struct timespec repeat_start;
 
+	/* Open-loop arrivals, iterations per second or zero if not used. */
+	double rate;
+	uint32_t arrival_prng;
+	unsigned long late;
+	struct latency_hist frame_latency;
+
+	double throughput;
+
 	unsigned int nr_ctxs;
 	struct ctx *ctx_list;
 
@@ -212,6 +277,7 @@ struct workload
 
 	unsigned long qd_sum[NUM_ENGINES];
 	unsigned long nr_bb[NUM_ENGINES];
+	unsigned long nr_eb;
 
 	struct igt_list requests[NUM_ENGINES];
 	unsigned int nrequest[NUM_ENGINES];
@@ -225,8 +291,21 @@ struct workload
 			struct ewma_rt avg[NUM_ENGINES];
 			uint32_t last[NUM_ENGINES];
 		} rt;
+		struct cost_model {
+			struct ewma_rt avg[NUM_ENGINES];
+			uint32_t last[NUM_ENGINES];
+			/* Observed over predicted completion time, x16. */
+			struct ewma_rt error[NUM_ENGINES];
+			struct cost_prediction {
+				uint32_t seqno;
+				uint64_t cost;
+			} predicted[NUM_ENGINES][COST_HISTORY];
+		} cost;
 	};
 
+	uint32_t latency_seqno[NUM_ENGINES];
+	struct latency_hist latency[NUM_LATENCY_CLASSES];
+
 	struct busy_balancer {
 		int fd;
 		bool first;
@@ -238,7 +317,7 @@ struct workload
 	} busy_balancer;
 };
 
-static const unsigned int nop_calibration_us = 1000;
+static const unsigned int nop_calibration_us = IGT_NOP_CALIBRATION_US;
 static unsigned long nop_calibration;
 
 static unsigned int master_prng;
@@ -263,11 +342,24 @@ static struct drm_i915_gem_context_param_sseu device_sseu = {
 #define DEPSYNC		(1<<9)
 #define I915		(1<<10)
 #define SSEU		(1<<11)
+#define LOCKFREE	(1<<12)
+#define LATENCY		(1<<13)
+#define POISSON		(1<<14)
+#define SYNCOBJ		(1<<15)
 
 #define SEQNO_IDX(engine) ((engine) * 16)
 #define SEQNO_OFFSET(engine) (SEQNO_IDX(engine) * sizeof(uint32_t))
 
 #define RCS_TIMESTAMP (0x2000 + 0x358)
+
+#define MI_REPORT_PERF_COUNT ((0x28 << 23) | (4 - 2))
+#define OA_FORMAT I915_OA_FORMAT_A32u40_A4u32_B8_C8
+#define OA_REPORT_SIZE 256
+#define OA_REPORT_START 0x5354 /* report ids */
+#define OA_REPORT_END 0x454e
+
+static char *oa_metrics;
+static uint64_t oa_timestamp_frequency;
 #define REG(x) (volatile uint32_t *)((volatile char *)igt_global_mmio + x)
 
 static const char *ring_str_map[NUM_ENGINES] = {
@@ -319,9 +411,14 @@ parse_dependencies(unsigned int nr_steps, struct w_step *w, char *_desc)
 		}
 
 		if (dep < 0) {
+			/* Sync and submit fences cannot be mixed. */
+			if (deps == &w->fence_deps && deps->nr &&
+			    deps->submit_fence != submit_fence) {
+				free(deps->list);
+				return -1;
+			}
+
 			deps->nr++;
-			/* Multiple fences not yet supported. */
-			igt_assert(deps->nr == 1 || deps != &w->fence_deps);
 			deps->list = realloc(deps->list,
 					     sizeof(*deps->list) * deps->nr);
 			igt_assert(deps->list);
@@ -372,41 +469,9 @@ static bool __engines_queried;
 static unsigned int __num_engines;
 static struct i915_engine_class_instance *__engines;
 
-static int
-__i915_query(int i915, struct drm_i915_query *q)
-{
-	if (igt_ioctl(i915, DRM_IOCTL_I915_QUERY, q))
-		return -errno;
-	return 0;
-}
-
-static int
-__i915_query_items(int i915, struct drm_i915_query_item *items, uint32_t n_items)
-{
-	struct drm_i915_query q = {
-		.num_items = n_items,
-		.items_ptr = to_user_pointer(items),
-	};
-	return __i915_query(i915, &q);
-}
-
-static void
-i915_query_items(int i915, struct drm_i915_query_item *items, uint32_t n_items)
-{
-	igt_assert_eq(__i915_query_items(i915, items, n_items), 0);
-}
-
-static bool has_engine_query(int i915)
-{
-	struct drm_i915_query_item item = {
-		.query_id = DRM_I915_QUERY_ENGINE_INFO,
-	};
-
-	return __i915_query_items(i915, &item, 1) == 0 && item.length > 0;
-}
-
 static void query_engines(void)
 {
+	const struct drm_i915_query_engine_info *engine_info;
 	struct i915_engine_class_instance *engines;
 	unsigned int num;
 
@@ -415,7 +480,8 @@ static void query_engines(void)
 
 	__engines_queried = true;
 
-	if (!has_engine_query(fd)) {
+	engine_info = gem_caps_engine_info(fd);
+	if (!engine_info || !engine_info->num_engines) {
 		unsigned int num_bsd = gem_has_bsd(fd) + gem_has_bsd2(fd);
 		unsigned int i = 0;
 
@@ -462,36 +528,16 @@ static void query_engines(void)
 			i++;
 		}
 	} else {
-		struct drm_i915_query_engine_info *engine_info;
-		struct drm_i915_query_item item = {
-			.query_id = DRM_I915_QUERY_ENGINE_INFO,
-		};
-		const unsigned int sz = 4096;
 		unsigned int i;
 
-		engine_info = malloc(sz);
-		igt_assert(engine_info);
-		memset(engine_info, 0, sz);
-
-		item.data_ptr = to_user_pointer(engine_info);
-		item.length = sz;
-
-		i915_query_items(fd, &item, 1);
-		igt_assert(item.length > 0);
-		igt_assert(item.length <= sz);
-
 		num = engine_info->num_engines;
 
 		engines = calloc(num,
 				 sizeof(struct i915_engine_class_instance));
 		igt_assert(engines);
 
-		for (i = 0; i < num; i++) {
-			struct drm_i915_engine_info *engine =
-				(struct drm_i915_engine_info *)&engine_info->engines[i];
-
-			engines[i] = engine->engine;
-		}
+		for (i = 0; i < num; i++)
+			engines[i] = engine_info->engines[i].engine;
 	}
 
 	__engines = engines;
@@ -795,6 +841,37 @@ parse_workload(struct w_arg *arg, unsigned int flags, struct workload *app_w)
 				int_field(TERMINATE, target,
 					  tmp >= 0 || ((int)nr_steps + tmp) < 0,
 					  "Invalid terminate target at step %u!\n");
+			} else if (!strcmp(field, "O")) {
+				unsigned int nr = 0;
+				while ((field = strtok_r(fstart, ".", &fctx))) {
+					check_arg(nr > 1,
+						  "Invalid OA sampling format at step %u!\n",
+						  nr_steps);
+
+					if (nr == 0) {
+						step.oa_metrics = strdup(field);
+						igt_assert(step.oa_metrics);
+					} else {
+						tmp = atoi(field);
+						check_arg(tmp >= 0 ||
+							  ((int)nr_steps + tmp) < 0,
+							  "Invalid OA sampling target at step %u!\n",
+							  nr_steps);
+						step.oa_target = tmp;
+					}
+
+					nr++;
+				}
+
+				check_arg(nr != 2,
+					  "Invalid OA sampling format at step %u!\n",
+					  nr_steps);
+				check_arg(intel_gen(intel_get_drm_devid(fd)) < 8,
+					  "OA sampling at step %u needs Gen8+!\n",
+					  nr_steps);
+
+				step.type = OA_SAMPLE;
+				goto add_step;
 			} else if (!strcmp(field, "X")) {
 				unsigned int nr = 0;
 				while ((field = strtok_r(fstart, ".", &fctx))) {
@@ -1014,6 +1091,13 @@ add_step:
 				  "Invalid dependency target %u!\n", i);
 			steps[tmp].emit_fence = -1;
 		}
+
+		/* Multiple input fences need syncobjs to be expressed. */
+		check_arg(steps[i].fence_deps.nr > 1 &&
+			  (steps[i].fence_deps.submit_fence ||
+			   !(flags & SYNCOBJ)),
+			  "Multiple fences need -F and cannot be submit fences at step %u!\n",
+			  i);
 	}
 
 	/* Validate SW_FENCE_SIGNAL targets. */
@@ -1026,6 +1110,29 @@ add_step:
 		}
 	}
 
+	/*
+	 * Tag the batches to sample the OA counters around. The OA unit
+	 * counts a single metric set for the whole device.
+	 */
+	for (i = 0; i < nr_steps; i++) {
+		if (steps[i].type != OA_SAMPLE)
+			continue;
+
+		tmp = steps[i].idx + steps[i].oa_target;
+		check_arg(tmp < 0 || tmp >= i ||
+			  steps[tmp].type != BATCH ||
+			  steps[tmp].engine != RCS ||
+			  steps[tmp].unbound_duration,
+			  "Invalid OA sampling target %u!\n", i);
+		check_arg(oa_metrics && strcmp(oa_metrics, steps[i].oa_metrics),
+			  "Different OA metric set at step %u!\n", i);
+
+		oa_metrics = steps[i].oa_metrics;
+		steps[tmp].oa_sample = true;
+		i915_oa_accumulator_init(&steps[tmp].oa,
+					 intel_get_drm_devid(fd), OA_FORMAT);
+	}
+
 	if (bcs_used && (flags & VCS2REMAP) && verbose)
 		printf("BCS usage in workload with VCS2 remapping enabled!\n");
 
@@ -1129,8 +1236,14 @@ terminate_bb(struct w_step *w, unsigned int flags)
 
 	if (w->unbound_duration)
 		batch_start -= 4 * sizeof(uint32_t); /* MI_ARB_CHK + MI_BATCH_BUFFER_START */
+	if (w->oa_sample)
+		batch_start -= 4 * sizeof(uint32_t); /* MI_REPORT_PERF_COUNT */
 
-	mmap_start = rounddown(batch_start, PAGE_SIZE);
+	/* The start report moves with the start of the batch */
+	if (w->oa_sample)
+		mmap_start = 0;
+	else
+		mmap_start = rounddown(batch_start, PAGE_SIZE);
 	mmap_len = ALIGN(w->bb_sz - mmap_start, PAGE_SIZE);
 
 	gem_set_domain(fd, w->bb_handle,
@@ -1193,6 +1306,21 @@ terminate_bb(struct w_step *w, unsigned int flags)
 		*cs++ = 0;
 	}
 
+	if (w->oa_sample) {
+		w->reloc[r].offset = batch_start + sizeof(uint32_t);
+		w->reloc[r++].delta = OA_REPORT_SIZE;
+		batch_start += 4 * sizeof(uint32_t);
+
+		*cs++ = MI_REPORT_PERF_COUNT;
+		*cs++ = OA_REPORT_SIZE;
+		*cs++ = 0;
+		*cs++ = OA_REPORT_END;
+
+		/* Placed at the start of each submission by update_bb_oa() */
+		w->oa_reloc = r++;
+		w->oa_bb = ptr;
+	}
+
 	*cs = bbe;
 
 	return r;
@@ -1332,6 +1460,10 @@ alloc_step_batch(struct workload *wrk, struct w_step *w, unsigned int flags)
 			w->reloc[i].target_handle = 1;
 		if (w->unbound_duration)
 			w->reloc[0].target_handle = j;
+		if (w->oa_sample) {
+			w->reloc[w->oa_reloc - 1].target_handle = 0;
+			w->reloc[w->oa_reloc].target_handle = 0;
+		}
 	}
 
 	w->eb.buffers_ptr = to_user_pointer(w->obj);
@@ -1461,6 +1593,129 @@ static size_t sizeof_engines_bond(int count)
 
 #define alloca0(sz) ({ size_t sz__ = (sz); memset(alloca(sz__), 0, sz__); })
 
+/*
+ * With -F sync fence dependencies are expressed with a syncobj per
+ * dependee step, signaled by its batch and waited upon by the batches
+ * depending on it through I915_EXEC_FENCE_ARRAY. The syncobjs are
+ * reused across iterations, so unlike with sync_file fences there is no
+ * fd to create, pass and close per dependency. Submit fences still use
+ * a sync_file, and a standalone fence is imported into the syncobj of
+ * its step when created.
+ */
+static void compile_syncobj_deps(struct workload *wrk)
+{
+	struct w_step *w;
+	int i, j;
+
+	for (i = 0, w = wrk->steps; i < wrk->nr_steps; i++, w++)
+		if (w->type == BATCH)
+			w->emit_fence = 0;
+
+	for (i = 0, w = wrk->steps; i < wrk->nr_steps; i++, w++) {
+		for (j = 0; j < w->fence_deps.nr; j++) {
+			struct w_step *tgt =
+				&wrk->steps[w->idx + w->fence_deps.list[j]];
+
+			if (w->fence_deps.submit_fence)
+				tgt->emit_fence = -1;
+			else if (!tgt->syncobj)
+				tgt->syncobj = syncobj_create(fd, 0);
+		}
+	}
+
+	for (i = 0, w = wrk->steps; i < wrk->nr_steps; i++, w++) {
+		unsigned int nr = 0;
+
+		if (w->type != BATCH)
+			continue;
+
+		if (!w->fence_deps.submit_fence)
+			nr = w->fence_deps.nr;
+		if (w->syncobj)
+			nr++;
+		if (!nr)
+			continue;
+
+		w->fences = calloc(nr, sizeof(*w->fences));
+		igt_assert(w->fences);
+
+		if (!w->fence_deps.submit_fence) {
+			for (j = 0; j < w->fence_deps.nr; j++) {
+				int tgt = w->idx + w->fence_deps.list[j];
+
+				w->fences[w->nr_fences].handle =
+					wrk->steps[tgt].syncobj;
+				w->fences[w->nr_fences++].flags =
+					I915_EXEC_FENCE_WAIT;
+			}
+		}
+
+		if (w->syncobj) {
+			w->fences[w->nr_fences].handle = w->syncobj;
+			w->fences[w->nr_fences++].flags =
+				I915_EXEC_FENCE_SIGNAL;
+		}
+	}
+}
+
+/*
+ * Resolves what the submission of each batch needs that doesn't change
+ * between iterations: the step providing its input fence and, for
+ * batches of a fixed duration, the batch start offset. The execbuf
+ * flags per engine are filled in lazily by eb_engine_flags().
+ */
+static void compile_workload(struct workload *wrk)
+{
+	struct w_step *w;
+	int i, j;
+
+	if (wrk->flags & SYNCOBJ)
+		compile_syncobj_deps(wrk);
+
+	for (i = 0, w = wrk->steps; i < wrk->nr_steps; i++, w++) {
+		w->engine_flags_mask = 0;
+		w->fence_dep = NULL;
+		w->fence_dep_flags = 0;
+		w->fixed_bb_start = false;
+
+		if (w->type != BATCH)
+			continue;
+
+		if (w->nr_fences) {
+			w->eb.cliprects_ptr = to_user_pointer(w->fences);
+			w->eb.num_cliprects = w->nr_fences;
+			w->fence_dep_flags = I915_EXEC_FENCE_ARRAY;
+		}
+
+		for (j = 0; j < w->fence_deps.nr; j++) {
+			int tgt = w->idx + w->fence_deps.list[j];
+
+			if ((wrk->flags & SYNCOBJ) &&
+			    !w->fence_deps.submit_fence)
+				break;
+
+			/* TODO: fence merging needed to support multiple inputs */
+			igt_assert(j == 0);
+			igt_assert(tgt >= 0 && tgt < w->idx);
+
+			w->fence_dep = &wrk->steps[tgt];
+			w->fence_dep_flags |= w->fence_deps.submit_fence ?
+					      I915_EXEC_FENCE_SUBMIT :
+					      I915_EXEC_FENCE_IN;
+		}
+
+		if (w->unbound_duration) {
+			w->eb.batch_start_offset = 0;
+			w->fixed_bb_start = true;
+		} else if (w->duration.min == w->duration.max) {
+			w->eb.batch_start_offset =
+				ALIGN(w->bb_sz - get_bb_sz(w->duration.min),
+				      2 * sizeof(uint32_t));
+			w->fixed_bb_start = true;
+		}
+	}
+}
+
 static int
 prepare_workload(unsigned int id, struct workload *wrk, unsigned int flags)
 {
@@ -1472,6 +1727,7 @@ prepare_workload(unsigned int id, struct workload *wrk, unsigned int flags)
 	wrk->id = id;
 	wrk->prng = rand();
 	wrk->bb_prng = (wrk->flags & SYNCEDCLIENTS) ? master_prng : rand();
+	wrk->arrival_prng = rand();
 	wrk->run = true;
 
 	ctx_vcs =  0;
@@ -1859,6 +2115,8 @@ prepare_workload(unsigned int id, struct workload *wrk, unsigned int flags)
 		alloc_step_batch(wrk, w, _flags);
 	}
 
+	compile_workload(wrk);
+
 	return 0;
 }
 
@@ -1884,32 +2142,26 @@ static enum intel_engine_id get_vcs_engine(unsigned int n)
 
 static uint32_t new_seqno(struct workload *wrk, enum intel_engine_id engine)
 {
-	uint32_t seqno;
-	int ret;
-
+	/*
+	 * The per-engine seqnos of the global domain are the only state
+	 * all clients write to, so they are allocated atomically rather
+	 * than under the global lock.
+	 */
 	if (wrk->flags & GLOBAL_BALANCE) {
 		igt_assert(wrk->global_wrk);
-		wrk = wrk->global_wrk;
-
-		ret = pthread_mutex_lock(&wrk->mutex);
-		igt_assert(ret == 0);
-	}
-
-	seqno = ++wrk->seqno[engine];
-
-	if (wrk->flags & GLOBAL_BALANCE) {
-		ret = pthread_mutex_unlock(&wrk->mutex);
-		igt_assert(ret == 0);
+		return __atomic_add_fetch(&wrk->global_wrk->seqno[engine], 1,
+					  __ATOMIC_RELAXED);
 	}
 
-	return seqno;
+	return ++wrk->seqno[engine];
 }
 
 static uint32_t
 current_seqno(struct workload *wrk, enum intel_engine_id engine)
 {
 	if (wrk->flags & GLOBAL_BALANCE)
-		return wrk->global_wrk->seqno[engine];
+		return __atomic_load_n(&wrk->global_wrk->seqno[engine],
+				       __ATOMIC_RELAXED);
 	else
 		return wrk->seqno[engine];
 }
@@ -2086,6 +2338,108 @@ static void get_rt_depth(struct workload *wrk,
 	} while (latch != rt->seqno);
 }
 
+static const enum latency_class engine_latency_class[NUM_ENGINES] = {
+	[DEFAULT] = LATENCY_RENDER,
+	[RCS] = LATENCY_RENDER,
+	[BCS] = LATENCY_COPY,
+	[VCS] = LATENCY_VIDEO,
+	[VCS1] = LATENCY_VIDEO,
+	[VCS2] = LATENCY_VIDEO,
+	[VECS] = LATENCY_VIDEO_ENHANCE,
+};
+
+static const char *latency_class_str[NUM_LATENCY_CLASSES] = {
+	[LATENCY_RENDER] = "RCS",
+	[LATENCY_COPY] = "BCS",
+	[LATENCY_VIDEO] = "VCS",
+	[LATENCY_VIDEO_ENHANCE] = "VECS",
+};
+
+static unsigned int latency_bucket(uint32_t v)
+{
+	unsigned int shift;
+
+	if (v < (1 << LATENCY_SUB_BITS))
+		return v;
+
+	shift = 31 - __builtin_clz(v) - LATENCY_SUB_BITS;
+
+	return ((shift + 1) << LATENCY_SUB_BITS) +
+	       ((v >> shift) & ((1 << LATENCY_SUB_BITS) - 1));
+}
+
+/* Highest value which falls into the bucket */
+static uint64_t latency_bucket_value(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < (1 << LATENCY_SUB_BITS))
+		return bucket;
+
+	shift = (bucket >> LATENCY_SUB_BITS) - 1;
+
+	return ((((1ull << LATENCY_SUB_BITS) +
+		  (bucket & ((1 << LATENCY_SUB_BITS) - 1))) + 1) << shift) - 1;
+}
+
+static uint64_t latency_percentile(const struct latency_hist *hist, double pct)
+{
+	unsigned long target = ceil(hist->total * pct / 100.0);
+	unsigned long sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		sum += hist->count[i];
+		if (sum >= target)
+			return latency_bucket_value(i);
+	}
+
+	return latency_bucket_value(LATENCY_BUCKETS - 1);
+}
+
+/*
+ * The status page holds the submit and completion timestamps of the
+ * last batch completed on each engine. Sampling it whenever we submit
+ * to the engine records each completion at most once, but not every
+ * one of them when more than one completes between submissions.
+ */
+static void sample_latency(struct workload *wrk, enum intel_engine_id engine)
+{
+	struct latency_hist *hist =
+		&wrk->latency[engine_latency_class[engine]];
+	struct rt_depth rt;
+
+	get_rt_depth(wrk, engine, &rt);
+	if (rt.seqno == wrk->latency_seqno[engine])
+		return;
+
+	wrk->latency_seqno[engine] = rt.seqno;
+	hist->count[latency_bucket(rt.completed - rt.submitted)]++;
+	hist->total++;
+}
+
+static double rcs_timestamp_ns;
+
+static void
+print_latency(const char *prefix, const struct latency_hist *latency)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_LATENCY_CLASSES; i++) {
+		const struct latency_hist *hist = &latency[i];
+
+		if (!hist->total)
+			continue;
+
+		printf("%s%s latency: p50 %.1fus, p99 %.1fus, p99.9 %.1fus (%lu samples)\n",
+		       prefix, latency_class_str[i],
+		       latency_percentile(hist, 50) * rcs_timestamp_ns / 1e3,
+		       latency_percentile(hist, 99) * rcs_timestamp_ns / 1e3,
+		       latency_percentile(hist, 99.9) * rcs_timestamp_ns / 1e3,
+		       hist->total);
+	}
+}
+
 static enum intel_engine_id
 __rt_balance(const struct workload_balancer *balancer,
 	     struct workload *wrk, struct w_step *w, bool random)
@@ -2289,6 +2643,81 @@ busy_init(const struct workload_balancer *balancer, struct workload *wrk)
 	return 0;
 }
 
+/*
+ * Predicts the completion time of a batch on each engine as
+ *
+ *     (queue depth + 1) x average completion time x (1 + busyness)
+ *
+ * where the completion time average tracks our own recent batches and
+ * busyness, from the PMU, also captures load from other clients which
+ * our queue depth does not see. The
+ * prediction is then scaled by how far off the previous predictions for
+ * the engine turned out to be, which is learnt from the completion times
+ * of the batches it was made for.
+ */
+static enum intel_engine_id
+cost_balance(const struct workload_balancer *balancer,
+	     struct workload *wrk, struct w_step *w)
+{
+	struct cost_model *cm = &wrk->cost;
+	uint64_t cost[NUM_ENGINES];
+	unsigned long qd[NUM_ENGINES];
+	unsigned int engine;
+
+	igt_assert(w->engine == VCS);
+
+	get_pmu_stats(balancer, wrk);
+
+	for (engine = VCS1; engine <= VCS2; engine++) {
+		struct cost_prediction *p;
+		struct rt_depth rt;
+		uint64_t error;
+
+		get_rt_depth(wrk, engine, &rt);
+		if (rt.seqno != cm->last[engine]) {
+			uint32_t latency = rt.completed - rt.submitted;
+
+			igt_assert((long)latency > 0);
+			ewma_rt_add(&cm->avg[engine], latency);
+			cm->last[engine] = rt.seqno;
+
+			p = &cm->predicted[engine][rt.seqno % COST_HISTORY];
+			if (p->seqno == rt.seqno && p->cost) {
+				error = 16 * latency / p->cost;
+				ewma_rt_add(&cm->error[engine],
+					    error ? error : 1);
+			}
+		}
+
+		qd[engine] = current_seqno(wrk, engine) - rt.seqno;
+		wrk->qd_sum[engine] += qd[engine];
+
+		cost[engine] = (qd[engine] + 1) *
+			       ewma_rt_read(&cm->avg[engine]) *
+			       (100 + get_engine_busy(balancer, wrk, engine)) /
+			       100;
+
+		/* Next seqno on the engine, if this batch ends up there. */
+		p = &cm->predicted[engine][(current_seqno(wrk, engine) + 1) %
+					   COST_HISTORY];
+		p->seqno = current_seqno(wrk, engine) + 1;
+		p->cost = cost[engine];
+
+		error = ewma_rt_read(&cm->error[engine]);
+		qd[engine] = error ? cost[engine] * error / 16 : cost[engine];
+
+#ifdef DEBUG
+		printf("cost[%d] = %ld x %ld x %u%% x %ld/16 = %ld\n",
+		       engine, current_seqno(wrk, engine) - rt.seqno,
+		       ewma_rt_read(&cm->avg[engine]),
+		       get_engine_busy(balancer, wrk, engine),
+		       error, qd[engine]);
+#endif
+	}
+
+	return __rt_select_engine(wrk, qd, false);
+}
+
 static const struct workload_balancer all_balancers[] = {
 	{
 		.id = 0,
@@ -2378,6 +2807,16 @@ static const struct workload_balancer all_balancers[] = {
 		.get_qd = get_engine_busy,
 		.balance = busy_avg_balance,
 	},
+	{
+		.id = 12,
+		.name = "cost",
+		.desc = "Lowest predicted completion time, from queue depth, runtime and busyness, with feedback.",
+		.flags = SEQNO | RT,
+		.min_gen = 8,
+		.init = busy_init,
+		.get_qd = get_qd_depth,
+		.balance = cost_balance,
+	},
 	{
 		.id = 11,
 		.name = "i915",
@@ -2407,6 +2846,16 @@ global_balance(const struct workload_balancer *balancer,
 	igt_assert(wrk->global_wrk);
 	igt_assert(wrk->global_balancer);
 
+	/*
+	 * Lock-free, each client balances with its own balancer state
+	 * (round-robin and random state, queue depth and runtime
+	 * averages, busyness counters) and only reads the shared seqnos
+	 * and status page.
+	 */
+	if (wrk->flags & LOCKFREE)
+		return wrk->global_balancer->balance(wrk->global_balancer,
+						     wrk, w);
+
 	wrk = wrk->global_wrk;
 
 	ret = pthread_mutex_lock(&wrk->mutex);
@@ -2481,6 +2930,60 @@ update_bb_start(struct w_step *w)
 	*w->recursive_bb_start = MI_BATCH_BUFFER_START | (1 << 8) | 1;
 }
 
+/*
+ * Puts the start report at the start offset of this submission, giving
+ * back the nops it replaced on the previous one, which collect_oa_reports()
+ * has waited for.
+ */
+static void
+update_bb_oa(struct w_step *w)
+{
+	struct drm_i915_gem_relocation_entry *reloc = &w->reloc[w->oa_reloc];
+	uint32_t *cs = w->oa_bb + w->eb.batch_start_offset / sizeof(uint32_t);
+	uint64_t address;
+
+	gem_set_domain(fd, w->bb_handle,
+		       I915_GEM_DOMAIN_WC, I915_GEM_DOMAIN_WC);
+
+	if (w->oa_start)
+		memcpy(w->oa_start, w->oa_saved, sizeof(w->oa_saved));
+	memcpy(w->oa_saved, cs, sizeof(w->oa_saved));
+	w->oa_start = cs;
+
+	reloc->offset = w->eb.batch_start_offset + sizeof(uint32_t);
+	address = reloc->presumed_offset + reloc->delta;
+
+	*cs++ = MI_REPORT_PERF_COUNT;
+	*cs++ = address;
+	*cs++ = address >> 32;
+	*cs++ = OA_REPORT_START;
+
+	/* If not using NO_RELOC, force the relocations */
+	if (!(w->eb.flags & I915_EXEC_NO_RELOC))
+		reloc->presumed_offset = -1;
+
+	w->oa_pending = true;
+}
+
+static void collect_oa_reports(struct w_step *w)
+{
+	uint32_t reports[2][OA_REPORT_SIZE / sizeof(uint32_t)];
+
+	if (!w->oa_pending)
+		return;
+
+	/* Waits for the batch */
+	gem_read(fd, w->obj[0].handle, 0, reports, sizeof(reports));
+	w->oa_pending = false;
+
+	if (reports[0][0] != OA_REPORT_START ||
+	    reports[1][0] != OA_REPORT_END)
+		return;
+
+	i915_oa_accumulate_reports(&w->oa, reports[0], reports[1]);
+	w->oa_batches++;
+}
+
 static void w_sync_to(struct workload *wrk, struct w_step *w, int target)
 {
 	if (target < 0)
@@ -2602,14 +3105,32 @@ static void init_status_page(struct workload *wrk, unsigned int flags)
 	}
 }
 
+/*
+ * Execbuf flags of a batch for each engine it gets submitted to. They
+ * only depend on the step and the engine, so are worked out on the
+ * first submission to each engine only.
+ */
+static uint64_t
+eb_engine_flags(struct workload *wrk, struct w_step *w,
+		enum intel_engine_id engine, unsigned int flags)
+{
+	if (!(w->engine_flags_mask & (1 << engine))) {
+		eb_update_flags(wrk, w, engine, flags);
+		w->engine_flags[engine] = w->eb.flags | w->fence_dep_flags;
+		w->engine_flags_mask |= 1 << engine;
+	}
+
+	return w->engine_flags[engine];
+}
+
 static void
 do_eb(struct workload *wrk, struct w_step *w, enum intel_engine_id engine,
       unsigned int flags)
 {
 	uint32_t seqno = new_seqno(wrk, engine);
-	unsigned int i;
 
-	eb_update_flags(wrk, w, engine, flags);
+	igt_assert(w->emit_fence <= 0);
+	w->eb.flags = eb_engine_flags(wrk, w, engine, flags);
 
 	if (flags & SEQNO)
 		update_bb_seqno(w, engine, seqno);
@@ -2618,26 +3139,17 @@ do_eb(struct workload *wrk, struct w_step *w, enum intel_engine_id engine,
 
 	update_bb_start(w);
 
-	w->eb.batch_start_offset =
-		w->unbound_duration ?
-		0 :
-		ALIGN(w->bb_sz - get_bb_sz(get_duration(wrk, w)),
-		      2 * sizeof(uint32_t));
+	if (!w->fixed_bb_start)
+		w->eb.batch_start_offset =
+			ALIGN(w->bb_sz - get_bb_sz(get_duration(wrk, w)),
+			      2 * sizeof(uint32_t));
 
-	for (i = 0; i < w->fence_deps.nr; i++) {
-		int tgt = w->idx + w->fence_deps.list[i];
+	if (w->oa_sample)
+		update_bb_oa(w);
 
-		/* TODO: fence merging needed to support multiple inputs */
-		igt_assert(i == 0);
-		igt_assert(tgt >= 0 && tgt < w->idx);
-		igt_assert(wrk->steps[tgt].emit_fence > 0);
-
-		if (w->fence_deps.submit_fence)
-			w->eb.flags |= I915_EXEC_FENCE_SUBMIT;
-		else
-			w->eb.flags |= I915_EXEC_FENCE_IN;
-
-		w->eb.rsvd2 = wrk->steps[tgt].emit_fence;
+	if (w->fence_dep) {
+		igt_assert(w->fence_dep->emit_fence > 0);
+		w->eb.rsvd2 = w->fence_dep->emit_fence;
 	}
 
 	if (w->eb.flags & I915_EXEC_FENCE_OUT)
@@ -2677,12 +3189,183 @@ static bool sync_deps(struct workload *wrk, struct w_step *w)
 	return synced;
 }
 
+/* Seconds from one workload iteration arrival to the next. */
+static double next_arrival(struct workload *wrk)
+{
+	double u;
+
+	if (!(wrk->flags & POISSON))
+		return 1.0 / wrk->rate;
+
+	/* Exponentially distributed intervals, u from (0, 1]. */
+	u = (hars_petruska_f54_1_random(&wrk->arrival_prng) + 1.0) /
+	    (UINT32_MAX + 1.0);
+
+	return -log(u) / wrk->rate;
+}
+
+static void sync_requests(struct workload *wrk)
+{
+	struct w_step *w;
+	int i;
+
+	for (i = 0; i < NUM_ENGINES; i++) {
+		if (!wrk->nrequest[i])
+			continue;
+
+		w = igt_list_last_entry(&wrk->requests[i], w, rq_link);
+		gem_sync(fd, w->obj[0].handle);
+
+		if (wrk->flags & LATENCY)
+			sample_latency(wrk, i);
+	}
+}
+
+static void print_frame_latency(const char *prefix,
+				const struct latency_hist *hist)
+{
+	if (!hist->total)
+		return;
+
+	printf("%sframe latency: p50 %luus, p99 %luus, p99.9 %luus (%lu frames)\n",
+	       prefix,
+	       (unsigned long)latency_percentile(hist, 50),
+	       (unsigned long)latency_percentile(hist, 99),
+	       (unsigned long)latency_percentile(hist, 99.9),
+	       hist->total);
+}
+
+static void bench_latency(const char *name, const struct latency_hist *hist,
+			  double scale)
+{
+	char buf[64];
+
+	if (!hist->total)
+		return;
+
+	snprintf(buf, sizeof(buf), "%s-p50", name);
+	igt_bench_value(buf, "us", latency_percentile(hist, 50) * scale);
+	snprintf(buf, sizeof(buf), "%s-p99", name);
+	igt_bench_value(buf, "us", latency_percentile(hist, 99) * scale);
+	snprintf(buf, sizeof(buf), "%s-p99.9", name);
+	igt_bench_value(buf, "us", latency_percentile(hist, 99.9) * scale);
+}
+
+static void oa_counter_name(const struct i915_oa_format *format, int idx,
+			    char *buf, size_t len)
+{
+	idx -= 2; /* timestamp and clock cycles */
+	if (idx < format->n_a40) {
+		snprintf(buf, len, "A%d", idx);
+		return;
+	}
+
+	idx -= format->n_a40;
+	if (idx < format->n_a) {
+		snprintf(buf, len, "A%d", format->first_a + idx);
+		return;
+	}
+
+	idx -= format->n_a;
+	if (idx < format->n_b) {
+		snprintf(buf, len, "B%d", idx);
+		return;
+	}
+
+	snprintf(buf, len, "C%d", idx - format->n_b);
+}
+
+/*
+ * What the counters count depends on the metric set, so they are reported
+ * raw, per gpu clock over the sampled batches. Steps of clients running the
+ * same workload are added up, otherwise reported per client.
+ */
+static void report_oa(struct workload **w, unsigned int clients, bool merge)
+{
+	unsigned int c, i, n;
+	int j;
+
+	for (c = 0; c < (merge ? 1 : clients); c++) {
+		for (i = 0; i < w[c]->nr_steps; i++) {
+			const struct i915_oa_format *format;
+			uint64_t deltas[I915_OA_MAX_RAW_COUNTERS] = {};
+			unsigned long batches = 0;
+			char prefix[32], name[48];
+			int count;
+
+			if (!w[c]->steps[i].oa_sample)
+				continue;
+
+			for (n = merge ? 0 : c; n < (merge ? clients : c + 1); n++) {
+				const struct w_step *step = &w[n]->steps[i];
+
+				batches += step->oa_batches;
+				for (j = 0; j < I915_OA_MAX_RAW_COUNTERS; j++)
+					deltas[j] += step->oa.deltas[j];
+			}
+
+			if (!batches || !deltas[1])
+				continue;
+
+			format = i915_oa_get_format(w[c]->steps[i].oa.devid,
+						    OA_FORMAT);
+			count = 2 + format->n_a40 + format->n_a +
+				format->n_b + format->n_c;
+
+			if (merge)
+				snprintf(prefix, sizeof(prefix), "step%u", i);
+			else
+				snprintf(prefix, sizeof(prefix), "client%u-step%u",
+					 c, i);
+
+			if (verbose) {
+				printf("%s: %lu batches sampled, %.1fus and %"PRIu64" clocks each, per clock:",
+				       prefix, batches,
+				       deltas[0] * 1e6 / oa_timestamp_frequency / batches,
+				       deltas[1] / batches);
+				for (j = 2; j < count; j++) {
+					if (!deltas[j])
+						continue;
+
+					oa_counter_name(format, j,
+							name, sizeof(name));
+					printf(" %s %.3f", name,
+					       (double)deltas[j] / deltas[1]);
+				}
+				putchar('\n');
+			}
+
+			snprintf(name, sizeof(name), "%s-oa-time", prefix);
+			igt_bench_value(name, "us",
+					deltas[0] * 1e6 / oa_timestamp_frequency /
+					batches);
+			snprintf(name, sizeof(name), "%s-oa-clocks", prefix);
+			igt_bench_value(name, "clocks",
+					(double)deltas[1] / batches);
+			for (j = 2; j < count; j++) {
+				int l;
+
+				if (!deltas[j])
+					continue;
+
+				l = snprintf(name, sizeof(name), "%s-oa-",
+					     prefix);
+				oa_counter_name(format, j, name + l,
+						sizeof(name) - l);
+				igt_bench_value(name, "per-clock",
+						(double)deltas[j] / deltas[1]);
+			}
+		}
+	}
+}
+
 static void *run_workload(void *data)
 {
 	struct workload *wrk = (struct workload *)data;
 	struct timespec t_start, t_end;
 	struct w_step *w;
 	bool last_sync = false;
+	double arrival = 0;
 	int throttle = -1;
 	int qd_throttle = -1;
 	int count;
@@ -2697,6 +3380,23 @@ static void *run_workload(void *data)
 
 		clock_gettime(CLOCK_MONOTONIC, &wrk->repeat_start);
 
+		/*
+		 * Arrivals follow the schedule regardless of how long the
+		 * previous iterations took, so once the client saturates the
+		 * backlog, and with it the latency, keeps growing.
+		 */
+		if (wrk->rate) {
+			double t = elapsed(&t_start, &wrk->repeat_start);
+
+			if (arrival > t) {
+				usleep((arrival - t) * 1e6);
+				clock_gettime(CLOCK_MONOTONIC,
+					      &wrk->repeat_start);
+			} else if (count) {
+				wrk->late++;
+			}
+		}
+
 		for (i = 0, w = wrk->steps; wrk->run && (i < wrk->nr_steps);
 		     i++, w++) {
 			enum intel_engine_id engine = w->engine;
@@ -2735,6 +3435,9 @@ static void *run_workload(void *data)
 					sw_sync_timeline_create_fence(wrk->sync_timeline,
 								      cur_seqno + w->idx);
 				igt_assert(w->emit_fence > 0);
+				if (w->syncobj)
+					syncobj_import_sync_file(fd, w->syncobj,
+								 w->emit_fence);
 				continue;
 			} else if (w->type == SW_FENCE_SIGNAL) {
 				int tgt = w->idx + w->target;
@@ -2773,7 +3476,8 @@ static void *run_workload(void *data)
 			} else if (w->type == PREEMPTION ||
 				   w->type == ENGINE_MAP ||
 				   w->type == LOAD_BALANCE ||
-				   w->type == BOND) {
+				   w->type == BOND ||
+				   w->type == OA_SAMPLE) {
 				continue;
 			} else if (w->type == SSEU) {
 				if (w->sseu != wrk->ctx_list[w->context * 2].sseu) {
@@ -2810,7 +3514,14 @@ static void *run_workload(void *data)
 			if (throttle > 0)
 				w_sync_to(wrk, w, i - throttle);
 
+			if (w->oa_sample)
+				collect_oa_reports(w);
+
 			do_eb(wrk, w, engine, wrk->flags);
+			wrk->nr_eb++;
+
+			if (wrk->flags & LATENCY)
+				sample_latency(wrk, engine);
 
 			if (w->request != -1) {
 				igt_list_del(&w->rq_link);
@@ -2861,18 +3572,33 @@ static void *run_workload(void *data)
 				w->emit_fence = -1;
 			}
 		}
-	}
 
-	for (i = 0; i < NUM_ENGINES; i++) {
-		if (!wrk->nrequest[i])
-			continue;
+		if (wrk->rate) {
+			struct timespec now;
+			double latency;
 
-		w = igt_list_last_entry(&wrk->requests[i], w, rq_link);
-		gem_sync(fd, w->obj[0].handle);
+			sync_requests(wrk);
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			latency = (elapsed(&t_start, &now) - arrival) * 1e6;
+			if (latency > UINT32_MAX)
+				latency = UINT32_MAX;
+			wrk->frame_latency.count[latency_bucket(latency)]++;
+			wrk->frame_latency.total++;
+
+			arrival += next_arrival(wrk);
+		}
 	}
 
+	sync_requests(wrk);
+
+	for (i = 0, w = wrk->steps; i < wrk->nr_steps; i++, w++)
+		collect_oa_reports(w);
+
 	clock_gettime(CLOCK_MONOTONIC, &t_end);
 
+	wrk->throughput = count / elapsed(&t_start, &t_end);
+
 	if (wrk->print_stats) {
 		double t = elapsed(&t_start, &t_end);
 
@@ -2887,6 +3613,21 @@ static void *run_workload(void *data)
 			       (double)wrk->qd_sum[VCS1] / wrk->nr_bb[VCS],
 			       (double)wrk->qd_sum[VCS2] / wrk->nr_bb[VCS]);
 		putchar('\n');
+
+		if (wrk->flags & LATENCY || wrk->rate) {
+			char prefix[16];
+
+			snprintf(prefix, sizeof(prefix), "%c%u: ",
+				 wrk->background ? ' ' : '*', wrk->id);
+			if (wrk->flags & LATENCY)
+				print_latency(prefix, wrk->latency);
+			if (wrk->rate) {
+				printf("%s%.3f/%.3f workloads/s achieved, %lu started late.\n",
+				       prefix, count / t, wrk->rate, wrk->late);
+				print_frame_latency(prefix,
+						    &wrk->frame_latency);
+			}
+		}
 	}
 
 	return NULL;
@@ -2894,50 +3635,16 @@ static void *run_workload(void *data)
 
 static void fini_workload(struct workload *wrk)
 {
+	for (int i = 0; i < wrk->nr_steps; i++) {
+		if (wrk->steps[i].syncobj)
+			syncobj_destroy(fd, wrk->steps[i].syncobj);
+		free(wrk->steps[i].fences);
+	}
+
 	free(wrk->steps);
 	free(wrk);
 }
 
-static unsigned long calibrate_nop(unsigned int tolerance_pct)
-{
-	const uint32_t bbe = 0xa << 23;
-	unsigned int loops = 17;
-	unsigned int usecs = nop_calibration_us;
-	struct drm_i915_gem_exec_object2 obj = {};
-	struct drm_i915_gem_execbuffer2 eb =
-		{ .buffer_count = 1, .buffers_ptr = (uintptr_t)&obj};
-	long size, last_size;
-	struct timespec t_0, t_end;
-
-	clock_gettime(CLOCK_MONOTONIC, &t_0);
-
-	size = 256 * 1024;
-	do {
-		struct timespec t_start;
-
-		obj.handle = gem_create(fd, size);
-		gem_write(fd, obj.handle, size - sizeof(bbe), &bbe,
-			  sizeof(bbe));
-		gem_execbuf(fd, &eb);
-		gem_sync(fd, obj.handle);
-
-		clock_gettime(CLOCK_MONOTONIC, &t_start);
-		for (int loop = 0; loop < loops; loop++)
-			gem_execbuf(fd, &eb);
-		gem_sync(fd, obj.handle);
-		clock_gettime(CLOCK_MONOTONIC, &t_end);
-
-		gem_close(fd, obj.handle);
-
-		last_size = size;
-		size = loops * size / elapsed(&t_start, &t_end) / 1e6 * usecs;
-		size = ALIGN(size, sizeof(uint32_t));
-	} while (elapsed(&t_0, &t_end) < 5 ||
-		 abs(size - last_size) > (size * tolerance_pct / 100));
-
-	return size / sizeof(uint32_t);
-}
-
 static void print_help(void)
 {
 	unsigned int i;
@@ -2946,8 +3653,8 @@ static void print_help(void)
 "Usage: gem_wsim [OPTIONS]\n"
 "\n"
 "Runs a simulated workload on the GPU.\n"
-"When ran without arguments performs a GPU calibration result of which needs to\n"
-"be provided when running the simulation in subsequent invocations.\n"
+"When ran without arguments performs a GPU calibration, which is cached for the\n"
+"subsequent invocations not given one with -n.\n"
 "\n"
 "Options:\n"
 "  -h              This text.\n"
@@ -2993,7 +3700,21 @@ static void print_help(void)
 "                  clients.\n"
 "  -G              Global load balancing - a single load balancer will be shared\n"
 "                  between all clients and there will be a single seqno domain.\n"
-"  -d              Sync between data dependencies in userspace."
+"  -L              Lock-free global load balancing - clients running with -G\n"
+"                  keep their own balancer state and only share the seqnos.\n"
+"                  Scales to more clients than the single shared balancer.\n"
+"  -l              Report batch submit to completion latency percentiles per\n"
+"                  engine class. Latencies are taken from the timestamps of the\n"
+"                  last completed batch on each engine, which are sampled on\n"
+"                  every submission.\n"
+"  -Q <rate>       Open-loop arrivals - every client starts workload iterations\n"
+"                  at the given rate per second, regardless of how long the\n"
+"                  previous ones took, and waits for each to complete so the\n"
+"                  achieved rate and iteration latency can be reported.\n"
+"  -E              Use Poisson instead of fixed arrivals with -Q.\n"
+"  -d              Sync between data dependencies in userspace.\n"
+"  -F              Express sync fence dependencies with syncobjs instead of\n"
+"                  sync_file fences, allowing multiple per step."
 	);
 }
 
@@ -3065,6 +3786,22 @@ static const struct workload_balancer *find_balancer_by_id(unsigned int id)
 	return NULL;
 }
 
+/* Length of an RCS timestamp tick, for reporting latencies */
+static void calibrate_rcs_timestamp(void)
+{
+	struct timespec t_start, t_end;
+	uint32_t rcs_start, rcs_end;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	rcs_start = *REG(RCS_TIMESTAMP);
+	usleep(10000);
+	rcs_end = *REG(RCS_TIMESTAMP);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+	rcs_timestamp_ns = elapsed(&t_start, &t_end) * 1e9 /
+			   (rcs_end - rcs_start);
+}
+
 static void init_clocks(void)
 {
 	struct timespec t_start, t_end;
@@ -3113,9 +3850,14 @@ int main(int argc, char **argv)
 	struct w_arg *w_args = NULL;
 	unsigned int tolerance_pct = 1;
 	const struct workload_balancer *balancer = NULL;
+	struct i915_oa_stream *oa_stream = NULL;
+	struct igt_engine_snapshot engines_start, engines_end;
+	struct igt_engine_monitor *engines;
+	struct igt_bench_energy energy;
 	char *endptr = NULL;
+	double rate = 0;
 	int prio = 0;
-	double t;
+	double t, J;
 	int i, c;
 
 	/*
@@ -3132,7 +3874,7 @@ int main(int argc, char **argv)
 	master_prng = time(NULL);
 
 	while ((c = getopt(argc, argv,
-			   "hqv2RsSHxGdc:n:r:w:W:a:t:b:p:I:")) != -1) {
+			   "hqv2RsSHxGLlEdFc:n:r:w:W:a:t:b:p:I:Q:")) != -1) {
 		switch (c) {
 		case 'W':
 			if (master_workload >= 0) {
@@ -3194,9 +3936,28 @@ int main(int argc, char **argv)
 		case 'G':
 			flags |= GLOBAL_BALANCE;
 			break;
+		case 'L':
+			flags |= LOCKFREE;
+			break;
+		case 'l':
+			flags |= LATENCY | SEQNO | RT;
+			break;
+		case 'Q':
+			rate = strtod(optarg, &endptr);
+			if (*endptr || rate <= 0) {
+				wsim_err("Invalid rate '%s'!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'E':
+			flags |= POISSON;
+			break;
 		case 'd':
 			flags |= DEPSYNC;
 			break;
+		case 'F':
+			flags |= SYNCOBJ;
+			break;
 		case 'b':
 			i = find_balancer_by_name(optarg);
 			if (i < 0) {
@@ -3240,11 +4001,12 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	if (!nop_calibration) {
+	if (!nop_calibration && !nr_w_args) {
 		if (verbose > 1)
 			printf("Calibrating nop delay with %u%% tolerance...\n",
 				tolerance_pct);
-		nop_calibration = calibrate_nop(tolerance_pct);
+		nop_calibration = igt_nop_calibrate(fd, I915_EXEC_DEFAULT,
+						    tolerance_pct);
 		if (verbose)
 			printf("Nop calibration for %uus delay is %lu.\n",
 			       nop_calibration_us, nop_calibration);
@@ -3252,6 +4014,9 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	if (!nop_calibration)
+		nop_calibration = igt_nop_calibration(fd, I915_EXEC_DEFAULT);
+
 	if (!nr_w_args) {
 		wsim_err("No workload descriptor(s)!\n");
 		return 1;
@@ -3267,6 +4032,32 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if ((flags & LOCKFREE) && !(flags & GLOBAL_BALANCE)) {
+		wsim_err("Lock-free balancing needs global balancing!\n");
+		return 1;
+	}
+
+	if ((flags & POISSON) && !rate) {
+		wsim_err("Poisson arrivals need a target rate!\n");
+		return 1;
+	}
+
+	if (flags & SYNCOBJ) {
+		int has = 0;
+		struct drm_i915_getparam gp = {
+			.param = I915_PARAM_HAS_EXEC_FENCE_ARRAY,
+			.value = &has,
+		};
+
+		if (igt_ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp) || !has) {
+			wsim_err("Syncobj dependencies need I915_EXEC_FENCE_ARRAY!\n");
+			return 1;
+		}
+	}
+
+	if (flags & LATENCY)
+		calibrate_rcs_timestamp();
+
 	if (append_workload_arg) {
 		append_workload_arg = load_workload_descriptor(append_workload_arg);
 		if (!append_workload_arg) {
@@ -3305,6 +4096,28 @@ int main(int argc, char **argv)
 	if (nr_w_args > 1)
 		clients = nr_w_args;
 
+	if (oa_metrics) {
+		uint64_t metric_set;
+
+		if (!i915_oa_metric_set_id(fd, oa_metrics, &metric_set)) {
+			wsim_err("Unknown OA metric set %s!\n", oa_metrics);
+			return 1;
+		}
+
+		/* Without periodic sampling, only for MI_REPORT_PERF_COUNT */
+		oa_stream = i915_oa_stream_open(fd, metric_set, OA_FORMAT, -1);
+		if (!oa_stream) {
+			wsim_err("Failed to open the OA stream! (%d)\n", errno);
+			return 1;
+		}
+
+		oa_timestamp_frequency = i915_oa_timestamp_frequency(fd);
+		if (!oa_timestamp_frequency) {
+			wsim_err("Unknown OA timestamp frequency!\n");
+			return 1;
+		}
+	}
+
 	if (verbose > 1) {
 		printf("Random seed is %u.\n", master_prng);
 		printf("Using %lu nop calibration for %uus delay.\n",
@@ -3317,8 +4130,9 @@ int main(int argc, char **argv)
 				printf("Ignoring global balancing with i915!\n");
 				flags &= ~GLOBAL_BALANCE;
 			} else {
-				printf("Using %s balancer in global mode.\n",
-				       balancer->name);
+				printf("Using %s balancer in %sglobal mode.\n",
+				       balancer->name,
+				       flags & LOCKFREE ? "lock-free " : "");
 			}
 		} else if (balancer) {
 			printf("Using %s balancer.\n", balancer->name);
@@ -3352,6 +4166,7 @@ int main(int argc, char **argv)
 
 		w[i]->flags = flags;
 		w[i]->repeat = repeat;
+		w[i]->rate = rate;
 		w[i]->background = master_workload >= 0 && i != master_workload;
 		w[i]->print_stats = verbose > 1 ||
 				    (verbose > 0 && master_workload == i);
@@ -3372,8 +4187,30 @@ int main(int argc, char **argv)
 		}
 	}
 
+	igt_bench_begin("gem_wsim");
+	for (i = 0; i < nr_w_args; i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "workload%u", i);
+		igt_bench_param(name, "%s", w_args[i].filename);
+	}
+	igt_bench_param("clients", "%u", clients);
+	igt_bench_param("repeat", "%u", repeat);
+	igt_bench_param("balancer", "%s", balancer ? balancer->name : "none");
+	igt_bench_param("flags", "0x%x", flags);
+	if (rate)
+		igt_bench_param("rate", "%g", rate);
+	if (oa_metrics)
+		igt_bench_param("oa-metrics", "%s", oa_metrics);
+
+	igt_freq_bench_setup(fd);
+
 	gem_quiescent_gpu(fd);
 
+	engines = igt_engine_monitor_open(fd);
+	if (engines)
+		igt_engine_monitor_snapshot(engines, &engines_start);
+	igt_bench_energy_start(&energy);
 	clock_gettime(CLOCK_MONOTONIC, &t_start);
 
 	for (i = 0; i < clients; i++) {
@@ -3400,12 +4237,127 @@ int main(int argc, char **argv)
 	}
 
 	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	J = igt_bench_energy_stop(&energy);
+	if (engines)
+		igt_engine_monitor_snapshot(engines, &engines_end);
 
 	t = elapsed(&t_start, &t_end);
 	if (verbose)
 		printf("%.3fs elapsed (%.3f workloads/s)\n",
 		       t, clients * repeat / t);
 
+	if (!isnan(J)) {
+		unsigned long execbufs = 0;
+
+		for (i = 0; i < clients; i++)
+			execbufs += w[i]->nr_eb;
+
+		if (verbose)
+			printf("%.3fJ consumed (%.3fW, %.3fJ/workload, %.3fmJ/execbuf)\n",
+			       J, igt_bench_energy_W(&energy),
+			       J / (clients * repeat),
+			       execbufs ? 1e3 * J / execbufs : 0.);
+
+		igt_bench_value("workload-energy", "J/workload",
+				J / (clients * repeat));
+		if (execbufs)
+			igt_bench_value("execbuf-energy", "J/execbuf",
+					J / execbufs);
+	}
+
+	if (engines) {
+		struct igt_engine_utilization util[IGT_ENGINE_MONITOR_MAX];
+
+		igt_engine_monitor_delta(engines, &engines_start, &engines_end,
+					 util);
+		for (i = 0; i < igt_engine_monitor_count(engines); i++) {
+			const char *e = igt_engine_monitor_name(engines, i);
+			char name[32];
+
+			if (verbose)
+				printf("%s: %.1f%% busy, %.1f%% wait, %.1f%% sema\n",
+				       e, util[i].busy, util[i].wait,
+				       util[i].sema);
+
+			snprintf(name, sizeof(name), "%s-busy", e);
+			igt_bench_value(name, "%", util[i].busy);
+			snprintf(name, sizeof(name), "%s-wait", e);
+			igt_bench_value(name, "%", util[i].wait);
+			snprintf(name, sizeof(name), "%s-sema", e);
+			igt_bench_value(name, "%", util[i].sema);
+		}
+
+		igt_engine_monitor_close(engines);
+	}
+
+	if (igt_bench_enabled()) {
+		igt_stats_t stats;
+
+		igt_stats_init_with_size(&stats, clients);
+		for (i = 0; i < clients; i++)
+			igt_stats_push_float(&stats, w[i]->throughput);
+
+		igt_bench_value("elapsed", "s", t);
+		igt_bench_value("throughput", "workloads/s",
+				clients * repeat / t);
+		igt_bench_result("client-throughput", "workloads/s", &stats);
+		igt_stats_fini(&stats);
+	}
+
+	if ((verbose || igt_bench_enabled()) && (flags & LATENCY)) {
+		struct latency_hist latency[NUM_LATENCY_CLASSES] = { };
+		unsigned int c, b;
+
+		for (i = 0; i < clients; i++) {
+			for (c = 0; c < NUM_LATENCY_CLASSES; c++) {
+				for (b = 0; b < LATENCY_BUCKETS; b++)
+					latency[c].count[b] +=
+						w[i]->latency[c].count[b];
+				latency[c].total += w[i]->latency[c].total;
+			}
+		}
+
+		if (verbose)
+			print_latency("", latency);
+
+		for (c = 0; c < NUM_LATENCY_CLASSES; c++) {
+			char name[32];
+
+			snprintf(name, sizeof(name), "%s-latency",
+				 latency_class_str[c]);
+			bench_latency(name, &latency[c], rcs_timestamp_ns / 1e3);
+		}
+	}
+
+	if ((verbose || igt_bench_enabled()) && rate) {
+		struct latency_hist latency = { };
+		unsigned long late = 0;
+		unsigned int b;
+
+		for (i = 0; i < clients; i++) {
+			for (b = 0; b < LATENCY_BUCKETS; b++)
+				latency.count[b] += w[i]->frame_latency.count[b];
+			latency.total += w[i]->frame_latency.total;
+			late += w[i]->late;
+		}
+
+		if (verbose) {
+			printf("%.3f/%.3f workloads/s achieved, %lu started late.\n",
+			       latency.total / t, clients * rate, late);
+			print_frame_latency("", &latency);
+		}
+
+		igt_bench_value("late", "workloads", late);
+		bench_latency("frame-latency", &latency, 1);
+	}
+
+	if (oa_stream)
+		report_oa(w, clients, nr_w_args == 1);
+
+	igt_bench_end();
+
+	i915_oa_stream_close(oa_stream);
+
 	for (i = 0; i < clients; i++)
 		fini_workload(w[i]);
 	free(w);
@@ -0,0 +1,356 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * Measures how GVT-g scales with the number of vGPUs. For each count of
+ * vGPUs, doubling from none up to as many as the vGPU type allows, the vGPUs
+ * are created and a nop or copy workload is run on the host for the duration,
+ * the drop in its throughput from the run without vGPUs being the overhead
+ * of mediating them.
+ *
+ * Workloads inside guests are started by the -g command, run through the
+ * shell once per vGPU with IGT_VGPU_UUID, IGT_VGPU_INDEX and
+ * IGT_VGPU_DURATION set in its environment. It is expected to boot a guest on
+ * the vGPU, for example with qemu and
+ * -device vfio-pci,sysfsdev=/sys/bus/pci/devices/0000:00:02.0/$IGT_VGPU_UUID,
+ * print a first line once the guest is up, then run a workload such as
+ * gem_wsim there for IGT_VGPU_DURATION seconds and print its throughput as
+ * the last number of its output. The host workload starts once every guest
+ * printed its first line. The throughput of
+ * every guest is reported, along with their total and the Jain fairness
+ * index of their shares.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include "igt_gvt.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define COPY_SIZE (1 << 20)
+
+enum workload {
+	NOP,
+	COPY,
+};
+
+struct guest {
+	char uuid[IGT_GVT_UUID_LEN];
+	FILE *out;
+	double rate;
+};
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static double host_nop(int fd, unsigned int seconds)
+{
+	const uint32_t bbe = MI_BATCH_BUFFER_END;
+	struct drm_i915_gem_exec_object2 obj = {};
+	struct drm_i915_gem_execbuffer2 execbuf = {};
+	struct timespec start, end;
+	unsigned long count = 0;
+
+	obj.handle = gem_create(fd, 4096);
+	gem_write(fd, obj.handle, 0, &bbe, sizeof(bbe));
+
+	execbuf.buffers_ptr = to_user_pointer(&obj);
+	execbuf.buffer_count = 1;
+
+	gem_execbuf(fd, &execbuf);
+	gem_sync(fd, obj.handle);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		for (int inner = 0; inner < 1024; inner++)
+			gem_execbuf(fd, &execbuf);
+		count += 1024;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+	} while (elapsed(&start, &end) < seconds);
+
+	gem_sync(fd, obj.handle);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	gem_close(fd, obj.handle);
+
+	return count / elapsed(&start, &end);
+}
+
+static double host_copy(int fd, unsigned int seconds)
+{
+	struct intel_batchbuffer *batch;
+	drm_intel_bufmgr *bufmgr;
+	drm_intel_bo *src, *dst;
+	struct timespec start, end;
+	unsigned long count = 0;
+
+	bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
+	igt_assert(bufmgr);
+	batch = intel_batchbuffer_alloc(bufmgr, intel_get_drm_devid(fd));
+	igt_assert(batch);
+
+	src = drm_intel_bo_alloc(bufmgr, "src", COPY_SIZE, 4096);
+	dst = drm_intel_bo_alloc(bufmgr, "dst", COPY_SIZE, 4096);
+	igt_assert(src && dst);
+
+	intel_copy_bo(batch, dst, src, COPY_SIZE);
+	drm_intel_bo_wait_rendering(dst);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		for (int inner = 0; inner < 64; inner++)
+			intel_copy_bo(batch, dst, src, COPY_SIZE);
+		count += 64;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+	} while (elapsed(&start, &end) < seconds);
+
+	drm_intel_bo_wait_rendering(dst);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	drm_intel_bo_unreference(src);
+	drm_intel_bo_unreference(dst);
+	intel_batchbuffer_free(batch);
+	drm_intel_bufmgr_destroy(bufmgr);
+
+	return count / elapsed(&start, &end);
+}
+
+static FILE *start_guest(const char *cmd, struct guest *g, int index,
+			 unsigned int seconds)
+{
+	char buf[16];
+
+	setenv("IGT_VGPU_UUID", g->uuid, 1);
+	snprintf(buf, sizeof(buf), "%d", index);
+	setenv("IGT_VGPU_INDEX", buf, 1);
+	snprintf(buf, sizeof(buf), "%u", seconds);
+	setenv("IGT_VGPU_DURATION", buf, 1);
+
+	return popen(cmd, "r");
+}
+
+static void wait_guest(FILE *out)
+{
+	char line[256];
+
+	if (!fgets(line, sizeof(line), out))
+		fprintf(stderr, "guest exited before starting\n");
+}
+
+/* The throughput is the last number the guest command printed */
+static double finish_guest(FILE *out)
+{
+	char line[256];
+	double rate = 0;
+
+	while (fgets(line, sizeof(line), out)) {
+		char *p = line, *end;
+
+		while (*p) {
+			double v = strtod(p, &end);
+
+			if (end == p) {
+				p++;
+				continue;
+			}
+			rate = v;
+			p = end;
+		}
+	}
+	pclose(out);
+
+	return rate;
+}
+
+/* 1 when all guests get the same share, down to 1/n when one gets it all */
+static double jain_index(const struct guest *guests, int n)
+{
+	double sum = 0, sq = 0;
+
+	for (int i = 0; i < n; i++) {
+		sum += guests[i].rate;
+		sq += guests[i].rate * guests[i].rate;
+	}
+
+	return sq ? sum * sum / (n * sq) : 0;
+}
+
+static double run(int fd, const char *type, int count, enum workload w,
+		  unsigned int seconds, const char *cmd, double baseline)
+{
+	struct guest *guests = calloc(count ?: 1, sizeof(*guests));
+	double host, total = 0, min = 0, max = 0;
+	const char *unit = w == NOP ? "execbuf/s" : "copies/s";
+	char name[64];
+	int created;
+
+	igt_assert(guests);
+
+	for (created = 0; created < count; created++)
+		if (!igt_gvt_vgpu_create(type, guests[created].uuid))
+			break;
+	if (created < count) {
+		fprintf(stderr, "could only create %d of %d vGPUs\n",
+			created, count);
+		count = created;
+	}
+
+	if (cmd) {
+		for (int i = 0; i < count; i++)
+			guests[i].out = start_guest(cmd, &guests[i], i,
+						    seconds);
+		for (int i = 0; i < count; i++)
+			if (guests[i].out)
+				wait_guest(guests[i].out);
+	}
+
+	host = w == NOP ? host_nop(fd, seconds) : host_copy(fd, seconds);
+
+	for (int i = 0; i < count; i++) {
+		if (guests[i].out)
+			guests[i].rate = finish_guest(guests[i].out);
+
+		total += guests[i].rate;
+		if (!i || guests[i].rate < min)
+			min = guests[i].rate;
+		if (guests[i].rate > max)
+			max = guests[i].rate;
+	}
+
+	printf("%3d vGPUs: host %10.0f %s", count, host, unit);
+	if (baseline > 0)
+		printf(" (%5.1f%% overhead)", 100 * (1 - host / baseline));
+	if (cmd && count)
+		printf(", guests %10.0f total, %.0f min, %.0f max,"
+		       " fairness %.3f",
+		       total, min, max, jain_index(guests, count));
+	putchar('\n');
+
+	snprintf(name, sizeof(name), "vgpus-%d-host", count);
+	igt_bench_value(name, unit, host);
+	if (baseline > 0) {
+		snprintf(name, sizeof(name), "vgpus-%d-overhead", count);
+		igt_bench_value(name, "%", 100 * (1 - host / baseline));
+	}
+	if (cmd && count) {
+		for (int i = 0; i < count; i++) {
+			snprintf(name, sizeof(name), "vgpus-%d-guest-%d",
+				 count, i);
+			igt_bench_value(name, "ops/s", guests[i].rate);
+		}
+		snprintf(name, sizeof(name), "vgpus-%d-guests", count);
+		igt_bench_value(name, "ops/s", total);
+		snprintf(name, sizeof(name), "vgpus-%d-fairness", count);
+		igt_bench_value(name, "jain", jain_index(guests, count));
+	}
+
+	for (int i = 0; i < count; i++)
+		igt_gvt_vgpu_remove(guests[i].uuid);
+	free(guests);
+
+	return host;
+}
+
+int main(int argc, char **argv)
+{
+	enum workload w = NOP;
+	unsigned int seconds = 5;
+	const char *cmd = NULL;
+	char type[256] = "";
+	double baseline;
+	int max = 0;
+	int fd, c;
+
+	while ((c = getopt (argc, argv, "n:t:w:d:g:")) != -1) {
+		switch (c) {
+		case 'n':
+			max = atoi(optarg);
+			break;
+
+		case 't':
+			snprintf(type, sizeof(type), "%s", optarg);
+			break;
+
+		case 'w':
+			if (!strcmp(optarg, "copy"))
+				w = COPY;
+			else
+				w = NOP;
+			break;
+
+		case 'd':
+			seconds = atoi(optarg);
+			if (seconds < 1)
+				seconds = 1;
+			break;
+
+		case 'g':
+			cmd = optarg;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (!*type && !igt_gvt_vgpu_densest_type(type, sizeof(type))) {
+		fprintf(stderr, "no vGPU type available, is GVT-g enabled?\n");
+		return 77;
+	}
+
+	if (!max)
+		max = igt_gvt_vgpu_available(type);
+	if (!max) {
+		fprintf(stderr, "no vGPU of type %s available\n", type);
+		return 77;
+	}
+
+	fd = drm_open_driver(DRIVER_INTEL);
+
+	igt_bench_begin("gvt_density");
+	igt_bench_param("type", "%s", type);
+	igt_bench_param("workload", "%s", w == NOP ? "nop" : "copy");
+	igt_bench_param("duration", "%u", seconds);
+	igt_bench_param("vgpus", "%d", max);
+
+	baseline = run(fd, type, 0, w, seconds, NULL, 0);
+	for (int n = 1; n < max; n *= 2)
+		run(fd, type, n, w, seconds, cmd, baseline);
+	run(fd, type, max, w, seconds, cmd, baseline);
+
+	igt_bench_end();
+
+	close(fd);
+
+	return 0;
+}
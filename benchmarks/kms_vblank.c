@@ -23,7 +23,8 @@
 
 /** @file kms_vblank.c
  *
- * This is a test of performance of drmWaitVblank.
+ * This is a test of performance of drmWaitVblank, of the crtc sequence
+ * ioctls and of nonblocking atomic page flips, on one or all of the pipes.
  */
 
 #include <stdlib.h>
@@ -40,9 +41,27 @@
 
 #include <drm.h>
 #include <xf86drm.h>
-#include "drmtest.h"
+#include <xf86drmMode.h>
+#include "igt.h"
+#include "igt_stats.h"
 #include "assert.h"
 
+/* Tags the event of the busy request, apart from those of the pipes */
+#define BUSY_EVENT (~0ull)
+
+struct pipes {
+	int count;
+	enum pipe pipe[IGT_MAX_PIPES];
+	uint32_t crtc_id[IGT_MAX_PIPES];
+};
+
+struct event {
+	uint32_t type;
+	uint64_t user_data;
+	uint64_t sequence;
+	uint64_t time_us;
+};
+
 static double elapsed(const struct timespec *start,
 		      const struct timespec *end,
 		      int loop)
@@ -50,92 +69,418 @@ static double elapsed(const struct timespec *start,
 	return (1e6*(end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec)/1000)/loop;
 }
 
-static int crtc0_active(int fd)
+static void wait_vblank(int fd, enum pipe pipe, unsigned int flags,
+			unsigned long sequence, unsigned long signal,
+			union drm_wait_vblank *vbl)
+{
+	memset(vbl, 0, sizeof(*vbl));
+	vbl->request.type =
+		DRM_VBLANK_RELATIVE | kmstest_get_vbl_flag(pipe) | flags;
+	vbl->request.sequence = sequence;
+	vbl->request.signal = signal;
+	drmIoctl(fd, DRM_IOCTL_WAIT_VBLANK, vbl);
+}
+
+static int pipe_active(int fd, enum pipe pipe)
 {
 	union drm_wait_vblank vbl;
 
 	memset(&vbl, 0, sizeof(vbl));
-	vbl.request.type = DRM_VBLANK_RELATIVE;
+	vbl.request.type = DRM_VBLANK_RELATIVE | kmstest_get_vbl_flag(pipe);
 	return drmIoctl(fd, DRM_IOCTL_WAIT_VBLANK, &vbl) == 0;
 }
 
-static void vblank_query(int fd, int busy)
+/* The active pipes, all of them or only @which */
+static void find_pipes(int fd, int which, struct pipes *pipes)
+{
+	drmModeRes *res = drmModeGetResources(fd);
+
+	pipes->count = 0;
+	if (!res)
+		return;
+
+	for (int p = 0; p < res->count_crtcs && p < IGT_MAX_PIPES; p++) {
+		if (which >= 0 && p != which)
+			continue;
+
+		if (!pipe_active(fd, p))
+			continue;
+
+		pipes->pipe[pipes->count] = p;
+		pipes->crtc_id[pipes->count] = res->crtcs[p];
+		pipes->count++;
+	}
+
+	drmModeFreeResources(res);
+}
+
+static uint64_t get_sequence(int fd, uint32_t crtc_id)
+{
+	struct drm_crtc_get_sequence cgs = { .crtc_id = crtc_id };
+
+	drmIoctl(fd, DRM_IOCTL_CRTC_GET_SEQUENCE, &cgs);
+	return cgs.sequence;
+}
+
+static void queue_sequence(int fd, uint32_t crtc_id, uint64_t sequence,
+			   uint64_t user_data)
+{
+	struct drm_crtc_queue_sequence cqs = {
+		.crtc_id = crtc_id,
+		.flags = DRM_CRTC_SEQUENCE_RELATIVE,
+		.sequence = sequence,
+		.user_data = user_data,
+	};
+
+	drmIoctl(fd, DRM_IOCTL_CRTC_QUEUE_SEQUENCE, &cqs);
+}
+
+/* Reads at least one event, returning how many were stored into @ev */
+static int read_events(int fd, struct event *ev, int max)
+{
+	char buf[4096];
+	int len, count = 0;
+
+	len = read(fd, buf, sizeof(buf));
+	assert(len > 0);
+
+	for (int i = 0; i < len && count < max; ) {
+		const struct drm_event *e = (const struct drm_event *)&buf[i];
+
+		if (e->type == DRM_EVENT_CRTC_SEQUENCE) {
+			const struct drm_event_crtc_sequence *s = (const void *)e;
+
+			ev[count++] = (struct event) {
+				.type = e->type,
+				.user_data = s->user_data,
+				.sequence = s->sequence,
+				.time_us = s->time_ns / 1000,
+			};
+		} else if (e->type == DRM_EVENT_VBLANK ||
+			   e->type == DRM_EVENT_FLIP_COMPLETE) {
+			const struct drm_event_vblank *v = (const void *)e;
+
+			ev[count++] = (struct event) {
+				.type = e->type,
+				.user_data = v->user_data,
+				.sequence = v->sequence,
+				.time_us = v->tv_sec * 1000000ull + v->tv_usec,
+			};
+		}
+
+		i += e->length;
+	}
+
+	return count;
+}
+
+static uint64_t current_sequence(int fd, const struct pipes *pipes,
+				 int n, bool seq)
 {
 	union drm_wait_vblank vbl;
-	struct timespec start, end;
-	unsigned long seq, count = 0;
-	struct drm_event_vblank event;
 
-	memset(&vbl, 0, sizeof(vbl));
+	if (seq)
+		return get_sequence(fd, pipes->crtc_id[n]);
+
+	wait_vblank(fd, pipes->pipe[n], 0, 0, 0, &vbl);
+	return vbl.reply.sequence;
+}
+
+static void queue_event(int fd, const struct pipes *pipes, int n,
+			uint64_t sequence, uint64_t user_data, bool seq)
+{
+	union drm_wait_vblank vbl;
+
+	if (seq)
+		queue_sequence(fd, pipes->crtc_id[n], sequence, user_data);
+	else
+		wait_vblank(fd, pipes->pipe[n], DRM_VBLANK_EVENT,
+			    sequence, user_data, &vbl);
+}
+
+/* Reads events until the busy one, queued on the first pipe, arrives */
+static void busy_end(int fd)
+{
+	struct event ev[64];
+	bool found = false;
+
+	while (!found) {
+		int count = read_events(fd, ev, ARRAY_SIZE(ev));
 
-	if (busy) {
-		vbl.request.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT;
-		vbl.request.sequence = 120 + 12;
-		drmIoctl(fd, DRM_IOCTL_WAIT_VBLANK, &vbl);
+		for (int i = 0; i < count; i++)
+			found |= ev[i].user_data == BUSY_EVENT;
 	}
+}
+
+static void vblank_query(int fd, const struct pipes *pipes, int busy,
+			 bool seq)
+{
+	struct timespec start, end;
+	unsigned long count = 0;
+	uint64_t first, last;
+
+	/* Keep the vblank interrupt of the first pipe enabled throughout */
+	if (busy)
+		queue_event(fd, pipes, 0, 120 + 12, BUSY_EVENT, seq);
 
-	vbl.request.type = DRM_VBLANK_RELATIVE;
-	vbl.request.sequence = 0;
-	drmIoctl(fd, DRM_IOCTL_WAIT_VBLANK, &vbl);
-	seq = vbl.reply.sequence;
+	first = current_sequence(fd, pipes, 0, seq);
 
 	clock_gettime(CLOCK_MONOTONIC, &start);
 	do {
-		vbl.request.type = DRM_VBLANK_RELATIVE;
-		vbl.request.sequence = 0;
-		drmIoctl(fd, DRM_IOCTL_WAIT_VBLANK, &vbl);
-		count++;
-	} while ((vbl.reply.sequence - seq) <= 120);
+		for (int n = 1; n < pipes->count; n++)
+			current_sequence(fd, pipes, n, seq);
+		last = current_sequence(fd, pipes, 0, seq);
+		count += pipes->count;
+	} while ((last - first) <= 120);
 	clock_gettime(CLOCK_MONOTONIC, &end);
 
 	printf("%f\n", 1e6/elapsed(&start, &end, count));
 	if (busy)
-		assert(read(fd, &event, sizeof(event)) != -1);
+		busy_end(fd);
 }
 
-static void vblank_event(int fd, int busy)
+/*
+ * Keeps an event queued on each pipe, queueing the next one as soon as the
+ * previous one is read, until the first pipe has seen 120 vblanks.
+ */
+static void vblank_event(int fd, const struct pipes *pipes, int busy,
+			 bool seq)
 {
-	union drm_wait_vblank vbl;
 	struct timespec start, end;
-	unsigned long seq, count = 0;
-	struct drm_event_vblank event;
+	unsigned long count = 0;
+	bool busy_seen = !busy;
+	int outstanding = 0;
+	uint64_t first, last;
+	struct event ev[64];
 
-	memset(&vbl, 0, sizeof(vbl));
+	if (busy)
+		queue_event(fd, pipes, 0, 120 + 12, BUSY_EVENT, seq);
+
+	first = last = current_sequence(fd, pipes, 0, seq);
 
-	if (busy) {
-		vbl.request.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT;
-		vbl.request.sequence = 120 + 12;
-		drmIoctl(fd, DRM_IOCTL_WAIT_VBLANK, &vbl);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int n = 0; n < pipes->count; n++) {
+		queue_event(fd, pipes, n, 0, n, seq);
+		outstanding++;
 	}
 
-	vbl.request.type = DRM_VBLANK_RELATIVE;
-	vbl.request.sequence = 0;
-	drmIoctl(fd, DRM_IOCTL_WAIT_VBLANK, &vbl);
-	seq = vbl.reply.sequence;
+	while (outstanding) {
+		int nev = read_events(fd, ev, ARRAY_SIZE(ev));
 
-	clock_gettime(CLOCK_MONOTONIC, &start);
-	do {
-		vbl.request.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT;
-		vbl.request.sequence = 0;
-		drmIoctl(fd, DRM_IOCTL_WAIT_VBLANK, &vbl);
+		for (int i = 0; i < nev; i++) {
+			if (ev[i].user_data == BUSY_EVENT) {
+				busy_seen = true;
+				continue;
+			}
 
-		assert(read(fd, &event, sizeof(event)) != -1);
-		count++;
-	} while ((event.sequence - seq) <= 120);
-	clock_gettime(CLOCK_MONOTONIC, &end);
+			outstanding--;
+			if ((last - first) > 120)
+				continue;
+
+			count++;
+			if (ev[i].user_data == 0) {
+				last = ev[i].sequence;
+				if ((last - first) > 120) {
+					clock_gettime(CLOCK_MONOTONIC, &end);
+					continue;
+				}
+			}
+
+			queue_event(fd, pipes, ev[i].user_data, 0,
+				    ev[i].user_data, seq);
+			outstanding++;
+		}
+	}
 
 	printf("%f\n", 1e6/elapsed(&start, &end, count));
-	if (busy)
-		assert(read(fd, &event, sizeof(event)) != -1);
+	if (!busy_seen)
+		busy_end(fd);
+}
+
+struct flip_pipe {
+	igt_output_t *output;
+	igt_plane_t *primary;
+	struct igt_fb fb[2];
+	int current;
+	unsigned long count;
+	uint64_t last_us;
+	igt_stats_t intervals;
+};
+
+static void queue_flip(igt_display_t *display, struct flip_pipe *fp,
+		       enum pipe pipe)
+{
+	fp->current ^= 1;
+	igt_plane_set_fb(fp->primary, &fp->fb[fp->current]);
+	igt_display_commit_atomic(display,
+				  DRM_MODE_ATOMIC_NONBLOCK |
+				  DRM_MODE_PAGE_FLIP_EVENT,
+				  (void *)(uintptr_t)pipe);
+}
+
+static void flip_report(const struct flip_pipe *fp, enum pipe pipe,
+			double secs)
+{
+	igt_stats_t *s = (igt_stats_t *)&fp->intervals;
+	double median, deviation;
+
+	if (s->n_values < 2) {
+		printf("pipe %s: %lu flips\n", kmstest_pipe_name(pipe),
+		       fp->count);
+		return;
+	}
+
+	median = igt_stats_get_median(s);
+	deviation = igt_stats_get_max(s) - median;
+	if (median - igt_stats_get_min(s) > deviation)
+		deviation = median - igt_stats_get_min(s);
+
+	printf("pipe %s: %.1f flips/s, interval %.1fus, jitter %.1fus, max %.1fus\n",
+	       kmstest_pipe_name(pipe), fp->count / secs,
+	       median, igt_stats_get_std_deviation(s), deviation);
+}
+
+/*
+ * Flips the primary plane of each pipe between two framebuffers for two
+ * seconds, each pipe with its own nonblocking atomic commit queued as soon
+ * as the completion of its previous one is read, and reports the rate of
+ * the flips and the jitter of the intervals between their completions.
+ */
+static int flip(int fd, int which, int loops)
+{
+	struct flip_pipe fp[IGT_MAX_PIPES] = {};
+	igt_display_t display;
+	igt_output_t *output;
+	int npipes = 0;
+	enum pipe p;
+
+	igt_display_require(&display, fd);
+	if (!display.is_atomic) {
+		fprintf(stderr, "No atomic modesetting\n");
+		return 77;
+	}
+
+	for_each_pipe_with_single_output(&display, p, output) {
+		drmModeModeInfo *mode;
+
+		if (which >= 0 && p != which)
+			continue;
+
+		igt_output_set_pipe(output, p);
+		mode = igt_output_get_mode(output);
+
+		fp[p].output = output;
+		fp[p].primary =
+			igt_output_get_plane_type(output, DRM_PLANE_TYPE_PRIMARY);
+		for (int i = 0; i < 2; i++)
+			igt_create_color_fb(fd, mode->hdisplay, mode->vdisplay,
+					    DRM_FORMAT_XRGB8888,
+					    LOCAL_DRM_FORMAT_MOD_NONE,
+					    i, i, i, &fp[p].fb[i]);
+		igt_plane_set_fb(fp[p].primary, &fp[p].fb[0]);
+		npipes++;
+	}
+	if (!npipes) {
+		fprintf(stderr, "No output for pipe %d\n", which);
+		return 77;
+	}
+
+	igt_display_commit2(&display, COMMIT_ATOMIC);
+
+	while (loops--) {
+		struct timespec start, now;
+		unsigned long total = 0;
+		int outstanding = 0;
+		bool done = false;
+		struct event ev[64];
+		double secs = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for_each_pipe(&display, p) {
+			if (!fp[p].output)
+				continue;
+
+			fp[p].count = 0;
+			fp[p].last_us = 0;
+			igt_stats_init(&fp[p].intervals);
+
+			queue_flip(&display, &fp[p], p);
+			outstanding++;
+		}
+
+		while (outstanding) {
+			int nev = read_events(fd, ev, ARRAY_SIZE(ev));
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (!done && elapsed(&start, &now, 1) >= 2e6) {
+				secs = elapsed(&start, &now, 1) / 1e6;
+				done = true;
+			}
+
+			for (int i = 0; i < nev; i++) {
+				struct flip_pipe *f;
+
+				if (ev[i].type != DRM_EVENT_FLIP_COMPLETE)
+					continue;
+
+				p = ev[i].user_data;
+				f = &fp[p];
+				outstanding--;
+				if (done)
+					continue;
+
+				if (f->last_us)
+					igt_stats_push_float(&f->intervals,
+							     ev[i].time_us - f->last_us);
+				f->last_us = ev[i].time_us;
+				f->count++;
+				total++;
+
+				queue_flip(&display, f, p);
+				outstanding++;
+			}
+		}
+
+		printf("%f flips/s\n", total / secs);
+		for_each_pipe(&display, p) {
+			if (!fp[p].output)
+				continue;
+
+			flip_report(&fp[p], p, secs);
+			igt_stats_fini(&fp[p].intervals);
+		}
+	}
+
+	for_each_pipe(&display, p) {
+		if (!fp[p].output)
+			continue;
+
+		igt_plane_set_fb(fp[p].primary, NULL);
+		igt_output_set_pipe(fp[p].output, PIPE_NONE);
+	}
+	igt_display_commit2(&display, COMMIT_ATOMIC);
+
+	for_each_pipe(&display, p) {
+		if (!fp[p].output)
+			continue;
+
+		igt_remove_fb(fd, &fp[p].fb[0]);
+		igt_remove_fb(fd, &fp[p].fb[1]);
+	}
+	igt_display_fini(&display);
+
+	return 0;
 }
 
 int main(int argc, char **argv)
 {
+	struct pipes pipes;
 	int fd, c;
 	int busy = 0, loops = 5;
-	enum what { EVENTS, QUERIES } what = EVENTS;
+	int which = 0;
+	enum what { EVENTS, QUERIES, SEQ_EVENTS, SEQ_QUERIES, FLIPS } what = EVENTS;
 
-	while ((c = getopt (argc, argv, "b:w:r:")) != -1) {
+	while ((c = getopt (argc, argv, "b:w:r:p:")) != -1) {
 		switch (c) {
 		case 'b':
 			if (strcmp(optarg, "busy") == 0)
@@ -151,6 +496,12 @@ int main(int argc, char **argv)
 				what = EVENTS;
 			else if (strcmp(optarg, "query") == 0)
 				what = QUERIES;
+			else if (strcmp(optarg, "seq-event") == 0)
+				what = SEQ_EVENTS;
+			else if (strcmp(optarg, "seq-query") == 0)
+				what = SEQ_QUERIES;
+			else if (strcmp(optarg, "flip") == 0)
+				what = FLIPS;
 			else
 				abort();
 			break;
@@ -158,22 +509,46 @@ int main(int argc, char **argv)
 			loops = atoi(optarg);
 			if (loops < 1)
 				loops = 1;
+			break;
+		case 'p':
+			/* A single pipe, or all the active ones at once */
+			if (strcmp(optarg, "all") == 0)
+				which = -1;
+			else
+				which = atoi(optarg);
+			break;
 		}
 	}
 
+	if (what == FLIPS)
+		return flip(drm_open_driver_master(DRIVER_INTEL), which, loops);
+
 	fd = drm_open_driver(DRIVER_INTEL);
-	if (!crtc0_active(fd)) {
-		fprintf(stderr, "CRTC/pipe 0 not active\n");
+
+	find_pipes(fd, which, &pipes);
+	if (!pipes.count) {
+		if (which < 0)
+			fprintf(stderr, "No CRTC/pipe active\n");
+		else
+			fprintf(stderr, "CRTC/pipe %d not active\n", which);
 		return 77;
 	}
 
 	while (loops--) {
 		switch (what) {
 		case EVENTS:
-			vblank_event(fd, busy);
+			vblank_event(fd, &pipes, busy, false);
 			break;
 		case QUERIES:
-			vblank_query(fd, busy);
+			vblank_query(fd, &pipes, busy, false);
+			break;
+		case SEQ_EVENTS:
+			vblank_event(fd, &pipes, busy, true);
+			break;
+		case SEQ_QUERIES:
+			vblank_query(fd, &pipes, busy, true);
+			break;
+		case FLIPS:
 			break;
 		}
 	}
@@ -0,0 +1,309 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures the rate of Panfrost job submission and the time from each
+ * submission to the completion of the job, from 1, 2, 4, ... threads, each
+ * keeping a queue of jobs in flight. The jobs are the fragment job of
+ * igt_panfrost_trivial_job(), clearing either a tiny or a 1080p framebuffer,
+ * and each one signals its own out syncobj and may wait, through its in
+ * syncobj, for the previous job of its thread.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include "igt_panfrost.h"
+#include "igt_syncobj.h"
+#include "sw_sync.h"
+#include "panfrost-job.h"
+#include "panfrost_drm.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define CLEAR_COLOR 0xff7f7f7f
+#define MAX_DEPTH 16
+
+#define CHAIN 0x1
+#define PRIVATE 0x2
+
+static const struct size {
+	const char *name;
+	int width, height;
+} sizes[] = {
+	{ "trivial", 16, 16 },
+	{ "fragment", 1920, 1080 },
+	{ }
+};
+
+struct job {
+	struct panfrost_submit *submit;
+	struct mali_job_descriptor_header header;
+	uint64_t submitted;
+	bool busy;
+};
+
+struct thread {
+	pthread_t thread;
+	pthread_barrier_t *barrier;
+	int fd;
+	const struct size *size;
+	unsigned int depth;
+	unsigned int flags;
+	double duration;
+
+	unsigned long count;
+	double elapsed;
+	struct igt_histogram latency;
+};
+
+static uint64_t gettime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Waits for the job and returns when it signaled its out syncobj */
+static uint64_t job_wait(int fd, struct job *job)
+{
+	uint32_t sync = job->submit->args->out_sync;
+	uint64_t ts;
+	int fence;
+
+	igt_assert(syncobj_wait(fd, &sync, 1, INT64_MAX, 0, NULL));
+
+	fence = syncobj_handle_to_fd(fd, sync,
+				     DRM_SYNCOBJ_HANDLE_TO_FD_FLAGS_EXPORT_SYNC_FILE);
+	ts = sync_fence_timestamp(fence);
+	close(fence);
+
+	job->busy = false;
+	return ts ?: gettime_ns();
+}
+
+static void *submit_thread(void *arg)
+{
+	struct thread *t = arg;
+	struct job jobs[MAX_DEPTH] = {};
+	uint32_t prev = 0;
+	uint64_t start, end, now;
+	unsigned int n;
+
+	for (n = 0; n < t->depth; n++) {
+		struct job *job = &jobs[n];
+
+		job->submit = igt_panfrost_trivial_job(t->fd, false,
+						       t->size->width,
+						       t->size->height,
+						       CLEAR_COLOR);
+		memcpy(&job->header, job->submit->submit_bo->map,
+		       sizeof(job->header));
+	}
+
+	pthread_barrier_wait(t->barrier);
+
+	start = now = gettime_ns();
+	end = start + t->duration * 1e9;
+	for (n = 0; now < end; n = (n + 1) % t->depth) {
+		struct job *job = &jobs[n];
+		struct drm_panfrost_submit *args = job->submit->args;
+
+		if (job->busy)
+			igt_histogram_add(&t->latency,
+					  job_wait(t->fd, job) - job->submitted);
+
+		/* The GPU writes back the status of the job into its header */
+		memcpy(job->submit->submit_bo->map, &job->header,
+		       sizeof(job->header));
+
+		if (t->flags & CHAIN && prev) {
+			args->in_syncs = to_user_pointer(&prev);
+			args->in_sync_count = 1;
+		} else {
+			args->in_sync_count = 0;
+		}
+
+		job->submitted = gettime_ns();
+		do_ioctl(t->fd, DRM_IOCTL_PANFROST_SUBMIT, args);
+		job->busy = true;
+		prev = args->out_sync;
+
+		t->count++;
+		now = gettime_ns();
+	}
+
+	for (n = 0; n < t->depth; n++) {
+		struct job *job = &jobs[n];
+
+		if (job->busy)
+			igt_histogram_add(&t->latency,
+					  job_wait(t->fd, job) - job->submitted);
+	}
+	t->elapsed = (gettime_ns() - start) * 1e-9;
+
+	for (n = 0; n < t->depth; n++) {
+		syncobj_destroy(t->fd, jobs[n].submit->args->out_sync);
+		igt_panfrost_free_job(t->fd, jobs[n].submit);
+	}
+
+	return NULL;
+}
+
+static void run_one(int fd, const struct size *size, unsigned int nthread,
+		    unsigned int depth, double duration, unsigned int flags)
+{
+	struct thread *threads = calloc(nthread, sizeof(*threads));
+	pthread_barrier_t barrier;
+	struct igt_histogram latency;
+	double rate = 0;
+	char name[64];
+
+	igt_assert(threads);
+	pthread_barrier_init(&barrier, NULL, nthread);
+
+	for (unsigned int n = 0; n < nthread; n++) {
+		struct thread *t = &threads[n];
+
+		t->barrier = &barrier;
+		t->fd = flags & PRIVATE ? drm_open_driver(DRIVER_PANFROST) : fd;
+		t->size = size;
+		t->depth = depth;
+		t->flags = flags;
+		t->duration = duration;
+		igt_histogram_init(&t->latency);
+
+		pthread_create(&t->thread, NULL, submit_thread, t);
+	}
+
+	igt_histogram_init(&latency);
+	for (unsigned int n = 0; n < nthread; n++) {
+		struct thread *t = &threads[n];
+
+		pthread_join(t->thread, NULL);
+		rate += t->count / t->elapsed;
+		igt_histogram_merge(&latency, &t->latency);
+		igt_histogram_fini(&t->latency);
+		if (t->fd != fd)
+			close(t->fd);
+	}
+
+	printf("%-8s %7u %10.0f %10.0f %10.1f %10.1f %10.1f\n",
+	       size->name, nthread, rate, rate / nthread,
+	       igt_histogram_get_median(&latency) / 1000,
+	       igt_histogram_get_percentile(&latency, 99) / 1000,
+	       igt_histogram_get_max(&latency) / 1000.);
+
+	snprintf(name, sizeof(name), "%s-threads-%u", size->name, nthread);
+	igt_bench_value(name, "jobs/s", rate);
+	snprintf(name, sizeof(name), "%s-threads-%u-latency",
+		 size->name, nthread);
+	igt_bench_histogram(name, "ns", &latency);
+
+	igt_histogram_fini(&latency);
+	pthread_barrier_destroy(&barrier);
+	free(threads);
+}
+
+int main(int argc, char **argv)
+{
+	const char *job = NULL;
+	unsigned int max = 0;
+	unsigned int depth = 2;
+	unsigned int flags = 0;
+	double duration = 2;
+	int fd, c;
+
+	while ((c = getopt (argc, argv, "j:t:q:d:cp")) != -1) {
+		switch (c) {
+		case 'j':
+			job = optarg;
+			break;
+
+		case 't':
+			max = atoi(optarg);
+			break;
+
+		case 'q':
+			/* Jobs kept in flight by each thread */
+			depth = atoi(optarg);
+			if (depth < 1)
+				depth = 1;
+			if (depth > MAX_DEPTH)
+				depth = MAX_DEPTH;
+			break;
+
+		case 'd':
+			duration = atof(optarg);
+			if (duration <= 0)
+				duration = 0.1;
+			break;
+
+		case 'c':
+			flags |= CHAIN;
+			break;
+
+		case 'p':
+			flags |= PRIVATE;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (!max)
+		max = sysconf(_SC_NPROCESSORS_ONLN);
+
+	fd = drm_open_driver(DRIVER_PANFROST);
+
+	igt_bench_begin("panfrost_throughput");
+	igt_bench_param("job", "%s", job ?: "all");
+	igt_bench_param("threads", "%u", max);
+	igt_bench_param("depth", "%u", depth);
+	igt_bench_param("duration", "%.1f", duration);
+	igt_bench_param("chain", "%d", !!(flags & CHAIN));
+	igt_bench_param("private", "%d", !!(flags & PRIVATE));
+
+	printf("%-8s %7s %10s %10s %10s %10s %10s\n", "job", "threads",
+	       "jobs/s", "per-thread", "median/us", "p99/us", "max/us");
+	for (const struct size *s = sizes; s->name; s++) {
+		if (job && strcmp(job, s->name))
+			continue;
+
+		for (unsigned int n = 1; n < max; n <<= 1)
+			run_one(fd, s, n, depth, duration, flags);
+		run_one(fd, s, max, depth, duration, flags);
+	}
+
+	igt_bench_end();
+
+	close(fd);
+	return 0;
+}
@@ -41,9 +41,33 @@
 #include "drmtest.h"
 #include "intel_io.h"
 #include "igt_rand.h"
+#include "igt_stats.h"
+#include "igt_bench.h"
 
 #define CLOSE_DEVICE 0x1
 
+enum op {
+	EXPORT,
+	IMPORT,
+	CLOSE,
+	NUM_OPS
+};
+
+enum result {
+	OPS,
+	MEDIAN,
+	P99,
+	MAX,
+	NUM_RESULTS
+};
+
+/* A dma-buf exported by a process, and where it has been imported */
+struct slot {
+	int fd;
+	int dev;
+	uint32_t handle;
+};
+
 static double elapsed(const struct timespec *start,
 		      const struct timespec *end)
 {
@@ -124,6 +148,197 @@ static int loop(int nobj, int ndev, int nage, int ncpus, unsigned flags)
 	return 0;
 }
 
+static uint64_t nsecs(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000000ull +
+		end->tv_nsec - start->tv_nsec;
+}
+
+static void __gem_close(int fd, uint32_t handle)
+{
+	struct drm_gem_close close = { .handle = handle };
+
+	/* Another process may have closed the same import before us */
+	igt_ioctl(fd, DRM_IOCTL_GEM_CLOSE, &close);
+}
+
+static void slot_close(const int *dev, struct slot *s)
+{
+	if (s->handle)
+		__gem_close(dev[s->dev], s->handle);
+	if (s->fd != -1)
+		close(s->fd);
+
+	s->fd = -1;
+	s->handle = 0;
+}
+
+static enum op pick_op(const unsigned int *ratio, unsigned int total)
+{
+	unsigned int x = hars_petruska_f54_1_random_unsafe() % total;
+	enum op op;
+
+	for (op = 0; x >= ratio[op]; op++)
+		x -= ratio[op];
+
+	return op;
+}
+
+static void stress_one(int parent, const int *dev, int ndev,
+		       const uint32_t *handle, int nobj, int nage,
+		       const unsigned int *ratio, int nproc,
+		       struct igt_child_results *results)
+{
+	unsigned int total = ratio[EXPORT] + ratio[IMPORT] + ratio[CLOSE];
+	igt_stats_t stats;
+	double ops, p99, max;
+	char name[32];
+
+	igt_fork(child, nproc) {
+		struct timespec start, end, op_start, op_end;
+		struct slot *slot;
+		igt_stats_t lat;
+		double *out;
+
+		hars_petruska_f54_1_random_perturb(child);
+
+		slot = malloc(nage * sizeof(*slot));
+		igt_assert(slot);
+		for (int n = 0; n < nage; n++)
+			slot[n] = (struct slot){ .fd = -1 };
+
+		igt_stats_init(&lat);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		do {
+			int a = hars_petruska_f54_1_random_unsafe() % nage;
+			int h = hars_petruska_f54_1_random_unsafe() % nobj;
+			enum op op = pick_op(ratio, total);
+			struct slot *s = &slot[a];
+
+			/* Import and close need a dma-buf, export a free slot */
+			if (s->fd == -1)
+				op = EXPORT;
+			else if (op == EXPORT)
+				slot_close(dev, s);
+
+			clock_gettime(CLOCK_MONOTONIC, &op_start);
+			switch (op) {
+			case EXPORT:
+				s->fd = prime_handle_to_fd(parent, handle[h]);
+				break;
+			case IMPORT:
+				if (s->handle)
+					__gem_close(dev[s->dev], s->handle);
+				s->dev = hars_petruska_f54_1_random_unsafe() % ndev;
+				s->handle = prime_fd_to_handle(dev[s->dev], s->fd);
+				break;
+			case CLOSE:
+			default:
+				slot_close(dev, s);
+				break;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &op_end);
+
+			igt_stats_push(&lat, nsecs(&op_start, &op_end));
+		} while (elapsed(&start, &op_end) < 2.);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		out = igt_child_results_get(results, child);
+		out[OPS] = lat.n_values / elapsed(&start, &end);
+		out[MEDIAN] = igt_stats_get_median(&lat) / 1000;
+		out[P99] = igt_stats_get_percentile(&lat, 99) / 1000;
+		out[MAX] = igt_stats_get_max(&lat) / 1000.;
+
+		igt_stats_fini(&lat);
+		for (int n = 0; n < nage; n++)
+			slot_close(dev, &slot[n]);
+		free(slot);
+	}
+	igt_waitchildren();
+
+	/* The tail is that of the worst process */
+	p99 = max = 0;
+	for (int n = 0; n < nproc; n++) {
+		double *out = igt_child_results_get(results, n);
+
+		if (out[P99] > p99)
+			p99 = out[P99];
+		if (out[MAX] > max)
+			max = out[MAX];
+	}
+	ops = igt_child_results_sum(results, OPS);
+
+	igt_child_results_stats(results, MEDIAN, &stats);
+	printf("%4d %12.0f %12.0f %10.2f %10.2f %10.2f\n",
+	       nproc, ops, ops / nproc,
+	       igt_stats_get_median(&stats), p99, max);
+	igt_stats_fini(&stats);
+
+	snprintf(name, sizeof(name), "procs-%d", nproc);
+	igt_bench_value(name, "ops/s", ops);
+	snprintf(name, sizeof(name), "procs-%d-p99", nproc);
+	igt_bench_value(name, "us", p99);
+}
+
+/*
+ * Every process exports from the same fd and imports into the same devices,
+ * so that all of them contend for the same locks of the prime lookup.
+ */
+static int stress(int nobj, int ndev, int nage, int nproc,
+		  const unsigned int *ratio)
+{
+	struct igt_child_results *results;
+	uint32_t *handle;
+	int parent;
+	int *dev;
+
+	parent = drm_open_driver(DRIVER_INTEL);
+
+	handle = malloc(nobj * sizeof(*handle));
+	igt_assert(handle);
+	for (int n = 0; n < nobj; n++)
+		handle[n] = gem_create(parent, 4096);
+
+	dev = malloc(ndev * sizeof(*dev));
+	igt_assert(dev);
+	for (int n = 0; n < ndev; n++)
+		dev[n] = drm_open_driver(DRIVER_INTEL);
+
+	results = igt_child_results_create(nproc, NUM_RESULTS);
+
+	printf("%4s %12s %12s %10s %10s %10s\n",
+	       "proc", "ops/s", "ops/s/proc", "median/us", "p99/us", "max/us");
+	for (int n = 1; n < nproc; n <<= 1)
+		stress_one(parent, dev, ndev, handle, nobj, nage, ratio,
+			   n, results);
+	stress_one(parent, dev, ndev, handle, nobj, nage, ratio,
+		   nproc, results);
+
+	igt_child_results_destroy(results);
+	for (int n = 0; n < ndev; n++)
+		close(dev[n]);
+	free(dev);
+	for (int n = 0; n < nobj; n++)
+		gem_close(parent, handle[n]);
+	free(handle);
+	close(parent);
+
+	return 0;
+}
+
+static void parse_ratio(const char *arg, unsigned int *ratio)
+{
+	if (sscanf(arg, "%u:%u:%u",
+		   &ratio[EXPORT], &ratio[IMPORT], &ratio[CLOSE]) != 3 ||
+	    !(ratio[EXPORT] + ratio[IMPORT] + ratio[CLOSE])) {
+		fprintf(stderr, "Invalid export:import:close ratio '%s'\n",
+			arg);
+		exit(1);
+	}
+}
+
 static bool allow_files(unsigned min)
 {
 	struct rlimit rlim;
@@ -155,14 +370,16 @@ static bool allow_files(unsigned min)
 
 int main(int argc, char **argv)
 {
+	unsigned int ratio[NUM_OPS] = { 1, 2, 1 };
 	unsigned flags = 0;
+	int nproc = 0;
 	int ncpus = 1;
 	int ndev = 512;
 	int nobj = 32 << 10;
 	int nage = 1024;
 	int c;
 
-	while ((c = getopt (argc, argv, "a:d:o:cf")) != -1) {
+	while ((c = getopt (argc, argv, "a:d:o:cft:m:")) != -1) {
 		switch (c) {
 		case 'o':
 			nobj = atoi(optarg);
@@ -190,11 +407,44 @@ int main(int argc, char **argv)
 			flags |= CLOSE_DEVICE;
 			break;
 
+		case 't':
+			/* Up to this many processes, or as many as cpus */
+			nproc = atoi(optarg);
+			if (nproc < 1)
+				nproc = sysconf(_SC_NPROCESSORS_ONLN);
+			break;
+
+		case 'm':
+			parse_ratio(optarg, ratio);
+			break;
+
 		default:
 			break;
 		}
 	}
 
+	if (nproc) {
+		/* Each process holds its slots, sharing the devices */
+		if (!allow_files(nage + ndev + 16)) {
+			fprintf(stderr, "Unable to relax fd limit\n");
+			exit(1);
+		}
+
+		igt_bench_begin("prime_lookup");
+		igt_bench_param("objects", "%d", nobj);
+		igt_bench_param("devices", "%d", ndev);
+		igt_bench_param("slots", "%d", nage);
+		igt_bench_param("processes", "%d", nproc);
+		igt_bench_param("ratio", "%u:%u:%u",
+				ratio[EXPORT], ratio[IMPORT], ratio[CLOSE]);
+
+		c = stress(nobj, ndev, nage, nproc, ratio);
+
+		igt_bench_end();
+
+		return c;
+	}
+
 	if (!allow_files((nage + 1)*ndev + 1)) {
 		fprintf(stderr, "Unable to relax fd limit\n");
 		exit(1);
@@ -0,0 +1,430 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures the cost of passing frames between devices through dma-buf, the
+ * way a camera, encoder and display pipeline does: exporting a buffer and
+ * importing it into another device, bracketing CPU access with
+ * DMA_BUF_IOCTL_SYNC, and writing and reading through the mmap of the
+ * dma-buf. The frames come from vgem, from a drm device with the operations
+ * of gem.h or, on Android, from the ION system heap, and are imported into
+ * the first drm device, both by an encoder and a display client.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include "gem.h"
+#ifdef ANDROID
+#include "ion.h"
+#include <ion/ion.h>
+#endif
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE 4096
+#define MAX_RING 16
+
+enum source {
+	VGEM,
+	DRM,
+	ION,
+	NUM_SOURCES
+};
+
+static const char * const source_names[] = {
+	[VGEM] = "vgem",
+	[DRM] = "drm",
+	[ION] = "ion",
+};
+
+struct exporter {
+	enum source source;
+	int fd;
+	struct gem_driver *gem;
+	int heap_id;
+};
+
+struct frame {
+	uint32_t handle;
+	int dmabuf;
+	void *map;
+};
+
+static uint64_t gettime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int exporter_open(struct exporter *e, enum source source)
+{
+	e->source = source;
+
+	switch (source) {
+	case VGEM:
+	case DRM:
+		e->fd = drm_open_driver(source == VGEM ? DRIVER_VGEM : DRIVER_ANY);
+		e->gem = gem_get_driver(e->fd);
+		if (!e->gem || !e->gem->create) {
+			fprintf(stderr, "no gem operations for this driver\n");
+			close(e->fd);
+			return 77;
+		}
+		return 0;
+
+	case ION:
+#ifdef ANDROID
+		e->fd = ion_open();
+		if (e->fd < 0) {
+			fprintf(stderr, "no ion device\n");
+			return 77;
+		}
+		e->heap_id = ion_get_heap_id(e->fd, ION_HEAP_TYPE_SYSTEM);
+		if (e->heap_id < 0) {
+			fprintf(stderr, "no ion system heap\n");
+			ion_close(e->fd);
+			return 77;
+		}
+		return 0;
+#else
+		fprintf(stderr, "ion is only available on Android\n");
+		return 77;
+#endif
+
+	default:
+		return 77;
+	}
+}
+
+static void exporter_close(struct exporter *e)
+{
+#ifdef ANDROID
+	if (e->source == ION) {
+		ion_close(e->fd);
+		return;
+	}
+#endif
+	close(e->fd);
+}
+
+static void frame_init(struct exporter *e, struct frame *f, unsigned int size)
+{
+	memset(f, 0, sizeof(*f));
+
+	if (e->source == ION) {
+#ifdef ANDROID
+		igt_assert_eq(ion_alloc_one_fd(e->fd, size, e->heap_id,
+					       &f->dmabuf), 0);
+#endif
+	} else {
+		igt_assert_eq(e->gem->create(&f->handle, e->fd, size), 0);
+		f->dmabuf = prime_handle_to_fd_for_mmap(e->fd, f->handle);
+	}
+	igt_assert_fd(f->dmabuf);
+
+	f->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      f->dmabuf, 0);
+	igt_assert(f->map != MAP_FAILED);
+}
+
+static void frame_fini(struct exporter *e, struct frame *f, unsigned int size)
+{
+	munmap(f->map, size);
+	close(f->dmabuf);
+	if (f->handle)
+		gem_release_handle(e->fd, f->handle);
+}
+
+/* ION buffers are born as dma-bufs, a dup stands in for their export */
+static int export(struct exporter *e, struct frame *f)
+{
+	if (e->source == ION)
+		return dup(f->dmabuf);
+
+	return prime_handle_to_fd(e->fd, f->handle);
+}
+
+static void share(struct exporter *e, int importer, struct frame *f,
+		  double duration)
+{
+	uint64_t start, end, now;
+	unsigned long count = 0;
+
+	start = now = gettime_ns();
+	end = start + duration * 1e9;
+	do {
+		int dmabuf = export(e, f);
+
+		gem_release_handle(importer,
+				   prime_fd_to_handle(importer, dmabuf));
+		close(dmabuf);
+
+		count++;
+		now = gettime_ns();
+	} while (now < end);
+
+	printf("export+import   %8.2f us\n", (now - start) / 1e3 / count);
+	igt_bench_value("share", "us", (now - start) / 1e3 / count);
+}
+
+static void sync_cost(struct frame *f, bool write, double duration)
+{
+	uint64_t start, end, now;
+	unsigned long count = 0;
+
+	start = now = gettime_ns();
+	end = start + duration * 1e9;
+	do {
+		prime_sync_start(f->dmabuf, write);
+		prime_sync_end(f->dmabuf, write);
+
+		count++;
+		now = gettime_ns();
+	} while (now < end);
+
+	printf("sync-%-5s      %8.2f us\n", write ? "write" : "read",
+	       (now - start) / 1e3 / count);
+	igt_bench_value(write ? "sync-write" : "sync-read", "us",
+			(now - start) / 1e3 / count);
+}
+
+static void bandwidth(struct frame *f, void *scratch, unsigned int size,
+		      int reps)
+{
+	igt_stats_t wr, rd;
+
+	igt_stats_init_with_size(&wr, reps);
+	igt_stats_init_with_size(&rd, reps);
+
+	for (int r = 0; r < reps; r++) {
+		uint64_t start;
+
+		start = gettime_ns();
+		prime_sync_start(f->dmabuf, true);
+		memset(f->map, r, size);
+		prime_sync_end(f->dmabuf, true);
+		igt_stats_push_float(&wr, (double)size / (gettime_ns() - start));
+
+		start = gettime_ns();
+		prime_sync_start(f->dmabuf, false);
+		memcpy(scratch, f->map, size);
+		prime_sync_end(f->dmabuf, false);
+		igt_stats_push_float(&rd, (double)size / (gettime_ns() - start));
+	}
+
+	printf("mmap-write      %8.3f GB/s\n", igt_stats_get_median(&wr));
+	printf("mmap-read       %8.3f GB/s\n", igt_stats_get_median(&rd));
+	igt_bench_result("mmap-write", "GB/s", &wr);
+	igt_bench_result("mmap-read", "GB/s", &rd);
+
+	igt_stats_fini(&wr);
+	igt_stats_fini(&rd);
+}
+
+/*
+ * Each frame is written by the camera, exported, imported by the encoder
+ * which reads it back, and imported by the display. The overhead is the
+ * time spent outside of the CPU copies, in the ioctls sharing the frame and
+ * synchronising access to it.
+ */
+static void pipeline(struct exporter *e, int encoder, int display,
+		     struct frame *ring, unsigned int count, void *scratch,
+		     unsigned int size, unsigned int frames)
+{
+	igt_stats_t overhead, total;
+
+	igt_stats_init_with_size(&overhead, frames);
+	igt_stats_init_with_size(&total, frames);
+
+	for (unsigned int n = 0; n < frames; n++) {
+		struct frame *f = &ring[n % count];
+		uint64_t start, t, copy;
+		uint32_t enc, disp;
+		int dmabuf;
+
+		start = gettime_ns();
+		prime_sync_start(f->dmabuf, true);
+		t = gettime_ns();
+		memset(f->map, n, size);
+		copy = gettime_ns() - t;
+		prime_sync_end(f->dmabuf, true);
+
+		dmabuf = export(e, f);
+		enc = prime_fd_to_handle(encoder, dmabuf);
+		prime_sync_start(dmabuf, false);
+		t = gettime_ns();
+		memcpy(scratch, f->map, size);
+		copy += gettime_ns() - t;
+		prime_sync_end(dmabuf, false);
+
+		disp = prime_fd_to_handle(display, dmabuf);
+		gem_release_handle(display, disp);
+		gem_release_handle(encoder, enc);
+		close(dmabuf);
+
+		t = gettime_ns() - start;
+		igt_stats_push(&total, t);
+		igt_stats_push(&overhead, t - copy);
+	}
+
+	printf("frame           %8.2f us, %.1f frames/s\n",
+	       igt_stats_get_median(&total) / 1e3,
+	       1e9 / igt_stats_get_mean(&total));
+	printf("frame overhead  %8.2f us, max %.2f us\n",
+	       igt_stats_get_median(&overhead) / 1e3,
+	       igt_stats_get_max(&overhead) / 1e3);
+	igt_bench_result("frame", "ns", &total);
+	igt_bench_result("frame-overhead", "ns", &overhead);
+
+	igt_stats_fini(&overhead);
+	igt_stats_fini(&total);
+}
+
+static int run(enum source source, unsigned int width, unsigned int height,
+	       unsigned int count, unsigned int frames, double duration,
+	       int reps)
+{
+	/* NV12, as out of the camera and into the encoder */
+	unsigned int size = ALIGN(width * height * 3 / 2, PAGE);
+	struct frame ring[MAX_RING];
+	struct exporter e = {};
+	int encoder, display;
+	void *scratch;
+	int ret;
+
+	ret = exporter_open(&e, source);
+	if (ret)
+		return ret;
+
+	encoder = drm_open_driver(DRIVER_ANY);
+	display = drm_reopen_driver(encoder);
+
+	scratch = malloc(size);
+	igt_assert(scratch);
+	for (unsigned int n = 0; n < count; n++)
+		frame_init(&e, &ring[n], size);
+
+	printf("%s, %ux%u, %uKiB\n", source_names[source],
+	       width, height, size >> 10);
+
+	share(&e, encoder, &ring[0], duration);
+	sync_cost(&ring[0], false, duration);
+	sync_cost(&ring[0], true, duration);
+	bandwidth(&ring[0], scratch, size, reps);
+	pipeline(&e, encoder, display, ring, count, scratch, size, frames);
+
+	for (unsigned int n = 0; n < count; n++)
+		frame_fini(&e, &ring[n], size);
+	free(scratch);
+
+	close(display);
+	close(encoder);
+	exporter_close(&e);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	enum source source = VGEM;
+	unsigned int width = 1920;
+	unsigned int height = 1080;
+	unsigned int count = 4;
+	unsigned int frames = 300;
+	double duration = 1;
+	int reps = 10;
+	int c;
+
+	while ((c = getopt (argc, argv, "e:w:h:n:f:d:r:")) != -1) {
+		switch (c) {
+		case 'e':
+			for (int s = 0; s < NUM_SOURCES; s++)
+				if (!strcmp(optarg, source_names[s]))
+					source = s;
+			break;
+
+		case 'w':
+			width = atoi(optarg);
+			if (width < 16)
+				width = 16;
+			break;
+
+		case 'h':
+			height = atoi(optarg);
+			if (height < 16)
+				height = 16;
+			break;
+
+		case 'n':
+			count = atoi(optarg);
+			if (count < 1)
+				count = 1;
+			if (count > MAX_RING)
+				count = MAX_RING;
+			break;
+
+		case 'f':
+			frames = atoi(optarg);
+			if (frames < 1)
+				frames = 1;
+			break;
+
+		case 'd':
+			duration = atof(optarg);
+			if (duration < 0.1)
+				duration = 0.1;
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	igt_bench_begin("prime_transfer");
+	igt_bench_param("source", "%s", source_names[source]);
+	igt_bench_param("width", "%u", width);
+	igt_bench_param("height", "%u", height);
+	igt_bench_param("ring", "%u", count);
+	igt_bench_param("frames", "%u", frames);
+	igt_bench_param("duration", "%.1f", duration);
+	igt_bench_param("reps", "%d", reps);
+
+	c = run(source, width, height, count, frames, duration, reps);
+
+	igt_bench_end();
+
+	return c;
+}
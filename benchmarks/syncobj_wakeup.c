@@ -0,0 +1,338 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures how long a thread blocked in DRM_IOCTL_SYNCOBJ_WAIT takes to wake
+ * up once its syncobjs are signaled, and the CPU time the wait costs it, for
+ * WAIT_ALL and WAIT_ANY over 1 to 4096 syncobjs. The syncobjs are signaled
+ * either by a sw_sync timeline or by requests queued behind a spinner.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include "igt_syncobj.h"
+#include "sw_sync.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_COUNT 4096
+
+enum source {
+	SW_SYNC,
+	GPU,
+	NUM_SOURCES
+};
+
+static const char * const source_names[] = {
+	[SW_SYNC] = "sw_sync",
+	[GPU] = "gpu",
+};
+
+struct waiter {
+	pthread_t thread;
+	int fd;
+	uint32_t *handles;
+	unsigned int count;
+	uint32_t flags;
+
+	volatile bool ready;
+	uint64_t woken;
+	uint64_t cpu;
+	int err;
+};
+
+static uint64_t gettime_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *waiter(void *arg)
+{
+	struct waiter *w = arg;
+	uint64_t cpu;
+
+	cpu = gettime_ns(CLOCK_THREAD_CPUTIME_ID);
+	w->ready = true;
+	w->err = syncobj_wait_err(w->fd, w->handles, w->count,
+				  gettime_ns(CLOCK_MONOTONIC) + 10ull * NSEC_PER_SEC,
+				  w->flags);
+	w->woken = gettime_ns(CLOCK_MONOTONIC);
+	w->cpu = gettime_ns(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+	return NULL;
+}
+
+static bool has_syncobj_wait(int fd)
+{
+	struct local_syncobj_wait wait = {};
+	uint32_t handle = 0;
+	uint64_t value;
+
+	if (drmGetCap(fd, DRM_CAP_SYNCOBJ, &value) || !value)
+		return false;
+
+	/* Waiting on an invalid handle is rejected only if the ioctl exists */
+	wait.count_handles = 1;
+	wait.handles = to_user_pointer(&handle);
+	return __syncobj_wait(fd, &wait) == -ENOENT;
+}
+
+static bool has_fence_array(int fd)
+{
+	int value = 0;
+	struct drm_i915_getparam gp = {
+		.param = I915_PARAM_HAS_EXEC_FENCE_ARRAY,
+		.value = &value,
+	};
+
+	ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp);
+	return value;
+}
+
+/* One request per syncobj, queued behind the spinner so they all wait */
+static void queue_requests(int fd, uint32_t batch, const uint32_t *handles,
+			   unsigned int count)
+{
+	struct drm_i915_gem_exec_object2 obj = { .handle = batch };
+	struct drm_i915_gem_exec_fence fence = {
+		.flags = I915_EXEC_FENCE_SIGNAL,
+	};
+	struct drm_i915_gem_execbuffer2 execbuf = {
+		.buffers_ptr = to_user_pointer(&obj),
+		.buffer_count = 1,
+		.cliprects_ptr = to_user_pointer(&fence),
+		.num_cliprects = 1,
+		.flags = I915_EXEC_FENCE_ARRAY,
+	};
+
+	for (unsigned int n = 0; n < count; n++) {
+		fence.handle = handles[n];
+		gem_execbuf(fd, &execbuf);
+	}
+}
+
+/*
+ * Arms the syncobjs, starts a waiter on them and, once it is blocked,
+ * signals them all at once. Returns the time from the signal to the wakeup
+ * and, in cpu, the CPU time the waiter spent in the wait.
+ */
+static uint64_t wakeup_once(int fd, enum source source, uint32_t batch,
+			    uint32_t *handles, unsigned int count,
+			    uint32_t flags, uint64_t *cpu)
+{
+	struct waiter w = {
+		.fd = fd,
+		.handles = handles,
+		.count = count,
+		.flags = flags,
+	};
+	igt_spin_t *spin = NULL;
+	int timeline = -1;
+	uint64_t signaled;
+
+	syncobj_reset(fd, handles, count);
+
+	if (source == SW_SYNC) {
+		timeline = sw_sync_timeline_create();
+		for (unsigned int n = 0; n < count; n++) {
+			int fence = sw_sync_timeline_create_fence(timeline, 1);
+
+			syncobj_import_sync_file(fd, handles[n], fence);
+			close(fence);
+		}
+	} else {
+		spin = igt_spin_new(fd);
+		queue_requests(fd, batch, handles, count);
+	}
+
+	pthread_create(&w.thread, NULL, waiter, &w);
+	while (!w.ready)
+		;
+	/* Give the waiter time to block in the ioctl */
+	usleep(1000 + count);
+
+	signaled = gettime_ns(CLOCK_MONOTONIC);
+	if (source == SW_SYNC)
+		sw_sync_timeline_inc(timeline, 1);
+	else
+		igt_spin_end(spin);
+
+	pthread_join(w.thread, NULL);
+	igt_assert_eq(w.err, 0);
+
+	if (timeline != -1)
+		close(timeline);
+	if (spin) {
+		gem_sync(fd, batch);
+		igt_spin_free(fd, spin);
+	}
+
+	*cpu = w.cpu;
+	return w.woken - signaled;
+}
+
+static void run_one(int fd, enum source source, uint32_t batch,
+		    uint32_t *handles, unsigned int count, bool all,
+		    int reps)
+{
+	uint32_t flags = all ? LOCAL_SYNCOBJ_WAIT_FLAGS_WAIT_ALL : 0;
+	igt_stats_t latency, cpu;
+	char name[64];
+
+	igt_stats_init_with_size(&latency, reps);
+	igt_stats_init_with_size(&cpu, reps);
+
+	for (int r = 0; r < reps; r++) {
+		uint64_t c;
+
+		igt_stats_push(&latency,
+			       wakeup_once(fd, source, batch, handles, count,
+					   flags, &c));
+		igt_stats_push(&cpu, c);
+	}
+
+	printf("%-8s %-4s %5u %10.1f %10.1f %10.1f\n",
+	       source_names[source], all ? "all" : "any", count,
+	       igt_stats_get_median(&latency) / 1000,
+	       igt_stats_get_max(&latency) / 1000.,
+	       igt_stats_get_median(&cpu) / 1000);
+
+	snprintf(name, sizeof(name), "%s-%s-%u",
+		 source_names[source], all ? "all" : "any", count);
+	igt_bench_result(name, "ns", &latency);
+	snprintf(name, sizeof(name), "%s-%s-%u-cpu",
+		 source_names[source], all ? "all" : "any", count);
+	igt_bench_result(name, "ns", &cpu);
+
+	igt_stats_fini(&cpu);
+	igt_stats_fini(&latency);
+}
+
+static int run(unsigned int sources, unsigned int max, int reps)
+{
+	uint32_t bbe = MI_BATCH_BUFFER_END;
+	uint32_t handles[MAX_COUNT];
+	uint32_t batch = 0;
+	int fd;
+
+	fd = drm_open_driver(DRIVER_INTEL);
+	if (!has_syncobj_wait(fd)) {
+		fprintf(stderr, "No syncobj wait support\n");
+		return 77;
+	}
+
+	if (sources & (1 << SW_SYNC) && !igt_has_sw_sync())
+		sources &= ~(1 << SW_SYNC);
+	if (sources & (1 << GPU) && !has_fence_array(fd))
+		sources &= ~(1 << GPU);
+	if (!sources) {
+		fprintf(stderr, "Neither sw_sync nor fence arrays supported\n");
+		return 77;
+	}
+
+	if (sources & (1 << GPU)) {
+		batch = gem_create(fd, 4096);
+		gem_write(fd, batch, 0, &bbe, sizeof(bbe));
+	}
+
+	for (unsigned int n = 0; n < max; n++)
+		handles[n] = syncobj_create(fd, 0);
+
+	printf("%-8s %-4s %5s %10s %10s %10s\n",
+	       "source", "wait", "count", "median/us", "max/us", "cpu/us");
+	for (enum source source = 0; source < NUM_SOURCES; source++) {
+		if (!(sources & (1 << source)))
+			continue;
+
+		for (int all = 1; all >= 0; all--)
+			for (unsigned int count = 1; count <= max; count <<= 1)
+				run_one(fd, source, batch, handles, count,
+					all, reps);
+	}
+
+	for (unsigned int n = 0; n < max; n++)
+		syncobj_destroy(fd, handles[n]);
+	if (batch)
+		gem_close(fd, batch);
+	close(fd);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int sources = 0;
+	unsigned int max = MAX_COUNT;
+	int reps = 10;
+	int c;
+
+	while ((c = getopt (argc, argv, "s:n:r:")) != -1) {
+		switch (c) {
+		case 's':
+			for (int s = 0; s < NUM_SOURCES; s++)
+				if (!strcmp(optarg, source_names[s]))
+					sources |= 1 << s;
+			break;
+
+		case 'n':
+			max = atoi(optarg);
+			if (max < 1)
+				max = 1;
+			if (max > MAX_COUNT)
+				max = MAX_COUNT;
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (!sources)
+		sources = (1 << NUM_SOURCES) - 1;
+
+	igt_bench_begin("syncobj_wakeup");
+	igt_bench_param("sources", "0x%x", sources);
+	igt_bench_param("max", "%u", max);
+	igt_bench_param("reps", "%d", reps);
+
+	c = run(sources, max, reps);
+
+	igt_bench_end();
+
+	return c;
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures the costs of the BO helpers of v3d and vc4 across size classes:
+ * the rate of creating and freeing BOs, the cost of faulting in the pages
+ * of a mapping against touching them once mapped, the rate of marking vc4
+ * BOs purgeable and back, and how creation slows down as the CMA pool the
+ * BOs come from fills up, with and without purgeable BOs to reclaim.
+ */
+
+#include "igt.h"
+#include "igt_bench.h"
+#include "igt_v3d.h"
+#include "igt_vc4.h"
+#include "vc4_drm.h"
+#include "v3d_drm.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define PAGE 4096
+
+#define PURGEABLE 0x1
+
+static const unsigned int sizes[] = {
+	4 << 10, 64 << 10, 1 << 20, 8 << 20, 0
+};
+
+/* Whether fd is vc4 rather than v3d, looked up once */
+static bool vc4;
+
+static uint64_t gettime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Unlike the igt helpers, reports a failure to allocate instead of asserting */
+static int __create_bo(int fd, size_t size, uint32_t *handle)
+{
+	if (vc4) {
+		struct drm_vc4_create_bo create = { .size = size };
+
+		if (igt_ioctl(fd, DRM_IOCTL_VC4_CREATE_BO, &create))
+			return -errno;
+		*handle = create.handle;
+	} else {
+		struct drm_v3d_create_bo create = { .size = size };
+
+		if (igt_ioctl(fd, DRM_IOCTL_V3D_CREATE_BO, &create))
+			return -errno;
+		*handle = create.handle;
+	}
+
+	return 0;
+}
+
+static void *mmap_bo(int fd, uint32_t handle, unsigned int size)
+{
+	if (vc4)
+		return igt_vc4_mmap_bo(fd, handle, size, PROT_READ | PROT_WRITE);
+	else
+		return igt_v3d_mmap_bo(fd, handle, size, PROT_READ | PROT_WRITE);
+}
+
+static void create(int fd, unsigned int size, double duration)
+{
+	uint64_t start, end, now;
+	unsigned long count = 0;
+	char name[32];
+
+	start = now = gettime_ns();
+	end = start + duration * 1e9;
+	do {
+		if (vc4)
+			gem_close(fd, igt_vc4_create_bo(fd, size));
+		else
+			igt_v3d_free_bo(fd, igt_v3d_create_bo(fd, size));
+		count++;
+		now = gettime_ns();
+	} while (now < end);
+
+	printf("create   %6uKiB %12.0f ops/s\n",
+	       size >> 10, count * 1e9 / (now - start));
+	snprintf(name, sizeof(name), "create-%uKiB", size >> 10);
+	igt_bench_value(name, "ops/s", count * 1e9 / (now - start));
+}
+
+static uint64_t touch(volatile uint8_t *ptr, unsigned int size)
+{
+	uint64_t start = gettime_ns();
+
+	for (unsigned int offset = 0; offset < size; offset += PAGE)
+		ptr[offset] = offset;
+
+	return gettime_ns() - start;
+}
+
+static void fault(int fd, unsigned int size, int reps)
+{
+	igt_stats_t first, steady;
+	char name[32];
+
+	igt_stats_init_with_size(&first, reps);
+	igt_stats_init_with_size(&steady, reps);
+
+	for (int r = 0; r < reps; r++) {
+		uint32_t handle;
+		void *ptr;
+
+		igt_assert_eq(__create_bo(fd, size, &handle), 0);
+		ptr = mmap_bo(fd, handle, size);
+		igt_assert(ptr);
+
+		igt_stats_push(&first, touch(ptr, size));
+		igt_stats_push(&steady, touch(ptr, size));
+
+		munmap(ptr, size);
+		gem_close(fd, handle);
+	}
+
+	printf("fault    %6uKiB %12.1f ns/page, %.1f ns/page once mapped\n",
+	       size >> 10,
+	       igt_stats_get_median(&first) / (size / PAGE),
+	       igt_stats_get_median(&steady) / (size / PAGE));
+	snprintf(name, sizeof(name), "fault-%uKiB", size >> 10);
+	igt_bench_result(name, "ns", &first);
+
+	igt_stats_fini(&steady);
+	igt_stats_fini(&first);
+}
+
+static void purgeable(int fd, unsigned int size, double duration)
+{
+	uint64_t start, end, now;
+	unsigned long count = 0;
+	uint32_t handle;
+	char name[32];
+
+	handle = igt_vc4_create_bo(fd, size);
+
+	start = now = gettime_ns();
+	end = start + duration * 1e9;
+	do {
+		igt_vc4_purgeable_bo(fd, handle, true);
+		igt_vc4_purgeable_bo(fd, handle, false);
+		count += 2;
+		now = gettime_ns();
+	} while (now < end);
+
+	gem_close(fd, handle);
+
+	printf("madvise  %6uKiB %12.0f ops/s\n",
+	       size >> 10, count * 1e9 / (now - start));
+	snprintf(name, sizeof(name), "madvise-%uKiB", size >> 10);
+	igt_bench_value(name, "ops/s", count * 1e9 / (now - start));
+}
+
+/*
+ * Allocates BOs of size until the allocation fails or max is reached,
+ * printing the median creation time of each tenth of the way. With
+ * PURGEABLE, every other BO is marked purgeable once created, so the
+ * kernel may reclaim them instead of failing.
+ */
+static void pressure(int fd, unsigned int size, uint64_t max,
+		     unsigned int flags)
+{
+	unsigned long count = max / size, n, step, purged = 0;
+	uint32_t *handles = calloc(count, sizeof(*handles));
+	igt_stats_t stats;
+
+	igt_assert(handles);
+	step = count / 10 ?: 1;
+
+	printf("pressure %6uKiB%s\n", size >> 10,
+	       flags & PURGEABLE ? ", every other bo purgeable" : "");
+
+	igt_stats_init_with_size(&stats, step);
+	for (n = 0; n < count; n++) {
+		uint64_t t = gettime_ns();
+
+		if (__create_bo(fd, size, &handles[n]))
+			break;
+		igt_stats_push(&stats, gettime_ns() - t);
+
+		if (flags & PURGEABLE && n & 1)
+			igt_vc4_purgeable_bo(fd, handles[n], true);
+
+		if ((n + 1) % step == 0) {
+			printf("  %8luMiB %10.1f us/create\n",
+			       (uint64_t)(n + 1) * size >> 20,
+			       igt_stats_get_median(&stats) / 1000);
+			igt_stats_fini(&stats);
+			igt_stats_init_with_size(&stats, step);
+		}
+	}
+	igt_stats_fini(&stats);
+
+	if (n < count)
+		printf("  allocation failed after %luMiB\n",
+		       (uint64_t)n * size >> 20);
+
+	while (n--) {
+		if (flags & PURGEABLE && n & 1 &&
+		    !igt_vc4_purgeable_bo(fd, handles[n], false))
+			purged++;
+		gem_close(fd, handles[n]);
+	}
+	if (flags & PURGEABLE)
+		printf("  %lu bos purged\n", purged);
+
+	free(handles);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int size = 0;
+	unsigned int max_mib = 0;
+	double duration = 1;
+	int reps = 10;
+	int fd, c;
+
+	while ((c = getopt (argc, argv, "s:m:d:r:")) != -1) {
+		switch (c) {
+		case 's':
+			/* In KiB */
+			size = ALIGN(atoi(optarg) << 10, PAGE);
+			if (size < PAGE)
+				size = PAGE;
+			break;
+
+		case 'm':
+			/* Limit of the CMA pressure, in MiB, 0 to skip it */
+			max_mib = atoi(optarg);
+			break;
+
+		case 'd':
+			duration = atof(optarg);
+			if (duration <= 0)
+				duration = 0.1;
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	fd = drm_open_driver(DRIVER_VC4 | DRIVER_V3D);
+	vc4 = is_vc4_device(fd);
+
+	igt_bench_begin("v3d_vc4_bo");
+	igt_bench_param("driver", "%s", vc4 ? "vc4" : "v3d");
+	igt_bench_param("size", "%u", size);
+	igt_bench_param("duration", "%.1f", duration);
+	igt_bench_param("reps", "%d", reps);
+
+	for (const unsigned int *s = sizes; *s; s++) {
+		unsigned int sz = size ?: *s;
+
+		create(fd, sz, duration);
+		fault(fd, sz, reps);
+		if (vc4)
+			purgeable(fd, sz, duration);
+
+		if (size)
+			break;
+	}
+
+	if (max_mib) {
+		unsigned int sz = size ?: 1 << 20;
+
+		pressure(fd, sz, (uint64_t)max_mib << 20, 0);
+		if (vc4)
+			pressure(fd, sz, (uint64_t)max_mib << 20, PURGEABLE);
+	}
+
+	igt_bench_end();
+
+	close(fd);
+	return 0;
+}
@@ -29,9 +29,12 @@
 #ifdef HAVE_LIBGEN_H
 #include <libgen.h>
 #endif
+#include <dirent.h>
+#include <limits.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/ioctl.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -161,6 +164,64 @@ static const char *forced_driver(void)
 	return NULL;
 }
 
+static char _forced_device[PATH_MAX] = "";
+
+/**
+ * __set_forced_device:
+ * @path: path to the drm device node to forcibly use
+ *
+ * Restrict device discovery in #drm_open_driver and friends to the
+ * given device node. Render nodes are resolved to the render node
+ * of the same device.
+ */
+void __set_forced_device(const char *path)
+{
+	if (!path) {
+		igt_warn("No device specified, keep default behaviour\n");
+		return;
+	}
+
+	strncpy(_forced_device, path, sizeof(_forced_device) - 1);
+}
+
+static const char *forced_device(void)
+{
+	if (_forced_device[0])
+		return _forced_device;
+
+	return NULL;
+}
+
+static int find_render_node(const char *card, char *name, size_t len)
+{
+	struct dirent *dirent;
+	struct stat st;
+	char path[80];
+	DIR *dir;
+	int ret = -1;
+
+	if (stat(card, &st) || !S_ISCHR(st.st_mode))
+		return -1;
+
+	snprintf(path, sizeof(path), "/sys/dev/char/%d:%d/device/drm",
+		 major(st.st_rdev), minor(st.st_rdev));
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+
+	while ((dirent = readdir(dir))) {
+		if (strncmp(dirent->d_name, "renderD", 7))
+			continue;
+
+		snprintf(name, len, "/dev/dri/%s", dirent->d_name);
+		ret = 0;
+		break;
+	}
+	closedir(dir);
+
+	return ret;
+}
+
 #define LOCAL_I915_EXEC_VEBOX	(4 << 0)
 /**
  * gem_quiescent_gpu:
@@ -245,22 +306,103 @@ err:
 	return -1;
 }
 
+/*
+ * The device nodes found by the search below, so that opening the same kind
+ * of device again does not need to probe every node before it. A hit is
+ * still checked by open_device(), and on a mismatch (e.g. the driver was
+ * reloaded under a different minor) we fall back to searching again.
+ */
+static struct {
+	pthread_mutex_t mutex;
+	struct {
+		int offset;
+		unsigned int chipset;
+		char name[80];
+	} nodes[8];
+	unsigned int count;
+} open_cache = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static bool open_cache_lookup(int offset, unsigned int chipset,
+			      char *name, size_t len)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&open_cache.mutex);
+	for (unsigned int i = 0; i < open_cache.count; i++) {
+		if (open_cache.nodes[i].offset == offset &&
+		    open_cache.nodes[i].chipset == chipset) {
+			snprintf(name, len, "%s", open_cache.nodes[i].name);
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&open_cache.mutex);
+
+	return found;
+}
+
+static void open_cache_store(int offset, unsigned int chipset,
+			     const char *name)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&open_cache.mutex);
+	for (i = 0; i < open_cache.count; i++) {
+		if (open_cache.nodes[i].offset == offset &&
+		    open_cache.nodes[i].chipset == chipset)
+			break;
+	}
+	if (i == open_cache.count) {
+		if (open_cache.count < ARRAY_SIZE(open_cache.nodes))
+			open_cache.count++;
+		else
+			i = 0; /* full, replace the oldest slot */
+	}
+	open_cache.nodes[i].offset = offset;
+	open_cache.nodes[i].chipset = chipset;
+	snprintf(open_cache.nodes[i].name, sizeof(open_cache.nodes[i].name),
+		 "%s", name);
+	pthread_mutex_unlock(&open_cache.mutex);
+}
+
 static int __search_and_open(const char *base, int offset, unsigned int chipset)
 {
 	const char *forced;
+	char name[80];
 
 	forced = forced_driver();
 	if (forced)
 		igt_info("Force option used: Using driver %s\n", forced);
 
+	forced = forced_device();
+	if (forced) {
+		if (offset == 0)
+			return open_device(forced, chipset);
+
+		if (find_render_node(forced, name, sizeof(name)))
+			return -1;
+
+		return open_device(name, chipset);
+	}
+
+	if (open_cache_lookup(offset, chipset, name, sizeof(name))) {
+		int fd = open_device(name, chipset);
+
+		if (fd != -1)
+			return fd;
+	}
+
 	for (int i = 0; i < 16; i++) {
-		char name[80];
 		int fd;
 
 		sprintf(name, "%s%u", base, i + offset);
 		fd = open_device(name, chipset);
-		if (fd != -1)
+		if (fd != -1) {
+			open_cache_store(offset, chipset, name);
 			return fd;
+		}
 	}
 
 	return -1;
@@ -401,6 +543,27 @@ int drm_open_driver(int chipset)
 	return fd;
 }
 
+/**
+ * drm_reopen_driver:
+ * @fd: open drm file descriptor
+ *
+ * Opens the device node behind @fd again, without searching for it. The
+ * new file descriptor is a separate drm client, with its own default
+ * context, GEM handles etc.
+ *
+ * Returns: a new drm file descriptor
+ */
+int drm_reopen_driver(int fd)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	fd = open(path, O_RDWR);
+	igt_assert_fd(fd);
+
+	return fd;
+}
+
 /**
  * drm_open_driver_master:
  * @chipset: OR'd flags for each chipset to search, eg. #DRIVER_INTEL
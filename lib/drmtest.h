@@ -59,6 +59,7 @@
 #define DRIVER_ANY 	~(DRIVER_VGEM)
 
 void __set_forced_driver(const char *name);
+void __set_forced_device(const char *path);
 
 /**
  * ARRAY_SIZE:
@@ -81,6 +82,7 @@ int drm_open_driver(int chipset);
 int drm_open_driver_master(int chipset);
 int drm_open_driver_render(int chipset);
 int __drm_open_driver(int chipset);
+int drm_reopen_driver(int fd);
 
 void gem_quiescent_gpu(int fd);
 
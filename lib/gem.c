@@ -1,6 +1,14 @@
+#include <poll.h>
+
 #include "gem.h"
 
+#include "gem_amdgpu.h"
+#include "gem_i915.h"
 #include "gem_msm.h"
+#include "gem_panfrost.h"
+#include "gem_v3d.h"
+#include "gem_vc4.h"
+#include "gem_vgem.h"
 
 struct gem_driver_lookup
 {
@@ -9,13 +17,41 @@ struct gem_driver_lookup
 };
 
 static struct gem_driver_lookup drivers[] = {
+	{
+		.name = "amdgpu",
+		.driver = &gem_amdgpu_driver
+	},
+	{
+		.name = "i915",
+		.driver = &gem_i915_driver
+	},
+	{
+		.name = "msm",
+		.driver = &gem_msm_driver
+	},
 	{
 		.name = "msm_drm",
 		.driver = &gem_msm_driver
+	},
+	{
+		.name = "panfrost",
+		.driver = &gem_panfrost_driver
+	},
+	{
+		.name = "v3d",
+		.driver = &gem_v3d_driver
+	},
+	{
+		.name = "vc4",
+		.driver = &gem_vc4_driver
+	},
+	{
+		.name = "vgem",
+		.driver = &gem_vgem_driver
 	}
 };
 
-static inline size_t num_drivers()
+static inline size_t num_drivers(void)
 {
 	return ARRAY_SIZE(drivers);
 }
@@ -83,6 +119,27 @@ int gem_size(int drm_fd, size_t *size, uint32_t gem_handle)
 	return 0;
 }
 
+int gem_dmabuf_wait(int drm_fd, uint32_t gem_handle, int64_t timeout_ns)
+{
+	struct pollfd pfd = {
+		.events = POLLOUT
+	};
+	int ret;
+
+	pfd.fd = prime_handle_to_fd(drm_fd, gem_handle);
+
+	/* POLLOUT on a dma-buf waits for all fences, readers and writers */
+	ret = poll(&pfd, 1, timeout_ns / 1000000);
+	close(pfd.fd);
+
+	return ret == 1 ? 0 : -1;
+}
+
+int gem_generic_munmap(int drm_fd, uint32_t gem_handle, void *ptr, size_t size)
+{
+	return munmap(ptr, size) ? -1 : 0;
+}
+
 void gem_release_handle(int drm_fd, uint32_t gem_handle)
 {
 	struct drm_gem_close drm_gem_close_arg = {
@@ -5,6 +5,25 @@
 
 struct gem_driver
 {
+	/**
+	 * name:
+	 *
+	 * Name of the kernel driver, for reporting.
+	 **/
+	const char *name;
+
+	/**
+	 * create:
+	 * @gem_handle: (out) GEM handle
+	 * @drm_fd: open DRM device fd
+	 * @size: minimum size of the GEM buffer
+	 *
+	 * Creates a buffer that can be mapped with mmap.
+	 *
+	 * Returns: 0 on success, -1 otherwise
+	 **/
+	int (*create)(uint32_t *gem_handle, int drm_fd, size_t size);
+
 	/**
 	 * mmap:
 	 * @ptr: (out) pointer to the buffer in the user process's memory
@@ -30,6 +49,52 @@ struct gem_driver
 	 * Returns: 0 on success: -1 otherwise
 	 **/
 	int (*munmap)(int drm_fd, uint32_t gem_handle, void *ptr, size_t size);
+
+	/**
+	 * wait:
+	 * @drm_fd: open DRM device fd
+	 * @gem_handle: GEM handle
+	 * @timeout_ns: how long to wait for, in nanoseconds
+	 *
+	 * Waits for the jobs using the buffer to complete.
+	 *
+	 * Returns: 0 once the buffer is idle, -1 otherwise
+	 **/
+	int (*wait)(int drm_fd, uint32_t gem_handle, int64_t timeout_ns);
+
+	/**
+	 * nop_init:
+	 * @nop: (out) state for nop_submit
+	 * @drm_fd: open DRM device fd
+	 *
+	 * Prepares the smallest job the driver can run. Optional, NULL when
+	 * the driver has no way to submit jobs.
+	 *
+	 * Returns: 0 on success, -1 otherwise
+	 **/
+	int (*nop_init)(void **nop, int drm_fd);
+
+	/**
+	 * nop_submit:
+	 * @drm_fd: open DRM device fd
+	 * @nop: state from nop_init
+	 * @gem_handle: GEM handle
+	 *
+	 * Queues the job prepared by nop_init, marking the buffer as written
+	 * by it, so that wait only returns once the job has completed.
+	 *
+	 * Returns: 0 on success, -1 otherwise
+	 **/
+	int (*nop_submit)(int drm_fd, void *nop, uint32_t gem_handle);
+
+	/**
+	 * nop_fini:
+	 * @drm_fd: open DRM device fd
+	 * @nop: state from nop_init
+	 *
+	 * Waits for the last job submitted and frees the state of nop_init.
+	 **/
+	void (*nop_fini)(int drm_fd, void *nop);
 };
 
 /**
@@ -51,6 +116,32 @@ struct gem_driver *gem_get_driver(int drm_fd);
  **/
 int gem_size(int drm_fd, size_t *size, uint32_t gem_handle);
 
+/**
+ * gem_dmabuf_wait:
+ * @drm_fd: open DRM device fd
+ * @gem_handle: GEM handle
+ * @timeout_ns: how long to wait for, in nanoseconds
+ *
+ * Waits for the buffer to be idle by polling a dma-buf exported from it,
+ * for drivers without a wait ioctl of their own.
+ *
+ * Returns: 0 once the buffer is idle, -1 otherwise
+ **/
+int gem_dmabuf_wait(int drm_fd, uint32_t gem_handle, int64_t timeout_ns);
+
+/**
+ * gem_generic_munmap:
+ * @drm_fd: open DRM device fd
+ * @gem_handle: GEM handle
+ * @ptr: pointer (see ptr argument to mmap)
+ * @size: exact size of the mapped area
+ *
+ * Plain munmap, for drivers with nothing to do on unmapping.
+ *
+ * Returns: 0 on success: -1 otherwise
+ **/
+int gem_generic_munmap(int drm_fd, uint32_t gem_handle, void *ptr, size_t size);
+
 /**
  * gem_release_handle
  * @drm_fd: open DRM device fd
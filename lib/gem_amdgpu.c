@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "gem_amdgpu.h"
+#include "amdgpu_drm.h"
+
+/*
+ * Submitting a job needs a context and a command buffer mapped into the GPU
+ * address space, so there is no nop here. Buffers are placed in GTT, as not
+ * all of VRAM need be visible to the CPU.
+ */
+
+static int gem_amdgpu_create(uint32_t *gem_handle, int drm_fd, size_t size)
+{
+	union drm_amdgpu_gem_create create = {};
+
+	create.in.bo_size = size;
+	create.in.alignment = 4096;
+	create.in.domains = AMDGPU_GEM_DOMAIN_GTT;
+
+	if (drmIoctl(drm_fd, DRM_IOCTL_AMDGPU_GEM_CREATE, &create))
+		return -1;
+
+	*gem_handle = create.out.handle;
+
+	return 0;
+}
+
+static int gem_amdgpu_mmap(void **ptr, int drm_fd, uint32_t gem_handle, size_t size)
+{
+	union drm_amdgpu_gem_mmap map = {};
+
+	map.in.handle = gem_handle;
+	if (drmIoctl(drm_fd, DRM_IOCTL_AMDGPU_GEM_MMAP, &map))
+		return -1;
+
+	*ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    drm_fd, map.out.addr_ptr);
+
+	return *ptr == MAP_FAILED ? -1 : 0;
+}
+
+static int gem_amdgpu_wait(int drm_fd, uint32_t gem_handle, int64_t timeout_ns)
+{
+	union drm_amdgpu_gem_wait_idle wait = {};
+	struct timespec now;
+
+	/* The timeout is absolute, on the monotonic clock */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wait.in.handle = gem_handle;
+	wait.in.timeout = now.tv_sec * NSEC_PER_SEC + now.tv_nsec + timeout_ns;
+
+	if (drmIoctl(drm_fd, DRM_IOCTL_AMDGPU_GEM_WAIT_IDLE, &wait))
+		return -1;
+
+	return wait.out.status ? -1 : 0;
+}
+
+struct gem_driver gem_amdgpu_driver = {
+	.name = "amdgpu",
+	.create = gem_amdgpu_create,
+	.mmap = gem_amdgpu_mmap,
+	.munmap = gem_generic_munmap,
+	.wait = gem_amdgpu_wait
+};
@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "gem_i915.h"
+#include "i915/gem_mman.h"
+#include "intel_reg.h"
+
+struct gem_i915_nop
+{
+	struct drm_i915_gem_exec_object2 obj[2];
+	struct drm_i915_gem_execbuffer2 execbuf;
+};
+
+static int gem_i915_create(uint32_t *gem_handle, int drm_fd, size_t size)
+{
+	return __gem_create(drm_fd, size, gem_handle) ? -1 : 0;
+}
+
+static int gem_i915_mmap(void **ptr, int drm_fd, uint32_t gem_handle, size_t size)
+{
+	const unsigned int prot = PROT_READ | PROT_WRITE;
+
+	if (gem_mmap__has_wc(drm_fd))
+		*ptr = __gem_mmap__wc(drm_fd, gem_handle, 0, size, prot);
+	else
+		*ptr = __gem_mmap__gtt(drm_fd, gem_handle, size, prot);
+
+	return *ptr ? 0 : -1;
+}
+
+static int gem_i915_wait(int drm_fd, uint32_t gem_handle, int64_t timeout_ns)
+{
+	return gem_wait(drm_fd, gem_handle, &timeout_ns) ? -1 : 0;
+}
+
+static int gem_i915_nop_init(void **nop, int drm_fd)
+{
+	const uint32_t bbe = MI_BATCH_BUFFER_END;
+	struct gem_i915_nop *n;
+
+	n = calloc(1, sizeof(*n));
+	if (!n)
+		return -1;
+
+	if (__gem_create(drm_fd, 4096, &n->obj[1].handle)) {
+		free(n);
+		return -1;
+	}
+	gem_write(drm_fd, n->obj[1].handle, 0, &bbe, sizeof(bbe));
+
+	n->obj[0].flags = EXEC_OBJECT_WRITE;
+	n->execbuf.buffers_ptr = to_user_pointer(n->obj);
+	n->execbuf.buffer_count = 2;
+
+	*nop = n;
+
+	return 0;
+}
+
+static int gem_i915_nop_submit(int drm_fd, void *nop, uint32_t gem_handle)
+{
+	struct gem_i915_nop *n = nop;
+
+	n->obj[0].handle = gem_handle;
+
+	return __gem_execbuf(drm_fd, &n->execbuf) ? -1 : 0;
+}
+
+static void gem_i915_nop_fini(int drm_fd, void *nop)
+{
+	struct gem_i915_nop *n = nop;
+
+	gem_sync(drm_fd, n->obj[1].handle);
+	gem_close(drm_fd, n->obj[1].handle);
+	free(n);
+}
+
+struct gem_driver gem_i915_driver = {
+	.name = "i915",
+	.create = gem_i915_create,
+	.mmap = gem_i915_mmap,
+	.munmap = gem_generic_munmap,
+	.wait = gem_i915_wait,
+	.nop_init = gem_i915_nop_init,
+	.nop_submit = gem_i915_nop_submit,
+	.nop_fini = gem_i915_nop_fini
+};
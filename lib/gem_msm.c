@@ -1,8 +1,25 @@
 #include "gem_msm.h"
-#include "drm-uapi/msm_drm.h"
+#include "msm_drm.h"
 
 #include "drm.h"
 
+static int gem_msm_create(uint32_t *gem_handle, int drm_fd, size_t size)
+{
+	struct drm_msm_gem_new gem_new = {
+		.size = size,
+		.flags = MSM_BO_WC
+	};
+
+	if (drmIoctl(drm_fd, DRM_IOCTL_MSM_GEM_NEW, &gem_new))
+	{
+		return -1;
+	}
+
+	*gem_handle = gem_new.handle;
+
+	return 0;
+}
+
 static int gem_msm_mmap(void **ptr, int drm_fd, uint32_t gem_handle, size_t size)
 {
 	struct drm_msm_gem_cpu_prep gem_prep = {
@@ -62,7 +79,37 @@ static int gem_msm_munmap(int drm_fd, uint32_t gem_handle, void *ptr, size_t siz
 	return 0;
 }
 
+static int gem_msm_wait(int drm_fd, uint32_t gem_handle, int64_t timeout_ns)
+{
+	struct drm_msm_gem_cpu_prep gem_prep = {
+		.handle = gem_handle,
+		.op = MSM_PREP_READ | MSM_PREP_WRITE
+	};
+	struct drm_msm_gem_cpu_fini gem_fini = {
+		.handle = gem_handle
+	};
+	struct timespec now;
+
+	/* The timeout is absolute, on the monotonic clock */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timeout_ns += now.tv_nsec;
+	gem_prep.timeout.tv_sec = now.tv_sec + timeout_ns / NSEC_PER_SEC;
+	gem_prep.timeout.tv_nsec = timeout_ns % NSEC_PER_SEC;
+
+	if (drmIoctl(drm_fd, DRM_IOCTL_MSM_GEM_CPU_PREP, &gem_prep))
+	{
+		return -1;
+	}
+
+	drmIoctl(drm_fd, DRM_IOCTL_MSM_GEM_CPU_FINI, &gem_fini);
+
+	return 0;
+}
+
 struct gem_driver gem_msm_driver = {
+	.name = "msm",
+	.create = gem_msm_create,
 	.mmap = gem_msm_mmap,
-	.munmap = gem_msm_munmap
+	.munmap = gem_msm_munmap,
+	.wait = gem_msm_wait
 };
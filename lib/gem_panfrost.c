@@ -0,0 +1,145 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "gem_panfrost.h"
+#include "igt_panfrost.h"
+#include "panfrost_drm.h"
+#include "panfrost-job.h"
+
+struct gem_panfrost_nop
+{
+	struct panfrost_submit *submit;
+	struct mali_job_descriptor_header header;
+	uint64_t job_bos;
+	uint32_t bos[7];
+};
+
+static int gem_panfrost_create(uint32_t *gem_handle, int drm_fd, size_t size)
+{
+	struct drm_panfrost_create_bo create = {
+		.size = size
+	};
+
+	if (drmIoctl(drm_fd, DRM_IOCTL_PANFROST_CREATE_BO, &create))
+		return -1;
+
+	*gem_handle = create.handle;
+
+	return 0;
+}
+
+static int gem_panfrost_mmap(void **ptr, int drm_fd, uint32_t gem_handle, size_t size)
+{
+	struct drm_panfrost_mmap_bo mmap_bo = {
+		.handle = gem_handle
+	};
+
+	if (drmIoctl(drm_fd, DRM_IOCTL_PANFROST_MMAP_BO, &mmap_bo))
+		return -1;
+
+	*ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    drm_fd, mmap_bo.offset);
+
+	return *ptr == MAP_FAILED ? -1 : 0;
+}
+
+static int gem_panfrost_wait(int drm_fd, uint32_t gem_handle, int64_t timeout_ns)
+{
+	struct drm_panfrost_wait_bo wait = {
+		.handle = gem_handle
+	};
+	struct timespec now;
+
+	/* The timeout is absolute, on the monotonic clock */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wait.timeout_ns = now.tv_sec * NSEC_PER_SEC + now.tv_nsec + timeout_ns;
+
+	return drmIoctl(drm_fd, DRM_IOCTL_PANFROST_WAIT_BO, &wait) ? -1 : 0;
+}
+
+/* The nop is the trivial job at its smallest, with the buffer added to it */
+static int gem_panfrost_nop_init(void **nop, int drm_fd)
+{
+	struct gem_panfrost_nop *n;
+	struct drm_panfrost_submit *args;
+
+	n = calloc(1, sizeof(*n));
+	if (!n)
+		return -1;
+
+	n->submit = igt_panfrost_trivial_job(drm_fd, false, 16, 16, 0);
+	memcpy(&n->header, n->submit->submit_bo->map, sizeof(n->header));
+
+	args = n->submit->args;
+	memcpy(n->bos, from_user_pointer(args->bo_handles),
+	       args->bo_handle_count * sizeof(n->bos[0]));
+	n->job_bos = args->bo_handles;
+	args->bo_handles = to_user_pointer(n->bos);
+
+	*nop = n;
+
+	return 0;
+}
+
+static int gem_panfrost_nop_submit(int drm_fd, void *nop, uint32_t gem_handle)
+{
+	struct gem_panfrost_nop *n = nop;
+	struct drm_panfrost_submit *args = n->submit->args;
+
+	/* The GPU writes back the status of the job into its header */
+	if (drmSyncobjWait(drm_fd, &args->out_sync, 1, INT64_MAX, 0, NULL))
+		return -1;
+	memcpy(n->submit->submit_bo->map, &n->header, sizeof(n->header));
+
+	n->bos[6] = gem_handle;
+	args->bo_handle_count = 7;
+
+	return drmIoctl(drm_fd, DRM_IOCTL_PANFROST_SUBMIT, args) ? -1 : 0;
+}
+
+static void gem_panfrost_nop_fini(int drm_fd, void *nop)
+{
+	struct gem_panfrost_nop *n = nop;
+	struct drm_panfrost_submit *args = n->submit->args;
+
+	drmSyncobjWait(drm_fd, &args->out_sync, 1, INT64_MAX, 0, NULL);
+
+	args->bo_handles = n->job_bos;
+	args->bo_handle_count = 6;
+	igt_panfrost_free_job(drm_fd, n->submit);
+	free(n);
+}
+
+struct gem_driver gem_panfrost_driver = {
+	.name = "panfrost",
+	.create = gem_panfrost_create,
+	.mmap = gem_panfrost_mmap,
+	.munmap = gem_generic_munmap,
+	.wait = gem_panfrost_wait,
+	.nop_init = gem_panfrost_nop_init,
+	.nop_submit = gem_panfrost_nop_submit,
+	.nop_fini = gem_panfrost_nop_fini
+};
@@ -0,0 +1,78 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "gem_vc4.h"
+#include "vc4_drm.h"
+
+/*
+ * Submitting a job needs a control list built for the buffers it uses, so
+ * there is no nop here.
+ */
+
+static int gem_vc4_create(uint32_t *gem_handle, int drm_fd, size_t size)
+{
+	struct drm_vc4_create_bo create = {
+		.size = size
+	};
+
+	if (drmIoctl(drm_fd, DRM_IOCTL_VC4_CREATE_BO, &create))
+		return -1;
+
+	*gem_handle = create.handle;
+
+	return 0;
+}
+
+static int gem_vc4_mmap(void **ptr, int drm_fd, uint32_t gem_handle, size_t size)
+{
+	struct drm_vc4_mmap_bo mmap_bo = {
+		.handle = gem_handle
+	};
+
+	if (drmIoctl(drm_fd, DRM_IOCTL_VC4_MMAP_BO, &mmap_bo))
+		return -1;
+
+	*ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    drm_fd, mmap_bo.offset);
+
+	return *ptr == MAP_FAILED ? -1 : 0;
+}
+
+static int gem_vc4_wait(int drm_fd, uint32_t gem_handle, int64_t timeout_ns)
+{
+	struct drm_vc4_wait_bo wait = {
+		.handle = gem_handle,
+		.timeout_ns = timeout_ns
+	};
+
+	return drmIoctl(drm_fd, DRM_IOCTL_VC4_WAIT_BO, &wait) ? -1 : 0;
+}
+
+struct gem_driver gem_vc4_driver = {
+	.name = "vc4",
+	.create = gem_vc4_create,
+	.mmap = gem_vc4_mmap,
+	.munmap = gem_generic_munmap,
+	.wait = gem_vc4_wait
+};
@@ -0,0 +1,98 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "gem_vgem.h"
+#include "igt_vgem.h"
+
+/*
+ * vgem has no engine, its jobs are the fences userspace attaches to buffers
+ * and signals when done. A nop is a write fence signaled right away.
+ */
+
+static int gem_vgem_create(uint32_t *gem_handle, int drm_fd, size_t size)
+{
+	struct vgem_bo bo = {
+		.width = 1024,
+		.height = DIV_ROUND_UP(size, 4096),
+		.bpp = 32
+	};
+
+	if (__vgem_create(drm_fd, &bo))
+		return -1;
+
+	*gem_handle = bo.handle;
+
+	return 0;
+}
+
+static int gem_vgem_mmap(void **ptr, int drm_fd, uint32_t gem_handle, size_t size)
+{
+	struct vgem_bo bo = {
+		.handle = gem_handle,
+		.size = size
+	};
+
+	*ptr = __vgem_mmap(drm_fd, &bo, PROT_READ | PROT_WRITE);
+
+	return *ptr ? 0 : -1;
+}
+
+static int gem_vgem_nop_init(void **nop, int drm_fd)
+{
+	if (!vgem_has_fences(drm_fd))
+		return -1;
+
+	*nop = NULL;
+
+	return 0;
+}
+
+static int gem_vgem_nop_submit(int drm_fd, void *nop, uint32_t gem_handle)
+{
+	struct vgem_bo bo = {
+		.handle = gem_handle
+	};
+	uint32_t fence;
+
+	fence = vgem_fence_attach(drm_fd, &bo, VGEM_FENCE_WRITE);
+
+	return __vgem_fence_signal(drm_fd, fence) ? -1 : 0;
+}
+
+static void gem_vgem_nop_fini(int drm_fd, void *nop)
+{
+}
+
+struct gem_driver gem_vgem_driver = {
+	.name = "vgem",
+	.create = gem_vgem_create,
+	.mmap = gem_vgem_mmap,
+	.munmap = gem_generic_munmap,
+	.wait = gem_dmabuf_wait,
+	.nop_init = gem_vgem_nop_init,
+	.nop_submit = gem_vgem_nop_submit,
+	.nop_fini = gem_vgem_nop_fini
+};
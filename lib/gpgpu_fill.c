@@ -33,59 +33,7 @@
 
 #include "gpgpu_fill.h"
 #include "gpu_cmds.h"
-
-/* lib/i915/shaders/gpgpu/gpgpu_fill.gxa */
-static const uint32_t gen7_gpgpu_kernel[][4] = {
-	{ 0x00400001, 0x20200231, 0x00000020, 0x00000000 },
-	{ 0x00000041, 0x20400c21, 0x00000004, 0x00000010 },
-	{ 0x00000001, 0x20440021, 0x00000018, 0x00000000 },
-	{ 0x00600001, 0x20800021, 0x008d0000, 0x00000000 },
-	{ 0x00200001, 0x20800021, 0x00450040, 0x00000000 },
-	{ 0x00000001, 0x20880061, 0x00000000, 0x0000000f },
-	{ 0x00800001, 0x20a00021, 0x00000020, 0x00000000 },
-	{ 0x05800031, 0x24001ca8, 0x00000080, 0x060a8000 },
-	{ 0x00600001, 0x2e000021, 0x008d0000, 0x00000000 },
-	{ 0x07800031, 0x20001ca8, 0x00000e00, 0x82000010 },
-};
-
-static const uint32_t gen8_gpgpu_kernel[][4] = {
-	{ 0x00400001, 0x20202288, 0x00000020, 0x00000000 },
-	{ 0x00000041, 0x20400208, 0x06000004, 0x00000010 },
-	{ 0x00000001, 0x20440208, 0x00000018, 0x00000000 },
-	{ 0x00600001, 0x20800208, 0x008d0000, 0x00000000 },
-	{ 0x00200001, 0x20800208, 0x00450040, 0x00000000 },
-	{ 0x00000001, 0x20880608, 0x00000000, 0x0000000f },
-	{ 0x00800001, 0x20a00208, 0x00000020, 0x00000000 },
-	{ 0x0c800031, 0x24000a40, 0x0e000080, 0x060a8000 },
-	{ 0x00600001, 0x2e000208, 0x008d0000, 0x00000000 },
-	{ 0x07800031, 0x20000a40, 0x0e000e00, 0x82000010 },
-};
-
-static const uint32_t gen9_gpgpu_kernel[][4] = {
-	{ 0x00400001, 0x20202288, 0x00000020, 0x00000000 },
-	{ 0x00000041, 0x20400208, 0x06000004, 0x00000010 },
-	{ 0x00000001, 0x20440208, 0x00000018, 0x00000000 },
-	{ 0x00600001, 0x20800208, 0x008d0000, 0x00000000 },
-	{ 0x00200001, 0x20800208, 0x00450040, 0x00000000 },
-	{ 0x00000001, 0x20880608, 0x00000000, 0x0000000f },
-	{ 0x00800001, 0x20a00208, 0x00000020, 0x00000000 },
-	{ 0x0c800031, 0x24000a40, 0x06000080, 0x060a8000 },
-	{ 0x00600001, 0x2e000208, 0x008d0000, 0x00000000 },
-	{ 0x07800031, 0x20000a40, 0x06000e00, 0x82000010 },
-};
-
-static const uint32_t gen11_gpgpu_kernel[][4] = {
-	{ 0x00400001, 0x20202288, 0x00000020, 0x00000000 },
-	{ 0x00000009, 0x20400208, 0x06000004, 0x00000004 },
-	{ 0x00000001, 0x20440208, 0x00000018, 0x00000000 },
-	{ 0x00600001, 0x20800208, 0x008d0000, 0x00000000 },
-	{ 0x00200001, 0x20800208, 0x00450040, 0x00000000 },
-	{ 0x00000001, 0x20880608, 0x00000000, 0x0000000f },
-	{ 0x00800001, 0x20a00208, 0x00000020, 0x00000000 },
-	{ 0x0c800031, 0x24000a40, 0x06000080, 0x040a8000 },
-	{ 0x00600001, 0x2e000208, 0x008d0000, 0x00000000 },
-	{ 0x07800031, 0x20000a40, 0x06000e00, 0x82000010 },
-};
+#include "gpu_shaders.h"
 
 /*
  * This sets up the gpgpu pipeline,
@@ -116,13 +64,24 @@ static const uint32_t gen11_gpgpu_kernel[][4] = {
 #define GPGPU_CURBE_SIZE 1
 #define GEN7_VFE_STATE_GPGPU_MODE 1
 
-void
-gen7_gpgpu_fillfunc(struct intel_batchbuffer *batch,
-		    const struct igt_buf *dst,
-		    unsigned int x, unsigned int y,
-		    unsigned int width, unsigned int height,
-		    uint8_t color)
+/*
+ * Every thread group is a single SIMD16 thread filling its own 16x1 block,
+ * the kernel only looks at the thread group ID, so the walk can be spread
+ * over as many threads as the hardware is allowed to run at once.
+ */
+static uint32_t vfe_threads(unsigned int threads)
 {
+	return threads ? threads - 1 : THREADS;
+}
+
+static void
+__gen7_gpgpu_fillfunc(struct intel_batchbuffer *batch,
+		      const struct igt_buf *dst,
+		      unsigned int x, unsigned int y,
+		      unsigned int width, unsigned int height,
+		      uint8_t color, unsigned int threads)
+{
+	const struct gpu_shader *kernel;
 	uint32_t curbe_buffer, interface_descriptor;
 	uint32_t batch_end;
 
@@ -138,8 +97,9 @@ gen7_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 	 */
 	curbe_buffer = gen7_fill_curbe_buffer_data(batch, color);
 
+	kernel = gpu_shader_lookup(batch->devid, GPU_SHADER_GPGPU_FILL);
 	interface_descriptor = gen7_fill_interface_descriptor(batch, dst,
-				gen7_gpgpu_kernel, sizeof(gen7_gpgpu_kernel));
+				kernel->code, kernel->size);
 
 	igt_assert(batch->ptr < &batch->buffer[4095]);
 
@@ -149,7 +109,7 @@ gen7_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 	OUT_BATCH(GEN7_PIPELINE_SELECT | PIPELINE_SELECT_GPGPU);
 
 	gen7_emit_state_base_address(batch);
-	gen7_emit_vfe_state(batch, THREADS, GEN7_GPGPU_URB_ENTRIES,
+	gen7_emit_vfe_state(batch, vfe_threads(threads), GEN7_GPGPU_URB_ENTRIES,
 			    GPGPU_URB_SIZE, GPGPU_CURBE_SIZE,
 			    GEN7_VFE_STATE_GPGPU_MODE);
 	gen7_emit_curbe_load(batch, curbe_buffer);
@@ -165,13 +125,14 @@ gen7_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 	intel_batchbuffer_reset(batch);
 }
 
-void
-gen8_gpgpu_fillfunc(struct intel_batchbuffer *batch,
-		    const struct igt_buf *dst,
-		    unsigned int x, unsigned int y,
-		    unsigned int width, unsigned int height,
-		    uint8_t color)
+static void
+__gen8_gpgpu_fillfunc(struct intel_batchbuffer *batch,
+		      const struct igt_buf *dst,
+		      unsigned int x, unsigned int y,
+		      unsigned int width, unsigned int height,
+		      uint8_t color, unsigned int threads)
 {
+	const struct gpu_shader *kernel;
 	uint32_t curbe_buffer, interface_descriptor;
 	uint32_t batch_end;
 
@@ -187,8 +148,9 @@ gen8_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 	 */
 	curbe_buffer = gen7_fill_curbe_buffer_data(batch, color);
 
+	kernel = gpu_shader_lookup(batch->devid, GPU_SHADER_GPGPU_FILL);
 	interface_descriptor = gen8_fill_interface_descriptor(batch, dst,
-				gen8_gpgpu_kernel, sizeof(gen8_gpgpu_kernel));
+				kernel->code, kernel->size);
 
 	igt_assert(batch->ptr < &batch->buffer[4095]);
 
@@ -198,7 +160,7 @@ gen8_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 	OUT_BATCH(GEN7_PIPELINE_SELECT | PIPELINE_SELECT_GPGPU);
 
 	gen8_emit_state_base_address(batch);
-	gen8_emit_vfe_state(batch, THREADS, GEN8_GPGPU_URB_ENTRIES,
+	gen8_emit_vfe_state(batch, vfe_threads(threads), GEN8_GPGPU_URB_ENTRIES,
 			    GPGPU_URB_SIZE, GPGPU_CURBE_SIZE);
 	gen7_emit_curbe_load(batch, curbe_buffer);
 	gen7_emit_interface_descriptor_load(batch, interface_descriptor);
@@ -213,14 +175,54 @@ gen8_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 	intel_batchbuffer_reset(batch);
 }
 
+void
+gen7_gpgpu_fillfunc(struct intel_batchbuffer *batch,
+		    const struct igt_buf *dst,
+		    unsigned int x, unsigned int y,
+		    unsigned int width, unsigned int height,
+		    uint8_t color)
+{
+	__gen7_gpgpu_fillfunc(batch, dst, x, y, width, height, color, 0);
+}
+
+void
+gen7_gpgpu_threaded_fillfunc(struct intel_batchbuffer *batch,
+			     const struct igt_buf *dst,
+			     unsigned int x, unsigned int y,
+			     unsigned int width, unsigned int height,
+			     uint8_t color, unsigned int threads)
+{
+	__gen7_gpgpu_fillfunc(batch, dst, x, y, width, height, color, threads);
+}
+
+void
+gen8_gpgpu_fillfunc(struct intel_batchbuffer *batch,
+		    const struct igt_buf *dst,
+		    unsigned int x, unsigned int y,
+		    unsigned int width, unsigned int height,
+		    uint8_t color)
+{
+	__gen8_gpgpu_fillfunc(batch, dst, x, y, width, height, color, 0);
+}
+
+void
+gen8_gpgpu_threaded_fillfunc(struct intel_batchbuffer *batch,
+			     const struct igt_buf *dst,
+			     unsigned int x, unsigned int y,
+			     unsigned int width, unsigned int height,
+			     uint8_t color, unsigned int threads)
+{
+	__gen8_gpgpu_fillfunc(batch, dst, x, y, width, height, color, threads);
+}
+
 static void
 __gen9_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 		      const struct igt_buf *dst,
 		      unsigned int x, unsigned int y,
 		      unsigned int width, unsigned int height,
-		      uint8_t color, const uint32_t kernel[][4],
-		      size_t kernel_size)
+		      uint8_t color, unsigned int threads)
 {
+	const struct gpu_shader *kernel;
 	uint32_t curbe_buffer, interface_descriptor;
 	uint32_t batch_end;
 
@@ -236,8 +238,9 @@ __gen9_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 	 */
 	curbe_buffer = gen7_fill_curbe_buffer_data(batch, color);
 
+	kernel = gpu_shader_lookup(batch->devid, GPU_SHADER_GPGPU_FILL);
 	interface_descriptor = gen8_fill_interface_descriptor(batch, dst,
-				kernel, kernel_size);
+				kernel->code, kernel->size);
 
 	igt_assert(batch->ptr < &batch->buffer[4095]);
 
@@ -248,7 +251,7 @@ __gen9_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 		  PIPELINE_SELECT_GPGPU);
 
 	gen9_emit_state_base_address(batch);
-	gen8_emit_vfe_state(batch, THREADS, GEN8_GPGPU_URB_ENTRIES,
+	gen8_emit_vfe_state(batch, vfe_threads(threads), GEN8_GPGPU_URB_ENTRIES,
 			    GPGPU_URB_SIZE, GPGPU_CURBE_SIZE);
 	gen7_emit_curbe_load(batch, curbe_buffer);
 	gen7_emit_interface_descriptor_load(batch, interface_descriptor);
@@ -269,8 +272,16 @@ void gen9_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 			 unsigned int width, unsigned int height,
 			 uint8_t color)
 {
-	__gen9_gpgpu_fillfunc(batch, dst, x, y, width, height, color,
-			      gen9_gpgpu_kernel, sizeof(gen9_gpgpu_kernel));
+	__gen9_gpgpu_fillfunc(batch, dst, x, y, width, height, color, 0);
+}
+
+void gen9_gpgpu_threaded_fillfunc(struct intel_batchbuffer *batch,
+				  const struct igt_buf *dst,
+				  unsigned int x, unsigned int y,
+				  unsigned int width, unsigned int height,
+				  uint8_t color, unsigned int threads)
+{
+	__gen9_gpgpu_fillfunc(batch, dst, x, y, width, height, color, threads);
 }
 
 void gen11_gpgpu_fillfunc(struct intel_batchbuffer *batch,
@@ -279,6 +290,14 @@ void gen11_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 			  unsigned int width, unsigned int height,
 			  uint8_t color)
 {
-	__gen9_gpgpu_fillfunc(batch, dst, x, y, width, height, color,
-			      gen11_gpgpu_kernel, sizeof(gen11_gpgpu_kernel));
+	__gen9_gpgpu_fillfunc(batch, dst, x, y, width, height, color, 0);
+}
+
+void gen11_gpgpu_threaded_fillfunc(struct intel_batchbuffer *batch,
+				   const struct igt_buf *dst,
+				   unsigned int x, unsigned int y,
+				   unsigned int width, unsigned int height,
+				   uint8_t color, unsigned int threads)
+{
+	__gen9_gpgpu_fillfunc(batch, dst, x, y, width, height, color, threads);
 }
@@ -36,6 +36,13 @@ gen7_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 		    unsigned int width, unsigned int height,
 		    uint8_t color);
 
+void
+gen7_gpgpu_threaded_fillfunc(struct intel_batchbuffer *batch,
+			     const struct igt_buf *dst,
+			     unsigned int x, unsigned int y,
+			     unsigned int width, unsigned int height,
+			     uint8_t color, unsigned int threads);
+
 void
 gen8_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 		    const struct igt_buf *dst,
@@ -43,6 +50,13 @@ gen8_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 		    unsigned int width, unsigned int height,
 		    uint8_t color);
 
+void
+gen8_gpgpu_threaded_fillfunc(struct intel_batchbuffer *batch,
+			     const struct igt_buf *dst,
+			     unsigned int x, unsigned int y,
+			     unsigned int width, unsigned int height,
+			     uint8_t color, unsigned int threads);
+
 void
 gen9_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 		    const struct igt_buf *dst,
@@ -50,6 +64,13 @@ gen9_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 		    unsigned int width, unsigned int height,
 		    uint8_t color);
 
+void
+gen9_gpgpu_threaded_fillfunc(struct intel_batchbuffer *batch,
+			     const struct igt_buf *dst,
+			     unsigned int x, unsigned int y,
+			     unsigned int width, unsigned int height,
+			     uint8_t color, unsigned int threads);
+
 void
 gen11_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 		     const struct igt_buf *dst,
@@ -57,4 +78,11 @@ gen11_gpgpu_fillfunc(struct intel_batchbuffer *batch,
 		     unsigned int width, unsigned int height,
 		     uint8_t color);
 
+void
+gen11_gpgpu_threaded_fillfunc(struct intel_batchbuffer *batch,
+			      const struct igt_buf *dst,
+			      unsigned int x, unsigned int y,
+			      unsigned int width, unsigned int height,
+			      uint8_t color, unsigned int threads);
+
 #endif /* GPGPU_FILL_H */
@@ -247,54 +247,33 @@ gen7_emit_vfe_state(struct intel_batchbuffer *batch, uint32_t threads,
 		    uint32_t urb_entries, uint32_t urb_size,
 		    uint32_t curbe_size, uint32_t mode)
 {
-	OUT_BATCH(GEN7_MEDIA_VFE_STATE | (8 - 2));
-
-	/* scratch buffer */
-	OUT_BATCH(0);
-
-	/* number of threads & urb entries */
-	OUT_BATCH(threads << 16 |
-		urb_entries << 8 |
-		mode << 2); /* GPGPU vs media mode */
-
-	OUT_BATCH(0);
-
-	/* urb entry size & curbe size */
-	OUT_BATCH(urb_size << 16 |	/* in 256 bits unit */
-		  curbe_size);		/* in 256 bits unit */
-
-	/* scoreboard */
-	OUT_BATCH(0);
-	OUT_BATCH(0);
-	OUT_BATCH(0);
+	gen_emit(batch, gen7_media_vfe_state,
+		 .max_threads = threads,
+		 .urb_entries = urb_entries,
+		 .gpgpu_mode = mode,
+		 .urb_entry_size = urb_size,
+		 .curbe_size = curbe_size);
 }
 
 void
 gen7_emit_curbe_load(struct intel_batchbuffer *batch, uint32_t curbe_buffer)
 {
-	OUT_BATCH(GEN7_MEDIA_CURBE_LOAD | (4 - 2));
-	OUT_BATCH(0);
-	/* curbe total data length */
-	OUT_BATCH(64);
-	/* curbe data start address, is relative to the dynamics base address */
-	OUT_BATCH(curbe_buffer);
+	gen_emit(batch, gen7_media_curbe_load,
+		 .total_length = 64,
+		 .start_address = curbe_buffer);
 }
 
 void
 gen7_emit_interface_descriptor_load(struct intel_batchbuffer *batch,
 				    uint32_t interface_descriptor)
 {
-	OUT_BATCH(GEN7_MEDIA_INTERFACE_DESCRIPTOR_LOAD | (4 - 2));
-	OUT_BATCH(0);
-	/* interface descriptor data length */
-	if (IS_GEN7(batch->devid))
-		OUT_BATCH(sizeof(struct gen7_interface_descriptor_data));
-	else
-		OUT_BATCH(sizeof(struct gen8_interface_descriptor_data));
-	/* interface descriptor address, is relative to the dynamics base
-	 * address
-	 */
-	OUT_BATCH(interface_descriptor);
+	uint32_t length = IS_GEN7(batch->devid) ?
+		sizeof(struct gen7_interface_descriptor_data) :
+		sizeof(struct gen8_interface_descriptor_data);
+
+	gen_emit(batch, gen7_media_interface_descriptor_load,
+		 .total_length = length,
+		 .start_address = interface_descriptor);
 }
 
 void
@@ -302,11 +281,24 @@ gen7_emit_media_objects(struct intel_batchbuffer *batch,
 			unsigned int x, unsigned int y,
 			unsigned int width, unsigned int height)
 {
-	int i, j;
+	bool flush = AT_LEAST_GEN(batch->devid, 8) &&
+		     !IS_CHERRYVIEW(batch->devid);
+	unsigned int count = (width / 16) * (height / 16);
+	unsigned int i, j;
+	uint32_t *dw;
+
+	/* Reserve the space for all the objects, packed straight into it */
+	dw = intel_batchbuffer_emit_dwords(batch,
+					   count * (gen7_media_object_length +
+						    flush * gen8_media_state_flush_length));
 
 	for (i = 0; i < width / 16; i++) {
 		for (j = 0; j < height / 16; j++) {
-			gen_emit_media_object(batch, x + i * 16, y + j * 16);
+			dw = gen7_media_object_pack(dw, &(struct gen7_media_object) {
+				.inline_data = { x + i * 16, y + j * 16 },
+			});
+			if (flush)
+				dw = gen8_media_state_flush_pack(dw, &(struct gen8_media_state_flush) {});
 		}
 	}
 }
@@ -338,34 +330,14 @@ gen7_emit_gpgpu_walk(struct intel_batchbuffer *batch,
 	else
 		right_mask = (1 << tmp) - 1;
 
-	OUT_BATCH(GEN7_GPGPU_WALKER | 9);
-
-	/* interface descriptor offset */
-	OUT_BATCH(0);
-
-	/* SIMD size, thread w/h/d */
-	OUT_BATCH(1 << 30 | /* SIMD16 */
-		  0 << 16 | /* depth:1 */
-		  0 << 8 | /* height:1 */
-		  0); /* width:1 */
-
-	/* thread group X */
-	OUT_BATCH(0);
-	OUT_BATCH(x_dim);
-
-	/* thread group Y */
-	OUT_BATCH(0);
-	OUT_BATCH(y_dim);
-
-	/* thread group Z */
-	OUT_BATCH(0);
-	OUT_BATCH(1);
-
-	/* right mask */
-	OUT_BATCH(right_mask);
-
 	/* bottom mask, height 1, always 0xffffffff */
-	OUT_BATCH(0xffffffff);
+	gen_emit(batch, gen7_gpgpu_walker,
+		 .simd_size = GEN7_GPGPU_SIMD16,
+		 .group_x_dim = x_dim,
+		 .group_y_dim = y_dim,
+		 .group_z_dim = 1,
+		 .right_mask = right_mask,
+		 .bottom_mask = 0xffffffff);
 }
 
 uint32_t
@@ -610,8 +582,7 @@ gen8_emit_state_base_address(struct intel_batchbuffer *batch)
 void
 gen8_emit_media_state_flush(struct intel_batchbuffer *batch)
 {
-	OUT_BATCH(GEN8_MEDIA_STATE_FLUSH | (2 - 2));
-	OUT_BATCH(0);
+	gen_emit(batch, gen8_media_state_flush);
 }
 
 void
@@ -619,26 +590,11 @@ gen8_emit_vfe_state(struct intel_batchbuffer *batch, uint32_t threads,
 		    uint32_t urb_entries, uint32_t urb_size,
 		    uint32_t curbe_size)
 {
-	OUT_BATCH(GEN7_MEDIA_VFE_STATE | (9 - 2));
-
-	/* scratch buffer */
-	OUT_BATCH(0);
-	OUT_BATCH(0);
-
-	/* number of threads & urb entries */
-	OUT_BATCH(threads << 16 |
-		urb_entries << 8);
-
-	OUT_BATCH(0);
-
-	/* urb entry size & curbe size */
-	OUT_BATCH(urb_size << 16 |
-		curbe_size);
-
-	/* scoreboard */
-	OUT_BATCH(0);
-	OUT_BATCH(0);
-	OUT_BATCH(0);
+	gen_emit(batch, gen8_media_vfe_state,
+		 .max_threads = threads,
+		 .urb_entries = urb_entries,
+		 .urb_entry_size = urb_size,
+		 .curbe_size = curbe_size);
 }
 
 void
@@ -668,59 +624,23 @@ gen8_emit_gpgpu_walk(struct intel_batchbuffer *batch,
 	else
 		right_mask = (1 << tmp) - 1;
 
-	OUT_BATCH(GEN7_GPGPU_WALKER | 13);
-
-	OUT_BATCH(0); /* kernel offset */
-	OUT_BATCH(0); /* indirect data length */
-	OUT_BATCH(0); /* indirect data offset */
-
-	/* SIMD size, thread w/h/d */
-	OUT_BATCH(1 << 30 | /* SIMD16 */
-		  0 << 16 | /* depth:1 */
-		  0 << 8 | /* height:1 */
-		  0); /* width:1 */
-
-	/* thread group X */
-	OUT_BATCH(0);
-	OUT_BATCH(0);
-	OUT_BATCH(x_dim);
-
-	/* thread group Y */
-	OUT_BATCH(0);
-	OUT_BATCH(0);
-	OUT_BATCH(y_dim);
-
-	/* thread group Z */
-	OUT_BATCH(0);
-	OUT_BATCH(1);
-
-	/* right mask */
-	OUT_BATCH(right_mask);
-
 	/* bottom mask, height 1, always 0xffffffff */
-	OUT_BATCH(0xffffffff);
+	gen_emit(batch, gen8_gpgpu_walker,
+		 .simd_size = GEN7_GPGPU_SIMD16,
+		 .group_x_dim = x_dim,
+		 .group_y_dim = y_dim,
+		 .group_z_dim = 1,
+		 .right_mask = right_mask,
+		 .bottom_mask = 0xffffffff);
 }
 
 void
 gen_emit_media_object(struct intel_batchbuffer *batch,
 		       unsigned int xoffset, unsigned int yoffset)
 {
-	OUT_BATCH(GEN7_MEDIA_OBJECT | (8 - 2));
-
-	/* interface descriptor offset */
-	OUT_BATCH(0);
-
-	/* without indirect data */
-	OUT_BATCH(0);
-	OUT_BATCH(0);
-
-	/* scoreboard */
-	OUT_BATCH(0);
-	OUT_BATCH(0);
-
 	/* inline data (xoffset, yoffset) */
-	OUT_BATCH(xoffset);
-	OUT_BATCH(yoffset);
+	gen_emit(batch, gen7_media_object,
+		 .inline_data = { xoffset, yoffset });
 	if (AT_LEAST_GEN(batch->devid, 8) && !IS_CHERRYVIEW(batch->devid))
 		gen8_emit_media_state_flush(batch);
 }
@@ -0,0 +1,433 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "drmtest.h"
+#include "gpu_shaders.h"
+#include "intel_chipset.h"
+
+/*
+ * The assembled kernels of the render copy and of the media and gpgpu
+ * pipelines, with the gens they are for. Their sources are under
+ * lib/i915/shaders; the hex arrays are the output of intel-gen4asm, or of
+ * IGA followed by lib/i915/shaders/converter.py, and adding a kernel for a
+ * new gen only takes adding its array and its line in the table below.
+ */
+
+static const uint32_t gen4_render_sf_kernel[][4] = {
+	{ 0x00400031, 0x20c01fbd, 0x0069002c, 0x01110001 },
+	{ 0x00600001, 0x206003be, 0x00690060, 0x00000000 },
+	{ 0x00600040, 0x20e077bd, 0x00690080, 0x006940a0 },
+	{ 0x00600041, 0x202077be, 0x008d00e0, 0x000000c0 },
+	{ 0x00600040, 0x20e077bd, 0x006900a0, 0x00694060 },
+	{ 0x00600041, 0x204077be, 0x008d00e0, 0x000000c8 },
+	{ 0x00600031, 0x20001fbc, 0x008d0000, 0x8640c800 },
+};
+
+static const uint32_t gen5_render_sf_kernel[][4] = {
+	{ 0x00400031, 0x20c01fbd, 0x1069002c, 0x02100001 },
+	{ 0x00600001, 0x206003be, 0x00690060, 0x00000000 },
+	{ 0x00600040, 0x20e077bd, 0x00690080, 0x006940a0 },
+	{ 0x00600041, 0x202077be, 0x008d00e0, 0x000000c0 },
+	{ 0x00600040, 0x20e077bd, 0x006900a0, 0x00694060 },
+	{ 0x00600041, 0x204077be, 0x008d00e0, 0x000000c8 },
+	{ 0x00600031, 0x20001fbc, 0x648d0000, 0x8808c800 },
+};
+
+static const uint32_t gen4_render_ps_kernel[][4] = {
+	{ 0x00800040, 0x23c06d29, 0x00480028, 0x10101010 },
+	{ 0x00800040, 0x23806d29, 0x0048002a, 0x11001100 },
+	{ 0x00802040, 0x2100753d, 0x008d03c0, 0x00004020 },
+	{ 0x00802040, 0x2140753d, 0x008d0380, 0x00004024 },
+	{ 0x00802059, 0x200077bc, 0x00000060, 0x008d0100 },
+	{ 0x00802048, 0x204077be, 0x00000064, 0x008d0140 },
+	{ 0x00802059, 0x200077bc, 0x00000070, 0x008d0100 },
+	{ 0x00802048, 0x208077be, 0x00000074, 0x008d0140 },
+	{ 0x00600201, 0x20200022, 0x008d0000, 0x00000000 },
+	{ 0x00000201, 0x20280062, 0x00000000, 0x00000000 },
+	{ 0x01800031, 0x21801d09, 0x008d0000, 0x02580001 },
+	{ 0x00600001, 0x204003be, 0x008d0180, 0x00000000 },
+	{ 0x00601001, 0x20c003be, 0x008d01a0, 0x00000000 },
+	{ 0x00600001, 0x206003be, 0x008d01c0, 0x00000000 },
+	{ 0x00601001, 0x20e003be, 0x008d01e0, 0x00000000 },
+	{ 0x00600001, 0x208003be, 0x008d0200, 0x00000000 },
+	{ 0x00601001, 0x210003be, 0x008d0220, 0x00000000 },
+	{ 0x00600001, 0x20a003be, 0x008d0240, 0x00000000 },
+	{ 0x00601001, 0x212003be, 0x008d0260, 0x00000000 },
+	{ 0x00600201, 0x202003be, 0x008d0020, 0x00000000 },
+	{ 0x00800031, 0x20001d28, 0x008d0000, 0x85a04800 },
+};
+
+static const uint32_t gen5_render_ps_kernel[][4] = {
+	{ 0x00800040, 0x23c06d29, 0x00480028, 0x10101010 },
+	{ 0x00800040, 0x23806d29, 0x0048002a, 0x11001100 },
+	{ 0x00802040, 0x2100753d, 0x008d03c0, 0x00004020 },
+	{ 0x00802040, 0x2140753d, 0x008d0380, 0x00004024 },
+	{ 0x00802059, 0x200077bc, 0x00000060, 0x008d0100 },
+	{ 0x00802048, 0x204077be, 0x00000064, 0x008d0140 },
+	{ 0x00802059, 0x200077bc, 0x00000070, 0x008d0100 },
+	{ 0x00802048, 0x208077be, 0x00000074, 0x008d0140 },
+	{ 0x01800031, 0x21801fa9, 0x208d0000, 0x0a8a0001 },
+	{ 0x00802001, 0x304003be, 0x008d0180, 0x00000000 },
+	{ 0x00802001, 0x306003be, 0x008d01c0, 0x00000000 },
+	{ 0x00802001, 0x308003be, 0x008d0200, 0x00000000 },
+	{ 0x00802001, 0x30a003be, 0x008d0240, 0x00000000 },
+	{ 0x00600201, 0x202003be, 0x008d0020, 0x00000000 },
+	{ 0x00800031, 0x20001d28, 0x548d0000, 0x94084800 },
+};
+
+static const uint32_t gen6_render_ps_kernel[][4] = {
+	{ 0x0060005a, 0x204077be, 0x000000c0, 0x008d0040 },
+	{ 0x0060005a, 0x206077be, 0x000000c0, 0x008d0080 },
+	{ 0x0060005a, 0x208077be, 0x000000d0, 0x008d0040 },
+	{ 0x0060005a, 0x20a077be, 0x000000d0, 0x008d0080 },
+	{ 0x00000201, 0x20080061, 0x00000000, 0x00000000 },
+	{ 0x00600001, 0x20200022, 0x008d0000, 0x00000000 },
+	{ 0x02800031, 0x21c01cc9, 0x00000020, 0x0a8a0001 },
+	{ 0x00600001, 0x204003be, 0x008d01c0, 0x00000000 },
+	{ 0x00600001, 0x206003be, 0x008d01e0, 0x00000000 },
+	{ 0x00600001, 0x208003be, 0x008d0200, 0x00000000 },
+	{ 0x00600001, 0x20a003be, 0x008d0220, 0x00000000 },
+	{ 0x00600001, 0x20c003be, 0x008d0240, 0x00000000 },
+	{ 0x00600001, 0x20e003be, 0x008d0260, 0x00000000 },
+	{ 0x00600001, 0x210003be, 0x008d0280, 0x00000000 },
+	{ 0x00600001, 0x212003be, 0x008d02a0, 0x00000000 },
+	{ 0x05800031, 0x24001cc8, 0x00000040, 0x90019000 },
+	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
+	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
+	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
+	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
+	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
+	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
+	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
+	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
+};
+
+static const uint32_t gen7_render_ps_kernel[][4] = {
+	{ 0x0080005a, 0x2e2077bd, 0x000000c0, 0x008d0040 },
+	{ 0x0080005a, 0x2e6077bd, 0x000000d0, 0x008d0040 },
+	{ 0x02800031, 0x21801fa9, 0x008d0e20, 0x08840001 },
+	{ 0x00800001, 0x2e2003bd, 0x008d0180, 0x00000000 },
+	{ 0x00800001, 0x2e6003bd, 0x008d01c0, 0x00000000 },
+	{ 0x00800001, 0x2ea003bd, 0x008d0200, 0x00000000 },
+	{ 0x00800001, 0x2ee003bd, 0x008d0240, 0x00000000 },
+	{ 0x05800031, 0x20001fa8, 0x008d0e20, 0x90031000 },
+};
+
+/* see lib/i915/shaders/ps/blit.g7a */
+static const uint32_t gen8_render_ps_kernel[][4] = {
+#if 1
+   { 0x0080005a, 0x2f403ae8, 0x3a0000c0, 0x008d0040 },
+   { 0x0080005a, 0x2f803ae8, 0x3a0000d0, 0x008d0040 },
+   { 0x02800031, 0x2e203a48, 0x0e8d0f40, 0x08840001 },
+   { 0x05800031, 0x20003a40, 0x0e8d0e20, 0x90031000 },
+#else
+   /* Write all -1 */
+   { 0x00600001, 0x2e000608, 0x00000000, 0x3f800000 },
+   { 0x00600001, 0x2e200608, 0x00000000, 0x3f800000 },
+   { 0x00600001, 0x2e400608, 0x00000000, 0x3f800000 },
+   { 0x00600001, 0x2e600608, 0x00000000, 0x3f800000 },
+   { 0x00600001, 0x2e800608, 0x00000000, 0x3f800000 },
+   { 0x00600001, 0x2ea00608, 0x00000000, 0x3f800000 },
+   { 0x00600001, 0x2ec00608, 0x00000000, 0x3f800000 },
+   { 0x00600001, 0x2ee00608, 0x00000000, 0x3f800000 },
+   { 0x05800031, 0x200022e0, 0x0e000e00, 0x90031000 },
+#endif
+};
+
+/* see lib/i915/shaders/ps/blit.g7a */
+static const uint32_t gen9_render_ps_kernel[][4] = {
+#if 1
+	{ 0x0080005a, 0x2f403ae8, 0x3a0000c0, 0x008d0040 },
+	{ 0x0080005a, 0x2f803ae8, 0x3a0000d0, 0x008d0040 },
+	{ 0x02800031, 0x2e203a48, 0x0e8d0f40, 0x08840001 },
+	{ 0x05800031, 0x20003a40, 0x0e8d0e20, 0x90031000 },
+#else
+	/* Write all -1 */
+	{ 0x00600001, 0x2e000608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2e200608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2e400608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2e600608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2e800608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2ea00608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2ec00608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2ee00608, 0x00000000, 0x3f800000 },
+	{ 0x05800031, 0x200022e0, 0x0e000e00, 0x90031000 },
+#endif
+};
+
+/* see lib/i915/shaders/ps/blit.g11a */
+static const uint32_t gen11_render_ps_kernel[][4] = {
+#if 1
+	{ 0x0060005b, 0x2000c01c, 0x07206601, 0x01800404 },
+	{ 0x0060005b, 0x7100480c, 0x0722003b, 0x01880406 },
+	{ 0x0060005b, 0x2000c01c, 0x07206601, 0x01800408 },
+	{ 0x0060005b, 0x7200480c, 0x0722003b, 0x0188040a },
+	{ 0x0060005b, 0x2000c01c, 0x07206e01, 0x01a00404 },
+	{ 0x0060005b, 0x7300480c, 0x0722003b, 0x01a80406 },
+	{ 0x0060005b, 0x2000c01c, 0x07206e01, 0x01a00408 },
+	{ 0x0060005b, 0x7400480c, 0x0722003b, 0x01a8040a },
+	{ 0x02800031, 0x21804a4c, 0x06000e20, 0x08840001 },
+	{ 0x00800001, 0x2e204b28, 0x008d0180, 0x00000000 },
+	{ 0x00800001, 0x2e604b28, 0x008d01c0, 0x00000000 },
+	{ 0x00800001, 0x2ea04b28, 0x008d0200, 0x00000000 },
+	{ 0x00800001, 0x2ee04b28, 0x008d0240, 0x00000000 },
+	{ 0x05800031, 0x20004a44, 0x06000e20, 0x90031000 },
+#else
+	/* Write all -1 */
+	{ 0x00600001, 0x2e000608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2e200608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2e400608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2e600608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2e800608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2ea00608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2ec00608, 0x00000000, 0x3f800000 },
+	{ 0x00600001, 0x2ee00608, 0x00000000, 0x3f800000 },
+	{ 0x05800031, 0x200022e0, 0x0e000e00, 0x90031000 },
+#endif
+};
+
+static const uint32_t gen7_media_fill_kernel[][4] = {
+	{ 0x00400001, 0x20200231, 0x00000020, 0x00000000 },
+	{ 0x00600001, 0x20800021, 0x008d0000, 0x00000000 },
+	{ 0x00200001, 0x20800021, 0x00450040, 0x00000000 },
+	{ 0x00000001, 0x20880061, 0x00000000, 0x000f000f },
+	{ 0x00800001, 0x20a00021, 0x00000020, 0x00000000 },
+	{ 0x00800001, 0x20e00021, 0x00000020, 0x00000000 },
+	{ 0x00800001, 0x21200021, 0x00000020, 0x00000000 },
+	{ 0x00800001, 0x21600021, 0x00000020, 0x00000000 },
+	{ 0x05800031, 0x24001ca8, 0x00000080, 0x120a8000 },
+	{ 0x00600001, 0x2e000021, 0x008d0000, 0x00000000 },
+	{ 0x07800031, 0x20001ca8, 0x00000e00, 0x82000010 },
+};
+
+static const uint32_t gen8_media_fill_kernel[][4] = {
+	{ 0x00400001, 0x20202288, 0x00000020, 0x00000000 },
+	{ 0x00600001, 0x20800208, 0x008d0000, 0x00000000 },
+	{ 0x00200001, 0x20800208, 0x00450040, 0x00000000 },
+	{ 0x00000001, 0x20880608, 0x00000000, 0x000f000f },
+	{ 0x00800001, 0x20a00208, 0x00000020, 0x00000000 },
+	{ 0x00800001, 0x20e00208, 0x00000020, 0x00000000 },
+	{ 0x00800001, 0x21200208, 0x00000020, 0x00000000 },
+	{ 0x00800001, 0x21600208, 0x00000020, 0x00000000 },
+	{ 0x0c800031, 0x24000a40, 0x0e000080, 0x120a8000 },
+	{ 0x00600001, 0x2e000208, 0x008d0000, 0x00000000 },
+	{ 0x07800031, 0x20000a40, 0x0e000e00, 0x82000010 },
+};
+
+static const uint32_t gen11_media_vme_kernel[][4] = {
+	{ 0x00600001, 0x20302e68,  0x00000000,  0x20000000 },
+	{ 0x00600001, 0x22802e68,  0x00000000,  0x00000001 },
+	{ 0x00000001, 0x20284f2c,  0x00000000,  0x3818000c },
+	{ 0x00600001, 0x22902e68,  0x00000000,  0x00000010 },
+	{ 0x00600001, 0x22a02e68,  0x00000000,  0x00010000 },
+	{ 0x00000001, 0x202c4f2c,  0x00000000,  0x22222222 },
+	{ 0x00000040, 0x22000a20,  0x0e000020,  0x10782000 },
+	{ 0x00600001, 0x20404f28,  0x00000000,  0x00000000 },
+	{ 0x00600001, 0x20a04f28,  0x00000000,  0x00000000 },
+	{ 0x00600001, 0x20c04f28,  0x00000000,  0x00000000 },
+	{ 0x00600001, 0x21204f28,  0x00000000,  0x00000000 },
+	{ 0x00600001, 0x20601a28,  0x008d0030,  0x00000000 },
+	{ 0x00600041, 0x20800a28,  0x1a000028,  0x008d0280 },
+	{ 0x00600041, 0x20e01a28,  0x1e8d0290,  0x01000100 },
+	{ 0x00600041, 0x21000a28,  0x1a00002c,  0x008d02a0 },
+	{ 0x00000001, 0x22284f2c,  0x00000000,  0x00000000 },
+	{ 0x0d80c031, 0x21404a48,  0x00000040,  0x00000200 },
+	{ 0x00000001, 0x215c4708,  0x00000000,  0xbeefbeef },
+	{ 0x00000040, 0x22000204,  0x06000024,  0x020a0400 },
+	{ 0x00000001, 0x215e4708,  0x00000000,  0xdeaddead },
+	{ 0x00000001, 0x22484f2c,  0x00000000,  0x00000008 },
+	{ 0x00000001, 0x22684f2c,  0x00000000,  0x0000000c },
+	{ 0x00600001, 0x2fe04b2c,  0x008d0000,  0x00000000 },
+	{ 0x0a800033, 0x0000a054,  0x00002224,  0x00000000 },
+	{ 0x00000040, 0x22000204,  0x06000024,  0x020a0300 },
+	{ 0x0a800033, 0x0000e054,  0x00002242,  0x00000000 },
+	{ 0x00000040, 0x22000204,  0x06000024,  0x020a0200 },
+	{ 0x0a600033, 0x00010014,  0x00002261,  0x00000000 },
+	{ 0x07600031, 0x20004a04,  0x06000fe0,  0x82000010 },
+	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
+	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
+	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
+	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
+	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
+	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
+	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
+	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
+};
+
+/* lib/i915/shaders/gpgpu/gpgpu_fill.gxa */
+static const uint32_t gen7_gpgpu_fill_kernel[][4] = {
+	{ 0x00400001, 0x20200231, 0x00000020, 0x00000000 },
+	{ 0x00000041, 0x20400c21, 0x00000004, 0x00000010 },
+	{ 0x00000001, 0x20440021, 0x00000018, 0x00000000 },
+	{ 0x00600001, 0x20800021, 0x008d0000, 0x00000000 },
+	{ 0x00200001, 0x20800021, 0x00450040, 0x00000000 },
+	{ 0x00000001, 0x20880061, 0x00000000, 0x0000000f },
+	{ 0x00800001, 0x20a00021, 0x00000020, 0x00000000 },
+	{ 0x05800031, 0x24001ca8, 0x00000080, 0x060a8000 },
+	{ 0x00600001, 0x2e000021, 0x008d0000, 0x00000000 },
+	{ 0x07800031, 0x20001ca8, 0x00000e00, 0x82000010 },
+};
+
+static const uint32_t gen8_gpgpu_fill_kernel[][4] = {
+	{ 0x00400001, 0x20202288, 0x00000020, 0x00000000 },
+	{ 0x00000041, 0x20400208, 0x06000004, 0x00000010 },
+	{ 0x00000001, 0x20440208, 0x00000018, 0x00000000 },
+	{ 0x00600001, 0x20800208, 0x008d0000, 0x00000000 },
+	{ 0x00200001, 0x20800208, 0x00450040, 0x00000000 },
+	{ 0x00000001, 0x20880608, 0x00000000, 0x0000000f },
+	{ 0x00800001, 0x20a00208, 0x00000020, 0x00000000 },
+	{ 0x0c800031, 0x24000a40, 0x0e000080, 0x060a8000 },
+	{ 0x00600001, 0x2e000208, 0x008d0000, 0x00000000 },
+	{ 0x07800031, 0x20000a40, 0x0e000e00, 0x82000010 },
+};
+
+static const uint32_t gen9_gpgpu_fill_kernel[][4] = {
+	{ 0x00400001, 0x20202288, 0x00000020, 0x00000000 },
+	{ 0x00000041, 0x20400208, 0x06000004, 0x00000010 },
+	{ 0x00000001, 0x20440208, 0x00000018, 0x00000000 },
+	{ 0x00600001, 0x20800208, 0x008d0000, 0x00000000 },
+	{ 0x00200001, 0x20800208, 0x00450040, 0x00000000 },
+	{ 0x00000001, 0x20880608, 0x00000000, 0x0000000f },
+	{ 0x00800001, 0x20a00208, 0x00000020, 0x00000000 },
+	{ 0x0c800031, 0x24000a40, 0x06000080, 0x060a8000 },
+	{ 0x00600001, 0x2e000208, 0x008d0000, 0x00000000 },
+	{ 0x07800031, 0x20000a40, 0x06000e00, 0x82000010 },
+};
+
+static const uint32_t gen11_gpgpu_fill_kernel[][4] = {
+	{ 0x00400001, 0x20202288, 0x00000020, 0x00000000 },
+	{ 0x00000009, 0x20400208, 0x06000004, 0x00000004 },
+	{ 0x00000001, 0x20440208, 0x00000018, 0x00000000 },
+	{ 0x00600001, 0x20800208, 0x008d0000, 0x00000000 },
+	{ 0x00200001, 0x20800208, 0x00450040, 0x00000000 },
+	{ 0x00000001, 0x20880608, 0x00000000, 0x0000000f },
+	{ 0x00800001, 0x20a00208, 0x00000020, 0x00000000 },
+	{ 0x0c800031, 0x24000a40, 0x06000080, 0x040a8000 },
+	{ 0x00600001, 0x2e000208, 0x008d0000, 0x00000000 },
+	{ 0x07800031, 0x20000a40, 0x06000e00, 0x82000010 },
+};
+
+static const uint32_t gen8_media_spin_kernel[][4] = {
+	{ 0x00600001, 0x20800208, 0x008d0000, 0x00000000 }, /* mov (8)r4.0<1>:ud r0.0<8;8;1>:ud */
+	{ 0x00200001, 0x20800208, 0x00450040, 0x00000000 }, /* mov (2)r4.0<1>.ud r2.0<2;2;1>:ud */
+	{ 0x00000001, 0x20880608, 0x00000000, 0x00000003 }, /* mov (1)r4.8<1>:ud 0x3 */
+	{ 0x00000001, 0x20a00608, 0x00000000, 0x00000000 }, /* mov (1)r5.0<1>:ud 0 */
+	{ 0x00000040, 0x20a00208, 0x060000a0, 0x00000001 }, /* add (1)r5.0<1>:ud r5.0<0;1;0>:ud 1 */
+	{ 0x01000010, 0x20000200, 0x02000020, 0x000000a0 }, /* cmp.e.f0.0 (1)null<1> r1<0;1;0> r5<0;1;0> */
+	{ 0x00110027, 0x00000000, 0x00000000, 0xffffffe0 }, /* ~f0.0 while (1) -32 */
+	{ 0x0c800031, 0x20000a00, 0x0e000080, 0x040a8000 }, /* send.dcdp1 (16)null<1> r4.0<0;1;0> 0x040a8000 */
+	{ 0x00600001, 0x2e000208, 0x008d0000, 0x00000000 }, /* mov (8)r112<1>:ud r0.0<8;8;1>:ud */
+	{ 0x07800031, 0x20000a40, 0x0e000e00, 0x82000010 }, /* send.ts (16)null<1> r112<0;1;0>:d 0x82000010 */
+};
+
+#define SHADER(t, min, max, k) { \
+	.type = (t), \
+	.gen_min = (min), \
+	.gen_max = (max), \
+	.name = #k, \
+	.code = (k), \
+	.size = sizeof(k), \
+}
+
+static const struct gpu_shader shaders[] = {
+	SHADER(GPU_SHADER_RENDER_SF, 4, 4, gen4_render_sf_kernel),
+	SHADER(GPU_SHADER_RENDER_SF, 5, 5, gen5_render_sf_kernel),
+	SHADER(GPU_SHADER_RENDER_PS, 4, 4, gen4_render_ps_kernel),
+	SHADER(GPU_SHADER_RENDER_PS, 5, 5, gen5_render_ps_kernel),
+	SHADER(GPU_SHADER_RENDER_PS, 6, 6, gen6_render_ps_kernel),
+	SHADER(GPU_SHADER_RENDER_PS, 7, 7, gen7_render_ps_kernel),
+	SHADER(GPU_SHADER_RENDER_PS, 8, 8, gen8_render_ps_kernel),
+	SHADER(GPU_SHADER_RENDER_PS, 9, 10, gen9_render_ps_kernel),
+	SHADER(GPU_SHADER_RENDER_PS, 11, 11, gen11_render_ps_kernel),
+	SHADER(GPU_SHADER_MEDIA_FILL, 7, 7, gen7_media_fill_kernel),
+	SHADER(GPU_SHADER_MEDIA_FILL, 8, 11, gen8_media_fill_kernel),
+	SHADER(GPU_SHADER_MEDIA_VME, 11, 11, gen11_media_vme_kernel),
+	SHADER(GPU_SHADER_MEDIA_SPIN, 8, 9, gen8_media_spin_kernel),
+	SHADER(GPU_SHADER_GPGPU_FILL, 7, 7, gen7_gpgpu_fill_kernel),
+	SHADER(GPU_SHADER_GPGPU_FILL, 8, 8, gen8_gpgpu_fill_kernel),
+	SHADER(GPU_SHADER_GPGPU_FILL, 9, 10, gen9_gpgpu_fill_kernel),
+	SHADER(GPU_SHADER_GPGPU_FILL, 11, 11, gen11_gpgpu_fill_kernel),
+};
+
+/**
+ * __gpu_shader_lookup:
+ * @devid: pci device id
+ * @type: the kind of kernel
+ *
+ * Finds the kernel of @type for the gen of @devid. The kernels of all types
+ * are looked up once for a device and cached, so that the fill and copy
+ * functions calling this for every batch don't walk the table each time.
+ *
+ * Returns: The kernel, or NULL if there is none for the device.
+ */
+const struct gpu_shader *__gpu_shader_lookup(uint32_t devid,
+					     enum gpu_shader_type type)
+{
+	static const struct gpu_shader *cache[GPU_SHADER_TYPE_COUNT];
+	static uint32_t cached_devid = ~0u;
+
+	igt_assert(type < GPU_SHADER_TYPE_COUNT);
+
+	if (cached_devid != devid) {
+		unsigned int gen = intel_gen(devid);
+
+		for (int t = 0; t < GPU_SHADER_TYPE_COUNT; t++) {
+			cache[t] = NULL;
+
+			for (int i = 0; i < ARRAY_SIZE(shaders); i++) {
+				if (shaders[i].type == t &&
+				    gen >= shaders[i].gen_min &&
+				    gen <= shaders[i].gen_max) {
+					cache[t] = &shaders[i];
+					break;
+				}
+			}
+		}
+
+		cached_devid = devid;
+	}
+
+	return cache[type];
+}
+
+/**
+ * gpu_shader_lookup:
+ * @devid: pci device id
+ * @type: the kind of kernel
+ *
+ * Like __gpu_shader_lookup(), but asserting that there is a kernel of @type
+ * for the device.
+ *
+ * Returns: The kernel.
+ */
+const struct gpu_shader *gpu_shader_lookup(uint32_t devid,
+					   enum gpu_shader_type type)
+{
+	const struct gpu_shader *shader = __gpu_shader_lookup(devid, type);
+
+	igt_assert_f(shader, "no kernel of type %d for gen%d\n",
+		     type, intel_gen(devid));
+
+	return shader;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef GPU_SHADERS_H
+#define GPU_SHADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * gpu_shader_type:
+ * @GPU_SHADER_RENDER_SF: strips and fans kernel of the gen4/5 render copy
+ * @GPU_SHADER_RENDER_PS: pixel shader of the render copy
+ * @GPU_SHADER_MEDIA_FILL: media fill kernel
+ * @GPU_SHADER_MEDIA_VME: media VME kernel
+ * @GPU_SHADER_MEDIA_SPIN: media spin kernel
+ * @GPU_SHADER_GPGPU_FILL: gpgpu fill kernel
+ * @GPU_SHADER_TYPE_COUNT: number of shader types
+ */
+enum gpu_shader_type {
+	GPU_SHADER_RENDER_SF,
+	GPU_SHADER_RENDER_PS,
+	GPU_SHADER_MEDIA_FILL,
+	GPU_SHADER_MEDIA_VME,
+	GPU_SHADER_MEDIA_SPIN,
+	GPU_SHADER_GPGPU_FILL,
+	GPU_SHADER_TYPE_COUNT,
+};
+
+/**
+ * gpu_shader:
+ * @type: what the kernel is for
+ * @gen_min: first gen the kernel is for
+ * @gen_max: last gen the kernel is for
+ * @name: name of the kernel, for debugging
+ * @code: the assembled kernel
+ * @size: size of @code in bytes
+ */
+struct gpu_shader {
+	enum gpu_shader_type type;
+	unsigned int gen_min, gen_max;
+	const char *name;
+	const uint32_t (*code)[4];
+	size_t size;
+};
+
+const struct gpu_shader *__gpu_shader_lookup(uint32_t devid,
+					     enum gpu_shader_type type);
+const struct gpu_shader *gpu_shader_lookup(uint32_t devid,
+					   enum gpu_shader_type type);
+
+#endif /* GPU_SHADERS_H */
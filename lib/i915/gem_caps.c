@@ -0,0 +1,316 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "drmtest.h"
+#include "ioctl_wrappers.h"
+
+#include "i915/gem_caps.h"
+#include "i915/gem_engine_topology.h"
+
+/**
+ * SECTION:gem_caps
+ * @short_description: Per-device cache of i915 capabilities
+ * @title: GEM Capabilities
+ *
+ * This helper library remembers the answers to the capability queries made
+ * against each i915 device, so that feature test macros called from every
+ * subtest and igt_require() only reach the kernel once per device. Devices
+ * are told apart by the dev_t of their node, so all the file descriptors open
+ * on the same device share one snapshot, which is filled lazily.
+ *
+ * Parameters that tests can change at runtime, like I915_PARAM_HAS_GPU_RESET
+ * following the reset module parameter, are never cached. Everything is
+ * forgotten with gem_caps_invalidate(), which igt_i915_driver_unload() calls
+ * as a reloaded driver may behave differently.
+ */
+
+#define GEM_CAPS_MAX_PARAM 64
+
+#define SIZEOF_QUERY offsetof(struct drm_i915_query_engine_info, \
+			      engines[GEM_MAX_ENGINES])
+
+struct gem_caps {
+	dev_t dev;
+	struct gem_caps *next;
+
+	struct {
+		bool known;
+		int err;
+		int value;
+	} params[GEM_CAPS_MAX_PARAM];
+
+	struct {
+		bool known;
+		uint64_t value;
+	} facts[GEM_CAPS_FACT_COUNT];
+
+	bool engine_info_known;
+	struct drm_i915_query_engine_info *engine_info;
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	struct gem_caps *devices;
+} caps_cache = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* Called with caps_cache.mutex held */
+static struct gem_caps *caps_lookup(int fd)
+{
+	struct gem_caps *caps;
+	struct stat st;
+
+	if (fstat(fd, &st) || !S_ISCHR(st.st_mode))
+		return NULL;
+
+	for (caps = caps_cache.devices; caps; caps = caps->next)
+		if (caps->dev == st.st_rdev)
+			return caps;
+
+	caps = calloc(1, sizeof(*caps));
+	igt_assert(caps);
+
+	caps->dev = st.st_rdev;
+	caps->next = caps_cache.devices;
+	caps_cache.devices = caps;
+
+	return caps;
+}
+
+static bool param_is_volatile(int param)
+{
+	return param == I915_PARAM_HAS_GPU_RESET;
+}
+
+static int getparam(int fd, int param, int *value)
+{
+	struct drm_i915_getparam gp = {
+		.param = param,
+		.value = value,
+	};
+	int err = 0;
+
+	if (igt_ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp))
+		err = -errno;
+
+	errno = 0;
+	return err;
+}
+
+/**
+ * __gem_caps_getparam:
+ * @fd: open i915 drm file descriptor
+ * @param: the I915_PARAM to query
+ * @value: (out): where to store the value of @param
+ *
+ * Queries @param with GETPARAM, reusing the answer from an earlier query on
+ * the same device. @value is left untouched on failure.
+ *
+ * Returns: 0 on success, the negative error code of the ioctl otherwise
+ */
+int __gem_caps_getparam(int fd, int param, int *value)
+{
+	struct gem_caps *caps;
+	int err, tmp = 0;
+
+	if (param < 0 || param >= GEM_CAPS_MAX_PARAM ||
+	    param_is_volatile(param))
+		return getparam(fd, param, value);
+
+	pthread_mutex_lock(&caps_cache.mutex);
+
+	caps = caps_lookup(fd);
+	if (!caps) {
+		pthread_mutex_unlock(&caps_cache.mutex);
+		return getparam(fd, param, value);
+	}
+
+	if (!caps->params[param].known) {
+		caps->params[param].err = getparam(fd, param, &tmp);
+		caps->params[param].value = tmp;
+		caps->params[param].known = true;
+	}
+
+	err = caps->params[param].err;
+	if (!err)
+		*value = caps->params[param].value;
+
+	pthread_mutex_unlock(&caps_cache.mutex);
+
+	return err;
+}
+
+/**
+ * gem_caps_getparam:
+ * @fd: open i915 drm file descriptor
+ * @param: the I915_PARAM to query
+ *
+ * Cached GETPARAM, see __gem_caps_getparam().
+ *
+ * Returns: the value of @param, 0 if the kernel doesn't know about it
+ */
+int gem_caps_getparam(int fd, int param)
+{
+	int value = 0;
+
+	__gem_caps_getparam(fd, param, &value);
+
+	return value;
+}
+
+/**
+ * gem_caps_get_fact:
+ * @fd: open i915 drm file descriptor
+ * @fact: the fact to look up
+ * @value: (out): where to store the value of @fact
+ *
+ * Returns: whether @fact was already stored for the device behind @fd
+ */
+bool gem_caps_get_fact(int fd, enum gem_caps_fact fact, uint64_t *value)
+{
+	struct gem_caps *caps;
+	bool known = false;
+
+	igt_assert(fact < GEM_CAPS_FACT_COUNT);
+
+	pthread_mutex_lock(&caps_cache.mutex);
+
+	caps = caps_lookup(fd);
+	if (caps && caps->facts[fact].known) {
+		*value = caps->facts[fact].value;
+		known = true;
+	}
+
+	pthread_mutex_unlock(&caps_cache.mutex);
+
+	return known;
+}
+
+/**
+ * gem_caps_set_fact:
+ * @fd: open i915 drm file descriptor
+ * @fact: the fact to store
+ * @value: the value of @fact
+ *
+ * Remembers @value for the device behind @fd, to be returned by
+ * gem_caps_get_fact() from then on.
+ */
+void gem_caps_set_fact(int fd, enum gem_caps_fact fact, uint64_t value)
+{
+	struct gem_caps *caps;
+
+	igt_assert(fact < GEM_CAPS_FACT_COUNT);
+
+	pthread_mutex_lock(&caps_cache.mutex);
+
+	caps = caps_lookup(fd);
+	if (caps) {
+		caps->facts[fact].value = value;
+		caps->facts[fact].known = true;
+	}
+
+	pthread_mutex_unlock(&caps_cache.mutex);
+}
+
+static struct drm_i915_query_engine_info *query_engine_info(int fd)
+{
+	struct drm_i915_query_engine_info *info;
+	struct drm_i915_query_item item = {
+		.query_id = DRM_I915_QUERY_ENGINE_INFO,
+		.length = SIZEOF_QUERY,
+	};
+	struct drm_i915_query query = {
+		.items_ptr = to_user_pointer(&item),
+		.num_items = 1,
+	};
+
+	info = calloc(1, SIZEOF_QUERY);
+	igt_assert(info);
+	item.data_ptr = to_user_pointer(info);
+
+	/* Errors of the item itself are reported in its length */
+	if (igt_ioctl(fd, DRM_IOCTL_I915_QUERY, &query) || item.length < 0) {
+		free(info);
+		info = NULL;
+	}
+
+	errno = 0;
+	return info;
+}
+
+/**
+ * gem_caps_engine_info:
+ * @fd: open i915 drm file descriptor
+ *
+ * Returns: the physical engines of the device, as reported by
+ * DRM_I915_QUERY_ENGINE_INFO, or NULL if the kernel doesn't support the query.
+ * The result stays valid until gem_caps_invalidate() is called.
+ */
+const struct drm_i915_query_engine_info *gem_caps_engine_info(int fd)
+{
+	struct drm_i915_query_engine_info *info;
+	struct gem_caps *caps;
+
+	pthread_mutex_lock(&caps_cache.mutex);
+
+	caps = caps_lookup(fd);
+	if (caps && !caps->engine_info_known) {
+		caps->engine_info = query_engine_info(fd);
+		caps->engine_info_known = true;
+	}
+
+	info = caps ? caps->engine_info : NULL;
+
+	pthread_mutex_unlock(&caps_cache.mutex);
+
+	return info;
+}
+
+/**
+ * gem_caps_invalidate:
+ *
+ * Forgets everything known about all devices, e.g. after reloading the
+ * driver.
+ */
+void gem_caps_invalidate(void)
+{
+	struct gem_caps *caps;
+
+	pthread_mutex_lock(&caps_cache.mutex);
+
+	while ((caps = caps_cache.devices)) {
+		caps_cache.devices = caps->next;
+		free(caps->engine_info);
+		free(caps);
+	}
+
+	pthread_mutex_unlock(&caps_cache.mutex);
+}
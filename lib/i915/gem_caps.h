@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef GEM_CAPS_H
+#define GEM_CAPS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct drm_i915_query_engine_info;
+
+/**
+ * gem_caps_fact:
+ * @GEM_CAPS_DEVID: PCI device id, see intel_get_drm_devid()
+ * @GEM_CAPS_APERTURE_SIZE: size of the GTT, see gem_aperture_size()
+ * @GEM_CAPS_SUBMISSION_METHOD: see gem_submission_method()
+ * @GEM_CAPS_ENGINE_TOPOLOGY: see gem_has_engine_topology()
+ * @GEM_CAPS_MMAP_WC: see gem_mmap__has_wc()
+ * @GEM_CAPS_STATIC_ENGINES: mask of the entries of intel_execution_engines2
+ *			     usable through legacy ring selection
+ * @GEM_CAPS_FACT_COUNT: useful for iterating through everything
+ *
+ * Facts about a device derived from more than a single GETPARAM, which the
+ * helpers computing them store with gem_caps_set_fact().
+ */
+enum gem_caps_fact {
+	GEM_CAPS_DEVID,
+	GEM_CAPS_APERTURE_SIZE,
+	GEM_CAPS_SUBMISSION_METHOD,
+	GEM_CAPS_ENGINE_TOPOLOGY,
+	GEM_CAPS_MMAP_WC,
+	GEM_CAPS_STATIC_ENGINES,
+	GEM_CAPS_FACT_COUNT,
+};
+
+int __gem_caps_getparam(int fd, int param, int *value);
+int gem_caps_getparam(int fd, int param);
+
+bool gem_caps_get_fact(int fd, enum gem_caps_fact fact, uint64_t *value);
+void gem_caps_set_fact(int fd, enum gem_caps_fact fact, uint64_t value);
+
+const struct drm_i915_query_engine_info *gem_caps_engine_info(int fd);
+
+void gem_caps_invalidate(void);
+
+#endif /* GEM_CAPS_H */
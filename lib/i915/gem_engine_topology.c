@@ -22,8 +22,10 @@
  */
 
 #include "drmtest.h"
+#include "intel_chipset.h"
 #include "ioctl_wrappers.h"
 
+#include "i915/gem_caps.h"
 #include "i915/gem_engine_topology.h"
 
 /*
@@ -32,8 +34,6 @@
  */
 #define SIZEOF_CTX_PARAM	offsetof(struct i915_context_param_engines, \
 					 engines[GEM_MAX_ENGINES])
-#define SIZEOF_QUERY		offsetof(struct drm_i915_query_engine_info, \
-					 engines[GEM_MAX_ENGINES])
 
 #define DEFINE_CONTEXT_ENGINES_PARAM(e__, p__, c__, N__) \
 		I915_DEFINE_CONTEXT_PARAM_ENGINES(e__, N__); \
@@ -44,39 +44,6 @@
 			.value = to_user_pointer(&e__), \
 		}
 
-static int __gem_query(int fd, struct drm_i915_query *q)
-{
-	int err = 0;
-
-	if (igt_ioctl(fd, DRM_IOCTL_I915_QUERY, q))
-		err = -errno;
-
-	errno = 0;
-	return err;
-}
-
-static void gem_query(int fd, struct drm_i915_query *q)
-{
-	igt_assert_eq(__gem_query(fd, q), 0);
-}
-
-static void query_engines(int fd,
-			  struct drm_i915_query_engine_info *query_engines,
-			  int length)
-{
-	struct drm_i915_query_item item = { };
-	struct drm_i915_query query = { };
-
-	item.query_id = DRM_I915_QUERY_ENGINE_INFO;
-	query.items_ptr = to_user_pointer(&item);
-	query.num_items = 1;
-	item.length = length;
-
-	item.data_ptr = to_user_pointer(query_engines);
-
-	gem_query(fd, &query);
-}
-
 static void ctx_map_engines(int fd, struct intel_engine_data *ed,
 			    struct drm_i915_gem_context_param *param)
 {
@@ -134,12 +101,11 @@ static void init_engine(struct intel_execution_engine2 *e2,
 
 static void query_engine_list(int fd, struct intel_engine_data *ed)
 {
-	uint8_t buff[SIZEOF_QUERY] = { };
-	struct drm_i915_query_engine_info *query_engine =
-			(struct drm_i915_query_engine_info *) buff;
+	const struct drm_i915_query_engine_info *query_engine =
+			gem_caps_engine_info(fd);
 	int i;
 
-	query_engines(fd, query_engine, SIZEOF_QUERY);
+	igt_assert(query_engine);
 
 	for (i = 0; i < query_engine->num_engines; i++)
 		init_engine(&ed->engines[i],
@@ -207,6 +173,28 @@ static int gem_topology_get_param(int fd,
 	return 0;
 }
 
+/*
+ * Without engine maps the legacy ring selectors are used on any context, so
+ * which of them exist is a device fact that only needs probing once.
+ */
+static uint64_t static_engines_mask(int fd)
+{
+	const struct intel_execution_engine2 *e2;
+	uint64_t mask;
+
+	if (gem_caps_get_fact(fd, GEM_CAPS_STATIC_ENGINES, &mask))
+		return mask;
+
+	mask = 0;
+	__for_each_static_engine(e2)
+		if (gem_has_ring(fd, e2->flags))
+			mask |= 1ull << (e2 - intel_execution_engines2);
+
+	gem_caps_set_fact(fd, GEM_CAPS_STATIC_ENGINES, mask);
+
+	return mask;
+}
+
 struct intel_engine_data intel_init_engine_list(int fd, uint32_t ctx_id)
 {
 	DEFINE_CONTEXT_ENGINES_PARAM(engines, param, ctx_id, GEM_MAX_ENGINES);
@@ -216,9 +204,13 @@ struct intel_engine_data intel_init_engine_list(int fd, uint32_t ctx_id)
 	if (gem_topology_get_param(fd, &param)) {
 		/* if kernel does not support engine/context mapping */
 		const struct intel_execution_engine2 *e2;
+		uint64_t mask = -1;
 
 		igt_debug("using pre-allocated engine list\n");
 
+		if (!igt_only_list_subtests())
+			mask = static_engines_mask(fd);
+
 		__for_each_static_engine(e2) {
 			struct intel_execution_engine2 *__e2 =
 				&engine_data.engines[engine_data.nengines];
@@ -229,8 +221,7 @@ struct intel_engine_data intel_init_engine_list(int fd, uint32_t ctx_id)
 			__e2->flags      = e2->flags;
 			__e2->is_virtual = false;
 
-			if (igt_only_list_subtests() ||
-			    gem_has_ring(fd, e2->flags))
+			if (mask & (1ull << (e2 - intel_execution_engines2)))
 				engine_data.nengines++;
 		}
 		return engine_data;
@@ -286,8 +277,14 @@ bool gem_has_engine_topology(int fd)
 	struct drm_i915_gem_context_param param = {
 		.param = I915_CONTEXT_PARAM_ENGINES,
 	};
+	uint64_t has_topology;
+
+	if (!gem_caps_get_fact(fd, GEM_CAPS_ENGINE_TOPOLOGY, &has_topology)) {
+		has_topology = !__gem_context_get_param(fd, &param);
+		gem_caps_set_fact(fd, GEM_CAPS_ENGINE_TOPOLOGY, has_topology);
+	}
 
-	return !__gem_context_get_param(fd, &param);
+	return has_topology;
 }
 
 struct intel_execution_engine2 gem_eb_flags_to_engine(unsigned int flags)
@@ -337,3 +334,44 @@ bool gem_engine_is_equal(const struct intel_execution_engine2 *e1,
 {
 	return e1->class == e2->class && e1->instance == e2->instance;
 }
+
+/*
+ * Returns the base of the mmio range of the engine, e.g. for addressing its
+ * RING_TIMESTAMP (base + 0x358) or CS_GPR (base + 0x600) registers, or 0 if
+ * not known.
+ */
+uint32_t gem_engine_mmio_base(int fd, int class, int instance)
+{
+	const int gen = intel_gen(intel_get_drm_devid(fd));
+
+	switch (class) {
+	case I915_ENGINE_CLASS_RENDER:
+		return instance ? 0 : 0x2000;
+	case I915_ENGINE_CLASS_COPY:
+		return instance ? 0 : 0x22000;
+	case I915_ENGINE_CLASS_VIDEO:
+		if (gen >= 11) {
+			static const uint32_t vcs[] = {
+				0x1c0000, 0x1c4000, 0x1d0000, 0x1d4000
+			};
+
+			return instance < ARRAY_SIZE(vcs) ? vcs[instance] : 0;
+		}
+		switch (instance) {
+		case 0: return 0x12000;
+		case 1: return 0x1c000;
+		default: return 0;
+		}
+	case I915_ENGINE_CLASS_VIDEO_ENHANCE:
+		if (gen >= 11) {
+			switch (instance) {
+			case 0: return 0x1c8000;
+			case 1: return 0x1d8000;
+			default: return 0;
+			}
+		}
+		return instance ? 0 : 0x1a000;
+	default:
+		return 0;
+	}
+}
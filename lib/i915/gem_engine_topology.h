@@ -60,6 +60,8 @@ bool gem_engine_is_equal(const struct intel_execution_engine2 *e1,
 
 struct intel_execution_engine2 gem_eb_flags_to_engine(unsigned int flags);
 
+uint32_t gem_engine_mmio_base(int fd, int class, int instance);
+
 #define __for_each_static_engine(e__) \
 	for ((e__) = intel_execution_engines2; (e__)->name; (e__)++)
 
@@ -0,0 +1,254 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "ioctl_wrappers.h"
+
+#include "i915/gem_exec_queue.h"
+
+/**
+ * SECTION:gem_exec_queue
+ * @short_description: Helpers for submitting many batches cheaply
+ * @title: GEM Exec Queue
+ *
+ * This helper library keeps the execbuf and object lists used for a stream
+ * of submissions, so that tests pushing many batches only pay for the
+ * execbuf ioctl itself.
+ *
+ * Objects are registered once with gem_exec_queue_add() and referred to by
+ * their slot afterwards. Where softpin is available each object is pinned to
+ * a fixed GTT offset at registration, which batches can use directly, and
+ * all submissions pass I915_EXEC_NO_RELOC so that the kernel never has to
+ * revalidate the object placement.
+ */
+
+/* Alignment of the softpinned objects, large enough for any GTT page size */
+#define GEM_EXEC_QUEUE_ALIGNMENT (64 << 10)
+
+struct gem_exec_queue {
+	int i915;
+	bool pinned;
+	uint64_t next_offset;
+	uint64_t aperture_size;
+
+	struct drm_i915_gem_execbuffer2 execbuf;
+
+	/* One persistent entry per slot, and scratch space for subsets */
+	struct drm_i915_gem_exec_object2 *objects;
+	struct drm_i915_gem_exec_object2 *scratch;
+	unsigned int count;
+	unsigned int allocated;
+};
+
+/**
+ * gem_exec_queue_create:
+ * @i915: open i915 drm file descriptor
+ * @ctx_id: context to submit the batches on
+ *
+ * Creates an empty submission queue for @ctx_id.
+ *
+ * Returns: the new queue, to be freed with gem_exec_queue_destroy()
+ */
+struct gem_exec_queue *gem_exec_queue_create(int i915, uint32_t ctx_id)
+{
+	struct gem_exec_queue *q;
+
+	q = calloc(1, sizeof(*q));
+	igt_assert(q);
+
+	q->i915 = i915;
+	q->pinned = gem_has_softpin(i915);
+	q->next_offset = GEM_EXEC_QUEUE_ALIGNMENT;
+	if (q->pinned)
+		q->aperture_size = gem_aperture_size(i915);
+
+	q->execbuf.rsvd1 = ctx_id;
+
+	return q;
+}
+
+/**
+ * gem_exec_queue_destroy:
+ * @q: the queue
+ *
+ * Frees @q. The objects registered with it remain owned by the caller.
+ */
+void gem_exec_queue_destroy(struct gem_exec_queue *q)
+{
+	free(q->objects);
+	free(q->scratch);
+	free(q);
+}
+
+/**
+ * gem_exec_queue_add:
+ * @q: the queue
+ * @handle: the object to register
+ * @size: size of the object
+ * @flags: extra exec object flags, e.g. EXEC_OBJECT_WRITE
+ *
+ * Registers @handle with @q, placing it at a fixed GTT offset when softpin is
+ * supported.
+ *
+ * Returns: the slot of the object in @q
+ */
+unsigned int gem_exec_queue_add(struct gem_exec_queue *q, uint32_t handle,
+				uint64_t size, uint64_t flags)
+{
+	struct drm_i915_gem_exec_object2 *obj;
+
+	if (q->count == q->allocated) {
+		q->allocated = q->allocated ? 2 * q->allocated : 16;
+		q->objects = realloc(q->objects,
+				     q->allocated * sizeof(*q->objects));
+		q->scratch = realloc(q->scratch,
+				     q->allocated * sizeof(*q->scratch));
+		igt_assert(q->objects && q->scratch);
+	}
+
+	obj = &q->objects[q->count];
+	memset(obj, 0, sizeof(*obj));
+	obj->handle = handle;
+	obj->flags = flags;
+
+	if (q->pinned) {
+		igt_assert(q->next_offset + size <= q->aperture_size);
+
+		obj->offset = q->next_offset;
+		obj->flags |= EXEC_OBJECT_PINNED;
+		if (q->aperture_size > 1ull << 32)
+			obj->flags |= EXEC_OBJECT_SUPPORTS_48B_ADDRESS;
+
+		q->next_offset = ALIGN(q->next_offset + size,
+				       GEM_EXEC_QUEUE_ALIGNMENT);
+	}
+
+	return q->count++;
+}
+
+/**
+ * gem_exec_queue_offset:
+ * @q: the queue
+ * @slot: the slot of an object registered with @q
+ *
+ * Returns: the GTT offset of the object. It is fixed for the lifetime of @q
+ * when gem_exec_queue_is_pinned() is true, otherwise it is the placement the
+ * kernel reported on the last submission using the object.
+ */
+uint64_t gem_exec_queue_offset(struct gem_exec_queue *q, unsigned int slot)
+{
+	igt_assert(slot < q->count);
+
+	return q->objects[slot].offset;
+}
+
+/**
+ * gem_exec_queue_is_pinned:
+ * @q: the queue
+ *
+ * Returns: whether the objects of @q are softpinned. Batches referencing
+ * other objects by address should only be submitted through @q when this is
+ * the case, as nothing relocates them.
+ */
+bool gem_exec_queue_is_pinned(struct gem_exec_queue *q)
+{
+	return q->pinned;
+}
+
+static int __gem_exec_queue_execbuf(struct gem_exec_queue *q,
+				    struct drm_i915_gem_exec_object2 *objects,
+				    unsigned int count, uint64_t flags)
+{
+	q->execbuf.buffers_ptr = to_user_pointer(objects);
+	q->execbuf.buffer_count = count;
+	q->execbuf.flags = flags | I915_EXEC_NO_RELOC;
+
+	return __gem_execbuf(q->i915, &q->execbuf);
+}
+
+/**
+ * __gem_exec_queue_submit:
+ * @q: the queue
+ * @slots: the objects to submit, the batch last
+ * @count: number of entries in @slots
+ * @flags: execbuf flags, e.g. the engine selection
+ *
+ * Submits a batch using the objects in @slots, without asserting on errors.
+ *
+ * Returns: 0 on success, a negative error code otherwise
+ */
+int __gem_exec_queue_submit(struct gem_exec_queue *q,
+			    const unsigned int *slots, unsigned int count,
+			    uint64_t flags)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < count; i++) {
+		igt_assert(slots[i] < q->count);
+		q->scratch[i] = q->objects[slots[i]];
+	}
+
+	err = __gem_exec_queue_execbuf(q, q->scratch, count, flags);
+
+	/* Keep the presumed offsets up to date for the next NO_RELOC */
+	if (!q->pinned)
+		for (i = 0; i < count; i++)
+			q->objects[slots[i]].offset = q->scratch[i].offset;
+
+	return err;
+}
+
+/**
+ * gem_exec_queue_submit:
+ * @q: the queue
+ * @slots: the objects to submit, the batch last
+ * @count: number of entries in @slots
+ * @flags: execbuf flags, e.g. the engine selection
+ *
+ * Submits a batch using the objects in @slots.
+ */
+void gem_exec_queue_submit(struct gem_exec_queue *q,
+			   const unsigned int *slots, unsigned int count,
+			   uint64_t flags)
+{
+	igt_assert_eq(__gem_exec_queue_submit(q, slots, count, flags), 0);
+}
+
+/**
+ * gem_exec_queue_submit_all:
+ * @q: the queue
+ * @flags: execbuf flags, e.g. the engine selection
+ *
+ * Submits a batch using all the objects of @q, in the order they were
+ * registered, the last one being the batch. Unlike gem_exec_queue_submit()
+ * this involves no copying at all.
+ */
+void gem_exec_queue_submit_all(struct gem_exec_queue *q, uint64_t flags)
+{
+	igt_assert_eq(__gem_exec_queue_execbuf(q, q->objects, q->count, flags),
+		      0);
+}
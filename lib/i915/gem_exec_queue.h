@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GEM_EXEC_QUEUE_H
+#define GEM_EXEC_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct gem_exec_queue;
+
+struct gem_exec_queue *gem_exec_queue_create(int i915, uint32_t ctx_id);
+void gem_exec_queue_destroy(struct gem_exec_queue *q);
+
+unsigned int gem_exec_queue_add(struct gem_exec_queue *q, uint32_t handle,
+				uint64_t size, uint64_t flags);
+uint64_t gem_exec_queue_offset(struct gem_exec_queue *q, unsigned int slot);
+bool gem_exec_queue_is_pinned(struct gem_exec_queue *q);
+
+int __gem_exec_queue_submit(struct gem_exec_queue *q,
+			    const unsigned int *slots, unsigned int count,
+			    uint64_t flags);
+void gem_exec_queue_submit(struct gem_exec_queue *q,
+			   const unsigned int *slots, unsigned int count,
+			   uint64_t flags);
+void gem_exec_queue_submit_all(struct gem_exec_queue *q, uint64_t flags);
+
+#endif /* GEM_EXEC_QUEUE_H */
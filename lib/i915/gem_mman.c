@@ -29,6 +29,7 @@
 #include "igt_core.h"
 #include "ioctl_wrappers.h"
 
+#include "i915/gem_caps.h"
 #include "gem_mman.h"
 
 #ifdef HAVE_VALGRIND
@@ -103,42 +104,35 @@ int gem_munmap(void *ptr, uint64_t size)
 
 bool gem_mmap__has_wc(int fd)
 {
-	static int has_wc = -1;
-
-	if (has_wc == -1) {
-		struct drm_i915_getparam gp;
-		int mmap_version = -1;
-		int gtt_version = -1;
-
-		has_wc = 0;
-
-		memset(&gp, 0, sizeof(gp));
-		gp.param = I915_PARAM_MMAP_GTT_VERSION;
-		gp.value = &gtt_version;
-		ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp);
-
-		memset(&gp, 0, sizeof(gp));
-		gp.param = I915_PARAM_MMAP_VERSION;
-		gp.value = &mmap_version;
-		ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp);
-
-		/* Do we have the new mmap_ioctl with DOMAIN_WC? */
-		if (mmap_version >= 1 && gtt_version >= 2) {
-			struct drm_i915_gem_mmap arg;
-
-			/* Does this device support wc-mmaps ? */
-			memset(&arg, 0, sizeof(arg));
-			arg.handle = gem_create(fd, 4096);
-			arg.offset = 0;
-			arg.size = 4096;
-			arg.flags = I915_MMAP_WC;
-			has_wc = igt_ioctl(fd, DRM_IOCTL_I915_GEM_MMAP, &arg) == 0;
-			gem_close(fd, arg.handle);
-		}
-		errno = 0;
+	int mmap_version, gtt_version;
+	uint64_t has_wc;
+
+	if (gem_caps_get_fact(fd, GEM_CAPS_MMAP_WC, &has_wc))
+		return has_wc;
+
+	has_wc = 0;
+
+	gtt_version = gem_caps_getparam(fd, I915_PARAM_MMAP_GTT_VERSION);
+	mmap_version = gem_caps_getparam(fd, I915_PARAM_MMAP_VERSION);
+
+	/* Do we have the new mmap_ioctl with DOMAIN_WC? */
+	if (mmap_version >= 1 && gtt_version >= 2) {
+		struct drm_i915_gem_mmap arg;
+
+		/* Does this device support wc-mmaps ? */
+		memset(&arg, 0, sizeof(arg));
+		arg.handle = gem_create(fd, 4096);
+		arg.offset = 0;
+		arg.size = 4096;
+		arg.flags = I915_MMAP_WC;
+		has_wc = igt_ioctl(fd, DRM_IOCTL_I915_GEM_MMAP, &arg) == 0;
+		gem_close(fd, arg.handle);
 	}
+	errno = 0;
+
+	gem_caps_set_fact(fd, GEM_CAPS_MMAP_WC, has_wc);
 
-	return has_wc > 0;
+	return has_wc;
 }
 
 /**
@@ -21,13 +21,10 @@
  * IN THE SOFTWARE.
  */
 
-#include <errno.h>
-#include <string.h>
-#include <sys/ioctl.h>
-
 #include "igt_core.h"
 #include "ioctl_wrappers.h"
 
+#include "i915/gem_caps.h"
 #include "i915/gem_scheduler.h"
 
 #define LOCAL_I915_PARAM_HAS_SCHEDULER		41
@@ -49,21 +46,7 @@
  */
 unsigned gem_scheduler_capability(int fd)
 {
-	static int caps = -1;
-
-	if (caps < 0) {
-		struct drm_i915_getparam gp;
-
-		memset(&gp, 0, sizeof(gp));
-		gp.param = LOCAL_I915_PARAM_HAS_SCHEDULER;
-		gp.value = &caps;
-
-		caps = 0;
-		ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp, sizeof(gp));
-		errno = 0;
-	}
-
-	return caps;
+	return gem_caps_getparam(fd, LOCAL_I915_PARAM_HAS_SCHEDULER);
 }
 
 /**
@@ -30,6 +30,7 @@
 
 #include "i915/gem_engine_topology.h"
 
+#include "drmtest.h"
 #include "igt_core.h"
 #include "igt_gt.h"
 #include "igt_sysfs.h"
@@ -37,6 +38,7 @@
 #include "intel_reg.h"
 #include "ioctl_wrappers.h"
 
+#include "i915/gem_caps.h"
 #include "i915/gem_submission.h"
 
 /**
@@ -55,11 +57,8 @@
 static bool has_semaphores(int fd, int dir)
 {
 	int val = 0;
-	struct drm_i915_getparam gp = {
-		gp.param = I915_PARAM_HAS_SEMAPHORES,
-		gp.value = &val,
-	};
-	if (ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp) < 0)
+
+	if (__gem_caps_getparam(fd, I915_PARAM_HAS_SEMAPHORES, &val) < 0)
 		val = igt_sysfs_get_boolean(dir, "semaphores");
 	return val;
 }
@@ -72,10 +71,14 @@ static bool has_semaphores(int fd, int dir)
  */
 unsigned gem_submission_method(int fd)
 {
-	const int gen = intel_gen(intel_get_drm_devid(fd));
 	unsigned flags = 0;
+	uint64_t cached;
+	int dir, gen;
+
+	if (gem_caps_get_fact(fd, GEM_CAPS_SUBMISSION_METHOD, &cached))
+		return cached;
 
-	int dir;
+	gen = intel_gen(intel_get_drm_devid(fd));
 
 	dir = igt_sysfs_open_parameters(fd);
 	if (dir < 0)
@@ -96,6 +99,7 @@ unsigned gem_submission_method(int fd)
 
 out:
 	close(dir);
+	gem_caps_set_fact(fd, GEM_CAPS_SUBMISSION_METHOD, flags);
 	return flags;
 }
 
@@ -168,13 +172,7 @@ bool gem_has_guc_submission(int fd)
  */
 int gem_reopen_driver(int fd)
 {
-	char path[256];
-
-	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
-	fd = open(path, O_RDWR);
-	igt_assert_fd(fd);
-
-	return fd;
+	return drm_reopen_driver(fd);
 }
 
 static bool is_wedged(int i915)
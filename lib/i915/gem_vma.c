@@ -0,0 +1,398 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "ioctl_wrappers.h"
+
+#include "i915/gem_vma.h"
+
+/**
+ * SECTION:gem_vma
+ * @short_description: Helpers for picking softpin addresses
+ * @title: GEM VMA Allocator
+ *
+ * This helper library hands out non-overlapping GTT offsets within one
+ * address space, for use with EXEC_OBJECT_PINNED. One allocator should be
+ * used per address space, i.e. per file descriptor for the default one, or
+ * per VM created with gem_vm_create() and shared by the contexts using it.
+ *
+ * Offsets are handed out by bumping through the address space. Ranges given
+ * back with gem_vma_allocator_free() are kept in a sorted list of holes and
+ * reused first.
+ */
+
+#define GEM_VMA_MIN_ALIGNMENT 4096
+
+struct gem_vma {
+	uint32_t handle; /* 0 for a free slot */
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct gem_vma_hole {
+	uint64_t start;
+	uint64_t end;
+};
+
+struct gem_vma_allocator {
+	uint32_t vm_id;
+	uint64_t start, end;
+	uint64_t bump;
+
+	/* Allocations, hashed by handle with linear probing */
+	struct gem_vma *vmas;
+	unsigned int vma_count;
+	unsigned int vma_slots;
+
+	/* Free ranges below the bump pointer, sorted by address */
+	struct gem_vma_hole *holes;
+	unsigned int hole_count;
+	unsigned int hole_slots;
+};
+
+/**
+ * gem_vma_allocator_create:
+ * @i915: open i915 drm file descriptor
+ * @vm_id: the VM the offsets are for, 0 for the default address space of @i915
+ *
+ * Creates an allocator covering the whole address space. Skips the test when
+ * softpin is not supported.
+ *
+ * Returns: the new allocator, to be freed with gem_vma_allocator_destroy()
+ */
+struct gem_vma_allocator *gem_vma_allocator_create(int i915, uint32_t vm_id)
+{
+	struct gem_vma_allocator *a;
+
+	igt_require(gem_has_softpin(i915));
+
+	a = calloc(1, sizeof(*a));
+	igt_assert(a);
+
+	a->vm_id = vm_id;
+	/* Keep offset 0 unused so that it can't be mistaken for "unbound" */
+	a->start = GEM_VMA_MIN_ALIGNMENT;
+	a->end = gem_aperture_size(i915);
+	a->bump = a->start;
+
+	return a;
+}
+
+/**
+ * gem_vma_allocator_destroy:
+ * @a: the allocator
+ *
+ * Frees @a. This does not affect the objects placed with it.
+ */
+void gem_vma_allocator_destroy(struct gem_vma_allocator *a)
+{
+	free(a->vmas);
+	free(a->holes);
+	free(a);
+}
+
+/**
+ * gem_vma_allocator_vm_id:
+ * @a: the allocator
+ *
+ * Returns: the VM @a was created for
+ */
+uint32_t gem_vma_allocator_vm_id(struct gem_vma_allocator *a)
+{
+	return a->vm_id;
+}
+
+/**
+ * gem_vma_allocator_end:
+ * @a: the allocator
+ *
+ * Returns: the end of the address space covered by @a. Objects need
+ * EXEC_OBJECT_SUPPORTS_48B_ADDRESS if it is above 4GiB.
+ */
+uint64_t gem_vma_allocator_end(struct gem_vma_allocator *a)
+{
+	return a->end;
+}
+
+static unsigned int vma_hash(struct gem_vma_allocator *a, uint32_t handle)
+{
+	return (handle * 2654435761u) & (a->vma_slots - 1);
+}
+
+static struct gem_vma *vma_find(struct gem_vma_allocator *a, uint32_t handle)
+{
+	unsigned int i;
+
+	if (!a->vma_slots)
+		return NULL;
+
+	for (i = vma_hash(a, handle); a->vmas[i].handle;
+	     i = (i + 1) & (a->vma_slots - 1))
+		if (a->vmas[i].handle == handle)
+			return &a->vmas[i];
+
+	return NULL;
+}
+
+static void vma_insert(struct gem_vma_allocator *a, const struct gem_vma *vma)
+{
+	unsigned int i;
+
+	if (2 * (a->vma_count + 1) > a->vma_slots) {
+		struct gem_vma *old = a->vmas;
+		unsigned int old_slots = a->vma_slots;
+
+		a->vma_slots = old_slots ? 2 * old_slots : 64;
+		a->vmas = calloc(a->vma_slots, sizeof(*a->vmas));
+		igt_assert(a->vmas);
+		a->vma_count = 0;
+
+		for (i = 0; i < old_slots; i++)
+			if (old[i].handle)
+				vma_insert(a, &old[i]);
+		free(old);
+	}
+
+	for (i = vma_hash(a, vma->handle); a->vmas[i].handle;
+	     i = (i + 1) & (a->vma_slots - 1))
+		;
+
+	a->vmas[i] = *vma;
+	a->vma_count++;
+}
+
+/* Backward shift deletion, keeping the probe sequences intact. */
+static void vma_remove(struct gem_vma_allocator *a, struct gem_vma *vma)
+{
+	unsigned int mask = a->vma_slots - 1;
+	unsigned int i = vma - a->vmas, j = i, k;
+
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!a->vmas[j].handle)
+			break;
+
+		k = vma_hash(a, a->vmas[j].handle);
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		a->vmas[i] = a->vmas[j];
+		i = j;
+	}
+
+	a->vmas[i].handle = 0;
+	a->vma_count--;
+}
+
+static void hole_insert_at(struct gem_vma_allocator *a, unsigned int idx,
+			   uint64_t start, uint64_t end)
+{
+	if (a->hole_count == a->hole_slots) {
+		a->hole_slots = a->hole_slots ? 2 * a->hole_slots : 16;
+		a->holes = realloc(a->holes,
+				   a->hole_slots * sizeof(*a->holes));
+		igt_assert(a->holes);
+	}
+
+	memmove(&a->holes[idx + 1], &a->holes[idx],
+		(a->hole_count - idx) * sizeof(*a->holes));
+	a->holes[idx].start = start;
+	a->holes[idx].end = end;
+	a->hole_count++;
+}
+
+static void hole_remove_at(struct gem_vma_allocator *a, unsigned int idx)
+{
+	a->hole_count--;
+	memmove(&a->holes[idx], &a->holes[idx + 1],
+		(a->hole_count - idx) * sizeof(*a->holes));
+}
+
+/* Returns the index of the first hole starting at or after @offset. */
+static unsigned int hole_search(struct gem_vma_allocator *a, uint64_t offset)
+{
+	unsigned int lo = 0, hi = a->hole_count;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (a->holes[mid].start < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void range_free(struct gem_vma_allocator *a, uint64_t start,
+		       uint64_t end)
+{
+	unsigned int idx = hole_search(a, start);
+
+	/* Merge with the neighbouring holes */
+	if (idx < a->hole_count && a->holes[idx].start == end) {
+		end = a->holes[idx].end;
+		hole_remove_at(a, idx);
+	}
+	if (idx > 0 && a->holes[idx - 1].end == start) {
+		start = a->holes[idx - 1].start;
+		hole_remove_at(a, --idx);
+	}
+
+	if (end == a->bump)
+		a->bump = start;
+	else
+		hole_insert_at(a, idx, start, end);
+}
+
+static uint64_t range_alloc(struct gem_vma_allocator *a, uint64_t size,
+			    uint64_t alignment)
+{
+	uint64_t start, end;
+	unsigned int i;
+
+	for (i = 0; i < a->hole_count; i++) {
+		uint64_t hole_start = a->holes[i].start;
+		uint64_t hole_end = a->holes[i].end;
+
+		start = ALIGN(hole_start, alignment);
+		end = start + size;
+		if (end > hole_end)
+			continue;
+
+		if (start == hole_start && end == hole_end) {
+			hole_remove_at(a, i);
+		} else if (start == hole_start) {
+			a->holes[i].start = end;
+		} else if (end == hole_end) {
+			a->holes[i].end = start;
+		} else {
+			a->holes[i].end = start;
+			hole_insert_at(a, i + 1, end, hole_end);
+		}
+
+		return start;
+	}
+
+	start = ALIGN(a->bump, alignment);
+	igt_assert_f(start + size <= a->end,
+		     "Out of address space for a %"PRIu64" bytes object\n",
+		     size);
+
+	if (start > a->bump)
+		hole_insert_at(a, a->hole_count, a->bump, start);
+	a->bump = start + size;
+
+	return start;
+}
+
+/**
+ * gem_vma_allocator_alloc:
+ * @a: the allocator
+ * @handle: the object to place
+ * @size: size of the object
+ * @alignment: required alignment of the offset, a power of two, or 0 for
+ *	       the page size
+ *
+ * Picks an offset for @handle that does not overlap any other object placed
+ * with @a. An object that already has an offset large and aligned enough
+ * keeps it, so this can be called before every submission.
+ *
+ * Returns: the offset of @handle
+ */
+uint64_t gem_vma_allocator_alloc(struct gem_vma_allocator *a, uint32_t handle,
+				 uint64_t size, uint64_t alignment)
+{
+	struct gem_vma *vma;
+	struct gem_vma new;
+
+	igt_assert(handle);
+
+	if (alignment < GEM_VMA_MIN_ALIGNMENT)
+		alignment = GEM_VMA_MIN_ALIGNMENT;
+	size = ALIGN(size, GEM_VMA_MIN_ALIGNMENT);
+
+	vma = vma_find(a, handle);
+	if (vma) {
+		if (vma->size >= size && !(vma->offset & (alignment - 1)))
+			return vma->offset;
+
+		range_free(a, vma->offset, vma->offset + vma->size);
+		vma_remove(a, vma);
+	}
+
+	new.handle = handle;
+	new.size = size;
+	new.offset = range_alloc(a, size, alignment);
+	vma_insert(a, &new);
+
+	return new.offset;
+}
+
+/**
+ * gem_vma_allocator_lookup:
+ * @a: the allocator
+ * @handle: the object to look up
+ * @offset: (out): where to store the offset of @handle
+ *
+ * Returns: whether @handle has been placed with @a
+ */
+bool gem_vma_allocator_lookup(struct gem_vma_allocator *a, uint32_t handle,
+			      uint64_t *offset)
+{
+	struct gem_vma *vma = vma_find(a, handle);
+
+	if (!vma)
+		return false;
+
+	*offset = vma->offset;
+	return true;
+}
+
+/**
+ * gem_vma_allocator_free:
+ * @a: the allocator
+ * @handle: the object to remove
+ *
+ * Gives the range used by @handle back to @a, typically right before closing
+ * the object.
+ *
+ * Returns: whether @handle had been placed with @a
+ */
+bool gem_vma_allocator_free(struct gem_vma_allocator *a, uint32_t handle)
+{
+	struct gem_vma *vma = vma_find(a, handle);
+
+	if (!vma)
+		return false;
+
+	range_free(a, vma->offset, vma->offset + vma->size);
+	vma_remove(a, vma);
+
+	return true;
+}
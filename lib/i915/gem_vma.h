@@ -0,0 +1,44 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GEM_VMA_H
+#define GEM_VMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct gem_vma_allocator;
+
+struct gem_vma_allocator *gem_vma_allocator_create(int i915, uint32_t vm_id);
+void gem_vma_allocator_destroy(struct gem_vma_allocator *a);
+
+uint32_t gem_vma_allocator_vm_id(struct gem_vma_allocator *a);
+uint64_t gem_vma_allocator_end(struct gem_vma_allocator *a);
+
+uint64_t gem_vma_allocator_alloc(struct gem_vma_allocator *a, uint32_t handle,
+				 uint64_t size, uint64_t alignment);
+bool gem_vma_allocator_lookup(struct gem_vma_allocator *a, uint32_t handle,
+			      uint64_t *offset);
+bool gem_vma_allocator_free(struct gem_vma_allocator *a, uint32_t handle);
+
+#endif /* GEM_VMA_H */
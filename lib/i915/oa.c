@@ -0,0 +1,618 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_sysfs.h"
+#include "intel_chipset.h"
+#include "ioctl_wrappers.h"
+
+#include "i915/oa.h"
+
+/**
+ * SECTION:oa
+ * @short_description: i915 OA unit streams and reports
+ * @title: OA
+ * @include: i915/oa.h
+ *
+ * The OA unit of Haswell and later periodically writes reports of the
+ * counters of a metric set, selected by the UUID under which it is
+ * advertised in sysfs, to a buffer that i915_oa_stream_open() gives access
+ * to through a perf stream. i915_oa_stream_read() then reads all of the
+ * pending reports at once into a buffer allocated with the stream, adding
+ * up the deltas of the counters between each report in an
+ * #i915_oa_accumulator, so that benchmarks can report the activity of the
+ * GPU, like its EU usage or memory bandwidth, next to their own results.
+ *
+ * The layout of the reports, and the helpers to read and accumulate them,
+ * are also available to tests parsing the streams themselves.
+ */
+
+/* Large enough to scrape all of the pending reports in one go */
+#define READ_BUF_SIZE (1 << 20)
+
+/* The largest report, A32u40_A4u32_B8_C8 or A45_B8_C8 */
+#define MAX_REPORT_SIZE 256
+
+static const struct i915_oa_format hsw_oa_formats[I915_OA_FORMAT_MAX] = {
+	[I915_OA_FORMAT_A13] = { /* HSW only */
+		"A13", .size = 64,
+		.a_off = 12, .n_a = 13, },
+	[I915_OA_FORMAT_A29] = { /* HSW only */
+		"A29", .size = 128,
+		.a_off = 12, .n_a = 29, },
+	[I915_OA_FORMAT_A13_B8_C8] = { /* HSW only */
+		"A13_B8_C8", .size = 128,
+		.a_off = 12, .n_a = 13,
+		.b_off = 64, .n_b = 8,
+		.c_off = 96, .n_c = 8, },
+	[I915_OA_FORMAT_A45_B8_C8] = { /* HSW only */
+		"A45_B8_C8", .size = 256,
+		.a_off = 12,  .n_a = 45,
+		.b_off = 192, .n_b = 8,
+		.c_off = 224, .n_c = 8, },
+	[I915_OA_FORMAT_B4_C8] = { /* HSW only */
+		"B4_C8", .size = 64,
+		.b_off = 16, .n_b = 4,
+		.c_off = 32, .n_c = 8, },
+	[I915_OA_FORMAT_B4_C8_A16] = { /* HSW only */
+		"B4_C8_A16", .size = 128,
+		.b_off = 16, .n_b = 4,
+		.c_off = 32, .n_c = 8,
+		.a_off = 60, .n_a = 16, .first_a = 29, },
+	[I915_OA_FORMAT_C4_B8] = { /* HSW+ (header differs from HSW-Gen8+) */
+		"C4_B8", .size = 64,
+		.c_off = 16, .n_c = 4,
+		.b_off = 28, .n_b = 8 },
+};
+
+static const struct i915_oa_format gen8_oa_formats[I915_OA_FORMAT_MAX] = {
+	[I915_OA_FORMAT_A12] = {
+		"A12", .size = 64,
+		.a_off = 12, .n_a = 12, .first_a = 7, },
+	[I915_OA_FORMAT_A12_B8_C8] = {
+		"A12_B8_C8", .size = 128,
+		.a_off = 12, .n_a = 12,
+		.b_off = 64, .n_b = 8,
+		.c_off = 96, .n_c = 8, .first_a = 7, },
+	[I915_OA_FORMAT_A32u40_A4u32_B8_C8] = {
+		"A32u40_A4u32_B8_C8", .size = 256,
+		.a40_high_off = 160, .a40_low_off = 16, .n_a40 = 32,
+		.a_off = 144, .n_a = 4, .first_a = 32,
+		.b_off = 192, .n_b = 8,
+		.c_off = 224, .n_c = 8, },
+	[I915_OA_FORMAT_C4_B8] = {
+		"C4_B8", .size = 64,
+		.c_off = 16, .n_c = 4,
+		.b_off = 32, .n_b = 8, },
+};
+
+struct i915_oa_stream {
+	int fd;
+	uint32_t devid;
+	enum drm_i915_oa_format format;
+	size_t report_size;
+	uint64_t lost;
+
+	bool has_last;
+	uint32_t last[MAX_REPORT_SIZE / sizeof(uint32_t)];
+
+	uint8_t buf[READ_BUF_SIZE];
+};
+
+/**
+ * i915_oa_get_format:
+ * @devid: pci id of the device
+ * @format: the report format
+ *
+ * Returns: The layout of the reports of @format on @devid, or NULL if the
+ * device has no such format.
+ */
+const struct i915_oa_format *
+i915_oa_get_format(uint32_t devid, enum drm_i915_oa_format format)
+{
+	const struct i915_oa_format *formats;
+
+	if (format >= I915_OA_FORMAT_MAX)
+		return NULL;
+
+	formats = IS_HASWELL(devid) ? hsw_oa_formats : gen8_oa_formats;
+	if (!formats[format].name)
+		return NULL;
+
+	return &formats[format];
+}
+
+/**
+ * i915_oa_timestamp_frequency:
+ * @i915: open i915 drm file descriptor
+ *
+ * Returns: The frequency of the timestamps of the OA reports, in Hz, as
+ * reported by the kernel or, for older kernels, as known for the device, or
+ * 0 if it is unknown.
+ */
+uint64_t i915_oa_timestamp_frequency(int i915)
+{
+	uint32_t devid = intel_get_drm_devid(i915);
+	int cs_ts_freq = 0;
+	drm_i915_getparam_t gp;
+
+	gp.param = I915_PARAM_CS_TIMESTAMP_FREQUENCY;
+	gp.value = &cs_ts_freq;
+	if (igt_ioctl(i915, DRM_IOCTL_I915_GETPARAM, &gp) == 0)
+		return cs_ts_freq;
+
+	igt_debug("Couldn't query CS timestamp frequency, trying to guess based on PCI-id\n");
+
+	if (IS_GEN7(devid) || IS_GEN8(devid))
+		return 12500000;
+	if (IS_SKYLAKE(devid) || IS_KABYLAKE(devid) || IS_COFFEELAKE(devid))
+		return 12000000;
+	if (IS_BROXTON(devid) || IS_GEMINILAKE(devid))
+		return 19200000;
+
+	return 0;
+}
+
+/**
+ * i915_oa_exponent_to_ns:
+ * @timestamp_frequency: frequency of the OA timestamps, in Hz
+ * @exponent: OA sampling exponent
+ *
+ * Returns: The sampling period for @exponent, in nanoseconds.
+ */
+uint64_t i915_oa_exponent_to_ns(uint64_t timestamp_frequency, int exponent)
+{
+	return 1000000000ULL * (2ULL << exponent) / timestamp_frequency;
+}
+
+/**
+ * i915_oa_exponent_for_period:
+ * @timestamp_frequency: frequency of the OA timestamps, in Hz
+ * @period_ns: the longest sampling period wanted, in nanoseconds
+ *
+ * Returns: The largest OA exponent that will still result in a sampling
+ * period less than or equal to @period_ns.
+ */
+int i915_oa_exponent_for_period(uint64_t timestamp_frequency,
+				uint64_t period_ns)
+{
+	/* An exponent of 30 would already represent a period of ~3 minutes
+	 * so there's really no need to consider higher exponents.
+	 */
+	for (int i = 0; i < 30; i++) {
+		if (i915_oa_exponent_to_ns(timestamp_frequency, i) > period_ns)
+			return max(0, i - 1);
+	}
+
+	return 29;
+}
+
+/**
+ * i915_oa_test_metric_set_uuid:
+ * @devid: pci id of the device
+ *
+ * The TestOa metric set, or RenderBasic for Haswell which has none, have
+ * counters of known relations to the gpu clock for checking their values.
+ *
+ * Returns: The UUID of the test metric set of @devid, or NULL if unknown.
+ */
+const char *i915_oa_test_metric_set_uuid(uint32_t devid)
+{
+	if (IS_HASWELL(devid))
+		return "403d8832-1a27-4aa6-a64e-f5389ce7b212";
+	if (IS_BROADWELL(devid))
+		return "d6de6f55-e526-4f79-a6a6-d7315c09044e";
+	if (IS_CHERRYVIEW(devid))
+		return "4a534b07-cba3-414d-8d60-874830e883aa";
+	if (IS_SKYLAKE(devid)) {
+		switch (intel_gt(devid)) {
+		case 1:
+			return "1651949f-0ac0-4cb1-a06f-dafd74a407d1";
+		case 2:
+			return "2b985803-d3c9-4629-8a4f-634bfecba0e8";
+		case 3:
+			return "882fa433-1f4a-4a67-a962-c741888fe5f5";
+		default:
+			igt_debug("unsupported Skylake GT size\n");
+			return NULL;
+		}
+	}
+	if (IS_BROXTON(devid))
+		return "5ee72f5c-092f-421e-8b70-225f7c3e9612";
+	if (IS_KABYLAKE(devid)) {
+		switch (intel_gt(devid)) {
+		case 1:
+			return "baa3c7e4-52b6-4b85-801e-465a94b746dd";
+		case 2:
+			return "f1792f32-6db2-4b50-b4b2-557128f1688d";
+		default:
+			igt_debug("unsupported Kabylake GT size\n");
+			return NULL;
+		}
+	}
+	if (IS_GEMINILAKE(devid))
+		return "dd3fd789-e783-4204-8cd0-b671bbccb0cf";
+	if (IS_COFFEELAKE(devid)) {
+		switch (intel_gt(devid)) {
+		case 1:
+			return "74fb4902-d3d3-4237-9e90-cbdc68d0a446";
+		case 2:
+			return "577e8e2c-3fa0-4875-8743-3538d585e3b0";
+		default:
+			igt_debug("unsupported Coffeelake GT size\n");
+			return NULL;
+		}
+	}
+	if (IS_CANNONLAKE(devid))
+		return "db41edd4-d8e7-4730-ad11-b9a2d6833503";
+	if (IS_ICELAKE(devid))
+		return "a291665e-244b-4b76-9b9a-01de9d3c8068";
+
+	igt_debug("unsupported GT\n");
+	return NULL;
+}
+
+/**
+ * i915_oa_metric_set_id:
+ * @i915: open i915 drm file descriptor
+ * @uuid: UUID of the metric set
+ * @id: returns the id of the metric set
+ *
+ * Looks up the id to open a stream of the metric set @uuid with, as
+ * advertised by the kernel in sysfs.
+ *
+ * Returns: Whether the kernel has the metric set.
+ */
+bool i915_oa_metric_set_id(int i915, const char *uuid, uint64_t *id)
+{
+	char path[64];
+	bool found;
+	int sysfs;
+
+	sysfs = igt_sysfs_open(i915);
+	if (sysfs < 0)
+		return false;
+
+	snprintf(path, sizeof(path), "metrics/%s/id", uuid);
+	found = igt_sysfs_scanf(sysfs, path, "%"PRIu64, id) == 1;
+	close(sysfs);
+
+	return found;
+}
+
+/**
+ * i915_oa_read_report_ticks:
+ * @devid: pci id of the device
+ * @report: the report
+ * @format: the format of @report
+ *
+ * On Haswell this reads C2, which only is the gpu clock for the RenderBasic
+ * metric set.
+ *
+ * Returns: The gpu clock cycles counted by @report.
+ */
+uint32_t i915_oa_read_report_ticks(uint32_t devid, const uint32_t *report,
+				   enum drm_i915_oa_format format)
+{
+	const struct i915_oa_format *fmt;
+	const uint32_t *c;
+
+	if (!IS_HASWELL(devid))
+		return report[3];
+
+	fmt = i915_oa_get_format(devid, format);
+	igt_assert_neq(fmt->n_c, 0);
+
+	c = (const uint32_t *)((const uint8_t *)report + fmt->c_off);
+	return c[2];
+}
+
+/**
+ * i915_oa_read_40bit_a_counter:
+ * @report: the report
+ * @format: the format of @report
+ * @a_id: index of the counter
+ *
+ * Returns: The value of the 40bit A counter @a_id of @report.
+ */
+uint64_t i915_oa_read_40bit_a_counter(const uint32_t *report,
+				      const struct i915_oa_format *format,
+				      int a_id)
+{
+	const uint8_t *a40_high = (const uint8_t *)report + format->a40_high_off;
+	const uint32_t *a40_low = (const uint32_t *)((const uint8_t *)report +
+						     format->a40_low_off);
+	uint64_t high = (uint64_t)(a40_high[a_id]) << 32;
+
+	return a40_low[a_id] | high;
+}
+
+/**
+ * i915_oa_40bit_a_delta:
+ * @value0: the earlier value of a 40bit A counter
+ * @value1: the later value
+ *
+ * Returns: The difference between the values, accounting for wrapping.
+ */
+uint64_t i915_oa_40bit_a_delta(uint64_t value0, uint64_t value1)
+{
+	if (value0 > value1)
+		return (1ULL << 40) + value1 - value0;
+	else
+		return value1 - value0;
+}
+
+static void
+accumulate_uint32(size_t offset,
+		  const uint32_t *report0,
+		  const uint32_t *report1,
+		  uint64_t *delta)
+{
+	uint32_t value0 = *(const uint32_t *)((const uint8_t *)report0 + offset);
+	uint32_t value1 = *(const uint32_t *)((const uint8_t *)report1 + offset);
+
+	*delta += (uint32_t)(value1 - value0);
+}
+
+static void
+accumulate_uint40(int a_index,
+		  const uint32_t *report0,
+		  const uint32_t *report1,
+		  const struct i915_oa_format *format,
+		  uint64_t *delta)
+{
+	uint64_t value0 = i915_oa_read_40bit_a_counter(report0, format, a_index),
+		 value1 = i915_oa_read_40bit_a_counter(report1, format, a_index);
+
+	*delta += i915_oa_40bit_a_delta(value0, value1);
+}
+
+/**
+ * i915_oa_accumulator_init:
+ * @accumulator: the accumulator
+ * @devid: pci id of the device the reports come from
+ * @format: the format of the reports
+ *
+ * Sets up @accumulator with all of its deltas at zero.
+ */
+void i915_oa_accumulator_init(struct i915_oa_accumulator *accumulator,
+			      uint32_t devid,
+			      enum drm_i915_oa_format format)
+{
+	memset(accumulator, 0, sizeof(*accumulator));
+	accumulator->devid = devid;
+	accumulator->format = format;
+}
+
+/**
+ * i915_oa_accumulate_reports:
+ * @accumulator: the accumulator
+ * @start: the earlier report
+ * @end: the later report
+ *
+ * Adds the deltas of each of the counters between @start and @end to those
+ * of @accumulator. The 32bit counters can only be told to have wrapped
+ * once, so the reports should not be further apart than that.
+ */
+void i915_oa_accumulate_reports(struct i915_oa_accumulator *accumulator,
+				const uint32_t *start,
+				const uint32_t *end)
+{
+	const struct i915_oa_format *format =
+		i915_oa_get_format(accumulator->devid, accumulator->format);
+	uint64_t *deltas = accumulator->deltas;
+	int idx = 0;
+
+	/* timestamp */
+	accumulate_uint32(4, start, end, deltas + idx++);
+
+	/* clock cycles */
+	if (intel_gen(accumulator->devid) >= 8)
+		accumulate_uint32(12, start, end, deltas + idx++);
+
+	for (int i = 0; i < format->n_a40; i++) {
+		accumulate_uint40(i, start, end, format,
+				  deltas + idx++);
+	}
+
+	for (int i = 0; i < format->n_a; i++) {
+		accumulate_uint32(format->a_off + 4 * i,
+				  start, end, deltas + idx++);
+	}
+
+	for (int i = 0; i < format->n_b; i++) {
+		accumulate_uint32(format->b_off + 4 * i,
+				  start, end, deltas + idx++);
+	}
+
+	for (int i = 0; i < format->n_c; i++) {
+		accumulate_uint32(format->c_off + 4 * i,
+				  start, end, deltas + idx++);
+	}
+}
+
+/**
+ * i915_oa_stream_open:
+ * @i915: open i915 drm file descriptor
+ * @metric_set: id of the metric set, from i915_oa_metric_set_id()
+ * @format: the format of the reports
+ * @exponent: the sampling exponent, from i915_oa_exponent_for_period(), or
+ * -1 for none
+ *
+ * Opens a system wide, non blocking, stream of the reports of @metric_set,
+ * which requires either CAP_SYS_ADMIN or dev.i915.perf_stream_paranoid
+ * to be 0. Without periodic sampling the stream only serves to have the OA
+ * unit count for MI_REPORT_PERF_COUNT.
+ *
+ * Returns: The stream, or NULL with errno set if the kernel refused it.
+ */
+struct i915_oa_stream *i915_oa_stream_open(int i915, uint64_t metric_set,
+					   enum drm_i915_oa_format format,
+					   int exponent)
+{
+	uint64_t properties[] = {
+		DRM_I915_PERF_PROP_SAMPLE_OA, true,
+		DRM_I915_PERF_PROP_OA_METRICS_SET, metric_set,
+		DRM_I915_PERF_PROP_OA_FORMAT, format,
+		DRM_I915_PERF_PROP_OA_EXPONENT, exponent,
+	};
+	struct drm_i915_perf_open_param param = {
+		.flags = I915_PERF_FLAG_FD_CLOEXEC | I915_PERF_FLAG_FD_NONBLOCK,
+		/* The exponent comes last, to be left out */
+		.num_properties = ARRAY_SIZE(properties) / 2 - (exponent < 0),
+		.properties_ptr = to_user_pointer(properties),
+	};
+	uint32_t devid = intel_get_drm_devid(i915);
+	const struct i915_oa_format *fmt;
+	struct i915_oa_stream *stream;
+	int fd;
+
+	fmt = i915_oa_get_format(devid, format);
+	if (!fmt) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	stream = malloc(sizeof(*stream));
+	if (!stream)
+		return NULL;
+
+	fd = igt_ioctl(i915, DRM_IOCTL_I915_PERF_OPEN, &param);
+	if (fd < 0) {
+		int err = errno;
+
+		free(stream);
+		errno = err;
+		return NULL;
+	}
+
+	stream->fd = fd;
+	stream->devid = devid;
+	stream->format = format;
+	stream->report_size = fmt->size;
+	stream->lost = 0;
+	stream->has_last = false;
+
+	return stream;
+}
+
+/**
+ * i915_oa_stream_close:
+ * @stream: the stream
+ *
+ * Closes @stream, disabling the OA unit.
+ */
+void i915_oa_stream_close(struct i915_oa_stream *stream)
+{
+	if (!stream)
+		return;
+
+	close(stream->fd);
+	free(stream);
+}
+
+/**
+ * i915_oa_stream_fd:
+ * @stream: the stream
+ *
+ * Returns: The file descriptor of @stream, for polling.
+ */
+int i915_oa_stream_fd(const struct i915_oa_stream *stream)
+{
+	return stream->fd;
+}
+
+/**
+ * i915_oa_stream_read:
+ * @stream: the stream
+ * @accumulator: where to add up the deltas, or NULL
+ *
+ * Reads all of the reports pending on @stream, adding the deltas between
+ * each of them, and between the last one of the previous read and the
+ * first, to @accumulator. Records of lost reports are counted rather than
+ * breaking the accumulation, as the counters run on regardless.
+ *
+ * Returns: The number of reports read, 0 if none was pending, or a negative
+ * error code.
+ */
+int i915_oa_stream_read(struct i915_oa_stream *stream,
+			struct i915_oa_accumulator *accumulator)
+{
+	const struct drm_i915_perf_record_header *header;
+	ssize_t len;
+	int n = 0;
+
+	while ((len = read(stream->fd, stream->buf, sizeof(stream->buf))) < 0 &&
+	       errno == EINTR)
+		;
+
+	if (len < 0)
+		return errno == EAGAIN ? 0 : -errno;
+
+	for (ssize_t offset = 0; offset < len; offset += header->size) {
+		const uint32_t *report;
+
+		header = (const void *)(stream->buf + offset);
+		if (!header->size)
+			return -EIO;
+
+		switch (header->type) {
+		case DRM_I915_PERF_RECORD_SAMPLE:
+			report = (const uint32_t *)(header + 1);
+			if (stream->has_last && accumulator)
+				i915_oa_accumulate_reports(accumulator,
+							   stream->last,
+							   report);
+
+			memcpy(stream->last, report, stream->report_size);
+			stream->has_last = true;
+			n++;
+			break;
+
+		case DRM_I915_PERF_RECORD_OA_REPORT_LOST:
+		case DRM_I915_PERF_RECORD_OA_BUFFER_LOST:
+			stream->lost++;
+			break;
+		}
+	}
+
+	return n;
+}
+
+/**
+ * i915_oa_stream_lost:
+ * @stream: the stream
+ *
+ * Returns: The number of records of lost reports read from @stream so far.
+ */
+uint64_t i915_oa_stream_lost(const struct i915_oa_stream *stream)
+{
+	return stream->lost;
+}
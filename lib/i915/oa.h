@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef I915_OA_H
+#define I915_OA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "i915_drm.h"
+
+/* The most counters of any of the report formats, with the timestamp */
+#define I915_OA_MAX_RAW_COUNTERS 62
+
+/**
+ * i915_oa_format:
+ * @name: name of the format, as in enum drm_i915_oa_format
+ * @size: size of a report, in bytes
+ * @a40_high_off: offset of the high bytes of the 40bit A counters
+ * @a40_low_off: offset of the low dwords of the 40bit A counters
+ * @n_a40: number of 40bit A counters
+ * @a_off: offset of the 32bit A counters
+ * @n_a: number of 32bit A counters
+ * @first_a: index of the first 32bit A counter
+ * @b_off: offset of the B counters
+ * @n_b: number of B counters
+ * @c_off: offset of the C counters
+ * @n_c: number of C counters
+ *
+ * The layout of an OA report, with offsets in bytes.
+ */
+struct i915_oa_format {
+	const char *name;
+	size_t size;
+	int a40_high_off; /* bytes */
+	int a40_low_off;
+	int n_a40;
+	int a_off;
+	int n_a;
+	int first_a;
+	int b_off;
+	int n_b;
+	int c_off;
+	int n_c;
+};
+
+/**
+ * i915_oa_accumulator:
+ * @devid: the device the reports come from
+ * @format: the format of the reports
+ * @deltas: the sums of the deltas of each counter
+ *
+ * The deltas are, in order, those of the timestamp, of the clock cycles on
+ * Gen8+, then of the 40bit A, 32bit A, B and C counters of @format.
+ */
+struct i915_oa_accumulator {
+	uint32_t devid;
+	enum drm_i915_oa_format format;
+	uint64_t deltas[I915_OA_MAX_RAW_COUNTERS];
+};
+
+const struct i915_oa_format *
+i915_oa_get_format(uint32_t devid, enum drm_i915_oa_format format);
+
+uint64_t i915_oa_timestamp_frequency(int i915);
+int i915_oa_exponent_for_period(uint64_t timestamp_frequency,
+				uint64_t period_ns);
+uint64_t i915_oa_exponent_to_ns(uint64_t timestamp_frequency, int exponent);
+
+const char *i915_oa_test_metric_set_uuid(uint32_t devid);
+bool i915_oa_metric_set_id(int i915, const char *uuid, uint64_t *id);
+
+uint32_t i915_oa_read_report_ticks(uint32_t devid, const uint32_t *report,
+				   enum drm_i915_oa_format format);
+uint64_t i915_oa_read_40bit_a_counter(const uint32_t *report,
+				      const struct i915_oa_format *format,
+				      int a_id);
+uint64_t i915_oa_40bit_a_delta(uint64_t value0, uint64_t value1);
+
+void i915_oa_accumulator_init(struct i915_oa_accumulator *accumulator,
+			      uint32_t devid,
+			      enum drm_i915_oa_format format);
+void i915_oa_accumulate_reports(struct i915_oa_accumulator *accumulator,
+				const uint32_t *start,
+				const uint32_t *end);
+
+struct i915_oa_stream;
+
+struct i915_oa_stream *i915_oa_stream_open(int i915, uint64_t metric_set,
+					   enum drm_i915_oa_format format,
+					   int exponent);
+void i915_oa_stream_close(struct i915_oa_stream *stream);
+int i915_oa_stream_fd(const struct i915_oa_stream *stream);
+int i915_oa_stream_read(struct i915_oa_stream *stream,
+			struct i915_oa_accumulator *accumulator);
+uint64_t i915_oa_stream_lost(const struct i915_oa_stream *stream);
+
+#endif /* I915_OA_H */
@@ -394,6 +394,7 @@ bool audio_signal_detect(struct audio_signal *signal, int sampling_rate,
 		if (bin_power[i] > NOISE_THRESHOLD) {
 			igt_debug("Noise level too high: freq=%d power=%f\n",
 				  freq, bin_power[i]);
+			free(data);
 			return false;
 		}
 	}
@@ -492,6 +493,308 @@ bool audio_signal_detect(struct audio_signal *signal, int sampling_rate,
 	return success;
 }
 
+/** MIN_DETECT_AMPLITUDE: below this, a test frequency is considered absent */
+#define MIN_DETECT_AMPLITUDE 0.01
+/** MAX_DRIFT: how far off, in Hz, a frequency may be within a stream.
+ *
+ * Dropped or repeated samples shift the phase of all frequencies, which shows
+ * up as a short drift in the windows around them.
+ */
+#define MAX_DRIFT 1.0 /* Hz */
+
+struct audio_signal_detector {
+	int sampling_rate;
+	size_t window_len, hop;
+	audio_signal_window_func_t func;
+	void *data;
+
+	/* Precomputed once: window and per-frequency Goertzel coefficients */
+	double *window;
+	double window_sum;
+	size_t freqs_count;
+	int freqs[FREQS_MAX + 2];
+	double coeff[FREQS_MAX + 2], cos_w[FREQS_MAX + 2], sin_w[FREQS_MAX + 2];
+	double omega[FREQS_MAX + 2];
+
+	/* The last window_len samples, filled up to samples_len */
+	double *samples;
+	size_t samples_len;
+
+	double amplitude[FREQS_MAX];
+	double drift[FREQS_MAX];
+	double phase[FREQS_MAX];
+	size_t windows, failed;
+};
+
+static void detector_add_freq(struct audio_signal_detector *d, int freq)
+{
+	size_t i = d->freqs_count++;
+
+	d->freqs[i] = freq;
+	d->omega[i] = 2.0 * M_PI * freq / d->sampling_rate;
+	d->cos_w[i] = cos(d->omega[i]);
+	d->sin_w[i] = sin(d->omega[i]);
+	d->coeff[i] = 2.0 * d->cos_w[i];
+}
+
+/**
+ * audio_signal_detector_init:
+ * @signal: The signal whose frequencies are expected
+ * @sampling_rate: The sampling rate of the samples, in Hz
+ * @channel: The channel of @signal the samples belong to
+ * @window_len: The number of samples analyzed per window
+ * @func: Function called with the results of each window, or NULL
+ * @data: Data passed to @func
+ *
+ * Sets up a streaming detector for the frequencies of @signal. Unlike
+ * #audio_signal_detect, it only measures the expected frequencies, with
+ * the Goertzel algorithm, and a couple of low frequencies to detect noise.
+ * This makes it cheap enough to check hours of capture as it arrives.
+ * It cannot notice unexpected frequencies, though.
+ *
+ * Samples are analyzed in Hann windows of @window_len samples, which
+ * overlap by half. For each window, the detector reports the amplitude
+ * of each frequency and its drift: the deviation of the frequency from
+ * the expected one, derived from the phase advance since the previous
+ * window.
+ *
+ * Returns: A detector to be freed with #audio_signal_detector_fini
+ */
+struct audio_signal_detector *
+audio_signal_detector_init(struct audio_signal *signal, int sampling_rate,
+			   int channel, size_t window_len,
+			   audio_signal_window_func_t func, void *data)
+{
+	struct audio_signal_detector *d;
+	size_t i;
+
+	igt_assert(window_len >= 2);
+
+	d = calloc(1, sizeof(*d));
+	igt_assert(d);
+
+	d->sampling_rate = sampling_rate;
+	d->window_len = window_len;
+	d->hop = window_len / 2;
+	d->func = func;
+	d->data = data;
+
+	d->window = malloc(window_len * sizeof(double));
+	d->samples = malloc(window_len * sizeof(double));
+	igt_assert(d->window && d->samples);
+
+	for (i = 0; i < window_len; i++) {
+		d->window[i] = hann_window(1.0, i, window_len);
+		d->window_sum += d->window[i];
+	}
+
+	for (i = 0; i < signal->freqs_count; i++) {
+		if (signal->freqs[i].channel >= 0 &&
+		    signal->freqs[i].channel != channel)
+			continue;
+		detector_add_freq(d, signal->freqs[i].freq);
+	}
+
+	/* Noise probes, in the range audio_signal_detect checks for noise */
+	detector_add_freq(d, (MIN_FREQ - 100) / 2);
+	detector_add_freq(d, MIN_FREQ - 100);
+
+	return d;
+}
+
+/**
+ * audio_signal_detector_fini:
+ * @d: The detector
+ *
+ * Releases the detector.
+ */
+void audio_signal_detector_fini(struct audio_signal_detector *d)
+{
+	if (!d)
+		return;
+
+	free(d->window);
+	free(d->samples);
+	free(d);
+}
+
+static double wrap_phase(double phase)
+{
+	return phase - 2.0 * M_PI * floor(phase / (2.0 * M_PI) + 0.5);
+}
+
+static void detector_process_window(struct audio_signal_detector *d)
+{
+	size_t n = d->freqs_count - 2;
+	struct audio_signal_window window = {
+		.index = d->windows,
+		.freqs_count = n,
+		.freqs = d->freqs,
+		.amplitude = d->amplitude,
+		.drift = d->drift,
+	};
+	double strongest = 0;
+	size_t i, j;
+
+	for (i = 0; i < d->freqs_count; i++) {
+		double s1 = 0, s2 = 0, s, re, im, amplitude, phase;
+
+		for (j = 0; j < d->window_len; j++) {
+			s = d->samples[j] * d->window[j] + d->coeff[i] * s1 - s2;
+			s2 = s1;
+			s1 = s;
+		}
+
+		/* Rotate back to the phase at the start of the window */
+		re = s1 - d->cos_w[i] * s2;
+		im = d->sin_w[i] * s2;
+		amplitude = 2 * hypot(re, im) / d->window_sum;
+		phase = atan2(im, re) - d->omega[i] * (d->window_len - 1);
+
+		if (i >= n) {
+			window.noise = fmax(window.noise, amplitude);
+			continue;
+		}
+
+		d->amplitude[i] = amplitude;
+		if (d->windows) {
+			double advance = wrap_phase(phase - d->phase[i] -
+						    d->omega[i] * d->hop);
+
+			d->drift[i] = advance * d->sampling_rate /
+				      (2.0 * M_PI * d->hop);
+		}
+		d->phase[i] = phase;
+
+		strongest = fmax(strongest, amplitude);
+	}
+
+	/* Same criteria as audio_signal_detect: every frequency has at least
+	 * half the power of the strongest one, and there is no noise. On top
+	 * of that, the frequencies must not drift. */
+	window.ok = strongest > MIN_DETECT_AMPLITUDE &&
+		    window.noise <= 2 * NOISE_THRESHOLD;
+	for (i = 0; i < n; i++)
+		if (d->amplitude[i] < strongest / 2 ||
+		    fabs(d->drift[i]) > MAX_DRIFT)
+			window.ok = false;
+
+	if (!window.ok) {
+		igt_debug("Audio window %zu doesn't match, noise=%f\n",
+			  d->windows, window.noise);
+		for (i = 0; i < n; i++)
+			igt_debug("  %d Hz: amplitude=%f drift=%+.2f Hz\n",
+				  d->freqs[i], d->amplitude[i], d->drift[i]);
+		d->failed++;
+	}
+
+	d->windows++;
+
+	if (d->func)
+		d->func(&window, d->data);
+}
+
+static void detector_next_window(struct audio_signal_detector *d)
+{
+	detector_process_window(d);
+
+	/* Keep the second half, it is the first half of the next window */
+	memmove(d->samples, &d->samples[d->hop],
+		(d->window_len - d->hop) * sizeof(double));
+	d->samples_len = d->window_len - d->hop;
+}
+
+/**
+ * audio_signal_detector_feed:
+ * @d: The detector
+ * @samples: Samples of the detector's channel
+ * @samples_len: The number of samples
+ *
+ * Passes more samples to the detector, which analyzes every window which
+ * got complete.
+ *
+ * Returns: The number of windows analyzed so far which didn't match the
+ * expected signal
+ */
+size_t audio_signal_detector_feed(struct audio_signal_detector *d,
+				  const double *samples, size_t samples_len)
+{
+	size_t count;
+
+	while (samples_len) {
+		count = d->window_len - d->samples_len;
+		if (count > samples_len)
+			count = samples_len;
+		memcpy(&d->samples[d->samples_len], samples,
+		       count * sizeof(double));
+		d->samples_len += count;
+		samples += count;
+		samples_len -= count;
+
+		if (d->samples_len == d->window_len)
+			detector_next_window(d);
+	}
+
+	return d->failed;
+}
+
+/**
+ * audio_signal_detector_feed_s32_le:
+ * @d: The detector
+ * @samples: Interleaved S32_LE samples of all channels
+ * @samples_len: The number of samples, of all channels
+ * @n_channels: The number of interleaved channels
+ * @channel: The channel to analyze
+ *
+ * Like #audio_signal_detector_feed, but reads one channel of an
+ * interleaved S32_LE capture in place, e.g. straight from the ring buffer
+ * of a Chamelium audio stream, instead of a separately extracted copy.
+ *
+ * Returns: The number of windows analyzed so far which didn't match the
+ * expected signal
+ */
+size_t audio_signal_detector_feed_s32_le(struct audio_signal_detector *d,
+					 const int32_t *samples,
+					 size_t samples_len,
+					 int n_channels, int channel)
+{
+	size_t frames, count, i;
+
+	igt_assert(channel < n_channels);
+	igt_assert(samples_len % n_channels == 0);
+	frames = samples_len / n_channels;
+	samples += channel;
+
+	while (frames) {
+		count = d->window_len - d->samples_len;
+		if (count > frames)
+			count = frames;
+
+		for (i = 0; i < count; i++)
+			d->samples[d->samples_len + i] =
+				(double) samples[i * n_channels] / INT32_MAX;
+		d->samples_len += count;
+		samples += count * n_channels;
+		frames -= count;
+
+		if (d->samples_len == d->window_len)
+			detector_next_window(d);
+	}
+
+	return d->failed;
+}
+
+/**
+ * audio_signal_detector_windows:
+ * @d: The detector
+ *
+ * Returns: The number of windows analyzed so far
+ */
+size_t audio_signal_detector_windows(struct audio_signal_detector *d)
+{
+	return d->windows;
+}
+
 /**
  * audio_extract_channel_s32_le: extracts a single channel from a multi-channel
  * S32_LE input buffer.
@@ -35,6 +35,33 @@
 #include <alsa/asoundlib.h>
 
 struct audio_signal;
+struct audio_signal_detector;
+
+/**
+ * audio_signal_window:
+ * @index: The number of the window, counted from 0
+ * @ok: Whether the window matched the expected signal
+ * @freqs_count: The number of frequencies expected on the channel
+ * @freqs: The expected frequencies, in Hz
+ * @amplitude: The measured amplitude of each frequency
+ * @drift: How far each frequency is off, in Hz, or 0 for the first window
+ * @noise: The highest amplitude measured at low frequencies
+ *
+ * Results of one window of an audio signal detector. The arrays are only
+ * valid during the #audio_signal_window_func_t call.
+ */
+struct audio_signal_window {
+	size_t index;
+	bool ok;
+	size_t freqs_count;
+	const int *freqs;
+	const double *amplitude;
+	const double *drift;
+	double noise;
+};
+
+typedef void (*audio_signal_window_func_t)(const struct audio_signal_window *window,
+					   void *data);
 
 struct audio_signal *audio_signal_init(int channels, int sampling_rate);
 void audio_signal_fini(struct audio_signal *signal);
@@ -46,6 +73,18 @@ void audio_signal_fill(struct audio_signal *signal, double *buffer,
 		       size_t samples);
 bool audio_signal_detect(struct audio_signal *signal, int sampling_rate,
 			 int channel, const double *samples, size_t samples_len);
+struct audio_signal_detector *
+audio_signal_detector_init(struct audio_signal *signal, int sampling_rate,
+			   int channel, size_t window_len,
+			   audio_signal_window_func_t func, void *data);
+void audio_signal_detector_fini(struct audio_signal_detector *d);
+size_t audio_signal_detector_feed(struct audio_signal_detector *d,
+				  const double *samples, size_t samples_len);
+size_t audio_signal_detector_feed_s32_le(struct audio_signal_detector *d,
+					 const int32_t *samples,
+					 size_t samples_len,
+					 int n_channels, int channel);
+size_t audio_signal_detector_windows(struct audio_signal_detector *d);
 size_t audio_extract_channel_s32_le(double *dst, size_t dst_cap,
 				    int32_t *src, size_t src_len,
 				    int n_channels, int channel);
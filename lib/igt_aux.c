@@ -85,16 +85,25 @@
  * fit into any other topic.
  */
 
-static struct __igt_sigiter_global {
+static __thread struct __igt_sigiter_global {
 	pid_t tid;
 	timer_t timer;
 	struct timespec offset;
+	uint64_t avg_ns; /* running average of uninterrupted ioctls */
+	uint32_t prng;
 	struct {
 		long hit, miss;
 		long ioctls, signals;
 	} stat;
+	struct {
+		long ioctls, hit;
+		unsigned int passes;
+	} total;
 } __igt_sigiter;
 
+/* Number of threads inside igt_while_interruptible() */
+static int sigiter_users;
+
 static void sigiter(int sig, siginfo_t *info, void *arg)
 {
 	__igt_sigiter.stat.signals++;
@@ -106,13 +115,30 @@ static void sigiter(int sig, siginfo_t *info, void *arg)
 #define SIG_ASSERT(expr)
 #endif
 
+static uint64_t ts_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static struct timespec ns_to_ts(uint64_t ns)
+{
+	return (struct timespec){
+		.tv_sec = ns / NSEC_PER_SEC,
+		.tv_nsec = ns % NSEC_PER_SEC,
+	};
+}
+
 static int
 sig_ioctl(int fd, unsigned long request, void *arg)
 {
 	struct itimerspec its;
+	uint64_t delay;
 	int ret;
 
-	SIG_ASSERT(__igt_sigiter.timer);
+	/* Another thread is being interrupted, but not us */
+	if (!__igt_sigiter.timer)
+		return drmIoctl(fd, request, arg);
+
 	SIG_ASSERT(__igt_sigiter.tid == gettid());
 
 	memset(&its, 0, sizeof(its));
@@ -122,8 +148,18 @@ sig_ioctl(int fd, unsigned long request, void *arg)
 		return drmIoctl(fd, request, arg);
 	}
 
-	its.it_value = __igt_sigiter.offset;
+	/*
+	 * Aim somewhere within the expected duration of the ioctl, on top
+	 * of the minimum delay for this pass, so that each pass hits
+	 * different points of the ioctls instead of only their start.
+	 */
+	delay = ts_to_ns(&__igt_sigiter.offset);
+	if (__igt_sigiter.avg_ns)
+		delay += ((uint64_t)hars_petruska_f54_1_random(&__igt_sigiter.prng) *
+			  __igt_sigiter.avg_ns) >> 32;
+	its.it_value = ns_to_ts(delay);
 	do {
+		struct timespec start, end;
 		long serial;
 
 		__igt_sigiter.stat.ioctls++;
@@ -131,22 +167,27 @@ sig_ioctl(int fd, unsigned long request, void *arg)
 		ret = 0;
 		serial = __igt_sigiter.stat.signals;
 		igt_assert(timer_settime(__igt_sigiter.timer, 0, &its, NULL) == 0);
+		clock_gettime(CLOCK_MONOTONIC, &start);
 		if (ioctl(fd, request, arg))
 			ret = errno;
-		if (__igt_sigiter.stat.signals == serial)
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (__igt_sigiter.stat.signals == serial) {
 			__igt_sigiter.stat.miss++;
+			if (ret == 0) {
+				uint64_t ns = ts_to_ns(&end) - ts_to_ns(&start);
+
+				__igt_sigiter.avg_ns = __igt_sigiter.avg_ns ?
+					(3 * __igt_sigiter.avg_ns + ns) / 4 : ns;
+			}
+		}
 		if (ret == 0)
 			break;
 
 		if (ret == EINTR) {
 			__igt_sigiter.stat.hit++;
 
-			its.it_value.tv_sec *= 2;
-			its.it_value.tv_nsec *= 2;
-			while (its.it_value.tv_nsec >= NSEC_PER_SEC) {
-				its.it_value.tv_nsec -= NSEC_PER_SEC;
-				its.it_value.tv_sec += 1;
-			}
+			/* Make sure the restarted ioctl progresses */
+			its.it_value = ns_to_ts(2 * ts_to_ns(&its.it_value));
 
 			SIG_ASSERT(its.it_value.tv_nsec >= 0);
 			SIG_ASSERT(its.it_value.tv_sec >= 0);
@@ -165,8 +206,10 @@ static bool igt_sigiter_start(struct __igt_sigiter *iter, bool enable)
 	/* Note that until we can automatically clean up on failed/skipped
 	 * tests, we cannot assume the state of the igt_ioctl indirection.
 	 */
-	SIG_ASSERT(igt_ioctl == drmIoctl);
-	igt_ioctl = drmIoctl;
+	if (!__atomic_load_n(&sigiter_users, __ATOMIC_SEQ_CST)) {
+		SIG_ASSERT(igt_ioctl == drmIoctl);
+		igt_ioctl = drmIoctl;
+	}
 
 	if (enable) {
 		struct timespec start, end;
@@ -174,8 +217,9 @@ static bool igt_sigiter_start(struct __igt_sigiter *iter, bool enable)
 		struct sigaction act;
 		struct itimerspec its;
 
-		igt_ioctl = sig_ioctl;
+		memset(&__igt_sigiter, 0, sizeof(__igt_sigiter));
 		__igt_sigiter.tid = gettid();
+		__igt_sigiter.prng = __igt_sigiter.tid;
 
 		memset(&sev, 0, sizeof(sev));
 		sev.sigev_notify = SIGEV_SIGNAL | SIGEV_THREAD_ID;
@@ -191,6 +235,9 @@ static bool igt_sigiter_start(struct __igt_sigiter *iter, bool enable)
 		act.sa_flags = SA_SIGINFO;
 		igt_assert(sigaction(SIGRTMIN, &act, NULL) == 0);
 
+		__atomic_add_fetch(&sigiter_users, 1, __ATOMIC_SEQ_CST);
+		igt_ioctl = sig_ioctl;
+
 		/* Try to find the approximate delay required to skip over
 		 * the timer_setttime and into the following ioctl() to try
 		 * and avoid the timer firing before we enter the drmIoctl.
@@ -219,6 +266,13 @@ static bool igt_sigiter_start(struct __igt_sigiter *iter, bool enable)
 	return true;
 }
 
+static void sigiter_account(void)
+{
+	__igt_sigiter.total.ioctls += __igt_sigiter.stat.ioctls;
+	__igt_sigiter.total.hit += __igt_sigiter.stat.hit;
+	__igt_sigiter.total.passes++;
+}
+
 static bool igt_sigiter_stop(struct __igt_sigiter *iter, bool enable)
 {
 	if (enable) {
@@ -226,13 +280,22 @@ static bool igt_sigiter_stop(struct __igt_sigiter *iter, bool enable)
 
 		SIG_ASSERT(igt_ioctl == sig_ioctl);
 		SIG_ASSERT(__igt_sigiter.tid == gettid());
-		igt_ioctl = drmIoctl;
+
+		sigiter_account();
+		igt_debug("Interrupted %ld of %ld ioctls over %u passes\n",
+			  __igt_sigiter.total.hit, __igt_sigiter.total.ioctls,
+			  __igt_sigiter.total.passes);
 
 		timer_delete(__igt_sigiter.timer);
 
-		memset(&act, 0, sizeof(act));
-		act.sa_handler = SIG_IGN;
-		sigaction(SIGRTMIN, &act, NULL);
+		/* Leave the signal handler to any other interrupted thread */
+		if (__atomic_sub_fetch(&sigiter_users, 1, __ATOMIC_SEQ_CST) == 0) {
+			igt_ioctl = drmIoctl;
+
+			memset(&act, 0, sizeof(act));
+			act.sa_handler = SIG_IGN;
+			sigaction(SIGRTMIN, &act, NULL);
+		}
 
 		memset(&__igt_sigiter, 0, sizeof(__igt_sigiter));
 	}
@@ -262,15 +325,11 @@ bool __igt_sigiter_continue(struct __igt_sigiter *iter, bool enable)
 	SIG_ASSERT(igt_ioctl == sig_ioctl);
 	SIG_ASSERT(__igt_sigiter.timer);
 
-	__igt_sigiter.offset.tv_sec *= 2;
-	__igt_sigiter.offset.tv_nsec *= 2;
-	while (__igt_sigiter.offset.tv_nsec >= NSEC_PER_SEC) {
-		__igt_sigiter.offset.tv_nsec -= NSEC_PER_SEC;
-		__igt_sigiter.offset.tv_sec += 1;
-	}
+	__igt_sigiter.offset = ns_to_ts(2 * ts_to_ns(&__igt_sigiter.offset));
 	SIG_ASSERT(__igt_sigiter.offset.tv_nsec >= 0);
 	SIG_ASSERT(__igt_sigiter.offset.tv_sec >= 0);
 
+	sigiter_account();
 	memset(&__igt_sigiter.stat, 0, sizeof(__igt_sigiter.stat));
 	return true;
 }
@@ -430,6 +489,163 @@ void igt_stop_shrink_helper(void)
 	igt_stop_helper(&shrink_helper);
 }
 
+#define PRESSURE_PERIOD_MS 10
+#define PRESSURE_CHUNK (1ull << 20)
+
+static struct igt_helper_process pressure_helper;
+static char pressure_cgroup[80];
+
+static uint64_t pressure_avail_mb(int meminfo)
+{
+	char buf[4096], *str;
+
+	if (igt_sysfs_attr_read(meminfo, buf, sizeof(buf)) <= 0)
+		return 0;
+
+	str = strstr(buf, "MemAvailable:");
+	if (!str)
+		return 0;
+
+	return strtoull(str + strlen("MemAvailable:"), NULL, 0) >> 10;
+}
+
+static void __attribute__((noreturn))
+pressure_helper_process(const struct igt_memory_pressure *opts, pid_t pid)
+{
+	void **chunks = NULL;
+	unsigned int count = 0, allocated = 0;
+	uint64_t step;
+	int meminfo;
+
+	if (pressure_cgroup[0]) {
+		int dir;
+
+		/* The helper alone goes into the group, not the test */
+		dir = open(pressure_cgroup, O_RDONLY);
+		igt_assert(dir >= 0);
+		igt_assert(igt_sysfs_printf(dir, "cgroup.procs", "%d",
+					    getpid()) > 0);
+		close(dir);
+	}
+
+	meminfo = igt_sysfs_attr_open(AT_FDCWD, "/proc/meminfo");
+	igt_assert(meminfo >= 0);
+
+	/* How many 1MiB chunks to allocate per period at most */
+	step = opts->rate_mb ?
+		max(opts->rate_mb * PRESSURE_PERIOD_MS / 1000, 1ull) :
+		-1ull;
+
+	while (1) {
+		uint64_t avail = pressure_avail_mb(meminfo);
+		uint64_t n;
+
+		if (avail > opts->target_free_mb) {
+			n = min(avail - opts->target_free_mb, step);
+			while (n--) {
+				void *ptr;
+
+				ptr = mmap(NULL, PRESSURE_CHUNK,
+					   PROT_READ | PROT_WRITE,
+					   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+				if (ptr == MAP_FAILED)
+					break;
+
+				/* Fault the pages in, with non-zero data */
+				memset(ptr, 0xc5, PRESSURE_CHUNK);
+
+				if (count == allocated) {
+					allocated = allocated ? 2 * allocated : 256;
+					chunks = realloc(chunks,
+							 allocated * sizeof(*chunks));
+					igt_assert(chunks);
+				}
+				chunks[count++] = ptr;
+			}
+		} else if (avail < opts->target_free_mb) {
+			n = min(opts->target_free_mb - avail, step);
+			while (n-- && count)
+				munmap(chunks[--count], PRESSURE_CHUNK);
+		}
+
+		usleep(PRESSURE_PERIOD_MS * 1000);
+		if (kill(pid, 0)) /* Parent has died, so must we. */
+			exit(0);
+	}
+}
+
+/**
+ * igt_fork_memory_pressure:
+ * @opts: the amount and kind of pressure to apply
+ *
+ * Fork a child process using #igt_fork_helper that keeps the amount of
+ * available system memory, as reported by MemAvailable in /proc/meminfo,
+ * around @opts->target_free_mb. It allocates and faults in anonymous memory
+ * while more is available, and releases it again when less is, at most
+ * @opts->rate_mb MiB per second in either direction (0 for no limit).
+ *
+ * When @opts->memory_high_mb is set, the child is placed in a new memory
+ * cgroup with memory.high set to that amount, so that the kernel keeps pushing
+ * its memory out to swap instead of letting it consume the target.
+ * This requires the cgroup v2 memory controller to be available under
+ * /sys/fs/cgroup.
+ *
+ * Unlike igt_fork_shrink_helper(), which keeps emptying every cache, this
+ * gives a steady, reproducible level of memory pressure for eviction and swap
+ * testing.
+ *
+ * This should only be used from an igt_fixture.
+ */
+void igt_fork_memory_pressure(const struct igt_memory_pressure *opts)
+{
+	static struct igt_memory_pressure pressure;
+
+	assert(!igt_only_list_subtests());
+	igt_require_f(intel_get_avail_ram_mb() > opts->target_free_mb,
+		      "Less than %"PRIu64"MiB of memory available\n",
+		      opts->target_free_mb);
+
+	pressure_cgroup[0] = '\0';
+	if (opts->memory_high_mb) {
+		int dir;
+
+		snprintf(pressure_cgroup, sizeof(pressure_cgroup),
+			 "/sys/fs/cgroup/igt-pressure-%d", getpid());
+		igt_require_f(mkdir(pressure_cgroup, 0755) == 0 ||
+			      errno == EEXIST,
+			      "Unable to create %s\n", pressure_cgroup);
+
+		dir = open(pressure_cgroup, O_RDONLY);
+		igt_assert(dir >= 0);
+		igt_require_f(igt_sysfs_printf(dir, "memory.high", "%"PRIu64,
+					       opts->memory_high_mb << 20) > 0,
+			      "No memory controller for %s\n",
+			      pressure_cgroup);
+		close(dir);
+	}
+
+	/* The child refers to the options after we may have returned */
+	pressure = *opts;
+	igt_fork_helper(&pressure_helper)
+		pressure_helper_process(&pressure, getppid());
+}
+
+/**
+ * igt_stop_memory_pressure:
+ *
+ * Stops the child process spawned with igt_fork_memory_pressure(), releasing
+ * all the memory it held, and removes its memory cgroup.
+ */
+void igt_stop_memory_pressure(void)
+{
+	igt_stop_helper(&pressure_helper);
+
+	if (pressure_cgroup[0]) {
+		rmdir(pressure_cgroup);
+		pressure_cgroup[0] = '\0';
+	}
+}
+
 #ifndef ANDROID
 
 static void show_kernel_stack(pid_t pid)
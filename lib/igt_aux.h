@@ -58,6 +58,15 @@ void igt_resume_signal_helper(void);
 void igt_fork_shrink_helper(int fd);
 void igt_stop_shrink_helper(void);
 
+struct igt_memory_pressure {
+	uint64_t target_free_mb;
+	uint64_t rate_mb;
+	uint64_t memory_high_mb;
+};
+
+void igt_fork_memory_pressure(const struct igt_memory_pressure *opts);
+void igt_stop_memory_pressure(void);
+
 void igt_fork_hang_detector(int fd);
 void igt_stop_hang_detector(void);
 
@@ -80,8 +89,15 @@ bool __igt_sigiter_continue(struct __igt_sigiter *iter, bool interrupt);
  * The code block attached to this macro is run in a loop with doubling the
  * interrupt timeout on each ioctl for every run, until no ioctl gets
  * interrupted any more. The starting timeout is taken to be the signal delivery
- * latency, measured at runtime. This way the any ioctls called from this code
- * block should be exhaustively tested for all signal interruption paths.
+ * latency, measured at runtime. On top of it, each ioctl gets a random extra
+ * delay of up to the average duration measured for the uninterrupted ioctls,
+ * so that every run interrupts them at various points rather than just at
+ * their start. This way the any ioctls called from this code block should be
+ * exhaustively tested for all signal interruption paths. The number of ioctls
+ * interrupted is reported in the debug log at the end.
+ *
+ * The interrupter is per thread, several threads may each run their own
+ * igt_while_interruptible() block concurrently.
  *
  * Note that since this overloads the igt_ioctl(), this method is not useful
  * for widespread signal injection, for example providing coverage of
@@ -98,10 +114,13 @@ bool __igt_sigiter_continue(struct __igt_sigiter *iter, bool interrupt);
  * timeout has expired. Of course when an individual execution takes too long,
  * the actual execution time could be a lot longer.
  *
+ * In simulation mode the timeout is shortened by igt_simulation_scale().
+ *
  * The code block will be executed at least once.
  */
 #define igt_until_timeout(timeout) \
-	for (struct timespec t__={}; igt_seconds_elapsed(&t__) < (timeout); )
+	for (struct timespec t__={}; \
+	     igt_seconds_elapsed(&t__) * igt_simulation_scale() < (timeout); )
 
 /**
  * igt_for_milliseconds:
@@ -111,10 +130,13 @@ bool __igt_sigiter_continue(struct __igt_sigiter *iter, bool interrupt);
  * target interval has expired. Of course when an individual execution takes
  * too long, the actual execution time could be a lot longer.
  *
+ * In simulation mode the interval is shortened by igt_simulation_scale().
+ *
  * The code block will be executed at least once.
  */
 #define igt_for_milliseconds(t) \
-	for (struct timespec t__={}; igt_nsec_elapsed(&t__)>>20 < (t); )
+	for (struct timespec t__={}; \
+	     (igt_nsec_elapsed(&t__)>>20) * igt_simulation_scale() < (t); )
 
 void igt_exchange_int(void *array, unsigned i, unsigned j);
 void igt_exchange_int64(void *array, unsigned i, unsigned j);
@@ -0,0 +1,552 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_bench.h"
+#include "igt_core.h"
+
+/**
+ * SECTION:igt_bench
+ * @short_description: Machine-readable benchmark results
+ * @title: Bench
+ * @include: igt_bench.h
+ *
+ * Benchmarks report their results in whatever format suits a human best.
+ * For tools ingesting them the same results can also be written as a JSON
+ * document, when the IGT_BENCH_JSON environment variable names the file
+ * to write it to, or is "-" for stdout. Otherwise all the functions here
+ * do nothing.
+ *
+ * |[
+ *	igt_stats_t stats;
+ *
+ *	igt_bench_begin("gem_example");
+ *	igt_bench_param("engine", "%s", "rcs0");
+ *
+ *	igt_stats_init(&stats);
+ *	for (i = 0; i < 10; i++)
+ *		igt_stats_push_float(&stats, measure());
+ *	igt_bench_result("latency", "us", &stats);
+ *	igt_stats_fini(&stats);
+ *
+ *	igt_bench_end();
+ * ]|
+ *
+ * results in
+ *
+ * |[
+ *	{
+ *	  "benchmark": "gem_example",
+ *	  "params": { "engine": "rcs0" },
+ *	  "results": [
+ *	    { "name": "latency", "unit": "us", "samples": [ ... ],
+ *	      "count": 10, "min": ..., "median": ..., "p99": ..., "max": ... }
+ *	  ]
+ *	}
+ * ]|
+ *
+ * Instead of a fixed number of measurement rounds, benchmarks can also
+ * measure until the confidence interval of the mean is narrow enough with
+ * igt_bench_unstable():
+ *
+ * |[
+ *	struct igt_bench_stability s = {
+ *		.target = 0.01, .min_rounds = 5, .max_rounds = 100,
+ *	};
+ *
+ *	igt_stats_init(&stats);
+ *	do
+ *		igt_stats_push_float(&stats, measure());
+ *	while (igt_bench_unstable(&stats, &s));
+ * ]|
+ *
+ * Where the GPU energy counter of RAPL is available, the report also
+ * includes the energy consumed and the average power drawn between
+ * igt_bench_begin() and igt_bench_end(). Benchmarks can sample the energy
+ * of their own intervals with igt_bench_energy_start() and
+ * igt_bench_energy_stop(), to report it per unit of work:
+ *
+ * |[
+ *	struct igt_bench_energy e;
+ *	double J;
+ *
+ *	igt_bench_energy_start(&e);
+ *	copy(bytes);
+ *	J = igt_bench_energy_stop(&e);
+ *	if (!isnan(J))
+ *		igt_bench_value("copy-energy", "J/GB", J / (bytes * 1e-9));
+ * ]|
+ */
+
+static struct {
+	char *name;
+	FILE *params, *results;
+	char *params_buf, *results_buf;
+	size_t params_len, results_len;
+	unsigned int nparams, nresults;
+	struct igt_bench_energy energy;
+} bench;
+
+static struct gpu_power power;
+static int power_err = 1;
+
+static bool power_available(void)
+{
+	/* Opened on first use, and left open until exit */
+	if (power_err > 0)
+		power_err = gpu_power_open(&power);
+
+	return power_err == 0;
+}
+
+static void write_string(FILE *f, const char *str)
+{
+	fputc('"', f);
+	for (; *str; str++) {
+		switch (*str) {
+		case '"':
+			fputs("\\\"", f);
+			break;
+		case '\\':
+			fputs("\\\\", f);
+			break;
+		case '\n':
+			fputs("\\n", f);
+			break;
+		case '\t':
+			fputs("\\t", f);
+			break;
+		default:
+			if ((unsigned char)*str < 0x20)
+				fprintf(f, "\\u%04x", *str);
+			else
+				fputc(*str, f);
+		}
+	}
+	fputc('"', f);
+}
+
+static void write_number(FILE *f, double value)
+{
+	/* JSON has no representation for them. */
+	if (isnan(value) || isinf(value))
+		fputs("null", f);
+	else
+		fprintf(f, "%.15g", value);
+}
+
+static void begin_result(const char *name, const char *unit)
+{
+	FILE *f = bench.results;
+
+	fputs(bench.nresults++ ? ",\n    { " : "\n    { ", f);
+	fputs("\"name\": ", f);
+	write_string(f, name);
+	fputs(", \"unit\": ", f);
+	write_string(f, unit);
+}
+
+/**
+ * igt_bench_begin:
+ * @name: name of the benchmark
+ *
+ * Starts collecting a JSON report, if one was requested with the
+ * IGT_BENCH_JSON environment variable.
+ */
+void igt_bench_begin(const char *name)
+{
+	if (!getenv("IGT_BENCH_JSON"))
+		return;
+
+	igt_assert(!bench.name);
+
+	bench.name = strdup(name);
+	bench.params = open_memstream(&bench.params_buf, &bench.params_len);
+	bench.results = open_memstream(&bench.results_buf, &bench.results_len);
+	igt_assert(bench.name && bench.params && bench.results);
+
+	igt_bench_energy_start(&bench.energy);
+}
+
+/**
+ * igt_bench_enabled:
+ *
+ * Returns: whether a JSON report is being collected, so benchmarks can skip
+ * gathering samples only needed for it.
+ */
+bool igt_bench_enabled(void)
+{
+	return bench.name;
+}
+
+/**
+ * igt_bench_param:
+ * @name: name of the parameter
+ * @format: printf-style format string for the value
+ * @...: optional arguments used in the format string
+ *
+ * Records a parameter the benchmark was run with.
+ */
+void igt_bench_param(const char *name, const char *format, ...)
+{
+	va_list args;
+	char *value;
+	int ret;
+
+	if (!bench.name)
+		return;
+
+	va_start(args, format);
+	ret = vasprintf(&value, format, args);
+	va_end(args);
+	igt_assert(ret >= 0);
+
+	fputs(bench.nparams++ ? ", " : " ", bench.params);
+	write_string(bench.params, name);
+	fputs(": ", bench.params);
+	write_string(bench.params, value);
+
+	free(value);
+}
+
+/**
+ * igt_bench_result:
+ * @name: name of the result
+ * @unit: unit the samples are in
+ * @stats: the samples
+ *
+ * Records a result, with all the samples from @stats and its minimum,
+ * median, 99th percentile and maximum, and the mean with the half-width of
+ * its 95% confidence interval.
+ */
+void igt_bench_result(const char *name, const char *unit, igt_stats_t *stats)
+{
+	FILE *f = bench.results;
+	unsigned int i;
+
+	if (!bench.name)
+		return;
+
+	begin_result(name, unit);
+
+	fputs(", \"samples\": [", f);
+	for (i = 0; i < stats->n_values; i++) {
+		if (i)
+			fputs(", ", f);
+		write_number(f, stats->is_float ?
+			     stats->values_f[i] : stats->values_u64[i]);
+	}
+	fputs("]", f);
+
+	fprintf(f, ", \"count\": %u", stats->n_values);
+	if (stats->n_values > 1) {
+		double half_width;
+
+		fputs(", \"mean\": ", f);
+		write_number(f, igt_bench_ci(stats, &half_width));
+		fputs(", \"ci95\": ", f);
+		write_number(f, half_width);
+	}
+	if (stats->n_values) {
+		fputs(", \"min\": ", f);
+		write_number(f, igt_stats_get_percentile(stats, 0));
+		fputs(", \"median\": ", f);
+		write_number(f, igt_stats_get_median(stats));
+		fputs(", \"p99\": ", f);
+		write_number(f, igt_stats_get_percentile(stats, 99));
+		fputs(", \"max\": ", f);
+		write_number(f, igt_stats_get_percentile(stats, 100));
+	}
+	fputs(" }", f);
+}
+
+/**
+ * igt_bench_histogram:
+ * @name: name of the result
+ * @unit: unit the values are in
+ * @h: the values
+ *
+ * Records a result like igt_bench_result(), from a histogram of the values
+ * instead of every sample: the count, mean, minimum and maximum are exact,
+ * the median and 99th percentile approximate.
+ */
+void igt_bench_histogram(const char *name, const char *unit,
+			 struct igt_histogram *h)
+{
+	FILE *f = bench.results;
+
+	if (!bench.name)
+		return;
+
+	begin_result(name, unit);
+
+	fprintf(f, ", \"count\": %"PRIu64, igt_histogram_get_count(h));
+	if (igt_histogram_get_count(h)) {
+		fputs(", \"mean\": ", f);
+		write_number(f, igt_histogram_get_mean(h));
+		fputs(", \"min\": ", f);
+		write_number(f, igt_histogram_get_min(h));
+		fputs(", \"median\": ", f);
+		write_number(f, igt_histogram_get_median(h));
+		fputs(", \"p99\": ", f);
+		write_number(f, igt_histogram_get_percentile(h, 99));
+		fputs(", \"max\": ", f);
+		write_number(f, igt_histogram_get_max(h));
+	}
+	fputs(" }", f);
+}
+
+/**
+ * igt_bench_value:
+ * @name: name of the result
+ * @unit: unit of @value
+ * @value: the result
+ *
+ * Records a result consisting of a single value.
+ */
+void igt_bench_value(const char *name, const char *unit, double value)
+{
+	FILE *f = bench.results;
+
+	if (!bench.name)
+		return;
+
+	begin_result(name, unit);
+	fputs(", \"value\": ", f);
+	write_number(f, value);
+	fputs(" }", f);
+}
+
+/**
+ * igt_bench_end:
+ *
+ * Writes out the JSON report collected since igt_bench_begin().
+ */
+void igt_bench_end(void)
+{
+	const char *path = getenv("IGT_BENCH_JSON");
+	double energy;
+	FILE *f;
+
+	if (!bench.name)
+		return;
+
+	energy = igt_bench_energy_stop(&bench.energy);
+	if (!isnan(energy)) {
+		igt_bench_value("energy", "J", energy);
+		igt_bench_value("power", "W", igt_bench_energy_W(&bench.energy));
+	}
+
+	fclose(bench.params);
+	fclose(bench.results);
+
+	f = strcmp(path, "-") ? fopen(path, "w") : stdout;
+	if (f) {
+		fputs("{\n  \"benchmark\": ", f);
+		write_string(f, bench.name);
+		fprintf(f, ",\n  \"params\": {%s%s},\n", bench.params_buf,
+			bench.nparams ? " " : "");
+		fprintf(f, "  \"results\": [%s%s]\n}\n", bench.results_buf,
+			bench.nresults ? "\n  " : "");
+
+		if (f == stdout)
+			fflush(f);
+		else
+			fclose(f);
+	} else {
+		igt_warn("Failed to open %s for the benchmark report\n", path);
+	}
+
+	free(bench.params_buf);
+	free(bench.results_buf);
+	free(bench.name);
+	memset(&bench, 0, sizeof(bench));
+}
+
+/**
+ * igt_bench_energy_start:
+ * @e: the interval to start
+ *
+ * Samples the GPU energy counter at the start of an interval. This does not
+ * depend on a JSON report being collected.
+ *
+ * Returns: whether the counter is available, otherwise the interval will
+ * read as NaN.
+ */
+bool igt_bench_energy_start(struct igt_bench_energy *e)
+{
+	memset(e, 0, sizeof(*e));
+
+	if (!power_available())
+		return false;
+
+	return gpu_power_read(&power, &e->start);
+}
+
+/**
+ * igt_bench_energy_stop:
+ * @e: the interval to stop
+ *
+ * Samples the GPU energy counter at the end of the interval started with
+ * igt_bench_energy_start(). The interval may be stopped again later, to
+ * measure a longer one from the same start.
+ *
+ * Returns: The energy consumed over the interval in joules, or NaN if the
+ * counter is not available.
+ */
+double igt_bench_energy_stop(struct igt_bench_energy *e)
+{
+	if (!e->start.time || !gpu_power_read(&power, &e->end)) {
+		memset(&e->end, 0, sizeof(e->end));
+		return NAN;
+	}
+
+	return gpu_power_J(&power, &e->start, &e->end);
+}
+
+/**
+ * igt_bench_energy_W:
+ * @e: a stopped interval
+ *
+ * Returns: The average power drawn over the interval in watts, or NaN if
+ * it was not measured.
+ */
+double igt_bench_energy_W(const struct igt_bench_energy *e)
+{
+	if (!e->end.time || e->end.time == e->start.time)
+		return NAN;
+
+	return gpu_power_W(&power, &e->start, &e->end);
+}
+
+/* Two-sided 95% quantiles of Student's t-distribution, by degrees of freedom */
+static const double t95[] = {
+	[1] = 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+	2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110,
+	2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056,
+	2.052, 2.048, 2.045, 2.042,
+};
+
+/**
+ * igt_bench_ci:
+ * @stats: the samples
+ * @half_width: (out): half-width of the confidence interval
+ *
+ * Computes the 95% confidence interval of the mean of @stats, from the sample
+ * standard deviation.
+ *
+ * Returns: the mean
+ */
+double igt_bench_ci(igt_stats_t *stats, double *half_width)
+{
+	unsigned int df = stats->n_values - 1;
+	double t;
+
+	if (stats->n_values < 2) {
+		*half_width = INFINITY;
+		return stats->n_values ? igt_stats_get_mean(stats) : 0.;
+	}
+
+	t = df < sizeof(t95) / sizeof(t95[0]) ? t95[df] : 1.960;
+	*half_width = t * igt_stats_get_std_deviation(stats) /
+		      sqrt(stats->n_values);
+
+	return igt_stats_get_mean(stats);
+}
+
+static bool is_outlier(igt_stats_t *stats, double value)
+{
+	double q1, q3, iqr;
+
+	igt_stats_get_quartiles(stats, &q1, NULL, &q3);
+	iqr = q3 - q1;
+
+	return value < q1 - 1.5 * iqr || value > q3 + 1.5 * iqr;
+}
+
+static double first_value(igt_stats_t *stats)
+{
+	return stats->is_float ? stats->values_f[0] : stats->values_u64[0];
+}
+
+static void drop_first(igt_stats_t *stats)
+{
+	igt_stats_t tmp;
+	unsigned int n;
+
+	igt_stats_init_with_size(&tmp, stats->n_values);
+	for (n = 1; n < stats->n_values; n++) {
+		if (stats->is_float)
+			igt_stats_push_float(&tmp, stats->values_f[n]);
+		else
+			igt_stats_push(&tmp, stats->values_u64[n]);
+	}
+
+	igt_stats_fini(stats);
+	*stats = tmp;
+}
+
+/**
+ * igt_bench_unstable:
+ * @stats: the samples measured so far, one per round
+ * @s: the stability criteria
+ *
+ * Decides whether another measurement round is needed. Leading rounds which
+ * are outliers compared to the rest, by Tukey's fences, are dropped from
+ * @stats as warm-up. The remaining rounds are stable once the 95% confidence
+ * interval of their mean is within @s->target of it.
+ *
+ * On return @s->rejected and @s->ci report the rounds rejected so far and
+ * the current relative half-width of the confidence interval.
+ *
+ * Returns: true if another round should be measured, false when the samples
+ * are stable or @s->max_rounds have been measured.
+ */
+bool igt_bench_unstable(igt_stats_t *stats, struct igt_bench_stability *s)
+{
+	double mean, half_width;
+
+	/* Quartiles need a few samples to be meaningful. */
+	while (stats->n_values >= 4 && is_outlier(stats, first_value(stats))) {
+		drop_first(stats);
+		s->rejected++;
+	}
+
+	mean = igt_bench_ci(stats, &half_width);
+	s->ci = mean ? half_width / fabs(mean) : half_width ? INFINITY : 0.;
+
+	if (stats->n_values + s->rejected >= s->max_rounds)
+		return false;
+
+	if (stats->n_values < s->min_rounds || stats->n_values < 2)
+		return true;
+
+	return s->ci > s->target;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __IGT_BENCH_H__
+#define __IGT_BENCH_H__
+
+#include <stdbool.h>
+
+#include "igt_gpu_power.h"
+#include "igt_stats.h"
+
+void igt_bench_begin(const char *name);
+bool igt_bench_enabled(void);
+void igt_bench_param(const char *name, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+void igt_bench_result(const char *name, const char *unit, igt_stats_t *stats);
+void igt_bench_histogram(const char *name, const char *unit,
+			 struct igt_histogram *h);
+void igt_bench_value(const char *name, const char *unit, double value);
+void igt_bench_end(void);
+
+/**
+ * igt_bench_stability:
+ * @target: largest acceptable half-width of the 95% confidence interval of
+ *	    the mean, relative to the mean, e.g 0.01 for +-1%
+ * @min_rounds: least number of rounds to measure
+ * @max_rounds: most number of rounds to measure, including rejected ones
+ * @rejected: (out): number of leading rounds rejected as warm-up outliers
+ * @ci: (out): relative half-width of the confidence interval reached
+ */
+struct igt_bench_stability {
+	double target;
+	unsigned int min_rounds;
+	unsigned int max_rounds;
+
+	unsigned int rejected;
+	double ci;
+};
+
+double igt_bench_ci(igt_stats_t *stats, double *half_width);
+bool igt_bench_unstable(igt_stats_t *stats, struct igt_bench_stability *s);
+
+/**
+ * igt_bench_energy:
+ * @start: GPU energy counter sampled by igt_bench_energy_start()
+ * @end: GPU energy counter sampled by igt_bench_energy_stop()
+ */
+struct igt_bench_energy {
+	struct gpu_power_sample start;
+	struct gpu_power_sample end;
+};
+
+bool igt_bench_energy_start(struct igt_bench_energy *e);
+double igt_bench_energy_stop(struct igt_bench_energy *e);
+double igt_bench_energy_W(const struct igt_bench_energy *e);
+
+#endif /* __IGT_BENCH_H__ */
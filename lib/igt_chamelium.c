@@ -35,7 +35,9 @@
 #include <glib.h>
 #include <pixman.h>
 #include <cairo.h>
+#include <unistd.h>
 
+#include "drmtest.h"
 #include "igt_chamelium.h"
 #include "igt_core.h"
 #include "igt_aux.h"
@@ -90,6 +92,15 @@ struct chamelium_edid {
 	struct igt_list link;
 };
 
+/* An EDID blob already created on the board, shared by identical EDIDs. */
+struct chamelium_uploaded_edid {
+	uint32_t hash;
+	size_t size;
+	struct edid *raw;
+	int id;
+	struct igt_list link;
+};
+
 struct chamelium_port {
 	unsigned int type;
 	int id;
@@ -120,9 +131,21 @@ struct chamelium {
 	/* Indicates the last port to have been used for capturing video */
 	struct chamelium_port *capturing_port;
 
+	/* Resolution of the last capture, valid until the next one */
+	bool has_captured_resolution;
+	int captured_width, captured_height;
+
+	/* Answers of chamelium_supports_method(), they can't change */
+	struct {
+		const char *name;
+		bool supported;
+	} methods[8];
+	int method_count;
+
 	int drm_fd;
 
 	struct igt_list edids;
+	struct igt_list uploaded_edids;
 	struct chamelium_port ports[CHAMELIUM_MAX_PORTS];
 	int port_count;
 };
@@ -552,17 +575,53 @@ void chamelium_schedule_hpd_toggle(struct chamelium *chamelium,
 				    "(iii)", port->id, delay_ms, rising_edge));
 }
 
+/* FNV-1a, only used to speed up the lookup of uploaded EDIDs. */
+static uint32_t chamelium_edid_hash(const struct edid *edid, size_t size)
+{
+	const uint8_t *data = (const uint8_t *) edid;
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		hash = (hash ^ data[i]) * 16777619u;
+
+	return hash;
+}
+
+/*
+ * Creates the EDID on the board, unless an identical one has already been
+ * created during this session, in which case its ID is reused.
+ */
 static int chamelium_upload_edid(struct chamelium *chamelium,
 				 const struct edid *edid)
 {
+	struct chamelium_uploaded_edid *uploaded;
+	size_t size = edid_get_size(edid);
+	uint32_t hash = chamelium_edid_hash(edid, size);
 	xmlrpc_value *res;
 	int edid_id;
 
+	igt_list_for_each(uploaded, &chamelium->uploaded_edids, link) {
+		if (uploaded->hash == hash && uploaded->size == size &&
+		    memcmp(uploaded->raw, edid, size) == 0)
+			return uploaded->id;
+	}
+
 	res = chamelium_rpc(chamelium, NULL, "CreateEdid", "(6)",
-			    edid, edid_get_size(edid));
+			    edid, size);
 	xmlrpc_read_int(&chamelium->env, res, &edid_id);
 	xmlrpc_DECREF(res);
 
+	uploaded = calloc(1, sizeof(*uploaded));
+	igt_assert(uploaded);
+	uploaded->hash = hash;
+	uploaded->size = size;
+	uploaded->raw = malloc(size);
+	igt_assert(uploaded->raw);
+	memcpy(uploaded->raw, edid, size);
+	uploaded->id = edid_id;
+	igt_list_add(&uploaded->link, &chamelium->uploaded_edids);
+
 	return edid_id;
 }
 
@@ -578,7 +637,9 @@ static void chamelium_destroy_edid(struct chamelium *chamelium, int edid_id)
  * @edid: The edid blob to upload to the chamelium
  *
  * Uploads and registers a new EDID with the chamelium. The EDID will be
- * destroyed automatically when #chamelium_deinit is called.
+ * destroyed automatically when #chamelium_deinit is called. EDIDs with the
+ * same content share a single blob on the Chamelium, so registering the same
+ * EDID more than once is cheap.
  *
  * Callers shouldn't assume that the raw EDID they provide is uploaded as-is to
  * the Chamelium. The EDID may be mutated (e.g. a serial number can be appended
@@ -772,6 +833,11 @@ static bool chamelium_supports_method(struct chamelium *chamelium,
 				      const char *name)
 {
 	xmlrpc_value *res;
+	bool supported;
+
+	for (int i = 0; i < chamelium->method_count; i++)
+		if (strcmp(chamelium->methods[i].name, name) == 0)
+			return chamelium->methods[i].supported;
 
 	res = __chamelium_rpc(chamelium, NULL, name, "()");
 	if (res)
@@ -780,8 +846,17 @@ static bool chamelium_supports_method(struct chamelium *chamelium,
 	/* XML-RPC has a special code for unsupported methods
 	 * (XMLRPC_NO_SUCH_METHOD_ERROR) however the Chamelium implementation
 	 * doesn't return it. */
-	return (!chamelium->env.fault_occurred ||
-		strstr(chamelium->env.fault_string, "not supported") == NULL);
+	supported = (!chamelium->env.fault_occurred ||
+		     strstr(chamelium->env.fault_string, "not supported") == NULL);
+
+	/* Only called with string literals, no need to copy @name */
+	if (chamelium->method_count < ARRAY_SIZE(chamelium->methods)) {
+		chamelium->methods[chamelium->method_count].name = name;
+		chamelium->methods[chamelium->method_count].supported = supported;
+		chamelium->method_count++;
+	}
+
+	return supported;
 }
 
 bool chamelium_supports_get_video_params(struct chamelium *chamelium)
@@ -851,6 +926,13 @@ static void chamelium_get_captured_resolution(struct chamelium *chamelium,
 {
 	xmlrpc_value *res, *res_w, *res_h;
 
+	/* All frames of one capture share the resolution, ask only once */
+	if (chamelium->has_captured_resolution) {
+		*w = chamelium->captured_width;
+		*h = chamelium->captured_height;
+		return;
+	}
+
 	res = chamelium_rpc(chamelium, NULL, "GetCapturedResolution", "()");
 
 	xmlrpc_array_read_item(&chamelium->env, res, 0, &res_w);
@@ -861,6 +943,10 @@ static void chamelium_get_captured_resolution(struct chamelium *chamelium,
 	xmlrpc_DECREF(res_w);
 	xmlrpc_DECREF(res_h);
 	xmlrpc_DECREF(res);
+
+	chamelium->captured_width = *w;
+	chamelium->captured_height = *h;
+	chamelium->has_captured_resolution = true;
 }
 
 static struct chamelium_frame_dump *frame_from_xml(struct chamelium *chamelium,
@@ -918,6 +1004,7 @@ struct chamelium_frame_dump *chamelium_port_dump_pixels(struct chamelium *chamel
 			    (w && h) ? "(iiiii)" : "(innnn)",
 			    port->id, x, y, w, h);
 	chamelium->capturing_port = port;
+	chamelium->has_captured_resolution = false;
 
 	frame = frame_from_xml(chamelium, res);
 	xmlrpc_DECREF(res);
@@ -980,6 +1067,7 @@ igt_crc_t *chamelium_get_crc_for_area(struct chamelium *chamelium,
 			    (w && h) ? "(iiiii)" : "(innnn)",
 			    port->id, x, y, w, h);
 	chamelium->capturing_port = port;
+	chamelium->has_captured_resolution = false;
 
 	crc_from_xml(chamelium, res, ret);
 	xmlrpc_DECREF(res);
@@ -1018,6 +1106,7 @@ void chamelium_start_capture(struct chamelium *chamelium,
 				    (w && h) ? "(iiiii)" : "(innnn)",
 				    port->id, x, y, w, h));
 	chamelium->capturing_port = port;
+	chamelium->has_captured_resolution = false;
 }
 
 /**
@@ -1067,6 +1156,7 @@ void chamelium_capture(struct chamelium *chamelium, struct chamelium_port *port,
 				    (w && h) ? "(iiiiii)" : "(iinnnn)",
 				    port->id, frame_count, x, y, w, h));
 	chamelium->capturing_port = port;
+	chamelium->has_captured_resolution = false;
 }
 
 /**
@@ -1518,6 +1608,236 @@ void chamelium_assert_frame_eq(const struct chamelium *chamelium,
 		      "Chamelium frame dump didn't match reference image\n");
 }
 
+struct chamelium_frame_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t *workers;
+	int worker_count;
+
+	/* Reference image, in the format of the chamelium frame dumps */
+	pixman_image_t *reference;
+	size_t size;
+	int width, height;
+	cairo_surface_t *reference_surface;
+
+	struct chamelium_frame_dump **pending;
+	int depth, head, count, busy;
+	int next_index;
+	bool finished;
+
+	int checked, mismatched;
+	int first_mismatch;
+	struct chamelium_frame_dump *mismatch;
+};
+
+static bool frame_queue_match(struct chamelium_frame_queue *queue,
+			      const struct chamelium_frame_dump *dump)
+{
+	return dump->width == queue->width && dump->height == queue->height &&
+	       dump->size == queue->size &&
+	       memcmp(dump->bgr, pixman_image_get_data(queue->reference),
+		      dump->size) == 0;
+}
+
+static void *frame_queue_work(void *data)
+{
+	struct chamelium_frame_queue *queue = data;
+	struct chamelium_frame_dump *dump;
+	int index;
+	bool match;
+
+	pthread_mutex_lock(&queue->lock);
+	for (;;) {
+		while (!queue->count && !queue->finished)
+			pthread_cond_wait(&queue->cond, &queue->lock);
+		if (!queue->count)
+			break;
+
+		dump = queue->pending[queue->head];
+		index = queue->next_index - queue->count;
+		queue->head = (queue->head + 1) % queue->depth;
+		queue->count--;
+		queue->busy++;
+		pthread_cond_broadcast(&queue->cond);
+		pthread_mutex_unlock(&queue->lock);
+
+		match = frame_queue_match(queue, dump);
+
+		pthread_mutex_lock(&queue->lock);
+		queue->busy--;
+		queue->checked++;
+		if (!match) {
+			queue->mismatched++;
+			if (!queue->mismatch || index < queue->first_mismatch) {
+				/* Keep the earliest mismatch for dumping */
+				if (queue->mismatch)
+					chamelium_destroy_frame_dump(queue->mismatch);
+				queue->mismatch = dump;
+				queue->first_mismatch = index;
+				dump = NULL;
+			}
+		}
+		pthread_cond_broadcast(&queue->cond);
+
+		if (dump)
+			chamelium_destroy_frame_dump(dump);
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return NULL;
+}
+
+/**
+ * chamelium_frame_queue_create:
+ * @chamelium: The chamelium instance the frame dumps will come from
+ * @fb: The framebuffer to check the frame dumps against
+ * @depth: The most frame dumps waiting to be compared at any time
+ *
+ * Sets up a pipeline which compares chamelium frame dumps against @fb on
+ * worker threads, so that the caller can capture and download the next
+ * frames from the Chamelium in the meantime. Frame dumps are handed over
+ * with #chamelium_frame_queue_push, and the results are checked with
+ * #chamelium_frame_queue_finish.
+ *
+ * The reference image is copied, so @fb may be removed before finishing
+ * the queue.
+ *
+ * Returns: the frame queue
+ */
+struct chamelium_frame_queue *
+chamelium_frame_queue_create(struct chamelium *chamelium, struct igt_fb *fb,
+			     int depth)
+{
+	struct chamelium_frame_queue *queue;
+	cairo_surface_t *fb_surface;
+	pixman_image_t *reference_src;
+	long cpus;
+
+	igt_assert(depth > 0);
+
+	queue = calloc(1, sizeof(*queue));
+	igt_assert(queue);
+
+	fb_surface = igt_get_cairo_surface(chamelium->drm_fd, fb);
+	queue->width = cairo_image_surface_get_width(fb_surface);
+	queue->height = cairo_image_surface_get_height(fb_surface);
+
+	/* Convert the reference only once, rather than for every frame */
+	reference_src = pixman_image_create_bits(
+	    PIXMAN_x8r8g8b8, queue->width, queue->height,
+	    (void*)cairo_image_surface_get_data(fb_surface),
+	    cairo_image_surface_get_stride(fb_surface));
+	queue->reference = convert_frame_format(reference_src, PIXMAN_b8g8r8);
+	queue->size = (size_t)pixman_image_get_stride(queue->reference) *
+		      queue->height;
+	pixman_image_unref(reference_src);
+
+	if (igt_frame_dump_is_enabled()) {
+		cairo_t *cr;
+
+		queue->reference_surface =
+			cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+						   queue->width, queue->height);
+		cr = cairo_create(queue->reference_surface);
+		cairo_set_source_surface(cr, fb_surface, 0, 0);
+		cairo_paint(cr);
+		cairo_destroy(cr);
+	}
+
+	queue->depth = depth;
+	queue->pending = calloc(depth, sizeof(*queue->pending));
+	igt_assert(queue->pending);
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	queue->worker_count = depth;
+	if (cpus > 0 && cpus < depth)
+		queue->worker_count = cpus;
+	queue->workers = calloc(queue->worker_count, sizeof(*queue->workers));
+	igt_assert(queue->workers);
+
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->cond, NULL);
+
+	for (int i = 0; i < queue->worker_count; i++)
+		igt_assert_eq(pthread_create(&queue->workers[i], NULL,
+					     frame_queue_work, queue), 0);
+
+	return queue;
+}
+
+/**
+ * chamelium_frame_queue_push:
+ * @queue: The frame queue
+ * @dump: The chamelium frame dump to compare
+ *
+ * Queues @dump for comparison against the reference of @queue, and takes
+ * ownership of it. This blocks while the queue is full.
+ */
+void chamelium_frame_queue_push(struct chamelium_frame_queue *queue,
+				struct chamelium_frame_dump *dump)
+{
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == queue->depth)
+		pthread_cond_wait(&queue->cond, &queue->lock);
+
+	queue->pending[(queue->head + queue->count) % queue->depth] = dump;
+	queue->count++;
+	queue->next_index++;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * chamelium_frame_queue_finish:
+ * @queue: The frame queue
+ *
+ * Waits for all queued frame dumps to be compared, frees @queue and
+ * asserts that all of them matched the reference. If frame dumping is
+ * enabled, the first frame dump which did not match is saved along with
+ * the reference to a png file.
+ */
+void chamelium_frame_queue_finish(struct chamelium_frame_queue *queue)
+{
+	int checked, mismatched, first_mismatch;
+
+	pthread_mutex_lock(&queue->lock);
+	queue->finished = true;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+
+	for (int i = 0; i < queue->worker_count; i++)
+		pthread_join(queue->workers[i], NULL);
+
+	if (queue->mismatch && queue->reference_surface) {
+		cairo_surface_t *capture;
+
+		capture = convert_frame_dump_argb32(queue->mismatch);
+		compared_frames_dump(queue->reference_surface, capture,
+				     NULL, NULL);
+		cairo_surface_destroy(capture);
+	}
+
+	checked = queue->checked;
+	mismatched = queue->mismatched;
+	first_mismatch = queue->first_mismatch;
+
+	if (queue->mismatch)
+		chamelium_destroy_frame_dump(queue->mismatch);
+	if (queue->reference_surface)
+		cairo_surface_destroy(queue->reference_surface);
+	pixman_image_unref(queue->reference);
+	pthread_cond_destroy(&queue->cond);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->workers);
+	free(queue->pending);
+	free(queue);
+
+	igt_debug("Compared %d chamelium frame dumps\n", checked);
+	igt_fail_on_f(mismatched,
+		      "%d of %d chamelium frame dumps didn't match reference image, first was #%d\n",
+		      mismatched, checked, first_mismatch);
+}
+
 /**
  * chamelium_assert_crc_eq_or_dump:
  * @chamelium: The chamelium instance the frame dump belongs to
@@ -1566,6 +1886,59 @@ void chamelium_assert_crc_eq_or_dump(struct chamelium *chamelium,
 	igt_assert(eq);
 }
 
+/**
+ * chamelium_assert_crcs_eq_or_dump:
+ * @chamelium: The chamelium instance the CRCs were captured with
+ * @reference_crcs: The CRCs of the reference frames
+ * @reference_count: The number of reference CRCs
+ * @capture_crcs: The CRCs of the captured frames, as returned by
+ * #chamelium_read_captured_crcs
+ * @count: The number of captured CRCs
+ * @fb: pointer to the #igt_fb the reference CRCs were calculated from, or NULL
+ *
+ * Asserts that each captured CRC is identical to its reference CRC, where
+ * captured frame i is checked against reference i % @reference_count. This
+ * allows checking a whole capture against a single reference, or against a
+ * repeating sequence of them, at once. If there are mismatches, the first
+ * mismatching frame is saved along with the reference from @fb to a png
+ * file, like #chamelium_assert_crc_eq_or_dump does.
+ */
+void chamelium_assert_crcs_eq_or_dump(struct chamelium *chamelium,
+				      igt_crc_t *reference_crcs,
+				      int reference_count,
+				      igt_crc_t *capture_crcs, int count,
+				      struct igt_fb *fb)
+{
+	int first = -1, mismatched = 0;
+
+	igt_assert(reference_count > 0);
+
+	for (int i = 0; i < count; i++) {
+		if (igt_check_crc_equal(&reference_crcs[i % reference_count],
+					&capture_crcs[i]))
+			continue;
+
+		if (first < 0)
+			first = i;
+		mismatched++;
+	}
+
+	if (!mismatched)
+		return;
+
+	igt_debug("%d of %d captured CRCs didn't match, first was #%d\n",
+		  mismatched, count, first);
+
+	if (fb)
+		chamelium_assert_crc_eq_or_dump(chamelium,
+						&reference_crcs[first % reference_count],
+						&capture_crcs[first], fb,
+						first);
+
+	igt_fail_on_f(mismatched, "%d of %d captured CRCs didn't match\n",
+		      mismatched, count);
+}
+
 /**
  * chamelium_assert_frame_match_or_dump:
  * @chamelium: The chamelium instance the frame dump belongs to
@@ -1756,52 +2129,125 @@ int chamelium_get_frame_limit(struct chamelium *chamelium,
 	return ret;
 }
 
-static uint32_t chamelium_xrgb_hash16(const unsigned char *buffer, int width,
-				      int height, int k, int m)
+/*
+ * The Chamelium hashes every 4th pixel into each of its 4 CRC words, with
+ * each pixel weighted by its position within that word's pixels. All four
+ * words are computed in a single pass, split into chunks which can be
+ * hashed in parallel: a chunk starting at pixel @first (a multiple of 4)
+ * contributes sum + first / 4 * value_sum to the total sums.
+ */
+struct xrgb_hash16_chunk {
+	const unsigned char *buffer;
+	int first, last;
+	uint64_t sum[4];
+	uint64_t value_sum[4];
+};
+
+static inline uint64_t xrgb_hash16_value(const unsigned char *p)
+{
+	return p[2] | (p[1] << 8) | (p[0] << 16);
+}
+
+static void *chamelium_xrgb_hash16_chunk(void *data)
 {
-	unsigned char r, g, b;
-	uint64_t sum = 0;
+	struct xrgb_hash16_chunk *chunk = data;
+	const unsigned char *p = chunk->buffer + (size_t)chunk->first * 4;
+	uint64_t sum[4] = {}, value_sum[4] = {};
 	uint64_t count = 0;
-	uint64_t value;
-	uint32_t hash;
-	int index;
-	int i;
+	int i, k;
 
-	for (i=0; i < width * height; i++) {
-		if ((i % m) != k)
-			continue;
+	for (i = chunk->first; i + 4 <= chunk->last; i += 4, p += 16) {
+		count++;
+		for (k = 0; k < 4; k++) {
+			uint64_t value = xrgb_hash16_value(p + k * 4);
 
-		index = i * 4;
+			sum[k] += count * value;
+			value_sum[k] += value;
+		}
+	}
 
-		r = buffer[index + 2];
-		g = buffer[index + 1];
-		b = buffer[index + 0];
+	count++;
+	for (k = 0; i < chunk->last; i++, k++, p += 4) {
+		uint64_t value = xrgb_hash16_value(p);
 
-		value = r | (g << 8) | (b << 16);
-		sum += ++count * value;
+		sum[k] += count * value;
+		value_sum[k] += value;
 	}
 
-	hash = ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+	memcpy(chunk->sum, sum, sizeof(sum));
+	memcpy(chunk->value_sum, value_sum, sizeof(value_sum));
 
-	return hash;
+	return NULL;
+}
+
+#define XRGB_HASH16_MAX_CHUNKS 8
+#define XRGB_HASH16_MIN_CHUNK (256 * 1024)
+
+static void chamelium_xrgb_hash16(const unsigned char *buffer, int width,
+				  int height, uint16_t hash[4])
+{
+	struct xrgb_hash16_chunk chunks[XRGB_HASH16_MAX_CHUNKS] = {};
+	pthread_t threads[XRGB_HASH16_MAX_CHUNKS];
+	bool threaded[XRGB_HASH16_MAX_CHUNKS] = {};
+	int pixels = width * height;
+	uint64_t sum[4] = {};
+	int n, per_chunk;
+	long cpus;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	n = pixels / XRGB_HASH16_MIN_CHUNK;
+	n = max(min(n, XRGB_HASH16_MAX_CHUNKS), 1);
+	if (cpus > 0 && cpus < n)
+		n = cpus;
+
+	per_chunk = ALIGN(DIV_ROUND_UP(pixels, n), 4);
+
+	for (int c = 0; c < n; c++) {
+		chunks[c].buffer = buffer;
+		chunks[c].first = min(c * per_chunk, pixels);
+		chunks[c].last = min((c + 1) * per_chunk, pixels);
+
+		/* The first chunk is hashed on this thread */
+		if (c)
+			threaded[c] = !pthread_create(&threads[c], NULL,
+						      chamelium_xrgb_hash16_chunk,
+						      &chunks[c]);
+	}
+
+	for (int c = 0; c < n; c++) {
+		if (threaded[c])
+			pthread_join(threads[c], NULL);
+		else
+			chamelium_xrgb_hash16_chunk(&chunks[c]);
+
+		for (int k = 0; k < 4; k++)
+			sum[k] += chunks[c].sum[k] +
+				  chunks[c].first / 4 * chunks[c].value_sum[k];
+	}
+
+	for (int k = 0; k < 4; k++)
+		hash[k] = ((sum[k] >> 0) ^ (sum[k] >> 16) ^
+			   (sum[k] >> 32) ^ (sum[k] >> 48)) & 0xffff;
 }
 
 static void chamelium_do_calculate_fb_crc(cairo_surface_t *fb_surface,
 					  igt_crc_t *out)
 {
 	unsigned char *buffer;
+	uint16_t hash[4];
 	int n = 4;
 	int w, h;
-	int i, j;
+	int i;
 
 	buffer = cairo_image_surface_get_data(fb_surface);
 	w = cairo_image_surface_get_width(fb_surface);
 	h = cairo_image_surface_get_height(fb_surface);
 
-	for (i = 0; i < n; i++) {
-		j = n - i - 1;
-		out->crc[i] = chamelium_xrgb_hash16(buffer, w, h, j, n);
-	}
+	chamelium_xrgb_hash16(buffer, w, h, hash);
+
+	/* The words are in reverse order of the pixels they hash */
+	for (i = 0; i < n; i++)
+		out->crc[i] = hash[n - i - 1];
 
 	out->n_words = n;
 }
@@ -2337,6 +2783,7 @@ struct chamelium *chamelium_init(int drm_fd)
 	memset(chamelium, 0, sizeof(*chamelium));
 	chamelium->drm_fd = drm_fd;
 	igt_list_init(&chamelium->edids);
+	igt_list_init(&chamelium->uploaded_edids);
 
 	/* Setup the libxmlrpc context */
 	xmlrpc_env_init(&chamelium->env);
@@ -2378,6 +2825,7 @@ void chamelium_deinit(struct chamelium *chamelium)
 {
 	int i;
 	struct chamelium_edid *pos, *tmp;
+	struct chamelium_uploaded_edid *uploaded, *next;
 
 	/* We want to make sure we leave all of the ports plugged in, since
 	 * testing setups requiring multiple monitors are probably using the
@@ -2388,12 +2836,16 @@ void chamelium_deinit(struct chamelium *chamelium)
 		chamelium_plug(chamelium, &chamelium->ports[i]);
 
 	/* Destroy any EDIDs we created to make sure we don't leak them */
+	igt_list_for_each_safe(uploaded, next, &chamelium->uploaded_edids,
+			       link) {
+		chamelium_destroy_edid(chamelium, uploaded->id);
+		free(uploaded->raw);
+		free(uploaded);
+	}
+
 	igt_list_for_each_safe(pos, tmp, &chamelium->edids, link) {
-		for (i = 0; i < CHAMELIUM_MAX_PORTS; i++) {
-			if (pos->ids[i])
-				chamelium_destroy_edid(chamelium, pos->ids[i]);
+		for (i = 0; i < CHAMELIUM_MAX_PORTS; i++)
 			free(pos->raw[i]);
-		}
 		free(pos->base);
 		free(pos);
 	}
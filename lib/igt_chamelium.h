@@ -40,6 +40,7 @@ struct chamelium;
 struct chamelium_port;
 struct chamelium_frame_dump;
 struct chamelium_fb_crc_async_data;
+struct chamelium_frame_queue;
 
 /**
  * chamelium_check:
@@ -199,11 +200,22 @@ void chamelium_assert_crc_eq_or_dump(struct chamelium *chamelium,
 				     igt_crc_t *reference_crc,
 				     igt_crc_t *capture_crc, struct igt_fb *fb,
 				     int index);
+void chamelium_assert_crcs_eq_or_dump(struct chamelium *chamelium,
+				      igt_crc_t *reference_crcs,
+				      int reference_count,
+				      igt_crc_t *capture_crcs, int count,
+				      struct igt_fb *fb);
 void chamelium_assert_frame_match_or_dump(struct chamelium *chamelium,
 					  struct chamelium_port *port,
 					  const struct chamelium_frame_dump *frame,
 					  struct igt_fb *fb,
 					  enum chamelium_check check);
+struct chamelium_frame_queue *
+chamelium_frame_queue_create(struct chamelium *chamelium, struct igt_fb *fb,
+			     int depth);
+void chamelium_frame_queue_push(struct chamelium_frame_queue *queue,
+				struct chamelium_frame_dump *dump);
+void chamelium_frame_queue_finish(struct chamelium_frame_queue *queue);
 void chamelium_crop_analog_frame(struct chamelium_frame_dump *dump, int width,
 				 int height);
 void chamelium_destroy_frame_dump(struct chamelium_frame_dump *dump);
@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "igt_chamelium_stream.h"
 #include "igt_core.h"
@@ -413,34 +414,18 @@ bool chamelium_stream_dump_realtime_audio(struct chamelium_stream *client,
 				     req, sizeof(req), NULL, 0);
 }
 
-/**
- * chamelium_stream_receive_realtime_audio:
- * @page_count: if non-NULL, will be set to the dumped page number
- * @buf: must either point to a dynamically allocated memory region or NULL
- * @buf_len: number of elements of *@buf, for zero if @buf is NULL
- *
- * Receives one audio page from the streaming server.
- *
- * In "best effort" mode, some pages can be dropped. This can be detected via
- * the page count.
- *
- * buf_len will be set to the size of the page. The caller is responsible for
- * calling free(3) on *buf.
- */
-bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
-					     size_t *page_count,
-					     int32_t **buf, size_t *buf_len)
+/* Reads the header of the next real-time audio page, skipping dropped ones.
+ * @body_len is set to the size of the page, without the page count. */
+static bool chamelium_stream_read_audio_header(struct chamelium_stream *client,
+					       size_t *body_len)
 {
 	enum stream_message_kind kind;
 	enum stream_message_type type;
 	enum stream_error err;
-	size_t body_len;
-	char page_count_buf[4];
-	int32_t *ptr;
 
 	while (true) {
 		if (!chamelium_stream_read_header(client, &kind, &type,
-						  &err, &body_len))
+						  &err, body_len))
 			return false;
 
 		if (kind != STREAM_MESSAGE_DATA) {
@@ -462,16 +447,44 @@ bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
 		}
 
 		igt_debug("Dropped an audio page because of an overflow\n");
-		igt_assert(body_len == 0);
+		igt_assert(*body_len == 0);
 	}
 
-	igt_assert(body_len >= sizeof(page_count_buf));
+	igt_assert(*body_len >= sizeof(uint32_t));
+	*body_len -= sizeof(uint32_t);
+
+	return true;
+}
+
+/**
+ * chamelium_stream_receive_realtime_audio:
+ * @page_count: if non-NULL, will be set to the dumped page number
+ * @buf: must either point to a dynamically allocated memory region or NULL
+ * @buf_len: number of elements of *@buf, for zero if @buf is NULL
+ *
+ * Receives one audio page from the streaming server.
+ *
+ * In "best effort" mode, some pages can be dropped. This can be detected via
+ * the page count.
+ *
+ * buf_len will be set to the size of the page. The caller is responsible for
+ * calling free(3) on *buf.
+ */
+bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
+					     size_t *page_count,
+					     int32_t **buf, size_t *buf_len)
+{
+	size_t body_len;
+	char page_count_buf[4];
+	int32_t *ptr;
+
+	if (!chamelium_stream_read_audio_header(client, &body_len))
+		return false;
 
 	if (!read_whole(client->fd, page_count_buf, sizeof(page_count_buf)))
 		return false;
 	if (page_count)
 		*page_count = ntohl(*(uint32_t *) &page_count_buf[0]);
-	body_len -= sizeof(page_count_buf);
 
 	igt_assert(body_len % sizeof(int32_t) == 0);
 	if (*buf_len * sizeof(int32_t) != body_len) {
@@ -487,6 +500,180 @@ bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
 	return read_whole(client->fd, *buf, body_len);
 }
 
+struct chamelium_stream_audio_ring {
+	int32_t *samples;
+	size_t len;
+	/* Number of samples received and consumed since creation */
+	size_t head, tail;
+};
+
+/**
+ * chamelium_stream_audio_ring_create:
+ * @len: capacity of the ring, in samples of all channels
+ *
+ * Allocates a ring buffer for #chamelium_stream_receive_realtime_audio_ring.
+ * @len must be a multiple of the number of captured channels, so that all
+ * channels of a frame are always contiguous.
+ */
+struct chamelium_stream_audio_ring *chamelium_stream_audio_ring_create(size_t len)
+{
+	struct chamelium_stream_audio_ring *ring;
+
+	igt_assert(len > 0);
+
+	ring = calloc(1, sizeof(*ring));
+	igt_assert(ring);
+
+	ring->samples = malloc(len * sizeof(int32_t));
+	igt_assert(ring->samples);
+	ring->len = len;
+
+	return ring;
+}
+
+void chamelium_stream_audio_ring_destroy(struct chamelium_stream_audio_ring *ring)
+{
+	if (!ring)
+		return;
+
+	free(ring->samples);
+	free(ring);
+}
+
+/**
+ * chamelium_stream_audio_ring_peek:
+ * @ring: the ring buffer
+ * @len: set to the number of samples available at the returned address
+ *
+ * Returns the oldest unconsumed samples of @ring, without copying them. If
+ * the unconsumed samples wrap around the end of the ring, only the part
+ * up to the end is returned; consuming it makes the rest available.
+ *
+ * Returns: a pointer to the samples, interleaved as received
+ */
+const int32_t *chamelium_stream_audio_ring_peek(struct chamelium_stream_audio_ring *ring,
+						size_t *len)
+{
+	size_t start = ring->tail % ring->len;
+
+	*len = ring->head - ring->tail;
+	if (*len > ring->len - start)
+		*len = ring->len - start;
+
+	return &ring->samples[start];
+}
+
+/**
+ * chamelium_stream_audio_ring_consume:
+ * @ring: the ring buffer
+ * @len: number of samples to release
+ *
+ * Releases the oldest @len samples of @ring, making room for new pages.
+ */
+void chamelium_stream_audio_ring_consume(struct chamelium_stream_audio_ring *ring,
+					 size_t len)
+{
+	igt_assert(len <= ring->head - ring->tail);
+	ring->tail += len;
+}
+
+static bool recv_whole_iov(int fd, struct iovec *iov, int iov_count)
+{
+	struct msghdr msg = {
+		.msg_iov = iov,
+		.msg_iovlen = iov_count,
+	};
+	ssize_t ret;
+
+	while (msg.msg_iovlen) {
+		ret = recvmsg(fd, &msg, MSG_WAITALL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			igt_warn("recvmsg failed: %s\n", strerror(errno));
+			return false;
+		} else if (ret == 0) {
+			igt_warn("short read\n");
+			return false;
+		}
+
+		/* Interrupted or timed out half-way, skip what we got */
+		while (msg.msg_iovlen && ret >= msg.msg_iov->iov_len) {
+			ret -= msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+		if (msg.msg_iovlen) {
+			msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + ret;
+			msg.msg_iov->iov_len -= ret;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * chamelium_stream_receive_realtime_audio_ring:
+ * @page_count: if non-NULL, will be set to the dumped page number
+ * @ring: ring buffer to receive the page into
+ *
+ * Receives one audio page from the streaming server, like
+ * #chamelium_stream_receive_realtime_audio, but straight into the free
+ * space of @ring instead of an intermediate buffer. The samples can then
+ * be processed in place with #chamelium_stream_audio_ring_peek.
+ *
+ * Fails if @ring doesn't have enough room for the page.
+ */
+bool chamelium_stream_receive_realtime_audio_ring(struct chamelium_stream *client,
+						  size_t *page_count,
+						  struct chamelium_stream_audio_ring *ring)
+{
+	char page_count_buf[4];
+	struct iovec iov[3];
+	size_t body_len, len, start, first;
+	int iov_count = 1;
+
+	if (!chamelium_stream_read_audio_header(client, &body_len))
+		return false;
+
+	igt_assert(body_len % sizeof(int32_t) == 0);
+	len = body_len / sizeof(int32_t);
+	if (len > ring->len - (ring->head - ring->tail)) {
+		igt_warn("Audio ring buffer overflow (page of %zu samples, "
+			 "%zu free)\n", len,
+			 ring->len - (ring->head - ring->tail));
+		/* Skip the page, so that the stream stays in sync */
+		read_and_discard(client->fd, sizeof(page_count_buf) + body_len);
+		return false;
+	}
+
+	iov[0].iov_base = page_count_buf;
+	iov[0].iov_len = sizeof(page_count_buf);
+
+	/* The page may wrap around the end of the ring */
+	start = ring->head % ring->len;
+	first = len < ring->len - start ? len : ring->len - start;
+	if (first) {
+		iov[iov_count].iov_base = &ring->samples[start];
+		iov[iov_count].iov_len = first * sizeof(int32_t);
+		iov_count++;
+	}
+	if (len > first) {
+		iov[iov_count].iov_base = ring->samples;
+		iov[iov_count].iov_len = (len - first) * sizeof(int32_t);
+		iov_count++;
+	}
+
+	if (!recv_whole_iov(client->fd, iov, iov_count))
+		return false;
+
+	if (page_count)
+		*page_count = ntohl(*(uint32_t *) &page_count_buf[0]);
+	ring->head += len;
+
+	return true;
+}
+
 /**
  * chamelium_stream_stop_realtime_audio:
  *
@@ -37,6 +37,7 @@ enum chamelium_stream_realtime_mode {
 };
 
 struct chamelium_stream;
+struct chamelium_stream_audio_ring;
 
 struct chamelium_stream *chamelium_stream_init(void);
 void chamelium_stream_deinit(struct chamelium_stream *client);
@@ -47,4 +48,14 @@ bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
 					     int32_t **buf, size_t *buf_len);
 bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client);
 
+struct chamelium_stream_audio_ring *chamelium_stream_audio_ring_create(size_t len);
+void chamelium_stream_audio_ring_destroy(struct chamelium_stream_audio_ring *ring);
+bool chamelium_stream_receive_realtime_audio_ring(struct chamelium_stream *client,
+						  size_t *page_count,
+						  struct chamelium_stream_audio_ring *ring);
+const int32_t *chamelium_stream_audio_ring_peek(struct chamelium_stream_audio_ring *ring,
+						size_t *len);
+void chamelium_stream_audio_ring_consume(struct chamelium_stream_audio_ring *ring,
+					 size_t len);
+
 #endif
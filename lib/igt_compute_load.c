@@ -0,0 +1,326 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <intel_bufmgr.h>
+
+#include "drmtest.h"
+#include "igt_compute_load.h"
+#include "igt_core.h"
+#include "intel_batchbuffer.h"
+#include "intel_chipset.h"
+#include "ioctl_wrappers.h"
+#include "media_spin.h"
+
+/**
+ * SECTION:igt_compute_load
+ * @short_description: Keep the EUs busy with a given kind of work
+ * @title: Compute load
+ * @include: igt_compute_load.h
+ *
+ * Power and frequency tests, like workload simulations, want the render
+ * engine to be loaded the way real applications load it, with threads
+ * running on the EUs, rather than by batches of MI_NOOPs. This library
+ * builds such loads out of the media spin, gpgpu fill and render copy
+ * functions of intel_batchbuffer:
+ *
+ * - #IGT_COMPUTE_LOAD_ALU runs a spinning thread for each hardware thread of
+ *   the device, the spin count being tuned so that each batch takes about
+ *   two milliseconds.
+ * - #IGT_COMPUTE_LOAD_MEMORY fills a 4MiB buffer with threads spread over all
+ *   of the EUs.
+ * - #IGT_COMPUTE_LOAD_SAMPLER copies a 4MiB texture with the render engine.
+ *
+ * igt_compute_load_run() then keeps submitting batches, idling between them
+ * so that the engine is busy for the requested share of the time.
+ * igt_compute_load_submit() queues a single batch, for callers doing their
+ * own pacing.
+ */
+
+#define ALU_CHUNK_NS (2 * 1000 * 1000)
+#define ALU_MIN_SPINS (1 << 10)
+#define ALU_MAX_SPINS (1 << 30)
+
+/* Used when the kernel does not report the number of EUs */
+#define DEFAULT_THREADS 8
+
+typedef void (*spin_threads_func_t)(struct intel_batchbuffer *batch,
+				    const struct igt_buf *dst, uint32_t spins,
+				    unsigned int threads);
+
+struct igt_compute_load {
+	int fd;
+	enum igt_compute_load_type type;
+	drm_intel_bufmgr *bufmgr;
+	struct intel_batchbuffer *batch;
+	struct igt_buf src, dst;
+	unsigned int threads;
+
+	spin_threads_func_t spin;
+	igt_threaded_fillfunc_t fill;
+	igt_render_copyfunc_t copy;
+
+	uint32_t spins;
+	struct timespec submitted;
+};
+
+static void buf_init(struct igt_compute_load *load, struct igt_buf *buf,
+		     unsigned int stride, unsigned int height,
+		     unsigned int bpp)
+{
+	memset(buf, 0, sizeof(*buf));
+
+	buf->bo = drm_intel_bo_alloc(load->bufmgr, "compute load",
+				     stride * height, 4096);
+	igt_assert(buf->bo);
+	buf->stride = stride;
+	buf->tiling = I915_TILING_NONE;
+	buf->size = stride * height;
+	buf->bpp = bpp;
+}
+
+/**
+ * igt_compute_load_name:
+ * @type: the kind of load
+ *
+ * Returns: A short name for @type, as used for subtest names.
+ */
+const char *igt_compute_load_name(enum igt_compute_load_type type)
+{
+	switch (type) {
+	case IGT_COMPUTE_LOAD_ALU:
+		return "alu";
+	case IGT_COMPUTE_LOAD_MEMORY:
+		return "memory";
+	case IGT_COMPUTE_LOAD_SAMPLER:
+		return "sampler";
+	}
+
+	return "unknown";
+}
+
+/**
+ * igt_compute_load_create:
+ * @fd: open i915 drm file descriptor
+ * @type: the kind of load to generate
+ *
+ * Sets up the buffers and batch to load the render engine of @fd with
+ * threads of the given @type.
+ *
+ * Returns: The new load, to be freed with igt_compute_load_destroy(), or NULL
+ * when the device has no implementation of the functions it needs.
+ */
+struct igt_compute_load *
+igt_compute_load_create(int fd, enum igt_compute_load_type type)
+{
+	uint32_t devid = intel_get_drm_devid(fd);
+	struct igt_compute_load *load;
+	spin_threads_func_t spin = NULL;
+	igt_threaded_fillfunc_t fill = NULL;
+	igt_render_copyfunc_t copy = NULL;
+
+	switch (type) {
+	case IGT_COMPUTE_LOAD_ALU:
+		if (IS_GEN9(devid))
+			spin = gen9_media_spin_threadsfunc;
+		else if (IS_GEN8(devid))
+			spin = gen8_media_spin_threadsfunc;
+		if (!spin)
+			return NULL;
+		break;
+	case IGT_COMPUTE_LOAD_MEMORY:
+		fill = igt_get_gpgpu_threaded_fillfunc(devid);
+		if (!fill)
+			return NULL;
+		break;
+	case IGT_COMPUTE_LOAD_SAMPLER:
+		copy = igt_get_render_copyfunc(devid);
+		if (!copy)
+			return NULL;
+		break;
+	}
+
+	load = calloc(1, sizeof(*load));
+	igt_assert(load);
+
+	load->fd = fd;
+	load->type = type;
+	load->spin = spin;
+	load->fill = fill;
+	load->copy = copy;
+
+	load->threads = igt_gpgpu_max_threads(fd);
+	if (!load->threads)
+		load->threads = DEFAULT_THREADS;
+	load->spins = ALU_MIN_SPINS;
+
+	load->bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
+	igt_assert(load->bufmgr);
+	load->batch = intel_batchbuffer_alloc(load->bufmgr, devid);
+	igt_assert(load->batch);
+
+	switch (type) {
+	case IGT_COMPUTE_LOAD_ALU:
+		/* A dword of the spin count written back by each thread */
+		buf_init(load, &load->dst, 1024, ALIGN(load->threads, 256) / 256,
+			 8);
+		break;
+	case IGT_COMPUTE_LOAD_MEMORY:
+		buf_init(load, &load->dst, 4096, 1024, 8);
+		break;
+	case IGT_COMPUTE_LOAD_SAMPLER:
+		buf_init(load, &load->src, 4096, 1024, 32);
+		buf_init(load, &load->dst, 4096, 1024, 32);
+		break;
+	}
+
+	return load;
+}
+
+/**
+ * igt_compute_load_destroy:
+ * @load: the load to free
+ *
+ * Waits for the last batch of @load to complete and frees it.
+ */
+void igt_compute_load_destroy(struct igt_compute_load *load)
+{
+	if (!load)
+		return;
+
+	igt_compute_load_sync(load);
+
+	if (load->src.bo)
+		drm_intel_bo_unreference(load->src.bo);
+	drm_intel_bo_unreference(load->dst.bo);
+	intel_batchbuffer_free(load->batch);
+	drm_intel_bufmgr_destroy(load->bufmgr);
+	free(load);
+}
+
+/**
+ * igt_compute_load_submit:
+ * @load: the load to submit
+ *
+ * Queues one batch of @load on the render engine, without waiting for it.
+ */
+void igt_compute_load_submit(struct igt_compute_load *load)
+{
+	const struct igt_buf *src = &load->src, *dst = &load->dst;
+
+	memset(&load->submitted, 0, sizeof(load->submitted));
+	igt_nsec_elapsed(&load->submitted);
+
+	switch (load->type) {
+	case IGT_COMPUTE_LOAD_ALU:
+		load->spin(load->batch, dst, load->spins, load->threads);
+		break;
+	case IGT_COMPUTE_LOAD_MEMORY:
+		load->fill(load->batch, dst, 0, 0,
+			   igt_buf_width(dst), igt_buf_height(dst),
+			   0, load->threads);
+		break;
+	case IGT_COMPUTE_LOAD_SAMPLER:
+		load->copy(load->batch, NULL,
+			   src, 0, 0, igt_buf_width(src), igt_buf_height(src),
+			   dst, 0, 0);
+		break;
+	}
+}
+
+/**
+ * igt_compute_load_sync:
+ * @load: the load to wait for
+ *
+ * Waits for the batches of @load submitted so far to complete.
+ */
+void igt_compute_load_sync(struct igt_compute_load *load)
+{
+	gem_sync(load->fd, load->dst.bo->handle);
+}
+
+static void tune_spins(struct igt_compute_load *load, uint64_t elapsed)
+{
+	uint64_t spins;
+
+	if (!elapsed)
+		return;
+
+	spins = (uint64_t)load->spins * ALU_CHUNK_NS / elapsed;
+	if (spins < ALU_MIN_SPINS)
+		spins = ALU_MIN_SPINS;
+	if (spins > ALU_MAX_SPINS)
+		spins = ALU_MAX_SPINS;
+
+	load->spins = spins;
+}
+
+/**
+ * igt_compute_load_run:
+ * @load: the load to run
+ * @intensity: share of the time the engine is to be kept busy, in percent
+ * @duration_ms: for how long to run the load
+ *
+ * Keeps submitting batches of @load one after the other for @duration_ms,
+ * each time waiting for the batch to complete and then, for an @intensity
+ * below 100, idling for as long as keeps the time the engine spent busy at
+ * @intensity percent of the time so far.
+ *
+ * Returns: The time spent busy, in nanoseconds.
+ */
+uint64_t igt_compute_load_run(struct igt_compute_load *load,
+			      unsigned int intensity,
+			      unsigned int duration_ms)
+{
+	uint64_t duration = (uint64_t)duration_ms * 1000 * 1000;
+	struct timespec start = {};
+	uint64_t busy = 0;
+
+	igt_assert(intensity > 0 && intensity <= 100);
+
+	igt_nsec_elapsed(&start);
+	while (igt_nsec_elapsed(&start) < duration) {
+		uint64_t elapsed, target;
+
+		igt_compute_load_submit(load);
+		igt_compute_load_sync(load);
+
+		elapsed = igt_nsec_elapsed(&load->submitted);
+		busy += elapsed;
+		if (load->type == IGT_COMPUTE_LOAD_ALU)
+			tune_spins(load, elapsed);
+
+		target = busy * 100 / intensity;
+		if (target > duration)
+			target = duration;
+
+		elapsed = igt_nsec_elapsed(&start);
+		if (target > elapsed)
+			usleep((target - elapsed) / 1000);
+	}
+
+	return busy;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __IGT_COMPUTE_LOAD_H__
+#define __IGT_COMPUTE_LOAD_H__
+
+#include <stdint.h>
+
+/**
+ * igt_compute_load_type:
+ * @IGT_COMPUTE_LOAD_ALU: threads spinning in a loop on every EU
+ * @IGT_COMPUTE_LOAD_MEMORY: threads on every EU writing out a large buffer
+ * @IGT_COMPUTE_LOAD_SAMPLER: pixel shaders sampling a large texture
+ */
+enum igt_compute_load_type {
+	IGT_COMPUTE_LOAD_ALU,
+	IGT_COMPUTE_LOAD_MEMORY,
+	IGT_COMPUTE_LOAD_SAMPLER,
+};
+
+struct igt_compute_load;
+
+struct igt_compute_load *
+igt_compute_load_create(int fd, enum igt_compute_load_type type);
+void igt_compute_load_destroy(struct igt_compute_load *load);
+
+const char *igt_compute_load_name(enum igt_compute_load_type type);
+
+void igt_compute_load_submit(struct igt_compute_load *load);
+void igt_compute_load_sync(struct igt_compute_load *load);
+uint64_t igt_compute_load_run(struct igt_compute_load *load,
+			      unsigned int intensity,
+			      unsigned int duration_ms);
+
+#endif /* __IGT_COMPUTE_LOAD_H__ */
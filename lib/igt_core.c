@@ -43,10 +43,12 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #ifdef __linux__
 #include <sys/syscall.h>
 #endif
 #include <pthread.h>
+#include <sched.h>
 #include <sys/utsname.h>
 #include <termios.h>
 #include <errno.h>
@@ -267,8 +269,31 @@ static bool list_subtests = false;
 static bool describe_subtests = false;
 static char *run_single_subtest = NULL;
 static bool run_single_subtest_found = false;
+
+/*
+ * The runner passes the subtests to run as a list of hundreds of names,
+ * which uwildmat() would scan through for every subtest. The list is instead
+ * split once, the plain names going into a hash table and the patterns with
+ * wildcards into an array, the last item matching deciding as in uwildmat().
+ */
+struct subtest_filter_item {
+	const char *pattern;
+	int index;
+	bool reverse;
+};
+
+static struct {
+	const char *source;
+	bool fallback;
+	char *buf;
+	GHashTable *names;
+	struct subtest_filter_item *wildcards;
+	int nr_wildcards;
+} subtest_filter;
 static const char *in_subtest = NULL;
 static struct timespec subtest_time;
+static bool parallel_child;
+static void wait_parallel_subtests(void);
 static clockid_t igt_clock = (clockid_t)-1;
 static bool in_fixture = false;
 static bool test_with_subtests = false;
@@ -314,10 +339,35 @@ static int igt_exitcode = IGT_EXIT_SUCCESS;
 static const char *command_str;
 
 static char* igt_log_domain_filter;
-static struct {
-	char *entries[256];
-	uint8_t start, end;
-} log_buffer;
+
+/*
+ * The log buffer is made of one ring of fixed-size records per thread, so
+ * that logging neither allocates nor serializes the threads. Each record is
+ * stamped with a global sequence number, which orders the records of all the
+ * rings when the log is replayed. The records of threads that exited are kept
+ * and their ring is taken over by the next new thread.
+ */
+#define LOG_RING_SIZE 256
+#define LOG_RECORD_SIZE 512
+
+struct log_record {
+	uint64_t seq; /* 0 while being written */
+	char line[LOG_RECORD_SIZE];
+};
+
+struct log_ring {
+	struct log_ring *next;
+	int in_use;
+	unsigned int head;
+	struct log_record records[LOG_RING_SIZE];
+};
+
+static struct log_ring *log_rings;
+static uint64_t log_seq;
+static uint64_t log_reset_seq;
+static __thread struct log_ring *log_ring;
+static pthread_key_t log_ring_key;
+static pthread_once_t log_ring_once = PTHREAD_ONCE_INIT;
 static pthread_mutex_t log_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 GKeyFile *igt_key_file;
@@ -331,57 +381,334 @@ const char *igt_test_name(void)
 	return command_str;
 }
 
-static void _igt_log_buffer_append(char *line)
+/*
+ * Event stream: When IGT_EVENT_FD names an open file descriptor, the
+ * subtest starts and results and the printed log messages are also
+ * written to it as JSON lines, for the runner to pick up without
+ * parsing the human readable output. Each event is a single write()
+ * to the fd in append mode, so that lines from forked children don't
+ * interleave. The events are:
+ *
+ * {"event":"start","subtest":"name","time":123.456}
+ * {"event":"result","subtest":"name","result":"SUCCESS","duration":0.003}
+ * {"event":"log","pid":1234,"domain":"name","level":"INFO","message":"text"}
+ *
+ * The result event of a test without subtests has no subtest name, and
+ * the domain of a log event is left out when there is none. The
+ * field names must match the ones in runner/resultgen.c.
+ */
+static int event_fd = -1;
+
+struct event {
+	char *buf;
+	size_t len, size;
+};
+
+static void event_reserve(struct event *e, size_t len)
 {
-	pthread_mutex_lock(&log_buffer_mutex);
+	if (!e->buf || e->len + len + 1 > e->size) {
+		char *buf;
+
+		e->size = max(2 * e->size, e->len + len + 1);
+		buf = realloc(e->buf, e->size);
+		if (!buf) {
+			free(e->buf);
+			e->buf = NULL;
+			return;
+		}
+		e->buf = buf;
+	}
+}
 
-	free(log_buffer.entries[log_buffer.end]);
-	log_buffer.entries[log_buffer.end] = line;
-	log_buffer.end++;
-	if (log_buffer.end == log_buffer.start)
-		log_buffer.start++;
+__attribute__((format(printf, 2, 3)))
+static void event_append(struct event *e, const char *format, ...)
+{
+	va_list args;
+	int len;
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+	va_start(args, format);
+	len = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (len < 0)
+		return;
+
+	event_reserve(e, len);
+	if (!e->buf)
+		return;
+
+	va_start(args, format);
+	vsnprintf(e->buf + e->len, e->size - e->len, format, args);
+	va_end(args);
+	e->len += len;
+}
+
+static void event_append_string(struct event *e, const char *key,
+				const char *str, size_t len)
+{
+	event_append(e, ",\"%s\":\"", key);
+
+	/* Worst case, every byte is a \u escape */
+	event_reserve(e, 6 * len + 1);
+	if (!e->buf)
+		return;
+
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = str[i];
+
+		switch (c) {
+		case '"':
+		case '\\':
+			e->buf[e->len++] = '\\';
+			e->buf[e->len++] = c;
+			break;
+		case '\n':
+			e->buf[e->len++] = '\\';
+			e->buf[e->len++] = 'n';
+			break;
+		case '\t':
+			e->buf[e->len++] = '\\';
+			e->buf[e->len++] = 't';
+			break;
+		default:
+			if (c < 0x20)
+				e->len += sprintf(e->buf + e->len, "\\u%04x", c);
+			else
+				e->buf[e->len++] = c;
+		}
+	}
+
+	e->buf[e->len++] = '"';
+}
+
+static void event_begin(struct event *e, const char *type)
+{
+	memset(e, 0, sizeof(*e));
+	event_append(e, "{\"event\":\"%s\"", type);
+}
+
+static void event_send(struct event *e)
+{
+	event_append(e, "}\n");
+	if (e->buf)
+		igt_ignore_warn(write(event_fd, e->buf, e->len));
+	free(e->buf);
+}
+
+static void event_subtest(const char *type, const char *subtest,
+			  const char *result, double time)
+{
+	struct event e;
+
+	if (event_fd < 0)
+		return;
+
+	event_begin(&e, type);
+	if (subtest)
+		event_append_string(&e, "subtest", subtest, strlen(subtest));
+	if (result) {
+		event_append_string(&e, "result", result, strlen(result));
+		event_append(&e, ",\"duration\":%.3f", time);
+	} else {
+		event_append(&e, ",\"time\":%.3f", time);
+	}
+	event_send(&e);
+}
+
+static void event_log(const char *domain, const char *level,
+		      const char *message, size_t len)
+{
+	struct event e;
+
+	if (event_fd < 0)
+		return;
+
+	event_begin(&e, "log");
+	event_append(&e, ",\"pid\":%d", getpid());
+	if (domain)
+		event_append_string(&e, "domain", domain, strlen(domain));
+	event_append_string(&e, "level", level, strlen(level));
+	event_append_string(&e, "message", message, len);
+	event_send(&e);
+}
+
+static void event_set_fd(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0)
+		return;
+
+	/* Keep it from the programs the tests execute */
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, flags | O_APPEND);
+	event_fd = fd;
+}
+
+static void log_ring_release(void *ring)
+{
+	__atomic_store_n(&((struct log_ring *)ring)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void log_ring_init(void)
+{
+	pthread_key_create(&log_ring_key, log_ring_release);
+}
+
+static struct log_ring *log_ring_get(void)
+{
+	struct log_ring *ring;
+
+	if (log_ring)
+		return log_ring;
+
+	pthread_once(&log_ring_once, log_ring_init);
+
+	/* Take over the ring of an exited thread, or add a new one */
+	for (ring = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE);
+	     ring; ring = ring->next) {
+		int unused = 0;
+
+		if (__atomic_compare_exchange_n(&ring->in_use, &unused, 1,
+						false, __ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			break;
+	}
+
+	if (!ring) {
+		ring = calloc(1, sizeof(*ring));
+		if (!ring)
+			return NULL;
+
+		ring->in_use = 1;
+		ring->next = __atomic_load_n(&log_rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&log_rings, &ring->next, ring,
+						    true, __ATOMIC_RELEASE,
+						    __ATOMIC_RELAXED))
+			;
+	}
+
+	pthread_setspecific(log_ring_key, ring);
+	return log_ring = ring;
+}
+
+static void _igt_log_buffer_append(bool continuation, const char *prefix,
+				   const char *line)
+{
+	static const char truncated[] = "[...]\n";
+	struct log_ring *ring = log_ring_get();
+	struct log_record *rec;
+	int len;
+
+	if (!ring)
+		return;
+
+	rec = &ring->records[ring->head++ % LOG_RING_SIZE];
+	__atomic_store_n(&rec->seq, 0, __ATOMIC_RELEASE);
+
+	len = snprintf(rec->line, sizeof(rec->line), "%s%s",
+		       continuation ? "" : prefix, line);
+	if (len >= sizeof(rec->line))
+		memcpy(rec->line + sizeof(rec->line) - sizeof(truncated),
+		       truncated, sizeof(truncated));
+
+	__atomic_store_n(&rec->seq,
+			 __atomic_add_fetch(&log_seq, 1, __ATOMIC_RELAXED),
+			 __ATOMIC_RELEASE);
 }
 
 static void _igt_log_buffer_reset(void)
 {
-	pthread_mutex_lock(&log_buffer_mutex);
+	__atomic_store_n(&log_reset_seq,
+			 __atomic_load_n(&log_seq, __ATOMIC_RELAXED),
+			 __ATOMIC_RELEASE);
+}
 
-	log_buffer.start = log_buffer.end = 0;
+struct log_snapshot {
+	uint64_t seq;
+	char line[LOG_RECORD_SIZE];
+};
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+static int log_snapshot_cmp(const void *A, const void *B)
+{
+	const struct log_snapshot *a = A, *b = B;
+
+	return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+/*
+ * Copies all the records logged since the last reset, in order. Records
+ * being rewritten while we copy them are skipped.
+ */
+static struct log_snapshot *log_buffer_snapshot(unsigned int *count)
+{
+	const uint64_t reset = __atomic_load_n(&log_reset_seq, __ATOMIC_ACQUIRE);
+	struct log_snapshot *snap = NULL;
+	unsigned int n = 0, allocated = 0;
+
+	for (struct log_ring *ring = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE);
+	     ring; ring = ring->next) {
+		for (int i = 0; i < LOG_RING_SIZE; i++) {
+			struct log_record *rec = &ring->records[i];
+			uint64_t seq;
+
+			seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+			if (seq <= reset)
+				continue;
+
+			if (n == allocated) {
+				struct log_snapshot *tmp;
+
+				allocated = allocated ? 2 * allocated : LOG_RING_SIZE;
+				tmp = realloc(snap, allocated * sizeof(*snap));
+				if (!tmp)
+					goto out;
+				snap = tmp;
+			}
+
+			memcpy(snap[n].line, rec->line, sizeof(rec->line));
+			snap[n].line[sizeof(rec->line) - 1] = '\0';
+			snap[n].seq = seq;
+			if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) == seq)
+				n++;
+		}
+	}
+
+out:
+	if (n)
+		qsort(snap, n, sizeof(*snap), log_snapshot_cmp);
+	*count = n;
+	return snap;
 }
 
 static void _igt_log_buffer_dump(void)
 {
-	uint8_t i;
+	struct log_snapshot *snap;
+	unsigned int count;
 
 	if (in_subtest)
 		fprintf(stderr, "Subtest %s failed.\n", in_subtest);
 	else
 		fprintf(stderr, "Test %s failed.\n", command_str);
 
-	if (log_buffer.start == log_buffer.end) {
+	pthread_mutex_lock(&log_buffer_mutex);
+
+	snap = log_buffer_snapshot(&count);
+	if (!count) {
 		fprintf(stderr, "No log.\n");
-		return;
+		goto out;
 	}
 
-	pthread_mutex_lock(&log_buffer_mutex);
 	fprintf(stderr, "**** DEBUG ****\n");
-
-	i = log_buffer.start;
-	do {
-		char *last_line = log_buffer.entries[i];
-		fprintf(stderr, "%s", last_line);
-		i++;
-	} while (i != log_buffer.start && i != log_buffer.end);
+	for (unsigned int i = 0; i < count; i++)
+		fprintf(stderr, "%s", snap[i].line);
 
 	/* reset the buffer */
-	log_buffer.start = log_buffer.end = 0;
+	_igt_log_buffer_reset();
 
 	fprintf(stderr, "****  END  ****\n");
+out:
 	pthread_mutex_unlock(&log_buffer_mutex);
+	free(snap);
 }
 
 /**
@@ -395,17 +722,19 @@ static void _igt_log_buffer_dump(void)
  */
 void igt_log_buffer_inspect(igt_buffer_log_handler_t check, void *data)
 {
-	uint8_t i;
+	struct log_snapshot *snap;
+	unsigned int count;
+
 	pthread_mutex_lock(&log_buffer_mutex);
 
-	i = log_buffer.start;
-	do {
-		if (check(log_buffer.entries[i], data))
+	snap = log_buffer_snapshot(&count);
+	for (unsigned int i = 0; i < count; i++) {
+		if (check(snap[i].line, data))
 			break;
-		i++;
-	} while (i != log_buffer.start && i != log_buffer.end);
+	}
 
 	pthread_mutex_unlock(&log_buffer_mutex);
+	free(snap);
 }
 
 void igt_kmsg(const char *format, ...)
@@ -487,6 +816,8 @@ bool __igt_fixture(void)
 	assert(!in_fixture);
 	assert(test_with_subtests);
 
+	wait_parallel_subtests();
+
 	if (igt_only_list_subtests())
 		return false;
 
@@ -724,10 +1055,116 @@ static void common_init_env(void)
 
 	stderr_needs_sentinel = getenv("IGT_SENTINEL_ON_STDERR") != NULL;
 
+	env = getenv("IGT_EVENT_FD");
+	if (env) {
+		event_set_fd(atoi(env));
+		unsetenv("IGT_EVENT_FD");
+	}
+
 	env = getenv("IGT_FORCE_DRIVER");
 	if (env) {
 		__set_forced_driver(env);
 	}
+
+	env = getenv("IGT_FORCE_DEVICE");
+	if (env) {
+		__set_forced_device(env);
+	}
+}
+
+/*
+ * Zygote mode: When IGT_ZYGOTE_FD names a SOCK_SEQPACKET socket, a
+ * test with subtests stops after initialization and serves requests
+ * from the socket instead of running. Each request has a subtest
+ * pattern as the payload and the fds to use as stdout, stderr and the
+ * event stream as SCM_RIGHTS. The zygote forks for each request, and the child
+ * continues from the warm state as if --run-subtest was given. The
+ * zygote replies with the child's pid and, once the child exits, its
+ * wait status.
+ *
+ * The message types must match the ones in runner/executor.c.
+ */
+enum {
+	ZYGOTE_READY,
+	ZYGOTE_PID,
+	ZYGOTE_STATUS,
+};
+
+static void zygote_send(int sock, int type, int value)
+{
+	int msg[2] = { type, value };
+
+	send(sock, msg, sizeof(msg), MSG_NOSIGNAL);
+}
+
+/* Returns only in the forked children */
+static void zygote_serve(int sock)
+{
+	zygote_send(sock, ZYGOTE_READY, getpid());
+
+	while (1) {
+		char pattern[4096];
+		char control[CMSG_SPACE(3 * sizeof(int))];
+		struct iovec iov = {
+			.iov_base = pattern,
+			.iov_len = sizeof(pattern) - 1,
+		};
+		struct msghdr msg = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+		struct cmsghdr *cmsg;
+		int fds[3];
+		ssize_t len;
+		pid_t pid;
+		int status;
+
+		len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+		if (len <= 0)
+			exit(0);
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS ||
+		    cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+			exit(IGT_EXIT_INVALID);
+
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+		pattern[len] = '\0';
+
+		fflush(stdout);
+		fflush(stderr);
+
+		pid = fork();
+		if (pid == 0) {
+			dup2(fds[0], STDOUT_FILENO);
+			dup2(fds[1], STDERR_FILENO);
+			close(fds[0]);
+			close(fds[1]);
+			close(sock);
+			event_set_fd(fds[2]);
+
+			setpgid(0, 0);
+
+			run_single_subtest = strdup(pattern);
+			return;
+		}
+
+		close(fds[0]);
+		close(fds[1]);
+		close(fds[2]);
+
+		zygote_send(sock, ZYGOTE_PID, pid);
+		if (pid < 0)
+			continue;
+
+		while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+			;
+
+		zygote_send(sock, ZYGOTE_STATUS, status);
+	}
 }
 
 static int common_init(int *argc, char **argv,
@@ -756,6 +1193,7 @@ static int common_init(int *argc, char **argv,
 	int extra_opt_count;
 	int all_opt_count;
 	int ret = 0;
+	const char *env;
 
 	common_init_env();
 	igt_list_init(&subgroup_descriptions);
@@ -904,6 +1342,19 @@ out:
 		/* exit with no error for -h/--help */
 		exit(ret == -1 ? 0 : IGT_EXIT_INVALID);
 
+	env = getenv("IGT_ZYGOTE_FD");
+	if (env) {
+		int sock = atoi(env);
+
+		unsetenv("IGT_ZYGOTE_FD");
+
+		/* Refuse instead of running everything to nowhere */
+		if (!test_with_subtests || list_subtests || run_single_subtest)
+			exit(IGT_EXIT_INVALID);
+
+		zygote_serve(sock);
+	}
+
 	if (!list_subtests) {
 		bind_fbcon(false);
 		igt_kmsg(KMSG_INFO "%s: executing\n", command_str);
@@ -1045,12 +1496,133 @@ static void __igt_print_description(const char *subtest_name, const char *file,
 		printf("%sNO DOCUMENTATION!\n\n", indent);
 }
 
+static void compile_subtest_filter(const char *pattern)
+{
+	char *item, *next;
+	int index = 0;
+
+	if (subtest_filter.names)
+		g_hash_table_destroy(subtest_filter.names);
+	free(subtest_filter.wildcards);
+	free(subtest_filter.buf);
+	memset(&subtest_filter, 0, sizeof(subtest_filter));
+
+	subtest_filter.source = pattern;
+
+	/* Escapes and character classes may hide commas from the split */
+	subtest_filter.fallback = strpbrk(pattern, "\\[") != NULL;
+	if (subtest_filter.fallback)
+		return;
+
+	subtest_filter.buf = strdup(pattern);
+	subtest_filter.names = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (item = subtest_filter.buf; item; item = next, index++) {
+		bool reverse = *item == '!';
+
+		next = strchr(item, ',');
+		if (next)
+			*next++ = '\0';
+		if (reverse)
+			item++;
+
+		if (strpbrk(item, "*?")) {
+			struct subtest_filter_item *w;
+
+			subtest_filter.wildcards =
+				realloc(subtest_filter.wildcards,
+					(subtest_filter.nr_wildcards + 1) *
+					sizeof(*subtest_filter.wildcards));
+			w = &subtest_filter.wildcards[subtest_filter.nr_wildcards++];
+			w->pattern = item;
+			w->index = index;
+			w->reverse = reverse;
+		} else {
+			/* Later duplicates replace the earlier ones */
+			g_hash_table_insert(subtest_filter.names, item,
+					    GINT_TO_POINTER(reverse ?
+							    -(index + 1) :
+							    index + 1));
+		}
+	}
+}
+
+static bool subtest_filter_match(const char *subtest_name)
+{
+	bool reverse = false;
+	int last = -1;
+	int value;
+
+	if (subtest_filter.source != run_single_subtest)
+		compile_subtest_filter(run_single_subtest);
+
+	if (subtest_filter.fallback)
+		return uwildmat(subtest_name, run_single_subtest);
+
+	value = GPOINTER_TO_INT(g_hash_table_lookup(subtest_filter.names,
+						    subtest_name));
+	if (value) {
+		last = abs(value) - 1;
+		reverse = value < 0;
+	}
+
+	for (int i = subtest_filter.nr_wildcards; i--; ) {
+		const struct subtest_filter_item *w = &subtest_filter.wildcards[i];
+
+		if (w->index < last)
+			break;
+
+		if (uwildmat_simple(subtest_name, w->pattern)) {
+			last = w->index;
+			reverse = w->reverse;
+			break;
+		}
+	}
+
+	return last >= 0 && !reverse;
+}
+
+static bool skipped_one = false;
+static bool succeeded_one = false;
+static bool failed_one = false;
+
+/* Reports the result of a subtest which is not run at all */
+static void report_unrun_subtest(const char *subtest_name, const char *result)
+{
+	printf("%sSubtest %s: %s%s\n",
+	       (!__igt_plain_output) ? "\x1b[1m" : "", subtest_name,
+	       result, (!__igt_plain_output) ? "\x1b[0m" : "");
+	fflush(stdout);
+	if (stderr_needs_sentinel)
+		fprintf(stderr, "Subtest %s: %s\n", subtest_name, result);
+	event_subtest("result", subtest_name, result, 0.0);
+}
+
+/*
+ * Subtests known to take too long on a simulator are listed in
+ * INTEL_SIMULATION_SKIP, with the same syntax as --run-subtest.
+ */
+static bool simulation_skips(const char *subtest_name)
+{
+	const char *list;
+
+	if (!igt_run_in_simulation())
+		return false;
+
+	list = getenv("INTEL_SIMULATION_SKIP");
+	if (!list || !*list)
+		return false;
+
+	return uwildmat(subtest_name, list);
+}
+
 /*
  * Note: Testcases which use these helpers MUST NOT output anything to stdout
  * outside of places protected by igt_run_subtest checks - the piglit
  * runner adds every line to the subtest list.
  */
-bool __igt_run_subtest(const char *subtest_name, const char *file, const int line)
+static bool subtest_selected(const char *subtest_name,
+			     const char *file, const int line)
 {
 	int i;
 
@@ -1066,7 +1638,7 @@ bool __igt_run_subtest(const char *subtest_name, const char *file, const int lin
 		}
 
 	if (run_single_subtest) {
-		if (uwildmat(subtest_name, run_single_subtest) == 0) {
+		if (!subtest_filter_match(subtest_name)) {
 			_clear_current_description();
 			return false;
 		} else {
@@ -1085,18 +1657,23 @@ bool __igt_run_subtest(const char *subtest_name, const char *file, const int lin
 
 
 	if (skip_subtests_henceforth) {
-		printf("%sSubtest %s: %s%s\n",
-		       (!__igt_plain_output) ? "\x1b[1m" : "", subtest_name,
-		       skip_subtests_henceforth == SKIP ?
-		       "SKIP" : "FAIL", (!__igt_plain_output) ? "\x1b[0m" : "");
-		fflush(stdout);
-		if (stderr_needs_sentinel)
-			fprintf(stderr, "Subtest %s: %s\n", subtest_name,
-				skip_subtests_henceforth == SKIP ?
-				"SKIP" : "FAIL");
+		report_unrun_subtest(subtest_name,
+				     skip_subtests_henceforth == SKIP ?
+				     "SKIP" : "FAIL");
+		return false;
+	}
+
+	if (simulation_skips(subtest_name)) {
+		report_unrun_subtest(subtest_name, "SKIP");
+		skipped_one = true;
 		return false;
 	}
 
+	return true;
+}
+
+static bool start_subtest(const char *subtest_name)
+{
 	igt_kmsg(KMSG_INFO "%s: starting subtest %s\n",
 		 command_str, subtest_name);
 	igt_info("Starting subtest: %s\n", subtest_name);
@@ -1107,9 +1684,22 @@ bool __igt_run_subtest(const char *subtest_name, const char *file, const int lin
 	_igt_log_buffer_reset();
 
 	igt_gettime(&subtest_time);
+	event_subtest("start", subtest_name, NULL,
+		      subtest_time.tv_sec + 1e-9 * subtest_time.tv_nsec);
 	return (in_subtest = subtest_name);
 }
 
+bool __igt_run_subtest(const char *subtest_name, const char *file, const int line)
+{
+	/* Whatever ran before is done by the time the next subtest starts */
+	wait_parallel_subtests();
+
+	if (!subtest_selected(subtest_name, file, line))
+		return false;
+
+	return start_subtest(subtest_name);
+}
+
 /**
  * igt_subtest_name:
  *
@@ -1161,10 +1751,6 @@ void __igt_subtest_group_restore(int save, int desc)
 	skip_subtests_henceforth = save;
 }
 
-static bool skipped_one = false;
-static bool succeeded_one = false;
-static bool failed_one = false;
-
 static void exit_subtest(const char *) __attribute__((noreturn));
 static void exit_subtest(const char *result)
 {
@@ -1179,13 +1765,170 @@ static void exit_subtest(const char *result)
 	if (stderr_needs_sentinel)
 		fprintf(stderr, "Subtest %s: %s (%.3fs)\n",
 			in_subtest, result, igt_time_elapsed(&subtest_time, &now));
+	event_subtest("result", in_subtest, result,
+		      igt_time_elapsed(&subtest_time, &now));
 
 	igt_terminate_spins();
 
+	/* The parent of a parallel subtest tells the result from the status */
+	if (parallel_child) {
+		fflush(NULL);
+		if (!strcmp(result, "SUCCESS"))
+			exit(IGT_EXIT_SUCCESS);
+		if (!strcmp(result, "SKIP"))
+			exit(IGT_EXIT_SKIP);
+		exit(igt_exitcode ?: IGT_EXIT_FAILURE);
+	}
+
 	in_subtest = NULL;
 	siglongjmp(igt_subtest_jmpbuf, 1);
 }
 
+static void reset_helper_process_list(void);
+
+struct parallel_subtest {
+	pid_t pid;
+	char *name;
+	FILE *out, *err;
+	struct timespec start;
+};
+
+static struct {
+	struct parallel_subtest *subtests;
+	int count;
+	int max;
+} parallel = { .max = -1 };
+
+static int parallel_jobs(void)
+{
+	if (parallel.max < 0) {
+		const char *env = getenv("IGT_SUBTEST_JOBS");
+
+		parallel.max = env ? atoi(env) : sysconf(_SC_NPROCESSORS_ONLN);
+		if (parallel.max > 1)
+			parallel.subtests = calloc(parallel.max,
+						   sizeof(*parallel.subtests));
+		if (!parallel.subtests)
+			parallel.max = 0;
+	}
+
+	return parallel.max;
+}
+
+static void copy_output(FILE *from, FILE *to)
+{
+	char buf[4096];
+	size_t len;
+
+	rewind(from);
+	while ((len = fread(buf, 1, sizeof(buf), from)))
+		fwrite(buf, 1, len, to);
+	fflush(to);
+	fclose(from);
+}
+
+/*
+ * Waits for the oldest of the parallel subtests, passing its output on in
+ * one piece, so that the log reads as if it had run on its own.
+ */
+static void finish_parallel_subtest(void)
+{
+	struct parallel_subtest *p = &parallel.subtests[0];
+	struct timespec now;
+	int status;
+
+	while (waitpid(p->pid, &status, 0) == -1 && errno == EINTR)
+		;
+
+	copy_output(p->out, stdout);
+	copy_output(p->err, stderr);
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == IGT_EXIT_SUCCESS) {
+		succeeded_one = true;
+	} else if (WIFEXITED(status) && WEXITSTATUS(status) == IGT_EXIT_SKIP) {
+		skipped_one = true;
+	} else {
+		if (!failed_one)
+			igt_exitcode = WIFEXITED(status) ?
+				WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		failed_one = true;
+	}
+
+	/* Killed before it could say so itself */
+	if (WIFSIGNALED(status)) {
+		igt_gettime(&now);
+		igt_info("%sSubtest %s: CRASH (%.3fs)%s\n",
+			 (!__igt_plain_output) ? "\x1b[1m" : "",
+			 p->name, igt_time_elapsed(&p->start, &now),
+			 (!__igt_plain_output) ? "\x1b[0m" : "");
+		fflush(stdout);
+		if (stderr_needs_sentinel)
+			fprintf(stderr, "Subtest %s: CRASH (%.3fs)\n",
+				p->name, igt_time_elapsed(&p->start, &now));
+		event_subtest("result", p->name, "CRASH",
+			      igt_time_elapsed(&p->start, &now));
+	}
+
+	free(p->name);
+	memmove(p, p + 1, --parallel.count * sizeof(*p));
+}
+
+static void wait_parallel_subtests(void)
+{
+	while (parallel.count)
+		finish_parallel_subtest();
+}
+
+bool __igt_run_subtest_parallel(const char *subtest_name,
+				const char *file, const int line)
+{
+	struct parallel_subtest *p;
+
+	if (parallel_child || parallel_jobs() <= 1)
+		return __igt_run_subtest(subtest_name, file, line);
+
+	if (!subtest_selected(subtest_name, file, line))
+		return false;
+
+	if (parallel.count == parallel.max)
+		finish_parallel_subtest();
+
+	p = &parallel.subtests[parallel.count];
+	p->out = tmpfile();
+	p->err = tmpfile();
+	igt_assert(p->out && p->err);
+	igt_gettime(&p->start);
+
+	/* ensure any buffers are flushed before fork */
+	fflush(NULL);
+
+	p->pid = fork();
+	igt_assert(p->pid != -1);
+	if (p->pid) {
+		p->name = strdup(subtest_name);
+		parallel.count++;
+		return false;
+	}
+
+	dup2(fileno(p->out), STDOUT_FILENO);
+	dup2(fileno(p->err), STDERR_FILENO);
+	for (int i = 0; i <= parallel.count; i++) {
+		fclose(parallel.subtests[i].out);
+		fclose(parallel.subtests[i].err);
+	}
+	parallel.count = 0;
+
+	parallel_child = true;
+	exit_handler_count = 0;
+	reset_helper_process_list();
+	igt_unshare_spins();
+
+	skipped_one = succeeded_one = failed_one = false;
+	igt_exitcode = IGT_EXIT_SUCCESS;
+
+	return start_subtest(subtest_name);
+}
+
 /**
  * igt_skip:
  * @f: format string
@@ -1703,6 +2446,8 @@ void igt_exit(void)
 {
 	int tmp;
 
+	wait_parallel_subtests();
+
 	igt_exit_called = true;
 
 	if (igt_key_file)
@@ -1759,6 +2504,8 @@ void igt_exit(void)
 
 		printf("%s (%.3fs)\n",
 		       result, igt_time_elapsed(&subtest_time, &now));
+		event_subtest("result", NULL, result,
+			      igt_time_elapsed(&subtest_time, &now));
 	}
 
 	exit(igt_exitcode);
@@ -1949,6 +2696,40 @@ bool __igt_fork(void)
 
 }
 
+static void pin_child(int child)
+{
+	cpu_set_t allowed, cpu;
+	int count, cpu_nr;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		return;
+
+	count = CPU_COUNT(&allowed);
+	if (!count)
+		return;
+
+	/* Spread the children over the CPUs the test is allowed to use */
+	child %= count;
+	for (cpu_nr = 0; cpu_nr < CPU_SETSIZE; cpu_nr++) {
+		if (CPU_ISSET(cpu_nr, &allowed) && child-- == 0)
+			break;
+	}
+
+	CPU_ZERO(&cpu);
+	CPU_SET(cpu_nr, &cpu);
+	if (sched_setaffinity(0, sizeof(cpu), &cpu))
+		igt_debug("Unable to pin child to cpu%d: %m\n", cpu_nr);
+}
+
+bool __igt_fork_pinned(int child)
+{
+	if (!__igt_fork())
+		return false;
+
+	pin_child(child);
+	return true;
+}
+
 int __igt_waitchildren(void)
 {
 	int err = 0;
@@ -2285,6 +3066,54 @@ bool igt_run_in_simulation(void)
 	return simulation;
 }
 
+/**
+ * igt_simulation_scale:
+ *
+ * Simulators run many times slower than the hardware, so tests left at their
+ * default sizes and iteration counts take too long to be of use there. In
+ * simulation mode the loops of igt_until_timeout() and igt_for_milliseconds(),
+ * the durations of spinners and the amount of memory reported by
+ * intel_get_total_ram_mb() and intel_get_avail_ram_mb() are all divided by
+ * this factor. It can be set with the INTEL_SIMULATION_SCALE environment
+ * variable and defaults to 16.
+ *
+ * Returns: The scale factor in simulation mode, 1 otherwise.
+ */
+unsigned int igt_simulation_scale(void)
+{
+	static unsigned int scale;
+
+	if (!scale) {
+		const char *env = getenv("INTEL_SIMULATION_SCALE");
+
+		scale = 1;
+		if (igt_run_in_simulation()) {
+			scale = 16;
+			if (env && atoi(env) > 0)
+				scale = atoi(env);
+		}
+	}
+
+	return scale;
+}
+
+/**
+ * igt_simulation_scaled:
+ * @value: a size, iteration count or duration
+ *
+ * Tests can use this to reduce their own sizes and loop counts alongside
+ * those of the library, see igt_simulation_scale().
+ *
+ * Returns: @value divided by the simulation scale factor, but no less than 1
+ * for a non-zero @value.
+ */
+uint64_t igt_simulation_scaled(uint64_t value)
+{
+	uint64_t scaled = value / igt_simulation_scale();
+
+	return scaled ?: !!value;
+}
+
 /**
  * igt_skip_on_simulation:
  *
@@ -2355,8 +3184,12 @@ void igt_log(const char *domain, enum igt_log_level level, const char *format, .
 void igt_vlog(const char *domain, enum igt_log_level level, const char *format, va_list args)
 {
 	FILE *file;
-	char *line, *formatted_line;
+	char stack[256], *line = stack;
+	char prefix[128];
 	const char *program_name;
+	bool continuation;
+	va_list ap;
+	int len;
 	const char *igt_log_level_str[] = {
 		"DEBUG",
 		"INFO",
@@ -2377,23 +3210,25 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 	if (list_subtests && level <= IGT_LOG_WARN)
 		return;
 
-	if (vasprintf(&line, format, args) == -1)
+	va_copy(ap, args);
+	len = vsnprintf(stack, sizeof(stack), format, ap);
+	va_end(ap);
+	if (len < 0)
 		return;
 
-	if (line_continuation) {
-		formatted_line = strdup(line);
-		if (!formatted_line)
-			goto out;
-	} else if (asprintf(&formatted_line, "(%s:%d) %s%s%s: %s", program_name,
-		     getpid(), (domain) ? domain : "", (domain) ? "-" : "",
-		     igt_log_level_str[level], line) == -1) {
-		goto out;
-	}
+	if (len >= sizeof(stack) && vasprintf(&line, format, args) == -1)
+		return;
+
+	snprintf(prefix, sizeof(prefix), "(%s:%d) %s%s%s: ", program_name,
+		 getpid(), (domain) ? domain : "", (domain) ? "-" : "",
+		 igt_log_level_str[level]);
 
-	line_continuation = line[strlen(line) - 1] != '\n';
+	continuation = line_continuation;
+	if (len)
+		line_continuation = line[len - 1] != '\n';
 
 	/* append log buffer */
-	_igt_log_buffer_append(formatted_line);
+	_igt_log_buffer_append(continuation, prefix, line);
 
 	/* check print log level */
 	if (igt_log_level > level)
@@ -2419,14 +3254,15 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 
 	/* prepend all except information messages with process, domain and log
 	 * level information */
-	if (level != IGT_LOG_INFO)
-		fwrite(formatted_line, sizeof(char), strlen(formatted_line),
-		       file);
-	else
-		fwrite(line, sizeof(char), strlen(line), file);
+	if (level != IGT_LOG_INFO && !continuation)
+		fwrite(prefix, sizeof(char), strlen(prefix), file);
+	fwrite(line, sizeof(char), len, file);
+
+	event_log(domain, igt_log_level_str[level], line, len);
 
 out:
-	free(line);
+	if (line != stack)
+		free(line);
 }
 
 static const char *timeout_op;
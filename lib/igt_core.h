@@ -224,6 +224,47 @@ bool __igt_run_subtest(const char *subtest_name, const char *file, const int lin
 #define igt_subtest_f(f...) \
 	__igt_subtest_f(igt_tokencat(__tmpchar, __LINE__), f)
 
+bool __igt_run_subtest_parallel(const char *subtest_name,
+				const char *file, const int line);
+
+/**
+ * igt_subtest_parallel:
+ * @name: name of the subtest
+ *
+ * Like igt_subtest(), but the subtest may run in a child process at the same
+ * time as the subtests marked the same way around it, for independent
+ * subtests such as those each running on their own engine. The parent goes
+ * on past the block right away; all the subtests in flight are waited for
+ * before the next #igt_fixture or plain igt_subtest(), or the end of the
+ * test. The output of each is passed on in one piece once it completes, in
+ * the order they were started.
+ *
+ * As the block runs in a child, nothing it changes is seen by the code after
+ * it. The IGT_SUBTEST_JOBS environment variable limits how many run at once,
+ * by default the number of cpus, with 1 running them in sequence.
+ */
+#define igt_subtest_parallel(name) \
+	for (; __igt_run_subtest_parallel((name), __FILE__, __LINE__) && \
+	     (sigsetjmp(igt_subtest_jmpbuf, 1) == 0); \
+	     igt_success())
+#define __igt_subtest_parallel_f(tmp, format...) \
+	for (char tmp [256]; \
+	     snprintf( tmp , sizeof( tmp ), \
+		      format), \
+	     __igt_run_subtest_parallel(tmp, __FILE__, __LINE__) && \
+	     (sigsetjmp(igt_subtest_jmpbuf, 1) == 0); \
+	     igt_success())
+
+/**
+ * igt_subtest_parallel_f:
+ * @...: format string and optional arguments
+ *
+ * Like igt_subtest_parallel(), but also accepts a printf format string
+ * instead of a static string.
+ */
+#define igt_subtest_parallel_f(f...) \
+	__igt_subtest_parallel_f(igt_tokencat(__tmpchar, __LINE__), f)
+
 const char *igt_subtest_name(void);
 bool igt_only_list_subtests(void);
 
@@ -923,6 +964,23 @@ bool __igt_fork(void);
 #define igt_fork(child, num_children) \
 	for (int child = 0; child < (num_children); child++) \
 		for (; __igt_fork(); exit(0))
+
+bool __igt_fork_pinned(int child);
+
+/**
+ * igt_fork_pinned:
+ * @child: name of the int variable with the child number
+ * @num_children: number of children to fork
+ *
+ * Like igt_fork(), except that each child is pinned to a single CPU, the
+ * children being spread round-robin over the CPUs the test is allowed to run
+ * on. This keeps the children of scaling tests from migrating and competing
+ * for the same CPUs, for less noisy results. See igt_child_results_create()
+ * for collecting results from the children.
+ */
+#define igt_fork_pinned(child, num_children) \
+	for (int child = 0; child < (num_children); child++) \
+		for (; __igt_fork_pinned(child); exit(0))
 int __igt_waitchildren(void);
 void igt_waitchildren(void);
 void igt_waitchildren_timeout(int seconds, const char *reason);
@@ -985,6 +1043,8 @@ void igt_install_exit_handler(igt_exit_handler_t fn);
 
 /* helpers to automatically reduce test runtime in simulation */
 bool igt_run_in_simulation(void);
+unsigned int igt_simulation_scale(void);
+uint64_t igt_simulation_scaled(uint64_t value);
 /**
  * SLOW_QUICK:
  * @slow: value in simulation mode
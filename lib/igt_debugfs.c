@@ -36,6 +36,9 @@
 #include <unistd.h>
 #include <i915_drm.h>
 #include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
 
 #include "drmtest.h"
 #include "igt_aux.h"
@@ -505,8 +508,23 @@ struct _igt_pipe_crc {
 
 	enum pipe pipe;
 	char *source;
+
+	/*
+	 * With igt_pipe_crc_start_async() a collector thread does all the
+	 * reading and hands the CRCs over in this single producer, single
+	 * consumer ring. wake_fd is signalled whenever new CRCs are queued.
+	 */
+	bool async;
+	pthread_t collector;
+	int wake_fd, stop_fd;
+	igt_crc_t *ring;
+	unsigned int head, tail;
+	unsigned int dropped;
+	bool done;
 };
 
+#define CRC_RING_SIZE 1024
+
 /**
  * igt_require_pipe_crc:
  *
@@ -724,9 +742,10 @@ void igt_pipe_crc_free(igt_pipe_crc_t *pipe_crc)
 	if (!pipe_crc)
 		return;
 
+	igt_pipe_crc_stop(pipe_crc);
 	close(pipe_crc->ctl_fd);
-	close(pipe_crc->crc_fd);
 	close(pipe_crc->dir);
+	free(pipe_crc->ring);
 	free(pipe_crc->source);
 	free(pipe_crc);
 }
@@ -753,11 +772,17 @@ static bool pipe_crc_init_from_string(igt_pipe_crc_t *pipe_crc, igt_crc_t *crc,
 	return true;
 }
 
+static int read_crc_async(igt_pipe_crc_t *pipe_crc, igt_crc_t *out, bool block);
+
 static int read_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out)
 {
 	ssize_t bytes_read;
 	char buf[MAX_LINE_LEN + 1];
 
+	if (pipe_crc->async)
+		return read_crc_async(pipe_crc, out,
+				      !(pipe_crc->flags & O_NONBLOCK));
+
 	igt_set_timeout(5, "CRC reading");
 	bytes_read = read(pipe_crc->crc_fd, &buf, MAX_LINE_LEN);
 	igt_reset_timeout();
@@ -773,10 +798,126 @@ static int read_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out)
 	return bytes_read;
 }
 
+static void *crc_collector(void *data)
+{
+	igt_pipe_crc_t *pipe_crc = data;
+	struct pollfd pfd[2] = {
+		{ .fd = pipe_crc->crc_fd, .events = POLLIN },
+		{ .fd = pipe_crc->stop_fd, .events = POLLIN },
+	};
+	unsigned int head = pipe_crc->head;
+	char buf[16 * MAX_LINE_LEN + 1];
+	size_t fill = 0;
+	bool eof = false;
+
+	fcntl(pipe_crc->crc_fd, F_SETFL, pipe_crc->flags | O_NONBLOCK);
+
+	while (!eof) {
+		unsigned int queued = 0;
+		ssize_t len;
+
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (pfd[1].revents || pfd[0].revents & POLLNVAL)
+			break;
+
+		/* Parse everything there is before waking up the test */
+		while ((len = read(pipe_crc->crc_fd, buf + fill,
+				   sizeof(buf) - 1 - fill)) > 0) {
+			char *line = buf, *end;
+
+			fill += len;
+			buf[fill] = '\0';
+
+			while ((end = strchr(line, '\n'))) {
+				if (head - __atomic_load_n(&pipe_crc->tail, __ATOMIC_ACQUIRE) < CRC_RING_SIZE) {
+					pipe_crc_init_from_string(pipe_crc,
+								  &pipe_crc->ring[head % CRC_RING_SIZE],
+								  line);
+					__atomic_store_n(&pipe_crc->head, ++head,
+							 __ATOMIC_RELEASE);
+					queued++;
+				} else {
+					pipe_crc->dropped++;
+				}
+
+				line = end + 1;
+			}
+
+			fill = buf + fill - line;
+			memmove(buf, line, fill);
+			if (fill == sizeof(buf) - 1)
+				fill = 0;
+		}
+		eof = len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR);
+
+		if (queued)
+			igt_ignore_warn(eventfd_write(pipe_crc->wake_fd, queued));
+	}
+
+	__atomic_store_n(&pipe_crc->done, true, __ATOMIC_RELEASE);
+	igt_ignore_warn(eventfd_write(pipe_crc->wake_fd, 1));
+
+	return NULL;
+}
+
+/*
+ * Returns the oldest queued CRC without consuming it, optionally waiting
+ * for one to arrive, or NULL if there is none.
+ */
+static igt_crc_t *crc_ring_peek(igt_pipe_crc_t *pipe_crc, bool block)
+{
+	struct pollfd pfd = { .fd = pipe_crc->wake_fd, .events = POLLIN };
+	eventfd_t count;
+
+	for (;;) {
+		bool done = __atomic_load_n(&pipe_crc->done, __ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&pipe_crc->head, __ATOMIC_ACQUIRE) != pipe_crc->tail)
+			return &pipe_crc->ring[pipe_crc->tail % CRC_RING_SIZE];
+
+		if (!block || done)
+			return NULL;
+
+		igt_set_timeout(5, "CRC reading");
+		poll(&pfd, 1, -1);
+		igt_reset_timeout();
+
+		eventfd_read(pipe_crc->wake_fd, &count);
+	}
+}
+
+static void crc_ring_pop(igt_pipe_crc_t *pipe_crc)
+{
+	__atomic_store_n(&pipe_crc->tail, pipe_crc->tail + 1, __ATOMIC_RELEASE);
+}
+
+static int read_crc_async(igt_pipe_crc_t *pipe_crc, igt_crc_t *out, bool block)
+{
+	igt_crc_t *crc = crc_ring_peek(pipe_crc, block);
+
+	if (!crc)
+		return -EAGAIN;
+
+	*out = *crc;
+	crc_ring_pop(pipe_crc);
+
+	return sizeof(*out);
+}
+
 static void read_one_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out)
 {
 	int ret;
 
+	if (pipe_crc->async) {
+		read_crc_async(pipe_crc, out, true);
+		return;
+	}
+
 	fcntl(pipe_crc->crc_fd, F_SETFL, pipe_crc->flags & ~O_NONBLOCK);
 
 	do {
@@ -786,16 +927,9 @@ static void read_one_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out)
 	fcntl(pipe_crc->crc_fd, F_SETFL, pipe_crc->flags);
 }
 
-/**
- * igt_pipe_crc_start:
- * @pipe_crc: pipe CRC object
- *
- * Starts the CRC capture process on @pipe_crc.
- */
-void igt_pipe_crc_start(igt_pipe_crc_t *pipe_crc)
+static void pipe_crc_open(igt_pipe_crc_t *pipe_crc)
 {
 	const char *src = pipe_crc->source;
-	struct pollfd pfd;
 	char buf[32];
 
 	/* Stop first just to make sure we don't have lingering state left. */
@@ -807,9 +941,22 @@ void igt_pipe_crc_start(igt_pipe_crc_t *pipe_crc)
 
 	sprintf(buf, "crtc-%d/crc/data", pipe_crc->pipe);
 
-	igt_set_timeout(10, "Opening crc fd, and poll for first CRC.");
 	pipe_crc->crc_fd = openat(pipe_crc->dir, buf, pipe_crc->flags);
 	igt_assert(pipe_crc->crc_fd != -1);
+}
+
+/**
+ * igt_pipe_crc_start:
+ * @pipe_crc: pipe CRC object
+ *
+ * Starts the CRC capture process on @pipe_crc.
+ */
+void igt_pipe_crc_start(igt_pipe_crc_t *pipe_crc)
+{
+	struct pollfd pfd;
+
+	igt_set_timeout(10, "Opening crc fd, and poll for first CRC.");
+	pipe_crc_open(pipe_crc);
 
 	pfd.fd = pipe_crc->crc_fd;
 	pfd.events = POLLIN;
@@ -820,6 +967,110 @@ void igt_pipe_crc_start(igt_pipe_crc_t *pipe_crc)
 	errno = 0;
 }
 
+static void crc_sanity_checks(igt_pipe_crc_t *pipe_crc, igt_crc_t *crc)
+{
+	int i;
+	bool all_zero = true;
+
+	/* Any CRC value can be considered valid on amdgpu hardware. */
+	if (is_amdgpu_device(pipe_crc->fd))
+		return;
+
+	for (i = 0; i < crc->n_words; i++) {
+		igt_warn_on_f(crc->crc[i] == 0xffffffff,
+			      "Suspicious CRC: it looks like the CRC "
+			      "read back was from a register in a powered "
+			      "down well\n");
+		if (crc->crc[i])
+			all_zero = false;
+	}
+
+	igt_warn_on_f(all_zero, "Suspicious CRC: All values are 0.\n");
+}
+
+/**
+ * igt_pipe_crc_start_async:
+ * @pipe_crc: pipe CRC object
+ *
+ * Starts the CRC capture process on @pipe_crc like igt_pipe_crc_start(), but
+ * with a thread that collects the CRCs as soon as the kernel has them, so
+ * that none are lost when the test doesn't keep up with high refresh rates.
+ * The kernel only queues a short backlog of CRCs before it starts dropping
+ * them.
+ *
+ * All the functions reading CRCs from @pipe_crc consume the collected CRCs,
+ * and igt_pipe_crc_get_for_frame() picks the one of a given frame. The
+ * collector is stopped with igt_pipe_crc_stop().
+ */
+void igt_pipe_crc_start_async(igt_pipe_crc_t *pipe_crc)
+{
+	sigset_t mask, old;
+
+	igt_pipe_crc_start(pipe_crc);
+
+	if (!pipe_crc->ring) {
+		pipe_crc->ring = calloc(CRC_RING_SIZE, sizeof(*pipe_crc->ring));
+		igt_assert(pipe_crc->ring);
+	}
+
+	pipe_crc->head = pipe_crc->tail = 0;
+	pipe_crc->dropped = 0;
+	pipe_crc->done = false;
+
+	pipe_crc->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	igt_assert(pipe_crc->wake_fd >= 0);
+	pipe_crc->stop_fd = eventfd(0, EFD_CLOEXEC);
+	igt_assert(pipe_crc->stop_fd >= 0);
+
+	/* Leave the signals, igt_set_timeout() included, to the test thread */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &old);
+	igt_assert_eq(pthread_create(&pipe_crc->collector, NULL,
+				     crc_collector, pipe_crc), 0);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pipe_crc->async = true;
+}
+
+/**
+ * igt_pipe_crc_get_for_frame:
+ * @pipe_crc: pipe CRC object
+ * @frame: vblank counter of the frame to get the CRC of
+ * @crc: buffer pointer for the captured CRC value
+ *
+ * Waits for the CRC of @frame to be collected by a @pipe_crc started with
+ * igt_pipe_crc_start_async(), discarding the CRCs of earlier frames. The CRC
+ * of a later frame is left queued.
+ *
+ * Returns: true if the CRC of @frame was captured, false if the kernel didn't
+ * produce one for it.
+ */
+bool igt_pipe_crc_get_for_frame(igt_pipe_crc_t *pipe_crc, unsigned int frame,
+				igt_crc_t *crc)
+{
+	igt_crc_t *next;
+
+	igt_assert(pipe_crc->async);
+
+	while ((next = crc_ring_peek(pipe_crc, true))) {
+		igt_require_f(next->has_valid_frame,
+			      "CRCs without frame counters\n");
+
+		if (igt_vblank_after(next->frame, frame))
+			return false;
+
+		if (next->frame == frame) {
+			*crc = *next;
+			crc_ring_pop(pipe_crc);
+			crc_sanity_checks(pipe_crc, crc);
+			return true;
+		}
+
+		crc_ring_pop(pipe_crc);
+	}
+
+	return false;
+}
+
 /**
  * igt_pipe_crc_stop:
  * @pipe_crc: pipe CRC object
@@ -828,6 +1079,18 @@ void igt_pipe_crc_start(igt_pipe_crc_t *pipe_crc)
  */
 void igt_pipe_crc_stop(igt_pipe_crc_t *pipe_crc)
 {
+	if (pipe_crc->async) {
+		igt_ignore_warn(eventfd_write(pipe_crc->stop_fd, 1));
+		pthread_join(pipe_crc->collector, NULL);
+		close(pipe_crc->stop_fd);
+		close(pipe_crc->wake_fd);
+		pipe_crc->async = false;
+
+		igt_warn_on_f(pipe_crc->dropped,
+			      "%u CRCs dropped, not consumed in time\n",
+			      pipe_crc->dropped);
+	}
+
 	close(pipe_crc->crc_fd);
 	pipe_crc->crc_fd = -1;
 }
@@ -879,27 +1142,6 @@ igt_pipe_crc_get_crcs(igt_pipe_crc_t *pipe_crc, int n_crcs,
 	return n;
 }
 
-static void crc_sanity_checks(igt_pipe_crc_t *pipe_crc, igt_crc_t *crc)
-{
-	int i;
-	bool all_zero = true;
-
-	/* Any CRC value can be considered valid on amdgpu hardware. */
-	if (is_amdgpu_device(pipe_crc->fd))
-		return;
-
-	for (i = 0; i < crc->n_words; i++) {
-		igt_warn_on_f(crc->crc[i] == 0xffffffff,
-			      "Suspicious CRC: it looks like the CRC "
-			      "read back was from a register in a powered "
-			      "down well\n");
-		if (crc->crc[i])
-			all_zero = false;
-	}
-
-	igt_warn_on_f(all_zero, "Suspicious CRC: All values are 0.\n");
-}
-
 /**
  * igt_pipe_crc_drain:
  * @pipe_crc: pipe CRC object
@@ -913,6 +1155,12 @@ void igt_pipe_crc_drain(igt_pipe_crc_t *pipe_crc)
 	int ret;
 	igt_crc_t crc;
 
+	if (pipe_crc->async) {
+		while (read_crc_async(pipe_crc, &crc, false) > 0)
+			;
+		return;
+	}
+
 	fcntl(pipe_crc->crc_fd, F_SETFL, pipe_crc->flags | O_NONBLOCK);
 
 	do {
@@ -1001,6 +1249,33 @@ void igt_pipe_crc_collect_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out_crc)
 	igt_pipe_crc_stop(pipe_crc);
 }
 
+/**
+ * igt_pipe_crc_collect_crcs:
+ * @pipe_crcs: pipe CRC objects of different pipes
+ * @count: number of pipe CRC objects
+ * @out_crcs: buffer for the @count captured CRC values
+ *
+ * Same as igt_pipe_crc_collect_crc() for each of @pipe_crcs, but with the
+ * captures all running at the same time, so that the frames it takes for the
+ * CRCs to arrive only have to be waited for once.
+ */
+void igt_pipe_crc_collect_crcs(igt_pipe_crc_t **pipe_crcs, int count,
+			       igt_crc_t *out_crcs)
+{
+	int i;
+
+	igt_debug_wait_for_keypress("crc");
+
+	for (i = 0; i < count; i++)
+		pipe_crc_open(pipe_crcs[i]);
+
+	for (i = 0; i < count; i++)
+		igt_pipe_crc_get_single(pipe_crcs[i], &out_crcs[i]);
+
+	for (i = 0; i < count; i++)
+		igt_pipe_crc_stop(pipe_crcs[i]);
+}
+
 /**
  * igt_reset_fifo_underrun_reporting:
  * @drm_fd: drm device file descriptor
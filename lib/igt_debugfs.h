@@ -98,6 +98,9 @@ igt_pipe_crc_new_nonblock(int fd, enum pipe pipe, const char *source);
 void igt_pipe_crc_free(igt_pipe_crc_t *pipe_crc);
 void igt_pipe_crc_start(igt_pipe_crc_t *pipe_crc);
 void igt_pipe_crc_stop(igt_pipe_crc_t *pipe_crc);
+void igt_pipe_crc_start_async(igt_pipe_crc_t *pipe_crc);
+bool igt_pipe_crc_get_for_frame(igt_pipe_crc_t *pipe_crc, unsigned int frame,
+				igt_crc_t *crc);
 __attribute__((warn_unused_result))
 int igt_pipe_crc_get_crcs(igt_pipe_crc_t *pipe_crc, int n_crcs,
 			  igt_crc_t **out_crcs);
@@ -106,6 +109,8 @@ void igt_pipe_crc_get_single(igt_pipe_crc_t *pipe_crc, igt_crc_t *out_crc);
 void igt_pipe_crc_get_current(int drm_fd, igt_pipe_crc_t *pipe_crc, igt_crc_t *crc);
 
 void igt_pipe_crc_collect_crc(igt_pipe_crc_t *pipe_crc, igt_crc_t *out_crc);
+void igt_pipe_crc_collect_crcs(igt_pipe_crc_t **pipe_crcs, int count,
+			       igt_crc_t *out_crcs);
 
 void igt_hpd_storm_set_threshold(int fd, unsigned int threshold);
 void igt_hpd_storm_reset(int fd);
@@ -22,11 +22,13 @@
  *
  */
 
+#include <stdlib.h>
 #include <sys/mman.h>
 
 #include "igt_draw.h"
 
 #include "drmtest.h"
+#include "igt_aux.h"
 #include "intel_batchbuffer.h"
 #include "intel_chipset.h"
 #include "igt_core.h"
@@ -42,6 +44,9 @@
 #define PAGE_ALIGN(x) ALIGN(x, PAGE_SIZE)
 #endif
 
+/* Room for one more XY_COLOR_BLT of a batch, and for switching tiling back */
+#define BLT_RECT_SPACE (16 * 4)
+
 /**
  * SECTION:igt_draw
  * @short_description: drawing helpers for tests
@@ -101,6 +106,8 @@ const char *igt_draw_get_method_name(enum igt_draw_method method)
 		return "blt";
 	case IGT_DRAW_RENDER:
 		return "render";
+	case IGT_DRAW_USERPTR:
+		return "userptr";
 	default:
 		igt_assert(false);
 	}
@@ -513,9 +520,9 @@ static void draw_rect_pwrite(int fd, struct buf_data *buf,
 	}
 }
 
-static void draw_rect_blt(int fd, struct cmd_data *cmd_data,
-			  struct buf_data *buf, struct rect *rect,
-			  uint32_t color)
+static void draw_rects_blt(int fd, struct cmd_data *cmd_data,
+			   struct buf_data *buf, const struct rect *rects,
+			   int num_rects, uint32_t color)
 {
 	drm_intel_bo *dst;
 	struct intel_batchbuffer *batch;
@@ -553,15 +560,26 @@ static void draw_rect_blt(int fd, struct cmd_data *cmd_data,
 
 	switch_blt_tiling(batch, tiling, true);
 
-	BEGIN_BATCH(6, 1);
-	OUT_BATCH(XY_COLOR_BLT_CMD_NOLEN | XY_COLOR_BLT_WRITE_ALPHA |
-		  XY_COLOR_BLT_WRITE_RGB | blt_cmd_tiling | blt_cmd_len);
-	OUT_BATCH(blt_cmd_depth | (0xF0 << 16) | pitch);
-	OUT_BATCH((rect->y << 16) | rect->x);
-	OUT_BATCH(((rect->y + rect->h) << 16) | (rect->x + rect->w));
-	OUT_RELOC_FENCED(dst, 0, I915_GEM_DOMAIN_RENDER, 0);
-	OUT_BATCH(color);
-	ADVANCE_BATCH();
+	for (int i = 0; i < num_rects; i++) {
+		const struct rect *rect = &rects[i];
+
+		/* Keep the blits and the tiling switch in the same batch */
+		if (intel_batchbuffer_space(batch) < BLT_RECT_SPACE) {
+			switch_blt_tiling(batch, tiling, false);
+			intel_batchbuffer_flush(batch);
+			switch_blt_tiling(batch, tiling, true);
+		}
+
+		BEGIN_BATCH(6, 1);
+		OUT_BATCH(XY_COLOR_BLT_CMD_NOLEN | XY_COLOR_BLT_WRITE_ALPHA |
+			  XY_COLOR_BLT_WRITE_RGB | blt_cmd_tiling | blt_cmd_len);
+		OUT_BATCH(blt_cmd_depth | (0xF0 << 16) | pitch);
+		OUT_BATCH((rect->y << 16) | rect->x);
+		OUT_BATCH(((rect->y + rect->h) << 16) | (rect->x + rect->w));
+		OUT_RELOC_FENCED(dst, 0, I915_GEM_DOMAIN_RENDER, 0);
+		OUT_BATCH(color);
+		ADVANCE_BATCH();
+	}
 
 	switch_blt_tiling(batch, tiling, false);
 
@@ -570,29 +588,38 @@ static void draw_rect_blt(int fd, struct cmd_data *cmd_data,
 	drm_intel_bo_unreference(dst);
 }
 
-static void draw_rect_render(int fd, struct cmd_data *cmd_data,
-			     struct buf_data *buf, struct rect *rect,
-			     uint32_t color)
+static void draw_rects_render(int fd, struct cmd_data *cmd_data,
+			      struct buf_data *buf, const struct rect *rects,
+			      int num_rects, uint32_t color)
 {
 	drm_intel_bo *src, *dst;
 	uint32_t devid = intel_get_drm_devid(fd);
-	igt_render_copyfunc_t rendercopy = igt_get_render_copyfunc(devid);
+	igt_render_copy_rects_func_t rendercopy =
+		igt_get_render_copy_rects_func(devid);
 	struct igt_buf src_buf = {}, dst_buf = {};
+	struct igt_render_copy_rect *copies;
 	struct intel_batchbuffer *batch;
 	uint32_t tiling, swizzle;
 	struct buf_data tmp;
 	int pixel_size = buf->bpp / 8;
+	int max_w = 0, max_h = 0;
 
 	igt_skip_on(!rendercopy);
 
 	igt_require(gem_get_tiling(fd, buf->handle, &tiling, &swizzle));
 
-	/* We create a temporary buffer and copy from it using rendercopy. */
-	tmp.size = rect->w * rect->h * pixel_size;
+	for (int i = 0; i < num_rects; i++) {
+		max_w = max(max_w, rects[i].w);
+		max_h = max(max_h, rects[i].h);
+	}
+
+	/* We create a temporary buffer, as large as the largest rectangle,
+	 * and copy from it using rendercopy. */
+	tmp.size = max_w * max_h * pixel_size;
 	tmp.handle = gem_create(fd, tmp.size);
-	tmp.stride = rect->w * pixel_size;
+	tmp.stride = max_w * pixel_size;
 	tmp.bpp = buf->bpp;
-	draw_rect_mmap_cpu(fd, &tmp, &(struct rect){0, 0, rect->w, rect->h},
+	draw_rect_mmap_cpu(fd, &tmp, &(struct rect){0, 0, max_w, max_h},
 			   color);
 
 	src = gem_handle_to_libdrm_bo(cmd_data->bufmgr, fd, "", tmp.handle);
@@ -611,23 +638,127 @@ static void draw_rect_render(int fd, struct cmd_data *cmd_data,
 	dst_buf.size = buf->size;
 	dst_buf.bpp = buf->bpp;
 
+	copies = calloc(num_rects, sizeof(*copies));
+	igt_assert(copies);
+
+	for (int i = 0; i < num_rects; i++)
+		copies[i] = (struct igt_render_copy_rect) {
+			.src = &src_buf,
+			.width = rects[i].w,
+			.height = rects[i].h,
+			.dst = &dst_buf,
+			.dst_x = rects[i].x,
+			.dst_y = rects[i].y,
+		};
+
 	batch = intel_batchbuffer_alloc(cmd_data->bufmgr, devid);
 	igt_assert(batch);
 
-	rendercopy(batch, cmd_data->context, &src_buf, 0, 0, rect->w,
-		   rect->h, &dst_buf, rect->x, rect->y);
+	rendercopy(batch, cmd_data->context, copies, num_rects);
 
 	intel_batchbuffer_free(batch);
+	free(copies);
 	drm_intel_bo_unreference(src);
 	drm_intel_bo_unreference(dst);
 	gem_close(fd, tmp.handle);
 }
 
+static void draw_rect_userptr(int fd, struct cmd_data *cmd_data,
+			      struct buf_data *buf, struct rect *rect,
+			      uint32_t color)
+{
+	drm_intel_bo *src, *dst;
+	struct intel_batchbuffer *batch;
+	int blt_cmd_len, blt_cmd_tiling, blt_cmd_depth;
+	uint32_t devid = intel_get_drm_devid(fd);
+	int gen = intel_gen(devid);
+	uint32_t tiling, swizzle;
+	uint32_t src_handle, src_stride, src_size;
+	int pixel_size = buf->bpp / 8;
+	int pitch, ret;
+	void *ptr;
+
+	igt_require(gem_get_tiling(fd, buf->handle, &tiling, &swizzle));
+
+	/* The rectangle is drawn straight into anonymous memory, which the
+	 * blitter then reads through a userptr object: unlike with
+	 * IGT_DRAW_PWRITE or IGT_DRAW_RENDER, the CPU never copies the pixels
+	 * into a GEM object. */
+	src_stride = ALIGN(rect->w * pixel_size, 64);
+	src_size = PAGE_ALIGN(src_stride * rect->h);
+	ptr = mmap(NULL, src_size, PROT_READ | PROT_WRITE,
+		   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	igt_assert(ptr != MAP_FAILED);
+
+	ret = __gem_userptr(fd, ptr, src_size, 0, 0, &src_handle);
+	if (ret) {
+		munmap(ptr, src_size);
+		igt_require_f(ret == 0, "userptr not supported\n");
+	}
+
+	draw_rect_ptr_linear(ptr, src_stride,
+			     &(struct rect){0, 0, rect->w, rect->h},
+			     color, buf->bpp);
+
+	src = gem_handle_to_libdrm_bo(cmd_data->bufmgr, fd, "", src_handle);
+	igt_assert(src);
+	dst = gem_handle_to_libdrm_bo(cmd_data->bufmgr, fd, "", buf->handle);
+	igt_assert(dst);
+
+	batch = intel_batchbuffer_alloc(cmd_data->bufmgr, devid);
+	igt_assert(batch);
+
+	switch (buf->bpp) {
+	case 8:
+		blt_cmd_depth = 0;
+		break;
+	case 16: /* we're assuming 565 */
+		blt_cmd_depth = 1 << 24;
+		break;
+	case 32:
+		blt_cmd_depth = 3 << 24;
+		break;
+	default:
+		igt_assert(false);
+	}
+
+	blt_cmd_len = (gen >= 8) ?  0x8 : 0x6;
+	blt_cmd_tiling = (tiling) ? XY_SRC_COPY_BLT_DST_TILED : 0;
+	pitch = (tiling) ? buf->stride / 4 : buf->stride;
+
+	switch_blt_tiling(batch, tiling, true);
+
+	BEGIN_BATCH(8, 2);
+	OUT_BATCH(XY_SRC_COPY_BLT_CMD | XY_SRC_COPY_BLT_WRITE_ALPHA |
+		  XY_SRC_COPY_BLT_WRITE_RGB | blt_cmd_tiling | blt_cmd_len);
+	OUT_BATCH(blt_cmd_depth | (0xCC << 16) | pitch);
+	OUT_BATCH((rect->y << 16) | rect->x);
+	OUT_BATCH(((rect->y + rect->h) << 16) | (rect->x + rect->w));
+	OUT_RELOC_FENCED(dst, I915_GEM_DOMAIN_RENDER, I915_GEM_DOMAIN_RENDER, 0);
+	OUT_BATCH(0);
+	OUT_BATCH(src_stride);
+	OUT_RELOC_FENCED(src, I915_GEM_DOMAIN_RENDER, 0, 0);
+	ADVANCE_BATCH();
+
+	switch_blt_tiling(batch, tiling, false);
+
+	intel_batchbuffer_flush(batch);
+	intel_batchbuffer_free(batch);
+
+	/* The host memory must outlive the copy */
+	gem_sync(fd, src_handle);
+
+	drm_intel_bo_unreference(src);
+	drm_intel_bo_unreference(dst);
+	gem_close(fd, src_handle);
+	munmap(ptr, src_size);
+}
+
 /**
  * igt_draw_rect:
  * @fd: the DRM file descriptor
- * @bufmgr: the libdrm bufmgr, only required for IGT_DRAW_BLT and
- *          IGT_DRAW_RENDER
+ * @bufmgr: the libdrm bufmgr, only required for IGT_DRAW_BLT,
+ *          IGT_DRAW_RENDER and IGT_DRAW_USERPTR
  * @context: the context, can be NULL if you don't want to think about it
  * @buf_handle: the handle of the buffer where you're going to draw to
  * @buf_size: the size of the buffer
@@ -679,10 +810,13 @@ void igt_draw_rect(int fd, drm_intel_bufmgr *bufmgr, drm_intel_context *context,
 		draw_rect_pwrite(fd, &buf, &rect, color);
 		break;
 	case IGT_DRAW_BLT:
-		draw_rect_blt(fd, &cmd_data, &buf, &rect, color);
+		draw_rects_blt(fd, &cmd_data, &buf, &rect, 1, color);
 		break;
 	case IGT_DRAW_RENDER:
-		draw_rect_render(fd, &cmd_data, &buf, &rect, color);
+		draw_rects_render(fd, &cmd_data, &buf, &rect, 1, color);
+		break;
+	case IGT_DRAW_USERPTR:
+		draw_rect_userptr(fd, &cmd_data, &buf, &rect, color);
 		break;
 	default:
 		igt_assert(false);
@@ -690,11 +824,84 @@ void igt_draw_rect(int fd, drm_intel_bufmgr *bufmgr, drm_intel_context *context,
 	}
 }
 
+/**
+ * igt_draw_rects:
+ * @fd: the DRM file descriptor
+ * @bufmgr: the libdrm bufmgr, only required for IGT_DRAW_BLT,
+ *          IGT_DRAW_RENDER and IGT_DRAW_USERPTR
+ * @context: the context, can be NULL if you don't want to think about it
+ * @buf_handle: the handle of the buffer where you're going to draw to
+ * @buf_size: the size of the buffer
+ * @buf_stride: the stride of the buffer
+ * @method: method you're going to use to write to the buffer
+ * @rects: the rectangles to draw
+ * @num_rects: the number of rectangles
+ * @color: color of the rectangles
+ * @bpp: bits per pixel
+ *
+ * Like igt_draw_rect(), but for many rectangles at once. IGT_DRAW_BLT emits
+ * one XY_COLOR_BLT per rectangle into a single batch and IGT_DRAW_RENDER
+ * copies all of them from one source in a batched render copy, so drawing
+ * hundreds of damage rectangles costs about one submission. The other
+ * methods draw the rectangles one after the other.
+ */
+void igt_draw_rects(int fd, drm_intel_bufmgr *bufmgr,
+		    drm_intel_context *context,
+		    uint32_t buf_handle, uint32_t buf_size, uint32_t buf_stride,
+		    enum igt_draw_method method,
+		    const drmModeClip *rects, int num_rects,
+		    uint32_t color, int bpp)
+{
+	struct cmd_data cmd_data = {
+		.bufmgr = bufmgr,
+		.context = context,
+	};
+	struct buf_data buf = {
+		.handle = buf_handle,
+		.size = buf_size,
+		.stride = buf_stride,
+		.bpp = bpp,
+	};
+	struct rect *r;
+
+	if (!num_rects)
+		return;
+
+	if (method != IGT_DRAW_BLT && method != IGT_DRAW_RENDER) {
+		for (int i = 0; i < num_rects; i++)
+			igt_draw_rect(fd, bufmgr, context, buf_handle,
+				      buf_size, buf_stride, method,
+				      rects[i].x1, rects[i].y1,
+				      rects[i].x2 - rects[i].x1,
+				      rects[i].y2 - rects[i].y1,
+				      color, bpp);
+		return;
+	}
+
+	r = calloc(num_rects, sizeof(*r));
+	igt_assert(r);
+
+	for (int i = 0; i < num_rects; i++)
+		r[i] = (struct rect) {
+			.x = rects[i].x1,
+			.y = rects[i].y1,
+			.w = rects[i].x2 - rects[i].x1,
+			.h = rects[i].y2 - rects[i].y1,
+		};
+
+	if (method == IGT_DRAW_BLT)
+		draw_rects_blt(fd, &cmd_data, &buf, r, num_rects, color);
+	else
+		draw_rects_render(fd, &cmd_data, &buf, r, num_rects, color);
+
+	free(r);
+}
+
 /**
  * igt_draw_rect_fb:
  * @fd: the DRM file descriptor
- * @bufmgr: the libdrm bufmgr, only required for IGT_DRAW_BLT and
- *          IGT_DRAW_RENDER
+ * @bufmgr: the libdrm bufmgr, only required for IGT_DRAW_BLT,
+ *          IGT_DRAW_RENDER and IGT_DRAW_USERPTR
  * @context: the context, can be NULL if you don't want to think about it
  * @fb: framebuffer
  * @method: method you're going to use to write to the buffer
@@ -717,6 +924,31 @@ void igt_draw_rect_fb(int fd, drm_intel_bufmgr *bufmgr,
 		      igt_drm_format_to_bpp(fb->drm_format));
 }
 
+/**
+ * igt_draw_rects_fb:
+ * @fd: the DRM file descriptor
+ * @bufmgr: the libdrm bufmgr, only required for IGT_DRAW_BLT,
+ *          IGT_DRAW_RENDER and IGT_DRAW_USERPTR
+ * @context: the context, can be NULL if you don't want to think about it
+ * @fb: framebuffer
+ * @method: method you're going to use to write to the buffer
+ * @rects: the rectangles to draw
+ * @num_rects: the number of rectangles
+ * @color: color of the rectangles
+ *
+ * This is exactly the same as igt_draw_rects, but you can pass an igt_fb
+ * instead of manually providing its details. See igt_draw_rects.
+ */
+void igt_draw_rects_fb(int fd, drm_intel_bufmgr *bufmgr,
+		       drm_intel_context *context, struct igt_fb *fb,
+		       enum igt_draw_method method,
+		       const drmModeClip *rects, int num_rects, uint32_t color)
+{
+	igt_draw_rects(fd, bufmgr, context, fb->gem_handle, fb->size,
+		       fb->strides[0], method, rects, num_rects, color,
+		       igt_drm_format_to_bpp(fb->drm_format));
+}
+
 /**
  * igt_draw_fill_fb:
  * @fd: the DRM file descriptor
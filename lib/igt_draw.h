@@ -36,6 +36,8 @@
  * @IGT_DRAW_PWRITE: draw using the pwrite ioctl.
  * @IGT_DRAW_BLT: draw using the BLT ring.
  * @IGT_DRAW_RENDER: draw using the render ring.
+ * @IGT_DRAW_USERPTR: draw to host memory, then copy it using the BLT ring
+ *		      through a userptr object.
  * @IGT_DRAW_METHOD_COUNT: useful for iterating through everything.
  */
 enum igt_draw_method {
@@ -45,6 +47,7 @@ enum igt_draw_method {
 	IGT_DRAW_PWRITE,
 	IGT_DRAW_BLT,
 	IGT_DRAW_RENDER,
+	IGT_DRAW_USERPTR,
 	IGT_DRAW_METHOD_COUNT,
 };
 
@@ -60,6 +63,18 @@ void igt_draw_rect_fb(int fd, drm_intel_bufmgr *bufmgr,
 		      enum igt_draw_method method, int rect_x, int rect_y,
 		      int rect_w, int rect_h, uint32_t color);
 
+void igt_draw_rects(int fd, drm_intel_bufmgr *bufmgr,
+		    drm_intel_context *context,
+		    uint32_t buf_handle, uint32_t buf_size, uint32_t buf_stride,
+		    enum igt_draw_method method,
+		    const drmModeClip *rects, int num_rects,
+		    uint32_t color, int bpp);
+
+void igt_draw_rects_fb(int fd, drm_intel_bufmgr *bufmgr,
+		       drm_intel_context *context, struct igt_fb *fb,
+		       enum igt_draw_method method,
+		       const drmModeClip *rects, int num_rects, uint32_t color);
+
 void igt_draw_fill_fb(int fd, struct igt_fb *fb, uint32_t color);
 
 #endif /* __IGT_DRAW_H__ */
@@ -25,7 +25,11 @@
 #include <time.h>
 #include <signal.h>
 #include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <sys/poll.h>
+#include <sys/syscall.h>
+#include <linux/kcmp.h>
 
 #include <i915_drm.h>
 
@@ -37,8 +41,10 @@
 #include "intel_chipset.h"
 #include "intel_reg.h"
 #include "ioctl_wrappers.h"
+#include "igt_syncobj.h"
 #include "sw_sync.h"
 #include "igt_vgem.h"
+#include "i915/gem_caps.h"
 #include "i915/gem_engine_topology.h"
 #include "i915/gem_mman.h"
 
@@ -61,13 +67,231 @@
 #define ENGINE_MASK  (I915_EXEC_RING_MASK | LOCAL_I915_EXEC_BSD_MASK)
 
 #define MI_ARB_CHK (0x5 << 23)
+#define MI_MATH(n) (0x1a << 23 | ((n) - 1))
+#define MI_STORE_REGISTER_MEM_GEN8 (0x24 << 23 | 2)
+#define MI_LOAD_REGISTER_REG (0x2a << 23 | 1)
+#define MI_COND_BATCH_BUFFER_END_GEN8 (0x36 << 23 | 1 << 21 | 2)
+
+#define MI_MATH_INSTR(opcode, op1, op2) ((opcode) << 20 | (op1) << 10 | (op2))
+#define MI_MATH_LOAD(op1, op2) MI_MATH_INSTR(0x080, op1, op2)
+#define MI_MATH_SUB MI_MATH_INSTR(0x101, 0x0, 0x0)
+#define MI_MATH_STORE(op1, op2) MI_MATH_INSTR(0x180, op1, op2)
+#define MI_MATH_REG(x) (x)
+#define MI_MATH_REG_SRCA 0x20
+#define MI_MATH_REG_SRCB 0x21
+#define MI_MATH_REG_ACCU 0x31
+#define MI_MATH_REG_CF 0x33
+
+#define RING_TIMESTAMP(base) ((base) + 0x358)
+#define CS_GPR(base, n) ((base) + 0x600 + 8 * (n))
 
 static const int BATCH_SIZE = 4096;
 static const int LOOP_START_OFFSET = 64;
+/* Where the duration check of the loop stores its result */
+static const int DURATION_OFFSET = 4096 - sizeof(uint32_t);
 
 static IGT_LIST(spin_list);
 static pthread_mutex_t list_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Batches (and poll pages) of freed spinners, kept mapped for reuse */
+struct spin_pool_bo {
+	struct igt_list link;
+	int fd;
+	uint32_t handle;
+	uint32_t *batch;
+	uint32_t poll_handle;
+	uint32_t *poll;
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	struct igt_list bos;
+	unsigned int count;
+	unsigned int max_count;
+	pid_t pid;
+	bool init;
+} spin_pool = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.bos = __IGT_INIT_LIST(spin_pool.bos),
+};
+
+static bool same_file(int fd1, int fd2)
+{
+	pid_t pid = getpid();
+
+	return syscall(SYS_kcmp, pid, pid, KCMP_FILE, fd1, fd2) == 0;
+}
+
+static void spin_pool_free(struct spin_pool_bo *bo)
+{
+	igt_list_del(&bo->link);
+	spin_pool.count--;
+
+	gem_munmap(bo->batch, BATCH_SIZE);
+	gem_close(bo->fd, bo->handle);
+	if (bo->poll) {
+		gem_munmap(bo->poll, 4096);
+		gem_close(bo->fd, bo->poll_handle);
+	}
+
+	close(bo->fd);
+	free(bo);
+}
+
+/* Called with spin_pool.mutex held */
+static void spin_pool_evict(unsigned int max_count)
+{
+	/* Entries inherited over fork() share their drm file with the parent */
+	if (spin_pool.pid != getpid()) {
+		igt_list_init(&spin_pool.bos);
+		spin_pool.count = 0;
+		spin_pool.pid = getpid();
+	}
+
+	while (spin_pool.count > max_count) {
+		struct spin_pool_bo *bo =
+			igt_list_last_entry(&spin_pool.bos, bo, link);
+
+		spin_pool_free(bo);
+	}
+}
+
+/**
+ * igt_spin_pool_enable:
+ * @max_count: most freed spinners to keep around
+ *
+ * Enables recycling of the spinners released with igt_spin_free(). Their
+ * batch, and poll page for IGT_SPIN_POLL_RUN, stay allocated and mapped, and
+ * the next spinner created on the same drm file reuses them instead of
+ * allocating new ones, which makes creating many short lived spinners cheap.
+ * The least recently freed are released once @max_count is exceeded.
+ *
+ * Pooled spinners keep the drm file they were created on open, call
+ * igt_spin_pool_disable() before closing the last fd of a device that needs
+ * to go idle, e.g. to unload the driver.
+ *
+ * The pool can also be enabled by setting the IGT_SPIN_POOL environment
+ * variable to the number of spinners to keep.
+ */
+void igt_spin_pool_enable(unsigned int max_count)
+{
+	pthread_mutex_lock(&spin_pool.mutex);
+
+	spin_pool.max_count = max_count;
+	spin_pool.init = true;
+	spin_pool_evict(max_count);
+
+	pthread_mutex_unlock(&spin_pool.mutex);
+}
+
+/**
+ * igt_spin_pool_disable:
+ *
+ * Disables the spinner pool and frees all pooled spinners.
+ */
+void igt_spin_pool_disable(void)
+{
+	igt_spin_pool_enable(0);
+}
+
+/* Called with spin_pool.mutex held */
+static unsigned int spin_pool_max_count(void)
+{
+	if (!spin_pool.init) {
+		const char *env = getenv("IGT_SPIN_POOL");
+
+		if (env)
+			spin_pool.max_count = strtoul(env, NULL, 0);
+		spin_pool.init = true;
+	}
+
+	return spin_pool.max_count;
+}
+
+static uint32_t *spin_pool_get(igt_spin_t *spin, int fd, bool poll)
+{
+	struct spin_pool_bo *bo;
+	uint32_t *batch = NULL;
+
+	pthread_mutex_lock(&spin_pool.mutex);
+
+	spin_pool_evict(spin_pool_max_count());
+
+	igt_list_for_each(bo, &spin_pool.bos, link) {
+		if (!bo->poll != !poll || !same_file(bo->fd, fd))
+			continue;
+
+		/* The handles are just as valid on fd */
+		spin->obj[IGT_SPIN_BATCH].handle = bo->handle;
+		batch = bo->batch;
+		if (poll) {
+			spin->poll_handle = bo->poll_handle;
+			spin->poll = bo->poll;
+			spin->poll[SPIN_POLL_START_IDX] = 0;
+		}
+
+		igt_list_del(&bo->link);
+		spin_pool.count--;
+		close(bo->fd);
+		free(bo);
+		break;
+	}
+
+	pthread_mutex_unlock(&spin_pool.mutex);
+
+	return batch;
+}
+
+static bool spin_pool_put(int fd, igt_spin_t *spin)
+{
+	struct spin_pool_bo *bo;
+	bool ret = false;
+
+	pthread_mutex_lock(&spin_pool.mutex);
+
+	if (!spin_pool_max_count())
+		goto out;
+
+	bo = malloc(sizeof(*bo));
+	if (!bo)
+		goto out;
+
+	bo->fd = dup(fd);
+	if (bo->fd < 0) {
+		free(bo);
+		goto out;
+	}
+
+	bo->handle = spin->handle;
+	bo->batch = (uint32_t *)((unsigned long)spin->condition & ~4095UL);
+	bo->poll_handle = spin->poll_handle;
+	bo->poll = spin->poll;
+
+	spin_pool_evict(spin_pool.max_count - 1);
+	igt_list_add(&bo->link, &spin_pool.bos);
+	spin_pool.count++;
+	ret = true;
+
+out:
+	pthread_mutex_unlock(&spin_pool.mutex);
+	return ret;
+}
+
+static uint32_t spin_mmio_base(int fd, const struct igt_spin_factory *opts)
+{
+	struct intel_execution_engine2 e;
+
+	if (gem_context_lookup_engine(fd, opts->engine, opts->ctx, &e)) {
+		e = gem_eb_flags_to_engine(opts->engine);
+		if (e.flags == I915_EXEC_DEFAULT) {
+			e.class = I915_ENGINE_CLASS_RENDER;
+			e.instance = 0;
+		}
+	}
+
+	return gem_engine_mmio_base(fd, e.class, e.instance);
+}
+
 static int
 emit_recursive_batch(igt_spin_t *spin,
 		     int fd, const struct igt_spin_factory *opts)
@@ -75,13 +299,16 @@ emit_recursive_batch(igt_spin_t *spin,
 #define SCRATCH 0
 #define BATCH IGT_SPIN_BATCH
 	const int gen = intel_gen(intel_get_drm_devid(fd));
-	struct drm_i915_gem_relocation_entry relocs[2], *r;
+	struct drm_i915_gem_relocation_entry relocs[4], *r;
 	struct drm_i915_gem_execbuffer2 *execbuf;
 	struct drm_i915_gem_exec_object2 *obj;
 	unsigned int flags[GEM_MAX_ENGINES];
 	unsigned int nengine;
 	int fence_fd = -1;
-	uint32_t *cs, *batch;
+	uint32_t *cs, *batch, *pad;
+	uint32_t mmio_base = 0;
+	uint64_t ticks = 0;
+	bool recycled;
 	int i;
 
 	nengine = 0;
@@ -100,21 +327,45 @@ emit_recursive_batch(igt_spin_t *spin,
 	}
 	igt_require(nengine);
 
+	if (opts->duration_ns) {
+		uint64_t freq;
+
+		igt_assert_f(opts->engine != ALL_ENGINES,
+			     "timed spinners use the registers of their engine\n");
+		igt_require(gen >= 8);
+
+		mmio_base = spin_mmio_base(fd, opts);
+		igt_require(mmio_base);
+
+		freq = gem_caps_getparam(fd, I915_PARAM_CS_TIMESTAMP_FREQUENCY);
+		igt_require(freq);
+
+		ticks = igt_simulation_scaled(opts->duration_ns) *
+			freq / NSEC_PER_SEC;
+	}
+
 	memset(&spin->execbuf, 0, sizeof(spin->execbuf));
 	execbuf = &spin->execbuf;
 	memset(spin->obj, 0, sizeof(spin->obj));
 	obj = spin->obj;
 	memset(relocs, 0, sizeof(relocs));
 
-	obj[BATCH].handle = gem_create(fd, BATCH_SIZE);
-	batch = __gem_mmap__wc(fd, obj[BATCH].handle,
-			       0, BATCH_SIZE, PROT_WRITE);
-	if (!batch)
-		batch = gem_mmap__gtt(fd, obj[BATCH].handle,
-				      BATCH_SIZE, PROT_WRITE);
+	batch = spin_pool_get(spin, fd, opts->flags & IGT_SPIN_POLL_RUN);
+	recycled = batch;
+	if (!batch) {
+		obj[BATCH].handle = gem_create(fd, BATCH_SIZE);
+		batch = __gem_mmap__wc(fd, obj[BATCH].handle,
+				       0, BATCH_SIZE, PROT_WRITE);
+		if (!batch)
+			batch = gem_mmap__gtt(fd, obj[BATCH].handle,
+					      BATCH_SIZE, PROT_WRITE);
+	}
 
+	/* This also waits for a recycled batch to be idle */
 	gem_set_domain(fd, obj[BATCH].handle,
 		       I915_GEM_DOMAIN_GTT, I915_GEM_DOMAIN_GTT);
+	if (recycled) /* the padding below relies on MI_NOOP being 0 */
+		memset(batch, 0, BATCH_SIZE);
 	execbuf->buffer_count++;
 	cs = batch;
 
@@ -143,19 +394,25 @@ emit_recursive_batch(igt_spin_t *spin,
 			igt_require(__igt_device_set_master(fd) == 0);
 		}
 
-		spin->poll_handle = gem_create(fd, 4096);
+		if (!spin->poll) {
+			spin->poll_handle = gem_create(fd, 4096);
+
+			if (__gem_set_caching(fd, spin->poll_handle,
+					      I915_CACHING_CACHED) == 0)
+				spin->poll = gem_mmap__cpu(fd,
+							   spin->poll_handle,
+							   0, 4096,
+							   PROT_READ |
+							   PROT_WRITE);
+			else
+				spin->poll = gem_mmap__wc(fd,
+							  spin->poll_handle,
+							  0, 4096,
+							  PROT_READ |
+							  PROT_WRITE);
+		}
 		obj[SCRATCH].handle = spin->poll_handle;
 
-		if (__gem_set_caching(fd, spin->poll_handle,
-				      I915_CACHING_CACHED) == 0)
-			spin->poll = gem_mmap__cpu(fd, spin->poll_handle,
-						   0, 4096,
-						   PROT_READ | PROT_WRITE);
-		else
-			spin->poll = gem_mmap__wc(fd, spin->poll_handle,
-						  0, 4096,
-						  PROT_READ | PROT_WRITE);
-
 		igt_assert_eq(spin->poll[SPIN_POLL_START_IDX], 0);
 
 		/* batch is first */
@@ -185,6 +442,19 @@ emit_recursive_batch(igt_spin_t *spin,
 
 	spin->handle = obj[BATCH].handle;
 
+	if (opts->duration_ns) {
+		/* Sample the start time in GPR0, zeroing the high dwords */
+		*cs++ = MI_LOAD_REGISTER_IMM;
+		*cs++ = CS_GPR(mmio_base, 0) + 4;
+		*cs++ = 0;
+		*cs++ = MI_LOAD_REGISTER_IMM;
+		*cs++ = CS_GPR(mmio_base, 1) + 4;
+		*cs++ = 0;
+		*cs++ = MI_LOAD_REGISTER_REG;
+		*cs++ = RING_TIMESTAMP(mmio_base);
+		*cs++ = CS_GPR(mmio_base, 0);
+	}
+
 	igt_assert_lt(cs - batch, LOOP_START_OFFSET / sizeof(*cs));
 	spin->condition = batch + LOOP_START_OFFSET / sizeof(*cs);
 	cs = spin->condition;
@@ -192,6 +462,60 @@ emit_recursive_batch(igt_spin_t *spin,
 	/* Allow ourselves to be preempted */
 	if (!(opts->flags & IGT_SPIN_NO_PREEMPTION))
 		*cs++ = MI_ARB_CHK;
+	pad = cs;
+
+	if (opts->duration_ns) {
+		/*
+		 * Each time around the loop, compute GPR3 = now - start and
+		 * compare it against the duration in GPR2: the borrow of
+		 * GPR3 - GPR2 is stored as ~0 while the duration has not
+		 * elapsed yet, and 0 afterwards, which ends the batch.
+		 *
+		 * RING_TIMESTAMP is only 32 bits wide, so a spinner running
+		 * across its wraparound ends early.
+		 */
+		*cs++ = MI_LOAD_REGISTER_IMM;
+		*cs++ = CS_GPR(mmio_base, 2);
+		*cs++ = ticks;
+		*cs++ = MI_LOAD_REGISTER_IMM;
+		*cs++ = CS_GPR(mmio_base, 2) + 4;
+		*cs++ = ticks >> 32;
+		*cs++ = MI_LOAD_REGISTER_REG;
+		*cs++ = RING_TIMESTAMP(mmio_base);
+		*cs++ = CS_GPR(mmio_base, 1);
+
+		*cs++ = MI_MATH(8);
+		*cs++ = MI_MATH_LOAD(MI_MATH_REG_SRCA, MI_MATH_REG(1));
+		*cs++ = MI_MATH_LOAD(MI_MATH_REG_SRCB, MI_MATH_REG(0));
+		*cs++ = MI_MATH_SUB;
+		*cs++ = MI_MATH_STORE(MI_MATH_REG(3), MI_MATH_REG_ACCU);
+		*cs++ = MI_MATH_LOAD(MI_MATH_REG_SRCA, MI_MATH_REG(3));
+		*cs++ = MI_MATH_LOAD(MI_MATH_REG_SRCB, MI_MATH_REG(2));
+		*cs++ = MI_MATH_SUB;
+		*cs++ = MI_MATH_STORE(MI_MATH_REG(4), MI_MATH_REG_CF);
+
+		r = &relocs[obj[BATCH].relocation_count++];
+		r->target_handle = obj[BATCH].handle;
+		r->offset = (cs + 2 - batch) * sizeof(*cs);
+		r->read_domains = I915_GEM_DOMAIN_INSTRUCTION;
+		r->write_domain = I915_GEM_DOMAIN_INSTRUCTION;
+		r->delta = DURATION_OFFSET;
+		*cs++ = MI_STORE_REGISTER_MEM_GEN8;
+		*cs++ = CS_GPR(mmio_base, 4);
+		*cs++ = r->delta;
+		*cs++ = 0;
+
+		/* Continues while the stored value is above 0 */
+		r = &relocs[obj[BATCH].relocation_count++];
+		r->target_handle = obj[BATCH].handle;
+		r->offset = (cs + 2 - batch) * sizeof(*cs);
+		r->read_domains = I915_GEM_DOMAIN_COMMAND;
+		r->delta = DURATION_OFFSET;
+		*cs++ = MI_COND_BATCH_BUFFER_END_GEN8;
+		*cs++ = 0;
+		*cs++ = r->delta;
+		*cs++ = 0;
+	}
 
 	/* Pad with a few nops so that we do not completely hog the system.
 	 *
@@ -205,7 +529,7 @@ emit_recursive_batch(igt_spin_t *spin,
 	 * trouble. See https://bugs.freedesktop.org/show_bug.cgi?id=102262
 	 */
 	if (!(opts->flags & IGT_SPIN_FAST))
-		cs += 1000;
+		cs = pad + 1000;
 
 	/* recurse */
 	r = &relocs[obj[BATCH].relocation_count++];
@@ -305,6 +629,13 @@ __igt_spin_factory(int fd, const struct igt_spin_factory *opts)
  * contains the batch's handle that can be waited upon. The returned structure
  * must be passed to igt_spin_free() for post-processing.
  *
+ * When @opts->duration_ns is set (gen8+, a single engine only), the batch ends
+ * itself once that much time has passed on the engine's timestamp counter
+ * since it started executing. This is far more precise than
+ * igt_spin_set_timeout(), which depends on the CPU being woken up in time.
+ * Like the timeout, the duration is reduced by igt_simulation_scale() in
+ * simulation mode.
+ *
  * Returns:
  * Structure with helper internal state for igt_spin_free().
  */
@@ -357,7 +688,8 @@ static void notify(union sigval arg)
  *      before finishing.
  *
  * Specify a timeout. This ends the recursive batch associated with @spin after
- * the timeout has elapsed.
+ * the timeout has elapsed. In simulation mode the timeout is reduced by
+ * igt_simulation_scale().
  */
 void igt_spin_set_timeout(igt_spin_t *spin, int64_t ns)
 {
@@ -371,6 +703,8 @@ void igt_spin_set_timeout(igt_spin_t *spin, int64_t ns)
 
 	igt_assert(!spin->timer);
 
+	ns = igt_simulation_scaled(ns);
+
 	memset(&sev, 0, sizeof(sev));
 	sev.sigev_notify = SIGEV_THREAD;
 	sev.sigev_value.sival_ptr = spin;
@@ -437,15 +771,18 @@ void igt_spin_free(int fd, igt_spin_t *spin)
 		timer_delete(spin->timer);
 
 	igt_spin_end(spin);
-	gem_munmap((void *)((unsigned long)spin->condition & (~4095UL)),
-		   BATCH_SIZE);
 
-	if (spin->poll) {
-		gem_munmap(spin->poll, 4096);
-		gem_close(fd, spin->poll_handle);
-	}
+	if (!spin_pool_put(fd, spin)) {
+		gem_munmap((void *)((unsigned long)spin->condition & (~4095UL)),
+			   BATCH_SIZE);
+
+		if (spin->poll) {
+			gem_munmap(spin->poll, 4096);
+			gem_close(fd, spin->poll_handle);
+		}
 
-	gem_close(fd, spin->handle);
+		gem_close(fd, spin->handle);
+	}
 
 	if (spin->out_fence >= 0)
 		close(spin->out_fence);
@@ -518,6 +855,43 @@ static void unplug_sync_fd(struct igt_cork *cork)
 	close(cork->sw_sync.timeline);
 }
 
+static uint32_t plug_syncobj(struct igt_cork *cork, int fd)
+{
+	struct igt_cork_syncobj *c = &cork->syncobj;
+	int fence;
+
+	igt_assert(!c->plugged);
+
+	/* Created on first use and kept for re-arming */
+	if (c->timeline == -1) {
+		igt_require_sw_sync();
+
+		c->timeline = sw_sync_timeline_create();
+		c->device = fd;
+		c->handle = syncobj_create(fd, 0);
+		c->seqno = 0;
+	}
+	igt_assert_eq(c->device, fd);
+
+	fence = sw_sync_timeline_create_fence(c->timeline, ++c->seqno);
+	syncobj_import_sync_file(fd, c->handle, fence);
+	close(fence);
+
+	c->plugged = true;
+
+	return c->handle;
+}
+
+static void unplug_syncobj(struct igt_cork *cork)
+{
+	struct igt_cork_syncobj *c = &cork->syncobj;
+
+	igt_assert(c->plugged);
+
+	sw_sync_timeline_inc(c->timeline, 1);
+	c->plugged = false;
+}
+
 /**
  * igt_cork_plug:
  * @fd: open drm file descriptor
@@ -537,23 +911,32 @@ static void unplug_sync_fd(struct igt_cork *cork)
  * as an input fence to a request, the request will be stalled until the fence
  * is signaled.
  *
+ * SYNCOBJ:
+ * Returns a syncobj on @fd holding an unsignaled fence, to be waited upon with
+ * I915_EXEC_FENCE_WAIT in an I915_EXEC_FENCE_ARRAY. Neither vgem nor a dma-buf
+ * import is needed, and the cork can be plugged again after being unplugged,
+ * reusing the same syncobj and timeline, until released with igt_cork_fini().
+ *
  * The parameters required to unblock the execution and to cleanup are stored in
  * the provided cork structure.
  *
  * Returns:
- * Handle of the imported BO / Sw sync fence FD.
+ * Handle of the imported BO / Sw sync fence FD / syncobj handle.
  */
 uint32_t igt_cork_plug(struct igt_cork *cork, int fd)
 {
-	igt_assert(cork->fd == -1);
-
 	switch (cork->type) {
 	case CORK_SYNC_FD:
+		igt_assert(cork->fd == -1);
 		return plug_sync_fd(cork);
 
 	case CORK_VGEM_HANDLE:
+		igt_assert(cork->fd == -1);
 		return plug_vgem_handle(cork, fd);
 
+	case CORK_SYNCOBJ:
+		return plug_syncobj(cork, fd);
+
 	default:
 		igt_assert_f(0, "Invalid cork type!\n");
 		return 0;
@@ -569,9 +952,15 @@ uint32_t igt_cork_plug(struct igt_cork *cork, int fd)
  * imported bo and does the necessary post-processing.
  *
  * NOTE: the handle returned by igt_cork_plug is not closed during this phase.
+ * A syncobj cork stays ready to be plugged again.
  */
 void igt_cork_unplug(struct igt_cork *cork)
 {
+	if (cork->type == CORK_SYNCOBJ) {
+		unplug_syncobj(cork);
+		return;
+	}
+
 	igt_assert(cork->fd != -1);
 
 	switch (cork->type) {
@@ -589,3 +978,30 @@ void igt_cork_unplug(struct igt_cork *cork)
 
 	cork->fd = -1; /* Reset cork */
 }
+
+/**
+ * igt_cork_fini:
+ * @cork: cork state from igt_cork_plug()
+ *
+ * Unplugs a syncobj cork if still plugged and releases its syncobj and
+ * timeline. For the other cork types, which are released when unplugged,
+ * this only unplugs them if needed.
+ */
+void igt_cork_fini(struct igt_cork *cork)
+{
+	if (cork->type != CORK_SYNCOBJ) {
+		if (cork->fd != -1)
+			igt_cork_unplug(cork);
+		return;
+	}
+
+	if (cork->syncobj.timeline == -1)
+		return;
+
+	if (cork->syncobj.plugged)
+		unplug_syncobj(cork);
+
+	syncobj_destroy(cork->syncobj.device, cork->syncobj.handle);
+	close(cork->syncobj.timeline);
+	cork->syncobj.timeline = -1;
+}
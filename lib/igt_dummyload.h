@@ -54,6 +54,7 @@ struct igt_spin_factory {
 	uint32_t dependency;
 	unsigned int engine;
 	unsigned int flags;
+	uint64_t duration_ns;
 };
 
 #define IGT_SPIN_FENCE_OUT     (1 << 0)
@@ -76,6 +77,9 @@ void igt_spin_reset(igt_spin_t *spin);
 void igt_spin_end(igt_spin_t *spin);
 void igt_spin_free(int fd, igt_spin_t *spin);
 
+void igt_spin_pool_enable(unsigned int max_count);
+void igt_spin_pool_disable(void);
+
 static inline bool igt_spin_has_poll(const igt_spin_t *spin)
 {
 	return spin->poll;
@@ -97,7 +101,8 @@ void igt_unshare_spins(void);
 
 enum igt_cork_type {
 	CORK_SYNC_FD = 1,
-	CORK_VGEM_HANDLE
+	CORK_VGEM_HANDLE,
+	CORK_SYNCOBJ
 };
 
 struct igt_cork_vgem {
@@ -109,6 +114,14 @@ struct igt_cork_sw_sync {
 	int timeline;
 };
 
+struct igt_cork_syncobj {
+	int timeline;
+	int device;
+	uint32_t handle;
+	uint32_t seqno;
+	bool plugged;
+};
+
 struct igt_cork {
 	enum igt_cork_type type;
 
@@ -117,14 +130,17 @@ struct igt_cork {
 
 		struct igt_cork_vgem vgem;
 		struct igt_cork_sw_sync sw_sync;
+		struct igt_cork_syncobj syncobj;
 	};
 };
 
 #define IGT_CORK(name, cork_type) struct igt_cork name = { .type = cork_type, .fd = -1}
 #define IGT_CORK_HANDLE(name) IGT_CORK(name, CORK_VGEM_HANDLE)
 #define IGT_CORK_FENCE(name) IGT_CORK(name, CORK_SYNC_FD)
+#define IGT_CORK_SYNCOBJ(name) IGT_CORK(name, CORK_SYNCOBJ)
 
 uint32_t igt_cork_plug(struct igt_cork *cork, int fd);
 void igt_cork_unplug(struct igt_cork *cork);
+void igt_cork_fini(struct igt_cork *cork);
 
 #endif /* __IGT_DUMMYLOAD_H__ */
@@ -0,0 +1,288 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "i915/gem_engine_topology.h"
+#include "igt_core.h"
+#include "igt_engine_monitor.h"
+#include "igt_perf.h"
+
+/**
+ * SECTION:igt_engine_monitor
+ * @short_description: Cheap snapshots of the i915 engine busy counters
+ * @title: Engine monitor
+ * @include: igt_engine_monitor.h
+ *
+ * The i915 PMU counts, for each engine, the time it spent busy, waiting for
+ * an event and waiting on a semaphore. Opening those counters one by one
+ * for every measurement is expensive, and reading them separately smears
+ * the time they are sampled at. An engine monitor opens the counters of all
+ * the physical engines once, as a single perf group, so that a snapshot of
+ * all of them is one read() and the utilization between two snapshots is
+ * plain arithmetic:
+ *
+ * |[<!-- language="C" -->
+ * struct igt_engine_snapshot s0, s1;
+ *
+ * igt_engine_monitor_snapshot(m, &s0);
+ * ... run the workload ...
+ * igt_engine_monitor_snapshot(m, &s1);
+ * igt_assert(igt_engine_monitor_busy(&s0, &s1, rcs) > 95);
+ * ]|
+ *
+ * The counters are those of the whole device, they include the work of
+ * every client and not just of the one the monitor was opened for.
+ */
+
+#define NO_COUNTER (-1)
+
+struct monitored_engine {
+	const char *name;
+	int class, instance;
+	/* Position of each counter in the group read, or NO_COUNTER */
+	int busy, wait, sema;
+};
+
+struct igt_engine_monitor {
+	int group;
+	unsigned int nr_fds;
+	int fds[3 * IGT_ENGINE_MONITOR_MAX];
+
+	unsigned int count;
+	struct monitored_engine engine[IGT_ENGINE_MONITOR_MAX];
+};
+
+static int add_counter(struct igt_engine_monitor *m, uint64_t config)
+{
+	int fd;
+
+	fd = perf_i915_open_group(config, m->group);
+	if (fd < 0)
+		return NO_COUNTER;
+
+	if (m->group < 0)
+		m->group = fd;
+	m->fds[m->nr_fds] = fd;
+
+	return m->nr_fds++;
+}
+
+/**
+ * igt_engine_monitor_open:
+ * @i915: open i915 drm file descriptor
+ *
+ * Opens the busy, wait and semaphore counters of every physical engine of
+ * @i915, as far as the PMU provides them. Engines without a busy counter
+ * are left out.
+ *
+ * Returns: The new monitor, to be freed with igt_engine_monitor_close(), or
+ * NULL when the PMU is not available.
+ */
+struct igt_engine_monitor *igt_engine_monitor_open(int i915)
+{
+	const struct intel_execution_engine2 *e;
+	struct igt_engine_monitor *m;
+
+	m = calloc(1, sizeof(*m));
+	igt_assert(m);
+	m->group = -1;
+
+	__for_each_physical_engine(i915, e) {
+		struct monitored_engine *engine = &m->engine[m->count];
+
+		if (m->count == IGT_ENGINE_MONITOR_MAX)
+			break;
+
+		engine->busy = add_counter(m, I915_PMU_ENGINE_BUSY(e->class,
+								   e->instance));
+		if (engine->busy == NO_COUNTER)
+			continue;
+
+		engine->wait = add_counter(m, I915_PMU_ENGINE_WAIT(e->class,
+								   e->instance));
+		engine->sema = add_counter(m, I915_PMU_ENGINE_SEMA(e->class,
+								   e->instance));
+		engine->name = e->name;
+		engine->class = e->class;
+		engine->instance = e->instance;
+		m->count++;
+	}
+
+	if (!m->count) {
+		igt_engine_monitor_close(m);
+		return NULL;
+	}
+
+	return m;
+}
+
+/**
+ * igt_engine_monitor_close:
+ * @m: the monitor, may be NULL
+ *
+ * Closes the counters of @m and frees it.
+ */
+void igt_engine_monitor_close(struct igt_engine_monitor *m)
+{
+	if (!m)
+		return;
+
+	/* The group leader goes last */
+	while (m->nr_fds--)
+		close(m->fds[m->nr_fds]);
+	free(m);
+}
+
+/**
+ * igt_engine_monitor_count:
+ * @m: the monitor
+ *
+ * Returns: The number of engines @m monitors, which its snapshots and
+ * utilization arrays are indexed by.
+ */
+unsigned int igt_engine_monitor_count(const struct igt_engine_monitor *m)
+{
+	return m->count;
+}
+
+/**
+ * igt_engine_monitor_name:
+ * @m: the monitor
+ * @engine: index of the engine
+ *
+ * Returns: The name of the engine, as in "rcs0".
+ */
+const char *igt_engine_monitor_name(const struct igt_engine_monitor *m,
+				    unsigned int engine)
+{
+	igt_assert(engine < m->count);
+
+	return m->engine[engine].name;
+}
+
+/**
+ * igt_engine_monitor_find:
+ * @m: the monitor
+ * @class: the i915 engine class
+ * @instance: the instance of the engine within @class
+ *
+ * Returns: The index of the engine in @m, or -1 if it is not monitored.
+ */
+int igt_engine_monitor_find(const struct igt_engine_monitor *m,
+			    int class, int instance)
+{
+	for (unsigned int i = 0; i < m->count; i++)
+		if (m->engine[i].class == class &&
+		    m->engine[i].instance == instance)
+			return i;
+
+	return -1;
+}
+
+static uint64_t counter(const uint64_t *val, int idx)
+{
+	return idx == NO_COUNTER ? 0 : val[2 + idx];
+}
+
+/**
+ * igt_engine_monitor_snapshot:
+ * @m: the monitor
+ * @s: where to store the counters
+ *
+ * Reads all the counters of @m at once into @s.
+ */
+void igt_engine_monitor_snapshot(struct igt_engine_monitor *m,
+				 struct igt_engine_snapshot *s)
+{
+	/* nr, time enabled, then the counters in the order they were added */
+	uint64_t val[2 + ARRAY_SIZE(m->fds)];
+	ssize_t len = (2 + m->nr_fds) * sizeof(val[0]);
+
+	igt_assert_eq(read(m->group, val, len), len);
+	igt_assert_eq(val[0], m->nr_fds);
+
+	memset(s, 0, sizeof(*s));
+	s->time = val[1];
+	for (unsigned int i = 0; i < m->count; i++) {
+		s->engine[i].busy = counter(val, m->engine[i].busy);
+		s->engine[i].wait = counter(val, m->engine[i].wait);
+		s->engine[i].sema = counter(val, m->engine[i].sema);
+	}
+}
+
+static double percent(uint64_t c0, uint64_t c1, uint64_t elapsed)
+{
+	return elapsed ? 100. * (c1 - c0) / elapsed : 0;
+}
+
+/**
+ * igt_engine_monitor_busy:
+ * @s0: the earlier snapshot
+ * @s1: the later snapshot
+ * @engine: index of the engine
+ *
+ * Returns: The share of the time between @s0 and @s1 that @engine spent
+ * busy, in percent, or 0 if no time passed.
+ */
+double igt_engine_monitor_busy(const struct igt_engine_snapshot *s0,
+			       const struct igt_engine_snapshot *s1,
+			       unsigned int engine)
+{
+	igt_assert(engine < IGT_ENGINE_MONITOR_MAX);
+
+	return percent(s0->engine[engine].busy, s1->engine[engine].busy,
+		       s1->time - s0->time);
+}
+
+/**
+ * igt_engine_monitor_delta:
+ * @m: the monitor
+ * @s0: the earlier snapshot
+ * @s1: the later snapshot
+ * @util: array of igt_engine_monitor_count() entries to fill
+ *
+ * Computes the utilization of each engine of @m between @s0 and @s1.
+ */
+void igt_engine_monitor_delta(const struct igt_engine_monitor *m,
+			      const struct igt_engine_snapshot *s0,
+			      const struct igt_engine_snapshot *s1,
+			      struct igt_engine_utilization *util)
+{
+	uint64_t elapsed = s1->time - s0->time;
+
+	for (unsigned int i = 0; i < m->count; i++) {
+		const struct igt_engine_counters *c0 = &s0->engine[i];
+		const struct igt_engine_counters *c1 = &s1->engine[i];
+
+		util[i].busy = percent(c0->busy, c1->busy, elapsed);
+		util[i].wait = percent(c0->wait, c1->wait, elapsed);
+		util[i].sema = percent(c0->sema, c1->sema, elapsed);
+	}
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#ifndef __IGT_ENGINE_MONITOR_H__
+#define __IGT_ENGINE_MONITOR_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Enough for the physical engines of all the current platforms */
+#define IGT_ENGINE_MONITOR_MAX 16
+
+/**
+ * igt_engine_counters:
+ * @busy: ns the engine spent executing requests
+ * @wait: ns the engine spent stalled on an MI_WAIT_FOR_EVENT
+ * @sema: ns the engine spent stalled on an MI_SEMAPHORE_WAIT
+ */
+struct igt_engine_counters {
+	uint64_t busy;
+	uint64_t wait;
+	uint64_t sema;
+};
+
+/**
+ * igt_engine_snapshot:
+ * @time: PMU time the counters were enabled for at the snapshot, in ns
+ * @engine: raw counters of each monitored engine
+ */
+struct igt_engine_snapshot {
+	uint64_t time;
+	struct igt_engine_counters engine[IGT_ENGINE_MONITOR_MAX];
+};
+
+/**
+ * igt_engine_utilization:
+ * @busy: share of the time the engine was busy, in percent
+ * @wait: share of the time the engine waited for an event, in percent
+ * @sema: share of the time the engine waited on a semaphore, in percent
+ *
+ * The counters an engine does not support read as 0.
+ */
+struct igt_engine_utilization {
+	double busy;
+	double wait;
+	double sema;
+};
+
+struct igt_engine_monitor;
+
+struct igt_engine_monitor *igt_engine_monitor_open(int i915);
+void igt_engine_monitor_close(struct igt_engine_monitor *m);
+
+unsigned int igt_engine_monitor_count(const struct igt_engine_monitor *m);
+const char *igt_engine_monitor_name(const struct igt_engine_monitor *m,
+				    unsigned int engine);
+int igt_engine_monitor_find(const struct igt_engine_monitor *m,
+			    int class, int instance);
+
+void igt_engine_monitor_snapshot(struct igt_engine_monitor *m,
+				 struct igt_engine_snapshot *s);
+void igt_engine_monitor_delta(const struct igt_engine_monitor *m,
+			      const struct igt_engine_snapshot *s0,
+			      const struct igt_engine_snapshot *s1,
+			      struct igt_engine_utilization *util);
+double igt_engine_monitor_busy(const struct igt_engine_snapshot *s0,
+			       const struct igt_engine_snapshot *s1,
+			       unsigned int engine);
+
+#endif /* __IGT_ENGINE_MONITOR_H__ */
@@ -0,0 +1,378 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+#include <libudev.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_event_loop.h"
+#include "igt_kms.h"
+#include "igt_list.h"
+
+/**
+ * SECTION:igt_event_loop
+ * @short_description: Shared loop for DRM events and uevents
+ * @title: Event loop
+ * @include: igt_event_loop.h
+ *
+ * Tests which wait for several kinds of events, e.g. page flip completions
+ * and hotplugs, would otherwise poll each source with its own timeout, or
+ * sleep for a fixed time to be sure everything arrived. The event loop
+ * waits on all of them at once with epoll and invokes a callback for
+ * every source which became ready, so a test wakes up exactly when there
+ * is something to handle.
+ *
+ * |[
+ *	static void hotplug(struct udev_device *dev, void *data)
+ *	{
+ *		const char *val = udev_device_get_property_value(dev, "HOTPLUG");
+ *
+ *		if (val && atoi(val) == 1)
+ *			*(bool *)data = true;
+ *	}
+ *
+ *	loop = igt_event_loop_create();
+ *	igt_event_loop_add_drm(loop, display->drm_fd, &evctx);
+ *	igt_event_loop_add_hotplug(loop, hotplug, &plugged);
+ *
+ *	chamelium_plug(chamelium, port);
+ *	igt_assert(igt_event_loop_run_until(loop, &plugged, 20000));
+ *
+ *	igt_event_loop_destroy(loop);
+ * ]|
+ *
+ * Hotplugs triggered by a Chamelium arrive as regular drm uevents, so they
+ * need no source of their own.
+ */
+
+struct event_source {
+	struct igt_list link;
+	int fd;
+	igt_event_func_t func;
+	void *data;
+	void (*release)(struct event_source *source);
+	bool removed;
+};
+
+struct drm_source {
+	struct event_source base;
+	drmEventContext evctx;
+};
+
+struct hotplug_source {
+	struct event_source base;
+	struct udev_monitor *mon;
+	igt_uevent_func_t func;
+	void *data;
+};
+
+struct igt_event_loop {
+	int epoll_fd;
+	struct igt_list sources;
+	bool dispatching;
+};
+
+/**
+ * igt_event_loop_create:
+ *
+ * Creates a new event loop without any sources.
+ *
+ * Returns: the event loop, to be freed with igt_event_loop_destroy()
+ */
+struct igt_event_loop *igt_event_loop_create(void)
+{
+	struct igt_event_loop *loop;
+
+	loop = calloc(1, sizeof(*loop));
+	igt_assert(loop);
+
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	igt_assert_fd(loop->epoll_fd);
+	igt_list_init(&loop->sources);
+
+	return loop;
+}
+
+static void free_source(struct event_source *source)
+{
+	igt_list_del(&source->link);
+	if (source->release)
+		source->release(source);
+	free(source);
+}
+
+static void reap_sources(struct igt_event_loop *loop)
+{
+	struct event_source *source, *tmp;
+
+	igt_list_for_each_safe(source, tmp, &loop->sources, link)
+		if (source->removed)
+			free_source(source);
+}
+
+/**
+ * igt_event_loop_destroy:
+ * @loop: event loop
+ *
+ * Removes all sources from @loop and frees it. File descriptors added with
+ * igt_event_loop_add_fd() and igt_event_loop_add_drm() are not closed, the
+ * udev monitors created by igt_event_loop_add_hotplug() are.
+ */
+void igt_event_loop_destroy(struct igt_event_loop *loop)
+{
+	struct event_source *source, *tmp;
+
+	if (!loop)
+		return;
+
+	igt_list_for_each_safe(source, tmp, &loop->sources, link)
+		free_source(source);
+
+	close(loop->epoll_fd);
+	free(loop);
+}
+
+static void add_source(struct igt_event_loop *loop,
+		       struct event_source *source)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = source,
+	};
+
+	igt_assert_f(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD,
+			       source->fd, &ev) == 0,
+		     "Failed to add fd %d to the event loop: %m\n",
+		     source->fd);
+
+	igt_list_add_tail(&source->link, &loop->sources);
+}
+
+/**
+ * igt_event_loop_add_fd:
+ * @loop: event loop
+ * @fd: file descriptor to wait on
+ * @func: function to call whenever @fd is readable
+ * @data: data passed to @func
+ *
+ * Adds @fd to @loop. @func is responsible for reading the pending data,
+ * otherwise it is called again on the next dispatch.
+ */
+void igt_event_loop_add_fd(struct igt_event_loop *loop, int fd,
+			   igt_event_func_t func, void *data)
+{
+	struct event_source *source;
+
+	source = calloc(1, sizeof(*source));
+	igt_assert(source);
+
+	source->fd = fd;
+	source->func = func;
+	source->data = data;
+
+	add_source(loop, source);
+}
+
+static void drm_source_dispatch(int fd, void *data)
+{
+	struct drm_source *source = data;
+
+	igt_assert_eq(drmHandleEvent(fd, &source->evctx), 0);
+}
+
+/**
+ * igt_event_loop_add_drm:
+ * @loop: event loop
+ * @drm_fd: DRM device to read events from
+ * @evctx: handlers for the vblank, page flip and sequence events
+ *
+ * Adds @drm_fd to @loop, passing its events to drmHandleEvent() with a
+ * copy of @evctx.
+ */
+void igt_event_loop_add_drm(struct igt_event_loop *loop, int drm_fd,
+			    drmEventContext *evctx)
+{
+	struct drm_source *source;
+
+	source = calloc(1, sizeof(*source));
+	igt_assert(source);
+
+	source->evctx = *evctx;
+	source->base.fd = drm_fd;
+	source->base.func = drm_source_dispatch;
+	source->base.data = source;
+
+	add_source(loop, &source->base);
+}
+
+static void hotplug_source_dispatch(int fd, void *data)
+{
+	struct hotplug_source *source = data;
+	struct udev_device *dev;
+
+	while ((dev = udev_monitor_receive_device(source->mon))) {
+		source->func(dev, source->data);
+		udev_device_unref(dev);
+	}
+}
+
+static void hotplug_source_release(struct event_source *base)
+{
+	struct hotplug_source *source =
+		container_of(base, source, base);
+
+	igt_cleanup_hotplug(source->mon);
+}
+
+/**
+ * igt_event_loop_add_hotplug:
+ * @loop: event loop
+ * @func: function to call for every drm uevent
+ * @data: data passed to @func
+ *
+ * Starts monitoring udev for drm uevents, like igt_watch_hotplug() does,
+ * and adds the monitor to @loop. Events which happened before this call
+ * are not reported.
+ */
+void igt_event_loop_add_hotplug(struct igt_event_loop *loop,
+				igt_uevent_func_t func, void *data)
+{
+	struct hotplug_source *source;
+
+	source = calloc(1, sizeof(*source));
+	igt_assert(source);
+
+	source->mon = igt_watch_hotplug();
+	source->func = func;
+	source->data = data;
+	source->base.fd = udev_monitor_get_fd(source->mon);
+	source->base.func = hotplug_source_dispatch;
+	source->base.data = source;
+	source->base.release = hotplug_source_release;
+
+	add_source(loop, &source->base);
+}
+
+/**
+ * igt_event_loop_remove_fd:
+ * @loop: event loop
+ * @fd: file descriptor to remove
+ *
+ * Stops waiting on @fd. This may be called from within a callback, also
+ * for the fd being dispatched.
+ */
+void igt_event_loop_remove_fd(struct igt_event_loop *loop, int fd)
+{
+	struct event_source *source;
+
+	igt_list_for_each(source, &loop->sources, link) {
+		if (source->removed || source->fd != fd)
+			continue;
+
+		epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+		/* Events for it may still be pending in this dispatch */
+		source->removed = true;
+		if (!loop->dispatching)
+			free_source(source);
+		return;
+	}
+
+	igt_assert_f(0, "fd %d is not part of the event loop\n", fd);
+}
+
+/**
+ * igt_event_loop_dispatch:
+ * @loop: event loop
+ * @timeout_ms: how long to wait for an event, -1 to wait forever
+ *
+ * Waits until at least one source of @loop is ready, or until @timeout_ms
+ * passed, and invokes the callbacks of all ready sources.
+ *
+ * Returns: the number of sources dispatched, 0 on timeout
+ */
+int igt_event_loop_dispatch(struct igt_event_loop *loop, int timeout_ms)
+{
+	struct epoll_event events[16];
+	int count;
+
+	count = epoll_wait(loop->epoll_fd, events, ARRAY_SIZE(events),
+			   timeout_ms);
+	if (count < 0) {
+		igt_assert_eq(errno, EINTR);
+		return 0;
+	}
+
+	loop->dispatching = true;
+	for (int i = 0; i < count; i++) {
+		struct event_source *source = events[i].data.ptr;
+
+		if (!source->removed)
+			source->func(source->fd, source->data);
+	}
+	loop->dispatching = false;
+
+	reap_sources(loop);
+
+	return count;
+}
+
+static int64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * igt_event_loop_run_until:
+ * @loop: event loop
+ * @done: flag set by a callback once the wait is over, or NULL
+ * @timeout_ms: total time to wait
+ *
+ * Dispatches events of @loop until *@done becomes true or @timeout_ms
+ * passed, whichever comes first. With a NULL @done this dispatches all
+ * events arriving within @timeout_ms.
+ *
+ * Returns: the value of *@done, false if @done is NULL
+ */
+bool igt_event_loop_run_until(struct igt_event_loop *loop, const bool *done,
+			      int timeout_ms)
+{
+	int64_t end = now_ms() + timeout_ms;
+	int64_t left;
+
+	while (!(done && *done) && (left = end - now_ms()) > 0)
+		igt_event_loop_dispatch(loop, left);
+
+	return done && *done;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __IGT_EVENT_LOOP_H__
+#define __IGT_EVENT_LOOP_H__
+
+#include <stdbool.h>
+#include <xf86drm.h>
+
+struct udev_device;
+struct igt_event_loop;
+
+/**
+ * igt_event_func_t:
+ * @fd: file descriptor which became readable
+ * @data: data passed when the fd was added to the loop
+ *
+ * Callback invoked by igt_event_loop_dispatch() for a readable fd.
+ */
+typedef void (*igt_event_func_t)(int fd, void *data);
+
+/**
+ * igt_uevent_func_t:
+ * @dev: the udev device which generated the uevent
+ * @data: data passed to igt_event_loop_add_hotplug()
+ *
+ * Callback invoked by igt_event_loop_dispatch() for each drm uevent.
+ * Properties such as "HOTPLUG" or "LEASE" can be read from @dev with
+ * udev_device_get_property_value(); @dev is released after returning.
+ */
+typedef void (*igt_uevent_func_t)(struct udev_device *dev, void *data);
+
+struct igt_event_loop *igt_event_loop_create(void);
+void igt_event_loop_destroy(struct igt_event_loop *loop);
+
+void igt_event_loop_add_fd(struct igt_event_loop *loop, int fd,
+			   igt_event_func_t func, void *data);
+void igt_event_loop_add_drm(struct igt_event_loop *loop, int drm_fd,
+			    drmEventContext *evctx);
+void igt_event_loop_add_hotplug(struct igt_event_loop *loop,
+				igt_uevent_func_t func, void *data);
+void igt_event_loop_remove_fd(struct igt_event_loop *loop, int fd);
+
+int igt_event_loop_dispatch(struct igt_event_loop *loop, int timeout_ms);
+bool igt_event_loop_run_until(struct igt_event_loop *loop, const bool *done,
+			      int timeout_ms);
+
+#endif /* __IGT_EVENT_LOOP_H__ */
@@ -29,6 +29,9 @@
 #include <math.h>
 #include <wchar.h>
 #include <inttypes.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/kcmp.h>
 
 #if defined(USE_CAIRO_PIXMAN)
 #include <pixman.h>
@@ -40,7 +43,9 @@
 #include "igt_fb.h"
 #include "igt_halffloat.h"
 #include "igt_kms.h"
+#include "igt_list.h"
 #include "igt_matrix.h"
+#include "igt_parallel.h"
 #if defined(USE_VC4)
 #include "igt_vc4.h"
 #endif
@@ -793,6 +798,48 @@ static void memset64(uint64_t *s, uint64_t c, size_t n)
 		s[i] = c;
 }
 
+struct fb_fill {
+	uint8_t *ptr;
+	size_t len;
+	unsigned int size;
+	uint64_t value;
+};
+
+#define FILL_CHUNK (64 << 10)
+
+static void fill_stripe(void *data, unsigned int start, unsigned int end)
+{
+	const struct fb_fill *f = data;
+	size_t offset = (size_t)start * FILL_CHUNK;
+	size_t len = min((size_t)end * FILL_CHUNK, f->len) - offset;
+
+	switch (f->size) {
+	case 1:
+		memset(f->ptr + offset, f->value, len);
+		break;
+	case 4:
+		wmemset((wchar_t *)(f->ptr + offset), f->value,
+			len / sizeof(wchar_t));
+		break;
+	case 8:
+		memset64((uint64_t *)(f->ptr + offset), f->value,
+			 len / sizeof(uint64_t));
+		break;
+	}
+}
+
+/* Faulting in and filling a fresh bo is slow, so spread it over the cpus */
+static void fill_buffer(uint8_t *ptr, size_t len,
+			unsigned int size, uint64_t value)
+{
+	struct fb_fill f = {
+		.ptr = ptr, .len = len, .size = size, .value = value,
+	};
+
+	igt_parallel_stripes(DIV_ROUND_UP(len, FILL_CHUNK), 1,
+			     fill_stripe, &f);
+}
+
 static void clear_yuv_buffer(struct igt_fb *fb)
 {
 	bool full_range = fb->color_range == IGT_COLOR_YCBCR_FULL_RANGE;
@@ -806,65 +853,239 @@ static void clear_yuv_buffer(struct igt_fb *fb)
 
 	switch (fb->drm_format) {
 	case DRM_FORMAT_NV12:
-		memset(ptr + fb->offsets[0],
-		       full_range ? 0x00 : 0x10,
-		       fb->strides[0] * fb->plane_height[0]);
-		memset(ptr + fb->offsets[1],
-		       0x80,
-		       fb->strides[1] * fb->plane_height[1]);
+		fill_buffer(ptr + fb->offsets[0],
+			    fb->strides[0] * fb->plane_height[0],
+			    1, full_range ? 0x00 : 0x10);
+		fill_buffer(ptr + fb->offsets[1],
+			    fb->strides[1] * fb->plane_height[1],
+			    1, 0x80);
 		break;
 	case DRM_FORMAT_XYUV8888:
-		wmemset((wchar_t*)(ptr + fb->offsets[0]), full_range ? 0x00008080 : 0x00108080,
-			fb->strides[0] * fb->plane_height[0] / sizeof(wchar_t));
+		fill_buffer(ptr + fb->offsets[0],
+			    fb->strides[0] * fb->plane_height[0],
+			    sizeof(wchar_t), full_range ? 0x00008080 : 0x00108080);
 		break;
 	case DRM_FORMAT_YUYV:
 	case DRM_FORMAT_YVYU:
-		wmemset((wchar_t*)(ptr + fb->offsets[0]),
-			full_range ? 0x80008000 : 0x80108010,
-			fb->strides[0] * fb->plane_height[0] / sizeof(wchar_t));
+		fill_buffer(ptr + fb->offsets[0],
+			    fb->strides[0] * fb->plane_height[0],
+			    sizeof(wchar_t), full_range ? 0x80008000 : 0x80108010);
 		break;
 	case DRM_FORMAT_UYVY:
 	case DRM_FORMAT_VYUY:
-		wmemset((wchar_t*)(ptr + fb->offsets[0]),
-			full_range ? 0x00800080 : 0x10801080,
-			fb->strides[0] * fb->plane_height[0] / sizeof(wchar_t));
+		fill_buffer(ptr + fb->offsets[0],
+			    fb->strides[0] * fb->plane_height[0],
+			    sizeof(wchar_t), full_range ? 0x00800080 : 0x10801080);
 		break;
 	case DRM_FORMAT_P010:
 	case DRM_FORMAT_P012:
 	case DRM_FORMAT_P016:
-		wmemset((wchar_t*)ptr, full_range ? 0 : 0x10001000,
-			fb->offsets[1] / sizeof(wchar_t));
-		wmemset((wchar_t*)(ptr + fb->offsets[1]), 0x80008000,
-			fb->strides[1] * fb->plane_height[1] / sizeof(wchar_t));
+		fill_buffer(ptr, fb->offsets[1],
+			    sizeof(wchar_t), full_range ? 0 : 0x10001000);
+		fill_buffer(ptr + fb->offsets[1],
+			    fb->strides[1] * fb->plane_height[1],
+			    sizeof(wchar_t), 0x80008000);
 		break;
 	case DRM_FORMAT_Y210:
 	case DRM_FORMAT_Y212:
 	case DRM_FORMAT_Y216:
-		wmemset((wchar_t*)(ptr + fb->offsets[0]),
-			full_range ? 0x80000000 : 0x80001000,
-			fb->strides[0] * fb->plane_height[0] / sizeof(wchar_t));
+		fill_buffer(ptr + fb->offsets[0],
+			    fb->strides[0] * fb->plane_height[0],
+			    sizeof(wchar_t), full_range ? 0x80000000 : 0x80001000);
 		break;
 
 	case DRM_FORMAT_XVYU2101010:
 	case DRM_FORMAT_Y410:
-		wmemset((wchar_t*)(ptr + fb->offsets[0]),
-			full_range ? 0x20000200 : 0x20010200,
-		fb->strides[0] * fb->plane_height[0] / sizeof(wchar_t));
+		fill_buffer(ptr + fb->offsets[0],
+			    fb->strides[0] * fb->plane_height[0],
+			    sizeof(wchar_t), full_range ? 0x20000200 : 0x20010200);
 		break;
 
 	case DRM_FORMAT_XVYU12_16161616:
 	case DRM_FORMAT_XVYU16161616:
 	case DRM_FORMAT_Y412:
 	case DRM_FORMAT_Y416:
-		memset64((uint64_t*)(ptr + fb->offsets[0]),
-			 full_range ? 0x800000008000ULL : 0x800010008000ULL,
-			 fb->strides[0] * fb->plane_height[0] / sizeof(uint64_t));
+		fill_buffer(ptr + fb->offsets[0],
+			    fb->strides[0] * fb->plane_height[0],
+			    sizeof(uint64_t),
+			    full_range ? 0x800000008000ULL : 0x800010008000ULL);
 		break;
 	}
 
 	igt_fb_unmap_buffer(fb, ptr);
 }
 
+/*
+ * Device bos of removed framebuffers can be kept in a pool, purgeable while
+ * unused, and handed out again for framebuffers of the same size and tiling
+ * instead of going back to the kernel for a new bo each time. Every pooled
+ * bo holds a dup of the fd it was created on, so its handle remains valid
+ * and can be matched against the open file of later requests.
+ */
+struct fb_pool_bo {
+	struct igt_list link;
+	int fd;
+	uint32_t handle;
+	uint64_t size;
+	uint32_t tiling;
+	uint32_t stride;
+};
+
+static struct {
+	struct igt_list bos;
+	uint64_t size;
+	uint64_t max_size;
+	bool init;
+} fb_pool = {
+	.bos = __IGT_INIT_LIST(fb_pool.bos),
+};
+
+static void fb_pool_free(struct fb_pool_bo *bo)
+{
+	igt_list_del(&bo->link);
+	fb_pool.size -= bo->size;
+
+	gem_close(bo->fd, bo->handle);
+	close(bo->fd);
+	free(bo);
+}
+
+static void fb_pool_evict(uint64_t max_size)
+{
+	while (fb_pool.size > max_size) {
+		struct fb_pool_bo *bo =
+			igt_list_last_entry(&fb_pool.bos, bo, link);
+
+		fb_pool_free(bo);
+	}
+}
+
+/**
+ * igt_fb_pool_enable:
+ * @max_size: most bytes of unused framebuffer bos to keep around
+ *
+ * Enables pooling of the i915 buffer objects of framebuffers released with
+ * igt_remove_fb(). Creating a framebuffer of the same size and tiling on the
+ * same drm file then reuses a pooled bo, cleared as a new one would be,
+ * instead of allocating a new one. The least recently released bos are freed
+ * once @max_size is exceeded.
+ *
+ * Pooled bos keep the drm file they were created on open, call
+ * igt_fb_pool_disable() before closing the last fd of a device that needs to
+ * go idle, e.g. to unload the driver.
+ *
+ * The pool can also be enabled by setting the IGT_FB_POOL environment
+ * variable to the size in MiB.
+ */
+void igt_fb_pool_enable(uint64_t max_size)
+{
+	fb_pool.max_size = max_size;
+	fb_pool.init = true;
+
+	fb_pool_evict(max_size);
+}
+
+/**
+ * igt_fb_pool_disable:
+ *
+ * Disables the framebuffer bo pool and frees all pooled bos.
+ */
+void igt_fb_pool_disable(void)
+{
+	igt_fb_pool_enable(0);
+}
+
+static uint64_t fb_pool_max_size(void)
+{
+	if (!fb_pool.init) {
+		const char *env = getenv("IGT_FB_POOL");
+
+		if (env)
+			fb_pool.max_size = strtoull(env, NULL, 0) << 20;
+		fb_pool.init = true;
+	}
+
+	return fb_pool.max_size;
+}
+
+static bool same_file(int fd1, int fd2)
+{
+	pid_t pid = getpid();
+
+	return syscall(SYS_kcmp, pid, pid, KCMP_FILE, fd1, fd2) == 0;
+}
+
+static uint32_t fb_pool_get(const struct igt_fb *fb, uint32_t tiling)
+{
+	struct fb_pool_bo *bo, *tmp;
+
+	igt_list_for_each_safe(bo, tmp, &fb_pool.bos, link) {
+		uint32_t handle = bo->handle;
+		void *ptr;
+
+		if (bo->size != fb->size || bo->tiling != tiling ||
+		    bo->stride != fb->strides[0] || !same_file(bo->fd, fb->fd))
+			continue;
+
+		/* The handle is just as valid on fb->fd */
+		igt_list_del(&bo->link);
+		fb_pool.size -= bo->size;
+		close(bo->fd);
+		free(bo);
+
+		if (!gem_madvise(fb->fd, handle, I915_MADV_WILLNEED)) {
+			gem_close(fb->fd, handle);
+			continue;
+		}
+
+		/* yuv buffers are cleared to black later on */
+		if (!igt_format_is_yuv(fb->drm_format)) {
+			gem_set_domain(fb->fd, handle,
+				       I915_GEM_DOMAIN_CPU, I915_GEM_DOMAIN_CPU);
+			ptr = gem_mmap__cpu(fb->fd, handle, 0, fb->size,
+					    PROT_WRITE);
+			memset(ptr, 0, fb->size);
+			gem_munmap(ptr, fb->size);
+			gem_set_domain(fb->fd, handle, I915_GEM_DOMAIN_GTT, 0);
+		}
+
+		return handle;
+	}
+
+	return 0;
+}
+
+static bool fb_pool_put(int fd, const struct igt_fb *fb)
+{
+	struct fb_pool_bo *bo;
+
+	if (fb->is_dumb || !is_i915_device(fd) ||
+	    !fb_pool_max_size() || fb->size > fb_pool.max_size)
+		return false;
+
+	bo = malloc(sizeof(*bo));
+	if (!bo)
+		return false;
+
+	bo->fd = dup(fd);
+	if (bo->fd < 0) {
+		free(bo);
+		return false;
+	}
+
+	bo->handle = fb->gem_handle;
+	bo->size = fb->size;
+	bo->tiling = igt_fb_mod_to_tiling(fb->modifier);
+	bo->stride = fb->strides[0];
+	gem_madvise(fd, bo->handle, I915_MADV_DONTNEED);
+
+	fb_pool_evict(fb_pool.max_size - bo->size);
+	igt_list_add(&bo->link, &fb_pool.bos);
+	fb_pool.size += bo->size;
+
+	return true;
+}
+
 /* helpers to create nice-looking framebuffers */
 static int create_bo_for_fb(struct igt_fb *fb)
 {
@@ -898,10 +1119,14 @@ static int create_bo_for_fb(struct igt_fb *fb)
 		fb->is_dumb = false;
 
 		if (is_i915_device(fd)) {
-			fb->gem_handle = gem_create(fd, fb->size);
-			gem_set_tiling(fd, fb->gem_handle,
-				       igt_fb_mod_to_tiling(fb->modifier),
-				       fb->strides[0]);
+			uint32_t tiling = igt_fb_mod_to_tiling(fb->modifier);
+
+			fb->gem_handle = fb_pool_get(fb, tiling);
+			if (!fb->gem_handle) {
+				fb->gem_handle = gem_create(fd, fb->size);
+				gem_set_tiling(fd, fb->gem_handle, tiling,
+					       fb->strides[0]);
+			}
 #if defined(USE_VC4)
 		} else if (is_vc4_device(fd)) {
 			fb->gem_handle = igt_vc4_create_bo(fd, fb->size);
@@ -1140,25 +1365,114 @@ static uint16_t update_crc16_dp(uint16_t crc_old, uint16_t d)
 	return crc_new;
 }
 
-/**
- * igt_fb_calc_crc:
- * @fb: pointer to an #igt_fb structure
- * @crc: pointer to an #igt_crc_t structure
- *
- * This function calculate the 16-bit frame CRC of RGB components over all
- * the active pixels.
+/*
+ * The crc update only depends on crc_old ^ d and is linear in it, so it can
+ * be looked up a byte at a time in tables generated from update_crc16_dp().
  */
-void igt_fb_calc_crc(struct igt_fb *fb, igt_crc_t *crc)
+static uint16_t crc16_dp_table[2][256];
+
+static void crc16_dp_init_table(void)
 {
-	int x, y, i;
-	uint8_t *ptr;
-	uint8_t *data;
-	uint16_t din;
+	static bool init;
 
-	igt_assert(fb && crc);
+	if (init)
+		return;
 
-	ptr = igt_fb_map_buffer(fb->fd, fb);
-	igt_assert(ptr);
+	for (int i = 0; i < 256; i++) {
+		crc16_dp_table[0][i] = update_crc16_dp(i, 0);
+		crc16_dp_table[1][i] = update_crc16_dp(i << 8, 0);
+	}
+
+	init = true;
+}
+
+/* update_crc16_dp() for an 8 bit component, zero-padded */
+static inline uint16_t update_crc16_dp_u8(uint16_t crc, uint8_t v)
+{
+	crc ^= v << 8;
+
+	return crc16_dp_table[0][crc & 0xff] ^ crc16_dp_table[1][crc >> 8];
+}
+
+/*
+ * The crc is linear, so the crc of a stripe starting from a non-zero crc is
+ * its crc starting from zero, xored with the starting crc advanced by the
+ * length of the stripe. Advancing a crc by n zero inputs is a 16x16 bit
+ * matrix raised to the power of n, which is cheap compared to the pixels.
+ */
+struct crc16_matrix {
+	uint16_t col[16];
+};
+
+static uint16_t crc16_matrix_apply(const struct crc16_matrix *m, uint16_t v)
+{
+	uint16_t ret = 0;
+
+	for (int i = 0; i < 16; i++)
+		if (v & (1 << i))
+			ret ^= m->col[i];
+
+	return ret;
+}
+
+static struct crc16_matrix crc16_matrix_mul(const struct crc16_matrix *a,
+					    const struct crc16_matrix *b)
+{
+	struct crc16_matrix ret;
+
+	for (int i = 0; i < 16; i++)
+		ret.col[i] = crc16_matrix_apply(a, b->col[i]);
+
+	return ret;
+}
+
+static uint16_t crc16_advance(uint16_t crc, uint64_t n)
+{
+	struct crc16_matrix m;
+
+	for (int i = 0; i < 16; i++)
+		m.col[i] = update_crc16_dp(1 << i, 0);
+
+	for (; n; n >>= 1) {
+		if (n & 1)
+			crc = crc16_matrix_apply(&m, crc);
+		m = crc16_matrix_mul(&m, &m);
+	}
+
+	return crc;
+}
+
+struct fb_crc {
+	const struct igt_fb *fb;
+	const uint8_t *data;
+	uint16_t (*crc)[3];
+	unsigned int *end;
+};
+
+static void crc_stripe(void *data, unsigned int start, unsigned int end)
+{
+	const struct fb_crc *c = data;
+	uint16_t crc[3] = {};
+
+	for (unsigned int y = start; y < end; y++) {
+		const uint8_t *row = c->data + y * c->fb->strides[0];
+
+		for (int x = 0; x < c->fb->width; x++) {
+			crc[0] = update_crc16_dp_u8(crc[0], row[x * 4 + 2]);
+			crc[1] = update_crc16_dp_u8(crc[1], row[x * 4 + 1]);
+			crc[2] = update_crc16_dp_u8(crc[2], row[x * 4 + 0]);
+		}
+	}
+
+	memcpy(c->crc[start], crc, sizeof(crc));
+	c->end[start] = end;
+}
+
+/* The crc of the XRGB8888 pixels of @fb, whose first plane is at @data */
+static void fb_calc_crc(const struct igt_fb *fb, const uint8_t *data,
+			igt_crc_t *crc)
+{
+	struct fb_crc c = { .fb = fb, .data = data };
 
 	/* set for later CRC comparison */
 	crc->has_valid_frame = true;
@@ -1168,32 +1482,23 @@ void igt_fb_calc_crc(struct igt_fb *fb, igt_crc_t *crc)
 	crc->crc[1] = 0;	/* G */
 	crc->crc[2] = 0;	/* B */
 
-	data = ptr + fb->offsets[0];
-	for (y = 0; y < fb->height; ++y) {
-		for (x = 0; x < fb->width; ++x) {
-			switch (fb->drm_format) {
-			case DRM_FORMAT_XRGB8888:
-				i = x * 4 + y * fb->strides[0];
-
-				din = data[i + 2] << 8; /* padding-zeros */
-				crc->crc[0] = update_crc16_dp(crc->crc[0], din);
-
-				/* Green-component */
-				din = data[i + 1] << 8;
-				crc->crc[1] = update_crc16_dp(crc->crc[1], din);
-
-				/* Blue-component */
-				din = data[i] << 8;
-				crc->crc[2] = update_crc16_dp(crc->crc[2], din);
-				break;
-			default:
-				igt_assert_f(0, "DRM Format Invalid");
-				break;
-			}
-		}
+	c.crc = calloc(fb->height, sizeof(*c.crc));
+	c.end = calloc(fb->height, sizeof(*c.end));
+	igt_assert(c.crc && c.end);
+
+	crc16_dp_init_table();
+	igt_parallel_stripes(fb->height, 1, crc_stripe, &c);
+
+	for (unsigned int y = 0; y < fb->height; y = c.end[y]) {
+		uint64_t n = (uint64_t)(c.end[y] - y) * fb->width;
+
+		for (int i = 0; i < 3; i++)
+			crc->crc[i] = crc16_advance(crc->crc[i], n) ^
+				c.crc[y][i];
 	}
 
-	igt_fb_unmap_buffer(fb, ptr);
+	free(c.end);
+	free(c.crc);
 }
 
 #if defined(USE_CAIRO_PIXMAN)
@@ -1601,6 +1906,355 @@ unsigned int igt_create_fb(int fd, int width, int height, uint32_t format,
 					  fb, 0, 0);
 }
 
+/*
+ * The framebuffer being filled right after its creation, which still holds
+ * what create_bo_for_fb() left in it, the same as any other new bo of the
+ * same format would.
+ */
+static const struct igt_fb *fresh_fb;
+
+/* Don't wait for each upload, igt_create_fbs() waits for all at the end */
+static bool defer_upload_sync;
+
+/*
+ * Framebuffers filled by igt_create_color_fb() and friends can be kept in a
+ * cache of their raw backing storage, so creating the same framebuffer again
+ * is a copy instead of cairo rendering, format conversion and tiling.
+ */
+struct fb_cache_key {
+	dev_t dev;
+	int width;
+	int height;
+	uint32_t format;
+	uint64_t modifier;
+	uint64_t size;
+	unsigned int fill;
+	double r, g, b;
+};
+
+struct fb_cache_entry {
+	struct igt_list link;
+	struct fb_cache_key key;
+	void *data;
+};
+
+static struct {
+	struct igt_list lru;
+	uint64_t size;
+	uint64_t max_size;
+	bool init;
+} fb_cache = {
+	.lru = __IGT_INIT_LIST(fb_cache.lru),
+};
+
+static void fb_cache_evict(uint64_t max_size)
+{
+	while (fb_cache.size > max_size) {
+		struct fb_cache_entry *e =
+			igt_list_last_entry(&fb_cache.lru, e, link);
+
+		igt_list_del(&e->link);
+		fb_cache.size -= e->key.size;
+		free(e->data);
+		free(e);
+	}
+}
+
+/**
+ * igt_fb_cache_enable:
+ * @max_size: most bytes of framebuffer contents to keep around
+ *
+ * Enables caching the contents of framebuffers created with
+ * igt_create_color_fb(), igt_create_pattern_fb() and
+ * igt_create_color_pattern_fb(). Creating a framebuffer with the same size,
+ * format, modifier and fill as an earlier one then copies the cached
+ * contents into the new buffer instead of drawing them again. The least
+ * recently used contents are dropped once @max_size is exceeded.
+ *
+ * The cache can also be enabled by setting the IGT_FB_CACHE environment
+ * variable to the size in MiB.
+ */
+void igt_fb_cache_enable(uint64_t max_size)
+{
+	fb_cache.max_size = max_size;
+	fb_cache.init = true;
+
+	fb_cache_evict(max_size);
+}
+
+/**
+ * igt_fb_cache_disable:
+ *
+ * Disables the framebuffer cache and frees all cached contents.
+ */
+void igt_fb_cache_disable(void)
+{
+	igt_fb_cache_enable(0);
+}
+
+#if defined(USE_CAIRO_PIXMAN)
+static uint64_t fb_cache_max_size(void)
+{
+	if (!fb_cache.init) {
+		const char *env = getenv("IGT_FB_CACHE");
+
+		if (env)
+			fb_cache.max_size = strtoull(env, NULL, 0) << 20;
+		fb_cache.init = true;
+	}
+
+	return fb_cache.max_size;
+}
+
+static bool fb_cache_key(struct fb_cache_key *key, const struct igt_fb *fb,
+			 unsigned int fill, double r, double g, double b)
+{
+	struct stat st;
+
+	/* Only buffers we can read and write raw, whatever their layout. */
+	if (!fb->is_dumb && !is_i915_device(fb->fd))
+		return false;
+
+	if (!fb_cache_max_size() || fb->size > fb_cache.max_size)
+		return false;
+
+	if (fstat(fb->fd, &st))
+		return false;
+
+	memset(key, 0, sizeof(*key));
+	key->dev = st.st_rdev;
+	key->width = fb->width;
+	key->height = fb->height;
+	key->format = fb->drm_format;
+	key->modifier = fb->modifier;
+	key->size = fb->size;
+	key->fill = fill;
+	if (fill & IGT_FB_FILL_COLOR) {
+		key->r = r;
+		key->g = g;
+		key->b = b;
+	}
+
+	return true;
+}
+
+static struct fb_cache_entry *fb_cache_find(const struct fb_cache_key *key)
+{
+	struct fb_cache_entry *e;
+
+	igt_list_for_each(e, &fb_cache.lru, link) {
+		if (!memcmp(&e->key, key, sizeof(*key))) {
+			igt_list_move(&e->link, &fb_cache.lru);
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+static void fb_cache_read(struct igt_fb *fb, void *data)
+{
+	void *ptr;
+
+	if (!fb->is_dumb) {
+		gem_read(fb->fd, fb->gem_handle, 0, data, fb->size);
+		return;
+	}
+
+	ptr = kmstest_dumb_map_buffer(fb->fd, fb->gem_handle, fb->size,
+				      PROT_READ);
+	igt_memcpy_from_wc(data, ptr, fb->size);
+	gem_munmap(ptr, fb->size);
+}
+
+static void fb_cache_write(struct igt_fb *fb, const void *data)
+{
+	void *ptr;
+
+	if (!fb->is_dumb) {
+		gem_write(fb->fd, fb->gem_handle, 0, data, fb->size);
+		return;
+	}
+
+	ptr = kmstest_dumb_map_buffer(fb->fd, fb->gem_handle, fb->size,
+				      PROT_WRITE);
+	memcpy(ptr, data, fb->size);
+	gem_munmap(ptr, fb->size);
+	igt_dirty_fb(fb->fd, fb);
+}
+
+static void fb_cache_insert(const struct fb_cache_key *key, struct igt_fb *fb)
+{
+	struct fb_cache_entry *e;
+
+	e = malloc(sizeof(*e));
+	if (!e)
+		return;
+
+	e->data = malloc(fb->size);
+	if (!e->data) {
+		free(e);
+		return;
+	}
+
+	e->key = *key;
+	fb_cache_read(fb, e->data);
+
+	fb_cache_evict(fb_cache.max_size - fb->size);
+	igt_list_add(&e->link, &fb_cache.lru);
+	fb_cache.size += fb->size;
+}
+
+/*
+ * Above this size a color fill is done by the blitter straight into the
+ * framebuffer, instead of cairo painting a linear copy of it only for that
+ * to be tiled back afterwards.
+ */
+#define GPU_FILL_MIN_SIZE (16 << 20)
+
+static void fill_fb(struct igt_fb *fb, unsigned int fill,
+		    double r, double g, double b);
+
+static bool fill_fb__gpu(struct igt_fb *fb, double r, double g, double b)
+{
+	const struct igt_fb *fresh = fresh_fb;
+	struct igt_fb pixel;
+	struct intel_bb *ibb;
+	uint32_t value = 0;
+	unsigned int cpp;
+	void *data;
+
+	if (!is_i915_device(fb->fd) || fb->size < GPU_FILL_MIN_SIZE)
+		return false;
+
+	if (fb->num_planes != 1 || fb->offsets[0] ||
+	    is_ccs_modifier(fb->modifier) ||
+	    igt_format_is_yuv(fb->drm_format))
+		return false;
+
+	/* Only pixels which repeat within a dword */
+	cpp = fb->plane_bpp[0] / 8;
+	if (cpp != 1 && cpp != 2 && cpp != 4)
+		return false;
+
+	/* Let cairo and the format conversion come up with the pixel */
+	igt_create_fb(fb->fd, 64, 1, fb->drm_format,
+		      LOCAL_DRM_FORMAT_MOD_NONE, &pixel);
+	fresh_fb = &pixel;
+	fill_fb(&pixel, IGT_FB_FILL_COLOR, r, g, b);
+	fresh_fb = fresh;
+
+	data = malloc(pixel.size);
+	igt_assert(data);
+	fb_cache_read(&pixel, data);
+	memcpy(&value, data, cpp);
+	free(data);
+	igt_remove_fb(fb->fd, &pixel);
+
+	if (cpp == 1)
+		value *= 0x01010101;
+	else if (cpp == 2)
+		value |= value << 16;
+
+	/* With every pixel the same, the tiling doesn't matter */
+	ibb = intel_bb_create(fb->fd, 4096);
+	intel_bb_register_object(ibb, fb->gem_handle, fb->size);
+	igt_blitter_fill__chunked(ibb, fb->gem_handle, fb->size, value);
+	intel_bb_destroy(ibb);
+
+	if (!defer_upload_sync)
+		gem_sync(fb->fd, fb->gem_handle);
+
+	return true;
+}
+
+static void fill_fb(struct igt_fb *fb, unsigned int fill,
+		    double r, double g, double b)
+{
+	struct fb_cache_key key;
+	struct fb_cache_entry *e = NULL;
+	bool cache;
+	cairo_t *cr;
+
+	if (fill == IGT_FB_FILL_COLOR && fill_fb__gpu(fb, r, g, b))
+		return;
+
+	cache = fb_cache_key(&key, fb, fill, r, g, b);
+	if (cache)
+		e = fb_cache_find(&key);
+	if (e) {
+		fb_cache_write(fb, e->data);
+		return;
+	}
+
+	cr = igt_get_cairo_ctx(fb->fd, fb);
+	if (fill & IGT_FB_FILL_COLOR)
+		igt_paint_color(cr, 0, 0, fb->width, fb->height, r, g, b);
+	if (fill & IGT_FB_FILL_PATTERN)
+		igt_paint_test_pattern(cr, fb->width, fb->height);
+	igt_put_cairo_ctx(fb->fd, fb, cr);
+
+	if (cache) {
+		/* Write the drawing out to the buffer before the snapshot */
+		cairo_surface_destroy(fb->cairo_surface);
+		fb->cairo_surface = NULL;
+
+		fb_cache_insert(&key, fb);
+	}
+}
+#endif
+
+static unsigned int create_filled_fb(int fd, int width, int height,
+				     uint32_t format, uint64_t modifier,
+				     unsigned int fill,
+				     double r, double g, double b,
+				     struct igt_fb *fb)
+{
+	unsigned int fb_id;
+
+	fb_id = igt_create_fb(fd, width, height, format, modifier, fb);
+	igt_assert(fb_id);
+
+#if defined(USE_CAIRO_PIXMAN)
+	fresh_fb = fb;
+	fill_fb(fb, fill, r, g, b);
+	fresh_fb = NULL;
+#endif
+
+	return fb_id;
+}
+
+/**
+ * igt_create_fbs:
+ * @fd: open drm file descriptor
+ * @params: array of @count framebuffer descriptions
+ * @count: number of framebuffers to create
+ * @fbs: array of @count #igt_fb structures to fill
+ *
+ * Creates @count framebuffers as igt_create_fb(), and fills each with the
+ * color and/or the test pattern selected in its #igt_fb_params.fill, as
+ * igt_create_color_pattern_fb() would. Unlike a loop over those, this doesn't
+ * wait for the gpu to finish uploading one framebuffer before starting on the
+ * next, but only once for all of them at the end.
+ */
+void igt_create_fbs(int fd, const struct igt_fb_params *params, int count,
+		    struct igt_fb *fbs)
+{
+	defer_upload_sync = true;
+	for (int i = 0; i < count; i++)
+		create_filled_fb(fd, params[i].width, params[i].height,
+				 params[i].format, params[i].modifier,
+				 params[i].fill,
+				 params[i].r, params[i].g, params[i].b,
+				 &fbs[i]);
+	defer_upload_sync = false;
+
+	if (is_i915_device(fd)) {
+		for (int i = 0; i < count; i++)
+			gem_sync(fd, fbs[i].gem_handle);
+	}
+}
+
 /**
  * igt_create_color_fb:
  * @fd: open i915 drm file descriptor
@@ -1629,19 +2283,8 @@ unsigned int igt_create_color_fb(int fd, int width, int height,
 				 double r, double g, double b,
 				 struct igt_fb *fb /* out */)
 {
-	unsigned int fb_id;
-	cairo_t *cr;
-
-	fb_id = igt_create_fb(fd, width, height, format, modifier, fb);
-	igt_assert(fb_id);
-
-#if defined(USE_CAIRO_PIXMAN)
-	cr = igt_get_cairo_ctx(fd, fb);
-	igt_paint_color(cr, 0, 0, width, height, r, g, b);
-	igt_put_cairo_ctx(fd, fb, cr);
-#endif
-
-	return fb_id;
+	return create_filled_fb(fd, width, height, format, modifier,
+				IGT_FB_FILL_COLOR, r, g, b, fb);
 }
 
 /**
@@ -1668,19 +2311,8 @@ unsigned int igt_create_pattern_fb(int fd, int width, int height,
 				   uint32_t format, uint64_t modifier,
 				   struct igt_fb *fb /* out */)
 {
-	unsigned int fb_id;
-	cairo_t *cr;
-
-	fb_id = igt_create_fb(fd, width, height, format, modifier, fb);
-	igt_assert(fb_id);
-
-#if defined(USE_CAIRO_PIXMAN)
-	cr = igt_get_cairo_ctx(fd, fb);
-	igt_paint_test_pattern(cr, width, height);
-	igt_put_cairo_ctx(fd, fb, cr);
-#endif
-
-	return fb_id;
+	return create_filled_fb(fd, width, height, format, modifier,
+				IGT_FB_FILL_PATTERN, 0, 0, 0, fb);
 }
 
 /**
@@ -1712,20 +2344,8 @@ unsigned int igt_create_color_pattern_fb(int fd, int width, int height,
 					 double r, double g, double b,
 					 struct igt_fb *fb /* out */)
 {
-	unsigned int fb_id;
-	cairo_t *cr;
-
-	fb_id = igt_create_fb(fd, width, height, format, modifier, fb);
-	igt_assert(fb_id);
-
-#if defined(USE_CAIRO_PIXMAN)
-	cr = igt_get_cairo_ctx(fd, fb);
-	igt_paint_color(cr, 0, 0, width, height, r, g, b);
-	igt_paint_test_pattern(cr, width, height);
-	igt_put_cairo_ctx(fd, fb, cr);
-#endif
-
-	return fb_id;
+	return create_filled_fb(fd, width, height, format, modifier,
+				IGT_FB_FILL_COLOR | IGT_FB_FILL_PATTERN, r, g, b, fb);
 }
 
 #if defined(USE_CAIRO_PIXMAN)
@@ -1910,6 +2530,11 @@ struct fb_blit_upload {
 	struct fb_blit_linear linear;
 	drm_intel_bufmgr *bufmgr;
 	struct intel_batchbuffer *batch;
+	struct intel_bb *ibb;
+
+	/* Rows to copy back to the fb on release, all of them if NULL */
+	const drmModeClip *damage;
+	int num_damage;
 };
 
 #if defined(USE_CAIRO_PIXMAN)
@@ -1917,15 +2542,12 @@ static bool blitter_ok(const struct igt_fb *fb)
 {
 	for (int i = 0; i < fb->num_planes; i++) {
 		/*
-		 * gen4+ stride limit is 4x this with tiling,
-		 * but since our blits are always between tiled
-		 * and linear surfaces (and we do this check just
-		 * for the tiled surface) we must use the lower
-		 * linear stride limit here.
+		 * The chunked fast copy gets around the coordinate
+		 * limits, and the linear pitch limit by copying a row
+		 * at a time, but not the pitch limit of the tiled
+		 * surface, which is in dwords.
 		 */
-		if (fb->plane_width[i] > 32767 ||
-		    fb->plane_height[i] > 32767 ||
-		    fb->strides[i] > 32767)
+		if (fb->strides[i] / 4 > 32767)
 			return false;
 	}
 
@@ -1976,7 +2598,8 @@ static void fini_buf(struct igt_buf *buf)
 
 static void rendercopy(struct fb_blit_upload *blit,
 		       const struct igt_fb *dst_fb,
-		       const struct igt_fb *src_fb)
+		       const struct igt_fb *src_fb,
+		       unsigned int y, unsigned int height)
 {
 	struct igt_buf src = {}, dst = {};
 	igt_render_copyfunc_t render_copy =
@@ -1991,37 +2614,47 @@ static void rendercopy(struct fb_blit_upload *blit,
 	init_buf(blit, &dst, dst_fb, "cairo rendercopy dst");
 
 	render_copy(blit->batch, NULL,
-		    &src, 0, 0, dst_fb->plane_width[0], dst_fb->plane_height[0],
-		    &dst, 0, 0);
+		    &src, 0, y, dst_fb->plane_width[0], height,
+		    &dst, 0, y);
 
 	fini_buf(&dst);
 	fini_buf(&src);
 }
 
-static void blitcopy(const struct igt_fb *dst_fb,
-		     const struct igt_fb *src_fb)
+static void blitcopy(struct fb_blit_upload *blit,
+		     const struct igt_fb *dst_fb,
+		     const struct igt_fb *src_fb,
+		     unsigned int y, unsigned int height)
 {
+	const struct format_desc_struct *f =
+		lookup_drm_format(dst_fb->drm_format);
+
 	igt_assert_eq(dst_fb->fd, src_fb->fd);
 	igt_assert_eq(dst_fb->num_planes, src_fb->num_planes);
 
 	for (int i = 0; i < dst_fb->num_planes; i++) {
+		unsigned int vsub = i ? f->vsub : 1;
+		unsigned int plane_y = y / vsub;
+		unsigned int plane_height =
+			DIV_ROUND_UP(y + height, vsub) - plane_y;
+
 		igt_assert_eq(dst_fb->plane_bpp[i], src_fb->plane_bpp[i]);
 		igt_assert_eq(dst_fb->plane_width[i], src_fb->plane_width[i]);
 		igt_assert_eq(dst_fb->plane_height[i], src_fb->plane_height[i]);
 
-		igt_blitter_fast_copy__raw(dst_fb->fd,
-					   src_fb->gem_handle,
-					   src_fb->offsets[i],
-					   src_fb->strides[i],
-					   igt_fb_mod_to_tiling(src_fb->modifier),
-					   0, 0, /* src_x, src_y */
-					   dst_fb->plane_width[i], dst_fb->plane_height[i],
-					   dst_fb->plane_bpp[i],
-					   dst_fb->gem_handle,
-					   dst_fb->offsets[i],
-					   dst_fb->strides[i],
-					   igt_fb_mod_to_tiling(dst_fb->modifier),
-					   0, 0 /* dst_x, dst_y */);
+		igt_blitter_fast_copy__chunked(blit->ibb,
+					       src_fb->gem_handle,
+					       src_fb->offsets[i],
+					       src_fb->strides[i],
+					       igt_fb_mod_to_tiling(src_fb->modifier),
+					       0, plane_y, /* src_x, src_y */
+					       dst_fb->plane_width[i], plane_height,
+					       dst_fb->plane_bpp[i],
+					       dst_fb->gem_handle,
+					       dst_fb->offsets[i],
+					       dst_fb->strides[i],
+					       igt_fb_mod_to_tiling(dst_fb->modifier),
+					       0, plane_y /* dst_x, dst_y */);
 	}
 }
 
@@ -2034,20 +2667,30 @@ static void free_linear_mapping(struct fb_blit_upload *blit)
 	if (igt_vc4_is_tiled(fb->modifier)) {
 		void *map = igt_vc4_mmap_bo(fd, fb->gem_handle, fb->size, PROT_WRITE);
 
-		vc4_fb_convert_plane_to_tiled(fb, map, &linear->fb, &linear->map);
+		vc4_fb_convert_plane_to_tiled(fb, map, &linear->fb, linear->map);
 
 		munmap(map, fb->size);
 	} else {
+		drmModeClip all = { 0, 0, fb->width, fb->height };
+		const drmModeClip *clips = blit->damage ?: &all;
+		int num_clips = blit->damage ? blit->num_damage : 1;
+
 		gem_munmap(linear->map, linear->fb.size);
 		gem_set_domain(fd, linear->fb.gem_handle,
 			I915_GEM_DOMAIN_GTT, 0);
 
-		if (blit->batch)
-			rendercopy(blit, fb, &linear->fb);
-		else
-			blitcopy(fb, &linear->fb);
+		for (int i = 0; i < num_clips; i++) {
+			unsigned int y = clips[i].y1;
+			unsigned int height = clips[i].y2 - clips[i].y1;
+
+			if (blit->batch)
+				rendercopy(blit, fb, &linear->fb, y, height);
+			else
+				blitcopy(blit, fb, &linear->fb, y, height);
+		}
 
-		gem_sync(fd, linear->fb.gem_handle);
+		if (!defer_upload_sync)
+			gem_sync(fd, linear->fb.gem_handle);
 		gem_close(fd, linear->fb.gem_handle);
 	}
 
@@ -2055,6 +2698,9 @@ static void free_linear_mapping(struct fb_blit_upload *blit)
 		intel_batchbuffer_free(blit->batch);
 		drm_intel_bufmgr_destroy(blit->bufmgr);
 	}
+
+	if (blit->ibb)
+		intel_bb_destroy(blit->ibb);
 }
 
 static void destroy_cairo_surface__gpu(void *arg)
@@ -2094,6 +2740,17 @@ static void setup_linear_mapping(struct fb_blit_upload *blit)
 
 	igt_assert(linear->fb.gem_handle > 0);
 
+	/*
+	 * All the blits of this mapping go through the same batch objects,
+	 * large enough for the many chunks of a big framebuffer.
+	 */
+	if (!igt_vc4_is_tiled(fb->modifier) && !blit->batch) {
+		blit->ibb = intel_bb_create(fd, 64 << 10);
+		intel_bb_register_object(blit->ibb, fb->gem_handle, fb->size);
+		intel_bb_register_object(blit->ibb, linear->fb.gem_handle,
+					 linear->fb.size);
+	}
+
 	if (igt_vc4_is_tiled(fb->modifier)) {
 		void *map = igt_vc4_mmap_bo(fd, fb->gem_handle, fb->size, PROT_READ);
 
@@ -2101,20 +2758,23 @@ static void setup_linear_mapping(struct fb_blit_upload *blit)
 					      linear->fb.size,
 					      PROT_READ | PROT_WRITE);
 
-		vc4_fb_convert_plane_from_tiled(&linear->fb, &linear->map, fb, map);
+		vc4_fb_convert_plane_from_tiled(&linear->fb, linear->map, fb, map);
 
 		munmap(map, fb->size);
 	} else {
-		/* Copy fb content to linear BO */
-		gem_set_domain(fd, linear->fb.gem_handle,
-				I915_GEM_DOMAIN_GTT, 0);
-
-		if (blit->batch)
-			rendercopy(blit, &linear->fb, fb);
-		else
-			blitcopy(&linear->fb, fb);
-
-		gem_sync(fd, linear->fb.gem_handle);
+		/* Copy fb content to linear BO, a new fb matches the new bo */
+		if (fb != fresh_fb) {
+			gem_set_domain(fd, linear->fb.gem_handle,
+				       I915_GEM_DOMAIN_GTT, 0);
+
+			if (blit->batch)
+				rendercopy(blit, &linear->fb, fb,
+					   0, fb->height);
+			else
+				blitcopy(blit, &linear->fb, fb, 0, fb->height);
+
+			gem_sync(fd, linear->fb.gem_handle);
+		}
 
 		gem_set_domain(fd, linear->fb.gem_handle,
 			I915_GEM_DOMAIN_CPU, I915_GEM_DOMAIN_CPU);
@@ -2149,8 +2809,82 @@ static void create_cairo_surface__gpu(int fd, struct igt_fb *fb)
 				    (cairo_user_data_key_t *)create_cairo_surface__gpu,
 				    blit, destroy_cairo_surface__gpu);
 }
+
+/*
+ * Reading a tiled fb back through the gtt is uncached, and detiles with a
+ * fence, which doesn't cover Yf. When the GPU can detile the fb, have it
+ * copy it to a linear bo instead, read back through the cpu caches at a
+ * fraction of the cost for large fbs.
+ */
+static bool use_gpu_readback(const struct igt_fb *fb)
+{
+	if (igt_vc4_is_tiled(fb->modifier) ||
+	    fb->modifier == LOCAL_DRM_FORMAT_MOD_NONE)
+		return false;
+
+	/* The fast copy handles X tiling too, from gen9 */
+	if (fb->modifier == I915_FORMAT_MOD_X_TILED)
+		return blitter_ok(fb) &&
+			intel_gen(intel_get_drm_devid(fb->fd)) >= 9;
+
+	return use_blitter(fb) || use_rendercopy(fb);
+}
+
+static void calc_crc__gpu(struct igt_fb *fb, igt_crc_t *crc)
+{
+	/* Nothing is written, so nothing is to be copied back to @fb */
+	static const drmModeClip no_damage;
+	struct fb_blit_upload blit = {
+		.fd = fb->fd,
+		.fb = fb,
+		.damage = &no_damage,
+		.num_damage = 0,
+	};
+
+	setup_linear_mapping(&blit);
+
+	fb_calc_crc(&blit.linear.fb,
+		    blit.linear.map + blit.linear.fb.offsets[0], crc);
+
+	free_linear_mapping(&blit);
+}
 #endif /*defined(USE_CAIRO_PIXMAN)*/
 
+/**
+ * igt_fb_calc_crc:
+ * @fb: pointer to an #igt_fb structure
+ * @crc: pointer to an #igt_crc_t structure
+ *
+ * This function calculate the 16-bit frame CRC of RGB components over all
+ * the active pixels.
+ *
+ * Tiled i915 framebuffers which the GPU can detile are first copied by it
+ * into a linear buffer read through the CPU caches, rather than read through
+ * an uncached GTT mapping.
+ */
+void igt_fb_calc_crc(struct igt_fb *fb, igt_crc_t *crc)
+{
+	uint8_t *ptr;
+
+	igt_assert(fb && crc);
+	igt_assert_f(fb->drm_format == DRM_FORMAT_XRGB8888,
+		     "DRM Format Invalid");
+
+#if defined(USE_CAIRO_PIXMAN)
+	if (is_i915_device(fb->fd) && use_gpu_readback(fb)) {
+		calc_crc__gpu(fb, crc);
+		return;
+	}
+#endif
+
+	ptr = igt_fb_map_buffer(fb->fd, fb);
+	igt_assert(ptr);
+
+	fb_calc_crc(fb, ptr + fb->offsets[0], crc);
+
+	igt_fb_unmap_buffer(fb, ptr);
+}
+
 /**
  * igt_dirty_fb:
  * @fd: open drm file descriptor
@@ -2165,12 +2899,39 @@ int igt_dirty_fb(int fd, struct igt_fb *fb)
 	return drmModeDirtyFB(fb->fd, fb->fb_id, NULL, 0);
 }
 
-static void unmap_bo(struct igt_fb *fb, void *ptr)
+/*
+ * Linear i915 bos, dumb ones included, don't need a fence to detile, so map
+ * them through the cpu caches: drawing with cairo reads as much as it writes,
+ * and reads through the gtt are uncached.
+ */
+static bool use_cpu_mmap(const struct igt_fb *fb)
+{
+	return is_i915_device(fb->fd) &&
+		fb->modifier == LOCAL_DRM_FORMAT_MOD_NONE;
+}
+
+/* Only rows in @clips were written, or all of them if @clips is NULL */
+static void __unmap_bo(struct igt_fb *fb, void *ptr,
+		       drmModeClip *clips, int num_clips)
 {
 	gem_munmap(ptr, fb->size);
 
-	if (fb->is_dumb)
-		igt_dirty_fb(fb->fd, fb);
+	/*
+	 * Flush the cpu writes to a bo in use for scanout, and clflush them
+	 * out of the caches on !llc before anything else reads the bo.
+	 */
+	if (use_cpu_mmap(fb)) {
+		gem_sw_finish(fb->fd, fb->gem_handle);
+		gem_set_domain(fb->fd, fb->gem_handle, I915_GEM_DOMAIN_GTT, 0);
+	}
+
+	if (fb->is_dumb && (!clips || num_clips))
+		drmModeDirtyFB(fb->fd, fb->fb_id, clips, num_clips);
+}
+
+static void unmap_bo(struct igt_fb *fb, void *ptr)
+{
+	__unmap_bo(fb, ptr, NULL, 0);
 }
 
 #if defined(USE_CAIRO_PIXMAN)
@@ -2187,6 +2948,14 @@ static void *map_bo(int fd, struct igt_fb *fb)
 {
 	void *ptr;
 
+	if (use_cpu_mmap(fb)) {
+		gem_set_domain(fd, fb->gem_handle,
+			       I915_GEM_DOMAIN_CPU, I915_GEM_DOMAIN_CPU);
+
+		return gem_mmap__cpu(fd, fb->gem_handle, 0, fb->size,
+				     PROT_READ | PROT_WRITE);
+	}
+
 	if (is_i915_device(fd))
 		gem_set_domain(fd, fb->gem_handle,
 			       I915_GEM_DOMAIN_GTT, I915_GEM_DOMAIN_GTT);
@@ -2226,7 +2995,8 @@ static void create_cairo_surface__gtt(int fd, struct igt_fb *fb)
 		      "Unable to create a cairo surface: %s\n",
 		      cairo_status_to_string(cairo_surface_status(fb->cairo_surface)));
 
-	fb->domain = I915_GEM_DOMAIN_GTT;
+	fb->domain = use_cpu_mmap(fb) ?
+		I915_GEM_DOMAIN_CPU : I915_GEM_DOMAIN_GTT;
 
 	cairo_surface_set_user_data(fb->cairo_surface,
 				    (cairo_user_data_key_t *)create_cairo_surface__gtt,
@@ -2239,6 +3009,9 @@ struct fb_convert_blit_upload {
 
 	struct igt_fb shadow_fb;
 	uint8_t *shadow_ptr;
+
+	/* The shadow as read back, to find what was drawn */
+	uint8_t *snapshot;
 };
 
 #if defined(USE_CAIRO_PIXMAN)
@@ -2263,6 +3036,10 @@ static void *igt_fb_create_cairo_shadow_buffer(int fd,
 		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 	igt_assert(ptr != MAP_FAILED);
 
+	/* Fewer tlb misses while cairo draws, if thp is available */
+	if (shadow->size >= 2 << 20)
+		madvise(ptr, shadow->size, MADV_HUGEPAGE);
+
 	return ptr;
 }
 
@@ -2301,8 +3078,11 @@ struct fb_convert_buf {
 struct fb_convert {
 	struct fb_convert_buf	dst;
 	struct fb_convert_buf	src;
+	bool			alpha;
 };
 
+typedef void (*fb_convert_fn)(struct fb_convert *cvt);
+
 static void *convert_src_get(const struct fb_convert *cvt)
 {
 	void *buf;
@@ -2507,12 +3287,479 @@ static void get_yuv_parameters(struct igt_fb *fb, struct yuv_parameters *params)
 	}
 }
 
+static void yuv_to_rgb24_row(uint8_t *rgb24,
+			     const uint8_t *y, const uint8_t *u, const uint8_t *v,
+			     const struct yuv_parameters *params,
+			     unsigned int hsub, unsigned int width,
+			     const struct igt_mat4 *m)
+{
+	for (unsigned int j = 0; j < width; j++) {
+		struct igt_vec4 rgb, yuv;
+
+		yuv.d[0] = *y;
+		yuv.d[1] = *u;
+		yuv.d[2] = *v;
+		yuv.d[3] = 1.0f;
+
+		rgb = igt_matrix_transform(m, &yuv);
+		write_rgb(rgb24, &rgb);
+
+		rgb24 += 4;
+		y += params->ay_inc;
+
+		if ((hsub == 1) || (j % hsub)) {
+			u += params->uv_inc;
+			v += params->uv_inc;
+		}
+	}
+}
+
+static void rgb24_to_yuv_row(uint8_t *y, uint8_t *u, uint8_t *v,
+			     const uint8_t *rgb24, unsigned int pair_stride,
+			     bool chroma, const struct yuv_parameters *params,
+			     unsigned int hsub, unsigned int width,
+			     const struct igt_mat4 *m)
+{
+	for (unsigned int j = 0; j < width; j++) {
+		const uint8_t *pair_rgb24 = rgb24;
+		struct igt_vec4 pair_rgb, rgb;
+		struct igt_vec4 pair_yuv, yuv;
+
+		read_rgb(&rgb, rgb24);
+		yuv = igt_matrix_transform(m, &rgb);
+
+		rgb24 += 4;
+
+		*y = yuv.d[0];
+		y += params->ay_inc;
+
+		if (!chroma || (j % hsub))
+			continue;
+
+		/*
+		 * We assume the MPEG2 chroma siting convention, where
+		 * pixel center for Cb'Cr' is between the left top and
+		 * bottom pixel in a 2x2 block, so take the average.
+		 *
+		 * Therefore, if we use subsampling, we only really care
+		 * about two pixels all the time, either the two
+		 * subsequent pixels horizontally, vertically, or the
+		 * two corners in a 2x2 block.
+		 *
+		 * The only corner case is when we have an odd number of
+		 * pixels, but this can be handled pretty easily by not
+		 * incrementing the paired pixel pointer in the
+		 * direction it's odd in.
+		 */
+		if (j != (width - 1))
+			pair_rgb24 += (hsub - 1) * 4;
+
+		pair_rgb24 += pair_stride;
+
+		read_rgb(&pair_rgb, pair_rgb24);
+		pair_yuv = igt_matrix_transform(m, &pair_rgb);
+
+		*u = (yuv.d[1] + pair_yuv.d[1]) / 2.0f;
+		*v = (yuv.d[2] + pair_yuv.d[2]) / 2.0f;
+
+		u += params->uv_inc;
+		v += params->uv_inc;
+	}
+}
+
+#if defined(__x86_64__) && !defined(__clang__)
+/*
+ * The vector kernels below evaluate the matrix in the same order as
+ * igt_matrix_transform() and round the same way as the scalar code above,
+ * so the results are bit identical. They only handle whole blocks and leave
+ * the remaining pixels at the end of the row to the scalar code, which also
+ * stays the reference for the formats they don't cover.
+ */
+#pragma GCC push_options
+#pragma GCC target("ssse3")
+
+#include <tmmintrin.h>
+
+static void yuv_to_rgb24_row_ssse3(uint8_t *rgb24,
+				   const uint8_t *y, const uint8_t *u, const uint8_t *v,
+				   const struct yuv_parameters *params,
+				   unsigned int hsub, unsigned int width,
+				   const struct igt_mat4 *m)
+{
+	/* { R0-3, G0-3, B0-3, B0-3 } -> { B, G, R, X } */
+	const __m128i bgrx = _mm_setr_epi8(8, 4, 0, -1, 9, 5, 1, -1,
+					   10, 6, 2, -1, 11, 7, 3, -1);
+	const __m128i rgb_mask = _mm_set1_epi32(0x00ffffff);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const unsigned int ay = params->ay_inc;
+	unsigned int uv[4];
+	__m128 r[3][4];
+	unsigned int j = 0;
+
+	if (hsub > 2)
+		goto out;
+
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 4; col++)
+			r[row][col] = _mm_set1_ps(m->d[m(row, col)]);
+
+	for (int k = 0; k < 4; k++)
+		uv[k] = k / hsub * params->uv_inc;
+
+	for (; j + 4 <= width; j += 4) {
+		const __m128 vy = _mm_cvtepi32_ps(_mm_setr_epi32(y[0], y[ay],
+								 y[2 * ay], y[3 * ay]));
+		const __m128 vu = _mm_cvtepi32_ps(_mm_setr_epi32(u[uv[0]], u[uv[1]],
+								 u[uv[2]], u[uv[3]]));
+		const __m128 vv = _mm_cvtepi32_ps(_mm_setr_epi32(v[uv[0]], v[uv[1]],
+								 v[uv[2]], v[uv[3]]));
+		__m128i c[3], out;
+
+		for (int row = 0; row < 3; row++) {
+			__m128 t;
+
+			t = _mm_add_ps(_mm_mul_ps(r[row][0], vy),
+				       _mm_mul_ps(r[row][1], vu));
+			t = _mm_add_ps(t, _mm_mul_ps(r[row][2], vv));
+			t = _mm_add_ps(t, r[row][3]);
+
+			c[row] = _mm_cvttps_epi32(_mm_add_ps(t, half));
+		}
+
+		/* Saturating packs clamp to [0, 255] like clamprgb() */
+		out = _mm_packus_epi16(_mm_packs_epi32(c[0], c[1]),
+				       _mm_packs_epi32(c[2], c[2]));
+		out = _mm_shuffle_epi8(out, bgrx);
+
+		/* Leave X alone, as write_rgb() does */
+		out = _mm_or_si128(_mm_and_si128(out, rgb_mask),
+				   _mm_andnot_si128(rgb_mask,
+						    _mm_loadu_si128((__m128i *)rgb24)));
+		_mm_storeu_si128((__m128i *)rgb24, out);
+
+		rgb24 += 16;
+		y += 4 * ay;
+		u += 4 / hsub * params->uv_inc;
+		v += 4 / hsub * params->uv_inc;
+	}
+
+out:
+	yuv_to_rgb24_row(rgb24, y, u, v, params, hsub, width - j, m);
+}
+
+static void rgb24_to_yuv_row_ssse3(uint8_t *y, uint8_t *u, uint8_t *v,
+				   const uint8_t *rgb24, unsigned int pair_stride,
+				   bool chroma, const struct yuv_parameters *params,
+				   unsigned int hsub, unsigned int width,
+				   const struct igt_mat4 *m)
+{
+	const __m128i shuf[3] = {
+		_mm_setr_epi8(2, -1, -1, -1, 6, -1, -1, -1,
+			      10, -1, -1, -1, 14, -1, -1, -1),
+		_mm_setr_epi8(1, -1, -1, -1, 5, -1, -1, -1,
+			      9, -1, -1, -1, 13, -1, -1, -1),
+		_mm_setr_epi8(0, -1, -1, -1, 4, -1, -1, -1,
+			      8, -1, -1, -1, 12, -1, -1, -1),
+	};
+	const __m128 half = _mm_set1_ps(0.5f);
+	__m128 r[3][4];
+	unsigned int j = 0;
+
+	if (hsub > 2)
+		goto out;
+
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 4; col++)
+			r[row][col] = _mm_set1_ps(m->d[m(row, col)]);
+
+	/* The pair of the last pixel is special, leave it to the tail */
+	for (; j + 4 + hsub - 1 <= width; j += 4) {
+		const __m128i px = _mm_loadu_si128((const __m128i *)rgb24);
+		__m128 c[3], t;
+		int32_t out[4];
+
+		for (int i = 0; i < 3; i++)
+			c[i] = _mm_cvtepi32_ps(_mm_shuffle_epi8(px, shuf[i]));
+
+		t = _mm_add_ps(_mm_mul_ps(r[0][0], c[0]),
+			       _mm_mul_ps(r[0][1], c[1]));
+		t = _mm_add_ps(t, _mm_mul_ps(r[0][2], c[2]));
+		t = _mm_add_ps(t, r[0][3]);
+
+		_mm_storeu_si128((__m128i *)out, _mm_cvttps_epi32(t));
+		for (int k = 0; k < 4; k++) {
+			*y = out[k];
+			y += params->ay_inc;
+		}
+
+		if (chroma) {
+			const __m128i pp =
+				_mm_loadu_si128((const __m128i *)(rgb24 + (hsub - 1) * 4 + pair_stride));
+			__m128 p[3];
+			int32_t cb[4], cr[4];
+
+			for (int i = 0; i < 3; i++)
+				p[i] = _mm_cvtepi32_ps(_mm_shuffle_epi8(pp, shuf[i]));
+
+			for (int row = 1; row < 3; row++) {
+				__m128 a, b;
+
+				a = _mm_add_ps(_mm_mul_ps(r[row][0], c[0]),
+					       _mm_mul_ps(r[row][1], c[1]));
+				a = _mm_add_ps(a, _mm_mul_ps(r[row][2], c[2]));
+				a = _mm_add_ps(a, r[row][3]);
+
+				b = _mm_add_ps(_mm_mul_ps(r[row][0], p[0]),
+					       _mm_mul_ps(r[row][1], p[1]));
+				b = _mm_add_ps(b, _mm_mul_ps(r[row][2], p[2]));
+				b = _mm_add_ps(b, r[row][3]);
+
+				/* Halving is exact, same as dividing by 2 */
+				a = _mm_mul_ps(_mm_add_ps(a, b), half);
+				_mm_storeu_si128((__m128i *)(row == 1 ? cb : cr),
+						 _mm_cvttps_epi32(a));
+			}
+
+			for (int k = 0; k < 4; k += hsub) {
+				*u = cb[k];
+				*v = cr[k];
+				u += params->uv_inc;
+				v += params->uv_inc;
+			}
+		}
+
+		rgb24 += 16;
+	}
+
+out:
+	rgb24_to_yuv_row(y, u, v, rgb24, pair_stride, chroma, params,
+			 hsub, width - j, m);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <immintrin.h>
+
+static void yuv_to_rgb24_row_avx2(uint8_t *rgb24,
+				  const uint8_t *y, const uint8_t *u, const uint8_t *v,
+				  const struct yuv_parameters *params,
+				  unsigned int hsub, unsigned int width,
+				  const struct igt_mat4 *m)
+{
+	/* per lane: { R0-3, G0-3, B0-3, B0-3 } -> { B, G, R, X } */
+	const __m256i bgrx = _mm256_setr_epi8(8, 4, 0, -1, 9, 5, 1, -1,
+					      10, 6, 2, -1, 11, 7, 3, -1,
+					      8, 4, 0, -1, 9, 5, 1, -1,
+					      10, 6, 2, -1, 11, 7, 3, -1);
+	const __m256i rgb_mask = _mm256_set1_epi32(0x00ffffff);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const unsigned int ay = params->ay_inc;
+	unsigned int uv[8];
+	__m256 r[3][4];
+	unsigned int j = 0;
+
+	if (hsub > 2)
+		goto out;
+
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 4; col++)
+			r[row][col] = _mm256_set1_ps(m->d[m(row, col)]);
+
+	for (int k = 0; k < 8; k++)
+		uv[k] = k / hsub * params->uv_inc;
+
+	for (; j + 8 <= width; j += 8) {
+		const __m256 vy =
+			_mm256_cvtepi32_ps(_mm256_setr_epi32(y[0], y[ay],
+							     y[2 * ay], y[3 * ay],
+							     y[4 * ay], y[5 * ay],
+							     y[6 * ay], y[7 * ay]));
+		const __m256 vu =
+			_mm256_cvtepi32_ps(_mm256_setr_epi32(u[uv[0]], u[uv[1]],
+							     u[uv[2]], u[uv[3]],
+							     u[uv[4]], u[uv[5]],
+							     u[uv[6]], u[uv[7]]));
+		const __m256 vv =
+			_mm256_cvtepi32_ps(_mm256_setr_epi32(v[uv[0]], v[uv[1]],
+							     v[uv[2]], v[uv[3]],
+							     v[uv[4]], v[uv[5]],
+							     v[uv[6]], v[uv[7]]));
+		__m256i c[3], out;
+
+		for (int row = 0; row < 3; row++) {
+			__m256 t;
+
+			t = _mm256_add_ps(_mm256_mul_ps(r[row][0], vy),
+					  _mm256_mul_ps(r[row][1], vu));
+			t = _mm256_add_ps(t, _mm256_mul_ps(r[row][2], vv));
+			t = _mm256_add_ps(t, r[row][3]);
+
+			c[row] = _mm256_cvttps_epi32(_mm256_add_ps(t, half));
+		}
+
+		/* The packs work within each lane, keeping pixels 0-3 and 4-7 apart */
+		out = _mm256_packus_epi16(_mm256_packs_epi32(c[0], c[1]),
+					  _mm256_packs_epi32(c[2], c[2]));
+		out = _mm256_shuffle_epi8(out, bgrx);
+
+		out = _mm256_or_si256(_mm256_and_si256(out, rgb_mask),
+				      _mm256_andnot_si256(rgb_mask,
+							  _mm256_loadu_si256((__m256i *)rgb24)));
+		_mm256_storeu_si256((__m256i *)rgb24, out);
+
+		rgb24 += 32;
+		y += 8 * ay;
+		u += 8 / hsub * params->uv_inc;
+		v += 8 / hsub * params->uv_inc;
+	}
+
+out:
+	yuv_to_rgb24_row_ssse3(rgb24, y, u, v, params, hsub, width - j, m);
+}
+
+static void rgb24_to_yuv_row_avx2(uint8_t *y, uint8_t *u, uint8_t *v,
+				  const uint8_t *rgb24, unsigned int pair_stride,
+				  bool chroma, const struct yuv_parameters *params,
+				  unsigned int hsub, unsigned int width,
+				  const struct igt_mat4 *m)
+{
+	const __m256i shuf[3] = {
+		_mm256_setr_epi8(2, -1, -1, -1, 6, -1, -1, -1,
+				 10, -1, -1, -1, 14, -1, -1, -1,
+				 2, -1, -1, -1, 6, -1, -1, -1,
+				 10, -1, -1, -1, 14, -1, -1, -1),
+		_mm256_setr_epi8(1, -1, -1, -1, 5, -1, -1, -1,
+				 9, -1, -1, -1, 13, -1, -1, -1,
+				 1, -1, -1, -1, 5, -1, -1, -1,
+				 9, -1, -1, -1, 13, -1, -1, -1),
+		_mm256_setr_epi8(0, -1, -1, -1, 4, -1, -1, -1,
+				 8, -1, -1, -1, 12, -1, -1, -1,
+				 0, -1, -1, -1, 4, -1, -1, -1,
+				 8, -1, -1, -1, 12, -1, -1, -1),
+	};
+	const __m256 half = _mm256_set1_ps(0.5f);
+	__m256 r[3][4];
+	unsigned int j = 0;
+
+	if (hsub > 2)
+		goto out;
+
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 4; col++)
+			r[row][col] = _mm256_set1_ps(m->d[m(row, col)]);
+
+	for (; j + 8 + hsub - 1 <= width; j += 8) {
+		const __m256i px = _mm256_loadu_si256((const __m256i *)rgb24);
+		__m256 c[3], t;
+		int32_t out[8];
+
+		for (int i = 0; i < 3; i++)
+			c[i] = _mm256_cvtepi32_ps(_mm256_shuffle_epi8(px, shuf[i]));
+
+		t = _mm256_add_ps(_mm256_mul_ps(r[0][0], c[0]),
+				  _mm256_mul_ps(r[0][1], c[1]));
+		t = _mm256_add_ps(t, _mm256_mul_ps(r[0][2], c[2]));
+		t = _mm256_add_ps(t, r[0][3]);
+
+		_mm256_storeu_si256((__m256i *)out, _mm256_cvttps_epi32(t));
+		for (int k = 0; k < 8; k++) {
+			*y = out[k];
+			y += params->ay_inc;
+		}
+
+		if (chroma) {
+			const __m256i pp =
+				_mm256_loadu_si256((const __m256i *)(rgb24 + (hsub - 1) * 4 + pair_stride));
+			__m256 p[3];
+			int32_t cb[8], cr[8];
+
+			for (int i = 0; i < 3; i++)
+				p[i] = _mm256_cvtepi32_ps(_mm256_shuffle_epi8(pp, shuf[i]));
+
+			for (int row = 1; row < 3; row++) {
+				__m256 a, b;
+
+				a = _mm256_add_ps(_mm256_mul_ps(r[row][0], c[0]),
+						  _mm256_mul_ps(r[row][1], c[1]));
+				a = _mm256_add_ps(a, _mm256_mul_ps(r[row][2], c[2]));
+				a = _mm256_add_ps(a, r[row][3]);
+
+				b = _mm256_add_ps(_mm256_mul_ps(r[row][0], p[0]),
+						  _mm256_mul_ps(r[row][1], p[1]));
+				b = _mm256_add_ps(b, _mm256_mul_ps(r[row][2], p[2]));
+				b = _mm256_add_ps(b, r[row][3]);
+
+				a = _mm256_mul_ps(_mm256_add_ps(a, b), half);
+				_mm256_storeu_si256((__m256i *)(row == 1 ? cb : cr),
+						    _mm256_cvttps_epi32(a));
+			}
+
+			for (int k = 0; k < 8; k += hsub) {
+				*u = cb[k];
+				*v = cr[k];
+				u += params->uv_inc;
+				v += params->uv_inc;
+			}
+		}
+
+		rgb24 += 32;
+	}
+
+out:
+	rgb24_to_yuv_row_ssse3(y, u, v, rgb24, pair_stride, chroma, params,
+			       hsub, width - j, m);
+}
+
+#pragma GCC pop_options
+
+typedef void (*yuv_to_rgb24_row_fn)(uint8_t *rgb24,
+				    const uint8_t *y, const uint8_t *u, const uint8_t *v,
+				    const struct yuv_parameters *params,
+				    unsigned int hsub, unsigned int width,
+				    const struct igt_mat4 *m);
+
+typedef void (*rgb24_to_yuv_row_fn)(uint8_t *y, uint8_t *u, uint8_t *v,
+				    const uint8_t *rgb24, unsigned int pair_stride,
+				    bool chroma, const struct yuv_parameters *params,
+				    unsigned int hsub, unsigned int width,
+				    const struct igt_mat4 *m);
+
+static yuv_to_rgb24_row_fn get_yuv_to_rgb24_row(void)
+{
+	unsigned int features = igt_x86_features();
+
+	if (features & AVX2)
+		return yuv_to_rgb24_row_avx2;
+	if (features & SSSE3)
+		return yuv_to_rgb24_row_ssse3;
+
+	return yuv_to_rgb24_row;
+}
+
+static rgb24_to_yuv_row_fn get_rgb24_to_yuv_row(void)
+{
+	unsigned int features = igt_x86_features();
+
+	if (features & AVX2)
+		return rgb24_to_yuv_row_avx2;
+	if (features & SSSE3)
+		return rgb24_to_yuv_row_ssse3;
+
+	return rgb24_to_yuv_row;
+}
+#else
+#define get_yuv_to_rgb24_row() yuv_to_rgb24_row
+#define get_rgb24_to_yuv_row() rgb24_to_yuv_row
+#endif
+
 static void convert_yuv_to_rgb24(struct fb_convert *cvt)
 {
 	const struct format_desc_struct *src_fmt =
 		lookup_drm_format(cvt->src.fb->drm_format);
-	int i, j;
-	uint8_t bpp = 4;
+	int i;
 	uint8_t *y, *u, *v;
 	uint8_t *rgb24 = cvt->dst.ptr;
 	unsigned int rgb24_stride = cvt->dst.fb->strides[0];
@@ -2522,6 +3769,7 @@ static void convert_yuv_to_rgb24(struct fb_convert *cvt)
 						    cvt->src.fb->color_range);
 	uint8_t *buf;
 	struct yuv_parameters params = { };
+	yuv_to_rgb24_row_fn row = get_yuv_to_rgb24_row();
 
 	igt_assert(cvt->dst.fb->drm_format == DRM_FORMAT_XRGB8888 &&
 		   igt_format_is_yuv(cvt->src.fb->drm_format));
@@ -2533,30 +3781,8 @@ static void convert_yuv_to_rgb24(struct fb_convert *cvt)
 	v = buf + params.v_offset;
 
 	for (i = 0; i < cvt->dst.fb->height; i++) {
-		const uint8_t *y_tmp = y;
-		const uint8_t *u_tmp = u;
-		const uint8_t *v_tmp = v;
-		uint8_t *rgb_tmp = rgb24;
-
-		for (j = 0; j < cvt->dst.fb->width; j++) {
-			struct igt_vec4 rgb, yuv;
-
-			yuv.d[0] = *y_tmp;
-			yuv.d[1] = *u_tmp;
-			yuv.d[2] = *v_tmp;
-			yuv.d[3] = 1.0f;
-
-			rgb = igt_matrix_transform(&m, &yuv);
-			write_rgb(rgb_tmp, &rgb);
-
-			rgb_tmp += bpp;
-			y_tmp += params.ay_inc;
-
-			if ((src_fmt->hsub == 1) || (j % src_fmt->hsub)) {
-				u_tmp += params.uv_inc;
-				v_tmp += params.uv_inc;
-			}
-		}
+		row(rgb24, y, u, v, &params, src_fmt->hsub,
+		    cvt->dst.fb->width, &m);
 
 		rgb24 += rgb24_stride;
 		y += params.ay_stride;
@@ -2574,16 +3800,16 @@ static void convert_rgb24_to_yuv(struct fb_convert *cvt)
 {
 	const struct format_desc_struct *dst_fmt =
 		lookup_drm_format(cvt->dst.fb->drm_format);
-	int i, j;
+	int i;
 	uint8_t *y, *u, *v;
 	const uint8_t *rgb24 = cvt->src.ptr;
-	uint8_t bpp = 4;
 	unsigned rgb24_stride = cvt->src.fb->strides[0];
 	struct igt_mat4 m = igt_rgb_to_ycbcr_matrix(cvt->src.fb->drm_format,
 						    cvt->dst.fb->drm_format,
 						    cvt->dst.fb->color_encoding,
 						    cvt->dst.fb->color_range);
 	struct yuv_parameters params = { };
+	rgb24_to_yuv_row_fn row = get_rgb24_to_yuv_row();
 
 	igt_assert(cvt->src.fb->drm_format == DRM_FORMAT_XRGB8888 &&
 		   igt_format_is_yuv(cvt->dst.fb->drm_format));
@@ -2594,57 +3820,13 @@ static void convert_rgb24_to_yuv(struct fb_convert *cvt)
 	v = (uint8_t*)cvt->dst.ptr + params.v_offset;
 
 	for (i = 0; i < cvt->dst.fb->height; i++) {
-		const uint8_t *rgb_tmp = rgb24;
-		uint8_t *y_tmp = y;
-		uint8_t *u_tmp = u;
-		uint8_t *v_tmp = v;
-
-		for (j = 0; j < cvt->dst.fb->width; j++) {
-			const uint8_t *pair_rgb24 = rgb_tmp;
-			struct igt_vec4 pair_rgb, rgb;
-			struct igt_vec4 pair_yuv, yuv;
-
-			read_rgb(&rgb, rgb_tmp);
-			yuv = igt_matrix_transform(&m, &rgb);
-
-			rgb_tmp += bpp;
-
-			*y_tmp = yuv.d[0];
-			y_tmp += params.ay_inc;
-
-			if ((i % dst_fmt->vsub) || (j % dst_fmt->hsub))
-				continue;
-
-			/*
-			 * We assume the MPEG2 chroma siting convention, where
-			 * pixel center for Cb'Cr' is between the left top and
-			 * bottom pixel in a 2x2 block, so take the average.
-			 *
-			 * Therefore, if we use subsampling, we only really care
-			 * about two pixels all the time, either the two
-			 * subsequent pixels horizontally, vertically, or the
-			 * two corners in a 2x2 block.
-			 *
-			 * The only corner case is when we have an odd number of
-			 * pixels, but this can be handled pretty easily by not
-			 * incrementing the paired pixel pointer in the
-			 * direction it's odd in.
-			 */
-			if (j != (cvt->dst.fb->width - 1))
-				pair_rgb24 += (dst_fmt->hsub - 1) * bpp;
-
-			if (i != (cvt->dst.fb->height - 1))
-				pair_rgb24 += rgb24_stride * (dst_fmt->vsub - 1);
+		unsigned int pair_stride = 0;
 
-			read_rgb(&pair_rgb, pair_rgb24);
-			pair_yuv = igt_matrix_transform(&m, &pair_rgb);
-
-			*u_tmp = (yuv.d[1] + pair_yuv.d[1]) / 2.0f;
-			*v_tmp = (yuv.d[2] + pair_yuv.d[2]) / 2.0f;
+		if (i != (cvt->dst.fb->height - 1))
+			pair_stride = rgb24_stride * (dst_fmt->vsub - 1);
 
-			u_tmp += params.uv_inc;
-			v_tmp += params.uv_inc;
-		}
+		row(y, u, v, rgb24, pair_stride, !(i % dst_fmt->vsub), &params,
+		    dst_fmt->hsub, cvt->dst.fb->width, &m);
 
 		rgb24 += rgb24_stride;
 		y += params.ay_stride;
@@ -2671,8 +3853,9 @@ static void write_rgbf(float *rgb24, const struct igt_vec4 *rgb)
 	rgb24[2] = rgb->d[2];
 }
 
-static void convert_yuv16_to_float(struct fb_convert *cvt, bool alpha)
+static void convert_yuv16_to_float(struct fb_convert *cvt)
 {
+	const bool alpha = cvt->alpha;
 	const struct format_desc_struct *src_fmt =
 		lookup_drm_format(cvt->src.fb->drm_format);
 	int i, j;
@@ -2747,8 +3930,9 @@ static void convert_yuv16_to_float(struct fb_convert *cvt, bool alpha)
 	convert_src_put(cvt, buf);
 }
 
-static void convert_float_to_yuv16(struct fb_convert *cvt, bool alpha)
+static void convert_float_to_yuv16(struct fb_convert *cvt)
 {
+	const bool alpha = cvt->alpha;
 	const struct format_desc_struct *dst_fmt =
 		lookup_drm_format(cvt->dst.fb->drm_format);
 	int i, j;
@@ -2846,8 +4030,9 @@ static void convert_float_to_yuv16(struct fb_convert *cvt, bool alpha)
 	}
 }
 
-static void convert_Y410_to_float(struct fb_convert *cvt, bool alpha)
+static void convert_Y410_to_float(struct fb_convert *cvt)
 {
+	const bool alpha = cvt->alpha;
 	int i, j;
 	const uint32_t *uyv;
 	uint32_t *buf;
@@ -2891,8 +4076,9 @@ static void convert_Y410_to_float(struct fb_convert *cvt, bool alpha)
 	convert_src_put(cvt, buf);
 }
 
-static void convert_float_to_Y410(struct fb_convert *cvt, bool alpha)
+static void convert_float_to_Y410(struct fb_convert *cvt)
 {
+	const bool alpha = cvt->alpha;
 	int i, j;
 	uint32_t *uyv = cvt->dst.ptr;
 	const float *ptr = cvt->src.ptr;
@@ -3070,12 +4256,11 @@ static void convert_pixman(struct fb_convert *cvt)
 	convert_src_put(cvt, src_ptr);
 }
 
-static void fb_convert(struct fb_convert *cvt)
+static fb_convert_fn fb_convert_lookup(struct fb_convert *cvt)
 {
 	if ((drm_format_to_pixman(cvt->src.fb->drm_format) != PIXMAN_invalid) &&
 	    (drm_format_to_pixman(cvt->dst.fb->drm_format) != PIXMAN_invalid)) {
-		convert_pixman(cvt);
-		return;
+		return convert_pixman;
 	} else if (cvt->dst.fb->drm_format == DRM_FORMAT_XRGB8888) {
 		switch (cvt->src.fb->drm_format) {
 		case DRM_FORMAT_XYUV8888:
@@ -3091,8 +4276,7 @@ static void fb_convert(struct fb_convert *cvt)
 		case DRM_FORMAT_YVU420:
 		case DRM_FORMAT_YVU422:
 		case DRM_FORMAT_YVYU:
-			convert_yuv_to_rgb24(cvt);
-			return;
+			return convert_yuv_to_rgb24;
 		}
 	} else if (cvt->src.fb->drm_format == DRM_FORMAT_XRGB8888) {
 		switch (cvt->dst.fb->drm_format) {
@@ -3109,8 +4293,7 @@ static void fb_convert(struct fb_convert *cvt)
 		case DRM_FORMAT_YVU420:
 		case DRM_FORMAT_YVU422:
 		case DRM_FORMAT_YVYU:
-			convert_rgb24_to_yuv(cvt);
-			return;
+			return convert_rgb24_to_yuv;
 		}
 	} else if (cvt->dst.fb->drm_format == IGT_FORMAT_FLOAT) {
 		switch (cvt->src.fb->drm_format) {
@@ -3122,24 +4305,23 @@ static void fb_convert(struct fb_convert *cvt)
 		case DRM_FORMAT_Y216:
 		case DRM_FORMAT_XVYU12_16161616:
 		case DRM_FORMAT_XVYU16161616:
-			convert_yuv16_to_float(cvt, false);
-			return;
+			cvt->alpha = false;
+			return convert_yuv16_to_float;
 		case DRM_FORMAT_Y410:
-			convert_Y410_to_float(cvt, true);
-			return;
+			cvt->alpha = true;
+			return convert_Y410_to_float;
 		case DRM_FORMAT_XVYU2101010:
-			convert_Y410_to_float(cvt, false);
-			return;
+			cvt->alpha = false;
+			return convert_Y410_to_float;
 		case DRM_FORMAT_Y412:
 		case DRM_FORMAT_Y416:
-			convert_yuv16_to_float(cvt, true);
-			return;
+			cvt->alpha = true;
+			return convert_yuv16_to_float;
 		case DRM_FORMAT_XRGB16161616F:
 		case DRM_FORMAT_XBGR16161616F:
 		case DRM_FORMAT_ARGB16161616F:
 		case DRM_FORMAT_ABGR16161616F:
-			convert_fp16_to_float(cvt);
-			return;
+			return convert_fp16_to_float;
 		}
 	} else if (cvt->src.fb->drm_format == IGT_FORMAT_FLOAT) {
 		switch (cvt->dst.fb->drm_format) {
@@ -3151,30 +4333,148 @@ static void fb_convert(struct fb_convert *cvt)
 		case DRM_FORMAT_Y216:
 		case DRM_FORMAT_XVYU12_16161616:
 		case DRM_FORMAT_XVYU16161616:
-			convert_float_to_yuv16(cvt, false);
-			return;
+			cvt->alpha = false;
+			return convert_float_to_yuv16;
 		case DRM_FORMAT_Y410:
-			convert_float_to_Y410(cvt, true);
-			return;
+			cvt->alpha = true;
+			return convert_float_to_Y410;
 		case DRM_FORMAT_XVYU2101010:
-			convert_float_to_Y410(cvt, false);
-			return;
+			cvt->alpha = false;
+			return convert_float_to_Y410;
 		case DRM_FORMAT_Y412:
 		case DRM_FORMAT_Y416:
-			convert_float_to_yuv16(cvt, true);
-			return;
+			cvt->alpha = true;
+			return convert_float_to_yuv16;
 		case DRM_FORMAT_XRGB16161616F:
 		case DRM_FORMAT_XBGR16161616F:
 		case DRM_FORMAT_ARGB16161616F:
 		case DRM_FORMAT_ABGR16161616F:
-			convert_float_to_fp16(cvt);
-			return;
+			return convert_float_to_fp16;
 		}
 	}
 
 	igt_assert_f(false,
 		     "Conversion not implemented (from format 0x%x to 0x%x)\n",
 		     cvt->src.fb->drm_format, cvt->dst.fb->drm_format);
+	return NULL;
+}
+
+struct fb_convert_job {
+	struct fb_convert cvt;
+	fb_convert_fn fn;
+	unsigned int y;
+};
+
+static void *fb_convert_view(struct igt_fb *view, const struct igt_fb *fb,
+			     void *ptr, unsigned int y, unsigned int height)
+{
+	const struct format_desc_struct *f = lookup_drm_format(fb->drm_format);
+
+	/*
+	 * Describe rows [y, y + height) as a framebuffer of its own. The
+	 * converters address the first plane relative to the pointer but not
+	 * always through the offsets, so move the pointer and compensate in
+	 * the offsets of the other planes, which all come after the first.
+	 */
+	*view = *fb;
+	view->height = height;
+	for (int i = 1; i < fb->num_planes; i++)
+		view->offsets[i] += y / f->vsub * fb->strides[i] -
+			y * fb->strides[0];
+
+	return (uint8_t *)ptr + y * fb->strides[0];
+}
+
+static void fb_convert_stripe(void *data, unsigned int start, unsigned int end)
+{
+	const struct fb_convert_job *job = data;
+	struct fb_convert cvt = job->cvt;
+	struct igt_fb src, dst;
+
+	start += job->y;
+	end += job->y;
+
+	cvt.src.ptr = fb_convert_view(&src, job->cvt.src.fb, job->cvt.src.ptr,
+				      start, end - start);
+	cvt.src.fb = &src;
+	cvt.dst.ptr = fb_convert_view(&dst, job->cvt.dst.fb, job->cvt.dst.ptr,
+				      start, end - start);
+	cvt.dst.fb = &dst;
+
+	job->fn(&cvt);
+}
+
+static unsigned int fb_convert_align(const struct fb_convert *cvt)
+{
+	const struct format_desc_struct *src_fmt =
+		lookup_drm_format(cvt->src.fb->drm_format);
+	const struct format_desc_struct *dst_fmt =
+		lookup_drm_format(cvt->dst.fb->drm_format);
+
+	return max(src_fmt->vsub, dst_fmt->vsub);
+}
+
+/* Converts rows [y, y + height), y must be aligned to fb_convert_align() */
+static void fb_convert_rows(struct fb_convert *cvt,
+			    unsigned int y, unsigned int height)
+{
+	struct fb_convert_job job = { .cvt = *cvt, .y = y };
+	void *src;
+
+	job.fn = fb_convert_lookup(&job.cvt);
+
+	/* Pull the whole source out of wc memory before splitting it up */
+	src = convert_src_get(cvt);
+	job.cvt.src.ptr = src;
+	job.cvt.src.slow_reads = false;
+
+	/* Keep subsampled chroma rows within a stripe */
+	igt_parallel_stripes(height, fb_convert_align(cvt),
+			     fb_convert_stripe, &job);
+
+	convert_src_put(cvt, src);
+}
+
+static void fb_convert(struct fb_convert *cvt)
+{
+	fb_convert_rows(cvt, 0, cvt->dst.fb->height);
+}
+
+#define MAX_DAMAGE_CLIPS 16
+
+/*
+ * Compares the shadow against its contents when it was read back and
+ * returns the bands of rows that were drawn to, aligned to @align rows.
+ * Nearby bands are merged once there are too many to track.
+ */
+static int shadow_damage(const struct fb_convert_blit_upload *blit,
+			 unsigned int align, drmModeClip *clips)
+{
+	const struct igt_fb *shadow = &blit->shadow_fb;
+	int n = 0;
+
+	if (!blit->snapshot) {
+		clips[0] = (drmModeClip){ 0, 0, shadow->width, shadow->height };
+		return 1;
+	}
+
+	for (unsigned int y = 0; y < shadow->height; y += align) {
+		unsigned int end = min(y + align, shadow->height);
+		size_t offset = (size_t)y * shadow->strides[0];
+
+		if (!memcmp(blit->shadow_ptr + offset, blit->snapshot + offset,
+			    (size_t)(end - y) * shadow->strides[0]))
+			continue;
+
+		if (n && (clips[n - 1].y2 == y || n == MAX_DAMAGE_CLIPS)) {
+			clips[n - 1].y2 = end;
+			continue;
+		}
+
+		clips[n++] = (drmModeClip){ 0, y, shadow->width, end };
+	}
+
+	return n;
 }
 
 static void destroy_cairo_surface__convert(void *arg)
@@ -3193,19 +4493,37 @@ static void destroy_cairo_surface__convert(void *arg)
 		},
 	};
 
-	fb_convert(&cvt);
+	drmModeClip damage[MAX_DAMAGE_CLIPS];
+	int num_damage;
+
+	/* Only convert and upload the rows that were drawn to */
+	num_damage = shadow_damage(blit, fb_convert_align(&cvt), damage);
+	for (int i = 0; i < num_damage; i++)
+		fb_convert_rows(&cvt, damage[i].y1,
+				damage[i].y2 - damage[i].y1);
+
 	igt_fb_destroy_cairo_shadow_buffer(&blit->shadow_fb, blit->shadow_ptr);
+	free(blit->snapshot);
 
-	if (blit->base.linear.fb.gem_handle)
+	if (blit->base.linear.fb.gem_handle) {
+		blit->base.damage = damage;
+		blit->base.num_damage = num_damage;
 		free_linear_mapping(&blit->base);
-	else
-		unmap_bo(fb, blit->base.linear.map);
+	} else {
+		__unmap_bo(fb, blit->base.linear.map, damage, num_damage);
+	}
 
 	free(blit);
 
 	fb->cairo_surface = NULL;
 }
 
+/*
+ * Formats cairo can't draw are drawn into an rgb shadow buffer which is
+ * converted on the cpu when the surface is destroyed, the gpu only does the
+ * detiling. There are no shader kernels for the conversion itself, it is
+ * kept cheap with the vectorised row converters and the worker pool.
+ */
 static void create_cairo_surface__convert(int fd, struct igt_fb *fb)
 {
 	struct fb_convert_blit_upload *blit = calloc(1, sizeof(*blit));
@@ -3256,7 +4574,7 @@ static void create_cairo_surface__convert(int fd, struct igt_fb *fb)
 		igt_assert(blit->base.linear.map);
 
 		/* reading via gtt mmap is slow */
-		cvt.src.slow_reads = is_i915_device(fd);
+		cvt.src.slow_reads = is_i915_device(fd) && !use_cpu_mmap(fb);
 	}
 
 	cvt.dst.ptr = blit->shadow_ptr;
@@ -3265,6 +4583,10 @@ static void create_cairo_surface__convert(int fd, struct igt_fb *fb)
 	cvt.src.fb = &blit->base.linear.fb;
 	fb_convert(&cvt);
 
+	blit->snapshot = malloc(blit->shadow_fb.size);
+	if (blit->snapshot)
+		memcpy(blit->snapshot, blit->shadow_ptr, blit->shadow_fb.size);
+
 	fb->cairo_surface =
 		cairo_image_surface_create_for_data(blit->shadow_ptr,
 						    cairo_id,
@@ -3424,7 +4746,7 @@ void igt_remove_fb(int fd, struct igt_fb *fb)
 	do_or_die(drmModeRmFB(fd, fb->fb_id));
 	if (fb->is_dumb)
 		kmstest_dumb_destroy(fd, fb->gem_handle);
-	else
+	else if (!fb_pool_put(fd, fb))
 		gem_close(fd, fb->gem_handle);
 	fb->fb_id = 0;
 }
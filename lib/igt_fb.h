@@ -99,6 +99,31 @@ typedef struct igt_fb {
 	unsigned int plane_height[4];
 } igt_fb_t;
 
+#define IGT_FB_FILL_COLOR	(1 << 0)
+#define IGT_FB_FILL_PATTERN	(1 << 1)
+
+/**
+ * igt_fb_params:
+ * @width: width in pixels
+ * @height: height in pixels
+ * @format: DRM FOURCC code
+ * @modifier: tiling mode as a DRM framebuffer modifier
+ * @fill: mask of IGT_FB_FILL_COLOR and IGT_FB_FILL_PATTERN, in that order
+ * @r: red value of the fill color
+ * @g: green value of the fill color
+ * @b: blue value of the fill color
+ *
+ * Description of a framebuffer for igt_create_fbs().
+ */
+struct igt_fb_params {
+	int width;
+	int height;
+	uint32_t format;
+	uint64_t modifier;
+	unsigned int fill;
+	double r, g, b;
+};
+
 /**
  * igt_text_align:
  * @align_left: align left
@@ -159,7 +184,13 @@ unsigned int igt_fb_convert_with_stride(struct igt_fb *dst, struct igt_fb *src,
 					unsigned int stride);
 unsigned int igt_fb_convert(struct igt_fb *dst, struct igt_fb *src,
 			    uint32_t dst_fourcc, uint64_t dst_modifier);
+void igt_create_fbs(int fd, const struct igt_fb_params *params, int count,
+		    struct igt_fb *fbs);
 void igt_remove_fb(int fd, struct igt_fb *fb);
+void igt_fb_cache_enable(uint64_t max_size);
+void igt_fb_cache_disable(void);
+void igt_fb_pool_enable(uint64_t max_size);
+void igt_fb_pool_disable(void);
 int igt_dirty_fb(int fd, struct igt_fb *fb);
 void *igt_fb_map_buffer(int fd, struct igt_fb *fb);
 void igt_fb_unmap_buffer(struct igt_fb *fb, void *buffer);
@@ -0,0 +1,189 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "igt_bench.h"
+#include "igt_core.h"
+#include "igt_flip_timing.h"
+
+/**
+ * SECTION:igt_flip_timing
+ * @short_description: Flip latency and jitter statistics
+ * @title: Flip timing
+ * @include: igt_flip_timing.h
+ *
+ * Collects how long flips take from submission until their completion
+ * event, how evenly spaced the completions are and how many frames were
+ * missed along the way, for tests that flip on every vblank.
+ *
+ * |[
+ *	igt_flip_timing_t t;
+ *
+ *	igt_flip_timing_init(&t, igt_output_get_mode(output));
+ *	for (i = 0; i < 100; i++) {
+ *		igt_flip_timing_submit(&t);
+ *		igt_display_commit_atomic(display, DRM_MODE_PAGE_FLIP_EVENT |
+ *					  DRM_MODE_ATOMIC_NONBLOCK, NULL);
+ *		igt_assert_eq(read(display->drm_fd, &ev, sizeof(ev)), sizeof(ev));
+ *		igt_flip_timing_event(&t, ev.sequence, ev.tv_sec, ev.tv_usec);
+ *	}
+ *	igt_flip_timing_report(&t, "flip");
+ *	igt_flip_timing_fini(&t);
+ * ]|
+ *
+ * The statistics are reported with igt_info(), and through igt_bench when
+ * the test writes benchmark results.
+ */
+
+/**
+ * igt_flip_timing_init:
+ * @t: flip timing statistics
+ * @mode: mode of the pipe being flipped, or NULL
+ *
+ * Initializes @t. The frame duration is derived from @mode, if given.
+ */
+void igt_flip_timing_init(igt_flip_timing_t *t, const drmModeModeInfo *mode)
+{
+	memset(t, 0, sizeof(*t));
+
+	if (mode && mode->clock)
+		t->frame_ns = (uint64_t)mode->htotal * mode->vtotal *
+			      1000000 / mode->clock;
+
+	igt_stats_init(&t->latency);
+	igt_stats_init(&t->interval);
+}
+
+/**
+ * igt_flip_timing_fini:
+ * @t: flip timing statistics
+ *
+ * Frees the resources of @t.
+ */
+void igt_flip_timing_fini(igt_flip_timing_t *t)
+{
+	igt_stats_fini(&t->latency);
+	igt_stats_fini(&t->interval);
+}
+
+/**
+ * igt_flip_timing_submit:
+ * @t: flip timing statistics
+ *
+ * Records the submission time of the next flip. Call this right before
+ * committing the flip.
+ */
+void igt_flip_timing_submit(igt_flip_timing_t *t)
+{
+	clock_gettime(CLOCK_MONOTONIC, &t->submit);
+	t->pending = true;
+}
+
+/**
+ * igt_flip_timing_event:
+ * @t: flip timing statistics
+ * @sequence: vblank sequence of the flip event
+ * @tv_sec: seconds of the flip event timestamp
+ * @tv_usec: microseconds of the flip event timestamp
+ *
+ * Records a flip completion event, as passed to the page_flip_handler of
+ * drmHandleEvent() or found in a struct drm_event_vblank. The event
+ * completes the flip last submitted with igt_flip_timing_submit().
+ */
+void igt_flip_timing_event(igt_flip_timing_t *t, unsigned int sequence,
+			   unsigned int tv_sec, unsigned int tv_usec)
+{
+	uint64_t ns = tv_sec * 1000000000ull + tv_usec * 1000ull;
+
+	if (t->pending) {
+		uint64_t submit = t->submit.tv_sec * 1000000000ull +
+				  t->submit.tv_nsec;
+
+		/* the event timestamp is the start of scanout, it can come first */
+		igt_stats_push(&t->latency, ns > submit ? ns - submit : 0);
+		t->pending = false;
+	}
+
+	if (t->has_last) {
+		if (sequence - t->last_seq == 1)
+			igt_stats_push(&t->interval, ns - t->last_ns);
+		else if (sequence - t->last_seq > 1)
+			t->missed += sequence - t->last_seq - 1;
+	}
+
+	t->last_seq = sequence;
+	t->last_ns = ns;
+	t->has_last = true;
+	t->flips++;
+}
+
+/**
+ * igt_flip_timing_jitter:
+ * @t: flip timing statistics
+ *
+ * Returns: the standard deviation of the time between flip events on
+ * consecutive vblanks, in ns.
+ */
+double igt_flip_timing_jitter(igt_flip_timing_t *t)
+{
+	if (t->interval.n_values < 2)
+		return 0;
+
+	return igt_stats_get_std_deviation(&t->interval);
+}
+
+/**
+ * igt_flip_timing_report:
+ * @t: flip timing statistics
+ * @name: name of the measurement
+ *
+ * Prints a summary of @t and adds the latency and interval samples to the
+ * igt_bench results, as @name-latency and @name-interval.
+ */
+void igt_flip_timing_report(igt_flip_timing_t *t, const char *name)
+{
+	char buf[128];
+
+	if (t->latency.n_values)
+		igt_info("%s: %u flips, latency median %.3fms, p99 %.3fms, max %.3fms\n",
+			 name, t->flips,
+			 igt_stats_get_median(&t->latency) / 1e6,
+			 igt_stats_get_percentile(&t->latency, 99) / 1e6,
+			 igt_stats_get_max(&t->latency) / 1e6);
+
+	if (t->interval.n_values)
+		igt_info("%s: frame %.3fms (nominal %.3fms), jitter %.3fms, %u missed frames\n",
+			 name, igt_stats_get_median(&t->interval) / 1e6,
+			 t->frame_ns / 1e6, igt_flip_timing_jitter(t) / 1e6,
+			 t->missed);
+
+	snprintf(buf, sizeof(buf), "%s-latency", name);
+	igt_bench_result(buf, "ns", &t->latency);
+	snprintf(buf, sizeof(buf), "%s-interval", name);
+	igt_bench_result(buf, "ns", &t->interval);
+	snprintf(buf, sizeof(buf), "%s-missed", name);
+	igt_bench_value(buf, "frames", t->missed);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __IGT_FLIP_TIMING_H__
+#define __IGT_FLIP_TIMING_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <xf86drmMode.h>
+
+#include "igt_stats.h"
+
+/**
+ * igt_flip_timing_t:
+ * @frame_ns: nominal duration of a frame, 0 if unknown
+ * @latency: time from each submission to its flip event, in ns
+ * @interval: time between flip events on consecutive vblanks, in ns
+ * @flips: number of flip events recorded
+ * @missed: number of vblanks without a flip between consecutive flips
+ *
+ * Flip timing statistics of a single pipe, see igt_flip_timing_init().
+ */
+typedef struct {
+	uint64_t frame_ns;
+	igt_stats_t latency;
+	igt_stats_t interval;
+	unsigned int flips;
+	unsigned int missed;
+
+	/*< private >*/
+	struct timespec submit;
+	bool pending;
+	bool has_last;
+	unsigned int last_seq;
+	uint64_t last_ns;
+} igt_flip_timing_t;
+
+void igt_flip_timing_init(igt_flip_timing_t *t, const drmModeModeInfo *mode);
+void igt_flip_timing_fini(igt_flip_timing_t *t);
+void igt_flip_timing_submit(igt_flip_timing_t *t);
+void igt_flip_timing_event(igt_flip_timing_t *t, unsigned int sequence,
+			   unsigned int tv_sec, unsigned int tv_usec);
+double igt_flip_timing_jitter(igt_flip_timing_t *t);
+void igt_flip_timing_report(igt_flip_timing_t *t, const char *name);
+
+#endif /* __IGT_FLIP_TIMING_H__ */
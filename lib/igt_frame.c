@@ -27,11 +27,16 @@
 #include "config.h"
 
 #include <fcntl.h>
-#include <pixman.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <cairo.h>
 #include <gsl/gsl_statistics_double.h>
 #include <gsl/gsl_fit.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "igt_frame.h"
 #include "igt_core.h"
 
@@ -57,17 +62,42 @@ bool igt_frame_dump_is_enabled(void)
 	return igt_frame_dump_path != NULL;
 }
 
-static void igt_write_frame_to_png(cairo_surface_t *surface, int fd,
-				   const char *qualifier, const char *suffix)
+/* Most dumps queued and not written yet before igt_write_compared_frames_to_png() blocks. */
+#define FRAME_DUMP_QUEUE_DEPTH 16
+
+struct frame_dump {
+	struct frame_dump *next;
+
+	char report_path[PATH_MAX];
+	char reference_path[PATH_MAX];
+	char capture_path[PATH_MAX];
+
+	cairo_surface_t *reference;
+	cairo_surface_t *capture;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t queued;
+	pthread_cond_t written;
+	pthread_t thread;
+	pid_t pid;
+	bool stopping;
+
+	struct frame_dump *head;
+	struct frame_dump **tail;
+	unsigned int pending;
+} frame_dump_queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.queued = PTHREAD_COND_INITIALIZER,
+	.written = PTHREAD_COND_INITIALIZER,
+};
+
+static void frame_dump_png_path(char *path, const char *qualifier,
+				const char *suffix)
 {
-	char path[PATH_MAX];
-	const char *test_name;
-	const char *subtest_name;
-	cairo_status_t status;
-	int index;
-
-	test_name = igt_test_name();
-	subtest_name = igt_subtest_name();
+	const char *test_name = igt_test_name();
+	const char *subtest_name = igt_subtest_name();
 
 	if (suffix)
 		snprintf(path, PATH_MAX, "%s/frame-%s-%s-%s-%s.png",
@@ -76,21 +106,180 @@ static void igt_write_frame_to_png(cairo_surface_t *surface, int fd,
 	else
 		snprintf(path, PATH_MAX, "%s/frame-%s-%s-%s.png",
 			 igt_frame_dump_path, test_name, subtest_name, qualifier);
+}
+
+static bool igt_write_frame_to_png(cairo_surface_t *surface, int fd,
+				   const char *qualifier, const char *path)
+{
+	cairo_status_t status;
+	int index;
 
 	igt_debug("Dumping %s frame to %s...\n", qualifier, path);
 
 	status = cairo_surface_write_to_png(surface, path);
-
-	igt_assert_eq(status, CAIRO_STATUS_SUCCESS);
+	if (status != CAIRO_STATUS_SUCCESS) {
+		igt_warn("Failed to dump %s frame to %s: %s\n", qualifier,
+			 path, cairo_status_to_string(status));
+		return false;
+	}
 
 	index = strlen(path);
 
 	if (fd >= 0 && index < (PATH_MAX - 1)) {
-		path[index++] = '\n';
-		path[index] = '\0';
+		write(fd, path, index);
+		write(fd, "\n", 1);
+	}
+
+	return true;
+}
 
-		write(fd, path, strlen(path));
+static void frame_dump_write(struct frame_dump *dump)
+{
+	int fd;
+
+	fd = open(dump->report_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		igt_warn("Failed to create dump report %s: %m\n",
+			 dump->report_path);
+		return;
 	}
+
+	igt_debug("Writing dump report to %s...\n", dump->report_path);
+
+	if (igt_write_frame_to_png(dump->reference, fd, "reference",
+				   dump->reference_path))
+		igt_write_frame_to_png(dump->capture, fd, "capture",
+				       dump->capture_path);
+
+	close(fd);
+}
+
+static void frame_dump_free(struct frame_dump *dump)
+{
+	cairo_surface_destroy(dump->reference);
+	cairo_surface_destroy(dump->capture);
+	free(dump);
+}
+
+static void *frame_dump_worker(void *data)
+{
+	struct frame_dump *dump;
+
+	pthread_mutex_lock(&frame_dump_queue.lock);
+
+	for (;;) {
+		while (!frame_dump_queue.head && !frame_dump_queue.stopping)
+			pthread_cond_wait(&frame_dump_queue.queued,
+					  &frame_dump_queue.lock);
+
+		dump = frame_dump_queue.head;
+		if (!dump)
+			break;
+
+		frame_dump_queue.head = dump->next;
+		if (!frame_dump_queue.head)
+			frame_dump_queue.tail = &frame_dump_queue.head;
+
+		pthread_mutex_unlock(&frame_dump_queue.lock);
+
+		frame_dump_write(dump);
+		frame_dump_free(dump);
+
+		pthread_mutex_lock(&frame_dump_queue.lock);
+		frame_dump_queue.pending--;
+		pthread_cond_broadcast(&frame_dump_queue.written);
+	}
+
+	pthread_mutex_unlock(&frame_dump_queue.lock);
+
+	return NULL;
+}
+
+static void frame_dump_exit_handler(int sig)
+{
+	/* Joining the worker is not safe from a signal handler. */
+	if (sig || frame_dump_queue.pid != getpid())
+		return;
+
+	igt_frame_dump_flush();
+
+	pthread_mutex_lock(&frame_dump_queue.lock);
+	frame_dump_queue.stopping = true;
+	pthread_cond_signal(&frame_dump_queue.queued);
+	pthread_mutex_unlock(&frame_dump_queue.lock);
+
+	pthread_join(frame_dump_queue.thread, NULL);
+	frame_dump_queue.pid = 0;
+	frame_dump_queue.stopping = false;
+}
+
+/* Returns false when the dump has to be written from the calling thread. */
+static bool frame_dump_queue_push(struct frame_dump *dump)
+{
+	/*
+	 * The worker thread is not carried over to forked children, which
+	 * write their dumps directly instead.
+	 */
+	if (frame_dump_queue.pid && frame_dump_queue.pid != getpid())
+		return false;
+
+	if (!frame_dump_queue.pid) {
+		frame_dump_queue.head = NULL;
+		frame_dump_queue.tail = &frame_dump_queue.head;
+		frame_dump_queue.pending = 0;
+
+		if (pthread_create(&frame_dump_queue.thread, NULL,
+				   frame_dump_worker, NULL))
+			return false;
+
+		frame_dump_queue.pid = getpid();
+		igt_install_exit_handler(frame_dump_exit_handler);
+	}
+
+	pthread_mutex_lock(&frame_dump_queue.lock);
+
+	while (frame_dump_queue.pending >= FRAME_DUMP_QUEUE_DEPTH)
+		pthread_cond_wait(&frame_dump_queue.written,
+				  &frame_dump_queue.lock);
+
+	*frame_dump_queue.tail = dump;
+	frame_dump_queue.tail = &dump->next;
+	frame_dump_queue.pending++;
+	pthread_cond_signal(&frame_dump_queue.queued);
+
+	pthread_mutex_unlock(&frame_dump_queue.lock);
+
+	return true;
+}
+
+static cairo_surface_t *frame_dump_copy_surface(cairo_surface_t *surface)
+{
+	cairo_surface_t *copy;
+	unsigned char *src, *dst;
+	int width, height, src_stride, dst_stride, y;
+
+	cairo_surface_flush(surface);
+
+	width = cairo_image_surface_get_width(surface);
+	height = cairo_image_surface_get_height(surface);
+	src = cairo_image_surface_get_data(surface);
+	src_stride = cairo_image_surface_get_stride(surface);
+	igt_assert(src);
+
+	copy = cairo_image_surface_create(cairo_image_surface_get_format(surface),
+					  width, height);
+	igt_assert(cairo_surface_status(copy) == CAIRO_STATUS_SUCCESS);
+
+	dst = cairo_image_surface_get_data(copy);
+	dst_stride = cairo_image_surface_get_stride(copy);
+
+	for (y = 0; y < height; y++)
+		memcpy(dst + y * dst_stride, src + y * src_stride,
+		       src_stride < dst_stride ? src_stride : dst_stride);
+
+	cairo_surface_mark_dirty(copy);
+
+	return copy;
 }
 
 /**
@@ -101,42 +290,67 @@ static void igt_write_frame_to_png(cairo_surface_t *surface, int fd,
  * @capture_suffix: The suffix to give to the capture png file
  *
  * Write previously compared frames to png files.
+ *
+ * The frames are copied and queued, then encoded on a background thread so
+ * that dumping a failure does not change the timing of the test. Queued
+ * dumps are written out at the latest when the test exits, or earlier with
+ * igt_frame_dump_flush().
  */
 void igt_write_compared_frames_to_png(cairo_surface_t *reference,
 				      cairo_surface_t *capture,
 				      const char *reference_suffix,
 				      const char *capture_suffix)
 {
+	struct frame_dump *dump;
 	char *id;
-	const char *test_name;
-	const char *subtest_name;
-	char path[PATH_MAX];
-	int fd = -1;
 
 	if (!igt_frame_dump_is_enabled())
 		return;
 
-	id = getenv("IGT_FRAME_DUMP_ID");
+	dump = calloc(1, sizeof(*dump));
+	igt_assert(dump);
 
-	test_name = igt_test_name();
-	subtest_name = igt_subtest_name();
+	/* The test and subtest names are only valid at this point. */
+	id = getenv("IGT_FRAME_DUMP_ID");
 
 	if (id)
-		snprintf(path, PATH_MAX, "%s/frame-%s-%s-%s.txt",
-			 igt_frame_dump_path, test_name, subtest_name, id);
+		snprintf(dump->report_path, PATH_MAX, "%s/frame-%s-%s-%s.txt",
+			 igt_frame_dump_path, igt_test_name(),
+			 igt_subtest_name(), id);
 	else
-		snprintf(path, PATH_MAX, "%s/frame-%s-%s.txt",
-			 igt_frame_dump_path, test_name, subtest_name);
+		snprintf(dump->report_path, PATH_MAX, "%s/frame-%s-%s.txt",
+			 igt_frame_dump_path, igt_test_name(),
+			 igt_subtest_name());
 
-	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	igt_assert(fd >= 0);
+	frame_dump_png_path(dump->reference_path, "reference",
+			    reference_suffix);
+	frame_dump_png_path(dump->capture_path, "capture", capture_suffix);
 
-	igt_debug("Writing dump report to %s...\n", path);
+	dump->reference = frame_dump_copy_surface(reference);
+	dump->capture = frame_dump_copy_surface(capture);
 
-	igt_write_frame_to_png(reference, fd, "reference", reference_suffix);
-	igt_write_frame_to_png(capture, fd, "capture", capture_suffix);
+	if (!frame_dump_queue_push(dump)) {
+		frame_dump_write(dump);
+		frame_dump_free(dump);
+	}
+}
 
-	close(fd);
+/**
+ * igt_frame_dump_flush:
+ *
+ * Wait for all the frame dumps queued by igt_write_compared_frames_to_png()
+ * to be written.
+ */
+void igt_frame_dump_flush(void)
+{
+	if (frame_dump_queue.pid != getpid())
+		return;
+
+	pthread_mutex_lock(&frame_dump_queue.lock);
+	while (frame_dump_queue.pending)
+		pthread_cond_wait(&frame_dump_queue.written,
+				  &frame_dump_queue.lock);
+	pthread_mutex_unlock(&frame_dump_queue.lock);
 }
 
 /**
@@ -169,8 +383,8 @@ void igt_write_compared_frames_to_png(cairo_surface_t *reference,
 bool igt_check_analog_frame_match(cairo_surface_t *reference,
 				  cairo_surface_t *capture)
 {
-	pixman_image_t *reference_src, *capture_src;
 	int w, h;
+	int reference_stride, capture_stride;
 	int error_count[3][256][2] = { 0 };
 	double error_average[4][250];
 	double error_trend[250];
@@ -187,24 +401,23 @@ bool igt_check_analog_frame_match(cairo_surface_t *reference,
 	w = cairo_image_surface_get_width(reference);
 	h = cairo_image_surface_get_height(reference);
 
-	reference_src = pixman_image_create_bits(
-	    PIXMAN_x8r8g8b8, w, h,
-	    (void*)cairo_image_surface_get_data(reference),
-	    cairo_image_surface_get_stride(reference));
-	reference_pixels = (unsigned char *) pixman_image_get_data(reference_src);
+	reference_pixels = cairo_image_surface_get_data(reference);
+	reference_stride = cairo_image_surface_get_stride(reference);
+	igt_assert(reference_pixels);
 
-	capture_src = pixman_image_create_bits(
-	    PIXMAN_x8r8g8b8, w, h,
-	    (void*)cairo_image_surface_get_data(capture),
-	    cairo_image_surface_get_stride(capture));
-	capture_pixels = (unsigned char *) pixman_image_get_data(capture_src);
+	capture_pixels = cairo_image_surface_get_data(capture);
+	capture_stride = cairo_image_surface_get_stride(capture);
+	igt_assert(capture_pixels);
 
-	/* Collect the absolute error for each color value */
-	for (x = 0; x < w; x++) {
-		for (y = 0; y < h; y++) {
-			p = &capture_pixels[(x + y * w) * 4];
-			q = &reference_pixels[(x + y * w) * 4];
+	/*
+	 * Collect the absolute error for each color value, walking the frames
+	 * in memory order.
+	 */
+	for (y = 0; y < h; y++) {
+		p = capture_pixels + y * capture_stride;
+		q = reference_pixels + y * reference_stride;
 
+		for (x = 0; x < w; x++, p += 4, q += 4) {
 			for (i = 0; i < 3; i++) {
 				diff = (int) p[i] - q[i];
 				if (diff < 0)
@@ -262,14 +475,119 @@ bool igt_check_analog_frame_match(cairo_surface_t *reference,
 	}
 
 complete:
-	pixman_image_unref(reference_src);
-	pixman_image_unref(capture_src);
-
 	return match;
 }
 
-#define XR24_COLOR_VALUE(data, stride, x, y, c) \
-	*((uint8_t *)(data) + (y) * (stride) + 4 * (x) + (c))
+static inline unsigned int xr24_diff(const uint8_t *a, const uint8_t *b)
+{
+	return abs(a[0] - b[0]) + abs(a[1] - b[1]) + abs(a[2] - b[2]);
+}
+
+static inline bool xr24_error(const uint8_t *a, const uint8_t *b,
+			      unsigned int threshold)
+{
+	return abs(a[0] - b[0]) > threshold ||
+	       abs(a[1] - b[1]) > threshold ||
+	       abs(a[2] - b[2]) > threshold;
+}
+
+#if defined(__SSE2__)
+#define XR24_SIMD_PIXELS 4
+
+static inline __m128i xr24_absdiff(__m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+
+/* Sums the per-component differences of four pixels, ignoring alpha. */
+static inline __m128i xr24_diff_sum(__m128i a, __m128i b)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	__m128i d = xr24_absdiff(a, b);
+
+	return _mm_add_epi32(_mm_add_epi32(_mm_and_si128(d, mask),
+					   _mm_and_si128(_mm_srli_epi32(d, 8), mask)),
+			     _mm_and_si128(_mm_srli_epi32(d, 16), mask));
+}
+
+static inline void xr24_store_mask(unsigned char *out, int mask)
+{
+	out[0] = mask & 1;
+	out[1] = (mask >> 1) & 1;
+	out[2] = (mask >> 2) & 1;
+	out[3] = (mask >> 3) & 1;
+}
+#endif
+
+/*
+ * Marks the edges on a reference row, for x in [span, width - span - 1].
+ * The rows at y - span and y + span must be valid.
+ */
+static void checkerboard_edges_row(const uint8_t *row, unsigned int stride,
+				   unsigned int width, unsigned int span,
+				   unsigned int threshold, unsigned char *edges)
+{
+	const uint8_t *up = row - span * stride;
+	const uint8_t *down = row + span * stride;
+	unsigned int x = span;
+
+#if defined(__SSE2__)
+	const __m128i limit = _mm_set1_epi32(threshold);
+
+	for (; x + XR24_SIMD_PIXELS + span <= width; x += XR24_SIMD_PIXELS) {
+		__m128i left, right, top, bottom, xdiff, ydiff;
+
+		left = _mm_loadu_si128((const __m128i *)(row + 4 * (x - span)));
+		right = _mm_loadu_si128((const __m128i *)(row + 4 * (x + span)));
+		top = _mm_loadu_si128((const __m128i *)(up + 4 * x));
+		bottom = _mm_loadu_si128((const __m128i *)(down + 4 * x));
+
+		xdiff = _mm_cmpgt_epi32(xr24_diff_sum(right, left), limit);
+		ydiff = _mm_cmpgt_epi32(xr24_diff_sum(bottom, top), limit);
+
+		xr24_store_mask(&edges[x],
+				_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(xdiff, ydiff))));
+	}
+#endif
+
+	for (; x + span < width; x++)
+		edges[x] = xr24_diff(row + 4 * (x + span),
+				     row + 4 * (x - span)) > threshold ||
+			   xr24_diff(down + 4 * x, up + 4 * x) > threshold;
+}
+
+/*
+ * Flags the pixels of a row where any color component differs by more than
+ * the threshold between the reference and the capture.
+ */
+static void checkerboard_errors_row(const uint8_t *ref, const uint8_t *cap,
+				    unsigned int width, unsigned int threshold,
+				    unsigned char *errors)
+{
+	unsigned int x = 0;
+
+#if defined(__SSE2__)
+	const __m128i limit = _mm_set1_epi8(threshold);
+	const __m128i color = _mm_set1_epi32(0x00ffffff);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; x + XR24_SIMD_PIXELS <= width; x += XR24_SIMD_PIXELS) {
+		__m128i r, c, over;
+
+		r = _mm_loadu_si128((const __m128i *)(ref + 4 * x));
+		c = _mm_loadu_si128((const __m128i *)(cap + 4 * x));
+
+		over = _mm_and_si128(_mm_subs_epu8(xr24_absdiff(r, c), limit),
+				     color);
+
+		xr24_store_mask(&errors[x],
+				~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(over, zero))));
+	}
+#endif
+
+	for (; x < width; x++)
+		errors[x] = xr24_error(ref + 4 * x, cap + 4 * x, threshold);
+}
 
 /**
  * igt_check_checkerboard_frame_match:
@@ -305,13 +623,13 @@ bool igt_check_checkerboard_frame_match(cairo_surface_t *reference,
 {
 	unsigned int width, height, ref_stride, cap_stride;
 	void *ref_data, *cap_data;
-	unsigned char *edges_map;
-	unsigned int x, y, c;
+	unsigned char *edges_map, *row_errors;
+	unsigned int x, y;
 	unsigned int errors = 0, pixels = 0;
 	unsigned int edge_threshold = 100;
 	unsigned int color_error_threshold = 24;
 	double error_rate_threshold = 0.01;
-	double error_rate;
+	double error_rate, max_errors;
 	unsigned int span = 2;
 	bool match = false;
 
@@ -329,48 +647,34 @@ bool igt_check_checkerboard_frame_match(cairo_surface_t *reference,
 	edges_map = calloc(1, width * height);
 	igt_assert(edges_map);
 
-	/* First pass to detect the pattern edges. */
-	for (y = 0; y < height; y++) {
-		if (y < span || y > (height - span - 1))
-			continue;
+	row_errors = malloc(width);
+	igt_assert(row_errors);
 
-		for (x = 0; x < width; x++) {
-			unsigned int xdiff = 0, ydiff = 0;
-
-			if (x < span || x > (width - span - 1))
-				continue;
-
-			for (c = 0; c < 3; c++) {
-				xdiff += abs(XR24_COLOR_VALUE(ref_data, ref_stride, x + span, y, c) -
-					     XR24_COLOR_VALUE(ref_data, ref_stride, x - span, y, c));
-				ydiff += abs(XR24_COLOR_VALUE(ref_data, ref_stride, x, y + span, c) -
-					     XR24_COLOR_VALUE(ref_data, ref_stride, x, y - span, c));
-			}
+	/* First pass to detect the pattern edges. */
+	for (y = span; y + span < height && width > 2 * span; y++)
+		checkerboard_edges_row((uint8_t *)ref_data + y * ref_stride,
+				       ref_stride, width, span, edge_threshold,
+				       &edges_map[y * width]);
 
-			edges_map[y * width + x] = (xdiff > edge_threshold ||
-						    ydiff > edge_threshold);
-		}
-	}
+	/*
+	 * Since at most all the pixels are compared, the frame can no longer
+	 * match once the error count reaches this bound.
+	 */
+	max_errors = error_rate_threshold * width * height;
 
 	/* Second pass to detect errors. */
-	for (y = 0; y < height; y++) {
+	for (y = 0; y < height && errors < max_errors; y++) {
+		checkerboard_errors_row((uint8_t *)ref_data + y * ref_stride,
+					(uint8_t *)cap_data + y * cap_stride,
+					width, color_error_threshold,
+					row_errors);
+
 		for (x = 0; x < width; x++) {
-			bool error = false;
+			bool error = row_errors[x];
 
 			if (edges_map[y * width + x])
 				continue;
 
-			for (c = 0; c < 3; c++) {
-				unsigned int diff;
-
-				/* Compare the reference and capture values. */
-				diff = abs(XR24_COLOR_VALUE(ref_data, ref_stride, x, y, c) -
-					   XR24_COLOR_VALUE(cap_data, cap_stride, x, y, c));
-
-				if (diff > color_error_threshold)
-					error = true;
-			}
-
 			/* Allow error if coming on or off an edge (on x). */
 			if (error && x >= span && x <= (width - span - 1) &&
 			    edges_map[y * width + (x - span)] !=
@@ -380,7 +684,7 @@ bool igt_check_checkerboard_frame_match(cairo_surface_t *reference,
 			/* Allow error if coming on or off an edge (on y). */
 			if (error && y >= span && y <= (height - span - 1) &&
 			    edges_map[(y - span) * width + x] !=
-			    edges_map[(y + span) * width + x] && error)
+			    edges_map[(y + span) * width + x])
 				continue;
 
 			if (error)
@@ -390,8 +694,15 @@ bool igt_check_checkerboard_frame_match(cairo_surface_t *reference,
 		}
 	}
 
+	free(row_errors);
 	free(edges_map);
 
+	if (y < height) {
+		igt_debug("Checkerboard pattern not matched with %u errors after %u lines\n",
+			  errors, y);
+		return false;
+	}
+
 	error_rate = (double) errors / pixels;
 
 	if (error_rate < error_rate_threshold)
@@ -36,6 +36,7 @@ void igt_write_compared_frames_to_png(cairo_surface_t *reference,
 				      cairo_surface_t *capture,
 				      const char *reference_suffix,
 				      const char *capture_suffix);
+void igt_frame_dump_flush(void);
 bool igt_check_analog_frame_match(cairo_surface_t *reference,
 				  cairo_surface_t *capture);
 bool igt_check_checkerboard_frame_match(cairo_surface_t *reference,
@@ -0,0 +1,551 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_bench.h"
+#include "igt_core.h"
+#include "igt_dummyload.h"
+#include "igt_freq.h"
+#include "igt_gt.h"
+#include "igt_sysfs.h"
+
+/**
+ * SECTION:igt_freq
+ * @short_description: GPU frequency control for stable benchmarks
+ * @title: Frequency
+ * @include: igt_freq.h
+ *
+ * Much of the noise in benchmark results comes from RPS ramping the GPU
+ * frequency up and down and from the GT waking up from RC6. The functions
+ * here pin the frequency of an i915 device with igt_freq_lock(), keep the
+ * GT out of RC6 with igt_freq_disable_rc6() and warm the GPU up with a
+ * spinner until its frequency has settled with igt_freq_warmup(). The
+ * previous state is put back by igt_freq_restore(), or on exit through an
+ * exit handler. Only one device at a time is supported.
+ *
+ * Where changing the frequency is not wanted, igt_freq_trace_start()
+ * records the actual frequency and the RC6 residency from a background
+ * thread instead, so that the results can be accounted for them.
+ *
+ * Benchmarks can leave all of it to the user with igt_freq_bench_setup(),
+ * which applies the IGT_BENCH_FREQ, IGT_BENCH_RC6 and IGT_BENCH_WARMUP
+ * environment variables:
+ *
+ * |[
+ *	$ IGT_BENCH_FREQ=rp1 IGT_BENCH_RC6=0 IGT_BENCH_WARMUP=500 ./gem_copy_bw
+ * ]|
+ */
+
+/* Samples in a row at the same frequency for it to be considered steady */
+#define WARMUP_STEADY 5
+#define WARMUP_INTERVAL_MS 10
+
+static struct {
+	int dir;
+	char min[16], max[16];
+	int forcewake;
+	bool handler;
+} saved = { .dir = -1, .forcewake = -1 };
+
+static struct {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool init, running, stop;
+
+	int act, rc6;
+	unsigned int interval_ms;
+
+	struct igt_freq_sample *samples;
+	unsigned int count, size;
+} trace = { .act = -1, .rc6 = -1 };
+
+/* Safe to use from a signal handler */
+static bool write_attr(int dir, const char *attr, const char *value)
+{
+	int len = strlen(value);
+	bool ret;
+	int fd;
+
+	fd = openat(dir, attr, O_WRONLY);
+	if (fd < 0)
+		return false;
+
+	ret = write(fd, value, len) == len;
+	close(fd);
+
+	return ret;
+}
+
+/*
+ * The kernel refuses a lower limit above the upper one and vice versa, so
+ * set the lower limit before and after the upper one to move them both
+ * either way.
+ */
+static bool write_limits(int dir, const char *min, const char *max)
+{
+	bool ret;
+
+	write_attr(dir, "gt_min_freq_mhz", min);
+	ret = write_attr(dir, "gt_max_freq_mhz", max);
+	ret &= write_attr(dir, "gt_min_freq_mhz", min);
+
+	return ret;
+}
+
+static void __igt_freq_restore(void)
+{
+	if (saved.dir >= 0) {
+		write_limits(saved.dir, saved.min, saved.max);
+		close(saved.dir);
+		saved.dir = -1;
+	}
+
+	if (saved.forcewake >= 0) {
+		close(saved.forcewake);
+		saved.forcewake = -1;
+	}
+}
+
+static void freq_exit_handler(int sig)
+{
+	__igt_freq_restore();
+}
+
+static void install_exit_handler(void)
+{
+	if (saved.handler)
+		return;
+
+	igt_install_exit_handler(freq_exit_handler);
+	saved.handler = true;
+}
+
+/**
+ * igt_freq_get_info:
+ * @i915: open i915 drm file descriptor
+ * @info: (out): the frequencies
+ *
+ * Reads the frequency limits of the hardware, those of RPS and the actual
+ * frequency from sysfs.
+ *
+ * Returns: Whether all of them could be read.
+ */
+bool igt_freq_get_info(int i915, struct igt_freq_info *info)
+{
+	bool ret = true;
+	int dir;
+
+	memset(info, 0, sizeof(*info));
+
+	dir = igt_sysfs_open(i915);
+	if (dir < 0)
+		return false;
+
+	ret &= igt_sysfs_scanf(dir, "gt_RPn_freq_mhz", "%u", &info->rpn) == 1;
+	ret &= igt_sysfs_scanf(dir, "gt_RP1_freq_mhz", "%u", &info->rp1) == 1;
+	ret &= igt_sysfs_scanf(dir, "gt_RP0_freq_mhz", "%u", &info->rp0) == 1;
+	ret &= igt_sysfs_scanf(dir, "gt_min_freq_mhz", "%u", &info->min) == 1;
+	ret &= igt_sysfs_scanf(dir, "gt_max_freq_mhz", "%u", &info->max) == 1;
+	ret &= igt_sysfs_scanf(dir, "gt_act_freq_mhz", "%u", &info->act) == 1;
+
+	close(dir);
+
+	return ret;
+}
+
+/**
+ * igt_freq_act:
+ * @i915: open i915 drm file descriptor
+ *
+ * Returns: The actual frequency of the GPU in MHz, or 0 if unknown.
+ */
+uint32_t igt_freq_act(int i915)
+{
+	uint32_t act = 0;
+	int dir;
+
+	dir = igt_sysfs_open(i915);
+	if (dir < 0)
+		return 0;
+
+	if (igt_sysfs_scanf(dir, "gt_act_freq_mhz", "%u", &act) != 1)
+		act = 0;
+	close(dir);
+
+	return act;
+}
+
+/**
+ * igt_freq_lock:
+ * @i915: open i915 drm file descriptor
+ * @mhz: frequency to lock to, or 0 for RP0
+ *
+ * Sets both the lower and upper limits of RPS to @mhz, clamped to the range
+ * of the hardware. The limits from before the first call are restored by
+ * igt_freq_restore() or on exit.
+ *
+ * Returns: The frequency locked to, or -errno on failure.
+ */
+int igt_freq_lock(int i915, uint32_t mhz)
+{
+	struct igt_freq_info info;
+	char value[16];
+
+	if (!igt_freq_get_info(i915, &info))
+		return -ENODEV;
+
+	if (!mhz || mhz > info.rp0)
+		mhz = info.rp0;
+	if (mhz < info.rpn)
+		mhz = info.rpn;
+
+	if (saved.dir < 0) {
+		saved.dir = igt_sysfs_open(i915);
+		if (saved.dir < 0)
+			return -ENODEV;
+
+		snprintf(saved.min, sizeof(saved.min), "%u", info.min);
+		snprintf(saved.max, sizeof(saved.max), "%u", info.max);
+		install_exit_handler();
+	}
+
+	snprintf(value, sizeof(value), "%u", mhz);
+	if (!write_limits(saved.dir, value, value))
+		return errno ? -errno : -EINVAL;
+
+	igt_debug("GPU frequency locked to %uMHz (RPS was %s-%sMHz)\n",
+		  mhz, saved.min, saved.max);
+
+	return mhz;
+}
+
+/**
+ * igt_freq_disable_rc6:
+ * @i915: open i915 drm file descriptor
+ *
+ * Keeps the GT awake, and so out of RC6, by holding the user forcewake
+ * until igt_freq_restore() or exit.
+ *
+ * Returns: Whether the forcewake could be taken.
+ */
+bool igt_freq_disable_rc6(int i915)
+{
+	if (saved.forcewake >= 0)
+		return true;
+
+	saved.forcewake = igt_open_forcewake_handle(i915);
+	if (saved.forcewake < 0)
+		return false;
+
+	install_exit_handler();
+
+	return true;
+}
+
+/**
+ * igt_freq_restore:
+ *
+ * Restores the RPS limits saved by igt_freq_lock() and lets the GT enter RC6
+ * again after igt_freq_disable_rc6().
+ */
+void igt_freq_restore(void)
+{
+	if (saved.dir >= 0)
+		igt_debug("Restoring RPS limits to %s-%sMHz\n",
+			  saved.min, saved.max);
+
+	__igt_freq_restore();
+}
+
+/**
+ * igt_freq_warmup:
+ * @i915: open i915 drm file descriptor
+ * @engine: execbuf engine selector to run the spinner on
+ * @timeout_ms: longest time to wait for the frequency to settle
+ *
+ * Keeps @engine busy with a spinner until the actual frequency has stayed
+ * the same for a few samples, WARMUP_STEADY at WARMUP_INTERVAL_MS apart, or
+ * @timeout_ms has passed.
+ *
+ * Returns: The steady frequency in MHz, -ETIMEDOUT if it did not settle in
+ * time or -ENODEV if the frequency could not be read.
+ */
+int igt_freq_warmup(int i915, unsigned int engine, unsigned int timeout_ms)
+{
+	struct timespec tv = {};
+	unsigned int steady = 0;
+	uint32_t last = 0, act;
+	igt_spin_t *spin;
+	int dir;
+
+	dir = igt_sysfs_open(i915);
+	if (dir < 0)
+		return -ENODEV;
+
+	spin = igt_spin_new(i915, .engine = engine);
+
+	igt_nsec_elapsed(&tv);
+	do {
+		usleep(WARMUP_INTERVAL_MS * 1000);
+
+		if (igt_sysfs_scanf(dir, "gt_act_freq_mhz", "%u", &act) != 1) {
+			act = 0;
+			break;
+		}
+
+		steady = act == last ? steady + 1 : 0;
+		last = act;
+	} while (steady < WARMUP_STEADY &&
+		 igt_nsec_elapsed(&tv) < timeout_ms * 1000000ull);
+
+	igt_spin_free(i915, spin);
+	close(dir);
+
+	if (!act)
+		return -ENODEV;
+
+	if (steady < WARMUP_STEADY)
+		return -ETIMEDOUT;
+
+	return act;
+}
+
+static void timespec_add_ms(struct timespec *ts, unsigned int ms)
+{
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000l;
+	if (ts->tv_nsec >= 1000000000l) {
+		ts->tv_nsec -= 1000000000l;
+		ts->tv_sec++;
+	}
+}
+
+static void trace_sample(struct igt_freq_sample *s)
+{
+	struct timespec ts;
+	uint64_t value;
+
+	memset(s, 0, sizeof(*s));
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	s->time = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+	if (trace.act >= 0 && igt_sysfs_attr_get_u64(trace.act, &value))
+		s->act = value;
+	if (trace.rc6 >= 0)
+		igt_sysfs_attr_get_u64(trace.rc6, &s->rc6);
+}
+
+static void *tracer(void *arg)
+{
+	struct timespec next;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	pthread_mutex_lock(&trace.mutex);
+	for (;;) {
+		if (trace.count == trace.size) {
+			trace.size = trace.size ? 2 * trace.size : 64;
+			trace.samples = realloc(trace.samples,
+						trace.size *
+						sizeof(*trace.samples));
+			igt_assert(trace.samples);
+		}
+		trace_sample(&trace.samples[trace.count++]);
+
+		if (trace.stop)
+			break;
+
+		timespec_add_ms(&next, trace.interval_ms);
+		while (!trace.stop &&
+		       pthread_cond_timedwait(&trace.cond, &trace.mutex,
+					      &next) != ETIMEDOUT)
+			;
+	}
+	pthread_mutex_unlock(&trace.mutex);
+
+	return NULL;
+}
+
+/**
+ * igt_freq_trace_start:
+ * @i915: open i915 drm file descriptor
+ * @interval_ms: time between two samples
+ *
+ * Starts sampling the actual frequency and the RC6 residency of @i915 every
+ * @interval_ms from a background thread, discarding any earlier trace.
+ * Counters missing from sysfs read as 0.
+ */
+void igt_freq_trace_start(int i915, unsigned int interval_ms)
+{
+	sigset_t mask, old;
+	int dir;
+
+	igt_assert(!trace.running);
+	igt_assert(interval_ms > 0);
+
+	if (!trace.init) {
+		pthread_condattr_t attr;
+
+		pthread_mutex_init(&trace.mutex, NULL);
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&trace.cond, &attr);
+		pthread_condattr_destroy(&attr);
+		trace.init = true;
+	}
+
+	dir = igt_sysfs_open(i915);
+	if (dir >= 0) {
+		trace.act = igt_sysfs_attr_open(dir, "gt_act_freq_mhz");
+		trace.rc6 = igt_sysfs_attr_open(dir, "power/rc6_residency_ms");
+		close(dir);
+	}
+
+	trace.interval_ms = interval_ms;
+	trace.count = 0;
+	trace.stop = false;
+
+	/* Leave the signals, igt_set_timeout() included, to the test thread */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &old);
+	igt_assert_eq(pthread_create(&trace.thread, NULL, tracer, NULL), 0);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	trace.running = true;
+}
+
+/**
+ * igt_freq_trace_stop:
+ *
+ * Stops the trace started with igt_freq_trace_start(), after a last sample.
+ *
+ * Returns: The number of samples taken.
+ */
+unsigned int igt_freq_trace_stop(void)
+{
+	igt_assert(trace.running);
+
+	pthread_mutex_lock(&trace.mutex);
+	trace.stop = true;
+	pthread_cond_signal(&trace.cond);
+	pthread_mutex_unlock(&trace.mutex);
+
+	pthread_join(trace.thread, NULL);
+	trace.running = false;
+
+	if (trace.act >= 0)
+		close(trace.act);
+	if (trace.rc6 >= 0)
+		close(trace.rc6);
+	trace.act = trace.rc6 = -1;
+
+	return trace.count;
+}
+
+/**
+ * igt_freq_trace:
+ * @count: (out): the number of samples
+ *
+ * Returns: The samples of the last trace, in order, valid until the next
+ * igt_freq_trace_start().
+ */
+const struct igt_freq_sample *igt_freq_trace(unsigned int *count)
+{
+	igt_assert(!trace.running);
+
+	*count = trace.count;
+	return trace.samples;
+}
+
+/**
+ * igt_freq_bench_setup:
+ * @i915: open i915 drm file descriptor
+ *
+ * Prepares the GPU for a benchmark as asked by the environment, recording
+ * the settings applied with igt_bench_param(), so to be called after
+ * igt_bench_begin():
+ *
+ * - IGT_BENCH_FREQ locks the frequency, to "rpn", "rp1", "rp0" or a value
+ *   in MHz, see igt_freq_lock().
+ * - IGT_BENCH_RC6=0 keeps the GT out of RC6, see igt_freq_disable_rc6().
+ * - IGT_BENCH_WARMUP runs a spinner on the default engine for up to that
+ *   many milliseconds until the frequency is steady, see igt_freq_warmup().
+ *
+ * Failures are only warned about, the benchmark running regardless.
+ */
+void igt_freq_bench_setup(int i915)
+{
+	const char *env;
+	int ret;
+
+	env = getenv("IGT_BENCH_FREQ");
+	if (env) {
+		struct igt_freq_info info;
+		uint32_t mhz;
+
+		igt_freq_get_info(i915, &info);
+		if (!strcmp(env, "rpn"))
+			mhz = info.rpn;
+		else if (!strcmp(env, "rp1"))
+			mhz = info.rp1;
+		else if (!strcmp(env, "rp0"))
+			mhz = info.rp0;
+		else
+			mhz = strtoul(env, NULL, 0);
+
+		ret = igt_freq_lock(i915, mhz);
+		if (ret < 0)
+			igt_warn("Failed to lock the GPU frequency: %s\n",
+				 strerror(-ret));
+		else
+			igt_bench_param("freq", "%d", ret);
+	}
+
+	env = getenv("IGT_BENCH_RC6");
+	if (env && !atoi(env)) {
+		if (igt_freq_disable_rc6(i915))
+			igt_bench_param("rc6", "%d", 0);
+		else
+			igt_warn("Failed to disable RC6\n");
+	}
+
+	env = getenv("IGT_BENCH_WARMUP");
+	if (env && atoi(env) > 0) {
+		ret = igt_freq_warmup(i915, 0, atoi(env));
+		if (ret < 0)
+			igt_warn("GPU frequency did not settle: %s\n",
+				 strerror(-ret));
+		else
+			igt_bench_param("warmup-freq", "%d", ret);
+	}
+}
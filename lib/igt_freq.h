@@ -0,0 +1,75 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __IGT_FREQ_H__
+#define __IGT_FREQ_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * igt_freq_info:
+ * @rpn: lowest frequency of the GPU
+ * @rp1: most efficient frequency
+ * @rp0: highest non-boost frequency
+ * @min: current lower limit of RPS
+ * @max: current upper limit of RPS
+ * @act: actual frequency
+ *
+ * All the frequencies are in MHz.
+ */
+struct igt_freq_info {
+	uint32_t rpn, rp1, rp0;
+	uint32_t min, max;
+	uint32_t act;
+};
+
+/**
+ * igt_freq_sample:
+ * @time: CLOCK_MONOTONIC time of the sample, in ns
+ * @act: actual frequency, in MHz
+ * @rc6: RC6 residency, in ms
+ */
+struct igt_freq_sample {
+	uint64_t time;
+	uint32_t act;
+	uint64_t rc6;
+};
+
+bool igt_freq_get_info(int i915, struct igt_freq_info *info);
+uint32_t igt_freq_act(int i915);
+
+int igt_freq_lock(int i915, uint32_t mhz);
+bool igt_freq_disable_rc6(int i915);
+void igt_freq_restore(void);
+
+int igt_freq_warmup(int i915, unsigned int engine, unsigned int timeout_ms);
+
+void igt_freq_trace_start(int i915, unsigned int interval_ms);
+unsigned int igt_freq_trace_stop(void);
+const struct igt_freq_sample *igt_freq_trace(unsigned int *count);
+
+void igt_freq_bench_setup(int i915);
+
+#endif /* __IGT_FREQ_H__ */
@@ -30,6 +30,8 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
 
 #include "drmtest.h"
 #include "igt_aux.h"
@@ -37,10 +39,12 @@
 #include "igt_gt.h"
 #include "igt_sysfs.h"
 #include "igt_debugfs.h"
+#include "igt_kmod.h"
 #include "ioctl_wrappers.h"
 #include "intel_reg.h"
 #include "intel_chipset.h"
 #include "igt_dummyload.h"
+#include "i915/gem_caps.h"
 #include "i915/gem_engine_topology.h"
 
 /**
@@ -375,6 +379,193 @@ void igt_force_gpu_reset(int drm_fd)
 	igt_assert(!wedged);
 }
 
+static bool gpu_is_healthy(int fd)
+{
+	const uint32_t bbe = MI_BATCH_BUFFER_END;
+	struct drm_i915_gem_exec_object2 obj = {};
+	struct drm_i915_gem_execbuffer2 execbuf = {
+		.buffers_ptr = to_user_pointer(&obj),
+		.buffer_count = 1,
+	};
+	int64_t timeout = NSEC_PER_SEC;
+	bool ret;
+
+	if (ioctl(fd, DRM_IOCTL_I915_GEM_THROTTLE) && errno == EIO)
+		return false;
+
+	if (__gem_create(fd, 4096, &obj.handle))
+		return false;
+
+	gem_write(fd, obj.handle, 0, &bbe, sizeof(bbe));
+	ret = __gem_execbuf(fd, &execbuf) == 0 &&
+	      gem_wait(fd, obj.handle, &timeout) == 0;
+	gem_close(fd, obj.handle);
+
+	errno = 0;
+	return ret;
+}
+
+static void recover_by_reset(int fd, bool engine_reset)
+{
+	int dir;
+
+	/* Only allow full device resets for the duration */
+	if (!engine_reset)
+		igt_sysfs_set_parameter(fd, "reset", "%d", 1);
+
+	dir = igt_debugfs_dir(fd);
+	igt_sysfs_set(dir, "i915_wedged", "-1");
+	close(dir);
+
+	if (!engine_reset)
+		igt_sysfs_set_parameter(fd, "reset", "%x", -1u);
+}
+
+static void recover_by_unwedge(int fd)
+{
+	igt_terminate_spins();
+
+	/* Make sure resets are allowed, then wedge and unwedge everything */
+	igt_sysfs_set_parameter(fd, "reset", "%x", -1u);
+	igt_drop_caches_set(fd,
+			    DROP_RESET_ACTIVE | DROP_RESET_SEQNO |
+			    DROP_ACTIVE | DROP_RETIRE | DROP_IDLE | DROP_FREED);
+	recover_by_reset(fd, true);
+}
+
+static bool recover_by_rebind(int fd)
+{
+	char path[PATH_MAX], device[PATH_MAX];
+	char *slot;
+	int dir;
+	bool ret;
+
+	if (!igt_sysfs_path(fd, path, sizeof(path)))
+		return false;
+
+	strncat(path, "/device", sizeof(path) - strlen(path) - 1);
+	if (!realpath(path, device))
+		return false;
+	slot = basename(device);
+
+	dir = open("/sys/bus/pci/drivers/i915", O_RDONLY);
+	if (dir < 0)
+		return false;
+
+	close(fd);
+	igt_debug("Rebinding %s\n", slot);
+	ret = igt_sysfs_set(dir, "unbind", slot) &&
+	      igt_sysfs_set(dir, "bind", slot);
+	close(dir);
+
+	return ret;
+}
+
+static bool recover_by_reload(int fd)
+{
+	close(fd);
+
+	if (igt_i915_driver_unload() != IGT_EXIT_SUCCESS)
+		return false;
+
+	return igt_i915_driver_load(NULL) == IGT_EXIT_SUCCESS;
+}
+
+static const char *recovery_name(enum igt_gpu_recovery step)
+{
+	static const char * const names[] = {
+		[IGT_RECOVERY_NONE] = "none",
+		[IGT_RECOVERY_ENGINE_RESET] = "engine reset",
+		[IGT_RECOVERY_GLOBAL_RESET] = "global reset",
+		[IGT_RECOVERY_UNWEDGE] = "unwedge",
+		[IGT_RECOVERY_REBIND] = "rebind",
+		[IGT_RECOVERY_RELOAD] = "module reload",
+	};
+
+	return names[step];
+}
+
+/**
+ * igt_gpu_recover:
+ * @fd: (inout): pointer to an open i915 drm file descriptor
+ * @max_step: the most expensive recovery method allowed
+ *
+ * Brings a hung or wedged GPU back into a working state, escalating from the
+ * cheapest recovery method to the most expensive one until a nop batch
+ * executes again:
+ *
+ * - #IGT_RECOVERY_ENGINE_RESET: a reset through i915_wedged, which resets
+ *   only the hung engines where supported
+ * - #IGT_RECOVERY_GLOBAL_RESET: the same with only full device resets allowed
+ * - #IGT_RECOVERY_UNWEDGE: re-enable resets, cancel all outstanding work and
+ *   reset again, to clear a terminally wedged GPU
+ * - #IGT_RECOVERY_REBIND: unbind and rebind the PCI device
+ * - #IGT_RECOVERY_RELOAD: reload the i915 module
+ *
+ * The last two steps close *@fd and replace it with a newly opened one, and
+ * can only succeed if nothing else keeps the device open. The step which
+ * succeeded and the time it took are reported with igt_info(), so that
+ * slow recoveries stand out in the logs.
+ *
+ * Returns:
+ * The step that recovered the GPU, #IGT_RECOVERY_NONE if it was fine to
+ * begin with, or -1 if all the steps up to @max_step failed.
+ */
+int igt_gpu_recover(int *fd, enum igt_gpu_recovery max_step)
+{
+	struct timespec tv = {};
+	enum igt_gpu_recovery step;
+
+	igt_nsec_elapsed(&tv);
+
+	if (gpu_is_healthy(*fd))
+		return IGT_RECOVERY_NONE;
+
+	for (step = IGT_RECOVERY_ENGINE_RESET; step <= max_step; step++) {
+		switch (step) {
+		case IGT_RECOVERY_ENGINE_RESET:
+		case IGT_RECOVERY_GLOBAL_RESET:
+			recover_by_reset(*fd,
+					 step == IGT_RECOVERY_ENGINE_RESET);
+			break;
+		case IGT_RECOVERY_UNWEDGE:
+			recover_by_unwedge(*fd);
+			break;
+		case IGT_RECOVERY_REBIND:
+		case IGT_RECOVERY_RELOAD:
+			if (*fd < 0)
+				break;
+
+			if (step == IGT_RECOVERY_REBIND ?
+			    !recover_by_rebind(*fd) : !recover_by_reload(*fd)) {
+				/* The fd may be gone, start afresh */
+				*fd = __drm_open_driver(DRIVER_INTEL);
+				continue;
+			}
+
+			gem_caps_invalidate();
+			*fd = __drm_open_driver(DRIVER_INTEL);
+			break;
+		default:
+			break;
+		}
+
+		if (*fd >= 0 && gpu_is_healthy(*fd)) {
+			igt_info("GPU recovered by %s after %.3fms\n",
+				 recovery_name(step),
+				 igt_nsec_elapsed(&tv) * 1e-6);
+			return step;
+		}
+
+		igt_debug("GPU not recovered by %s after %.3fms\n",
+			  recovery_name(step), igt_nsec_elapsed(&tv) * 1e-6);
+	}
+
+	igt_warn("GPU not recovered after %.3fms\n",
+		 igt_nsec_elapsed(&tv) * 1e-6);
+	return -1;
+}
+
 /* GPU abusers */
 static struct igt_helper_process hang_helper;
 static void __attribute__((noreturn))
@@ -53,6 +53,17 @@ void igt_post_hang_ring(int fd, igt_hang_t arg);
 
 void igt_force_gpu_reset(int fd);
 
+enum igt_gpu_recovery {
+	IGT_RECOVERY_NONE,
+	IGT_RECOVERY_ENGINE_RESET,
+	IGT_RECOVERY_GLOBAL_RESET,
+	IGT_RECOVERY_UNWEDGE,
+	IGT_RECOVERY_REBIND,
+	IGT_RECOVERY_RELOAD,
+};
+
+int igt_gpu_recover(int *fd, enum igt_gpu_recovery max_step);
+
 void igt_fork_hang_helper(void);
 void igt_stop_hang_helper(void);
 
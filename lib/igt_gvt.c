@@ -26,6 +26,11 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "igt_gvt.h"
 #include "igt_sysfs.h"
 #include "igt_kmod.h"
@@ -36,8 +41,14 @@
  * @short_description: Graphics virtualization technology library
  * @title: GVT
  * @include: igt_gvt.h
+ *
+ * Besides loading i915 with GVT-g enabled, this library creates and removes
+ * the mediated devices of the vGPUs guests are then given, through the
+ * mdev_supported_types of the integrated GPU.
  */
 
+#define GVT_DEVICE "/sys/bus/pci/devices/0000:00:02.0"
+
 static bool is_gvt_enabled(void)
 {
 	bool enabled = false;
@@ -82,3 +93,129 @@ void igt_gvt_unload_module(void)
 
 	igt_assert(!is_gvt_enabled());
 }
+
+static int open_vgpu_type(const char *type)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path),
+		 GVT_DEVICE "/mdev_supported_types/%s", type);
+
+	return open(path, O_RDONLY);
+}
+
+/**
+ * igt_gvt_vgpu_available:
+ * @type: a vGPU type, e.g. "i915-GVTg_V5_4"
+ *
+ * Returns: How many more vGPUs of @type can be created, 0 when the type does
+ * not exist.
+ */
+int igt_gvt_vgpu_available(const char *type)
+{
+	int dir, n;
+
+	dir = open_vgpu_type(type);
+	if (dir < 0)
+		return 0;
+
+	n = igt_sysfs_get_u32(dir, "available_instances");
+	close(dir);
+
+	return n;
+}
+
+/**
+ * igt_gvt_vgpu_densest_type:
+ * @type: where to return the name of the type
+ * @len: size of @type
+ *
+ * Finds the vGPU type of which most instances can be created, i.e. the one
+ * with the smallest share of the GPU.
+ *
+ * Returns: false if GVT-g exposes no vGPU type.
+ */
+bool igt_gvt_vgpu_densest_type(char *type, size_t len)
+{
+	struct dirent *de;
+	int best = 0;
+	DIR *dir;
+
+	dir = opendir(GVT_DEVICE "/mdev_supported_types");
+	if (!dir)
+		return false;
+
+	while ((de = readdir(dir))) {
+		int n;
+
+		if (*de->d_name == '.')
+			continue;
+
+		n = igt_gvt_vgpu_available(de->d_name);
+		if (n > best) {
+			snprintf(type, len, "%s", de->d_name);
+			best = n;
+		}
+	}
+	closedir(dir);
+
+	return best > 0;
+}
+
+/**
+ * igt_gvt_vgpu_create:
+ * @type: the vGPU type to create
+ * @uuid: where to return the uuid of the new vGPU
+ *
+ * Creates a vGPU of @type, which a guest can then be given as
+ * vfio-pci,sysfsdev=/sys/bus/pci/devices/0000:00:02.0/@uuid.
+ *
+ * Returns: false if the vGPU could not be created.
+ */
+bool igt_gvt_vgpu_create(const char *type, char uuid[IGT_GVT_UUID_LEN])
+{
+	bool ret;
+	int dir, fd;
+
+	/* A random, version 4, uuid */
+	fd = open("/proc/sys/kernel/random/uuid", O_RDONLY);
+	if (fd < 0)
+		return false;
+	ret = read(fd, uuid, IGT_GVT_UUID_LEN - 1) == IGT_GVT_UUID_LEN - 1;
+	close(fd);
+	if (!ret)
+		return false;
+	uuid[IGT_GVT_UUID_LEN - 1] = '\0';
+
+	dir = open_vgpu_type(type);
+	if (dir < 0)
+		return false;
+
+	ret = igt_sysfs_set(dir, "create", uuid);
+	close(dir);
+
+	return ret;
+}
+
+/**
+ * igt_gvt_vgpu_remove:
+ * @uuid: the uuid of a vGPU
+ *
+ * Removes the vGPU, which must no longer be used by a guest.
+ */
+bool igt_gvt_vgpu_remove(const char *uuid)
+{
+	char path[PATH_MAX];
+	bool ret;
+	int dir;
+
+	snprintf(path, sizeof(path), GVT_DEVICE "/%s", uuid);
+	dir = open(path, O_RDONLY);
+	if (dir < 0)
+		return false;
+
+	ret = igt_sysfs_set(dir, "remove", "1");
+	close(dir);
+
+	return ret;
+}
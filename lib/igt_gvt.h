@@ -26,8 +26,17 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 bool igt_gvt_load_module(void);
 void igt_gvt_unload_module(void);
 
+/* The 36 characters of a uuid and the terminating NUL */
+#define IGT_GVT_UUID_LEN 37
+
+int igt_gvt_vgpu_available(const char *type);
+bool igt_gvt_vgpu_densest_type(char *type, size_t len);
+bool igt_gvt_vgpu_create(const char *type, char uuid[IGT_GVT_UUID_LEN]);
+bool igt_gvt_vgpu_remove(const char *uuid);
+
 #endif /* IGT_GVT_H */
@@ -21,13 +21,17 @@
  * IN THE SOFTWARE.
  */
 
+#include <ctype.h>
 #include <signal.h>
 #include <errno.h>
 
+#include "drmtest.h"
 #include "igt_aux.h"
+#include "igt_bench.h"
 #include "igt_core.h"
 #include "igt_kmod.h"
 #include "igt_sysfs.h"
+#include "i915/gem_caps.h"
 
 /**
  * SECTION:igt_kmod
@@ -358,6 +362,9 @@ igt_i915_driver_unload(void)
 		}
 	}
 
+	/* A reloaded driver may come up with other capabilities */
+	gem_caps_invalidate();
+
 	if (igt_kmod_is_loaded("intel-gtt"))
 		igt_kmod_unload("intel-gtt", 0);
 
@@ -396,6 +403,128 @@ static void kmsg_dump(int fd)
 	}
 }
 
+/* Appends the words of @str to a result name, in lowercase between dashes */
+static void append_name(char *name, size_t size, const char *str, size_t len)
+{
+	size_t n = strlen(name);
+	bool dash = n;
+
+	for (size_t i = 0; i < len && n + 2 < size; i++) {
+		if (!isalnum(str[i]) && str[i] != '_') {
+			dash = n;
+			continue;
+		}
+
+		if (dash)
+			name[n++] = '-';
+		dash = false;
+		name[n++] = tolower(str[i]);
+	}
+	name[n] = '\0';
+}
+
+/*
+ * Finds a time, a number followed by a unit of ns, us or ms, in @str and
+ * returns it in nanoseconds, with *start pointing at the number.
+ */
+static bool find_time(const char *str, const char **start, double *ns)
+{
+	static const struct {
+		const char *unit;
+		double scale;
+	} units[] = {
+		{ "ns", 1 },
+		{ "us", 1e3 },
+		{ "ms", 1e6 },
+	};
+
+	for (const char *p = str; *p; p++) {
+		const char *u;
+		double v;
+		char *end;
+
+		if (!isdigit(*p) ||
+		    (p > str && (isalnum(p[-1]) || p[-1] == '.')))
+			continue;
+
+		v = strtod(p, &end);
+		u = end;
+		if (*u == ' ')
+			u++;
+
+		for (int i = 0; i < ARRAY_SIZE(units); i++) {
+			if (strncmp(u, units[i].unit, 2) || isalnum(u[2]))
+				continue;
+
+			*start = p;
+			*ns = v * units[i].scale;
+			return true;
+		}
+
+		p = end - 1;
+	}
+
+	return false;
+}
+
+/*
+ * Selftests print their timings as they like, so this picks up any line
+ * with times in it. Each comma separated part of a line, such as in
+ * "Request latencies on rcs0: 1 = 1128ns, 1024 = 1544ns", gives a result
+ * named after the test, the text before the colon and the text before the
+ * time within that part, here "...-request-latencies-on-rcs0-1024".
+ */
+static void kmsg_line_timings(const char *test, const char *msg)
+{
+	const char *colon = strchr(msg, ':');
+	const char *part = colon ? colon + 1 : msg;
+
+	while (*part) {
+		size_t len = strcspn(part, ",");
+		char buf[256], name[128] = "";
+		const char *start;
+		double ns;
+
+		snprintf(buf, sizeof(buf), "%.*s", (int)len, part);
+		if (find_time(buf, &start, &ns)) {
+			append_name(name, sizeof(name), test, strlen(test));
+			if (colon)
+				append_name(name, sizeof(name), msg, colon - msg);
+			append_name(name, sizeof(name), buf, start - buf);
+
+			igt_info("%s: %.0fns\n", name, ns);
+			igt_bench_value(name, "ns", ns);
+		}
+
+		part += len;
+		if (*part)
+			part++;
+	}
+}
+
+static void kmsg_timings(int fd, const char *test)
+{
+	char record[1024];
+	ssize_t len;
+
+	/* One record a read, "prio,seq,usecs,flags;message\n" and context */
+	while ((len = read(fd, record, sizeof(record) - 1)) > 0 ||
+	       (len < 0 && errno == EPIPE)) {
+		char *msg;
+
+		if (len < 0)
+			continue;
+
+		record[len] = '\0';
+		msg = strchr(record, ';');
+		if (!msg)
+			continue;
+
+		msg[1 + strcspn(msg + 1, "\n")] = '\0';
+		kmsg_line_timings(test, msg + 1);
+	}
+}
+
 static void tests_add(struct igt_kselftest_list *tl, struct igt_list *list)
 {
 	struct igt_kselftest_list *pos;
@@ -506,14 +635,19 @@ int igt_kselftest_execute(struct igt_kselftest *tst,
 			  const char *options,
 			  const char *result)
 {
+	struct timespec tv = {};
 	char buf[1024];
+	double elapsed;
 	int err;
 
 	lseek(tst->kmsg, 0, SEEK_END);
 
 	snprintf(buf, sizeof(buf), "%s=1 %s", tl->param, options ?: "");
 
+	/* The selftests all run from the module init */
+	igt_nsec_elapsed(&tv);
 	err = modprobe(tst->kmod, buf);
+	elapsed = igt_nsec_elapsed(&tv) * 1e-9;
 	if (err == 0 && result) {
 		int dir = open_parameters(tst->module_name);
 		igt_sysfs_scanf(dir, result, "%d", &err);
@@ -521,8 +655,13 @@ int igt_kselftest_execute(struct igt_kselftest *tst,
 	}
 	if (err == -ENOTTY) /* special case */
 		err = 0;
-	if (err)
+	if (err) {
 		kmsg_dump(tst->kmsg);
+	} else {
+		snprintf(buf, sizeof(buf), "%s-runtime", tl->name);
+		igt_bench_value(buf, "s", elapsed);
+		kmsg_timings(tst->kmsg, tl->name);
+	}
 
 	kmod_module_remove_module(tst->kmod, 0);
 
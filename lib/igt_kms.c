@@ -91,6 +91,177 @@
 static char *forced_connectors[MAX_CONNECTORS + 1];
 static int forced_connectors_device[MAX_CONNECTORS + 1];
 
+/*
+ * Cache of connectors that have been fully probed.
+ *
+ * A full probe through drmModeGetConnector() reads the EDID over DDC and
+ * takes a considerable time for every disconnected DP/HDMI connector, so we
+ * only do it once per connector and then trust drmModeGetConnectorCurrent()
+ * for as long as the kernel's view of the connector hasn't changed. Any
+ * hotplug uevent drops the whole cache.
+ *
+ * If IGT_PROBE_CACHE names a file (igt_runner provides one in the results
+ * directory) the cache is shared with the tests that run after us.
+ */
+struct probe_cache_entry {
+	dev_t dev;
+	uint32_t connector_id;
+	int connection;
+	int count_modes;
+};
+
+static struct {
+	struct probe_cache_entry *entries;
+	int count, size;
+	bool loaded;
+	const char *path;
+#if !defined(ANDROID)
+	struct udev_monitor *mon;
+#endif
+} probe_cache;
+
+static dev_t probe_cache_dev(int drm_fd)
+{
+	struct stat st;
+
+	if (fstat(drm_fd, &st))
+		return 0;
+
+	return st.st_rdev;
+}
+
+static void probe_cache_add(const struct probe_cache_entry *e)
+{
+	int i;
+
+	for (i = 0; i < probe_cache.count; i++)
+		if (probe_cache.entries[i].dev == e->dev &&
+		    probe_cache.entries[i].connector_id == e->connector_id)
+			break;
+
+	if (i == probe_cache.size) {
+		struct probe_cache_entry *entries;
+		int size = probe_cache.size ? 2 * probe_cache.size : 16;
+
+		entries = realloc(probe_cache.entries, size * sizeof(*entries));
+		if (!entries)
+			return;
+
+		probe_cache.entries = entries;
+		probe_cache.size = size;
+	}
+
+	probe_cache.entries[i] = *e;
+	if (i == probe_cache.count)
+		probe_cache.count++;
+}
+
+static void probe_cache_invalidate(void)
+{
+	probe_cache.count = 0;
+	if (probe_cache.path)
+		igt_ignore_warn(truncate(probe_cache.path, 0));
+}
+
+static void probe_cache_load(void)
+{
+	struct probe_cache_entry e;
+	unsigned long long dev;
+	FILE *file;
+
+	if (probe_cache.loaded)
+		return;
+
+	probe_cache.loaded = true;
+	probe_cache.path = getenv("IGT_PROBE_CACHE");
+	if (probe_cache.path && !*probe_cache.path)
+		probe_cache.path = NULL;
+
+#if !defined(ANDROID)
+	/* Not fatal, but without uevents we can only check the status */
+	probe_cache.mon = udev_monitor_new_from_netlink(udev_new(), "udev");
+	if (probe_cache.mon &&
+	    (udev_monitor_filter_add_match_subsystem_devtype(probe_cache.mon,
+							     "drm",
+							     "drm_minor") ||
+	     udev_monitor_enable_receiving(probe_cache.mon) ||
+	     fcntl(udev_monitor_get_fd(probe_cache.mon), F_SETFL,
+		   O_NONBLOCK))) {
+		igt_cleanup_hotplug(probe_cache.mon);
+		probe_cache.mon = NULL;
+	}
+#endif
+
+	if (!probe_cache.path)
+		return;
+
+	file = fopen(probe_cache.path, "r");
+	if (!file)
+		return;
+
+	while (fscanf(file, "%llx %u %d %d\n", &dev, &e.connector_id,
+		      &e.connection, &e.count_modes) == 4) {
+		e.dev = dev;
+		probe_cache_add(&e);
+	}
+
+	fclose(file);
+}
+
+/*
+ * Returns whether @connector, as reported by drmModeGetConnectorCurrent(),
+ * still matches what we saw when we last probed it.
+ */
+static bool probe_cache_valid(int drm_fd, const drmModeConnector *connector)
+{
+	dev_t dev = probe_cache_dev(drm_fd);
+
+	probe_cache_load();
+
+#if !defined(ANDROID)
+	if (probe_cache.mon && igt_hotplug_detected(probe_cache.mon, 0)) {
+		igt_debug("Hotplug detected, dropping the connector probe cache\n");
+		probe_cache_invalidate();
+	}
+#endif
+
+	for (int i = 0; i < probe_cache.count; i++) {
+		const struct probe_cache_entry *e = &probe_cache.entries[i];
+
+		if (e->dev == dev && e->connector_id == connector->connector_id)
+			return e->connection == connector->connection &&
+			       e->count_modes == connector->count_modes;
+	}
+
+	return false;
+}
+
+static void probe_cache_store(int drm_fd, const drmModeConnector *connector)
+{
+	struct probe_cache_entry e = {
+		.dev = probe_cache_dev(drm_fd),
+		.connector_id = connector->connector_id,
+		.connection = connector->connection,
+		.count_modes = connector->count_modes,
+	};
+	FILE *file;
+
+	probe_cache_load();
+	probe_cache_add(&e);
+
+	if (!probe_cache.path)
+		return;
+
+	/* Later lines override earlier ones, so just append */
+	file = fopen(probe_cache.path, "a");
+	if (!file)
+		return;
+
+	fprintf(file, "%llx %u %d %d\n", (unsigned long long)e.dev,
+		e.connector_id, e.connection, e.count_modes);
+	fclose(file);
+}
+
 /**
  * igt_kms_get_base_edid:
  *
@@ -107,8 +278,12 @@ static int forced_connectors_device[MAX_CONNECTORS + 1];
 const struct edid *igt_kms_get_base_edid(void)
 {
 	static struct edid edid;
+	static bool initialized;
 	drmModeModeInfo mode = {};
 
+	if (initialized)
+		return &edid;
+
 	mode.clock = 148500;
 	mode.hdisplay = 1920;
 	mode.hsync_start = 2008;
@@ -122,6 +297,7 @@ const struct edid *igt_kms_get_base_edid(void)
 
 	edid_init_with_mode(&edid, &mode);
 	edid_update_checksum(&edid);
+	initialized = true;
 
 	return &edid;
 }
@@ -143,8 +319,12 @@ const struct edid *igt_kms_get_base_edid(void)
 const struct edid *igt_kms_get_alt_edid(void)
 {
 	static struct edid edid;
+	static bool initialized;
 	drmModeModeInfo mode = {};
 
+	if (initialized)
+		return &edid;
+
 	mode.clock = 101000;
 	mode.hdisplay = 1400;
 	mode.hsync_start = 1448;
@@ -158,6 +338,7 @@ const struct edid *igt_kms_get_alt_edid(void)
 
 	edid_init_with_mode(&edid, &mode);
 	edid_update_checksum(&edid);
+	initialized = true;
 
 	return &edid;
 }
@@ -218,9 +399,13 @@ const struct edid *igt_kms_get_hdmi_audio_edid(void)
 	int channels;
 	uint8_t sampling_rates, sample_sizes;
 	static unsigned char raw_edid[AUDIO_EDID_SIZE] = {0};
+	static const struct edid *edid;
 	struct cea_sad sad = {0};
 	struct cea_speaker_alloc speaker_alloc = {0};
 
+	if (edid)
+		return edid;
+
 	/* Initialize the Short Audio Descriptor for PCM */
 	channels = 2;
 	sampling_rates = CEA_SAD_SAMPLING_RATE_32KHZ |
@@ -234,7 +419,9 @@ const struct edid *igt_kms_get_hdmi_audio_edid(void)
 	/* Initialize the Speaker Allocation Data */
 	speaker_alloc.speakers = CEA_SPEAKER_FRONT_LEFT_RIGHT_CENTER;
 
-	return generate_audio_edid(raw_edid, true, &sad, &speaker_alloc);
+	edid = generate_audio_edid(raw_edid, true, &sad, &speaker_alloc);
+
+	return edid;
 }
 
 const struct edid *igt_kms_get_dp_audio_edid(void)
@@ -242,9 +429,13 @@ const struct edid *igt_kms_get_dp_audio_edid(void)
 	int channels;
 	uint8_t sampling_rates, sample_sizes;
 	static unsigned char raw_edid[AUDIO_EDID_SIZE] = {0};
+	static const struct edid *edid;
 	struct cea_sad sad = {0};
 	struct cea_speaker_alloc speaker_alloc = {0};
 
+	if (edid)
+		return edid;
+
 	/* Initialize the Short Audio Descriptor for PCM */
 	channels = 2;
 	sampling_rates = CEA_SAD_SAMPLING_RATE_32KHZ |
@@ -258,7 +449,9 @@ const struct edid *igt_kms_get_dp_audio_edid(void)
 	/* Initialize the Speaker Allocation Data */
 	speaker_alloc.speakers = CEA_SPEAKER_FRONT_LEFT_RIGHT_CENTER;
 
-	return generate_audio_edid(raw_edid, false, &sad, &speaker_alloc);
+	edid = generate_audio_edid(raw_edid, false, &sad, &speaker_alloc);
+
+	return edid;
 }
 
 static const uint8_t edid_4k_svds[] = {
@@ -272,6 +465,7 @@ static const uint8_t edid_4k_svds[] = {
 const struct edid *igt_kms_get_4k_edid(void)
 {
 	static unsigned char raw_edid[256] = {0};
+	static bool initialized;
 	struct edid *edid;
 	struct edid_ext *edid_ext;
 	struct edid_cea *edid_cea;
@@ -282,6 +476,9 @@ const struct edid *igt_kms_get_4k_edid(void)
 	struct hdmi_vsdb *hdmi;
 	size_t cea_data_size = 0;
 
+	if (initialized)
+		return (const struct edid *) raw_edid;
+
 	/* Create a new EDID from the base IGT EDID, and add an
 	 * extension that advertises 4K support. */
 	edid = (struct edid *) raw_edid;
@@ -317,6 +514,7 @@ const struct edid *igt_kms_get_4k_edid(void)
 	edid_ext_set_cea(edid_ext, cea_data_size, 0, 0);
 
 	edid_update_checksum(edid);
+	initialized = true;
 
 	return edid;
 }
@@ -324,6 +522,7 @@ const struct edid *igt_kms_get_4k_edid(void)
 const struct edid *igt_kms_get_3d_edid(void)
 {
 	static unsigned char raw_edid[256] = {0};
+	static bool initialized;
 	struct edid *edid;
 	struct edid_ext *edid_ext;
 	struct edid_cea *edid_cea;
@@ -334,6 +533,9 @@ const struct edid *igt_kms_get_3d_edid(void)
 	struct hdmi_vsdb *hdmi;
 	size_t cea_data_size = 0;
 
+	if (initialized)
+		return (const struct edid *) raw_edid;
+
 	/* Create a new EDID from the base IGT EDID, and add an
 	 * extension that advertises 3D support. */
 	edid = (struct edid *) raw_edid;
@@ -368,6 +570,7 @@ const struct edid *igt_kms_get_3d_edid(void)
 	edid_ext_set_cea(edid_ext, cea_data_size, 0, 0);
 
 	edid_update_checksum(edid);
+	initialized = true;
 
 	return edid;
 }
@@ -1078,6 +1281,7 @@ bool kmstest_force_connector(int drm_fd, drmModeConnector *connector,
 
 	/* To allow callers to always use GetConnectorCurrent we need to force a
 	 * redetection here. */
+	probe_cache_invalidate();
 	temp = drmModeGetConnector(drm_fd, connector->connector_id);
 	drmModeFreeConnector(temp);
 
@@ -1117,6 +1321,7 @@ void kmstest_force_edid(int drm_fd, drmModeConnector *connector,
 
 	/* To allow callers to always use GetConnectorCurrent we need to force a
 	 * redetection here. */
+	probe_cache_invalidate();
 	temp = drmModeGetConnector(drm_fd, connector->connector_id);
 	drmModeFreeConnector(temp);
 
@@ -1251,6 +1456,9 @@ static bool _kmstest_connector_config(int drm_fd, uint32_t connector_id,
 		goto err3;
 	}
 
+	if (probe)
+		probe_cache_store(drm_fd, connector);
+
 	/*
 	 * Find given CRTC if crtc_id != 0 or else the first CRTC not in use.
 	 * In both cases find the first compatible encoder and skip the CRTC
@@ -1946,6 +2154,28 @@ void igt_display_reset(igt_display_t *display)
 	}
 }
 
+/**
+ * igt_display_set_keep_modeset:
+ * @display: a pointer to an #igt_display_t structure
+ * @keep: whether to keep pipes running across subtests
+ *
+ * Many tests turn all pipes off when a subtest ends, only to set the same
+ * mode again right away in the next subtest, which costs a full modeset and
+ * link training every time. With @keep set, an atomic commit that turns a
+ * pipe and its connectors off leaves them running instead, with just the
+ * planes disabled. The held back disable is committed along with the next
+ * commit, unless that commit uses the pipe again, in which case the kernel
+ * can skip the modeset if the mode and connectors are the same.
+ *
+ * This requires the driver to accept an active pipe without any planes, and
+ * must not be used by tests which check the pipe is really off after a
+ * commit. Legacy and universal commits always turn pipes off.
+ */
+void igt_display_set_keep_modeset(igt_display_t *display, bool keep)
+{
+	display->keep_modeset = keep;
+}
+
 static void igt_fill_plane_format_mod(igt_display_t *display, igt_plane_t *plane);
 static void igt_fill_display_format_mod(igt_display_t *display);
 
@@ -2126,7 +2356,8 @@ void igt_display_require(igt_display_t *display, int drm_fd)
 
 		connector = output->config.connector;
 		if (connector && (!connector->count_modes ||
-		    connector->connection == DRM_MODE_UNKNOWNCONNECTION)) {
+		    connector->connection == DRM_MODE_UNKNOWNCONNECTION) &&
+		    !probe_cache_valid(drm_fd, connector)) {
 			output->force_reprobe = true;
 			igt_output_refresh(output);
 		}
@@ -2546,6 +2777,129 @@ igt_output_t *igt_get_single_output_for_pipe(igt_display_t *display, enum pipe p
 	return chosen_outputs[pipe];
 }
 
+static void run_pipe_jobs(igt_display_t *display, igt_pipe_job_t *jobs,
+			  int count, igt_pipe_job_func_t prepare,
+			  igt_pipe_job_func_t check, igt_pipe_job_func_t finish,
+			  void *data)
+{
+	igt_pipe_crc_t *pipe_crcs[count];
+	igt_crc_t crcs[count];
+	int i, n_crcs = 0;
+
+	igt_display_reset(display);
+	for (i = 0; i < count; i++) {
+		igt_output_set_pipe(jobs[i].output, jobs[i].pipe);
+		jobs[i].pipe_crc = NULL;
+		prepare(display, &jobs[i], data);
+	}
+
+	/* Split up whatever doesn't fit in one go, e.g. for bandwidth */
+	if (count > 1 &&
+	    igt_display_try_commit_atomic(display,
+					  DRM_MODE_ATOMIC_TEST_ONLY |
+					  DRM_MODE_ATOMIC_ALLOW_MODESET,
+					  NULL)) {
+		igt_debug("Pipes don't fit together, running them one at a time\n");
+
+		for (i = 0; i < count; i++)
+			if (finish)
+				finish(display, &jobs[i], data);
+
+		for (i = 0; i < count; i++)
+			run_pipe_jobs(display, &jobs[i], 1,
+				      prepare, check, finish, data);
+		return;
+	}
+
+	igt_display_commit2(display, display->is_atomic ?
+			    COMMIT_ATOMIC : COMMIT_LEGACY);
+
+	for (i = 0; i < count; i++)
+		if (jobs[i].pipe_crc)
+			pipe_crcs[n_crcs++] = jobs[i].pipe_crc;
+
+	if (n_crcs)
+		igt_pipe_crc_collect_crcs(pipe_crcs, n_crcs, crcs);
+
+	for (i = 0, n_crcs = 0; i < count; i++)
+		if (jobs[i].pipe_crc)
+			jobs[i].crc = crcs[n_crcs++];
+
+	for (i = 0; i < count; i++) {
+		check(display, &jobs[i], data);
+		if (finish)
+			finish(display, &jobs[i], data);
+	}
+}
+
+/**
+ * igt_display_run_pipes:
+ * @display: a pointer to an #igt_display_t structure
+ * @prepare: sets up the state of a pipe
+ * @check: checks the results on a pipe
+ * @finish: releases the resources of a pipe set up by @prepare, or NULL
+ * @data: passed to the hooks
+ *
+ * Runs a per-pipe test on all pipes at once instead of one pipe after the
+ * other, each with its own output as chosen by
+ * for_each_pipe_with_single_output().
+ *
+ * @prepare is called for each pipe with its output already set, to set up
+ * the planes of the pipe. If it sets @pipe_crc of the #igt_pipe_job_t, a CRC
+ * of the pipe is captured into @crc after the commit. All pipes are then
+ * committed together, their CRCs captured in parallel, and @check is called
+ * for each of them.
+ *
+ * Pipes which can't be enabled at the same time, because they would need the
+ * same output or the commit fails due to e.g. bandwidth limits, are run one
+ * at a time. In the latter case @finish is called for each pipe which was
+ * prepared, and @prepare is then called again for each pipe on its own.
+ * Without atomic modesetting all pipes are run one at a time.
+ */
+void igt_display_run_pipes(igt_display_t *display,
+			   igt_pipe_job_func_t prepare,
+			   igt_pipe_job_func_t check,
+			   igt_pipe_job_func_t finish,
+			   void *data)
+{
+	igt_output_t *chosen_outputs[display->n_pipes];
+	igt_pipe_job_t jobs[display->n_pipes];
+	unsigned int todo = 0;
+	enum pipe pipe;
+
+	__igt_pipe_populate_outputs(display, chosen_outputs);
+	for_each_pipe(display, pipe)
+		if (chosen_outputs[pipe])
+			todo |= 1 << pipe;
+
+	while (todo) {
+		int count = 0;
+
+		for_each_pipe(display, pipe) {
+			bool busy = false;
+
+			if (!(todo & (1 << pipe)))
+				continue;
+
+			for (int i = 0; i < count; i++)
+				busy |= jobs[i].output == chosen_outputs[pipe];
+			if (busy)
+				continue;
+
+			memset(&jobs[count], 0, sizeof(jobs[count]));
+			jobs[count].pipe = pipe;
+			jobs[count].output = chosen_outputs[pipe];
+			count++;
+
+			todo &= ~(1 << pipe);
+			if (!display->is_atomic)
+				break;
+		}
+
+		run_pipe_jobs(display, jobs, count, prepare, check, finish, data);
+	}
+}
+
 static igt_output_t *igt_pipe_get_output(igt_pipe_t *pipe)
 {
 	igt_display_t *display = pipe->display;
@@ -2572,6 +2926,36 @@ static uint32_t igt_plane_get_fb_id(igt_plane_t *plane)
 	igt_assert_eq(r, 0);	\
 }
 
+/*
+ * Changed properties that already have the requested value in the kernel
+ * are left out of atomic commits, so that objects which don't actually
+ * change stay out of the commit altogether. The kernel's values are read
+ * back instead of remembered from our last commit, since raw ioctls from
+ * the tests, removing a framebuffer or the kernel itself (link status,
+ * content protection) all change them behind our back.
+ *
+ * Fences are one-shot, and a flip to the same framebuffer must still
+ * generate an event, so those are always added.
+ */
+#define IGT_PLANE_ALWAYS_COMMIT_MASK \
+	((1 << IGT_PLANE_FB_ID) | (1 << IGT_PLANE_IN_FENCE_FD))
+#define IGT_CRTC_ALWAYS_COMMIT_MASK \
+	(1 << IGT_CRTC_OUT_FENCE_PTR)
+
+static bool
+atomic_prop_is_current(drmModeObjectPropertiesPtr current, uint32_t prop_id,
+		       uint64_t value)
+{
+	if (!current)
+		return false;
+
+	for (int i = 0; i < current->count_props; i++)
+		if (current->props[i] == prop_id)
+			return current->prop_values[i] == value;
+
+	return false;
+}
+
 /*
  * Add position and fb changes of a plane to the atomic property set
  */
@@ -2580,10 +2964,16 @@ igt_atomic_prepare_plane_commit(igt_plane_t *plane, igt_pipe_t *pipe,
 	drmModeAtomicReq *req)
 {
 	igt_display_t *display = pipe->display;
+	drmModeObjectPropertiesPtr current = NULL;
 	int i;
 
 	igt_assert(plane->drm_plane);
 
+	if (plane->changed & ~IGT_PLANE_ALWAYS_COMMIT_MASK)
+		current = drmModeObjectGetProperties(display->drm_fd,
+						     plane->drm_plane->plane_id,
+						     DRM_MODE_OBJECT_PLANE);
+
 	LOG(display,
 	    "populating plane data: %s.%d, fb %u\n",
 	    kmstest_pipe_name(pipe->pipe),
@@ -2597,6 +2987,11 @@ igt_atomic_prepare_plane_commit(igt_plane_t *plane, igt_pipe_t *pipe,
 		/* it's an error to try an unsupported feature */
 		igt_assert(plane->props[i]);
 
+		if (!(IGT_PLANE_ALWAYS_COMMIT_MASK & (1 << i)) &&
+		    atomic_prop_is_current(current, plane->props[i],
+					   plane->values[i]))
+			continue;
+
 		igt_debug("plane %s.%d: Setting property \"%s\" to 0x%"PRIx64"/%"PRIi64"\n",
 			kmstest_pipe_name(pipe->pipe), plane->index, igt_plane_prop_names[i],
 			plane->values[i], plane->values[i]);
@@ -2605,6 +3000,8 @@ igt_atomic_prepare_plane_commit(igt_plane_t *plane, igt_pipe_t *pipe,
 						  plane->props[i],
 						  plane->values[i]));
 	}
+
+	drmModeFreeObjectProperties(current);
 }
 
 /*
@@ -3284,12 +3681,27 @@ igt_pipe_obj_replace_prop_blob(igt_pipe_t *pipe, enum igt_atomic_crtc_properties
  */
 static void igt_atomic_prepare_crtc_commit(igt_pipe_t *pipe_obj, drmModeAtomicReq *req)
 {
+	drmModeObjectPropertiesPtr current = NULL;
 	int i;
 
+	if (pipe_obj->changed & ~IGT_CRTC_ALWAYS_COMMIT_MASK)
+		current = drmModeObjectGetProperties(pipe_obj->display->drm_fd,
+						     pipe_obj->crtc_id,
+						     DRM_MODE_OBJECT_CRTC);
+
 	for (i = 0; i < IGT_NUM_CRTC_PROPS; i++) {
 		if (!igt_pipe_obj_is_prop_changed(pipe_obj, i))
 			continue;
 
+		if (!(IGT_CRTC_ALWAYS_COMMIT_MASK & (1 << i)) &&
+		    atomic_prop_is_current(current, pipe_obj->props[i],
+					   pipe_obj->values[i]))
+			continue;
+
+		if (pipe_obj->parking &&
+		    (i == IGT_CRTC_MODE_ID || i == IGT_CRTC_ACTIVE))
+			continue;
+
 		igt_debug("Pipe %s: Setting property \"%s\" to 0x%"PRIx64"/%"PRIi64"\n",
 			kmstest_pipe_name(pipe_obj->pipe), igt_crtc_prop_names[i],
 			pipe_obj->values[i], pipe_obj->values[i]);
@@ -3297,6 +3709,8 @@ static void igt_atomic_prepare_crtc_commit(igt_pipe_t *pipe_obj, drmModeAtomicRe
 		igt_assert_lt(0, drmModeAtomicAddProperty(req, pipe_obj->crtc_id, pipe_obj->props[i], pipe_obj->values[i]));
 	}
 
+	drmModeFreeObjectProperties(current);
+
 	if (pipe_obj->out_fence_fd != -1) {
 		close(pipe_obj->out_fence_fd);
 		pipe_obj->out_fence_fd = -1;
@@ -3308,9 +3722,14 @@ static void igt_atomic_prepare_crtc_commit(igt_pipe_t *pipe_obj, drmModeAtomicRe
  */
 static void igt_atomic_prepare_connector_commit(igt_output_t *output, drmModeAtomicReq *req)
 {
-
+	uint32_t connector_id = output->config.connector->connector_id;
+	drmModeObjectPropertiesPtr current;
 	int i;
 
+	current = drmModeObjectGetProperties(output->display->drm_fd,
+					     connector_id,
+					     DRM_MODE_OBJECT_CONNECTOR);
+
 	for (i = 0; i < IGT_NUM_CONNECTOR_PROPS; i++) {
 		if (!igt_output_is_prop_changed(output, i))
 			continue;
@@ -3318,15 +3737,118 @@ static void igt_atomic_prepare_connector_commit(igt_output_t *output, drmModeAto
 		/* it's an error to try an unsupported feature */
 		igt_assert(output->props[i]);
 
+		if (atomic_prop_is_current(current, output->props[i],
+					   output->values[i]))
+			continue;
+
+		if (output->parking && i == IGT_CONNECTOR_CRTC_ID)
+			continue;
+
 		igt_debug("%s: Setting property \"%s\" to 0x%"PRIx64"/%"PRIi64"\n",
 			  igt_output_name(output), igt_connector_prop_names[i],
 			  output->values[i], output->values[i]);
 
 		igt_assert_lt(0, drmModeAtomicAddProperty(req,
-					  output->config.connector->connector_id,
+					  connector_id,
 					  output->props[i],
 					  output->values[i]));
 	}
+
+	drmModeFreeObjectProperties(current);
+}
+
+static bool
+atomic_get_current_prop(int drm_fd, uint32_t obj_id, uint32_t obj_type,
+			uint32_t prop_id, uint64_t *value)
+{
+	drmModeObjectPropertiesPtr current;
+	bool found = false;
+
+	current = drmModeObjectGetProperties(drm_fd, obj_id, obj_type);
+	if (!current)
+		return false;
+
+	for (int i = 0; i < current->count_props; i++) {
+		if (current->props[i] == prop_id) {
+			*value = current->prop_values[i];
+			found = true;
+			break;
+		}
+	}
+
+	drmModeFreeObjectProperties(current);
+	return found;
+}
+
+/* Returns the pipe the kernel currently has @output on, if any */
+static igt_pipe_t *igt_output_get_current_pipe(igt_output_t *output)
+{
+	igt_display_t *display = output->display;
+	uint64_t crtc_id;
+	enum pipe pipe;
+
+	if (!output->config.connector ||
+	    !atomic_get_current_prop(display->drm_fd,
+				     output->config.connector->connector_id,
+				     DRM_MODE_OBJECT_CONNECTOR,
+				     output->props[IGT_CONNECTOR_CRTC_ID],
+				     &crtc_id))
+		return NULL;
+
+	for_each_pipe(display, pipe)
+		if (crtc_id && display->pipes[pipe].crtc_id == crtc_id)
+			return &display->pipes[pipe];
+
+	return NULL;
+}
+
+/*
+ * Work out which active pipes are turned off in this commit together with
+ * all their connectors, and hold that back with igt_display_set_keep_modeset().
+ */
+static void igt_atomic_prepare_parking(igt_display_t *display)
+{
+	bool parking = false;
+	uint64_t active;
+	enum pipe pipe;
+	int i;
+
+	for_each_pipe(display, pipe) {
+		igt_pipe_t *pipe_obj = &display->pipes[pipe];
+
+		pipe_obj->parking = display->keep_modeset && !pipe_obj->parked &&
+			igt_pipe_obj_is_prop_changed(pipe_obj, IGT_CRTC_ACTIVE) &&
+			!pipe_obj->values[IGT_CRTC_ACTIVE] &&
+			!pipe_obj->values[IGT_CRTC_MODE_ID] &&
+			atomic_get_current_prop(display->drm_fd, pipe_obj->crtc_id,
+						DRM_MODE_OBJECT_CRTC,
+						pipe_obj->props[IGT_CRTC_ACTIVE],
+						&active) && active;
+
+		parking |= pipe_obj->parking;
+	}
+
+	for (i = 0; i < display->n_outputs; i++)
+		display->outputs[i].parking = false;
+
+	if (!parking)
+		return;
+
+	/* A connector moving to another pipe needs its pipe turned off */
+	for (i = 0; i < display->n_outputs; i++) {
+		igt_output_t *output = &display->outputs[i];
+		igt_pipe_t *pipe_obj = igt_output_get_current_pipe(output);
+
+		if (pipe_obj && output->values[IGT_CONNECTOR_CRTC_ID])
+			pipe_obj->parking = false;
+	}
+
+	for (i = 0; i < display->n_outputs; i++) {
+		igt_output_t *output = &display->outputs[i];
+		igt_pipe_t *pipe_obj = igt_output_get_current_pipe(output);
+
+		output->parking = pipe_obj && pipe_obj->parking;
+	}
 }
 
 /*
@@ -3345,6 +3867,8 @@ static int igt_atomic_commit(igt_display_t *display, uint32_t flags, void *user_
 		return -1;
 	req = drmModeAtomicAlloc();
 
+	igt_atomic_prepare_parking(display);
+
 	for_each_pipe(display, pipe) {
 		igt_pipe_t *pipe_obj = &display->pipes[pipe];
 		igt_plane_t *plane;
@@ -3402,7 +3926,16 @@ display_commit_changed(igt_display_t *display, enum igt_commit_style s)
 
 			pipe_obj->values[IGT_CRTC_OUT_FENCE_PTR] = 0;
 			pipe_obj->changed = 0;
+
+			/* the held back disable goes into the next commit */
+			if (pipe_obj->parking) {
+				igt_pipe_obj_set_prop_changed(pipe_obj, IGT_CRTC_MODE_ID);
+				igt_pipe_obj_set_prop_changed(pipe_obj, IGT_CRTC_ACTIVE);
+			}
+			pipe_obj->parked = pipe_obj->parking;
 		} else {
+			pipe_obj->parked = false;
+
 			for (i = 0; i < IGT_NUM_CRTC_PROPS; i++)
 				if (!is_atomic_prop(i))
 					igt_pipe_obj_clear_prop_changed(pipe_obj, i);
@@ -3412,6 +3945,7 @@ display_commit_changed(igt_display_t *display, enum igt_commit_style s)
 				igt_pipe_obj_clear_prop_changed(pipe_obj, IGT_CRTC_ACTIVE);
 			}
 		}
+		pipe_obj->parking = false;
 
 		for_each_plane_on_pipe(display, pipe, plane) {
 			if (s == COMMIT_ATOMIC) {
@@ -3449,6 +3983,11 @@ display_commit_changed(igt_display_t *display, enum igt_commit_style s)
 		else
 			/* no modeset in universal commit, no change to crtc. */
 			output->changed &= 1 << IGT_CONNECTOR_CRTC_ID;
+
+		output->parked = s == COMMIT_ATOMIC && output->parking;
+		if (output->parked)
+			igt_output_set_prop_changed(output, IGT_CONNECTOR_CRTC_ID);
+		output->parking = false;
 	}
 
 	if (display->first_commit) {
@@ -3523,6 +4062,9 @@ static int do_display_commit(igt_display_t *display,
  * @user_data is returned in the event if you pass
  * DRM_MODE_PAGE_FLIP_EVENT to @flags.
  *
+ * Changed properties which already have the requested value in the
+ * kernel are left out of the commit, except for framebuffers and fences.
+ *
  * This function will return an error if commit fails, instead of
  * aborting the test.
  */
@@ -4214,6 +4756,9 @@ void igt_reset_connectors(void)
 		igt_sysfs_set(forced_connectors_device[i],
 			      forced_connectors[i],
 			      "detect");
+
+	if (forced_connectors[0])
+		probe_cache_invalidate();
 }
 
 #if !defined(ANDROID)
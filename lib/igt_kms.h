@@ -35,6 +35,7 @@
 
 #include <xf86drmMode.h>
 
+#include "igt_debugfs.h"
 #include "igt_fb.h"
 #include "ioctl_wrappers.h"
 
@@ -352,6 +353,9 @@ struct igt_pipe {
 	uint32_t crtc_id;
 
 	int32_t out_fence_fd;
+
+	/* disable held back by igt_display_set_keep_modeset() */
+	bool parking, parked;
 };
 
 typedef struct {
@@ -370,6 +374,9 @@ typedef struct {
 
 	uint32_t props[IGT_NUM_CONNECTOR_PROPS];
 	uint64_t values[IGT_NUM_CONNECTOR_PROPS];
+
+	/* disable held back by igt_display_set_keep_modeset() */
+	bool parking, parked;
 } igt_output_t;
 
 struct igt_display {
@@ -384,6 +391,7 @@ struct igt_display {
 	bool has_cursor_plane;
 	bool is_atomic;
 	bool first_commit;
+	bool keep_modeset;
 
 	uint64_t *modifiers;
 	uint32_t *formats;
@@ -393,6 +401,7 @@ struct igt_display {
 void igt_display_require(igt_display_t *display, int drm_fd);
 void igt_display_fini(igt_display_t *display);
 void igt_display_reset(igt_display_t *display);
+void igt_display_set_keep_modeset(igt_display_t *display, bool keep);
 int  igt_display_commit2(igt_display_t *display, enum igt_commit_style s);
 int  igt_display_commit(igt_display_t *display);
 int  igt_display_try_commit_atomic(igt_display_t *display, uint32_t flags, void *user_data);
@@ -542,6 +551,33 @@ igt_output_t **__igt_pipe_populate_outputs(igt_display_t *display,
 		for_each_if (*__output && \
 			     ((pipe) = (__output - __outputs), (output) = *__output, 1))
 
+/**
+ * igt_pipe_job_t:
+ * @pipe: pipe to run on
+ * @output: output driven by @pipe
+ * @pipe_crc: set by the prepare hook to capture a CRC of @pipe
+ * @crc: CRC of @pipe after the commit, if @pipe_crc is set
+ * @priv: for use by the test
+ *
+ * A single pipe's share of igt_display_run_pipes().
+ */
+typedef struct {
+	enum pipe pipe;
+	igt_output_t *output;
+	igt_pipe_crc_t *pipe_crc;
+	igt_crc_t crc;
+	void *priv;
+} igt_pipe_job_t;
+
+typedef void (*igt_pipe_job_func_t)(igt_display_t *display,
+				    igt_pipe_job_t *job, void *data);
+
+void igt_display_run_pipes(igt_display_t *display,
+			   igt_pipe_job_func_t prepare,
+			   igt_pipe_job_func_t check,
+			   igt_pipe_job_func_t finish,
+			   void *data);
+
 /**
  * for_each_valid_output_on_pipe:
  * @display: a pointer to an #igt_display_t structure
@@ -0,0 +1,331 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "igt_map.h"
+
+/**
+ * SECTION:igt_map
+ * @short_description: Hash map and LRU cache of intrusive nodes
+ * @title: Map
+ * @include: igt_map.h
+ *
+ * #igt_map stores structures embedding an #igt_map_node under its 64-bit
+ * key, in an open addressing table with linear probing which is grown to
+ * stay at most three quarters full. Inserting, looking up and removing a
+ * node take constant time on average, in place of walking an #igt_list.
+ * Removal shifts the following nodes of the probe sequence back instead
+ * of leaving tombstones behind, so lookups don't degrade as nodes come
+ * and go. Keys made of several fields need to be packed into the 64 bits.
+ *
+ * #igt_lru builds a cache of a bounded size on top, handing the least
+ * recently used node to an eviction callback once full.
+ *
+ * Neither allocates nor frees the nodes, and neither is thread-safe.
+ */
+
+#define MIN_SLOTS 16
+
+static unsigned int slot(const struct igt_map *map, uint64_t key)
+{
+	/* The splitmix64 finalizer, spreading out sequential keys */
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ull;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebull;
+	key ^= key >> 31;
+
+	return key & map->mask;
+}
+
+static void resize(struct igt_map *map, unsigned int size)
+{
+	struct igt_map_node **old = map->slots;
+	unsigned int old_size = old ? map->mask + 1 : 0;
+
+	map->slots = calloc(size, sizeof(*map->slots));
+	igt_assert(map->slots);
+	map->mask = size - 1;
+
+	for (unsigned int i = 0; i < old_size; i++) {
+		unsigned int j;
+
+		if (!old[i])
+			continue;
+
+		for (j = slot(map, old[i]->key); map->slots[j];
+		     j = (j + 1) & map->mask)
+			;
+		map->slots[j] = old[i];
+	}
+
+	free(old);
+}
+
+/**
+ * igt_map_init:
+ * @map: the map to initialize
+ *
+ * Initializes @map to be empty. No memory is allocated until the first
+ * insertion.
+ */
+void igt_map_init(struct igt_map *map)
+{
+	memset(map, 0, sizeof(*map));
+}
+
+/**
+ * igt_map_fini:
+ * @map: the map to release
+ *
+ * Frees the table of @map and leaves it empty. The nodes still in it are
+ * left alone.
+ */
+void igt_map_fini(struct igt_map *map)
+{
+	free(map->slots);
+	igt_map_init(map);
+}
+
+/**
+ * igt_map_insert:
+ * @map: the map to insert into
+ * @node: the node to insert, with its key set
+ *
+ * Inserts @node into @map under @node->key, unless a node with the same
+ * key is already there.
+ *
+ * Returns: NULL once inserted, or the node already stored under the key.
+ */
+struct igt_map_node *igt_map_insert(struct igt_map *map,
+				    struct igt_map_node *node)
+{
+	unsigned int i;
+
+	if (!map->slots || (map->count + 1) * 4 > (map->mask + 1) * 3)
+		resize(map, map->slots ? 2 * (map->mask + 1) : MIN_SLOTS);
+
+	for (i = slot(map, node->key); map->slots[i]; i = (i + 1) & map->mask)
+		if (map->slots[i]->key == node->key)
+			return map->slots[i];
+
+	map->slots[i] = node;
+	map->count++;
+
+	return NULL;
+}
+
+static int find_slot(const struct igt_map *map, uint64_t key)
+{
+	unsigned int i;
+
+	if (!map->slots)
+		return -1;
+
+	for (i = slot(map, key); map->slots[i]; i = (i + 1) & map->mask)
+		if (map->slots[i]->key == key)
+			return i;
+
+	return -1;
+}
+
+/**
+ * igt_map_find:
+ * @map: the map to search
+ * @key: the key to look up
+ *
+ * Returns: The node stored under @key in @map, or NULL.
+ */
+struct igt_map_node *igt_map_find(const struct igt_map *map, uint64_t key)
+{
+	int i = find_slot(map, key);
+
+	return i < 0 ? NULL : map->slots[i];
+}
+
+/**
+ * igt_map_remove:
+ * @map: the map to remove from
+ * @key: the key of the node to remove
+ *
+ * Removes the node stored under @key from @map.
+ *
+ * Returns: The removed node, or NULL if there was none.
+ */
+struct igt_map_node *igt_map_remove(struct igt_map *map, uint64_t key)
+{
+	struct igt_map_node *node;
+	unsigned int hole, j;
+	int i;
+
+	i = find_slot(map, key);
+	if (i < 0)
+		return NULL;
+
+	node = map->slots[i];
+
+	/*
+	 * Move back into the hole each following node of the probe run
+	 * whose home slot isn't cyclically within (hole, j], as lookups
+	 * for it would otherwise stop at the hole.
+	 */
+	hole = i;
+	for (j = (hole + 1) & map->mask; map->slots[j];
+	     j = (j + 1) & map->mask) {
+		unsigned int home = slot(map, map->slots[j]->key);
+		bool stays;
+
+		if (j > hole)
+			stays = home > hole && home <= j;
+		else
+			stays = home > hole || home <= j;
+
+		if (!stays) {
+			map->slots[hole] = map->slots[j];
+			hole = j;
+		}
+	}
+
+	map->slots[hole] = NULL;
+	map->count--;
+
+	return node;
+}
+
+/**
+ * igt_lru_init:
+ * @lru: the cache to initialize
+ * @capacity: how many nodes to keep, at least one
+ * @evict: called with each node dropped from the cache, may be NULL
+ *
+ * Initializes @lru to be empty.
+ */
+void igt_lru_init(struct igt_lru *lru, unsigned int capacity,
+		  void (*evict)(struct igt_lru *lru,
+				struct igt_lru_node *node))
+{
+	igt_assert(capacity > 0);
+
+	igt_map_init(&lru->map);
+	igt_list_init(&lru->list);
+	lru->capacity = capacity;
+	lru->evict = evict;
+}
+
+static void evict_last(struct igt_lru *lru)
+{
+	struct igt_lru_node *node;
+
+	node = igt_list_last_entry(&lru->list, node, link);
+	igt_lru_remove(lru, node);
+	if (lru->evict)
+		lru->evict(lru, node);
+}
+
+/**
+ * igt_lru_fini:
+ * @lru: the cache to release
+ *
+ * Evicts all nodes left in @lru, least recently used first, and frees
+ * its table.
+ */
+void igt_lru_fini(struct igt_lru *lru)
+{
+	while (!igt_list_empty(&lru->list))
+		evict_last(lru);
+
+	igt_map_fini(&lru->map);
+}
+
+/**
+ * igt_lru_insert:
+ * @lru: the cache to insert into
+ * @node: the node to insert, with its @map.key set
+ *
+ * Inserts @node into @lru as the most recently used node, unless a node
+ * with the same key is already there. Evicts the least recently used
+ * node if that takes @lru over its capacity.
+ *
+ * Returns: NULL once inserted, or the node already stored under the key.
+ */
+struct igt_lru_node *igt_lru_insert(struct igt_lru *lru,
+				    struct igt_lru_node *node)
+{
+	struct igt_map_node *old;
+	struct igt_lru_node *n;
+
+	old = igt_map_insert(&lru->map, &node->map);
+	if (old)
+		return container_of(old, n, map);
+
+	igt_list_add(&node->link, &lru->list);
+
+	if (igt_lru_count(lru) > lru->capacity)
+		evict_last(lru);
+
+	return NULL;
+}
+
+/**
+ * igt_lru_find:
+ * @lru: the cache to search
+ * @key: the key to look up
+ *
+ * Looks up the node stored under @key and makes it the most recently
+ * used one.
+ *
+ * Returns: The node found, or NULL.
+ */
+struct igt_lru_node *igt_lru_find(struct igt_lru *lru, uint64_t key)
+{
+	struct igt_map_node *m = igt_map_find(&lru->map, key);
+	struct igt_lru_node *node;
+
+	if (!m)
+		return NULL;
+
+	node = container_of(m, node, map);
+	igt_list_move(&node->link, &lru->list);
+
+	return node;
+}
+
+/**
+ * igt_lru_remove:
+ * @lru: the cache to remove from
+ * @node: a node stored in @lru
+ *
+ * Removes @node from @lru without calling the eviction callback.
+ */
+void igt_lru_remove(struct igt_lru *lru, struct igt_lru_node *node)
+{
+	struct igt_map_node *m = igt_map_remove(&lru->map, node->map.key);
+
+	igt_assert(m == &node->map);
+	igt_list_del(&node->link);
+}
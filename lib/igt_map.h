@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#ifndef IGT_MAP_H
+#define IGT_MAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "igt_list.h"
+
+/**
+ * igt_map_node:
+ * @key: the key the node is stored under
+ *
+ * Embedded in the structures kept in an #igt_map, which only stores
+ * pointers to the nodes and never allocates or frees them.
+ */
+struct igt_map_node {
+	uint64_t key;
+};
+
+/**
+ * igt_map:
+ *
+ * Intrusive hash map from 64-bit keys to #igt_map_node, with open
+ * addressing and linear probing. Initialize with igt_map_init(), or
+ * zero-initialize.
+ */
+struct igt_map {
+	struct igt_map_node **slots;
+	unsigned int mask;
+	unsigned int count;
+};
+
+void igt_map_init(struct igt_map *map);
+void igt_map_fini(struct igt_map *map);
+
+struct igt_map_node *igt_map_insert(struct igt_map *map,
+				    struct igt_map_node *node);
+struct igt_map_node *igt_map_find(const struct igt_map *map, uint64_t key);
+struct igt_map_node *igt_map_remove(struct igt_map *map, uint64_t key);
+
+static inline unsigned int igt_map_count(const struct igt_map *map)
+{
+	return map->count;
+}
+
+/**
+ * igt_map_for_each:
+ * @map: the map to iterate over
+ * @i: unsigned int slot iterator
+ * @node: struct igt_map_node pointer set to each node in turn
+ *
+ * Iterates over the nodes of @map in no particular order. The map must
+ * not be modified while iterating.
+ */
+#define igt_map_for_each(map, i, node)					\
+	for ((i) = 0; (map)->slots && (i) <= (map)->mask; (i)++)	\
+		if (((node) = (map)->slots[(i)]) != NULL)
+
+/**
+ * igt_lru_node:
+ * @map: node in the map of the cache, holding the key
+ * @link: position in the recently used order
+ */
+struct igt_lru_node {
+	struct igt_map_node map;
+	struct igt_list link;
+};
+
+/**
+ * igt_lru:
+ *
+ * Cache holding up to a given number of #igt_lru_node, evicting the
+ * least recently used one past that.
+ */
+struct igt_lru {
+	struct igt_map map;
+	struct igt_list list;
+	unsigned int capacity;
+	void (*evict)(struct igt_lru *lru, struct igt_lru_node *node);
+};
+
+void igt_lru_init(struct igt_lru *lru, unsigned int capacity,
+		  void (*evict)(struct igt_lru *lru,
+				struct igt_lru_node *node));
+void igt_lru_fini(struct igt_lru *lru);
+
+struct igt_lru_node *igt_lru_insert(struct igt_lru *lru,
+				    struct igt_lru_node *node);
+struct igt_lru_node *igt_lru_find(struct igt_lru *lru, uint64_t key);
+void igt_lru_remove(struct igt_lru *lru, struct igt_lru_node *node);
+
+static inline unsigned int igt_lru_count(const struct igt_lru *lru)
+{
+	return igt_map_count(&lru->map);
+}
+
+#endif /* IGT_MAP_H */
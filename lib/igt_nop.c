@@ -0,0 +1,346 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_nop.h"
+#include "intel_chipset.h"
+#include "intel_reg.h"
+#include "ioctl_wrappers.h"
+
+/**
+ * SECTION:igt_nop
+ * @short_description: Batches keeping an engine busy for a given time
+ * @title: Nop calibration
+ * @include: igt_nop.h
+ *
+ * A batch of MI_NOOPs is the simplest way of keeping an engine busy for a
+ * known amount of time, given how many of them the engine gets through per
+ * microsecond. igt_nop_calibrate() measures that, for one engine, by
+ * resizing a batch until its execution time settles at
+ * #IGT_NOP_CALIBRATION_US.
+ *
+ * As the calibration takes a few seconds it is kept in a cache file, keyed
+ * by the PCI id of the device, the kernel release and the engine, so that
+ * igt_nop_calibration() only measures the engines it has not seen on this
+ * machine before. The cache lives in $XDG_CACHE_HOME/igt-gpu-tools, or
+ * ~/.cache/igt-gpu-tools, unless the IGT_NOP_CACHE environment variable
+ * names another file; an empty IGT_NOP_CACHE disables it.
+ *
+ * igt_nop_batch() then creates batches lasting a given number of
+ * microseconds on the engine, for benchmarks to load it with.
+ */
+
+#define CALIBRATION_MIN_NS (5ull * 1000 * 1000 * 1000)
+#define DEFAULT_TOLERANCE_PCT 1
+
+static struct {
+	uint16_t devid;
+	unsigned int engine;
+	unsigned long value;
+} known[16];
+static unsigned int nr_known;
+
+static void remember(uint16_t devid, unsigned int engine, unsigned long value)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_known; i++)
+		if (known[i].devid == devid && known[i].engine == engine)
+			break;
+
+	if (i == ARRAY_SIZE(known))
+		return;
+	if (i == nr_known)
+		nr_known++;
+
+	known[i].devid = devid;
+	known[i].engine = engine;
+	known[i].value = value;
+}
+
+static const char *cache_dir(const char *base, const char *sub,
+			     char *buf, size_t len)
+{
+	snprintf(buf, len, "%s%s", base, sub);
+	if (mkdir(buf, 0755) && errno != EEXIST)
+		return NULL;
+
+	return buf;
+}
+
+static const char *cache_path(char *buf, size_t len)
+{
+	char dir[PATH_MAX];
+	const char *env;
+
+	env = getenv("IGT_NOP_CACHE");
+	if (env)
+		return *env ? env : NULL;
+
+	env = getenv("XDG_CACHE_HOME");
+	if (env && *env) {
+		if (!cache_dir(env, "/igt-gpu-tools", dir, sizeof(dir)))
+			return NULL;
+	} else {
+		env = getenv("HOME");
+		if (!env || !cache_dir(env, "/.cache", dir, sizeof(dir)) ||
+		    !cache_dir(env, "/.cache/igt-gpu-tools", dir, sizeof(dir)))
+			return NULL;
+	}
+
+	snprintf(buf, len, "%s/nop-calibration", dir);
+	return buf;
+}
+
+static void cache_key(uint16_t devid, unsigned int engine,
+		      char *buf, size_t len)
+{
+	struct utsname uts;
+
+	if (uname(&uts))
+		strcpy(uts.release, "unknown");
+
+	/* "<pci id> <kernel release> <engine> ", the value follows */
+	snprintf(buf, len, "%04x %s %u ", devid, uts.release, engine);
+}
+
+static unsigned long cache_lookup(uint16_t devid, unsigned int engine)
+{
+	char path[PATH_MAX], key[128];
+	unsigned long value = 0;
+	size_t len = 0;
+	char *line = NULL;
+	FILE *file;
+
+	if (!cache_path(path, sizeof(path)))
+		return 0;
+
+	file = fopen(path, "r");
+	if (!file)
+		return 0;
+
+	cache_key(devid, engine, key, sizeof(key));
+	while (getline(&line, &len, file) > 0) {
+		if (!strncmp(line, key, strlen(key))) {
+			value = strtoul(line + strlen(key), NULL, 0);
+			break;
+		}
+	}
+
+	free(line);
+	fclose(file);
+
+	return value;
+}
+
+static void cache_store(uint16_t devid, unsigned int engine,
+			unsigned long value)
+{
+	char path[PATH_MAX], tmp[PATH_MAX + 16], key[128];
+	FILE *old, *new;
+
+	if (!cache_path(path, sizeof(path)))
+		return;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+	new = fopen(tmp, "w");
+	if (!new)
+		return;
+
+	cache_key(devid, engine, key, sizeof(key));
+
+	/* Copy over the other entries, then replace the whole file at once */
+	old = fopen(path, "r");
+	if (old) {
+		size_t len = 0;
+		char *line = NULL;
+
+		while (getline(&line, &len, old) > 0)
+			if (strncmp(line, key, strlen(key)))
+				fputs(line, new);
+
+		free(line);
+		fclose(old);
+	}
+
+	fprintf(new, "%s%lu\n", key, value);
+
+	if (fclose(new) || rename(tmp, path)) {
+		igt_debug("Failed to write the nop calibration cache %s\n",
+			  path);
+		unlink(tmp);
+	}
+}
+
+/**
+ * igt_nop_calibrate:
+ * @i915: open i915 drm file descriptor
+ * @engine: the execbuf engine selector, as in I915_EXEC_RENDER
+ * @tolerance_pct: how close successive estimates need to be, in percent
+ *
+ * Measures, over at least five seconds, how many MI_NOOPs @engine executes
+ * in #IGT_NOP_CALIBRATION_US microseconds, resizing the nop batch until
+ * successive estimates agree to within @tolerance_pct. The result replaces
+ * any cached calibration of @engine.
+ *
+ * Returns: The number of MI_NOOPs.
+ */
+unsigned long igt_nop_calibrate(int i915, unsigned int engine,
+				unsigned int tolerance_pct)
+{
+	const uint16_t devid = intel_get_drm_devid(i915);
+	const uint32_t bbe = MI_BATCH_BUFFER_END;
+	const unsigned int loops = 17;
+	struct drm_i915_gem_exec_object2 obj = {};
+	struct drm_i915_gem_execbuffer2 eb = {
+		.buffers_ptr = to_user_pointer(&obj),
+		.buffer_count = 1,
+		.flags = engine,
+	};
+	struct timespec t_0 = {};
+	long size, last_size;
+	unsigned long value;
+
+	igt_nsec_elapsed(&t_0);
+
+	size = 256 * 1024;
+	do {
+		struct timespec t_start = {};
+		uint64_t ns;
+
+		obj.handle = gem_create(i915, size);
+		gem_write(i915, obj.handle, size - sizeof(bbe),
+			  &bbe, sizeof(bbe));
+		gem_execbuf(i915, &eb);
+		gem_sync(i915, obj.handle);
+
+		igt_nsec_elapsed(&t_start);
+		for (int loop = 0; loop < loops; loop++)
+			gem_execbuf(i915, &eb);
+		gem_sync(i915, obj.handle);
+		ns = igt_nsec_elapsed(&t_start);
+
+		gem_close(i915, obj.handle);
+
+		last_size = size;
+		size = 1e3 * loops * size / ns * IGT_NOP_CALIBRATION_US;
+		size = ALIGN(size, sizeof(uint32_t));
+	} while (igt_nsec_elapsed(&t_0) < CALIBRATION_MIN_NS ||
+		 labs(size - last_size) > size * tolerance_pct / 100);
+
+	value = size / sizeof(uint32_t);
+	remember(devid, engine, value);
+	cache_store(devid, engine, value);
+
+	return value;
+}
+
+/**
+ * igt_nop_calibration:
+ * @i915: open i915 drm file descriptor
+ * @engine: the execbuf engine selector, as in I915_EXEC_RENDER
+ *
+ * Looks up how many MI_NOOPs @engine executes in #IGT_NOP_CALIBRATION_US
+ * microseconds, first in the calibrations of this process, then in the
+ * cache file, calibrating @engine with igt_nop_calibrate() if neither has
+ * it.
+ *
+ * Returns: The number of MI_NOOPs.
+ */
+unsigned long igt_nop_calibration(int i915, unsigned int engine)
+{
+	const uint16_t devid = intel_get_drm_devid(i915);
+	unsigned long value;
+
+	for (unsigned int i = 0; i < nr_known; i++)
+		if (known[i].devid == devid && known[i].engine == engine)
+			return known[i].value;
+
+	value = cache_lookup(devid, engine);
+	if (value) {
+		igt_debug("Using the cached nop calibration of engine %u: %lu\n",
+			  engine, value);
+		remember(devid, engine, value);
+		return value;
+	}
+
+	return igt_nop_calibrate(i915, engine, DEFAULT_TOLERANCE_PCT);
+}
+
+/**
+ * igt_nop_batch_size:
+ * @i915: open i915 drm file descriptor
+ * @engine: the execbuf engine selector, as in I915_EXEC_RENDER
+ * @usecs: how long the batch is to execute for
+ *
+ * Returns: The size in bytes of a nop batch executing for @usecs on @engine,
+ * according to igt_nop_calibration().
+ */
+uint64_t igt_nop_batch_size(int i915, unsigned int engine, unsigned int usecs)
+{
+	uint64_t nops = igt_nop_calibration(i915, engine);
+
+	/* The MI_BATCH_BUFFER_END included, in whole qwords */
+	return ALIGN(usecs * nops / IGT_NOP_CALIBRATION_US + 1,
+		     sizeof(uint64_t)) * sizeof(uint32_t);
+}
+
+/**
+ * igt_nop_batch:
+ * @i915: open i915 drm file descriptor
+ * @engine: the execbuf engine selector, as in I915_EXEC_RENDER
+ * @usecs: how long the batch is to execute for
+ * @size: where to store the length of the batch, may be NULL
+ *
+ * Creates a batch of MI_NOOPs ending with an MI_BATCH_BUFFER_END, sized to
+ * keep @engine busy for @usecs.
+ *
+ * Returns: The handle of the batch.
+ */
+uint32_t igt_nop_batch(int i915, unsigned int engine, unsigned int usecs,
+		       uint64_t *size)
+{
+	const uint32_t bbe = MI_BATCH_BUFFER_END;
+	uint64_t sz = igt_nop_batch_size(i915, engine, usecs);
+	uint32_t handle;
+
+	handle = gem_create(i915, sz);
+	gem_write(i915, handle, sz - sizeof(bbe), &bbe, sizeof(bbe));
+
+	if (size)
+		*size = sz;
+
+	return handle;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#ifndef __IGT_NOP_H__
+#define __IGT_NOP_H__
+
+#include <stdint.h>
+
+/* The calibrations count the MI_NOOPs executed in this many microseconds */
+#define IGT_NOP_CALIBRATION_US 1000
+
+unsigned long igt_nop_calibrate(int i915, unsigned int engine,
+				unsigned int tolerance_pct);
+unsigned long igt_nop_calibration(int i915, unsigned int engine);
+
+uint64_t igt_nop_batch_size(int i915, unsigned int engine,
+			    unsigned int usecs);
+uint32_t igt_nop_batch(int i915, unsigned int engine, unsigned int usecs,
+		       uint64_t *size);
+
+#endif /* __IGT_NOP_H__ */
@@ -0,0 +1,247 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_parallel.h"
+
+/**
+ * SECTION:igt_parallel
+ * @short_description: Split cpu bound work across a pool of threads
+ * @title: Parallel
+ * @include: igt_parallel.h
+ *
+ * Some of the library helpers, like the pixel format conversions of
+ * igt_fb, spend a lot of cpu time on work that is trivially split into
+ * independent stripes of rows. igt_parallel_stripes() hands out such
+ * stripes to a small pool of worker threads, which is started on first use
+ * and kept around for the lifetime of the process.
+ *
+ * The pool has one thread per online cpu, including the calling thread.
+ * The IGT_THREADS environment variable overrides that, with IGT_THREADS=1
+ * doing all of the work in the calling thread.
+ *
+ * The stripe callbacks run on other threads than the test itself, so they
+ * must not use igt_assert() and friends. Check everything that can fail
+ * before splitting the work.
+ */
+
+#define MAX_THREADS 64
+
+static struct igt_parallel_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pthread_mutex_t submit;
+
+	pid_t pid;
+	unsigned int nthreads;
+
+	igt_parallel_fn_t fn;
+	void *data;
+	unsigned int count;
+	unsigned int stripe;
+	unsigned int next;
+	unsigned int pending;
+} pool;
+
+static __thread bool pool_worker;
+
+static bool run_stripe(struct igt_parallel_pool *p)
+{
+	igt_parallel_fn_t fn = p->fn;
+	void *data = p->data;
+	unsigned int start, end;
+
+	/* Called with the lock held, returns with it held */
+	if (p->next >= p->count)
+		return false;
+
+	start = p->next;
+	end = start + p->stripe;
+	if (end > p->count)
+		end = p->count;
+	p->next = end;
+
+	pthread_mutex_unlock(&p->lock);
+	fn(data, start, end);
+	pthread_mutex_lock(&p->lock);
+
+	if (--p->pending == 0)
+		pthread_cond_signal(&p->done);
+
+	return true;
+}
+
+static void *pool_thread(void *arg)
+{
+	struct igt_parallel_pool *p = arg;
+
+	pool_worker = true;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (!run_stripe(p))
+			pthread_cond_wait(&p->work, &p->lock);
+	}
+
+	return NULL;
+}
+
+static unsigned int pool_size(void)
+{
+	const char *env = getenv("IGT_THREADS");
+	long n;
+
+	if (env)
+		n = atoi(env);
+	else
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n < 1)
+		n = 1;
+	if (n > MAX_THREADS)
+		n = MAX_THREADS;
+
+	return n;
+}
+
+static void pool_init(struct igt_parallel_pool *p)
+{
+	pthread_attr_t attr;
+	sigset_t all, old;
+	unsigned int n;
+
+	/*
+	 * Also taken when we are a fork of a process that already had a pool.
+	 * Its threads did not come along, so start over from scratch.
+	 */
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_mutex_init(&p->submit, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+	p->pid = getpid();
+	p->count = p->next = p->pending = 0;
+
+	n = pool_size();
+
+	/* Leave all signals to the test's own threads */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	p->nthreads = 1;
+	while (p->nthreads < n) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, &attr, pool_thread, p))
+			break;
+
+		p->nthreads++;
+	}
+
+	pthread_attr_destroy(&attr);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (p->nthreads < n)
+		igt_debug("Only started %u of %u threads\n", p->nthreads, n);
+}
+
+/**
+ * igt_parallel_threads:
+ *
+ * Returns:
+ * The number of threads igt_parallel_stripes() splits the work across,
+ * including the calling thread.
+ */
+unsigned int igt_parallel_threads(void)
+{
+	if (pool.pid != getpid())
+		pool_init(&pool);
+
+	return pool.nthreads;
+}
+
+/**
+ * igt_parallel_stripes:
+ * @count: number of items
+ * @align: stripe sizes are a multiple of this, except for the last stripe
+ * @fn: callback for each stripe
+ * @data: user data passed to @fn
+ *
+ * Splits the items [0, @count) into contiguous stripes and calls @fn for
+ * each of them, in parallel on the thread pool and the calling thread. This
+ * returns once all stripes are complete.
+ *
+ * When called from within a stripe callback or with a single thread, @fn
+ * is simply called once for all of the items.
+ */
+void igt_parallel_stripes(unsigned int count, unsigned int align,
+			  igt_parallel_fn_t fn, void *data)
+{
+	struct igt_parallel_pool *p = &pool;
+	unsigned int stripes;
+
+	if (!count)
+		return;
+
+	if (!align)
+		align = 1;
+
+	stripes = count / align;
+	if (!pool_worker && stripes > 1 && igt_parallel_threads() > 1) {
+		if (stripes > p->nthreads)
+			stripes = p->nthreads;
+
+		pthread_mutex_lock(&p->submit);
+		pthread_mutex_lock(&p->lock);
+
+		p->fn = fn;
+		p->data = data;
+		p->count = count;
+		p->stripe = (count / align + stripes - 1) / stripes * align;
+		p->next = 0;
+		p->pending = (count + p->stripe - 1) / p->stripe;
+
+		pthread_cond_broadcast(&p->work);
+
+		while (run_stripe(p))
+			;
+		while (p->pending)
+			pthread_cond_wait(&p->done, &p->lock);
+
+		pthread_mutex_unlock(&p->lock);
+		pthread_mutex_unlock(&p->submit);
+		return;
+	}
+
+	fn(data, 0, count);
+}
@@ -628,3 +628,175 @@ bool igt_wait_for_pm_status(enum igt_runtime_pm_status status)
 {
 	return igt_wait(igt_get_runtime_pm_status() == status, 10000, 100);
 }
+
+/* The status is sampled more and more slowly while waiting, up to every 1ms */
+#define PM_POLL_MIN_US 10
+#define PM_POLL_MAX_US 1000
+#define PM_LATENCY_TIMEOUT_NS (10 * 1000000000ull)
+
+static enum igt_runtime_pm_status __igt_get_runtime_pm_status(void)
+{
+	static const char * const names[] = {
+		[IGT_RUNTIME_PM_STATUS_ACTIVE] = "active",
+		[IGT_RUNTIME_PM_STATUS_SUSPENDED] = "suspended",
+		[IGT_RUNTIME_PM_STATUS_SUSPENDING] = "suspending",
+		[IGT_RUNTIME_PM_STATUS_RESUMING] = "resuming",
+	};
+	char buf[32];
+	ssize_t len;
+
+	len = pread(pm_status_fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return IGT_RUNTIME_PM_STATUS_UNKNOWN;
+	buf[len] = '\0';
+	strchomp(buf);
+
+	for (int i = 0; i < ARRAY_SIZE(names); i++)
+		if (!strcmp(buf, names[i]))
+			return i;
+
+	return IGT_RUNTIME_PM_STATUS_UNKNOWN;
+}
+
+/*
+ * Polls the runtime status until it reads @status, returning the time since
+ * @start taken before the read which saw it.
+ */
+static int64_t pm_status_wait_ns(enum igt_runtime_pm_status status,
+				 struct timespec *start)
+{
+	unsigned int interval_us = PM_POLL_MIN_US;
+
+	for (;;) {
+		uint64_t elapsed = igt_nsec_elapsed(start);
+
+		if (__igt_get_runtime_pm_status() == status)
+			return elapsed;
+
+		if (elapsed > PM_LATENCY_TIMEOUT_NS)
+			return -ETIMEDOUT;
+
+		usleep(interval_us);
+		interval_us = min(2 * interval_us, PM_POLL_MAX_US);
+	}
+}
+
+static uint64_t pm_suspended_time_ms(void)
+{
+	uint64_t value = 0;
+	char buf[32];
+	int fd, len;
+
+	fd = open(POWER_DIR "/runtime_suspended_time", O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	len = read(fd, buf, sizeof(buf) - 1);
+	if (len > 0) {
+		buf[len] = '\0';
+		value = strtoull(buf, NULL, 10);
+	}
+	close(fd);
+
+	return value;
+}
+
+/**
+ * igt_pm_latency_init:
+ * @lat: the latencies to initialize
+ *
+ * Initializes the histograms of @lat for igt_pm_measure_resume() and
+ * igt_pm_measure_suspend().
+ */
+void igt_pm_latency_init(struct igt_pm_latency *lat)
+{
+	igt_histogram_init(&lat->resume);
+	igt_histogram_init(&lat->suspend);
+}
+
+/**
+ * igt_pm_latency_fini:
+ * @lat: the latencies to free
+ */
+void igt_pm_latency_fini(struct igt_pm_latency *lat)
+{
+	igt_histogram_fini(&lat->resume);
+	igt_histogram_fini(&lat->suspend);
+}
+
+/**
+ * igt_pm_measure_resume:
+ * @lat: (optional): where to record the latency
+ * @trigger: function waking the device up, e.g. with an ioctl or a modeset
+ * @data: argument for @trigger
+ *
+ * Waits for the device to be runtime suspended, then measures the time from
+ * calling @trigger until the runtime status reads active. Requires
+ * igt_setup_runtime_pm().
+ *
+ * Returns: The resume latency in ns, or -ETIMEDOUT if the device did not
+ * suspend or resume within 10 seconds.
+ */
+int64_t igt_pm_measure_resume(struct igt_pm_latency *lat,
+			      void (*trigger)(void *data), void *data)
+{
+	struct timespec start = {};
+	int64_t ret;
+
+	igt_assert(pm_status_fd >= 0);
+
+	if (!igt_wait_for_pm_status(IGT_RUNTIME_PM_STATUS_SUSPENDED))
+		return -ETIMEDOUT;
+
+	igt_nsec_elapsed(&start);
+	trigger(data);
+
+	ret = pm_status_wait_ns(IGT_RUNTIME_PM_STATUS_ACTIVE, &start);
+	if (ret >= 0 && lat)
+		igt_histogram_add(&lat->resume, ret);
+
+	return ret;
+}
+
+/**
+ * igt_pm_measure_suspend:
+ * @lat: (optional): where to record the latency
+ * @trigger: (optional): function releasing the device, e.g. disabling the
+ *	     screens or closing a file
+ * @data: argument for @trigger
+ *
+ * Measures the time from calling @trigger, or from now, until the device
+ * is runtime suspended. As the status is polled ever more slowly, the time
+ * the kernel accounts in runtime_suspended_time by then is taken off the
+ * latency. Requires igt_setup_runtime_pm(), which also sets the
+ * autosuspend delay to 0.
+ *
+ * Returns: The suspend latency in ns, or -ETIMEDOUT if the device did not
+ * suspend within 10 seconds.
+ */
+int64_t igt_pm_measure_suspend(struct igt_pm_latency *lat,
+			       void (*trigger)(void *data), void *data)
+{
+	struct timespec start = {};
+	uint64_t suspended;
+	int64_t ret;
+
+	igt_assert(pm_status_fd >= 0);
+
+	suspended = pm_suspended_time_ms();
+	igt_nsec_elapsed(&start);
+	if (trigger)
+		trigger(data);
+
+	ret = pm_status_wait_ns(IGT_RUNTIME_PM_STATUS_SUSPENDED, &start);
+	if (ret < 0)
+		return ret;
+
+	suspended = (pm_suspended_time_ms() - suspended) * 1000000;
+	ret = suspended < ret ? ret - suspended : 0;
+
+	if (lat)
+		igt_histogram_add(&lat->suspend, ret);
+
+	return ret;
+}
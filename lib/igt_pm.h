@@ -24,6 +24,8 @@
 #ifndef IGT_PM_H
 #define IGT_PM_H
 
+#include "igt_stats.h"
+
 void igt_pm_enable_audio_runtime_pm(void);
 int8_t *igt_pm_enable_sata_link_power_management(void);
 void igt_pm_restore_sata_link_power_management(int8_t *pm_data);
@@ -51,4 +53,21 @@ void igt_restore_runtime_pm(void);
 enum igt_runtime_pm_status igt_get_runtime_pm_status(void);
 bool igt_wait_for_pm_status(enum igt_runtime_pm_status status);
 
+/**
+ * igt_pm_latency:
+ * @resume: runtime resume latencies, in ns
+ * @suspend: runtime suspend latencies, in ns
+ */
+struct igt_pm_latency {
+	struct igt_histogram resume;
+	struct igt_histogram suspend;
+};
+
+void igt_pm_latency_init(struct igt_pm_latency *lat);
+void igt_pm_latency_fini(struct igt_pm_latency *lat);
+int64_t igt_pm_measure_resume(struct igt_pm_latency *lat,
+			      void (*trigger)(void *data), void *data);
+int64_t igt_pm_measure_suspend(struct igt_pm_latency *lat,
+			       void (*trigger)(void *data), void *data);
+
 #endif /* IGT_PM_H */
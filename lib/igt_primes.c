@@ -27,17 +27,26 @@
 #include <stdbool.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 /**
  * SECTION:igt_primes
  * @short_description: Prime numbers helper library
  * @title: Primes
  * @include: igt_primes.h
+ *
+ * igt_next_prime_number() answers from a table for the primes below 1024,
+ * and beyond them from a sieve of Eratosthenes that is extended a segment
+ * at a time as larger numbers are asked for. Looking up the sieve takes no
+ * lock, so the iterators may be used from several threads and from
+ * igt_fork() children.
  */
 
 #define BITS_PER_CHAR 8
 #define BITS_PER_LONG (sizeof(long)*BITS_PER_CHAR)
 
+#define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
+
 #define BITMAP_FIRST_WORD_MASK(start) (~0UL << ((start) & (BITS_PER_LONG - 1)))
 #define BITMAP_LAST_WORD_MASK(nbits) (~0UL >> (-(nbits) & (BITS_PER_LONG - 1)))
 
@@ -127,59 +136,174 @@ static unsigned long slow_next_prime_number(unsigned long x)
 	}
 }
 
-static unsigned long mark_multiples(unsigned long x,
-				    unsigned long *primes,
-				    unsigned long start,
-				    unsigned long end)
+static const unsigned short small_primes[] = {
+	2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61,
+	67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131, 137,
+	139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211,
+	223, 227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283,
+	293, 307, 311, 313, 317, 331, 337, 347, 349, 353, 359, 367, 373, 379,
+	383, 389, 397, 401, 409, 419, 421, 431, 433, 439, 443, 449, 457, 461,
+	463, 467, 479, 487, 491, 499, 503, 509, 521, 523, 541, 547, 557, 563,
+	569, 571, 577, 587, 593, 599, 601, 607, 613, 617, 619, 631, 641, 643,
+	647, 653, 659, 661, 673, 677, 683, 691, 701, 709, 719, 727, 733, 739,
+	743, 751, 757, 761, 769, 773, 787, 797, 809, 811, 821, 823, 827, 829,
+	839, 853, 857, 859, 863, 877, 881, 883, 887, 907, 911, 919, 929, 937,
+	941, 947, 953, 967, 971, 977, 983, 991, 997, 1009, 1013, 1019, 1021,
+};
+
+#define SMALL_LIMIT 1024
+
+/* Sieved one cache sized segment at a time, in bits */
+#define SEGMENT_BITS (32768UL * BITS_PER_CHAR)
+
+/*
+ * A sieve is never modified once published, growing it makes a new copy.
+ * The old ones are kept as a reader may still be looking at them, they add
+ * up to less than the size of the largest as the size at least doubles.
+ */
+struct sieve {
+	struct sieve *prev;
+	unsigned long limit;
+	unsigned long bits[];
+};
+
+static struct sieve *sieve;
+static pthread_mutex_t sieve_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long small_next_prime_number(unsigned long x)
+{
+	unsigned int lo = 0, hi = ARRAY_SIZE(small_primes);
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (small_primes[mid] <= x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return small_primes[lo];
+}
+
+static void mark_multiples(unsigned long x,
+			   unsigned long *primes,
+			   unsigned long start,
+			   unsigned long end)
 {
 	unsigned long m;
 
-	m = 2*x;
+	m = x*x;
 	if (m < start)
-		m = (start / x + 1) * x;
+		m = (start + x - 1) / x * x;
 
 	while (m < end) {
 		clear_bit(m, primes);
 		m += x;
 	}
+}
+
+/*
+ * Sieves [start, end) with the primes up to the square root of end, both
+ * being multiples of SEGMENT_BITS. Beyond the small primes the sieving
+ * primes are read from the part of the bitmap already sieved, as past the
+ * first segment the square root of end is always below start.
+ */
+static void sieve_segment(unsigned long *primes,
+			  unsigned long start,
+			  unsigned long end)
+{
+	unsigned long x;
+
+	memset(primes + start / BITS_PER_LONG, 0xff,
+	       (end - start) / BITS_PER_CHAR);
+	if (!start)
+		primes[0] &= ~3UL;
+
+	for (int i = 0; i < ARRAY_SIZE(small_primes); i++) {
+		x = small_primes[i];
+		if (x > end / x)
+			return;
+
+		mark_multiples(x, primes, start, end);
+	}
 
-	return x;
+	for (x = find_next_bit(primes, start, SMALL_LIMIT);
+	     x < start && x <= end / x;
+	     x = find_next_bit(primes, start, x + 1))
+		mark_multiples(x, primes, start, end);
+}
+
+/* Returns a sieve covering at least [0, x + 1] */
+static const struct sieve *grow_sieve(unsigned long x)
+{
+	struct sieve *old, *new = NULL;
+	unsigned long sz, y;
+
+	if (x > ~0UL - 2*SEGMENT_BITS)
+		return NULL;
+
+	pthread_mutex_lock(&sieve_lock);
+
+	old = sieve;
+	if (old && old->limit > x + 1) {
+		new = old;
+		goto out;
+	}
+
+	sz = round_up(x + 2, SEGMENT_BITS);
+	if (old && old->limit <= ~0UL / 2)
+		sz = max(sz, 2 * old->limit);
+
+	/* Where memory permits, track the primes using the
+	 * Sieve of Eratosthenes.
+	 */
+	new = malloc(sizeof(*new) + sz / BITS_PER_CHAR);
+	if (!new)
+		goto out;
+
+	y = 0;
+	if (old) {
+		memcpy(new->bits, old->bits, old->limit / BITS_PER_CHAR);
+		y = old->limit;
+	}
+	for (; y < sz; y += SEGMENT_BITS)
+		sieve_segment(new->bits, y, y + SEGMENT_BITS);
+
+	new->prev = old;
+	new->limit = sz;
+	__atomic_store_n(&sieve, new, __ATOMIC_RELEASE);
+
+out:
+	pthread_mutex_unlock(&sieve_lock);
+	return new;
 }
 
 unsigned long igt_next_prime_number(unsigned long x)
 {
-	static unsigned long *primes;
-	static unsigned long last, last_sz;
+	const struct sieve *s;
+	unsigned long y;
 
 	if (x == 0)
 		return 1; /* a white lie for for_each_prime_number() */
-	if (x == 1)
-		return 2;
-
-	if (x >= last) {
-		unsigned long sz, y;
-		unsigned long *nprimes;
-
-		sz = x*x;
-		if (sz < x)
-			return slow_next_prime_number(x);
-
-		sz = round_up(sz, BITS_PER_LONG);
-		nprimes = realloc(primes, sz / sizeof(long));
-		if (!nprimes)
-			return slow_next_prime_number(x);
-
-		/* Where memory permits, track the primes using the
-		 * Sieve of Eratosthenes.
-		 */
-		memset(nprimes + last_sz / BITS_PER_LONG,
-		       0xff, (sz - last_sz) / sizeof(long));
-		for (y = 2UL; y < sz; y = find_next_bit(nprimes, sz, y + 1))
-			last = mark_multiples(y, nprimes, last_sz, sz);
-
-		primes = nprimes;
-		last_sz = sz;
+	if (x < small_primes[ARRAY_SIZE(small_primes) - 1])
+		return small_next_prime_number(x);
+
+	s = __atomic_load_n(&sieve, __ATOMIC_ACQUIRE);
+	if (!s)
+		s = grow_sieve(x);
+
+	for (y = x; s; s = grow_sieve(y)) {
+		if (y + 1 >= s->limit)
+			continue;
+
+		y = find_next_bit(s->bits, s->limit, y + 1);
+		if (y < s->limit)
+			return y;
+
+		/* Carry on from the end of this sieve */
+		y = s->limit - 1;
 	}
 
-	return find_next_bit(primes, last, x + 1);
+	return slow_next_prime_number(x);
 }
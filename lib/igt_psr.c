@@ -24,16 +24,60 @@
 #include "igt_psr.h"
 #include "igt_sysfs.h"
 #include <errno.h>
+#include <fcntl.h>
 
-static bool psr_active_check(int debugfs_fd, enum psr_mode mode)
+/* The status is sampled more and more slowly while waiting, up to every 2ms */
+#define PSR_POLL_MIN_US 50
+#define PSR_POLL_MAX_US 2000
+
+typedef bool (*psr_status_match_t)(const char *status, void *data);
+
+/*
+ * Keeps the status file open and rereads it from the start, which has the
+ * kernel regenerate it, until match() accepts it. The time is taken before
+ * each read, so the one returned is when the state was first seen, to
+ * within the read before it.
+ */
+static int64_t psr_status_wait(int debugfs_fd, psr_status_match_t match,
+			       void *data, unsigned int timeout_ms)
 {
+	unsigned int interval_us = PSR_POLL_MIN_US;
 	char buf[PSR_STATUS_MAX_LEN];
-	const char *state = mode == PSR_MODE_1 ? "SRDENT" : "DEEP_SLEEP";
+	struct timespec start = {};
+	int64_t ret = -ETIMEDOUT;
+	int fd;
+
+	fd = openat(debugfs_fd, "i915_edp_psr_status", O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	igt_nsec_elapsed(&start);
+	for (;;) {
+		uint64_t elapsed = igt_nsec_elapsed(&start);
+		ssize_t len;
+
+		len = pread(fd, buf, sizeof(buf) - 1, 0);
+		if (len < 0) {
+			ret = -errno;
+			break;
+		}
+		buf[len] = '\0';
 
-	igt_debugfs_simple_read(debugfs_fd, "i915_edp_psr_status", buf,
-				sizeof(buf));
+		if (match(buf, data)) {
+			ret = elapsed;
+			break;
+		}
 
-	return strstr(buf, state);
+		if (elapsed > timeout_ms * 1000000ull)
+			break;
+
+		usleep(interval_us);
+		interval_us = min(2 * interval_us, PSR_POLL_MAX_US);
+	}
+
+	close(fd);
+
+	return ret;
 }
 
 static inline const char *psr_active_state_get(enum psr_mode mode)
@@ -41,22 +85,56 @@ static inline const char *psr_active_state_get(enum psr_mode mode)
 	return mode == PSR_MODE_1 ? "SRDENT" : "DEEP_SLEEP";
 }
 
+struct psr_state {
+	const char *state;
+	bool active;
+};
+
+static bool psr_state_match(const char *status, void *data)
+{
+	const struct psr_state *s = data;
+
+	return !!strstr(status, s->state) == s->active;
+}
+
+/*
+ * Waits for PSR to be active, or not, in @mode and returns the time it took
+ * in ns, -ETIMEDOUT if that did not happen within @timeout_ms or -errno if
+ * the status could not be read.
+ */
+int64_t psr_wait_state(int debugfs_fd, enum psr_mode mode, bool active,
+		       unsigned int timeout_ms)
+{
+	struct psr_state s = {
+		.state = psr_active_state_get(mode),
+		.active = active,
+	};
+	int64_t ret;
+
+	ret = psr_status_wait(debugfs_fd, psr_state_match, &s, timeout_ms);
+	if (ret >= 0)
+		igt_debug("PSR %s after %.3fms\n",
+			  active ? "active" : "inactive", ret * 1e-6);
+
+	return ret;
+}
+
 /*
  * For PSR1, we wait until PSR is active. We wait until DEEP_SLEEP for PSR2.
  */
 bool psr_wait_entry(int debugfs_fd, enum psr_mode mode)
 {
-	return igt_wait(psr_active_check(debugfs_fd, mode), 500, 20);
+	return psr_wait_state(debugfs_fd, mode, true, 500) >= 0;
 }
 
 bool psr_wait_update(int debugfs_fd, enum psr_mode mode)
 {
-	return igt_wait(!psr_active_check(debugfs_fd, mode), 40, 10);
+	return psr_wait_state(debugfs_fd, mode, false, 40) >= 0;
 }
 
 bool psr_long_wait_update(int debugfs_fd, enum psr_mode mode)
 {
-	return igt_wait(!psr_active_check(debugfs_fd, mode), 500, 10);
+	return psr_wait_state(debugfs_fd, mode, false, 500) >= 0;
 }
 
 static ssize_t psr_write(int debugfs_fd, const char *buf)
@@ -186,19 +264,12 @@ bool psr_sink_support(int debugfs_fd, enum psr_mode mode)
 
 #define PSR2_SU_BLOCK_STR_LOOKUP "PSR2 SU blocks:\n0\t"
 
-static bool
-psr2_read_last_num_su_blocks_val(int debugfs_fd, uint16_t *num_su_blocks)
+static bool psr2_su_blocks_match(const char *status, void *data)
 {
-	char buf[PSR_STATUS_MAX_LEN];
-	char *str;
-	int ret;
-
-	ret = igt_debugfs_simple_read(debugfs_fd, "i915_edp_psr_status", buf,
-				      sizeof(buf));
-	if (ret < 0)
-		return false;
+	uint16_t *num_su_blocks = data;
+	const char *str;
 
-	str = strstr(buf, PSR2_SU_BLOCK_STR_LOOKUP);
+	str = strstr(status, PSR2_SU_BLOCK_STR_LOOKUP);
 	if (!str)
 		return false;
 
@@ -210,5 +281,6 @@ psr2_read_last_num_su_blocks_val(int debugfs_fd, uint16_t *num_su_blocks)
 
 bool psr2_wait_su(int debugfs_fd, uint16_t *num_su_blocks)
 {
-	return igt_wait(psr2_read_last_num_su_blocks_val(debugfs_fd, num_su_blocks), 40, 1);
+	return psr_status_wait(debugfs_fd, psr2_su_blocks_match,
+			       num_su_blocks, 40) >= 0;
 }
@@ -35,6 +35,8 @@ enum psr_mode {
 	PSR_MODE_2
 };
 
+int64_t psr_wait_state(int debugfs_fd, enum psr_mode mode, bool active,
+		       unsigned int timeout_ms);
 bool psr_wait_entry(int debugfs_fd, enum psr_mode mode);
 bool psr_wait_update(int debugfs_fd, enum psr_mode mode);
 bool psr_long_wait_update(int debugfs_fd, enum psr_mode mode);
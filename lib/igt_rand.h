@@ -24,6 +24,7 @@
 #ifndef IGT_RAND_H
 #define IGT_RAND_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 uint32_t hars_petruska_f54_1_random(uint32_t *state);
@@ -44,4 +45,6 @@ static inline uint32_t hars_petruska_f54_1_random_unsafe_max(uint32_t ep_ro)
 	return ((uint64_t)hars_petruska_f54_1_random_unsafe() * ep_ro) >> 32;
 }
 
+void igt_random_fill(void *buf, size_t len, uint64_t seed);
+
 #endif /* IGT_RAND_H */
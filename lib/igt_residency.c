@@ -0,0 +1,405 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_kmod.h"
+#include "igt_residency.h"
+#include "igt_sysfs.h"
+
+/**
+ * SECTION:igt_residency
+ * @short_description: Sampling of package C-state and RC6 residencies
+ * @title: Residency
+ * @include: igt_residency.h
+ *
+ * Reads the package C-state residency MSRs of the CPU, through the msr
+ * module, along with the time stamp counter they count in, and the RC6
+ * residency of an i915 device from sysfs. Counters missing on the machine
+ * are left out, see igt_residency_has().
+ *
+ * Two samples taken with igt_residency_read() around some work give the
+ * share of the time spent in each state with igt_residency_percent(). To
+ * record a timeline instead, igt_residency_start() samples all the counters
+ * at a fixed interval from a background thread, until igt_residency_stop():
+ *
+ * |[
+ *	struct igt_residency *r = igt_residency_open(i915);
+ *	const struct igt_residency_sample *s;
+ *	unsigned int count;
+ *
+ *	igt_require(r && igt_residency_has(r, IGT_RESIDENCY_PC8));
+ *
+ *	igt_residency_start(r, 100);
+ *	run_test();
+ *	igt_residency_stop(r);
+ *
+ *	s = igt_residency_samples(r, &count);
+ *	for (i = 1; i < count; i++)
+ *		igt_info("%.1f%%\n",
+ *			 igt_residency_percent(&s[i - 1], &s[i],
+ *					       IGT_RESIDENCY_PC8));
+ *
+ *	igt_residency_close(r);
+ * ]|
+ */
+
+#define IA32_TIME_STAMP_COUNTER		0x10
+
+static const struct {
+	const char *name;
+	uint32_t msr;
+} counters[IGT_RESIDENCY_COUNT] = {
+	[IGT_RESIDENCY_PC2] = { "PC2", 0x60d },
+	[IGT_RESIDENCY_PC3] = { "PC3", 0x3f8 },
+	[IGT_RESIDENCY_PC6] = { "PC6", 0x3f9 },
+	[IGT_RESIDENCY_PC7] = { "PC7", 0x3fa },
+	[IGT_RESIDENCY_PC8] = { "PC8", 0x630 },
+	[IGT_RESIDENCY_PC9] = { "PC9", 0x631 },
+	[IGT_RESIDENCY_PC10] = { "PC10", 0x632 },
+	[IGT_RESIDENCY_RC6] = { "RC6" },
+};
+
+struct igt_residency {
+	int msr;
+	int rc6;
+	bool has[IGT_RESIDENCY_COUNT];
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned int interval_ms;
+	bool running, stop;
+
+	struct igt_residency_sample *samples;
+	unsigned int count, size;
+};
+
+static bool msr_read(int fd, uint32_t addr, uint64_t *value)
+{
+	return pread(fd, value, sizeof(*value), addr) == sizeof(*value);
+}
+
+static int msr_open(void)
+{
+	int fd;
+
+	fd = open("/dev/cpu/0/msr", O_RDONLY | O_CLOEXEC);
+	if (fd < 0 && errno == ENOENT) {
+		igt_kmod_load("msr", NULL);
+		fd = open("/dev/cpu/0/msr", O_RDONLY | O_CLOEXEC);
+	}
+
+	return fd;
+}
+
+/**
+ * igt_residency_open:
+ * @i915: open i915 drm file descriptor for its RC6 residency, or -1 for
+ *	  only the package C-states
+ *
+ * Opens the residency counters of the machine. Reading the MSRs usually
+ * requires root.
+ *
+ * Returns: The counters, to be freed with igt_residency_close(), or NULL if
+ * none of them is available.
+ */
+struct igt_residency *igt_residency_open(int i915)
+{
+	struct igt_residency *r;
+	pthread_condattr_t attr;
+	bool any = false;
+	uint64_t value;
+
+	r = calloc(1, sizeof(*r));
+	igt_assert(r);
+
+	r->msr = msr_open();
+	if (r->msr >= 0 && !msr_read(r->msr, IA32_TIME_STAMP_COUNTER, &value)) {
+		close(r->msr);
+		r->msr = -1;
+	}
+	if (r->msr >= 0) {
+		for (int i = 0; i < IGT_RESIDENCY_COUNT; i++) {
+			if (counters[i].msr)
+				r->has[i] = msr_read(r->msr, counters[i].msr,
+						     &value);
+			any |= r->has[i];
+		}
+	}
+
+	r->rc6 = -1;
+	if (i915 >= 0) {
+		int dir = igt_sysfs_open(i915);
+
+		if (dir >= 0) {
+			r->rc6 = igt_sysfs_attr_open(dir,
+						     "power/rc6_residency_ms");
+			close(dir);
+		}
+	}
+	r->has[IGT_RESIDENCY_RC6] = r->rc6 >= 0;
+	any |= r->has[IGT_RESIDENCY_RC6];
+
+	if (!any) {
+		igt_residency_close(r);
+		return NULL;
+	}
+
+	pthread_mutex_init(&r->mutex, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&r->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return r;
+}
+
+/**
+ * igt_residency_close:
+ * @r: the counters to close
+ *
+ * Stops the background sampling, if running, and frees @r along with its
+ * samples.
+ */
+void igt_residency_close(struct igt_residency *r)
+{
+	if (!r)
+		return;
+
+	if (r->running)
+		igt_residency_stop(r);
+
+	if (r->msr >= 0)
+		close(r->msr);
+	if (r->rc6 >= 0)
+		close(r->rc6);
+
+	free(r->samples);
+	free(r);
+}
+
+/**
+ * igt_residency_name:
+ * @counter: the counter
+ *
+ * Returns: A short name for @counter, e.g. "PC8".
+ */
+const char *igt_residency_name(enum igt_residency_counter counter)
+{
+	igt_assert(counter < IGT_RESIDENCY_COUNT);
+
+	return counters[counter].name;
+}
+
+/**
+ * igt_residency_has:
+ * @r: the counters
+ * @counter: the counter to look for
+ *
+ * Returns: Whether @counter could be read on this machine.
+ */
+bool igt_residency_has(struct igt_residency *r,
+		       enum igt_residency_counter counter)
+{
+	return counter < IGT_RESIDENCY_COUNT && r->has[counter];
+}
+
+/**
+ * igt_residency_read:
+ * @r: the counters
+ * @s: (out): the sample
+ *
+ * Reads the time stamp counter and all the available residency counters,
+ * back to back.
+ */
+void igt_residency_read(struct igt_residency *r,
+			struct igt_residency_sample *s)
+{
+	struct timespec ts;
+
+	memset(s, 0, sizeof(*s));
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	s->time = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+	if (r->msr >= 0) {
+		msr_read(r->msr, IA32_TIME_STAMP_COUNTER, &s->tsc);
+		for (int i = 0; i < IGT_RESIDENCY_COUNT; i++)
+			if (r->has[i] && counters[i].msr)
+				msr_read(r->msr, counters[i].msr,
+					 &s->counter[i]);
+	}
+
+	if (r->rc6 >= 0)
+		igt_sysfs_attr_get_u64(r->rc6, &s->counter[IGT_RESIDENCY_RC6]);
+}
+
+/**
+ * igt_residency_percent:
+ * @s0: the earlier sample
+ * @s1: the later sample
+ * @counter: the counter
+ *
+ * Returns: The share of the time between @s0 and @s1 spent in the state of
+ * @counter, in percent, or NaN if no time passed.
+ */
+double igt_residency_percent(const struct igt_residency_sample *s0,
+			     const struct igt_residency_sample *s1,
+			     enum igt_residency_counter counter)
+{
+	double delta = s1->counter[counter] - s0->counter[counter];
+
+	if (counter == IGT_RESIDENCY_RC6) {
+		if (s1->time == s0->time)
+			return NAN;
+
+		return 1e8 * delta / (s1->time - s0->time);
+	}
+
+	if (s1->tsc == s0->tsc)
+		return NAN;
+
+	return 100 * delta / (s1->tsc - s0->tsc);
+}
+
+static void timespec_add_ms(struct timespec *ts, unsigned int ms)
+{
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000l;
+	if (ts->tv_nsec >= 1000000000l) {
+		ts->tv_nsec -= 1000000000l;
+		ts->tv_sec++;
+	}
+}
+
+static void *sampler(void *arg)
+{
+	struct igt_residency *r = arg;
+	struct timespec next;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	pthread_mutex_lock(&r->mutex);
+	for (;;) {
+		if (r->count == r->size) {
+			r->size = r->size ? 2 * r->size : 64;
+			r->samples = realloc(r->samples,
+					     r->size * sizeof(*r->samples));
+			igt_assert(r->samples);
+		}
+		igt_residency_read(r, &r->samples[r->count++]);
+
+		if (r->stop)
+			break;
+
+		/* Keep to the interval however long the reads took */
+		timespec_add_ms(&next, r->interval_ms);
+		while (!r->stop &&
+		       pthread_cond_timedwait(&r->cond, &r->mutex,
+					      &next) != ETIMEDOUT)
+			;
+	}
+	pthread_mutex_unlock(&r->mutex);
+
+	return NULL;
+}
+
+/**
+ * igt_residency_start:
+ * @r: the counters
+ * @interval_ms: time between two samples
+ *
+ * Starts sampling all the counters of @r every @interval_ms from a
+ * background thread, discarding the samples of any earlier run. The first
+ * sample is taken right away.
+ */
+void igt_residency_start(struct igt_residency *r, unsigned int interval_ms)
+{
+	sigset_t mask, old;
+
+	igt_assert(!r->running);
+	igt_assert(interval_ms > 0);
+
+	r->interval_ms = interval_ms;
+	r->count = 0;
+	r->stop = false;
+
+	/* Leave the signals, igt_set_timeout() included, to the test thread */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &old);
+	igt_assert_eq(pthread_create(&r->thread, NULL, sampler, r), 0);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	r->running = true;
+}
+
+/**
+ * igt_residency_stop:
+ * @r: the counters
+ *
+ * Stops the sampling started with igt_residency_start(), after a last
+ * sample so that the timeline covers the whole run.
+ *
+ * Returns: The number of samples taken.
+ */
+unsigned int igt_residency_stop(struct igt_residency *r)
+{
+	igt_assert(r->running);
+
+	pthread_mutex_lock(&r->mutex);
+	r->stop = true;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->mutex);
+
+	pthread_join(r->thread, NULL);
+	r->running = false;
+
+	return r->count;
+}
+
+/**
+ * igt_residency_samples:
+ * @r: the counters
+ * @count: (out): the number of samples
+ *
+ * Returns: The samples of the last run of igt_residency_start() and
+ * igt_residency_stop(), in order, owned by @r until the next run.
+ */
+const struct igt_residency_sample *
+igt_residency_samples(struct igt_residency *r, unsigned int *count)
+{
+	igt_assert(!r->running);
+
+	*count = r->count;
+	return r->samples;
+}
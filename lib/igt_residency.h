@@ -0,0 +1,87 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __IGT_RESIDENCY_H__
+#define __IGT_RESIDENCY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * igt_residency_counter:
+ * @IGT_RESIDENCY_PC2: package C2 residency MSR
+ * @IGT_RESIDENCY_PC3: package C3 residency MSR
+ * @IGT_RESIDENCY_PC6: package C6 residency MSR
+ * @IGT_RESIDENCY_PC7: package C7 residency MSR
+ * @IGT_RESIDENCY_PC8: package C8 residency MSR
+ * @IGT_RESIDENCY_PC9: package C9 residency MSR
+ * @IGT_RESIDENCY_PC10: package C10 residency MSR
+ * @IGT_RESIDENCY_RC6: GT RC6 residency of the i915 device, in ms
+ * @IGT_RESIDENCY_COUNT: number of counters
+ */
+enum igt_residency_counter {
+	IGT_RESIDENCY_PC2,
+	IGT_RESIDENCY_PC3,
+	IGT_RESIDENCY_PC6,
+	IGT_RESIDENCY_PC7,
+	IGT_RESIDENCY_PC8,
+	IGT_RESIDENCY_PC9,
+	IGT_RESIDENCY_PC10,
+	IGT_RESIDENCY_RC6,
+	IGT_RESIDENCY_COUNT
+};
+
+/**
+ * igt_residency_sample:
+ * @time: CLOCK_MONOTONIC time of the sample, in ns
+ * @tsc: the CPU time stamp counter, which the package residencies count in
+ * @counter: raw value of each counter, 0 for those not available
+ */
+struct igt_residency_sample {
+	uint64_t time;
+	uint64_t tsc;
+	uint64_t counter[IGT_RESIDENCY_COUNT];
+};
+
+struct igt_residency;
+
+struct igt_residency *igt_residency_open(int i915);
+void igt_residency_close(struct igt_residency *r);
+
+const char *igt_residency_name(enum igt_residency_counter counter);
+bool igt_residency_has(struct igt_residency *r,
+		       enum igt_residency_counter counter);
+
+void igt_residency_read(struct igt_residency *r,
+			struct igt_residency_sample *s);
+double igt_residency_percent(const struct igt_residency_sample *s0,
+			     const struct igt_residency_sample *s1,
+			     enum igt_residency_counter counter);
+
+void igt_residency_start(struct igt_residency *r, unsigned int interval_ms);
+unsigned int igt_residency_stop(struct igt_residency *r);
+const struct igt_residency_sample *
+igt_residency_samples(struct igt_residency *r, unsigned int *count);
+
+#endif /* __IGT_RESIDENCY_H__ */
@@ -25,6 +25,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "igt_core.h"
 #include "igt_stats.h"
@@ -64,6 +65,12 @@
  *
  *	igt_stats_fini(&stats);
  * ]|
+ *
+ * #igt_histogram instead keeps counts of values in buckets of constant
+ * relative width, for long running measurements: its memory does not grow
+ * with the number of samples, adding a value is constant time, histograms
+ * filled by different threads can be merged, and its percentiles are within
+ * 0.4% of the exact ones.
  */
 
 static unsigned int get_new_capacity(int need)
@@ -479,6 +486,35 @@ double igt_stats_get_median(igt_stats_t *stats)
 					     NULL, NULL);
 }
 
+/**
+ * igt_stats_get_percentile:
+ * @stats: An #igt_stats_t instance
+ * @percentile: The percentile to retrieve, between 0 and 100
+ *
+ * Retrieves the given percentile of the @stats dataset, linearly
+ * interpolating between the two closest ranks. The 50th percentile is the
+ * median.
+ */
+double igt_stats_get_percentile(igt_stats_t *stats, double percentile)
+{
+	unsigned int lo, hi;
+	double rank;
+
+	igt_assert(percentile >= 0. && percentile <= 100.);
+
+	if (!stats->n_values)
+		return 0.;
+
+	igt_stats_ensure_sorted_values(stats);
+
+	rank = percentile / 100. * (stats->n_values - 1);
+	lo = floor(rank);
+	hi = ceil(rank);
+
+	return sorted_value(stats, lo) +
+	       (sorted_value(stats, hi) - sorted_value(stats, lo)) * (rank - lo);
+}
+
 /*
  * Algorithm popularised by Knuth in:
  *
@@ -549,6 +585,32 @@ double igt_stats_get_std_deviation(igt_stats_t *stats)
 	return sqrt(stats->variance);
 }
 
+/**
+ * igt_stats_merge:
+ * @stats: An #igt_stats_t instance
+ * @other: An #igt_stats_t instance
+ *
+ * Adds all the values of @other to the @stats dataset, for instance to
+ * gather the samples each thread recorded into its own #igt_stats_t. Both
+ * must hold the same kind of values, integer or float.
+ */
+void igt_stats_merge(igt_stats_t *stats, igt_stats_t *other)
+{
+	unsigned int i;
+
+	igt_assert(!stats->n_values || !other->n_values ||
+		   stats->is_float == other->is_float);
+
+	igt_stats_ensure_capacity(stats, other->n_values);
+
+	for (i = 0; i < other->n_values; i++) {
+		if (other->is_float)
+			igt_stats_push_float(stats, other->values_f[i]);
+		else
+			igt_stats_push(stats, other->values_u64[i]);
+	}
+}
+
 /**
  * igt_stats_get_iqm:
  * @stats: An #igt_stats_t instance
@@ -638,6 +700,32 @@ void igt_mean_add(struct igt_mean *m, double v)
 		m->max = v;
 }
 
+/**
+ * igt_mean_merge:
+ * @m: tracking structure
+ * @other: tracking structure to add to @m
+ *
+ * Adds the samples tracked in @other to @m, with the parallel algorithm of
+ * Chan et al., giving the same mean and variance as if all the samples had
+ * been added to @m.
+ */
+void igt_mean_merge(struct igt_mean *m, const struct igt_mean *other)
+{
+	unsigned long count = m->count + other->count;
+	double delta = other->mean - m->mean;
+
+	if (!other->count)
+		return;
+
+	m->sq += other->sq + delta * delta * m->count * other->count / count;
+	m->mean += delta * other->count / count;
+	m->count = count;
+	if (other->min < m->min)
+		m->min = other->min;
+	if (other->max > m->max)
+		m->max = other->max;
+}
+
 /**
  * igt_mean_get:
  * @m: tracking structure
@@ -660,3 +748,444 @@ double igt_mean_get_variance(struct igt_mean *m)
 	return m->sq / m->count;
 }
 
+/*
+ * Values below 2^HIST_BITS have a bucket each, above that every power of two
+ * is split into 2^HIST_BITS buckets, as in HDR histograms.
+ */
+#define HIST_BITS 7
+#define HIST_SUB (1u << HIST_BITS)
+#define HIST_BUCKETS ((64 - HIST_BITS + 1) * HIST_SUB)
+
+static unsigned int hist_bucket(uint64_t v)
+{
+	unsigned int shift;
+
+	if (v < HIST_SUB)
+		return v;
+
+	shift = 63 - __builtin_clzll(v) - HIST_BITS;
+	return (shift + 1) * HIST_SUB + (v >> shift) - HIST_SUB;
+}
+
+static double hist_value(unsigned int bucket)
+{
+	unsigned int shift;
+	uint64_t base;
+
+	if (bucket < HIST_SUB)
+		return bucket;
+
+	/* The middle of the range of values of the bucket */
+	shift = bucket / HIST_SUB - 1;
+	base = (uint64_t)(HIST_SUB + bucket % HIST_SUB) << shift;
+	return base + ((1ull << shift) - 1) / 2.;
+}
+
+/**
+ * igt_histogram_init:
+ * @h: tracking structure
+ *
+ * Initializes @h, with no values.
+ */
+void igt_histogram_init(struct igt_histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = U64_MAX;
+
+	h->buckets = calloc(HIST_BUCKETS, sizeof(*h->buckets));
+	igt_assert(h->buckets);
+}
+
+/**
+ * igt_histogram_fini:
+ * @h: tracking structure
+ *
+ * Frees the resources of @h.
+ */
+void igt_histogram_fini(struct igt_histogram *h)
+{
+	free(h->buckets);
+	h->buckets = NULL;
+}
+
+/**
+ * igt_histogram_add:
+ * @h: tracking structure
+ * @v: value
+ *
+ * Adds a new value @v to @h.
+ */
+void igt_histogram_add(struct igt_histogram *h, uint64_t v)
+{
+	h->buckets[hist_bucket(v)]++;
+	h->count++;
+	h->sum += v;
+	if (v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+}
+
+/**
+ * igt_histogram_merge:
+ * @h: tracking structure
+ * @other: histogram to add to @h
+ *
+ * Adds all the values of @other to @h, as if they had been added to @h one
+ * by one. Used to combine the histograms of different threads.
+ */
+void igt_histogram_merge(struct igt_histogram *h,
+			 const struct igt_histogram *other)
+{
+	for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+		h->buckets[i] += other->buckets[i];
+
+	h->count += other->count;
+	h->sum += other->sum;
+	if (other->min < h->min)
+		h->min = other->min;
+	if (other->max > h->max)
+		h->max = other->max;
+}
+
+/**
+ * igt_histogram_get_count:
+ * @h: tracking structure
+ *
+ * Returns: the number of values added to @h.
+ */
+uint64_t igt_histogram_get_count(struct igt_histogram *h)
+{
+	return h->count;
+}
+
+/**
+ * igt_histogram_get_min:
+ * @h: tracking structure
+ *
+ * Returns: the exact minimum of the values added to @h.
+ */
+uint64_t igt_histogram_get_min(struct igt_histogram *h)
+{
+	return h->count ? h->min : 0;
+}
+
+/**
+ * igt_histogram_get_max:
+ * @h: tracking structure
+ *
+ * Returns: the exact maximum of the values added to @h.
+ */
+uint64_t igt_histogram_get_max(struct igt_histogram *h)
+{
+	return h->max;
+}
+
+/**
+ * igt_histogram_get_mean:
+ * @h: tracking structure
+ *
+ * Returns: the exact mean of the values added to @h.
+ */
+double igt_histogram_get_mean(struct igt_histogram *h)
+{
+	return h->count ? h->sum / h->count : 0.;
+}
+
+/**
+ * igt_histogram_get_percentile:
+ * @h: tracking structure
+ * @percentile: the percentile to retrieve, between 0 and 100
+ *
+ * Retrieves the value below which @percentile percent of the values added
+ * to @h fall, using the nearest rank. It is approximated with the middle of
+ * its bucket, clamped to the exact minimum and maximum.
+ *
+ * Returns: the approximate percentile, 0 with no values.
+ */
+double igt_histogram_get_percentile(struct igt_histogram *h,
+				    double percentile)
+{
+	uint64_t rank, seen = 0;
+	double v = 0;
+
+	if (!h->count)
+		return 0.;
+
+	rank = ceil(percentile / 100 * h->count);
+	if (rank < 1)
+		rank = 1;
+	if (rank >= h->count)
+		return h->max;
+
+	for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			v = hist_value(i);
+			break;
+		}
+	}
+
+	if (v < h->min)
+		v = h->min;
+	if (v > h->max)
+		v = h->max;
+
+	return v;
+}
+
+/**
+ * igt_histogram_get_median:
+ * @h: tracking structure
+ *
+ * Returns: the approximate median of the values added to @h.
+ */
+double igt_histogram_get_median(struct igt_histogram *h)
+{
+	return igt_histogram_get_percentile(h, 50);
+}
+
+/* The approximate value of the 0-based @rank of the values added to @h */
+static double hist_value_at_rank(struct igt_histogram *h, uint64_t rank)
+{
+	uint64_t seen = 0;
+
+	for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen > rank)
+			return fmin(fmax(hist_value(i), h->min), h->max);
+	}
+
+	return h->max;
+}
+
+/**
+ * igt_histogram_get_iqm:
+ * @h: tracking structure
+ *
+ * Approximates the interquartile mean of the values added to @h, as defined
+ * by igt_stats_get_iqm(), taking each value as the middle of its bucket.
+ *
+ * Returns: the approximate interquartile mean, 0 with no values.
+ */
+double igt_histogram_get_iqm(struct igt_histogram *h)
+{
+	uint64_t q1, q3, seen = 0;
+	double mean = 0;
+	unsigned int n;
+
+	if (h->count < 2)
+		return h->count ? h->max : 0.;
+
+	q1 = (h->count + 3) / 4;
+	q3 = 3 * h->count / 4;
+
+	/* The part of each bucket ranked between the quartiles */
+	for (unsigned int i = 0; i < HIST_BUCKETS && seen <= q3; i++) {
+		uint64_t lo = seen > q1 ? seen : q1;
+		uint64_t hi = seen + h->buckets[i];
+
+		if (hi > q3 + 1)
+			hi = q3 + 1;
+
+		if (hi > lo)
+			mean += (hi - lo) *
+				fmin(fmax(hist_value(i), h->min), h->max);
+		seen += h->buckets[i];
+	}
+	n = q3 - q1 + 1;
+	mean /= n;
+
+	if (h->count % 4) {
+		double rem = .5 * (h->count % 4) / 4;
+
+		mean += rem * (hist_value_at_rank(h, h->count / 4) - mean) / n++;
+		mean += rem * (hist_value_at_rank(h, (3 * h->count + 3) / 4) - mean) / n++;
+	}
+
+	return mean;
+}
+
+/**
+ * igt_thread_stats_create:
+ * @count: number of threads
+ *
+ * Allocates and initializes an accumulator for each of @count threads, each
+ * on its own cache lines.
+ *
+ * Returns: the accumulators, to be freed with igt_thread_stats_destroy()
+ */
+struct igt_thread_stats *igt_thread_stats_create(unsigned int count)
+{
+	struct igt_thread_stats *t;
+
+	igt_assert(!posix_memalign((void **)&t, sizeof(*t),
+				   count * sizeof(*t)));
+
+	for (unsigned int n = 0; n < count; n++) {
+		igt_mean_init(&t[n].mean);
+		igt_histogram_init(&t[n].hist);
+	}
+
+	return t;
+}
+
+/**
+ * igt_thread_stats_destroy:
+ * @t: the accumulators
+ * @count: number of accumulators in @t
+ *
+ * Frees the accumulators of igt_thread_stats_create().
+ */
+void igt_thread_stats_destroy(struct igt_thread_stats *t, unsigned int count)
+{
+	for (unsigned int n = 0; n < count; n++)
+		igt_histogram_fini(&t[n].hist);
+	free(t);
+}
+
+/**
+ * igt_thread_stats_add:
+ * @t: accumulator of the calling thread
+ * @v: value
+ *
+ * Adds a new value @v to @t. No other thread may use @t at the same time.
+ */
+void igt_thread_stats_add(struct igt_thread_stats *t, uint64_t v)
+{
+	igt_mean_add(&t->mean, v);
+	igt_histogram_add(&t->hist, v);
+}
+
+/**
+ * igt_thread_stats_merge:
+ * @t: the accumulators
+ * @count: number of accumulators in @t
+ * @mean: (allow-none): initialized tracking structure to add the means to
+ * @hist: (allow-none): initialized histogram to add the histograms to
+ *
+ * Combines the samples of all the accumulators in @t, once the threads
+ * using them are done.
+ */
+void igt_thread_stats_merge(struct igt_thread_stats *t, unsigned int count,
+			    struct igt_mean *mean, struct igt_histogram *hist)
+{
+	for (unsigned int n = 0; n < count; n++) {
+		if (mean)
+			igt_mean_merge(mean, &t[n].mean);
+		if (hist)
+			igt_histogram_merge(hist, &t[n].hist);
+	}
+}
+
+/**
+ * igt_child_results:
+ *
+ * Area shared between the children spawned with igt_fork() or
+ * igt_fork_pinned() and the parent, for the children to store their
+ * counters or timings into. Create it with igt_child_results_create() before
+ * forking.
+ */
+struct igt_child_results {
+	/*< private >*/
+	unsigned int num_children;
+	unsigned int num_values;
+	size_t size;
+	double values[];
+};
+
+/**
+ * igt_child_results_create:
+ * @num_children: number of children that will report results
+ * @num_values: number of values reported by each child
+ *
+ * Allocates a results area in memory shared with the children forked
+ * afterwards. All values start at 0.
+ *
+ * Returns: the new results area, to be freed with igt_child_results_destroy()
+ */
+struct igt_child_results *
+igt_child_results_create(unsigned int num_children, unsigned int num_values)
+{
+	struct igt_child_results *results;
+	size_t size;
+
+	size = sizeof(*results) +
+		sizeof(double) * num_children * num_values;
+	results = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	igt_assert(results != MAP_FAILED);
+
+	results->num_children = num_children;
+	results->num_values = num_values;
+	results->size = size;
+
+	return results;
+}
+
+/**
+ * igt_child_results_destroy:
+ * @results: the results area
+ *
+ * Frees @results, once all children are done with it.
+ */
+void igt_child_results_destroy(struct igt_child_results *results)
+{
+	munmap(results, results->size);
+}
+
+/**
+ * igt_child_results_get:
+ * @results: the results area
+ * @child: the child number
+ *
+ * Returns: the array of values of @child, for the child to fill in
+ */
+double *igt_child_results_get(struct igt_child_results *results,
+			      unsigned int child)
+{
+	igt_assert(child < results->num_children);
+
+	return &results->values[child * results->num_values];
+}
+
+/**
+ * igt_child_results_stats:
+ * @results: the results area
+ * @value: index of the value to collect
+ * @stats: an #igt_stats_t to initialize
+ *
+ * Collects @value as reported by all children into @stats, e.g. to get the
+ * spread of their throughput. @stats needs to be freed with igt_stats_fini()
+ * after use.
+ */
+void igt_child_results_stats(struct igt_child_results *results,
+			     unsigned int value, igt_stats_t *stats)
+{
+	igt_assert(value < results->num_values);
+
+	igt_stats_init_with_size(stats, results->num_children);
+	for (unsigned int n = 0; n < results->num_children; n++)
+		igt_stats_push_float(stats,
+				     igt_child_results_get(results, n)[value]);
+}
+
+/**
+ * igt_child_results_sum:
+ * @results: the results area
+ * @value: index of the value to add up
+ *
+ * Returns: the sum of @value over all children, e.g. the total throughput
+ */
+double igt_child_results_sum(struct igt_child_results *results,
+			     unsigned int value)
+{
+	double sum = 0;
+
+	igt_assert(value < results->num_values);
+
+	for (unsigned int n = 0; n < results->num_children; n++)
+		sum += igt_child_results_get(results, n)[value];
+
+	return sum;
+}
@@ -79,8 +79,10 @@ double igt_stats_get_iqm(igt_stats_t *stats);
 double igt_stats_get_mean(igt_stats_t *stats);
 double igt_stats_get_trimean(igt_stats_t *stats);
 double igt_stats_get_median(igt_stats_t *stats);
+double igt_stats_get_percentile(igt_stats_t *stats, double percentile);
 double igt_stats_get_variance(igt_stats_t *stats);
 double igt_stats_get_std_deviation(igt_stats_t *stats);
+void igt_stats_merge(igt_stats_t *stats, igt_stats_t *other);
 
 /**
  * igt_mean:
@@ -97,7 +99,70 @@ struct igt_mean {
 
 void igt_mean_init(struct igt_mean *m);
 void igt_mean_add(struct igt_mean *m, double v);
+void igt_mean_merge(struct igt_mean *m, const struct igt_mean *other);
 double igt_mean_get(struct igt_mean *m);
 double igt_mean_get_variance(struct igt_mean *m);
 
+/**
+ * igt_histogram:
+ *
+ * Structure to compute approximate percentiles of a stream of integer
+ * values in constant memory, for when storing every sample in an
+ * #igt_stats_t would be too much. Needs to be initialized with
+ * igt_histogram_init() and freed with igt_histogram_fini().
+ */
+struct igt_histogram {
+	/*< private >*/
+	uint64_t *buckets;
+	uint64_t count, min, max;
+	double sum;
+};
+
+void igt_histogram_init(struct igt_histogram *h);
+void igt_histogram_fini(struct igt_histogram *h);
+void igt_histogram_add(struct igt_histogram *h, uint64_t v);
+void igt_histogram_merge(struct igt_histogram *h,
+			 const struct igt_histogram *other);
+uint64_t igt_histogram_get_count(struct igt_histogram *h);
+uint64_t igt_histogram_get_min(struct igt_histogram *h);
+uint64_t igt_histogram_get_max(struct igt_histogram *h);
+double igt_histogram_get_mean(struct igt_histogram *h);
+double igt_histogram_get_median(struct igt_histogram *h);
+double igt_histogram_get_percentile(struct igt_histogram *h,
+				    double percentile);
+double igt_histogram_get_iqm(struct igt_histogram *h);
+
+/**
+ * igt_thread_stats:
+ * @mean: running mean, variance, minimum and maximum of the samples
+ * @hist: histogram of the samples, for their percentiles
+ *
+ * Accumulator for the samples of one thread, padded out to its own cache
+ * line so that threads recording into neighbouring accumulators never write
+ * to the same line. Create an array of them with igt_thread_stats_create()
+ * and combine them with igt_thread_stats_merge() once the threads are done.
+ */
+struct igt_thread_stats {
+	struct igt_mean mean;
+	struct igt_histogram hist;
+} __attribute__((aligned(64)));
+
+struct igt_thread_stats *igt_thread_stats_create(unsigned int count);
+void igt_thread_stats_destroy(struct igt_thread_stats *t, unsigned int count);
+void igt_thread_stats_add(struct igt_thread_stats *t, uint64_t v);
+void igt_thread_stats_merge(struct igt_thread_stats *t, unsigned int count,
+			    struct igt_mean *mean, struct igt_histogram *hist);
+
+struct igt_child_results;
+
+struct igt_child_results *
+igt_child_results_create(unsigned int num_children, unsigned int num_values);
+void igt_child_results_destroy(struct igt_child_results *results);
+double *igt_child_results_get(struct igt_child_results *results,
+			      unsigned int child);
+void igt_child_results_stats(struct igt_child_results *results,
+			     unsigned int value, igt_stats_t *stats);
+double igt_child_results_sum(struct igt_child_results *results,
+			     unsigned int value);
+
 #endif /* __IGT_STATS_H__ */
@@ -498,6 +498,117 @@ bool igt_sysfs_set_boolean(int dir, const char *attr, bool value)
 	return igt_sysfs_printf(dir, attr, "%d", value) == 1;
 }
 
+/**
+ * igt_sysfs_attr_open:
+ * @dir: directory for the device from igt_sysfs_open()
+ * @attr: name of the sysfs node to open
+ *
+ * Opens a sysfs file for repeated reading with igt_sysfs_attr_read() and
+ * friends. Unlike igt_sysfs_get() and igt_sysfs_scanf(), which open and close
+ * the file on every access, each read of the returned handle is a single
+ * pread(), as sysfs regenerates the contents when reading from offset 0.
+ * This is meant for sampling counters, e.g. frequencies or rc6 residencies,
+ * at a high rate.
+ *
+ * Returns:
+ * A file descriptor to be closed with close() after use, or -errno on
+ * failure.
+ */
+int igt_sysfs_attr_open(int dir, const char *attr)
+{
+	int fd;
+
+	fd = openat(dir, attr, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	return fd;
+}
+
+/**
+ * igt_sysfs_attr_read:
+ * @fd: sysfs file from igt_sysfs_attr_open()
+ * @buf: the buffer to read into
+ * @len: the size of @buf
+ *
+ * Reads the current contents of the sysfs file into @buf, nul-terminated
+ * and with the trailing newlines removed.
+ *
+ * Returns:
+ * The length of the string read, -errno on failure.
+ */
+int igt_sysfs_attr_read(int fd, char *buf, int len)
+{
+	int ret;
+
+	igt_assert(len > 0);
+
+	do {
+		ret = pread(fd, buf, len - 1, 0);
+	} while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+	if (ret < 0)
+		return -errno;
+
+	buf[ret] = '\0';
+	while (ret > 0 && buf[ret - 1] == '\n')
+		buf[--ret] = '\0';
+
+	return ret;
+}
+
+/**
+ * igt_sysfs_attr_get_u64:
+ * @fd: sysfs file from igt_sysfs_attr_open()
+ * @value: (out): where to store the value read
+ *
+ * Convenience wrapper to read an unsigned integer from a sysfs file opened
+ * with igt_sysfs_attr_open().
+ *
+ * Returns:
+ * True if a value was read.
+ */
+bool igt_sysfs_attr_get_u64(int fd, uint64_t *value)
+{
+	char buf[32], *end;
+
+	if (igt_sysfs_attr_read(fd, buf, sizeof(buf)) <= 0)
+		return false;
+
+	errno = 0;
+	*value = strtoull(buf, &end, 0);
+
+	return !errno && end != buf;
+}
+
+/**
+ * igt_sysfs_attr_get_u64_array:
+ * @fds: sysfs files from igt_sysfs_attr_open()
+ * @values: (out): where to store the values read
+ * @count: number of entries in @fds and @values
+ *
+ * Samples several sysfs files back to back, e.g. all the frequency or
+ * residency counters of a device, so that the values read are as close
+ * together in time as possible. Entries of @values for which the read
+ * failed, or whose file descriptor is negative, are set to 0.
+ *
+ * Returns:
+ * The number of values successfully read.
+ */
+int igt_sysfs_attr_get_u64_array(const int *fds, uint64_t *values,
+				 unsigned int count)
+{
+	int ret = 0;
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (fds[i] >= 0 && igt_sysfs_attr_get_u64(fds[i], &values[i]))
+			ret++;
+		else
+			values[i] = 0;
+	}
+
+	return ret;
+}
+
 static void bind_con(const char *name, bool enable)
 {
 	const char *path = "/sys/class/vtconsole";
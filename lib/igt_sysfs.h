@@ -55,6 +55,12 @@ bool igt_sysfs_set_u32(int dir, const char *attr, uint32_t value);
 bool igt_sysfs_get_boolean(int dir, const char *attr);
 bool igt_sysfs_set_boolean(int dir, const char *attr, bool value);
 
+int igt_sysfs_attr_open(int dir, const char *attr);
+int igt_sysfs_attr_read(int fd, char *buf, int len);
+bool igt_sysfs_attr_get_u64(int fd, uint64_t *value);
+int igt_sysfs_attr_get_u64_array(const int *fds, uint64_t *values,
+				 unsigned int count);
+
 void bind_fbcon(bool enable);
 void kick_snd_hda_intel(void);
 void fbcon_blink_enable(bool enable);
@@ -196,144 +196,92 @@ bool igt_vc4_purgeable_bo(int fd, int handle, bool purgeable)
 }
 
 
-/* Calculate the t-tile width so that size = width * height * bpp / 8. */
-#define VC4_T_TILE_W(size, height, bpp) ((size) / (height) / ((bpp) / 8))
+static void vc4_copy_row(void *dst, const void *src, size_t len)
+{
+	/* A constant size lets the compiler inline a full row as a vector move */
+	if (len == 16)
+		memcpy(dst, src, 16);
+	else
+		memcpy(dst, src, len);
+}
 
-static size_t igt_vc4_t_tiled_offset(size_t stride, size_t height, size_t bpp,
-				     size_t x, size_t y)
+/*
+ * Each 64 byte subtile of a T-tiled buffer is 4 rows of 16 bytes, each 1K
+ * tile is 4x4 subtiles in row order and each 4K tile is 2x2 1K tiles. Rows
+ * of 4K tiles run from the left on even rows and from the right on odd
+ * rows, and the order of the 1K tiles within them alternates the same way.
+ * So walk the 4K tiles in memory order, rather than looking up the offset
+ * of each pixel, and copy 16 byte rows, which keeps the accesses to the
+ * write-combined bo sequential.
+ */
+static void vc4_fb_copy_plane_t_tiled(struct igt_fb *tiled, void *tiled_buf,
+				      struct igt_fb *linear, void *linear_buf,
+				      unsigned int plane, bool to_tiled)
 {
-	const size_t t1k_map_even[] = { 0, 3, 1, 2 };
-	const size_t t1k_map_odd[] = { 2, 1, 3, 0 };
-	const size_t t4k_t_h = 32;
-	const size_t t1k_t_h = 16;
-	const size_t t64_t_h = 4;
-	size_t offset = 0;
-	size_t t4k_t_w, t4k_w, t4k_x, t4k_y;
-	size_t t1k_t_w, t1k_x, t1k_y;
-	size_t t64_t_w, t64_x, t64_y;
-	size_t pix_x, pix_y;
-	unsigned int index;
+	/* The 1K tile at each offset of a 4K tile, as 2 * y + x */
+	static const unsigned int t1k_even[] = { 0, 2, 3, 1 };
+	static const unsigned int t1k_odd[] = { 3, 1, 0, 2 };
+	size_t bpp = linear->plane_bpp[plane];
+	size_t width = linear->width * bpp / 8;
+	size_t t4k_w = tiled->strides[plane] / 128;
+	uint8_t *tile = tiled_buf + tiled->offsets[plane];
+	unsigned int ty, k, s, i;
 
-	/* T-tiling is only supported for 16 and 32 bpp. */
 	igt_assert(bpp == 16 || bpp == 32);
+	igt_assert(tiled->strides[plane] % 128 == 0);
 
-	/* T-tiling stride must be aligned to the 4K tiles strides. */
-	igt_assert((stride % (4096 / t4k_t_h)) == 0);
-
-	/* Calculate the tile width for the bpp. */
-	t4k_t_w = VC4_T_TILE_W(4096, t4k_t_h, bpp);
-	t1k_t_w = VC4_T_TILE_W(1024, t1k_t_h, bpp);
-	t64_t_w = VC4_T_TILE_W(64, t64_t_h, bpp);
+	for (ty = 0; ty * 32 < linear->height; ty++) {
+		const unsigned int *map = ty % 2 ? t1k_odd : t1k_even;
 
-	/* Aligned total width in number of 4K tiles. */
-	t4k_w = (stride / (bpp / 8)) / t4k_t_w;
+		for (k = 0; k < t4k_w; k++, tile += 4096) {
+			unsigned int tx = ty % 2 ? t4k_w - k - 1 : k;
 
-	/* X and y coordinates in number of 4K tiles. */
-	t4k_x = x / t4k_t_w;
-	t4k_y = y / t4k_t_h;
+			if (tx * 128 >= width)
+				continue;
 
-	/* Increase offset to the beginning of the 4K tile row. */
-	offset += t4k_y * t4k_w * 4096;
+			for (s = 0; s < 4; s++) {
+				unsigned int x = tx * 128 + map[s] % 2 * 64;
+				unsigned int y = ty * 32 + map[s] / 2 * 16;
+				uint8_t *t1k = tile + s * 1024;
 
-	/* X and Y coordinates in number of 1K tiles within the 4K tile. */
-	t1k_x = (x % t4k_t_w) / t1k_t_w;
-	t1k_y = (y % t4k_t_h) / t1k_t_h;
+				if (x >= width || y >= linear->height)
+					continue;
 
-	/* Index for 1K tile map lookup. */
-	index = 2 * t1k_y + t1k_x;
+				for (i = 0; i < 1024; i += 16) {
+					unsigned int row_y = y + i / 256 * 4 + i % 64 / 16;
+					unsigned int row_x = x + i % 256 / 64 * 16;
+					uint8_t *row;
+					size_t len;
 
-	/* Odd rows start from the right, even rows from the left. */
-	if (t4k_y % 2) {
-		/* Increase offset to the 4K tile (starting from the right). */
-		offset += (t4k_w - t4k_x - 1) * 4096;
+					if (row_y >= linear->height || row_x >= width)
+						continue;
 
-		/* Incrase offset to the beginning of the (odd) 1K tile. */
-		offset += t1k_map_odd[index] * 1024;
-	} else {
-		/* Increase offset to the 4K tile (starting from the left). */
-		offset += t4k_x * 4096;
+					row = linear_buf + linear->offsets[plane] +
+						linear->strides[plane] * row_y + row_x;
+					len = min(16, width - row_x);
 
-		/* Incrase offset to the beginning of the (even) 1K tile. */
-		offset += t1k_map_even[index] * 1024;
+					if (to_tiled)
+						vc4_copy_row(t1k + i, row, len);
+					else
+						vc4_copy_row(row, t1k + i, len);
+				}
+			}
+		}
 	}
-
-	/* X and Y coordinates in number of 64 byte tiles within the 1K tile. */
-	t64_x = (x % t1k_t_w) / t64_t_w;
-	t64_y = (y % t1k_t_h) / t64_t_h;
-
-	/* Increase offset to the beginning of the 64-byte tile. */
-	offset += (t64_y * (t1k_t_w / t64_t_w) + t64_x) * 64;
-
-	/* X and Y coordinates in number of pixels within the 64-byte tile. */
-	pix_x = x % t64_t_w;
-	pix_y = y % t64_t_h;
-
-	/* Increase offset to the correct pixel. */
-	offset += (pix_y * t64_t_w + pix_x) * bpp / 8;
-
-	return offset;
 }
 
 static void vc4_fb_convert_plane_to_t_tiled(struct igt_fb *dst, void *dst_buf,
 					    struct igt_fb *src, void *src_buf,
 					    unsigned int plane)
 {
-	size_t bpp = src->plane_bpp[plane];
-	unsigned int i, j;
-
-	for (i = 0; i < src->height; i++) {
-		for (j = 0; j < src->width; j++) {
-			size_t src_offset = src->offsets[plane];
-			size_t dst_offset = dst->offsets[plane];
-
-			src_offset += src->strides[plane] * i + j * bpp / 8;
-			dst_offset += igt_vc4_t_tiled_offset(dst->strides[plane],
-							     dst->height,
-							     bpp, j, i);
-
-			switch (bpp) {
-			case 16:
-				*(uint16_t *)(dst_buf + dst_offset) =
-					*(uint16_t *)(src_buf + src_offset);
-				break;
-			case 32:
-				*(uint32_t *)(dst_buf + dst_offset) =
-					*(uint32_t *)(src_buf + src_offset);
-				break;
-			}
-		}
-	}
+	vc4_fb_copy_plane_t_tiled(dst, dst_buf, src, src_buf, plane, true);
 }
 
 static void vc4_fb_convert_plane_from_t_tiled(struct igt_fb *dst, void *dst_buf,
 					      struct igt_fb *src, void *src_buf,
 					      unsigned int plane)
 {
-	size_t bpp = src->plane_bpp[plane];
-	unsigned int i, j;
-
-	for (i = 0; i < src->height; i++) {
-		for (j = 0; j < src->width; j++) {
-			size_t src_offset = src->offsets[plane];
-			size_t dst_offset = dst->offsets[plane];
-
-			src_offset += igt_vc4_t_tiled_offset(src->strides[plane],
-							     src->height,
-							     bpp, j, i);
-			src_offset += dst->strides[plane] * i + j * bpp / 8;
-
-			switch (bpp) {
-			case 16:
-				*(uint16_t *)(dst_buf + dst_offset) =
-					*(uint16_t *)(src_buf + src_offset);
-				break;
-			case 32:
-				*(uint32_t *)(dst_buf + dst_offset) =
-					*(uint32_t *)(src_buf + src_offset);
-				break;
-			}
-		}
-	}
+	vc4_fb_copy_plane_t_tiled(src, src_buf, dst, dst_buf, plane, false);
 }
 
 static size_t vc4_sand_tiled_offset(size_t column_width, size_t column_size, size_t x,
@@ -354,14 +302,20 @@ static size_t vc4_sand_tiled_offset(size_t column_width, size_t column_size, siz
 	return offset;
 }
 
-static void vc4_fb_convert_plane_to_sand_tiled(struct igt_fb *dst, void *dst_buf,
-					       struct igt_fb *src, void *src_buf,
-					       unsigned int plane)
+/*
+ * A SAND column holds column_height rows of the column width each, so the
+ * part of a linear row in a column is one contiguous copy. Walk each column
+ * from top to bottom, which is memory order for the tiled buffer.
+ */
+static void vc4_fb_copy_plane_sand_tiled(struct igt_fb *tiled, void *tiled_buf,
+					 struct igt_fb *linear, void *linear_buf,
+					 unsigned int plane, bool to_tiled)
 {
-	uint64_t modifier_base = fourcc_mod_broadcom_mod(dst->modifier);
-	uint32_t column_height = fourcc_mod_broadcom_param(dst->modifier);
-	uint32_t column_width_bytes, column_width, column_size;
-	size_t bpp = dst->plane_bpp[plane];
+	uint64_t modifier_base = fourcc_mod_broadcom_mod(tiled->modifier);
+	uint32_t column_height = fourcc_mod_broadcom_param(tiled->modifier);
+	uint32_t column_width_bytes, column_width, column_size, column_row;
+	size_t bpp = tiled->plane_bpp[plane];
+	size_t width = linear->plane_width[plane] * bpp / 8;
 	unsigned int i, j;
 
 	switch (modifier_base) {
@@ -381,89 +335,44 @@ static void vc4_fb_convert_plane_to_sand_tiled(struct igt_fb *dst, void *dst_buf
 		igt_assert(false);
 	}
 
-	column_width = column_width_bytes * dst->plane_width[plane] / dst->width;
+	igt_assert(bpp == 8 || bpp == 16);
+
+	column_width = column_width_bytes * tiled->plane_width[plane] / tiled->width;
 	column_size = column_width_bytes * column_height;
 
-	for (i = 0; i < dst->plane_height[plane]; i++) {
-		for (j = 0; j < src->plane_width[plane]; j++) {
-			size_t src_offset = src->offsets[plane];
-			size_t dst_offset = dst->offsets[plane];
-
-			src_offset += src->strides[plane] * i + j * bpp / 8;
-			dst_offset += vc4_sand_tiled_offset(column_width,
-							    column_size, j, i,
-							    bpp);
-
-			switch (bpp) {
-			case 8:
-				*(uint8_t *)(dst_buf + dst_offset) =
-					*(uint8_t *)(src_buf + src_offset);
-				break;
-			case 16:
-				*(uint16_t *)(dst_buf + dst_offset) =
-					*(uint16_t *)(src_buf + src_offset);
-				break;
-			default:
-				igt_assert(false);
-			}
+	column_row = column_width * bpp / 8;
+
+	for (j = 0; j < width; j += column_row) {
+		uint8_t *t = tiled_buf + tiled->offsets[plane] +
+			vc4_sand_tiled_offset(column_width, column_size,
+					      j / (bpp / 8), 0, bpp);
+		uint8_t *row = linear_buf + linear->offsets[plane] + j;
+		size_t len = min(column_row, width - j);
+
+		for (i = 0; i < tiled->plane_height[plane]; i++) {
+			if (to_tiled)
+				memcpy(t, row, len);
+			else
+				memcpy(row, t, len);
+
+			t += column_row;
+			row += linear->strides[plane];
 		}
 	}
 }
 
+static void vc4_fb_convert_plane_to_sand_tiled(struct igt_fb *dst, void *dst_buf,
+					       struct igt_fb *src, void *src_buf,
+					       unsigned int plane)
+{
+	vc4_fb_copy_plane_sand_tiled(dst, dst_buf, src, src_buf, plane, true);
+}
+
 static void vc4_fb_convert_plane_from_sand_tiled(struct igt_fb *dst, void *dst_buf,
 						 struct igt_fb *src, void *src_buf,
 						 unsigned int plane)
 {
-	uint64_t modifier_base = fourcc_mod_broadcom_mod(src->modifier);
-	uint32_t column_height = fourcc_mod_broadcom_param(src->modifier);
-	uint32_t column_width_bytes, column_width, column_size;
-	size_t bpp = src->plane_bpp[plane];
-	unsigned int i, j;
-
-	switch (modifier_base) {
-	case DRM_FORMAT_MOD_BROADCOM_SAND32:
-		column_width_bytes = 32;
-		break;
-	case DRM_FORMAT_MOD_BROADCOM_SAND64:
-		column_width_bytes = 64;
-		break;
-	case DRM_FORMAT_MOD_BROADCOM_SAND128:
-		column_width_bytes = 128;
-		break;
-	case DRM_FORMAT_MOD_BROADCOM_SAND256:
-		column_width_bytes = 256;
-		break;
-	default:
-		igt_assert(false);
-	}
-
-	column_width = column_width_bytes * src->plane_width[plane] / src->width;
-	column_size = column_width_bytes * column_height;
-
-	for (i = 0; i < dst->plane_height[plane]; i++) {
-		for (j = 0; j < src->plane_width[plane]; j++) {
-			size_t src_offset = src->offsets[plane];
-			size_t dst_offset = dst->offsets[plane];
-
-			src_offset += vc4_sand_tiled_offset(column_width,
-							    column_size, j, i,
-							    bpp);
-			dst_offset += dst->strides[plane] * i + j * bpp / 8;
-
-			switch (bpp) {
-			case 8:
-				*(uint8_t *)(dst_buf + dst_offset) =
-					*(uint8_t *)(src_buf + src_offset);
-				break;
-			case 16:
-				*(uint16_t *)(dst_buf + dst_offset) =
-					*(uint16_t *)(src_buf + src_offset);
-				break;
-			default:
-				igt_assert(false);
-			}
-		}
-	}
+	vc4_fb_copy_plane_sand_tiled(src, src_buf, dst, dst_buf, plane, false);
 }
 
 void vc4_fb_convert_plane_to_tiled(struct igt_fb *dst, void *dst_buf,
@@ -33,6 +33,7 @@
 
 #include "drm.h"
 #include "drmtest.h"
+#include "igt_aux.h"
 #include "intel_batchbuffer.h"
 #include "intel_bufmgr.h"
 #include "intel_chipset.h"
@@ -42,6 +43,7 @@
 #include "ioctl_wrappers.h"
 #include "media_spin.h"
 #include "gpgpu_fill.h"
+#include "i915/gem_vma.h"
 
 #include <i915_drm.h>
 
@@ -120,22 +122,67 @@ intel_batchbuffer_subdata_offset(struct intel_batchbuffer *batch, void *ptr)
 	return (uint8_t *)ptr - batch->buffer;
 }
 
+static void
+intel_batchbuffer_pin_bo(struct intel_batchbuffer *batch, drm_intel_bo *bo)
+{
+	uint64_t offset;
+
+	offset = gem_vma_allocator_alloc(batch->allocator, bo->handle,
+					 bo->size, bo->align);
+
+	if (gem_vma_allocator_end(batch->allocator) > 1ull << 32)
+		igt_assert_eq(drm_intel_bo_use_48b_address_range(bo, 1), 0);
+	igt_assert_eq(drm_intel_bo_set_softpin_offset(bo, offset), 0);
+}
+
+static drm_intel_bo *
+intel_batchbuffer_next_bo(struct intel_batchbuffer *batch)
+{
+	unsigned int i, slot;
+
+	batch->resets++;
+
+	/* Starting from the oldest batch, take the first one that is idle */
+	for (i = 0; i < BATCH_RING_SIZE; i++) {
+		slot = (batch->ring_next + i) % BATCH_RING_SIZE;
+
+		if (!batch->ring[slot]) {
+			batch->ring[slot] = drm_intel_bo_alloc(batch->bufmgr,
+							       "batchbuffer",
+							       BATCH_SZ, 4096);
+			goto out;
+		}
+
+		if (!drm_intel_bo_busy(batch->ring[slot]))
+			goto out;
+	}
+
+	/* All of them are still in flight, wait for the oldest one */
+	slot = batch->ring_next;
+	batch->waits++;
+	drm_intel_bo_wait_rendering(batch->ring[slot]);
+
+out:
+	batch->ring_next = (slot + 1) % BATCH_RING_SIZE;
+	drm_intel_gem_bo_clear_relocs(batch->ring[slot], 0);
+
+	return batch->ring[slot];
+}
+
 /**
  * intel_batchbuffer_reset:
  * @batch: batchbuffer object
  *
- * Resets @batch by allocating a new gem buffer object as backing storage.
+ * Resets @batch, switching to the next idle gem buffer object of its ring as
+ * backing storage. A new one is allocated while the ring is not full, and the
+ * oldest one waited for if all of them are busy.
  */
 void
 intel_batchbuffer_reset(struct intel_batchbuffer *batch)
 {
-	if (batch->bo != NULL) {
-		drm_intel_bo_unreference(batch->bo);
-		batch->bo = NULL;
-	}
-
-	batch->bo = drm_intel_bo_alloc(batch->bufmgr, "batchbuffer",
-				       BATCH_SZ, 4096);
+	batch->bo = intel_batchbuffer_next_bo(batch);
+	if (batch->allocator)
+		intel_batchbuffer_pin_bo(batch, batch->bo);
 
 	memset(batch->buffer, 0, sizeof(batch->buffer));
 	batch->ctx = NULL;
@@ -176,7 +223,17 @@ intel_batchbuffer_alloc(drm_intel_bufmgr *bufmgr, uint32_t devid)
 void
 intel_batchbuffer_free(struct intel_batchbuffer *batch)
 {
-	drm_intel_bo_unreference(batch->bo);
+	int i;
+
+	if (batch->waits)
+		igt_debug("Batchbuffer waited for an idle batch on %lu of %lu resets\n",
+			  batch->waits, batch->resets);
+
+	for (i = 0; i < BATCH_RING_SIZE; i++)
+		if (batch->ring[i])
+			drm_intel_bo_unreference(batch->ring[i]);
+	if (batch->render_state)
+		drm_intel_bo_unreference(batch->render_state);
 	batch->bo = NULL;
 	free(batch);
 }
@@ -248,6 +305,55 @@ intel_batchbuffer_set_context(struct intel_batchbuffer *batch,
 	batch->ctx = context;
 }
 
+/**
+ * intel_batchbuffer_set_allocator:
+ * @batch: batchbuffer object
+ * @allocator: softpin address allocator, or NULL to go back to relocations
+ *
+ * Makes @batch softpin its own buffer and every buffer passed to
+ * intel_batchbuffer_emit_reloc() at addresses handed out by @allocator. The
+ * addresses are then final when the commands are emitted and the kernel has
+ * no relocations to process at execution time.
+ *
+ * @allocator must cover the address space @batch gets executed in, and all
+ * the buffers that are softpinned in that address space must have been placed
+ * with it.
+ */
+void
+intel_batchbuffer_set_allocator(struct intel_batchbuffer *batch,
+				struct gem_vma_allocator *allocator)
+{
+	batch->allocator = allocator;
+	if (allocator)
+		intel_batchbuffer_pin_bo(batch, batch->bo);
+}
+
+/**
+ * intel_batchbuffer_cache_render_state:
+ * @batch: batchbuffer object
+ * @enable: whether to keep the invariant render copy state
+ *
+ * With @enable, the render copy functions that support it build the 3D
+ * pipeline state that is the same for every copy only once, into a buffer
+ * kept with @batch, and call it from each copy with a second level
+ * MI_BATCH_BUFFER_START. Each copy then only writes its surface states,
+ * vertices and primitive into the batch.
+ *
+ * The hardware state is still programmed in full by every copy, so this is
+ * safe to use across contexts. Currently only gen9+ supports it.
+ */
+void
+intel_batchbuffer_cache_render_state(struct intel_batchbuffer *batch,
+				     bool enable)
+{
+	batch->cache_render_state = enable;
+	if (!enable && batch->render_state) {
+		drm_intel_bo_unreference(batch->render_state);
+		batch->render_state = NULL;
+		batch->render_state_key = NULL;
+	}
+}
+
 /**
  * intel_batchbuffer_flush_with_context:
  * @batch: batchbuffer object
@@ -309,7 +415,9 @@ intel_batchbuffer_flush(struct intel_batchbuffer *batch)
  *
  * Note that @fenced is only relevant if @buffer is actually tiled.
  *
- * This is the only way buffers get added to the validate list.
+ * This is the only way buffers get added to the validate list. When @batch
+ * has an allocator, @buffer is softpinned first and libdrm only adds it to
+ * the validate list, without any relocation entry.
  */
 void
 intel_batchbuffer_emit_reloc(struct intel_batchbuffer *batch,
@@ -325,6 +433,9 @@ intel_batchbuffer_emit_reloc(struct intel_batchbuffer *batch,
 			 batch->ptr, batch->buffer,
 			 (int)(batch->ptr - batch->buffer), BATCH_SZ);
 
+	if (batch->allocator)
+		intel_batchbuffer_pin_bo(batch, buffer);
+
 	if (fenced)
 		ret = drm_intel_bo_emit_reloc_fence(batch->bo, batch->ptr - batch->buffer,
 						    buffer, delta,
@@ -616,48 +727,319 @@ static uint32_t fast_copy_dword1(unsigned int src_tiling,
 	return dword1;
 }
 
-static void
-fill_relocation(struct drm_i915_gem_relocation_entry *reloc,
-		uint32_t gem_handle, uint32_t delta, /* in bytes */
-		uint32_t offset, /* in dwords */
-		uint32_t read_domains, uint32_t write_domains)
+/* Number of batch objects an intel_bb cycles through */
+#define INTEL_BB_RING_SIZE 4
+
+struct intel_bb {
+	int i915;
+	int gen;
+	uint32_t ctx;
+
+	/* NULL when softpin is not supported and relocations are used */
+	struct gem_vma_allocator *allocator;
+
+	uint32_t batches[INTEL_BB_RING_SIZE];
+	unsigned int current;
+	uint32_t last;
+	uint32_t size;
+
+	uint32_t *buffer;
+	uint32_t *ptr;
+
+	struct drm_i915_gem_exec_object2 *objects;
+	unsigned int object_count;
+	unsigned int object_slots;
+
+	struct drm_i915_gem_relocation_entry *relocs;
+	unsigned int reloc_count;
+	unsigned int reloc_slots;
+};
+
+/**
+ * intel_bb_create:
+ * @i915: open i915 drm file descriptor
+ * @size: size of the batches in bytes
+ *
+ * Creates a batchbuffer which talks to the kernel directly instead of going
+ * through libdrm_intel. Where softpin is supported, the batch objects and the
+ * objects registered with intel_bb_register_object() are pinned at fixed
+ * addresses, so the commands are emitted with their final addresses and
+ * nothing gets relocated. The batch objects are reused from a small ring
+ * instead of being created for each submission.
+ *
+ * Returns: the new batchbuffer, to be freed with intel_bb_destroy()
+ */
+struct intel_bb *intel_bb_create(int i915, uint32_t size)
 {
-	reloc->target_handle = gem_handle;
-	reloc->delta = delta;
-	reloc->offset = offset * sizeof(uint32_t);
-	reloc->presumed_offset = 0;
-	reloc->read_domains = read_domains;
-	reloc->write_domain = write_domains;
+	struct intel_bb *ibb;
+	int i;
+
+	igt_assert(size && !(size & 7));
+
+	ibb = calloc(1, sizeof(*ibb));
+	igt_assert(ibb);
+
+	ibb->i915 = i915;
+	ibb->gen = intel_gen(intel_get_drm_devid(i915));
+	ibb->size = size;
+
+	ibb->buffer = calloc(1, size);
+	igt_assert(ibb->buffer);
+	ibb->ptr = ibb->buffer;
+
+	if (gem_has_softpin(i915))
+		ibb->allocator = gem_vma_allocator_create(i915, 0);
+
+	for (i = 0; i < INTEL_BB_RING_SIZE; i++) {
+		ibb->batches[i] = gem_create(i915, size);
+		if (ibb->allocator)
+			gem_vma_allocator_alloc(ibb->allocator,
+						ibb->batches[i], size, 0);
+	}
+
+	return ibb;
 }
 
-static void
-fill_object(struct drm_i915_gem_exec_object2 *obj, uint32_t gem_handle,
-	    struct drm_i915_gem_relocation_entry *relocs, uint32_t count)
+/**
+ * intel_bb_destroy:
+ * @ibb: the batchbuffer
+ *
+ * Frees @ibb and its batch objects.
+ */
+void intel_bb_destroy(struct intel_bb *ibb)
+{
+	int i;
+
+	for (i = 0; i < INTEL_BB_RING_SIZE; i++)
+		gem_close(ibb->i915, ibb->batches[i]);
+
+	if (ibb->allocator)
+		gem_vma_allocator_destroy(ibb->allocator);
+
+	free(ibb->objects);
+	free(ibb->relocs);
+	free(ibb->buffer);
+	free(ibb);
+}
+
+/**
+ * intel_bb_set_context:
+ * @ibb: the batchbuffer
+ * @ctx_id: the context the next batches are executed on
+ */
+void intel_bb_set_context(struct intel_bb *ibb, uint32_t ctx_id)
+{
+	ibb->ctx = ctx_id;
+}
+
+/**
+ * intel_bb_out:
+ * @ibb: the batchbuffer
+ * @dword: the value to emit
+ *
+ * Emits @dword into @ibb.
+ */
+void intel_bb_out(struct intel_bb *ibb, uint32_t dword)
 {
+	igt_assert((ibb->ptr - ibb->buffer + 1) * sizeof(uint32_t) <=
+		   ibb->size);
+
+	*ibb->ptr++ = dword;
+}
+
+static struct drm_i915_gem_exec_object2 *
+intel_bb_add_object(struct intel_bb *ibb, uint32_t handle)
+{
+	struct drm_i915_gem_exec_object2 *obj;
+	uint64_t offset;
+	unsigned int i;
+
+	for (i = 0; i < ibb->object_count; i++)
+		if (ibb->objects[i].handle == handle)
+			return &ibb->objects[i];
+
+	if (ibb->object_count == ibb->object_slots) {
+		ibb->object_slots = ibb->object_slots ?
+				    2 * ibb->object_slots : 8;
+		ibb->objects = realloc(ibb->objects,
+				       ibb->object_slots *
+				       sizeof(*ibb->objects));
+		igt_assert(ibb->objects);
+	}
+
+	obj = &ibb->objects[ibb->object_count++];
 	memset(obj, 0, sizeof(*obj));
-	obj->handle = gem_handle;
-	obj->relocation_count = count;
-	obj->relocs_ptr = to_user_pointer(relocs);
+	obj->handle = handle;
+
+	if (ibb->allocator &&
+	    gem_vma_allocator_lookup(ibb->allocator, handle, &offset)) {
+		obj->offset = offset;
+		obj->flags = EXEC_OBJECT_PINNED;
+		if (gem_vma_allocator_end(ibb->allocator) > 1ull << 32)
+			obj->flags |= EXEC_OBJECT_SUPPORTS_48B_ADDRESS;
+	}
+
+	return obj;
+}
+
+/**
+ * intel_bb_register_object:
+ * @ibb: the batchbuffer
+ * @handle: the object
+ * @size: size of the object
+ *
+ * Lets @ibb softpin @handle, which requires knowing its size. Objects that
+ * are not registered are still usable, but get relocated by the kernel.
+ * Does nothing where softpin is not supported.
+ */
+void intel_bb_register_object(struct intel_bb *ibb, uint32_t handle,
+			      uint64_t size)
+{
+	if (ibb->allocator)
+		gem_vma_allocator_alloc(ibb->allocator, handle, size, 0);
+}
+
+/**
+ * intel_bb_emit_reloc:
+ * @ibb: the batchbuffer
+ * @handle: the object the address points into
+ * @read_domains: gem domain bits for the access
+ * @write_domain: gem domain bit for the access, 0 for read-only accesses
+ * @delta: offset into the object
+ *
+ * Adds @handle to the objects of the next submission and emits its address
+ * plus @delta into @ibb, as one dword before gen8 and two dwords after.
+ */
+void intel_bb_emit_reloc(struct intel_bb *ibb, uint32_t handle,
+			 uint32_t read_domains, uint32_t write_domain,
+			 uint64_t delta)
+{
+	struct drm_i915_gem_exec_object2 *obj;
+	uint64_t address;
+
+	obj = intel_bb_add_object(ibb, handle);
+	if (write_domain)
+		obj->flags |= EXEC_OBJECT_WRITE;
+
+	if (!(obj->flags & EXEC_OBJECT_PINNED)) {
+		struct drm_i915_gem_relocation_entry *reloc;
+
+		if (ibb->reloc_count == ibb->reloc_slots) {
+			ibb->reloc_slots = ibb->reloc_slots ?
+					   2 * ibb->reloc_slots : 8;
+			ibb->relocs = realloc(ibb->relocs,
+					      ibb->reloc_slots *
+					      sizeof(*ibb->relocs));
+			igt_assert(ibb->relocs);
+		}
+
+		reloc = &ibb->relocs[ibb->reloc_count++];
+		memset(reloc, 0, sizeof(*reloc));
+		reloc->target_handle = handle;
+		reloc->delta = delta;
+		reloc->offset = (ibb->ptr - ibb->buffer) * sizeof(uint32_t);
+		reloc->presumed_offset = -1;
+		reloc->read_domains = read_domains;
+		reloc->write_domain = write_domain;
+	}
+
+	address = obj->offset + delta;
+	intel_bb_out(ibb, address);
+	if (ibb->gen >= 8)
+		intel_bb_out(ibb, address >> 32);
+}
+
+/**
+ * intel_bb_exec:
+ * @ibb: the batchbuffer
+ * @flags: execbuf flags, e.g. the engine selection
+ *
+ * Terminates the commands emitted so far, submits them and resets @ibb for
+ * the next batch. The batch object then goes back to the end of the ring.
+ */
+void intel_bb_exec(struct intel_bb *ibb, uint64_t flags)
+{
+	struct drm_i915_gem_execbuffer2 execbuf = {};
+	struct drm_i915_gem_exec_object2 *batch;
+	uint32_t handle = ibb->batches[ibb->current];
+	uint32_t used;
+
+	intel_bb_out(ibb, MI_BATCH_BUFFER_END);
+	if ((ibb->ptr - ibb->buffer) & 1)
+		intel_bb_out(ibb, MI_NOOP);
+	used = (ibb->ptr - ibb->buffer) * sizeof(uint32_t);
+
+	/* Waits for the previous use of this batch object, if any */
+	gem_write(ibb->i915, handle, 0, ibb->buffer, used);
+
+	batch = intel_bb_add_object(ibb, handle);
+	batch->relocs_ptr = to_user_pointer(ibb->relocs);
+	batch->relocation_count = ibb->reloc_count;
+
+	execbuf.buffers_ptr = to_user_pointer(ibb->objects);
+	execbuf.buffer_count = ibb->object_count;
+	execbuf.batch_len = used;
+	execbuf.flags = flags;
+	if (!ibb->reloc_count)
+		execbuf.flags |= I915_EXEC_NO_RELOC;
+	i915_execbuffer2_set_context_id(execbuf, ibb->ctx);
+
+	gem_execbuf(ibb->i915, &execbuf);
+
+	ibb->last = handle;
+	ibb->current = (ibb->current + 1) % INTEL_BB_RING_SIZE;
+	ibb->object_count = 0;
+	ibb->reloc_count = 0;
+	ibb->ptr = ibb->buffer;
+}
+
+/**
+ * intel_bb_sync:
+ * @ibb: the batchbuffer
+ *
+ * Waits for the last batch submitted with @ibb to complete.
+ */
+void intel_bb_sync(struct intel_bb *ibb)
+{
+	if (ibb->last)
+		gem_sync(ibb->i915, ibb->last);
 }
 
-static void exec_blit(int fd,
-		      struct drm_i915_gem_exec_object2 *objs, uint32_t count,
-		      uint32_t batch_len /* in dwords */)
+static void emit_fast_copy(struct intel_bb *ibb,
+			   uint32_t src_handle, unsigned int src_delta,
+			   unsigned int src_stride, unsigned int src_tiling,
+			   unsigned int src_x, unsigned int src_y,
+			   unsigned int width, unsigned int height, int bpp,
+			   uint32_t dst_handle, unsigned int dst_delta,
+			   unsigned int dst_stride, unsigned int dst_tiling,
+			   unsigned int dst_x, unsigned int dst_y)
 {
-	struct drm_i915_gem_execbuffer2 exec;
+	uint32_t dword0, dword1;
+	uint32_t src_pitch, dst_pitch;
+
+	src_pitch = fast_copy_pitch(src_stride, src_tiling);
+	dst_pitch = fast_copy_pitch(dst_stride, dst_tiling);
+	dword0 = fast_copy_dword0(src_tiling, dst_tiling);
+	dword1 = fast_copy_dword1(src_tiling, dst_tiling, bpp);
 
-	exec.buffers_ptr = to_user_pointer(objs);
-	exec.buffer_count = count;
-	exec.batch_start_offset = 0;
-	exec.batch_len = batch_len * 4;
-	exec.DR1 = exec.DR4 = 0;
-	exec.num_cliprects = 0;
-	exec.cliprects_ptr = 0;
-	exec.flags = I915_EXEC_BLT;
-	i915_execbuffer2_set_context_id(exec, 0);
-	exec.rsvd2 = 0;
+	CHECK_RANGE(src_x); CHECK_RANGE(src_y);
+	CHECK_RANGE(dst_x); CHECK_RANGE(dst_y);
+	CHECK_RANGE(width); CHECK_RANGE(height);
+	CHECK_RANGE(src_x + width); CHECK_RANGE(src_y + height);
+	CHECK_RANGE(dst_x + width); CHECK_RANGE(dst_y + height);
+	CHECK_RANGE(src_pitch); CHECK_RANGE(dst_pitch);
 
-	gem_execbuf(fd, &exec);
+	intel_bb_out(ibb, dword0);
+	intel_bb_out(ibb, dword1 | dst_pitch);
+	intel_bb_out(ibb, (dst_y << 16) | dst_x); /* dst x1,y1 */
+	intel_bb_out(ibb, ((dst_y + height) << 16) | (dst_x + width)); /* dst x2,y2 */
+	intel_bb_emit_reloc(ibb, dst_handle,
+			    I915_GEM_DOMAIN_RENDER, I915_GEM_DOMAIN_RENDER,
+			    dst_delta);
+	intel_bb_out(ibb, (src_y << 16) | src_x); /* src x1,y1 */
+	intel_bb_out(ibb, src_pitch);
+	intel_bb_emit_reloc(ibb, src_handle,
+			    I915_GEM_DOMAIN_RENDER, 0, src_delta);
 }
 
 /**
@@ -702,55 +1084,257 @@ void igt_blitter_fast_copy__raw(int fd,
 				unsigned int dst_tiling,
 				unsigned int dst_x, unsigned dst_y)
 {
-	uint32_t batch[12];
-	struct drm_i915_gem_exec_object2 objs[3];
-	struct drm_i915_gem_relocation_entry relocs[2];
-	uint32_t batch_handle;
-	uint32_t dword0, dword1;
-	uint32_t src_pitch, dst_pitch;
-	int i = 0;
+	struct intel_bb *ibb = intel_bb_create(fd, 4096);
 
-	src_pitch = fast_copy_pitch(src_stride, src_tiling);
-	dst_pitch = fast_copy_pitch(dst_stride, dst_tiling);
-	dword0 = fast_copy_dword0(src_tiling, dst_tiling);
-	dword1 = fast_copy_dword1(src_tiling, dst_tiling, bpp);
+	igt_blitter_fast_copy__bb(ibb, src_handle, src_delta, src_stride,
+				  src_tiling, src_x, src_y, width, height, bpp,
+				  dst_handle, dst_delta, dst_stride, dst_tiling,
+				  dst_x, dst_y);
 
-	CHECK_RANGE(src_x); CHECK_RANGE(src_y);
-	CHECK_RANGE(dst_x); CHECK_RANGE(dst_y);
-	CHECK_RANGE(width); CHECK_RANGE(height);
-	CHECK_RANGE(src_x + width); CHECK_RANGE(src_y + height);
-	CHECK_RANGE(dst_x + width); CHECK_RANGE(dst_y + height);
-	CHECK_RANGE(src_pitch); CHECK_RANGE(dst_pitch);
+	intel_bb_destroy(ibb);
+}
+
+/**
+ * igt_blitter_fast_copy__bb:
+ * @ibb: native batchbuffer to use
+ * @src_handle: GEM handle of the source buffer
+ * @src_delta: offset into the source GEM bo, in bytes
+ * @src_stride: Stride (in bytes) of the source buffer
+ * @src_tiling: Tiling mode of the source buffer
+ * @src_x: X coordinate of the source region to copy
+ * @src_y: Y coordinate of the source region to copy
+ * @width: Width of the region to copy
+ * @height: Height of the region to copy
+ * @bpp: source and destination bits per pixel
+ * @dst_handle: GEM handle of the destination buffer
+ * @dst_delta: offset into the destination GEM bo, in bytes
+ * @dst_stride: Stride (in bytes) of the destination buffer
+ * @dst_tiling: Tiling mode of the destination buffer
+ * @dst_x: X coordinate of destination
+ * @dst_y: Y coordinate of destination
+ *
+ * Like igt_blitter_fast_copy__raw(), but submitting through @ibb, which
+ * amortizes the batch setup over many copies.
+ */
+void igt_blitter_fast_copy__bb(struct intel_bb *ibb,
+			       uint32_t src_handle, unsigned int src_delta,
+			       unsigned int src_stride, unsigned int src_tiling,
+			       unsigned int src_x, unsigned int src_y,
+			       unsigned int width, unsigned int height, int bpp,
+			       uint32_t dst_handle, unsigned int dst_delta,
+			       unsigned int dst_stride, unsigned int dst_tiling,
+			       unsigned int dst_x, unsigned int dst_y)
+{
+	emit_fast_copy(ibb, src_handle, src_delta, src_stride, src_tiling,
+		       src_x, src_y, width, height, bpp,
+		       dst_handle, dst_delta, dst_stride, dst_tiling,
+		       dst_x, dst_y);
+	intel_bb_exec(ibb, I915_EXEC_BLT);
+}
+
+/* Largest blit of a chunk, keeping the rebased coordinates in range */
+#define FAST_COPY_CHUNK 16384
+/* Largest pitch of a linear surface, a multiple of 64 below 1 << 15 */
+#define FAST_COPY_LINEAR_PITCH 32704
+/* Dwords of an XY_FAST_COPY_BLT, plus the MI_BATCH_BUFFER_END and padding */
+#define FAST_COPY_DWORDS (10 + 2)
+
+static void fast_copy_tile(unsigned int tiling, int bpp,
+			   unsigned int *width, unsigned int *height)
+{
+	switch (tiling) {
+	case I915_TILING_X:
+		*width = 512;
+		break;
+	case I915_TILING_Y:
+		*width = 128;
+		break;
+	case I915_TILING_Yf:
+		*width = bpp <= 8 ? 64 : bpp <= 32 ? 128 : 256;
+		break;
+	default:
+		/* Keep the rebased linear addresses cacheline aligned */
+		*width = 64;
+		*height = 1;
+		return;
+	}
+
+	*height = 4096 / *width;
+}
 
-	batch[i++] = dword0;
-	batch[i++] = dword1 | dst_pitch;
-	batch[i++] = (dst_y << 16) | dst_x; /* dst x1,y1 */
-	batch[i++] = ((dst_y + height) << 16) | (dst_x + width); /* dst x2,y2 */
-	batch[i++] = dst_delta; /* dst address lower bits */
-	batch[i++] = 0;	/* dst address upper bits */
-	batch[i++] = (src_y << 16) | src_x; /* src x1,y1 */
-	batch[i++] = src_pitch;
-	batch[i++] = src_delta; /* src address lower bits */
-	batch[i++] = 0;	/* src address upper bits */
-	batch[i++] = MI_BATCH_BUFFER_END;
-	batch[i++] = MI_NOOP;
+/*
+ * Moves as much of @x and @y as possible into @delta, a whole number of
+ * tiles, so that the blit coordinates stay in the range of the hardware.
+ */
+static void fast_copy_rebase(unsigned int stride, unsigned int tiling, int bpp,
+			     unsigned int *delta,
+			     unsigned int *x, unsigned int *y)
+{
+	unsigned int cpp = bpp / 8;
+	unsigned int tile_width, tile_height;
+	unsigned int tiles, rows;
+
+	fast_copy_tile(tiling, bpp, &tile_width, &tile_height);
 
-	igt_assert(i == ARRAY_SIZE(batch));
+	tiles = *x * cpp / tile_width;
+	*delta += tiles * tile_width * tile_height;
+	*x -= tiles * tile_width / cpp;
+
+	rows = *y / tile_height * tile_height;
+	*delta += rows * stride;
+	*y -= rows;
+}
+
+/**
+ * igt_blitter_fast_copy__chunked:
+ * @ibb: native batchbuffer to use
+ * @src_handle: GEM handle of the source buffer
+ * @src_delta: offset into the source GEM bo, in bytes
+ * @src_stride: Stride (in bytes) of the source buffer
+ * @src_tiling: Tiling mode of the source buffer
+ * @src_x: X coordinate of the source region to copy
+ * @src_y: Y coordinate of the source region to copy
+ * @width: Width of the region to copy
+ * @height: Height of the region to copy
+ * @bpp: source and destination bits per pixel
+ * @dst_handle: GEM handle of the destination buffer
+ * @dst_delta: offset into the destination GEM bo, in bytes
+ * @dst_stride: Stride (in bytes) of the destination buffer
+ * @dst_tiling: Tiling mode of the destination buffer
+ * @dst_x: X coordinate of destination
+ * @dst_y: Y coordinate of destination
+ *
+ * Like igt_blitter_fast_copy__bb(), but for surfaces beyond the coordinate
+ * and pitch limits of XY_FAST_COPY_BLT. The region is split into chunks,
+ * each blitted with coordinates relative to its nearest whole tile, and a
+ * linear surface whose stride is above the pitch limit is copied a row at a
+ * time. The blits are packed into as few batches as fit in @ibb.
+ *
+ * The stride of a tiled surface is still limited to 128KiB.
+ */
+void igt_blitter_fast_copy__chunked(struct intel_bb *ibb,
+				    uint32_t src_handle, unsigned int src_delta,
+				    unsigned int src_stride,
+				    unsigned int src_tiling,
+				    unsigned int src_x, unsigned int src_y,
+				    unsigned int width, unsigned int height,
+				    int bpp,
+				    uint32_t dst_handle, unsigned int dst_delta,
+				    unsigned int dst_stride,
+				    unsigned int dst_tiling,
+				    unsigned int dst_x, unsigned int dst_y)
+{
+	unsigned int cpp = bpp / 8;
+	unsigned int chunk_width = FAST_COPY_CHUNK;
+	unsigned int chunk_height = FAST_COPY_CHUNK;
+	bool src_rows, dst_rows;
+
+	igt_assert(ibb->size >= FAST_COPY_DWORDS * sizeof(uint32_t));
+
+	src_rows = src_tiling == I915_TILING_NONE &&
+		   src_stride > FAST_COPY_LINEAR_PITCH;
+	dst_rows = dst_tiling == I915_TILING_NONE &&
+		   dst_stride > FAST_COPY_LINEAR_PITCH;
+	if (src_rows || dst_rows) {
+		/* A single row does not step by the pitch, so fake one */
+		chunk_width = min(chunk_width, FAST_COPY_LINEAR_PITCH / cpp);
+		chunk_height = 1;
+	}
 
-	batch_handle = gem_create(fd, 4096);
-	gem_write(fd, batch_handle, 0, batch, sizeof(batch));
+	for (unsigned int y = 0; y < height; y += chunk_height) {
+		unsigned int h = min(chunk_height, height - y);
+
+		for (unsigned int x = 0; x < width; x += chunk_width) {
+			unsigned int w = min(chunk_width, width - x);
+			unsigned int sx = src_x + x, sy = src_y + y;
+			unsigned int dx = dst_x + x, dy = dst_y + y;
+			unsigned int sd = src_delta, dd = dst_delta;
+
+			fast_copy_rebase(src_stride, src_tiling, bpp,
+					 &sd, &sx, &sy);
+			fast_copy_rebase(dst_stride, dst_tiling, bpp,
+					 &dd, &dx, &dy);
+
+			if ((ibb->ptr - ibb->buffer + FAST_COPY_DWORDS) *
+			    sizeof(uint32_t) > ibb->size)
+				intel_bb_exec(ibb, I915_EXEC_BLT);
+
+			emit_fast_copy(ibb, src_handle, sd,
+				       src_rows ? ALIGN(w * cpp, 64) : src_stride,
+				       src_tiling, sx, sy, w, h, bpp,
+				       dst_handle, dd,
+				       dst_rows ? ALIGN(w * cpp, 64) : dst_stride,
+				       dst_tiling, dx, dy);
+		}
+	}
 
-	fill_relocation(&relocs[0], dst_handle, dst_delta, 4,
-			I915_GEM_DOMAIN_RENDER, I915_GEM_DOMAIN_RENDER);
-	fill_relocation(&relocs[1], src_handle, src_delta, 8, I915_GEM_DOMAIN_RENDER, 0);
+	if (ibb->ptr != ibb->buffer)
+		intel_bb_exec(ibb, I915_EXEC_BLT);
+}
 
-	fill_object(&objs[0], dst_handle, NULL, 0);
-	fill_object(&objs[1], src_handle, NULL, 0);
-	fill_object(&objs[2], batch_handle, relocs, 2);
+/* Pitch and rows of the linear 32bpp surfaces a fill is split into */
+#define FILL_PITCH 16384
+#define FILL_ROWS 16384
+/* Dwords of an XY_COLOR_BLT, plus the MI_BATCH_BUFFER_END and padding */
+#define FILL_DWORDS (7 + 2)
 
-	exec_blit(fd, objs, 3, ARRAY_SIZE(batch));
+/**
+ * igt_blitter_fill__chunked:
+ * @ibb: native batchbuffer to use
+ * @handle: GEM handle of the buffer to fill
+ * @size: number of bytes to fill from the start of the buffer, a multiple
+ *	  of 4
+ * @value: the dword to fill the buffer with
+ *
+ * Fills the first @size bytes of @handle with @value using XY_COLOR_BLT,
+ * treating the buffer as a stack of linear 32bpp surfaces each within the
+ * coordinate and pitch limits of the command. Since every dword ends up the
+ * same, this fills a framebuffer of 8, 16 or 32bpp with a single color
+ * whatever its tiling, as long as @value holds the pixel repeated. The blits
+ * are packed into as few batches as fit in @ibb.
+ */
+void igt_blitter_fill__chunked(struct intel_bb *ibb, uint32_t handle,
+			       uint64_t size, uint32_t value)
+{
+	const uint64_t flags = ibb->gen >= 6 ? I915_EXEC_BLT : I915_EXEC_DEFAULT;
+	uint64_t offset = 0;
+
+	igt_assert(ibb->size >= FILL_DWORDS * sizeof(uint32_t));
+	igt_assert_eq(size & 3, 0);
+	igt_assert(size <= UINT32_MAX);
+
+	while (offset < size) {
+		unsigned int width = FILL_PITCH / 4;
+		unsigned int rows = min(FILL_ROWS, (size - offset) / FILL_PITCH);
+
+		/* What is left is less than a row */
+		if (!rows) {
+			width = (size - offset) / 4;
+			rows = 1;
+		}
+
+		if ((ibb->ptr - ibb->buffer + FILL_DWORDS) *
+		    sizeof(uint32_t) > ibb->size)
+			intel_bb_exec(ibb, flags);
+
+		intel_bb_out(ibb, XY_COLOR_BLT_CMD_NOLEN |
+			     XY_COLOR_BLT_WRITE_ALPHA |
+			     XY_COLOR_BLT_WRITE_RGB |
+			     (ibb->gen >= 8 ? 5 : 4));
+		intel_bb_out(ibb, 3 << 24 | 0xf0 << 16 | FILL_PITCH);
+		intel_bb_out(ibb, 0); /* dst x1,y1 */
+		intel_bb_out(ibb, rows << 16 | width); /* dst x2,y2 */
+		intel_bb_emit_reloc(ibb, handle,
+				    I915_GEM_DOMAIN_RENDER,
+				    I915_GEM_DOMAIN_RENDER,
+				    offset);
+		intel_bb_out(ibb, value);
+
+		offset += (uint64_t)rows * width * 4;
+	}
 
-	gem_close(fd, batch_handle);
+	if (ibb->ptr != ibb->buffer)
+		intel_bb_exec(ibb, flags);
 }
 
 /**
@@ -848,6 +1432,46 @@ igt_render_copyfunc_t igt_get_render_copyfunc(int devid)
 	return copy;
 }
 
+static void
+render_copy_rects(struct intel_batchbuffer *batch,
+		  drm_intel_context *context,
+		  const struct igt_render_copy_rect *rects,
+		  unsigned int count)
+{
+	igt_render_copyfunc_t copy = igt_get_render_copyfunc(batch->devid);
+
+	for (unsigned int i = 0; i < count; i++)
+		copy(batch, context,
+		     rects[i].src, rects[i].src_x, rects[i].src_y,
+		     rects[i].width, rects[i].height,
+		     rects[i].dst, rects[i].dst_x, rects[i].dst_y);
+}
+
+/**
+ * igt_get_render_copy_rects_func:
+ * @devid: pci device id
+ *
+ * Returns:
+ *
+ * The platform-specific batched render copy function pointer for the device
+ * specified with @devid. Platforms without a batched implementation get one
+ * doing each copy with the function from igt_get_render_copyfunc(). Will
+ * return NULL when no render copy function is implemented.
+ */
+igt_render_copy_rects_func_t igt_get_render_copy_rects_func(int devid)
+{
+	igt_render_copy_rects_func_t copy = NULL;
+
+	if (IS_GEN9(devid) || IS_GEN10(devid))
+		copy = gen9_render_copy_rects;
+	else if (IS_GEN11(devid))
+		copy = gen11_render_copy_rects;
+	else if (igt_get_render_copyfunc(devid))
+		copy = render_copy_rects;
+
+	return copy;
+}
+
 /**
  * igt_get_media_fillfunc:
  * @devid: pci device id
@@ -905,6 +1529,57 @@ igt_fillfunc_t igt_get_gpgpu_fillfunc(int devid)
 	return fill;
 }
 
+/**
+ * igt_get_gpgpu_threaded_fillfunc:
+ * @devid: pci device id
+ *
+ * Returns:
+ *
+ * The platform-specific threaded gpgpu fill function pointer for the device
+ * specified with @devid. Will return NULL when no gpgpu fill function is
+ * implemented.
+ */
+igt_threaded_fillfunc_t igt_get_gpgpu_threaded_fillfunc(int devid)
+{
+	igt_threaded_fillfunc_t fill = NULL;
+
+	if (IS_GEN7(devid))
+		fill = gen7_gpgpu_threaded_fillfunc;
+	else if (IS_BROADWELL(devid))
+		fill = gen8_gpgpu_threaded_fillfunc;
+	else if (IS_GEN9(devid) || IS_GEN10(devid))
+		fill = gen9_gpgpu_threaded_fillfunc;
+	else if (IS_GEN11(devid))
+		fill = gen11_gpgpu_threaded_fillfunc;
+
+	return fill;
+}
+
+/**
+ * igt_gpgpu_max_threads:
+ * @fd: open i915 drm file descriptor
+ *
+ * Returns:
+ *
+ * The number of hardware threads the device can run at once, for use with
+ * an #igt_threaded_fillfunc_t, or 0 when the kernel does not report the
+ * number of EUs.
+ */
+unsigned int igt_gpgpu_max_threads(int fd)
+{
+	uint32_t devid = intel_get_drm_devid(fd);
+	struct drm_i915_getparam gp;
+	int eu_total = 0;
+
+	memset(&gp, 0, sizeof(gp));
+	gp.param = I915_PARAM_EU_TOTAL;
+	gp.value = &eu_total;
+	if (igt_ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp) || eu_total <= 0)
+		return 0;
+
+	return eu_total * (IS_IVYBRIDGE(devid) ? 8 : 7);
+}
+
 /**
  * igt_get_media_spinfunc:
  * @devid: pci device id
@@ -10,6 +10,9 @@
 
 #define BATCH_SZ 4096
 #define BATCH_RESERVED 16
+#define BATCH_RING_SIZE 8
+
+struct gem_vma_allocator;
 
 struct intel_batchbuffer {
 	drm_intel_bufmgr *bufmgr;
@@ -19,6 +22,19 @@ struct intel_batchbuffer {
 	drm_intel_context *ctx;
 	drm_intel_bo *bo;
 
+	/* When set, all buffers are softpinned at addresses taken from it */
+	struct gem_vma_allocator *allocator;
+
+	/* Batch objects reused by intel_batchbuffer_reset() once idle */
+	drm_intel_bo *ring[BATCH_RING_SIZE];
+	unsigned int ring_next;
+	unsigned long resets, waits;
+
+	/* Invariant render copy state, see intel_batchbuffer_cache_render_state() */
+	bool cache_render_state;
+	drm_intel_bo *render_state;
+	const void *render_state_key;
+
 	uint8_t buffer[BATCH_SZ];
 	uint8_t *ptr, *end;
 };
@@ -28,6 +44,10 @@ struct intel_batchbuffer *intel_batchbuffer_alloc(drm_intel_bufmgr *bufmgr,
 
 void intel_batchbuffer_set_context(struct intel_batchbuffer *batch,
 				   drm_intel_context *ctx);
+void intel_batchbuffer_set_allocator(struct intel_batchbuffer *batch,
+				     struct gem_vma_allocator *allocator);
+void intel_batchbuffer_cache_render_state(struct intel_batchbuffer *batch,
+					  bool enable);
 
 
 void intel_batchbuffer_free(struct intel_batchbuffer *batch);
@@ -82,6 +102,22 @@ intel_batchbuffer_emit_dword(struct intel_batchbuffer *batch, uint32_t dword)
 	batch->ptr += 4;
 }
 
+/*
+ * Reserves @count dwords at the current position for the caller to write
+ * directly, like the command packers of media_pack.h do.
+ */
+static inline uint32_t *
+intel_batchbuffer_emit_dwords(struct intel_batchbuffer *batch,
+			      unsigned int count)
+{
+	uint32_t *dw = (uint32_t *)batch->ptr;
+
+	igt_assert(intel_batchbuffer_space(batch) >= 4 * count);
+	batch->ptr += 4 * count;
+
+	return dw;
+}
+
 static inline void
 intel_batchbuffer_require_space(struct intel_batchbuffer *batch,
                                 unsigned int sz)
@@ -270,6 +306,42 @@ void igt_blitter_fast_copy__raw(int fd,
 				unsigned int dst_tiling,
 				unsigned int dst_x, unsigned dst_y);
 
+struct intel_bb;
+
+struct intel_bb *intel_bb_create(int i915, uint32_t size);
+void intel_bb_destroy(struct intel_bb *ibb);
+void intel_bb_set_context(struct intel_bb *ibb, uint32_t ctx_id);
+void intel_bb_register_object(struct intel_bb *ibb, uint32_t handle,
+			      uint64_t size);
+void intel_bb_out(struct intel_bb *ibb, uint32_t dword);
+void intel_bb_emit_reloc(struct intel_bb *ibb, uint32_t handle,
+			 uint32_t read_domains, uint32_t write_domain,
+			 uint64_t delta);
+void intel_bb_exec(struct intel_bb *ibb, uint64_t flags);
+void intel_bb_sync(struct intel_bb *ibb);
+
+void igt_blitter_fast_copy__bb(struct intel_bb *ibb,
+			       uint32_t src_handle, unsigned int src_delta,
+			       unsigned int src_stride, unsigned int src_tiling,
+			       unsigned int src_x, unsigned int src_y,
+			       unsigned int width, unsigned int height, int bpp,
+			       uint32_t dst_handle, unsigned int dst_delta,
+			       unsigned int dst_stride, unsigned int dst_tiling,
+			       unsigned int dst_x, unsigned int dst_y);
+void igt_blitter_fast_copy__chunked(struct intel_bb *ibb,
+				    uint32_t src_handle, unsigned int src_delta,
+				    unsigned int src_stride,
+				    unsigned int src_tiling,
+				    unsigned int src_x, unsigned int src_y,
+				    unsigned int width, unsigned int height,
+				    int bpp,
+				    uint32_t dst_handle, unsigned int dst_delta,
+				    unsigned int dst_stride,
+				    unsigned int dst_tiling,
+				    unsigned int dst_x, unsigned int dst_y);
+void igt_blitter_fill__chunked(struct intel_bb *ibb, uint32_t handle,
+			       uint64_t size, uint32_t value);
+
 /**
  * igt_render_copyfunc_t:
  * @batch: batchbuffer object
@@ -299,6 +371,49 @@ typedef void (*igt_render_copyfunc_t)(struct intel_batchbuffer *batch,
 
 igt_render_copyfunc_t igt_get_render_copyfunc(int devid);
 
+/**
+ * igt_render_copy_rect:
+ * @src: source i-g-t buffer object
+ * @src_x: source pixel x-coordination
+ * @src_y: source pixel y-coordination
+ * @width: width of the copied rectangle
+ * @height: height of the copied rectangle
+ * @dst: destination i-g-t buffer object
+ * @dst_x: destination pixel x-coordination
+ * @dst_y: destination pixel y-coordination
+ *
+ * One of the copies done by an #igt_render_copy_rects_func_t.
+ */
+struct igt_render_copy_rect {
+	const struct igt_buf *src;
+	unsigned src_x, src_y;
+	unsigned width, height;
+	const struct igt_buf *dst;
+	unsigned dst_x, dst_y;
+};
+
+/**
+ * igt_render_copy_rects_func_t:
+ * @batch: batchbuffer object
+ * @context: libdrm hardware context to use
+ * @rects: the copies to do
+ * @count: number of elements in @rects
+ *
+ * This is the type of the per-platform batched render copy functions, which
+ * can be obtained by calling igt_get_render_copy_rects_func().
+ *
+ * It does the same as calling the #igt_render_copyfunc_t for each of @rects
+ * in turn, but emits as many of the copies as fit into each batchbuffer and
+ * sets up the pipeline only once for all of them. Consecutive elements of
+ * @rects with the same @src and @dst also share their surface state.
+ */
+typedef void (*igt_render_copy_rects_func_t)(struct intel_batchbuffer *batch,
+					     drm_intel_context *context,
+					     const struct igt_render_copy_rect *rects,
+					     unsigned int count);
+
+igt_render_copy_rects_func_t igt_get_render_copy_rects_func(int devid);
+
 /**
  * igt_fillfunc_t:
  * @batch: batchbuffer object
@@ -325,6 +440,35 @@ typedef void (*igt_fillfunc_t)(struct intel_batchbuffer *batch,
 igt_fillfunc_t igt_get_media_fillfunc(int devid);
 igt_fillfunc_t igt_get_gpgpu_fillfunc(int devid);
 
+/**
+ * igt_threaded_fillfunc_t:
+ * @batch: batchbuffer object
+ * @dst: destination i-g-t buffer object
+ * @x: destination pixel x-coordination
+ * @y: destination pixel y-coordination
+ * @width: width of the filled rectangle
+ * @height: height of the filled rectangle
+ * @color: fill color to use
+ * @threads: most hardware threads to run the fill on at once, 0 for the
+ *	     default of an #igt_fillfunc_t
+ *
+ * This is the type of the per-platform gpgpu fill functions which spread the
+ * fill over up to @threads hardware threads, so that a large enough fill keeps
+ * all the EUs busy. The platform-specific implementation can be obtained by
+ * calling igt_get_gpgpu_threaded_fillfunc().
+ *
+ * @threads must not be more than the device runs at once, as returned by
+ * igt_gpgpu_max_threads().
+ */
+typedef void (*igt_threaded_fillfunc_t)(struct intel_batchbuffer *batch,
+					const struct igt_buf *dst,
+					unsigned x, unsigned y,
+					unsigned width, unsigned height,
+					uint8_t color, unsigned threads);
+
+igt_threaded_fillfunc_t igt_get_gpgpu_threaded_fillfunc(int devid);
+unsigned int igt_gpgpu_max_threads(int fd);
+
 typedef void (*igt_vme_func_t)(struct intel_batchbuffer *batch,
 			       const struct igt_buf *src,
 			       unsigned int width, unsigned int height,
@@ -41,6 +41,7 @@
 #include "drmtest.h"
 #include "intel_chipset.h"
 #include "igt_core.h"
+#include "i915/gem_caps.h"
 
 /**
  * SECTION:intel_chipset
@@ -127,20 +128,27 @@ intel_get_drm_devid(int fd)
 {
 	struct drm_i915_getparam gp;
 	const char *override;
+	uint64_t cached;
 	int devid = 0;
 
-	igt_assert(is_i915_device(fd));
+	/* Only devices known to be i915 make it into the cache */
+	if (!gem_caps_get_fact(fd, GEM_CAPS_DEVID, &cached)) {
+		igt_assert(is_i915_device(fd));
+
+		memset(&gp, 0, sizeof(gp));
+		gp.param = I915_PARAM_CHIPSET_ID;
+		gp.value = &devid;
+		ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp, sizeof(gp));
+
+		cached = devid;
+		gem_caps_set_fact(fd, GEM_CAPS_DEVID, cached);
+	}
 
 	override = getenv("INTEL_DEVID_OVERRIDE");
 	if (override)
 		return strtol(override, NULL, 0);
 
-	memset(&gp, 0, sizeof(gp));
-	gp.param = I915_PARAM_CHIPSET_ID;
-	gp.value = &devid;
-	ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp, sizeof(gp));
-
-	return devid;
+	return cached;
 }
 
 /**
@@ -28,6 +28,7 @@
 #ifndef INTEL_GPU_TOOLS_H
 #define INTEL_GPU_TOOLS_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <pciaccess.h>
 
@@ -42,6 +43,19 @@ uint32_t intel_register_read(uint32_t reg);
 void intel_register_write(uint32_t reg, uint32_t val);
 int intel_register_access_needs_fakewake(void);
 
+struct intel_register_batch;
+struct intel_register_batch *
+intel_register_batch_create(const uint32_t *offsets, unsigned int count);
+void intel_register_batch_destroy(struct intel_register_batch *batch);
+void intel_register_batch_read(const struct intel_register_batch *batch,
+			       uint32_t *values);
+unsigned int
+intel_register_batch_sample(const struct intel_register_batch *batch,
+			    uint64_t period_ns, unsigned int samples,
+			    bool (*func)(void *data, uint64_t time_ns,
+					 const uint32_t *values),
+			    void *data);
+
 uint32_t INREG(uint32_t reg);
 uint16_t INREG16(uint32_t reg);
 uint8_t INREG8(uint32_t reg);
@@ -36,6 +36,7 @@
 #include <string.h>
 #include <errno.h>
 #include <err.h>
+#include <time.h>
 #include <assert.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -306,6 +307,162 @@ write_out:
 	*(volatile uint32_t *)((volatile char *)igt_global_mmio + reg) = val;
 }
 
+#define BLOCKED_REG 0xffffffff
+
+struct intel_register_batch {
+	unsigned int count;
+	uint32_t offsets[];
+};
+
+/**
+ * intel_register_batch_create:
+ * @offsets: register offsets
+ * @count: number of entries in @offsets
+ *
+ * Prepares reading a set of registers with intel_register_batch_read() or
+ * intel_register_batch_sample(). The offsets are checked against the register
+ * access white list once, here, so that the reads themselves are just back to
+ * back MMIO accesses. The user forcewake taken by intel_register_access_init()
+ * covers all the power wells, so there is nothing to take per read either.
+ *
+ * Registers blocked by the white list always read as 0xffffffff, like with
+ * intel_register_read().
+ *
+ * Returns:
+ * The new register batch, to be freed with intel_register_batch_destroy().
+ */
+struct intel_register_batch *
+intel_register_batch_create(const uint32_t *offsets, unsigned int count)
+{
+	struct intel_register_batch *batch;
+	unsigned int i;
+
+	igt_assert(mmio_data.inited);
+
+	if (intel_gen(mmio_data.i915_devid) >= 6)
+		igt_assert(mmio_data.key != -1);
+
+	batch = malloc(sizeof(*batch) + count * sizeof(*batch->offsets));
+	igt_assert(batch);
+
+	batch->count = count;
+	for (i = 0; i < count; i++) {
+		batch->offsets[i] = offsets[i];
+
+		if (mmio_data.safe &&
+		    !intel_get_register_range(mmio_data.map, offsets[i],
+					      INTEL_RANGE_READ)) {
+			igt_warn("Register read blocked for safety ""(*0x%08x)\n",
+				 offsets[i]);
+			batch->offsets[i] = BLOCKED_REG;
+		}
+	}
+
+	return batch;
+}
+
+/**
+ * intel_register_batch_destroy:
+ * @batch: register batch
+ *
+ * Frees a register batch created with intel_register_batch_create().
+ */
+void intel_register_batch_destroy(struct intel_register_batch *batch)
+{
+	free(batch);
+}
+
+/**
+ * intel_register_batch_read:
+ * @batch: register batch
+ * @values: where to store the values, one per register in @batch
+ *
+ * Reads all the registers in @batch, in the order they were given, into
+ * @values.
+ */
+void intel_register_batch_read(const struct intel_register_batch *batch,
+			       uint32_t *values)
+{
+	volatile char *mmio = igt_global_mmio;
+	unsigned int i;
+
+	for (i = 0; i < batch->count; i++) {
+		uint32_t reg = batch->offsets[i];
+
+		values[i] = reg == BLOCKED_REG ?
+			BLOCKED_REG : *(volatile uint32_t *)(mmio + reg);
+	}
+}
+
+static uint64_t mmio_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * intel_register_batch_sample:
+ * @batch: register batch
+ * @period_ns: sampling period in nanoseconds
+ * @samples: number of samples to take, or 0 to sample until @func says to stop
+ * @func: called with each sample
+ * @data: user data passed to @func
+ *
+ * Periodically reads all the registers in @batch and hands each snapshot to
+ * @func, along with the CLOCK_MONOTONIC time in nanoseconds it was taken at.
+ * Sampling stops early when @func returns false.
+ *
+ * The samples are taken at absolute deadlines so that the period doesn't drift
+ * with the time spent in @func. If @func takes longer than @period_ns, the
+ * missed deadlines are skipped rather than caught up on in a burst.
+ *
+ * Returns:
+ * The number of samples taken.
+ */
+unsigned int
+intel_register_batch_sample(const struct intel_register_batch *batch,
+			    uint64_t period_ns, unsigned int samples,
+			    bool (*func)(void *data, uint64_t time_ns,
+					 const uint32_t *values),
+			    void *data)
+{
+	uint32_t *values;
+	uint64_t next, now;
+	unsigned int n;
+
+	values = malloc((batch->count ?: 1) * sizeof(*values));
+	igt_assert(values);
+
+	next = mmio_clock_ns();
+	for (n = 0; !samples || n < samples; ) {
+		struct timespec ts = {
+			.tv_sec = next / 1000000000,
+			.tv_nsec = next % 1000000000,
+		};
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &ts, NULL) == EINTR)
+			;
+
+		now = mmio_clock_ns();
+		intel_register_batch_read(batch, values);
+		n++;
+
+		if (!func(data, now, values))
+			break;
+
+		next += period_ns;
+		if (next < now)
+			next = now + period_ns - (now - next) % period_ns;
+	}
+
+	free(values);
+
+	return n;
+}
 
 /**
  * INREG:
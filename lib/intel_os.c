@@ -57,7 +57,8 @@
  * intel_get_total_ram_mb:
  *
  * Returns:
- * The total amount of system RAM available in MB.
+ * The total amount of system RAM available in MB, reduced by
+ * igt_simulation_scale() in simulation mode.
  */
 uint64_t
 intel_get_total_ram_mb(void)
@@ -81,7 +82,7 @@ intel_get_total_ram_mb(void)
 #error "Unknown how to get RAM size for this OS"
 #endif
 
-	return retval / (1024*1024);
+	return igt_simulation_scaled(retval / (1024*1024));
 }
 
 static uint64_t get_meminfo(const char *info, const char *tag)
@@ -101,7 +102,8 @@ static uint64_t get_meminfo(const char *info, const char *tag)
  * intel_get_avail_ram_mb:
  *
  * Returns:
- * The amount of unused system RAM available in MB.
+ * The amount of unused system RAM available in MB, reduced by
+ * igt_simulation_scale() in simulation mode.
  */
 uint64_t
 intel_get_avail_ram_mb(void)
@@ -152,7 +154,7 @@ intel_get_avail_ram_mb(void)
 #error "Unknown how to get available RAM for this OS"
 #endif
 
-	return retval / (1024*1024);
+	return igt_simulation_scaled(retval / (1024*1024));
 }
 
 /**
@@ -67,6 +67,8 @@
 
 #include "ioctl_wrappers.h"
 
+#include "i915/gem_caps.h"
+
 /**
  * SECTION:ioctl_wrappers
  * @short_description: ioctl wrappers and related functions
@@ -471,21 +473,8 @@ void gem_sync(int fd, uint32_t handle)
 
 bool gem_create__has_stolen_support(int fd)
 {
-	static int has_stolen_support = -1;
-	struct drm_i915_getparam gp;
-	int val = -1;
-
-	if (has_stolen_support < 0) {
-		memset(&gp, 0, sizeof(gp));
-		gp.param = 38; /* CREATE_VERSION */
-		gp.value = &val;
-
-		/* Do we have the extended gem_create_ioctl? */
-		ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp);
-		has_stolen_support = val >= 2;
-	}
-
-	return has_stolen_support;
+	/* Do we have the extended gem_create_ioctl? */
+	return gem_caps_getparam(fd, 38 /* CREATE_VERSION */) >= 2;
 }
 
 struct local_i915_gem_create_v2 {
@@ -759,18 +748,7 @@ bool gem_bo_busy(int fd, uint32_t handle)
  */
 static int gem_gtt_type(int fd)
 {
-	struct drm_i915_getparam gp;
-	int val = 0;
-
-	memset(&gp, 0, sizeof(gp));
-	gp.param = I915_PARAM_HAS_ALIASING_PPGTT;
-	gp.value = &val;
-
-	if (ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp, sizeof(gp)))
-		return 0;
-
-	errno = 0;
-	return val;
+	return gem_caps_getparam(fd, I915_PARAM_HAS_ALIASING_PPGTT);
 }
 
 /**
@@ -864,56 +842,17 @@ bool gem_engine_reset_enabled(int fd)
  */
 int gem_available_fences(int fd)
 {
-	static int num_fences = -1;
-
-	if (num_fences < 0) {
-		struct drm_i915_getparam gp;
-
-		memset(&gp, 0, sizeof(gp));
-		gp.param = I915_PARAM_NUM_FENCES_AVAIL;
-		gp.value = &num_fences;
-
-		num_fences = 0;
-		ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp, sizeof(gp));
-		errno = 0;
-	}
-
-	return num_fences;
+	return gem_caps_getparam(fd, I915_PARAM_NUM_FENCES_AVAIL);
 }
 
 bool gem_has_llc(int fd)
 {
-	static int has_llc = -1;
-
-	if (has_llc < 0) {
-		struct drm_i915_getparam gp;
-
-		memset(&gp, 0, sizeof(gp));
-		gp.param = I915_PARAM_HAS_LLC;
-		gp.value = &has_llc;
-
-		has_llc = 0;
-		ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp, sizeof(gp));
-		errno = 0;
-	}
-
-	return has_llc;
+	return gem_caps_getparam(fd, I915_PARAM_HAS_LLC);
 }
 
 static bool has_param(int fd, int param)
 {
-	drm_i915_getparam_t gp;
-	int tmp = 0;
-
-	memset(&gp, 0, sizeof(gp));
-	gp.value = &tmp;
-	gp.param = param;
-
-	if (igt_ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp))
-		return false;
-
-	errno = 0;
-	return tmp > 0;
+	return gem_caps_getparam(fd, param) > 0;
 }
 
 /**
@@ -928,10 +867,7 @@ static bool has_param(int fd, int param)
  */
 bool gem_has_bsd(int fd)
 {
-	static int has_bsd = -1;
-	if (has_bsd < 0)
-		has_bsd = has_param(fd, I915_PARAM_HAS_BSD);
-	return has_bsd;
+	return has_param(fd, I915_PARAM_HAS_BSD);
 }
 
 /**
@@ -946,10 +882,7 @@ bool gem_has_bsd(int fd)
  */
 bool gem_has_blt(int fd)
 {
-	static int has_blt = -1;
-	if (has_blt < 0)
-		has_blt =  has_param(fd, I915_PARAM_HAS_BLT);
-	return has_blt;
+	return has_param(fd, I915_PARAM_HAS_BLT);
 }
 
 /**
@@ -965,10 +898,7 @@ bool gem_has_blt(int fd)
  */
 bool gem_has_vebox(int fd)
 {
-	static int has_vebox = -1;
-	if (has_vebox < 0)
-		has_vebox =  has_param(fd, I915_PARAM_HAS_VEBOX);
-	return has_vebox;
+	return has_param(fd, I915_PARAM_HAS_VEBOX);
 }
 
 #define I915_PARAM_HAS_BSD2 31
@@ -984,10 +914,7 @@ bool gem_has_vebox(int fd)
  */
 bool gem_has_bsd2(int fd)
 {
-	static int has_bsd2 = -1;
-	if (has_bsd2 < 0)
-		has_bsd2 = has_param(fd, I915_PARAM_HAS_BSD2);
-	return has_bsd2;
+	return has_param(fd, I915_PARAM_HAS_BSD2);
 }
 
 struct local_i915_gem_get_aperture {
@@ -1065,26 +992,28 @@ uint64_t gem_available_aperture_size(int fd)
  */
 uint64_t gem_aperture_size(int fd)
 {
-	static uint64_t aperture_size = 0;
+	struct drm_i915_gem_context_param p;
+	uint64_t aperture_size;
 
-	if (aperture_size == 0) {
-		struct drm_i915_gem_context_param p;
+	if (gem_caps_get_fact(fd, GEM_CAPS_APERTURE_SIZE, &aperture_size))
+		return aperture_size;
 
-		memset(&p, 0, sizeof(p));
-		p.param = 0x3;
-		if (__gem_context_get_param(fd, &p) == 0) {
-			aperture_size = p.value;
-		} else {
-			struct drm_i915_gem_get_aperture aperture;
+	memset(&p, 0, sizeof(p));
+	p.param = 0x3;
+	if (__gem_context_get_param(fd, &p) == 0) {
+		aperture_size = p.value;
+	} else {
+		struct drm_i915_gem_get_aperture aperture;
 
-			memset(&aperture, 0, sizeof(aperture));
-			aperture.aper_size = 256*1024*1024;
+		memset(&aperture, 0, sizeof(aperture));
+		aperture.aper_size = 256*1024*1024;
 
-			do_ioctl(fd, DRM_IOCTL_I915_GEM_GET_APERTURE, &aperture);
-			aperture_size =  aperture.aper_size;
-		}
+		do_ioctl(fd, DRM_IOCTL_I915_GEM_GET_APERTURE, &aperture);
+		aperture_size =  aperture.aper_size;
 	}
 
+	gem_caps_set_fact(fd, GEM_CAPS_APERTURE_SIZE, aperture_size);
+
 	return aperture_size;
 }
 
@@ -1144,21 +1073,7 @@ uint64_t gem_global_aperture_size(int fd)
  */
 bool gem_has_softpin(int fd)
 {
-	static int has_softpin = -1;
-
-	if (has_softpin < 0) {
-		struct drm_i915_getparam gp;
-
-		memset(&gp, 0, sizeof(gp));
-		gp.param = I915_PARAM_HAS_EXEC_SOFTPIN;
-		gp.value = &has_softpin;
-
-		has_softpin = 0;
-		ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp, sizeof(gp));
-		errno = 0;
-	}
-
-	return has_softpin;
+	return gem_caps_getparam(fd, I915_PARAM_HAS_EXEC_SOFTPIN);
 }
 
 /**
@@ -1172,21 +1087,7 @@ bool gem_has_softpin(int fd)
  */
 bool gem_has_exec_fence(int fd)
 {
-	static int has_exec_fence = -1;
-
-	if (has_exec_fence < 0) {
-		struct drm_i915_getparam gp;
-
-		memset(&gp, 0, sizeof(gp));
-		gp.param = I915_PARAM_HAS_EXEC_FENCE;
-		gp.value = &has_exec_fence;
-
-		has_exec_fence = 0;
-		ioctl(fd, DRM_IOCTL_I915_GETPARAM, &gp, sizeof(gp));
-		errno = 0;
-	}
-
-	return has_exec_fence;
+	return gem_caps_getparam(fd, I915_PARAM_HAS_EXEC_FENCE);
 }
 
 /**
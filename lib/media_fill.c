@@ -31,76 +31,9 @@
 #include "intel_reg.h"
 #include "drmtest.h"
 #include "gpu_cmds.h"
+#include "gpu_shaders.h"
 #include <assert.h>
 
-static const uint32_t gen7_media_kernel[][4] = {
-	{ 0x00400001, 0x20200231, 0x00000020, 0x00000000 },
-	{ 0x00600001, 0x20800021, 0x008d0000, 0x00000000 },
-	{ 0x00200001, 0x20800021, 0x00450040, 0x00000000 },
-	{ 0x00000001, 0x20880061, 0x00000000, 0x000f000f },
-	{ 0x00800001, 0x20a00021, 0x00000020, 0x00000000 },
-	{ 0x00800001, 0x20e00021, 0x00000020, 0x00000000 },
-	{ 0x00800001, 0x21200021, 0x00000020, 0x00000000 },
-	{ 0x00800001, 0x21600021, 0x00000020, 0x00000000 },
-	{ 0x05800031, 0x24001ca8, 0x00000080, 0x120a8000 },
-	{ 0x00600001, 0x2e000021, 0x008d0000, 0x00000000 },
-	{ 0x07800031, 0x20001ca8, 0x00000e00, 0x82000010 },
-};
-
-static const uint32_t gen8_media_kernel[][4] = {
-	{ 0x00400001, 0x20202288, 0x00000020, 0x00000000 },
-	{ 0x00600001, 0x20800208, 0x008d0000, 0x00000000 },
-	{ 0x00200001, 0x20800208, 0x00450040, 0x00000000 },
-	{ 0x00000001, 0x20880608, 0x00000000, 0x000f000f },
-	{ 0x00800001, 0x20a00208, 0x00000020, 0x00000000 },
-	{ 0x00800001, 0x20e00208, 0x00000020, 0x00000000 },
-	{ 0x00800001, 0x21200208, 0x00000020, 0x00000000 },
-	{ 0x00800001, 0x21600208, 0x00000020, 0x00000000 },
-	{ 0x0c800031, 0x24000a40, 0x0e000080, 0x120a8000 },
-	{ 0x00600001, 0x2e000208, 0x008d0000, 0x00000000 },
-	{ 0x07800031, 0x20000a40, 0x0e000e00, 0x82000010 },
-};
-
-static const uint32_t gen11_media_vme_kernel[][4] = {
-	{ 0x00600001, 0x20302e68,  0x00000000,  0x20000000 },
-	{ 0x00600001, 0x22802e68,  0x00000000,  0x00000001 },
-	{ 0x00000001, 0x20284f2c,  0x00000000,  0x3818000c },
-	{ 0x00600001, 0x22902e68,  0x00000000,  0x00000010 },
-	{ 0x00600001, 0x22a02e68,  0x00000000,  0x00010000 },
-	{ 0x00000001, 0x202c4f2c,  0x00000000,  0x22222222 },
-	{ 0x00000040, 0x22000a20,  0x0e000020,  0x10782000 },
-	{ 0x00600001, 0x20404f28,  0x00000000,  0x00000000 },
-	{ 0x00600001, 0x20a04f28,  0x00000000,  0x00000000 },
-	{ 0x00600001, 0x20c04f28,  0x00000000,  0x00000000 },
-	{ 0x00600001, 0x21204f28,  0x00000000,  0x00000000 },
-	{ 0x00600001, 0x20601a28,  0x008d0030,  0x00000000 },
-	{ 0x00600041, 0x20800a28,  0x1a000028,  0x008d0280 },
-	{ 0x00600041, 0x20e01a28,  0x1e8d0290,  0x01000100 },
-	{ 0x00600041, 0x21000a28,  0x1a00002c,  0x008d02a0 },
-	{ 0x00000001, 0x22284f2c,  0x00000000,  0x00000000 },
-	{ 0x0d80c031, 0x21404a48,  0x00000040,  0x00000200 },
-	{ 0x00000001, 0x215c4708,  0x00000000,  0xbeefbeef },
-	{ 0x00000040, 0x22000204,  0x06000024,  0x020a0400 },
-	{ 0x00000001, 0x215e4708,  0x00000000,  0xdeaddead },
-	{ 0x00000001, 0x22484f2c,  0x00000000,  0x00000008 },
-	{ 0x00000001, 0x22684f2c,  0x00000000,  0x0000000c },
-	{ 0x00600001, 0x2fe04b2c,  0x008d0000,  0x00000000 },
-	{ 0x0a800033, 0x0000a054,  0x00002224,  0x00000000 },
-	{ 0x00000040, 0x22000204,  0x06000024,  0x020a0300 },
-	{ 0x0a800033, 0x0000e054,  0x00002242,  0x00000000 },
-	{ 0x00000040, 0x22000204,  0x06000024,  0x020a0200 },
-	{ 0x0a600033, 0x00010014,  0x00002261,  0x00000000 },
-	{ 0x07600031, 0x20004a04,  0x06000fe0,  0x82000010 },
-	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
-	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
-	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
-	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
-	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
-	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
-	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
-	{ 0x00000000, 0x00000000,  0x00000000,  0x00000000 },
-};
-
 /*
  * This sets up the media pipeline,
  *
@@ -136,6 +69,7 @@ gen7_media_fillfunc(struct intel_batchbuffer *batch,
 		    unsigned int width, unsigned int height,
 		    uint8_t color)
 {
+	const struct gpu_shader *kernel;
 	uint32_t curbe_buffer, interface_descriptor;
 	uint32_t batch_end;
 
@@ -145,9 +79,9 @@ gen7_media_fillfunc(struct intel_batchbuffer *batch,
 	batch->ptr = &batch->buffer[BATCH_STATE_SPLIT];
 
 	curbe_buffer = gen7_fill_curbe_buffer_data(batch, color);
+	kernel = gpu_shader_lookup(batch->devid, GPU_SHADER_MEDIA_FILL);
 	interface_descriptor = gen7_fill_interface_descriptor(batch, dst,
-					gen7_media_kernel,
-					sizeof(gen7_media_kernel));
+					kernel->code, kernel->size);
 	igt_assert(batch->ptr < &batch->buffer[4095]);
 
 	/* media pipeline */
@@ -180,6 +114,7 @@ gen8_media_fillfunc(struct intel_batchbuffer *batch,
 		    unsigned int width, unsigned int height,
 		    uint8_t color)
 {
+	const struct gpu_shader *kernel;
 	uint32_t curbe_buffer, interface_descriptor;
 	uint32_t batch_end;
 
@@ -189,9 +124,9 @@ gen8_media_fillfunc(struct intel_batchbuffer *batch,
 	batch->ptr = &batch->buffer[BATCH_STATE_SPLIT];
 
 	curbe_buffer = gen7_fill_curbe_buffer_data(batch, color);
+	kernel = gpu_shader_lookup(batch->devid, GPU_SHADER_MEDIA_FILL);
 	interface_descriptor = gen8_fill_interface_descriptor(batch, dst,
-					gen8_media_kernel,
-					sizeof(gen8_media_kernel));
+					kernel->code, kernel->size);
 	igt_assert(batch->ptr < &batch->buffer[4095]);
 
 	/* media pipeline */
@@ -280,10 +215,11 @@ gen9_media_fillfunc(struct intel_batchbuffer *batch,
 		    unsigned int width, unsigned int height,
 		    uint8_t color)
 {
+	const struct gpu_shader *kernel =
+		gpu_shader_lookup(batch->devid, GPU_SHADER_MEDIA_FILL);
 
 	__gen9_media_fillfunc(batch, dst, x, y, width, height, color,
-			      gen8_media_kernel, sizeof(gen8_media_kernel));
-
+			      kernel->code, kernel->size);
 }
 
 static void
@@ -348,10 +284,12 @@ gen11_media_vme_func(struct intel_batchbuffer *batch,
 		     unsigned int width, unsigned int height,
 		     const struct igt_buf *dst)
 {
+	const struct gpu_shader *kernel =
+		gpu_shader_lookup(batch->devid, GPU_SHADER_MEDIA_VME);
+
 	__gen11_media_vme_func(batch,
 			       src,
 			       width, height,
 			       dst,
-			       gen11_media_vme_kernel,
-			       sizeof(gen11_media_vme_kernel));
+			       kernel->code, kernel->size);
 }
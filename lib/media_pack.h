@@ -0,0 +1,279 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#ifndef MEDIA_PACK_H
+#define MEDIA_PACK_H
+
+#include <stdint.h>
+
+#include "gen7_media.h"
+#include "gen8_media.h"
+#include "intel_batchbuffer.h"
+
+/*
+ * Packers for the media and GPGPU pipeline commands, laid out after the
+ * genxml descriptions of Mesa: a struct of the fields of each command,
+ * its length in dwords and an inline function packing the fields into
+ * the dwords of the command. Fields not in the structs are always zero.
+ * The field positions are constants, so with the values known at
+ * compile time the packing folds into stores of constant dwords, and
+ * there are no per-dword space checks as with OUT_BATCH().
+ *
+ * gen_emit() packs a single command into the batch, loops emitting many
+ * commands reserve the space once with intel_batchbuffer_emit_dwords()
+ * and chain the packers, each returning the dword after its command.
+ */
+
+static inline uint32_t
+__gen_mask(unsigned int start, unsigned int end)
+{
+	return (~0u >> (31 - end)) & (~0u << start);
+}
+
+static inline uint32_t
+__gen_uint(uint32_t v, unsigned int start, unsigned int end)
+{
+	return (v << start) & __gen_mask(start, end);
+}
+
+#define gen_emit(batch, cmd, ...) do {					\
+	uint32_t *__dw = intel_batchbuffer_emit_dwords((batch),		\
+						       cmd##_length);	\
+	cmd##_pack(__dw, &(const struct cmd){ __VA_ARGS__ });		\
+} while (0)
+
+enum { gen7_media_vfe_state_length = 8 };
+
+struct gen7_media_vfe_state {
+	uint32_t max_threads;
+	uint32_t urb_entries;
+	uint32_t gpgpu_mode;
+	uint32_t urb_entry_size;	/* in 256 bit units */
+	uint32_t curbe_size;		/* in 256 bit units */
+};
+
+static inline uint32_t *
+gen7_media_vfe_state_pack(uint32_t *dw, const struct gen7_media_vfe_state *v)
+{
+	dw[0] = GEN7_MEDIA_VFE_STATE | (gen7_media_vfe_state_length - 2);
+	dw[1] = 0;
+	dw[2] = __gen_uint(v->max_threads, 16, 31) |
+		__gen_uint(v->urb_entries, 8, 15) |
+		__gen_uint(v->gpgpu_mode, 2, 2);
+	dw[3] = 0;
+	dw[4] = __gen_uint(v->urb_entry_size, 16, 31) |
+		__gen_uint(v->curbe_size, 0, 15);
+	dw[5] = 0;
+	dw[6] = 0;
+	dw[7] = 0;
+
+	return dw + gen7_media_vfe_state_length;
+}
+
+enum { gen8_media_vfe_state_length = 9 };
+
+struct gen8_media_vfe_state {
+	uint32_t max_threads;
+	uint32_t urb_entries;
+	uint32_t urb_entry_size;	/* in 256 bit units */
+	uint32_t curbe_size;		/* in 256 bit units */
+};
+
+static inline uint32_t *
+gen8_media_vfe_state_pack(uint32_t *dw, const struct gen8_media_vfe_state *v)
+{
+	dw[0] = GEN8_MEDIA_VFE_STATE | (gen8_media_vfe_state_length - 2);
+	dw[1] = 0;
+	dw[2] = 0;
+	dw[3] = __gen_uint(v->max_threads, 16, 31) |
+		__gen_uint(v->urb_entries, 8, 15);
+	dw[4] = 0;
+	dw[5] = __gen_uint(v->urb_entry_size, 16, 31) |
+		__gen_uint(v->curbe_size, 0, 15);
+	dw[6] = 0;
+	dw[7] = 0;
+	dw[8] = 0;
+
+	return dw + gen8_media_vfe_state_length;
+}
+
+enum { gen7_media_curbe_load_length = 4 };
+
+struct gen7_media_curbe_load {
+	uint32_t total_length;
+	uint32_t start_address;		/* from the dynamic state base */
+};
+
+static inline uint32_t *
+gen7_media_curbe_load_pack(uint32_t *dw, const struct gen7_media_curbe_load *v)
+{
+	dw[0] = GEN7_MEDIA_CURBE_LOAD | (gen7_media_curbe_load_length - 2);
+	dw[1] = 0;
+	dw[2] = __gen_uint(v->total_length, 0, 16);
+	dw[3] = v->start_address;
+
+	return dw + gen7_media_curbe_load_length;
+}
+
+enum { gen7_media_interface_descriptor_load_length = 4 };
+
+struct gen7_media_interface_descriptor_load {
+	uint32_t total_length;
+	uint32_t start_address;		/* from the dynamic state base */
+};
+
+static inline uint32_t *
+gen7_media_interface_descriptor_load_pack(uint32_t *dw,
+					  const struct gen7_media_interface_descriptor_load *v)
+{
+	dw[0] = GEN7_MEDIA_INTERFACE_DESCRIPTOR_LOAD |
+		(gen7_media_interface_descriptor_load_length - 2);
+	dw[1] = 0;
+	dw[2] = __gen_uint(v->total_length, 0, 16);
+	dw[3] = v->start_address;
+
+	return dw + gen7_media_interface_descriptor_load_length;
+}
+
+/* With the two dwords of inline data holding the block offsets */
+enum { gen7_media_object_length = 8 };
+
+struct gen7_media_object {
+	uint32_t interface_descriptor_offset;
+	uint32_t inline_data[2];
+};
+
+static inline uint32_t *
+gen7_media_object_pack(uint32_t *dw, const struct gen7_media_object *v)
+{
+	dw[0] = GEN7_MEDIA_OBJECT | (gen7_media_object_length - 2);
+	dw[1] = __gen_uint(v->interface_descriptor_offset, 0, 5);
+	dw[2] = 0;
+	dw[3] = 0;
+	dw[4] = 0;
+	dw[5] = 0;
+	dw[6] = v->inline_data[0];
+	dw[7] = v->inline_data[1];
+
+	return dw + gen7_media_object_length;
+}
+
+enum { gen8_media_state_flush_length = 2 };
+
+struct gen8_media_state_flush {
+	uint32_t interface_descriptor_offset;
+};
+
+static inline uint32_t *
+gen8_media_state_flush_pack(uint32_t *dw,
+			    const struct gen8_media_state_flush *v)
+{
+	dw[0] = GEN8_MEDIA_STATE_FLUSH | (gen8_media_state_flush_length - 2);
+	dw[1] = __gen_uint(v->interface_descriptor_offset, 0, 5);
+
+	return dw + gen8_media_state_flush_length;
+}
+
+#define GEN7_GPGPU_SIMD16 1
+
+enum { gen7_gpgpu_walker_length = 11 };
+
+struct gen7_gpgpu_walker {
+	uint32_t interface_descriptor_offset;
+	uint32_t simd_size;
+	uint32_t thread_depth_max;	/* minus one */
+	uint32_t thread_height_max;	/* minus one */
+	uint32_t thread_width_max;	/* minus one */
+	uint32_t group_x_start, group_x_dim;
+	uint32_t group_y_start, group_y_dim;
+	uint32_t group_z_start, group_z_dim;
+	uint32_t right_mask;
+	uint32_t bottom_mask;
+};
+
+static inline uint32_t *
+gen7_gpgpu_walker_pack(uint32_t *dw, const struct gen7_gpgpu_walker *v)
+{
+	dw[0] = GEN7_GPGPU_WALKER | (gen7_gpgpu_walker_length - 2);
+	dw[1] = __gen_uint(v->interface_descriptor_offset, 0, 4);
+	dw[2] = __gen_uint(v->simd_size, 30, 31) |
+		__gen_uint(v->thread_depth_max, 16, 21) |
+		__gen_uint(v->thread_height_max, 8, 13) |
+		__gen_uint(v->thread_width_max, 0, 5);
+	dw[3] = v->group_x_start;
+	dw[4] = v->group_x_dim;
+	dw[5] = v->group_y_start;
+	dw[6] = v->group_y_dim;
+	dw[7] = v->group_z_start;
+	dw[8] = v->group_z_dim;
+	dw[9] = v->right_mask;
+	dw[10] = v->bottom_mask;
+
+	return dw + gen7_gpgpu_walker_length;
+}
+
+enum { gen8_gpgpu_walker_length = 15 };
+
+struct gen8_gpgpu_walker {
+	uint32_t interface_descriptor_offset;
+	uint32_t indirect_data_length;
+	uint32_t indirect_data_start_address;
+	uint32_t simd_size;
+	uint32_t thread_depth_max;	/* minus one */
+	uint32_t thread_height_max;	/* minus one */
+	uint32_t thread_width_max;	/* minus one */
+	uint32_t group_x_start, group_x_dim;
+	uint32_t group_y_start, group_y_dim;
+	uint32_t group_z_start, group_z_dim;
+	uint32_t right_mask;
+	uint32_t bottom_mask;
+};
+
+static inline uint32_t *
+gen8_gpgpu_walker_pack(uint32_t *dw, const struct gen8_gpgpu_walker *v)
+{
+	dw[0] = GEN7_GPGPU_WALKER | (gen8_gpgpu_walker_length - 2);
+	dw[1] = __gen_uint(v->interface_descriptor_offset, 0, 5);
+	dw[2] = __gen_uint(v->indirect_data_length, 0, 16);
+	dw[3] = v->indirect_data_start_address & __gen_mask(6, 31);
+	dw[4] = __gen_uint(v->simd_size, 30, 31) |
+		__gen_uint(v->thread_depth_max, 16, 21) |
+		__gen_uint(v->thread_height_max, 8, 13) |
+		__gen_uint(v->thread_width_max, 0, 5);
+	dw[5] = v->group_x_start;
+	dw[6] = 0;
+	dw[7] = v->group_x_dim;
+	dw[8] = v->group_y_start;
+	dw[9] = 0;
+	dw[10] = v->group_y_dim;
+	dw[11] = v->group_z_start;
+	dw[12] = v->group_z_dim;
+	dw[13] = v->right_mask;
+	dw[14] = v->bottom_mask;
+
+	return dw + gen8_gpgpu_walker_length;
+}
+
+#endif /* MEDIA_PACK_H */
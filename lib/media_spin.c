@@ -24,6 +24,7 @@
  * 	Jeff McGee <jeff.mcgee@intel.com>
  */
 
+#include <stdlib.h>
 #include <intel_bufmgr.h>
 #include <i915_drm.h>
 #include "intel_reg.h"
@@ -32,19 +33,7 @@
 #include "gen8_media.h"
 #include "media_spin.h"
 #include "gpu_cmds.h"
-
-static const uint32_t spin_kernel[][4] = {
-	{ 0x00600001, 0x20800208, 0x008d0000, 0x00000000 }, /* mov (8)r4.0<1>:ud r0.0<8;8;1>:ud */
-	{ 0x00200001, 0x20800208, 0x00450040, 0x00000000 }, /* mov (2)r4.0<1>.ud r2.0<2;2;1>:ud */
-	{ 0x00000001, 0x20880608, 0x00000000, 0x00000003 }, /* mov (1)r4.8<1>:ud 0x3 */
-	{ 0x00000001, 0x20a00608, 0x00000000, 0x00000000 }, /* mov (1)r5.0<1>:ud 0 */
-	{ 0x00000040, 0x20a00208, 0x060000a0, 0x00000001 }, /* add (1)r5.0<1>:ud r5.0<0;1;0>:ud 1 */
-	{ 0x01000010, 0x20000200, 0x02000020, 0x000000a0 }, /* cmp.e.f0.0 (1)null<1> r1<0;1;0> r5<0;1;0> */
-	{ 0x00110027, 0x00000000, 0x00000000, 0xffffffe0 }, /* ~f0.0 while (1) -32 */
-	{ 0x0c800031, 0x20000a00, 0x0e000080, 0x040a8000 }, /* send.dcdp1 (16)null<1> r4.0<0;1;0> 0x040a8000 */
-	{ 0x00600001, 0x2e000208, 0x008d0000, 0x00000000 }, /* mov (8)r112<1>:ud r0.0<8;8;1>:ud */
-	{ 0x07800031, 0x20000a40, 0x0e000e00, 0x82000010 }, /* send.ts (16)null<1> r112<0;1;0>:d 0x82000010 */
-};
+#include "gpu_shaders.h"
 
 /*
  * This sets up the media pipeline,
@@ -79,10 +68,74 @@ static const uint32_t spin_kernel[][4] = {
 #define xoffset 0
 #define yoffset 0
 
-void
-gen8_media_spinfunc(struct intel_batchbuffer *batch,
-		    const struct igt_buf *dst, uint32_t spins)
+/*
+ * The MEDIA_OBJECTs for more than one thread go into a second level batch of
+ * their own, as there can be many more of them than fit into the batch. Each
+ * thread writes its count into the next dword of @dst.
+ */
+static void
+emit_spin_objects(struct intel_batchbuffer *batch,
+		  const struct igt_buf *dst, unsigned int threads)
 {
+	unsigned int stride = igt_buf_width(dst);
+	uint32_t *objects, *cs;
+	drm_intel_bo *bo;
+	size_t size;
+	int ret;
+
+	igt_assert(threads * 4 <= stride * igt_buf_height(dst));
+
+	size = (threads * 10 + 2) * sizeof(uint32_t);
+	cs = objects = calloc(1, size);
+	igt_assert(objects);
+
+	for (unsigned int i = 0; i < threads; i++) {
+		*cs++ = GEN7_MEDIA_OBJECT | (8 - 2);
+		*cs++ = 0; /* interface descriptor offset */
+		*cs++ = 0; /* without indirect data */
+		*cs++ = 0;
+		*cs++ = 0; /* scoreboard */
+		*cs++ = 0;
+		*cs++ = i * 4 % stride; /* inline data (xoffset, yoffset) */
+		*cs++ = i * 4 / stride;
+		if (!IS_CHERRYVIEW(batch->devid)) {
+			*cs++ = GEN8_MEDIA_STATE_FLUSH | (2 - 2);
+			*cs++ = 0;
+		}
+	}
+	*cs++ = MI_BATCH_BUFFER_END;
+
+	bo = drm_intel_bo_alloc(batch->bufmgr, "spin objects",
+				ALIGN(size, 4096), 4096);
+	igt_assert(bo);
+	ret = drm_intel_bo_subdata(bo, 0, (cs - objects) * sizeof(*cs),
+				   objects);
+	igt_assert(ret == 0);
+	free(objects);
+
+	OUT_BATCH(MI_BATCH_BUFFER_START | 1 << 22 | 1 << 8 | (3 - 2));
+	OUT_RELOC(bo, I915_GEM_DOMAIN_COMMAND, 0, 0);
+
+	/* The relocation keeps it alive until the batch has executed */
+	drm_intel_bo_unreference(bo);
+}
+
+static void
+emit_spin(struct intel_batchbuffer *batch,
+	  const struct igt_buf *dst, unsigned int threads)
+{
+	if (threads > 1)
+		emit_spin_objects(batch, dst, threads);
+	else
+		gen_emit_media_object(batch, xoffset, yoffset);
+}
+
+static void
+__gen8_media_spinfunc(struct intel_batchbuffer *batch,
+		      const struct igt_buf *dst, uint32_t spins,
+		      unsigned int threads)
+{
+	const struct gpu_shader *kernel;
 	uint32_t curbe_buffer, interface_descriptor;
 	uint32_t batch_end;
 
@@ -92,8 +145,9 @@ gen8_media_spinfunc(struct intel_batchbuffer *batch,
 	batch->ptr = &batch->buffer[BATCH_STATE_SPLIT];
 
 	curbe_buffer = gen8_spin_curbe_buffer_data(batch, spins);
+	kernel = gpu_shader_lookup(batch->devid, GPU_SHADER_MEDIA_SPIN);
 	interface_descriptor = gen8_fill_interface_descriptor(batch, dst,
-					      spin_kernel, sizeof(spin_kernel));
+					      kernel->code, kernel->size);
 	igt_assert(batch->ptr < &batch->buffer[4095]);
 
 	/* media pipeline */
@@ -101,14 +155,15 @@ gen8_media_spinfunc(struct intel_batchbuffer *batch,
 	OUT_BATCH(GEN8_PIPELINE_SELECT | PIPELINE_SELECT_MEDIA);
 	gen8_emit_state_base_address(batch);
 
-	gen8_emit_vfe_state(batch, THREADS, MEDIA_URB_ENTRIES,
-			    MEDIA_URB_SIZE, MEDIA_CURBE_SIZE);
+	gen8_emit_vfe_state(batch, threads > 1 ? threads - 1 : THREADS,
+			    MEDIA_URB_ENTRIES, MEDIA_URB_SIZE,
+			    MEDIA_CURBE_SIZE);
 
 	gen7_emit_curbe_load(batch, curbe_buffer);
 
 	gen7_emit_interface_descriptor_load(batch, interface_descriptor);
 
-	gen_emit_media_object(batch, xoffset, yoffset);
+	emit_spin(batch, dst, threads);
 
 	OUT_BATCH(MI_BATCH_BUFFER_END);
 
@@ -120,9 +175,26 @@ gen8_media_spinfunc(struct intel_batchbuffer *batch,
 }
 
 void
-gen9_media_spinfunc(struct intel_batchbuffer *batch,
+gen8_media_spinfunc(struct intel_batchbuffer *batch,
 		    const struct igt_buf *dst, uint32_t spins)
 {
+	__gen8_media_spinfunc(batch, dst, spins, 1);
+}
+
+void
+gen8_media_spin_threadsfunc(struct intel_batchbuffer *batch,
+			    const struct igt_buf *dst, uint32_t spins,
+			    unsigned int threads)
+{
+	__gen8_media_spinfunc(batch, dst, spins, threads);
+}
+
+static void
+__gen9_media_spinfunc(struct intel_batchbuffer *batch,
+		      const struct igt_buf *dst, uint32_t spins,
+		      unsigned int threads)
+{
+	const struct gpu_shader *kernel;
 	uint32_t curbe_buffer, interface_descriptor;
 	uint32_t batch_end;
 
@@ -132,8 +204,9 @@ gen9_media_spinfunc(struct intel_batchbuffer *batch,
 	batch->ptr = &batch->buffer[BATCH_STATE_SPLIT];
 
 	curbe_buffer = gen8_spin_curbe_buffer_data(batch, spins);
+	kernel = gpu_shader_lookup(batch->devid, GPU_SHADER_MEDIA_SPIN);
 	interface_descriptor = gen8_fill_interface_descriptor(batch, dst,
-					      spin_kernel, sizeof(spin_kernel));
+					      kernel->code, kernel->size);
 	igt_assert(batch->ptr < &batch->buffer[4095]);
 
 	/* media pipeline */
@@ -146,14 +219,15 @@ gen9_media_spinfunc(struct intel_batchbuffer *batch,
 		  GEN9_FORCE_MEDIA_AWAKE_MASK);
 	gen9_emit_state_base_address(batch);
 
-	gen8_emit_vfe_state(batch, THREADS, MEDIA_URB_ENTRIES,
-			    MEDIA_URB_SIZE, MEDIA_CURBE_SIZE);
+	gen8_emit_vfe_state(batch, threads > 1 ? threads - 1 : THREADS,
+			    MEDIA_URB_ENTRIES, MEDIA_URB_SIZE,
+			    MEDIA_CURBE_SIZE);
 
 	gen7_emit_curbe_load(batch, curbe_buffer);
 
 	gen7_emit_interface_descriptor_load(batch, interface_descriptor);
 
-	gen_emit_media_object(batch, xoffset, yoffset);
+	emit_spin(batch, dst, threads);
 
 	OUT_BATCH(GEN8_PIPELINE_SELECT | PIPELINE_SELECT_MEDIA |
 		  GEN9_FORCE_MEDIA_AWAKE_DISABLE |
@@ -170,3 +244,18 @@ gen9_media_spinfunc(struct intel_batchbuffer *batch,
 	gen7_render_flush(batch, batch_end);
 	intel_batchbuffer_reset(batch);
 }
+
+void
+gen9_media_spinfunc(struct intel_batchbuffer *batch,
+		    const struct igt_buf *dst, uint32_t spins)
+{
+	__gen9_media_spinfunc(batch, dst, spins, 1);
+}
+
+void
+gen9_media_spin_threadsfunc(struct intel_batchbuffer *batch,
+			    const struct igt_buf *dst, uint32_t spins,
+			    unsigned int threads)
+{
+	__gen9_media_spinfunc(batch, dst, spins, threads);
+}
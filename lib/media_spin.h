@@ -33,4 +33,12 @@ void gen8_media_spinfunc(struct intel_batchbuffer *batch,
 void gen9_media_spinfunc(struct intel_batchbuffer *batch,
 			 const struct igt_buf *dst, uint32_t spins);
 
+void gen8_media_spin_threadsfunc(struct intel_batchbuffer *batch,
+				 const struct igt_buf *dst, uint32_t spins,
+				 unsigned int threads);
+
+void gen9_media_spin_threadsfunc(struct intel_batchbuffer *batch,
+				 const struct igt_buf *dst, uint32_t spins,
+				 unsigned int threads);
+
 #endif /* MEDIA_SPIN_H */
@@ -28,6 +28,14 @@ void gen11_render_copyfunc(struct intel_batchbuffer *batch,
 			  const struct igt_buf *src, unsigned src_x, unsigned src_y,
 			  unsigned width, unsigned height,
 			  const struct igt_buf *dst, unsigned dst_x, unsigned dst_y);
+void gen11_render_copy_rects(struct intel_batchbuffer *batch,
+			     drm_intel_context *context,
+			     const struct igt_render_copy_rect *rects,
+			     unsigned int count);
+void gen9_render_copy_rects(struct intel_batchbuffer *batch,
+			    drm_intel_context *context,
+			    const struct igt_render_copy_rect *rects,
+			    unsigned int count);
 void gen9_render_copyfunc(struct intel_batchbuffer *batch,
 			  drm_intel_context *context,
 			  const struct igt_buf *src, unsigned src_x, unsigned src_y,
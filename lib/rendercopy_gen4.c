@@ -1,6 +1,7 @@
 #include "rendercopy.h"
 #include "intel_chipset.h"
 #include "gen4_render.h"
+#include "gpu_shaders.h"
 #include "surfaceformat.h"
 
 #include <assert.h>
@@ -17,68 +18,6 @@
 #define SF_KERNEL_NUM_GRF 16
 #define PS_KERNEL_NUM_GRF 32
 
-static const uint32_t gen4_sf_kernel_nomask[][4] = {
-	{ 0x00400031, 0x20c01fbd, 0x0069002c, 0x01110001 },
-	{ 0x00600001, 0x206003be, 0x00690060, 0x00000000 },
-	{ 0x00600040, 0x20e077bd, 0x00690080, 0x006940a0 },
-	{ 0x00600041, 0x202077be, 0x008d00e0, 0x000000c0 },
-	{ 0x00600040, 0x20e077bd, 0x006900a0, 0x00694060 },
-	{ 0x00600041, 0x204077be, 0x008d00e0, 0x000000c8 },
-	{ 0x00600031, 0x20001fbc, 0x008d0000, 0x8640c800 },
-};
-
-static const uint32_t gen5_sf_kernel_nomask[][4] = {
-	{ 0x00400031, 0x20c01fbd, 0x1069002c, 0x02100001 },
-	{ 0x00600001, 0x206003be, 0x00690060, 0x00000000 },
-	{ 0x00600040, 0x20e077bd, 0x00690080, 0x006940a0 },
-	{ 0x00600041, 0x202077be, 0x008d00e0, 0x000000c0 },
-	{ 0x00600040, 0x20e077bd, 0x006900a0, 0x00694060 },
-	{ 0x00600041, 0x204077be, 0x008d00e0, 0x000000c8 },
-	{ 0x00600031, 0x20001fbc, 0x648d0000, 0x8808c800 },
-};
-
-static const uint32_t gen4_ps_kernel_nomask_affine[][4] = {
-	{ 0x00800040, 0x23c06d29, 0x00480028, 0x10101010 },
-	{ 0x00800040, 0x23806d29, 0x0048002a, 0x11001100 },
-	{ 0x00802040, 0x2100753d, 0x008d03c0, 0x00004020 },
-	{ 0x00802040, 0x2140753d, 0x008d0380, 0x00004024 },
-	{ 0x00802059, 0x200077bc, 0x00000060, 0x008d0100 },
-	{ 0x00802048, 0x204077be, 0x00000064, 0x008d0140 },
-	{ 0x00802059, 0x200077bc, 0x00000070, 0x008d0100 },
-	{ 0x00802048, 0x208077be, 0x00000074, 0x008d0140 },
-	{ 0x00600201, 0x20200022, 0x008d0000, 0x00000000 },
-	{ 0x00000201, 0x20280062, 0x00000000, 0x00000000 },
-	{ 0x01800031, 0x21801d09, 0x008d0000, 0x02580001 },
-	{ 0x00600001, 0x204003be, 0x008d0180, 0x00000000 },
-	{ 0x00601001, 0x20c003be, 0x008d01a0, 0x00000000 },
-	{ 0x00600001, 0x206003be, 0x008d01c0, 0x00000000 },
-	{ 0x00601001, 0x20e003be, 0x008d01e0, 0x00000000 },
-	{ 0x00600001, 0x208003be, 0x008d0200, 0x00000000 },
-	{ 0x00601001, 0x210003be, 0x008d0220, 0x00000000 },
-	{ 0x00600001, 0x20a003be, 0x008d0240, 0x00000000 },
-	{ 0x00601001, 0x212003be, 0x008d0260, 0x00000000 },
-	{ 0x00600201, 0x202003be, 0x008d0020, 0x00000000 },
-	{ 0x00800031, 0x20001d28, 0x008d0000, 0x85a04800 },
-};
-
-static const uint32_t gen5_ps_kernel_nomask_affine[][4] = {
-	{ 0x00800040, 0x23c06d29, 0x00480028, 0x10101010 },
-	{ 0x00800040, 0x23806d29, 0x0048002a, 0x11001100 },
-	{ 0x00802040, 0x2100753d, 0x008d03c0, 0x00004020 },
-	{ 0x00802040, 0x2140753d, 0x008d0380, 0x00004024 },
-	{ 0x00802059, 0x200077bc, 0x00000060, 0x008d0100 },
-	{ 0x00802048, 0x204077be, 0x00000064, 0x008d0140 },
-	{ 0x00802059, 0x200077bc, 0x00000070, 0x008d0100 },
-	{ 0x00802048, 0x208077be, 0x00000074, 0x008d0140 },
-	{ 0x01800031, 0x21801fa9, 0x208d0000, 0x0a8a0001 },
-	{ 0x00802001, 0x304003be, 0x008d0180, 0x00000000 },
-	{ 0x00802001, 0x306003be, 0x008d01c0, 0x00000000 },
-	{ 0x00802001, 0x308003be, 0x008d0200, 0x00000000 },
-	{ 0x00802001, 0x30a003be, 0x008d0240, 0x00000000 },
-	{ 0x00600201, 0x202003be, 0x008d0020, 0x00000000 },
-	{ 0x00800031, 0x20001d28, 0x548d0000, 0x94084800 },
-};
-
 static uint32_t
 batch_used(struct intel_batchbuffer *batch)
 {
@@ -532,27 +471,21 @@ gen4_create_cc_state(struct intel_batchbuffer *batch,
 static uint32_t
 gen4_create_sf_kernel(struct intel_batchbuffer *batch)
 {
-	if (IS_GEN5(batch->devid))
-		return intel_batchbuffer_copy_data(batch, gen5_sf_kernel_nomask,
-						   sizeof(gen5_sf_kernel_nomask),
-						   64);
-	else
-		return intel_batchbuffer_copy_data(batch, gen4_sf_kernel_nomask,
-						   sizeof(gen4_sf_kernel_nomask),
-						   64);
+	const struct gpu_shader *kernel =
+		gpu_shader_lookup(batch->devid, GPU_SHADER_RENDER_SF);
+
+	return intel_batchbuffer_copy_data(batch, kernel->code, kernel->size,
+					   64);
 }
 
 static uint32_t
 gen4_create_ps_kernel(struct intel_batchbuffer *batch)
 {
-	if (IS_GEN5(batch->devid))
-		return intel_batchbuffer_copy_data(batch, gen5_ps_kernel_nomask_affine,
-						   sizeof(gen5_ps_kernel_nomask_affine),
-						   64);
-	else
-		return intel_batchbuffer_copy_data(batch, gen4_ps_kernel_nomask_affine,
-						   sizeof(gen4_ps_kernel_nomask_affine),
-						   64);
+	const struct gpu_shader *kernel =
+		gpu_shader_lookup(batch->devid, GPU_SHADER_RENDER_PS);
+
+	return intel_batchbuffer_copy_data(batch, kernel->code, kernel->size,
+					   64);
 }
 
 static uint32_t
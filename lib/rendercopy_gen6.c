@@ -17,37 +17,11 @@
 #include "intel_io.h"
 #include "rendercopy.h"
 #include "gen6_render.h"
+#include "gpu_shaders.h"
 #include "intel_reg.h"
 
 #define VERTEX_SIZE (3*4)
 
-static const uint32_t ps_kernel_nomask_affine[][4] = {
-	{ 0x0060005a, 0x204077be, 0x000000c0, 0x008d0040 },
-	{ 0x0060005a, 0x206077be, 0x000000c0, 0x008d0080 },
-	{ 0x0060005a, 0x208077be, 0x000000d0, 0x008d0040 },
-	{ 0x0060005a, 0x20a077be, 0x000000d0, 0x008d0080 },
-	{ 0x00000201, 0x20080061, 0x00000000, 0x00000000 },
-	{ 0x00600001, 0x20200022, 0x008d0000, 0x00000000 },
-	{ 0x02800031, 0x21c01cc9, 0x00000020, 0x0a8a0001 },
-	{ 0x00600001, 0x204003be, 0x008d01c0, 0x00000000 },
-	{ 0x00600001, 0x206003be, 0x008d01e0, 0x00000000 },
-	{ 0x00600001, 0x208003be, 0x008d0200, 0x00000000 },
-	{ 0x00600001, 0x20a003be, 0x008d0220, 0x00000000 },
-	{ 0x00600001, 0x20c003be, 0x008d0240, 0x00000000 },
-	{ 0x00600001, 0x20e003be, 0x008d0260, 0x00000000 },
-	{ 0x00600001, 0x210003be, 0x008d0280, 0x00000000 },
-	{ 0x00600001, 0x212003be, 0x008d02a0, 0x00000000 },
-	{ 0x05800031, 0x24001cc8, 0x00000040, 0x90019000 },
-	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
-	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
-	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
-	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
-	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
-	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
-	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
-	{ 0x0000007e, 0x00000000, 0x00000000, 0x00000000 },
-};
-
 static uint32_t
 batch_round_upto(struct intel_batchbuffer *batch, uint32_t divisor)
 {
@@ -433,8 +407,10 @@ gen6_create_cc_blend(struct intel_batchbuffer *batch)
 static uint32_t
 gen6_create_kernel(struct intel_batchbuffer *batch)
 {
-	return intel_batchbuffer_copy_data(batch, ps_kernel_nomask_affine,
-			  sizeof(ps_kernel_nomask_affine),
+	const struct gpu_shader *kernel =
+		gpu_shader_lookup(batch->devid, GPU_SHADER_RENDER_PS);
+
+	return intel_batchbuffer_copy_data(batch, kernel->code, kernel->size,
 			  64);
 }
 
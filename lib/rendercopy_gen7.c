@@ -18,20 +18,10 @@
 #include "intel_chipset.h"
 #include "rendercopy.h"
 #include "gen7_render.h"
+#include "gpu_shaders.h"
 #include "intel_reg.h"
 
 
-static const uint32_t ps_kernel[][4] = {
-	{ 0x0080005a, 0x2e2077bd, 0x000000c0, 0x008d0040 },
-	{ 0x0080005a, 0x2e6077bd, 0x000000d0, 0x008d0040 },
-	{ 0x02800031, 0x21801fa9, 0x008d0e20, 0x08840001 },
-	{ 0x00800001, 0x2e2003bd, 0x008d0180, 0x00000000 },
-	{ 0x00800001, 0x2e6003bd, 0x008d01c0, 0x00000000 },
-	{ 0x00800001, 0x2ea003bd, 0x008d0200, 0x00000000 },
-	{ 0x00800001, 0x2ee003bd, 0x008d0240, 0x00000000 },
-	{ 0x05800031, 0x20001fa8, 0x008d0e20, 0x90031000 },
-};
-
 static void
 gen7_render_flush(struct intel_batchbuffer *batch,
 		  drm_intel_context *context, uint32_t batch_end)
@@ -508,6 +498,7 @@ void gen7_render_copyfunc(struct intel_batchbuffer *batch,
 			  unsigned width, unsigned height,
 			  const struct igt_buf *dst, unsigned dst_x, unsigned dst_y)
 {
+	const struct gpu_shader *kernel;
 	uint32_t ps_binding_table, ps_sampler_off, ps_kernel_off;
 	uint32_t blend_state, cc_viewport;
 	uint32_t vertex_buffer;
@@ -522,8 +513,9 @@ void gen7_render_copyfunc(struct intel_batchbuffer *batch,
 	blend_state = gen7_create_blend_state(batch);
 	cc_viewport = gen7_create_cc_viewport(batch);
 	ps_sampler_off = gen7_create_sampler(batch);
-	ps_kernel_off = intel_batchbuffer_copy_data(batch, ps_kernel,
-						    sizeof(ps_kernel), 64);
+	kernel = gpu_shader_lookup(batch->devid, GPU_SHADER_RENDER_PS);
+	ps_kernel_off = intel_batchbuffer_copy_data(batch, kernel->code,
+						    kernel->size, 64);
 	vertex_buffer = gen7_create_vertex_buffer(batch,
 						  src_x, src_y,
 						  dst_x, dst_y,
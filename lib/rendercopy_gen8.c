@@ -20,6 +20,7 @@
 #include "intel_io.h"
 #include "rendercopy.h"
 #include "gen8_render.h"
+#include "gpu_shaders.h"
 #include "intel_reg.h"
 #include "igt_aux.h"
 
@@ -49,27 +50,6 @@ struct {
 	uint32_t sf_clip_state;
 } viewport;
 
-/* see lib/i915/shaders/ps/blit.g7a */
-static const uint32_t ps_kernel[][4] = {
-#if 1
-   { 0x0080005a, 0x2f403ae8, 0x3a0000c0, 0x008d0040 },
-   { 0x0080005a, 0x2f803ae8, 0x3a0000d0, 0x008d0040 },
-   { 0x02800031, 0x2e203a48, 0x0e8d0f40, 0x08840001 },
-   { 0x05800031, 0x20003a40, 0x0e8d0e20, 0x90031000 },
-#else
-   /* Write all -1 */
-   { 0x00600001, 0x2e000608, 0x00000000, 0x3f800000 },
-   { 0x00600001, 0x2e200608, 0x00000000, 0x3f800000 },
-   { 0x00600001, 0x2e400608, 0x00000000, 0x3f800000 },
-   { 0x00600001, 0x2e600608, 0x00000000, 0x3f800000 },
-   { 0x00600001, 0x2e800608, 0x00000000, 0x3f800000 },
-   { 0x00600001, 0x2ea00608, 0x00000000, 0x3f800000 },
-   { 0x00600001, 0x2ec00608, 0x00000000, 0x3f800000 },
-   { 0x00600001, 0x2ee00608, 0x00000000, 0x3f800000 },
-   { 0x05800031, 0x200022e0, 0x0e000e00, 0x90031000 },
-#endif
-};
-
 /* AUB annotation support */
 #define MAX_ANNOTATIONS	33
 struct annotations_context {
@@ -905,6 +885,7 @@ void gen8_render_copyfunc(struct intel_batchbuffer *batch,
 			  const struct igt_buf *dst, unsigned dst_x, unsigned dst_y)
 {
 	struct annotations_context aub_annotations;
+	const struct gpu_shader *kernel;
 	uint32_t ps_sampler_state, ps_kernel_off, ps_binding_table;
 	uint32_t scissor_state;
 	uint32_t vertex_buffer;
@@ -922,8 +903,9 @@ void gen8_render_copyfunc(struct intel_batchbuffer *batch,
 	ps_binding_table  = gen8_bind_surfaces(batch, &aub_annotations,
 					       src, dst);
 	ps_sampler_state  = gen8_create_sampler(batch, &aub_annotations);
+	kernel = gpu_shader_lookup(batch->devid, GPU_SHADER_RENDER_PS);
 	ps_kernel_off = gen8_fill_ps(batch, &aub_annotations,
-				     ps_kernel, sizeof(ps_kernel));
+				     kernel->code, kernel->size);
 	vertex_buffer = gen7_fill_vertex_buffer_data(batch, &aub_annotations,
 						     src,
 						     src_x, src_y,
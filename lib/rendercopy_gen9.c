@@ -20,6 +20,7 @@
 #include "intel_io.h"
 #include "rendercopy.h"
 #include "gen9_render.h"
+#include "gpu_shaders.h"
 #include "intel_reg.h"
 #include "igt_aux.h"
 
@@ -49,60 +50,8 @@ struct {
 	uint32_t sf_clip_state;
 } viewport;
 
-/* see lib/i915/shaders/ps/blit.g7a */
-static const uint32_t ps_kernel_gen9[][4] = {
-#if 1
-	{ 0x0080005a, 0x2f403ae8, 0x3a0000c0, 0x008d0040 },
-	{ 0x0080005a, 0x2f803ae8, 0x3a0000d0, 0x008d0040 },
-	{ 0x02800031, 0x2e203a48, 0x0e8d0f40, 0x08840001 },
-	{ 0x05800031, 0x20003a40, 0x0e8d0e20, 0x90031000 },
-#else
-	/* Write all -1 */
-	{ 0x00600001, 0x2e000608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2e200608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2e400608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2e600608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2e800608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2ea00608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2ec00608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2ee00608, 0x00000000, 0x3f800000 },
-	{ 0x05800031, 0x200022e0, 0x0e000e00, 0x90031000 },
-#endif
-};
-
-/* see lib/i915/shaders/ps/blit.g11a */
-static const uint32_t ps_kernel_gen11[][4] = {
-#if 1
-	{ 0x0060005b, 0x2000c01c, 0x07206601, 0x01800404 },
-	{ 0x0060005b, 0x7100480c, 0x0722003b, 0x01880406 },
-	{ 0x0060005b, 0x2000c01c, 0x07206601, 0x01800408 },
-	{ 0x0060005b, 0x7200480c, 0x0722003b, 0x0188040a },
-	{ 0x0060005b, 0x2000c01c, 0x07206e01, 0x01a00404 },
-	{ 0x0060005b, 0x7300480c, 0x0722003b, 0x01a80406 },
-	{ 0x0060005b, 0x2000c01c, 0x07206e01, 0x01a00408 },
-	{ 0x0060005b, 0x7400480c, 0x0722003b, 0x01a8040a },
-	{ 0x02800031, 0x21804a4c, 0x06000e20, 0x08840001 },
-	{ 0x00800001, 0x2e204b28, 0x008d0180, 0x00000000 },
-	{ 0x00800001, 0x2e604b28, 0x008d01c0, 0x00000000 },
-	{ 0x00800001, 0x2ea04b28, 0x008d0200, 0x00000000 },
-	{ 0x00800001, 0x2ee04b28, 0x008d0240, 0x00000000 },
-	{ 0x05800031, 0x20004a44, 0x06000e20, 0x90031000 },
-#else
-	/* Write all -1 */
-	{ 0x00600001, 0x2e000608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2e200608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2e400608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2e600608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2e800608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2ea00608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2ec00608, 0x00000000, 0x3f800000 },
-	{ 0x00600001, 0x2ee00608, 0x00000000, 0x3f800000 },
-	{ 0x05800031, 0x200022e0, 0x0e000e00, 0x90031000 },
-#endif
-};
-
-/* AUB annotation support */
-#define MAX_ANNOTATIONS	33
+/* AUB annotation support, with room for the surfaces of batched copies */
+#define MAX_ANNOTATIONS	81
 struct annotations_context {
 	drm_intel_aub_annotation annotations[MAX_ANNOTATIONS];
 	int index;
@@ -311,6 +260,26 @@ gen8_fill_ps(struct intel_batchbuffer *batch,
 	return offset;
 }
 
+static void
+gen7_emit_rect_vertices(struct intel_batchbuffer *batch,
+			const struct igt_buf *src,
+			uint32_t src_x, uint32_t src_y,
+			uint32_t dst_x, uint32_t dst_y,
+			uint32_t width, uint32_t height)
+{
+	emit_vertex_2s(batch, dst_x + width, dst_y + height);
+	emit_vertex_normalized(batch, src_x + width, igt_buf_width(src));
+	emit_vertex_normalized(batch, src_y + height, igt_buf_height(src));
+
+	emit_vertex_2s(batch, dst_x, dst_y + height);
+	emit_vertex_normalized(batch, src_x, igt_buf_width(src));
+	emit_vertex_normalized(batch, src_y + height, igt_buf_height(src));
+
+	emit_vertex_2s(batch, dst_x, dst_y);
+	emit_vertex_normalized(batch, src_x, igt_buf_width(src));
+	emit_vertex_normalized(batch, src_y, igt_buf_height(src));
+}
+
 /*
  * gen7_fill_vertex_buffer_data populate vertex buffer with data.
  *
@@ -334,17 +303,8 @@ gen7_fill_vertex_buffer_data(struct intel_batchbuffer *batch,
 	intel_batchbuffer_align(batch, 8);
 	start = batch->ptr;
 
-	emit_vertex_2s(batch, dst_x + width, dst_y + height);
-	emit_vertex_normalized(batch, src_x + width, igt_buf_width(src));
-	emit_vertex_normalized(batch, src_y + height, igt_buf_height(src));
-
-	emit_vertex_2s(batch, dst_x, dst_y + height);
-	emit_vertex_normalized(batch, src_x, igt_buf_width(src));
-	emit_vertex_normalized(batch, src_y + height, igt_buf_height(src));
-
-	emit_vertex_2s(batch, dst_x, dst_y);
-	emit_vertex_normalized(batch, src_x, igt_buf_width(src));
-	emit_vertex_normalized(batch, src_y, igt_buf_height(src));
+	gen7_emit_rect_vertices(batch, src, src_x, src_y, dst_x, dst_y,
+				width, height);
 
 	offset = intel_batchbuffer_subdata_offset(batch, start);
 	annotation_add_state(&aub_annotations, AUB_TRACE_VERTEX_BUFFER,
@@ -414,15 +374,16 @@ gen6_emit_vertex_elements(struct intel_batchbuffer *batch) {
  *
  * @batch
  * @offset - bytw offset within the @batch where the vertex buffer starts.
+ * @num_rects - number of RECTLIST rectangles in the vertex buffer.
  */
 static void gen7_emit_vertex_buffer(struct intel_batchbuffer *batch,
-				    uint32_t offset) {
+				    uint32_t offset, unsigned int num_rects) {
 	OUT_BATCH(GEN4_3DSTATE_VERTEX_BUFFERS | (1 + (4 * 1) - 2));
 	OUT_BATCH(0 << GEN6_VB0_BUFFER_INDEX_SHIFT | /* VB 0th index */
 		  GEN8_VB0_BUFFER_ADDR_MOD_EN | /* Address Modify Enable */
 		  VERTEX_SIZE << VB0_BUFFER_PITCH_SHIFT);
 	OUT_RELOC(batch->bo, I915_GEM_DOMAIN_VERTEX, 0, offset);
-	OUT_BATCH(3 * VERTEX_SIZE);
+	OUT_BATCH(num_rects * 3 * VERTEX_SIZE);
 }
 
 static uint32_t
@@ -537,7 +498,8 @@ gen7_emit_push_constants(struct intel_batchbuffer *batch) {
 }
 
 static void
-gen9_emit_state_base_address(struct intel_batchbuffer *batch) {
+gen9_emit_state_base_address(struct intel_batchbuffer *batch,
+			     drm_intel_bo *state) {
 
 	/* WaBindlessSurfaceStateModifyEnable:skl,bxt */
 	/* The length has to be one less if we dont modify
@@ -555,7 +517,7 @@ gen9_emit_state_base_address(struct intel_batchbuffer *batch) {
 	OUT_RELOC(batch->bo, I915_GEM_DOMAIN_SAMPLER, 0, BASE_ADDRESS_MODIFY);
 
 	/* dynamic */
-	OUT_RELOC(batch->bo, I915_GEM_DOMAIN_RENDER | I915_GEM_DOMAIN_INSTRUCTION,
+	OUT_RELOC(state, I915_GEM_DOMAIN_RENDER | I915_GEM_DOMAIN_INSTRUCTION,
 		  0, BASE_ADDRESS_MODIFY);
 
 	/* indirect */
@@ -563,7 +525,7 @@ gen9_emit_state_base_address(struct intel_batchbuffer *batch) {
 	OUT_BATCH(0);
 
 	/* instruction */
-	OUT_RELOC(batch->bo, I915_GEM_DOMAIN_INSTRUCTION, 0, BASE_ADDRESS_MODIFY);
+	OUT_RELOC(state, I915_GEM_DOMAIN_INSTRUCTION, 0, BASE_ADDRESS_MODIFY);
 
 	/* general state buffer size */
 	OUT_BATCH(0xfffff000 | 1);
@@ -903,8 +865,7 @@ static void gen8_emit_vf_topology(struct intel_batchbuffer *batch)
 	OUT_BATCH(_3DPRIM_RECTLIST);
 }
 
-/* Vertex elements MUST be defined before this according to spec */
-static void gen8_emit_primitive(struct intel_batchbuffer *batch, uint32_t offset)
+static void gen8_emit_vf(struct intel_batchbuffer *batch)
 {
 	OUT_BATCH(GEN8_3DSTATE_VF | (2 - 2));
 	OUT_BATCH(0);
@@ -912,11 +873,15 @@ static void gen8_emit_primitive(struct intel_batchbuffer *batch, uint32_t offset
 	OUT_BATCH(GEN8_3DSTATE_VF_INSTANCING | (3 - 2));
 	OUT_BATCH(0);
 	OUT_BATCH(0);
+}
 
+/* Vertex elements MUST be defined before this according to spec */
+static void gen8_emit_primitive(struct intel_batchbuffer *batch, uint32_t start)
+{
 	OUT_BATCH(GEN4_3DPRIMITIVE | (7-2));
 	OUT_BATCH(0);	/* gen8+ ignore the topology type field */
 	OUT_BATCH(3);	/* vertex count */
-	OUT_BATCH(0);	/*  We're specifying this instead with offset in GEN6_3DSTATE_VERTEX_BUFFERS */
+	OUT_BATCH(start);	/* start vertex, within GEN6_3DSTATE_VERTEX_BUFFERS */
 	OUT_BATCH(1);	/* single instance */
 	OUT_BATCH(0);	/* start instance location */
 	OUT_BATCH(0);	/* index buffer offset, ignored */
@@ -954,23 +919,124 @@ static void gen8_emit_primitive(struct intel_batchbuffer *batch, uint32_t offset
 
 #define BATCH_STATE_SPLIT 2048
 
-static
-void _gen9_render_copyfunc(struct intel_batchbuffer *batch,
-			  drm_intel_context *context,
-			  const struct igt_buf *src, unsigned src_x,
-			  unsigned src_y, unsigned width, unsigned height,
-			  const struct igt_buf *dst, unsigned dst_x,
-			  unsigned dst_y, const uint32_t ps_kernel[][4],
-			  uint32_t ps_kernel_size)
+/*
+ * With intel_batchbuffer_cache_render_state(), the commands and the dynamic
+ * state that do not depend on the buffers being copied are laid out as above
+ * once, in a buffer of their own which is then the dynamic and instruction
+ * state base, and each copy calls into it as a second level batch.
+ */
+static drm_intel_bo *
+gen9_render_state(struct intel_batchbuffer *batch,
+		  const uint32_t ps_kernel[][4], uint32_t ps_kernel_size)
 {
-	uint32_t ps_sampler_state, ps_kernel_off, ps_binding_table;
+	uint32_t ps_sampler_state, ps_kernel_off;
 	uint32_t scissor_state;
+	drm_intel_bo *bo;
+	int ret;
+
+	if (batch->render_state && batch->render_state_key == ps_kernel)
+		return batch->render_state;
+
+	if (batch->render_state)
+		drm_intel_bo_unreference(batch->render_state);
+	batch->render_state = NULL;
+
+	/* The batch is empty after the flush, borrow its buffer */
+	batch->ptr = &batch->buffer[BATCH_STATE_SPLIT];
+
+	annotation_init(&aub_annotations);
+
+	ps_sampler_state  = gen8_create_sampler(batch);
+	ps_kernel_off = gen8_fill_ps(batch, ps_kernel, ps_kernel_size);
+	cc.cc_state = gen6_create_cc_state(batch);
+	cc.blend_state = gen8_create_blend_state(batch);
+	viewport.cc_state = gen6_create_cc_viewport(batch);
+	viewport.sf_clip_state = gen7_create_sf_clip_viewport(batch);
+	scissor_state = gen6_create_scissor_rect(batch);
+
+	assert(batch->ptr < &batch->buffer[4095]);
+
+	batch->ptr = batch->buffer;
+
+	gen8_emit_sip(batch);
+
+	gen7_emit_push_constants(batch);
+
+	OUT_BATCH(GEN7_3DSTATE_VIEWPORT_STATE_POINTERS_CC);
+	OUT_BATCH(viewport.cc_state);
+	OUT_BATCH(GEN8_3DSTATE_VIEWPORT_STATE_POINTERS_SF_CLIP);
+	OUT_BATCH(viewport.sf_clip_state);
+
+	gen7_emit_urb(batch);
+
+	gen8_emit_cc(batch);
+
+	gen8_emit_multisample(batch);
+
+	gen8_emit_null_state(batch);
+
+	OUT_BATCH(GEN7_3DSTATE_STREAMOUT | (5 - 2));
+	OUT_BATCH(0);
+	OUT_BATCH(0);
+	OUT_BATCH(0);
+	OUT_BATCH(0);
+
+	gen7_emit_clip(batch);
+
+	gen8_emit_sf(batch);
+
+	gen8_emit_ps(batch, ps_kernel_off);
+
+	OUT_BATCH(GEN7_3DSTATE_SAMPLER_STATE_POINTERS_PS);
+	OUT_BATCH(ps_sampler_state);
+
+	OUT_BATCH(GEN8_3DSTATE_SCISSOR_STATE_POINTERS);
+	OUT_BATCH(scissor_state);
+
+	gen9_emit_depth(batch);
+
+	gen7_emit_clear(batch);
+
+	gen6_emit_vertex_elements(batch);
+
+	gen8_emit_vf_topology(batch);
+
+	OUT_BATCH(MI_BATCH_BUFFER_END);
+
+	assert(batch->ptr < &batch->buffer[BATCH_STATE_SPLIT]);
+
+	bo = drm_intel_bo_alloc(batch->bufmgr, "render state", 4096, 4096);
+	igt_assert(bo);
+	ret = drm_intel_bo_subdata(bo, 0, 4096, batch->buffer);
+	igt_assert(ret == 0);
+
+	memset(batch->buffer, 0, sizeof(batch->buffer));
+	batch->ptr = batch->buffer;
+
+	batch->render_state = bo;
+	batch->render_state_key = ps_kernel;
+	return bo;
+}
+
+static
+void _gen9_render_copyfunc_cached(struct intel_batchbuffer *batch,
+				  drm_intel_context *context,
+				  const struct igt_buf *src, unsigned src_x,
+				  unsigned src_y, unsigned width, unsigned height,
+				  const struct igt_buf *dst, unsigned dst_x,
+				  unsigned dst_y, const uint32_t ps_kernel[][4],
+				  uint32_t ps_kernel_size)
+{
+	uint32_t ps_binding_table;
 	uint32_t vertex_buffer;
 	uint32_t batch_end;
+	drm_intel_bo *state;
 
 	igt_assert(src->bpp == dst->bpp);
 	intel_batchbuffer_flush_with_context(batch, context);
 
+	state = gen9_render_state(batch, ps_kernel, ps_kernel_size);
+
 	intel_batchbuffer_align(batch, 8);
 
 	batch->ptr = &batch->buffer[BATCH_STATE_SPLIT];
@@ -978,12 +1044,113 @@ void _gen9_render_copyfunc(struct intel_batchbuffer *batch,
 	annotation_init(&aub_annotations);
 
 	ps_binding_table  = gen8_bind_surfaces(batch, src, dst);
-	ps_sampler_state  = gen8_create_sampler(batch);
-	ps_kernel_off = gen8_fill_ps(batch, ps_kernel, ps_kernel_size);
 	vertex_buffer = gen7_fill_vertex_buffer_data(batch, src,
 						     src_x, src_y,
 						     dst_x, dst_y,
 						     width, height);
+
+	assert(batch->ptr < &batch->buffer[4095]);
+
+	batch->ptr = batch->buffer;
+
+	OUT_BATCH(G4X_PIPELINE_SELECT | PIPELINE_SELECT_3D |
+				GEN9_PIPELINE_SELECTION_MASK);
+
+	gen9_emit_state_base_address(batch, state);
+
+	/* Second level batch, returning here at its MI_BATCH_BUFFER_END */
+	OUT_BATCH(MI_BATCH_BUFFER_START | 1 << 22 | 1 << 8 | 1);
+	OUT_RELOC(state, I915_GEM_DOMAIN_COMMAND, 0, 0);
+
+	OUT_BATCH(GEN7_3DSTATE_BINDING_TABLE_POINTERS_PS);
+	OUT_BATCH(ps_binding_table);
+
+	gen6_emit_drawing_rectangle(batch, dst);
+
+	gen7_emit_vertex_buffer(batch, vertex_buffer, 1);
+
+	gen8_emit_vf(batch);
+	gen8_emit_primitive(batch, 0);
+
+	OUT_BATCH(MI_BATCH_BUFFER_END);
+
+	batch_end = intel_batchbuffer_align(batch, 8);
+	assert(batch_end < BATCH_STATE_SPLIT);
+	annotation_add_batch(&aub_annotations, batch_end);
+
+	dump_batch(batch);
+
+	annotation_flush(&aub_annotations, batch);
+
+	gen6_render_flush(batch, context, batch_end);
+	intel_batchbuffer_reset(batch);
+}
+
+/*
+ * Without intel_batchbuffer_cache_render_state(), each batch sets up the whole
+ * pipeline as above and then draws as many of the rectangles as fit, the
+ * vertices of all of them being packed into a single vertex buffer. Only the
+ * binding table and the drawing rectangle change between the primitives.
+ */
+#define GEN9_MAX_RECTS 64
+
+/* An 8 byte binding table and two surface states, with their alignment */
+#define GEN9_BIND_SIZE (32 + 2 * 64 + 64)
+
+/* A flush, binding table and drawing rectangle changes and the primitive */
+#define GEN9_RECT_CMDS_SIZE ((6 + 2 + 4 + 7) * 4)
+
+static bool
+gen9_rect_needs_flush(const struct igt_render_copy_rect *rects,
+		      unsigned int first, unsigned int n)
+{
+	for (unsigned int i = first; i < n; i++)
+		if (rects[i].dst->bo == rects[n].src->bo)
+			return true;
+
+	return false;
+}
+
+/* Make the earlier render target writes visible to the sampler */
+static void
+gen9_emit_texture_flush(struct intel_batchbuffer *batch)
+{
+	OUT_BATCH(GEN6_PIPE_CONTROL | (6 - 2));
+	OUT_BATCH(GEN7_PIPE_CONTROL_CS_STALL |
+		  GEN6_PIPE_CONTROL_WC_FLUSH |
+		  GEN6_PIPE_CONTROL_TC_FLUSH);
+	OUT_BATCH(0);
+	OUT_BATCH(0);
+	OUT_BATCH(0);
+	OUT_BATCH(0);
+}
+
+static unsigned int
+gen9_render_copy_batch(struct intel_batchbuffer *batch,
+		       drm_intel_context *context,
+		       const struct igt_render_copy_rect *rects,
+		       unsigned int count,
+		       const uint32_t ps_kernel[][4],
+		       uint32_t ps_kernel_size)
+{
+	uint32_t ps_binding_table[GEN9_MAX_RECTS];
+	uint32_t ps_sampler_state, ps_kernel_off;
+	uint32_t scissor_state;
+	uint32_t vertex_buffer;
+	uint32_t batch_end;
+	unsigned int i, n, flushed;
+	void *start;
+
+	intel_batchbuffer_flush_with_context(batch, context);
+
+	intel_batchbuffer_align(batch, 8);
+
+	batch->ptr = &batch->buffer[BATCH_STATE_SPLIT];
+
+	annotation_init(&aub_annotations);
+
+	ps_sampler_state  = gen8_create_sampler(batch);
+	ps_kernel_off = gen8_fill_ps(batch, ps_kernel, ps_kernel_size);
 	cc.cc_state = gen6_create_cc_state(batch);
 	cc.blend_state = gen8_create_blend_state(batch);
 	viewport.cc_state = gen6_create_cc_viewport(batch);
@@ -991,6 +1158,42 @@ void _gen9_render_copyfunc(struct intel_batchbuffer *batch,
 	scissor_state = gen6_create_scissor_rect(batch);
 	/* TODO: theree is other state which isn't setup */
 
+	/* Bind the surfaces, leaving room for the vertices of every rectangle */
+	for (n = 0; n < count && n < GEN9_MAX_RECTS; n++) {
+		const struct igt_render_copy_rect *r = &rects[n];
+		uint32_t space = (n + 1) * 3 * VERTEX_SIZE + 8;
+		bool rebind;
+
+		igt_assert(r->src->bpp == r->dst->bpp);
+
+		rebind = n == 0 ||
+			 r->src != rects[n - 1].src ||
+			 r->dst != rects[n - 1].dst;
+		if (rebind)
+			space += GEN9_BIND_SIZE;
+
+		if (intel_batchbuffer_space(batch) < space)
+			break;
+
+		if (rebind)
+			ps_binding_table[n] = gen8_bind_surfaces(batch,
+								 r->src, r->dst);
+		else
+			ps_binding_table[n] = ps_binding_table[n - 1];
+	}
+	igt_assert(n);
+
+	intel_batchbuffer_align(batch, 8);
+	start = batch->ptr;
+	for (i = 0; i < n; i++)
+		gen7_emit_rect_vertices(batch, rects[i].src,
+					rects[i].src_x, rects[i].src_y,
+					rects[i].dst_x, rects[i].dst_y,
+					rects[i].width, rects[i].height);
+	vertex_buffer = intel_batchbuffer_subdata_offset(batch, start);
+	annotation_add_state(&aub_annotations, AUB_TRACE_VERTEX_BUFFER,
+			     vertex_buffer, n * 3 * VERTEX_SIZE);
+
 	assert(batch->ptr < &batch->buffer[4095]);
 
 	batch->ptr = batch->buffer;
@@ -1004,7 +1207,7 @@ void _gen9_render_copyfunc(struct intel_batchbuffer *batch,
 
 	gen7_emit_push_constants(batch);
 
-	gen9_emit_state_base_address(batch);
+	gen9_emit_state_base_address(batch, batch->bo);
 
 	OUT_BATCH(GEN7_3DSTATE_VIEWPORT_STATE_POINTERS_CC);
 	OUT_BATCH(viewport.cc_state);
@@ -1031,9 +1234,6 @@ void _gen9_render_copyfunc(struct intel_batchbuffer *batch,
 
 	gen8_emit_ps(batch, ps_kernel_off);
 
-	OUT_BATCH(GEN7_3DSTATE_BINDING_TABLE_POINTERS_PS);
-	OUT_BATCH(ps_binding_table);
-
 	OUT_BATCH(GEN7_3DSTATE_SAMPLER_STATE_POINTERS_PS);
 	OUT_BATCH(ps_sampler_state);
 
@@ -1044,13 +1244,39 @@ void _gen9_render_copyfunc(struct intel_batchbuffer *batch,
 
 	gen7_emit_clear(batch);
 
-	gen6_emit_drawing_rectangle(batch, dst);
-
-	gen7_emit_vertex_buffer(batch, vertex_buffer);
+	gen7_emit_vertex_buffer(batch, vertex_buffer, n);
 	gen6_emit_vertex_elements(batch);
 
 	gen8_emit_vf_topology(batch);
-	gen8_emit_primitive(batch, vertex_buffer);
+	gen8_emit_vf(batch);
+
+	/*
+	 * Any rectangle left over once the commands fill their half of the
+	 * batch is drawn by the next one, its state here is simply unused.
+	 */
+	flushed = 0;
+	for (i = 0; i < n; i++) {
+		const struct igt_render_copy_rect *r = &rects[i];
+
+		if (batch->ptr + GEN9_RECT_CMDS_SIZE + 8 >
+		    &batch->buffer[BATCH_STATE_SPLIT])
+			break;
+
+		if (gen9_rect_needs_flush(rects, flushed, i)) {
+			gen9_emit_texture_flush(batch);
+			flushed = i;
+		}
+
+		if (i == 0 || ps_binding_table[i] != ps_binding_table[i - 1]) {
+			OUT_BATCH(GEN7_3DSTATE_BINDING_TABLE_POINTERS_PS);
+			OUT_BATCH(ps_binding_table[i]);
+		}
+
+		if (i == 0 || r->dst != rects[i - 1].dst)
+			gen6_emit_drawing_rectangle(batch, r->dst);
+
+		gen8_emit_primitive(batch, 3 * i);
+	}
 
 	OUT_BATCH(MI_BATCH_BUFFER_END);
 
@@ -1064,6 +1290,52 @@ void _gen9_render_copyfunc(struct intel_batchbuffer *batch,
 
 	gen6_render_flush(batch, context, batch_end);
 	intel_batchbuffer_reset(batch);
+
+	return i;
+}
+
+static
+void _gen9_render_copy_rects(struct intel_batchbuffer *batch,
+			     drm_intel_context *context,
+			     const struct igt_render_copy_rect *rects,
+			     unsigned int count,
+			     const uint32_t ps_kernel[][4],
+			     uint32_t ps_kernel_size)
+{
+	while (count) {
+		unsigned int n;
+
+		n = gen9_render_copy_batch(batch, context, rects, count,
+					   ps_kernel, ps_kernel_size);
+		rects += n;
+		count -= n;
+	}
+}
+
+static
+void _gen9_render_copyfunc(struct intel_batchbuffer *batch,
+			  drm_intel_context *context,
+			  const struct igt_buf *src, unsigned src_x,
+			  unsigned src_y, unsigned width, unsigned height,
+			  const struct igt_buf *dst, unsigned dst_x,
+			  unsigned dst_y, const uint32_t ps_kernel[][4],
+			  uint32_t ps_kernel_size)
+{
+	struct igt_render_copy_rect rect = {
+		.src = src, .src_x = src_x, .src_y = src_y,
+		.width = width, .height = height,
+		.dst = dst, .dst_x = dst_x, .dst_y = dst_y,
+	};
+
+	if (batch->cache_render_state) {
+		_gen9_render_copyfunc_cached(batch, context, src, src_x, src_y,
+					     width, height, dst, dst_x, dst_y,
+					     ps_kernel, ps_kernel_size);
+		return;
+	}
+
+	_gen9_render_copy_rects(batch, context, &rect, 1,
+				ps_kernel, ps_kernel_size);
 }
 
 void gen9_render_copyfunc(struct intel_batchbuffer *batch,
@@ -1073,9 +1345,12 @@ void gen9_render_copyfunc(struct intel_batchbuffer *batch,
 			  const struct igt_buf *dst, unsigned dst_x, unsigned dst_y)
 
 {
+	const struct gpu_shader *kernel =
+		gpu_shader_lookup(batch->devid, GPU_SHADER_RENDER_PS);
+
 	_gen9_render_copyfunc(batch, context, src, src_x, src_y,
-			  width, height, dst, dst_x, dst_y, ps_kernel_gen9,
-			  sizeof(ps_kernel_gen9));
+			  width, height, dst, dst_x, dst_y, kernel->code,
+			  kernel->size);
 }
 
 void gen11_render_copyfunc(struct intel_batchbuffer *batch,
@@ -1085,7 +1360,34 @@ void gen11_render_copyfunc(struct intel_batchbuffer *batch,
 			  const struct igt_buf *dst, unsigned dst_x, unsigned dst_y)
 
 {
+	const struct gpu_shader *kernel =
+		gpu_shader_lookup(batch->devid, GPU_SHADER_RENDER_PS);
+
 	_gen9_render_copyfunc(batch, context, src, src_x, src_y,
-			  width, height, dst, dst_x, dst_y, ps_kernel_gen11,
-			  sizeof(ps_kernel_gen11));
+			  width, height, dst, dst_x, dst_y, kernel->code,
+			  kernel->size);
+}
+
+void gen9_render_copy_rects(struct intel_batchbuffer *batch,
+			    drm_intel_context *context,
+			    const struct igt_render_copy_rect *rects,
+			    unsigned int count)
+{
+	const struct gpu_shader *kernel =
+		gpu_shader_lookup(batch->devid, GPU_SHADER_RENDER_PS);
+
+	_gen9_render_copy_rects(batch, context, rects, count,
+				kernel->code, kernel->size);
+}
+
+void gen11_render_copy_rects(struct intel_batchbuffer *batch,
+			     drm_intel_context *context,
+			     const struct igt_render_copy_rect *rects,
+			     unsigned int count)
+{
+	const struct gpu_shader *kernel =
+		gpu_shader_lookup(batch->devid, GPU_SHADER_RENDER_PS);
+
+	_gen9_render_copy_rects(batch, context, rects, count,
+				kernel->code, kernel->size);
 }
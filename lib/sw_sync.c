@@ -214,12 +214,45 @@ int sync_fence_status(int fence)
 	return info.status;
 }
 
+/**
+ * sync_fence_timestamp:
+ * @fence: sync_file fd
+ *
+ * Returns: the CLOCK_MONOTONIC time, in ns, at which the last fence of
+ * @fence signaled, or 0 if they have not all signaled yet.
+ */
+uint64_t sync_fence_timestamp(int fence)
+{
+	struct sync_file_info info = {};
+	struct sync_fence_info *fence_info;
+	uint64_t ts = 0;
+
+	if (ioctl(fence, SYNC_IOC_FILE_INFO, &info) ||
+	    info.status != 1 || !info.num_fences)
+		return 0;
+
+	fence_info = calloc(info.num_fences, sizeof(*fence_info));
+	if (!fence_info)
+		return 0;
+
+	info.sync_fence_info = to_user_pointer(fence_info);
+	if (ioctl(fence, SYNC_IOC_FILE_INFO, &info) == 0) {
+		for (int i = 0; i < info.num_fences; i++)
+			if (fence_info[i].timestamp_ns > ts)
+				ts = fence_info[i].timestamp_ns;
+	}
+
+	free(fence_info);
+
+	return ts;
+}
+
 static void modprobe(const char *driver)
 {
 	igt_kmod_load(driver, NULL);
 }
 
-static bool kernel_has_sw_sync(void)
+bool igt_has_sw_sync(void)
 {
 	char buf[128];
 
@@ -230,5 +263,5 @@ static bool kernel_has_sw_sync(void)
 
 void igt_require_sw_sync(void)
 {
-	igt_require(kernel_has_sw_sync());
+	igt_require(igt_has_sw_sync());
 }
@@ -27,10 +27,14 @@
 #ifndef SW_SYNC_H
 #define SW_SYNC_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #define SW_SYNC_FENCE_STATUS_ERROR		(-1)
 #define SW_SYNC_FENCE_STATUS_ACTIVE		(0)
 #define SW_SYNC_FENCE_STATUS_SIGNALED	(1)
 
+bool igt_has_sw_sync(void);
 void igt_require_sw_sync(void);
 
 int sw_sync_timeline_create(void);
@@ -44,6 +48,7 @@ int sync_fence_wait(int fence, int timeout);
 int sync_fence_status(int fence);
 int sync_fence_count(int fence);
 int sync_fence_count_status(int fence, int status);
+uint64_t sync_fence_timestamp(int fence);
 
 #define SYNC_FENCE_OK 1
 
@@ -25,7 +25,9 @@
 
 #include "config.h"
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "igt_core.h"
 #include "igt_audio.h"
@@ -174,6 +176,157 @@ static void test_signal_detect_phaseshift(struct audio_signal *signal)
 	igt_assert(!ok);
 }
 
+#define STREAM_WINDOWS 64
+
+static void test_signal_detector_untampered(struct audio_signal *signal)
+{
+	struct audio_signal_detector *d;
+	double buf[BUFFER_LEN];
+	size_t i;
+
+	d = audio_signal_detector_init(signal, SAMPLING_RATE, 0, BUFFER_LEN,
+				       NULL, NULL);
+
+	/* Feed in chunks unrelated to the window size */
+	for (i = 0; i < STREAM_WINDOWS; i++) {
+		audio_signal_fill(signal, buf, 1000 / CHANNELS);
+		igt_assert_eq(audio_signal_detector_feed(d, buf, 1000), 0);
+	}
+	igt_assert_eq(audio_signal_detector_windows(d),
+		      (STREAM_WINDOWS * 1000 - BUFFER_LEN) / (BUFFER_LEN / 2) + 1);
+
+	audio_signal_detector_fini(d);
+}
+
+static void test_signal_detector_silence(struct audio_signal *signal)
+{
+	struct audio_signal_detector *d;
+	double buf[BUFFER_LEN] = {0};
+
+	d = audio_signal_detector_init(signal, SAMPLING_RATE, 0, BUFFER_LEN,
+				       NULL, NULL);
+	igt_assert_eq(audio_signal_detector_feed(d, buf, BUFFER_LEN), 1);
+	audio_signal_detector_fini(d);
+}
+
+static void test_signal_detector_with_missing_freq(struct audio_signal *signal)
+{
+	struct audio_signal_detector *d;
+	struct audio_signal *missing;
+	double buf[BUFFER_LEN];
+	size_t i;
+
+	missing = audio_signal_init(CHANNELS, SAMPLING_RATE);
+	for (i = 1; i < test_freqs_len; i++)
+		audio_signal_add_frequency(missing, test_freqs[i], 0);
+	audio_signal_synthesize(missing);
+	audio_signal_fill(missing, buf, BUFFER_LEN / CHANNELS);
+
+	d = audio_signal_detector_init(signal, SAMPLING_RATE, 0, BUFFER_LEN,
+				       NULL, NULL);
+	igt_assert_eq(audio_signal_detector_feed(d, buf, BUFFER_LEN), 1);
+	audio_signal_detector_fini(d);
+	audio_signal_fini(missing);
+}
+
+static void test_signal_detector_phaseshift(struct audio_signal *signal)
+{
+	struct audio_signal_detector *d;
+	double *buf;
+	size_t len = 8 * BUFFER_LEN;
+
+	buf = malloc((len + PHASESHIFT_LEN) * sizeof(double));
+	audio_signal_fill(signal, buf, (len + PHASESHIFT_LEN) / CHANNELS);
+
+	/* Drop a few samples in the middle of the stream */
+	memmove(&buf[len / 2], &buf[len / 2 + PHASESHIFT_LEN],
+		(len / 2) * sizeof(double));
+
+	d = audio_signal_detector_init(signal, SAMPLING_RATE, 0, BUFFER_LEN,
+				       NULL, NULL);
+	igt_assert_lt(0, audio_signal_detector_feed(d, buf, len));
+	audio_signal_detector_fini(d);
+
+	free(buf);
+}
+
+static void test_signal_detector_s32(struct audio_signal *signal)
+{
+	struct audio_signal_detector *d[2];
+	double buf[BUFFER_LEN];
+	int32_t interleaved[2 * BUFFER_LEN];
+	size_t i, j;
+
+	/* The signal on channel 0, silence on channel 1 */
+	for (i = 0; i < 2; i++)
+		d[i] = audio_signal_detector_init(signal, SAMPLING_RATE, 0,
+						  BUFFER_LEN, NULL, NULL);
+
+	for (i = 0; i < 4; i++) {
+		audio_signal_fill(signal, buf, BUFFER_LEN / CHANNELS);
+		for (j = 0; j < BUFFER_LEN; j++) {
+			interleaved[2 * j] = buf[j] * INT32_MAX;
+			interleaved[2 * j + 1] = 0;
+		}
+
+		for (j = 0; j < 2; j++)
+			audio_signal_detector_feed_s32_le(d[j], interleaved,
+							  2 * BUFFER_LEN, 2, j);
+	}
+
+	igt_assert_eq(audio_signal_detector_windows(d[0]), 7);
+	igt_assert_eq(audio_signal_detector_feed_s32_le(d[0], NULL, 0, 2, 0), 0);
+	igt_assert_eq(audio_signal_detector_feed_s32_le(d[1], NULL, 0, 2, 1), 7);
+
+	for (i = 0; i < 2; i++)
+		audio_signal_detector_fini(d[i]);
+}
+
+struct drift_result {
+	double drift;
+	size_t failed;
+};
+
+static void record_drift(const struct audio_signal_window *window, void *data)
+{
+	struct drift_result *result = data;
+
+	igt_assert_eq(window->freqs_count, 1);
+	result->drift = window->drift[0];
+	result->failed += !window->ok;
+}
+
+static void test_signal_detector_drift(double offset)
+{
+	struct audio_signal *signal;
+	struct audio_signal_detector *d;
+	struct drift_result result = {};
+	double buf[BUFFER_LEN];
+	size_t i, j;
+
+	/* 44100 / 44, a frequency audio_signal_add_frequency keeps as is */
+	signal = audio_signal_init(CHANNELS, SAMPLING_RATE);
+	audio_signal_add_frequency(signal, 1002, 0);
+
+	d = audio_signal_detector_init(signal, SAMPLING_RATE, 0, BUFFER_LEN,
+				       record_drift, &result);
+	for (i = 0; i < 16; i++) {
+		for (j = 0; j < BUFFER_LEN; j++)
+			buf[j] = 0.5 * sin(2.0 * M_PI * (1002 + offset) *
+					   (i * BUFFER_LEN + j) / SAMPLING_RATE);
+		audio_signal_detector_feed(d, buf, BUFFER_LEN);
+	}
+
+	igt_debug("Measured drift %f Hz, expected %f Hz\n",
+		  result.drift, offset);
+	igt_assert(fabs(result.drift - offset) < 0.05);
+	/* The first window has no previous phase to measure the drift */
+	igt_assert_eq(result.failed, offset > 1.0 ? 30 : 0);
+
+	audio_signal_detector_fini(d);
+	audio_signal_fini(signal);
+}
+
 igt_main
 {
 	struct audio_signal *signal = NULL;
@@ -215,8 +368,29 @@ igt_main
 		igt_subtest("signal-detect-phaseshift")
 			test_signal_detect_phaseshift(signal);
 
+		igt_subtest("signal-detector-untampered")
+			test_signal_detector_untampered(signal);
+
+		igt_subtest("signal-detector-silence")
+			test_signal_detector_silence(signal);
+
+		igt_subtest("signal-detector-with-missing-freq")
+			test_signal_detector_with_missing_freq(signal);
+
+		igt_subtest("signal-detector-phaseshift")
+			test_signal_detector_phaseshift(signal);
+
+		igt_subtest("signal-detector-s32")
+			test_signal_detector_s32(signal);
+
 		igt_fixture {
 			audio_signal_fini(signal);
 		}
 	}
+
+	igt_subtest("signal-detector-small-drift")
+		test_signal_detector_drift(0.5);
+
+	igt_subtest("signal-detector-large-drift")
+		test_signal_detector_drift(2.0);
 }
@@ -0,0 +1,117 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <math.h>
+
+#include "igt_core.h"
+#include "igt_bench.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
+
+static void test_ci(void)
+{
+	igt_stats_t stats;
+	double half_width;
+
+	igt_stats_init(&stats);
+	igt_stats_push(&stats, 2);
+	igt_stats_push(&stats, 4);
+	igt_stats_push(&stats, 6);
+	igt_stats_push(&stats, 8);
+	igt_stats_push(&stats, 10);
+
+	/* t(4) * sqrt(10) / sqrt(5) */
+	igt_assert_eq_double(igt_bench_ci(&stats, &half_width), 6);
+	igt_assert(fabs(half_width - 2.776 * sqrt(2)) < 1e-9);
+
+	igt_stats_fini(&stats);
+}
+
+static void test_min_rounds(void)
+{
+	struct igt_bench_stability s = {
+		.target = 0.01, .min_rounds = 5, .max_rounds = 100,
+	};
+	igt_stats_t stats;
+
+	igt_stats_init(&stats);
+	do
+		igt_stats_push(&stats, 10);
+	while (igt_bench_unstable(&stats, &s));
+
+	igt_assert_eq(stats.n_values, 5);
+	igt_assert_eq(s.rejected, 0);
+	igt_assert_eq_double(s.ci, 0);
+
+	igt_stats_fini(&stats);
+}
+
+static void test_warmup(void)
+{
+	static const uint64_t values[] = { 50, 10, 11, 9, 10, 10, 11, 9 };
+	struct igt_bench_stability s = {
+		.target = 0.1, .min_rounds = 5, .max_rounds = 100,
+	};
+	igt_stats_t stats;
+	unsigned int n = 0;
+
+	igt_stats_init(&stats);
+	do
+		igt_stats_push(&stats, values[n++]);
+	while (igt_bench_unstable(&stats, &s) && n < ARRAY_SIZE(values));
+
+	igt_assert_eq(s.rejected, 1);
+	igt_assert_eq(stats.n_values, n - 1);
+	igt_assert(stats.values_u64[0] == 10);
+	igt_assert(s.ci <= s.target);
+
+	igt_stats_fini(&stats);
+}
+
+static void test_max_rounds(void)
+{
+	struct igt_bench_stability s = {
+		.target = 0.001, .min_rounds = 2, .max_rounds = 10,
+	};
+	igt_stats_t stats;
+	unsigned int n = 0;
+
+	igt_stats_init(&stats);
+	do
+		igt_stats_push(&stats, n++ & 1 ? 1 : 100);
+	while (igt_bench_unstable(&stats, &s));
+
+	igt_assert_eq(n, 10);
+	igt_assert(s.ci > s.target);
+
+	igt_stats_fini(&stats);
+}
+
+igt_simple_main
+{
+	test_ci();
+	test_min_rounds();
+	test_warmup();
+	test_max_rounds();
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_event_loop.h"
+
+struct reader {
+	struct igt_event_loop *loop;
+	int count;
+	bool remove;
+	bool done;
+};
+
+static void read_byte(int fd, void *data)
+{
+	struct reader *r = data;
+	char c;
+
+	igt_assert_eq(read(fd, &c, 1), 1);
+	r->count++;
+	r->done = true;
+
+	if (r->remove)
+		igt_event_loop_remove_fd(r->loop, fd);
+}
+
+static void test_dispatch(void)
+{
+	struct igt_event_loop *loop = igt_event_loop_create();
+	struct reader a = {}, b = {};
+	int pa[2], pb[2];
+
+	igt_assert_eq(pipe(pa), 0);
+	igt_assert_eq(pipe(pb), 0);
+	igt_event_loop_add_fd(loop, pa[0], read_byte, &a);
+	igt_event_loop_add_fd(loop, pb[0], read_byte, &b);
+
+	igt_assert_eq(igt_event_loop_dispatch(loop, 0), 0);
+
+	igt_assert_eq(write(pa[1], "x", 1), 1);
+	igt_assert_eq(igt_event_loop_dispatch(loop, 1000), 1);
+	igt_assert_eq(a.count, 1);
+	igt_assert_eq(b.count, 0);
+
+	igt_assert_eq(write(pa[1], "x", 1), 1);
+	igt_assert_eq(write(pb[1], "x", 1), 1);
+	igt_assert_eq(igt_event_loop_dispatch(loop, 1000), 2);
+	igt_assert_eq(a.count, 2);
+	igt_assert_eq(b.count, 1);
+
+	igt_event_loop_destroy(loop);
+	for (int i = 0; i < 2; i++) {
+		close(pa[i]);
+		close(pb[i]);
+	}
+}
+
+static void test_remove(void)
+{
+	struct igt_event_loop *loop = igt_event_loop_create();
+	struct reader r = { .loop = loop, .remove = true };
+	int p[2];
+
+	igt_assert_eq(pipe(p), 0);
+	igt_event_loop_add_fd(loop, p[0], read_byte, &r);
+
+	/* The callback removes its own fd, further data is not dispatched */
+	igt_assert_eq(write(p[1], "xx", 2), 2);
+	igt_assert_eq(igt_event_loop_dispatch(loop, 1000), 1);
+	igt_assert_eq(igt_event_loop_dispatch(loop, 0), 0);
+	igt_assert_eq(r.count, 1);
+
+	/* The same fd can be added again after removal */
+	r.remove = false;
+	igt_event_loop_add_fd(loop, p[0], read_byte, &r);
+	igt_assert_eq(igt_event_loop_dispatch(loop, 1000), 1);
+	igt_assert_eq(r.count, 2);
+	igt_event_loop_remove_fd(loop, p[0]);
+
+	igt_event_loop_destroy(loop);
+	close(p[0]);
+	close(p[1]);
+}
+
+static void test_run_until(void)
+{
+	struct igt_event_loop *loop = igt_event_loop_create();
+	struct reader r = {};
+	struct timespec start = {};
+	int p[2];
+
+	igt_assert_eq(pipe(p), 0);
+	igt_event_loop_add_fd(loop, p[0], read_byte, &r);
+
+	/* Nothing arrives: waits for the full timeout */
+	igt_nsec_elapsed(&start);
+	igt_assert(!igt_event_loop_run_until(loop, &r.done, 100));
+	igt_assert(igt_nsec_elapsed(&start) >= 90ull * 1000 * 1000);
+
+	/* Returns as soon as the flag is set, not after the timeout */
+	igt_assert_eq(write(p[1], "x", 1), 1);
+	memset(&start, 0, sizeof(start));
+	igt_nsec_elapsed(&start);
+	igt_assert(igt_event_loop_run_until(loop, &r.done, 10000));
+	igt_assert(igt_nsec_elapsed(&start) < 5000ull * 1000 * 1000);
+
+	/* Without a flag all events within the timeout are dispatched */
+	igt_assert_eq(write(p[1], "xxx", 3), 3);
+	igt_assert(!igt_event_loop_run_until(loop, NULL, 100));
+	igt_assert_eq(r.count, 4);
+
+	igt_event_loop_destroy(loop);
+	close(p[0]);
+	close(p[1]);
+}
+
+igt_simple_main
+{
+	test_dispatch();
+	test_remove();
+	test_run_until();
+}
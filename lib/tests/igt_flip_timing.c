@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "igt_core.h"
+#include "igt_flip_timing.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
+
+static void test_frame_ns(void)
+{
+	/* CEA 1080p60 */
+	drmModeModeInfo mode = {
+		.clock = 148500, .htotal = 2200, .vtotal = 1125,
+	};
+	igt_flip_timing_t t;
+
+	igt_flip_timing_init(&t, &mode);
+	igt_assert_eq(t.frame_ns, 16666666);
+	igt_flip_timing_fini(&t);
+
+	igt_flip_timing_init(&t, NULL);
+	igt_assert_eq(t.frame_ns, 0);
+	igt_flip_timing_fini(&t);
+}
+
+static void test_missed(void)
+{
+	static const unsigned int seqs[] = { 10, 11, 12, 14, 15, 19, 20 };
+	igt_flip_timing_t t;
+
+	igt_flip_timing_init(&t, NULL);
+	for (int i = 0; i < ARRAY_SIZE(seqs); i++)
+		igt_flip_timing_event(&t, seqs[i], 1, seqs[i] * 10000);
+
+	igt_assert_eq(t.flips, ARRAY_SIZE(seqs));
+	igt_assert_eq(t.missed, 1 + 3);
+	igt_assert_eq(t.interval.n_values, 4);
+	igt_assert_eq(igt_stats_get_min(&t.interval), 10000000);
+	igt_assert_eq(igt_stats_get_max(&t.interval), 10000000);
+	igt_assert_eq_double(igt_flip_timing_jitter(&t), 0);
+
+	/* no submissions, no latencies */
+	igt_assert_eq(t.latency.n_values, 0);
+
+	igt_flip_timing_fini(&t);
+}
+
+static void test_wraparound(void)
+{
+	igt_flip_timing_t t;
+
+	igt_flip_timing_init(&t, NULL);
+	igt_flip_timing_event(&t, 0xffffffff, 1, 0);
+	igt_flip_timing_event(&t, 0, 1, 1000);
+	igt_flip_timing_event(&t, 2, 1, 2000);
+
+	igt_assert_eq(t.missed, 1);
+	igt_assert_eq(t.interval.n_values, 1);
+
+	igt_flip_timing_fini(&t);
+}
+
+static void test_latency(void)
+{
+	igt_flip_timing_t t;
+	struct timespec now;
+
+	igt_flip_timing_init(&t, NULL);
+
+	igt_flip_timing_submit(&t);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	igt_flip_timing_event(&t, 1, now.tv_sec + 1, now.tv_nsec / 1000);
+
+	/* an event without a submission doesn't count */
+	igt_flip_timing_event(&t, 2, now.tv_sec + 2, 0);
+
+	igt_assert_eq(t.latency.n_values, 1);
+	igt_assert_lte(1000000000 - 1000, igt_stats_get_min(&t.latency));
+	igt_assert_lt(igt_stats_get_min(&t.latency), 1100000000);
+
+	igt_flip_timing_fini(&t);
+}
+
+igt_simple_main
+{
+	test_frame_ns();
+	test_missed();
+	test_wraparound();
+	test_latency();
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "igt_map.h"
+#include "igt_rand.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
+
+#define NODES 4096
+
+struct item {
+	struct igt_map_node node;
+	bool present;
+};
+
+static void test_basic(void)
+{
+	struct item a = { .node.key = 1 }, b = { .node.key = 2 };
+	struct item dup = { .node.key = 1 };
+	struct igt_map map;
+
+	igt_map_init(&map);
+	igt_assert(!igt_map_find(&map, 1));
+	igt_assert(!igt_map_remove(&map, 1));
+
+	igt_assert(!igt_map_insert(&map, &a.node));
+	igt_assert(!igt_map_insert(&map, &b.node));
+	igt_assert(igt_map_insert(&map, &dup.node) == &a.node);
+	igt_assert_eq(igt_map_count(&map), 2);
+
+	igt_assert(igt_map_find(&map, 1) == &a.node);
+	igt_assert(igt_map_find(&map, 2) == &b.node);
+	igt_assert(!igt_map_find(&map, 3));
+
+	igt_assert(igt_map_remove(&map, 1) == &a.node);
+	igt_assert(!igt_map_find(&map, 1));
+	igt_assert(igt_map_find(&map, 2) == &b.node);
+	igt_assert_eq(igt_map_count(&map), 1);
+
+	igt_map_fini(&map);
+	igt_assert_eq(igt_map_count(&map), 0);
+}
+
+/* Sequential keys, like GEM handles, are spread out and all retrievable */
+static void test_sequential(void)
+{
+	static struct item items[NODES];
+	struct igt_map map = {};
+
+	for (int n = 0; n < NODES; n++) {
+		items[n].node.key = n;
+		igt_assert(!igt_map_insert(&map, &items[n].node));
+	}
+	igt_assert_eq(igt_map_count(&map), NODES);
+
+	for (int n = 0; n < NODES; n += 2)
+		igt_assert(igt_map_remove(&map, n) == &items[n].node);
+
+	for (int n = 0; n < NODES; n++)
+		igt_assert(igt_map_find(&map, n) ==
+			   (n & 1 ? &items[n].node : NULL));
+
+	igt_map_fini(&map);
+}
+
+/* Random operations checked against which nodes should be present */
+static void test_random(void)
+{
+	static struct item items[NODES];
+	struct igt_map_node *node;
+	struct igt_map map = {};
+	unsigned int count = 0, i;
+	uint32_t prng = 0x12345678;
+
+	for (int n = 0; n < NODES; n++) {
+		items[n].node.key = (uint64_t)hars_petruska_f54_1_random(&prng) << 32 | n;
+		items[n].present = false;
+	}
+
+	for (int pass = 0; pass < 64 * NODES; pass++) {
+		struct item *it = &items[hars_petruska_f54_1_random(&prng) % NODES];
+
+		switch (hars_petruska_f54_1_random(&prng) % 3) {
+		case 0:
+			igt_assert(igt_map_insert(&map, &it->node) ==
+				   (it->present ? &it->node : NULL));
+			if (!it->present)
+				count++;
+			it->present = true;
+			break;
+		case 1:
+			igt_assert(igt_map_remove(&map, it->node.key) ==
+				   (it->present ? &it->node : NULL));
+			if (it->present)
+				count--;
+			it->present = false;
+			break;
+		case 2:
+			igt_assert(igt_map_find(&map, it->node.key) ==
+				   (it->present ? &it->node : NULL));
+			break;
+		}
+
+		igt_assert_eq(igt_map_count(&map), count);
+	}
+
+	for (int n = 0; n < NODES; n++)
+		igt_assert(igt_map_find(&map, items[n].node.key) ==
+			   (items[n].present ? &items[n].node : NULL));
+
+	igt_map_for_each(&map, i, node) {
+		struct item *it = container_of(node, it, node);
+
+		igt_assert(it->present);
+		count--;
+	}
+	igt_assert_eq(count, 0);
+
+	igt_map_fini(&map);
+}
+
+static uint64_t evicted[8];
+static int num_evicted;
+
+static void record_evict(struct igt_lru *lru, struct igt_lru_node *node)
+{
+	igt_assert(num_evicted < ARRAY_SIZE(evicted));
+	evicted[num_evicted++] = node->map.key;
+}
+
+static void test_lru(void)
+{
+	struct igt_lru_node nodes[6] = {};
+	struct igt_lru lru;
+
+	for (int n = 0; n < ARRAY_SIZE(nodes); n++)
+		nodes[n].map.key = n;
+
+	num_evicted = 0;
+	igt_lru_init(&lru, 4, record_evict);
+
+	for (int n = 0; n < 4; n++)
+		igt_assert(!igt_lru_insert(&lru, &nodes[n]));
+	igt_assert(igt_lru_insert(&lru, &nodes[0]) == &nodes[0]);
+	igt_assert_eq(igt_lru_count(&lru), 4);
+	igt_assert_eq(num_evicted, 0);
+
+	/* Using 0 leaves 1 as the least recently used */
+	igt_assert(igt_lru_find(&lru, 0) == &nodes[0]);
+	igt_assert(!igt_lru_insert(&lru, &nodes[4]));
+	igt_assert_eq(num_evicted, 1);
+	igt_assert_eq(evicted[0], 1);
+	igt_assert(!igt_lru_find(&lru, 1));
+
+	/* Removal doesn't count as eviction */
+	igt_lru_remove(&lru, &nodes[2]);
+	igt_assert_eq(num_evicted, 1);
+	igt_assert(!igt_lru_find(&lru, 2));
+	igt_assert(!igt_lru_insert(&lru, &nodes[5]));
+	igt_assert_eq(num_evicted, 1);
+
+	/* Left from least to most recently used: 3, 0, 4, 5 */
+	igt_lru_fini(&lru);
+	igt_assert_eq(num_evicted, 5);
+	igt_assert_eq(evicted[1], 3);
+	igt_assert_eq(evicted[2], 0);
+	igt_assert_eq(evicted[3], 4);
+	igt_assert_eq(evicted[4], 5);
+}
+
+igt_simple_main
+{
+	test_basic();
+	test_sequential();
+	test_random();
+	test_lru();
+}
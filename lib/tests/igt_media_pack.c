@@ -0,0 +1,147 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <string.h>
+
+#include "igt_core.h"
+#include "media_pack.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
+
+/*
+ * The expected dwords are the ones gpu_cmds.c used to emit dword by
+ * dword with OUT_BATCH().
+ */
+
+#define check_pack(cmd, expected, ...) do {				\
+	uint32_t dw[cmd##_length + 1];					\
+									\
+	igt_assert_eq(ARRAY_SIZE(expected), cmd##_length);		\
+	memset(dw, 0xc5, sizeof(dw));					\
+	igt_assert(cmd##_pack(dw, &(const struct cmd){ __VA_ARGS__ }) ==	\
+		   dw + cmd##_length);					\
+	for (int i = 0; i < cmd##_length; i++)				\
+		igt_assert_f(dw[i] == expected[i],			\
+			     #cmd " dword %d: %08x, expected %08x\n",	\
+			     i, dw[i], expected[i]);			\
+	igt_assert_eq_u32(dw[cmd##_length], 0xc5c5c5c5);		\
+} while (0)
+
+static void test_vfe_state(void)
+{
+	const uint32_t gen7[] = {
+		GEN7_MEDIA_VFE_STATE | (8 - 2), 0,
+		60 << 16 | 2 << 8 | 1 << 2, 0,
+		2 << 16 | 2, 0, 0, 0,
+	};
+	const uint32_t gen8[] = {
+		GEN8_MEDIA_VFE_STATE | (9 - 2), 0, 0,
+		1 << 16 | 2 << 8, 0,
+		2 << 16 | 2, 0, 0, 0,
+	};
+
+	check_pack(gen7_media_vfe_state, gen7,
+		   .max_threads = 60, .urb_entries = 2, .gpgpu_mode = 1,
+		   .urb_entry_size = 2, .curbe_size = 2);
+	check_pack(gen8_media_vfe_state, gen8,
+		   .max_threads = 1, .urb_entries = 2,
+		   .urb_entry_size = 2, .curbe_size = 2);
+}
+
+static void test_loads(void)
+{
+	const uint32_t curbe[] = {
+		GEN7_MEDIA_CURBE_LOAD | (4 - 2), 0, 64, 0x1040,
+	};
+	const uint32_t idl[] = {
+		GEN7_MEDIA_INTERFACE_DESCRIPTOR_LOAD | (4 - 2), 0, 32, 0x1080,
+	};
+
+	check_pack(gen7_media_curbe_load, curbe,
+		   .total_length = 64, .start_address = 0x1040);
+	check_pack(gen7_media_interface_descriptor_load, idl,
+		   .total_length = 32, .start_address = 0x1080);
+}
+
+static void test_media_object(void)
+{
+	const uint32_t object[] = {
+		GEN7_MEDIA_OBJECT | (8 - 2), 0, 0, 0, 0, 0, 48, 16,
+	};
+	const uint32_t flush[] = {
+		GEN8_MEDIA_STATE_FLUSH | (2 - 2), 0,
+	};
+
+	check_pack(gen7_media_object, object, .inline_data = { 48, 16 });
+	check_pack(gen8_media_state_flush, flush, .interface_descriptor_offset = 0);
+}
+
+static void test_gpgpu_walker(void)
+{
+	const uint32_t gen7[] = {
+		GEN7_GPGPU_WALKER | 9, 0, 1 << 30,
+		0, 4, 0, 64, 0, 1,
+		0x7, 0xffffffff,
+	};
+	const uint32_t gen8[] = {
+		GEN7_GPGPU_WALKER | 13, 0, 0, 0, 1 << 30,
+		0, 0, 4, 0, 0, 64, 0, 1,
+		0x7, 0xffffffff,
+	};
+
+	check_pack(gen7_gpgpu_walker, gen7,
+		   .simd_size = GEN7_GPGPU_SIMD16,
+		   .group_x_dim = 4, .group_y_dim = 64, .group_z_dim = 1,
+		   .right_mask = 0x7, .bottom_mask = 0xffffffff);
+	check_pack(gen8_gpgpu_walker, gen8,
+		   .simd_size = GEN7_GPGPU_SIMD16,
+		   .group_x_dim = 4, .group_y_dim = 64, .group_z_dim = 1,
+		   .right_mask = 0x7, .bottom_mask = 0xffffffff);
+}
+
+/* Values too wide for their field don't spill over into the next ones */
+static void test_field_overflow(void)
+{
+	uint32_t dw[gen7_gpgpu_walker_length];
+
+	gen7_gpgpu_walker_pack(dw, &(const struct gen7_gpgpu_walker) {
+		.simd_size = 0x7,
+		.thread_width_max = 0xff,
+	});
+	igt_assert_eq_u32(dw[2], 0x3u << 30 | 0x3f);
+
+	igt_assert_eq_u32(__gen_mask(0, 31), 0xffffffff);
+	igt_assert_eq_u32(__gen_mask(8, 15), 0xff00);
+	igt_assert_eq_u32(__gen_uint(0x1ff, 8, 15), 0xff00);
+}
+
+igt_simple_main
+{
+	test_vfe_state();
+	test_loads();
+	test_media_object();
+	test_gpgpu_walker();
+	test_field_overflow();
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <pthread.h>
+
+#include "igt_core.h"
+#include "igt_primes.h"
+
+static bool is_prime(unsigned long x)
+{
+	if (x < 2)
+		return false;
+
+	for (unsigned long y = 2; y <= x / y; y++)
+		if (x % y == 0)
+			return false;
+
+	return true;
+}
+
+static unsigned long slow_next_prime(unsigned long x)
+{
+	while (!is_prime(++x))
+		;
+
+	return x;
+}
+
+/* Across the small table, the first segments of the sieve and their ends */
+static void test_sequence(void)
+{
+	unsigned long last = 1;
+	unsigned long n = 0;
+
+	for_each_prime_number(prime, 30000) {
+		if (!n++) {
+			igt_assert_eq(prime, 1);
+			continue;
+		}
+
+		igt_assert_f(prime == slow_next_prime(last),
+			     "%lu follows %lu, expected %lu\n",
+			     prime, last, slow_next_prime(last));
+		last = prime;
+	}
+}
+
+/* Jumping well past the sieve, then back below it */
+static void test_jumps(void)
+{
+	static const unsigned long x[] = {
+		1020, 1021, 1 << 20, 100000000, 262143, 262144, 3,
+	};
+
+	for (int i = 0; i < sizeof(x) / sizeof(x[0]); i++)
+		igt_assert_eq_u64(igt_next_prime_number(x[i]),
+			      slow_next_prime(x[i]));
+}
+
+static void *thread(void *arg)
+{
+	unsigned long x = (unsigned long)arg;
+
+	for (int i = 0; i < 1000; i++, x += 9973)
+		igt_assert_eq_u64(igt_next_prime_number(x), slow_next_prime(x));
+
+	return NULL;
+}
+
+/* Threads growing the sieve under each other */
+static void test_threads(void)
+{
+	pthread_t threads[4];
+
+	for (long i = 0; i < 4; i++)
+		pthread_create(&threads[i], NULL, thread,
+			       (void *)(200000000 + i * 10000000));
+
+	for (int i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+}
+
+igt_simple_main
+{
+	test_sequence();
+	test_jumps();
+	test_threads();
+
+	igt_fork(child, 2)
+		test_sequence();
+	igt_waitchildren();
+}
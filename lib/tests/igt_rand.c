@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "igt_rand.h"
+
+#define SIZE 4096
+
+/* The stream is part of the interface, checks may regenerate it */
+static void test_known_values(void)
+{
+	static const struct {
+		int index;
+		uint32_t value;
+	} expected[] = {
+		{ 0, 0x9d9452c1 },
+		{ 1, 0xa9504807 },
+		{ 7, 0x80d85f77 },
+		{ 8, 0x6909d440 },
+		{ 9, 0x476e943a },
+	};
+	uint32_t buf[10];
+
+	igt_random_fill(buf, sizeof(buf), 42);
+
+	for (int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+		igt_assert_eq_u32(buf[expected[i].index], expected[i].value);
+}
+
+static void test_reproducible(void)
+{
+	uint8_t *a = malloc(SIZE), *b = malloc(SIZE);
+
+	igt_assert(a && b);
+
+	igt_random_fill(a, SIZE, 1);
+	igt_random_fill(b, SIZE, 1);
+	igt_assert(memcmp(a, b, SIZE) == 0);
+
+	igt_random_fill(b, SIZE, 2);
+	igt_assert(memcmp(a, b, SIZE) != 0);
+
+	free(a);
+	free(b);
+}
+
+/* Any shorter length and any alignment give a prefix of the same stream */
+static void test_prefix(void)
+{
+	uint8_t ref[SIZE], buf[SIZE + 8];
+
+	igt_random_fill(ref, sizeof(ref), 7);
+
+	for (int len = 0; len < 100; len++) {
+		for (int offset = 0; offset < 8; offset++) {
+			memset(buf, 0xc5, sizeof(buf));
+			igt_random_fill(buf + offset, len, 7);
+
+			igt_assert(memcmp(buf + offset, ref, len) == 0);
+			for (int i = 0; i < offset; i++)
+				igt_assert_eq(buf[i], 0xc5);
+			igt_assert_eq(buf[offset + len], 0xc5);
+		}
+	}
+}
+
+/* Every bit should be set in about half of the dwords */
+static void test_distribution(void)
+{
+	uint32_t buf[SIZE];
+	int count[32] = {};
+
+	igt_random_fill(buf, sizeof(buf), 0);
+
+	for (int n = 0; n < SIZE; n++)
+		for (int bit = 0; bit < 32; bit++)
+			count[bit] += (buf[n] >> bit) & 1;
+
+	for (int bit = 0; bit < 32; bit++) {
+		igt_assert_f(count[bit] > SIZE / 2 - SIZE / 16 &&
+			     count[bit] < SIZE / 2 + SIZE / 16,
+			     "bit %d set %d times out of %d\n",
+			     bit, count[bit], SIZE);
+	}
+}
+
+igt_simple_main
+{
+	test_known_values();
+	test_reproducible();
+	test_prefix();
+	test_distribution();
+}
@@ -96,6 +96,39 @@ static int do_fork(void)
 	}
 }
 
+static int do_fork_scaled(void)
+{
+	int pid, status;
+	int argc = 1;
+
+	switch (pid = fork()) {
+	case -1:
+		internal_assert(0);
+	case 0:
+		igt_subtest_init(argc, argv_run);
+
+		igt_subtest("scale") {
+			igt_assert_eq(igt_simulation_scaled(100),
+				      100 / igt_simulation_scale());
+			igt_assert_eq(igt_simulation_scaled(1), 1);
+			igt_assert_eq(igt_simulation_scaled(0), 0);
+		}
+
+		igt_subtest("foo")
+			;
+
+		igt_exit();
+	default:
+		while (waitpid(pid, &status, 0) == -1 &&
+		       errno == EINTR)
+			;
+
+		internal_assert(WIFEXITED(status));
+
+		return status;
+	}
+}
+
 int main(int argc, char **argv)
 {
 	/* simple tests */
@@ -167,5 +200,20 @@ int main(int argc, char **argv)
 	internal_assert(WEXITSTATUS(do_fork()) == IGT_EXIT_SUCCESS);
 
 
+	/* scaling and skip list */
+	internal_assert(setenv("INTEL_SIMULATION_SCALE", "4", 1) == 0);
+	internal_assert(setenv("INTEL_SIMULATION", "1", 1) == 0);
+	internal_assert(WEXITSTATUS(do_fork_scaled()) == IGT_EXIT_SUCCESS);
+
+	internal_assert(setenv("INTEL_SIMULATION_SKIP", "foo", 1) == 0);
+	internal_assert(WEXITSTATUS(do_fork_scaled()) == IGT_EXIT_SUCCESS);
+
+	internal_assert(setenv("INTEL_SIMULATION_SKIP", "*", 1) == 0);
+	internal_assert(WEXITSTATUS(do_fork_scaled()) == IGT_EXIT_SKIP);
+
+	internal_assert(setenv("INTEL_SIMULATION", "0", 1) == 0);
+	internal_assert(WEXITSTATUS(do_fork_scaled()) == IGT_EXIT_SUCCESS);
+
+
 	return 0;
 }
@@ -120,6 +120,35 @@ static void test_quartiles(void)
 	igt_stats_fini(&stats);
 }
 
+static void test_percentile(void)
+{
+	static const uint64_t s1[] =
+		{ 47, 49, 6, 7, 15, 36, 39, 40, 41, 42, 43 };
+	static const uint64_t s2[] = { 40, 41, 7, 15, 36, 39 };
+	igt_stats_t stats;
+
+	igt_stats_init(&stats);
+	igt_stats_push_array(&stats, s1, ARRAY_SIZE(s1));
+
+	igt_assert_eq_double(igt_stats_get_percentile(&stats, 0), 6);
+	igt_assert_eq_double(igt_stats_get_percentile(&stats, 50), 40);
+	igt_assert_eq_double(igt_stats_get_percentile(&stats, 90), 47);
+	igt_assert_eq_double(igt_stats_get_percentile(&stats, 95), 48);
+	igt_assert_eq_double(igt_stats_get_percentile(&stats, 100), 49);
+
+	igt_stats_fini(&stats);
+
+	igt_stats_init(&stats);
+	igt_stats_push_array(&stats, s2, ARRAY_SIZE(s2));
+
+	igt_assert_eq_double(igt_stats_get_percentile(&stats, 10), 11);
+	igt_assert_eq_double(igt_stats_get_percentile(&stats, 20), 15);
+	igt_assert_eq_double(igt_stats_get_percentile(&stats, 50),
+			     igt_stats_get_median(&stats));
+
+	igt_stats_fini(&stats);
+}
+
 static void test_invalidate_sorted(void)
 {
 	igt_stats_t stats;
@@ -228,6 +257,122 @@ static void test_reallocation(void)
 	igt_stats_fini(&stats);
 }
 
+static void test_histogram(void)
+{
+	struct igt_histogram h, other;
+	igt_stats_t stats;
+
+	igt_histogram_init(&h);
+	igt_histogram_init(&other);
+	igt_stats_init(&stats);
+
+	igt_assert_eq_double(igt_histogram_get_median(&h), 0.);
+
+	/* In increasing order, half in each histogram, over 40 bits */
+	for (uint64_t v = 1; v < 1ull << 40; v += v / 16 + 1) {
+		igt_histogram_add(v & 1 ? &h : &other, v);
+		igt_stats_push(&stats, v);
+	}
+	igt_histogram_merge(&h, &other);
+
+	igt_assert_eq(igt_histogram_get_count(&h), stats.n_values);
+	igt_assert_eq(igt_histogram_get_min(&h), igt_stats_get_min(&stats));
+	igt_assert_eq(igt_histogram_get_max(&h), igt_stats_get_max(&stats));
+	igt_assert_eq_double(igt_histogram_get_percentile(&h, 100),
+			     igt_stats_get_max(&stats));
+
+	for (double p = 5; p < 100; p += 5) {
+		uint64_t rank = ceil(p / 100 * stats.n_values);
+		double exact = stats.values_u64[rank - 1];
+		double approx = igt_histogram_get_percentile(&h, p);
+
+		igt_assert_f(fabs(approx - exact) <= exact / 256,
+			     "p%.0f: %f, expected %f\n", p, approx, exact);
+	}
+
+	igt_assert_f(fabs(igt_histogram_get_iqm(&h) - igt_stats_get_iqm(&stats)) <=
+		     igt_stats_get_iqm(&stats) / 256,
+		     "iqm: %f, expected %f\n",
+		     igt_histogram_get_iqm(&h), igt_stats_get_iqm(&stats));
+
+	igt_stats_fini(&stats);
+	igt_histogram_fini(&other);
+	igt_histogram_fini(&h);
+}
+
+static void test_merge(void)
+{
+	struct igt_mean all, half[2];
+	struct igt_thread_stats *t;
+	struct igt_histogram hist;
+	igt_stats_t stats, other;
+
+	igt_mean_init(&all);
+	igt_mean_init(&half[0]);
+	igt_mean_init(&half[1]);
+	t = igt_thread_stats_create(3);
+	igt_assert(((uintptr_t)&t[1] & 63) == 0);
+
+	for (unsigned int v = 0; v < 100; v++) {
+		igt_mean_add(&all, v * v);
+		igt_mean_add(&half[v < 30], v * v);
+		igt_thread_stats_add(&t[v % 3], v);
+	}
+
+	igt_mean_merge(&half[0], &half[1]);
+	igt_assert_eq(half[0].count, all.count);
+	igt_assert(fabs(igt_mean_get(&half[0]) - igt_mean_get(&all)) < 1e-9);
+	igt_assert(fabs(igt_mean_get_variance(&half[0]) /
+			igt_mean_get_variance(&all) - 1) < 1e-9);
+
+	igt_mean_init(&all);
+	igt_histogram_init(&hist);
+	igt_thread_stats_merge(t, 3, &all, &hist);
+	igt_assert_eq_double(igt_mean_get(&all), 49.5);
+	igt_assert_eq_double(all.min, 0);
+	igt_assert_eq_double(all.max, 99);
+	igt_assert_eq(igt_histogram_get_count(&hist), 100);
+	igt_assert_eq_double(igt_histogram_get_median(&hist), 49);
+	igt_histogram_fini(&hist);
+	igt_thread_stats_destroy(t, 3);
+
+	igt_stats_init(&stats);
+	igt_stats_init(&other);
+	push_fixture_1(&stats);
+	push_fixture_1(&other);
+	igt_stats_merge(&stats, &other);
+	igt_assert_eq(stats.n_values, 10);
+	igt_assert_eq_double(igt_stats_get_mean(&stats), 6.0);
+	igt_stats_fini(&other);
+	igt_stats_fini(&stats);
+}
+
+static void test_child_results(void)
+{
+	struct igt_child_results *results;
+	igt_stats_t stats;
+
+	results = igt_child_results_create(4, 2);
+
+	igt_fork_pinned(child, 4) {
+		double *values = igt_child_results_get(results, child);
+
+		values[0] = child;
+		values[1] = 1;
+	}
+	igt_waitchildren();
+
+	igt_assert_eq_double(igt_child_results_sum(results, 0), 6.0);
+	igt_assert_eq_double(igt_child_results_sum(results, 1), 4.0);
+
+	igt_child_results_stats(results, 0, &stats);
+	igt_assert_eq(stats.n_values, 4);
+	igt_assert_eq_double(igt_stats_get_median(&stats), 1.5);
+	igt_stats_fini(&stats);
+
+	igt_child_results_destroy(results);
+}
+
 igt_simple_main
 {
 	test_init_zero();
@@ -235,9 +380,13 @@ igt_simple_main
 	test_min_max();
 	test_range();
 	test_quartiles();
+	test_percentile();
 	test_invalidate_sorted();
 	test_mean();
 	test_invalidate_mean();
 	test_std_deviation();
 	test_reallocation();
+	test_histogram();
+	test_merge();
+	test_child_results();
 }
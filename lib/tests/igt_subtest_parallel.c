@@ -0,0 +1,169 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#include <sys/wait.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "drmtest.h"
+#include "igt_tests_common.h"
+
+static void fake_main(int argc, char **argv)
+{
+	igt_subtest_init(argc, argv);
+
+	igt_subtest_parallel("slow-a")
+		usleep(500 * 1000);
+
+	igt_subtest_parallel("slow-b")
+		usleep(500 * 1000);
+
+	igt_subtest_parallel("skip")
+		igt_skip("skipping\n");
+
+	igt_subtest_parallel("fail")
+		igt_fail(IGT_EXIT_FAILURE);
+
+	igt_subtest("serial")
+		;
+
+	igt_exit();
+}
+
+static void read_whole_pipe(int fd, char *buf, size_t buflen)
+{
+	ssize_t readlen;
+	off_t offset;
+
+	offset = 0;
+	while ((readlen = read(fd, buf + offset, buflen - offset - 1))) {
+		if (readlen == -1) {
+			if (errno == EINTR)
+				continue;
+
+			printf("read failed with %s\n", strerror(errno));
+			exit(1);
+		}
+		offset += readlen;
+	}
+	buf[offset] = '\0';
+}
+
+static pid_t do_fork(int argc, char **argv, int *out)
+{
+	int outfd[2];
+	pid_t pid;
+
+	internal_assert(pipe(outfd) != -1);
+
+	pid = fork();
+	internal_assert(pid != -1);
+
+	if (pid == 0) {
+		while (dup2(outfd[1], STDOUT_FILENO) == -1 && errno == EINTR) {}
+
+		close(outfd[0]);
+		close(outfd[1]);
+
+		fake_main(argc, argv);
+
+		exit(-1);
+	}
+
+	close(outfd[1]);
+	*out = outfd[0];
+
+	return pid;
+}
+
+static int _wait(pid_t pid, int *status)
+{
+	int ret;
+
+	do {
+		ret = waitpid(pid, status, 0);
+	} while (ret == -1 && errno == EINTR);
+
+	return ret;
+}
+
+/* Checks that each of @lines is found in @out, after the one before */
+static void assert_in_order(const char *out, const char * const *lines)
+{
+	for (; *lines; lines++) {
+		out = strstr(out, *lines);
+		internal_assert(out);
+	}
+}
+
+static double run(const char *jobs)
+{
+	static const char * const lines[] = {
+		"Starting subtest: slow-a",
+		"Subtest slow-a: SUCCESS",
+		"Starting subtest: slow-b",
+		"Subtest slow-b: SUCCESS",
+		"Starting subtest: skip",
+		"Subtest skip: SKIP",
+		"Starting subtest: fail",
+		"Subtest fail: FAIL",
+		"Starting subtest: serial",
+		"Subtest serial: SUCCESS",
+		NULL
+	};
+	char prog[] = "igt_subtest_parallel";
+	char *fake_argv[] = { prog };
+	struct timespec start, end;
+	static char out[16384];
+	int status, outfd;
+	pid_t pid;
+
+	setenv("IGT_SUBTEST_JOBS", jobs, 1);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid = do_fork(ARRAY_SIZE(fake_argv), fake_argv, &outfd);
+	read_whole_pipe(outfd, out, sizeof(out));
+	internal_assert(_wait(pid, &status) != -1);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	close(outfd);
+
+	/* Each subtest's output in one piece, in the order they started */
+	assert_in_order(out, lines);
+	internal_assert_wexited(status, IGT_EXIT_FAILURE);
+
+	return (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+}
+
+int main(int argc, char **argv)
+{
+	/* The slow subtests overlap */
+	internal_assert(run("4") < 0.9);
+
+	/* Or run one after the other */
+	internal_assert(run("1") >= 1.0);
+
+	return 0;
+}
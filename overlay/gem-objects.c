@@ -178,3 +178,40 @@ done:
 
 	return ret;
 }
+
+int gem_objects_copy(struct gem_objects *dst, const struct gem_objects *src)
+{
+	const struct gem_objects_comm *from;
+	struct gem_objects_comm *comm, *freed, **tail;
+	int ret = 0;
+
+	freed = dst->comm;
+	*dst = *src;
+
+	/* Take a deep copy of the per-client list, reusing dst's entries */
+	tail = &dst->comm;
+	for (from = src->comm; from; from = from->next) {
+		comm = freed;
+		if (comm)
+			freed = comm->next;
+		else
+			comm = malloc(sizeof(*comm));
+		if (comm == NULL) {
+			ret = ENOMEM;
+			break;
+		}
+
+		*comm = *from;
+		*tail = comm;
+		tail = &comm->next;
+	}
+	*tail = NULL;
+
+	while (freed) {
+		comm = freed;
+		freed = comm->next;
+		free(comm);
+	}
+
+	return ret;
+}
@@ -41,5 +41,6 @@ struct gem_objects {
 
 int gem_objects_init(struct gem_objects *obj);
 int gem_objects_update(struct gem_objects *obj);
+int gem_objects_copy(struct gem_objects *dst, const struct gem_objects *src);
 
 #endif /* GEM_OBJECTS_H */
@@ -65,10 +65,16 @@ int gpu_freq_init(struct gpu_freq *gf)
 		return gf->error = errno;
 
 	len = read(fd, buf, sizeof(buf)-1);
-	close(fd);
 	if (len < 0)
 		goto err;
 
+	/* Without the PMU, the same file is re-parsed on every update */
+	if (gf->fd < 0)
+		gf->debugfs = fd;
+	else
+		close(fd);
+	fd = -1;
+
 	buf[len] = '\0';
 
 	if (strstr(buf, "PUNIT_REG_GPU_FREQ_STS")) {
@@ -111,6 +117,8 @@ int gpu_freq_init(struct gpu_freq *gf)
 	return 0;
 
 err:
+	if (fd >= 0)
+		close(fd);
 	return gf->error = EIO;
 }
 
@@ -121,19 +129,9 @@ int gpu_freq_update(struct gpu_freq *gf)
 
 	if (gf->fd < 0) {
 		char buf[4096], *s;
-		int fd, len = -1;
-
-		sprintf(buf, "%s/i915_frequency_info", debugfs_dri_path);
-		fd = open(buf, 0);
-		if (fd < 0) {
-			sprintf(buf, "%s/i915_cur_delayinfo", debugfs_dri_path);
-			fd = open(buf, 0);
-		}
-		if (fd < 0)
-			return gf->error = errno;
+		int len;
 
-		len = read(fd, buf, sizeof(buf)-1);
-		close(fd);
+		len = pread(gf->debugfs, buf, sizeof(buf)-1, 0);
 		if (len < 0)
 			return gf->error = EIO;
 
@@ -33,6 +33,7 @@ struct gpu_freq {
 		uint64_t timestamp;
 	} stat[2];
 	int fd;
+	int debugfs;
 	int count;
 	int is_byt;
 	int min, max;
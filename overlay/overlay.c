@@ -36,6 +36,7 @@
 #include <getopt.h>
 #include <time.h>
 #include <locale.h>
+#include <pthread.h>
 
 #include "overlay.h"
 #include "chart.h"
@@ -101,6 +102,7 @@ struct overlay_gpu_top {
 	struct chart busy[MAX_RINGS];
 	struct chart wait[MAX_RINGS];
 	struct chart cpu;
+	int update, cpu_update;
 };
 
 struct overlay_gpu_perf {
@@ -118,6 +120,8 @@ struct overlay_gpu_freq {
 	struct chart request;
 	struct chart power_chart;
 	double power_max;
+	int has_freq, has_rc6, has_power, has_irqs;
+	int fresh;
 };
 
 struct overlay_gem_objects {
@@ -125,6 +129,7 @@ struct overlay_gem_objects {
 	struct chart aperture;
 	struct chart gtt;
 	int error;
+	int fresh;
 };
 
 struct overlay_context {
@@ -138,6 +143,59 @@ struct overlay_context {
 	struct overlay_gpu_perf gpu_perf;
 	struct overlay_gpu_freq gpu_freq;
 	struct overlay_gem_objects gem_objects;
+
+	unsigned int seq;
+};
+
+/*
+ * All the counters are read from a single sampler thread, so that a slow
+ * debugfs read never stalls drawing. Each round is copied into the back half
+ * of a double buffer and published by flipping the front index under the
+ * lock; the render loop copies the front half out at the start of a frame.
+ */
+struct overlay_sample {
+	unsigned int seq;
+
+	int gpu_top_update;
+	int cpu_top_update;
+	struct gpu_top gpu_top;
+	struct cpu_top cpu_top;
+
+	int gpu_freq_update;
+	int rc6_update;
+	int power_update;
+	int irqs_update;
+	struct gpu_freq gpu_freq;
+	struct rc6 rc6;
+	struct power power;
+	struct gem_interrupts irqs;
+
+	int gem_objects_error;
+	struct gem_objects gem_objects;
+};
+
+/* i915_gem_objects walks every object, so only parse it this often (s) */
+#define GEM_OBJECTS_PERIOD 1
+
+struct overlay_sampler {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int period;
+
+	/* Live counter state, only touched by the sampler thread */
+	struct gpu_top gpu_top;
+	struct cpu_top cpu_top;
+	struct gpu_freq gpu_freq;
+	struct rc6 rc6;
+	struct power power;
+	struct gem_interrupts irqs;
+	struct gem_objects gem_objects;
+	int gem_objects_error;
+	time_t gem_objects_time;
+
+	struct overlay_sample sample[2];
+	int front;
+	unsigned int seq;
 };
 
 static void init_gpu_top(struct overlay_context *ctx,
@@ -195,14 +253,14 @@ static void show_gpu_top(struct overlay_context *ctx, struct overlay_gpu_top *gt
 	int rewind;
 	int do_rewind;
 
-	update = gpu_top_update(&gt->gpu_top);
+	update = gt->update;
 
 	cairo_rectangle(ctx->cr, PAD-.5, PAD-.5, ctx->width/2-SIZE_PAD+1, ctx->height/2-SIZE_PAD+1);
 	cairo_set_source_rgb(ctx->cr, .15, .15, .15);
 	cairo_set_line_width(ctx->cr, 1);
 	cairo_stroke(ctx->cr);
 
-	if (update && cpu_top_update(&gt->cpu_top) == 0)
+	if (update && gt->cpu_update == 0)
 		chart_add_sample(&gt->cpu, gt->cpu_top.busy);
 
 	for (n = 0; n < gt->gpu_top.num_rings; n++) {
@@ -576,10 +634,10 @@ static void show_gpu_freq(struct overlay_context *ctx, struct overlay_gpu_freq *
 	char buf[160];
 	int y1, y2, y, len;
 
-	int has_freq = gpu_freq_update(&gf->gpu_freq) == 0;
-	int has_rc6 = rc6_update(&gf->rc6) == 0;
-	int has_power = power_update(&gf->power) == 0;
-	int has_irqs = gem_interrupts_update(&gf->irqs) == 0;
+	int has_freq = gf->has_freq;
+	int has_rc6 = gf->has_rc6;
+	int has_power = gf->has_power;
+	int has_irqs = gf->has_irqs;
 	cairo_pattern_t *linear;
 
 	cairo_rectangle(ctx->cr, PAD-.5, ctx->height/2+HALF_PAD-.5, ctx->width/2-SIZE_PAD+1, ctx->height/2-SIZE_PAD+1);
@@ -599,9 +657,9 @@ static void show_gpu_freq(struct overlay_context *ctx, struct overlay_gpu_freq *
 	}
 
 	if (has_freq) {
-		if (gf->gpu_freq.current)
+		if (gf->fresh && gf->gpu_freq.current)
 			chart_add_sample(&gf->current, gf->gpu_freq.current);
-		if (gf->gpu_freq.request)
+		if (gf->fresh && gf->gpu_freq.request)
 			chart_add_sample(&gf->request, gf->gpu_freq.request);
 
 		chart_draw(&gf->request, ctx->cr);
@@ -609,7 +667,8 @@ static void show_gpu_freq(struct overlay_context *ctx, struct overlay_gpu_freq *
 	}
 
 	if (has_power) {
-		chart_add_sample(&gf->power_chart, gf->power.power_mW);
+		if (gf->fresh)
+			chart_add_sample(&gf->power_chart, gf->power.power_mW);
 		if (gf->power.new_sample) {
 			if (gf->power.power_mW > gf->power_max)
 				gf->power_max = gf->power.power_mW;
@@ -745,8 +804,6 @@ static void show_gem_objects(struct overlay_context *ctx, struct overlay_gem_obj
 	cairo_pattern_t *linear;
 	int x, y, y1, y2;
 
-	if (go->error == 0)
-		go->error = gem_objects_update(&go->gem_objects);
 	if (go->error)
 		return;
 
@@ -755,8 +812,10 @@ static void show_gem_objects(struct overlay_context *ctx, struct overlay_gem_obj
 	cairo_set_line_width(ctx->cr, 1);
 	cairo_stroke(ctx->cr);
 
-	chart_add_sample(&go->gtt, go->gem_objects.total_gtt);
-	chart_add_sample(&go->aperture, go->gem_objects.total_aperture);
+	if (go->fresh) {
+		chart_add_sample(&go->gtt, go->gem_objects.total_gtt);
+		chart_add_sample(&go->aperture, go->gem_objects.total_aperture);
+	}
 
 	chart_draw(&go->gtt, ctx->cr);
 	chart_draw(&go->aperture, ctx->cr);
@@ -804,6 +863,123 @@ static void show_gem_objects(struct overlay_context *ctx, struct overlay_gem_obj
 	}
 }
 
+static void *sampler_thread(void *arg)
+{
+	struct overlay_sampler *s = arg;
+
+	while (1) {
+		/* Only this thread changes front, so no need for the lock here */
+		struct overlay_sample *back = &s->sample[!s->front];
+		time_t now = time(NULL);
+
+		back->gpu_top_update = gpu_top_update(&s->gpu_top);
+		back->cpu_top_update = EAGAIN;
+		if (back->gpu_top_update)
+			back->cpu_top_update = cpu_top_update(&s->cpu_top);
+
+		back->gpu_freq_update = gpu_freq_update(&s->gpu_freq);
+		back->rc6_update = rc6_update(&s->rc6);
+		back->power_update = power_update(&s->power);
+		back->irqs_update = gem_interrupts_update(&s->irqs);
+
+		if (s->gem_objects_error == 0 &&
+		    now - s->gem_objects_time >= GEM_OBJECTS_PERIOD) {
+			s->gem_objects_error = gem_objects_update(&s->gem_objects);
+			s->gem_objects_time = now;
+		}
+
+		back->gpu_top = s->gpu_top;
+		back->cpu_top = s->cpu_top;
+		back->gpu_freq = s->gpu_freq;
+		back->rc6 = s->rc6;
+		back->power = s->power;
+		back->irqs = s->irqs;
+		back->gem_objects_error = s->gem_objects_error;
+		if (back->gem_objects_error == 0)
+			back->gem_objects_error =
+				gem_objects_copy(&back->gem_objects,
+						 &s->gem_objects);
+		back->seq = ++s->seq;
+
+		pthread_mutex_lock(&s->lock);
+		s->front = !s->front;
+		pthread_mutex_unlock(&s->lock);
+
+		usleep(s->period);
+	}
+
+	return NULL;
+}
+
+static int sampler_start(struct overlay_sampler *s,
+			 struct overlay_context *ctx,
+			 int period)
+{
+	memset(s, 0, sizeof(*s));
+	pthread_mutex_init(&s->lock, NULL);
+	s->period = period;
+
+	/* Take over the counters opened by the init_*() functions */
+	s->gpu_top = ctx->gpu_top.gpu_top;
+	s->cpu_top = ctx->gpu_top.cpu_top;
+	s->gpu_freq = ctx->gpu_freq.gpu_freq;
+	s->rc6 = ctx->gpu_freq.rc6;
+	s->power = ctx->gpu_freq.power;
+	s->irqs = ctx->gpu_freq.irqs;
+	s->gem_objects = ctx->gem_objects.gem_objects;
+	s->gem_objects_error = ctx->gem_objects.error;
+
+	return pthread_create(&s->thread, NULL, sampler_thread, s);
+}
+
+static void sampler_read(struct overlay_sampler *s,
+			 struct overlay_context *ctx)
+{
+	const struct overlay_sample *front;
+	int fresh;
+
+	pthread_mutex_lock(&s->lock);
+	front = &s->sample[s->front];
+
+	fresh = front->seq != ctx->seq;
+	ctx->seq = front->seq;
+	if (front->seq == 0) {
+		/* Nothing sampled yet */
+		ctx->gpu_top.update = 0;
+		ctx->gpu_freq.has_freq = 0;
+		ctx->gpu_freq.has_rc6 = 0;
+		ctx->gpu_freq.has_power = 0;
+		ctx->gpu_freq.has_irqs = 0;
+		ctx->gem_objects.fresh = 0;
+		goto unlock;
+	}
+
+	ctx->gpu_top.gpu_top = front->gpu_top;
+	ctx->gpu_top.cpu_top = front->cpu_top;
+	ctx->gpu_top.update = fresh && front->gpu_top_update;
+	ctx->gpu_top.cpu_update = front->cpu_top_update;
+
+	ctx->gpu_freq.gpu_freq = front->gpu_freq;
+	ctx->gpu_freq.rc6 = front->rc6;
+	ctx->gpu_freq.power = front->power;
+	ctx->gpu_freq.irqs = front->irqs;
+	ctx->gpu_freq.has_freq = front->gpu_freq_update == 0;
+	ctx->gpu_freq.has_rc6 = front->rc6_update == 0;
+	ctx->gpu_freq.has_power = front->power_update == 0;
+	ctx->gpu_freq.has_irqs = front->irqs_update == 0;
+	ctx->gpu_freq.fresh = fresh;
+
+	ctx->gem_objects.error = front->gem_objects_error;
+	if (ctx->gem_objects.error == 0)
+		ctx->gem_objects.error =
+			gem_objects_copy(&ctx->gem_objects.gem_objects,
+					 &front->gem_objects);
+	ctx->gem_objects.fresh = fresh;
+
+unlock:
+	pthread_mutex_unlock(&s->lock);
+}
+
 static int take_snapshot;
 
 static void signal_snapshot(int sig)
@@ -857,6 +1033,7 @@ int main(int argc, char **argv)
 		{NULL, 0, 0, 0,}
 	};
 	struct overlay_context ctx;
+	struct overlay_sampler sampler;
 	struct config config;
 	int index, sample_period;
 	int daemonize = 1, renice = 0;
@@ -928,9 +1105,17 @@ int main(int argc, char **argv)
 
 	sample_period = get_sample_period(&config);
 
+	ctx.seq = 0;
+	i = sampler_start(&sampler, &ctx, sample_period);
+	if (i) {
+		fprintf(stderr, "Could not start the sampler: %s\n", strerror(i));
+		return i;
+	}
+
 	i = 0;
 	while (1) {
 		ctx.time = time(NULL);
+		sampler_read(&sampler, &ctx);
 
 		ctx.cr = cairo_create(ctx.surface);
 		cairo_set_operator(ctx.cr, CAIRO_OPERATOR_CLEAR);
@@ -35,32 +35,43 @@
 
 #include "rc6.h"
 
+static const char *sysfs_residency[] = {
+	"/sys/class/drm/card0/power/rc6_residency_ms",
+	"/sys/class/drm/card0/power/rc6p_residency_ms",
+	"/sys/class/drm/card0/power/rc6pp_residency_ms",
+};
+
 int rc6_init(struct rc6 *rc6)
 {
+	int i;
+
 	memset(rc6, 0, sizeof(*rc6));
+	for (i = 0; i < 3; i++)
+		rc6->sysfs[i] = -1;
 
 	rc6->fd = perf_i915_open(I915_PMU_RC6_RESIDENCY);
 	if (rc6->fd < 0) {
 		struct stat st;
 		if (stat("/sys/class/drm/card0/power", &st) < 0)
 			return rc6->error = errno;
+
+		/* Keep the attributes open, they are re-read on every update */
+		for (i = 0; i < 3; i++)
+			rc6->sysfs[i] = open(sysfs_residency[i], O_RDONLY);
 	}
 
 	return 0;
 }
 
-static uint64_t file_to_u64(const char *path)
+static uint64_t fd_to_u64(int fd)
 {
 	char buf[4096];
-	int fd, len;
+	int len;
 
-	fd = open(path, 0);
 	if (fd < 0)
 		return -1;
 
-	len = read(fd, buf, sizeof(buf)-1);
-	close(fd);
-
+	len = pread(fd, buf, sizeof(buf)-1, 0);
 	if (len < 0)
 		return -1;
 
@@ -89,14 +100,12 @@ int rc6_update(struct rc6 *rc6)
 		return rc6->error;
 
 	if (rc6->fd < 0) {
-		struct stat st;
-
-		if (stat("/sys/class/drm/card0/power/rc6_residency_ms", &st) < 0)
+		if (rc6->sysfs[0] < 0)
 			return rc6->error = ENOENT;
 
-		s->rc6_residency = file_to_u64("/sys/class/drm/card0/power/rc6_residency_ms");
-		s->rc6p_residency = file_to_u64("/sys/class/drm/card0/power/rc6p_residency_ms");
-		s->rc6pp_residency = file_to_u64("/sys/class/drm/card0/power/rc6pp_residency_ms");
+		s->rc6_residency = fd_to_u64(rc6->sysfs[0]);
+		s->rc6p_residency = fd_to_u64(rc6->sysfs[1]);
+		s->rc6pp_residency = fd_to_u64(rc6->sysfs[2]);
 		s->timestamp = clock_ms_to_u64();
 	} else {
 		uint64_t data[2];
@@ -36,6 +36,7 @@ struct rc6 {
 	} stat[2];
 
 	int fd;
+	int sysfs[3];
 	int count;
 	int error;
 
@@ -0,0 +1,1125 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "distributed.h"
+#include "resultgen.h"
+
+/*
+ * The protocol is line based, some of the messages being followed by
+ * a payload of the given length:
+ *
+ *   worker:      HELLO <name>
+ *   coordinator: SETTINGS <len>, the contents of metadata.txt
+ *   worker:      NEXT
+ *   coordinator: ENTRY <idx> <timeout> <len>, a line of the job list,
+ *                or DONE when there's nothing left to execute
+ *   worker:      DATA <idx> <file> <len>, appended to that file of the
+ *                test directory, sent while the entry executes
+ *   worker:      ABORT <len>, the contents of aborted.txt
+ *   worker:      FINISHED <idx>
+ *
+ * NEXT is only answered once there is an entry to hand out, or when
+ * the run is over, so that idle workers stay around to pick up the
+ * entries of workers lost mid-run. Those are resumed from the journal
+ * received so far the way igt_resume would resume them.
+ */
+
+#define MSG_MAX 512
+#define CHUNK_SIZE (64 << 10)
+
+static double timeofday_double(void)
+{
+	struct timeval tv;
+
+	if (!gettimeofday(&tv, NULL))
+		return tv.tv_sec + tv.tv_usec / 1000000.0;
+	return 0.0;
+}
+
+static int digits(size_t num)
+{
+	int ret = 0;
+
+	do {
+		num /= 10;
+		ret++;
+	} while (num);
+
+	return ret;
+}
+
+static bool send_all(int sock, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t ret = send(sock, p, len, MSG_NOSIGNAL);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		p += ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static bool __attribute__((format(printf, 4, 5)))
+send_msg(int sock, const void *payload, size_t len, const char *fmt, ...)
+{
+	char line[MSG_MAX];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+	va_end(ap);
+
+	if (n < 0 || n >= sizeof(line) - 1)
+		return false;
+	line[n++] = '\n';
+
+	return send_all(sock, line, n) && send_all(sock, payload, len);
+}
+
+/* Received messages, with the lines split off */
+struct conn {
+	int sock;
+	char buf[4096];
+	size_t len;
+};
+
+static void consume(struct conn *c, size_t len)
+{
+	c->len -= len;
+	memmove(c->buf, c->buf + len, c->len);
+}
+
+static bool recv_more(struct conn *c)
+{
+	ssize_t ret;
+
+	do {
+		ret = recv(c->sock, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret <= 0)
+		return false;
+
+	c->len += ret;
+	return true;
+}
+
+/* Blocks until a whole line has arrived, returned without the newline */
+static bool recv_line(struct conn *c, char *line, size_t size)
+{
+	char *nl;
+
+	while (!(nl = memchr(c->buf, '\n', c->len))) {
+		if (c->len == sizeof(c->buf) || !recv_more(c))
+			return false;
+	}
+
+	if (nl - c->buf >= size)
+		return false;
+
+	memcpy(line, c->buf, nl - c->buf);
+	line[nl - c->buf] = '\0';
+	consume(c, nl - c->buf + 1);
+
+	return true;
+}
+
+static bool recv_payload(struct conn *c, char *buf, size_t len)
+{
+	while (len) {
+		size_t n;
+
+		if (!c->len && !recv_more(c))
+			return false;
+
+		n = len < c->len ? len : c->len;
+		memcpy(buf, c->buf, n);
+		consume(c, n);
+		buf += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+static int listen_on(int port)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+		.ai_flags = AI_PASSIVE,
+	};
+	struct addrinfo *res, *ai;
+	char service[16];
+	int sock = -1;
+
+	snprintf(service, sizeof(service), "%d", port);
+	if (getaddrinfo(NULL, service, &hints, &res)) {
+		fprintf(stderr, "Cannot resolve the coordinator port %d\n", port);
+		return -1;
+	}
+
+	/* Prefer a dual-stack socket when there's one */
+	for (ai = res; ai; ai = ai->ai_next)
+		if (ai->ai_family == AF_INET6)
+			break;
+	if (!ai)
+		ai = res;
+
+	for (; ai; ai = ai->ai_next) {
+		int one = 1, zero = 0;
+
+		sock = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+			      ai->ai_protocol);
+		if (sock < 0)
+			continue;
+
+		setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (ai->ai_family == AF_INET6)
+			setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY,
+				   &zero, sizeof(zero));
+
+		if (!bind(sock, ai->ai_addr, ai->ai_addrlen) &&
+		    !listen(sock, 64))
+			break;
+
+		close(sock);
+		sock = -1;
+	}
+
+	freeaddrinfo(res);
+
+	if (sock < 0)
+		fprintf(stderr, "Cannot listen on port %d: %s\n",
+			port, strerror(errno));
+
+	return sock;
+}
+
+static int connect_to(const char *address)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo *res, *ai;
+	char *host = strdup(address);
+	char *port = strrchr(host, ':');
+	char *h = host;
+	int sock = -1, ret;
+
+	*port++ = '\0';
+
+	/* [addr]:port for IPv6 addresses */
+	if (h[0] == '[' && h[strlen(h) - 1] == ']') {
+		h[strlen(h) - 1] = '\0';
+		h++;
+	}
+
+	ret = getaddrinfo(h, port, &hints, &res);
+	if (ret) {
+		fprintf(stderr, "Cannot resolve %s: %s\n",
+			address, gai_strerror(ret));
+		free(host);
+		return -1;
+	}
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		sock = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+			      ai->ai_protocol);
+		if (sock < 0)
+			continue;
+
+		if (!connect(sock, ai->ai_addr, ai->ai_addrlen))
+			break;
+
+		close(sock);
+		sock = -1;
+	}
+
+	if (sock < 0)
+		fprintf(stderr, "Cannot connect to the coordinator at %s: %s\n",
+			address, strerror(errno));
+
+	freeaddrinfo(res);
+	free(host);
+
+	return sock;
+}
+
+/* Only plain file names go into the test directories */
+static bool valid_filename(const char *name)
+{
+	return name[0] && name[0] != '.' && !strchr(name, '/');
+}
+
+struct remote {
+	struct conn conn;
+	char name[64];
+	/* The entry being executed, -1 for none */
+	ssize_t entry;
+	/* Asked for an entry that hasn't been handed out yet */
+	bool waiting;
+	/* Destination of the payload being received, -1 to drop it */
+	int outfd;
+	size_t payload;
+};
+
+struct coordinator {
+	struct settings *settings;
+	struct job_list *job_list;
+	int resdirfd;
+
+	char *metadata;
+	size_t metadata_len;
+
+	/* Entries left to hand out, those of lost workers first */
+	size_t *queue;
+	size_t head, count;
+	size_t outstanding;
+	size_t finished;
+
+	/* No more entries get handed out after an abort or the timeout */
+	bool stop;
+	bool aborted;
+
+	struct remote **remotes;
+	size_t num_remotes;
+};
+
+static void queue_entry(struct coordinator *co, size_t idx, bool front)
+{
+	if (!front) {
+		co->queue[co->head + co->count++] = idx;
+		return;
+	}
+
+	if (!co->head) {
+		memmove(co->queue + 1, co->queue, co->count * sizeof(*co->queue));
+		co->head++;
+	}
+
+	co->queue[--co->head] = idx;
+	co->count++;
+}
+
+/*
+ * Queues the entry again with the subtests already started, as told by
+ * the journal received so far, excluded. Entries that completed, or
+ * that didn't make it to their first subtest, are not executed again,
+ * the same as when resuming a local run.
+ */
+static void requeue_from_journal(struct coordinator *co, size_t idx,
+				 bool front)
+{
+	struct job_list_entry *entry = &co->job_list->entries[idx];
+	char name[32];
+	int dirfd, fd;
+
+	if (entry->binary[0] == '\0')
+		return;
+
+	snprintf(name, sizeof(name), "%zd", idx);
+	if ((dirfd = openat(co->resdirfd, name, O_DIRECTORY | O_RDONLY)) < 0) {
+		queue_entry(co, idx, front);
+		return;
+	}
+
+	fd = openat(dirfd, "journal.txt", O_RDONLY);
+	close(dirfd);
+	if (fd < 0) {
+		queue_entry(co, idx, front);
+		return;
+	}
+
+	if (prune_from_journal(entry, fd) && entry->binary[0] != '\0')
+		queue_entry(co, idx, front);
+}
+
+static bool read_metadata(struct coordinator *co)
+{
+	struct stat st;
+	int fd;
+
+	if ((fd = openat(co->resdirfd, "metadata.txt", O_RDONLY)) < 0)
+		return false;
+
+	if (fstat(fd, &st) ||
+	    !(co->metadata = malloc(st.st_size)) ||
+	    read(fd, co->metadata, st.st_size) != st.st_size) {
+		close(fd);
+		return false;
+	}
+
+	co->metadata_len = st.st_size;
+	close(fd);
+
+	return true;
+}
+
+static void print_progress(struct coordinator *co, struct remote *r,
+			   size_t idx)
+{
+	char *displayname;
+	int width;
+
+	if (co->settings->log_level < LOG_LEVEL_NORMAL)
+		return;
+
+	width = digits(co->job_list->size);
+	displayname = entry_display_name(&co->job_list->entries[idx]);
+	printf("[%0*zd/%0*zd] %s: %s\n",
+	       width, idx + 1, width, co->job_list->size,
+	       r->name, displayname);
+	fflush(stdout);
+	free(displayname);
+}
+
+static bool hand_out(struct coordinator *co, struct remote *r)
+{
+	struct job_list_entry *entry;
+	char *line = NULL;
+	size_t len = 0;
+	size_t idx;
+	FILE *f;
+	bool ok;
+
+	idx = co->queue[co->head++];
+	co->count--;
+	entry = &co->job_list->entries[idx];
+
+	if (!(f = open_memstream(&line, &len)))
+		return false;
+	write_job_list_entry(f, entry);
+	fclose(f);
+
+	ok = send_msg(r->conn.sock, line, len, "ENTRY %zd %d %zu",
+		      idx, entry->timeout, len);
+	free(line);
+
+	/* Picked up by the next worker when this one is lost */
+	r->entry = idx;
+	r->waiting = false;
+	co->outstanding++;
+
+	if (ok)
+		print_progress(co, r, idx);
+
+	return ok;
+}
+
+static bool run_over(struct coordinator *co)
+{
+	return (co->stop || !co->count) && !co->outstanding;
+}
+
+static void lose_remote(struct coordinator *co, size_t i);
+
+static void dispatch(struct coordinator *co)
+{
+	size_t i = 0;
+
+	while (i < co->num_remotes) {
+		struct remote *r = co->remotes[i];
+		bool ok = true;
+
+		if (r->waiting) {
+			if (run_over(co)) {
+				ok = send_msg(r->conn.sock, NULL, 0, "DONE");
+				r->waiting = false;
+			} else if (!co->stop && co->count) {
+				ok = hand_out(co, r);
+			}
+		}
+
+		if (!ok) {
+			lose_remote(co, i);
+			continue;
+		}
+
+		i++;
+	}
+}
+
+static void finish_entry(struct coordinator *co, struct remote *r)
+{
+	size_t idx = r->entry;
+
+	r->entry = -1;
+	co->outstanding--;
+	co->finished++;
+
+	if (co->settings->incremental_results &&
+	    !append_incremental_results(co->resdirfd, idx,
+					&co->job_list->entries[idx],
+					co->settings))
+		fprintf(stderr, "Warning: Cannot record incremental results\n");
+}
+
+static int open_output(struct coordinator *co, size_t idx, const char *name)
+{
+	char dirname[32];
+	int dirfd, fd;
+
+	snprintf(dirname, sizeof(dirname), "%zd", idx);
+	mkdirat(co->resdirfd, dirname, 0777);
+	if ((dirfd = openat(co->resdirfd, dirname, O_DIRECTORY | O_RDONLY)) < 0)
+		return -1;
+
+	fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+	close(dirfd);
+
+	return fd;
+}
+
+static bool handle_message(struct coordinator *co, struct remote *r,
+			   const char *line)
+{
+	char name[NAME_MAX + 1];
+	ssize_t idx;
+	size_t len;
+
+	if (sscanf(line, "HELLO %63s", r->name) == 1)
+		return send_msg(r->conn.sock, co->metadata, co->metadata_len,
+				"SETTINGS %zu", co->metadata_len);
+
+	if (!strcmp(line, "NEXT")) {
+		if (r->entry >= 0)
+			return false;
+
+		r->waiting = true;
+		return true;
+	}
+
+	if (sscanf(line, "DATA %zd %255s %zu", &idx, name, &len) == 3) {
+		if (idx != r->entry || !valid_filename(name))
+			return false;
+
+		r->outfd = open_output(co, idx, name);
+		if (r->outfd < 0)
+			fprintf(stderr, "Warning: Cannot store %s of entry %zd: %s\n",
+				name, idx, strerror(errno));
+		r->payload = len;
+		return true;
+	}
+
+	if (sscanf(line, "ABORT %zu", &len) == 1) {
+		/* The first abort gets reported */
+		r->outfd = openat(co->resdirfd, "aborted.txt",
+				  O_CREAT | O_WRONLY | O_EXCL | O_CLOEXEC, 0666);
+		r->payload = len;
+
+		if (co->settings->log_level >= LOG_LEVEL_NORMAL)
+			printf("Worker %s aborted, stopping.\n", r->name);
+		co->stop = true;
+		co->aborted = true;
+		return true;
+	}
+
+	if (sscanf(line, "FINISHED %zd", &idx) == 1) {
+		if (idx != r->entry)
+			return false;
+
+		finish_entry(co, r);
+		return true;
+	}
+
+	return false;
+}
+
+/* Returns false when the worker is to be dropped */
+static bool remote_input(struct coordinator *co, struct remote *r)
+{
+	struct conn *c = &r->conn;
+	ssize_t ret;
+
+	ret = recv(c->sock, c->buf + c->len, sizeof(c->buf) - c->len,
+		   MSG_DONTWAIT);
+	if (ret < 0)
+		return errno == EAGAIN || errno == EINTR;
+	if (ret == 0)
+		return false;
+
+	c->len += ret;
+
+	while (c->len) {
+		char *nl;
+		bool ok;
+
+		if (r->payload) {
+			size_t n = r->payload < c->len ? r->payload : c->len;
+
+			if (r->outfd >= 0 && write(r->outfd, c->buf, n) != n) {
+				fprintf(stderr, "Warning: Error storing the results of %s: %s\n",
+					r->name, strerror(errno));
+				close(r->outfd);
+				r->outfd = -1;
+			}
+
+			consume(c, n);
+			r->payload -= n;
+			if (!r->payload) {
+				if (r->outfd >= 0 && co->settings->sync)
+					fsync(r->outfd);
+				close(r->outfd);
+				r->outfd = -1;
+			}
+			continue;
+		}
+
+		if (!(nl = memchr(c->buf, '\n', c->len)))
+			return c->len < sizeof(c->buf);
+
+		*nl = '\0';
+		ok = handle_message(co, r, c->buf);
+		consume(c, nl - c->buf + 1);
+		if (!ok)
+			return false;
+
+		if (!r->payload && r->outfd >= 0) {
+			close(r->outfd);
+			r->outfd = -1;
+		}
+	}
+
+	return true;
+}
+
+static void add_remote(struct coordinator *co, int listenfd)
+{
+	struct remote *r;
+	int sock;
+
+	sock = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC);
+	if (sock < 0)
+		return;
+
+	r = calloc(1, sizeof(*r));
+	r->conn.sock = sock;
+	r->entry = -1;
+	r->outfd = -1;
+	strcpy(r->name, "unknown");
+
+	co->remotes = realloc(co->remotes,
+			      (co->num_remotes + 1) * sizeof(*co->remotes));
+	co->remotes[co->num_remotes++] = r;
+}
+
+static void close_remote(struct remote *r)
+{
+	close(r->outfd);
+	close(r->conn.sock);
+	free(r);
+}
+
+static void lose_remote(struct coordinator *co, size_t i)
+{
+	struct remote *r = co->remotes[i];
+
+	if (r->entry >= 0) {
+		char *displayname;
+
+		displayname = entry_display_name(&co->job_list->entries[r->entry]);
+		fprintf(stderr, "Lost worker %s while executing %s\n",
+			r->name, displayname);
+		free(displayname);
+
+		co->outstanding--;
+		requeue_from_journal(co, r->entry, true);
+	}
+
+	close_remote(r);
+	co->remotes[i] = co->remotes[--co->num_remotes];
+}
+
+static int coordinator_signalfd(sigset_t *sigmask)
+{
+	sigemptyset(sigmask);
+	sigaddset(sigmask, SIGINT);
+	sigaddset(sigmask, SIGTERM);
+	sigaddset(sigmask, SIGQUIT);
+	sigaddset(sigmask, SIGHUP);
+	sigprocmask(SIG_BLOCK, sigmask, NULL);
+
+	return signalfd(-1, sigmask, O_CLOEXEC);
+}
+
+bool execute_coordinator(struct execute_state *state,
+			 struct settings *settings,
+			 struct job_list *job_list,
+			 int resdirfd)
+{
+	struct coordinator co = {
+		.settings = settings,
+		.job_list = job_list,
+		.resdirfd = resdirfd,
+	};
+	struct pollfd *pfd = NULL;
+	double start = timeofday_double();
+	bool status = true;
+	sigset_t sigmask;
+	int listenfd, sigfd, timefd;
+	size_t i;
+
+	if (!read_metadata(&co)) {
+		fprintf(stderr, "Error: Cannot read the settings metadata\n");
+		return false;
+	}
+
+	co.queue = calloc(job_list->size + 1, sizeof(*co.queue));
+	for (i = 0; i < job_list->size; i++) {
+		if (state->resuming)
+			requeue_from_journal(&co, i, false);
+		else
+			queue_entry(&co, i, false);
+	}
+
+	if ((listenfd = listen_on(settings->coordinator_port)) < 0) {
+		free(co.queue);
+		free(co.metadata);
+		return false;
+	}
+
+	sigfd = coordinator_signalfd(&sigmask);
+
+	if (settings->log_level >= LOG_LEVEL_NORMAL) {
+		printf("Handing out %zd jobs on port %d\n",
+		       co.count, settings->coordinator_port);
+		fflush(stdout);
+	}
+
+	while (!run_over(&co)) {
+		struct signalfd_siginfo siginfo;
+		size_t n = 0;
+
+		pfd = realloc(pfd, (co.num_remotes + 2) * sizeof(*pfd));
+		pfd[n++] = (struct pollfd) { .fd = sigfd, .events = POLLIN };
+		pfd[n++] = (struct pollfd) { .fd = listenfd, .events = POLLIN };
+		for (i = 0; i < co.num_remotes; i++)
+			pfd[n++] = (struct pollfd) {
+				.fd = co.remotes[i]->conn.sock,
+				.events = POLLIN,
+			};
+
+		if (poll(pfd, n, 1000) < 0 && errno != EINTR) {
+			fprintf(stderr, "Poll failed: %s\n", strerror(errno));
+			status = false;
+			break;
+		}
+
+		if (pfd[0].revents &&
+		    read(sigfd, &siginfo, sizeof(siginfo)) == sizeof(siginfo)) {
+			if (settings->log_level >= LOG_LEVEL_NORMAL)
+				printf("Abort requested via %s, disconnecting the workers\n",
+				       strsignal(siginfo.ssi_signo));
+			status = false;
+			break;
+		}
+
+		/* Walk backwards, lost workers are replaced by the last one */
+		for (i = co.num_remotes; i--; ) {
+			if (pfd[i + 2].revents && !remote_input(&co, co.remotes[i]))
+				lose_remote(&co, i);
+		}
+
+		if (pfd[1].revents)
+			add_remote(&co, listenfd);
+
+		if (settings->overall_timeout > 0 && !co.stop &&
+		    timeofday_double() - start >= settings->overall_timeout) {
+			if (settings->log_level >= LOG_LEVEL_NORMAL)
+				printf("Overall timeout time exceeded, stopping.\n");
+			state->time_left = 0.0;
+			co.stop = true;
+		}
+
+		dispatch(&co);
+	}
+
+	/* Tell the idle workers we're done */
+	dispatch(&co);
+
+	if (co.aborted)
+		status = false;
+
+	if (status &&
+	    (timefd = openat(resdirfd, "endtime.txt", O_CREAT | O_WRONLY | O_EXCL, 0666)) >= 0) {
+		dprintf(timefd, "%f\n", timeofday_double());
+		close(timefd);
+	}
+
+	for (i = 0; i < co.num_remotes; i++)
+		close_remote(co.remotes[i]);
+	free(co.remotes);
+	free(pfd);
+	free(co.queue);
+	free(co.metadata);
+	close(listenfd);
+	close(sigfd);
+	sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
+
+	return status;
+}
+
+/* How much of each output file of the entry has been sent */
+struct sent_file {
+	char name[NAME_MAX + 1];
+	off_t offset;
+};
+
+struct sent_files {
+	struct sent_file *files;
+	size_t count;
+};
+
+static off_t *sent_offset(struct sent_files *sent, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sent->count; i++)
+		if (!strcmp(sent->files[i].name, name))
+			return &sent->files[i].offset;
+
+	sent->files = realloc(sent->files,
+			      (sent->count + 1) * sizeof(*sent->files));
+	snprintf(sent->files[sent->count].name,
+		 sizeof(sent->files[0].name), "%s", name);
+	sent->files[sent->count].offset = 0;
+
+	return &sent->files[sent->count++].offset;
+}
+
+static bool forward_file(int sock, size_t idx, int dirfd, const char *name,
+			 off_t *offset)
+{
+	char *buf;
+	struct stat st;
+	bool ok = true;
+	int fd;
+
+	if ((fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC)) < 0)
+		return true;
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= *offset) {
+		close(fd);
+		return true;
+	}
+
+	buf = malloc(CHUNK_SIZE);
+	while (ok && *offset < st.st_size) {
+		ssize_t n = pread(fd, buf, CHUNK_SIZE, *offset);
+
+		if (n <= 0)
+			break;
+
+		ok = send_msg(sock, buf, n, "DATA %zd %s %zd", idx, name, n);
+		*offset += n;
+	}
+
+	free(buf);
+	close(fd);
+
+	return ok;
+}
+
+/* Sends what has been appended to the outputs of the entry since last time */
+static bool forward_outputs(int sock, size_t idx, const char *testdir,
+			    struct sent_files *sent)
+{
+	struct dirent *ent;
+	bool ok = true;
+	DIR *dir;
+
+	if (!(dir = opendir(testdir)))
+		return true;
+
+	while (ok && (ent = readdir(dir)) != NULL) {
+		if (!valid_filename(ent->d_name))
+			continue;
+
+		ok = forward_file(sock, idx, dirfd(dir), ent->d_name,
+				  sent_offset(sent, ent->d_name));
+	}
+
+	closedir(dir);
+
+	return ok;
+}
+
+/* Returns whether the entry aborted the run, sending aborted.txt if so */
+static bool forward_abort(int sock, const char *results_path)
+{
+	char *path, *buf;
+	ssize_t n;
+	int fd;
+
+	asprintf(&path, "%s/aborted.txt", results_path);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	free(path);
+	if (fd < 0)
+		return false;
+
+	/* A failure to send shows when finishing the entry */
+	buf = malloc(CHUNK_SIZE);
+	n = read(fd, buf, CHUNK_SIZE);
+	send_msg(sock, buf, n > 0 ? n : 0, "ABORT %zu", n > 0 ? n : 0);
+	free(buf);
+	close(fd);
+
+	return true;
+}
+
+static void __attribute__((noreturn))
+execute_entry_process(struct settings *settings, struct job_list *list)
+{
+	struct execute_state state;
+
+	/* Don't leave the test running when the worker is killed */
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+	if (!initialize_execute_state(&state, settings, list))
+		exit(1);
+
+	exit(execute(&state, settings, list) ? 0 : 1);
+}
+
+/*
+ * Returns:
+ *  =0 - Entry executed
+ *  <0 - Lost the coordinator
+ *  >0 - Entry executed and aborted, no more entries to take
+ */
+static int run_remote_entry(struct conn *c, struct settings *settings,
+			    const char *root, size_t idx, int timeout,
+			    char *line)
+{
+	struct sent_files sent = {};
+	struct job_list list;
+	char *testdir;
+	int ret = 0;
+	pid_t child;
+
+	free(settings->results_path);
+	asprintf(&settings->results_path, "%s/%zd", root, idx);
+	asprintf(&testdir, "%s/0", settings->results_path);
+
+	init_job_list(&list);
+	add_job_list_line(&list, line);
+	if (list.size != 1) {
+		free_job_list(&list);
+		free(testdir);
+		return -1;
+	}
+	list.entries[0].timeout = timeout;
+
+	/* Don't duplicate our buffered output in the child */
+	fflush(stdout);
+	fflush(stderr);
+
+	child = fork();
+	if (child < 0) {
+		fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+		ret = -1;
+		goto out;
+	} else if (child == 0) {
+		close(c->sock);
+		execute_entry_process(settings, &list);
+		/* unreachable */
+	}
+
+	for (;;) {
+		struct pollfd pfd = { .fd = c->sock, .events = POLLIN };
+		int wstatus;
+		pid_t pid;
+
+		pid = waitpid(child, &wstatus, WNOHANG);
+
+		if (!forward_outputs(c->sock, idx, testdir, &sent)) {
+			ret = -1;
+			break;
+		}
+
+		if (pid == child)
+			break;
+
+		/* The coordinator doesn't talk during an entry, it hung up */
+		if (poll(&pfd, 1, 250) > 0) {
+			ret = -1;
+			break;
+		}
+	}
+
+	if (ret < 0) {
+		kill(child, SIGTERM);
+		waitpid(child, NULL, 0);
+		goto out;
+	}
+
+	if (forward_abort(c->sock, settings->results_path))
+		ret = 1;
+
+	if (!send_msg(c->sock, NULL, 0, "FINISHED %zd", idx))
+		ret = -1;
+
+out:
+	free(sent.files);
+	free(testdir);
+	free_job_list(&list);
+
+	return ret;
+}
+
+/* Executes with the coordinator's settings, but with the local paths */
+static bool init_remote_settings(struct settings *remote,
+				 struct settings *settings,
+				 char *metadata, size_t len)
+{
+	FILE *f;
+	bool ok;
+
+	if (!(f = fmemopen(metadata, len, "r")))
+		return false;
+
+	init_settings(remote);
+	ok = read_settings_from_file(remote, f);
+	fclose(f);
+	if (!ok)
+		return false;
+
+	free(remote->test_root);
+	remote->test_root = strdup(settings->test_root);
+	free(remote->devices);
+	remote->devices = settings->devices ? strdup(settings->devices) : NULL;
+
+	/* The coordinator has filtered and ordered the jobs already */
+	free(remote->test_list);
+	remote->test_list = NULL;
+
+	remote->log_level = settings->log_level;
+	remote->use_watchdog = settings->use_watchdog;
+	remote->dry_run = false;
+	remote->overwrite = true;
+	remote->num_workers = 0;
+	remote->coordinator_port = 0;
+	/* These are up to the coordinator */
+	remote->overall_timeout = 0;
+	remote->incremental_results = false;
+
+	return true;
+}
+
+bool execute_remote_worker(struct settings *settings)
+{
+	struct settings remote;
+	struct utsname unamebuf;
+	char line[MSG_MAX];
+	char *payload;
+	struct conn c = {};
+	bool status = true;
+	size_t len;
+
+	mkdir(settings->results_path, 0777);
+
+	if ((c.sock = connect_to(settings->connect)) < 0)
+		return false;
+
+	if (uname(&unamebuf))
+		strcpy(unamebuf.nodename, "unknown");
+
+	if (!send_msg(c.sock, NULL, 0, "HELLO %.63s", unamebuf.nodename) ||
+	    !recv_line(&c, line, sizeof(line)) ||
+	    sscanf(line, "SETTINGS %zu", &len) != 1) {
+		fprintf(stderr, "Error: No settings from the coordinator\n");
+		close(c.sock);
+		return false;
+	}
+
+	payload = malloc(len + 1);
+	if (!recv_payload(&c, payload, len) ||
+	    !init_remote_settings(&remote, settings, payload, len)) {
+		fprintf(stderr, "Error: Cannot parse the coordinator settings\n");
+		free(payload);
+		close(c.sock);
+		return false;
+	}
+	free(payload);
+
+	for (;;) {
+		ssize_t idx;
+		int timeout, ret;
+
+		if (!send_msg(c.sock, NULL, 0, "NEXT") ||
+		    !recv_line(&c, line, sizeof(line))) {
+			fprintf(stderr, "Error: Lost the coordinator\n");
+			status = false;
+			break;
+		}
+
+		if (!strcmp(line, "DONE"))
+			break;
+
+		if (sscanf(line, "ENTRY %zd %d %zu", &idx, &timeout, &len) != 3) {
+			fprintf(stderr, "Error: Unexpected message from the coordinator\n");
+			status = false;
+			break;
+		}
+
+		payload = malloc(len + 1);
+		if (!recv_payload(&c, payload, len)) {
+			fprintf(stderr, "Error: Lost the coordinator\n");
+			free(payload);
+			status = false;
+			break;
+		}
+		payload[len] = '\0';
+
+		ret = run_remote_entry(&c, &remote, settings->results_path,
+				       idx, timeout, payload);
+		free(payload);
+
+		if (ret < 0) {
+			fprintf(stderr, "Error: Lost the coordinator\n");
+			status = false;
+			break;
+		}
+
+		if (ret > 0) {
+			status = false;
+			break;
+		}
+	}
+
+	free_settings(&remote);
+	close(c.sock);
+
+	return status;
+}
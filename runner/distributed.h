@@ -0,0 +1,29 @@
+#ifndef RUNNER_DISTRIBUTED_H
+#define RUNNER_DISTRIBUTED_H
+
+#include <stdbool.h>
+
+#include "executor.h"
+
+/*
+ * Hands out the entries of job_list one at a time to the remote
+ * workers connecting to settings->coordinator_port, each worker asking
+ * for the next entry once it's done with the previous one. What the
+ * workers send back is stored in the results directory pointed to by
+ * resdirfd like locally executed results, so results generation and
+ * resuming work as usual.
+ */
+bool execute_coordinator(struct execute_state *state,
+			 struct settings *settings,
+			 struct job_list *job_list,
+			 int resdirfd);
+
+/*
+ * Executes entries handed out by the coordinator at
+ * settings->connect with the coordinator's settings, keeping local
+ * copies of the results under settings->results_path, until the
+ * coordinator runs out of entries.
+ */
+bool execute_remote_worker(struct settings *settings);
+
+#endif
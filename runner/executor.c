@@ -1,25 +1,37 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <linux/watchdog.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/poll.h>
+#include <sys/resource.h>
 #include <sys/signalfd.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/utsname.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include "igt_core.h"
+#include "igt_gt.h"
+#include "igt_perf.h"
+#include "distributed.h"
 #include "executor.h"
 #include "output_strings.h"
+#include "resultgen.h"
 
 static struct {
 	int *fds;
@@ -273,7 +285,7 @@ static void prune_subtest(struct job_list_entry *entry, char *subtest)
 	entry->subtests[entry->subtest_count - 1] = excl;
 }
 
-static bool prune_from_journal(struct job_list_entry *entry, int fd)
+bool prune_from_journal(struct job_list_entry *entry, int fd)
 {
 	char *subtest;
 	FILE *f;
@@ -322,13 +334,137 @@ static bool prune_from_journal(struct job_list_entry *entry, int fd)
 	return pruned > 0;
 }
 
+static double timeofday_double(void)
+{
+	struct timeval tv;
+
+	if (!gettimeofday(&tv, NULL))
+		return tv.tv_sec + tv.tv_usec / 1000000.0;
+	return 0.0;
+}
+
+static struct {
+	int fd;
+	uint32_t entry;
+	bool sync;
+} binary_journal = { .fd = -1 };
+
+/* FNV-1a */
+static uint32_t subtest_hash(const char *name, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static void open_binary_journal(int resdirfd, struct settings *settings)
+{
+	binary_journal.fd = openat(resdirfd, BINARY_JOURNAL_FILENAME,
+				   O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+	binary_journal.sync = settings->sync;
+}
+
+static void close_binary_journal(void)
+{
+	close(binary_journal.fd);
+	binary_journal.fd = -1;
+}
+
+static void write_journal_record(uint32_t type, uint32_t hash, int32_t result)
+{
+	struct journal_record record = {
+		.type = type,
+		.entry = binary_journal.entry,
+		.subtest_hash = hash,
+		.result = result,
+		.timestamp = timeofday_double(),
+	};
+
+	if (binary_journal.fd < 0)
+		return;
+
+	write(binary_journal.fd, &record, sizeof(record));
+	if (binary_journal.sync)
+		fdatasync(binary_journal.fd);
+}
+
+/*
+ * Reads the last complete record of the binary journal. Records torn
+ * by a crash are ignored.
+ */
+static bool read_last_journal_record(int dirfd, struct journal_record *record)
+{
+	struct stat st;
+	off_t last;
+	int fd;
+	bool ok;
+
+	if ((fd = openat(dirfd, BINARY_JOURNAL_FILENAME, O_RDONLY)) < 0)
+		return false;
+
+	if (fstat(fd, &st) || st.st_size < sizeof(*record)) {
+		close(fd);
+		return false;
+	}
+
+	last = st.st_size - st.st_size % sizeof(*record) - sizeof(*record);
+	ok = pread(fd, record, sizeof(*record), last) == sizeof(*record);
+	close(fd);
+
+	return ok;
+}
+
+bool dump_binary_journal(int dirfd, FILE *f)
+{
+	struct journal_record record;
+	int fd;
+
+	if ((fd = openat(dirfd, BINARY_JOURNAL_FILENAME, O_RDONLY)) < 0)
+		return false;
+
+	while (read(fd, &record, sizeof(record)) == sizeof(record)) {
+		fprintf(f, "%u %f ", record.entry, record.timestamp);
+
+		switch (record.type) {
+		case JOURNAL_START:
+			fprintf(f, "start\n");
+			break;
+		case JOURNAL_SUBTEST:
+			fprintf(f, "subtest %08x\n", record.subtest_hash);
+			break;
+		case JOURNAL_EXIT:
+			fprintf(f, "%s%d\n", EXECUTOR_EXIT, record.result);
+			break;
+		case JOURNAL_TIMEOUT:
+			fprintf(f, "%s%d\n", EXECUTOR_TIMEOUT, record.result);
+			break;
+		default:
+			fprintf(f, "unknown record %u\n", record.type);
+			break;
+		}
+	}
+
+	close(fd);
+	return true;
+}
+
 static const char *filenames[_F_LAST] = {
 	[_F_JOURNAL] = "journal.txt",
 	[_F_OUT] = "out.txt",
 	[_F_ERR] = "err.txt",
 	[_F_DMESG] = "dmesg.txt",
+	[_F_EVENTS] = "events.txt",
 };
 
+/* Appended to the filenames of compressed outputs */
+#define COMPRESSED_SUFFIX ".gz"
+
 static int open_at_end(int dirfd, const char *name)
 {
 	int fd = openat(dirfd, name, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
@@ -346,9 +482,58 @@ static int open_at_end(int dirfd, const char *name)
 	return fd;
 }
 
+/*
+ * Outputs stored compressed are decompressed to an anonymous file, so
+ * that they can be read (and mapped) like the plain ones.
+ */
+static int open_decompressed(int dirfd, const char *name)
+{
+	char path[PATH_MAX];
+	char buf[65536];
+	gzFile f;
+	int fd, outfd;
+	int s;
+
+	snprintf(path, sizeof(path), "%s%s", name, COMPRESSED_SUFFIX);
+	if ((fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+
+	if ((f = gzdopen(fd, "rb")) == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	if ((outfd = memfd_create(name, MFD_CLOEXEC)) < 0) {
+		gzclose(f);
+		return -1;
+	}
+
+	/*
+	 * A stream cut short by the runner dying is read as far as it
+	 * goes. The writer flushes regularly so that's most of it.
+	 */
+	while ((s = gzread(f, buf, sizeof(buf))) > 0) {
+		if (write(outfd, buf, s) != s) {
+			close(outfd);
+			gzclose(f);
+			return -1;
+		}
+	}
+
+	gzclose(f);
+	lseek(outfd, 0, SEEK_SET);
+
+	return outfd;
+}
+
 static int open_for_reading(int dirfd, const char *name)
 {
-	return openat(dirfd, name, O_RDONLY);
+	int fd = openat(dirfd, name, O_RDONLY);
+
+	if (fd < 0 && errno == ENOENT)
+		fd = open_decompressed(dirfd, name);
+
+	return fd;
 }
 
 bool open_output_files(int dirfd, int *fds, bool write)
@@ -358,6 +543,10 @@ bool open_output_files(int dirfd, int *fds, bool write)
 
 	for (i = 0; i < _F_LAST; i++) {
 		if ((fds[i] = openfunc(dirfd, filenames[i])) < 0) {
+			/* Results from older runners have no event stream */
+			if (i == _F_EVENTS && !write)
+				continue;
+
 			while (--i >= 0)
 				close(fds[i]);
 			return false;
@@ -367,16 +556,432 @@ bool open_output_files(int dirfd, int *fds, bool write)
 	return true;
 }
 
+/*
+ * With settings->compress_outputs, all outputs except the journal are
+ * stored as gzip streams. The executor writes them to pipes like it
+ * would to the files, and a writer thread does the compressing so
+ * that reading the test pipes is never held up by it.
+ */
+static struct {
+	pthread_t thread;
+	bool running;
+	bool sync;
+	int pipes[_F_LAST];
+	int fds[_F_LAST];
+	gzFile files[_F_LAST];
+} compressor;
+
+static void finish_compressed(int i)
+{
+	if (compressor.files[i] == NULL)
+		return;
+
+	if (compressor.sync) {
+		gzflush(compressor.files[i], Z_FINISH);
+		fdatasync(compressor.fds[i]);
+	}
+
+	gzclose(compressor.files[i]);
+	compressor.files[i] = NULL;
+	compressor.fds[i] = -1;
+}
+
+static void *compressor_thread(void *data)
+{
+	struct pollfd pfd[_F_LAST];
+	bool written[_F_LAST] = {};
+	char buf[65536];
+	int i, open = 0;
+
+	for (i = 0; i < _F_LAST; i++) {
+		pfd[i].fd = compressor.pipes[i];
+		pfd[i].events = POLLIN;
+		if (pfd[i].fd >= 0)
+			open++;
+	}
+
+	while (open > 0) {
+		if (poll(pfd, _F_LAST, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			fprintf(stderr, "Error compressing outputs: %s\n",
+				strerror(errno));
+			break;
+		}
+
+		for (i = 0; i < _F_LAST; i++) {
+			ssize_t s;
+
+			if (pfd[i].fd < 0 || !pfd[i].revents)
+				continue;
+
+			s = read(pfd[i].fd, buf, sizeof(buf));
+			if (s > 0) {
+				gzwrite(compressor.files[i], buf, s);
+				written[i] = true;
+				continue;
+			}
+
+			if (s < 0 && errno == EINTR)
+				continue;
+
+			/* Closed by close_outputs() */
+			finish_compressed(i);
+			pfd[i].fd = -1;
+			open--;
+		}
+
+		/*
+		 * Flush whenever we've caught up with the executor, so
+		 * that the outputs survive the runner dying like plain
+		 * files would.
+		 */
+		for (i = 0; i < _F_LAST; i++) {
+			if (!written[i] || compressor.files[i] == NULL)
+				continue;
+
+			gzflush(compressor.files[i], Z_SYNC_FLUSH);
+			if (compressor.sync)
+				fdatasync(compressor.fds[i]);
+			written[i] = false;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * gzip streams can't be appended to reliably when the previous
+ * execution was cut short, so when resuming, the readable part of an
+ * existing stream is recompressed to a new one instead.
+ */
+static gzFile open_compressed_at_end(int dirfd, const char *name, int *fdp)
+{
+	char tmpname[PATH_MAX];
+	char buf[65536];
+	char last = '\n';
+	gzFile f, old;
+	int fd, oldfd;
+	int s;
+
+	snprintf(tmpname, sizeof(tmpname), "%s.new", name);
+	fd = openat(dirfd, tmpname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0)
+		return NULL;
+
+	if ((f = gzdopen(fd, "wb")) == NULL) {
+		close(fd);
+		unlinkat(dirfd, tmpname, 0);
+		return NULL;
+	}
+
+	if ((oldfd = openat(dirfd, name, O_RDONLY | O_CLOEXEC)) >= 0) {
+		if ((old = gzdopen(oldfd, "rb")) != NULL) {
+			while ((s = gzread(old, buf, sizeof(buf))) > 0) {
+				gzwrite(f, buf, s);
+				last = buf[s - 1];
+			}
+			gzclose(old);
+		} else {
+			close(oldfd);
+		}
+
+		if (last != '\n')
+			gzwrite(f, "\n", 1);
+	}
+
+	if (renameat(dirfd, tmpname, dirfd, name)) {
+		gzclose(f);
+		unlinkat(dirfd, tmpname, 0);
+		return NULL;
+	}
+
+	*fdp = fd;
+	return f;
+}
+
+static void close_compressor_files(void)
+{
+	int i;
+
+	for (i = 0; i < _F_LAST; i++) {
+		close(compressor.pipes[i]);
+		compressor.pipes[i] = -1;
+		finish_compressed(i);
+	}
+}
+
+static bool open_compressed_output_files(int dirfd, int *fds,
+					 struct settings *settings)
+{
+	char name[PATH_MAX];
+	int pipefd[2];
+	int i;
+
+	for (i = 0; i < _F_LAST; i++) {
+		fds[i] = -1;
+		compressor.pipes[i] = -1;
+		compressor.fds[i] = -1;
+		compressor.files[i] = NULL;
+	}
+
+	compressor.sync = settings->sync;
+
+	/*
+	 * The journal stays plain, resuming needs to read it. So does the
+	 * event stream, the tests write it directly.
+	 */
+	if ((fds[_F_JOURNAL] = open_at_end(dirfd, filenames[_F_JOURNAL])) < 0 ||
+	    (fds[_F_EVENTS] = open_at_end(dirfd, filenames[_F_EVENTS])) < 0) {
+		close(fds[_F_JOURNAL]);
+		return false;
+	}
+
+	for (i = 0; i < _F_LAST; i++) {
+		if (i == _F_JOURNAL || i == _F_EVENTS)
+			continue;
+
+		snprintf(name, sizeof(name), "%s%s", filenames[i], COMPRESSED_SUFFIX);
+		compressor.files[i] = open_compressed_at_end(dirfd, name,
+							     &compressor.fds[i]);
+		if (compressor.files[i] == NULL ||
+		    pipe2(pipefd, O_CLOEXEC))
+			goto err;
+
+		/* Best effort, a bigger pipe only evens out bursts */
+		fcntl(pipefd[1], F_SETPIPE_SZ, 1 << 20);
+
+		compressor.pipes[i] = pipefd[0];
+		fds[i] = pipefd[1];
+	}
+
+	if (pthread_create(&compressor.thread, NULL, compressor_thread, NULL))
+		goto err;
+
+	compressor.running = true;
+	return true;
+
+err:
+	fprintf(stderr, "Error opening compressed output files: %s\n",
+		strerror(errno));
+	for (i = 0; i < _F_LAST; i++) {
+		close(fds[i]);
+		fds[i] = -1;
+	}
+	close_compressor_files();
+
+	return false;
+}
+
 void close_outputs(int *fds)
 {
 	int i;
 
 	for (i = 0; i < _F_LAST; i++) {
 		close(fds[i]);
+		fds[i] = -1;
+	}
+
+	/* The writer thread finishes the streams once it sees the pipes close */
+	if (compressor.running) {
+		pthread_join(compressor.thread, NULL);
+		compressor.running = false;
+		close_compressor_files();
+	}
+}
+
+/*
+ * Kernel log records are read from /dev/kmsg one per read(), but
+ * they are collected to a buffer and written out in batches, one
+ * write per wakeup instead of one per record.
+ *
+ * In ring buffer mode the records are only written out when they are
+ * interesting: when a record is at dmesg_warn_level or more serious,
+ * or when the test fails. Otherwise the oldest records are dropped
+ * when the buffer is full. The last subtest marker record is kept
+ * aside so that resultgen can still attribute the written records to
+ * the correct subtest.
+ */
+
+/* CONSOLE_EXT_LOG_MAX, the largest record /dev/kmsg will return */
+#define KMSG_RECORD_MAX 8192
+#define KMSG_BUFFER_SIZE (8 * KMSG_RECORD_MAX)
+
+struct kmsg_buffer
+{
+	int outfd;
+	bool sync;
+	int warn_level;
+
+	char *buf;
+	size_t len;
+	size_t size;
+
+	bool ring;
+	char *marker;
+	size_t marker_len;
+	ssize_t marker_offset; /* < 0 if not in buf */
+	bool marker_written;
+};
+
+static void kmsg_buffer_init(struct kmsg_buffer *kmsg, int outfd,
+			     struct settings *settings)
+{
+	memset(kmsg, 0, sizeof(*kmsg));
+
+	kmsg->outfd = outfd;
+	kmsg->sync = settings->sync;
+	kmsg->warn_level = settings->dmesg_warn_level;
+	kmsg->ring = settings->dmesg_ring_buffer > 0;
+	kmsg->marker_offset = -1;
+	kmsg->marker_written = true;
+
+	kmsg->size = KMSG_BUFFER_SIZE;
+	if (kmsg->ring) {
+		kmsg->size = (size_t)settings->dmesg_ring_buffer * 1024;
+		if (kmsg->size < 2 * KMSG_RECORD_MAX)
+			kmsg->size = 2 * KMSG_RECORD_MAX;
+		kmsg->marker = malloc(KMSG_RECORD_MAX);
+	}
+
+	kmsg->buf = malloc(kmsg->size);
+}
+
+static void kmsg_buffer_fini(struct kmsg_buffer *kmsg)
+{
+	free(kmsg->buf);
+	free(kmsg->marker);
+}
+
+static void kmsg_buffer_flush(struct kmsg_buffer *kmsg)
+{
+	struct iovec iov[2];
+	int iovcnt = 0;
+
+	/* Re-emit the subtest marker if it got dropped from the ring */
+	if (!kmsg->marker_written && kmsg->marker_offset < 0) {
+		iov[iovcnt].iov_base = kmsg->marker;
+		iov[iovcnt].iov_len = kmsg->marker_len;
+		iovcnt++;
+	}
+
+	if (kmsg->len > 0) {
+		iov[iovcnt].iov_base = kmsg->buf;
+		iov[iovcnt].iov_len = kmsg->len;
+		iovcnt++;
+	}
+
+	if (iovcnt == 0)
+		return;
+
+	writev(kmsg->outfd, iov, iovcnt);
+	if (kmsg->sync)
+		fdatasync(kmsg->outfd);
+
+	kmsg->len = 0;
+	kmsg->marker_offset = -1;
+	kmsg->marker_written = true;
+}
+
+/* Drops the oldest whole records until a new record is known to fit */
+static void kmsg_buffer_drop_oldest(struct kmsg_buffer *kmsg)
+{
+	size_t cut = KMSG_RECORD_MAX + 1 - (kmsg->size - kmsg->len);
+
+	/* Make some headroom to avoid moving the data for every record */
+	if (cut < kmsg->size / 4)
+		cut = kmsg->size / 4;
+
+	/* Records begin at lines that don't begin with a space */
+	while (cut < kmsg->len &&
+	       (kmsg->buf[cut - 1] != '\n' || kmsg->buf[cut] == ' '))
+		cut++;
+
+	if (cut > kmsg->len)
+		cut = kmsg->len;
+
+	memmove(kmsg->buf, kmsg->buf + cut, kmsg->len - cut);
+	kmsg->len -= cut;
+
+	if (kmsg->marker_offset >= 0) {
+		if ((size_t)kmsg->marker_offset < cut)
+			kmsg->marker_offset = -1;
+		else
+			kmsg->marker_offset -= cut;
 	}
 }
 
-static void dump_dmesg(int kmsgfd, int outfd)
+/*
+ * Reads one record from kmsgfd to the buffer. Returns the record
+ * length, or the read() return value on error or EOF.
+ */
+static ssize_t kmsg_buffer_read(struct kmsg_buffer *kmsg, int kmsgfd)
+{
+	unsigned flags;
+	unsigned long long seq, usec;
+	char cont;
+	char *record;
+	ssize_t r;
+
+	/* Leave room for null termination */
+	if (kmsg->size - kmsg->len < KMSG_RECORD_MAX + 1) {
+		if (kmsg->ring)
+			kmsg_buffer_drop_oldest(kmsg);
+		else
+			kmsg_buffer_flush(kmsg);
+	}
+
+	record = kmsg->buf + kmsg->len;
+	r = read(kmsgfd, record, kmsg->size - kmsg->len - 1);
+	if (r <= 0)
+		return r;
+
+	record[r] = '\0';
+	kmsg->len += r;
+
+	if (!kmsg->ring)
+		return r;
+
+	if (strstr(record, STARTING_SUBTEST_DMESG) &&
+	    r <= KMSG_RECORD_MAX) {
+		memcpy(kmsg->marker, record, r);
+		kmsg->marker_len = r;
+		kmsg->marker_offset = record - kmsg->buf;
+		kmsg->marker_written = false;
+	}
+
+	if (sscanf(record, "%u,%llu,%llu,%c;", &flags, &seq, &usec, &cont) == 4 &&
+	    (flags & 0x07) <= kmsg->warn_level && cont != 'c')
+		kmsg_buffer_flush(kmsg);
+
+	return r;
+}
+
+/*
+ * Reads all records available without blocking. Returns false if
+ * kmsg can't be read anymore.
+ */
+static bool kmsg_buffer_drain(struct kmsg_buffer *kmsg, int kmsgfd)
+{
+	ssize_t r;
+
+	while ((r = kmsg_buffer_read(kmsg, kmsgfd)) > 0)
+		;
+
+	if (r < 0 && errno != EAGAIN && errno != EPIPE && errno != EINVAL) {
+		fprintf(stderr, "Error reading from kmsg, stopping monitoring: %s\n",
+			strerror(errno));
+		return false;
+	}
+
+	if (!kmsg->ring)
+		kmsg_buffer_flush(kmsg);
+
+	return true;
+}
+
+static void dump_dmesg(int kmsgfd, struct kmsg_buffer *kmsg)
 {
 	/*
 	 * Write kernel messages to the log file until we reach
@@ -396,7 +1001,7 @@ static void dump_dmesg(int kmsgfd, int outfd)
 		return;
 	lseek(comparefd, 0, SEEK_END);
 
-	if (fcntl(kmsgfd, F_SETFL, O_NONBLOCK)) {
+	if (kmsgfd < 0 || fcntl(kmsgfd, F_SETFL, O_NONBLOCK)) {
 		close(comparefd);
 		return;
 	}
@@ -407,7 +1012,7 @@ static void dump_dmesg(int kmsgfd, int outfd)
 			if (r < 0) {
 				if (errno != EAGAIN && errno != EPIPE) {
 					close(comparefd);
-					return;
+					break;
 				}
 			} else {
 				buf[r] = '\0';
@@ -420,7 +1025,7 @@ static void dump_dmesg(int kmsgfd, int outfd)
 			}
 		}
 
-		r = read(kmsgfd, buf, sizeof(buf));
+		r = kmsg_buffer_read(kmsg, kmsgfd);
 		if (r <= 0) {
 			if (errno == EPIPE)
 				continue;
@@ -430,12 +1035,10 @@ static void dump_dmesg(int kmsgfd, int outfd)
 			 * we can't do anything anyway.
 			 */
 			close(comparefd);
-			return;
+			break;
 		}
 
-		write(outfd, buf, r);
-
-		if (comparefd < 0 && sscanf(buf, "%u,%llu,%llu,%c;",
+		if (comparefd < 0 && sscanf(kmsg->buf + kmsg->len - r, "%u,%llu,%llu,%c;",
 					    &flags, &seq, &usec, &cont) == 4) {
 			/*
 			 * Comparison record has been read, compare
@@ -443,9 +1046,383 @@ static void dump_dmesg(int kmsgfd, int outfd)
 			 * enough.
 			 */
 			if (seq >= cmpseq)
-				return;
+				break;
 		}
 	}
+
+	if (!kmsg->ring)
+		kmsg_buffer_flush(kmsg);
+}
+
+static int exitcode_from_wait_status(int status)
+{
+	if (WIFEXITED(status)) {
+		status = WEXITSTATUS(status);
+		if (status >= 128)
+			status = 128 - status;
+		return status;
+	}
+
+	if (WIFSIGNALED(status))
+		return -WTERMSIG(status);
+
+	return 9999;
+}
+
+/*
+ * CPU isolation with --test-cpus: the tests execute in a cgroup of
+ * their own whose cpuset holds the test CPUs, made an isolated
+ * partition when the kernel allows it so nothing else gets scheduled
+ * there, while the runner and its threads keep to the remaining CPUs.
+ * Without cgroup v2 only the affinity is set.
+ */
+static struct {
+	bool enabled;
+	cpu_set_t cpus;
+	char cgroup[64];
+} isolation;
+
+static bool write_cgroup_file(const char *name, const char *value)
+{
+	char path[PATH_MAX];
+	ssize_t len = strlen(value);
+	int fd;
+	bool ok;
+
+	snprintf(path, sizeof(path), "%s/%s", isolation.cgroup, name);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return false;
+
+	ok = write(fd, value, len) == len;
+	close(fd);
+
+	return ok;
+}
+
+static void create_test_cgroup(struct settings *settings)
+{
+	char mems[256] = "0";
+	ssize_t len;
+	int fd;
+
+	fd = open("/sys/fs/cgroup/cgroup.subtree_control", O_WRONLY);
+	if (fd >= 0) {
+		/* Fails harmlessly when already enabled */
+		if (write(fd, "+cpuset", 7) != 7 && errno != EBUSY)
+			fprintf(stderr, "Warning: Cannot enable the cpuset controller: %s\n",
+				strerror(errno));
+		close(fd);
+	}
+
+	fd = open("/sys/fs/cgroup/cpuset.mems.effective", O_RDONLY);
+	if (fd >= 0) {
+		len = read(fd, mems, sizeof(mems) - 1);
+		if (len > 0)
+			mems[len] = '\0';
+		close(fd);
+	}
+
+	snprintf(isolation.cgroup, sizeof(isolation.cgroup),
+		 "/sys/fs/cgroup/igt-runner-%d", getpid());
+	if (mkdir(isolation.cgroup, 0755) && errno != EEXIST)
+		goto fail;
+
+	if (!write_cgroup_file("cpuset.cpus", settings->test_cpus) ||
+	    !write_cgroup_file("cpuset.mems", mems)) {
+		rmdir(isolation.cgroup);
+		goto fail;
+	}
+
+	if (!write_cgroup_file("cpuset.cpus.partition", "isolated") &&
+	    !write_cgroup_file("cpuset.cpus.partition", "root") &&
+	    settings->log_level >= LOG_LEVEL_NORMAL)
+		fprintf(stderr, "Warning: Test CPUs are not an exclusive partition, other tasks may still run there\n");
+
+	return;
+
+ fail:
+	if (settings->log_level >= LOG_LEVEL_NORMAL)
+		fprintf(stderr, "Warning: Cannot create a cpuset cgroup for the tests, only setting their affinity\n");
+	isolation.cgroup[0] = '\0';
+}
+
+static void setup_test_isolation(struct settings *settings)
+{
+	cpu_set_t allowed, runner;
+	int cpu;
+
+	if (!settings->test_cpus || isolation.enabled)
+		return;
+
+	if (!parse_cpu_list(settings->test_cpus, &isolation.cpus))
+		return;
+	isolation.enabled = true;
+
+	create_test_cgroup(settings);
+
+	/*
+	 * Done before any monitoring or compression threads exist, so
+	 * they all inherit it.
+	 */
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		return;
+
+	CPU_ZERO(&runner);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &isolation.cpus))
+			CPU_SET(cpu, &runner);
+
+	if (!CPU_COUNT(&runner))
+		fprintf(stderr, "Warning: No CPUs left for the runner outside --test-cpus\n");
+	else if (sched_setaffinity(0, sizeof(runner), &runner))
+		fprintf(stderr, "Warning: Cannot move the runner off the test CPUs: %s\n",
+			strerror(errno));
+}
+
+static void teardown_test_isolation(void)
+{
+	if (!isolation.enabled)
+		return;
+
+	if (isolation.cgroup[0])
+		rmdir(isolation.cgroup);
+	memset(&isolation, 0, sizeof(isolation));
+}
+
+/*
+ * Called in the test process before executing the test binary.
+ * Failures are reported in the test's stderr, the test still runs.
+ */
+static void isolate_test_process(struct settings *settings)
+{
+	if (isolation.enabled) {
+		char pid[16];
+
+		snprintf(pid, sizeof(pid), "%d", getpid());
+		if (isolation.cgroup[0] &&
+		    !write_cgroup_file("cgroup.procs", pid))
+			fprintf(stderr, "Cannot move to the test cgroup: %s\n",
+				strerror(errno));
+
+		/* The runner's own affinity was inherited */
+		if (sched_setaffinity(0, sizeof(isolation.cpus), &isolation.cpus))
+			fprintf(stderr, "Cannot set the test CPU affinity: %s\n",
+				strerror(errno));
+	}
+
+	if (settings->test_fifo_priority) {
+		struct sched_param param = {
+			.sched_priority = settings->test_fifo_priority,
+		};
+
+		if (sched_setscheduler(0, SCHED_FIFO, &param))
+			fprintf(stderr, "Cannot set SCHED_FIFO: %s\n",
+				strerror(errno));
+	} else if (settings->test_nice) {
+		if (setpriority(PRIO_PROCESS, 0, settings->test_nice))
+			fprintf(stderr, "Cannot set the nice value: %s\n",
+				strerror(errno));
+	}
+}
+
+/*
+ * Zygote mode: instead of executing the test binary for each job
+ * list entry, the binary is executed once with IGT_ZYGOTE_FD. It
+ * initializes and then forks a child for each subtest pattern sent
+ * to it over the socket, along with the stdout and stderr for it.
+ *
+ * The message types must match the ones in lib/igt_core.c.
+ */
+enum {
+	ZYGOTE_READY,
+	ZYGOTE_PID,
+	ZYGOTE_STATUS,
+};
+
+/* How long to wait for the zygote to initialize or fork, in ms */
+#define ZYGOTE_TIMEOUT 10000
+
+static struct {
+	pid_t pid;
+	int sock;
+	char *binary;
+} zygote = { .sock = -1 };
+
+static bool zygote_recv(int type, int *value, int timeout)
+{
+	struct pollfd pfd = { .fd = zygote.sock, .events = POLLIN };
+	int msg[2];
+
+	if (timeout > 0 && poll(&pfd, 1, timeout) <= 0)
+		return false;
+
+	if (recv(zygote.sock, msg, sizeof(msg), 0) != sizeof(msg) ||
+	    msg[0] != type)
+		return false;
+
+	*value = msg[1];
+	return true;
+}
+
+static void stop_zygote(void)
+{
+	sigset_t sigchld;
+	struct timespec notime = {};
+
+	free(zygote.binary);
+	zygote.binary = NULL;
+
+	if (zygote.sock < 0)
+		return;
+
+	close(zygote.sock);
+	zygote.sock = -1;
+
+	kill(zygote.pid, SIGKILL);
+	waitpid(zygote.pid, NULL, 0);
+
+	/* Don't let the zygote's SIGCHLD be seen as a test exiting */
+	sigemptyset(&sigchld);
+	sigaddset(&sigchld, SIGCHLD);
+	sigtimedwait(&sigchld, NULL, &notime);
+}
+
+static char *test_binary_path(struct settings *settings,
+			      struct job_list_entry *entry)
+{
+	size_t rootlen = strlen(settings->test_root);
+	char *path = malloc(rootlen + strlen(entry->binary) + 2);
+
+	strcpy(path, settings->test_root);
+	path[rootlen] = '/';
+	strcpy(path + rootlen + 1, entry->binary);
+
+	return path;
+}
+
+static char *subtest_pattern(struct job_list_entry *entry)
+{
+	size_t argsize;
+	char *pattern;
+	size_t i;
+
+	argsize = strlen(entry->subtests[0]);
+	pattern = malloc(argsize + 1);
+	strcpy(pattern, entry->subtests[0]);
+
+	for (i = 1; i < entry->subtest_count; i++) {
+		char *sub = entry->subtests[i];
+		size_t sublen = strlen(sub);
+
+		pattern = realloc(pattern, argsize + sublen + 2);
+		pattern[argsize] = ',';
+		strcpy(pattern + argsize + 1, sub);
+		argsize += sublen + 1;
+	}
+
+	return pattern;
+}
+
+static bool start_zygote(struct settings *settings,
+			 struct job_list_entry *entry,
+			 sigset_t *sigmask)
+{
+	int sv[2];
+	pid_t pid;
+	int value;
+
+	/* Also remembers the binaries that can't be zygotes */
+	if (zygote.binary && !strcmp(zygote.binary, entry->binary))
+		return zygote.sock >= 0;
+
+	stop_zygote();
+	zygote.binary = strdup(entry->binary);
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv))
+		return false;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if (pid < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return false;
+	} else if (pid == 0) {
+		char *argv[2] = { test_binary_path(settings, entry), NULL };
+		int nullfd = open("/dev/null", O_WRONLY);
+		char fdstr[16];
+
+		close(sv[0]);
+		fcntl(sv[1], F_SETFD, 0);
+		snprintf(fdstr, sizeof(fdstr), "%d", sv[1]);
+		setenv("IGT_ZYGOTE_FD", fdstr, 1);
+		setenv("IGT_SENTINEL_ON_STDERR", "1", 1);
+
+		/* The children get the real outputs from the requests */
+		dup2(nullfd, STDOUT_FILENO);
+		dup2(nullfd, STDERR_FILENO);
+
+		setpgid(0, 0);
+		sigprocmask(SIG_UNBLOCK, sigmask, NULL);
+		isolate_test_process(settings);
+
+		execv(argv[0], argv);
+		exit(IGT_EXIT_INVALID);
+	}
+
+	close(sv[1]);
+	zygote.pid = pid;
+	zygote.sock = sv[0];
+
+	if (!zygote_recv(ZYGOTE_READY, &value, ZYGOTE_TIMEOUT)) {
+		if (settings->log_level >= LOG_LEVEL_VERBOSE)
+			printf("Cannot use %s as a zygote, executing it normally\n",
+			       entry->binary);
+		stop_zygote();
+		zygote.binary = strdup(entry->binary);
+		return false;
+	}
+
+	return true;
+}
+
+/* Returns the pid of the test process, or -1 on failure */
+static pid_t spawn_from_zygote(struct job_list_entry *entry,
+			       int outfd, int errfd, int eventfd)
+{
+	char *pattern = subtest_pattern(entry);
+	char control[CMSG_SPACE(3 * sizeof(int))] = {};
+	struct iovec iov = {
+		.iov_base = pattern,
+		.iov_len = strlen(pattern),
+	};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	int fds[3] = { outfd, errfd, eventfd };
+	ssize_t sent;
+	int pid;
+
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	sent = sendmsg(zygote.sock, &msg, MSG_NOSIGNAL);
+	free(pattern);
+
+	if (sent < 0 || !zygote_recv(ZYGOTE_PID, &pid, ZYGOTE_TIMEOUT) ||
+	    pid <= 0)
+		return -1;
+
+	return pid;
 }
 
 static bool kill_child(int sig, pid_t child)
@@ -463,6 +1440,123 @@ static bool kill_child(int sig, pid_t child)
 	return true;
 }
 
+/*
+ * Engine busyness while a test runs, sampled from the i915 PMU. The
+ * counters are system-wide, which is what we want as only one test
+ * runs at a time. Engines the PMU doesn't know about are skipped.
+ */
+#define MAX_PMU_ENGINES 16
+
+struct engine_busy {
+	int fd[MAX_PMU_ENGINES];
+	uint64_t busy[MAX_PMU_ENGINES];
+	bool valid[MAX_PMU_ENGINES];
+};
+
+static bool pmu_read(int fd, uint64_t *value)
+{
+	uint64_t data[2]; /* value, time enabled */
+
+	if (read(fd, data, sizeof(data)) != sizeof(data))
+		return false;
+
+	*value = data[0];
+	return true;
+}
+
+static void engine_busy_start(struct engine_busy *busy)
+{
+	const struct intel_execution_engine2 *e;
+	int i;
+
+	for (i = 0; i < MAX_PMU_ENGINES; i++) {
+		busy->fd[i] = -1;
+		busy->valid[i] = false;
+	}
+
+	/* No point in probing every engine without the PMU */
+	if (i915_type_id() == 0)
+		return;
+
+	for (e = intel_execution_engines2, i = 0;
+	     e->name && i < MAX_PMU_ENGINES; e++, i++) {
+		busy->fd[i] = perf_i915_open(I915_PMU_ENGINE_BUSY(e->class,
+								  e->instance));
+		if (busy->fd[i] >= 0)
+			busy->valid[i] = pmu_read(busy->fd[i], &busy->busy[i]);
+	}
+}
+
+/* Turns the counters into the busy time during the test, in ns */
+static void engine_busy_stop(struct engine_busy *busy)
+{
+	uint64_t now;
+	int i;
+
+	for (i = 0; i < MAX_PMU_ENGINES; i++) {
+		if (busy->fd[i] < 0)
+			continue;
+
+		/* A failing read means the driver went away, e.g. module reload */
+		if (busy->valid[i] && pmu_read(busy->fd[i], &now) &&
+		    now >= busy->busy[i])
+			busy->busy[i] = now - busy->busy[i];
+		else
+			busy->valid[i] = false;
+
+		close(busy->fd[i]);
+		busy->fd[i] = -1;
+	}
+}
+
+static double timeval_double(const struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+/*
+ * Appends the resource usage of a test execution to the resources
+ * file. A test directory gets several executions if it's resumed,
+ * resultgen sums them up.
+ *
+ * Usage is not available for tests spawned by a zygote as they are
+ * not our children; only the engine busyness gets written for them.
+ */
+static void write_resources(int dirfd, const struct rusage *usage,
+			    const struct engine_busy *busy,
+			    struct settings *settings)
+{
+	const struct intel_execution_engine2 *e;
+	int fd, i;
+
+	fd = openat(dirfd, RESOURCES_FILENAME,
+		    O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+	if (fd < 0)
+		return;
+
+	if (usage->ru_maxrss) {
+		dprintf(fd, "%s%.6f\n", RESOURCE_USER_TIME,
+			timeval_double(&usage->ru_utime));
+		dprintf(fd, "%s%.6f\n", RESOURCE_SYSTEM_TIME,
+			timeval_double(&usage->ru_stime));
+		dprintf(fd, "%s%ld\n", RESOURCE_MAX_RSS, usage->ru_maxrss);
+	}
+
+	for (e = intel_execution_engines2, i = 0;
+	     e->name && i < MAX_PMU_ENGINES; e++, i++) {
+		if (!busy->valid[i])
+			continue;
+
+		dprintf(fd, "%s%s:%.6f\n", RESOURCE_ENGINE_BUSY, e->name,
+			busy->busy[i] / 1e9);
+	}
+
+	if (settings->sync)
+		fdatasync(fd);
+
+	close(fd);
+}
+
 /*
  * Returns:
  *  =0 - Success
@@ -471,8 +1565,11 @@ static bool kill_child(int sig, pid_t child)
  */
 static int monitor_output(pid_t child,
 			   int outfd, int errfd, int kmsgfd, int sigfd,
+			   int statusfd,
+			   int inactivity_timeout,
 			   int *outputs,
 			   double *time_spent,
+			   struct rusage *usage,
 			   struct settings *settings)
 {
 	fd_set set;
@@ -484,15 +1581,20 @@ static int monitor_output(pid_t child,
 	ssize_t s;
 	int n, status;
 	int nfds = outfd;
-	int timeout = settings->inactivity_timeout;
+	int timeout = inactivity_timeout;
 	int timeout_intervals = 1, intervals_left;
 	int wd_extra = 10;
 	int killed = 0; /* 0 if not killed, signal number otherwise */
 	struct timespec time_beg, time_end;
 	unsigned long taints = 0;
 	bool aborting = false;
+	bool failed = false;
+	bool zygote_child = statusfd >= 0;
+	bool zygote_exited = false;
+	struct kmsg_buffer kmsg;
 
 	igt_gettime(&time_beg);
+	kmsg_buffer_init(&kmsg, outputs[_F_DMESG], settings);
 
 	if (errfd > nfds)
 		nfds = errfd;
@@ -500,6 +1602,8 @@ static int monitor_output(pid_t child,
 		nfds = kmsgfd;
 	if (sigfd > nfds)
 		nfds = sigfd;
+	if (statusfd > nfds)
+		nfds = statusfd;
 	nfds++;
 
 	if (timeout > 0) {
@@ -539,10 +1643,13 @@ static int monitor_output(pid_t child,
 			FD_SET(kmsgfd, &set);
 		if (sigfd >= 0)
 			FD_SET(sigfd, &set);
+		if (statusfd >= 0)
+			FD_SET(statusfd, &set);
 
 		n = select(nfds, &set, NULL, NULL, timeout == 0 ? NULL : &tv);
 		if (n < 0) {
 			/* TODO */
+			kmsg_buffer_fini(&kmsg);
 			return -1;
 		}
 
@@ -560,8 +1667,10 @@ static int monitor_output(pid_t child,
 				}
 
 				killed = SIGQUIT;
-				if (!kill_child(killed, child))
+				if (!kill_child(killed, child)) {
+					kmsg_buffer_fini(&kmsg);
 					return -1;
+				}
 
 				/*
 				 * Now continue the loop and let the
@@ -578,8 +1687,10 @@ static int monitor_output(pid_t child,
 				}
 
 				killed = SIGKILL;
-				if (!kill_child(killed, child))
+				if (!kill_child(killed, child)) {
+					kmsg_buffer_fini(&kmsg);
 					return -1;
+				}
 
 				intervals_left = timeout_intervals = 1;
 				break;
@@ -605,6 +1716,7 @@ static int monitor_output(pid_t child,
 				close(outfd);
 				close(errfd);
 				close(kmsgfd);
+				kmsg_buffer_fini(&kmsg);
 				return -1;
 			}
 
@@ -646,6 +1758,10 @@ static int monitor_output(pid_t child,
 				    !memcmp(outbuf, STARTING_SUBTEST, strlen(STARTING_SUBTEST))) {
 					write(outputs[_F_JOURNAL], outbuf + strlen(STARTING_SUBTEST),
 					      linelen - strlen(STARTING_SUBTEST));
+					write_journal_record(JOURNAL_SUBTEST,
+							     subtest_hash(outbuf + strlen(STARTING_SUBTEST),
+									  linelen - strlen(STARTING_SUBTEST) - 1),
+							     0);
 					memcpy(current_subtest, outbuf + strlen(STARTING_SUBTEST),
 					       linelen - strlen(STARTING_SUBTEST));
 					current_subtest[linelen - strlen(STARTING_SUBTEST)] = '\0';
@@ -670,6 +1786,10 @@ static int monitor_output(pid_t child,
 							if (settings->sync) {
 								fdatasync(outputs[_F_JOURNAL]);
 							}
+							write_journal_record(JOURNAL_SUBTEST,
+									     subtest_hash(outbuf + strlen(SUBTEST_RESULT),
+											  subtestlen),
+									     0);
 							current_subtest[0] = '\0';
 						}
 
@@ -703,45 +1823,51 @@ static int monitor_output(pid_t child,
 		}
 
 		if (kmsgfd >= 0 && FD_ISSET(kmsgfd, &set)) {
-			s = read(kmsgfd, buf, sizeof(buf));
-			if (s < 0) {
-				if (errno != EPIPE && errno != EINVAL) {
-					fprintf(stderr, "Error reading from kmsg, stopping monitoring: %s\n",
-						strerror(errno));
-					close(kmsgfd);
-					kmsgfd = -1;
-				} else if (errno == EINVAL) {
-					fprintf(stderr, "Warning: Buffer too small for kernel log record, record lost.\n");
-				}
+			if (!kmsg_buffer_drain(&kmsg, kmsgfd)) {
+				close(kmsgfd);
+				kmsgfd = -1;
+			}
+		}
+
+		if (statusfd >= 0 && FD_ISSET(statusfd, &set)) {
+			int wstatus;
+
+			/*
+			 * A zygote child is not our child, its exit
+			 * status comes from the zygote instead of a
+			 * SIGCHLD.
+			 */
+			if (zygote_recv(ZYGOTE_STATUS, &wstatus, 0)) {
+				status = exitcode_from_wait_status(wstatus);
 			} else {
-				write(outputs[_F_DMESG], buf, s);
-				if (settings->sync) {
-					fdatasync(outputs[_F_DMESG]);
-				}
+				fprintf(stderr, "Lost connection to the zygote\n");
+				kill_child(SIGKILL, child);
+				status = 9999;
 			}
+
+			statusfd = -1;
+			zygote_exited = true;
 		}
 
-		if (sigfd >= 0 && FD_ISSET(sigfd, &set)) {
+		if (zygote_exited || (sigfd >= 0 && FD_ISSET(sigfd, &set))) {
 			double time;
 
-			s = read(sigfd, &siginfo, sizeof(siginfo));
-			if (s < 0) {
+			if (zygote_exited) {
+				zygote_exited = false;
+			} else if (read(sigfd, &siginfo, sizeof(siginfo)) < 0) {
 				fprintf(stderr, "Error reading from signalfd: %s\n",
 					strerror(errno));
 				continue;
 			} else if (siginfo.ssi_signo == SIGCHLD) {
-				if (child != waitpid(child, &status, WNOHANG)) {
+				/* Only the zygote can be our child */
+				if (zygote_child)
+					continue;
+
+				if (child != wait4(child, &status, WNOHANG, usage)) {
 					fprintf(stderr, "Failed to reap child\n");
 					status = 9999;
-				} else if (WIFEXITED(status)) {
-					status = WEXITSTATUS(status);
-					if (status >= 128) {
-						status = 128 - status;
-					}
-				} else if (WIFSIGNALED(status)) {
-					status = -WTERMSIG(status);
 				} else {
-					status = 9999;
+					status = exitcode_from_wait_status(status);
 				}
 			} else {
 				/* We're dying, so we're taking them with us */
@@ -752,12 +1878,18 @@ static int monitor_output(pid_t child,
 				aborting = true;
 				timeout = 2;
 				killed = SIGQUIT;
-				if (!kill_child(killed, child))
+				if (!kill_child(killed, child)) {
+					kmsg_buffer_fini(&kmsg);
 					return -1;
+				}
 
 				continue;
 			}
 
+			if (killed ||
+			    (status != IGT_EXIT_SUCCESS && status != IGT_EXIT_SKIP))
+				failed = true;
+
 			igt_gettime(&time_end);
 
 			time = igt_time_elapsed(&time_beg, &time_end);
@@ -771,6 +1903,8 @@ static int monitor_output(pid_t child,
 				if (settings->sync) {
 					fdatasync(outputs[_F_JOURNAL]);
 				}
+				write_journal_record(killed ? JOURNAL_TIMEOUT : JOURNAL_EXIT,
+						     0, status);
 
 				if (time_spent)
 					*time_spent = time;
@@ -781,9 +1915,10 @@ static int monitor_output(pid_t child,
 		}
 	}
 
-	dump_dmesg(kmsgfd, outputs[_F_DMESG]);
-	if (settings->sync)
-		fdatasync(outputs[_F_DMESG]);
+	dump_dmesg(kmsgfd, &kmsg);
+	if (failed || aborting)
+		kmsg_buffer_flush(&kmsg);
+	kmsg_buffer_fini(&kmsg);
 
 	free(outbuf);
 	close(outfd);
@@ -797,42 +1932,30 @@ static int monitor_output(pid_t child,
 }
 
 static void __attribute__((noreturn))
-execute_test_process(int outfd, int errfd,
+execute_test_process(int outfd, int errfd, int eventfd,
 		     struct settings *settings,
 		     struct job_list_entry *entry)
 {
 	char *argv[4] = {};
-	size_t rootlen;
+	char fdstr[16];
 
 	dup2(outfd, STDOUT_FILENO);
 	dup2(errfd, STDERR_FILENO);
 
+	/* dup() drops O_CLOEXEC */
+	if ((eventfd = dup(eventfd)) >= 0) {
+		snprintf(fdstr, sizeof(fdstr), "%d", eventfd);
+		setenv("IGT_EVENT_FD", fdstr, 1);
+	}
+
 	setpgid(0, 0);
+	isolate_test_process(settings);
 
-	rootlen = strlen(settings->test_root);
-	argv[0] = malloc(rootlen + strlen(entry->binary) + 2);
-	strcpy(argv[0], settings->test_root);
-	argv[0][rootlen] = '/';
-	strcpy(argv[0] + rootlen + 1, entry->binary);
+	argv[0] = test_binary_path(settings, entry);
 
 	if (entry->subtest_count) {
-		size_t argsize;
-		size_t i;
-
 		argv[1] = strdup("--run-subtest");
-		argsize = strlen(entry->subtests[0]);
-		argv[2] = malloc(argsize + 1);
-		strcpy(argv[2], entry->subtests[0]);
-
-		for (i = 1; i < entry->subtest_count; i++) {
-			char *sub = entry->subtests[i];
-			size_t sublen = strlen(sub);
-
-			argv[2] = realloc(argv[2], argsize + sublen + 2);
-			argv[2][argsize] = ',';
-			strcpy(argv[2] + argsize + 1, sub);
-			argsize += sublen + 1;
-		}
+		argv[2] = subtest_pattern(entry);
 	}
 
 	execv(argv[0], argv);
@@ -864,7 +1987,7 @@ static void print_time_left(struct execute_state *state,
 	printf("(%*.0fs left) ", width, state->time_left);
 }
 
-static char *entry_display_name(struct job_list_entry *entry)
+char *entry_display_name(struct job_list_entry *entry)
 {
 	size_t size = strlen(entry->binary) + 1;
 	char *ret = malloc(size);
@@ -901,6 +2024,18 @@ static char *entry_display_name(struct job_list_entry *entry)
  *  <0 - Failure executing
  *  >0 - Timeout happened, need to recreate from journal
  */
+/* Timeouts from --adaptive-timeout only ever shorten the global one */
+static int entry_timeout(struct settings *settings,
+			 struct job_list_entry *entry)
+{
+	if (entry->timeout > 0 &&
+	    (settings->inactivity_timeout <= 0 ||
+	     entry->timeout < settings->inactivity_timeout))
+		return entry->timeout;
+
+	return settings->inactivity_timeout;
+}
+
 static int execute_next_entry(struct execute_state *state,
 			      size_t total,
 			      double *time_spent,
@@ -916,18 +2051,31 @@ static int execute_next_entry(struct execute_state *state,
 	int errpipe[2] = { -1, -1 };
 	int outfd, errfd;
 	char name[32];
-	pid_t child;
+	pid_t child = 0;
+	int statusfd = -1;
+	struct rusage usage = {};
+	struct engine_busy busy;
 	int result;
 	size_t idx = state->next;
 
+	/* Started first so that it doesn't inherit this entry's fds */
+	if (settings->use_zygote && entry->subtest_count > 0 &&
+	    start_zygote(settings, entry, sigmask))
+		statusfd = zygote.sock;
+
 	snprintf(name, sizeof(name), "%zd", idx);
 	mkdirat(resdirfd, name, 0777);
+
+	binary_journal.entry = idx;
+	write_journal_record(JOURNAL_START, 0, 0);
 	if ((dirfd = openat(resdirfd, name, O_DIRECTORY | O_RDONLY | O_CLOEXEC)) < 0) {
 		fprintf(stderr, "Error accessing individual test result directory\n");
 		return -1;
 	}
 
-	if (!open_output_files(dirfd, outputs, true)) {
+	if (settings->compress_outputs ?
+	    !open_compressed_output_files(dirfd, outputs, settings) :
+	    !open_output_files(dirfd, outputs, true)) {
 		fprintf(stderr, "Error opening output files\n");
 		result = -1;
 		goto out_dirfd;
@@ -944,7 +2092,7 @@ static int execute_next_entry(struct execute_state *state,
 		goto out_pipe;
 	}
 
-	if ((kmsgfd = open("/dev/kmsg", O_RDONLY | O_CLOEXEC)) < 0) {
+	if ((kmsgfd = open("/dev/kmsg", O_RDONLY | O_CLOEXEC | O_NONBLOCK)) < 0) {
 		fprintf(stderr, "Warning: Cannot open /dev/kmsg\n");
 	} else {
 		/* TODO: Checking of abort conditions in pre-execute dmesg */
@@ -973,10 +2121,24 @@ static int execute_next_entry(struct execute_state *state,
 	fflush(stdout);
 	fflush(stderr);
 
-	child = fork();
+	if (statusfd >= 0 &&
+	    (child = spawn_from_zygote(entry, outpipe[1], errpipe[1],
+					outputs[_F_EVENTS])) < 0) {
+		/* Start a fresh zygote for the next entry */
+		fprintf(stderr, "Zygote failed to spawn the test, executing it normally\n");
+		stop_zygote();
+		statusfd = -1;
+		child = 0;
+	}
+
+	engine_busy_start(&busy);
+
+	if (child == 0)
+		child = fork();
 	if (child < 0) {
 		fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
 		result = -1;
+		engine_busy_stop(&busy);
 		goto out_kmsgfd;
 	} else if (child == 0) {
 		outfd = outpipe[1];
@@ -988,7 +2150,8 @@ static int execute_next_entry(struct execute_state *state,
 
 		setenv("IGT_SENTINEL_ON_STDERR", "1", 1);
 
-		execute_test_process(outfd, errfd, settings, entry);
+		execute_test_process(outfd, errfd, outputs[_F_EVENTS],
+				     settings, entry);
 		/* unreachable */
 	}
 
@@ -999,7 +2162,16 @@ static int execute_next_entry(struct execute_state *state,
 	outpipe[1] = errpipe[1] = -1;
 
 	result = monitor_output(child, outfd, errfd, kmsgfd, sigfd,
-				outputs, time_spent, settings);
+				statusfd, entry_timeout(settings, entry),
+				outputs, time_spent, &usage, settings);
+	engine_busy_stop(&busy);
+
+	if (result >= 0)
+		write_resources(dirfd, &usage, &busy, settings);
+
+	/* Don't reuse a zygote after a timeout or an abort */
+	if (statusfd >= 0 && result != 0)
+		stop_zygote();
 
 out_kmsgfd:
 	close(kmsgfd);
@@ -1034,6 +2206,25 @@ static bool clear_test_result_directory(int dirfd)
 		}
 	}
 
+	for (i = 0; i < _F_LAST; i++) {
+		char name[PATH_MAX];
+
+		snprintf(name, sizeof(name), "%s%s", filenames[i], COMPRESSED_SUFFIX);
+		if (remove_file(dirfd, name)) {
+			fprintf(stderr, "Error deleting %s from test result directory: %s\n",
+				name,
+				strerror(errno));
+			return false;
+		}
+	}
+
+	if (remove_file(dirfd, RESOURCES_FILENAME)) {
+		fprintf(stderr, "Error deleting %s from test result directory: %s\n",
+			RESOURCES_FILENAME,
+			strerror(errno));
+		return false;
+	}
+
 	return true;
 }
 
@@ -1055,7 +2246,8 @@ static bool clear_old_results(char *path)
 	if (remove_file(dirfd, "uname.txt") ||
 	    remove_file(dirfd, "starttime.txt") ||
 	    remove_file(dirfd, "endtime.txt") ||
-	    remove_file(dirfd, "aborted.txt")) {
+	    remove_file(dirfd, "aborted.txt") ||
+	    remove_file(dirfd, PROBE_CACHE_FILENAME)) {
 		close(dirfd);
 		fprintf(stderr, "Error clearing old results: %s\n", strerror(errno));
 		return false;
@@ -1087,15 +2279,6 @@ static bool clear_old_results(char *path)
 	return true;
 }
 
-static double timeofday_double(void)
-{
-	struct timeval tv;
-
-	if (!gettimeofday(&tv, NULL))
-		return tv.tv_sec + tv.tv_usec / 1000000.0;
-	return 0.0;
-}
-
 static void init_time_left(struct execute_state *state,
 			   struct settings *settings)
 {
@@ -1111,7 +2294,9 @@ bool initialize_execute_state_from_resume(int dirfd,
 					  struct job_list *list)
 {
 	struct job_list_entry *entry;
-	int resdirfd, fd, i;
+	struct journal_record record;
+	int resdirfd = -1, fd, i;
+	char name[32];
 
 	free_settings(settings);
 	free_job_list(list);
@@ -1126,17 +2311,33 @@ bool initialize_execute_state_from_resume(int dirfd,
 
 	init_time_left(state, settings);
 
-	for (i = list->size; i >= 0; i--) {
-		char name[32];
+	if (read_last_journal_record(dirfd, &record) &&
+	    record.entry < list->size) {
+		/*
+		 * The binary journal tells the last entry that was
+		 * started without scanning for the directories.
+		 */
+		i = record.entry;
+		state->next = i + 1;
+
+		/* Fully completed */
+		if (record.type == JOURNAL_EXIT)
+			goto success;
 
 		snprintf(name, sizeof(name), "%d", i);
-		if ((resdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) >= 0)
-			break;
-	}
+		if ((resdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) < 0)
+			goto success;
+	} else {
+		for (i = list->size; i >= 0; i--) {
+			snprintf(name, sizeof(name), "%d", i);
+			if ((resdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) >= 0)
+				break;
+		}
 
-	if (i < 0)
-		/* Nothing has been executed yet, state is fine as is */
-		goto success;
+		if (i < 0)
+			/* Nothing has been executed yet, state is fine as is */
+			goto success;
+	}
 
 	entry = &list->entries[i];
 	state->next = i;
@@ -1277,12 +2478,219 @@ static bool should_die_because_signal(int sigfd)
 	return false;
 }
 
+static void init_worker_settings(struct settings *worker,
+				 struct settings *settings,
+				 size_t idx)
+{
+	*worker = *settings;
+
+	/* The job list is already filtered, regexes are not needed */
+	memset(&worker->include_regexes, 0, sizeof(worker->include_regexes));
+	memset(&worker->exclude_regexes, 0, sizeof(worker->exclude_regexes));
+
+	worker->test_list = settings->test_list ? strdup(settings->test_list) : NULL;
+	worker->name = settings->name ? strdup(settings->name) : NULL;
+	worker->test_root = strdup(settings->test_root);
+	asprintf(&worker->results_path, "%s/" WORKER_DIRNAME,
+		 settings->results_path, idx);
+	worker->devices = get_device(settings, idx);
+	worker->num_workers = 0;
+
+	/*
+	 * Hardware watchdogs can only be opened once, and a single
+	 * worker cannot keep them fed for everyone.
+	 */
+	worker->use_watchdog = false;
+}
+
+static void __attribute__((noreturn))
+execute_worker(struct execute_state *state,
+	       struct settings *settings,
+	       struct job_list *job_list,
+	       int resdirfd, size_t idx)
+{
+	struct execute_state worker_state;
+	struct settings worker_settings;
+	struct job_list worker_list;
+	char name[32];
+	int dirfd;
+	bool ok;
+
+	init_settings(&worker_settings);
+	init_job_list(&worker_list);
+
+	snprintf(name, sizeof(name), WORKER_DIRNAME, idx);
+	dirfd = openat(resdirfd, name, O_DIRECTORY | O_RDONLY);
+
+	if (state->resuming && dirfd >= 0 &&
+	    faccessat(dirfd, "metadata.txt", F_OK, 0) == 0) {
+		/* Closes dirfd for us */
+		ok = initialize_execute_state_from_resume(dirfd, &worker_state,
+							 &worker_settings,
+							 &worker_list);
+	} else {
+		if (dirfd >= 0)
+			close(dirfd);
+
+		init_worker_settings(&worker_settings, settings, idx);
+		shard_job_list(&worker_list, job_list, idx, settings->num_workers);
+		ok = initialize_execute_state(&worker_state, &worker_settings,
+					      &worker_list);
+	}
+
+	if (!ok)
+		exit(1);
+
+	if (settings->log_level >= LOG_LEVEL_VERBOSE)
+		printf("Worker %zd: %zd jobs%s%s\n", idx, worker_list.size,
+		       worker_settings.devices ? " on " : "",
+		       worker_settings.devices ?: "");
+
+	ok = execute(&worker_state, &worker_settings, &worker_list);
+
+	free_settings(&worker_settings);
+	free_job_list(&worker_list);
+
+	if (!ok)
+		exit(1);
+	if (worker_state.time_left == 0.0)
+		exit(2);
+	exit(0);
+}
+
+/*
+ * Forwards termination signals to the workers and waits until all of
+ * them have exited.
+ */
+static bool wait_workers(pid_t *workers, size_t num_workers,
+			 struct execute_state *state,
+			 struct settings *settings)
+{
+	struct signalfd_siginfo siginfo;
+	size_t running = num_workers;
+	bool status = true;
+	sigset_t sigmask;
+	int sigfd;
+	size_t i;
+
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGCHLD);
+	sigaddset(&sigmask, SIGINT);
+	sigaddset(&sigmask, SIGTERM);
+	sigaddset(&sigmask, SIGQUIT);
+	sigaddset(&sigmask, SIGHUP);
+	sigfd = signalfd(-1, &sigmask, O_CLOEXEC);
+
+	while (running) {
+		int wstatus;
+		pid_t pid;
+
+		if (sigfd >= 0 &&
+		    read(sigfd, &siginfo, sizeof(siginfo)) == sizeof(siginfo) &&
+		    siginfo.ssi_signo != SIGCHLD) {
+			if (settings->log_level >= LOG_LEVEL_NORMAL)
+				printf("Abort requested via %s, terminating workers\n",
+				       strsignal(siginfo.ssi_signo));
+
+			for (i = 0; i < num_workers; i++)
+				if (workers[i] > 0)
+					kill(workers[i], siginfo.ssi_signo);
+			status = false;
+			continue;
+		}
+
+		while ((pid = waitpid(-1, &wstatus, sigfd >= 0 ? WNOHANG : 0)) > 0) {
+			for (i = 0; i < num_workers; i++) {
+				if (workers[i] != pid)
+					continue;
+
+				workers[i] = 0;
+				running--;
+
+				if (!WIFEXITED(wstatus)) {
+					fprintf(stderr, "Worker %zd died unexpectedly\n", i);
+					status = false;
+				} else if (WEXITSTATUS(wstatus) == 2) {
+					state->time_left = 0.0;
+				} else if (WEXITSTATUS(wstatus) != 0) {
+					status = false;
+				}
+			}
+		}
+
+		if (pid < 0 && errno == ECHILD)
+			break;
+	}
+
+	close(sigfd);
+	return status;
+}
+
+/*
+ * Shards the job list across settings->num_workers worker processes,
+ * each executing in its own results subdirectory. Device assignment
+ * happens through IGT_FORCE_DEVICE in the environment of the worker.
+ */
+static bool execute_parallel(struct execute_state *state,
+			     struct settings *settings,
+			     struct job_list *job_list,
+			     int resdirfd)
+{
+	size_t num_workers = settings->num_workers;
+	pid_t *workers = calloc(num_workers, sizeof(*workers));
+	sigset_t sigmask, oldmask;
+	bool status = true;
+	int timefd;
+	size_t i;
+
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGCHLD);
+	sigaddset(&sigmask, SIGINT);
+	sigaddset(&sigmask, SIGTERM);
+	sigaddset(&sigmask, SIGQUIT);
+	sigaddset(&sigmask, SIGHUP);
+	sigprocmask(SIG_BLOCK, &sigmask, &oldmask);
+
+	for (i = 0; i < num_workers; i++) {
+		/* Don't duplicate our buffered output in the workers */
+		fflush(stdout);
+		fflush(stderr);
+
+		workers[i] = fork();
+		if (workers[i] < 0) {
+			fprintf(stderr, "Failed to fork worker %zd: %s\n",
+				i, strerror(errno));
+			workers[i] = 0;
+			status = false;
+			break;
+		} else if (workers[i] == 0) {
+			execute_worker(state, settings, job_list, resdirfd, i);
+			/* unreachable */
+		}
+	}
+
+	if (!wait_workers(workers, num_workers, state, settings))
+		status = false;
+
+	sigprocmask(SIG_SETMASK, &oldmask, NULL);
+	free(workers);
+
+	if (status &&
+	    (timefd = openat(resdirfd, "endtime.txt", O_CREAT | O_WRONLY | O_EXCL, 0666)) >= 0) {
+		dprintf(timefd, "%f\n", timeofday_double());
+		close(timefd);
+	}
+
+	return status;
+}
+
 bool execute(struct execute_state *state,
 	     struct settings *settings,
 	     struct job_list *job_list)
 {
 	struct utsname unamebuf;
 	int resdirfd, testdirfd, unamefd, timefd;
+	char *probe_cache;
 	sigset_t sigmask;
 	int sigfd;
 	double time_spent = 0.0;
@@ -1326,7 +2734,47 @@ bool execute(struct execute_state *state,
 		close(timefd);
 	}
 
+	if (!uname(&unamebuf)) {
+		dprintf(unamefd, "%s %s %s %s %s\n",
+			unamebuf.sysname,
+			unamebuf.nodename,
+			unamebuf.release,
+			unamebuf.version,
+			unamebuf.machine);
+	} else {
+		dprintf(unamefd, "uname() failed\n");
+	}
+	close(unamefd);
+
+	if (settings->num_workers > 1) {
+		close(testdirfd);
+		status = execute_parallel(state, settings, job_list, resdirfd);
+		close(resdirfd);
+		return status;
+	}
+
+	if (settings->coordinator_port) {
+		close(testdirfd);
+		status = execute_coordinator(state, settings, job_list, resdirfd);
+		close(resdirfd);
+		return status;
+	}
+
+	if (settings->devices) {
+		char *device = get_device(settings, 0);
+
+		setenv("IGT_FORCE_DEVICE", device, 1);
+		free(device);
+	}
+
+	if (asprintf(&probe_cache, "%s/" PROBE_CACHE_FILENAME,
+		     settings->results_path) > 0) {
+		setenv("IGT_PROBE_CACHE", probe_cache, 1);
+		free(probe_cache);
+	}
+
 	oom_immortal();
+	setup_test_isolation(settings);
 
 	sigemptyset(&sigmask);
 	sigaddset(&sigmask, SIGCHLD);
@@ -1345,18 +2793,7 @@ bool execute(struct execute_state *state,
 	}
 
 	init_watchdogs(settings);
-
-	if (!uname(&unamebuf)) {
-		dprintf(unamefd, "%s %s %s %s %s\n",
-			unamebuf.sysname,
-			unamebuf.nodename,
-			unamebuf.release,
-			unamebuf.version,
-			unamebuf.machine);
-	} else {
-		dprintf(unamefd, "uname() failed\n");
-	}
-	close(unamefd);
+	open_binary_journal(resdirfd, settings);
 
 	/* Check if we're already in abort-state at bootup */
 	if (!state->resuming) {
@@ -1397,6 +2834,12 @@ bool execute(struct execute_state *state,
 			break;
 		}
 
+		if (settings->incremental_results &&
+		    !append_incremental_results(resdirfd, state->next,
+						&job_list->entries[state->next],
+						settings))
+			fprintf(stderr, "Warning: Cannot record incremental results\n");
+
 		reduce_time_left(settings, state, time_spent);
 
 		if (overall_timeout_exceeded(state)) {
@@ -1430,6 +2873,7 @@ bool execute(struct execute_state *state,
 				status = false;
 				goto end_post_signal_restore;
 			}
+			close_binary_journal();
 			close(sigfd);
 			close(testdirfd);
 			initialize_execute_state_from_resume(resdirfd, state, settings, job_list);
@@ -1450,6 +2894,9 @@ bool execute(struct execute_state *state,
 	if (should_die_because_signal(sigfd))
 		status = false;
  end_post_signal_restore:
+	stop_zygote();
+	teardown_test_isolation();
+	close_binary_journal();
 	close(sigfd);
 	close(testdirfd);
 	close(resdirfd);
@@ -1,6 +1,9 @@
 #ifndef RUNNER_EXECUTOR_H
 #define RUNNER_EXECUTOR_H
 
+#include <stdint.h>
+#include <stdio.h>
+
 #include "job_list.h"
 #include "settings.h"
 
@@ -22,9 +25,55 @@ enum {
 	_F_OUT,
 	_F_ERR,
 	_F_DMESG,
+	_F_EVENTS,
 	_F_LAST,
 };
 
+/*
+ * Resource usage of the test executions, written next to the output
+ * files when a test exits. Optional, as it's not there for results
+ * from older runners.
+ */
+#define RESOURCES_FILENAME "resources.txt"
+
+/*
+ * With settings->num_workers > 1, every worker slot executes its
+ * shard of the job list in a results subdirectory of its own. The
+ * subdirectory name is this format applied to the slot index.
+ */
+#define WORKER_DIRNAME "worker%zd"
+
+/*
+ * Connector probe results shared between the tests executed in the
+ * same results directory, handed to them in IGT_PROBE_CACHE.
+ */
+#define PROBE_CACHE_FILENAME "probe-cache.txt"
+
+/*
+ * The binary journal has a fixed size record for every start, subtest
+ * and exit of each executed job list entry, appended in order. The
+ * last entry started can be found with a single seek when resuming.
+ * The per-entry journal.txt files remain the authoritative,
+ * human-readable journals.
+ */
+#define BINARY_JOURNAL_FILENAME "journal.bin"
+
+enum journal_record_type {
+	JOURNAL_START,
+	JOURNAL_SUBTEST,
+	JOURNAL_EXIT,
+	JOURNAL_TIMEOUT,
+};
+
+struct journal_record
+{
+	uint32_t type;
+	uint32_t entry;
+	uint32_t subtest_hash;
+	int32_t result;
+	double timestamp;
+};
+
 bool open_output_files(int dirfd, int *fds, bool write);
 void close_outputs(int *fds);
 
@@ -53,5 +102,25 @@ bool execute(struct execute_state *state,
 	     struct settings *settings,
 	     struct job_list *job_list);
 
+/*
+ * Prunes the subtests recorded as started in the journal read from fd
+ * from entry, which gets an empty binary name if it's fully
+ * completed. The journal is read through a stdio stream on fd, which
+ * closes it.
+ *
+ * Returns: Whether the journal had any subtests, false meaning the
+ * entry is not suitable to re-run.
+ */
+bool prune_from_journal(struct job_list_entry *entry, int fd);
+
+/* A newly allocated name for entry, for the progress output */
+char *entry_display_name(struct job_list_entry *entry);
+
+/*
+ * Writes the binary journal in the results directory pointed to by
+ * dirfd to f as text, one record per line.
+ */
+bool dump_binary_journal(int dirfd, FILE *f);
+
 
 #endif
@@ -2,6 +2,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,13 +10,22 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <json.h>
+
 #include "job_list.h"
 #include "igt_core.h"
+#include "igt_stats.h"
+
+/* Shortest inactivity timeout --adaptive-timeout gives a test */
+#define ADAPTIVE_TIMEOUT_MIN 10
 
 static bool matches_any(const char *str, struct regex_list *list)
 {
 	size_t i;
 
+	if (list->combined)
+		return g_regex_match(list->combined, str, 0, NULL);
+
 	for (i = 0; i < list->size; i++) {
 		if (g_regex_match(list->regexes[i], str, 0, NULL))
 			return true;
@@ -38,12 +48,180 @@ static void add_job_list_entry(struct job_list *job_list,
 	entry->binary = binary;
 	entry->subtests = subtests;
 	entry->subtest_count = subtest_count;
+	entry->timeout = 0;
+}
+
+/*
+ * The subtests of the test binaries as listed at build time, for those
+ * binaries that still have the mtime they had then.
+ */
+struct subtest_index_entry {
+	char *binary;
+	char **subtests;
+	size_t subtest_count;
+};
+
+struct subtest_index {
+	struct subtest_index_entry *entries;
+	size_t size;
+};
+
+static const char subtest_index_filename[] = "subtest-index.txt";
+
+static void free_subtest_index_entry(struct subtest_index_entry *entry)
+{
+	size_t k;
+
+	for (k = 0; k < entry->subtest_count; k++)
+		free(entry->subtests[k]);
+	free(entry->subtests);
+	free(entry->binary);
+	memset(entry, 0, sizeof(*entry));
+}
+
+static void free_subtest_index(struct subtest_index *index)
+{
+	size_t i;
+
+	for (i = 0; i < index->size; i++)
+		free_subtest_index_entry(&index->entries[i]);
+	free(index->entries);
+	memset(index, 0, sizeof(*index));
+}
+
+static bool read_subtest_index_entry(FILE *f, int dirfd,
+				     struct subtest_index_entry *entry,
+				     bool *current)
+{
+	long long mtime;
+	struct stat st;
+	size_t k;
+
+	memset(entry, 0, sizeof(*entry));
+	if (fscanf(f, "%ms %lld %zu",
+		   &entry->binary, &mtime, &entry->subtest_count) != 3) {
+		free(entry->binary);
+		entry->binary = NULL;
+		entry->subtest_count = 0;
+		return false;
+	}
+
+	entry->subtests = calloc(entry->subtest_count, sizeof(*entry->subtests));
+	for (k = 0; k < entry->subtest_count; k++) {
+		if (fscanf(f, "%ms", &entry->subtests[k]) != 1) {
+			entry->subtest_count = k;
+			free_subtest_index_entry(entry);
+			return false;
+		}
+	}
+
+	*current = fstatat(dirfd, entry->binary, &st, 0) == 0 &&
+		st.st_mtime == mtime;
+
+	return true;
+}
+
+static void load_subtest_index(struct subtest_index *index, int dirfd)
+{
+	struct subtest_index_entry entry;
+	char header[32];
+	bool current;
+	FILE *f;
+	int fd;
+
+	memset(index, 0, sizeof(*index));
+
+	fd = openat(dirfd, subtest_index_filename, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	f = fdopen(fd, "r");
+	if (!f) {
+		close(fd);
+		return;
+	}
+
+	if (!fgets(header, sizeof(header), f) ||
+	    strcmp(header, "SUBTEST INDEX\n")) {
+		fclose(f);
+		return;
+	}
+
+	while (read_subtest_index_entry(f, dirfd, &entry, &current)) {
+		/* Rebuilt or replaced since, it gets listed again */
+		if (!current) {
+			free_subtest_index_entry(&entry);
+			continue;
+		}
+
+		index->size++;
+		index->entries = realloc(index->entries,
+					 index->size * sizeof(*index->entries));
+		index->entries[index->size - 1] = entry;
+	}
+
+	fclose(f);
+}
+
+static struct subtest_index_entry *
+find_in_subtest_index(struct subtest_index *index, const char *binary)
+{
+	size_t i;
+
+	for (i = 0; i < index->size; i++)
+		if (!strcmp(index->entries[i].binary, binary))
+			return &index->entries[i];
+
+	return NULL;
+}
+
+static void add_subtest(struct job_list *job_list, struct settings *settings,
+			char *binary, const char *subtestname,
+			struct regex_list *include, struct regex_list *exclude,
+			char ***subtests, size_t *num_subtests)
+{
+	char piglitname[256];
+
+	generate_piglit_name(binary, subtestname, piglitname, sizeof(piglitname));
+
+	if (exclude && exclude->size && matches_any(piglitname, exclude))
+		return;
+
+	if (include && include->size && !matches_any(piglitname, include))
+		return;
+
+	if (settings->multiple_mode) {
+		(*num_subtests)++;
+		*subtests = realloc(*subtests, *num_subtests * sizeof(**subtests));
+		(*subtests)[*num_subtests - 1] = strdup(subtestname);
+	} else {
+		char **single = malloc(sizeof(*single));
+
+		*single = strdup(subtestname);
+		add_job_list_entry(job_list, strdup(binary), single, 1);
+	}
+}
+
+static void add_without_subtests(struct job_list *job_list, char *binary,
+				 struct regex_list *include,
+				 struct regex_list *exclude)
+{
+	char piglitname[256];
+
+	generate_piglit_name(binary, NULL, piglitname, sizeof(piglitname));
+
+	if (exclude && exclude->size && matches_any(piglitname, exclude))
+		return;
+
+	if (!include || !include->size || matches_any(piglitname, include))
+		add_job_list_entry(job_list, strdup(binary), NULL, 0);
 }
 
 static void add_subtests(struct job_list *job_list, struct settings *settings,
-			 char *binary,
+			 char *binary, struct subtest_index *index,
 			 struct regex_list *include, struct regex_list *exclude)
 {
+	struct subtest_index_entry *indexed;
 	FILE *p;
 	char cmd[256] = {};
 	char *subtestname;
@@ -51,6 +229,23 @@ static void add_subtests(struct job_list *job_list, struct settings *settings,
 	size_t num_subtests = 0;
 	int s;
 
+	indexed = find_in_subtest_index(index, binary);
+	if (indexed) {
+		size_t i;
+
+		for (i = 0; i < indexed->subtest_count; i++)
+			add_subtest(job_list, settings, binary,
+				    indexed->subtests[i], include, exclude,
+				    &subtests, &num_subtests);
+
+		if (num_subtests)
+			add_job_list_entry(job_list, strdup(binary), subtests, num_subtests);
+		else if (!indexed->subtest_count)
+			add_without_subtests(job_list, binary, include, exclude);
+
+		return;
+	}
+
 	s = snprintf(cmd, sizeof(cmd), "%s/%s --list-subtests",
 		     settings->test_root, binary);
 	if (s < 0) {
@@ -73,31 +268,8 @@ static void add_subtests(struct job_list *job_list, struct settings *settings,
 	}
 
 	while (fscanf(p, "%ms", &subtestname) == 1) {
-		char piglitname[256];
-
-		generate_piglit_name(binary, subtestname, piglitname, sizeof(piglitname));
-
-		if (exclude && exclude->size && matches_any(piglitname, exclude)) {
-			free(subtestname);
-			continue;
-		}
-
-		if (include && include->size && !matches_any(piglitname, include)) {
-			free(subtestname);
-			continue;
-		}
-
-		if (settings->multiple_mode) {
-			num_subtests++;
-			subtests = realloc(subtests, num_subtests * sizeof(*subtests));
-			subtests[num_subtests - 1] = strdup(subtestname);
-		} else {
-			subtests = malloc(sizeof(*subtests));
-			*subtests = strdup(subtestname);
-			add_job_list_entry(job_list, strdup(binary), subtests, 1);
-			subtests = NULL;
-		}
-
+		add_subtest(job_list, settings, binary, subtestname,
+			    include, exclude, &subtests, &num_subtests);
 		free(subtestname);
 	}
 
@@ -110,22 +282,9 @@ static void add_subtests(struct job_list *job_list, struct settings *settings,
 	} else if (s == -1) {
 		fprintf(stderr, "popen error when executing %s: %s\n", binary, strerror(errno));
 	} else if (WIFEXITED(s)) {
-		if (WEXITSTATUS(s) == IGT_EXIT_INVALID) {
-			char piglitname[256];
-
-			generate_piglit_name(binary, NULL,
-					     piglitname, sizeof(piglitname));
-			/* No subtests on this one */
-			if (exclude && exclude->size &&
-			    matches_any(piglitname, exclude)) {
-				return;
-			}
-			if (!include || !include->size ||
-			    matches_any(piglitname, include)) {
-				add_job_list_entry(job_list, strdup(binary), NULL, 0);
-				return;
-			}
-		}
+		/* No subtests on this one */
+		if (WEXITSTATUS(s) == IGT_EXIT_INVALID)
+			add_without_subtests(job_list, binary, include, exclude);
 	} else {
 		fprintf(stderr, "Test binary %s died unexpectedly\n", binary);
 	}
@@ -133,8 +292,9 @@ static void add_subtests(struct job_list *job_list, struct settings *settings,
 
 static bool filtered_job_list(struct job_list *job_list,
 			      struct settings *settings,
-			      int fd)
+			      int dirfd, int fd)
 {
+	struct subtest_index index;
 	FILE *f;
 	char buf[128];
 	bool ok;
@@ -145,6 +305,7 @@ static bool filtered_job_list(struct job_list *job_list,
 	}
 
 	f = fdopen(fd, "r");
+	load_subtest_index(&index, dirfd);
 
 	while (fscanf(f, "%127s", buf) == 1) {
 		if (!strcmp(buf, "TESTLIST") || !(strcmp(buf, "END")))
@@ -171,7 +332,7 @@ static bool filtered_job_list(struct job_list *job_list,
 				 */
 				add_job_list_entry(job_list, strdup(buf), NULL, 0);
 			else
-				add_subtests(job_list, settings, buf,
+				add_subtests(job_list, settings, buf, &index,
 					     NULL, &settings->exclude_regexes);
 			continue;
 		}
@@ -179,11 +340,13 @@ static bool filtered_job_list(struct job_list *job_list,
 		/*
 		 * Binary name doesn't match exclude or include filters.
 		 */
-		add_subtests(job_list, settings, buf,
+		add_subtests(job_list, settings, buf, &index,
 			     &settings->include_regexes,
 			     &settings->exclude_regexes);
 	}
 
+	free_subtest_index(&index);
+
 	ok = job_list->size != 0;
 	if (!ok)
 		fprintf(stderr, "Filter didn't match any job name\n");
@@ -357,6 +520,167 @@ void generate_piglit_name(const char *binary, const char *subtest,
 	free(lc_subtest);
 }
 
+static bool lookup_runtime(struct json_object *root, const char *section,
+			   const char *piglit_name, double *time)
+{
+	struct json_object *sectionobj, *test, *timeobj, *end;
+
+	if (!json_object_object_get_ex(root, section, &sectionobj) ||
+	    !json_object_object_get_ex(sectionobj, piglit_name, &test) ||
+	    !json_object_object_get_ex(test, "time", &timeobj) ||
+	    !json_object_object_get_ex(timeobj, "end", &end))
+		return false;
+
+	*time = json_object_get_double(end);
+	return true;
+}
+
+/*
+ * Looks up the runtime of a job list entry in one results.json. For
+ * entries with subtests, the subtest runtimes are summed up. For
+ * entries that run the whole binary, the binary runtime is used.
+ */
+static bool entry_runtime(struct json_object *root,
+			  struct job_list_entry *entry,
+			  double *time)
+{
+	char piglit_name[256];
+	bool found = false;
+	size_t i;
+
+	*time = 0.0;
+
+	if (entry->subtest_count == 0) {
+		generate_piglit_name(entry->binary, NULL, piglit_name, sizeof(piglit_name));
+		return lookup_runtime(root, "runtimes", piglit_name, time) ||
+			lookup_runtime(root, "tests", piglit_name, time);
+	}
+
+	for (i = 0; i < entry->subtest_count; i++) {
+		double subtime;
+
+		generate_piglit_name(entry->binary, entry->subtests[i],
+				     piglit_name, sizeof(piglit_name));
+		if (lookup_runtime(root, "tests", piglit_name, &subtime)) {
+			*time += subtime;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+struct job_cost {
+	double time;
+	size_t idx;
+};
+
+static int cmp_job_cost(const void *a, const void *b)
+{
+	const struct job_cost *one = a, *two = b;
+
+	if (one->time > two->time)
+		return -1;
+	if (one->time < two->time)
+		return 1;
+
+	/* Keep the original order for equal runtimes */
+	return one->idx < two->idx ? -1 : one->idx > two->idx;
+}
+
+static void sort_by_runtime_history(struct job_list *job_list,
+				    struct settings *settings)
+{
+	struct json_object **roots;
+	struct job_cost *costs;
+	struct job_list_entry *sorted;
+	size_t num_roots = 0, known = 0, timeouts = 0;
+	double total = 0.0;
+	size_t i, k;
+
+	roots = calloc(settings->runtime_history.size, sizeof(*roots));
+	for (i = 0; i < settings->runtime_history.size; i++) {
+		roots[num_roots] = json_object_from_file(settings->runtime_history.paths[i]);
+		if (!roots[num_roots]) {
+			fprintf(stderr, "Warning: Cannot parse runtime history %s, ignoring\n",
+				settings->runtime_history.paths[i]);
+			continue;
+		}
+		num_roots++;
+	}
+
+	if (!num_roots) {
+		free(roots);
+		return;
+	}
+
+	costs = calloc(job_list->size, sizeof(*costs));
+	for (i = 0; i < job_list->size; i++) {
+		struct job_list_entry *entry = &job_list->entries[i];
+		igt_stats_t stats;
+
+		costs[i].idx = i;
+		costs[i].time = -1.0;
+
+		igt_stats_init_with_size(&stats, num_roots);
+		for (k = 0; k < num_roots; k++) {
+			double time;
+
+			if (entry_runtime(roots[k], entry, &time)) {
+				costs[i].time = stats.n_values ? costs[i].time + time : time;
+				igt_stats_push_float(&stats, time);
+			}
+		}
+
+		if (stats.n_values) {
+			costs[i].time /= stats.n_values;
+			total += costs[i].time;
+			known++;
+		}
+
+		/*
+		 * The IQR needs at least three runtimes, with fewer
+		 * the timeout is based on the median alone.
+		 */
+		if (stats.n_values && settings->adaptive_timeout > 0.0) {
+			double deadline = igt_stats_get_median(&stats) +
+				settings->adaptive_timeout * igt_stats_get_iqr(&stats);
+
+			entry->timeout = ceil(deadline);
+			if (entry->timeout < ADAPTIVE_TIMEOUT_MIN)
+				entry->timeout = ADAPTIVE_TIMEOUT_MIN;
+			timeouts++;
+		}
+
+		igt_stats_fini(&stats);
+	}
+
+	/* Jobs without history are assumed to take the average time */
+	for (i = 0; i < job_list->size; i++)
+		if (costs[i].time < 0.0)
+			costs[i].time = known ? total / known : 0.0;
+
+	qsort(costs, job_list->size, sizeof(*costs), cmp_job_cost);
+
+	sorted = malloc(job_list->size * sizeof(*sorted));
+	for (i = 0; i < job_list->size; i++)
+		sorted[i] = job_list->entries[costs[i].idx];
+	free(job_list->entries);
+	job_list->entries = sorted;
+
+	if (settings->log_level >= LOG_LEVEL_VERBOSE) {
+		printf("Ordered %zd jobs longest-first, runtime known for %zd\n",
+		       job_list->size, known);
+		if (settings->adaptive_timeout > 0.0)
+			printf("Adaptive timeouts set for %zd jobs\n", timeouts);
+	}
+
+	for (k = 0; k < num_roots; k++)
+		json_object_put(roots[k]);
+	free(roots);
+	free(costs);
+}
+
 void init_job_list(struct job_list *job_list)
 {
 	memset(job_list, 0, sizeof(*job_list));
@@ -379,6 +703,29 @@ void free_job_list(struct job_list *job_list)
 	init_job_list(job_list);
 }
 
+void shard_job_list(struct job_list *shard, struct job_list *job_list,
+		    size_t idx, size_t num_shards)
+{
+	size_t i, k;
+
+	free_job_list(shard);
+
+	for (i = idx; i < job_list->size; i += num_shards) {
+		struct job_list_entry *entry = &job_list->entries[i];
+		char **subtests = NULL;
+
+		if (entry->subtest_count) {
+			subtests = malloc(entry->subtest_count * sizeof(*subtests));
+			for (k = 0; k < entry->subtest_count; k++)
+				subtests[k] = strdup(entry->subtests[k]);
+		}
+
+		add_job_list_entry(shard, strdup(entry->binary),
+				   subtests, entry->subtest_count);
+		shard->entries[shard->size - 1].timeout = entry->timeout;
+	}
+}
+
 bool create_job_list(struct job_list *job_list,
 		     struct settings *settings)
 {
@@ -414,7 +761,10 @@ bool create_job_list(struct job_list *job_list,
 	if (settings->test_list)
 		result = job_list_from_test_list(job_list, settings);
 	else
-		result = filtered_job_list(job_list, settings, fd);
+		result = filtered_job_list(job_list, settings, dirfd, fd);
+
+	if (result && settings->runtime_history.size)
+		sort_by_runtime_history(job_list, settings);
 
 	close(fd);
 	close(dirfd);
@@ -423,10 +773,126 @@ bool create_job_list(struct job_list *job_list,
 }
 
 static char joblist_filename[] = "joblist.txt";
+static char timeouts_filename[] = "timeouts.txt";
+
+/*
+ * The per-entry timeouts are stored separately from the job list, one
+ * line per job list entry, and only when there are any.
+ */
+static bool serialize_timeouts(struct job_list *job_list,
+			       struct settings *settings, int dirfd)
+{
+	FILE *f;
+	size_t i;
+	int fd;
+
+	if (unlinkat(dirfd, timeouts_filename, 0) != 0 && errno != ENOENT) {
+		fprintf(stderr, "Error removing old timeouts\n");
+		return false;
+	}
+
+	for (i = 0; i < job_list->size; i++)
+		if (job_list->entries[i].timeout)
+			break;
+	if (i == job_list->size)
+		return true;
+
+	if ((fd = openat(dirfd, timeouts_filename, O_CREAT | O_EXCL | O_WRONLY, 0666)) < 0 ||
+	    (f = fdopen(fd, "w")) == NULL) {
+		fprintf(stderr, "Creating timeouts file failed: %s\n", strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	for (i = 0; i < job_list->size; i++)
+		fprintf(f, "%d\n", job_list->entries[i].timeout);
+
+	if (settings->sync)
+		fsync(fd);
+
+	fclose(f);
+	return true;
+}
+
+static void read_timeouts(struct job_list *job_list, int dirfd)
+{
+	FILE *f;
+	size_t i;
+	int fd;
+
+	if ((fd = openat(dirfd, timeouts_filename, O_RDONLY)) < 0)
+		return;
+
+	if ((f = fdopen(fd, "r")) == NULL) {
+		close(fd);
+		return;
+	}
+
+	for (i = 0; i < job_list->size; i++)
+		if (fscanf(f, "%d", &job_list->entries[i].timeout) != 1)
+			break;
+
+	fclose(f);
+}
+
+void write_job_list_entry(FILE *f, struct job_list_entry *entry)
+{
+	size_t k;
+
+	fputs(entry->binary, f);
+
+	if (entry->subtest_count) {
+		const char *delim = "";
+
+		fprintf(f, " ");
+
+		for (k = 0; k < entry->subtest_count; k++) {
+			fprintf(f, "%s%s", delim, entry->subtests[k]);
+			delim = ",";
+		}
+	}
+
+	fprintf(f, "\n");
+}
+
+void add_job_list_line(struct job_list *job_list, char *line)
+{
+	char *binary, *sublist, *comma;
+	char **subtests = NULL;
+	size_t num_subtests = 0, len;
+
+	len = strlen(line);
+	if (len > 0 && line[len - 1] == '\n')
+		line[len - 1] = '\0';
+
+	sublist = strchr(line, ' ');
+	if (!sublist) {
+		add_job_list_entry(job_list, strdup(line), NULL, 0);
+		return;
+	}
+
+	*sublist++ = '\0';
+	binary = strdup(line);
+
+	do {
+		comma = strchr(sublist, ',');
+		if (comma) {
+			*comma++ = '\0';
+		}
+
+		++num_subtests;
+		subtests = realloc(subtests, num_subtests * sizeof(*subtests));
+		subtests[num_subtests - 1] = strdup(sublist);
+		sublist = comma;
+	} while (comma != NULL);
+
+	add_job_list_entry(job_list, binary, subtests, num_subtests);
+}
+
 bool serialize_job_list(struct job_list *job_list, struct settings *settings)
 {
 	int dirfd, fd;
-	size_t i, k;
+	size_t i;
 	FILE *f;
 
 	if (!settings->results_path) {
@@ -470,22 +936,13 @@ bool serialize_job_list(struct job_list *job_list, struct settings *settings)
 		return false;
 	}
 
-	for (i = 0; i < job_list->size; i++) {
-		struct job_list_entry *entry = &job_list->entries[i];
-		fputs(entry->binary, f);
-
-		if (entry->subtest_count) {
-			const char *delim = "";
-
-			fprintf(f, " ");
+	for (i = 0; i < job_list->size; i++)
+		write_job_list_entry(f, &job_list->entries[i]);
 
-			for (k = 0; k < entry->subtest_count; k++) {
-				fprintf(f, "%s%s", delim, entry->subtests[k]);
-				delim = ",";
-			}
-		}
-
-		fprintf(f, "\n");
+	if (!serialize_timeouts(job_list, settings, dirfd)) {
+		fclose(f);
+		close(dirfd);
+		return false;
 	}
 
 	if (settings->sync) {
@@ -518,10 +975,6 @@ bool read_job_list(struct job_list *job_list, int dirfd)
 	}
 
 	while ((read = getline(&line, &line_len, f))) {
-		char *binary, *sublist, *comma;
-		char **subtests = NULL;
-		size_t num_subtests = 0, len;
-
 		if (read < 0) {
 			if (errno == EINTR)
 				continue;
@@ -529,36 +982,13 @@ bool read_job_list(struct job_list *job_list, int dirfd)
 				break;
 		}
 
-		len = strlen(line);
-		if (len > 0 && line[len - 1] == '\n')
-			line[len - 1] = '\0';
-
-		sublist = strchr(line, ' ');
-		if (!sublist) {
-			add_job_list_entry(job_list, strdup(line), NULL, 0);
-			continue;
-		}
-
-		*sublist++ = '\0';
-		binary = strdup(line);
-
-		do {
-			comma = strchr(sublist, ',');
-			if (comma) {
-				*comma++ = '\0';
-			}
-
-			++num_subtests;
-			subtests = realloc(subtests, num_subtests * sizeof(*subtests));
-			subtests[num_subtests - 1] = strdup(sublist);
-			sublist = comma;
-		} while (comma != NULL);
-
-		add_job_list_entry(job_list, binary, subtests, num_subtests);
+		add_job_list_line(job_list, line);
 	}
 
 	free(line);
 	fclose(f);
 
+	read_timeouts(job_list, dirfd);
+
 	return true;
 }
@@ -2,6 +2,7 @@
 #define RUNNER_JOB_LIST_H
 
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "settings.h"
 
@@ -19,6 +20,11 @@ struct job_list_entry {
 	 * the above array.
 	 */
 	size_t subtest_count;
+	/*
+	 * Inactivity timeout derived from the runtime history with
+	 * --adaptive-timeout, in seconds. 0 = use the global one.
+	 */
+	int timeout;
 };
 
 struct job_list
@@ -34,6 +40,20 @@ void init_job_list(struct job_list *job_list);
 void free_job_list(struct job_list *job_list);
 bool create_job_list(struct job_list *job_list, struct settings *settings);
 
+/*
+ * Fill @shard with a copy of every @num_shards'th entry of @job_list,
+ * starting from entry @idx.
+ */
+void shard_job_list(struct job_list *shard, struct job_list *job_list,
+		    size_t idx, size_t num_shards);
+
+/*
+ * Write @entry to @f as a line of the serialized job list, and add the
+ * entry such a @line describes to @job_list. The line is modified.
+ */
+void write_job_list_entry(FILE *f, struct job_list_entry *entry);
+void add_job_list_line(struct job_list *job_list, char *line);
+
 bool serialize_job_list(struct job_list *job_list, struct settings *settings);
 bool read_job_list(struct job_list *job_list, int dirfd);
 void list_all_tests(struct job_list *lst);
@@ -52,4 +52,20 @@ static const char EXECUTOR_EXIT[] = "exit:";
  */
 static const char EXECUTOR_TIMEOUT[] = "timeout:";
 
+/*
+ * Output by the executor to the resources file, one line per resource
+ * used by a test execution. The times are in seconds, the maximum
+ * resident set size in kilobytes.
+ *
+ * Example:
+ * user:0.104000
+ * system:0.012000
+ * max-rss:12340
+ * engine-busy:rcs0:0.250000
+ */
+static const char RESOURCE_USER_TIME[] = "user:";
+static const char RESOURCE_SYSTEM_TIME[] = "system:";
+static const char RESOURCE_MAX_RSS[] = "max-rss:";
+static const char RESOURCE_ENGINE_BUSY[] = "engine-busy:";
+
 #endif
@@ -1,7 +1,10 @@
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -59,83 +62,6 @@ static char *find_line_starting_with(char *haystack, const char *needle, char *e
 	return NULL;
 }
 
-static char *find_line_starting_with_either(char *haystack,
-					    const char *needle1,
-					    const char *needle2,
-					    char *end)
-{
-	while (haystack < end) {
-		char *line_end = memchr(haystack, '\n', end - haystack);
-		size_t linelen = line_end != NULL ? line_end - haystack : end - haystack;
-		if ((linelen >= strlen(needle1) && !memcmp(haystack, needle1, strlen(needle1))) ||
-		    (linelen >= strlen(needle2) && !memcmp(haystack, needle2, strlen(needle2))))
-			return haystack;
-
-		if (line_end == NULL)
-			return NULL;
-
-		haystack = line_end + 1;
-	}
-
-	return NULL;
-}
-
-static char *next_line(char *line, char *bufend)
-{
-	char *ret;
-
-	if (!line)
-		return NULL;
-
-	ret = memchr(line, '\n', bufend - line);
-	if (ret)
-		ret++;
-
-	if (ret < bufend)
-		return ret;
-	else
-		return NULL;
-}
-
-static char *find_line_after_last(char *begin,
-				  const char *needle1,
-				  const char *needle2,
-				  char *end)
-{
-	char *one, *two;
-	char *current_pos = begin;
-	char *needle1_newline = malloc(strlen(needle1) + 2);
-	char *needle2_newline = malloc(strlen(needle2) + 2);
-
-	needle1_newline[0] = needle2_newline[0] = '\n';
-	strcpy(needle1_newline + 1, needle1);
-	strcpy(needle2_newline + 1, needle2);
-
-	while (true) {
-		one = memmem(current_pos, end - current_pos, needle1_newline, strlen(needle1_newline));
-		two = memmem(current_pos, end - current_pos, needle2_newline, strlen(needle2_newline));
-		if (one == NULL && two == NULL)
-			break;
-
-		if (one != NULL && current_pos < one)
-			current_pos = one;
-		if (two != NULL && current_pos < two)
-			current_pos = two;
-
-		one = next_line(current_pos, end);
-		if (one != NULL)
-			current_pos = one;
-	}
-	free(needle1_newline);
-	free(needle2_newline);
-
-	one = memchr(current_pos, '\n', end - current_pos);
-	if (one != NULL)
-		return ++one;
-
-	return current_pos;
-}
-
 static size_t count_lines(const char *buf, const char *bufend)
 {
 	size_t ret = 0;
@@ -308,6 +234,175 @@ static void set_runtime(struct json_object *obj, double time)
 			       json_object_new_double(time));
 }
 
+/*
+ * Resources add up over the executions of a test, except for the
+ * peak memory use which is the largest one seen.
+ */
+static void add_resource(struct json_object *obj, const char *key,
+			 struct json_object *value)
+{
+	struct json_object *old;
+
+	if (!strcmp(key, "max-rss")) {
+		int64_t rss = json_object_get_int64(value);
+
+		if (json_object_object_get_ex(obj, key, &old) &&
+		    json_object_get_int64(old) > rss)
+			return;
+
+		json_object_object_add(obj, key, json_object_new_int64(rss));
+	} else {
+		double sum = json_object_get_double(value);
+
+		if (json_object_object_get_ex(obj, key, &old))
+			sum += json_object_get_double(old);
+
+		json_object_object_add(obj, key, json_object_new_double(sum));
+	}
+}
+
+static void merge_resources(struct json_object *dst, struct json_object *src)
+{
+	struct json_object_iter iter;
+
+	json_object_object_foreachC(src, iter) {
+		if (json_object_is_type(iter.val, json_type_object))
+			merge_resources(get_or_create_json_object(dst, iter.key),
+					iter.val);
+		else
+			add_resource(dst, iter.key, iter.val);
+	}
+}
+
+/*
+ * The subtest marker lines of an output, in the order they appear.
+ * The index is built in one pass over the buffer, after which the
+ * output of each subtest is found without rescanning the buffer.
+ */
+struct output_marker
+{
+	char *line;
+	size_t linelen; /* Not including the newline */
+	char *next; /* The line after this one, or the end of the buffer */
+	bool starting;
+};
+
+struct output_index
+{
+	struct output_marker *markers;
+	size_t size;
+};
+
+static bool line_starts_with(const char *line, size_t linelen, const char *prefix)
+{
+	return linelen >= strlen(prefix) && !memcmp(line, prefix, strlen(prefix));
+}
+
+static void index_output(struct output_index *index, char *buf, char *bufend)
+{
+	size_t allocated = 0;
+	char *line = buf;
+
+	index->markers = NULL;
+	index->size = 0;
+
+	while (line < bufend) {
+		char *line_end = memchr(line, '\n', bufend - line);
+		size_t linelen = line_end != NULL ? line_end - line : bufend - line;
+		bool starting = line_starts_with(line, linelen, STARTING_SUBTEST);
+		struct output_marker *marker;
+
+		if (starting || line_starts_with(line, linelen, SUBTEST_RESULT)) {
+			if (index->size == allocated) {
+				allocated = allocated ? allocated * 2 : 64;
+				index->markers = realloc(index->markers,
+							 allocated * sizeof(*index->markers));
+			}
+
+			marker = &index->markers[index->size++];
+			marker->line = line;
+			marker->linelen = linelen;
+			marker->next = line_end != NULL ? line_end + 1 : bufend;
+			marker->starting = starting;
+		}
+
+		if (line_end == NULL)
+			break;
+		line = line_end + 1;
+	}
+}
+
+/* Finds the "Starting subtest: name" line, or returns index->size */
+static size_t find_starting_marker(struct output_index *index, const char *subtest)
+{
+	size_t prefixlen = strlen(STARTING_SUBTEST);
+	size_t subtestlen = strlen(subtest);
+	size_t i;
+
+	for (i = 0; i < index->size; i++) {
+		struct output_marker *marker = &index->markers[i];
+
+		/* The whole line must match, including the newline */
+		if (marker->starting &&
+		    marker->linelen == prefixlen + subtestlen &&
+		    marker->next > marker->line + marker->linelen &&
+		    !memcmp(marker->line + prefixlen, subtest, subtestlen))
+			return i;
+	}
+
+	return index->size;
+}
+
+/* Finds the "Subtest name: " line, or returns index->size */
+static size_t find_result_marker(struct output_index *index, const char *subtest)
+{
+	size_t prefixlen = strlen(SUBTEST_RESULT);
+	size_t subtestlen = strlen(subtest);
+	size_t i;
+
+	for (i = 0; i < index->size; i++) {
+		struct output_marker *marker = &index->markers[i];
+
+		if (!marker->starting &&
+		    marker->linelen >= prefixlen + subtestlen + strlen(": ") &&
+		    !memcmp(marker->line + prefixlen, subtest, subtestlen) &&
+		    !memcmp(marker->line + prefixlen + subtestlen, ": ", strlen(": ")))
+			return i;
+	}
+
+	return index->size;
+}
+
+/*
+ * Returns the beginning of the line after the last marker before the
+ * marker at idx. A marker on the first line of the buffer doesn't
+ * count, but without other markers the first line is skipped anyway.
+ */
+static char *find_line_after_last(struct output_index *index, size_t idx,
+				  char *buf, char *end)
+{
+	char *newline;
+
+	while (idx-- > 0) {
+		struct output_marker *marker = &index->markers[idx];
+
+		if (marker->line == buf)
+			continue;
+
+		/* An unterminated last line is included */
+		if (marker->next == marker->line + marker->linelen)
+			return marker->line;
+
+		return marker->next;
+	}
+
+	newline = memchr(buf, '\n', end - buf);
+	if (newline != NULL)
+		return newline + 1;
+
+	return buf;
+}
+
 static bool fill_from_output(int fd, const char *binary, const char *key,
 			     struct subtests *subtests,
 			     struct json_object *tests)
@@ -318,13 +413,16 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 	char *igt_version = NULL;
 	size_t igt_version_len = 0;
 	struct json_object *current_test = NULL;
+	struct output_index index;
+	size_t mapsize;
 	size_t i;
 
 	if (fstat(fd, &statbuf))
 		return false;
 
-	if (statbuf.st_size != 0) {
-		buf = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	mapsize = statbuf.st_size;
+	if (mapsize != 0) {
+		buf = mmap(NULL, mapsize, PROT_READ, MAP_SHARED, fd, 0);
 		if (buf == MAP_FAILED)
 			return false;
 	} else {
@@ -344,7 +442,7 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 	igt_version = find_line_starting_with(buf, IGT_VERSIONSTRING, bufend);
 	if (igt_version) {
 		char *newline = memchr(igt_version, '\n', bufend - igt_version);
-		igt_version_len = newline - igt_version;
+		igt_version_len = (newline != NULL ? newline : bufend) - igt_version;
 	}
 
 	/* TODO: Refactor to helper functions */
@@ -360,89 +458,54 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 					       json_object_new_string_len(igt_version,
 									  igt_version_len));
 
+		if (buf)
+			munmap(buf, mapsize);
 		return true;
 	}
 
+	index_output(&index, buf, bufend);
+
 	for (i = 0; i < subtests->size; i++) {
-		char *this_sub_begin, *this_sub_result;
 		const char *resulttext;
-		char *beg, *end, *startline;
+		char *beg, *end;
+		size_t begin_idx, result_idx;
 		double time;
-		int begin_len;
-		int result_len;
 
 		generate_piglit_name(binary, subtests->names[i], piglit_name, sizeof(piglit_name));
 		current_test = get_or_create_json_object(tests, piglit_name);
 
-		begin_len = asprintf(&this_sub_begin, "%s%s\n", STARTING_SUBTEST, subtests->names[i]);
-		result_len = asprintf(&this_sub_result, "%s%s: ", SUBTEST_RESULT, subtests->names[i]);
-
-		if (begin_len < 0 || result_len < 0) {
-			fprintf(stderr, "Failure generating strings\n");
-			return false;
-		}
-
-		beg = find_line_starting_with(buf, this_sub_begin, bufend);
-		end = find_line_starting_with(buf, this_sub_result, bufend);
-		startline = beg;
-
-		free(this_sub_begin);
-		free(this_sub_result);
+		begin_idx = find_starting_marker(&index, subtests->names[i]);
+		result_idx = find_result_marker(&index, subtests->names[i]);
 
-		if (beg == NULL && end == NULL) {
-			/* No output at all */
-			beg = bufend;
-			end = bufend;
-		}
-
-		if (beg == NULL) {
+		if (begin_idx == index.size) {
 			/*
 			 * Subtest didn't start, probably skipped from
 			 * fixture already. Start from the result
-			 * line, it gets adjusted below.
+			 * line, it gets adjusted below. With no
+			 * result line either, there's no output at
+			 * all.
 			 */
-			beg = end;
+			beg = result_idx < index.size ? index.markers[result_idx].line : bufend;
+			begin_idx = result_idx;
+		} else {
+			beg = index.markers[begin_idx].line;
 		}
 
 		/* Include the output after the previous subtest output */
-		beg = find_line_after_last(buf,
-					   STARTING_SUBTEST,
-					   SUBTEST_RESULT,
-					   beg);
-
-		if (end == NULL) {
-			/* Incomplete result. Find the next starting subtest or result. */
-			end = next_line(startline, bufend);
-			if (end != NULL) {
-				end = find_line_starting_with_either(end,
-								     STARTING_SUBTEST,
-								     SUBTEST_RESULT,
-								     bufend);
-			}
-			if (end == NULL) {
-				end = bufend;
-			}
-		} else {
-			/*
-			 * Now pointing to the line where this sub's
-			 * result is. We need to include that of
-			 * course.
-			 */
-			char *nexttest = next_line(end, bufend);
-
-			/* Stretch onwards until the next subtest begins or ends */
-			if (nexttest != NULL) {
-				nexttest = find_line_starting_with_either(nexttest,
-									  STARTING_SUBTEST,
-									  SUBTEST_RESULT,
-									  bufend);
-			}
-			if (nexttest != NULL) {
-				end = nexttest;
-			} else {
-				end = bufend;
-			}
-		}
+		beg = find_line_after_last(&index, begin_idx, buf, beg);
+
+		/*
+		 * Stretch onwards until the next subtest begins or
+		 * ends. If the result is missing, the output is
+		 * incomplete and ends where the next subtest starts
+		 * or ends.
+		 */
+		if (result_idx < index.size)
+			end = result_idx + 1 < index.size ? index.markers[result_idx + 1].line : bufend;
+		else if (begin_idx < index.size && begin_idx + 1 < index.size)
+			end = index.markers[begin_idx + 1].line;
+		else
+			end = bufend;
 
 		json_object_object_add(current_test, key,
 				       json_object_new_string_len(beg, end - beg));
@@ -460,9 +523,100 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 		}
 	}
 
+	free(index.markers);
+	if (buf)
+		munmap(buf, mapsize);
+
 	return true;
 }
 
+/*
+ * The event stream written by igt_core has the subtest results in
+ * JSON lines, one per event:
+ *
+ * {"event":"result","subtest":"name","result":"SUCCESS","duration":0.003}
+ *
+ * Results found there take precedence over the ones parsed from the
+ * output. The other events are skipped, as is anything that's not a
+ * complete line, like the last one of a test that died mid-write.
+ */
+static void fill_from_events(int fd, const char *binary,
+			     struct subtests *subtests,
+			     struct json_object *tests)
+{
+	char piglit_name[256];
+	char *line = NULL;
+	size_t linelen = 0;
+	ssize_t read;
+	FILE *f;
+
+	if (fd < 0 || subtests->size == 0)
+		return;
+
+	if ((fd = dup(fd)) < 0)
+		return;
+
+	if ((f = fdopen(fd, "r")) == NULL) {
+		close(fd);
+		return;
+	}
+
+	while ((read = getline(&line, &linelen, f)) > 0) {
+		struct json_object *event, *obj, *current_test;
+		const char *subtest, *result = "incomplete";
+		size_t i;
+
+		if (line[read - 1] != '\n' ||
+		    (event = json_tokener_parse(line)) == NULL)
+			continue;
+
+		if (!json_object_object_get_ex(event, "event", &obj) ||
+		    strcmp(json_object_get_string(obj), "result") ||
+		    !json_object_object_get_ex(event, "subtest", &obj)) {
+			json_object_put(event);
+			continue;
+		}
+
+		subtest = json_object_get_string(obj);
+		for (i = 0; i < subtests->size; i++)
+			if (!strcmp(subtests->names[i], subtest))
+				break;
+
+		if (i == subtests->size) {
+			json_object_put(event);
+			continue;
+		}
+
+		generate_piglit_name(binary, subtest, piglit_name, sizeof(piglit_name));
+		current_test = get_or_create_json_object(tests, piglit_name);
+
+		/* Timeouts from the journal stay */
+		if (json_object_object_get_ex(current_test, "result", NULL)) {
+			json_object_put(event);
+			continue;
+		}
+
+		if (json_object_object_get_ex(event, "result", &obj)) {
+			for (i = 0; i < (sizeof(resultmap) / sizeof(resultmap[0])); i++) {
+				if (!strcmp(json_object_get_string(obj),
+					    resultmap[i].output_str)) {
+					result = resultmap[i].result_str;
+					break;
+				}
+			}
+		}
+
+		set_result(current_test, result);
+		if (json_object_object_get_ex(event, "duration", &obj))
+			set_runtime(current_test, json_object_get_double(obj));
+
+		json_object_put(event);
+	}
+
+	free(line);
+	fclose(f);
+}
+
 /*
  * This regexp controls the kmsg handling. All kernel log records that
  * have log level of warning or higher convert the result to
@@ -629,28 +783,49 @@ static bool fill_from_dmesg(int fd,
 	char *line = NULL, *warnings = NULL, *dmesg = NULL;
 	size_t linelen = 0, warningslen = 0, dmesglen = 0;
 	struct json_object *current_test = NULL;
-	FILE *f = fdopen(fd, "r");
+	char *buf, *bufend, *record;
+	struct stat statbuf;
 	char piglit_name[256];
-	ssize_t read;
 	size_t i;
 	GRegex *re;
 
-	if (!f) {
+	if (fstat(fd, &statbuf))
 		return false;
+
+	if (statbuf.st_size != 0) {
+		buf = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (buf == MAP_FAILED)
+			return false;
+	} else {
+		buf = NULL;
 	}
 
+	bufend = buf + statbuf.st_size;
+
 	if (!init_regex_whitelist(settings, &re)) {
-		fclose(f);
+		if (buf)
+			munmap(buf, statbuf.st_size);
 		return false;
 	}
 
-	while ((read = getline(&line, &linelen, f)) > 0) {
+	for (record = buf; record < bufend; ) {
+		char *record_end = memchr(record, '\n', bufend - record);
+		size_t recordlen = (record_end != NULL ? record_end + 1 : bufend) - record;
 		char *formatted;
 		unsigned flags;
 		unsigned long long ts_usec;
 		char continuation;
 		char *message, *subtest;
 
+		/* The parsing needs a null-terminated copy of the record */
+		if (recordlen + 1 > linelen) {
+			linelen = recordlen + 1;
+			line = realloc(line, linelen);
+		}
+		memcpy(line, record, recordlen);
+		line[recordlen] = '\0';
+		record += recordlen;
+
 		if (!parse_dmesg_line(line, &flags, &ts_usec, &continuation, &message))
 			continue;
 
@@ -719,7 +894,8 @@ static bool fill_from_dmesg(int fd,
 	free(dmesg);
 	free(warnings);
 	g_regex_unref(re);
-	fclose(f);
+	if (buf)
+		munmap(buf, statbuf.st_size);
 	return true;
 }
 
@@ -995,6 +1171,73 @@ static void add_to_totals(const char *binary,
 	}
 }
 
+/*
+ * The resources file is optional. Its usage gets added to the
+ * binary's runtime entry, under "resources".
+ */
+static void fill_from_resources(int dirfd,
+				struct job_list_entry *entry,
+				struct results *results)
+{
+	struct json_object *usage, *engines, *obj;
+	char piglit_name[256];
+	char *line = NULL;
+	size_t linelen = 0;
+	FILE *f;
+	int fd;
+
+	if ((fd = openat(dirfd, RESOURCES_FILENAME, O_RDONLY)) < 0)
+		return;
+
+	if ((f = fdopen(fd, "r")) == NULL) {
+		close(fd);
+		return;
+	}
+
+	usage = json_object_new_object();
+	engines = json_object_new_object();
+
+	while (getline(&line, &linelen, f) > 0) {
+		char *engine, *p;
+
+		if (!strncmp(line, RESOURCE_USER_TIME, strlen(RESOURCE_USER_TIME))) {
+			obj = json_object_new_double(atof(line + strlen(RESOURCE_USER_TIME)));
+			add_resource(usage, "user", obj);
+		} else if (!strncmp(line, RESOURCE_SYSTEM_TIME, strlen(RESOURCE_SYSTEM_TIME))) {
+			obj = json_object_new_double(atof(line + strlen(RESOURCE_SYSTEM_TIME)));
+			add_resource(usage, "system", obj);
+		} else if (!strncmp(line, RESOURCE_MAX_RSS, strlen(RESOURCE_MAX_RSS))) {
+			obj = json_object_new_int64(atoll(line + strlen(RESOURCE_MAX_RSS)));
+			add_resource(usage, "max-rss", obj);
+		} else if (!strncmp(line, RESOURCE_ENGINE_BUSY, strlen(RESOURCE_ENGINE_BUSY))) {
+			engine = line + strlen(RESOURCE_ENGINE_BUSY);
+			if ((p = strchr(engine, ':')) == NULL)
+				continue;
+
+			*p = '\0';
+			obj = json_object_new_double(atof(p + 1));
+			add_resource(engines, engine, obj);
+		} else {
+			continue;
+		}
+
+		json_object_put(obj);
+	}
+
+	if (json_object_object_length(engines))
+		json_object_object_add(usage, "engine-busy", engines);
+	else
+		json_object_put(engines);
+
+	generate_piglit_name(entry->binary, NULL, piglit_name, sizeof(piglit_name));
+	obj = get_or_create_json_object(results->runtimes, piglit_name);
+	merge_resources(get_or_create_json_object(obj, "resources"), usage);
+
+	json_object_put(usage);
+	free(line);
+	fclose(f);
+}
+
 static bool parse_test_directory(int dirfd,
 				 struct job_list_entry *entry,
 				 struct settings *settings,
@@ -1014,6 +1257,8 @@ static bool parse_test_directory(int dirfd,
 	 * timeout results where applicable.
 	 */
 	fill_from_journal(fds[_F_JOURNAL], entry, &subtests, results);
+	fill_from_resources(dirfd, entry, results);
+	fill_from_events(fds[_F_EVENTS], entry->binary, &subtests, results->tests);
 
 	if (!fill_from_output(fds[_F_OUT], entry->binary, "out", &subtests, results->tests) ||
 	    !fill_from_output(fds[_F_ERR], entry->binary, "err", &subtests, results->tests) ||
@@ -1082,34 +1327,287 @@ static void create_result_root_nodes(struct json_object *root,
 	json_object_object_add(root, "runtimes", results->runtimes);
 }
 
-struct json_object *generate_results_json(int dirfd)
+static void add_abort_result(int dirfd, struct results *results)
 {
-	struct settings settings;
-	struct job_list job_list;
-	struct json_object *obj, *elapsed;
-	struct results results;
-	int testdirfd, fd;
+	char piglit_name[] = "igt@runner@aborted";
+	struct subtests abortsub = {};
+	struct json_object *aborttest;
+	char buf[4096];
+	ssize_t s;
+	int fd;
+
+	/* With parallel workers, the first abort gets reported */
+	if (json_object_object_get_ex(results->tests, piglit_name, NULL))
+		return;
+
+	if ((fd = openat(dirfd, "aborted.txt", O_RDONLY)) < 0)
+		return;
+
+	aborttest = get_or_create_json_object(results->tests, piglit_name);
+	add_subtest(&abortsub, strdup("aborted"));
+
+	s = read(fd, buf, sizeof(buf));
+	close(fd);
+
+	json_object_object_add(aborttest, "out",
+			       json_object_new_string_len(buf, s));
+	json_object_object_add(aborttest, "err",
+			       json_object_new_string(""));
+	json_object_object_add(aborttest, "dmesg",
+			       json_object_new_string(""));
+	json_object_object_add(aborttest, "result",
+			       json_object_new_string("fail"));
+
+	add_to_totals("runner", &abortsub, results);
+
+	free_subtests(&abortsub);
+}
+
+static bool parse_entry_results(int dirfd, size_t idx,
+				struct job_list_entry *entry,
+				struct settings *settings,
+				struct results *results)
+{
+	char name[16];
+	int testdirfd;
+	bool ok;
+
+	snprintf(name, 16, "%zd", idx);
+	if (dirfd < 0 ||
+	    (testdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) < 0) {
+		try_add_notrun_results(entry, settings, results);
+		return true;
+	}
+
+	ok = parse_test_directory(testdirfd, entry, settings, results);
+	close(testdirfd);
+
+	return ok;
+}
+
+static void merge_totals(struct json_object *dst, struct json_object *src)
+{
+	struct json_object_iter iter;
+
+	json_object_object_foreachC(src, iter) {
+		struct json_object *total = get_totals_object(dst, iter.key);
+		struct json_object_iter count;
+
+		json_object_object_foreachC(iter.val, count) {
+			struct json_object *old;
+			int value = json_object_get_int(count.val);
+
+			if (json_object_object_get_ex(total, count.key, &old))
+				value += json_object_get_int(old);
+			json_object_object_add(total, count.key,
+					       json_object_new_int(value));
+		}
+	}
+}
+
+static void merge_runtimes(struct json_object *dst, struct json_object *src)
+{
+	struct json_object_iter iter;
+
+	json_object_object_foreachC(src, iter) {
+		struct json_object *timeobj, *end, *resources, *obj;
+
+		if (json_object_object_get_ex(iter.val, "time", &timeobj) &&
+		    json_object_object_get_ex(timeobj, "end", &end))
+			add_runtime(get_or_create_json_object(dst, iter.key),
+				    json_object_get_double(end));
+
+		if (json_object_object_get_ex(iter.val, "resources", &resources)) {
+			obj = get_or_create_json_object(dst, iter.key);
+			merge_resources(get_or_create_json_object(obj, "resources"),
+					resources);
+		}
+	}
+}
+
+/*
+ * The entries are parsed in parallel, each into results of its own,
+ * then merged in job list order.
+ */
+struct entry_parser {
+	int dirfd;
+	struct job_list *job_list;
+	struct settings *settings;
+	struct json_object **entries;
+	size_t next;
+	bool failed;
+};
+
+static void *parse_entries_thread(void *data)
+{
+	struct entry_parser *p = data;
 	size_t i;
 
-	init_settings(&settings);
-	init_job_list(&job_list);
+	while ((i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED)) <
+	       p->job_list->size) {
+		struct json_object *obj = json_object_new_object();
+		struct results results;
+
+		create_result_root_nodes(obj, &results);
+		if (!parse_entry_results(p->dirfd, i, &p->job_list->entries[i],
+					 p->settings, &results)) {
+			json_object_put(obj);
+			obj = NULL;
+			p->failed = true;
+		}
 
-	if (!read_settings_from_dir(&settings, dirfd)) {
-		fprintf(stderr, "resultgen: Cannot parse settings\n");
-		return NULL;
+		p->entries[i] = obj;
 	}
 
-	if (!read_job_list(&job_list, dirfd)) {
-		fprintf(stderr, "resultgen: Cannot parse job list\n");
-		return NULL;
+	return NULL;
+}
+
+static void merge_entry_results(struct results *results,
+				struct json_object *obj)
+{
+	struct json_object *tests, *totals, *runtimes;
+	struct json_object_iter iter;
+
+	json_object_object_get_ex(obj, "tests", &tests);
+	json_object_object_get_ex(obj, "totals", &totals);
+	json_object_object_get_ex(obj, "runtimes", &runtimes);
+
+	json_object_object_foreachC(tests, iter)
+		json_object_object_add(results->tests, iter.key,
+				       json_object_get(iter.val));
+
+	merge_totals(results->totals, totals);
+	merge_runtimes(results->runtimes, runtimes);
+}
+
+static size_t parser_threads(size_t entries)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (cpus < 1)
+		cpus = 1;
+
+	return entries < cpus ? entries : cpus;
+}
+
+/*
+ * Parses the numbered test directories and the abort marker from a
+ * results directory. A negative dirfd means nothing was executed and
+ * every job gets a notrun result.
+ */
+static bool parse_results_directory(int dirfd,
+				    struct job_list *job_list,
+				    struct settings *settings,
+				    struct results *results)
+{
+	struct entry_parser parser = {
+		.dirfd = dirfd,
+		.job_list = job_list,
+		.settings = settings,
+	};
+	size_t num_threads = parser_threads(job_list->size);
+	pthread_t *threads;
+	size_t i, started;
+
+	parser.entries = calloc(job_list->size, sizeof(*parser.entries));
+	threads = calloc(num_threads, sizeof(*threads));
+
+	/* The calling thread takes its share of entries as well */
+	for (started = 0; started + 1 < num_threads; started++)
+		if (pthread_create(&threads[started], NULL,
+				   parse_entries_thread, &parser))
+			break;
+	parse_entries_thread(&parser);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < job_list->size; i++) {
+		if (parser.entries[i]) {
+			if (!parser.failed)
+				merge_entry_results(results, parser.entries[i]);
+			json_object_put(parser.entries[i]);
+		}
+	}
+
+	free(threads);
+	free(parser.entries);
+
+	if (parser.failed)
+		return false;
+
+	if (dirfd >= 0)
+		add_abort_result(dirfd, results);
+
+	return true;
+}
+
+/*
+ * Iterates over the directories holding the numbered test
+ * directories: the results directory itself, or the worker
+ * subdirectories of a parallel run. Workers that never started get
+ * their shard of the job list with a negative dirfd.
+ */
+static bool for_each_results_directory(int dirfd,
+				       struct settings *settings,
+				       struct job_list *job_list,
+				       bool (*fn)(int dirfd,
+						  struct job_list *job_list,
+						  struct settings *settings,
+						  void *data),
+				       void *data)
+{
+	size_t i;
+
+	if (settings->num_workers <= 1)
+		return fn(dirfd, job_list, settings, data);
+
+	for (i = 0; i < settings->num_workers; i++) {
+		struct job_list worker_list;
+		char name[32];
+		int workerfd;
+		bool ok;
+
+		init_job_list(&worker_list);
+
+		snprintf(name, sizeof(name), WORKER_DIRNAME, i);
+		workerfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY);
+
+		if (workerfd < 0 || !read_job_list(&worker_list, workerfd))
+			shard_job_list(&worker_list, job_list,
+				       i, settings->num_workers);
+
+		ok = fn(workerfd, &worker_list, settings, data);
+
+		close(workerfd);
+		free_job_list(&worker_list);
+
+		if (!ok)
+			return false;
 	}
 
+	return true;
+}
+
+static bool parse_results_directory_cb(int dirfd,
+				       struct job_list *job_list,
+				       struct settings *settings,
+				       void *data)
+{
+	return parse_results_directory(dirfd, job_list, settings, data);
+}
+
+static struct json_object *create_results_root(int dirfd,
+					       struct settings *settings)
+{
+	struct json_object *obj, *elapsed;
+	int fd;
+
 	obj = json_object_new_object();
 	json_object_object_add(obj, "__type__", json_object_new_string("TestrunResult"));
 	json_object_object_add(obj, "results_version", json_object_new_int(10));
 	json_object_object_add(obj, "name",
-			       settings.name ?
-			       json_object_new_string(settings.name) :
+			       settings->name ?
+			       json_object_new_string(settings->name) :
 			       json_object_new_string(""));
 
 	if ((fd = openat(dirfd, "uname.txt", O_RDONLY)) >= 0) {
@@ -1140,8 +1638,6 @@ struct json_object *generate_results_json(int dirfd)
 	}
 	json_object_object_add(obj, "time_elapsed", elapsed);
 
-	create_result_root_nodes(obj, &results);
-
 	/*
 	 * Result fields that won't be added:
 	 *
@@ -1155,59 +1651,302 @@ struct json_object *generate_results_json(int dirfd)
 	 * - options
 	 */
 
-	for (i = 0; i < job_list.size; i++) {
-		char name[16];
+	return obj;
+}
+
+struct json_object *generate_results_json(int dirfd)
+{
+	struct settings settings;
+	struct job_list job_list;
+	struct json_object *obj;
+	struct results results;
+
+	init_settings(&settings);
+	init_job_list(&job_list);
+
+	if (!read_settings_from_dir(&settings, dirfd)) {
+		fprintf(stderr, "resultgen: Cannot parse settings\n");
+		return NULL;
+	}
+
+	if (!read_job_list(&job_list, dirfd)) {
+		fprintf(stderr, "resultgen: Cannot parse job list\n");
+		return NULL;
+	}
+
+	obj = create_results_root(dirfd, &settings);
+	create_result_root_nodes(obj, &results);
+
+	if (!for_each_results_directory(dirfd, &settings, &job_list,
+					parse_results_directory_cb, &results)) {
+		json_object_put(obj);
+		obj = NULL;
+	}
+
+	free_settings(&settings);
+	free_job_list(&job_list);
+
+	return obj;
+}
+
+/*
+ * Incremental results: after each executed job list entry, the
+ * entry's parsed results are appended to this file as a single line
+ * of JSON. If an entry gets executed again when recovering from a
+ * timeout, the last line for that entry wins.
+ */
+static const char incremental_filename[] = "results.jsonl";
+
+bool append_incremental_results(int dirfd, size_t idx,
+				struct job_list_entry *entry,
+				struct settings *settings)
+{
+	struct json_object *obj = json_object_new_object();
+	struct results results;
+	const char *json_string;
+	bool ok = false;
+	int fd;
+
+	json_object_object_add(obj, "index", json_object_new_int(idx));
+	create_result_root_nodes(obj, &results);
+
+	if (!parse_entry_results(dirfd, idx, entry, settings, &results))
+		goto out;
+
+	if ((fd = openat(dirfd, incremental_filename,
+			 O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666)) < 0) {
+		fprintf(stderr, "resultgen: Cannot open %s: %s\n",
+			incremental_filename, strerror(errno));
+		goto out;
+	}
+
+	json_string = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN);
+	ok = dprintf(fd, "%s\n", json_string) > 0;
+
+	if (settings->sync)
+		fdatasync(fd);
+	close(fd);
+
+ out:
+	json_object_put(obj);
+	return ok;
+}
+
+struct results_stream {
+	FILE *out;
+	bool first;
+	bool aborted;
+	struct results totals;
+};
+
+/* Writes the tests of one entry out and merges the rest to the totals */
+static void stream_entry_results(struct results_stream *stream,
+				 struct json_object *tests,
+				 struct json_object *totals,
+				 struct json_object *runtimes)
+{
+	struct json_object_iter iter;
+
+	json_object_object_foreachC(tests, iter) {
+		struct json_object *key = json_object_new_string(iter.key);
+
+		fprintf(stream->out, "%s\n    %s: %s",
+			stream->first ? "" : ",",
+			json_object_to_json_string(key),
+			json_object_to_json_string_ext(iter.val, JSON_C_TO_STRING_PLAIN));
+		stream->first = false;
+
+		json_object_put(key);
+	}
+
+	merge_totals(stream->totals.totals, totals);
+	merge_runtimes(stream->totals.runtimes, runtimes);
+}
+
+static bool stream_parsed_results(struct results_stream *stream,
+				  struct json_object *obj)
+{
+	struct json_object *tests, *totals, *runtimes;
+
+	if (!json_object_object_get_ex(obj, "tests", &tests) ||
+	    !json_object_object_get_ex(obj, "totals", &totals) ||
+	    !json_object_object_get_ex(obj, "runtimes", &runtimes))
+		return false;
+
+	stream_entry_results(stream, tests, totals, runtimes);
+	return true;
+}
+
+/*
+ * Finds the offset of the last line for each job list entry in the
+ * incremental results file. Entries without a line get -1.
+ */
+static off_t *index_incremental_results(FILE *f, size_t size)
+{
+	off_t *offsets = malloc(size * sizeof(*offsets));
+	char *line = NULL;
+	size_t linelen = 0;
+	off_t offset = 0;
+	ssize_t len;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		offsets[i] = -1;
+
+	while ((len = getline(&line, &linelen, f)) > 0) {
+		unsigned long idx;
+
+		/* Skip torn writes from an interrupted run */
+		if (sscanf(line, "{\"index\":%lu", &idx) == 1 &&
+		    idx < size && line[len - 1] == '\n')
+			offsets[idx] = offset;
+
+		offset += len;
+	}
+
+	free(line);
+	return offsets;
+}
+
+static bool stream_results_directory(int dirfd,
+				     struct job_list *job_list,
+				     struct settings *settings,
+				     void *data)
+{
+	struct results_stream *stream = data;
+	FILE *f = NULL;
+	off_t *offsets = NULL;
+	char *line = NULL;
+	size_t linelen = 0;
+	bool ok = true;
+	size_t i;
+	int fd;
+
+	if (dirfd >= 0 &&
+	    (fd = openat(dirfd, incremental_filename, O_RDONLY)) >= 0) {
+		if ((f = fdopen(fd, "r")) != NULL)
+			offsets = index_incremental_results(f, job_list->size);
+		else
+			close(fd);
+	}
+
+	for (i = 0; ok && i < job_list->size; i++) {
+		struct json_object *obj = NULL;
+		struct results results;
+
+		if (offsets && offsets[i] >= 0 &&
+		    fseeko(f, offsets[i], SEEK_SET) == 0 &&
+		    getline(&line, &linelen, f) > 0)
+			obj = json_tokener_parse(line);
 
-		snprintf(name, 16, "%zd", i);
-		if ((testdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) < 0) {
-			try_add_notrun_results(&job_list.entries[i], &settings, &results);
+		if (obj && stream_parsed_results(stream, obj)) {
+			json_object_put(obj);
 			continue;
 		}
 
-		if (!parse_test_directory(testdirfd, &job_list.entries[i], &settings, &results)) {
-			close(testdirfd);
-			return NULL;
-		}
-		close(testdirfd);
+		/* Not recorded incrementally, parse the entry now */
+		json_object_put(obj);
+		obj = json_object_new_object();
+		create_result_root_nodes(obj, &results);
+		ok = parse_entry_results(dirfd, i, &job_list->entries[i],
+					 settings, &results);
+		if (ok)
+			stream_entry_results(stream, results.tests,
+					     results.totals, results.runtimes);
+		json_object_put(obj);
 	}
 
-	if ((fd = openat(dirfd, "aborted.txt", O_RDONLY)) >= 0) {
-		char buf[4096];
-		char piglit_name[] = "igt@runner@aborted";
-		struct subtests abortsub = {};
-		struct json_object *aborttest = get_or_create_json_object(results.tests, piglit_name);
-		ssize_t s;
-
-		add_subtest(&abortsub, strdup("aborted"));
+	/* With parallel workers, the first abort gets reported */
+	if (ok && dirfd >= 0 && !stream->aborted) {
+		struct json_object *obj = json_object_new_object();
+		struct results results;
+
+		create_result_root_nodes(obj, &results);
+		add_abort_result(dirfd, &results);
+		stream->aborted = json_object_object_length(results.tests) > 0;
+		stream_entry_results(stream, results.tests,
+				     results.totals, results.runtimes);
+		json_object_put(obj);
+	}
 
-		s = read(fd, buf, sizeof(buf));
+	free(line);
+	free(offsets);
+	if (f)
+		fclose(f);
 
-		json_object_object_add(aborttest, "out",
-				       json_object_new_string_len(buf, s));
-		json_object_object_add(aborttest, "err",
-				       json_object_new_string(""));
-		json_object_object_add(aborttest, "dmesg",
-				       json_object_new_string(""));
-		json_object_object_add(aborttest, "result",
-				       json_object_new_string("fail"));
+	return ok;
+}
 
-		add_to_totals("runner", &abortsub, &results);
+/*
+ * Generates results.json from the incremental results without
+ * holding all the test outputs in memory at once. The tests object is
+ * streamed to the file entry by entry, only the totals and runtimes
+ * are accumulated.
+ */
+static bool generate_results_incremental(int dirfd,
+					 struct settings *settings,
+					 struct job_list *job_list)
+{
+	struct results_stream stream = { .first = true };
+	struct json_object *obj;
+	const char *json_string;
+	int resultsfd;
+	bool ok;
 
-		free_subtests(&abortsub);
+	if ((resultsfd = openat(dirfd, "results.json", O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0 ||
+	    (stream.out = fdopen(resultsfd, "w")) == NULL) {
+		fprintf(stderr, "resultgen: Cannot create results file\n");
+		if (resultsfd >= 0)
+			close(resultsfd);
+		return false;
 	}
 
-	free_settings(&settings);
-	free_job_list(&job_list);
+	obj = create_results_root(dirfd, settings);
+	stream.totals.totals = json_object_new_object();
+	json_object_object_add(obj, "totals", stream.totals.totals);
+	stream.totals.runtimes = json_object_new_object();
+	json_object_object_add(obj, "runtimes", stream.totals.runtimes);
 
-	return obj;
+	fprintf(stream.out, "{\n  \"tests\": {");
+	ok = for_each_results_directory(dirfd, settings, job_list,
+					stream_results_directory, &stream);
+
+	/* Splice the rest of the root object in after the tests */
+	json_string = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY);
+	fprintf(stream.out, "\n  },%s", strchr(json_string, '{') + 1);
+	fputc('\n', stream.out);
+
+	json_object_put(obj);
+
+	if (fclose(stream.out))
+		ok = false;
+
+	return ok;
 }
 
 bool generate_results(int dirfd)
 {
-	struct json_object *obj = generate_results_json(dirfd);
+	struct json_object *obj;
+	struct settings settings;
+	struct job_list job_list;
 	const char *json_string;
 	int resultsfd;
 
+	init_settings(&settings);
+	init_job_list(&job_list);
+
+	if (read_settings_from_dir(&settings, dirfd) &&
+	    settings.incremental_results) {
+		bool ok = read_job_list(&job_list, dirfd) &&
+			generate_results_incremental(dirfd, &settings, &job_list);
+
+		free_settings(&settings);
+		free_job_list(&job_list);
+		return ok;
+	}
+	free_settings(&settings);
+
+	obj = generate_results_json(dirfd);
 	if (obj == NULL)
 		return false;
 
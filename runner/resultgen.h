@@ -3,9 +3,16 @@
 
 #include <stdbool.h>
 
+#include "job_list.h"
+#include "settings.h"
+
 bool generate_results(int dirfd);
 bool generate_results_path(char *resultspath);
 
 struct json_object *generate_results_json(int dirfd);
 
+bool append_incremental_results(int dirfd, size_t idx,
+				struct job_list_entry *entry,
+				struct settings *settings);
+
 #endif
@@ -5,6 +5,7 @@
 #include "job_list.h"
 #include "executor.h"
 #include "resultgen.h"
+#include "distributed.h"
 
 int main(int argc, char **argv)
 {
@@ -20,6 +21,13 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	/* The coordinator has the job list and collects the results */
+	if (settings.connect) {
+		exitcode = execute_remote_worker(&settings) ? 0 : 1;
+		free_settings(&settings);
+		return exitcode;
+	}
+
 	if (!create_job_list(&job_list, &settings)) {
 		return 1;
 	}
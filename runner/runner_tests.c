@@ -1,5 +1,6 @@
 #include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -9,6 +10,7 @@
 #include "settings.h"
 #include "job_list.h"
 #include "executor.h"
+#include "resultgen.h"
 
 /*
  * NOTE: this test is using a lot of variables that are changed in igt_fixture,
@@ -166,6 +168,16 @@ static void assert_settings_equal(struct settings *one, struct settings *two)
 	igt_assert_eqstr(one->results_path, two->results_path);
 	igt_assert_eq(one->piglit_style_dmesg, two->piglit_style_dmesg);
 	igt_assert_eq(one->dmesg_warn_level, two->dmesg_warn_level);
+	igt_assert_eq(one->num_workers, two->num_workers);
+	igt_assert_eqstr(one->devices, two->devices);
+	igt_assert_eq(one->incremental_results, two->incremental_results);
+	igt_assert_eq(one->dmesg_ring_buffer, two->dmesg_ring_buffer);
+	igt_assert_eq(one->use_zygote, two->use_zygote);
+	igt_assert_eq(one->coordinator_port, two->coordinator_port);
+	igt_assert_eq(one->compress_outputs, two->compress_outputs);
+	igt_assert_eqstr(one->test_cpus, two->test_cpus);
+	igt_assert_eq(one->test_fifo_priority, two->test_fifo_priority);
+	igt_assert_eq(one->test_nice, two->test_nice);
 }
 
 static void assert_job_list_equal(struct job_list *one, struct job_list *two)
@@ -202,6 +214,7 @@ static void assert_execution_results_exist(int dirfd)
 	assert_execution_created(dirfd, "out.txt");
 	assert_execution_created(dirfd, "err.txt");
 	assert_execution_created(dirfd, "dmesg.txt");
+	assert_execution_created(dirfd, "events.txt");
 }
 
 igt_main
@@ -256,6 +269,17 @@ igt_main
 
 		igt_assert(!settings->piglit_style_dmesg);
 		igt_assert_eq(settings->dmesg_warn_level, 4);
+		igt_assert_eq(settings->num_workers, 0);
+		igt_assert(!settings->devices);
+		igt_assert(!settings->incremental_results);
+		igt_assert_eq(settings->dmesg_ring_buffer, 0);
+		igt_assert(!settings->use_zygote);
+		igt_assert(!settings->compress_outputs);
+		igt_assert_eq(settings->coordinator_port, 0);
+		igt_assert(!settings->connect);
+		igt_assert(!settings->test_cpus);
+		igt_assert_eq(settings->test_fifo_priority, 0);
+		igt_assert_eq(settings->test_nice, 0);
 	}
 
 	igt_subtest_group {
@@ -400,6 +424,12 @@ igt_main
 				       "--use-watchdog",
 				       "--piglit-style-dmesg",
 				       "--dmesg-warn-level=3",
+				       "--workers", "3",
+				       "--devices", "/dev/dri/card0,/dev/dri/card1",
+				       "--incremental-results",
+				       "--dmesg-ring-buffer", "256",
+				       "--zygote",
+				       "--compress-outputs",
 				       "test-root-dir",
 				       "path-to-results",
 		};
@@ -433,7 +463,131 @@ igt_main
 
 		igt_assert(settings->piglit_style_dmesg);
 		igt_assert_eq(settings->dmesg_warn_level, 3);
+		igt_assert_eq(settings->num_workers, 3);
+		igt_assert_eqstr(settings->devices, "/dev/dri/card0,/dev/dri/card1");
+		igt_assert(settings->incremental_results);
+		igt_assert_eq(settings->dmesg_ring_buffer, 256);
+		igt_assert(settings->use_zygote);
+		igt_assert(settings->compress_outputs);
 	}
+
+	igt_subtest("devices-imply-workers") {
+		const char *argv[] = { "runner",
+				       "--devices", "/dev/dri/card0,/dev/dri/card1",
+				       "test-root-dir",
+				       "path-to-results",
+		};
+		char *device;
+
+		igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+
+		igt_assert_eq(settings->num_workers, 2);
+		igt_assert_eq(count_devices(settings), 2);
+
+		device = get_device(settings, 0);
+		igt_assert_eqstr(device, "/dev/dri/card0");
+		free(device);
+
+		device = get_device(settings, 1);
+		igt_assert_eqstr(device, "/dev/dri/card1");
+		free(device);
+
+		/* Worker slots wrap around the device list */
+		device = get_device(settings, 2);
+		igt_assert_eqstr(device, "/dev/dri/card0");
+		free(device);
+	}
+
+	igt_subtest("distributed-options") {
+		const char *coordinator[] = { "runner",
+					      "--coordinator", "7777",
+					      "test-root-dir",
+					      "path-to-results",
+		};
+		const char *worker[] = { "runner",
+					 "--connect", "ci-coordinator:7777",
+					 "test-root-dir",
+					 "path-to-results",
+		};
+		const char *both[] = { "runner",
+				       "--coordinator", "7777",
+				       "--connect", "ci-coordinator:7777",
+				       "test-root-dir",
+				       "path-to-results",
+		};
+		const char *local_workers[] = { "runner",
+						"--coordinator", "7777",
+						"--workers", "2",
+						"test-root-dir",
+						"path-to-results",
+		};
+		const char *no_port[] = { "runner",
+					  "--connect", "ci-coordinator",
+					  "test-root-dir",
+					  "path-to-results",
+		};
+
+		igt_assert(parse_options(ARRAY_SIZE(coordinator), (char**)coordinator, settings));
+		igt_assert_eq(settings->coordinator_port, 7777);
+		igt_assert(!settings->connect);
+
+		igt_assert(parse_options(ARRAY_SIZE(worker), (char**)worker, settings));
+		igt_assert_eq(settings->coordinator_port, 0);
+		igt_assert_eqstr(settings->connect, "ci-coordinator:7777");
+
+		igt_assert(!parse_options(ARRAY_SIZE(both), (char**)both, settings));
+		igt_assert(!parse_options(ARRAY_SIZE(local_workers), (char**)local_workers, settings));
+		igt_assert(!parse_options(ARRAY_SIZE(no_port), (char**)no_port, settings));
+	}
+
+	igt_subtest("test-isolation-options") {
+		const char *fifo[] = { "runner",
+				       "--test-cpus", "2-5,8",
+				       "--test-sched", "fifo",
+				       "test-root-dir",
+				       "path-to-results",
+		};
+		const char *nice[] = { "runner",
+				       "--test-sched", "nice:-10",
+				       "test-root-dir",
+				       "path-to-results",
+		};
+		const char *bad_cpus[] = { "runner",
+					   "--test-cpus", "5-2",
+					   "test-root-dir",
+					   "path-to-results",
+		};
+		const char *bad_sched[] = { "runner",
+					    "--test-sched", "fifo:100",
+					    "test-root-dir",
+					    "path-to-results",
+		};
+		cpu_set_t set;
+
+		igt_assert(parse_options(ARRAY_SIZE(fifo), (char**)fifo, settings));
+		igt_assert_eqstr(settings->test_cpus, "2-5,8");
+		igt_assert_eq(settings->test_fifo_priority, 50);
+		igt_assert_eq(settings->test_nice, 0);
+
+		igt_assert(parse_options(ARRAY_SIZE(nice), (char**)nice, settings));
+		igt_assert(!settings->test_cpus);
+		igt_assert_eq(settings->test_fifo_priority, 0);
+		igt_assert_eq(settings->test_nice, -10);
+
+		igt_assert(!parse_options(ARRAY_SIZE(bad_cpus), (char**)bad_cpus, settings));
+		igt_assert(!parse_options(ARRAY_SIZE(bad_sched), (char**)bad_sched, settings));
+
+		igt_assert(parse_cpu_list("2-5,8", &set));
+		igt_assert_eq(CPU_COUNT(&set), 5);
+		igt_assert(CPU_ISSET(2, &set) && CPU_ISSET(5, &set) && CPU_ISSET(8, &set));
+		igt_assert(!CPU_ISSET(6, &set));
+		igt_assert(parse_cpu_list("0", &set));
+		igt_assert(!parse_cpu_list("", &set));
+		igt_assert(!parse_cpu_list("1,", &set));
+		igt_assert(!parse_cpu_list("1-", &set));
+		igt_assert(!parse_cpu_list("a", &set));
+	}
+
 	igt_subtest("parse-list-all") {
 		const char *argv[] = { "runner",
 				       "--list-all",
@@ -658,6 +812,54 @@ igt_main
 	job_list_filter_test("piglit-names", "-t", "igt@successtest", 2, 1);
 	job_list_filter_test("piglit-names-subtest", "-t", "igt@successtest@first", 1, 1);
 
+	igt_subtest("job-list-combined-filters") {
+		const char *argv[] = { "runner",
+				       "-x", "first",
+				       "-x", "skip-o.e",
+				       testdatadir,
+				       "path-to-results",
+		};
+		struct job_list list;
+		bool success;
+		size_t size;
+
+		init_job_list(&list);
+		igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+		igt_assert(settings->exclude_regexes.combined);
+
+		success = create_job_list(&list, settings);
+		size = list.size;
+		free_job_list(&list);
+
+		igt_assert(success);
+		igt_assert_eq(size, 3);
+	}
+
+	igt_subtest("job-list-uncombined-filters") {
+		/* A backreference can't be part of a larger regex */
+		const char *argv[] = { "runner",
+				       "-x", "first",
+				       "-x", "(skip)-\\1",
+				       "-x", "skip-o.e",
+				       testdatadir,
+				       "path-to-results",
+		};
+		struct job_list list;
+		bool success;
+		size_t size;
+
+		init_job_list(&list);
+		igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+		igt_assert(!settings->exclude_regexes.combined);
+
+		success = create_job_list(&list, settings);
+		size = list.size;
+		free_job_list(&list);
+
+		igt_assert(success);
+		igt_assert_eq(size, 3);
+	}
+
 	igt_subtest_group {
 		char filename[] = "tmplistXXXXXX";
 		const char testlisttext[] = "igt@successtest@first-subtest\n"
@@ -728,6 +930,95 @@ igt_main
 		}
 	}
 
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		const char testlisttext[] = "TESTLIST\nsuccesstest\nEND TESTLIST\n";
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1;
+		char indextext[256];
+		char target[PATH_MAX];
+		struct stat st;
+		int multiple;
+
+		igt_fixture {
+			int fd;
+
+			igt_require(mkdtemp(dirname) != NULL);
+			igt_require((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_require((fd = openat(dirfd, "test-list.txt", O_CREAT | O_WRONLY, 0660)) >= 0);
+			igt_require(write(fd, testlisttext, strlen(testlisttext)) == strlen(testlisttext));
+			close(fd);
+
+			snprintf(target, sizeof(target), "%s/successtest", testdatadir);
+			igt_require(stat(target, &st) == 0);
+			igt_require(symlinkat(target, dirfd, "successtest") == 0);
+
+			init_job_list(list);
+		}
+
+		for (multiple = 0; multiple < 2; multiple++) {
+			igt_subtest_f("job-list-subtest-index-%s", multiple ? "multiple" : "normal") {
+				const char *argv[] = { "runner",
+						       multiple ? "--multiple-mode" : "--sync",
+						       "-x", "nothing",
+						       dirname,
+						       "path-to-results",
+				};
+				int fd;
+
+				/* Not the real subtests, to tell them apart */
+				snprintf(indextext, sizeof(indextext),
+					 "SUBTEST INDEX\nsuccesstest %lld 2\nfirst-indexed\nsecond-indexed\n",
+					 (long long)st.st_mtime);
+				igt_assert((fd = openat(dirfd, "subtest-index.txt", O_CREAT | O_TRUNC | O_WRONLY, 0660)) >= 0);
+				igt_assert(write(fd, indextext, strlen(indextext)) == strlen(indextext));
+				close(fd);
+
+				igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+				igt_assert(create_job_list(list, settings));
+
+				igt_assert_eq(list->size, multiple ? 1 : 2);
+				igt_assert_eqstr(list->entries[0].binary, "successtest");
+				igt_assert_eq(list->entries[0].subtest_count, multiple ? 2 : 1);
+				igt_assert_eqstr(list->entries[0].subtests[0], "first-indexed");
+				igt_assert_eqstr(list->entries[multiple ? 0 : 1].subtests[multiple ? 1 : 0], "second-indexed");
+			}
+
+			igt_subtest_f("job-list-subtest-index-stale-%s", multiple ? "multiple" : "normal") {
+				const char *argv[] = { "runner",
+						       multiple ? "--multiple-mode" : "--sync",
+						       "-x", "nothing",
+						       dirname,
+						       "path-to-results",
+				};
+				int fd;
+
+				/* The binary changed since, its subtests get listed again */
+				snprintf(indextext, sizeof(indextext),
+					 "SUBTEST INDEX\nsuccesstest %lld 1\nfirst-indexed\n",
+					 (long long)st.st_mtime - 1);
+				igt_assert((fd = openat(dirfd, "subtest-index.txt", O_CREAT | O_TRUNC | O_WRONLY, 0660)) >= 0);
+				igt_assert(write(fd, indextext, strlen(indextext)) == strlen(indextext));
+				close(fd);
+
+				igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+				igt_assert(create_job_list(list, settings));
+
+				igt_assert_eq(list->size, multiple ? 1 : 2);
+				igt_assert_eq(list->entries[0].subtest_count, multiple ? 2 : 1);
+				igt_assert_eqstr(list->entries[0].subtests[0], "first-subtest");
+			}
+		}
+
+		igt_fixture {
+			unlinkat(dirfd, "successtest", 0);
+			clear_directory_fd(dirfd);
+			rmdir(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
 	igt_subtest_group {
 		char dirname[] = "tmpdirXXXXXX";
 		volatile int dirfd = -1, fd = -1;
@@ -758,6 +1049,7 @@ igt_main
 					       "--overall-timeout", "360",
 					       "--use-watchdog",
 					       "--piglit-style-dmesg",
+					       "--devices", "/dev/dri/card0,/dev/dri/card1",
 					       testdatadir,
 					       dirname,
 			};
@@ -844,6 +1136,160 @@ igt_main
 		}
 	}
 
+	igt_subtest_group {
+		char filename[] = "tmp.historyXXXXXX";
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int fd = -1;
+
+		igt_fixture {
+			static const char history[] =
+				"{ \"tests\": {"
+				"  \"igt@successtest@second-subtest\": { \"time\": { \"end\": 5.0 } },"
+				"  \"igt@skippers@skip-two\": { \"time\": { \"end\": 30.0 } }"
+				"}, \"runtimes\": {"
+				"  \"igt@no-subtests\": { \"time\": { \"end\": 1.0 } }"
+				"} }";
+
+			init_job_list(list);
+			igt_require((fd = mkstemp(filename)) >= 0);
+			igt_require(write(fd, history, strlen(history)) == strlen(history));
+		}
+
+		igt_subtest("job-list-runtime-history") {
+			const char *argv[] = { "runner",
+					       "--runtime-history", filename,
+					       testdatadir,
+					       "path-to-results",
+			};
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert_eq(settings->runtime_history.size, 1);
+			igt_assert(create_job_list(list, settings));
+			debug_print_executions(list);
+
+			igt_assert_lte(3, list->size);
+			igt_assert_eqstr(list->entries[0].binary, "skippers");
+			igt_assert_eqstr(list->entries[0].subtests[0], "skip-two");
+			/* Unknown runtimes are averaged, putting these in the middle */
+			igt_assert_eqstr(list->entries[list->size - 2].binary, "successtest");
+			igt_assert_eqstr(list->entries[list->size - 2].subtests[0], "second-subtest");
+			igt_assert_eqstr(list->entries[list->size - 1].binary, "no-subtests");
+		}
+
+		igt_subtest("job-list-adaptive-timeout") {
+			const char *argv[] = { "runner",
+					       "--runtime-history", filename,
+					       "--adaptive-timeout", "3",
+					       testdatadir,
+					       "path-to-results",
+			};
+			const char *nohistory_argv[] = { "runner",
+							 "--adaptive-timeout", "3",
+							 testdatadir,
+							 "path-to-results",
+			};
+			size_t i;
+
+			igt_assert(!parse_options(ARRAY_SIZE(nohistory_argv), (char**)nohistory_argv, settings));
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert_eq(settings->adaptive_timeout, 3.0);
+			igt_assert(create_job_list(list, settings));
+
+			for (i = 0; i < list->size; i++) {
+				struct job_list_entry *entry = &list->entries[i];
+
+				/* One runtime each, so the timeout is the median, but at least 10s */
+				if (!strcmp(entry->binary, "skippers") &&
+				    !strcmp(entry->subtests[0], "skip-two"))
+					igt_assert_eq(entry->timeout, 30);
+				else if (!strcmp(entry->binary, "no-subtests") ||
+					 (!strcmp(entry->binary, "successtest") &&
+					  !strcmp(entry->subtests[0], "second-subtest")))
+					igt_assert_eq(entry->timeout, 10);
+				else
+					igt_assert_eq(entry->timeout, 0);
+			}
+		}
+
+		igt_fixture {
+			close(fd);
+			unlink(filename);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
+	igt_subtest("job-list-entry-line") {
+		struct job_list list, copy;
+		const char *argv[] = { "runner",
+				       testdatadir,
+				       "path-to-results",
+		};
+		size_t i;
+
+		init_job_list(&list);
+		init_job_list(&copy);
+
+		igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+		igt_assert(create_job_list(&list, settings));
+
+		/* The lines the coordinator hands out to the workers */
+		for (i = 0; i < list.size; i++) {
+			char *line = NULL;
+			size_t len = 0;
+			FILE *f;
+
+			igt_assert((f = open_memstream(&line, &len)) != NULL);
+			write_job_list_entry(f, &list.entries[i]);
+			fclose(f);
+
+			add_job_list_line(&copy, line);
+			free(line);
+		}
+
+		assert_job_list_equal(&list, &copy);
+
+		free_job_list(&copy);
+		free_job_list(&list);
+	}
+
+	igt_subtest("job-list-shard") {
+		struct job_list list, shards[3];
+		const char *argv[] = { "runner",
+				       testdatadir,
+				       "path-to-results",
+		};
+		size_t i, k, total = 0;
+
+		init_job_list(&list);
+		for (i = 0; i < ARRAY_SIZE(shards); i++)
+			init_job_list(&shards[i]);
+
+		igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+		igt_assert(create_job_list(&list, settings));
+
+		for (i = 0; i < ARRAY_SIZE(shards); i++) {
+			shard_job_list(&shards[i], &list, i, ARRAY_SIZE(shards));
+			total += shards[i].size;
+
+			for (k = 0; k < shards[i].size; k++) {
+				struct job_list_entry *orig =
+					&list.entries[i + k * ARRAY_SIZE(shards)];
+
+				igt_assert_eqstr(shards[i].entries[k].binary, orig->binary);
+				igt_assert_eq(shards[i].entries[k].subtest_count,
+					      orig->subtest_count);
+			}
+		}
+
+		igt_assert_eq(total, list.size);
+
+		for (i = 0; i < ARRAY_SIZE(shards); i++)
+			free_job_list(&shards[i]);
+		free_job_list(&list);
+	}
+
 	igt_subtest_group {
 		char dirname[] = "tmpdirXXXXXX";
 		struct job_list *list = malloc(sizeof(*list));
@@ -1339,6 +1785,265 @@ igt_main
 			free(list);
 	}
 
+	igt_subtest_group {
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1, subdirfd = -1;
+		char dirname[] = "tmpdirXXXXXX";
+
+		igt_fixture {
+			igt_require(mkdtemp(dirname) != NULL);
+			rmdir(dirname);
+
+			init_job_list(list);
+		}
+
+		igt_subtest("execute-zygote-journal") {
+			struct execute_state state;
+			const char *argv[] = { "runner",
+					       "--zygote",
+					       "-t", "successtest",
+					       testdatadir,
+					       dirname,
+			};
+			const char *expected[] = {
+				"first-subtest\nexit:0 (",
+				"second-subtest\nexit:0 (",
+			};
+			char *dump;
+			int i;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert_eq(list->size, 2);
+			igt_assert(initialize_execute_state(&state, settings, list));
+
+			igt_assert(execute(&state, settings, list));
+			igt_assert_f((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create the results directory\n");
+
+			for (i = 0; i < ARRAY_SIZE(expected); i++) {
+				char name[16];
+
+				snprintf(name, sizeof(name), "%d", i);
+				igt_assert_f((subdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) >= 0,
+					     "Execute didn't create result directory '%s'\n", name);
+				dump = dump_file(subdirfd, "journal.txt");
+				igt_assert_f(dump != NULL,
+					     "Execute didn't create the journal\n");
+				/* Trim out the runtime */
+				dump[strlen(expected[i])] = '\0';
+				igt_assert_eqstr(dump, expected[i]);
+				free(dump);
+
+				dump = dump_file(subdirfd, "out.txt");
+				igt_assert_f(dump != NULL,
+					     "Execute didn't create the output\n");
+				igt_assert(strstr(dump, "IGT-Version: ") != NULL);
+				free(dump);
+
+				close(subdirfd);
+				subdirfd = -1;
+			}
+		}
+
+		igt_fixture {
+			close(subdirfd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
+	igt_subtest_group {
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1;
+		char dirname[] = "tmpdirXXXXXX";
+
+		igt_fixture {
+			igt_require(mkdtemp(dirname) != NULL);
+			rmdir(dirname);
+
+			init_job_list(list);
+		}
+
+		igt_subtest("execute-incremental-results") {
+			struct execute_state state;
+			const char *argv[] = { "runner",
+					       "--incremental-results",
+					       "-t", "skippers",
+					       testdatadir,
+					       dirname,
+			};
+			char *dump;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert(initialize_execute_state(&state, settings, list));
+
+			igt_assert(execute(&state, settings, list));
+			igt_assert_f((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create the results directory\n");
+
+			dump = dump_file(dirfd, "results.jsonl");
+			igt_assert_f(dump != NULL,
+				     "Execute didn't create results.jsonl\n");
+			igt_assert(!strncmp(dump, "{\"index\":0,", strlen("{\"index\":0,")));
+			igt_assert(strstr(dump, "\n{\"index\":1,") != NULL);
+			free(dump);
+
+			igt_assert(generate_results(dirfd));
+			dump = dump_file(dirfd, "results.json");
+			igt_assert_f(dump != NULL,
+				     "Resultgen didn't create results.json\n");
+			igt_assert(strstr(dump, "\"igt@skippers@skip-one\"") != NULL);
+			igt_assert(strstr(dump, "\"igt@skippers@skip-two\"") != NULL);
+			igt_assert(strstr(dump, "\"totals\"") != NULL);
+			free(dump);
+		}
+
+		igt_fixture {
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
+	igt_subtest_group {
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1, fd = -1;
+		char dirname[] = "tmpdirXXXXXX";
+
+		igt_fixture {
+			igt_require(mkdtemp(dirname) != NULL);
+			rmdir(dirname);
+
+			init_job_list(list);
+		}
+
+		igt_subtest("execute-binary-journal") {
+			struct execute_state state;
+			const char *argv[] = { "runner",
+					       "-t", "skippers",
+					       testdatadir,
+					       dirname,
+			};
+			const uint32_t expected_types[] = {
+				JOURNAL_START, JOURNAL_SUBTEST, JOURNAL_EXIT,
+				JOURNAL_START, JOURNAL_SUBTEST, JOURNAL_EXIT,
+			};
+			struct journal_record record;
+			char *dump;
+			size_t dumpsize;
+			FILE *f;
+			int i;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert_eq(list->size, 2);
+			igt_assert(initialize_execute_state(&state, settings, list));
+
+			igt_assert(execute(&state, settings, list));
+			igt_assert_f((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create the results directory\n");
+
+			igt_assert_f((fd = openat(dirfd, BINARY_JOURNAL_FILENAME, O_RDONLY)) >= 0,
+				     "Execute didn't create the binary journal\n");
+			for (i = 0; i < ARRAY_SIZE(expected_types); i++) {
+				igt_assert_eq(read(fd, &record, sizeof(record)), sizeof(record));
+				igt_assert_eq(record.type, expected_types[i]);
+				igt_assert_eq(record.entry, i / 3);
+				if (record.type == JOURNAL_EXIT)
+					igt_assert_eq(record.result, IGT_EXIT_SKIP);
+			}
+			igt_assert_eq(read(fd, &record, sizeof(record)), 0);
+			close(fd);
+			fd = -1;
+
+			f = open_memstream(&dump, &dumpsize);
+			igt_assert(dump_binary_journal(dirfd, f));
+			fclose(f);
+			igt_assert(strstr(dump, "exit:77") != NULL);
+			free(dump);
+
+			igt_assert(initialize_execute_state_from_resume(dirfd, &state, settings, list));
+			/* initialize_execute_state_from_resume() closes the dirfd */
+			dirfd = -1;
+			igt_assert_eq(state.next, 2);
+		}
+
+		igt_fixture {
+			close(fd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
+	igt_subtest_group {
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1, subdirfd = -1, fd = -1;
+		char dirname[] = "tmpdirXXXXXX";
+
+		igt_fixture {
+			igt_require(mkdtemp(dirname) != NULL);
+			rmdir(dirname);
+
+			init_job_list(list);
+		}
+
+		igt_subtest("execute-compressed-outputs") {
+			struct execute_state state;
+			const char *argv[] = { "runner",
+					       "--compress-outputs",
+					       "-t", "successtest",
+					       testdatadir,
+					       dirname,
+			};
+			char *dump;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert(initialize_execute_state(&state, settings, list));
+
+			igt_assert(execute(&state, settings, list));
+			igt_assert_f((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create the results directory\n");
+			igt_assert_f((subdirfd = openat(dirfd, "0", O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create result directory '0'\n");
+
+			/* The journal stays plain */
+			dump = dump_file(subdirfd, "journal.txt");
+			igt_assert_f(dump != NULL,
+				     "Execute didn't create the journal\n");
+			igt_assert(!strncmp(dump, "first-subtest\nexit:0 (", strlen("first-subtest\nexit:0 (")));
+			free(dump);
+
+			igt_assert((fd = openat(subdirfd, "out.txt", O_RDONLY)) < 0);
+			igt_assert_f((fd = openat(subdirfd, "out.txt.gz", O_RDONLY)) >= 0,
+				     "Execute didn't create the compressed output\n");
+
+			igt_assert(generate_results(dirfd));
+			dump = dump_file(dirfd, "results.json");
+			igt_assert_f(dump != NULL,
+				     "Resultgen didn't create results.json\n");
+			igt_assert(strstr(dump, "\"igt@successtest@first-subtest\"") != NULL);
+			igt_assert(strstr(dump, "Subtest first-subtest: SUCCESS") != NULL);
+			free(dump);
+		}
+
+		igt_fixture {
+			close(fd);
+			close(subdirfd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
 	igt_subtest("file-descriptor-leakage") {
 		int i;
 
@@ -20,6 +20,18 @@ enum {
 	OPT_PIGLIT_DMESG,
 	OPT_DMESG_WARN_LEVEL,
 	OPT_OVERALL_TIMEOUT,
+	OPT_WORKERS,
+	OPT_DEVICES,
+	OPT_RUNTIME_HISTORY,
+	OPT_INCREMENTAL_RESULTS,
+	OPT_DMESG_RING_BUFFER,
+	OPT_ZYGOTE,
+	OPT_COMPRESS_OUTPUTS,
+	OPT_ADAPTIVE_TIMEOUT,
+	OPT_COORDINATOR,
+	OPT_CONNECT,
+	OPT_TEST_CPUS,
+	OPT_TEST_SCHED,
 	OPT_HELP = 'h',
 	OPT_NAME = 'n',
 	OPT_DRY_RUN = 'd',
@@ -180,6 +192,48 @@ static const char *usage_str =
 	"                        Exclude all test matching to regexes from FILENAME\n"
 	"                        (can be used more than once)\n"
 	"  -L, --list-all        List all matching subtests instead of running\n"
+	"  --workers <count>     Shard the job list across <count> worker slots that\n"
+	"                        execute in parallel, each with its own results\n"
+	"                        subdirectory and journal. Defaults to the number of\n"
+	"                        devices given with --devices.\n"
+	"  --devices <list>      A comma-separated list of DRM device nodes. Worker\n"
+	"                        slots are assigned to the devices in round-robin\n"
+	"                        order and tests are restricted to their device.\n"
+	"  --runtime-history <results.json>\n"
+	"                        Order the job list longest-first using the runtimes\n"
+	"                        recorded in the results of a previous run. Can be used\n"
+	"                        more than once, the runtimes are averaged. Tests\n"
+	"                        without recorded runtimes are assumed to take the\n"
+	"                        average time.\n"
+	"  --incremental-results Record the results of each test to results.jsonl as\n"
+	"                        soon as it finishes, and assemble results.json from\n"
+	"                        those records without keeping all test outputs in\n"
+	"                        memory\n"
+	"  --dmesg-ring-buffer <kilobytes>\n"
+	"                        Keep the kernel log of a test in a ring buffer of the\n"
+	"                        given size and only write it out when the test fails\n"
+	"                        or a message at --dmesg-warn-level appears\n"
+	"  --zygote              Execute each test binary only once and fork the\n"
+	"                        processes for its subtests from the initialized\n"
+	"                        binary, saving the startup cost per subtest\n"
+	"  --compress-outputs    Store the outputs and the kernel log of each test\n"
+	"                        gzip-compressed\n"
+	"  --adaptive-timeout <k>\n"
+	"                        Use an inactivity timeout of median + k * IQR of the\n"
+	"                        runtimes in --runtime-history for tests that have\n"
+	"                        them, if shorter than --inactivity-timeout. Tests\n"
+	"                        are given at least 10 seconds.\n"
+	"  --coordinator <port>  Don't execute the tests but hand them out one at a\n"
+	"                        time to the workers connecting to <port>, storing\n"
+	"                        their results in results-path\n"
+	"  --connect <host:port> Execute tests handed out by the coordinator at\n"
+	"                        <host:port>, with its settings, until it runs out.\n"
+	"                        The results-path only holds local copies.\n"
+	"  --test-cpus <list>    Execute the tests on the given CPUs only, e.g. 2-5,8,\n"
+	"                        in a cgroup of their own, keeping the runner itself\n"
+	"                        on the other CPUs\n"
+	"  --test-sched <policy> Scheduling of the test processes, fifo[:<priority>]\n"
+	"                        for SCHED_FIFO (default priority 50) or nice:<n>\n"
 	"  [test_root]           Directory that contains the IGT tests. The environment\n"
 	"                        variable IGT_TEST_ROOT will be used if set, overriding\n"
 	"                        this option if given.\n"
@@ -266,10 +320,60 @@ static bool parse_blacklist(struct regex_list *exclude_regexes,
 	return status;
 }
 
+/*
+ * Whether a regex means the same as a group of a larger one: references
+ * to numbered or named groups, \\Q quoting and inline options, which could
+ * turn on extended mode and its comments, would all leak out of it.
+ */
+static bool self_contained_regex(const char *regex)
+{
+	const char *s;
+
+	for (s = regex; *s; s++) {
+		if (*s == '\\') {
+			if (!*++s)
+				return false;
+			if (strchr("123456789gkQ", *s))
+				return false;
+		} else if (s[0] == '(' && s[1] == '?') {
+			if (!strchr(":=!>", s[2]) &&
+			    strncmp(s + 2, "<=", 2) && strncmp(s + 2, "<!", 2))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void combine_regexes(struct regex_list *list)
+{
+	GString *str;
+	size_t i;
+
+	if (list->size < 2)
+		return;
+
+	for (i = 0; i < list->size; i++)
+		if (!self_contained_regex(list->regex_strings[i]))
+			return;
+
+	str = g_string_new(NULL);
+	for (i = 0; i < list->size; i++)
+		g_string_append_printf(str, "%s(?:%s)",
+				       i ? "|" : "", list->regex_strings[i]);
+
+	/* Leave the regexes to be matched one by one on failure */
+	list->combined = g_regex_new(str->str, G_REGEX_OPTIMIZE, 0, NULL);
+	g_string_free(str, TRUE);
+}
+
 static void free_regexes(struct regex_list *regexes)
 {
 	size_t i;
 
+	if (regexes->combined)
+		g_regex_unref(regexes->combined);
+
 	for (i = 0; i < regexes->size; i++) {
 		free(regexes->regex_strings[i]);
 		g_regex_unref(regexes->regexes[i]);
@@ -278,6 +382,118 @@ static void free_regexes(struct regex_list *regexes)
 	free(regexes->regexes);
 }
 
+size_t count_devices(struct settings *settings)
+{
+	size_t count = 0;
+	const char *p;
+
+	if (!settings->devices || !*settings->devices)
+		return 0;
+
+	for (p = settings->devices; p; p = strchr(p, ',')) {
+		if (*p == ',')
+			p++;
+		count++;
+	}
+
+	return count;
+}
+
+bool parse_cpu_list(const char *list, cpu_set_t *set)
+{
+	const char *p = list;
+
+	CPU_ZERO(set);
+
+	do {
+		unsigned long first, last;
+		char *end;
+
+		if (!isdigit(*p))
+			return false;
+		first = last = strtoul(p, &end, 10);
+
+		if (*end == '-') {
+			p = end + 1;
+			if (!isdigit(*p))
+				return false;
+			last = strtoul(p, &end, 10);
+		}
+
+		if (first > last || last >= CPU_SETSIZE)
+			return false;
+
+		for (; first <= last; first++)
+			CPU_SET(first, set);
+
+		p = end;
+	} while (*p++ == ',');
+
+	return !p[-1] && CPU_COUNT(set);
+}
+
+static bool parse_test_sched(const char *str, struct settings *settings)
+{
+	char *end;
+
+	settings->test_fifo_priority = 0;
+	settings->test_nice = 0;
+
+	if (!strcmp(str, "fifo")) {
+		settings->test_fifo_priority = 50;
+		return true;
+	}
+
+	if (!strncmp(str, "fifo:", 5)) {
+		settings->test_fifo_priority = strtol(str + 5, &end, 10);
+		return !*end && str[5] &&
+			settings->test_fifo_priority >= 1 &&
+			settings->test_fifo_priority <= 99;
+	}
+
+	if (!strncmp(str, "nice:", 5)) {
+		settings->test_nice = strtol(str + 5, &end, 10);
+		return !*end && str[5] &&
+			settings->test_nice >= -20 &&
+			settings->test_nice <= 19;
+	}
+
+	return false;
+}
+
+char *get_device(struct settings *settings, size_t idx)
+{
+	size_t count = count_devices(settings);
+	const char *p = settings->devices;
+	const char *end;
+
+	if (!count)
+		return NULL;
+
+	for (idx %= count; idx; idx--)
+		p = strchr(p, ',') + 1;
+
+	end = strchrnul(p, ',');
+	return strndup(p, end - p);
+}
+
+static void add_path(struct path_list *list, char *path)
+{
+	list->paths = realloc(list->paths,
+			      (list->size + 1) * sizeof(*list->paths));
+	list->paths[list->size] = path;
+	list->size++;
+}
+
+static void free_paths(struct path_list *list)
+{
+	size_t i;
+
+	for (i = 0; i < list->size; i++)
+		free(list->paths[i]);
+	free(list->paths);
+}
+
 static bool readable_file(char *filename)
 {
 	return !access(filename, R_OK);
@@ -294,9 +510,13 @@ void free_settings(struct settings *settings)
 	free(settings->name);
 	free(settings->test_root);
 	free(settings->results_path);
+	free(settings->devices);
+	free(settings->connect);
+	free(settings->test_cpus);
 
 	free_regexes(&settings->include_regexes);
 	free_regexes(&settings->exclude_regexes);
+	free_paths(&settings->runtime_history);
 
 	init_settings(settings);
 }
@@ -327,6 +547,18 @@ bool parse_options(int argc, char **argv,
 		{"dmesg-warn-level", required_argument, NULL, OPT_DMESG_WARN_LEVEL},
 		{"blacklist", required_argument, NULL, OPT_BLACKLIST},
 		{"list-all", no_argument, NULL, OPT_LIST_ALL},
+		{"workers", required_argument, NULL, OPT_WORKERS},
+		{"devices", required_argument, NULL, OPT_DEVICES},
+		{"runtime-history", required_argument, NULL, OPT_RUNTIME_HISTORY},
+		{"incremental-results", no_argument, NULL, OPT_INCREMENTAL_RESULTS},
+		{"dmesg-ring-buffer", required_argument, NULL, OPT_DMESG_RING_BUFFER},
+		{"zygote", no_argument, NULL, OPT_ZYGOTE},
+		{"compress-outputs", no_argument, NULL, OPT_COMPRESS_OUTPUTS},
+		{"adaptive-timeout", required_argument, NULL, OPT_ADAPTIVE_TIMEOUT},
+		{"coordinator", required_argument, NULL, OPT_COORDINATOR},
+		{"connect", required_argument, NULL, OPT_CONNECT},
+		{"test-cpus", required_argument, NULL, OPT_TEST_CPUS},
+		{"test-sched", required_argument, NULL, OPT_TEST_SCHED},
 		{ 0, 0, 0, 0},
 	};
 
@@ -406,6 +638,74 @@ bool parse_options(int argc, char **argv,
 		case OPT_LIST_ALL:
 			settings->list_all = true;
 			break;
+		case OPT_WORKERS:
+			settings->num_workers = atoi(optarg);
+			if (settings->num_workers < 0) {
+				usage("Worker count cannot be negative", stderr);
+				goto error;
+			}
+			break;
+		case OPT_DEVICES:
+			settings->devices = strdup(optarg);
+			break;
+		case OPT_RUNTIME_HISTORY:
+			add_path(&settings->runtime_history, absolute_path(optarg));
+			break;
+		case OPT_INCREMENTAL_RESULTS:
+			settings->incremental_results = true;
+			break;
+		case OPT_ZYGOTE:
+			settings->use_zygote = true;
+			break;
+		case OPT_COMPRESS_OUTPUTS:
+			settings->compress_outputs = true;
+			break;
+		case OPT_ADAPTIVE_TIMEOUT:
+			settings->adaptive_timeout = atof(optarg);
+			if (settings->adaptive_timeout <= 0.0) {
+				usage("Adaptive timeout factor must be positive", stderr);
+				goto error;
+			}
+			break;
+		case OPT_COORDINATOR:
+			settings->coordinator_port = atoi(optarg);
+			if (settings->coordinator_port <= 0 ||
+			    settings->coordinator_port > 65535) {
+				usage("Invalid coordinator port", stderr);
+				goto error;
+			}
+			break;
+		case OPT_CONNECT:
+			if (!strrchr(optarg, ':')) {
+				usage("Coordinator address must be host:port", stderr);
+				goto error;
+			}
+			settings->connect = strdup(optarg);
+			break;
+		case OPT_TEST_CPUS: {
+			cpu_set_t set;
+
+			if (!parse_cpu_list(optarg, &set)) {
+				usage("Invalid CPU list for --test-cpus", stderr);
+				goto error;
+			}
+			free(settings->test_cpus);
+			settings->test_cpus = strdup(optarg);
+			break;
+		}
+		case OPT_TEST_SCHED:
+			if (!parse_test_sched(optarg, settings)) {
+				usage("Test scheduling must be fifo[:<1-99>] or nice:<-20-19>", stderr);
+				goto error;
+			}
+			break;
+		case OPT_DMESG_RING_BUFFER:
+			settings->dmesg_ring_buffer = atoi(optarg);
+			if (settings->dmesg_ring_buffer < 0) {
+				usage("Ring buffer size cannot be negative", stderr);
+				goto error;
+			}
+			break;
 		case '?':
 			usage(NULL, stderr);
 			goto error;
@@ -418,6 +718,25 @@ bool parse_options(int argc, char **argv,
 	if (settings->dmesg_warn_level < 0)
 		settings->dmesg_warn_level = 4; /* KERN_WARN */
 
+	if (settings->devices && settings->num_workers == 0)
+		settings->num_workers = count_devices(settings);
+
+	if (settings->coordinator_port && settings->connect) {
+		usage("--coordinator and --connect are mutually exclusive", stderr);
+		goto error;
+	}
+
+	if ((settings->coordinator_port || settings->connect) &&
+	    settings->num_workers > 1) {
+		usage("Distributed execution cannot use local workers", stderr);
+		goto error;
+	}
+
+	if (settings->adaptive_timeout > 0.0 && !settings->runtime_history.size) {
+		usage("--adaptive-timeout requires --runtime-history", stderr);
+		goto error;
+	}
+
 	if (settings->list_all) { /* --list-all doesn't require results path */
 		switch (argc - optind) {
 		case 1:
@@ -464,6 +783,8 @@ bool parse_options(int argc, char **argv,
 		goto error;
 	}
 
+	combine_regexes(&settings->include_regexes);
+	combine_regexes(&settings->exclude_regexes);
 
 	return true;
 
@@ -475,12 +796,20 @@ bool parse_options(int argc, char **argv,
 bool validate_settings(struct settings *settings)
 {
 	int dirfd, fd;
+	size_t i;
 
 	if (settings->test_list && !readable_file(settings->test_list)) {
 		usage("Cannot open test-list file", stderr);
 		return false;
 	}
 
+	for (i = 0; i < settings->runtime_history.size; i++) {
+		if (!readable_file(settings->runtime_history.paths[i])) {
+			usage("Cannot open runtime history file", stderr);
+			return false;
+		}
+	}
+
 	if (!settings->results_path) {
 		usage("No results-path set; this shouldn't happen", stderr);
 		return false;
@@ -619,6 +948,18 @@ bool serialize_settings(struct settings *settings)
 	SERIALIZE_LINE(f, settings, dmesg_warn_level, "%d");
 	SERIALIZE_LINE(f, settings, test_root, "%s");
 	SERIALIZE_LINE(f, settings, results_path, "%s");
+	SERIALIZE_LINE(f, settings, num_workers, "%d");
+	if (settings->devices)
+		SERIALIZE_LINE(f, settings, devices, "%s");
+	SERIALIZE_LINE(f, settings, incremental_results, "%d");
+	SERIALIZE_LINE(f, settings, dmesg_ring_buffer, "%d");
+	SERIALIZE_LINE(f, settings, use_zygote, "%d");
+	SERIALIZE_LINE(f, settings, compress_outputs, "%d");
+	SERIALIZE_LINE(f, settings, coordinator_port, "%d");
+	if (settings->test_cpus)
+		SERIALIZE_LINE(f, settings, test_cpus, "%s");
+	SERIALIZE_LINE(f, settings, test_fifo_priority, "%d");
+	SERIALIZE_LINE(f, settings, test_nice, "%d");
 
 	if (settings->sync) {
 		fsync(fd);
@@ -664,6 +1005,16 @@ bool read_settings_from_file(struct settings *settings, FILE *f)
 		PARSE_LINE(settings, name, val, dmesg_warn_level, numval);
 		PARSE_LINE(settings, name, val, test_root, val ? strdup(val) : NULL);
 		PARSE_LINE(settings, name, val, results_path, val ? strdup(val) : NULL);
+		PARSE_LINE(settings, name, val, num_workers, numval);
+		PARSE_LINE(settings, name, val, devices, val ? strdup(val) : NULL);
+		PARSE_LINE(settings, name, val, incremental_results, numval);
+		PARSE_LINE(settings, name, val, dmesg_ring_buffer, numval);
+		PARSE_LINE(settings, name, val, use_zygote, numval);
+		PARSE_LINE(settings, name, val, compress_outputs, numval);
+		PARSE_LINE(settings, name, val, coordinator_port, numval);
+		PARSE_LINE(settings, name, val, test_cpus, val ? strdup(val) : NULL);
+		PARSE_LINE(settings, name, val, test_fifo_priority, numval);
+		PARSE_LINE(settings, name, val, test_nice, numval);
 
 		printf("Warning: Unknown field in settings file: %s = %s\n",
 		       name, val);
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <sched.h>
 #include <sys/types.h>
 #include <stdio.h>
 #include <glib.h>
@@ -23,6 +24,16 @@ struct regex_list {
 	char **regex_strings;
 	GRegex **regexes;
 	size_t size;
+	/*
+	 * All of the regexes as one alternation, to match them all in a
+	 * single pass, or NULL when they can't be combined.
+	 */
+	GRegex *combined;
+};
+
+struct path_list {
+	char **paths;
+	size_t size;
 };
 
 struct settings {
@@ -44,6 +55,23 @@ struct settings {
 	bool piglit_style_dmesg;
 	int dmesg_warn_level;
 	bool list_all;
+	int num_workers;
+	char *devices;
+	struct path_list runtime_history;
+	bool incremental_results;
+	int dmesg_ring_buffer;
+	bool use_zygote;
+	bool compress_outputs;
+	double adaptive_timeout;
+	/* Port handing out the job list to remote workers, 0 = none */
+	int coordinator_port;
+	/* host:port of the coordinator to take the jobs from */
+	char *connect;
+	/* CPU list the tests are confined to, NULL = no isolation */
+	char *test_cpus;
+	/* SCHED_FIFO priority of the test processes, 0 = not realtime */
+	int test_fifo_priority;
+	int test_nice;
 };
 
 /**
@@ -104,6 +132,38 @@ bool parse_options(int argc, char **argv,
  */
 bool validate_settings(struct settings *settings);
 
+/**
+ * count_devices:
+ *
+ * Returns: The number of device nodes in the comma-separated
+ * settings->devices list.
+ */
+size_t count_devices(struct settings *settings);
+
+/**
+ * parse_cpu_list:
+ *
+ * Parses a comma-separated list of CPUs and CPU ranges, like 2-5,8,
+ * into @set.
+ *
+ * Returns: False if @list is malformed or empty.
+ */
+bool parse_cpu_list(const char *list, cpu_set_t *set);
+
+/**
+ * get_device:
+ *
+ * Picks the device node a worker slot is assigned to. Worker slots
+ * are distributed over the device list in round-robin order.
+ *
+ * @settings: Settings object with the device list.
+ * @idx: Index of the worker slot.
+ *
+ * Returns: A newly allocated device node path, or NULL if no devices
+ * were given.
+ */
+char *get_device(struct settings *settings, size_t idx);
+
 /* TODO: Better place for this */
 char *absolute_path(char *path);
 
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+#
+# Copyright © 2020 Intel Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice (including the next
+# paragraph) shall be included in all copies or substantial portions of the
+# Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+#
+# Usage:
+#  scripts/exec_trace2wsim.py [options] trace-file > workload.wsim
+#
+# Converts a capture made with benchmarks/gem_exec_tracer.so into a
+# gem_wsim workload descriptor. Every execbuf becomes a batch step on the
+# engine it was submitted to, with data dependencies on the previous
+# writers (and, for writes, readers) of the objects it uses. Waits in the
+# capture become sync steps on the last batch using the waited on object.
+#
+# The capture does not record execution times, so all batches get the
+# duration given with -d.
+
+import argparse
+import struct
+import sys
+
+ADD_BO, DEL_BO, ADD_CTX, DEL_CTX, EXEC, WAIT = range(6)
+
+I915_EXEC_RING_MASK = 0x3f
+I915_EXEC_BSD_SHIFT = 13
+I915_EXEC_BSD_MASK = 3 << I915_EXEC_BSD_SHIFT
+I915_EXEC_HANDLE_LUT = 1 << 12
+I915_EXEC_BATCH_FIRST = 1 << 18
+
+EXEC_OBJECT_WRITE = 1 << 2
+
+engines = { 0: 'DEFAULT', 1: 'RCS', 2: 'VCS', 3: 'BCS', 4: 'VECS' }
+
+trace_version = struct.Struct('=II')
+trace_add_bo = struct.Struct('=IQ')
+trace_handle = struct.Struct('=I')
+trace_exec = struct.Struct('=IQI')
+trace_exec_object = struct.Struct('=IIQQQQQ')
+trace_relocation = struct.Struct('=IIQQII')
+
+class Batch:
+	def __init__(self, idx, ctx, engine):
+		self.idx = idx
+		self.ctx = ctx
+		self.engine = engine
+		self.deps = []
+
+class Sync:
+	def __init__(self, idx, target):
+		self.idx = idx
+		self.target = target
+
+def engine_name(flags, args):
+	ring = flags & I915_EXEC_RING_MASK
+	if ring not in engines:
+		sys.exit("Unknown engine %u in execbuf flags!" % ring)
+
+	name = engines[ring]
+	if name == 'VCS' and not args.balance:
+		bsd = (flags & I915_EXEC_BSD_MASK) >> I915_EXEC_BSD_SHIFT
+		if bsd:
+			name = 'VCS%u' % bsd
+
+	return name
+
+def read_trace(f, args):
+	data = f.read()
+
+	magic, version = trace_version.unpack_from(data, 0)
+	if magic != 0xdeadbeef:
+		sys.exit("%s: invalid magic" % f.name)
+	if version != 1:
+		sys.exit("%s: unhandled version %d" % (f.name, version))
+	pos = trace_version.size
+
+	steps = []
+	contexts = {}
+	writer = {}
+	readers = {}
+	last_use = {}
+	nr_batches = 0
+
+	while pos < len(data):
+		cmd = data[pos]
+		pos += 1
+
+		if cmd == ADD_BO:
+			pos += trace_add_bo.size
+		elif cmd in (DEL_BO, DEL_CTX):
+			handle, = trace_handle.unpack_from(data, pos)
+			pos += trace_handle.size
+			if cmd == DEL_BO:
+				writer.pop(handle, None)
+				readers.pop(handle, None)
+				last_use.pop(handle, None)
+		elif cmd == ADD_CTX:
+			pos += trace_handle.size
+		elif cmd == EXEC:
+			count, flags, ctx = trace_exec.unpack_from(data, pos)
+			pos += trace_exec.size
+
+			objects = []
+			writes = set()
+			targets = set()
+			for i in range(count):
+				obj = trace_exec_object.unpack_from(data, pos)
+				pos += trace_exec_object.size
+
+				objects.append(obj[0])
+				if obj[4] & EXEC_OBJECT_WRITE:
+					writes.add(obj[0])
+
+				for j in range(obj[1]):
+					reloc = trace_relocation.unpack_from(data, pos)
+					pos += trace_relocation.size
+					if reloc[5]:
+						targets.add(reloc[0])
+
+			# Relocation targets are indices into the object list with LUT.
+			if flags & I915_EXEC_HANDLE_LUT:
+				targets = set(objects[i] for i in targets
+					      if i < len(objects))
+			writes |= targets
+
+			# The batch buffer itself is not a dependency.
+			if flags & I915_EXEC_BATCH_FIRST:
+				objects = objects[1:]
+			else:
+				objects = objects[:-1]
+
+			if ctx not in contexts:
+				contexts[ctx] = len(contexts) + 1
+
+			batch = Batch(len(steps), contexts[ctx],
+				      engine_name(flags, args))
+
+			deps = set()
+			for handle in objects:
+				if handle in writer:
+					deps.add(writer[handle])
+				if handle in writes:
+					deps.update(readers.get(handle, []))
+			deps.discard(batch)
+			batch.deps = sorted(deps, key=lambda b: b.idx)
+
+			for handle in objects:
+				if handle in writes:
+					writer[handle] = batch
+					readers[handle] = []
+				else:
+					readers.setdefault(handle, []).append(batch)
+				last_use[handle] = batch
+
+			steps.append(batch)
+			nr_batches += 1
+			if args.max_batches and nr_batches >= args.max_batches:
+				break
+		elif cmd == WAIT:
+			handle, = trace_handle.unpack_from(data, pos)
+			pos += trace_handle.size
+			if handle in last_use:
+				steps.append(Sync(len(steps), last_use[handle]))
+		else:
+			sys.exit("%s: unknown cmd %x" % (f.name, cmd))
+
+	return steps
+
+def dependency(batch, dep, args):
+	if args.fences and dep.engine != batch.engine:
+		return 'f%d' % (dep.idx - batch.idx)
+	return '%d' % (dep.idx - batch.idx)
+
+def write_workload(steps, args):
+	for step in steps:
+		if isinstance(step, Sync):
+			print('s.%d' % (step.target.idx - step.idx))
+			continue
+
+		deps = [dependency(step, dep, args) for dep in step.deps]
+		print('%u.%s.%s.%s.0' % (step.ctx, step.engine, args.duration,
+					 '/'.join(deps) if deps else '0'))
+
+parser = argparse.ArgumentParser(description='Convert a gem_exec_tracer capture into a gem_wsim workload.')
+parser.add_argument('trace', type=argparse.FileType('rb'),
+		    help='capture from gem_exec_tracer')
+parser.add_argument('-d', '--duration', default='1000',
+		    help='batch duration in microseconds, or a min-max range (default: 1000)')
+parser.add_argument('-b', '--balance', action='store_true',
+		    help='submit to VCS instead of VCS1/VCS2 so batches can be load balanced')
+parser.add_argument('-f', '--fences', action='store_true',
+		    help='use sync fences for dependencies between different engines')
+parser.add_argument('-n', '--max-batches', type=int, default=0,
+		    help='stop after converting this many batches')
+args = parser.parse_args()
+
+write_workload(read_trace(args.trace, args), args)
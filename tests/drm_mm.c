@@ -22,11 +22,70 @@
  */
 
 #include "igt.h"
+#include "igt_bench.h"
 #include "igt_kmod.h"
 
 IGT_TEST_DESCRIPTION("Basic sanity check of DRM's range manager (struct drm_mm)");
 
-igt_main
+/* Module parameters of test-drm_mm, the kernel defaults when 0 */
+static unsigned int max_iterations;
+static unsigned int max_prime;
+static unsigned int random_seed;
+
+static int opt_handler(int opt, int opt_index, void *data)
+{
+	switch (opt) {
+	case 'i':
+		max_iterations = strtoul(optarg, NULL, 0);
+		break;
+	case 'p':
+		max_prime = strtoul(optarg, NULL, 0);
+		break;
+	case 's':
+		random_seed = strtoul(optarg, NULL, 0);
+		break;
+	default:
+		return IGT_OPT_HANDLER_ERROR;
+	}
+
+	return IGT_OPT_HANDLER_SUCCESS;
+}
+
+const char *help_str =
+	"  --iterations=n\tMaximum number of iterations of each test\n"
+	"  --prime=n\tLargest prime number of nodes and sizes to test with\n"
+	"  --seed=n\tSeed of the random orders";
+static struct option long_options[] = {
+	{"iterations", required_argument, 0, 'i'},
+	{"prime", required_argument, 0, 'p'},
+	{"seed", required_argument, 0, 's'},
+	{ 0, 0, 0, 0 }
+};
+
+igt_main_args("", long_options, help_str, opt_handler, NULL)
 {
-	igt_kselftests("test-drm_mm", NULL, NULL, NULL);
+	char opts[128] = "";
+	int len = 0;
+
+	if (max_iterations)
+		len += snprintf(opts + len, sizeof(opts) - len,
+				"max_iterations=%u ", max_iterations);
+	if (max_prime)
+		len += snprintf(opts + len, sizeof(opts) - len,
+				"max_prime=%u ", max_prime);
+	if (random_seed)
+		len += snprintf(opts + len, sizeof(opts) - len,
+				"random_seed=%u ", random_seed);
+
+	igt_fixture {
+		igt_bench_begin("drm_mm");
+		igt_bench_param("max_iterations", "%u", max_iterations);
+		igt_bench_param("max_prime", "%u", max_prime);
+		igt_bench_param("random_seed", "%u", random_seed);
+	}
+
+	igt_kselftests("test-drm_mm", opts, NULL, NULL);
+
+	igt_fixture
+		igt_bench_end();
 }
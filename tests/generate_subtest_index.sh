@@ -0,0 +1,35 @@
+#!/bin/bash
+#
+# Lists the subtests of each test binary given into an index which
+# igt_runner reads instead of running every binary with --list-subtests.
+# Each binary has a line with its name, its mtime and its number of
+# subtests, followed by one line per subtest. Binaries that fail to list
+# their subtests are left out, for the runner to list them itself.
+
+OUTPUT=$1
+shift
+
+echo "SUBTEST INDEX" > $OUTPUT.tmp
+
+for bin in "$@" ; do
+	subtests=$("$bin" --list-subtests 2> /dev/null)
+	case $? in
+	0)
+		;;
+	79)
+		# IGT_EXIT_INVALID, no subtests
+		subtests=
+		;;
+	*)
+		continue
+		;;
+	esac
+
+	count=$(echo -n "$subtests" | grep -c '^')
+	echo "$(basename $bin) $(stat -c %Y $bin) $count" >> $OUTPUT.tmp
+	if [[ $count -gt 0 ]] ; then
+		echo "$subtests" >> $OUTPUT.tmp
+	fi
+done
+
+mv $OUTPUT.tmp $OUTPUT
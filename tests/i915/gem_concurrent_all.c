@@ -32,6 +32,9 @@
  * This is a test of pread/pwrite/mmap behavior when writing to active
  * buffers.
  *
+ * The throughput subtests instead time how fast buffers of each access mode
+ * go through each copy pipeline, printing a matrix of MiB/s per size.
+ *
  * Based on gem_gtt_concurrent_blt.
  */
 
@@ -536,7 +539,7 @@ gttX_create_bo(const struct buffers *b)
 	return tile_bo(gtt_create_bo(b), b->width);
 }
 
-static void bit17_require(void)
+static bool bit17_available(void)
 {
 	static struct drm_i915_gem_get_tiling2 {
 		uint32_t handle;
@@ -553,7 +556,17 @@ static void bit17_require(void)
 		do_ioctl(fd, DRM_IOCTL_I915_GEM_GET_TILING2, &arg);
 		gem_close(fd, arg.handle);
 	}
-	igt_require(arg.phys_swizzle_mode == arg.swizzle_mode);
+	return arg.phys_swizzle_mode == arg.swizzle_mode;
+}
+
+static void bit17_require(void)
+{
+	igt_require(bit17_available());
+}
+
+static bool wc_available(void)
+{
+	return bit17_available() && gem_mmap__has_wc(fd);
 }
 
 static void wc_require(void)
@@ -1398,24 +1411,39 @@ static void run_bomb(struct buffers *buffers,
 		     do_test_func, do_copy_func, do_hang_func);
 }
 
-static void cpu_require(void)
+static bool cpu_available(void)
 {
-	bit17_require();
+	return bit17_available();
 }
 
-static void gtt_require(void)
+static bool gtt_available(void)
 {
+	return true;
 }
 
-static void bcs_require(void)
+static bool bcs_available(void)
 {
+	return true;
 }
 
-static void rcs_require(void)
+static bool rcs_available(void)
 {
-	igt_require(rendercopy);
+	return rendercopy != NULL;
 }
 
+static const struct pipeline {
+	const char *prefix;
+	do_copy copy;
+	bool (*available)(void);
+} pipelines[] = {
+	{ "cpu", cpu_copy_bo, cpu_available },
+	{ "gtt", gtt_copy_bo, gtt_available },
+	{ "wc", wc_copy_bo, wc_available },
+	{ "blt", blt_copy_bo, bcs_available },
+	{ "render", render_copy_bo, rcs_available },
+	{ NULL, NULL }
+};
+
 static void
 run_mode(const char *prefix,
 	 const struct create *create,
@@ -1425,18 +1453,7 @@ run_mode(const char *prefix,
 	 const char *suffix,
 	 run_wrap run_wrap_func)
 {
-	const struct {
-		const char *prefix;
-		do_copy copy;
-		void (*require)(void);
-	} pipelines[] = {
-		{ "cpu", cpu_copy_bo, cpu_require },
-		{ "gtt", gtt_copy_bo, gtt_require },
-		{ "wc", wc_copy_bo, wc_require },
-		{ "blt", blt_copy_bo, bcs_require },
-		{ "render", render_copy_bo, rcs_require },
-		{ NULL, NULL }
-	}, *pskip = pipelines + 3, *p;
+	const struct pipeline *pskip = pipelines + 3, *p;
 	const struct {
 		const char *suffix;
 		do_hang hang;
@@ -1464,7 +1481,7 @@ run_mode(const char *prefix,
 
 		for (p = all ? pipelines : pskip; p->prefix; p++) {
 			igt_subtest_group  {
-				igt_fixture p->require();
+				igt_fixture igt_require(p->available());
 
 				igt_subtest_f("%s-%s-%s-sanitycheck0%s%s", prefix, mode->name, p->prefix, suffix, h->suffix) {
 					buffers_create(&buffers);
@@ -1661,6 +1678,70 @@ num_buffers(uint64_t max,
 	return n;
 }
 
+/*
+ * How fast a buffer of each access mode makes it through each of the copy
+ * pipelines: written with the mode, copied into another buffer of the
+ * mode and read back from that, so that every cell also pays for the
+ * coherency domain transitions between the mode and the pipeline.
+ */
+#define THROUGHPUT_NS (250 * 1000 * 1000ull)
+
+static void
+run_throughput(const struct create *create,
+	       const struct access_mode *mode,
+	       const struct size *size)
+{
+	static const struct size *header;
+	struct buffers buffers;
+	char row[128];
+	int len, count;
+
+	count = num_buffers(0, size, create, CHECK_RAM);
+	if (mode->require)
+		mode->require(create, count);
+
+	buffers_init(&buffers, "throughput", create, mode, size, count,
+		     fd, true);
+	buffers_create(&buffers);
+
+	if (header != size) {
+		len = snprintf(row, sizeof(row), "%-8s", size->name);
+		for (const struct pipeline *p = pipelines; p->prefix; p++)
+			len += snprintf(row + len, sizeof(row) - len,
+					" %10s", p->prefix);
+		igt_info("%s MiB/s\n", row);
+		header = size;
+	}
+
+	len = snprintf(row, sizeof(row), "%-8s", mode->name);
+	for (const struct pipeline *p = pipelines; p->prefix; p++) {
+		struct timespec start = {};
+		uint64_t bytes = 0, elapsed;
+
+		if (!p->available()) {
+			len += snprintf(row + len, sizeof(row) - len,
+					" %10s", "-");
+			continue;
+		}
+
+		igt_nsec_elapsed(&start);
+		do {
+			for (int i = 0; i < buffers.count; i++) {
+				mode->set_bo(&buffers, buffers.src[i], i);
+				p->copy(&buffers, buffers.dst[i], buffers.src[i]);
+				mode->cmp_bo(&buffers, buffers.dst[i], i);
+			}
+			bytes += (uint64_t)buffers.count * buffers.page_size;
+		} while ((elapsed = igt_nsec_elapsed(&start)) < THROUGHPUT_NS);
+
+		len += snprintf(row + len, sizeof(row) - len, " %10.1f",
+				bytes * 1e9 / elapsed / (1 << 20));
+	}
+	igt_info("%s\n", row);
+
+	buffers_fini(&buffers);
+}
+
 igt_main
 {
 	const struct access_mode modes[] = {
@@ -1902,4 +1983,12 @@ igt_main
 			}
 		}
 	}
+
+	/* A map of the transfer throughput, rather than a correctness test */
+	for (const struct size *s = sizes; s->name; s++) {
+		for (const struct access_mode *m = modes; m->name; m++) {
+			igt_subtest_f("throughput-%s-%s", s->name, m->name)
+				run_throughput(&create[0], m, s);
+		}
+	}
 }
@@ -61,9 +61,11 @@ static void all(int fd, unsigned flags, int timeout, int ncpus)
 	const uint32_t bbe = MI_BATCH_BUFFER_END;
 	struct drm_i915_gem_execbuffer2 execbuf;
 	struct drm_i915_gem_exec_object2 obj;
+	struct igt_child_results *results;
 	unsigned engines[16];
 	unsigned nengine;
 	unsigned engine;
+	igt_stats_t stats;
 
 	nengine = 0;
 	for_each_physical_engine(fd, engine)
@@ -86,8 +88,10 @@ static void all(int fd, unsigned flags, int timeout, int ncpus)
 	gem_sync(fd, obj.handle);
 	gem_close(fd, obj.handle);
 
+	results = igt_child_results_create(ncpus, 1);
+
 	intel_detect_and_clear_missed_interrupts(fd);
-	igt_fork(child, ncpus) {
+	igt_fork_pinned(child, ncpus) {
 		struct timespec start, now;
 		unsigned long count;
 		double time;
@@ -125,9 +129,18 @@ static void all(int fd, unsigned flags, int timeout, int ncpus)
 		time = elapsed(&start, &now) / count;
 		igt_info("[%d] All (%d engines): %'lu cycles, average %.3fus per cycle\n",
 			 child, nengine, count, 1e6*time);
+		igt_child_results_get(results, child)[0] = count / elapsed(&start, &now);
 	}
 	igt_waitchildren();
 	igt_assert_eq(intel_detect_and_clear_missed_interrupts(fd), 0);
+
+	igt_child_results_stats(results, 0, &stats);
+	igt_info("Total: %'.0f cycles/s, per child median %'.0f, stddev %'.0f\n",
+		 igt_child_results_sum(results, 0),
+		 igt_stats_get_median(&stats),
+		 igt_stats_get_std_deviation(&stats));
+	igt_stats_fini(&stats);
+	igt_child_results_destroy(results);
 }
 
 igt_main
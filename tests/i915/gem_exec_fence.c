@@ -1386,6 +1386,53 @@ static void test_syncobj_import(int fd)
 	syncobj_destroy(fd, sync);
 }
 
+static void test_syncobj_cork(int fd)
+{
+	const uint32_t bbe = MI_BATCH_BUFFER_END;
+	struct drm_i915_gem_exec_object2 obj;
+	struct drm_i915_gem_execbuffer2 execbuf;
+	struct local_gem_exec_fence fence = {
+		.flags = LOCAL_EXEC_FENCE_WAIT,
+	};
+	IGT_CORK_SYNCOBJ(cork);
+	uint32_t handle = 0;
+
+	/* Check that a syncobj cork holds back the request each time it is
+	 * plugged again, reusing the same syncobj.
+	 */
+
+	memset(&execbuf, 0, sizeof(execbuf));
+	execbuf.buffers_ptr = to_user_pointer(&obj);
+	execbuf.buffer_count = 1;
+	execbuf.flags = LOCAL_EXEC_FENCE_ARRAY;
+	execbuf.cliprects_ptr = to_user_pointer(&fence);
+	execbuf.num_cliprects = 1;
+
+	memset(&obj, 0, sizeof(obj));
+	obj.handle = gem_create(fd, 4096);
+	gem_write(fd, obj.handle, 0, &bbe, sizeof(bbe));
+
+	for (int pass = 0; pass < 16; pass++) {
+		int64_t timeout = 10 * 1000 * 1000;
+
+		fence.handle = igt_cork_plug(&cork, fd);
+		if (pass)
+			igt_assert_eq(fence.handle, handle);
+		handle = fence.handle;
+
+		gem_execbuf(fd, &execbuf);
+		igt_assert_eq(gem_wait(fd, obj.handle, &timeout), -ETIME);
+
+		igt_cork_unplug(&cork);
+
+		gem_sync(fd, obj.handle);
+		igt_assert(!gem_bo_busy(fd, obj.handle));
+	}
+
+	igt_cork_fini(&cork);
+	gem_close(fd, obj.handle);
+}
+
 static void test_syncobj_channel(int fd)
 {
 	const uint32_t bbe = MI_BATCH_BUFFER_END;
@@ -1673,6 +1720,9 @@ igt_main
 		igt_subtest("syncobj-channel")
 			test_syncobj_channel(i915);
 
+		igt_subtest("syncobj-cork")
+			test_syncobj_cork(i915);
+
 		igt_fixture {
 			igt_stop_hang_detector();
 		}
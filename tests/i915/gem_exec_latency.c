@@ -40,6 +40,7 @@
 
 #include "drm.h"
 
+#include "igt_bench.h"
 #include "igt_sysfs.h"
 #include "igt_vgem.h"
 #include "igt_dummyload.h"
@@ -58,21 +59,55 @@
 #define LIVE 0x1
 #define CORK 0x2
 #define PREEMPT 0x4
+#define CONTEXT 0x8
 
 static unsigned int ring_size;
 static double rcs_clock;
 
+/* Seconds to keep sampling for, instead of a single pass */
+static unsigned int soak;
+
+static uint64_t ticks_to_ns(uint32_t ticks)
+{
+	return ticks * rcs_clock;
+}
+
+/*
+ * All of the latency distributions are also reported as benchmark results,
+ * named after the subtest, so that they can be tracked across runs.
+ */
+static void report_latency(const char *metric, struct igt_histogram *h)
+{
+	char name[128];
+
+	if (!igt_histogram_get_count(h))
+		return;
+
+	snprintf(name, sizeof(name), "%s-%s", igt_subtest_name(), metric);
+	igt_info("%s: median=%.0fns p99=%.0fns [%"PRIu64"ns, %"PRIu64"ns] (n=%"PRIu64")\n",
+		 name,
+		 igt_histogram_get_median(h),
+		 igt_histogram_get_percentile(h, 99),
+		 igt_histogram_get_min(h),
+		 igt_histogram_get_max(h),
+		 igt_histogram_get_count(h));
+	igt_bench_histogram(name, "ns", h);
+}
+
 static void
-poll_ring(int fd, unsigned ring, const char *name)
+poll_ring(int fd, unsigned ring, const char *name, unsigned flags)
 {
-	const struct igt_spin_factory opts = {
+	struct igt_spin_factory opts = {
 		.engine = ring,
 		.flags = IGT_SPIN_POLL_RUN | IGT_SPIN_FAST,
 	};
+	const uint64_t timeout = soak ? (uint64_t)soak * NSEC_PER_SEC : 2ull << 30;
+	struct igt_histogram cycle;
 	struct timespec tv = {};
 	unsigned long cycles;
 	igt_spin_t *spin[2];
-	uint64_t elapsed;
+	uint64_t elapsed, last;
+	uint32_t ctx = 0;
 
 	gem_require_ring(fd, ring);
 	igt_require(gem_can_store_dword(fd, ring));
@@ -80,6 +115,10 @@ poll_ring(int fd, unsigned ring, const char *name)
 	spin[0] = __igt_spin_factory(fd, &opts);
 	igt_assert(igt_spin_has_poll(spin[0]));
 
+	/* Switching contexts, rather than just requests, on every cycle */
+	if (flags & CONTEXT)
+		opts.ctx = ctx = gem_context_create(fd);
+
 	spin[1] = __igt_spin_factory(fd, &opts);
 	igt_assert(igt_spin_has_poll(spin[1]));
 
@@ -88,9 +127,16 @@ poll_ring(int fd, unsigned ring, const char *name)
 
 	igt_assert(!gem_bo_busy(fd, spin[0]->handle));
 
+	igt_histogram_init(&cycle);
+
 	cycles = 0;
-	while ((elapsed = igt_nsec_elapsed(&tv)) < 2ull << 30) {
-		const unsigned int idx = cycles++ & 1;
+	last = 0;
+	while ((elapsed = igt_nsec_elapsed(&tv)) < timeout) {
+		const unsigned int idx = cycles & 1;
+
+		if (cycles++)
+			igt_histogram_add(&cycle, elapsed - last);
+		last = elapsed;
 
 		igt_spin_reset(spin[idx]);
 
@@ -102,15 +148,21 @@ poll_ring(int fd, unsigned ring, const char *name)
 
 	igt_info("%s completed %ld cycles: %.3f us\n",
 		 name, cycles, elapsed*1e-3/cycles);
+	report_latency("cycle", &cycle);
+	igt_histogram_fini(&cycle);
 
 	igt_spin_free(fd, spin[1]);
 	igt_spin_free(fd, spin[0]);
+	if (ctx)
+		gem_context_destroy(fd, ctx);
 }
 
 #define RCS_TIMESTAMP (0x2000 + 0x358)
-static void latency_on_ring(int fd,
-			    unsigned ring, const char *name,
-			    unsigned flags)
+static void __latency_on_ring(int fd,
+			      unsigned ring, const char *name,
+			      unsigned flags,
+			      struct igt_histogram *submit,
+			      struct igt_histogram *execution)
 {
 	const int gen = intel_gen(intel_get_drm_devid(fd));
 	const int has_64bit_reloc = gen >= 8;
@@ -121,7 +173,7 @@ static void latency_on_ring(int fd,
 	IGT_CORK_HANDLE(c);
 	volatile uint32_t *reg;
 	unsigned repeats = ring_size;
-	uint32_t start, end, *map, *results;
+	uint32_t start, end, last, *map, *results;
 	uint64_t offset;
 	double gpu_latency;
 	int i, j;
@@ -190,7 +242,7 @@ static void latency_on_ring(int fd,
 	if (flags & LIVE)
 		spin = igt_spin_new(fd, .engine = ring);
 
-	start = *reg;
+	start = last = *reg;
 	for (j = 0; j < repeats; j++) {
 		uint64_t presumed_offset = reloc.presumed_offset;
 
@@ -201,8 +253,11 @@ static void latency_on_ring(int fd,
 
 		gem_execbuf(fd, &execbuf);
 		igt_assert(reloc.presumed_offset == presumed_offset);
+
+		end = *reg;
+		igt_histogram_add(submit, ticks_to_ns(end - last));
+		last = end;
 	}
-	end = *reg;
 	igt_assert(reloc.presumed_offset == obj[1].offset);
 
 	igt_spin_free(fd, spin);
@@ -211,6 +266,9 @@ static void latency_on_ring(int fd,
 
 	gem_set_domain(fd, obj[1].handle, I915_GEM_DOMAIN_GTT, 0);
 	gpu_latency = (results[repeats-1] - results[0]) / (double)(repeats-1);
+	for (j = 1; j < repeats; j++)
+		igt_histogram_add(execution,
+				  ticks_to_ns(results[j] - results[j - 1]));
 
 	gem_set_domain(fd, obj[2].handle,
 		       I915_GEM_DOMAIN_GTT, I915_GEM_DOMAIN_GTT);
@@ -241,11 +299,12 @@ static void latency_on_ring(int fd,
 	igt_assert(offset == obj[2].offset);
 
 	gem_set_domain(fd, obj[1].handle, I915_GEM_DOMAIN_GTT, 0);
-	igt_info("%s: dispatch latency: %.1fns, execution latency: %.1fns (target %.1fns)\n",
-		 name,
-		 (end - start) / (double)repeats * rcs_clock,
-		 gpu_latency * rcs_clock,
-		 (results[repeats - 1] - results[0]) / (double)(repeats - 1) * rcs_clock);
+	igt_log(IGT_LOG_DOMAIN, soak ? IGT_LOG_DEBUG : IGT_LOG_INFO,
+		"%s: dispatch latency: %.1fns, execution latency: %.1fns (target %.1fns)\n",
+		name,
+		(end - start) / (double)repeats * rcs_clock,
+		gpu_latency * rcs_clock,
+		(results[repeats - 1] - results[0]) / (double)(repeats - 1) * rcs_clock);
 
 	munmap(map, 64*1024);
 	munmap(results, 4096);
@@ -255,9 +314,34 @@ static void latency_on_ring(int fd,
 	gem_close(fd, obj[2].handle);
 }
 
-static void latency_from_ring(int fd,
-			      unsigned ring, const char *name,
-			      unsigned flags)
+static void latency_on_ring(int fd,
+			    unsigned ring, const char *name,
+			    unsigned flags)
+{
+	struct igt_histogram submit, execution;
+	struct timespec tv = {};
+
+	igt_histogram_init(&submit);
+	igt_histogram_init(&execution);
+
+	igt_seconds_elapsed(&tv);
+	do
+		__latency_on_ring(fd, ring, name, flags, &submit, &execution);
+	while (igt_seconds_elapsed(&tv) < soak);
+
+	report_latency("submit", &submit);
+	report_latency("execution", &execution);
+
+	igt_histogram_fini(&execution);
+	igt_histogram_fini(&submit);
+}
+
+static void __latency_from_ring(int fd,
+				unsigned ring, const char *name,
+				unsigned flags,
+				struct igt_histogram *delay,
+				const char **others,
+				unsigned int *nother)
 {
 	const int gen = intel_gen(intel_get_drm_devid(fd));
 	const int has_64bit_reloc = gen >= 8;
@@ -265,7 +349,7 @@ static void latency_from_ring(int fd,
 	struct drm_i915_gem_relocation_entry reloc;
 	struct drm_i915_gem_execbuffer2 execbuf;
 	const unsigned int repeats = ring_size / 2;
-	unsigned int other;
+	unsigned int other, n = 0;
 	uint32_t *map, *results;
 	uint32_t ctx[2] = {};
 	int i, j;
@@ -391,10 +475,19 @@ static void latency_from_ring(int fd,
 			       I915_GEM_DOMAIN_GTT);
 		igt_spin_free(fd, spin);
 
-		igt_info("%s-%s delay: %.2fns\n",
-			 name, e__->name,
-			 (results[2*repeats-1] - results[0]) / (double)repeats * rcs_clock);
+		igt_log(IGT_LOG_DOMAIN, soak ? IGT_LOG_DEBUG : IGT_LOG_INFO,
+			"%s-%s delay: %.2fns\n",
+			name, e__->name,
+			(results[2*repeats-1] - results[0]) / (double)repeats * rcs_clock);
+
+		igt_assert(n < *nother);
+		for (j = 0; j < repeats; j++)
+			igt_histogram_add(&delay[n],
+					  ticks_to_ns(results[j + repeats] -
+						      results[j]));
+		others[n++] = e__->name;
 	}
+	*nother = n;
 
 	munmap(map, 64*1024);
 	munmap(results, 4096);
@@ -410,6 +503,91 @@ static void latency_from_ring(int fd,
 	}
 }
 
+static void latency_from_ring(int fd,
+			      unsigned ring, const char *name,
+			      unsigned flags)
+{
+	struct igt_histogram delay[16];
+	const char *others[16];
+	unsigned int nother;
+	struct timespec tv = {};
+
+	for (unsigned int n = 0; n < ARRAY_SIZE(delay); n++)
+		igt_histogram_init(&delay[n]);
+
+	igt_seconds_elapsed(&tv);
+	do {
+		nother = ARRAY_SIZE(delay);
+		__latency_from_ring(fd, ring, name, flags,
+				    delay, others, &nother);
+	} while (igt_seconds_elapsed(&tv) < soak);
+
+	for (unsigned int n = 0; n < nother; n++)
+		report_latency(others[n], &delay[n]);
+
+	for (unsigned int n = 0; n < ARRAY_SIZE(delay); n++)
+		igt_histogram_fini(&delay[n]);
+}
+
+/*
+ * Measure how long it takes from submitting a high priority request until
+ * it is running on the engine, preempting a low priority spinner.
+ */
+static void preempt_to_run(int fd, unsigned ring)
+{
+	struct igt_histogram latency;
+	igt_spin_t *lo, *hi;
+	uint32_t ctx[2];
+
+	igt_require(gem_can_store_dword(fd, ring));
+
+	ctx[0] = gem_context_create(fd);
+	gem_context_set_priority(fd, ctx[0], -1023);
+	ctx[1] = gem_context_create(fd);
+	gem_context_set_priority(fd, ctx[1], 1023);
+
+	lo = __igt_spin_new(fd,
+			    .ctx = ctx[0],
+			    .engine = ring,
+			    .flags = IGT_SPIN_POLL_RUN);
+	hi = __igt_spin_new(fd,
+			    .ctx = ctx[1],
+			    .engine = ring,
+			    .flags = IGT_SPIN_POLL_RUN | IGT_SPIN_FAST);
+	igt_assert(igt_spin_has_poll(lo) && igt_spin_has_poll(hi));
+
+	igt_spin_end(hi);
+	igt_spin_end(lo);
+	gem_sync(fd, lo->handle);
+
+	igt_histogram_init(&latency);
+	igt_until_timeout(soak ?: 2) {
+		struct timespec ts = {};
+
+		igt_spin_reset(lo);
+		gem_execbuf(fd, &lo->execbuf);
+		igt_spin_busywait_until_started(lo);
+
+		igt_spin_reset(hi);
+		igt_nsec_elapsed(&ts);
+		gem_execbuf(fd, &hi->execbuf);
+		igt_spin_busywait_until_started(hi);
+		igt_histogram_add(&latency, igt_nsec_elapsed(&ts));
+
+		igt_spin_end(hi);
+		igt_spin_end(lo);
+		gem_sync(fd, lo->handle);
+	}
+
+	report_latency("latency", &latency);
+	igt_histogram_fini(&latency);
+
+	igt_spin_free(fd, hi);
+	igt_spin_free(fd, lo);
+	gem_context_destroy(fd, ctx[1]);
+	gem_context_destroy(fd, ctx[0]);
+}
+
 static void
 __submit_spin(int fd, igt_spin_t *spin, unsigned int flags)
 {
@@ -585,6 +763,7 @@ rthog_latency_on_ring(int fd, unsigned int engine, const char *name, unsigned in
 		struct rt_pkt normal = results[NPASS * child + 1];
 		igt_stats_t stats;
 		double variance;
+		char metric[64];
 
 		igt_stats_init_with_size(&stats, NPASS);
 
@@ -606,6 +785,13 @@ rthog_latency_on_ring(int fd, unsigned int engine, const char *name, unsigned in
 			 igt_stats_get_median(&stats) * 1e6,
 			 sqrt(variance) * 1e6);
 
+		snprintf(metric, sizeof(metric), "%s-%s-normal",
+			 igt_subtest_name(), names[child]);
+		igt_bench_value(metric, "ns", igt_mean_get(&normal.mean) * 1e9);
+		snprintf(metric, sizeof(metric), "%s-%s-rt",
+			 igt_subtest_name(), names[child]);
+		igt_bench_value(metric, "ns", igt_stats_get_median(&stats) * 1e9);
+
 		igt_assert(igt_stats_get_median(&stats) <
 			   igt_mean_get(&normal.mean) * 2);
 
@@ -648,7 +834,27 @@ static double clockrate(int i915, int reg)
 	return (r_end - r_start) * 1e9 / elapsed;
 }
 
-igt_main
+static int opt_handler(int opt, int opt_index, void *data)
+{
+	switch (opt) {
+	case 's':
+		soak = strtoul(optarg, NULL, 0);
+		break;
+	default:
+		return IGT_OPT_HANDLER_ERROR;
+	}
+
+	return IGT_OPT_HANDLER_SUCCESS;
+}
+
+const char *help_str =
+	"  --soak=seconds\tKeep sampling the latencies for at least this long";
+static struct option long_options[] = {
+	{"soak", required_argument, 0, 's'},
+	{ 0, 0, 0, 0 }
+};
+
+igt_main_args("", long_options, help_str, opt_handler, NULL)
 {
 	const struct intel_execution_engine *e;
 	int device = -1;
@@ -672,6 +878,11 @@ igt_main
 		igt_info("RCS timestamp clock: %.0fKHz, %.1fns\n",
 			 rcs_clock / 1e3, 1e9 / rcs_clock);
 		rcs_clock = 1e9 / rcs_clock;
+
+		igt_bench_begin("gem_exec_latency");
+		igt_bench_param("ring-size", "%u", ring_size);
+		igt_bench_param("timestamp-ns", "%.3f", rcs_clock);
+		igt_bench_param("soak", "%u", soak);
 	}
 
 	igt_subtest("all-rtidle-submit")
@@ -706,7 +917,14 @@ igt_main
 				igt_subtest_f("%s-poll", e->name)
 					poll_ring(device,
 						  e->exec_id | e->flags,
-						  e->name);
+						  e->name, 0);
+
+				igt_subtest_f("%s-context-switch", e->name) {
+					gem_require_contexts(device);
+					poll_ring(device,
+						  e->exec_id | e->flags,
+						  e->name, CONTEXT);
+				}
 
 				igt_subtest_f("%s-rtidle-submit", e->name)
 					rthog_latency_on_ring(device,
@@ -751,12 +969,17 @@ igt_main
 						latency_from_ring(device,
 								  e->exec_id | e->flags,
 								  e->name, PREEMPT);
+
+					igt_subtest_f("%s-preempt-to-run", e->name)
+						preempt_to_run(device,
+							       e->exec_id | e->flags);
 				}
 			}
 		}
 	}
 
 	igt_fixture {
+		igt_bench_end();
 		close(device);
 	}
 }
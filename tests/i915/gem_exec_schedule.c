@@ -1649,6 +1649,9 @@ igt_main
 		gem_require_mmap_wc(fd);
 		gem_require_contexts(fd);
 
+		/* Most subtests churn through many short lived spinners */
+		igt_spin_pool_enable(64);
+
 		igt_fork_hang_detector(fd);
 	}
 
@@ -1811,6 +1814,7 @@ igt_main
 
 	igt_fixture {
 		igt_stop_hang_detector();
+		igt_spin_pool_disable();
 		close(fd);
 	}
 }
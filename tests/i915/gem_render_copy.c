@@ -59,6 +59,8 @@ typedef struct {
 	drm_intel_bufmgr *bufmgr;
 	struct intel_batchbuffer *batch;
 	igt_render_copyfunc_t render_copy;
+	igt_render_copy_rects_func_t render_copy_rects;
+	bool batched;
 } data_t;
 static int opt_dump_png = false;
 static int check_all_pixels = false;
@@ -633,10 +635,25 @@ static void test(data_t *data, uint32_t tiling, uint64_t ccs_modifier)
 				  &dst, 0, 0, WIDTH, HEIGHT,
 				  &ccs, 0, 0);
 
-	for (int i = 0; i < num_src; i++)
-		data->render_copy(data->batch, NULL,
-				  &src[i].buf, WIDTH/4, HEIGHT/4, WIDTH/2-2, HEIGHT/2-2,
-				  ccs_modifier ? &ccs : &dst, src[i].x, src[i].y);
+	if (data->batched) {
+		struct igt_render_copy_rect rects[ARRAY_SIZE(src)];
+
+		for (int i = 0; i < num_src; i++)
+			rects[i] = (struct igt_render_copy_rect) {
+				.src = &src[i].buf,
+				.src_x = WIDTH/4, .src_y = HEIGHT/4,
+				.width = WIDTH/2-2, .height = HEIGHT/2-2,
+				.dst = ccs_modifier ? &ccs : &dst,
+				.dst_x = src[i].x, .dst_y = src[i].y,
+			};
+
+		data->render_copy_rects(data->batch, NULL, rects, num_src);
+	} else {
+		for (int i = 0; i < num_src; i++)
+			data->render_copy(data->batch, NULL,
+					  &src[i].buf, WIDTH/4, HEIGHT/4, WIDTH/2-2, HEIGHT/2-2,
+					  ccs_modifier ? &ccs : &dst, src[i].x, src[i].y);
+	}
 
 	if (ccs_modifier)
 		data->render_copy(data->batch, NULL,
@@ -712,6 +729,7 @@ igt_main_args("da", NULL, help_str, opt_handler, NULL)
 		data.render_copy = igt_get_render_copyfunc(data.devid);
 		igt_require_f(data.render_copy,
 			      "no render-copy function\n");
+		data.render_copy_rects = igt_get_render_copy_rects_func(data.devid);
 
 		data.batch = intel_batchbuffer_alloc(data.bufmgr, data.devid);
 		igt_assert(data.batch);
@@ -744,6 +762,36 @@ igt_main_args("da", NULL, help_str, opt_handler, NULL)
 	igt_subtest("yf-tiled-ccs-to-yf-tiled")
 		test(&data, I915_TILING_Yf, I915_TILING_Yf);
 
+	igt_subtest_group {
+		igt_fixture {
+			igt_require(intel_gen(data.devid) >= 9);
+			intel_batchbuffer_cache_render_state(data.batch, true);
+		}
+
+		igt_subtest("linear-cached-state")
+			test(&data, I915_TILING_NONE, 0);
+		igt_subtest("y-tiled-cached-state")
+			test(&data, I915_TILING_Y, 0);
+
+		igt_fixture
+			intel_batchbuffer_cache_render_state(data.batch, false);
+	}
+
+	igt_subtest_group {
+		igt_fixture
+			data.batched = true;
+
+		igt_subtest("linear-batched")
+			test(&data, I915_TILING_NONE, 0);
+		igt_subtest("y-tiled-batched")
+			test(&data, I915_TILING_Y, 0);
+		igt_subtest("y-tiled-ccs-to-y-tiled-batched")
+			test(&data, I915_TILING_Y, I915_TILING_Y);
+
+		igt_fixture
+			data.batched = false;
+	}
+
 	igt_fixture {
 		intel_batchbuffer_free(data.batch);
 		drm_intel_bufmgr_destroy(data.bufmgr);
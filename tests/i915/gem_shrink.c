@@ -287,6 +287,7 @@ static void leak(int fd, uint64_t alloc)
 #define USERPTR 2
 #define USERPTR_DIRTY 4
 #define OOM 8
+#define PRESSURE 16
 
 static void run_test(int nchildren, uint64_t alloc,
 		     void (*func)(int, uint64_t), unsigned flags)
@@ -304,6 +305,16 @@ static void run_test(int nchildren, uint64_t alloc,
 	if (flags & SOLO)
 		nchildren = 1;
 
+	/* Keep the system just short of memory for the duration */
+	if (flags & PRESSURE) {
+		const struct igt_memory_pressure pressure = {
+			.target_free_mb = 2 * (alloc >> 20),
+			.rate_mb = 1024,
+		};
+
+		igt_fork_memory_pressure(&pressure);
+	}
+
 	/* Background load */
 	if (flags & OOM) {
 		igt_fork(child, nchildren) {
@@ -352,6 +363,9 @@ static void run_test(int nchildren, uint64_t alloc,
 		}
 	}
 	igt_waitchildren();
+
+	if (flags & PRESSURE)
+		igt_stop_memory_pressure();
 }
 
 static void reclaim(unsigned engine, int timeout)
@@ -419,6 +433,7 @@ igt_main
 		{ "-userptr", USERPTR },
 		{ "-userptr-dirty", USERPTR | USERPTR_DIRTY },
 		{ "-oom", USERPTR | OOM },
+		{ "-pressure", PRESSURE },
 		{ NULL },
 	};
 	uint64_t alloc_size = 0;
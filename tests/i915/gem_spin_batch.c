@@ -67,6 +67,29 @@ static void spin(int fd, const struct intel_execution_engine2 *e2,
 	assert_within_epsilon(timeout_100ms * loops, elapsed, MAX_ERROR);
 }
 
+static void spin_duration(int fd, const struct intel_execution_engine2 *e2)
+{
+	const uint64_t duration_100ms = 100000000LL;
+	struct timespec tv = { };
+	igt_spin_t *spin;
+	uint64_t elapsed;
+
+	igt_nsec_elapsed(&tv);
+	spin = __igt_spin_new(fd,
+			      .engine = e2->flags,
+			      .flags = IGT_SPIN_POLL_RUN,
+			      .duration_ns = duration_100ms);
+	igt_spin_busywait_until_started(spin);
+	gem_sync(fd, spin->handle);
+	elapsed = igt_nsec_elapsed(&tv);
+	igt_spin_free(fd, spin);
+
+	igt_info("Spinner of %lldns completed after %lldns\n",
+		 (long long)duration_100ms, (long long)elapsed);
+
+	assert_within_epsilon(elapsed, duration_100ms, MAX_ERROR);
+}
+
 #define RESUBMIT_NEW_CTX     (1 << 0)
 #define RESUBMIT_ALL_ENGINES (1 << 1)
 
@@ -174,6 +197,11 @@ igt_main
 		igt_subtest_f("resubmit-%s", e2->name)
 			spin_resubmit(fd, e2, 0);
 
+		igt_subtest_f("duration-%s", e2->name) {
+			igt_require(gem_class_can_store_dword(fd, e2->class));
+			spin_duration(fd, e2);
+		}
+
 		igt_subtest_f("resubmit-new-%s", e2->name)
 			spin_resubmit(fd, e2, RESUBMIT_NEW_CTX);
 
@@ -177,22 +177,30 @@ static void measure_residencies(int devid, unsigned int mask,
 static bool wait_for_rc6(void)
 {
 	struct timespec tv = {};
-	unsigned long start, now;
+	uint64_t start, now;
+	bool ret = false;
+	int fd;
+
+	fd = igt_sysfs_attr_open(sysfs, "power/rc6_residency_ms");
+	igt_assert_fd(fd);
 
 	/* First wait for roughly an RC6 Evaluation Interval */
 	usleep(160 * 1000);
 
 	/* Then poll for RC6 to start ticking */
-	now = read_rc6_residency("rc6");
+	igt_assert(igt_sysfs_attr_get_u64(fd, &now));
 	do {
 		start = now;
 		usleep(5000);
-		now = read_rc6_residency("rc6");
-		if (now - start > 1)
-			return true;
+		igt_assert(igt_sysfs_attr_get_u64(fd, &now));
+		if (now - start > 1) {
+			ret = true;
+			break;
+		}
 	} while (!igt_seconds_elapsed(&tv));
 
-	return false;
+	close(fd);
+	return ret;
 }
 
 igt_main
@@ -842,6 +842,50 @@ static void basic_subtest(void)
 	/* XXX Also we can test wake up via exec nop */
 }
 
+static void exec_nop(void *data)
+{
+	uint32_t *handle = data;
+	struct drm_i915_gem_exec_object2 obj = { .handle = *handle };
+	struct drm_i915_gem_execbuffer2 execbuf = {
+		.buffers_ptr = to_user_pointer(&obj),
+		.buffer_count = 1,
+	};
+
+	gem_execbuf(drm_fd, &execbuf);
+	gem_sync(drm_fd, *handle);
+}
+
+static void transition_latency_subtest(void)
+{
+	const uint32_t bbe = MI_BATCH_BUFFER_END;
+	struct igt_pm_latency lat;
+	uint32_t handle;
+
+	igt_require(has_runtime_pm);
+
+	disable_all_screens_and_wait(&ms_data);
+
+	handle = gem_create(drm_fd, 4096);
+	gem_write(drm_fd, handle, 0, &bbe, sizeof(bbe));
+
+	igt_pm_latency_init(&lat);
+	for (int i = 0; i < 10; i++) {
+		/* Woken up by an execbuf, then suspending once idle */
+		igt_assert(igt_pm_measure_resume(&lat, exec_nop, &handle) >= 0);
+		igt_assert(igt_pm_measure_suspend(&lat, NULL, NULL) >= 0);
+	}
+
+	igt_info("Resume latency: median %.3fms, max %.3fms\n",
+		 igt_histogram_get_median(&lat.resume) * 1e-6,
+		 igt_histogram_get_max(&lat.resume) * 1e-6);
+	igt_info("Suspend latency: median %.3fms, max %.3fms\n",
+		 igt_histogram_get_median(&lat.suspend) * 1e-6,
+		 igt_histogram_get_max(&lat.suspend) * 1e-6);
+
+	igt_pm_latency_fini(&lat);
+	gem_close(drm_fd, handle);
+}
+
 static void pc8_residency_subtest(void)
 {
 	igt_require(has_pc8);
@@ -2032,6 +2076,8 @@ igt_main_args("", long_options, help_str, opt_handler, NULL)
 		drm_resources_equal_subtest();
 	igt_subtest("basic-pci-d3-state")
 		pci_d3_state_subtest();
+	igt_subtest("transition-latency")
+		transition_latency_subtest();
 
 	/* Basic modeset */
 	igt_subtest("modeset-lpsp")
@@ -22,6 +22,7 @@
  */
 
 #include "igt.h"
+#include "igt_bench.h"
 #include "igt_kmod.h"
 
 IGT_TEST_DESCRIPTION("Basic unit tests for i915.ko");
@@ -31,6 +32,11 @@ igt_main
 	const char *env = getenv("SELFTESTS") ?: "";
 	char opts[1024];
 
+	igt_fixture {
+		igt_bench_begin("i915_selftest");
+		igt_bench_param("st_filter", "%s", env);
+	}
+
 	igt_assert(snprintf(opts, sizeof(opts),
 			    "mock_selftests=-1 disable_display=1 st_filter=%s",
 			    env) < sizeof(opts));
@@ -40,4 +46,7 @@ igt_main
 			    "live_selftests=-1 disable_display=1 st_filter=%s",
 			    env) < sizeof(opts));
 	igt_kselftests("i915", opts, "live_selftests", "live");
+
+	igt_fixture
+		igt_bench_end();
 }
@@ -70,28 +70,20 @@ static void fini_buf(struct igt_buf *buf)
 	drm_intel_bo_unreference(buf->bo);
 }
 
-static void copy_pattern(data_t *data,
-			 struct igt_fb *dst_fb, int dx, int dy,
-			 struct igt_fb *src_fb, int sx, int sy,
-			 int w, int h)
+static void __copy_pattern(data_t *data,
+			   struct igt_buf *dst, struct igt_fb *dst_fb,
+			   int dx, int dy,
+			   struct igt_buf *src, struct igt_fb *src_fb,
+			   int sx, int sy,
+			   int w, int h)
 {
-	struct igt_buf src = {}, dst = {};
-
-	init_buf(data, &src, src_fb, "big fb src");
-	init_buf(data, &dst, dst_fb, "big fb dst");
-
-	gem_set_domain(data->drm_fd, dst_fb->gem_handle,
-		       I915_GEM_DOMAIN_GTT, I915_GEM_DOMAIN_GTT);
-	gem_set_domain(data->drm_fd, src_fb->gem_handle,
-		       I915_GEM_DOMAIN_GTT, 0);
-
 	/*
 	 * We expect the kernel to limit the max fb
 	 * size/stride to something that can still
 	 * rendered with the blitter/render engine.
 	 */
 	if (data->render_copy) {
-		data->render_copy(data->batch, NULL, &src, sx, sy, w, h, &dst, dx, dy);
+		data->render_copy(data->batch, NULL, src, sx, sy, w, h, dst, dx, dy);
 	} else {
 		w = min(w, src_fb->width - sx);
 		w = min(w, dst_fb->width - dx);
@@ -99,9 +91,27 @@ static void copy_pattern(data_t *data,
 		h = min(h, src_fb->height - sy);
 		h = min(h, dst_fb->height - dy);
 
-		intel_blt_copy(data->batch, src.bo, sx, sy, src.stride,
-			       dst.bo, dx, dy, dst.stride, w, h, dst.bpp);
+		intel_blt_copy(data->batch, src->bo, sx, sy, src->stride,
+			       dst->bo, dx, dy, dst->stride, w, h, dst->bpp);
 	}
+}
+
+static void copy_pattern(data_t *data,
+			 struct igt_fb *dst_fb, int dx, int dy,
+			 struct igt_fb *src_fb, int sx, int sy,
+			 int w, int h)
+{
+	struct igt_buf src = {}, dst = {};
+
+	init_buf(data, &src, src_fb, "big fb src");
+	init_buf(data, &dst, dst_fb, "big fb dst");
+
+	gem_set_domain(data->drm_fd, dst_fb->gem_handle,
+		       I915_GEM_DOMAIN_GTT, I915_GEM_DOMAIN_GTT);
+	gem_set_domain(data->drm_fd, src_fb->gem_handle,
+		       I915_GEM_DOMAIN_GTT, 0);
+
+	__copy_pattern(data, &dst, dst_fb, dx, dy, &src, src_fb, sx, sy, w, h);
 
 	fini_buf(&dst);
 	fini_buf(&src);
@@ -111,22 +121,39 @@ static void generate_pattern(data_t *data,
 			     struct igt_fb *fb,
 			     int w, int h)
 {
+	struct igt_buf src = {}, dst = {};
 	struct igt_fb pat_fb;
 
 	igt_create_pattern_fb(data->drm_fd, w, h,
 			      data->format, data->modifier,
 			      &pat_fb);
 
+	init_buf(data, &src, &pat_fb, "big fb pattern");
+	init_buf(data, &dst, fb, "big fb");
+
+	gem_set_domain(data->drm_fd, fb->gem_handle,
+		       I915_GEM_DOMAIN_GTT, I915_GEM_DOMAIN_GTT);
+	gem_set_domain(data->drm_fd, pat_fb.gem_handle,
+		       I915_GEM_DOMAIN_GTT, 0);
+
+	/*
+	 * Only the gpu touches the big fb from here on, so all the
+	 * copies are queued up without waiting for any of them as
+	 * moving the whole fb to the gtt domain for each would.
+	 */
 	for (int y = 0; y < fb->height; y += h) {
 		for (int x = 0; x < fb->width; x += w) {
-			copy_pattern(data, fb, x, y,
-				     &pat_fb, 0, 0,
-				     pat_fb.width, pat_fb.height);
+			__copy_pattern(data, &dst, fb, x, y,
+				       &src, &pat_fb, 0, 0,
+				       pat_fb.width, pat_fb.height);
 			w++;
 			h++;
 		}
 	}
 
+	fini_buf(&dst);
+	fini_buf(&src);
+
 	igt_remove_fb(data->drm_fd, &pat_fb);
 }
 
@@ -29,9 +29,11 @@
 #include "igt_vc4.h"
 #include "igt_edid.h"
 #include "igt_eld.h"
+#include "igt_event_loop.h"
 #include "igt_infoframe.h"
 
 #include <fcntl.h>
+#include <libudev.h>
 #include <pthread.h>
 #include <string.h>
 #include <stdatomic.h>
@@ -747,7 +749,7 @@ static void do_test_display(data_t *data, struct chamelium_port *port,
 {
 	struct chamelium_fb_crc_async_data *fb_crc;
 	struct igt_fb frame_fb, fb;
-	int i, fb_id, captured_frame_count;
+	int fb_id, captured_frame_count;
 	int frame_id;
 
 	fb_id = chamelium_get_pattern_fb(data, mode->hdisplay, mode->vdisplay,
@@ -782,10 +784,10 @@ static void do_test_display(data_t *data, struct chamelium_port *port,
 
 		expected_crc = chamelium_calculate_fb_crc_async_finish(fb_crc);
 
-		for (i = 0; i < captured_frame_count; i++)
-			chamelium_assert_crc_eq_or_dump(data->chamelium,
-							expected_crc, &crc[i],
-							&fb, i);
+		chamelium_assert_crcs_eq_or_dump(data->chamelium,
+						 expected_crc, 1,
+						 crc, captured_frame_count,
+						 &fb);
 
 		free(expected_crc);
 		free(crc);
@@ -881,7 +883,7 @@ test_display_frame_dump(data_t *data, struct chamelium_port *port)
 	igt_output_t *output;
 	igt_plane_t *primary;
 	struct igt_fb fb;
-	struct chamelium_frame_dump *frame;
+	struct chamelium_frame_queue *queue = NULL;
 	drmModeModeInfo *mode;
 	drmModeConnector *connector;
 	int fb_id, i, j;
@@ -906,16 +908,23 @@ test_display_frame_dump(data_t *data, struct chamelium_port *port)
 
 		igt_debug("Reading frame dumps from Chamelium...\n");
 		chamelium_capture(data->chamelium, port, 0, 0, 0, 0, 5);
-		for (j = 0; j < 5; j++) {
-			frame = chamelium_read_captured_frame(
-			    data->chamelium, j);
-			chamelium_assert_frame_eq(data->chamelium, frame, &fb);
-			chamelium_destroy_frame_dump(frame);
-		}
+
+		/* The previous mode's frames were compared during the capture */
+		if (queue)
+			chamelium_frame_queue_finish(queue);
+
+		queue = chamelium_frame_queue_create(data->chamelium, &fb, 2);
+		for (j = 0; j < 5; j++)
+			chamelium_frame_queue_push(queue,
+				chamelium_read_captured_frame(data->chamelium,
+							      j));
 
 		igt_remove_fb(data->drm_fd, &fb);
 	}
 
+	if (queue)
+		chamelium_frame_queue_finish(queue);
+
 	drmModeFreeConnector(connector);
 }
 
@@ -2479,10 +2488,18 @@ test_hpd_without_ddc(data_t *data, struct chamelium_port *port)
 	igt_cleanup_hotplug(mon);
 }
 
+static void count_hotplug(struct udev_device *dev, void *data)
+{
+	const char *val = udev_device_get_property_value(dev, "HOTPLUG");
+
+	if (val && atoi(val) == 1)
+		(*(int *)data)++;
+}
+
 static void
 test_hpd_storm_detect(data_t *data, struct chamelium_port *port, int width)
 {
-	struct udev_monitor *mon;
+	struct igt_event_loop *loop;
 	int count = 0;
 
 	igt_require_hpd_storm_ctl(data->drm_fd);
@@ -2492,18 +2509,18 @@ test_hpd_storm_detect(data_t *data, struct chamelium_port *port, int width)
 	chamelium_fire_hpd_pulses(data->chamelium, port, width, 10);
 	igt_assert(igt_hpd_storm_detected(data->drm_fd));
 
-	mon = igt_watch_hotplug();
+	loop = igt_event_loop_create();
+	igt_event_loop_add_hotplug(loop, count_hotplug, &count);
 	chamelium_fire_hpd_pulses(data->chamelium, port, width, 10);
 
 	/*
 	 * Polling should have been enabled by the HPD storm at this point,
 	 * so we should only get at most 1 hotplug event
 	 */
-	igt_until_timeout(5)
-		count += igt_hotplug_detected(mon, 1);
+	igt_event_loop_run_until(loop, NULL, 5000);
 	igt_assert_lt(count, 2);
 
-	igt_cleanup_hotplug(mon);
+	igt_event_loop_destroy(loop);
 	igt_hpd_storm_reset(data->drm_fd);
 }
 
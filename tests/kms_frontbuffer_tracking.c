@@ -231,6 +231,7 @@ struct {
 	bool no_edp;
 	bool small_modes;
 	bool show_hidden;
+	bool reuse_state;
 	int step;
 	int only_pipes;
 	int shared_fb_x_offset;
@@ -244,6 +245,7 @@ struct {
 	.no_edp = false,
 	.small_modes = false,
 	.show_hidden= false,
+	.reuse_state = false,
 	.step = 0,
 	.only_pipes = PIPE_COUNT,
 	.shared_fb_x_offset = 248,
@@ -646,8 +648,13 @@ static void create_fbs(enum pixel_format format)
 {
 	struct screen_fbs *s = &fbs[format];
 
-	if (s->initialized)
+	if (s->initialized) {
+		/* Every subtest repaints the regions it uses. */
+		if (opt.reuse_state)
+			return;
+
 		destroy_fbs(format);
+	}
 
 	s->initialized = true;
 
@@ -1111,14 +1118,35 @@ static void unset_all_crtcs(void)
 	igt_display_commit(&drm.display);
 }
 
+/*
+ * The features that are currently enabled, or -1 if unknown. With
+ * --reuse-state, only the features that differ between one subtest and the
+ * next are toggled, saving the modesets that come with toggling PSR.
+ */
+static int features_enabled = -1;
+
 static bool disable_features(const struct test_mode *t)
 {
+	int off = FEATURE_FBC | FEATURE_PSR | FEATURE_DRRS;
+	bool ret = false;
+
 	if (t->feature == FEATURE_DEFAULT)
 		return false;
 
-	fbc_disable();
-	drrs_disable();
-	return psr.can_test ? psr_disable(drm.debugfs) : false;
+	if (opt.reuse_state && features_enabled >= 0)
+		off = features_enabled & ~t->feature;
+
+	if (off & FEATURE_FBC)
+		fbc_disable();
+	if (off & FEATURE_DRRS)
+		drrs_disable();
+	if ((off & FEATURE_PSR) && psr.can_test)
+		ret = psr_disable(drm.debugfs);
+
+	features_enabled = features_enabled >= 0 ?
+			   features_enabled & ~off : 0;
+
+	return ret;
 }
 
 static void *busy_thread_func(void *data)
@@ -1699,18 +1727,21 @@ static void set_region_for_test(const struct test_mode *t,
 
 static bool enable_features_for_test(const struct test_mode *t)
 {
+	int on = t->feature & ~features_enabled;
 	bool ret = false;
 
 	if (t->feature == FEATURE_DEFAULT)
 		return false;
 
-	if (t->feature & FEATURE_FBC)
+	if (on & FEATURE_FBC)
 		fbc_enable();
-	if (t->feature & FEATURE_PSR)
+	if (on & FEATURE_PSR)
 		ret = psr_enable(drm.debugfs, PSR_MODE_1);
-	if (t->feature & FEATURE_DRRS)
+	if (on & FEATURE_DRRS)
 		drrs_enable();
 
+	features_enabled = t->feature;
+
 	return ret;
 }
 
@@ -3066,6 +3097,9 @@ static int opt_handler(int option, int option_index, void *data)
 	case 'i':
 		opt.show_hidden = true;
 		break;
+	case 'r':
+		opt.reuse_state = true;
+		break;
 	case 't':
 		opt.step++;
 		break;
@@ -3116,6 +3150,10 @@ const char *help_str =
 "  --no-edp                    Don't use eDP monitors\n"
 "  --use-small-modes           Use smaller resolutions for the modes\n"
 "  --show-hidden               Show hidden subtests\n"
+"  --reuse-state               Keep the framebuffers and the enabled features\n"
+"                              from one subtest to the next, running the\n"
+"                              subtests in the order that toggles the fewest\n"
+"                              features\n"
 "  --step                      Stop on each step so you can check the screen\n"
 "  --shared-fb-x offset        Use 'offset' as the X offset for the shared FB\n"
 "  --shared-fb-y offset        Use 'offset' as the Y offset for the shared FB\n"
@@ -3228,10 +3266,20 @@ static const char *flip_str(enum flip_type flip)
 	}
 }
 
+/*
+ * With --reuse-state the features are walked in Gray code order, so that each
+ * step only turns a single one of them on or off.
+ */
+static int feature_order(int i)
+{
+	return opt.reuse_state ? i ^ (i >> 1) : i;
+}
+
 #define TEST_MODE_ITER_BEGIN(t) \
 	t.format = FORMAT_DEFAULT;					   \
 	t.flip = FLIP_PAGEFLIP;						   \
-	for (t.feature = 0; t.feature < FEATURE_COUNT; t.feature++) {	   \
+	for (int f__ = 0; f__ < FEATURE_COUNT &&			   \
+	     (t.feature = feature_order(f__), true); f__++) {		   \
 	for (t.pipes = 0; t.pipes < PIPE_COUNT; t.pipes++) {		   \
 	for (t.screen = 0; t.screen < SCREEN_COUNT; t.screen++) {	   \
 	for (t.plane = 0; t.plane < PLANE_COUNT; t.plane++) {		   \
@@ -3261,6 +3309,7 @@ struct option long_options[] = {
 	{ "no-edp",                   0, 0, 'e'},
 	{ "use-small-modes",          0, 0, 'm'},
 	{ "show-hidden",              0, 0, 'i'},
+	{ "reuse-state",              0, 0, 'r'},
 	{ "step",                     0, 0, 't'},
 	{ "shared-fb-x",              1, 0, 'x'},
 	{ "shared-fb-y",              1, 0, 'y'},
@@ -3277,7 +3326,8 @@ igt_main_args("", long_options, help_str, opt_handler, NULL)
 	igt_fixture
 		setup_environment();
 
-	for (t.feature = 0; t.feature < FEATURE_COUNT; t.feature++) {
+	for (int f = 0; f < FEATURE_COUNT; f++) {
+		t.feature = feature_order(f);
 		if (!opt.show_hidden && t.feature == FEATURE_NONE)
 			continue;
 		for (t.pipes = 0; t.pipes < PIPE_COUNT; t.pipes++) {
@@ -153,6 +153,74 @@ static void test_read_crc(data_t *data, enum pipe pipe, unsigned flags)
 	}
 }
 
+struct all_pipes {
+	data_t *data;
+	int color;
+	igt_crc_t crcs[IGT_MAX_PIPES][ARRAY_SIZE(colors)];
+};
+
+static void all_pipes_prepare(igt_display_t *display, igt_pipe_job_t *job,
+			      void *priv)
+{
+	struct all_pipes *all = priv;
+	drmModeModeInfo *mode = igt_output_get_mode(job->output);
+	struct igt_fb *fb = malloc(sizeof(*fb));
+
+	igt_assert(fb);
+	igt_create_color_fb(all->data->drm_fd,
+			    mode->hdisplay, mode->vdisplay,
+			    DRM_FORMAT_XRGB8888,
+			    LOCAL_DRM_FORMAT_MOD_NONE,
+			    colors[all->color].r,
+			    colors[all->color].g,
+			    colors[all->color].b,
+			    fb);
+	igt_plane_set_fb(igt_output_get_plane(job->output, 0), fb);
+
+	job->pipe_crc = igt_pipe_crc_new(all->data->drm_fd, job->pipe,
+					 INTEL_PIPE_CRC_SOURCE_AUTO);
+	job->priv = fb;
+}
+
+static void all_pipes_check(igt_display_t *display, igt_pipe_job_t *job,
+			    void *priv)
+{
+	struct all_pipes *all = priv;
+
+	all->crcs[job->pipe][all->color] = job->crc;
+}
+
+static void all_pipes_finish(igt_display_t *display, igt_pipe_job_t *job,
+			     void *priv)
+{
+	struct all_pipes *all = priv;
+
+	igt_plane_set_fb(igt_output_get_plane(job->output, 0), NULL);
+	igt_pipe_crc_free(job->pipe_crc);
+	igt_remove_fb(all->data->drm_fd, job->priv);
+	free(job->priv);
+}
+
+static void test_read_crc_all_pipes(data_t *data)
+{
+	struct all_pipes all = { .data = data };
+	igt_output_t *output;
+	enum pipe pipe;
+
+	igt_display_require_output(&data->display);
+
+	for (all.color = 0; all.color < ARRAY_SIZE(colors); all.color++)
+		igt_display_run_pipes(&data->display, all_pipes_prepare,
+				      all_pipes_check, all_pipes_finish, &all);
+
+	/* every pipe should see the difference between the colors */
+	for_each_pipe_with_single_output(&data->display, pipe, output)
+		igt_assert_f(!igt_check_crc_equal(&all.crcs[pipe][0],
+						  &all.crcs[pipe][1]),
+			     "Same CRC for both colors on pipe %s\n",
+			     kmstest_pipe_name(pipe));
+}
+
 data_t data = {0, };
 
 igt_main
@@ -175,6 +243,9 @@ igt_main
 
 	igt_skip_on_simulation();
 
+	igt_subtest("read-crc-all-pipes")
+		test_read_crc_all_pipes(&data);
+
 	for_each_pipe_static(pipe) {
 		igt_subtest_f("read-crc-pipe-%s", kmstest_pipe_name(pipe))
 			test_read_crc(&data, pipe, 0);
@@ -40,6 +40,7 @@
 
 #include "igt.h"
 #include "igt_sysfs.h"
+#include "i915/oa.h"
 #include "drm.h"
 
 IGT_TEST_DESCRIPTION("Test the i915 perf metrics streaming interface");
@@ -84,81 +85,6 @@ IGT_TEST_DESCRIPTION("Test the i915 perf metrics streaming interface");
 
 #define MAX_OA_BUF_SIZE (16 * 1024 * 1024)
 
-struct accumulator {
-#define MAX_RAW_OA_COUNTERS 62
-	enum drm_i915_oa_format format;
-
-	uint64_t deltas[MAX_RAW_OA_COUNTERS];
-};
-
-struct oa_format {
-	const char *name;
-	size_t size;
-	int a40_high_off; /* bytes */
-	int a40_low_off;
-	int n_a40;
-	int a_off;
-	int n_a;
-	int first_a;
-	int b_off;
-	int n_b;
-	int c_off;
-	int n_c;
-};
-
-static struct oa_format hsw_oa_formats[I915_OA_FORMAT_MAX] = {
-	[I915_OA_FORMAT_A13] = { /* HSW only */
-		"A13", .size = 64,
-		.a_off = 12, .n_a = 13, },
-	[I915_OA_FORMAT_A29] = { /* HSW only */
-		"A29", .size = 128,
-		.a_off = 12, .n_a = 29, },
-	[I915_OA_FORMAT_A13_B8_C8] = { /* HSW only */
-		"A13_B8_C8", .size = 128,
-		.a_off = 12, .n_a = 13,
-		.b_off = 64, .n_b = 8,
-		.c_off = 96, .n_c = 8, },
-	[I915_OA_FORMAT_A45_B8_C8] = { /* HSW only */
-		"A45_B8_C8", .size = 256,
-		.a_off = 12,  .n_a = 45,
-		.b_off = 192, .n_b = 8,
-		.c_off = 224, .n_c = 8, },
-	[I915_OA_FORMAT_B4_C8] = { /* HSW only */
-		"B4_C8", .size = 64,
-		.b_off = 16, .n_b = 4,
-		.c_off = 32, .n_c = 8, },
-	[I915_OA_FORMAT_B4_C8_A16] = { /* HSW only */
-		"B4_C8_A16", .size = 128,
-		.b_off = 16, .n_b = 4,
-		.c_off = 32, .n_c = 8,
-		.a_off = 60, .n_a = 16, .first_a = 29, },
-	[I915_OA_FORMAT_C4_B8] = { /* HSW+ (header differs from HSW-Gen8+) */
-		"C4_B8", .size = 64,
-		.c_off = 16, .n_c = 4,
-		.b_off = 28, .n_b = 8 },
-};
-
-static struct oa_format gen8_oa_formats[I915_OA_FORMAT_MAX] = {
-	[I915_OA_FORMAT_A12] = {
-		"A12", .size = 64,
-		.a_off = 12, .n_a = 12, .first_a = 7, },
-	[I915_OA_FORMAT_A12_B8_C8] = {
-		"A12_B8_C8", .size = 128,
-		.a_off = 12, .n_a = 12,
-		.b_off = 64, .n_b = 8,
-		.c_off = 96, .n_c = 8, .first_a = 7, },
-	[I915_OA_FORMAT_A32u40_A4u32_B8_C8] = {
-		"A32u40_A4u32_B8_C8", .size = 256,
-		.a40_high_off = 160, .a40_low_off = 16, .n_a40 = 32,
-		.a_off = 144, .n_a = 4, .first_a = 32,
-		.b_off = 192, .n_b = 8,
-		.c_off = 224, .n_c = 8, },
-	[I915_OA_FORMAT_C4_B8] = {
-		"C4_B8", .size = 64,
-		.c_off = 16, .n_c = 4,
-		.b_off = 32, .n_b = 8, },
-};
-
 static bool hsw_undefined_a_counters[45] = {
 	[4] = true,
 	[6] = true,
@@ -196,17 +122,15 @@ static bool *undefined_a_counters;
 static uint64_t oa_exp_1_millisec;
 
 static igt_render_copyfunc_t render_copy = NULL;
-static uint32_t (*read_report_ticks)(uint32_t *report,
-				     enum drm_i915_oa_format format);
 static void (*sanity_check_reports)(uint32_t *oa_report0, uint32_t *oa_report1,
 				    enum drm_i915_oa_format format);
 
-static struct oa_format
+static struct i915_oa_format
 get_oa_format(enum drm_i915_oa_format format)
 {
-	if (IS_HASWELL(devid))
-		return hsw_oa_formats[format];
-	return gen8_oa_formats[format];
+	const struct i915_oa_format *fmt = i915_oa_get_format(devid, format);
+
+	return fmt ? *fmt : (struct i915_oa_format) {};
 }
 
 static void
@@ -305,24 +229,11 @@ sysfs_read(const char *path)
 
 /* XXX: For Haswell this utility is only applicable to the render basic
  * metric set.
- *
- * C2 corresponds to a clock counter for the Haswell render basic metric set
- * but it's not included in all of the formats.
  */
 static uint32_t
-hsw_read_report_ticks(uint32_t *report, enum drm_i915_oa_format format)
-{
-	uint32_t *c = (uint32_t *)(((uint8_t *)report) + get_oa_format(format).c_off);
-
-	igt_assert_neq(get_oa_format(format).n_c, 0);
-
-	return c[2];
-}
-
-static uint32_t
-gen8_read_report_ticks(uint32_t *report, enum drm_i915_oa_format format)
+read_report_ticks(uint32_t *report, enum drm_i915_oa_format format)
 {
-	return report[3];
+	return i915_oa_read_report_ticks(devid, report, format);
 }
 
 static void
@@ -373,19 +284,7 @@ timebase_scale(uint32_t u32_delta)
 static int
 max_oa_exponent_for_period_lte(uint64_t period)
 {
-	/* NB: timebase_scale() takes a uint32_t and an exponent of 30
-	 * would already represent a period of ~3 minutes so there's
-	 * really no need to consider higher exponents.
-	 */
-	for (int i = 0; i < 30; i++) {
-		uint64_t oa_period = timebase_scale(2 << i);
-
-		if (oa_period > period)
-			return max(0, i - 1);
-	}
-
-	igt_assert(!"reached");
-	return -1;
+	return i915_oa_exponent_for_period(timestamp_frequency, period);
 }
 
 /* Return: the largest OA exponent that will still result in a sampling
@@ -404,7 +303,7 @@ max_oa_exponent_for_freq_gt(uint64_t frequency)
 static uint64_t
 oa_exponent_to_ns(int exponent)
 {
-       return 1000000000ULL * (2ULL << exponent) / timestamp_frequency;
+	return i915_oa_exponent_to_ns(timestamp_frequency, exponent);
 }
 
 static bool
@@ -520,7 +419,7 @@ hsw_sanity_check_render_basic_reports(uint32_t *oa_report0, uint32_t *oa_report1
 	uint32_t time_delta = timebase_scale(oa_report1[1] - oa_report0[1]);
 	uint32_t clock_delta;
 	uint32_t max_delta;
-	struct oa_format format = get_oa_format(fmt);
+	struct i915_oa_format format = get_oa_format(fmt);
 
 	igt_assert_neq(time_delta, 0);
 
@@ -598,97 +497,10 @@ hsw_sanity_check_render_basic_reports(uint32_t *oa_report0, uint32_t *oa_report1
 	}
 }
 
-static uint64_t
-gen8_read_40bit_a_counter(uint32_t *report, enum drm_i915_oa_format fmt, int a_id)
-{
-	struct oa_format format = get_oa_format(fmt);
-	uint8_t *a40_high = (((uint8_t *)report) + format.a40_high_off);
-	uint32_t *a40_low = (uint32_t *)(((uint8_t *)report) +
-					 format.a40_low_off);
-	uint64_t high = (uint64_t)(a40_high[a_id]) << 32;
-
-	return a40_low[a_id] | high;
-}
-
-static uint64_t
-gen8_40bit_a_delta(uint64_t value0, uint64_t value1)
-{
-	if (value0 > value1)
-		return (1ULL << 40) + value1 - value0;
-	else
-		return value1 - value0;
-}
-
-static void
-accumulate_uint32(size_t offset,
-		  uint32_t *report0,
-                  uint32_t *report1,
-                  uint64_t *delta)
-{
-	uint32_t value0 = *(uint32_t *)(((uint8_t *)report0) + offset);
-	uint32_t value1 = *(uint32_t *)(((uint8_t *)report1) + offset);
-
-	*delta += (uint32_t)(value1 - value0);
-}
-
 static void
-accumulate_uint40(int a_index,
-                  uint32_t *report0,
-                  uint32_t *report1,
-		  enum drm_i915_oa_format format,
-                  uint64_t *delta)
+accumulator_print(struct i915_oa_accumulator *accumulator, const char *title)
 {
-	uint64_t value0 = gen8_read_40bit_a_counter(report0, format, a_index),
-		 value1 = gen8_read_40bit_a_counter(report1, format, a_index);
-
-	*delta += gen8_40bit_a_delta(value0, value1);
-}
-
-static void
-accumulate_reports(struct accumulator *accumulator,
-		   uint32_t *start,
-		   uint32_t *end)
-{
-	struct oa_format format = get_oa_format(accumulator->format);
-	uint64_t *deltas = accumulator->deltas;
-	int idx = 0;
-
-	if (intel_gen(devid) >= 8) {
-		/* timestamp */
-		accumulate_uint32(4, start, end, deltas + idx++);
-
-		/* clock cycles */
-		accumulate_uint32(12, start, end, deltas + idx++);
-	} else {
-		/* timestamp */
-		accumulate_uint32(4, start, end, deltas + idx++);
-	}
-
-	for (int i = 0; i < format.n_a40; i++) {
-		accumulate_uint40(i, start, end, accumulator->format,
-				  deltas + idx++);
-	}
-
-	for (int i = 0; i < format.n_a; i++) {
-		accumulate_uint32(format.a_off + 4 * i,
-				  start, end, deltas + idx++);
-	}
-
-	for (int i = 0; i < format.n_b; i++) {
-		accumulate_uint32(format.b_off + 4 * i,
-				  start, end, deltas + idx++);
-	}
-
-	for (int i = 0; i < format.n_c; i++) {
-		accumulate_uint32(format.c_off + 4 * i,
-				  start, end, deltas + idx++);
-	}
-}
-
-static void
-accumulator_print(struct accumulator *accumulator, const char *title)
-{
-	struct oa_format format = get_oa_format(accumulator->format);
+	struct i915_oa_format format = get_oa_format(accumulator->format);
 	uint64_t *deltas = accumulator->deltas;
 	int idx = 0;
 
@@ -720,7 +532,7 @@ static void
 gen8_sanity_check_test_oa_reports(uint32_t *oa_report0, uint32_t *oa_report1,
 				  enum drm_i915_oa_format fmt)
 {
-	struct oa_format format = get_oa_format(fmt);
+	struct i915_oa_format format = get_oa_format(fmt);
 	uint32_t time_delta = timebase_scale(oa_report1[1] - oa_report0[1]);
 	uint32_t ticks0 = read_report_ticks(oa_report0, fmt);
 	uint32_t ticks1 = read_report_ticks(oa_report1, fmt);
@@ -749,9 +561,9 @@ gen8_sanity_check_test_oa_reports(uint32_t *oa_report0, uint32_t *oa_report1,
 
 	/* Gen8+ has some 40bit A counters... */
 	for (int j = 0; j < format.n_a40; j++) {
-		uint64_t value0 = gen8_read_40bit_a_counter(oa_report0, fmt, j);
-		uint64_t value1 = gen8_read_40bit_a_counter(oa_report1, fmt, j);
-		uint64_t delta = gen8_40bit_a_delta(value0, value1);
+		uint64_t value0 = i915_oa_read_40bit_a_counter(oa_report0, &format, j);
+		uint64_t value1 = i915_oa_read_40bit_a_counter(oa_report1, &format, j);
+		uint64_t delta = i915_oa_40bit_a_delta(value0, value1);
 
 		if (undefined_a_counters[j])
 			continue;
@@ -832,24 +644,12 @@ gen8_sanity_check_test_oa_reports(uint32_t *oa_report0, uint32_t *oa_report1,
 static uint64_t
 get_cs_timestamp_frequency(void)
 {
-	int cs_ts_freq = 0;
-	drm_i915_getparam_t gp;
-
-	gp.param = I915_PARAM_CS_TIMESTAMP_FREQUENCY;
-	gp.value = &cs_ts_freq;
-	if (igt_ioctl(drm_fd, DRM_IOCTL_I915_GETPARAM, &gp) == 0)
-		return cs_ts_freq;
+	uint64_t freq = i915_oa_timestamp_frequency(drm_fd);
 
-	igt_debug("Couldn't query CS timestamp frequency, trying to guess based on PCI-id\n");
+	if (!freq)
+		igt_skip("Kernel with PARAM_CS_TIMESTAMP_FREQUENCY support required\n");
 
-	if (IS_GEN7(devid) || IS_GEN8(devid))
-		return 12500000;
-	if (IS_SKYLAKE(devid) || IS_KABYLAKE(devid) || IS_COFFEELAKE(devid))
-		return 12000000;
-	if (IS_BROXTON(devid) || IS_GEMINILAKE(devid))
-		return 19200000;
-
-	igt_skip("Kernel with PARAM_CS_TIMESTAMP_FREQUENCY support required\n");
+	return freq;
 }
 
 static bool
@@ -857,7 +657,6 @@ init_sys_info(void)
 {
 	const char *test_set_name = NULL;
 	const char *test_set_uuid = NULL;
-	char buf[256];
 
 	igt_assert_neq(devid, 0);
 
@@ -869,10 +668,8 @@ init_sys_info(void)
 		 * RenderBasic
 		 */
 		test_set_name = "RenderBasic";
-		test_set_uuid = "403d8832-1a27-4aa6-a64e-f5389ce7b212";
 		test_oa_format = I915_OA_FORMAT_A45_B8_C8;
 		undefined_a_counters = hsw_undefined_a_counters;
-		read_report_ticks = hsw_read_report_ticks;
 		sanity_check_reports = hsw_sanity_check_render_basic_reports;
 
 		if (intel_gt(devid) == 0)
@@ -891,79 +688,25 @@ init_sys_info(void)
 		test_set_name = "TestOa";
 		test_oa_format = I915_OA_FORMAT_A32u40_A4u32_B8_C8;
 		undefined_a_counters = gen8_undefined_a_counters;
-		read_report_ticks = gen8_read_report_ticks;
 		sanity_check_reports = gen8_sanity_check_test_oa_reports;
 
-		if (IS_BROADWELL(devid)) {
-			test_set_uuid = "d6de6f55-e526-4f79-a6a6-d7315c09044e";
-		} else if (IS_CHERRYVIEW(devid)) {
-			test_set_uuid = "4a534b07-cba3-414d-8d60-874830e883aa";
-		} else if (IS_SKYLAKE(devid)) {
-			switch (intel_gt(devid)) {
-			case 1:
-				test_set_uuid = "1651949f-0ac0-4cb1-a06f-dafd74a407d1";
-				break;
-			case 2:
-				test_set_uuid = "2b985803-d3c9-4629-8a4f-634bfecba0e8";
-				break;
-			case 3:
-				test_set_uuid = "882fa433-1f4a-4a67-a962-c741888fe5f5";
-				break;
-			default:
-				igt_debug("unsupported Skylake GT size\n");
-				return false;
-			}
-		} else if (IS_BROXTON(devid)) {
-			test_set_uuid = "5ee72f5c-092f-421e-8b70-225f7c3e9612";
-		} else if (IS_KABYLAKE(devid)) {
-			switch (intel_gt(devid)) {
-			case 1:
-				test_set_uuid = "baa3c7e4-52b6-4b85-801e-465a94b746dd";
-				break;
-			case 2:
-				test_set_uuid = "f1792f32-6db2-4b50-b4b2-557128f1688d";
-				break;
-			default:
-				igt_debug("unsupported Kabylake GT size\n");
-				return false;
-			}
-		} else if (IS_GEMINILAKE(devid)) {
-			test_set_uuid = "dd3fd789-e783-4204-8cd0-b671bbccb0cf";
-		} else if (IS_COFFEELAKE(devid)) {
-			switch (intel_gt(devid)) {
-			case 1:
-				test_set_uuid = "74fb4902-d3d3-4237-9e90-cbdc68d0a446";
-				break;
-			case 2:
-				test_set_uuid = "577e8e2c-3fa0-4875-8743-3538d585e3b0";
-				break;
-			default:
-				igt_debug("unsupported Coffeelake GT size\n");
-				return false;
-			}
-		} else if (IS_CANNONLAKE(devid)) {
-			test_set_uuid = "db41edd4-d8e7-4730-ad11-b9a2d6833503";
-		} else if (IS_ICELAKE(devid)) {
-			test_set_uuid = "a291665e-244b-4b76-9b9a-01de9d3c8068";
-		} else {
-			igt_debug("unsupported GT\n");
-			return false;
-		}
-
 		gp.param = I915_PARAM_EU_TOTAL;
 		gp.value = &n_eus;
 		do_ioctl(drm_fd, DRM_IOCTL_I915_GETPARAM, &gp);
 	}
 
+	test_set_uuid = i915_oa_test_metric_set_uuid(devid);
+	if (!test_set_uuid)
+		return false;
+
 	igt_debug("%s metric set UUID = %s\n",
 		  test_set_name,
 		  test_set_uuid);
 
 	oa_exp_1_millisec = max_oa_exponent_for_period_lte(1000000);
 
-	snprintf(buf, sizeof(buf), "metrics/%s/id", test_set_uuid);
-
-	return try_sysfs_read_u64(buf, &test_metric_set_id);
+	return i915_oa_metric_set_id(drm_fd, test_set_uuid,
+				     &test_metric_set_id);
 }
 
 static int
@@ -1338,7 +1081,7 @@ open_and_read_2_oa_reports(int format_id,
 static void
 print_reports(uint32_t *oa_report0, uint32_t *oa_report1, int fmt)
 {
-	struct oa_format format = get_oa_format(fmt);
+	struct i915_oa_format format = get_oa_format(fmt);
 
 	igt_debug("TIMESTAMP: 1st = %"PRIu32", 2nd = %"PRIu32", delta = %"PRIu32"\n",
 		  oa_report0[1], oa_report1[1], oa_report1[1] - oa_report0[1]);
@@ -1378,9 +1121,9 @@ print_reports(uint32_t *oa_report0, uint32_t *oa_report1, int fmt)
 
 	/* Gen8+ has some 40bit A counters... */
 	for (int j = 0; j < format.n_a40; j++) {
-		uint64_t value0 = gen8_read_40bit_a_counter(oa_report0, fmt, j);
-		uint64_t value1 = gen8_read_40bit_a_counter(oa_report1, fmt, j);
-		uint64_t delta = gen8_40bit_a_delta(value0, value1);
+		uint64_t value0 = i915_oa_read_40bit_a_counter(oa_report0, &format, j);
+		uint64_t value1 = i915_oa_read_40bit_a_counter(oa_report1, &format, j);
+		uint64_t delta = i915_oa_40bit_a_delta(value0, value1);
 
 		if (undefined_a_counters[j])
 			continue;
@@ -1432,7 +1175,7 @@ print_reports(uint32_t *oa_report0, uint32_t *oa_report1, int fmt)
 static void
 print_report(uint32_t *report, int fmt)
 {
-	struct oa_format format = get_oa_format(fmt);
+	struct i915_oa_format format = get_oa_format(fmt);
 
 	igt_debug("TIMESTAMP: %"PRIu32"\n", report[1]);
 
@@ -1458,7 +1201,7 @@ print_report(uint32_t *report, int fmt)
 
 	/* Gen8+ has some 40bit A counters... */
 	for (int j = 0; j < format.n_a40; j++) {
-		uint64_t value = gen8_read_40bit_a_counter(report, fmt, j);
+		uint64_t value = i915_oa_read_40bit_a_counter(report, &format, j);
 
 		if (undefined_a_counters[j])
 			continue;
@@ -1497,7 +1240,7 @@ static void
 test_oa_formats(void)
 {
 	for (int i = 0; i < I915_OA_FORMAT_MAX; i++) {
-		struct oa_format format = get_oa_format(i);
+		struct i915_oa_format format = get_oa_format(i);
 		uint32_t oa_report0[64];
 		uint32_t oa_report1[64];
 
@@ -3196,8 +2939,9 @@ gen8_test_single_ctx_render_target_writes_a_counter(void)
 			uint32_t current_ctx_id = 0xffffffff;
 			uint32_t n_invalid_ctx = 0;
 			int ret;
-			struct accumulator accumulator = {
-				.format = test_oa_format
+			struct i915_oa_accumulator accumulator = {
+				.devid = devid,
+				.format = test_oa_format,
 			};
 
 			bufmgr = drm_intel_bufmgr_gem_init(drm_fd, 4096);
@@ -3328,7 +3072,7 @@ gen8_test_single_ctx_render_target_writes_a_counter(void)
 			ctx1_id = report1_32[2];
 
 			memset(accumulator.deltas, 0, sizeof(accumulator.deltas));
-			accumulate_reports(&accumulator, report0_32, report1_32);
+			i915_oa_accumulate_reports(&accumulator, report0_32, report1_32);
 			igt_debug("total: A0 = %"PRIu64", A21 = %"PRIu64", A26 = %"PRIu64"\n",
 				  accumulator.deltas[2 + 0], /* skip timestamp + clock cycles */
 				  accumulator.deltas[2 + 21],
@@ -3384,8 +3128,9 @@ gen8_test_single_ctx_render_target_writes_a_counter(void)
 				uint32_t *report;
 				uint32_t reason;
 				const char *skip_reason = NULL, *report_reason = NULL;
-				struct accumulator laccumulator = {
-					.format = test_oa_format
+				struct i915_oa_accumulator laccumulator = {
+					.devid = devid,
+					.format = test_oa_format,
 				};
 
 
@@ -3450,7 +3195,7 @@ gen8_test_single_ctx_render_target_writes_a_counter(void)
 				 * counters for each report. */
 				if (lprev) {
 					memset(laccumulator.deltas, 0, sizeof(laccumulator.deltas));
-					accumulate_reports(&laccumulator, lprev, report);
+					i915_oa_accumulate_reports(&laccumulator, lprev, report);
 					igt_debug("    deltas: A0=%"PRIu64" A21=%"PRIu64", A26=%"PRIu64"\n",
 						  laccumulator.deltas[2 + 0], /* skip timestamp + clock cycles */
 						  laccumulator.deltas[2 + 21],
@@ -3491,7 +3236,7 @@ gen8_test_single_ctx_render_target_writes_a_counter(void)
 				}
 
 				if (!skip_reason) {
-					accumulate_reports(&accumulator, prev, report);
+					i915_oa_accumulate_reports(&accumulator, prev, report);
 					igt_debug(" -> Accumulated deltas A0=%"PRIu64" A21=%"PRIu64", A26=%"PRIu64"\n",
 						  accumulator.deltas[2 + 0], /* skip timestamp + clock cycles */
 						  accumulator.deltas[2 + 21],
@@ -65,9 +65,11 @@
 #include <sys/stat.h>
 
 #include "testdisplay.h"
+#include "igt_bench.h"
 
 #include <stdlib.h>
 #include <signal.h>
+#include <fcntl.h>
 
 enum {
 	OPT_YB,
@@ -86,6 +88,7 @@ int sleep_between_modes = 0;
 int do_dpms = 0; /* This aliases to DPMS_ON */
 uint32_t depth = 24, stride, bpp;
 int qr_code = 0;
+int benchmark_modes = 0;
 int specified_mode_num = -1, specified_disp_id = -1;
 bool opt_dump_info = false;
 
@@ -464,6 +467,177 @@ set_stereo_mode(struct connector *c)
 	drmModeFreeConnector(c->connector);
 }
 
+/*
+ * With drm.debug including KMS messages, the kernel logs each step of the DP
+ * link training. The time between the first and the last of those stamps
+ * is the time spent training the link, bar the first step.
+ */
+static int link_training_open(void)
+{
+	int fd = open("/dev/kmsg", O_RDONLY | O_NONBLOCK);
+
+	if (fd >= 0)
+		lseek(fd, 0, SEEK_END);
+
+	return fd;
+}
+
+static double link_training_ms(int fd)
+{
+	unsigned long long ts, first = 0, last = 0;
+	char record[1024];
+	ssize_t len;
+	int offset;
+
+	if (fd < 0)
+		return -1;
+
+	/* EPIPE only tells that older records were overwritten */
+	while ((len = read(fd, record, sizeof(record) - 1)) > 0 ||
+	       (len == -1 && errno == EPIPE)) {
+		if (len == -1)
+			continue;
+
+		record[len] = '\0';
+		if (sscanf(record, "%*u,%*u,%llu,%*[^;];%n", &ts, &offset) != 1)
+			continue;
+
+		if (!strstr(record + offset, "link_train"))
+			continue;
+
+		if (!first)
+			first = ts;
+		last = ts;
+	}
+
+	close(fd);
+
+	return first ? (last - first) / 1e3 : -1;
+}
+
+static double elapsed_ms(const struct timespec *start,
+			 const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e3 +
+		(end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/*
+ * Lights up every mode of the connector from a disabled CRTC, as after a
+ * hotplug, and reports how long the modeset took to return, how long until
+ * the first vblank afterwards and how long the link training took.
+ */
+static void
+benchmark_mode_set(struct connector *c)
+{
+	struct igt_fb fb_info[2] = { };
+	int j, current_fb = 0, old_fb = -1;
+	const char *type;
+
+	type = kmstest_connector_type_str(c->connector->connector_type);
+
+	for (j = 0; j < c->connector->count_modes; j++) {
+		struct timespec start, commit, vblank;
+		drmVBlank vbl = { };
+		double link;
+		char name[80];
+		int kmsg;
+
+		c->mode = c->connector->modes[j];
+		if (c->mode.flags & DRM_MODE_FLAG_3D_MASK)
+			continue;
+
+		igt_create_color_fb(drm_fd, c->mode.hdisplay, c->mode.vdisplay,
+				    igt_bpp_depth_to_drm_format(bpp, depth),
+				    tiling, 0.0, 0.0, 1.0,
+				    &fb_info[current_fb]);
+
+		drmModeSetCrtc(drm_fd, c->crtc, 0, 0, 0, NULL, 0, NULL);
+
+		kmsg = link_training_open();
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (drmModeSetCrtc(drm_fd, c->crtc, fb_info[current_fb].fb_id,
+				   0, 0, &c->id, 1, &c->mode)) {
+			igt_warn("failed to set mode (%dx%d@%dHz): %s\n",
+				 c->mode.hdisplay, c->mode.vdisplay,
+				 c->mode.vrefresh, strerror(errno));
+			igt_remove_fb(drm_fd, &fb_info[current_fb]);
+			if (kmsg >= 0)
+				close(kmsg);
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &commit);
+
+		vbl.request.type = DRM_VBLANK_RELATIVE |
+			kmstest_get_vbl_flag(c->pipe);
+		vbl.request.sequence = 1;
+		igt_warn_on(drmWaitVBlank(drm_fd, &vbl));
+		clock_gettime(CLOCK_MONOTONIC, &vblank);
+
+		link = link_training_ms(kmsg);
+
+		igt_info("%-12s %3u %-16s %3dHz %9.2f %9.2f ",
+			 type, c->id, c->mode.name, c->mode.vrefresh,
+			 elapsed_ms(&start, &commit),
+			 elapsed_ms(&start, &vblank));
+		if (link < 0)
+			igt_info("%9s\n", "-");
+		else
+			igt_info("%9.2f\n", link);
+
+		snprintf(name, sizeof(name), "%s-%u-%s-%d",
+			 type, c->id, c->mode.name, c->mode.vrefresh);
+		igt_bench_value(name, "ms", elapsed_ms(&start, &vblank));
+
+		if (old_fb != -1)
+			igt_remove_fb(drm_fd, &fb_info[old_fb]);
+		old_fb = current_fb;
+		current_fb = 1 - current_fb;
+	}
+
+	drmModeSetCrtc(drm_fd, c->crtc, 0, 0, 0, NULL, 0, NULL);
+	if (old_fb != -1)
+		igt_remove_fb(drm_fd, &fb_info[old_fb]);
+
+	drmModeFreeEncoder(c->encoder);
+	drmModeFreeConnector(c->connector);
+}
+
+static int benchmark_display(void)
+{
+	struct connector c;
+	int i;
+
+	resources = drmModeGetResources(drm_fd);
+	igt_require(resources);
+
+	igt_bench_begin("testdisplay");
+	igt_bench_param("depth", "%u", depth);
+	igt_bench_param("tiling", "0x%" PRIx64, tiling);
+
+	igt_info("%-12s %3s %-16s %5s %9s %9s %9s\n",
+		 "connector", "id", "mode", "rate",
+		 "commit/ms", "vblank/ms", "link/ms");
+
+	for (i = 0; i < resources->count_connectors; i++) {
+		memset(&c, 0, sizeof(c));
+		c.id = resources->connectors[i];
+		if (specified_disp_id != -1 && c.id != specified_disp_id)
+			continue;
+
+		connector_find_preferred_mode(c.id, -1UL, -1, &c, false);
+		if (!c.mode_valid)
+			continue;
+
+		benchmark_mode_set(&c);
+	}
+
+	igt_bench_end();
+
+	drmModeFreeResources(resources);
+	return 0;
+}
+
 /*
  * Re-probe outputs and light up as many as possible.
  *
@@ -593,7 +767,7 @@ static void set_termio_mode(void)
 	tcsetattr(tio_fd, TCSANOW, &tio);
 }
 
-static char optstr[] = "3Aiaf:s:d:p:mrto:j:y";
+static char optstr[] = "3Aiabf:s:d:p:mrto:j:y";
 static struct option long_opts[] = {
 	{"yb", 0, 0, OPT_YB},
 	{"yf", 0, 0, OPT_YF},
@@ -603,6 +777,8 @@ static struct option long_opts[] = {
 static const char *help_str =
 	"  -i\tdump info\n"
 	"  -a\ttest all modes\n"
+	"  -b\tmeasure the time to set each mode of every connector, without\n"
+	"  \tkeeping the modes up, and print a table of the timings\n"
 	"  -s\t<duration>\tsleep between each mode test (default: 0)\n"
 	"  -d\t<depth>\tbit depth of scanout buffer\n"
 	"  -p\t<planew,h>,<crtcx,y>,<crtcw,h> test overlay plane\n"
@@ -639,6 +815,9 @@ static int opt_handler(int opt, int opt_index, void *data)
 	case 'a':
 		test_all_modes = 1;
 		break;
+	case 'b':
+		benchmark_modes = 1;
+		break;
 	case 'f':
 		force_mode = 1;
 		if (sscanf(optarg,"%f,%hu,%hu,%hu,%hu,%hu,%hu,%hu,%hu",
@@ -734,6 +913,11 @@ igt_simple_main_args(optstr, long_opts, help_str, opt_handler, NULL)
 
 	kmstest_set_vt_graphics_mode();
 
+	if (benchmark_modes) {
+		ret = benchmark_display();
+		goto out_close;
+	}
+
 	mainloop = g_main_loop_new(NULL, FALSE);
 	if (!mainloop) {
 		igt_warn("failed to create glib mainloop\n");
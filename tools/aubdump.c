@@ -37,6 +37,8 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <dlfcn.h>
+#include <pthread.h>
+#include <zlib.h>
 #include <i915_drm.h>
 
 #include "intel_aub.h"
@@ -233,9 +235,11 @@ static int (*libc_ioctl)(int fd, unsigned long request, ...) = ioctl_init_helper
 
 static int drm_fd = -1;
 static char *filename = NULL;
-static FILE *files[2] = { NULL, NULL };
 static int gen = 0;
 static int verbose = 0;
+static bool gzip_file;
+static bool full_dump;
+static uint64_t exec_count;
 static bool device_override;
 static uint32_t device;
 static int addr_bits = 0;
@@ -246,6 +250,11 @@ struct bo {
 	uint32_t size;
 	uint64_t offset;
 	void *map;
+
+	/* Hash of each page as last written to the AUB, at dump_offset */
+	uint64_t *page_hashes;
+	uint64_t dump_offset;
+	uint64_t dump_exec;
 };
 
 static struct bo *bos;
@@ -322,15 +331,199 @@ align_u64(uint64_t v, uint64_t a)
 	return (v + a - 1) & ~(a - 1);
 }
 
+/*
+ * The AUB stream is staged in large chunks, which a writer thread per output
+ * then writes out (and optionally compresses), so that the intercepted
+ * ioctls only ever copy into memory. The application keeps filling the
+ * chunk at head while the writer drains the chunks from tail, and only
+ * waits for the writer once all the chunks are full.
+ */
+#define OUTPUT_CHUNK_SIZE (8 << 20)
+#define OUTPUT_CHUNKS 8
+
+struct output_chunk {
+	char *data;
+	size_t len;
+};
+
+static struct output {
+	int fd;
+	gzFile gz;
+
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	struct output_chunk chunks[OUTPUT_CHUNKS];
+	unsigned int head, tail;
+	bool done;
+} outputs[2] = {
+	{ .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER },
+	{ .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER },
+};
+
+static void
+output_write_chunk(struct output *o, const struct output_chunk *chunk)
+{
+	const char *data = chunk->data;
+	size_t len = chunk->len;
+
+	if (o->gz) {
+		fail_if(gzwrite(o->gz, data, len) != len,
+			"Writing to output failed\n");
+		return;
+	}
+
+	while (len) {
+		ssize_t ret = write(o->fd, data, len);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+
+		fail_if(ret <= 0, "Writing to output failed\n");
+		if (ret <= 0)
+			return;
+
+		data += ret;
+		len -= ret;
+	}
+}
+
+static void *
+output_writer(void *arg)
+{
+	struct output *o = arg;
+
+	pthread_mutex_lock(&o->lock);
+	for (;;) {
+		struct output_chunk *chunk;
+
+		if (o->tail == o->head) {
+			if (o->done)
+				break;
+			pthread_cond_wait(&o->cond, &o->lock);
+			continue;
+		}
+
+		chunk = &o->chunks[o->tail % OUTPUT_CHUNKS];
+		pthread_mutex_unlock(&o->lock);
+
+		output_write_chunk(o, chunk);
+
+		pthread_mutex_lock(&o->lock);
+		chunk->len = 0;
+		o->tail++;
+		pthread_cond_broadcast(&o->cond);
+	}
+	pthread_mutex_unlock(&o->lock);
+
+	return NULL;
+}
+
+/*
+ * The writers do not survive fork(), so children of the application stop
+ * dumping rather than wait for them forever.
+ */
+static void
+output_atfork_child(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(outputs); i++) {
+		if (outputs[i].fd >= 0)
+			close(outputs[i].fd);
+		outputs[i].fd = -1;
+	}
+}
+
+static void
+output_start(struct output *o, bool gzip)
+{
+	static bool once;
+	int err;
+
+	if (!once) {
+		pthread_atfork(NULL, NULL, output_atfork_child);
+		once = true;
+	}
+
+	for (int i = 0; i < OUTPUT_CHUNKS; i++) {
+		o->chunks[i].data = malloc(OUTPUT_CHUNK_SIZE);
+		fail_if(o->chunks[i].data == NULL,
+			"intel_aubdump: out of memory\n");
+	}
+
+	if (gzip) {
+		o->gz = gzdopen(o->fd, "wb1");
+		fail_if(o->gz == NULL,
+			"intel_aubdump: failed to start compression\n");
+	}
+
+	err = pthread_create(&o->writer, NULL, output_writer, o);
+	fail_if(err, "intel_aubdump: failed to start writer thread: %s\n",
+		strerror(err));
+}
+
+/* Hand the current chunk over to the writer, without waiting for it */
+static void
+output_submit(struct output *o)
+{
+	if (o->chunks[o->head % OUTPUT_CHUNKS].len == 0)
+		return;
+
+	pthread_mutex_lock(&o->lock);
+	o->head++;
+	pthread_cond_broadcast(&o->cond);
+	while (o->head - o->tail == OUTPUT_CHUNKS)
+		pthread_cond_wait(&o->cond, &o->lock);
+	pthread_mutex_unlock(&o->lock);
+}
+
+static void
+output_stop(struct output *o)
+{
+	output_submit(o);
+
+	pthread_mutex_lock(&o->lock);
+	o->done = true;
+	pthread_cond_broadcast(&o->cond);
+	pthread_mutex_unlock(&o->lock);
+
+	pthread_join(o->writer, NULL);
+
+	if (o->gz)
+		gzclose(o->gz);
+	else
+		close(o->fd);
+	o->fd = -1;
+
+	for (int i = 0; i < OUTPUT_CHUNKS; i++)
+		free(o->chunks[i].data);
+}
+
+static void
+output_data(struct output *o, const void *data, size_t size)
+{
+	while (size) {
+		struct output_chunk *chunk = &o->chunks[o->head % OUTPUT_CHUNKS];
+		size_t len = min(size, OUTPUT_CHUNK_SIZE - chunk->len);
+
+		memcpy(chunk->data + chunk->len, data, len);
+		chunk->len += len;
+		data = (const char *)data + len;
+		size -= len;
+
+		if (chunk->len == OUTPUT_CHUNK_SIZE)
+			output_submit(o);
+	}
+}
+
 static void
 dword_out(uint32_t data)
 {
-	for (int i = 0; i < ARRAY_SIZE (files); i++) {
-		if (files[i] == NULL)
+	for (int i = 0; i < ARRAY_SIZE (outputs); i++) {
+		if (outputs[i].fd < 0)
 			continue;
 
-		fail_if(fwrite(&data, 1, 4, files[i]) == 0,
-			"Writing to output failed\n");
+		output_data(&outputs[i], &data, 4);
 	}
 }
 
@@ -340,12 +533,11 @@ data_out(const void *data, size_t size)
 	if (size == 0)
 		return;
 
-	for (int i = 0; i < ARRAY_SIZE (files); i++) {
-		if (files[i] == NULL)
+	for (int i = 0; i < ARRAY_SIZE (outputs); i++) {
+		if (outputs[i].fd < 0)
 			continue;
 
-		fail_if(fwrite(data, 1, size, files[i]) == 0,
-			"Writing to output failed\n");
+		output_data(&outputs[i], data, size);
 	}
 }
 
@@ -686,6 +878,80 @@ aub_write_trace_block(uint32_t type, void *virtual, uint32_t size, uint64_t gtt_
 	}
 }
 
+static uint64_t
+page_hash(const char *data, uint32_t size)
+{
+	uint64_t hash = 0x9e3779b97f4a7c15ull;
+	uint32_t i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		uint64_t v;
+
+		memcpy(&v, data + i, 8);
+		hash ^= v * 0x87c37b91114253d5ull;
+		hash = ((hash << 31) | (hash >> 33)) * 0x4cf5ad432745937full;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ (uint8_t)data[i]) * 0x100000001b3ull;
+
+	return hash;
+}
+
+/*
+ * Write out only the pages of a bo that changed since we last dumped it.
+ * The simulator keeps the memory contents between execbuffers, so what we
+ * wrote before at the same address is still there, unless another bo was
+ * written over it in the meantime. The objects of a single execbuffer never
+ * overlap, so we can only trust the hashes of bos that were also part of
+ * the previous execbuffer, at the same address.
+ */
+static void
+aub_write_bo(uint32_t type, struct bo *bo, void *virtual)
+{
+	uint32_t num_pages = align_u32(bo->size, 4096) / 4096;
+	const char *data = GET_PTR(virtual);
+	uint32_t run = 0;
+	bool valid;
+
+	if (!virtual || full_dump) {
+		aub_write_trace_block(type, virtual, bo->size, bo->offset);
+		return;
+	}
+
+	valid = bo->page_hashes &&
+		bo->dump_offset == bo->offset &&
+		bo->dump_exec + 1 == exec_count;
+	if (!bo->page_hashes) {
+		bo->page_hashes = calloc(num_pages, sizeof(*bo->page_hashes));
+		fail_if(bo->page_hashes == NULL,
+			"intel_aubdump: out of memory\n");
+	}
+
+	/* Coalesce consecutive dirty pages into a single trace block */
+	for (uint32_t page = 0; page <= num_pages; page++) {
+		uint32_t offset = page * 4096;
+
+		if (page < num_pages) {
+			uint64_t hash = page_hash(data + offset,
+						  min(bo->size - offset, 4096u));
+			bool dirty = !valid || hash != bo->page_hashes[page];
+
+			bo->page_hashes[page] = hash;
+			if (dirty)
+				continue;
+		}
+
+		if (run < page)
+			aub_write_trace_block(type, (void *)(data + run * 4096),
+					      min(offset, bo->size) - run * 4096,
+					      bo->offset + run * 4096);
+		run = page + 1;
+	}
+
+	bo->dump_offset = bo->offset;
+	bo->dump_exec = exec_count;
+}
+
 static void
 write_reloc(void *p, uint64_t v)
 {
@@ -944,6 +1210,8 @@ dump_execbuffer2(int fd, struct drm_i915_gem_execbuffer2 *execbuffer2)
 	if (verbose)
 		printf("Dumping execbuffer2:\n");
 
+	exec_count++;
+
 	for (uint32_t i = 0; i < execbuffer2->buffer_count; i++) {
 		obj = &exec_objects[i];
 		bo = get_bo(obj->handle);
@@ -992,13 +1260,10 @@ dump_execbuffer2(int fd, struct drm_i915_gem_execbuffer2 *execbuffer2)
 		else
 			data = bo->map;
 
-		if (bo == batch_bo) {
-			aub_write_trace_block(AUB_TRACE_TYPE_BATCH,
-					      data, bo->size, bo->offset);
-		} else {
-			aub_write_trace_block(AUB_TRACE_TYPE_NOTYPE,
-					      data, bo->size, bo->offset);
-		}
+		if (bo == batch_bo)
+			aub_write_bo(AUB_TRACE_TYPE_BATCH, bo, data);
+		else
+			aub_write_bo(AUB_TRACE_TYPE_NOTYPE, bo, data);
 		if (data != bo->map)
 			free(data);
 	}
@@ -1013,9 +1278,9 @@ dump_execbuffer2(int fd, struct drm_i915_gem_execbuffer2 *execbuffer2)
 				    ring_flag);
 	}
 
-	for (int i = 0; i < ARRAY_SIZE(files); i++) {
-		if (files[i] != NULL)
-			fflush(files[i]);
+	for (int i = 0; i < ARRAY_SIZE(outputs); i++) {
+		if (outputs[i].fd >= 0)
+			output_submit(&outputs[i]);
 	}
 
 	if (device_override &&
@@ -1045,6 +1310,8 @@ add_new_bo(int handle, uint64_t size, void *map)
 
 	bo->size = size;
 	bo->map = map;
+	free(bo->page_hashes);
+	bo->page_hashes = NULL;
 }
 
 static void
@@ -1056,6 +1323,8 @@ remove_bo(int handle)
 		munmap(bo->map, bo->size);
 	bo->size = 0;
 	bo->map = NULL;
+	free(bo->page_hashes);
+	bo->page_hashes = NULL;
 }
 
 int
@@ -1067,7 +1336,7 @@ close(int fd)
 	return libc_close(fd);
 }
 
-static FILE *
+static int
 launch_command(char *command)
 {
 	int i = 0, fds[2];
@@ -1083,21 +1352,21 @@ launch_command(char *command)
 	}
 
 	if (pipe(fds) == -1)
-		return NULL;
+		return -1;
 
 	switch (fork()) {
 	case 0:
 		dup2(fds[0], 0);
 		fail_if(execvp(args[0], args) == -1,
 			"intel_aubdump: failed to launch child command\n");
-		return NULL;
+		return -1;
 
 	default:
 		free(args);
-		return fdopen(fds[1], "w");
+		return fds[1];
 
 	case -1:
-		return NULL;
+		return -1;
 	}
 }
 
@@ -1122,15 +1391,20 @@ maybe_init(void)
 				"intel_aubdump: failed to parse device id '%s'",
 				value);
 			device_override = true;
+		} else if (!strcmp(key, "full")) {
+			full_dump = true;
+		} else if (!strcmp(key, "compress")) {
+			gzip_file = true;
 		} else if (!strcmp(key, "file")) {
 			filename = strdup(value);
-			files[0] = fopen(filename, "w+");
-			fail_if(files[0] == NULL,
+			outputs[0].fd = open(filename,
+					     O_WRONLY | O_CREAT | O_TRUNC, 0666);
+			fail_if(outputs[0].fd < 0,
 				"intel_aubdump: failed to open file '%s'\n",
 				filename);
 		} else if (!strcmp(key,  "command")) {
-			files[1] = launch_command(value);
-			fail_if(files[1] == NULL,
+			outputs[1].fd = launch_command(value);
+			fail_if(outputs[1].fd < 0,
 				"intel_aubdump: failed to launch command '%s'\n",
 				value);
 		} else {
@@ -1142,6 +1416,12 @@ maybe_init(void)
 	}
 	fclose(config);
 
+	/* Only the file is compressed, the command expects a plain AUB */
+	for (int i = 0; i < ARRAY_SIZE(outputs); i++) {
+		if (outputs[i].fd >= 0)
+			output_start(&outputs[i], gzip_file && i == 0);
+	}
+
 	bos = calloc(MAX_BO_COUNT, sizeof(bos[0]));
 	fail_if(bos == NULL, "intel_aubdump: out of memory\n");
 }
@@ -1307,9 +1587,9 @@ static void __attribute__ ((destructor))
 fini(void)
 {
 	free(filename);
-	for (int i = 0; i < ARRAY_SIZE(files); i++) {
-		if (files[i] != NULL)
-			fclose(files[i]);
+	for (int i = 0; i < ARRAY_SIZE(outputs); i++) {
+		if (outputs[i].fd >= 0)
+			output_stop(&outputs[i]);
 	}
 	free(bos);
 }
@@ -22,83 +22,299 @@
  *
  */
 
-/* Simple tool to print statistics on incoming line buffers intervals */
+/*
+ * Prints statistics on a stream of numbers, read from the standard input or
+ * from files, separated by any other characters.
+ *
+ * Over the whole stream only a running mean and a histogram are kept, so
+ * that memory use stays the same however many numbers come in; the
+ * percentiles, interquartile mean and trimean are then approximated to
+ * within 1/256 of their value. The histogram is over integers, so numbers
+ * with a fractional part first need to be scaled up by -s. With -n or -t,
+ * the exact statistics of each window of numbers are printed along the way.
+ */
 
 #define _ISOC99_SOURCE
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "igt_stats.h"
 
-static void statify(FILE *file, const char *name)
+#define READ_SIZE (64 << 10)
+
+struct stream {
+	const char *name;
+
+	struct igt_mean mean;
+	struct igt_histogram hist;
+
+	igt_stats_t window;
+	uint64_t window_start;
+};
+
+static unsigned int window_samples;
+static unsigned int window_ms;
+static double scale = 1;
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+static void print_prefix(struct stream *s)
+{
+	if (s->name)
+		printf("%s: ", s->name);
+}
+
+static void print_window(struct stream *s)
+{
+	igt_stats_t *w = &s->window;
+
+	if (!w->n_values)
+		return;
+
+	print_prefix(s);
+	printf("n=%u mean=%g stddev=%g p50=%g p90=%g p99=%g p99.9=%g "
+	       "iqm=%g trimean=%g\n",
+	       w->n_values,
+	       igt_stats_get_mean(w),
+	       igt_stats_get_std_deviation(w),
+	       igt_stats_get_median(w),
+	       igt_stats_get_percentile(w, 90),
+	       igt_stats_get_percentile(w, 99),
+	       igt_stats_get_percentile(w, 99.9),
+	       igt_stats_get_iqm(w),
+	       igt_stats_get_trimean(w));
+	fflush(stdout);
+
+	igt_stats_fini(w);
+	igt_stats_init_with_size(w, window_samples ?: 1024);
+	s->window_start = now_ms();
+}
+
+static void print_total(struct stream *s)
+{
+	struct igt_histogram *h = &s->hist;
+	uint64_t n = igt_histogram_get_count(h);
+	double q1, q2, q3, var;
+
+	if (!n)
+		return;
+
+	/* As igt_stats, the unbiased variance of a sample */
+	var = igt_mean_get_variance(&s->mean);
+	if (n > 1)
+		var = var * n / (n - 1);
+
+	q1 = igt_histogram_get_percentile(h, 25);
+	q2 = igt_histogram_get_percentile(h, 50);
+	q3 = igt_histogram_get_percentile(h, 75);
+
+	print_prefix(s);
+	printf("total n=%" PRIu64 " mean=%g stddev=%g p50=%g p90=%g p99=%g "
+	       "p99.9=%g iqm=%g trimean=%g\n",
+	       n, igt_mean_get(&s->mean), sqrt(var),
+	       q2 / scale,
+	       igt_histogram_get_percentile(h, 90) / scale,
+	       igt_histogram_get_percentile(h, 99) / scale,
+	       igt_histogram_get_percentile(h, 99.9) / scale,
+	       igt_histogram_get_iqm(h) / scale,
+	       (q1 + 2 * q2 + q3) / 4 / scale);
+}
+
+static void add(struct stream *s, double v)
+{
+	igt_mean_add(&s->mean, v);
+	v *= scale;
+	igt_histogram_add(&s->hist, v > 0 ? (uint64_t)(v + .5) : 0);
+
+	if (window_samples || window_ms) {
+		igt_stats_push_float(&s->window, v / scale);
+		if (window_samples && s->window.n_values >= window_samples)
+			print_window(s);
+	}
+}
+
+/*
+ * Parses all the complete numbers in [buf, end), returning where the last,
+ * possibly incomplete, one starts. Plain integers, the bulk of what tests
+ * print, are parsed by hand and anything else is left to strtod().
+ */
+static const char *parse(struct stream *s, const char *buf, const char *end,
+			 bool eof)
 {
-	igt_stats_t stats;
-	char *line = NULL;
-	size_t line_len = 0;
-
-	igt_stats_init(&stats);
-	while (getline(&line, &line_len, file) != -1) {
-		char *end, *start = line;
-		union {
-			unsigned long long u64;
-			double fp;
-		} u;
-		int is_float;
-
-		is_float = 0;
-		u.u64 = strtoull(start, &end, 0);
-		if (*end == '.') {
-			u.fp = strtod(start, &end);
-			is_float = 1;
+	const char *p = buf;
+
+	while (p < end) {
+		const char *start;
+		uint64_t u = 0;
+
+		if (!(*p >= '0' && *p <= '9') &&
+		    !((*p == '-' || *p == '.') && p + 1 < end &&
+		      p[1] >= '0' && p[1] <= '9')) {
+			p++;
+			continue;
 		}
-		while (start != end) {
-			if (is_float)
-				igt_stats_push_float(&stats, u.fp);
-			else
-				igt_stats_push(&stats, u.u64);
-
-			is_float = 0;
-			u.u64 = strtoull(start = end, &end, 0);
-			if (*end == '.') {
-				u.fp = strtod(start, &end);
-				is_float = 1;
+
+		start = p;
+		while (p < end && *p >= '0' && *p <= '9')
+			u = u * 10 + *p++ - '0';
+
+		/* Wait for the rest of a number cut short by the buffer */
+		if (p == end && !eof)
+			return start;
+
+		if (start != p && *p != '.' && *p != 'e' && *p != 'E' &&
+		    *p != 'x' && *p != 'X') {
+			add(s, u);
+			continue;
+		}
+
+		p = start;
+		while (p < end && strchr("0123456789+-.eExXabcdefABCDEF", *p))
+			p++;
+		if (p == end && !eof)
+			return start;
+
+		{
+			char tmp[64], *tail;
+			size_t len = p - start;
+			double v;
+
+			if (len >= sizeof(tmp))
+				len = sizeof(tmp) - 1;
+			memcpy(tmp, start, len);
+			tmp[len] = '\0';
+
+			v = strtod(tmp, &tail);
+			if (tail == tmp) {
+				p = start + 1;
+				continue;
 			}
+			add(s, v);
+			p = start + (tail - tmp);
 		}
 	}
-	free(line);
 
-	if (name)
-		printf("%s: ", name);
+	return p;
+}
+
+static void statify(int fd, const char *name)
+{
+	struct stream s = { .name = name };
+	char *buf = malloc(READ_SIZE + 1);
+	size_t fill = 0;
 
-	printf("%f\n", igt_stats_get_trimean(&stats));
+	igt_mean_init(&s.mean);
+	igt_histogram_init(&s.hist);
+	igt_stats_init_with_size(&s.window, window_samples ?: 1024);
+	s.window_start = now_ms();
 
-	igt_stats_fini(&stats);
+	for (;;) {
+		const char *rest;
+		ssize_t len;
+
+		if (window_ms) {
+			struct pollfd pfd = { .fd = fd, .events = POLLIN };
+			int64_t left = s.window_start + window_ms - now_ms();
+
+			if (left <= 0 || !poll(&pfd, 1, left)) {
+				print_window(&s);
+				continue;
+			}
+		}
+
+		len = read(fd, buf + fill, READ_SIZE - fill);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+
+		fill += len;
+		rest = parse(&s, buf, buf + fill, false);
+		fill = buf + fill - rest;
+		memmove(buf, rest, fill);
+		if (fill == READ_SIZE)
+			fill = 0;
+	}
+	parse(&s, buf, buf + fill, true);
+
+	print_window(&s);
+	print_total(&s);
+
+	igt_stats_fini(&s.window);
+	igt_histogram_fini(&s.hist);
+	free(buf);
 }
 
-int main(int argc, char **argv)
+static void usage(const char *name)
 {
-	if (argc == 1) {
-		statify(stdin, NULL);
-	} else {
-		int i;
+	fprintf(stderr,
+		"Usage: %s [-n samples] [-t seconds] [-s scale] [file...]\n"
+		"  -n  print the statistics of every window of that many numbers\n"
+		"  -t  print the statistics of every window of that many seconds\n"
+		"  -s  multiply the numbers by this before adding them to the\n"
+		"      histogram the totals are taken from (default 1)\n",
+		name);
+}
 
-		for (i = 1; i < argc; i++) {
-			FILE *file;
+int main(int argc, char **argv)
+{
+	int opt, i;
 
-			file = fopen(argv[i], "r");
-			if (file == NULL) {
-				perror(argv[i]);
-				continue;
+	while ((opt = getopt(argc, argv, "n:t:s:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			window_samples = atoi(optarg);
+			break;
+		case 't':
+			window_ms = atof(optarg) * 1000;
+			break;
+		case 's':
+			scale = atof(optarg);
+			if (scale <= 0) {
+				usage(argv[0]);
+				return 1;
 			}
+			break;
+		default:
+			usage(argv[0]);
+			return opt != 'h';
+		}
+	}
 
-			statify(file, argv[i]);
-			fclose(file);
+	if (optind == argc) {
+		statify(STDIN_FILENO, NULL);
+		return 0;
+	}
+
+	for (i = optind; i < argc; i++) {
+		int fd;
+
+		fd = open(argv[i], O_RDONLY);
+		if (fd < 0) {
+			perror(argv[i]);
+			continue;
 		}
+
+		statify(fd, argv[i]);
+		close(fd);
 	}
 
 	return 0;
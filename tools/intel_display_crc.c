@@ -24,21 +24,71 @@
  *    Damien Lespiau <damien.lespiau@intel.com>
  */
 
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "drmtest.h"
 #include "igt_core.h"
 #include "igt_debugfs.h"
 #include "igt_kms.h"
 
+/*
+ * In streaming mode the CRCs are polled this often, well within the
+ * backlog kept by the collector thread of each pipe.
+ */
+#define STREAM_POLL_US (4 * 1000)
+#define STREAM_BATCH 64
+
+#define CRC_FLAG_DUPLICATE (1 << 0) /* same frame number as the last CRC */
+#define CRC_FLAG_GAP (1 << 1) /* frames missing since the last CRC */
+#define CRC_FLAG_REPEAT (1 << 2) /* same CRC as the last frame */
+
+/*
+ * A record of the binary stream, in host byte order. @time is the
+ * CLOCK_MONOTONIC time at which the CRC was read back, @missed the number of
+ * frames missing before this one.
+ */
+struct crc_record {
+	uint64_t time;
+	uint32_t pipe;
+	uint32_t frame;
+	uint32_t flags;
+	uint32_t missed;
+	uint32_t n_words;
+	uint32_t crc[DRM_MAX_CRC_NR];
+	uint32_t pad;
+};
+
 typedef struct {
 	int fd;
-	int pipe;
+	unsigned int pipes;
 	int n_crcs;
+
+	bool stream;
+	bool binary;
+	unsigned int duration;
+	FILE *out;
 } display_crc_t;
 
+struct pipe_stream {
+	igt_pipe_crc_t *pipe_crc;
+	igt_crc_t last;
+	bool has_last;
+
+	uint64_t count;
+	uint64_t duplicates;
+	uint64_t missed;
+	uint64_t repeats;
+};
+
+static volatile sig_atomic_t stop;
+
 static int pipe_from_str(const char *str)
 {
 	unsigned char c;
@@ -60,20 +110,20 @@ static int pipe_from_str(const char *str)
 	return -1;
 }
 
-static void print_crcs(display_crc_t *ctx)
+static void print_crcs(display_crc_t *ctx, int pipe)
 {
 	igt_pipe_crc_t *pipe_crc;
 	igt_crc_t crc;
 	char *crc_str;
 	int i;
 
-	pipe_crc = igt_pipe_crc_new(ctx->fd, ctx->pipe, INTEL_PIPE_CRC_SOURCE_AUTO);
+	pipe_crc = igt_pipe_crc_new(ctx->fd, pipe, INTEL_PIPE_CRC_SOURCE_AUTO);
 
 	for (i = 0; i < ctx->n_crcs; i++) {
 		igt_pipe_crc_collect_crc(pipe_crc, &crc);
 
 		crc_str = igt_crc_to_string(&crc);
-		printf("CRC on pipe %s: %s\n", kmstest_pipe_name(ctx->pipe),
+		printf("CRC on pipe %s: %s\n", kmstest_pipe_name(pipe),
 		       crc_str);
 		free(crc_str);
 	}
@@ -81,30 +131,228 @@ static void print_crcs(display_crc_t *ctx)
 	igt_pipe_crc_free(pipe_crc);
 }
 
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void stop_stream(int sig)
+{
+	stop = 1;
+}
+
+static const char *flags_str(uint32_t flags)
+{
+	if (flags & CRC_FLAG_DUPLICATE)
+		return "duplicate";
+	if (flags & CRC_FLAG_GAP)
+		return "gap";
+	if (flags & CRC_FLAG_REPEAT)
+		return "repeat";
+	return "ok";
+}
+
+static void write_crc(display_crc_t *ctx, const struct crc_record *r)
+{
+	if (ctx->binary) {
+		fwrite(r, sizeof(*r), 1, ctx->out);
+		return;
+	}
+
+	fprintf(ctx->out, "%" PRIu64 ",%s,%u,%s,%u,",
+		r->time, kmstest_pipe_name(r->pipe), r->frame,
+		flags_str(r->flags), r->missed);
+	for (int i = 0; i < r->n_words; i++)
+		fprintf(ctx->out, "%s%08x", i ? " " : "", r->crc[i]);
+	fputc('\n', ctx->out);
+}
+
+static void check_crc(struct pipe_stream *s, const igt_crc_t *crc,
+		      struct crc_record *r)
+{
+	r->frame = crc->frame;
+	r->n_words = crc->n_words;
+	memcpy(r->crc, crc->crc, sizeof(r->crc));
+	r->flags = 0;
+	r->missed = 0;
+
+	if (s->has_last && crc->has_valid_frame && s->last.has_valid_frame) {
+		int32_t delta = crc->frame - s->last.frame;
+
+		if (delta <= 0) {
+			r->flags |= CRC_FLAG_DUPLICATE;
+			s->duplicates++;
+		} else if (delta > 1) {
+			r->flags |= CRC_FLAG_GAP;
+			r->missed = delta - 1;
+			s->missed += r->missed;
+		}
+	}
+
+	if (s->has_last && igt_check_crc_equal(crc, &s->last)) {
+		r->flags |= CRC_FLAG_REPEAT;
+		s->repeats++;
+	}
+
+	s->last = *crc;
+	s->has_last = true;
+	s->count++;
+}
+
+/*
+ * Streams the CRCs of all the selected pipes until interrupted or until
+ * the duration has elapsed, writing each out as soon as it has been read so
+ * that the memory used stays the same however long it runs.
+ */
+static void stream_crcs(display_crc_t *ctx)
+{
+	struct pipe_stream streams[IGT_MAX_PIPES] = {};
+	uint64_t end = 0;
+	int pipe;
+
+	if (ctx->duration)
+		end = now_ns() + ctx->duration * 1000000000ull;
+
+	for_each_pipe_static(pipe) {
+		if (!(ctx->pipes & (1 << pipe)))
+			continue;
+
+		streams[pipe].pipe_crc =
+			igt_pipe_crc_new_nonblock(ctx->fd, pipe,
+						  INTEL_PIPE_CRC_SOURCE_AUTO);
+		igt_pipe_crc_start_async(streams[pipe].pipe_crc);
+	}
+
+	signal(SIGINT, stop_stream);
+	signal(SIGTERM, stop_stream);
+
+	if (!ctx->binary)
+		fprintf(ctx->out, "time_ns,pipe,frame,status,missed,crc\n");
+
+	while (!stop && (!end || now_ns() < end)) {
+		for_each_pipe_static(pipe) {
+			struct pipe_stream *s = &streams[pipe];
+			struct crc_record r = { .pipe = pipe };
+			igt_crc_t *crcs;
+			int n;
+
+			if (!s->pipe_crc)
+				continue;
+
+			n = igt_pipe_crc_get_crcs(s->pipe_crc, STREAM_BATCH,
+						  &crcs);
+			r.time = now_ns();
+			for (int i = 0; i < n; i++) {
+				check_crc(s, &crcs[i], &r);
+				write_crc(ctx, &r);
+			}
+			free(crcs);
+		}
+
+		fflush(ctx->out);
+		usleep(STREAM_POLL_US);
+	}
+
+	for_each_pipe_static(pipe) {
+		struct pipe_stream *s = &streams[pipe];
+
+		if (!s->pipe_crc)
+			continue;
+
+		igt_pipe_crc_stop(s->pipe_crc);
+		igt_pipe_crc_free(s->pipe_crc);
+
+		fprintf(stderr,
+			"pipe %s: %" PRIu64 " CRCs, %" PRIu64 " frames missed, "
+			"%" PRIu64 " duplicates, %" PRIu64 " repeated\n",
+			kmstest_pipe_name(pipe), s->count, s->missed,
+			s->duplicates, s->repeats);
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-p pipe]... [-n count]\n"
+		"       %s -s [-p pipe]... [-t seconds] [-o file] [-b]\n"
+		"  -p  pipe to read the CRCs of, A by default\n"
+		"  -n  number of CRCs to print\n"
+		"  -s  stream the CRCs of the pipes as they come in\n"
+		"  -t  stop streaming after this many seconds\n"
+		"  -o  write the stream to this file instead of stdout\n"
+		"  -b  write the stream as binary records instead of CSV\n",
+		name, name);
+}
+
 static display_crc_t ctx;
 
 int main(int argc, char **argv)
 {
-	int opt;
+	const char *output = NULL;
+	int opt, pipe;
 
 	ctx.n_crcs = 1;
 
-	while ((opt = getopt(argc, argv, "p:n:")) != -1) {
+	while ((opt = getopt(argc, argv, "p:n:st:o:bh")) != -1) {
 		switch (opt) {
 		case 'p':
-			ctx.pipe = pipe_from_str(optarg);
-			if (ctx.pipe == -1) {
+			pipe = pipe_from_str(optarg);
+			if (pipe == -1) {
 				fprintf(stderr, "Unknown pipe %s\n", optarg);
 				exit(1);
 			}
+			ctx.pipes |= 1 << pipe;
 			break;
 		case 'n':
 			ctx.n_crcs = atoi(optarg);
 			break;
+		case 's':
+			ctx.stream = true;
+			break;
+		case 't':
+			ctx.duration = atoi(optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'b':
+			ctx.binary = true;
+			break;
 		default:
-			igt_assert(0);
+			usage(argv[0]);
+			exit(opt == 'h' ? 0 : 1);
 		}
 	}
 
-	print_crcs(&ctx);
+	if (!ctx.pipes)
+		ctx.pipes = 1 << PIPE_A;
+
+	ctx.fd = drm_open_driver(DRIVER_ANY);
+
+	if (ctx.stream) {
+		ctx.out = stdout;
+		if (output) {
+			ctx.out = fopen(output, ctx.binary ? "wb" : "w");
+			if (!ctx.out) {
+				fprintf(stderr, "Failed to open %s: %s\n",
+					output, strerror(errno));
+				exit(1);
+			}
+		}
+
+		stream_crcs(&ctx);
+
+		if (ctx.out != stdout)
+			fclose(ctx.out);
+	} else {
+		for_each_pipe_static(pipe)
+			if (ctx.pipes & (1 << pipe))
+				print_crcs(&ctx, pipe);
+	}
+
+	close(ctx.fd);
+	return 0;
 }
@@ -0,0 +1,699 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Predicts the SKL+ universal plane watermarks, the DDB split and the
+ * memory bandwidth of a display configuration, without any hardware.
+ *
+ * The model follows the i915 watermark code: for every plane and level the
+ * blocks and lines needed to ride out the memory latency of that level are
+ * computed as in skl_compute_plane_wm(), then the DDB of each pipe, split
+ * between the pipes by their width, goes first to the minimum allocation
+ * of the highest level all the planes of the pipe fit in, and the rest in
+ * proportion to their data rates, as in skl_allocate_pipe_ddb(). Levels
+ * whose minimum allocation does not fit are disabled.
+ *
+ * The deepest level enabled on every plane bounds the memory latency the
+ * display tolerates, and so the package C-states and SAGV it allows. A
+ * configuration in which level 0 does not fit would be refused.
+ */
+
+#define MAX_PIPES	4
+#define MAX_PLANES	8	/* the last one being the cursor */
+#define CURSOR		(MAX_PLANES - 1)
+#define NUM_LEVELS	8
+#define BLOCK_SIZE	512
+
+static const struct gen_info {
+	const char *name;
+	int gen;
+	unsigned int ddb_size;	/* in blocks */
+	unsigned int max_lines;
+	unsigned int sagv_block_us;
+} gens[] = {
+	{ "skl", 9, 896, 31, 30 },
+	{ "kbl", 9, 896, 31, 30 },
+	{ "glk", 9, 512, 31, 0 },
+	{ "cnl", 10, 1024, 31, 0 },
+	{ "icl", 11, 2048, 255, 10 },
+	{ "tgl", 12, 2048, 255, 10 },
+	{ }
+};
+
+static const struct format {
+	const char *name;
+	unsigned int cpp;
+} formats[] = {
+	{ "c8", 1 },
+	{ "rgb565", 2 },
+	{ "yuyv", 2 },
+	{ "xrgb8888", 4 },
+	{ "argb8888", 4 },
+	{ "xbgr8888", 4 },
+	{ "xrgb2101010", 4 },
+	{ "xrgb16161616f", 8 },
+	{ }
+};
+
+enum modifier {
+	LINEAR,
+	X_TILED,
+	Y_TILED,
+	YF_TILED,
+};
+
+static const char * const modifier_names[] = {
+	[LINEAR] = "linear",
+	[X_TILED] = "x",
+	[Y_TILED] = "y",
+	[YF_TILED] = "yf",
+};
+
+/* Example latencies of a Skylake laptop, in us, level 0 first */
+static unsigned int latency[NUM_LEVELS] = { 2, 19, 19, 19, 36, 69, 81, 102 };
+
+struct level {
+	unsigned int blocks, lines, min_ddb;
+	bool valid, enabled;
+};
+
+struct plane {
+	bool enabled;
+	unsigned int src_w, src_h, dst_w, dst_h;
+	const struct format *format;
+	enum modifier modifier;
+
+	double pixel_rate;	/* kHz, with the downscaling */
+	double rate;		/* bytes/s fetched */
+	struct level wm[NUM_LEVELS];
+	unsigned int ddb_start, ddb_end;
+};
+
+struct pipe {
+	bool active;
+	unsigned int hdisplay, vdisplay, refresh;
+	unsigned int htotal, vtotal;
+	unsigned int clock;	/* kHz */
+
+	struct plane plane[MAX_PLANES];
+	unsigned int ddb_start, ddb_end;
+	int level;
+};
+
+static const struct gen_info *gen = &gens[0];
+static struct pipe pipes[MAX_PIPES];
+
+static bool y_tiled(const struct plane *p)
+{
+	return p->modifier == Y_TILED || p->modifier == YF_TILED;
+}
+
+static void compute_plane_wm(const struct pipe *pipe, struct plane *p)
+{
+	unsigned int cpp = p->format->cpp;
+	unsigned int bytes_per_line = p->src_w * cpp;
+	unsigned int y_min_scanlines = 0;
+	double blocks_per_line, y_tile_minimum = 0;
+	double linetime_us;
+
+	p->pixel_rate = pipe->clock;
+	if (p->src_w > p->dst_w)
+		p->pixel_rate = p->pixel_rate * p->src_w / p->dst_w;
+	if (p->src_h > p->dst_h)
+		p->pixel_rate = p->pixel_rate * p->src_h / p->dst_h;
+	p->rate = (double)p->src_w * p->src_h * cpp * pipe->refresh;
+
+	if (y_tiled(p)) {
+		y_min_scanlines = 4;
+		blocks_per_line = ceil((double)bytes_per_line *
+				       y_min_scanlines / BLOCK_SIZE) /
+				  y_min_scanlines;
+		y_tile_minimum = blocks_per_line * y_min_scanlines;
+	} else if (p->modifier == X_TILED && gen->gen == 9) {
+		blocks_per_line = ceil((double)bytes_per_line / BLOCK_SIZE);
+	} else {
+		blocks_per_line = ceil((double)bytes_per_line / BLOCK_SIZE) + 1;
+	}
+
+	linetime_us = ceil(pipe->htotal * 1000. / pipe->clock);
+
+	for (int level = 0; level < NUM_LEVELS; level++) {
+		struct level *wm = &p->wm[level];
+		double method1, method2, selected;
+
+		memset(wm, 0, sizeof(*wm));
+		if (!latency[level])
+			continue;
+
+		method1 = latency[level] * p->pixel_rate * cpp /
+			  (1000. * BLOCK_SIZE);
+		if (gen->gen >= 10)
+			method1 += 1;
+		method2 = ceil(latency[level] * p->pixel_rate /
+			       (pipe->htotal * 1000.)) * blocks_per_line;
+
+		if (y_tiled(p))
+			selected = fmax(method2, y_tile_minimum);
+		else if (cpp * pipe->htotal < BLOCK_SIZE &&
+			 bytes_per_line < BLOCK_SIZE)
+			selected = method2;
+		else if (latency[level] >= linetime_us)
+			selected = fmin(method1, method2);
+		else
+			selected = method1;
+
+		wm->blocks = ceil(selected) + 1;
+		wm->lines = ceil(selected / blocks_per_line);
+
+		/* Display WA #1125 and #1126 */
+		if (gen->gen == 9 && level >= 1) {
+			if (y_tiled(p)) {
+				wm->blocks += ceil(y_tile_minimum);
+				wm->lines += y_min_scanlines;
+			} else {
+				wm->blocks++;
+			}
+		}
+
+		if (y_tiled(p)) {
+			unsigned int extra;
+
+			if (wm->lines % y_min_scanlines == 0)
+				extra = y_min_scanlines;
+			else
+				extra = y_min_scanlines * 2 -
+					wm->lines % y_min_scanlines;
+			wm->min_ddb = ceil((wm->lines + extra) *
+					   blocks_per_line);
+		} else {
+			wm->min_ddb = wm->blocks + (wm->blocks + 9) / 10;
+		}
+
+		wm->valid = wm->lines <= gen->max_lines;
+	}
+}
+
+static unsigned int num_active_pipes(void)
+{
+	unsigned int n = 0;
+
+	for (int i = 0; i < MAX_PIPES; i++)
+		n += pipes[i].active;
+
+	return n;
+}
+
+static void allocate_pipe_ddb(struct pipe *pipe, unsigned int start,
+			      unsigned int end)
+{
+	unsigned int alloc_size, remaining;
+	double total_rate = 0;
+	struct plane *p;
+	int level;
+
+	pipe->ddb_start = start;
+	pipe->ddb_end = end;
+
+	/* A fixed allocation for the cursor, enough for its highest level */
+	p = &pipe->plane[CURSOR];
+	if (p->enabled) {
+		unsigned int blocks = num_active_pipes() == 1 ? 32 : 8;
+
+		for (level = 0; level < NUM_LEVELS && p->wm[level].valid; level++)
+			if (p->wm[level].min_ddb > blocks)
+				blocks = p->wm[level].min_ddb;
+
+		p->ddb_start = end - blocks;
+		p->ddb_end = end;
+		end -= blocks;
+	}
+	alloc_size = end - start;
+
+	/* The highest level whose minimum allocations all fit */
+	for (level = NUM_LEVELS - 1; level >= 0; level--) {
+		unsigned int blocks = 0;
+		bool valid = true;
+
+		for (int i = 0; i < CURSOR; i++) {
+			p = &pipe->plane[i];
+			if (!p->enabled)
+				continue;
+
+			valid &= p->wm[level].valid;
+			blocks += p->wm[level].min_ddb;
+		}
+
+		if (valid && blocks <= alloc_size) {
+			alloc_size -= blocks;
+			break;
+		}
+	}
+	pipe->level = level;
+	if (level < 0)
+		return;
+
+	for (int i = 0; i < CURSOR; i++)
+		if (pipe->plane[i].enabled)
+			total_rate += pipe->plane[i].rate;
+
+	/* The rest in proportion to the data rates */
+	remaining = alloc_size;
+	for (int i = 0; i < CURSOR; i++) {
+		unsigned int extra;
+
+		p = &pipe->plane[i];
+		if (!p->enabled)
+			continue;
+
+		extra = ceil(alloc_size * p->rate / total_rate);
+		if (extra > remaining)
+			extra = remaining;
+		remaining -= extra;
+
+		p->ddb_start = start;
+		p->ddb_end = start + p->wm[level].min_ddb + extra;
+		start = p->ddb_end;
+	}
+}
+
+static void enable_levels(struct plane *p, int max_level)
+{
+	unsigned int size = p->ddb_end - p->ddb_start;
+
+	for (int level = 0; level < NUM_LEVELS; level++) {
+		struct level *wm = &p->wm[level];
+
+		wm->enabled = level <= max_level && wm->valid &&
+			      wm->min_ddb <= size;
+		if (!wm->enabled)
+			max_level = level - 1;
+	}
+}
+
+static void allocate_ddb(void)
+{
+	unsigned int size = gen->ddb_size;
+	unsigned int total_width = 0, width = 0;
+
+	/* The bypass path takes 4 blocks before gen11 */
+	if (gen->gen < 11)
+		size -= 4;
+
+	for (int i = 0; i < MAX_PIPES; i++)
+		if (pipes[i].active)
+			total_width += pipes[i].hdisplay;
+
+	for (int i = 0; i < MAX_PIPES; i++) {
+		struct pipe *pipe = &pipes[i];
+
+		if (!pipe->active)
+			continue;
+
+		for (int j = 0; j < MAX_PLANES; j++)
+			if (pipe->plane[j].enabled)
+				compute_plane_wm(pipe, &pipe->plane[j]);
+
+		allocate_pipe_ddb(pipe,
+				  (uint64_t)size * width / total_width,
+				  (uint64_t)size * (width + pipe->hdisplay) /
+				  total_width);
+		width += pipe->hdisplay;
+
+		for (int j = 0; j < MAX_PLANES; j++)
+			if (pipe->plane[j].enabled)
+				enable_levels(&pipe->plane[j],
+					      j == CURSOR ? NUM_LEVELS - 1 :
+					      pipe->level);
+	}
+}
+
+static void print_plane(int index, const struct plane *p)
+{
+	char name[16];
+
+	if (index == CURSOR)
+		snprintf(name, sizeof(name), "Cursor");
+	else
+		snprintf(name, sizeof(name), "Plane %d", index + 1);
+
+	printf("  %-8s %ux%u", name, p->src_w, p->src_h);
+	if (p->src_w != p->dst_w || p->src_h != p->dst_h)
+		printf("->%ux%u", p->dst_w, p->dst_h);
+	printf(" %s %s, %.1f MB/s, DDB %u-%u (%u blocks)\n",
+	       p->format->name, modifier_names[p->modifier], p->rate / 1e6,
+	       p->ddb_start, p->ddb_end, p->ddb_end - p->ddb_start);
+
+	printf("    %-8s", "level");
+	for (int level = 0; level < NUM_LEVELS; level++)
+		printf("%6d", level);
+	printf("\n    %-8s", "blocks");
+	for (int level = 0; level < NUM_LEVELS; level++)
+		printf("%6u", p->wm[level].blocks);
+	printf("\n    %-8s", "lines");
+	for (int level = 0; level < NUM_LEVELS; level++)
+		printf("%6u", p->wm[level].lines);
+	printf("\n    %-8s", "min ddb");
+	for (int level = 0; level < NUM_LEVELS; level++)
+		printf("%6u", p->wm[level].min_ddb);
+	printf("\n    %-8s", "enabled");
+	for (int level = 0; level < NUM_LEVELS; level++)
+		printf("%6s", p->wm[level].enabled ? "yes" : "no");
+	printf("\n");
+}
+
+static int print_results(double budget)
+{
+	int common_level = NUM_LEVELS - 1;
+	double total_rate = 0;
+
+	printf("Platform %s, DDB of %u blocks\n", gen->name, gen->ddb_size);
+
+	for (int i = 0; i < MAX_PIPES; i++) {
+		const struct pipe *pipe = &pipes[i];
+
+		if (!pipe->active)
+			continue;
+
+		printf("\nPipe %c: %ux%u@%u, htotal %u, vtotal %u, %u kHz, DDB %u-%u\n",
+		       'A' + i, pipe->hdisplay, pipe->vdisplay, pipe->refresh,
+		       pipe->htotal, pipe->vtotal, pipe->clock,
+		       pipe->ddb_start, pipe->ddb_end);
+
+		for (int j = 0; j < MAX_PLANES; j++) {
+			const struct plane *p = &pipe->plane[j];
+			int level;
+
+			if (!p->enabled)
+				continue;
+
+			print_plane(j, p);
+			total_rate += p->rate;
+
+			for (level = 0; level < NUM_LEVELS; level++)
+				if (!p->wm[level].enabled)
+					break;
+			if (level - 1 < common_level)
+				common_level = level - 1;
+		}
+	}
+
+	printf("\nMemory bandwidth: %.1f MB/s", total_rate / 1e6);
+	if (budget)
+		printf(" of %.1f MB/s (%.0f%%)", budget, 100 * total_rate / 1e6 / budget);
+	printf("\n");
+
+	if (common_level < 0) {
+		printf("Level 0 does not fit: the configuration would be rejected\n");
+		return 1;
+	}
+
+	printf("Deepest level enabled on all planes: %d, tolerating %uus of memory latency\n",
+	       common_level, latency[common_level]);
+	if (gen->sagv_block_us)
+		printf("SAGV: %s (needs %uus)\n",
+		       latency[common_level] >= gen->sagv_block_us ?
+		       "possible" : "blocked", gen->sagv_block_us);
+
+	if (budget && total_rate / 1e6 > budget) {
+		printf("The bandwidth exceeds the budget\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+static struct pipe *parse_pipe(const char **s)
+{
+	int i = **s - 'A';
+
+	if (i < 0 || i >= MAX_PIPES || (*s)[1] != ':')
+		return NULL;
+
+	*s += 2;
+	return &pipes[i];
+}
+
+/* A:<width>x<height>@<refresh>[:<htotal>:<vtotal>] */
+static bool parse_mode(const char *s)
+{
+	struct pipe *pipe = parse_pipe(&s);
+	int n;
+
+	if (!pipe)
+		return false;
+
+	n = sscanf(s, "%ux%u@%u:%u:%u",
+		   &pipe->hdisplay, &pipe->vdisplay, &pipe->refresh,
+		   &pipe->htotal, &pipe->vtotal);
+	if (n != 3 && n != 5)
+		return false;
+	if (!pipe->hdisplay || !pipe->vdisplay || !pipe->refresh)
+		return false;
+
+	/* Roughly CVT reduced blanking */
+	if (n == 3) {
+		pipe->htotal = pipe->hdisplay + 160;
+		pipe->vtotal = pipe->vdisplay + pipe->vdisplay / 20 + 6;
+	}
+	if (pipe->htotal < pipe->hdisplay || pipe->vtotal < pipe->vdisplay)
+		return false;
+
+	pipe->clock = (uint64_t)pipe->htotal * pipe->vtotal *
+		      pipe->refresh / 1000;
+	pipe->active = true;
+
+	return true;
+}
+
+/* A:<plane>:<width>x<height>[:<format>[:<modifier>[:<width>x<height>]]] */
+static bool parse_plane(const char *s)
+{
+	struct pipe *pipe = parse_pipe(&s);
+	char format[32] = "xrgb8888", modifier[8] = "linear";
+	unsigned int dst_w = 0, dst_h = 0;
+	struct plane *p;
+	int index, n;
+
+	if (!pipe)
+		return false;
+
+	if (!strncmp(s, "cursor:", 7)) {
+		index = CURSOR;
+		s += 7;
+		strcpy(format, "argb8888");
+	} else {
+		char *end;
+
+		index = strtol(s, &end, 10) - 1;
+		if (end == s || *end != ':' || index < 0 || index >= CURSOR)
+			return false;
+		s = end + 1;
+	}
+
+	p = &pipe->plane[index];
+	n = sscanf(s, "%ux%u:%31[^:]:%7[^:]:%ux%u",
+		   &p->src_w, &p->src_h, format, modifier, &dst_w, &dst_h);
+	if (n < 2 || n == 5 || !p->src_w || !p->src_h)
+		return false;
+
+	p->format = NULL;
+	for (const struct format *f = formats; f->name; f++)
+		if (!strcmp(format, f->name))
+			p->format = f;
+	if (!p->format)
+		return false;
+
+	p->modifier = -1;
+	for (int i = 0; i < sizeof(modifier_names) / sizeof(*modifier_names); i++)
+		if (!strcmp(modifier, modifier_names[i]))
+			p->modifier = i;
+	if (p->modifier == -1)
+		return false;
+	if (index == CURSOR && p->modifier != LINEAR)
+		return false;
+
+	p->dst_w = dst_w ?: p->src_w;
+	p->dst_h = dst_h ?: p->src_h;
+	p->enabled = true;
+
+	return true;
+}
+
+static bool parse_latencies(const char *s)
+{
+	for (int level = 0; level < NUM_LEVELS; level++) {
+		char *end;
+
+		latency[level] = strtoul(s, &end, 10);
+		if (end == s)
+			return false;
+		s = end;
+		if (*s == ',')
+			s++;
+		else if (*s)
+			return false;
+		else
+			while (++level < NUM_LEVELS)
+				latency[level] = 0;
+	}
+
+	return !*s && latency[0];
+}
+
+/* As printed by debugfs, "WM<level> <raw> (<us> usec)" */
+static bool read_latencies(const char *path)
+{
+	unsigned int level, raw;
+	double us;
+	bool ret = false;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return false;
+
+	memset(latency, 0, sizeof(latency));
+	while (fscanf(f, " WM%u %u (%lf usec)", &level, &raw, &us) == 3) {
+		if (level < NUM_LEVELS)
+			latency[level] = ceil(us);
+		ret = true;
+	}
+	fclose(f);
+
+	return ret && latency[0];
+}
+
+static void usage(const char *appname)
+{
+	printf("intel_display_plan - Predict the watermarks, DDB split and bandwidth of a display layout\n"
+	       "\n"
+	       "Usage: %s [-p <platform>] [-l <latencies>] [-b <MB/s>]\n"
+	       "\t-m <pipe>:<width>x<height>@<refresh>[:<htotal>:<vtotal>]...\n"
+	       "\t-P <pipe>:<plane>:<width>x<height>[:<format>[:<modifier>[:<dst width>x<dst height>]]]...\n"
+	       "\n"
+	       "\t-p\tskl, kbl, glk, cnl, icl or tgl, skl by default\n"
+	       "\t-l\tmemory latencies of the watermark levels in us, comma\n"
+	       "\t\tseparated from level 0, or a file like the i915_pri_wm_latency\n"
+	       "\t\tdebugfs file\n"
+	       "\t-d\tDDB size in blocks, instead of that of the platform\n"
+	       "\t-b\tmemory bandwidth available to the display, in MB/s\n"
+	       "\t-m\tmode of a pipe, A to D; htotal and vtotal default to\n"
+	       "\t\treduced blanking\n"
+	       "\t-P\tplane of a pipe, numbered from 1, or \"cursor\"; the\n"
+	       "\t\tformat is xrgb8888 by default, the modifier linear, x, y or\n"
+	       "\t\tyf, and the destination size tells the scaling\n"
+	       "\n"
+	       "Example: %s -m A:3840x2160@60 -P A:1:3840x2160:xrgb8888:y -P A:cursor:64x64\n",
+	       appname, appname);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int ddb_size = 0;
+	double budget = 0;
+	bool any = false;
+	int c;
+
+	while ((c = getopt(argc, argv, "p:l:d:b:m:P:h")) != -1) {
+		switch (c) {
+		case 'p':
+			for (gen = gens; gen->name; gen++)
+				if (!strcmp(optarg, gen->name))
+					break;
+			if (!gen->name) {
+				fprintf(stderr, "Unknown platform %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'l':
+			if (!parse_latencies(optarg) && !read_latencies(optarg)) {
+				fprintf(stderr, "Invalid latencies %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'd':
+			ddb_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			budget = atof(optarg);
+			break;
+		case 'm':
+			if (!parse_mode(optarg)) {
+				fprintf(stderr, "Invalid mode %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'P':
+			if (!parse_plane(optarg)) {
+				fprintf(stderr, "Invalid plane %s\n", optarg);
+				return 1;
+			}
+			any = true;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!any) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (int i = 0; i < MAX_PIPES; i++) {
+		bool planes = false;
+
+		for (int j = 0; j < MAX_PLANES; j++)
+			planes |= pipes[i].plane[j].enabled;
+
+		if (planes && !pipes[i].active) {
+			fprintf(stderr, "No mode for pipe %c\n", 'A' + i);
+			return 1;
+		}
+		if (!planes)
+			pipes[i].active = false;
+	}
+
+	if (ddb_size) {
+		static struct gen_info custom;
+
+		custom = *gen;
+		custom.ddb_size = ddb_size;
+		gen = &custom;
+	}
+
+	allocate_ddb();
+
+	return print_results(budget);
+}
@@ -25,6 +25,8 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
+#include <sched.h>
 #include <unistd.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -38,6 +40,7 @@
 #include "igt_debugfs.h"
 #include "drmtest.h"
 #include "igt_aux.h"
+#include "igt_stats.h"
 
 enum test {
 	TEST_INVALID,
@@ -947,6 +950,66 @@ static const char *test_name(enum test test, int pipe, int bit, bool test_pixel_
 	}
 }
 
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Prints the distribution of the position at which the event was seen, the
+ * middle of the interval it was bracketed by, and of the width of those
+ * intervals which bounds the error of each sample.
+ */
+static void print_histogram(const char *name, int field,
+			    const uint32_t *min, const uint32_t *max,
+			    const int count)
+{
+	struct igt_histogram pos, width;
+	uint32_t *mid;
+	int i, n, j;
+
+	mid = calloc(count, sizeof(*mid));
+	assert(mid);
+
+	igt_histogram_init(&pos);
+	igt_histogram_init(&width);
+	for (n = 0; n < count; n++) {
+		if (min[n] == 0 && max[n] == 0)
+			break;
+
+		mid[n] = (min[n] + max[n] + 1) >> 1;
+		igt_histogram_add(&pos, mid[n]);
+		igt_histogram_add(&width, max[n] - min[n]);
+	}
+
+	if (n) {
+		printf("%s: [%u] %d samples, position min %" PRIu64
+		       " median %.0f p99 %.0f max %" PRIu64
+		       ", interval median %.0f max %" PRIu64 "\n",
+		       name, field, n,
+		       igt_histogram_get_min(&pos),
+		       igt_histogram_get_median(&pos),
+		       igt_histogram_get_percentile(&pos, 99),
+		       igt_histogram_get_max(&pos),
+		       igt_histogram_get_median(&width),
+		       igt_histogram_get_max(&width));
+
+		qsort(mid, n, sizeof(*mid), cmp_u32);
+		for (i = 0; i < n; i = j) {
+			for (j = i + 1; j < n && mid[j] == mid[i]; j++)
+				;
+			printf("[%u] %6u: %6d %5.1f%%\n",
+			       field, mid[i], j - i, 100. * (j - i) / n);
+		}
+	}
+
+	igt_histogram_fini(&width);
+	igt_histogram_fini(&pos);
+	free(mid);
+}
+
 static void __attribute__((noreturn)) usage(const char *name)
 {
 	fprintf(stderr, "Usage: %s [options]\n"
@@ -955,7 +1018,9 @@ static void __attribute__((noreturn)) usage(const char *name)
 		" -b,--bit <bit>\n"
 		" -l,--line <target scanline/pixel>\n"
 		" -f,--fuzz <target fuzz>\n"
-		" -x,--pixel\n",
+		" -x,--pixel\n"
+		" -H,--histogram <samples> print the distribution of that many samples\n"
+		" -c,--cpu <cpu> run pinned to that cpu\n",
 		name);
 	exit(1);
 }
@@ -964,13 +1029,12 @@ int main(int argc, char *argv[])
 {
 	int i;
 	int pipe = 0, bit = 0, target_scanline = 0, target_fuzz = 1;
-	bool test_pixelcount = false;
+	bool test_pixelcount = false, histogram = false;
 	uint32_t devid;
-	uint32_t min[2*128] = {};
-	uint32_t max[2*128] = {};
+	uint32_t *min, *max;
 	uint32_t a, b;
 	enum test test = TEST_INVALID;
-	const int count = ARRAY_SIZE(min)/2;
+	int count = 128, cpu = -1;
 
 	for (;;) {
 		static const struct option long_options[] = {
@@ -980,10 +1044,12 @@ int main(int argc, char *argv[])
 			{ .name = "line", .has_arg = required_argument, },
 			{ .name = "fuzz", .has_arg = required_argument, },
 			{ .name = "pixel", .has_arg = no_argument, },
+			{ .name = "histogram", .has_arg = required_argument, },
+			{ .name = "cpu", .has_arg = required_argument, },
 			{ },
 		};
 
-		int opt = getopt_long(argc, argv, "t:p:b:l:f:x", long_options, NULL);
+		int opt = getopt_long(argc, argv, "t:p:b:l:f:xH:c:", long_options, NULL);
 		if (opt == -1)
 			break;
 
@@ -1043,9 +1109,35 @@ int main(int argc, char *argv[])
 		case 'x':
 			test_pixelcount = true;
 			break;
+		case 'H':
+			histogram = true;
+			count = atoi(optarg);
+			if (count <= 0)
+				usage(argv[0]);
+			break;
+		case 'c':
+			cpu = atoi(optarg);
+			if (cpu < 0)
+				usage(argv[0]);
+			break;
 		}
 	}
 
+	min = calloc(2 * count, sizeof(*min));
+	max = calloc(2 * count, sizeof(*max));
+	if (!min || !max)
+		err(1, "allocating %d samples", count);
+
+	/* An isolated cpu keeps the polling from being preempted */
+	if (cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set))
+			err(1, "pinning to cpu %d", cpu);
+	}
+
 	devid = intel_get_pci_device()->device_id;
 
 	/*
@@ -1264,9 +1356,18 @@ int main(int argc, char *argv[])
 
 	intel_register_access_fini();
 
-	if (quit)
+	/* Long histogram runs may be cut short, keeping what was collected */
+	if (quit && !histogram)
 		return 0;
 
+	if (histogram) {
+		print_histogram(test_name(test, pipe, bit, test_pixelcount), 0,
+				&min[0*count], &max[0*count], count);
+		print_histogram(test_name(test, pipe, bit, test_pixelcount), 1,
+				&min[1*count], &max[1*count], count);
+		return 0;
+	}
+
 	for (i = 0; i < count; i++) {
 		if (min[0*count+i] == 0 && max[0*count+i] == 0)
 			break;
@@ -0,0 +1,682 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+/*
+ * Indexed error state archives.
+ *
+ * Packing parses an i915 error state once: every ascii85 buffer is decoded
+ * (and inflated) and stored as raw bytes, every "NAME: value" line becomes
+ * a register entry tagged with the engine whose "command stream" section it
+ * belongs to, and the remaining text is kept as a single blob. A table of
+ * contents and a string table follow the data, and the header at the start
+ * of the file points at both.
+ *
+ * Reading an archive is then a matter of mapping it and walking the table
+ * of contents, so listing, extracting a single buffer or looking up a
+ * register across many dumps never touches the original text again.
+ */
+
+#define ARCHIVE_MAGIC "IGTERRAR"
+#define ARCHIVE_VERSION 1
+
+enum {
+	ENTRY_TEXT,
+	ENTRY_REGISTER,
+	ENTRY_BUFFER,
+};
+
+struct archive_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_entries;
+	uint64_t toc; /* offset of the entries */
+	uint64_t strings; /* offset of the string table */
+	uint64_t strings_size;
+};
+
+struct archive_entry {
+	uint32_t type;
+	uint32_t engine; /* offsets into the string table, 0 is "" */
+	uint32_t name;
+	uint32_t value; /* registers only */
+	uint64_t gtt_offset; /* buffers only */
+	uint64_t offset; /* text and buffers: data within the archive */
+	uint64_t size;
+};
+
+struct archive_writer {
+	FILE *file;
+	uint64_t offset;
+
+	struct archive_entry *entries;
+	unsigned int num_entries, max_entries;
+
+	char *strings;
+	size_t strings_size, max_strings;
+};
+
+struct archive {
+	const char *path;
+	void *map;
+	size_t size;
+
+	const struct archive_header *hdr;
+	const struct archive_entry *entries;
+	const char *strings;
+};
+
+static int ascii85_decode(const char *in, uint32_t **data, bool compressed)
+{
+	int len = 0, size = 1024;
+
+	*data = realloc(*data, sizeof(uint32_t)*size);
+	if (*data == NULL)
+		return 0;
+
+	while (*in >= '!' && *in <= 'z') {
+		uint32_t v = 0;
+
+		if (len == size) {
+			size *= 2;
+			*data = realloc(*data, sizeof(uint32_t)*size);
+			if (*data == NULL)
+				return 0;
+		}
+
+		if (*in == 'z') {
+			in++;
+		} else {
+			v += in[0] - 33; v *= 85;
+			v += in[1] - 33; v *= 85;
+			v += in[2] - 33; v *= 85;
+			v += in[3] - 33; v *= 85;
+			v += in[4] - 33;
+			in += 5;
+		}
+		(*data)[len++] = v;
+	}
+
+	if (compressed) {
+		struct z_stream_s zstream;
+		size_t max = 128 * 4096;
+		void *buf;
+
+		memset(&zstream, 0, sizeof(zstream));
+		zstream.next_in = (unsigned char *)*data;
+		zstream.avail_in = 4 * len;
+		if (inflateInit(&zstream) != Z_OK)
+			return 0;
+
+		buf = malloc(max);
+		for (;;) {
+			int ret;
+
+			if (!buf) {
+				inflateEnd(&zstream);
+				return 0;
+			}
+
+			zstream.next_out = (unsigned char *)buf + zstream.total_out;
+			zstream.avail_out = max - zstream.total_out;
+
+			ret = inflate(&zstream, Z_SYNC_FLUSH);
+			if (ret == Z_STREAM_END)
+				break;
+			if (ret != Z_OK) {
+				inflateEnd(&zstream);
+				free(buf);
+				return 0;
+			}
+			if (zstream.avail_out)
+				break;
+
+			max *= 2;
+			buf = realloc(buf, max);
+		}
+		inflateEnd(&zstream);
+
+		free(*data);
+		*data = buf;
+		len = zstream.total_out / 4;
+	}
+
+	return len;
+}
+
+static char *trim(char *s)
+{
+	char *end;
+
+	while (isspace(*s))
+		s++;
+
+	end = s + strlen(s);
+	while (end > s && isspace(end[-1]))
+		end--;
+	*end = '\0';
+
+	return s;
+}
+
+static uint32_t add_string(struct archive_writer *w, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	uint32_t offset;
+
+	if (len == 1)
+		return 0;
+
+	if (w->strings_size + len > w->max_strings) {
+		w->max_strings = 2 * (w->strings_size + len);
+		w->strings = realloc(w->strings, w->max_strings);
+		if (!w->strings) {
+			fprintf(stderr, "Out of memory.\n");
+			exit(1);
+		}
+	}
+
+	offset = w->strings_size;
+	memcpy(w->strings + offset, str, len);
+	w->strings_size += len;
+
+	return offset;
+}
+
+static struct archive_entry *add_entry(struct archive_writer *w, int type)
+{
+	struct archive_entry *e;
+
+	if (w->num_entries == w->max_entries) {
+		w->max_entries = w->max_entries ? 2 * w->max_entries : 256;
+		w->entries = realloc(w->entries,
+				     w->max_entries * sizeof(*w->entries));
+		if (!w->entries) {
+			fprintf(stderr, "Out of memory.\n");
+			exit(1);
+		}
+	}
+
+	e = memset(&w->entries[w->num_entries++], 0, sizeof(*e));
+	e->type = type;
+
+	return e;
+}
+
+static int write_data(struct archive_writer *w, const void *data, size_t len)
+{
+	static const char zero[8];
+	size_t pad = -len & 7; /* keep every blob 8 byte aligned */
+
+	if (fwrite(data, 1, len, w->file) != len ||
+	    fwrite(zero, 1, pad, w->file) != pad)
+		return -errno;
+
+	w->offset += len + pad;
+	return 0;
+}
+
+static void add_register(struct archive_writer *w, const char *engine,
+			 char *line)
+{
+	struct archive_entry *e;
+	char *sep, *name, *value;
+
+	sep = strstr(line, ": ");
+	if (!sep)
+		return;
+	*sep = '\0';
+
+	name = trim(line);
+	value = trim(sep + 2);
+	if (!*name || !*value || strlen(name) > 64)
+		return;
+
+	e = add_entry(w, ENTRY_REGISTER);
+	e->engine = add_string(w, engine);
+	e->name = add_string(w, name);
+	e->value = add_string(w, value);
+}
+
+static int pack(FILE *in, const char *path)
+{
+	struct archive_writer w = {};
+	struct archive_header hdr = {};
+	struct archive_entry *e;
+	char engine[64] = "", buf_engine[64] = "", buf_name[64] = "";
+	uint64_t gtt_offset = 0;
+	uint32_t *data = NULL;
+	char *line = NULL, *text = NULL;
+	size_t line_size = 0, text_len = 0;
+	unsigned int num_buffers = 0;
+	FILE *text_file;
+	int ret = 0;
+
+	w.file = fopen(path, "w");
+	if (!w.file)
+		return -errno;
+
+	text_file = open_memstream(&text, &text_len);
+	if (!text_file) {
+		fclose(w.file);
+		return -errno;
+	}
+
+	/* The string table starts with "", so that 0 means no string */
+	w.max_strings = 4096;
+	w.strings = calloc(1, w.max_strings);
+	w.strings_size = 1;
+	if (!w.strings) {
+		fclose(text_file);
+		fclose(w.file);
+		return -ENOMEM;
+	}
+
+	/* The header is rewritten once the table of contents is known */
+	ret = write_data(&w, &hdr, sizeof(hdr));
+
+	/* The remaining text is entry 0, filled in at the end */
+	add_entry(&w, ENTRY_TEXT);
+
+	while (!ret && getline(&line, &line_size, in) > 0) {
+		char *dashes;
+
+		if (line[0] == ':' || line[0] == '~') {
+			int count = ascii85_decode(line + 1, &data,
+						   line[0] == ':');
+			if (count == 0) {
+				fprintf(stderr,
+					"ASCII85 decode failed (%s - %s).\n",
+					buf_engine, buf_name);
+				continue;
+			}
+
+			e = add_entry(&w, ENTRY_BUFFER);
+			e->engine = add_string(&w, buf_engine);
+			e->name = add_string(&w, buf_name);
+			e->gtt_offset = gtt_offset;
+			e->offset = w.offset;
+			e->size = 4ull * count;
+
+			ret = write_data(&w, data, e->size);
+			num_buffers++;
+			continue;
+		}
+
+		fputs(line, text_file);
+
+		dashes = strstr(line, " --- ");
+		if (dashes) {
+			uint32_t hi, lo;
+			char *eq;
+			int matched;
+
+			*dashes = '\0';
+			snprintf(buf_engine, sizeof(buf_engine), "%s",
+				 trim(line));
+
+			dashes += 5;
+			eq = strchr(dashes, '=');
+			gtt_offset = 0;
+			if (eq) {
+				matched = sscanf(eq, "= 0x%08x %08x", &hi, &lo);
+				if (matched > 0)
+					gtt_offset = hi;
+				if (matched == 2)
+					gtt_offset = gtt_offset << 32 | lo;
+				*eq = '\0';
+			}
+			snprintf(buf_name, sizeof(buf_name), "%s",
+				 trim(dashes));
+			continue;
+		}
+
+		if (!isspace(line[0])) {
+			const char *suffix = " command stream:";
+			char *s = trim(line);
+			size_t len = strlen(s), slen = strlen(suffix);
+
+			if (len > slen && !strcmp(s + len - slen, suffix)) {
+				s[len - slen] = '\0';
+				snprintf(engine, sizeof(engine), "%s", s);
+				continue;
+			}
+
+			/* Anything else at the top level ends the engine */
+			engine[0] = '\0';
+		}
+
+		add_register(&w, engine, line);
+	}
+
+	if (!ret) {
+		fclose(text_file);
+		text_file = NULL;
+
+		e = &w.entries[0];
+		e->name = add_string(&w, "error state");
+		e->offset = w.offset;
+		e->size = text_len;
+		ret = write_data(&w, text, text_len);
+	}
+
+	if (!ret) {
+		memcpy(hdr.magic, ARCHIVE_MAGIC, sizeof(hdr.magic));
+		hdr.version = ARCHIVE_VERSION;
+		hdr.num_entries = w.num_entries;
+		hdr.toc = w.offset;
+		ret = write_data(&w, w.entries,
+				 w.num_entries * sizeof(*w.entries));
+	}
+
+	if (!ret) {
+		hdr.strings = w.offset;
+		hdr.strings_size = w.strings_size;
+		ret = write_data(&w, w.strings, w.strings_size);
+	}
+
+	if (!ret) {
+		rewind(w.file);
+		if (fwrite(&hdr, sizeof(hdr), 1, w.file) != 1)
+			ret = -errno;
+	}
+
+	if (fclose(w.file) && !ret)
+		ret = -errno;
+	if (text_file)
+		fclose(text_file);
+
+	if (!ret)
+		printf("%u buffers and %u registers packed into %s\n",
+		       num_buffers, w.num_entries - num_buffers - 1, path);
+
+	free(w.entries);
+	free(w.strings);
+	free(text);
+	free(line);
+	free(data);
+
+	return ret;
+}
+
+static int archive_open(struct archive *a, const char *path)
+{
+	const struct archive_header *hdr;
+	struct stat st;
+	int fd;
+
+	memset(a, 0, sizeof(*a));
+	a->path = path;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) || st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	a->size = st.st_size;
+	a->map = mmap(NULL, a->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (a->map == MAP_FAILED)
+		return -errno;
+
+	hdr = a->hdr = a->map;
+	if (memcmp(hdr->magic, ARCHIVE_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != ARCHIVE_VERSION ||
+	    hdr->toc > a->size ||
+	    hdr->num_entries > (a->size - hdr->toc) / sizeof(*a->entries) ||
+	    hdr->strings > a->size ||
+	    hdr->strings_size == 0 ||
+	    hdr->strings_size > a->size - hdr->strings) {
+		munmap(a->map, a->size);
+		return -EINVAL;
+	}
+
+	a->entries = (const void *)((const char *)a->map + hdr->toc);
+	a->strings = (const char *)a->map + hdr->strings;
+	if (a->strings[hdr->strings_size - 1]) {
+		munmap(a->map, a->size);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void archive_close(struct archive *a)
+{
+	munmap(a->map, a->size);
+}
+
+static const char *archive_string(const struct archive *a, uint32_t offset)
+{
+	return offset < a->hdr->strings_size ? a->strings + offset : "";
+}
+
+static const void *
+archive_data(const struct archive *a, const struct archive_entry *e)
+{
+	if (e->offset > a->size || e->size > a->size - e->offset)
+		return NULL;
+
+	return (const char *)a->map + e->offset;
+}
+
+static int list(const char *path)
+{
+	struct archive a;
+	int ret;
+
+	ret = archive_open(&a, path);
+	if (ret)
+		return ret;
+
+	for (unsigned int i = 0; i < a.hdr->num_entries; i++) {
+		const struct archive_entry *e = &a.entries[i];
+		const char *engine = archive_string(&a, e->engine);
+
+		switch (e->type) {
+		case ENTRY_TEXT:
+			printf("%5u text     %-8s %s, %"PRIu64" bytes\n",
+			       i, "-", archive_string(&a, e->name), e->size);
+			break;
+		case ENTRY_BUFFER:
+			printf("%5u buffer   %-8s %s at 0x%08x_%08x, %"PRIu64" bytes\n",
+			       i, *engine ? engine : "-",
+			       archive_string(&a, e->name),
+			       (unsigned)(e->gtt_offset >> 32),
+			       (unsigned)(e->gtt_offset & 0xffffffff),
+			       e->size);
+			break;
+		case ENTRY_REGISTER:
+			printf("%5u register %-8s %s: %s\n",
+			       i, *engine ? engine : "-",
+			       archive_string(&a, e->name),
+			       archive_string(&a, e->value));
+			break;
+		}
+	}
+
+	archive_close(&a);
+	return 0;
+}
+
+static int dump(const char *path, const char *index)
+{
+	const struct archive_entry *e;
+	struct archive a;
+	const void *data;
+	char *end;
+	unsigned long i;
+	int ret;
+
+	ret = archive_open(&a, path);
+	if (ret)
+		return ret;
+
+	i = strtoul(index, &end, 0);
+	if (*end || i >= a.hdr->num_entries) {
+		fprintf(stderr, "No entry %s in %s\n", index, path);
+		archive_close(&a);
+		return -ENOENT;
+	}
+
+	e = &a.entries[i];
+	if (e->type == ENTRY_REGISTER) {
+		printf("%s\n", archive_string(&a, e->value));
+	} else {
+		data = archive_data(&a, e);
+		if (!data)
+			ret = -EINVAL;
+		else if (fwrite(data, 1, e->size, stdout) != e->size)
+			ret = -errno;
+	}
+
+	archive_close(&a);
+	return ret;
+}
+
+static int query(const char *path, const char *reg, const char *engine)
+{
+	struct archive a;
+	int ret;
+
+	ret = archive_open(&a, path);
+	if (ret)
+		return ret;
+
+	for (unsigned int i = 0; i < a.hdr->num_entries; i++) {
+		const struct archive_entry *e = &a.entries[i];
+		const char *e_engine;
+
+		if (e->type != ENTRY_REGISTER)
+			continue;
+
+		if (strcasecmp(archive_string(&a, e->name), reg))
+			continue;
+
+		e_engine = archive_string(&a, e->engine);
+		if (engine && strcmp(e_engine, engine))
+			continue;
+
+		printf("%s: %s%s%s\n", path,
+		       e_engine, *e_engine ? ": " : "",
+		       archive_string(&a, e->value));
+	}
+
+	archive_close(&a);
+	return 0;
+}
+
+static void usage(const char *appname)
+{
+	printf("intel_error_archive - Convert i915 error states into indexed archives\n"
+	       "\n"
+	       "Usage:\n"
+	       "\t%s pack <error-state> <archive>\n"
+	       "\t%s list <archive>\n"
+	       "\t%s dump <archive> <entry>\n"
+	       "\t%s query [-e <engine>] <register> <archive>...\n"
+	       "\n"
+	       "\tpack reads the error state from stdin if <error-state> is -.\n"
+	       "\tdump writes the raw contents of an entry, as numbered by list.\n"
+	       "\tquery prints <register> from every archive, only for <engine>\n"
+	       "\tif given.\n",
+	       appname, appname, appname, appname);
+}
+
+int main(int argc, char **argv)
+{
+	const char *cmd = argc > 1 ? argv[1] : "";
+	int ret = 0;
+
+	if (!strcmp(cmd, "pack") && argc == 4) {
+		FILE *in = stdin;
+
+		if (strcmp(argv[2], "-")) {
+			in = fopen(argv[2], "r");
+			if (!in) {
+				fprintf(stderr, "Failed to open %s: %s\n",
+					argv[2], strerror(errno));
+				return 1;
+			}
+		}
+
+		ret = pack(in, argv[3]);
+		if (ret)
+			fprintf(stderr, "Failed to write %s: %s\n",
+				argv[3], strerror(-ret));
+
+		if (in != stdin)
+			fclose(in);
+	} else if (!strcmp(cmd, "list") && argc == 3) {
+		ret = list(argv[2]);
+		if (ret)
+			fprintf(stderr, "Failed to read %s: %s\n",
+				argv[2], strerror(-ret));
+	} else if (!strcmp(cmd, "dump") && argc == 4) {
+		ret = dump(argv[2], argv[3]);
+		if (ret && ret != -ENOENT)
+			fprintf(stderr, "Failed to read %s: %s\n",
+				argv[2], strerror(-ret));
+	} else if (!strcmp(cmd, "query") && argc > 3) {
+		const char *engine = NULL;
+		int i = 2;
+
+		if (!strcmp(argv[i], "-e") && argc > 5) {
+			engine = argv[i + 1];
+			i += 2;
+		}
+
+		for (const char *reg = argv[i++]; i < argc; i++) {
+			int err = query(argv[i], reg, engine);
+
+			if (err) {
+				fprintf(stderr, "Failed to read %s: %s\n",
+					argv[i], strerror(-err));
+				ret = err;
+			}
+		}
+	} else {
+		usage(argv[0]);
+		return 1;
+	}
+
+	return ret ? 1 : 0;
+}
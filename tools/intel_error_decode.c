@@ -52,6 +52,7 @@
 #include <intel_bufmgr.h>
 #include <zlib.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "intel_chipset.h"
 #include "intel_io.h"
@@ -59,10 +60,16 @@
 #include "intel_reg.h"
 #include "drmtest.h"
 
+/*
+ * Where the decoded text goes: stdout, or with -j the in-memory stream of
+ * whichever part of the dump the current thread is decoding.
+ */
+static __thread FILE *out;
+
 static uint32_t
 print_head(unsigned int reg)
 {
-	printf("    head = 0x%08x, wraps = %d\n", reg & (0x7ffff<<2), reg >> 21);
+	fprintf(out, "    head = 0x%08x, wraps = %d\n", reg & (0x7ffff<<2), reg >> 21);
 	return reg & (0x7ffff<<2);
 }
 
@@ -73,7 +80,7 @@ print_ctl(unsigned int reg)
 
 #define BIT_STR(reg, x, on, off) ((1 << (x)) & reg) ? on : off
 
-	printf("    len=%d%s%s%s\n", ring_length,
+	fprintf(out, "    len=%d%s%s%s\n", ring_length,
 	       BIT_STR(reg, 0, ", enabled", ", disabled"),
 	       BIT_STR(reg, 10, ", semaphore wait ", ""),
 	       BIT_STR(reg, 11, ", rb wait ", "")
@@ -86,9 +93,9 @@ static void
 print_acthd(unsigned int reg, unsigned int ring_length)
 {
 	if ((reg & (0x7ffff << 2)) < ring_length)
-		printf("    at ring: 0x%08x\n", reg & (0x7ffff << 2));
+		fprintf(out, "    at ring: 0x%08x\n", reg & (0x7ffff << 2));
 	else
-		printf("    at batch: 0x%08x\n", reg);
+		fprintf(out, "    at batch: 0x%08x\n", reg);
 }
 
 static void
@@ -115,7 +122,7 @@ print_instdone(uint32_t devid, unsigned int instdone, unsigned int instdone1)
 		}
 
 		if (busy)
-			printf("    busy: %s\n", instdone_bits[i].name);
+			fprintf(out, "    busy: %s\n", instdone_bits[i].name);
 	}
 }
 
@@ -141,7 +148,7 @@ print_i830_pgtbl_err(unsigned int reg)
 	}
 
 	if (str)
-		printf("    source = %s\n", str);
+		fprintf(out, "    source = %s\n", str);
 
 	switch(reg & 0x7) {
 	case 0x0: str  = "Invalid GTT"; break;
@@ -153,85 +160,85 @@ print_i830_pgtbl_err(unsigned int reg)
 	case 0x6: str = "Invalid Tiling"; break;
 	case 0x7: str = "Host to CAM"; break;
 	}
-	printf("    error = %s\n", str);
+	fprintf(out, "    error = %s\n", str);
 }
 
 static void
 print_i915_pgtbl_err(unsigned int reg)
 {
 	if (reg & (1 << 29))
-		printf("    Cursor A: Invalid GTT PTE\n");
+		fprintf(out, "    Cursor A: Invalid GTT PTE\n");
 	if (reg & (1 << 28))
-		printf("    Cursor B: Invalid GTT PTE\n");
+		fprintf(out, "    Cursor B: Invalid GTT PTE\n");
 	if (reg & (1 << 27))
-		printf("    MT: Invalid tiling\n");
+		fprintf(out, "    MT: Invalid tiling\n");
 	if (reg & (1 << 26))
-		printf("    MT: Invalid GTT PTE\n");
+		fprintf(out, "    MT: Invalid GTT PTE\n");
 	if (reg & (1 << 25))
-		printf("    LC: Invalid tiling\n");
+		fprintf(out, "    LC: Invalid tiling\n");
 	if (reg & (1 << 24))
-		printf("    LC: Invalid GTT PTE\n");
+		fprintf(out, "    LC: Invalid GTT PTE\n");
 	if (reg & (1 << 23))
-		printf("    BIN VertexData: Invalid GTT PTE\n");
+		fprintf(out, "    BIN VertexData: Invalid GTT PTE\n");
 	if (reg & (1 << 22))
-		printf("    BIN Instruction: Invalid GTT PTE\n");
+		fprintf(out, "    BIN Instruction: Invalid GTT PTE\n");
 	if (reg & (1 << 21))
-		printf("    CS VertexData: Invalid GTT PTE\n");
+		fprintf(out, "    CS VertexData: Invalid GTT PTE\n");
 	if (reg & (1 << 20))
-		printf("    CS Instruction: Invalid GTT PTE\n");
+		fprintf(out, "    CS Instruction: Invalid GTT PTE\n");
 	if (reg & (1 << 19))
-		printf("    CS: Invalid GTT\n");
+		fprintf(out, "    CS: Invalid GTT\n");
 	if (reg & (1 << 18))
-		printf("    Overlay: Invalid tiling\n");
+		fprintf(out, "    Overlay: Invalid tiling\n");
 	if (reg & (1 << 16))
-		printf("    Overlay: Invalid GTT PTE\n");
+		fprintf(out, "    Overlay: Invalid GTT PTE\n");
 	if (reg & (1 << 14))
-		printf("    Display C: Invalid tiling\n");
+		fprintf(out, "    Display C: Invalid tiling\n");
 	if (reg & (1 << 12))
-		printf("    Display C: Invalid GTT PTE\n");
+		fprintf(out, "    Display C: Invalid GTT PTE\n");
 	if (reg & (1 << 10))
-		printf("    Display B: Invalid tiling\n");
+		fprintf(out, "    Display B: Invalid tiling\n");
 	if (reg & (1 << 8))
-		printf("    Display B: Invalid GTT PTE\n");
+		fprintf(out, "    Display B: Invalid GTT PTE\n");
 	if (reg & (1 << 6))
-		printf("    Display A: Invalid tiling\n");
+		fprintf(out, "    Display A: Invalid tiling\n");
 	if (reg & (1 << 4))
-		printf("    Display A: Invalid GTT PTE\n");
+		fprintf(out, "    Display A: Invalid GTT PTE\n");
 	if (reg & (1 << 1))
-		printf("    Host Invalid PTE data\n");
+		fprintf(out, "    Host Invalid PTE data\n");
 	if (reg & (1 << 0))
-		printf("    Host Invalid GTT PTE\n");
+		fprintf(out, "    Host Invalid GTT PTE\n");
 }
 
 static void
 print_i965_pgtbl_err(unsigned int reg)
 {
 	if (reg & (1 << 26))
-		printf("    Invalid Sampler Cache GTT entry\n");
+		fprintf(out, "    Invalid Sampler Cache GTT entry\n");
 	if (reg & (1 << 24))
-		printf("    Invalid Render Cache GTT entry\n");
+		fprintf(out, "    Invalid Render Cache GTT entry\n");
 	if (reg & (1 << 23))
-		printf("    Invalid Instruction/State Cache GTT entry\n");
+		fprintf(out, "    Invalid Instruction/State Cache GTT entry\n");
 	if (reg & (1 << 22))
-		printf("    There is no ROC, this cannot occur!\n");
+		fprintf(out, "    There is no ROC, this cannot occur!\n");
 	if (reg & (1 << 21))
-		printf("    Invalid GTT entry during Vertex Fetch\n");
+		fprintf(out, "    Invalid GTT entry during Vertex Fetch\n");
 	if (reg & (1 << 20))
-		printf("    Invalid GTT entry during Command Fetch\n");
+		fprintf(out, "    Invalid GTT entry during Command Fetch\n");
 	if (reg & (1 << 19))
-		printf("    Invalid GTT entry during CS\n");
+		fprintf(out, "    Invalid GTT entry during CS\n");
 	if (reg & (1 << 18))
-		printf("    Invalid GTT entry during Cursor Fetch\n");
+		fprintf(out, "    Invalid GTT entry during Cursor Fetch\n");
 	if (reg & (1 << 17))
-		printf("    Invalid GTT entry during Overlay Fetch\n");
+		fprintf(out, "    Invalid GTT entry during Overlay Fetch\n");
 	if (reg & (1 << 8))
-		printf("    Invalid GTT entry during Display B Fetch\n");
+		fprintf(out, "    Invalid GTT entry during Display B Fetch\n");
 	if (reg & (1 << 4))
-		printf("    Invalid GTT entry during Display A Fetch\n");
+		fprintf(out, "    Invalid GTT entry during Display A Fetch\n");
 	if (reg & (1 << 1))
-		printf("    Valid PTE references illegal memory\n");
+		fprintf(out, "    Valid PTE references illegal memory\n");
 	if (reg & (1 << 0))
-		printf("    Invalid GTT entry during fetch for host\n");
+		fprintf(out, "    Invalid GTT entry during fetch for host\n");
 }
 
 static void
@@ -249,45 +256,45 @@ print_pgtbl_err(unsigned int reg, unsigned int devid)
 static void print_ivb_error(unsigned int reg, unsigned int devid)
 {
 	if (reg & (1 << 0))
-		printf("    TLB page fault error (GTT entry not valid)\n");
+		fprintf(out, "    TLB page fault error (GTT entry not valid)\n");
 	if (reg & (1 << 1))
-		printf("    Invalid physical address in RSTRM interface (PAVP)\n");
+		fprintf(out, "    Invalid physical address in RSTRM interface (PAVP)\n");
 	if (reg & (1 << 2))
-		printf("    Invalid page directory entry error\n");
+		fprintf(out, "    Invalid page directory entry error\n");
 	if (reg & (1 << 3))
-		printf("    Invalid physical address in ROSTRM interface (PAVP)\n");
+		fprintf(out, "    Invalid physical address in ROSTRM interface (PAVP)\n");
 	if (reg & (1 << 4))
-		printf("    TLB page VTD translation generated an error\n");
+		fprintf(out, "    TLB page VTD translation generated an error\n");
 	if (reg & (1 << 5))
-		printf("    Invalid physical address in WRITE interface (PAVP)\n");
+		fprintf(out, "    Invalid physical address in WRITE interface (PAVP)\n");
 	if (reg & (1 << 6))
-		printf("    Page directory VTD translation generated error\n");
+		fprintf(out, "    Page directory VTD translation generated error\n");
 	if (reg & (1 << 8))
-		printf("    Cacheline containing a PD was marked as invalid\n");
+		fprintf(out, "    Cacheline containing a PD was marked as invalid\n");
 	if (IS_HASWELL(devid) && (reg >> 10) & 0x1f)
-		printf("    %d pending page faults\n", (reg >> 10) & 0x1f);
+		fprintf(out, "    %d pending page faults\n", (reg >> 10) & 0x1f);
 }
 
 static void print_snb_error(unsigned int reg)
 {
 	if (reg & (1 << 0))
-		printf("    TLB page fault error (GTT entry not valid)\n");
+		fprintf(out, "    TLB page fault error (GTT entry not valid)\n");
 	if (reg & (1 << 1))
-		printf("    Context page GTT translation generated a fault (GTT entry not valid)\n");
+		fprintf(out, "    Context page GTT translation generated a fault (GTT entry not valid)\n");
 	if (reg & (1 << 2))
-		printf("    Invalid page directory entry error\n");
+		fprintf(out, "    Invalid page directory entry error\n");
 	if (reg & (1 << 3))
-		printf("    HWS page GTT translation generated a page fault (GTT entry not valid)\n");
+		fprintf(out, "    HWS page GTT translation generated a page fault (GTT entry not valid)\n");
 	if (reg & (1 << 4))
-		printf("    TLB page VTD translation generated an error\n");
+		fprintf(out, "    TLB page VTD translation generated an error\n");
 	if (reg & (1 << 5))
-		printf("    Context page VTD translation generated an error\n");
+		fprintf(out, "    Context page VTD translation generated an error\n");
 	if (reg & (1 << 6))
-		printf("    Page directory VTD translation generated error\n");
+		fprintf(out, "    Page directory VTD translation generated error\n");
 	if (reg & (1 << 7))
-		printf("    HWS page VTD translation generated an error\n");
+		fprintf(out, "    HWS page VTD translation generated an error\n");
 	if (reg & (1 << 8))
-		printf("    Cacheline containing a PD was marked as invalid\n");
+		fprintf(out, "    Cacheline containing a PD was marked as invalid\n");
 }
 
 static void print_bdw_error(unsigned int reg, unsigned int devid)
@@ -295,17 +302,17 @@ static void print_bdw_error(unsigned int reg, unsigned int devid)
 	print_ivb_error(reg, devid);
 
 	if (reg & (1 << 10))
-		printf("    Non WB memory type for Advanced Context\n");
+		fprintf(out, "    Non WB memory type for Advanced Context\n");
 	if (reg & (1 << 11))
-		printf("    PASID not enabled\n");
+		fprintf(out, "    PASID not enabled\n");
 	if (reg & (1 << 12))
-		printf("    PASID boundary violation\n");
+		fprintf(out, "    PASID boundary violation\n");
 	if (reg & (1 << 13))
-		printf("    PASID not valid\n");
+		fprintf(out, "    PASID not valid\n");
 	if (reg & (1 << 14))
-		printf("    PASID was zero for untranslated request\n");
+		fprintf(out, "    PASID was zero for untranslated request\n");
 	if (reg & (1 << 15))
-		printf("    Context was not marked as present when doing DMA\n");
+		fprintf(out, "    Context was not marked as present when doing DMA\n");
 }
 
 static void
@@ -321,7 +328,7 @@ print_error(unsigned int reg, unsigned int devid)
 static void
 print_snb_fence(unsigned int devid, uint64_t fence)
 {
-	printf("    %svalid, %c-tiled, pitch: %i, start: 0x%08x, size: %u\n",
+	fprintf(out, "    %svalid, %c-tiled, pitch: %i, start: 0x%08x, size: %u\n",
 			fence & 1 ? "" : "in",
 			fence & (1<<1) ? 'y' : 'x',
 			(int)(((fence>>32)&0xfff)+1)*128,
@@ -332,7 +339,7 @@ print_snb_fence(unsigned int devid, uint64_t fence)
 static void
 print_i965_fence(unsigned int devid, uint64_t fence)
 {
-	printf("    %svalid, %c-tiled, pitch: %i, start: 0x%08x, size: %u\n",
+	fprintf(out, "    %svalid, %c-tiled, pitch: %i, start: 0x%08x, size: %u\n",
 			fence & 1 ? "" : "in",
 			fence & (1<<1) ? 'y' : 'x',
 			(int)(((fence>>2)&0x1ff)+1)*128,
@@ -349,7 +356,7 @@ print_i915_fence(unsigned int devid, uint64_t fence)
 	else
 		tile_width = 512;
 
-	printf("    %svalid, %c-tiled, pitch: %i, start: 0x%08x, size: %i\n",
+	fprintf(out, "    %svalid, %c-tiled, pitch: %i, start: 0x%08x, size: %i\n",
 			fence & 1 ? "" : "in",
 			fence & (1<<12) ? 'y' : 'x',
 			(1<<((fence>>4)&0xf))*tile_width,
@@ -360,7 +367,7 @@ print_i915_fence(unsigned int devid, uint64_t fence)
 static void
 print_i830_fence(unsigned int devid, uint64_t fence)
 {
-	printf("    %svalid, %c-tiled, pitch: %i, start: 0x%08x, size: %i\n",
+	fprintf(out, "    %svalid, %c-tiled, pitch: %i, start: 0x%08x, size: %i\n",
 			fence & 1 ? "" : "in",
 			fence & (1<<12) ? 'y' : 'x',
 			(1<<((fence>>4)&0xf))*128,
@@ -402,22 +409,22 @@ print_fault_reg(unsigned devid, uint32_t reg)
 		return;
 
 	if (reg & (1 << 0))
-		printf("    Valid\n");
+		fprintf(out, "    Valid\n");
 	else
 		return;
 
 	if (intel_gen(devid) < 8)
-		printf("    %s Fault (%s)\n", gen7_types[reg >> 1 & 0x3],
+		fprintf(out, "    %s Fault (%s)\n", gen7_types[reg >> 1 & 0x3],
 		       reg & (1 << 11) ? "GGTT" : "PPGTT");
 	else
-		printf("    Invalid %s Fault\n", gen8_types[reg >> 1 & 0x3]);
+		fprintf(out, "    Invalid %s Fault\n", gen8_types[reg >> 1 & 0x3]);
 
 	if (intel_gen(devid) < 8)
-		printf("    Address 0x%08x\n", reg & ~((1 << 12)-1));
+		fprintf(out, "    Address 0x%08x\n", reg & ~((1 << 12)-1));
 	else
-		printf("    Engine %s\n", engine[reg >> 12 & 0x7]);
+		fprintf(out, "    Engine %s\n", engine[reg >> 12 & 0x7]);
 
-	printf("    Source ID %d\n", reg >> 3 & 0xff);
+	fprintf(out, "    Source ID %d\n", reg >> 3 & 0xff);
 }
 
 static void
@@ -429,7 +436,7 @@ print_fault_data(unsigned devid, uint32_t data1, uint32_t data0)
 		return;
 
 	address = ((uint64_t)(data0) << 12) | ((uint64_t)data1 & 0xf) << 44;
-	printf("    Address 0x%016" PRIx64 " %s\n", address,
+	fprintf(out, "    Address 0x%016" PRIx64 " %s\n", address,
 	       data1 & (1 << 4) ? "GGTT" : "PPGTT");
 }
 
@@ -456,24 +463,25 @@ static void decode(struct drm_intel_decode *ctx,
 	if (!*count)
 		return;
 
-	printf("%s (%s) at 0x%08x_%08x", buffer_name, ring_name,
+	fprintf(out, "%s (%s) at 0x%08x_%08x", buffer_name, ring_name,
 	       (unsigned)(gtt_offset >> 32),
 	       (unsigned)(gtt_offset & 0xffffffff));
 	if (head_offset != -1)
-		printf("; HEAD points to: 0x%08x_%08x",
+		fprintf(out, "; HEAD points to: 0x%08x_%08x",
 		       (unsigned)((head_offset + gtt_offset) >> 32),
 		       (unsigned)((head_offset + gtt_offset) & 0xffffffff));
-	printf("\n");
+	fprintf(out, "\n");
 
 	if (decode) {
+		drm_intel_decode_set_output_file(ctx, out);
 		drm_intel_decode_set_batch_pointer(ctx, data, gtt_offset,
 						   *count);
 		drm_intel_decode(ctx);
 	} else if (maybe_ascii(data, 16)) {
-		printf("%*s\n", 4 * *count, (char *)data);
+		fprintf(out, "%.*s\n", 4 * *count, (char *)data);
 	} else {
 		for (int i = 0; i + 4 <= *count; i += 4)
-			printf("[%04x] %08x %08x %08x %08x\n",
+			fprintf(out, "[%04x] %08x %08x %08x %08x\n",
 			       4*i, data[i], data[i+1], data[i+2], data[i+3]);
 	}
 	*count = 0;
@@ -482,7 +490,7 @@ static void decode(struct drm_intel_decode *ctx,
 static int zlib_inflate(uint32_t **ptr, int len)
 {
 	struct z_stream_s zstream;
-	void *out;
+	void *buf;
 
 	memset(&zstream, 0, sizeof(zstream));
 
@@ -492,8 +500,8 @@ static int zlib_inflate(uint32_t **ptr, int len)
 	if (inflateInit(&zstream) != Z_OK)
 		return 0;
 
-	out = malloc(128*4096); /* approximate obj size */
-	zstream.next_out = out;
+	buf = malloc(128*4096); /* approximate obj size */
+	zstream.next_out = buf;
 	zstream.avail_out = 128*4096;
 
 	do {
@@ -510,28 +518,28 @@ static int zlib_inflate(uint32_t **ptr, int len)
 		if (zstream.avail_out)
 			break;
 
-		out = realloc(out, 2*zstream.total_out);
-		if (out == NULL) {
+		buf = realloc(buf, 2*zstream.total_out);
+		if (buf == NULL) {
 			inflateEnd(&zstream);
 			return 0;
 		}
 
-		zstream.next_out = (unsigned char *)out + zstream.total_out;
+		zstream.next_out = (unsigned char *)buf + zstream.total_out;
 		zstream.avail_out = zstream.total_out;
 	} while (1);
 end:
 	inflateEnd(&zstream);
 	free(*ptr);
-	*ptr = out;
+	*ptr = buf;
 	return zstream.total_out / 4;
 }
 
-static int ascii85_decode(const char *in, uint32_t **out, bool inflate)
+static int ascii85_decode(const char *in, uint32_t **data, bool inflate)
 {
 	int len = 0, size = 1024;
 
-	*out = realloc(*out, sizeof(uint32_t)*size);
-	if (*out == NULL)
+	*data = realloc(*data, sizeof(uint32_t)*size);
+	if (*data == NULL)
 		return 0;
 
 	while (*in >= '!' && *in <= 'z') {
@@ -539,8 +547,8 @@ static int ascii85_decode(const char *in, uint32_t **out, bool inflate)
 
 		if (len == size) {
 			size *= 2;
-			*out = realloc(*out, sizeof(uint32_t)*size);
-			if (*out == NULL)
+			*data = realloc(*data, sizeof(uint32_t)*size);
+			if (*data == NULL)
 				return 0;
 		}
 
@@ -554,13 +562,214 @@ static int ascii85_decode(const char *in, uint32_t **out, bool inflate)
 			v += in[4] - 33;
 			in += 5;
 		}
-		(*out)[len++] = v;
+		(*data)[len++] = v;
 	}
 
 	if (!inflate)
 		return len;
 
-	return zlib_inflate(out, len);
+	return zlib_inflate(data, len);
+}
+
+/*
+ * With -j, read_data_file() only indexes the dump: the text between the
+ * buffers is decoded as it is read, but each ascii85 buffer is queued as a
+ * job along with the state needed to decode it on its own. A pool of
+ * workers then inflates and decodes the buffers concurrently, each into
+ * its own memory stream and with its own decode context, while a writer
+ * thread prints the jobs back in their original order.
+ */
+struct decode_job {
+	struct decode_job *next;
+
+	char *prefix; /* text preceding this buffer in the dump */
+	size_t prefix_len;
+
+	char *line;
+	const char *buffer_name;
+	char *ring_name;
+	uint64_t gtt_offset;
+	uint32_t head_offset;
+	int do_decode;
+
+	bool has_ctx;
+	uint32_t devid;
+	bool has_acthd;
+	uint32_t acthd;
+
+	char *text;
+	size_t len;
+	bool done;
+};
+
+static struct decode_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	pthread_t *workers;
+	int num_workers;
+	pthread_t writer;
+
+	struct decode_job *head, **tail;
+	struct decode_job *pending; /* first job not yet taken by a worker */
+	int queued;
+	bool finished;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.tail = &pool.head,
+};
+
+static void decode_job(struct decode_job *job)
+{
+	struct drm_intel_decode *ctx = NULL;
+	uint32_t *data = NULL;
+	int count;
+
+	out = open_memstream(&job->text, &job->len);
+	if (!out) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+
+	count = ascii85_decode(job->line + 1, &data, job->line[0] == ':');
+	if (count == 0)
+		fprintf(stderr, "ASCII85 decode failed (%s - %s).\n",
+			job->ring_name, job->buffer_name);
+
+	if (job->has_ctx) {
+		ctx = drm_intel_decode_context_alloc(job->devid);
+		if (job->has_acthd)
+			drm_intel_decode_set_head_tail(ctx, job->acthd,
+						       0xffffffff);
+	}
+
+	decode(ctx,
+	       job->buffer_name, job->ring_name,
+	       job->gtt_offset, job->head_offset,
+	       data, &count, job->do_decode);
+
+	if (ctx)
+		drm_intel_decode_context_free(ctx);
+	fclose(out);
+
+	free(data);
+	free(job->line);
+	job->line = NULL;
+}
+
+static void *decode_worker(void *arg)
+{
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		struct decode_job *job = pool.pending;
+
+		if (!job) {
+			if (pool.finished)
+				break;
+			pthread_cond_wait(&pool.cond, &pool.lock);
+			continue;
+		}
+		pool.pending = job->next;
+		pthread_mutex_unlock(&pool.lock);
+
+		decode_job(job);
+
+		pthread_mutex_lock(&pool.lock);
+		job->done = true;
+		pthread_cond_broadcast(&pool.cond);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	return NULL;
+}
+
+static void *decode_writer(void *arg)
+{
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		struct decode_job *job = pool.head;
+
+		if (!job || !job->done) {
+			if (!job && pool.finished)
+				break;
+			pthread_cond_wait(&pool.cond, &pool.lock);
+			continue;
+		}
+		pool.head = job->next;
+		if (!pool.head)
+			pool.tail = &pool.head;
+		pthread_mutex_unlock(&pool.lock);
+
+		fwrite(job->prefix, 1, job->prefix_len, stdout);
+		fwrite(job->text, 1, job->len, stdout);
+		free(job->prefix);
+		free(job->text);
+		free(job->ring_name);
+		free(job);
+
+		pthread_mutex_lock(&pool.lock);
+		pool.queued--;
+		pthread_cond_broadcast(&pool.cond);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	fflush(stdout);
+	return NULL;
+}
+
+static void decode_pool_start(int num_workers)
+{
+	int err;
+
+	pool.workers = calloc(num_workers, sizeof(*pool.workers));
+	assert(pool.workers);
+
+	for (pool.num_workers = 0;
+	     pool.num_workers < num_workers;
+	     pool.num_workers++) {
+		err = pthread_create(&pool.workers[pool.num_workers], NULL,
+				     decode_worker, NULL);
+		if (err)
+			errx(1, "Failed to start decode thread: %s",
+			     strerror(err));
+	}
+
+	err = pthread_create(&pool.writer, NULL, decode_writer, NULL);
+	if (err)
+		errx(1, "Failed to start output thread: %s", strerror(err));
+}
+
+static void decode_pool_submit(struct decode_job *job)
+{
+	pthread_mutex_lock(&pool.lock);
+
+	/* Keep only a few buffers per worker in memory at any time */
+	while (pool.queued >= 4 * pool.num_workers)
+		pthread_cond_wait(&pool.cond, &pool.lock);
+
+	*pool.tail = job;
+	pool.tail = &job->next;
+	if (!pool.pending)
+		pool.pending = job;
+	pool.queued++;
+
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+static void decode_pool_finish(void)
+{
+	pthread_mutex_lock(&pool.lock);
+	pool.finished = true;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int i = 0; i < pool.num_workers; i++)
+		pthread_join(pool.workers[i], NULL);
+	pthread_join(pool.writer, NULL);
+
+	free(pool.workers);
 }
 
 static void
@@ -582,10 +791,59 @@ read_data_file(FILE *file)
 	const char *buffer_name = "batch buffer";
 	char *ring_name = NULL;
 	int do_decode = 1;
+	bool has_acthd = false;
+	uint32_t acthd = 0;
+	char *text = NULL;
+	size_t text_len = 0;
+
+	if (pool.num_workers) {
+		out = open_memstream(&text, &text_len);
+		if (!out) {
+			fprintf(stderr, "Out of memory.\n");
+			exit(1);
+		}
+	}
 
 	while (getline(&line, &line_size, file) > 0) {
 		char *dashes;
 
+		if ((line[0] == ':' || line[0] == '~') && pool.num_workers) {
+			struct decode_job *job;
+
+			job = calloc(1, sizeof(*job));
+			if (job == NULL) {
+				fprintf(stderr, "Out of memory.\n");
+				exit(1);
+			}
+
+			/* The job takes the line, getline() allocates afresh */
+			job->line = line;
+			line = NULL;
+			line_size = 0;
+
+			job->buffer_name = buffer_name;
+			job->ring_name = ring_name ? strdup(ring_name) : NULL;
+			job->gtt_offset = gtt_offset;
+			job->head_offset = head_offset;
+			job->do_decode = do_decode;
+			job->has_ctx = decode_ctx;
+			job->devid = devid;
+			job->has_acthd = has_acthd;
+			job->acthd = acthd;
+
+			fclose(out);
+			job->prefix = text;
+			job->prefix_len = text_len;
+			out = open_memstream(&text, &text_len);
+			if (!out) {
+				fprintf(stderr, "Out of memory.\n");
+				exit(1);
+			}
+
+			decode_pool_submit(job);
+			continue;
+		}
+
 		if (line[0] == ':' || line[0] == '~') {
 			count = ascii85_decode(line+1, &data, line[0] == ':');
 			if (count == 0)
@@ -674,7 +932,7 @@ read_data_file(FILE *file)
 			       gtt_offset, head_offset,
 			       data, &count, do_decode);
 
-			printf("%s", line);
+			fprintf(out, "%s", line);
 
 			matched = sscanf(line, "PCI ID: 0x%04x\n", &reg);
 			if (matched == 0)
@@ -686,10 +944,11 @@ read_data_file(FILE *file)
 			}
 			if (matched == 1) {
 				devid = reg;
-				printf("Detected GEN%i chipset\n",
+				fprintf(out, "Detected GEN%i chipset\n",
 						intel_gen(devid));
 
 				decode_ctx = drm_intel_decode_context_alloc(devid);
+				has_acthd = false;
 			}
 
 			matched = sscanf(line, "  CTL: 0x%08x\n", &reg);
@@ -705,6 +964,8 @@ read_data_file(FILE *file)
 			if (matched == 1) {
 				print_acthd(reg, ring_length);
 				drm_intel_decode_set_head_tail(decode_ctx, reg, 0xffffffff);
+				has_acthd = true;
+				acthd = reg;
 			}
 
 			matched = sscanf(line, "  PGTBL_ER: 0x%08x\n", &reg);
@@ -757,6 +1018,15 @@ read_data_file(FILE *file)
 	       gtt_offset, head_offset,
 	       data, &count, do_decode);
 
+	if (pool.num_workers) {
+		fclose(out);
+		out = stdout;
+
+		decode_pool_finish();
+		fwrite(text, 1, text_len, stdout);
+		free(text);
+	}
+
 	free(data);
 	free(line);
 	free(ring_name);
@@ -793,28 +1063,52 @@ main(int argc, char *argv[])
 	const char *path;
 	char *filename = NULL;
 	struct stat st;
-	int error;
+	int num_workers = 0;
+	bool usage = false;
+	int error, c;
+
+	while ((c = getopt(argc, argv, "j:")) != -1) {
+		switch (c) {
+		case 'j':
+			num_workers = atoi(optarg);
+			if (num_workers <= 0)
+				num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+			break;
+		default:
+			usage = true;
+			break;
+		}
+	}
 
-	if (argc > 2) {
+	if (usage || argc - optind > 1) {
 		fprintf(stderr,
 				"intel_gpu_decode: Parse an Intel GPU i915_error_state\n"
 				"Usage:\n"
-				"\t%s [<file>]\n"
+				"\t%s [-j <threads>] [<file>]\n"
 				"\n"
 				"With no arguments, debugfs-dri-directory is probed for in "
 				"/debug and \n"
 				"/sys/kernel/debug.  Otherwise, it may be "
 				"specified.  If a file is given,\n"
 				"it is parsed as an GPU dump in the format of "
-				"/debug/dri/0/i915_error_state.\n",
+				"/debug/dri/0/i915_error_state.\n"
+				"\n"
+				"With -j, the buffers are decoded by the given number of "
+				"threads at once,\n"
+				"or one per CPU if that is 0.\n",
 				argv[0]);
 		return 1;
 	}
 
+	out = stdout;
+
 	if (isatty(1))
 		setup_pager();
 
-	if (argc == 1) {
+	if (num_workers)
+		decode_pool_start(num_workers);
+
+	if (argc == optind) {
 		if (isatty(0)) {
 			path = "/sys/class/drm/card0/error";
 			error = stat(path, &st);
@@ -837,7 +1131,7 @@ main(int argc, char *argv[])
 			exit(0);
 		}
 	} else {
-		path = argv[1];
+		path = argv[optind];
 		error = stat(path, &st);
 		if (error != 0) {
 			fprintf(stderr, "Error opening %s: %s\n",
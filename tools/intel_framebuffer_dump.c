@@ -23,24 +23,241 @@
  */
 
 /*
- * Read back all the KMS framebuffers attached to the CRTC and record as PNG.
+ * Read back all the KMS framebuffers attached to the CRTC and record as PNG,
+ * or with -r as raw dumps.
+ *
+ * A raw dump is a struct fb_dump_header followed by the pixels of the first
+ * plane of the framebuffer. Where the blitter can do it the pixels are first
+ * detiled into a linear copy, which also spares reading the scanout through
+ * an uncached mapping. With -z the whole dump goes through zlib, at its
+ * fastest level, and can be read back with zcat.
  */
 
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <errno.h>
 #include <xf86drmMode.h>
 #include <i915_drm.h>
 #include <cairo.h>
+#include <zlib.h>
 
 #include "intel_io.h"
 #include "drmtest.h"
+#include "igt_fb.h"
+#include "intel_batchbuffer.h"
+#include "intel_chipset.h"
+#include "ioctl_wrappers.h"
+#include "i915/gem_mman.h"
+
+#ifndef DRM_IOCTL_MODE_GETFB2
+#define DRM_IOCTL_MODE_GETFB2 DRM_IOWR(0xCE, struct drm_mode_fb_cmd2)
+#endif
+
+#define FB_DUMP_MAGIC "IGTFBDMP"
+#define FB_DUMP_VERSION 1
+
+struct fb_dump_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;	/* DRM fourcc */
+	uint64_t modifier;	/* of the framebuffer */
+	uint64_t layout;	/* modifier of the pixels that follow */
+	uint32_t stride;	/* of the pixels that follow */
+	uint32_t size;		/* in bytes of the pixels that follow */
+};
+
+static void dump_png(int fd, drmModeFBPtr fb)
+{
+	struct drm_gem_open open_arg;
+	struct drm_gem_flink flink;
+
+	flink.handle = fb->handle;
+	if (drmIoctl(fd, DRM_IOCTL_GEM_FLINK, &flink))
+		return;
+
+	open_arg.name = flink.name;
+	if (drmIoctl(fd, DRM_IOCTL_GEM_OPEN, &open_arg) == 0) {
+		struct drm_i915_gem_mmap_gtt mmap_arg;
+		void *ptr;
+
+		mmap_arg.handle = open_arg.handle;
+		if (drmIoctl(fd, DRM_IOCTL_I915_GEM_MMAP_GTT, &mmap_arg) == 0 &&
+		    (ptr = mmap(0, open_arg.size, PROT_READ, MAP_SHARED, fd, mmap_arg.offset)) != (void *)-1) {
+			cairo_surface_t *surface;
+			cairo_format_t format;
+			char name[80];
+
+			snprintf(name, sizeof(name), "fb-%d.png",  fb->fb_id);
+
+			switch (fb->depth) {
+			case 16: format = CAIRO_FORMAT_RGB16_565; break;
+			case 24: format = CAIRO_FORMAT_RGB24; break;
+			case 30: format = CAIRO_FORMAT_RGB30; break;
+			case 32: format = CAIRO_FORMAT_ARGB32; break;
+			default: format = CAIRO_FORMAT_INVALID; break;
+			}
+
+			surface = cairo_image_surface_create_for_data(ptr, format,
+								      fb->width, fb->height, fb->pitch);
+			cairo_surface_write_to_png(surface, name);
+			cairo_surface_destroy(surface);
+
+			munmap(ptr, open_arg.size);
+		}
+		drmIoctl(fd, DRM_IOCTL_GEM_CLOSE, &open_arg.handle);
+	}
+}
+
+/*
+ * Copies the first plane of @f into a new linear, cacheable bo with the
+ * blitter, for the tilings XY_FAST_COPY_BLT handles.
+ */
+static uint32_t detile(int fd, const struct drm_mode_fb_cmd2 *f,
+		       uint32_t *stride)
+{
+	int bpp = igt_drm_format_to_bpp(f->pixel_format);
+	uint32_t handle;
+
+	if (intel_gen(intel_get_drm_devid(fd)) < 9)
+		return 0;
+
+	switch (f->modifier[0]) {
+	case LOCAL_DRM_FORMAT_MOD_NONE:
+	case LOCAL_I915_FORMAT_MOD_X_TILED:
+	case LOCAL_I915_FORMAT_MOD_Y_TILED:
+	case LOCAL_I915_FORMAT_MOD_Yf_TILED:
+		break;
+	default:
+		return 0;
+	}
+
+	*stride = ALIGN(f->width * bpp / 8, 128);
+	handle = gem_create(fd, (uint64_t)*stride * f->height);
+
+	igt_blitter_fast_copy__raw(fd,
+				   f->handles[0], f->offsets[0], f->pitches[0],
+				   igt_fb_mod_to_tiling(f->modifier[0]), 0, 0,
+				   f->width, f->height, bpp,
+				   handle, 0, *stride, I915_TILING_NONE,
+				   0, 0);
+
+	return handle;
+}
+
+static void dump_raw(int fd, uint32_t fb_id, bool compress)
+{
+	struct drm_mode_fb_cmd2 f = { .fb_id = fb_id };
+	struct fb_dump_header header = {
+		.magic = FB_DUMP_MAGIC,
+		.version = FB_DUMP_VERSION,
+	};
+	uint32_t handle, stride;
+	char name[80];
+	void *ptr;
+	gzFile gz;
+	FILE *out;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETFB2, &f) || !f.handles[0]) {
+		fprintf(stderr, "Failed to look up fb %u: %s\n",
+			fb_id, strerror(errno));
+		return;
+	}
+
+	if (!(f.flags & DRM_MODE_FB_MODIFIERS))
+		f.modifier[0] = LOCAL_DRM_FORMAT_MOD_NONE;
+
+	header.width = f.width;
+	header.height = f.height;
+	header.format = f.pixel_format;
+	header.modifier = f.modifier[0];
+
+	handle = detile(fd, &f, &stride);
+	if (handle) {
+		header.layout = LOCAL_DRM_FORMAT_MOD_NONE;
+		header.stride = stride;
+		header.size = stride * f.height;
+
+		gem_set_domain(fd, handle, I915_GEM_DOMAIN_CPU, 0);
+		ptr = gem_mmap__cpu(fd, handle, 0, header.size, PROT_READ);
+	} else {
+		/* As is, bar the fence detiling of the GTT mapping */
+		header.layout = f.modifier[0];
+		header.stride = f.pitches[0];
+		header.size = f.pitches[0] * f.height;
+
+		gem_set_domain(fd, f.handles[0], I915_GEM_DOMAIN_GTT, 0);
+		ptr = gem_mmap__gtt(fd, f.handles[0],
+				    f.offsets[0] + header.size, PROT_READ);
+		ptr = (char *)ptr + f.offsets[0];
+	}
+
+	snprintf(name, sizeof(name), "fb-%u.raw%s", fb_id,
+		 compress ? ".gz" : "");
+
+	if (compress) {
+		gz = gzopen(name, "wb1");
+		if (!gz ||
+		    gzwrite(gz, &header, sizeof(header)) != sizeof(header) ||
+		    gzwrite(gz, ptr, header.size) != header.size)
+			fprintf(stderr, "Failed to write %s\n", name);
+		if (gz)
+			gzclose(gz);
+	} else {
+		out = fopen(name, "wb");
+		if (!out ||
+		    fwrite(&header, sizeof(header), 1, out) != 1 ||
+		    fwrite(ptr, header.size, 1, out) != 1)
+			fprintf(stderr, "Failed to write %s: %s\n",
+				name, strerror(errno));
+		if (out)
+			fclose(out);
+	}
+
+	if (handle) {
+		munmap(ptr, header.size);
+		gem_close(fd, handle);
+	} else {
+		munmap((char *)ptr - f.offsets[0], f.offsets[0] + header.size);
+	}
+
+	/* The planes sharing a bo share its handle */
+	for (int i = 0; i < 4; i++) {
+		bool seen = false;
+
+		for (int j = 0; j < i; j++)
+			seen |= f.handles[j] == f.handles[i];
+
+		if (f.handles[i] && !seen)
+			gem_close(fd, f.handles[i]);
+	}
+}
 
 int main(int argc, char **argv)
 {
+	bool raw = false, compress = false;
 	drmModeResPtr res;
-	int fd, n;
+	int fd, n, opt;
+
+	while ((opt = getopt(argc, argv, "rz")) != -1) {
+		switch (opt) {
+		case 'r':
+			raw = true;
+			break;
+		case 'z':
+			raw = true;
+			compress = true;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-r] [-z]\n", argv[0]);
+			return EINVAL;
+		}
+	}
 
 	fd = drmOpen("i915", NULL);
 	if (fd < 0)
@@ -51,8 +268,6 @@ int main(int argc, char **argv)
 		return ENOMEM;
 
 	for (n = 0; n < res->count_crtcs; n++) {
-		struct drm_gem_open open_arg;
-		struct drm_gem_flink flink;
 		drmModeCrtcPtr crtc;
 		drmModeFBPtr fb;
 
@@ -60,48 +275,18 @@ int main(int argc, char **argv)
 		if (crtc == NULL)
 			continue;
 
+		if (raw && crtc->buffer_id) {
+			dump_raw(fd, crtc->buffer_id, compress);
+			drmModeFreeCrtc(crtc);
+			continue;
+		}
+
 		fb = drmModeGetFB(fd, crtc->buffer_id);
 		drmModeFreeCrtc(crtc);
 		if (fb == NULL)
 			continue;
 
-		flink.handle = fb->handle;
-		if (drmIoctl(fd, DRM_IOCTL_GEM_FLINK, &flink)) {
-			drmModeFreeFB(fb);
-			continue;
-		}
-
-		open_arg.name = flink.name;
-		if (drmIoctl(fd, DRM_IOCTL_GEM_OPEN, &open_arg) == 0) {
-			struct drm_i915_gem_mmap_gtt mmap_arg;
-			void *ptr;
-
-						mmap_arg.handle = open_arg.handle;
-			if (drmIoctl(fd, DRM_IOCTL_I915_GEM_MMAP_GTT, &mmap_arg) == 0 &&
-			    (ptr = mmap(0, open_arg.size, PROT_READ, MAP_SHARED, fd, mmap_arg.offset)) != (void *)-1) {
-				cairo_surface_t *surface;
-				cairo_format_t format;
-				char name[80];
-
-				snprintf(name, sizeof(name), "fb-%d.png",  fb->fb_id);
-
-				switch (fb->depth) {
-				case 16: format = CAIRO_FORMAT_RGB16_565; break;
-				case 24: format = CAIRO_FORMAT_RGB24; break;
-				case 30: format = CAIRO_FORMAT_RGB30; break;
-				case 32: format = CAIRO_FORMAT_ARGB32; break;
-				default: format = CAIRO_FORMAT_INVALID; break;
-				}
-
-				surface = cairo_image_surface_create_for_data(ptr, format,
-									      fb->width, fb->height, fb->pitch);
-				cairo_surface_write_to_png(surface, name);
-				cairo_surface_destroy(surface);
-
-				munmap(ptr, open_arg.size);
-			}
-			drmIoctl(fd, DRM_IOCTL_GEM_CLOSE, &open_arg.handle);
-		}
+		dump_png(fd, fb);
 
 		drmModeFreeFB(fb);
 	}
@@ -0,0 +1,546 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * A canary client measuring how responsive the GPU is under whatever load it
+ * is running: every interval a nop batch is submitted to each engine from a
+ * high priority context, and the time from the submission until its fence
+ * signals is recorded. Only one probe per engine is ever in flight, so the
+ * canary itself adds next to no load.
+ *
+ * The latencies are reported as percentiles every period on stdout, and as
+ * Prometheus histograms, served over HTTP with -E and/or written to a file
+ * with -o, e.g. for the textfile collector of the node exporter.
+ */
+
+#include "igt.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "igt_stats.h"
+
+/* Upper bounds of the exported buckets, in microseconds */
+static const unsigned int bucket_us[] = {
+	10, 20, 50, 100, 200, 500,
+	1000, 2000, 5000, 10000, 20000, 50000,
+	100000, 200000, 500000, 1000000,
+};
+
+#define NUM_BUCKETS ARRAY_SIZE(bucket_us)
+
+struct probe {
+	char *name;
+	uint64_t flags;
+
+	int fence;
+	uint64_t submitted;
+
+	/* Since the start, for the exporter */
+	uint64_t buckets[NUM_BUCKETS + 1];
+	uint64_t count;
+	double sum;
+
+	/* Since the last report */
+	struct igt_histogram window;
+};
+
+struct canary {
+	int fd;
+	uint32_t ctx;
+	uint32_t batch;
+	int priority;
+	unsigned int interval_us;
+
+	struct probe probes[GEM_MAX_ENGINES];
+	unsigned int num_probes;
+
+	pthread_mutex_t lock;
+};
+
+static volatile bool stop;
+
+static void sigint_handler(int sig)
+{
+	stop = true;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void submit(struct canary *c, struct probe *p)
+{
+	struct drm_i915_gem_exec_object2 obj = {
+		.handle = c->batch,
+	};
+	struct drm_i915_gem_execbuffer2 execbuf = {
+		.buffers_ptr = to_user_pointer(&obj),
+		.buffer_count = 1,
+		.flags = p->flags | I915_EXEC_FENCE_OUT,
+		.rsvd1 = c->ctx,
+	};
+
+	p->submitted = now_ns();
+	if (__gem_execbuf_wr(c->fd, &execbuf)) {
+		p->fence = -1;
+		return;
+	}
+
+	p->fence = execbuf.rsvd2 >> 32;
+}
+
+static void record(struct canary *c, struct probe *p, uint64_t ns)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_BUCKETS; i++)
+		if (ns <= bucket_us[i] * 1000ull)
+			break;
+
+	pthread_mutex_lock(&c->lock);
+	p->buckets[i]++;
+	p->count++;
+	p->sum += ns * 1e-9;
+	igt_histogram_add(&p->window, ns);
+	pthread_mutex_unlock(&c->lock);
+}
+
+static void *probe_thread(void *arg)
+{
+	struct canary *c = arg;
+	struct pollfd pfd[GEM_MAX_ENGINES];
+	struct timespec next;
+
+	for (unsigned int i = 0; i < c->num_probes; i++)
+		pfd[i].fd = -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!stop) {
+		unsigned int pending = 0;
+
+		for (unsigned int i = 0; i < c->num_probes; i++) {
+			submit(c, &c->probes[i]);
+			pfd[i].fd = c->probes[i].fence;
+			pfd[i].events = POLLIN;
+			pending += c->probes[i].fence >= 0;
+		}
+
+		while (pending && !stop) {
+			if (poll(pfd, c->num_probes, 1000) <= 0)
+				continue;
+
+			for (unsigned int i = 0; i < c->num_probes; i++) {
+				struct probe *p = &c->probes[i];
+
+				if (pfd[i].fd < 0 || !pfd[i].revents)
+					continue;
+
+				record(c, p, now_ns() - p->submitted);
+				close(p->fence);
+				pfd[i].fd = -1;
+				pending--;
+			}
+		}
+
+		/* Keep to the interval, unless a probe took longer than it */
+		next.tv_nsec += c->interval_us * 1000ull;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		if (now_ns() > next.tv_sec * 1000000000ull + next.tv_nsec)
+			clock_gettime(CLOCK_MONOTONIC, &next);
+		else
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&next, NULL);
+	}
+
+	for (unsigned int i = 0; i < c->num_probes; i++)
+		if (pfd[i].fd >= 0)
+			close(pfd[i].fd);
+
+	return NULL;
+}
+
+static void report(struct canary *c)
+{
+	pthread_mutex_lock(&c->lock);
+	for (unsigned int i = 0; i < c->num_probes; i++) {
+		struct probe *p = &c->probes[i];
+		struct igt_histogram *h = &p->window;
+
+		printf("%s: %" PRIu64 " probes", p->name,
+		       igt_histogram_get_count(h));
+		if (igt_histogram_get_count(h))
+			printf(", p50 %.1fus, p99 %.1fus, p99.9 %.1fus,"
+			       " max %.1fus",
+			       igt_histogram_get_median(h) / 1e3,
+			       igt_histogram_get_percentile(h, 99) / 1e3,
+			       igt_histogram_get_percentile(h, 99.9) / 1e3,
+			       igt_histogram_get_max(h) / 1e3);
+		putchar('\n');
+
+		igt_histogram_fini(h);
+		igt_histogram_init(h);
+	}
+	pthread_mutex_unlock(&c->lock);
+	fflush(stdout);
+}
+
+static char *format_metrics(struct canary *c, size_t *len)
+{
+	static const char name[] = "intel_gpu_canary_latency_seconds";
+	char *buf = NULL;
+	FILE *f;
+
+	f = open_memstream(&buf, len);
+	if (!f)
+		return NULL;
+
+	fprintf(f, "# HELP %s Time from submitting a nop batch at priority %d"
+		" until its fence signaled.\n# TYPE %s histogram\n",
+		name, c->priority, name);
+
+	pthread_mutex_lock(&c->lock);
+	for (unsigned int i = 0; i < c->num_probes; i++) {
+		struct probe *p = &c->probes[i];
+		uint64_t total = 0;
+
+		for (unsigned int b = 0; b < NUM_BUCKETS; b++) {
+			total += p->buckets[b];
+			fprintf(f, "%s_bucket{engine=\"%s\",le=\"%g\"} %" PRIu64
+				"\n", name, p->name, bucket_us[b] * 1e-6,
+				total);
+		}
+		fprintf(f, "%s_bucket{engine=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+			name, p->name, p->count);
+		fprintf(f, "%s_sum{engine=\"%s\"} %.9g\n",
+			name, p->name, p->sum);
+		fprintf(f, "%s_count{engine=\"%s\"} %" PRIu64 "\n",
+			name, p->name, p->count);
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	if (fclose(f)) {
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+/* Replace the file at once, for the collector to never see half of it */
+static void write_metrics(struct canary *c, const char *path)
+{
+	char tmp[PATH_MAX];
+	size_t len;
+	char *body;
+	FILE *f;
+
+	body = format_metrics(c, &len);
+	if (!body)
+		return;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "w");
+	if (f) {
+		bool ok = fwrite(body, 1, len, f) == len;
+
+		if (fclose(f) == 0 && ok)
+			rename(tmp, path);
+		else
+			unlink(tmp);
+	}
+
+	free(body);
+}
+
+static void send_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+
+		if (ret <= 0)
+			return;
+
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static void serve_scrape(int fd, struct canary *c)
+{
+	static const char not_found[] =
+		"HTTP/1.1 404 Not Found\r\n"
+		"Content-Length: 0\r\n"
+		"Connection: close\r\n\r\n";
+	struct timeval timeout = { .tv_sec = 1 };
+	char request[4096], header[256];
+	size_t len = 0;
+	char *body;
+	ssize_t ret;
+
+	/* Don't let a stuck scraper hold up the others */
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	do {
+		ret = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+		if (ret <= 0)
+			return;
+
+		len += ret;
+		request[len] = 0;
+	} while (!strstr(request, "\r\n\r\n") && len < sizeof(request) - 1);
+
+	if (strncmp(request, "GET /metrics ", 13) &&
+	    strncmp(request, "GET / ", 6)) {
+		send_all(fd, not_found, strlen(not_found));
+		return;
+	}
+
+	body = format_metrics(c, &len);
+	if (!body)
+		return;
+
+	ret = snprintf(header, sizeof(header),
+		       "HTTP/1.1 200 OK\r\n"
+		       "Content-Type: text/plain; version=0.0.4\r\n"
+		       "Content-Length: %zu\r\n"
+		       "Connection: close\r\n\r\n", len);
+	send_all(fd, header, ret);
+	send_all(fd, body, len);
+
+	free(body);
+}
+
+static int listen_on(unsigned int port)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_ANY),
+	};
+	int sock, one = 1;
+
+	sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -1;
+
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(sock, 16)) {
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+static int setup(struct canary *c, const char *engine)
+{
+	const uint32_t bbe = MI_BATCH_BUFFER_END;
+	const struct intel_execution_engine2 *e;
+
+	c->fd = drm_open_driver(DRIVER_INTEL);
+	c->batch = gem_create(c->fd, 4096);
+	gem_write(c->fd, c->batch, 0, &bbe, sizeof(bbe));
+
+	c->ctx = gem_context_create(c->fd);
+	gem_context_set_all_engines(c->fd, c->ctx);
+
+	/* Above every other client, if we are allowed to */
+	c->priority = I915_CONTEXT_MAX_USER_PRIORITY;
+	if (__gem_context_set_priority(c->fd, c->ctx, c->priority)) {
+		fprintf(stderr, "Could not raise the priority, "
+			"probing at the default one\n");
+		c->priority = 0;
+	}
+
+	__for_each_physical_engine(c->fd, e) {
+		struct probe *p = &c->probes[c->num_probes];
+
+		if (engine && strcmp(engine, e->name))
+			continue;
+
+		p->name = strdup(e->name);
+		p->flags = e->flags;
+		p->fence = -1;
+		igt_histogram_init(&p->window);
+		c->num_probes++;
+	}
+
+	return c->num_probes ? 0 : -ENODEV;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"\t[-i <us>]       Interval between probes (default 100000).\n"
+		"\t[-e <engine>]   Only probe this engine, e.g. rcs0.\n"
+		"\t[-p <s>]        Report period on stdout (default 10, 0 for none).\n"
+		"\t[-E <port>]     Serve the histograms to Prometheus on <port>.\n"
+		"\t[-o <file>]     Write the histograms to <file> every period.\n"
+		"\t[-d]            Detach and run as a daemon.\n"
+		"\t[-h]            Show this help.\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	struct canary c = {
+		.interval_us = 100000,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	/* No SA_RESTART, to get out of poll() */
+	struct sigaction sa = {
+		.sa_handler = sigint_handler,
+	};
+	const char *engine = NULL, *output = NULL;
+	unsigned int period = 10, port = 0;
+	bool detach = false;
+	uint64_t next_report;
+	pthread_t thread;
+	int sock = -1;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "i:e:p:E:o:dh")) != -1) {
+		switch (ch) {
+		case 'i':
+			c.interval_us = atoi(optarg);
+			if (!c.interval_us)
+				c.interval_us = 1;
+			break;
+		case 'e':
+			engine = optarg;
+			break;
+		case 'p':
+			period = atoi(optarg);
+			break;
+		case 'E':
+			port = atoi(optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'd':
+			detach = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (output && !period)
+		period = 10;
+
+	if (setup(&c, engine)) {
+		fprintf(stderr, "No engine to probe\n");
+		return 1;
+	}
+
+	if (port) {
+		sock = listen_on(port);
+		if (sock < 0) {
+			fprintf(stderr, "Failed to listen on port %u: %s\n",
+				port, strerror(errno));
+			return 1;
+		}
+	}
+
+	if (detach && daemon(0, 0)) {
+		perror("daemon");
+		return 1;
+	}
+
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	pthread_create(&thread, NULL, probe_thread, &c);
+
+	next_report = now_ns() + period * 1000000000ull;
+	while (!stop) {
+		struct pollfd pfd = { .fd = sock, .events = POLLIN };
+		int64_t timeout = -1;
+
+		if (period) {
+			timeout = (int64_t)(next_report - now_ns()) / 1000000;
+			if (timeout <= 0) {
+				if (output)
+					write_metrics(&c, output);
+				if (!detach)
+					report(&c);
+				next_report += period * 1000000000ull;
+				continue;
+			}
+		}
+
+		if (poll(&pfd, 1, timeout) == 1) {
+			int fd = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+
+			if (fd >= 0) {
+				serve_scrape(fd, &c);
+				close(fd);
+			}
+		}
+	}
+
+	pthread_join(thread, NULL);
+
+	if (output)
+		write_metrics(&c, output);
+	if (sock >= 0)
+		close(sock);
+
+	for (unsigned int i = 0; i < c.num_probes; i++) {
+		igt_histogram_fini(&c.probes[i].window);
+		free(c.probes[i].name);
+	}
+	gem_context_destroy(c.fd, c.ctx);
+	gem_close(c.fd, c.batch);
+	close(c.fd);
+
+	return 0;
+}
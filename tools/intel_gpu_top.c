@@ -39,6 +39,10 @@
 #include <locale.h>
 #include <limits.h>
 #include <signal.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 #include "igt_perf.h"
 
@@ -625,25 +629,43 @@ static void update_sample(struct pmu_counter *counter, uint64_t *val)
 		__update_sample(counter, val[counter->idx]);
 }
 
-static void pmu_sample(struct engines *engines)
+/*
+ * A raw sample is the timestamp, the RAPL and IMC counters and then the
+ * values of the i915 counter group.
+ */
+#define SAMPLE_TS	0
+#define SAMPLE_RAPL	1
+#define SAMPLE_IMC	2
+#define SAMPLE_VAL	4
+
+static void pmu_read(struct engines *engines, uint64_t *sample)
+{
+	if (engines->rapl_fd >= 0)
+		sample[SAMPLE_RAPL] = pmu_read_single(engines->rapl_fd);
+
+	if (engines->imc_fd >= 0)
+		pmu_read_multi(engines->imc_fd, 2, &sample[SAMPLE_IMC]);
+
+	sample[SAMPLE_TS] = pmu_read_multi(engines->fd, engines->num_counters,
+					   &sample[SAMPLE_VAL]);
+}
+
+static void pmu_update(struct engines *engines, uint64_t *sample)
 {
-	const int num_val = engines->num_counters;
-	uint64_t val[2 + num_val];
+	uint64_t *val = &sample[SAMPLE_VAL];
 	unsigned int i;
 
 	engines->ts.prev = engines->ts.cur;
 
 	if (engines->rapl_fd >= 0)
-		__update_sample(&engines->rapl,
-				pmu_read_single(engines->rapl_fd));
+		__update_sample(&engines->rapl, sample[SAMPLE_RAPL]);
 
 	if (engines->imc_fd >= 0) {
-		pmu_read_multi(engines->imc_fd, 2, val);
-		update_sample(&engines->imc_reads, val);
-		update_sample(&engines->imc_writes, val);
+		update_sample(&engines->imc_reads, &sample[SAMPLE_IMC]);
+		update_sample(&engines->imc_writes, &sample[SAMPLE_IMC]);
 	}
 
-	engines->ts.cur = pmu_read_multi(engines->fd, num_val, val);
+	engines->ts.cur = sample[SAMPLE_TS];
 
 	update_sample(&engines->freq_req, val);
 	update_sample(&engines->freq_act, val);
@@ -659,6 +681,16 @@ static void pmu_sample(struct engines *engines)
 	}
 }
 
+static void pmu_sample(struct engines *engines)
+{
+	uint64_t sample[SAMPLE_VAL + engines->num_counters];
+
+	memset(sample, 0, sizeof(sample));
+
+	pmu_read(engines, sample);
+	pmu_update(engines, sample);
+}
+
 static const char *bars[] = { " ", "▏", "▎", "▍", "▌", "▋", "▊", "▉", "█" };
 
 static void
@@ -695,6 +727,13 @@ usage(const char *appname)
 		"\t[-l]            List plain text data.\n"
 		"\t[-o <file|->]   Output to specified file or '-' for standard out.\n"
 		"\t[-s <ms>]       Refresh period in milliseconds (default %ums).\n"
+		"\t[-r <us>]       Sample every <us> microseconds instead, and\n"
+		"\t                output a record for each sample.\n"
+		"\t[-R <file>]     Record the raw samples to a file.\n"
+		"\t[-p <file>]     Summarize a recording and exit.\n"
+		"\t[-w <s>,<s>]    The window of the recording to summarize,\n"
+		"\t                in seconds from its start.\n"
+		"\t[-E <port>]     Serve the counters to Prometheus on <port>.\n"
 		"\n",
 		appname, DEFAULT_PERIOD_MS);
 }
@@ -787,7 +826,7 @@ json_add_member(const struct cnt_group *parent, struct cnt_item *item,
 
 	json_struct_members++;
 
-	if (!strcmp(item->name, "unit"))
+	if (!item->pmu)
 		fprintf(out, "\"%s\"", item->unit);
 	else
 		fprintf(out, "%f",
@@ -1232,7 +1271,6 @@ print_engines_footer(struct engines *engines, double t,
 		     int lines, int con_w, int con_h)
 {
 	pops->close_struct();
-	pops->close_struct();
 
 	if (output_mode == INTERACTIVE) {
 		if (lines++ < con_h)
@@ -1242,6 +1280,901 @@ print_engines_footer(struct engines *engines, double t,
 	return lines;
 }
 
+/*
+ * Per-client usage: The busyness of each DRM client comes from the
+ * clients/ directory of the card in sysfs where the kernel has it, and
+ * otherwise from the drm-* keys in the fdinfo of the processes with the
+ * card open. The clients stay sorted by id between the scans, so each
+ * reading is matched to the previous one with a binary search, and the
+ * usage over the period is the difference between the two.
+ */
+#define NUM_ENGINE_CLASSES (I915_ENGINE_CLASS_VIDEO_ENHANCE + 1)
+
+static const char *fdinfo_class_names[NUM_ENGINE_CLASSES] = {
+	[I915_ENGINE_CLASS_RENDER] = "render",
+	[I915_ENGINE_CLASS_COPY] = "copy",
+	[I915_ENGINE_CLASS_VIDEO] = "video",
+	[I915_ENGINE_CLASS_VIDEO_ENHANCE] = "video-enhance",
+};
+
+enum client_status {
+	FREE = 0, /* mbz */
+	ALIVE,
+	PROBE
+};
+
+struct client {
+	enum client_status status;
+	unsigned int id;
+	unsigned int pid;
+	char id_str[16];
+	char pid_str[16];
+	char name[24];
+
+	struct pmu_counter engine[NUM_ENGINE_CLASSES];
+	uint64_t busy; /* Over the last period, for sorting */
+};
+
+struct clients {
+	int sysfs; /* clients/ directory, or -1 for fdinfo */
+	bool classes[NUM_ENGINE_CLASSES];
+
+	unsigned int num_clients;
+	unsigned int num_sorted;
+	unsigned int allocated;
+	struct client *client;
+	struct client **by_busy;
+
+	struct pmu_pair ts;
+};
+
+static int find_sysfs_clients(void)
+{
+	char path[PATH_MAX], driver[PATH_MAX];
+	const char *name;
+	ssize_t len;
+
+	for (unsigned int i = 0; i < 64; i++) {
+		snprintf(path, sizeof(path),
+			 "/sys/class/drm/card%u/device/driver", i);
+		len = readlink(path, driver, sizeof(driver) - 1);
+		if (len < 0)
+			continue;
+
+		driver[len] = 0;
+		name = strrchr(driver, '/');
+		if (strcmp(name ? name + 1 : driver, "i915"))
+			continue;
+
+		snprintf(path, sizeof(path), "/sys/class/drm/card%u/clients", i);
+		return open(path, O_RDONLY | O_DIRECTORY);
+	}
+
+	return -1;
+}
+
+static struct clients *init_clients(struct engines *engines)
+{
+	struct clients *clients;
+
+	clients = calloc(1, sizeof(*clients));
+	if (!clients)
+		return NULL;
+
+	clients->sysfs = find_sysfs_clients();
+
+	for (unsigned int i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+
+		if (engine->class < NUM_ENGINE_CLASSES)
+			clients->classes[engine->class] = true;
+	}
+
+	return clients;
+}
+
+static int client_id_cmp(const void *_a, const void *_b)
+{
+	const struct client *a = _a, *b = _b;
+
+	return a->id < b->id ? -1 : a->id > b->id;
+}
+
+static int client_busy_cmp(const void *_a, const void *_b)
+{
+	const struct client *a = *(const struct client **)_a;
+	const struct client *b = *(const struct client **)_b;
+
+	if (a->busy != b->busy)
+		return a->busy < b->busy ? 1 : -1;
+
+	return client_id_cmp(a, b);
+}
+
+static struct client *get_client(struct clients *clients, unsigned int id)
+{
+	struct client key = { .id = id }, *c;
+
+	if (clients->num_sorted) {
+		c = bsearch(&key, clients->client, clients->num_sorted,
+			    sizeof(*c), client_id_cmp);
+		if (c)
+			return c;
+	}
+
+	/* Seen earlier in this scan? */
+	for (unsigned int i = clients->num_sorted;
+	     i < clients->num_clients; i++)
+		if (clients->client[i].id == id)
+			return &clients->client[i];
+
+	if (clients->num_clients == clients->allocated) {
+		clients->allocated = clients->allocated ?
+				     2 * clients->allocated : 16;
+		c = realloc(clients->client,
+			    clients->allocated * sizeof(*c));
+		if (!c)
+			return NULL;
+		clients->client = c;
+	}
+
+	c = &clients->client[clients->num_clients++];
+	memset(c, 0, sizeof(*c));
+	c->id = id;
+
+	return c;
+}
+
+static void update_client(struct clients *clients, struct client *c,
+			  unsigned int pid, const char *name,
+			  const uint64_t *val)
+{
+	bool new = c->status == FREE;
+
+	/* Another fd of a client already seen in this scan */
+	if (c->status == ALIVE)
+		return;
+
+	c->status = ALIVE;
+	c->pid = pid;
+	snprintf(c->id_str, sizeof(c->id_str), "%u", c->id);
+	snprintf(c->pid_str, sizeof(c->pid_str), "%u", pid);
+
+	/* Keep the name printable as is in every output mode */
+	for (unsigned int i = 0; i < sizeof(c->name); i++) {
+		char ch = name[i];
+
+		if (ch == '\n' || !ch) {
+			c->name[i] = 0;
+			break;
+		}
+
+		c->name[i] = isprint(ch) && ch != '"' && ch != '\\' ? ch : '_';
+	}
+	c->name[sizeof(c->name) - 1] = 0;
+
+	c->busy = 0;
+	for (unsigned int i = 0; i < NUM_ENGINE_CLASSES; i++) {
+		struct pmu_counter *cnt = &c->engine[i];
+
+		cnt->present = clients->classes[i];
+		__update_sample(cnt, val[i]);
+		if (new)
+			cnt->val.prev = val[i];
+
+		c->busy += cnt->val.cur - cnt->val.prev;
+	}
+}
+
+static int read_at(int dirfd, const char *name, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = openat(dirfd, name, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+
+	buf[len] = 0;
+	return 0;
+}
+
+static void scan_sysfs_clients(struct clients *clients)
+{
+	struct dirent *dent;
+	DIR *d;
+
+	/* The dup shares the position with the previous scans */
+	d = fdopendir(dup(clients->sysfs));
+	if (!d)
+		return;
+	rewinddir(d);
+
+	while ((dent = readdir(d)) != NULL) {
+		uint64_t val[NUM_ENGINE_CLASSES] = {};
+		char name[64], pid[16], buf[64];
+		struct client *c;
+		int fd;
+
+		if (!isdigit(dent->d_name[0]))
+			continue;
+
+		fd = openat(dirfd(d), dent->d_name, O_RDONLY | O_DIRECTORY);
+		if (fd < 0)
+			continue;
+
+		if (read_at(fd, "name", name, sizeof(name)) ||
+		    read_at(fd, "pid", pid, sizeof(pid))) {
+			close(fd);
+			continue;
+		}
+
+		for (unsigned int i = 0; i < NUM_ENGINE_CLASSES; i++) {
+			char file[16];
+
+			snprintf(file, sizeof(file), "busy/%u", i);
+			if (!read_at(fd, file, buf, sizeof(buf)))
+				val[i] = strtoull(buf, NULL, 10);
+		}
+		close(fd);
+
+		c = get_client(clients, strtoul(dent->d_name, NULL, 10));
+		if (c)
+			update_client(clients, c, strtoul(pid, NULL, 10),
+				      name, val);
+	}
+
+	closedir(d);
+}
+
+/* Returns the client id, or -1 if the fdinfo is not of an i915 client */
+static long parse_fdinfo(char *buf, uint64_t *val)
+{
+	bool i915 = false;
+	long id = -1;
+	char *line;
+
+	for (line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+		char *value = strchr(line, ':');
+
+		if (!value || strncmp(line, "drm-", 4))
+			continue;
+
+		*value++ = 0;
+		line += 4;
+
+		if (!strcmp(line, "driver")) {
+			i915 = strstr(value, "i915") != NULL;
+		} else if (!strcmp(line, "client-id")) {
+			id = strtol(value, NULL, 10);
+		} else if (!strncmp(line, "engine-", 7)) {
+			for (unsigned int i = 0; i < NUM_ENGINE_CLASSES; i++)
+				if (!strcmp(line + 7, fdinfo_class_names[i]))
+					val[i] = strtoull(value, NULL, 10);
+		}
+	}
+
+	return i915 ? id : -1;
+}
+
+static void scan_fdinfo_clients(struct clients *clients)
+{
+	struct dirent *proc_dent, *fd_dent;
+	DIR *proc, *fds;
+
+	proc = opendir("/proc");
+	if (!proc)
+		return;
+
+	while ((proc_dent = readdir(proc)) != NULL) {
+		char path[PATH_MAX], comm[64] = "";
+		unsigned int pid;
+
+		if (!isdigit(proc_dent->d_name[0]))
+			continue;
+
+		pid = strtoul(proc_dent->d_name, NULL, 10);
+		snprintf(path, sizeof(path), "/proc/%u/fd", pid);
+		fds = opendir(path);
+		if (!fds)
+			continue;
+
+		while ((fd_dent = readdir(fds)) != NULL) {
+			uint64_t val[NUM_ENGINE_CLASSES] = {};
+			char target[64], buf[4096];
+			struct client *c;
+			ssize_t len;
+			long id;
+
+			if (!isdigit(fd_dent->d_name[0]))
+				continue;
+
+			/* Cheaper than reading the fdinfo of every fd */
+			len = readlinkat(dirfd(fds), fd_dent->d_name,
+					 target, sizeof(target) - 1);
+			if (len < 0)
+				continue;
+			target[len] = 0;
+			if (strncmp(target, "/dev/dri/", 9))
+				continue;
+
+			snprintf(path, sizeof(path), "/proc/%u/fdinfo/%s",
+				 pid, fd_dent->d_name);
+			if (read_at(AT_FDCWD, path, buf, sizeof(buf)))
+				continue;
+
+			id = parse_fdinfo(buf, val);
+			if (id < 0)
+				continue;
+
+			if (!comm[0]) {
+				snprintf(path, sizeof(path), "/proc/%u/comm", pid);
+				if (read_at(AT_FDCWD, path, comm, sizeof(comm)))
+					strcpy(comm, "?");
+			}
+
+			c = get_client(clients, id);
+			if (c)
+				update_client(clients, c, pid, comm, val);
+		}
+
+		closedir(fds);
+	}
+
+	closedir(proc);
+}
+
+static void scan_clients(struct clients *clients)
+{
+	struct client **by_busy;
+	struct timespec ts;
+	unsigned int i, j;
+
+	if (!clients)
+		return;
+
+	for (i = 0; i < clients->num_clients; i++)
+		clients->client[i].status = PROBE;
+
+	clients->num_sorted = clients->num_clients;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	clients->ts.prev = clients->ts.cur;
+	clients->ts.cur = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+	if (clients->sysfs >= 0)
+		scan_sysfs_clients(clients);
+	else
+		scan_fdinfo_clients(clients);
+
+	/* Drop the clients which have gone */
+	for (i = j = 0; i < clients->num_clients; i++) {
+		if (clients->client[i].status != ALIVE)
+			continue;
+		if (i != j)
+			clients->client[j] = clients->client[i];
+		j++;
+	}
+	clients->num_clients = j;
+
+	qsort(clients->client, clients->num_clients,
+	      sizeof(*clients->client), client_id_cmp);
+	clients->num_sorted = clients->num_clients;
+
+	by_busy = realloc(clients->by_busy,
+			  (clients->num_clients + 1) * sizeof(*by_busy));
+	if (!by_busy)
+		return;
+	clients->by_busy = by_busy;
+
+	for (i = 0; i < clients->num_clients; i++)
+		by_busy[i] = &clients->client[i];
+	qsort(by_busy, clients->num_clients, sizeof(*by_busy),
+	      client_busy_cmp);
+}
+
+static int
+print_client(struct clients *clients, struct client *c, double t,
+	     int lines, int con_w, int con_h)
+{
+	if (output_mode == INTERACTIVE) {
+		printf("%6u %17s ", c->pid, c->name);
+
+		for (unsigned int i = 0; i < NUM_ENGINE_CLASSES; i++) {
+			if (!clients->classes[i])
+				continue;
+
+			printf(" %*.1f%%", (int)strlen(class_display_name(i)),
+			       pmu_calc(&c->engine[i].val, 1e9, t, 100));
+		}
+
+		printf("\n");
+		lines++;
+	} else if (output_mode == JSON) {
+		struct cnt_item info_items[] = {
+			{ NULL, 0, 0, 0.0, 0.0, 0.0, "name", c->name },
+			{ NULL, 0, 0, 0.0, 0.0, 0.0, "pid", c->pid_str },
+			{ },
+		};
+		struct cnt_group info_group = {
+			.name = c->id_str,
+			.items = info_items,
+		};
+
+		pops->open_struct(c->id_str);
+
+		for (struct cnt_item *item = info_items; item->name; item++)
+			pops->add_member(&info_group, item, 0);
+
+		pops->open_struct("engine-classes");
+
+		for (unsigned int i = 0; i < NUM_ENGINE_CLASSES; i++) {
+			struct cnt_item class_items[] = {
+				{ &c->engine[i], 6, 2, 1e9, t, 100, "busy", "%" },
+				{ NULL, 0, 0, 0.0, 0.0, 0.0, "unit", "%" },
+				{ },
+			};
+			struct cnt_group class_group = {
+				.name = class_display_name(i),
+				.items = class_items,
+			};
+
+			pops->print_group(&class_group, false);
+		}
+
+		pops->close_struct();
+		pops->close_struct();
+	}
+
+	return lines;
+}
+
+static int
+print_clients(struct clients *clients, int lines, int con_w, int con_h)
+{
+	double t;
+
+	/* The plain text columns are fixed, so only the engines go there */
+	if (!clients || !clients->num_clients || output_mode == STDOUT)
+		return lines;
+
+	t = (double)(clients->ts.cur - clients->ts.prev) / 1e9;
+
+	if (output_mode == INTERACTIVE) {
+		const char *a = "   PID              NAME ";
+		int len = strlen(a);
+
+		if (lines >= con_h)
+			return lines;
+
+		printf("\033[7m%s", a);
+		for (unsigned int i = 0; i < NUM_ENGINE_CLASSES; i++) {
+			const char *name = class_display_name(i);
+
+			if (clients->classes[i])
+				len += printf(" %*s", (int)strlen(name) + 1,
+					      name);
+		}
+		printf("%*s\033[0m\n", len < con_w - 1 ? con_w - 1 - len : 1,
+		       " ");
+		lines++;
+	} else {
+		pops->open_struct("clients");
+	}
+
+	/* Busiest first, as many as fit */
+	for (unsigned int i = 0;
+	     i < clients->num_clients && lines < con_h; i++)
+		lines = print_client(clients, clients->by_busy[i], t,
+				     lines, con_w, con_h);
+
+	if (output_mode == JSON)
+		pops->close_struct();
+
+	return lines;
+}
+
+static void
+print_sample(struct engines *engines, struct clients *clients, double t,
+	     int con_w, int con_h)
+{
+	bool consumed = false;
+	int lines = 0;
+	unsigned int i;
+
+	while (!consumed) {
+		lines = print_header(engines, t, lines, con_w, con_h,
+				     &consumed);
+
+		if (engines->imc_fd)
+			lines = print_imc(engines, t, lines, con_w, con_h);
+
+		lines = print_engines_header(engines, t, lines, con_w, con_h);
+
+		for (i = 0; i < engines->num_engines && lines < con_h; i++)
+			lines = print_engine(engines, i, t, lines,
+					     con_w, con_h);
+
+		lines = print_engines_footer(engines, t, lines, con_w, con_h);
+
+		lines = print_clients(clients, lines, con_w, con_h);
+
+		pops->close_struct();
+	}
+}
+
+/*
+ * Recording: With -R the raw samples are written to a file instead of
+ * printing, for soak runs. The file starts with a header listing the
+ * counters, followed by fixed size records, each being one raw sample
+ * as read by pmu_read(). The counters are cumulative so any window can
+ * be summarized from its two ends, and the fixed size lets the replay
+ * find the start of a window with a binary search.
+ */
+#define RECORD_MAGIC "IGTGPUTP"
+#define RECORD_VERSION 1
+
+struct record_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t stride; /* In u64, of each record */
+	uint32_t num_columns;
+	uint32_t pad;
+};
+
+/*
+ * The value of a column over a period is the difference between two
+ * records, divided by the duration in seconds, times the scale.
+ */
+struct record_column {
+	char name[32];
+	char unit[16];
+	double scale;
+	uint32_t index; /* In the records */
+	uint32_t pad;
+};
+
+static FILE *record;
+
+static void
+add_column(struct record_column **columns, unsigned int *num,
+	   struct pmu_counter *pmu, unsigned int index,
+	   const char *name, const char *unit, double scale)
+{
+	struct record_column *c;
+
+	if (!pmu->present)
+		return;
+
+	*columns = realloc(*columns, (*num + 1) * sizeof(**columns));
+	assert(*columns);
+
+	c = &(*columns)[(*num)++];
+	memset(c, 0, sizeof(*c));
+	snprintf(c->name, sizeof(c->name), "%s", name);
+	snprintf(c->unit, sizeof(c->unit), "%s", unit);
+	c->scale = scale;
+	c->index = index;
+}
+
+static int record_open(const char *path, struct engines *engines)
+{
+	struct record_header hdr = {
+		.magic = RECORD_MAGIC,
+		.version = RECORD_VERSION,
+		.stride = SAMPLE_VAL + engines->num_counters,
+	};
+	struct record_column *columns = NULL;
+	unsigned int num = 0;
+	char buf[64];
+
+	add_column(&columns, &num, &engines->freq_req,
+		   SAMPLE_VAL + engines->freq_req.idx,
+		   "frequency-requested", "MHz", 1.0);
+	add_column(&columns, &num, &engines->freq_act,
+		   SAMPLE_VAL + engines->freq_act.idx,
+		   "frequency-actual", "MHz", 1.0);
+	add_column(&columns, &num, &engines->irq,
+		   SAMPLE_VAL + engines->irq.idx,
+		   "interrupts", "irq/s", 1.0);
+	add_column(&columns, &num, &engines->rc6,
+		   SAMPLE_VAL + engines->rc6.idx,
+		   "rc6", "%", 100 / 1e9);
+	add_column(&columns, &num, &engines->rapl, SAMPLE_RAPL,
+		   "power", engines->rapl_unit ?: "", engines->rapl_scale);
+
+	if (engines->imc_fd >= 0) {
+		snprintf(buf, sizeof(buf), "%s/s", engines->imc_reads_unit);
+		add_column(&columns, &num, &engines->imc_reads,
+			   SAMPLE_IMC + engines->imc_reads.idx,
+			   "imc-reads", buf, engines->imc_reads_scale);
+		snprintf(buf, sizeof(buf), "%s/s", engines->imc_writes_unit);
+		add_column(&columns, &num, &engines->imc_writes,
+			   SAMPLE_IMC + engines->imc_writes.idx,
+			   "imc-writes", buf, engines->imc_writes_scale);
+	}
+
+	for (unsigned int i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+		struct {
+			struct pmu_counter *pmu;
+			const char *counter;
+		} counters[] = {
+			{ &engine->busy, "busy" },
+			{ &engine->sema, "sema" },
+			{ &engine->wait, "wait" },
+		};
+
+		for (unsigned int j = 0; j < ARRAY_SIZE(counters); j++) {
+			snprintf(buf, sizeof(buf), "%s-%s",
+				 engine->display_name, counters[j].counter);
+			add_column(&columns, &num, counters[j].pmu,
+				   SAMPLE_VAL + counters[j].pmu->idx,
+				   buf, "%", 100 / 1e9);
+		}
+	}
+
+	hdr.num_columns = num;
+
+	record = fopen(path, "w");
+	if (!record) {
+		free(columns);
+		return -1;
+	}
+
+	/* Large writes, rarely */
+	setvbuf(record, NULL, _IOFBF, 1 << 16);
+
+	if (fwrite(&hdr, sizeof(hdr), 1, record) != 1 ||
+	    fwrite(columns, sizeof(*columns), num, record) != num) {
+		fclose(record);
+		record = NULL;
+		free(columns);
+		return -1;
+	}
+
+	free(columns);
+	return 0;
+}
+
+static void record_sample(struct engines *engines, const uint64_t *sample)
+{
+	fwrite(sample, sizeof(*sample), SAMPLE_VAL + engines->num_counters,
+	       record);
+}
+
+static void record_close(void)
+{
+	if (record && fclose(record))
+		fprintf(stderr, "Failed to write the recording! (%s)\n",
+			strerror(errno));
+	record = NULL;
+}
+
+/*
+ * Replay: Summarizes a recording over a window, with the mean of each
+ * counter, and for the percentages also the percentiles and a histogram
+ * of the per-sample values. Those are kept in fixed bins, so the
+ * memory use doesn't depend on the length of the recording.
+ */
+#define REPLAY_BINS 1000 /* Of 0.1% */
+#define REPLAY_HISTOGRAM 10
+
+struct replay_column {
+	struct record_column desc;
+	bool percent;
+	uint64_t first, last;
+	double max;
+	unsigned int *bins;
+};
+
+static double replay_percentile(const struct replay_column *c,
+				unsigned long count, double p)
+{
+	unsigned long target = p * count, sum = 0;
+
+	if (target < p * count)
+		target++;
+
+	for (unsigned int i = 0; i <= REPLAY_BINS; i++) {
+		sum += c->bins[i];
+		if (sum >= target && sum)
+			return i * 100.0 / REPLAY_BINS;
+	}
+
+	return 100.0;
+}
+
+static int replay(const char *path, double from, double to)
+{
+	struct replay_column *columns;
+	struct record_header hdr;
+	uint64_t *cur, *prev;
+	unsigned long count = 0;
+	uint64_t start, first_ts;
+	long lo, hi, num_records;
+	size_t record_size;
+	off_t data;
+	FILE *f;
+	int ret = 1;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Failed to open '%s'! (%s)\n", path,
+			strerror(errno));
+		return 1;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, RECORD_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != RECORD_VERSION || hdr.stride <= SAMPLE_VAL) {
+		fprintf(stderr, "'%s' is not a recording!\n", path);
+		fclose(f);
+		return 1;
+	}
+
+	columns = calloc(hdr.num_columns, sizeof(*columns));
+	cur = calloc(hdr.stride, sizeof(*cur));
+	prev = calloc(hdr.stride, sizeof(*prev));
+	assert(columns && cur && prev);
+
+	for (unsigned int i = 0; i < hdr.num_columns; i++) {
+		struct replay_column *c = &columns[i];
+
+		if (fread(&c->desc, sizeof(c->desc), 1, f) != 1 ||
+		    c->desc.index >= hdr.stride) {
+			fprintf(stderr, "'%s' is truncated!\n", path);
+			goto out;
+		}
+
+		c->desc.name[sizeof(c->desc.name) - 1] = 0;
+		c->desc.unit[sizeof(c->desc.unit) - 1] = 0;
+		c->percent = !strcmp(c->desc.unit, "%");
+		if (c->percent) {
+			c->bins = calloc(REPLAY_BINS + 1, sizeof(*c->bins));
+			assert(c->bins);
+		}
+	}
+
+	/* A record cut short by the recorder being killed doesn't count */
+	record_size = hdr.stride * sizeof(uint64_t);
+	data = ftello(f);
+	fseeko(f, 0, SEEK_END);
+	num_records = (ftello(f) - data) / record_size;
+
+	if (num_records < 2 ||
+	    fseeko(f, data, SEEK_SET) || fread(cur, record_size, 1, f) != 1) {
+		fprintf(stderr, "'%s' has no complete period!\n", path);
+		goto out;
+	}
+	first_ts = cur[SAMPLE_TS];
+	start = first_ts + from * 1e9;
+
+	/* The last record at or before the start of the window */
+	lo = 0;
+	hi = num_records - 1;
+	while (lo < hi) {
+		long mid = (lo + hi + 1) / 2;
+
+		if (fseeko(f, data + mid * record_size, SEEK_SET) ||
+		    fread(cur, record_size, 1, f) != 1)
+			goto out;
+
+		if (cur[SAMPLE_TS] <= start)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	if (fseeko(f, data + lo * record_size, SEEK_SET) ||
+	    fread(prev, record_size, 1, f) != 1)
+		goto out;
+
+	for (unsigned int i = 0; i < hdr.num_columns; i++)
+		columns[i].first = prev[columns[i].desc.index];
+	start = prev[SAMPLE_TS];
+
+	while (fread(cur, record_size, 1, f) == 1) {
+		double t = (double)(cur[SAMPLE_TS] - prev[SAMPLE_TS]) / 1e9;
+
+		if (to > 0 && (double)(cur[SAMPLE_TS] - first_ts) / 1e9 > to)
+			break;
+
+		if (t <= 0)
+			continue;
+
+		for (unsigned int i = 0; i < hdr.num_columns; i++) {
+			struct replay_column *c = &columns[i];
+			unsigned int idx = c->desc.index;
+			double v;
+
+			v = (cur[idx] - prev[idx]) / t * c->desc.scale;
+			if (v > c->max)
+				c->max = v;
+
+			c->last = cur[idx];
+			if (c->bins)
+				c->bins[v < 100.0 ?
+					(unsigned int)(v * REPLAY_BINS / 100) :
+					REPLAY_BINS]++;
+		}
+
+		memcpy(prev, cur, record_size);
+		count++;
+	}
+
+	if (!count) {
+		fprintf(stderr, "No samples in the window!\n");
+		goto out;
+	}
+
+	printf("Window %.3fs - %.3fs, %lu samples\n\n",
+	       (double)(start - first_ts) / 1e9,
+	       (double)(prev[SAMPLE_TS] - first_ts) / 1e9, count);
+
+	printf("%-32s %10s %10s %8s %8s %8s %10s\n",
+	       "COUNTER", "UNIT", "MEAN", "P50", "P90", "P99", "MAX");
+
+	for (unsigned int i = 0; i < hdr.num_columns; i++) {
+		struct replay_column *c = &columns[i];
+		double t = (double)(prev[SAMPLE_TS] - start) / 1e9;
+
+		printf("%-32s %10s %10.2f", c->desc.name, c->desc.unit,
+		       (c->last - c->first) / t * c->desc.scale);
+
+		if (c->percent)
+			printf(" %8.1f %8.1f %8.1f",
+			       replay_percentile(c, count, 0.50),
+			       replay_percentile(c, count, 0.90),
+			       replay_percentile(c, count, 0.99));
+		else
+			printf(" %8s %8s %8s", "-", "-", "-");
+
+		printf(" %10.2f\n", c->max);
+	}
+
+	printf("\nShare of the samples per %d%% of busyness:\n",
+	       100 / REPLAY_HISTOGRAM);
+
+	for (unsigned int i = 0; i < hdr.num_columns; i++) {
+		struct replay_column *c = &columns[i];
+
+		if (!c->percent)
+			continue;
+
+		printf("%-32s", c->desc.name);
+		for (unsigned int h = 0; h < REPLAY_HISTOGRAM; h++) {
+			unsigned int per = REPLAY_BINS / REPLAY_HISTOGRAM;
+			unsigned long sum = 0;
+
+			for (unsigned int b = h * per; b < (h + 1) * per; b++)
+				sum += c->bins[b];
+			/* 100% goes to the last bucket */
+			if (h == REPLAY_HISTOGRAM - 1)
+				sum += c->bins[REPLAY_BINS];
+
+			printf(" %5.1f", 100.0 * sum / count);
+		}
+		printf("\n");
+	}
+
+	ret = 0;
+out:
+	for (unsigned int i = 0; i < hdr.num_columns; i++)
+		free(columns[i].bins);
+	free(columns);
+	free(prev);
+	free(cur);
+	fclose(f);
+
+	return ret;
+}
+
 static bool stop_top;
 
 static void sigint_handler(int  sig)
@@ -1249,17 +2182,367 @@ static void sigint_handler(int  sig)
 	stop_top = true;
 }
 
+/*
+ * High-rate sampling: Sleeping between the samples drifts and the
+ * formatting gets in the way below a few milliseconds. So with -r the
+ * main thread only reads the counters into a preallocated ring on
+ * timerfd wakeups, and a writer thread turns the samples into records
+ * and prints them. The counters are cumulative, so when the writer
+ * can't keep up and samples get dropped, the next record just covers
+ * a longer period.
+ */
+#define SAMPLE_RING_SIZE 4096 /* power of two */
+#define SAMPLE_WRITER_SLEEP_US 10000
+
+struct sample_ring {
+	struct engines *engines;
+	uint64_t *samples;
+	unsigned int stride;
+	unsigned int head; /* Advanced by the sampler */
+	unsigned int tail; /* Advanced by the writer */
+	unsigned long dropped;
+	bool done;
+};
+
+static uint64_t *ring_slot(struct sample_ring *ring, unsigned int idx)
+{
+	return &ring->samples[(idx & (SAMPLE_RING_SIZE - 1)) * ring->stride];
+}
+
+static void *sample_writer(void *data)
+{
+	struct sample_ring *ring = data;
+	struct engines *engines = ring->engines;
+	unsigned int tail = 0;
+
+	for (;;) {
+		bool done = __atomic_load_n(&ring->done, __ATOMIC_ACQUIRE);
+		unsigned int head = __atomic_load_n(&ring->head,
+						    __ATOMIC_ACQUIRE);
+		double t;
+
+		if (tail == head) {
+			if (done)
+				break;
+
+			usleep(SAMPLE_WRITER_SLEEP_US);
+			continue;
+		}
+
+		if (record) {
+			record_sample(engines, ring_slot(ring, tail));
+			__atomic_store_n(&ring->tail, ++tail, __ATOMIC_RELEASE);
+			continue;
+		}
+
+		pmu_update(engines, ring_slot(ring, tail));
+		__atomic_store_n(&ring->tail, ++tail, __ATOMIC_RELEASE);
+
+		t = (double)(engines->ts.cur - engines->ts.prev) / 1e9;
+		print_sample(engines, NULL, t, INT_MAX, INT_MAX);
+	}
+
+	fflush(out);
+
+	return NULL;
+}
+
+static int sample_high_rate(struct engines *engines, unsigned int rate_us)
+{
+	struct sample_ring ring = {
+		.engines = engines,
+		.stride = SAMPLE_VAL + engines->num_counters,
+	};
+	struct itimerspec its = {
+		.it_interval.tv_sec = rate_us / 1000000,
+		.it_interval.tv_nsec = rate_us % 1000000 * 1000,
+	};
+	pthread_t writer;
+	uint64_t expired;
+	int tfd;
+
+	its.it_value = its.it_interval;
+
+	ring.samples = calloc(SAMPLE_RING_SIZE,
+			      ring.stride * sizeof(*ring.samples));
+	if (!ring.samples)
+		return -1;
+
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (tfd < 0 || timerfd_settime(tfd, 0, &its, NULL)) {
+		free(ring.samples);
+		return -1;
+	}
+
+	errno = pthread_create(&writer, NULL, sample_writer, &ring);
+	if (errno) {
+		close(tfd);
+		free(ring.samples);
+		return -1;
+	}
+
+	while (!stop_top) {
+		unsigned int head = ring.head;
+
+		if (read(tfd, &expired, sizeof(expired)) != sizeof(expired)) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) ==
+		    SAMPLE_RING_SIZE) {
+			ring.dropped++;
+			continue;
+		}
+
+		pmu_read(engines, ring_slot(&ring, head));
+		__atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&ring.done, true, __ATOMIC_RELEASE);
+	pthread_join(writer, NULL);
+
+	if (ring.dropped)
+		fprintf(stderr,
+			"Dropped %lu samples, the output could not keep up!\n",
+			ring.dropped);
+
+	close(tfd);
+	free(ring.samples);
+
+	return 0;
+}
+
+/*
+ * Exporter: With -E the counters are served over HTTP in the Prometheus
+ * text format, keeping the perf events open between the scrapes. Each
+ * scrape reads the counters once, and they are exported as the
+ * cumulative totals, for the scraper to take the rates over whatever
+ * period it likes.
+ */
+static void
+metric_header(FILE *f, const char *name, const char *help)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+}
+
+static void
+metric(FILE *f, struct pmu_counter *pmu, const char *name, const char *help,
+       double scale)
+{
+	if (!pmu->present)
+		return;
+
+	metric_header(f, name, help);
+	fprintf(f, "%s %.9g\n", name, pmu->val.cur * scale);
+}
+
+static void
+engine_metric(FILE *f, struct engines *engines, const char *counter,
+	      const char *help)
+{
+	char name[64];
+	bool header = false;
+
+	snprintf(name, sizeof(name), "intel_gpu_engine_%s_seconds_total",
+		 counter);
+
+	for (unsigned int i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+		struct pmu_counter *pmu =
+			!strcmp(counter, "busy") ? &engine->busy :
+			!strcmp(counter, "sema") ? &engine->sema : &engine->wait;
+
+		if (!pmu->present)
+			continue;
+
+		if (!header) {
+			metric_header(f, name, help);
+			header = true;
+		}
+
+		fprintf(f, "%s{engine=\"%s\",class=\"%s\"} %.9g\n",
+			name, engine->name, class_display_name(engine->class),
+			pmu->val.cur / 1e9);
+	}
+}
+
+static char *format_metrics(struct engines *engines, size_t *len)
+{
+	char *buf = NULL;
+	FILE *f;
+
+	f = open_memstream(&buf, len);
+	if (!f)
+		return NULL;
+
+	engine_metric(f, engines, "busy", "Time the engine was busy.");
+	engine_metric(f, engines, "wait",
+		      "Time the engine was stalled on a wait.");
+	engine_metric(f, engines, "sema",
+		      "Time the engine was stalled on a semaphore.");
+
+	metric(f, &engines->freq_req,
+	       "intel_gpu_frequency_requested_mhz_seconds_total",
+	       "Requested GPU frequency integrated over time, the rate is in MHz.",
+	       1.0);
+	metric(f, &engines->freq_act,
+	       "intel_gpu_frequency_actual_mhz_seconds_total",
+	       "Actual GPU frequency integrated over time, the rate is in MHz.",
+	       1.0);
+	metric(f, &engines->irq, "intel_gpu_interrupts_total",
+	       "Interrupts raised by the GPU.", 1.0);
+	metric(f, &engines->rc6, "intel_gpu_rc6_seconds_total",
+	       "Time the GPU spent in RC6.", 1e-9);
+
+	/* RAPL reports the energy in Joules, as power in Watts */
+	if (engines->rapl_unit && !strcmp(engines->rapl_unit, "Watts"))
+		metric(f, &engines->rapl, "intel_gpu_energy_joules_total",
+		       "Energy used by the GPU.", engines->rapl_scale);
+
+	if (engines->imc_reads.present && engines->imc_writes.present) {
+		metric_header(f, "intel_gpu_imc_reads_total",
+			      "Data read from memory by the whole package.");
+		fprintf(f, "intel_gpu_imc_reads_total{unit=\"%s\"} %.9g\n",
+			engines->imc_reads_unit,
+			engines->imc_reads.val.cur * engines->imc_reads_scale);
+		metric_header(f, "intel_gpu_imc_writes_total",
+			      "Data written to memory by the whole package.");
+		fprintf(f, "intel_gpu_imc_writes_total{unit=\"%s\"} %.9g\n",
+			engines->imc_writes_unit,
+			engines->imc_writes.val.cur * engines->imc_writes_scale);
+	}
+
+	if (fclose(f)) {
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+static void send_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+
+		if (ret <= 0)
+			return;
+
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static void serve_scrape(int fd, struct engines *engines, uint64_t *sample)
+{
+	static const char not_found[] =
+		"HTTP/1.1 404 Not Found\r\n"
+		"Content-Length: 0\r\n"
+		"Connection: close\r\n\r\n";
+	struct timeval timeout = { .tv_sec = 1 };
+	char request[4096], header[256];
+	size_t len = 0;
+	char *body;
+	ssize_t ret;
+
+	/* Don't let a stuck scraper hold up the others */
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	do {
+		ret = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+		if (ret <= 0)
+			return;
+
+		len += ret;
+		request[len] = 0;
+	} while (!strstr(request, "\r\n\r\n") && len < sizeof(request) - 1);
+
+	if (strncmp(request, "GET /metrics ", 13) &&
+	    strncmp(request, "GET / ", 6)) {
+		send_all(fd, not_found, strlen(not_found));
+		return;
+	}
+
+	pmu_read(engines, sample);
+	pmu_update(engines, sample);
+
+	body = format_metrics(engines, &len);
+	if (!body)
+		return;
+
+	ret = snprintf(header, sizeof(header),
+		       "HTTP/1.1 200 OK\r\n"
+		       "Content-Type: text/plain; version=0.0.4\r\n"
+		       "Content-Length: %zu\r\n"
+		       "Connection: close\r\n\r\n", len);
+	send_all(fd, header, ret);
+	send_all(fd, body, len);
+
+	free(body);
+}
+
+static int serve_metrics(struct engines *engines, unsigned int port)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_ANY),
+	};
+	/* No SA_RESTART, to get out of accept() */
+	struct sigaction sa = {
+		.sa_handler = sigint_handler,
+	};
+	uint64_t sample[SAMPLE_VAL + engines->num_counters];
+	int sock, one = 1;
+
+	memset(sample, 0, sizeof(sample));
+
+	sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -1;
+
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(sock, 16)) {
+		close(sock);
+		return -1;
+	}
+
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (!stop_top) {
+		int fd = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+
+		if (fd < 0)
+			continue;
+
+		serve_scrape(fd, engines, sample);
+		close(fd);
+	}
+
+	close(sock);
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	unsigned int period_us = DEFAULT_PERIOD_MS * 1000;
+	unsigned int rate_us = 0;
+	char *record_path = NULL, *replay_path = NULL;
+	double from = 0, to = 0;
+	unsigned int port = 0;
 	int con_w = -1, con_h = -1;
 	char *output_path = NULL;
+	struct clients *clients = NULL;
 	struct engines *engines;
-	unsigned int i;
 	int ret, ch;
 
 	/* Parse options */
-	while ((ch = getopt(argc, argv, "o:s:Jlh")) != -1) {
+	while ((ch = getopt(argc, argv, "o:s:r:R:p:w:E:Jlh")) != -1) {
 		switch (ch) {
 		case 'o':
 			output_path = optarg;
@@ -1267,6 +2550,33 @@ int main(int argc, char **argv)
 		case 's':
 			period_us = atoi(optarg) * 1000;
 			break;
+		case 'r':
+			rate_us = atoi(optarg);
+			if (!rate_us) {
+				fprintf(stderr, "Invalid sampling period!\n");
+				exit(1);
+			}
+			break;
+		case 'R':
+			record_path = optarg;
+			break;
+		case 'p':
+			replay_path = optarg;
+			break;
+		case 'w':
+			if (sscanf(optarg, "%lf,%lf", &from, &to) < 1 ||
+			    from < 0 || (to && to <= from)) {
+				fprintf(stderr, "Invalid window!\n");
+				exit(1);
+			}
+			break;
+		case 'E':
+			port = atoi(optarg);
+			if (!port || port > 65535) {
+				fprintf(stderr, "Invalid port!\n");
+				exit(1);
+			}
+			break;
 		case 'J':
 			output_mode = JSON;
 			break;
@@ -1283,7 +2593,11 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (output_mode == INTERACTIVE && (output_path || isatty(1) != 1))
+	if (replay_path)
+		return replay(replay_path, from, to);
+
+	if (output_mode == INTERACTIVE &&
+	    (output_path || isatty(1) != 1 || rate_us || record_path || port))
 		output_mode = STDOUT;
 
 	if (output_path && strcmp(output_path, "-")) {
@@ -1303,6 +2617,10 @@ int main(int argc, char **argv)
 
 		if (sig == SIG_ERR)
 			fprintf(stderr, "Failed to install signal handler!\n");
+
+		/* Recordings are usually stopped by whatever started them */
+		if (record_path && signal(SIGTERM, sigint_handler) == SIG_ERR)
+			fprintf(stderr, "Failed to install signal handler!\n");
 	}
 
 	switch (output_mode) {
@@ -1337,9 +2655,48 @@ int main(int argc, char **argv)
 
 	pmu_sample(engines);
 
+	if (port) {
+		ret = serve_metrics(engines, port);
+		if (ret)
+			fprintf(stderr, "Failed to serve on port %u! (%s)\n",
+				port, strerror(errno));
+		return ret ? 1 : 0;
+	}
+
+	if (record_path && record_open(record_path, engines)) {
+		fprintf(stderr, "Failed to open the recording! (%s)\n",
+			strerror(errno));
+		return 1;
+	}
+
+	if (rate_us) {
+		ret = sample_high_rate(engines, rate_us);
+		if (ret)
+			fprintf(stderr, "Failed to start sampling! (%s)\n",
+				strerror(errno));
+		record_close();
+		return ret ? 1 : 0;
+	}
+
+	if (record) {
+		uint64_t sample[SAMPLE_VAL + engines->num_counters];
+
+		memset(sample, 0, sizeof(sample));
+
+		while (!stop_top) {
+			pmu_read(engines, sample);
+			record_sample(engines, sample);
+			usleep(period_us);
+		}
+
+		record_close();
+		return 0;
+	}
+
+	clients = init_clients(engines);
+	scan_clients(clients);
+
 	while (!stop_top) {
-		bool consumed = false;
-		int lines = 0;
 		struct winsize ws;
 		double t;
 
@@ -1352,31 +2709,13 @@ int main(int argc, char **argv)
 		}
 
 		pmu_sample(engines);
+		scan_clients(clients);
 		t = (double)(engines->ts.cur - engines->ts.prev) / 1e9;
 
 		if (stop_top)
 			break;
 
-		while (!consumed) {
-			lines = print_header(engines, t, lines, con_w, con_h,
-					     &consumed);
-
-			if (engines->imc_fd)
-				lines = print_imc(engines, t, lines, con_w,
-						  con_h);
-
-			lines = print_engines_header(engines, t, lines, con_w,
-						     con_h);
-
-			for (i = 0;
-			     i < engines->num_engines && lines < con_h;
-			     i++)
-				lines = print_engine(engines, i, t, lines,
-						     con_w, con_h);
-
-			lines = print_engines_footer(engines, t, lines, con_w,
-						     con_h);
-		}
+		print_sample(engines, clients, t, con_w, con_h);
 
 		if (stop_top)
 			break;
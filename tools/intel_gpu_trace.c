@@ -0,0 +1,1085 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sysinfo.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "igt_perf.h"
+
+/*
+ * Request lifecycle tracing.
+ *
+ * Recording opens the i915_request_{add,submit,in,out} tracepoints on every
+ * CPU, drains the perf ring buffers and stores each event as a fixed size
+ * trace_record. Nothing is decoded beyond the few fields we need, so the
+ * file stays compact and recording stays cheap.
+ *
+ * Reporting sorts the records by time and follows each (ctx, seqno) pair
+ * from add (queued by the driver), through submit (all dependencies
+ * signaled), in (running on the HW) to the final out, and prints the
+ * distribution of each phase per context. It can also write the same
+ * requests as a Chrome trace / Perfetto JSON timeline.
+ */
+
+#define TRACE_MAGIC "IGTGPUTR"
+#define TRACE_VERSION 1
+
+#define N_PAGES 64
+
+enum {
+	TP_ADD,
+	TP_SUBMIT,
+	TP_IN,
+	TP_OUT,
+
+	TP_NB
+};
+
+enum {
+	FIELD_CTX,
+	FIELD_SEQNO,
+	FIELD_CLASS,
+	FIELD_INSTANCE,
+	FIELD_COMPLETED,
+
+	FIELD_NB
+};
+
+static const char *field_names[FIELD_NB] = {
+	[FIELD_CTX] = "ctx",
+	[FIELD_SEQNO] = "seqno",
+	[FIELD_CLASS] = "class",
+	[FIELD_INSTANCE] = "instance",
+	[FIELD_COMPLETED] = "completed",
+};
+
+static struct tracepoint {
+	const char *name;
+	bool required;
+	uint64_t config;
+	uint64_t *ids;
+	struct {
+		int offset;
+		int size;
+	} fields[FIELD_NB];
+} tracepoints[TP_NB] = {
+	[TP_ADD]    = { .name = "i915_request_add", .required = true },
+	[TP_SUBMIT] = { .name = "i915_request_submit" },
+	[TP_IN]     = { .name = "i915_request_in", .required = true },
+	[TP_OUT]    = { .name = "i915_request_out", .required = true },
+};
+
+struct trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t lost;
+};
+
+#define RECORD_COMPLETED (1 << 0)
+
+struct trace_record {
+	uint64_t time;
+	uint64_t ctx;
+	uint32_t seqno;
+	uint8_t type;
+	uint8_t class;
+	uint8_t instance;
+	uint8_t flags;
+};
+
+struct sample_event {
+	struct perf_event_header header;
+	uint64_t time;
+	uint64_t id;
+	uint32_t raw_size;
+	uint8_t raw[];
+};
+
+static const char *tracefs_paths[] = {
+	"/sys/kernel/tracing",
+	"/sys/kernel/debug/tracing",
+};
+
+static FILE *tracefs_open(const char *tp, const char *file)
+{
+	char buf[256];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(tracefs_paths) / sizeof(tracefs_paths[0]); i++) {
+		FILE *f;
+
+		snprintf(buf, sizeof(buf), "%s/events/i915/%s/%s",
+			 tracefs_paths[i], tp, file);
+		f = fopen(buf, "r");
+		if (f)
+			return f;
+	}
+
+	return NULL;
+}
+
+/*
+ *	field:u64 ctx;	offset:16;	size:8;	signed:0;
+ */
+static void parse_field(struct tracepoint *tp, const char *line)
+{
+	const char *decl, *end, *name;
+	int offset, size, i;
+
+	decl = strstr(line, "field:");
+	if (!decl)
+		return;
+
+	end = strchr(decl, ';');
+	if (!end)
+		return;
+
+	name = end;
+	while (name > decl && name[-1] != ' ')
+		name--;
+
+	if (sscanf(end, "; offset:%d; size:%d;", &offset, &size) != 2)
+		return;
+
+	for (i = 0; i < FIELD_NB; i++) {
+		if (strlen(field_names[i]) == end - name &&
+		    !strncmp(name, field_names[i], end - name)) {
+			tp->fields[i].offset = offset;
+			tp->fields[i].size = size;
+		}
+	}
+}
+
+static int tracepoint_init(struct tracepoint *tp)
+{
+	char line[512];
+	FILE *f;
+
+	f = tracefs_open(tp->name, "id");
+	if (!f)
+		return -ENOENT;
+
+	if (fscanf(f, "%" SCNu64, &tp->config) != 1)
+		tp->config = 0;
+	fclose(f);
+	if (!tp->config)
+		return -EINVAL;
+
+	f = tracefs_open(tp->name, "format");
+	if (!f)
+		return -ENOENT;
+
+	while (fgets(line, sizeof(line), f))
+		parse_field(tp, line);
+	fclose(f);
+
+	if (!tp->fields[FIELD_CTX].size || !tp->fields[FIELD_SEQNO].size)
+		return -EINVAL;
+
+	return 0;
+}
+
+static uint64_t read_field(const struct sample_event *s,
+			   const struct tracepoint *tp, int field)
+{
+	const uint8_t *ptr = s->raw + tp->fields[field].offset;
+
+	if (tp->fields[field].offset + tp->fields[field].size > s->raw_size)
+		return 0;
+
+	switch (tp->fields[field].size) {
+	case 1: return *ptr;
+	case 2: return *(const uint16_t *)ptr;
+	case 4: return *(const uint32_t *)ptr;
+	case 8: return *(const uint64_t *)ptr;
+	default: return 0;
+	}
+}
+
+struct ring {
+	int fd;
+	void *map;
+};
+
+struct recorder {
+	int nr_cpus;
+	struct ring *rings;
+	int nr_rings;
+	size_t page_size, size;
+
+	FILE *out;
+	uint64_t count;
+	uint64_t lost;
+
+	uint8_t *copy;
+};
+
+static int tracepoint_open(struct recorder *rec, struct tracepoint *tp,
+			   int cpu, int group)
+{
+	struct perf_event_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_TRACEPOINT;
+	attr.size = sizeof(attr);
+	attr.config = tp->config;
+	attr.sample_period = 1;
+	attr.sample_type = PERF_SAMPLE_TIME | PERF_SAMPLE_STREAM_ID |
+			   PERF_SAMPLE_RAW;
+	attr.use_clockid = 1;
+	attr.clockid = CLOCK_MONOTONIC;
+	attr.watermark = 1;
+	attr.wakeup_watermark = rec->size / 4;
+	attr.exclude_guest = 1;
+
+	fd = perf_event_open(&attr, -1, cpu, -1, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (ioctl(fd, PERF_EVENT_IOC_ID, &tp->ids[cpu]) < 0 ||
+	    (group >= 0 && ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, group) < 0)) {
+		int err = -errno;
+
+		close(fd);
+		return err;
+	}
+
+	return fd;
+}
+
+static int recorder_init(struct recorder *rec, FILE *out)
+{
+	int cpu, i, err;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->out = out;
+	rec->nr_cpus = get_nprocs_conf();
+	rec->page_size = sysconf(_SC_PAGESIZE);
+	rec->size = N_PAGES * rec->page_size;
+
+	rec->rings = calloc(rec->nr_cpus, sizeof(*rec->rings));
+	rec->copy = malloc(rec->size);
+	if (!rec->rings || !rec->copy)
+		return -ENOMEM;
+
+	for (i = 0; i < TP_NB; i++) {
+		struct tracepoint *tp = &tracepoints[i];
+
+		err = tracepoint_init(tp);
+		if (err) {
+			fprintf(stderr, "Tracepoint i915:%s unavailable (%s)%s\n",
+				tp->name, strerror(-err),
+				tp->required ? "" : ", ignoring");
+			if (tp->required)
+				return err;
+			tp->config = 0;
+			continue;
+		}
+
+		tp->ids = calloc(rec->nr_cpus, sizeof(*tp->ids));
+		if (!tp->ids)
+			return -ENOMEM;
+	}
+
+	for (cpu = 0; cpu < rec->nr_cpus; cpu++) {
+		struct ring *ring = &rec->rings[rec->nr_rings];
+
+		ring->fd = -1;
+		for (i = 0; i < TP_NB; i++) {
+			int fd;
+
+			if (!tracepoints[i].config)
+				continue;
+
+			fd = tracepoint_open(rec, &tracepoints[i], cpu,
+					     ring->fd);
+			if (fd == -ENODEV && ring->fd < 0)
+				break; /* offline cpu */
+			if (fd < 0)
+				return fd;
+
+			if (ring->fd < 0)
+				ring->fd = fd;
+		}
+		if (ring->fd < 0)
+			continue;
+
+		ring->map = mmap(NULL, rec->page_size + rec->size,
+				 PROT_READ | PROT_WRITE, MAP_SHARED,
+				 ring->fd, 0);
+		if (ring->map == MAP_FAILED)
+			return -errno;
+
+		rec->nr_rings++;
+	}
+
+	return rec->nr_rings ? 0 : -ENODEV;
+}
+
+static const struct tracepoint *
+lookup_event(const struct recorder *rec, uint64_t id, uint8_t *type)
+{
+	int i, cpu;
+
+	/* Every tracepoint has one id per cpu, all of them unique */
+	for (i = 0; i < TP_NB; i++) {
+		const struct tracepoint *tp = &tracepoints[i];
+
+		if (!tp->config)
+			continue;
+
+		for (cpu = 0; cpu < rec->nr_cpus; cpu++) {
+			if (tp->ids[cpu] == id) {
+				*type = i;
+				return tp;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void record_event(struct recorder *rec, const struct sample_event *s)
+{
+	const struct tracepoint *tp;
+	struct trace_record r = {};
+
+	tp = lookup_event(rec, s->id, &r.type);
+	if (!tp)
+		return;
+
+	r.time = s->time;
+	r.ctx = read_field(s, tp, FIELD_CTX);
+	r.seqno = read_field(s, tp, FIELD_SEQNO);
+	r.class = read_field(s, tp, FIELD_CLASS);
+	r.instance = read_field(s, tp, FIELD_INSTANCE);
+
+	/* Older kernels do not tell us about preemption, assume completion */
+	if (r.type != TP_OUT || !tp->fields[FIELD_COMPLETED].size ||
+	    read_field(s, tp, FIELD_COMPLETED))
+		r.flags |= RECORD_COMPLETED;
+
+	fwrite(&r, sizeof(r), 1, rec->out);
+	rec->count++;
+}
+
+static void ring_drain(struct recorder *rec, struct ring *ring)
+{
+	struct perf_event_mmap_page *page = ring->map;
+	const uint8_t *data = (uint8_t *)ring->map + rec->page_size;
+	const uint64_t mask = rec->size - 1;
+	uint64_t head, tail;
+
+	head = __atomic_load_n(&page->data_head, __ATOMIC_ACQUIRE);
+	tail = page->data_tail;
+
+	while (tail != head) {
+		const struct perf_event_header *header =
+			(const void *)(data + (tail & mask));
+		uint64_t offset = tail & mask;
+
+		if (header->size == 0)
+			break;
+
+		/* Records are 8 byte aligned, only the payload may wrap */
+		if (offset + header->size > rec->size) {
+			uint64_t len = rec->size - offset;
+
+			memcpy(rec->copy, data + offset, len);
+			memcpy(rec->copy + len, data, header->size - len);
+			header = (const void *)rec->copy;
+		}
+
+		switch (header->type) {
+		case PERF_RECORD_SAMPLE:
+			record_event(rec, (const void *)header);
+			break;
+		case PERF_RECORD_LOST:
+			rec->lost += ((const uint64_t *)(header + 1))[1];
+			break;
+		}
+
+		tail += header->size;
+	}
+
+	__atomic_store_n(&page->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+static volatile sig_atomic_t stop;
+
+static void sighandler(int sig)
+{
+	stop = sig;
+}
+
+static int record(const char *filename, double duration, char **argv)
+{
+	struct trace_header header = { .magic = TRACE_MAGIC };
+	struct sigaction sa = { .sa_handler = sighandler };
+	struct timespec start, now;
+	struct recorder rec;
+	struct pollfd *pfd;
+	pid_t child = -1;
+	FILE *out;
+	int i, err;
+
+	out = fopen(filename, "w");
+	if (!out) {
+		fprintf(stderr, "Failed to create '%s': %s\n",
+			filename, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	err = recorder_init(&rec, out);
+	if (err) {
+		fprintf(stderr, "Failed to open the i915 tracepoints: %s\n",
+			strerror(-err));
+		fclose(out);
+		unlink(filename);
+		return EXIT_FAILURE;
+	}
+
+	pfd = calloc(rec.nr_rings, sizeof(*pfd));
+	if (!pfd)
+		return EXIT_FAILURE;
+	for (i = 0; i < rec.nr_rings; i++) {
+		pfd[i].fd = rec.rings[i].fd;
+		pfd[i].events = POLLIN;
+	}
+
+	/* Filled in again on completion, with the lost event count */
+	header.version = TRACE_VERSION;
+	header.record_size = sizeof(struct trace_record);
+	fwrite(&header, sizeof(header), 1, out);
+
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGCHLD, &sa, NULL);
+
+	if (argv[0]) {
+		child = fork();
+		if (child == 0) {
+			execvp(argv[0], argv);
+			fprintf(stderr, "Failed to execute '%s': %s\n",
+				argv[0], strerror(errno));
+			_exit(127);
+		}
+		if (child < 0) {
+			fprintf(stderr, "Failed to fork: %s\n",
+				strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		poll(pfd, rec.nr_rings, 100);
+		for (i = 0; i < rec.nr_rings; i++)
+			ring_drain(&rec, &rec.rings[i]);
+
+		if (child > 0 && waitpid(child, NULL, WNOHANG) == child)
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (duration > 0 &&
+		    (now.tv_sec - start.tv_sec) +
+		    1e-9 * (now.tv_nsec - start.tv_nsec) >= duration)
+			break;
+	} while (!stop || stop == SIGCHLD);
+
+	for (i = 0; i < rec.nr_rings; i++)
+		ring_drain(&rec, &rec.rings[i]);
+
+	header.lost = rec.lost;
+	rewind(out);
+	fwrite(&header, sizeof(header), 1, out);
+	if (fclose(out)) {
+		fprintf(stderr, "Failed to write '%s': %s\n",
+			filename, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stderr, "Recorded %" PRIu64 " events to '%s'",
+		rec.count, filename);
+	if (rec.lost)
+		fprintf(stderr, ", %" PRIu64 " lost", rec.lost);
+	fprintf(stderr, "\n");
+
+	return EXIT_SUCCESS;
+}
+
+enum {
+	PHASE_QUEUED,	/* add -> submit */
+	PHASE_READY,	/* submit -> in */
+	PHASE_RUNNING,	/* time spent on the HW, excluding preemption */
+	PHASE_TOTAL,	/* add -> final out */
+
+	PHASE_NB
+};
+
+static const char *phase_names[PHASE_NB] = {
+	[PHASE_QUEUED] = "queued",
+	[PHASE_READY] = "ready",
+	[PHASE_RUNNING] = "running",
+	[PHASE_TOTAL] = "total",
+};
+
+struct samples {
+	uint64_t *values;
+	unsigned int count, size;
+};
+
+struct context {
+	uint64_t ctx;
+	uint8_t class, instance;
+	unsigned int requests;
+	struct samples phase[PHASE_NB];
+};
+
+struct request {
+	uint64_t ctx;
+	uint32_t seqno;
+	bool used;
+
+	struct context *context;
+	uint64_t add, submit, in, last_in;
+	uint64_t running;
+};
+
+struct report {
+	struct context *contexts;
+	unsigned int num_contexts, contexts_size;
+
+	/* In-flight requests, hashed by (ctx, seqno) with linear probing */
+	struct request *requests;
+	unsigned int num_requests, requests_size;
+
+	FILE *json;
+	uint64_t epoch;
+	bool json_first;
+};
+
+static const char *class_name(uint8_t class)
+{
+	static const char *names[] = { "rcs", "bcs", "vcs", "vecs" };
+
+	if (class < sizeof(names) / sizeof(names[0]))
+		return names[class];
+
+	return "virtual";
+}
+
+static void samples_push(struct samples *s, uint64_t value)
+{
+	if (s->count == s->size) {
+		s->size = s->size ? 2 * s->size : 64;
+		s->values = realloc(s->values, s->size * sizeof(*s->values));
+		if (!s->values) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	s->values[s->count++] = value;
+}
+
+static int cmp_u64(const void *A, const void *B)
+{
+	const uint64_t *a = A, *b = B;
+
+	return *a < *b ? -1 : *a > *b;
+}
+
+static struct context *get_context(struct report *r,
+				   const struct trace_record *rec)
+{
+	unsigned int i;
+
+	for (i = 0; i < r->num_contexts; i++)
+		if (r->contexts[i].ctx == rec->ctx)
+			return &r->contexts[i];
+
+	if (r->num_contexts == r->contexts_size) {
+		r->contexts_size = r->contexts_size ? 2 * r->contexts_size : 16;
+		r->contexts = realloc(r->contexts,
+				      r->contexts_size * sizeof(*r->contexts));
+		if (!r->contexts) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	memset(&r->contexts[r->num_contexts], 0, sizeof(*r->contexts));
+	r->contexts[r->num_contexts].ctx = rec->ctx;
+	r->contexts[r->num_contexts].class = rec->class;
+	r->contexts[r->num_contexts].instance = rec->instance;
+
+	return &r->contexts[r->num_contexts++];
+}
+
+static unsigned int request_hash(const struct report *r,
+				 uint64_t ctx, uint32_t seqno)
+{
+	uint64_t key = ctx * 0x9e3779b97f4a7c15ull ^ seqno;
+
+	return (key ^ key >> 29) & (r->requests_size - 1);
+}
+
+static struct request *find_request(struct report *r,
+				    const struct trace_record *rec)
+{
+	unsigned int i;
+
+	if (!r->requests_size)
+		return NULL;
+
+	for (i = request_hash(r, rec->ctx, rec->seqno); r->requests[i].used;
+	     i = (i + 1) & (r->requests_size - 1))
+		if (r->requests[i].ctx == rec->ctx &&
+		    r->requests[i].seqno == rec->seqno)
+			return &r->requests[i];
+
+	return NULL;
+}
+
+static struct request *request_slot(struct report *r,
+				    uint64_t ctx, uint32_t seqno)
+{
+	unsigned int i;
+
+	for (i = request_hash(r, ctx, seqno); r->requests[i].used;
+	     i = (i + 1) & (r->requests_size - 1))
+		;
+
+	return &r->requests[i];
+}
+
+static struct request *insert_request(struct report *r,
+				      const struct trace_record *rec)
+{
+	struct request *rq;
+	unsigned int i;
+
+	if (2 * (r->num_requests + 1) > r->requests_size) {
+		struct request *old = r->requests;
+		unsigned int old_size = r->requests_size;
+
+		r->requests_size = old_size ? 2 * old_size : 1024;
+		r->requests = calloc(r->requests_size, sizeof(*r->requests));
+		if (!r->requests) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+
+		for (i = 0; i < old_size; i++) {
+			if (old[i].used)
+				*request_slot(r, old[i].ctx, old[i].seqno) =
+					old[i];
+		}
+		free(old);
+	}
+
+	rq = request_slot(r, rec->ctx, rec->seqno);
+	memset(rq, 0, sizeof(*rq));
+	rq->used = true;
+	rq->ctx = rec->ctx;
+	rq->seqno = rec->seqno;
+	rq->context = get_context(r, rec);
+	r->num_requests++;
+
+	return rq;
+}
+
+/* Backward shift deletion, keeping the probe sequences intact. */
+static void remove_request(struct report *r, struct request *rq)
+{
+	unsigned int mask = r->requests_size - 1;
+	unsigned int i = rq - r->requests, j = i, k;
+
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!r->requests[j].used)
+			break;
+
+		k = request_hash(r, r->requests[j].ctx, r->requests[j].seqno);
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		r->requests[i] = r->requests[j];
+		i = j;
+	}
+
+	r->requests[i].used = false;
+	r->num_requests--;
+}
+
+static double to_us(uint64_t ns)
+{
+	return ns * 1e-3;
+}
+
+static void json_slice(struct report *r, int pid, unsigned int tid,
+		       const char *name, uint64_t start, uint64_t end,
+		       const struct request *rq)
+{
+	if (!r->json || !start || end < start)
+		return;
+
+	fprintf(r->json,
+		"%s\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"name\":\"%s\","
+		"\"ts\":%.3f,\"dur\":%.3f,"
+		"\"args\":{\"ctx\":%" PRIu64 ",\"seqno\":%u}}",
+		r->json_first ? "" : ",", pid, tid, name,
+		to_us(start - r->epoch), to_us(end - start),
+		rq->ctx, rq->seqno);
+	r->json_first = false;
+}
+
+#define JSON_PID_ENGINES 1
+#define JSON_PID_CONTEXTS 2
+
+static unsigned int engine_tid(const struct trace_record *rec)
+{
+	return rec->class << 8 | rec->instance;
+}
+
+static unsigned int context_tid(const struct report *r,
+				const struct context *c)
+{
+	return c - r->contexts + 1;
+}
+
+static void process(struct report *r, const struct trace_record *rec)
+{
+	struct request *rq = find_request(r, rec);
+	struct context *c;
+
+	if (!r->epoch)
+		r->epoch = rec->time;
+
+	switch (rec->type) {
+	case TP_ADD:
+		if (rq) /* seqno wrapped, or a lost out */
+			remove_request(r, rq);
+		rq = insert_request(r, rec);
+		rq->add = rec->time;
+		return;
+
+	case TP_SUBMIT:
+		if (rq && !rq->submit)
+			rq->submit = rec->time;
+		return;
+
+	case TP_IN:
+		/* Requests that were queued before we started recording */
+		if (!rq)
+			rq = insert_request(r, rec);
+		if (!rq->in)
+			rq->in = rec->time;
+		rq->last_in = rec->time;
+		return;
+
+	case TP_OUT:
+		if (!rq || !rq->last_in)
+			return;
+
+		c = rq->context;
+		rq->running += rec->time - rq->last_in;
+		json_slice(r, JSON_PID_ENGINES, engine_tid(rec), "running",
+			   rq->last_in, rec->time, rq);
+		rq->last_in = 0;
+
+		if (!(rec->flags & RECORD_COMPLETED))
+			return; /* preempted, expect another in */
+
+		c->requests++;
+		samples_push(&c->phase[PHASE_RUNNING], rq->running);
+		if (rq->add) {
+			uint64_t ready = rq->submit ?: rq->add;
+
+			if (rq->submit)
+				samples_push(&c->phase[PHASE_QUEUED],
+					     rq->submit - rq->add);
+			samples_push(&c->phase[PHASE_READY], rq->in - ready);
+			samples_push(&c->phase[PHASE_TOTAL],
+				     rec->time - rq->add);
+
+			json_slice(r, JSON_PID_CONTEXTS, context_tid(r, c),
+				   "queued", rq->add, ready, rq);
+			json_slice(r, JSON_PID_CONTEXTS, context_tid(r, c),
+				   "ready", ready, rq->in, rq);
+		}
+		json_slice(r, JSON_PID_CONTEXTS, context_tid(r, c),
+			   "running", rq->in, rec->time, rq);
+
+		remove_request(r, rq);
+		return;
+	}
+}
+
+static void json_name(struct report *r, const char *type, int pid,
+		      unsigned int tid, const char *name)
+{
+	fprintf(r->json,
+		"%s\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"name\":\"%s\","
+		"\"args\":{\"name\":\"%s\"}}",
+		r->json_first ? "" : ",", pid, tid, type, name);
+	r->json_first = false;
+}
+
+static void json_close(struct report *r, const struct trace_record *records,
+		       size_t count)
+{
+	bool seen[1 << 16] = {};
+	unsigned int i;
+	char buf[64];
+
+	json_name(r, "process_name", JSON_PID_ENGINES, 0, "Engines");
+	json_name(r, "process_name", JSON_PID_CONTEXTS, 0, "Contexts");
+
+	for (i = 0; i < count; i++) {
+		unsigned int tid = engine_tid(&records[i]);
+
+		if (records[i].type != TP_IN || seen[tid])
+			continue;
+
+		seen[tid] = true;
+		snprintf(buf, sizeof(buf), "%s%u",
+			 class_name(records[i].class), records[i].instance);
+		json_name(r, "thread_name", JSON_PID_ENGINES, tid, buf);
+	}
+
+	for (i = 0; i < r->num_contexts; i++) {
+		snprintf(buf, sizeof(buf), "ctx %" PRIu64,
+			 r->contexts[i].ctx);
+		json_name(r, "thread_name", JSON_PID_CONTEXTS,
+			  context_tid(r, &r->contexts[i]), buf);
+	}
+
+	fprintf(r->json, "\n],\n\"displayTimeUnit\":\"ns\"\n}\n");
+}
+
+static double percentile(const struct samples *s, unsigned int pct)
+{
+	return to_us(s->values[(uint64_t)(s->count - 1) * pct / 100]);
+}
+
+static void print_report(struct report *r)
+{
+	unsigned int i, p;
+
+	printf("%20s %-10s %8s %-8s %10s %10s %10s %10s %10s\n",
+	       "ctx", "engine", "requests", "phase",
+	       "min", "p50", "p90", "p99", "max (us)");
+
+	for (i = 0; i < r->num_contexts; i++) {
+		struct context *c = &r->contexts[i];
+		char engine[16];
+
+		if (!c->requests)
+			continue;
+
+		snprintf(engine, sizeof(engine), "%s%u",
+			 class_name(c->class), c->instance);
+
+		for (p = 0; p < PHASE_NB; p++) {
+			struct samples *s = &c->phase[p];
+
+			if (!s->count)
+				continue;
+
+			qsort(s->values, s->count, sizeof(*s->values),
+			      cmp_u64);
+			printf("%20" PRIu64 " %-10s %8u %-8s %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+			       c->ctx, engine, c->requests, phase_names[p],
+			       to_us(s->values[0]),
+			       percentile(s, 50), percentile(s, 90),
+			       percentile(s, 99),
+			       to_us(s->values[s->count - 1]));
+		}
+	}
+}
+
+static int cmp_record(const void *A, const void *B)
+{
+	const struct trace_record *a = A, *b = B;
+
+	if (a->time != b->time)
+		return a->time < b->time ? -1 : 1;
+
+	/* Keep the lifecycle order for events with the same timestamp */
+	return (int)a->type - (int)b->type;
+}
+
+static int report(const char *filename, const char *json)
+{
+	struct trace_record *records;
+	struct trace_header header;
+	struct report r = {};
+	size_t count, i;
+	long size;
+	FILE *in;
+
+	in = fopen(filename, "r");
+	if (!in) {
+		fprintf(stderr, "Failed to open '%s': %s\n",
+			filename, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (fread(&header, sizeof(header), 1, in) != 1 ||
+	    memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) ||
+	    header.version != TRACE_VERSION ||
+	    header.record_size != sizeof(struct trace_record)) {
+		fprintf(stderr, "'%s' is not an intel_gpu_trace recording\n",
+			filename);
+		fclose(in);
+		return EXIT_FAILURE;
+	}
+
+	fseek(in, 0, SEEK_END);
+	size = ftell(in) - sizeof(header);
+	fseek(in, sizeof(header), SEEK_SET);
+
+	count = size / sizeof(*records);
+	records = malloc(count * sizeof(*records) ?: 1);
+	if (!records || fread(records, sizeof(*records), count, in) != count) {
+		fprintf(stderr, "Failed to read '%s'\n", filename);
+		fclose(in);
+		return EXIT_FAILURE;
+	}
+	fclose(in);
+
+	if (header.lost)
+		fprintf(stderr,
+			"Warning: %" PRIu64 " events were lost while recording\n",
+			header.lost);
+
+	/* Each cpu's buffer is ordered, but not across cpus */
+	qsort(records, count, sizeof(*records), cmp_record);
+
+	if (json) {
+		r.json = fopen(json, "w");
+		if (!r.json) {
+			fprintf(stderr, "Failed to create '%s': %s\n",
+				json, strerror(errno));
+			return EXIT_FAILURE;
+		}
+		fprintf(r.json, "{\n\"traceEvents\":[");
+		r.json_first = true;
+	}
+
+	for (i = 0; i < count; i++)
+		process(&r, &records[i]);
+
+	if (r.json) {
+		json_close(&r, records, count);
+		if (fclose(r.json)) {
+			fprintf(stderr, "Failed to write '%s': %s\n",
+				json, strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
+	print_report(&r);
+
+	return EXIT_SUCCESS;
+}
+
+static void usage(const char *appname)
+{
+	printf("intel_gpu_trace - Trace the lifecycle of i915 requests\n"
+	       "\n"
+	       "Usage: %s [parameters] [command [args...]]\n"
+	       "\n"
+	       "\tThe following parameters are optional:\n\n"
+	       "\t[-h]           Show this help text.\n"
+	       "\t[-o <file>]    Record to <file> (default intel_gpu_trace.dat).\n"
+	       "\t[-t <seconds>] Stop recording after <seconds>.\n"
+	       "\t[-i <file>]    Report the per-context latencies in <file>.\n"
+	       "\t[-j <file>]    Also write a Chrome trace JSON timeline to <file>.\n"
+	       "\n"
+	       "\tWithout -i, records until interrupted, <seconds> have passed\n"
+	       "\tor <command> has exited.\n",
+	       appname);
+}
+
+int main(int argc, char **argv)
+{
+	const char *output = "intel_gpu_trace.dat";
+	const char *input = NULL, *json = NULL;
+	double duration = 0;
+	int ch;
+
+	/* Stop at the first non-option, which starts the command. */
+	while ((ch = getopt(argc, argv, "+o:t:i:j:h")) != -1) {
+		switch (ch) {
+		case 'o':
+			output = optarg;
+			break;
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 'i':
+			input = optarg;
+			break;
+		case 'j':
+			json = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(0);
+		default:
+			fprintf(stderr, "Invalid option %c!\n", (char)optopt);
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (json && !input) {
+		fprintf(stderr, "-j requires a recording given with -i\n");
+		exit(1);
+	}
+
+	if (input)
+		return report(input, json);
+
+	return record(output, duration, argv + optind);
+}
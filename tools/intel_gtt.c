@@ -31,9 +31,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <pciaccess.h>
 #include <unistd.h>
 
+#include "drmtest.h"
+#include "igt_aux.h"
 #include "intel_io.h"
 #include "intel_chipset.h"
 
@@ -45,28 +48,58 @@ uint32_t devid;
 typedef uint32_t gen6_gtt_pte_t;
 typedef uint64_t gen8_gtt_pte_t;
 
-static gen6_gtt_pte_t gen6_gtt_pte(const unsigned i)
-{
-	return *((volatile gen6_gtt_pte_t *)(gtt) + i);
-}
+#define PTE_VALID (1 << 0)
+
+/* Copied out of the GSM in chunks, since reads over the BAR are slow */
+#define READ_CHUNK MB(1)
 
-static gen8_gtt_pte_t gen8_gtt_pte(const unsigned i)
+#define HIST_BUCKETS 24
+
+static uint64_t *ptes;
+static unsigned int num_ptes;
+
+static int pte_size(void)
 {
-	return *((volatile gen8_gtt_pte_t *)(gtt) + i);
+	return intel_gen(devid) < 8 ? sizeof(gen6_gtt_pte_t) :
+				      sizeof(gen8_gtt_pte_t);
 }
 
-static uint64_t ingtt(const unsigned offset)
+/*
+ * Takes a snapshot of the whole GTT in a single pass, widening all the
+ * PTEs to 64 bits.
+ */
+static void read_ptes(unsigned int gsm_size)
 {
-	if (intel_gen(devid) < 8)
-		return gen6_gtt_pte(offset/KB(4));
+	unsigned int size = pte_size();
+	void *chunk;
+
+	num_ptes = gsm_size / size;
+	ptes = malloc(num_ptes * sizeof(*ptes));
+	chunk = malloc(READ_CHUNK);
+	if (!ptes || !chunk) {
+		fprintf(stderr, "Failed to allocate the GTT snapshot\n");
+		exit(1);
+	}
+
+	for (unsigned int i = 0; i < num_ptes; ) {
+		unsigned int n = min(num_ptes - i, READ_CHUNK / size);
+
+		memcpy(chunk, gtt + (uint64_t)i * size, n * size);
+		for (unsigned int j = 0; j < n; j++, i++) {
+			if (size == sizeof(gen6_gtt_pte_t))
+				ptes[i] = ((gen6_gtt_pte_t *)chunk)[j];
+			else
+				ptes[i] = ((gen8_gtt_pte_t *)chunk)[j];
+		}
+	}
 
-	return gen8_gtt_pte(offset/KB(4));
+	free(chunk);
 }
 
-static uint64_t get_phys(uint32_t pt_offset)
+static uint64_t get_phys(unsigned int index)
 {
 	uint64_t pae = 0;
-	uint64_t phys = ingtt(pt_offset);
+	uint64_t phys = ptes[index];
 
 	if (intel_gen(devid) < 4 && !IS_G33(devid))
 		return phys & ~0xfff;
@@ -96,50 +129,178 @@ static uint64_t get_phys(uint32_t pt_offset)
 	return (phys | pae) & ~0xfff;
 }
 
-static void pte_dump(int size, uint32_t offset) {
-	int pte_size;
-	int entries;
+static void pte_dump(void)
+{
 	unsigned int i;
 
-	/* Want to print 4 ptes at a time (4b PTE assumed). */
-	if (size % 16)
-		size = (size + 16) & ~0xffff;
-
-	if (intel_gen(devid) < 8)
-		pte_size = 4;
-	else
-		pte_size = 8;
-
-	entries = size / pte_size;
-
-	printf("GTT offset   |                 %d PTEs (%d MB)\n", entries,
-	       entries * 4096 / 1024 / 1024);
+	printf("GTT offset   |                 %d PTEs (%d MB)\n", num_ptes,
+	       num_ptes * 4096 / 1024 / 1024);
 	printf("----------------------------------------------------------\n");
 
-	for (i = 0; i < entries; i += 4) {
+	for (i = 0; i + 4 <= num_ptes; i += 4) {
 		if (intel_gen(devid) < 8) {
-			printf("  0x%08x | 0x%08x 0x%08x 0x%08x 0x%08x\n",
-			       KB(4 * i),
-			       gen6_gtt_pte(i + 0),
-			       gen6_gtt_pte(i + 1),
-			       gen6_gtt_pte(i + 2),
-			       gen6_gtt_pte(i + 3) );
+			printf("  0x%08" PRIx64 " | 0x%08x 0x%08x 0x%08x 0x%08x\n",
+			       (uint64_t)KB(4) * i,
+			       (gen6_gtt_pte_t)ptes[i + 0],
+			       (gen6_gtt_pte_t)ptes[i + 1],
+			       (gen6_gtt_pte_t)ptes[i + 2],
+			       (gen6_gtt_pte_t)ptes[i + 3]);
 		} else {
-			printf("  0x%08x | 0x%016" PRIx64 " 0x%016" PRIx64
+			printf("  0x%08" PRIx64 " | 0x%016" PRIx64 " 0x%016" PRIx64
 			       " 0x%016" PRIx64 " 0x%016" PRIx64 " \n",
-			       KB(4 * i),
-			       gen8_gtt_pte(i + 0),
-			       gen8_gtt_pte(i + 1),
-			       gen8_gtt_pte(i + 2),
-			       gen8_gtt_pte(i + 3) );
+			       (uint64_t)KB(4) * i,
+			       ptes[i + 0], ptes[i + 1],
+			       ptes[i + 2], ptes[i + 3]);
+		}
+	}
+}
+
+/*
+ * Every unused PTE points to the same scratch page, so the page most of the
+ * PTEs point to is taken to be the scratch page.
+ */
+static uint64_t find_scratch(void)
+{
+	struct { uint64_t phys, count; } top[16] = {};
+	unsigned int i, j, slot;
+
+	for (i = 0; i < num_ptes; i = j) {
+		uint64_t phys = get_phys(i);
+
+		for (j = i + 1; j < num_ptes && get_phys(j) == phys; j++)
+			;
+
+		slot = 0;
+		for (unsigned int k = 0; k < ARRAY_SIZE(top); k++) {
+			if (top[k].phys == phys && top[k].count) {
+				slot = k;
+				break;
+			}
+			if (top[k].count < top[slot].count)
+				slot = k;
+		}
+		if (top[slot].phys != phys) {
+			top[slot].phys = phys;
+			top[slot].count = 0;
+		}
+		top[slot].count += j - i;
+	}
+
+	slot = 0;
+	for (i = 1; i < ARRAY_SIZE(top); i++)
+		if (top[i].count > top[slot].count)
+			slot = i;
+
+	return top[slot].phys;
+}
+
+static bool pte_used(unsigned int index, uint64_t scratch)
+{
+	return ptes[index] & PTE_VALID && get_phys(index) != scratch;
+}
+
+static unsigned int hist_bucket(uint64_t pages)
+{
+	unsigned int bucket = 0;
+
+	while (pages >>= 1)
+		bucket++;
+
+	return min(bucket, HIST_BUCKETS - 1);
+}
+
+/*
+ * Splits the GTT into runs of used and free PTEs, and prints how much of it
+ * is in use and how that is spread out as a histogram of the run lengths.
+ */
+static void summary(void)
+{
+	uint64_t used_hist[HIST_BUCKETS] = {}, free_hist[HIST_BUCKETS] = {};
+	uint64_t scratch = find_scratch();
+	uint64_t used = 0, largest_free = 0;
+	unsigned int used_runs = 0, free_runs = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < num_ptes; i = j) {
+		bool in_use = pte_used(i, scratch);
+
+		for (j = i + 1; j < num_ptes && pte_used(j, scratch) == in_use; j++)
+			;
+
+		if (in_use) {
+			used += j - i;
+			used_runs++;
+			used_hist[hist_bucket(j - i)]++;
+		} else {
+			free_runs++;
+			free_hist[hist_bucket(j - i)]++;
+			if (j - i > largest_free)
+				largest_free = j - i;
+		}
+	}
+
+	printf("GTT: %" PRIu64 " MiB, scratch page 0x%" PRIx64 "\n",
+	       (uint64_t)num_ptes * KB(4) >> 20, scratch);
+	printf("used: %" PRIu64 " MiB in %u runs\n",
+	       used * KB(4) >> 20, used_runs);
+	printf("free: %" PRIu64 " MiB in %u holes, largest %" PRIu64 " KiB\n",
+	       (num_ptes - used) * KB(4) >> 20, free_runs,
+	       largest_free * KB(4) >> 10);
+	if (num_ptes > used)
+		printf("fragmentation: %.1f%%\n",
+		       100. * (1. - (double)largest_free / (num_ptes - used)));
+
+	printf("\n%12s %10s %10s\n", "run size", "used", "free");
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if (!used_hist[i] && !free_hist[i])
+			continue;
+
+		printf("%8" PRIu64 " KiB %10" PRIu64 " %10" PRIu64 "\n",
+		       (uint64_t)KB(4) << i >> 10, used_hist[i], free_hist[i]);
+	}
+}
+
+static void ranges(void)
+{
+	unsigned int start, end;
+
+	for (start = 0; start < num_ptes; start = end) {
+		uint64_t start_phys = get_phys(start);
+
+		/* Check if it's a linear sequence */
+		for (end = start + 1; end < num_ptes; end++)
+			if (get_phys(end) != start_phys + (uint64_t)KB(4) * (end - start))
+				break;
+		if (end - start > 1) {
+			printf("0x%08" PRIx64 " - 0x%08" PRIx64 ": linear from "
+			       "0x%" PRIx64 " to 0x%" PRIx64 "\n",
+			       (uint64_t)KB(4) * start,
+			       (uint64_t)KB(4) * (end - 1),
+			       start_phys,
+			       start_phys + (uint64_t)KB(4) * (end - start - 1));
+			continue;
+		}
+
+		/* Check if it's a constant sequence */
+		for (end = start + 1; end < num_ptes; end++)
+			if (get_phys(end) != start_phys)
+				break;
+		if (end - start > 1) {
+			printf("0x%08" PRIx64 " - 0x%08" PRIx64 ": constant 0x%" PRIx64 "\n",
+			       (uint64_t)KB(4) * start,
+			       (uint64_t)KB(4) * (end - 1), start_phys);
+			continue;
 		}
+
+		printf("0x%08" PRIx64 ": 0x%" PRIx64 "\n",
+		       (uint64_t)KB(4) * start, start_phys);
 	}
 }
 
 int main(int argc, char **argv)
 {
 	struct pci_device *pci_dev;
-	unsigned int start, gtt_size;
+	unsigned int gsm_size;
 	int flag[] = {
 		PCI_DEV_MAP_FLAG_WRITE_COMBINE,
 		PCI_DEV_MAP_FLAG_WRITABLE,
@@ -157,6 +318,7 @@ int main(int argc, char **argv)
 	for (f = 0; flag[f] != 0; f++) {
 		if (IS_GEN3(devid)) {
 			/* 915/945 chips has GTT range in bar 3 */
+			gsm_size = pci_dev->regions[3].size;
 			if (pci_device_map_range(pci_dev,
 						 pci_dev->regions[3].base_addr,
 						 pci_dev->regions[3].size,
@@ -171,6 +333,7 @@ int main(int argc, char **argv)
 			if (IS_GEN4(devid))
 				offset = KB(512);
 
+			gsm_size = offset;
 			if (pci_device_map_range(pci_dev,
 						 pci_dev->regions[0].base_addr + offset,
 						 offset,
@@ -184,52 +347,15 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	gtt_size = pci_dev->regions[0].size / 2;
-	if (argc > 1 && !strncmp("-d", argv[1], 2)) {
-		pte_dump(gtt_size, 0);
-		return 0;
-	}
-
-	for (start = 0; start < gtt_size; start += KB(4)) {
-		uint64_t start_phys = get_phys(start);
-		uint32_t end;
-		int constant_length = 0;
-		int linear_length = 0;
-
-		/* Check if it's a linear sequence */
-		for (end = start + KB(4); end < gtt_size; end += KB(4)) {
-			uint64_t end_phys = get_phys(end);
-			if (end_phys == start_phys + (end - start))
-				linear_length++;
-			else
-				break;
-		}
-		if (linear_length > 0) {
-			printf("0x%08x - 0x%08x: linear from "
-			       "0x%" PRIx64 " to 0x%" PRIx64 "\n",
-			       start, end - KB(4),
-			       start_phys, start_phys + (end - start) - KB(4));
-			start = end - KB(4);
-			continue;
-		}
-
-		/* Check if it's a constant sequence */
-		for (end = start + KB(4); end < gtt_size; end += KB(4)) {
-			uint64_t end_phys = get_phys(end);
-			if (end_phys == start_phys)
-				constant_length++;
-			else
-				break;
-		}
-		if (constant_length > 0) {
-			printf("0x%08x - 0x%08x: constant 0x%" PRIx64 "\n",
-			       start, end - KB(4), start_phys);
-			start = end - KB(4);
-			continue;
-		}
+	read_ptes(gsm_size);
 
-		printf("0x%08x: 0x%" PRIx64 "\n", start, start_phys);
-	}
+	if (argc > 1 && !strncmp("-d", argv[1], 2))
+		pte_dump();
+	else if (argc > 1 && !strncmp("-s", argv[1], 2))
+		summary();
+	else
+		ranges();
 
+	free(ptes);
 	return 0;
 }
@@ -39,6 +39,7 @@
 #include <sys/mman.h>
 #include <assert.h>
 #include <pthread.h>
+#include <zlib.h>
 
 #include "igt.h"
 
@@ -59,6 +60,7 @@
 #define RELAY_FILE_NAME  "guc_log"
 #define DEFAULT_OUTPUT_FILE_NAME  "guc_log_dump.dat"
 #define CONTROL_FILE_NAME "i915_guc_log_control"
+#define INFO_FILE_NAME "i915_guc_log_info"
 
 char *read_buffer;
 char *out_filename;
@@ -73,6 +75,10 @@ int relay_fd, outfile_fd = -1;
 uint32_t test_duration, max_filesize;
 pthread_cond_t underflow_cond, overflow_cond;
 bool stop_logging, discard_oldlogs, capturing_stopped;
+bool compress_logs, zerocopy;
+gzFile gz_outfile;
+int pipe_fds[2] = { -1, -1 };
+uint32_t logger_stalls;
 
 static void guc_log_control(bool enable, uint32_t log_level)
 {
@@ -105,6 +111,58 @@ static void guc_log_control(bool enable, uint32_t log_level)
 	close(control_fd);
 }
 
+struct log_stats {
+	uint32_t relay_full;
+	uint32_t overflows;
+};
+
+/*
+ * i915 counts the GuC log buffer overflows, where the GuC wrapped around
+ * before the flush interrupt got handled, and the times there was no free
+ * relay subbuffer because the logger didn't keep up. Either means lost logs.
+ */
+static bool read_log_stats(struct log_stats *stats)
+{
+	char buf[4096], *s;
+	int fd, len;
+
+	memset(stats, 0, sizeof(*stats));
+
+	fd = igt_debugfs_open(-1, INFO_FILE_NAME, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len < 0)
+		return false;
+	buf[len] = '\0';
+
+	s = strstr(buf, "Relay full count:");
+	if (s)
+		stats->relay_full = strtoul(s + strlen("Relay full count:"),
+					    NULL, 10);
+
+	for (s = buf; (s = strstr(s, "overflow count")); )
+		stats->overflows += strtoul(s + strlen("overflow count"),
+					    &s, 10);
+
+	return true;
+}
+
+static void write_logs(const void *ptr, int size)
+{
+	int ret;
+
+	if (compress_logs)
+		ret = gzwrite(gz_outfile, ptr, size);
+	else
+		ret = write(outfile_fd, ptr, size);
+	igt_assert_f(ret == size, "couldn't dump the logs in a file\n");
+
+	total_bytes_written += ret;
+}
+
 static void int_sig_handler(int sig)
 {
 	igt_info("received signal %d\n", sig);
@@ -128,11 +186,8 @@ static void pull_leftover_data(void)
 
 		bytes_read += ret;
 
-		if (outfile_fd >= 0) {
-			ret = write(outfile_fd, read_buffer, SUBBUF_SIZE);
-			igt_assert_f(ret == SUBBUF_SIZE, "couldn't dump the logs in a file\n");
-			total_bytes_written += ret;
-		}
+		if (outfile_fd >= 0)
+			write_logs(read_buffer, SUBBUF_SIZE);
 	} while(1);
 
 	igt_debug("%u bytes flushed\n", bytes_read);
@@ -149,6 +204,8 @@ static void pull_data(void)
 	int ret;
 
 	pthread_mutex_lock(&mutex);
+	if (num_filled_bufs() >= num_buffers)
+		logger_stalls++;
 	while (num_filled_bufs() >= num_buffers) {
 		igt_debug("overflow, will wait, produced %u, consumed %u\n", produced, consumed);
 		/* Stall the main thread in case of overflow, as there are no
@@ -183,7 +240,6 @@ static void pull_data(void)
 static void *flusher(void *arg)
 {
 	char *ptr;
-	int ret;
 
 	igt_debug("execution started of flusher thread\n");
 
@@ -206,10 +262,8 @@ static void *flusher(void *arg)
 
 		ptr = read_buffer + (consumed % num_buffers) * SUBBUF_SIZE;
 
-		ret = write(outfile_fd, ptr, SUBBUF_SIZE);
-		igt_assert_f(ret == SUBBUF_SIZE, "couldn't dump the logs in a file\n");
+		write_logs(ptr, SUBBUF_SIZE);
 
-		total_bytes_written += ret;
 		if (max_filesize && (total_bytes_written > MB(max_filesize))) {
 			igt_debug("reached the target of %" PRIu64 " bytes\n", MB(max_filesize));
 			stop_logging = true;
@@ -224,6 +278,53 @@ static void *flusher(void *arg)
 	return NULL;
 }
 
+/*
+ * In zerocopy mode the relay subbuffer pages are spliced into a pipe that
+ * stands in for the logger side buffers, and from there into the output
+ * file, so the logs never get copied through userspace.
+ */
+static void splice_data(void)
+{
+	ssize_t ret;
+
+	ret = splice(relay_fd, NULL, pipe_fds[1], NULL, SUBBUF_SIZE,
+		     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (ret < 0 && errno == EAGAIN) {
+		/* The pipe is full, wait for the flusher to make room */
+		igt_debug("overflow, will wait for the flusher\n");
+		logger_stalls++;
+		ret = splice(relay_fd, NULL, pipe_fds[1], NULL, SUBBUF_SIZE,
+			     SPLICE_F_MOVE);
+	}
+	igt_assert_f(ret >= 0, "failed to splice from the guc log file\n");
+
+	if (!ret)
+		igt_debug("no data read from the relay file\n");
+}
+
+static void *splice_flusher(void *arg)
+{
+	ssize_t ret;
+
+	igt_debug("execution started of flusher thread\n");
+
+	/* Runs until the pipe is drained after the write end got closed */
+	do {
+		ret = splice(pipe_fds[0], NULL, outfile_fd, NULL, SUBBUF_SIZE,
+			     SPLICE_F_MOVE | SPLICE_F_MORE);
+		igt_assert_f(ret >= 0, "couldn't splice the logs in a file\n");
+
+		total_bytes_written += ret;
+		if (max_filesize && (total_bytes_written > MB(max_filesize))) {
+			igt_debug("reached the target of %" PRIu64 " bytes\n", MB(max_filesize));
+			stop_logging = true;
+		}
+	} while (ret);
+
+	igt_debug("flusher to exit now\n");
+	return NULL;
+}
+
 static void init_flusher_thread(void)
 {
 	struct sched_param	thread_sched;
@@ -251,7 +352,8 @@ static void init_flusher_thread(void)
 	ret = pthread_attr_setschedparam(&p_attr, &thread_sched);
 	igt_assert_f(ret == 0, "couldn't set thread priority\n");
 
-	ret = pthread_create(&flush_thread, &p_attr, flusher, NULL);
+	ret = pthread_create(&flush_thread, &p_attr,
+			     zerocopy ? splice_flusher : flusher, NULL);
 	igt_assert_f(ret == 0, "thread creation failed\n");
 
 	ret = pthread_attr_destroy(&p_attr);
@@ -276,20 +378,53 @@ static void open_relay_file(void)
 
 static void open_output_file(void)
 {
+	int flags = O_CREAT | O_WRONLY | O_TRUNC;
+
 	/* Use Direct IO mode for the output file, as the data written is not
 	 * supposed to be accessed again, this saves a copy of data from App's
 	 * buffer to kernel buffer (Page cache). Due to no buffering on kernel
 	 * side, data is flushed out to disk faster and more buffering can be
 	 * done on the logger side to hide the disk IO latency.
+	 * Neither the compressed stream nor spliced pages are suitably sized
+	 * and aligned for it though.
 	 */
-	outfile_fd = open(out_filename ? : DEFAULT_OUTPUT_FILE_NAME,
-			  O_CREAT | O_WRONLY | O_TRUNC | O_DIRECT,
-			  0440);
+	if (!compress_logs && !zerocopy)
+		flags |= O_DIRECT;
+
+	outfile_fd = open(out_filename ? :
+			  compress_logs ? DEFAULT_OUTPUT_FILE_NAME ".gz" :
+			  DEFAULT_OUTPUT_FILE_NAME,
+			  flags, 0440);
 	igt_assert_f(outfile_fd >= 0, "couldn't open the output file\n");
 
+	if (compress_logs) {
+		/* Favour speed, the logs have to keep up with the GuC */
+		gz_outfile = gzdopen(outfile_fd, "wb1");
+		igt_assert_f(gz_outfile, "couldn't set up the compression\n");
+	}
+
 	free(out_filename);
 }
 
+static void open_pipe(void)
+{
+	int size = num_buffers * SUBBUF_SIZE;
+	int ret;
+
+	ret = pipe(pipe_fds);
+	igt_assert_f(ret == 0, "couldn't create the pipe\n");
+
+	/* The pipe replaces the logger side buffers, make it as big as allowed */
+	while (fcntl(pipe_fds[1], F_SETPIPE_SZ, size) < 0) {
+		igt_assert_f((errno == EPERM || errno == ENOMEM) &&
+			     size > SUBBUF_SIZE,
+			     "couldn't resize the pipe\n");
+		size /= 2;
+	}
+
+	igt_debug("pipe can hold %d bytes\n", fcntl(pipe_fds[1], F_GETPIPE_SZ));
+}
+
 static void init_main_thread(void)
 {
 	struct sched_param	thread_sched;
@@ -310,6 +445,10 @@ static void init_main_thread(void)
 	if (signal(SIGALRM, int_sig_handler) == SIG_ERR)
 		igt_assert_f(0, "SIGALRM handler registration failed\n");
 
+	/* In zerocopy mode, the buffer is only used for the leftover logs */
+	if (zerocopy)
+		num_buffers = 1;
+
 	/* Need an aligned pointer for direct IO */
 	ret = posix_memalign((void **)&read_buffer, PAGE_SIZE, num_buffers * SUBBUF_SIZE);
 	igt_assert_f(ret == 0, "couldn't allocate the read buffer\n");
@@ -367,6 +506,14 @@ static int parse_options(int opt, int opt_index, void *data)
 		discard_oldlogs = true;
 		igt_debug("old/boot-time logs will be discarded\n");
 		break;
+	case 'c':
+		compress_logs = true;
+		igt_debug("logs will be compressed\n");
+		break;
+	case 'z':
+		zerocopy = true;
+		igt_debug("logs will be spliced to the output file\n");
+		break;
 	}
 
 	return 0;
@@ -382,6 +529,8 @@ static void process_command_line(int argc, char **argv)
 		{"polltimeout", required_argument, 0, 'p'},
 		{"size", required_argument, 0, 's'},
 		{"discard", no_argument, 0, 'd'},
+		{"compress", no_argument, 0, 'c'},
+		{"zerocopy", no_argument, 0, 'z'},
 		{ 0, 0, 0, 0 }
 	};
 
@@ -392,15 +541,22 @@ static void process_command_line(int argc, char **argv)
 		"  -t --testduration=sec  max duration in seconds for which the logger should run\n"
 		"  -p --polltimeout=ms    polling timeout in ms, -1 == indefinite wait for the new data\n"
 		"  -s --size=MB           max size of output file in MBs after which logging will be stopped\n"
-		"  -d --discard           discard the old/boot-time logs before entering into the capture loop\n";
+		"  -d --discard           discard the old/boot-time logs before entering into the capture loop\n"
+		"  -c --compress          gzip the logs while writing them out\n"
+		"  -z --zerocopy          splice the logs from the relay file to the output file without copying them, by way of a pipe of -b buffers\n";
 
-	igt_simple_init_parse_opts(&argc, argv, "v:o:b:t:p:s:d", long_options,
+	igt_simple_init_parse_opts(&argc, argv, "v:o:b:t:p:s:dcz", long_options,
 				   help, parse_options, NULL);
+
+	igt_assert_f(!(compress_logs && zerocopy),
+		     "compression needs the logs copied, -c and -z are exclusive\n");
 }
 
 int main(int argc, char **argv)
 {
+	struct log_stats start_stats, end_stats;
 	struct pollfd relay_poll_fd;
+	bool has_stats;
 	int nfds;
 	int ret;
 
@@ -408,6 +564,11 @@ int main(int argc, char **argv)
 
 	init_main_thread();
 
+	if (zerocopy)
+		open_pipe();
+
+	has_stats = read_log_stats(&start_stats);
+
 	/* Use a separate thread for flushing the logs to a file on disk.
 	 * Main thread will buffer the data from relay file in its pool of
 	 * buffers and other thread will flush the data to disk in background.
@@ -449,7 +610,10 @@ int main(int argc, char **argv)
 		if (!relay_poll_fd.revents)
 			continue;
 
-		pull_data();
+		if (zerocopy)
+			splice_data();
+		else
+			pull_data();
 	} while (!stop_logging);
 
 	/* Pause logging on the GuC side */
@@ -458,13 +622,27 @@ int main(int argc, char **argv)
 	/* Signal flusher thread to make an exit */
 	capturing_stopped = 1;
 	pthread_cond_signal(&underflow_cond);
+	if (zerocopy)
+		close(pipe_fds[1]);
 	pthread_join(flush_thread, NULL);
 
 	pull_leftover_data();
 	igt_info("total bytes written %" PRIu64 "\n", total_bytes_written);
 
+	if (has_stats && read_log_stats(&end_stats))
+		igt_info("GuC log buffer overflowed %u times, relay was full %u times\n",
+			 end_stats.overflows - start_stats.overflows,
+			 end_stats.relay_full - start_stats.relay_full);
+	igt_info("logger ran out of buffers %u times\n", logger_stalls);
+
 	free(read_buffer);
 	close(relay_fd);
-	close(outfile_fd);
+	if (zerocopy)
+		close(pipe_fds[0]);
+	if (compress_logs)
+		igt_assert_f(gzclose(gz_outfile) == Z_OK,
+			     "couldn't finish the compressed file\n");
+	else
+		close(outfile_fd);
 	igt_exit();
 }
@@ -34,6 +34,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <stdarg.h>
+#include <time.h>
 #include "intel_chipset.h"
 #include "intel_io.h"
 #include "igt_sysfs.h"
@@ -151,6 +153,195 @@ static void enables_rbs(int row, int bank, int sbank, int slice)
 		reg->row0_enable = 0;
 }
 
+/*
+ * With --remap the listener disables the rows reported to it, but no faster
+ * than --remap-rate per second so that an error storm cannot keep it
+ * rewriting the log registers. Locations already waiting are not queued
+ * again, and new ones are dropped while the queue is full.
+ */
+#define REMAP_QUEUE_SIZE 256
+#define LISTEN_BATCH 64
+#define STATS_PERIOD_MS (60 * 1000)
+
+static struct remap_queue {
+	struct l3_location loc[REMAP_QUEUE_SIZE];
+	unsigned int head, count;
+
+	unsigned long queued;
+	unsigned long coalesced;
+	unsigned long dropped;
+	unsigned long remapped;
+	unsigned long failed;
+} remapq;
+
+static bool listen_daemon;
+
+static void report(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	if (listen_daemon) {
+		vsyslog(LOG_INFO, fmt, ap);
+	} else {
+		vfprintf(stderr, fmt, ap);
+		fputc('\n', stderr);
+	}
+	va_end(ap);
+}
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+static void remap_queue_push(const struct l3_location *loc)
+{
+	unsigned int i;
+
+	for (i = 0; i < remapq.count; i++) {
+		const struct l3_location *q =
+			&remapq.loc[(remapq.head + i) % REMAP_QUEUE_SIZE];
+
+		if (q->slice == loc->slice && q->row == loc->row &&
+		    q->bank == loc->bank && q->subbank == loc->subbank) {
+			remapq.coalesced++;
+			return;
+		}
+	}
+
+	if (remapq.count == REMAP_QUEUE_SIZE) {
+		remapq.dropped++;
+		return;
+	}
+
+	remapq.loc[(remapq.head + remapq.count++) % REMAP_QUEUE_SIZE] = *loc;
+	remapq.queued++;
+}
+
+static bool row_disabled(const struct l3_location *loc)
+{
+	struct l3_log_register *reg = &l3logs[loc->slice][loc->bank][loc->subbank];
+
+	return (reg->row0_enable && reg->row0 == loc->row) ||
+		(reg->row1_enable && reg->row1 == loc->row);
+}
+
+/* Disables the row at the head of the queue and writes back its slice */
+static void remap_queue_pop(const int *fd)
+{
+	struct l3_location loc = remapq.loc[remapq.head];
+
+	remapq.head = (remapq.head + 1) % REMAP_QUEUE_SIZE;
+	remapq.count--;
+
+	if (loc.slice >= MAX_SLICES || fd[loc.slice] < 0 ||
+	    (which_slice != -1 && loc.slice != which_slice) ||
+	    loc.bank >= num_banks() || loc.bank >= MAX_BANKS_PER_SLICE ||
+	    loc.subbank >= NUM_SUBBANKS || loc.row >= MAX_ROW) {
+		report("Parity error on %d,%d,%d,%d is out of range",
+		       loc.slice, loc.row, loc.bank, loc.subbank);
+		remapq.failed++;
+		return;
+	}
+
+	/* Reported again before the remap took effect */
+	if (row_disabled(&loc)) {
+		remapq.coalesced++;
+		return;
+	}
+
+	if (disable_rbs(loc.row, loc.bank, loc.subbank, loc.slice)) {
+		report("No spare row left for %d,%d,%d,%d",
+		       loc.slice, loc.row, loc.bank, loc.subbank);
+		remapq.failed++;
+		return;
+	}
+
+	if (pwrite(fd[loc.slice], l3logs[loc.slice],
+		   NUM_REGS * sizeof(uint32_t), 0) < 0) {
+		report("Writing sysfs: %m");
+		enables_rbs(loc.row, loc.bank, loc.subbank, loc.slice);
+		remapq.failed++;
+		return;
+	}
+
+	report("Disabled row %d,%d,%d,%d",
+	       loc.slice, loc.row, loc.bank, loc.subbank);
+	remapq.remapped++;
+}
+
+static void report_stats(const struct l3_parity *par)
+{
+	report("uevents: %lu received, %lu ignored, %lu duplicates; "
+	       "remaps: %lu queued, %lu coalesced, %lu dropped, "
+	       "%lu done, %lu failed, %u pending",
+	       par->received, par->ignored, par->duplicates,
+	       remapq.queued, remapq.coalesced, remapq.dropped,
+	       remapq.remapped, remapq.failed, remapq.count);
+}
+
+static void listen_loop(struct l3_parity *par, const int *fd,
+			bool remap, unsigned int rate)
+{
+	uint64_t interval = 1000 / rate;
+	uint64_t next_remap = 0, next_stats;
+	unsigned long last_received = 0;
+
+	next_stats = now_ms() + STATS_PERIOD_MS;
+	for (;;) {
+		struct l3_location loc[LISTEN_BATCH];
+		uint64_t now = now_ms(), wake;
+		int timeout, n, i;
+
+		/* Sleep until the next remap is due, if any is waiting */
+		wake = listen_daemon ? next_stats : UINT64_MAX;
+		if (remapq.count && next_remap < wake)
+			wake = next_remap;
+		if (wake == UINT64_MAX)
+			timeout = -1;
+		else
+			timeout = wake > now ? wake - now : 0;
+
+		n = l3_listen_batch(par, loc, LISTEN_BATCH, timeout);
+		assert(n >= 0);
+
+		for (i = 0; i < n; i++) {
+			if (remap) {
+				remap_queue_push(&loc[i]);
+				continue;
+			}
+
+			report("Parity error detected on: %d,%d,%d,%d. "
+			       "Try to run intel_l3_parity -r %d -b %d -s %d -w %d -d",
+			       loc[i].slice, loc[i].row, loc[i].bank, loc[i].subbank,
+			       loc[i].row, loc[i].bank, loc[i].subbank, loc[i].slice);
+		}
+
+		now = now_ms();
+		if (remapq.count && now >= next_remap) {
+			remap_queue_pop(fd);
+			next_remap = now + interval;
+		}
+
+		if (!listen_daemon) {
+			/* One burst of errors, then leave once it is handled */
+			if (par->received > par->ignored && !remapq.count) {
+				report_stats(par);
+				return;
+			}
+		} else if (now >= next_stats) {
+			if (par->received != last_received)
+				report_stats(par);
+			last_received = par->received;
+			next_stats = now + STATS_PERIOD_MS;
+		}
+	}
+}
+
 static void usage(const char *name)
 {
 	printf("usage: %s [OPTIONS] [ACTION]\n"
@@ -161,6 +352,8 @@ static void usage(const char *name)
 		"  -s, --subbank=[subbank]		The subbank to act upon (default 0)\n"
 		"  -w, --slice=[slice]			Which slice to act on (default: -1 [all])\n"
 		"    , --daemon				Run the listener (-L) as a daemon\n"
+		"    , --remap				Make the listener (-L) disable the rows with errors\n"
+		"    , --remap-rate=[n]			Disable at most n rows per second (default 1)\n"
 		" ACTIONS (only 1 may be specified at a time):\n"
 		"  -h, --help				Display this help\n"
 		"  -H, --hw-info				Display the current L3 properties\n"
@@ -181,6 +374,8 @@ int main(int argc, char *argv[])
 	int fd[REAL_MAX_SLICES] = {0}, ret, i;
 	int action = '0';
 	int daemonize = 0;
+	int remap = 0;
+	unsigned int remap_rate = 1;
 	int device, dir;
 	uint32_t dft;
 
@@ -236,6 +431,8 @@ int main(int argc, char *argv[])
 			{ "subbank", required_argument, 0, 's' },
 			{ "slice", required_argument, 0, 'w' },
 			{ "daemon", no_argument, &daemonize, 1 },
+			{ "remap", no_argument, &remap, 1 },
+			{ "remap-rate", required_argument, 0, 'R' },
 			{0, 0, 0, 0}
 		};
 
@@ -279,6 +476,11 @@ int main(int argc, char *argv[])
 				if (which_slice >= MAX_SLICES)
 					exit(EXIT_FAILURE);
 				break;
+			case 'R':
+				remap_rate = atoi(optarg);
+				if (remap_rate < 1 || remap_rate > 1000)
+					exit(EXIT_FAILURE);
+				break;
 			case 'i':
 			case 'u':
 				if (!IS_HASWELL(devid)) {
@@ -323,14 +525,15 @@ int main(int argc, char *argv[])
 	/* Daemon doesn't work like the other commands */
 	if (action == 'L') {
 		struct l3_parity par;
-		struct l3_location loc;
 		if (daemonize) {
 			assert(daemon(0, 0) == 0);
 			openlog(argv[0], LOG_CONS | LOG_PID, LOG_USER);
 		}
+		listen_daemon = daemonize == 1;
+		intel_register_access_fini();
 		memset(&par, 0, sizeof(par));
 		assert(l3_uevent_setup(&par) == 0);
-		assert(l3_listen(&par, daemonize == 1, &loc) == 0);
+		listen_loop(&par, fd, remap == 1, remap_rate);
 		exit(EXIT_SUCCESS);
 	}
 
@@ -9,6 +9,11 @@ struct l3_parity {
 	struct udev_monitor *uevent_monitor;
 	int fd;
 	fd_set fdset;
+
+	/* What l3_listen_batch() made of the uevents it received */
+	unsigned long received;
+	unsigned long ignored;
+	unsigned long duplicates;
 };
 
 struct l3_location {
@@ -21,6 +26,13 @@ struct l3_location {
 int l3_uevent_setup(struct l3_parity *par);
 /* Listens (blocks) for an l3 parity event. Returns the location of the error. */
 int l3_listen(struct l3_parity *par, bool daemon, struct l3_location *loc);
+/*
+ * Waits up to timeout_ms (-1 for ever) for l3 parity events, then drains all
+ * of those already queued, up to max distinct locations. Returns the number
+ * of locations stored in loc, 0 on timeout, or -1 on error.
+ */
+int l3_listen_batch(struct l3_parity *par, struct l3_location *loc, int max,
+		    int timeout_ms);
 #define l3_uevent_teardown(par) {}
 
 #endif
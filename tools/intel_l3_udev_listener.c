@@ -24,6 +24,9 @@
 #include "config.h"
 
 #include <libudev.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,6 +40,9 @@
 #define I915_L3_PARITY_UEVENT "L3_PARITY_ERROR"
 #endif
 
+/* Room for the bursts of uevents sent while the listener is busy */
+#define UEVENT_RCVBUF (4 << 20)
+
 int l3_uevent_setup(struct l3_parity *par)
 {
 	struct udev *udev;
@@ -61,7 +67,16 @@ int l3_uevent_setup(struct l3_parity *par)
 	if (ret < 0)
 		goto err_out;
 
+	/* Best effort, the default is fine when the events trickle in */
+	udev_monitor_set_receive_buffer_size(uevent_monitor, UEVENT_RCVBUF);
+
+	/* Draining stops at the first receive that would block */
 	fd = udev_monitor_get_fd(uevent_monitor);
+	ret = fcntl(fd, F_GETFL);
+	if (ret < 0 || fcntl(fd, F_SETFL, ret | O_NONBLOCK) < 0) {
+		ret = -1;
+		goto err_out;
+	}
 	FD_ZERO(&fdset);
 	FD_SET(fd, &fdset);
 
@@ -76,49 +91,119 @@ err_out:
 	return ret;
 }
 
-int l3_listen(struct l3_parity *par, bool daemon, struct l3_location *loc)
+static int get_property(struct udev_device *dev, const char *key)
 {
-	struct udev_device *udev_dev;
-	const char *parity_status;
-	char *err_msg;
-	int ret;
+	const char *value = udev_device_get_property_value(dev, key);
 
-again:
-	ret = select(par->fd + 1, &par->fdset, NULL, NULL, NULL);
-	/* Number of bits set is returned, must be >= 1 */
-	if (ret <= 0) {
-		return ret;
-	}
+	return value ? atoi(value) : -1;
+}
 
-	assert(FD_ISSET(par->fd, &par->fdset));
+/* Returns 0 and fills loc if dev reports an l3 parity error */
+static int parse_uevent(struct udev_device *dev, struct l3_location *loc)
+{
+	const char *parity_status;
+	int slice, row, bank, subbank;
 
-	udev_dev = udev_monitor_receive_device(par->uevent_monitor);
-	if (!udev_dev)
+	parity_status = udev_device_get_property_value(dev, I915_L3_PARITY_UEVENT);
+	if (!parity_status || strncmp(parity_status, "1", 1))
 		return -1;
 
-	parity_status = udev_device_get_property_value(udev_dev, I915_L3_PARITY_UEVENT);
-	if (strncmp(parity_status, "1", 1))
-		goto again;
+	slice = get_property(dev, "SLICE");
+	row = get_property(dev, "ROW");
+	bank = get_property(dev, "BANK");
+	subbank = get_property(dev, "SUBBANK");
+	if (slice < 0 || row < 0 || bank < 0 || subbank < 0)
+		return -1;
 
-	loc->slice = atoi(udev_device_get_property_value(udev_dev, "SLICE"));
-	loc->row = atoi(udev_device_get_property_value(udev_dev, "ROW"));
-	loc->bank = atoi(udev_device_get_property_value(udev_dev, "BANK"));
-	loc->subbank = atoi(udev_device_get_property_value(udev_dev, "SUBBANK"));
+	loc->slice = slice;
+	loc->row = row;
+	loc->bank = bank;
+	loc->subbank = subbank;
+	return 0;
+}
 
-	udev_device_unref(udev_dev);
+static bool same_location(const struct l3_location *a,
+			  const struct l3_location *b)
+{
+	return a->slice == b->slice && a->row == b->row &&
+		a->bank == b->bank && a->subbank == b->subbank;
+}
 
-	assert(asprintf(&err_msg, "Parity error detected on: %d,%d,%d,%d. "
-			"Try to run intel_l3_parity -r %d -b %d -s %d -w %d -d",
-			loc->slice, loc->row, loc->bank, loc->subbank,
-			loc->row, loc->bank, loc->subbank, loc->slice) != -1);
-	if (daemon) {
-		syslog(LOG_INFO, "%s\n", err_msg);
-		goto again;
+int l3_listen_batch(struct l3_parity *par, struct l3_location *loc, int max,
+		    int timeout_ms)
+{
+	struct pollfd pfd = { .fd = par->fd, .events = POLLIN };
+	int count = 0, ret;
+
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret < 0)
+		return errno == EINTR ? 0 : -1;
+	if (ret == 0)
+		return 0;
+
+	/*
+	 * An error storm reports the same row many times over, so take in
+	 * everything queued on the socket and keep each location once. Once
+	 * loc is full the rest stays queued for the next call.
+	 */
+	while (count < max) {
+		struct udev_device *udev_dev;
+		struct l3_location l;
+		int i;
+
+		udev_dev = udev_monitor_receive_device(par->uevent_monitor);
+		if (!udev_dev)
+			break;
+
+		par->received++;
+		ret = parse_uevent(udev_dev, &l);
+		udev_device_unref(udev_dev);
+		if (ret) {
+			par->ignored++;
+			continue;
+		}
+
+		for (i = 0; i < count; i++)
+			if (same_location(&loc[i], &l))
+				break;
+		if (i < count) {
+			par->duplicates++;
+			continue;
+		}
+
+		loc[count++] = l;
 	}
 
-	fprintf(stderr, "%s\n", err_msg);
+	return count;
+}
 
-	free(err_msg);
+int l3_listen(struct l3_parity *par, bool daemon, struct l3_location *loc)
+{
+	struct l3_location batch[64];
+	char *err_msg;
+	int ret, i;
+
+again:
+	ret = l3_listen_batch(par, batch, sizeof(batch) / sizeof(batch[0]), -1);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < ret; i++) {
+		*loc = batch[i];
+
+		assert(asprintf(&err_msg, "Parity error detected on: %d,%d,%d,%d. "
+				"Try to run intel_l3_parity -r %d -b %d -s %d -w %d -d",
+				loc->slice, loc->row, loc->bank, loc->subbank,
+				loc->row, loc->bank, loc->subbank, loc->slice) != -1);
+		if (daemon)
+			syslog(LOG_INFO, "%s\n", err_msg);
+		else
+			fprintf(stderr, "%s\n", err_msg);
+		free(err_msg);
+	}
+
+	if (daemon || !ret)
+		goto again;
 
 	return 0;
 }
@@ -60,9 +60,12 @@ struct config {
 	char *mmiofile;
 	uint32_t devid;
 
-	/* read: number of registers to read */
+	/* read: number of registers to read, sample: number of samples */
 	uint32_t count;
 
+	/* sample: sampling period in microseconds */
+	uint32_t period;
+
 	/* write: do a posting read */
 	bool post;
 
@@ -80,6 +83,7 @@ struct config {
 
 	struct reg *regs;
 	ssize_t regcount;
+	struct reg_index index;
 
 	int verbosity;
 };
@@ -88,28 +92,22 @@ struct config {
 static int set_reg_by_addr(struct config *config, struct reg *reg,
 			   uint32_t addr)
 {
-	int i;
+	struct reg *r;
 
 	reg->addr = addr;
 	if (reg->name)
 		free(reg->name);
 	reg->name = NULL;
 
-	for (i = 0; i < config->regcount; i++) {
-		struct reg *r = &config->regs[i];
-
-		if (reg->port_desc.port != r->port_desc.port)
-			continue;
-
-		/* ->mmio_offset should be 0 for non-MMIO ports. */
-		if (addr + reg->mmio_offset == r->addr + r->mmio_offset) {
-			/* Always output the "normalized" offset+addr. */
-			reg->mmio_offset = r->mmio_offset;
-			reg->addr = r->addr;
+	/* ->mmio_offset should be 0 for non-MMIO ports. */
+	r = intel_reg_spec_find_addr(&config->index, reg->port_desc.port,
+				     addr + reg->mmio_offset);
+	if (r) {
+		/* Always output the "normalized" offset+addr. */
+		reg->mmio_offset = r->mmio_offset;
+		reg->addr = r->addr;
 
-			reg->name = r->name ? strdup(r->name) : NULL;
-			break;
-		}
+		reg->name = r->name ? strdup(r->name) : NULL;
 	}
 
 	return 0;
@@ -119,32 +117,22 @@ static int set_reg_by_addr(struct config *config, struct reg *reg,
 static int set_reg_by_name(struct config *config, struct reg *reg,
 			   const char *name)
 {
-	int i;
+	struct reg *r;
 
 	reg->name = strdup(name);
 	reg->addr = 0;
 
-	for (i = 0; i < config->regcount; i++) {
-		struct reg *r = &config->regs[i];
-
-		if (reg->port_desc.port != r->port_desc.port)
-			continue;
-
-		if (!r->name)
-			continue;
-
-		if (strcasecmp(name, r->name) == 0) {
-			reg->addr = r->addr;
+	r = intel_reg_spec_find_name(&config->index, reg->port_desc.port, name);
+	if (!r)
+		return -1;
 
-			/* Also get MMIO offset if not already specified. */
-			if (!reg->mmio_offset && r->mmio_offset)
-				reg->mmio_offset = r->mmio_offset;
+	reg->addr = r->addr;
 
-			return 0;
-		}
-	}
+	/* Also get MMIO offset if not already specified. */
+	if (!reg->mmio_offset && r->mmio_offset)
+		reg->mmio_offset = r->mmio_offset;
 
-	return -1;
+	return 0;
 }
 
 static void to_binary(char *buf, size_t buflen, uint32_t val)
@@ -614,6 +602,47 @@ static int intel_reg_write(struct config *config, int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
+/* s has REGISTER..REGISTER, both on the same port */
+static int dump_range(struct config *config, const char *s)
+{
+	struct reg start, end, **regs;
+	const char *sep;
+	char *first;
+	size_t i, n;
+	int ret;
+
+	sep = strstr(s, "..");
+	if (!sep) {
+		fprintf(stderr, "dump: invalid range '%s'\n", s);
+		return -1;
+	}
+
+	first = strndup(s, sep - s);
+	ret = parse_reg(config, &start, first);
+	free(first);
+	if (ret || parse_reg(config, &end, sep + 2))
+		return -1;
+
+	if (start.port_desc.port != end.port_desc.port || start.engine ||
+	    end.engine) {
+		fprintf(stderr, "dump: range '%s' spans ports\n", s);
+		return -1;
+	}
+
+	n = intel_reg_spec_find_range(&config->index, start.port_desc.port,
+				      start.addr + start.mmio_offset,
+				      end.addr + end.mmio_offset, &regs);
+	for (i = 0; i < n; i++) {
+		/* can't dump sideband with mmiofile */
+		if (config->mmiofile && regs[i]->port_desc.port != PORT_MMIO)
+			continue;
+
+		dump_register(config, regs[i]);
+	}
+
+	return 0;
+}
+
 static int intel_reg_dump(struct config *config, int argc, char *argv[])
 {
 	struct reg *reg;
@@ -624,7 +653,10 @@ static int intel_reg_dump(struct config *config, int argc, char *argv[])
 	else
 		intel_register_access_init(config->pci_dev, 0, -1);
 
-	for (i = 0; i < config->regcount; i++) {
+	for (i = 1; i < argc; i++)
+		dump_range(config, argv[i]);
+
+	for (i = 0; argc == 1 && i < config->regcount; i++) {
 		reg = &config->regs[i];
 
 		/* can't dump sideband with mmiofile */
@@ -639,6 +671,94 @@ static int intel_reg_dump(struct config *config, int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
+struct sample {
+	struct reg *regs;
+	int count;
+	uint64_t start;
+};
+
+static bool print_sample(void *data, uint64_t time_ns, const uint32_t *values)
+{
+	struct sample *sample = data;
+	int i;
+
+	if (!sample->start)
+		sample->start = time_ns;
+
+	printf("%.6f", (time_ns - sample->start) * 1e-9);
+	for (i = 0; i < sample->count; i++)
+		printf(" 0x%08x", values[i]);
+	printf("\n");
+
+	return true;
+}
+
+static int intel_reg_sample(struct config *config, int argc, char *argv[])
+{
+	struct intel_register_batch *batch;
+	struct sample sample = {};
+	uint32_t *offsets;
+	int i;
+
+	if (argc == 1) {
+		fprintf(stderr, "sample: no registers specified\n");
+		return EXIT_FAILURE;
+	}
+
+	if (config->mmiofile) {
+		fprintf(stderr, "specifying --mmio=FILE is not compatible\n");
+		return EXIT_FAILURE;
+	}
+
+	sample.regs = calloc(argc - 1, sizeof(*sample.regs));
+	offsets = calloc(argc - 1, sizeof(*offsets));
+	if (!sample.regs || !offsets) {
+		fprintf(stderr, "calloc: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (i = 1; i < argc; i++) {
+		struct reg *reg = &sample.regs[sample.count];
+
+		if (parse_reg(config, reg, argv[i]))
+			continue;
+
+		if (reg->port_desc.port != PORT_MMIO || reg->engine) {
+			fprintf(stderr, "sample: only plain MMIO registers can be sampled, skipping '%s'\n",
+				argv[i]);
+			continue;
+		}
+
+		offsets[sample.count++] = reg->mmio_offset + reg->addr;
+	}
+
+	if (!sample.count)
+		return EXIT_FAILURE;
+
+	intel_register_access_init(config->pci_dev, 0, -1);
+
+	printf("# time");
+	for (i = 0; i < sample.count; i++) {
+		if (sample.regs[i].name)
+			printf(" %s", sample.regs[i].name);
+		else
+			printf(" 0x%08x", offsets[i]);
+	}
+	printf("\n");
+
+	batch = intel_register_batch_create(offsets, sample.count);
+	intel_register_batch_sample(batch, config->period * 1000ull,
+				    config->count, print_sample, &sample);
+	intel_register_batch_destroy(batch);
+
+	intel_register_access_fini();
+
+	free(offsets);
+	free(sample.regs);
+
+	return EXIT_SUCCESS;
+}
+
 static int intel_reg_snapshot(struct config *config, int argc, char *argv[])
 {
 	int mmio_bar = IS_GEN2(config->devid) ? 1 : 0;
@@ -733,7 +853,8 @@ static const struct command commands[] = {
 	{
 		.name = "dump",
 		.function = intel_reg_dump,
-		.description = "dump all known registers",
+		.synopsis = "[REGISTER..REGISTER ...]",
+		.description = "dump all known registers, or those in the range(s)",
 	},
 	{
 		.name = "decode",
@@ -741,6 +862,12 @@ static const struct command commands[] = {
 		.synopsis = "REGISTER VALUE [REGISTER VALUE ...]",
 		.description = "decode value(s) for specified register(s)",
 	},
+	{
+		.name = "sample",
+		.function = intel_reg_sample,
+		.synopsis = "[--count=N] [--period=US] REGISTER [...]",
+		.description = "sample register(s) N times, every US microseconds",
+	},
 	{
 		.name = "snapshot",
 		.function = intel_reg_snapshot,
@@ -792,12 +919,16 @@ static int intel_reg_help(struct config *config, int argc, char *argv[])
 	printf(" --devid=DEVID  Specify PCI device ID for --mmio=FILE\n");
 	printf(" --all          Decode registers for all known platforms\n");
 	printf(" --binary       Binary dump registers\n");
+	printf(" --period=US    Sampling period in microseconds\n");
 	printf(" --verbose      Increase verbosity\n");
 	printf(" --quiet        Reduce verbosity\n");
 
 	printf("\n");
 	printf("Environment variables:\n");
 	printf(" INTEL_REG_SPEC Read register spec from directory or file\n");
+	printf(" INTEL_REG_SPEC_CACHE\n");
+	printf("                Cache parsed register specs in this directory,\n");
+	printf("                none if empty (default $XDG_CACHE_HOME/igt)\n");
 
 	return EXIT_SUCCESS;
 }
@@ -903,6 +1034,7 @@ enum opt {
 	OPT_MMIO,
 	OPT_DEVID,
 	OPT_COUNT,
+	OPT_PERIOD,
 	OPT_POST,
 	OPT_ALL,
 	OPT_BINARY,
@@ -920,6 +1052,7 @@ int main(int argc, char *argv[])
 	const struct command *command = NULL;
 	struct config config = {
 		.count = 1,
+		.period = 1000,
 		.fd = -1,
 	};
 	bool help = false;
@@ -933,8 +1066,10 @@ int main(int argc, char *argv[])
 		/* options specific to read and dump */
 		{ "mmio",	required_argument,	NULL,	OPT_MMIO },
 		{ "devid",	required_argument,	NULL,	OPT_DEVID },
-		/* options specific to read */
+		/* options specific to read and sample */
 		{ "count",	required_argument,	NULL,	OPT_COUNT },
+		/* options specific to sample */
+		{ "period",	required_argument,	NULL,	OPT_PERIOD },
 		/* options specific to write */
 		{ "post",	no_argument,		NULL,	OPT_POST },
 		/* options specific to read, dump and decode */
@@ -969,6 +1104,13 @@ int main(int argc, char *argv[])
 				return EXIT_FAILURE;
 			}
 			break;
+		case OPT_PERIOD:
+			config.period = strtoul(optarg, &endp, 10);
+			if (*endp || !config.period) {
+				fprintf(stderr, "invalid period '%s'\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
 		case OPT_POST:
 			config.post = true;
 			break;
@@ -1032,6 +1174,11 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (intel_reg_spec_index(&config.index, config.regs, config.regcount)) {
+		fprintf(stderr, "Error: %s\n", strerror(ENOMEM));
+		return EXIT_FAILURE;
+	}
+
 	for (i = 0; i < ARRAY_SIZE(commands); i++) {
 		if (strcmp(argv[0], commands[i].name) == 0) {
 			command = &commands[i];
@@ -1046,6 +1193,7 @@ int main(int argc, char *argv[])
 
 	ret = command->function(&config, argc, argv);
 
+	intel_reg_spec_index_free(&config.index);
 	free(config.mmiofile);
 
 	if (config.fd >= 0)
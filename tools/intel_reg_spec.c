@@ -29,6 +29,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "intel_reg_spec.h"
 
@@ -233,9 +235,9 @@ static int parse_line(struct reg *reg, const char *line)
 			reg->name = p;
 		} else if (i == 2) {
 			reg->addr = strtoul(p, &e, 16);
-			free(p);
 			if (*e)
 				ret = -1;
+			free(p);
 		} else if (i == 3) {
 			ret = parse_port_desc(reg, p);
 			free(p);
@@ -248,8 +250,52 @@ static int parse_line(struct reg *reg, const char *line)
 	return ret;
 }
 
+/* The files a spec was parsed from, for checking the cache is up to date */
+struct spec_file {
+	char *path;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t size;
+};
+
+struct spec_files {
+	struct spec_file *file;
+	size_t count;
+};
+
+static void spec_files_fini(struct spec_files *files)
+{
+	size_t i;
+
+	for (i = 0; i < files->count; i++)
+		free(files->file[i].path);
+	free(files->file);
+}
+
+static void add_spec_file(struct spec_files *files, FILE *file,
+			  const char *filename)
+{
+	struct spec_file *f;
+	struct stat st;
+
+	if (fstat(fileno(file), &st))
+		return;
+
+	f = recalloc(files->file, files->count + 1, sizeof(*f));
+	if (!f)
+		return;
+	files->file = f;
+
+	f += files->count++;
+	f->path = strdup(filename);
+	f->mtime_sec = st.st_mtim.tv_sec;
+	f->mtime_nsec = st.st_mtim.tv_nsec;
+	f->size = st.st_size;
+}
+
 static ssize_t parse_file(struct reg **regs, size_t *nregs,
-			  ssize_t index, const char *filename)
+			  ssize_t index, const char *filename,
+			  struct spec_files *files)
 {
 	FILE *file;
 	char *line = NULL, *include;
@@ -264,6 +310,8 @@ static ssize_t parse_file(struct reg **regs, size_t *nregs,
 		return -1;
 	}
 
+	add_spec_file(files, file, filename);
+
 	while (getline(&line, &linesize, file) != -1) {
 		struct reg reg = {};
 
@@ -274,7 +322,8 @@ static ssize_t parse_file(struct reg **regs, size_t *nregs,
 
 		include = include_file(line, filename);
 		if (include) {
-			index = parse_file(regs, nregs, index, include);
+			index = parse_file(regs, nregs, index, include,
+					   files);
 			free(include);
 			if (index < 0) {
 				fprintf(stderr, "Error: %s:%d: %s",
@@ -318,15 +367,486 @@ out:
 	return ret;
 }
 
+/*
+ * Parsing the spec files with regular expressions is what takes most of the
+ * time of a decode, so the parsed registers are cached in a binary file under
+ * $INTEL_REG_SPEC_CACHE, by default $XDG_CACHE_HOME/igt, along with the path,
+ * size and modification time of each file they came from. The cache is only
+ * used while none of those files changed, and set INTEL_REG_SPEC_CACHE to the
+ * empty string to not use a cache at all.
+ */
+#define CACHE_MAGIC "IGTREGSP"
+#define CACHE_VERSION 1
+
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nfiles;
+	uint32_t nregs;
+	uint32_t pad;
+};
+
+struct cache_file {
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t size;
+	uint32_t len;
+	uint32_t pad;
+};
+
+struct cache_reg {
+	uint32_t port_desc;
+	uint32_t mmio_offset;
+	uint32_t addr;
+	uint32_t len;
+};
+
+#define NO_NAME 0xffffffff
+
+static char *cache_dir(void)
+{
+	const char *dir, *home;
+	char *path;
+
+	dir = getenv("INTEL_REG_SPEC_CACHE");
+	if (dir)
+		return *dir ? strdup(dir) : NULL;
+
+	dir = getenv("XDG_CACHE_HOME");
+	if (dir && *dir) {
+		if (asprintf(&path, "%s/igt", dir) < 0)
+			return NULL;
+		return path;
+	}
+
+	home = getenv("HOME");
+	if (!home || !*home)
+		return NULL;
+
+	if (asprintf(&path, "%s/.cache/igt", home) < 0)
+		return NULL;
+
+	return path;
+}
+
+static char *cache_path(const char *filename)
+{
+	char *dir, *real, *path;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const char *p;
+	int ret;
+
+	dir = cache_dir();
+	if (!dir)
+		return NULL;
+
+	real = realpath(filename, NULL);
+	if (!real) {
+		free(dir);
+		return NULL;
+	}
+
+	/* FNV-1a of the absolute path of the top level spec file */
+	for (p = real; *p; p++)
+		hash = (hash ^ (uint8_t)*p) * 0x100000001b3ull;
+	free(real);
+
+	ret = asprintf(&path, "%s/intel_reg-%016llx.spec",
+		       dir, (unsigned long long)hash);
+	free(dir);
+
+	return ret < 0 ? NULL : path;
+}
+
+static bool read_all(FILE *file, void *buf, size_t len)
+{
+	return fread(buf, 1, len, file) == len;
+}
+
+static char *read_string(FILE *file, uint32_t len)
+{
+	char *s;
+
+	s = malloc(len + 1);
+	if (!s)
+		return NULL;
+
+	if (!read_all(file, s, len)) {
+		free(s);
+		return NULL;
+	}
+	s[len] = '\0';
+
+	return s;
+}
+
+static bool cache_file_current(FILE *file)
+{
+	struct cache_file f;
+	struct stat st;
+	char *path;
+	bool ret;
+
+	if (!read_all(file, &f, sizeof(f)))
+		return false;
+
+	path = read_string(file, f.len);
+	if (!path)
+		return false;
+
+	ret = stat(path, &st) == 0 &&
+		st.st_mtim.tv_sec == f.mtime_sec &&
+		st.st_mtim.tv_nsec == f.mtime_nsec &&
+		st.st_size == f.size;
+	free(path);
+
+	return ret;
+}
+
+static ssize_t read_cache(struct reg **regs, const char *path)
+{
+	struct cache_header h;
+	struct reg *r = NULL;
+	FILE *file;
+	uint32_t i;
+
+	file = fopen(path, "r");
+	if (!file)
+		return -1;
+
+	if (!read_all(file, &h, sizeof(h)) ||
+	    memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) ||
+	    h.version != CACHE_VERSION || !h.nregs)
+		goto err;
+
+	for (i = 0; i < h.nfiles; i++)
+		if (!cache_file_current(file))
+			goto err;
+
+	r = calloc(h.nregs, sizeof(*r));
+	if (!r)
+		goto err;
+
+	for (i = 0; i < h.nregs; i++) {
+		struct cache_reg c;
+
+		if (!read_all(file, &c, sizeof(c)) ||
+		    c.port_desc >= ARRAY_SIZE(port_descs))
+			goto err;
+
+		r[i].port_desc = port_descs[c.port_desc];
+		r[i].mmio_offset = c.mmio_offset;
+		r[i].addr = c.addr;
+
+		if (c.len != NO_NAME) {
+			r[i].name = read_string(file, c.len);
+			if (!r[i].name)
+				goto err;
+		}
+	}
+
+	fclose(file);
+	*regs = r;
+
+	return h.nregs;
+
+err:
+	if (r)
+		intel_reg_spec_free(r, h.nregs);
+	fclose(file);
+
+	return -1;
+}
+
+static void write_cache(const char *path, const struct reg *regs, size_t n,
+			const struct spec_files *files)
+{
+	struct cache_header h = {
+		.magic = CACHE_MAGIC,
+		.version = CACHE_VERSION,
+		.nfiles = files->count,
+		.nregs = n,
+	};
+	char *dir, *tmp, *p;
+	FILE *file;
+	bool ok;
+	size_t i;
+
+	/* Create the cache directory and its parents as needed */
+	dir = strdup(path);
+	if (!dir)
+		return;
+	for (p = strchr(dir + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		mkdir(dir, 0755);
+		*p = '/';
+	}
+	free(dir);
+
+	if (asprintf(&tmp, "%s.%d", path, getpid()) < 0)
+		return;
+
+	file = fopen(tmp, "w");
+	if (!file) {
+		free(tmp);
+		return;
+	}
+
+	ok = fwrite(&h, sizeof(h), 1, file) == 1;
+
+	for (i = 0; ok && i < files->count; i++) {
+		const struct spec_file *s = &files->file[i];
+		struct cache_file f = {
+			.mtime_sec = s->mtime_sec,
+			.mtime_nsec = s->mtime_nsec,
+			.size = s->size,
+			.len = s->path ? strlen(s->path) : 0,
+		};
+		char *real = s->path ? realpath(s->path, NULL) : NULL;
+
+		/* Included files are relative to the spec file */
+		if (real)
+			f.len = strlen(real);
+
+		ok = fwrite(&f, sizeof(f), 1, file) == 1 &&
+			fwrite(real ?: s->path, 1, f.len, file) == f.len;
+		free(real);
+	}
+
+	for (i = 0; ok && i < n; i++) {
+		struct cache_reg c = {
+			.mmio_offset = regs[i].mmio_offset,
+			.addr = regs[i].addr,
+			.len = regs[i].name ? strlen(regs[i].name) : NO_NAME,
+		};
+
+		/* The port descs of parsed registers all come from the table */
+		c.port_desc = ARRAY_SIZE(port_descs);
+		for (uint32_t j = 0; j < ARRAY_SIZE(port_descs); j++) {
+			if (regs[i].port_desc.name == port_descs[j].name) {
+				c.port_desc = j;
+				break;
+			}
+		}
+
+		ok = c.port_desc < ARRAY_SIZE(port_descs) &&
+			fwrite(&c, sizeof(c), 1, file) == 1 &&
+			(c.len == NO_NAME ||
+			 fwrite(regs[i].name, 1, c.len, file) == c.len);
+	}
+
+	if (fclose(file))
+		ok = false;
+
+	if (!ok || rename(tmp, path))
+		unlink(tmp);
+	free(tmp);
+}
+
 /*
  * Get register definitions from file.
  */
 ssize_t intel_reg_spec_file(struct reg **regs, const char *file)
 {
+	struct spec_files files = {};
 	size_t nregs = 0;
+	ssize_t ret;
+	char *cache;
+
 	*regs = NULL;
 
-	return parse_file(regs, &nregs, 0, file);
+	cache = cache_path(file);
+	if (cache) {
+		ret = read_cache(regs, cache);
+		if (ret > 0) {
+			free(cache);
+			return ret;
+		}
+	}
+
+	ret = parse_file(regs, &nregs, 0, file, &files);
+	if (ret > 0 && cache)
+		write_cache(cache, *regs, ret, &files);
+
+	spec_files_fini(&files);
+	free(cache);
+
+	return ret;
+}
+
+static int cmp_port(const struct reg *a, const struct reg *b)
+{
+	return (a->port_desc.port > b->port_desc.port) -
+		(a->port_desc.port < b->port_desc.port);
+}
+
+/* Duplicates keep the order of the spec, the first one being found */
+static int cmp_order(const struct reg *a, const struct reg *b)
+{
+	return (a > b) - (a < b);
+}
+
+static int cmp_name(const void *A, const void *B)
+{
+	const struct reg *a = *(const struct reg **)A;
+	const struct reg *b = *(const struct reg **)B;
+	int ret;
+
+	ret = cmp_port(a, b);
+	if (!ret)
+		ret = strcasecmp(a->name, b->name);
+	if (!ret)
+		ret = cmp_order(a, b);
+
+	return ret;
+}
+
+static uint32_t reg_offset(const struct reg *r)
+{
+	/* ->mmio_offset is 0 for non-MMIO ports */
+	return r->addr + r->mmio_offset;
+}
+
+static int cmp_addr(const void *A, const void *B)
+{
+	const struct reg *a = *(const struct reg **)A;
+	const struct reg *b = *(const struct reg **)B;
+	int ret;
+
+	ret = cmp_port(a, b);
+	if (!ret)
+		ret = (reg_offset(a) > reg_offset(b)) -
+			(reg_offset(a) < reg_offset(b));
+	if (!ret)
+		ret = cmp_order(a, b);
+
+	return ret;
+}
+
+/*
+ * Index the register definitions by name and by address, for the lookups
+ * below. The index points into regs, which must outlive it.
+ */
+int intel_reg_spec_index(struct reg_index *index, struct reg *regs, size_t n)
+{
+	size_t i;
+
+	memset(index, 0, sizeof(*index));
+	if (!n)
+		return 0;
+
+	index->by_name = calloc(n, sizeof(*index->by_name));
+	index->by_addr = calloc(n, sizeof(*index->by_addr));
+	if (!index->by_name || !index->by_addr) {
+		intel_reg_spec_index_free(index);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (regs[i].name)
+			index->by_name[index->nnames++] = &regs[i];
+		index->by_addr[index->naddrs++] = &regs[i];
+	}
+
+	qsort(index->by_name, index->nnames, sizeof(*index->by_name),
+	      cmp_name);
+	qsort(index->by_addr, index->naddrs, sizeof(*index->by_addr),
+	      cmp_addr);
+
+	return 0;
+}
+
+void intel_reg_spec_index_free(struct reg_index *index)
+{
+	free(index->by_name);
+	free(index->by_addr);
+	memset(index, 0, sizeof(*index));
+}
+
+/*
+ * Look up the first register named name, ignoring case, on port.
+ */
+struct reg *intel_reg_spec_find_name(const struct reg_index *index,
+				     enum port_addr port, const char *name)
+{
+	size_t lo = 0, hi = index->nnames;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct reg *r = index->by_name[mid];
+
+		if (r->port_desc.port < port ||
+		    (r->port_desc.port == port &&
+		     strcasecmp(r->name, name) < 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < index->nnames &&
+	    index->by_name[lo]->port_desc.port == port &&
+	    !strcasecmp(index->by_name[lo]->name, name))
+		return index->by_name[lo];
+
+	return NULL;
+}
+
+static size_t lower_bound_addr(const struct reg_index *index,
+			       enum port_addr port, uint32_t addr)
+{
+	size_t lo = 0, hi = index->naddrs;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct reg *r = index->by_addr[mid];
+
+		if (r->port_desc.port < port ||
+		    (r->port_desc.port == port && reg_offset(r) < addr))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * Look up the first register at addr, including any MMIO offset, on port.
+ */
+struct reg *intel_reg_spec_find_addr(const struct reg_index *index,
+				     enum port_addr port, uint32_t addr)
+{
+	struct reg **first;
+
+	if (!intel_reg_spec_find_range(index, port, addr, addr, &first))
+		return NULL;
+
+	return *first;
+}
+
+/*
+ * Look up the registers from start to end inclusive, including any MMIO
+ * offset, on port. Returns how many there are, first pointing to the first
+ * of them in address order.
+ */
+size_t intel_reg_spec_find_range(const struct reg_index *index,
+				 enum port_addr port,
+				 uint32_t start, uint32_t end,
+				 struct reg ***first)
+{
+	size_t lo, hi;
+
+	lo = lower_bound_addr(index, port, start);
+	for (hi = lo; hi < index->naddrs; hi++) {
+		const struct reg *r = index->by_addr[hi];
+
+		if (r->port_desc.port != port || reg_offset(r) > end)
+			break;
+	}
+
+	*first = index->by_addr + lo;
+
+	return hi - lo;
 }
 
 /*
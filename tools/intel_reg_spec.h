@@ -59,6 +59,14 @@ struct reg {
 	char *name;
 };
 
+/* Registers of a spec sorted by port and name, and by port and address */
+struct reg_index {
+	struct reg **by_name;
+	size_t nnames;
+	struct reg **by_addr;
+	size_t naddrs;
+};
+
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof(x[0]))
 #endif
@@ -72,6 +80,16 @@ int parse_port_desc(struct reg *reg, const char *s);
 ssize_t intel_reg_spec_builtin(struct reg **regs, uint32_t devid);
 ssize_t intel_reg_spec_file(struct reg **regs, const char *filename);
 void intel_reg_spec_free(struct reg *regs, size_t n);
+int intel_reg_spec_index(struct reg_index *index, struct reg *regs, size_t n);
+void intel_reg_spec_index_free(struct reg_index *index);
+struct reg *intel_reg_spec_find_name(const struct reg_index *index,
+				     enum port_addr port, const char *name);
+struct reg *intel_reg_spec_find_addr(const struct reg_index *index,
+				     enum port_addr port, uint32_t addr);
+size_t intel_reg_spec_find_range(const struct reg_index *index,
+				 enum port_addr port,
+				 uint32_t start, uint32_t end,
+				 struct reg ***first);
 int intel_reg_spec_decode(char *buf, size_t bufsize, const struct reg *reg,
 			  uint32_t val, uint32_t devid);
 void intel_reg_spec_print_ports(void);
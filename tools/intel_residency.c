@@ -34,47 +34,12 @@
 #include <time.h>
 #include <getopt.h>
 #include "igt.h"
+#include "igt_residency.h"
 
-#define IA32_TIME_STAMP_COUNTER		0x10
-
-#define MSR_PKG_CST_CONFIG_CONTROL	0xE2
-#define  PKG_CST_LIMIT_MASK		0x7
-#define  PKG_CST_LIMIT_C0		0x0
-#define  PKG_CST_LIMIT_C2		0x1
-#define  PKG_CST_LIMIT_C3		0x2
-#define  PKG_CST_LIMIT_C6		0x3
-#define  PKG_CST_LIMIT_C7		0x4
-#define  PKG_CST_LIMIT_C7s		0x5
-#define  PKG_CST_NO_LIMIT		0x7
-
-#define MSR_PKG_C2_RESIDENCY		0x60D
-#define MSR_PKG_C3_RESIDENCY		0x3F8
-#define MSR_PKG_C6_RESIDENCY		0x3F9
-#define MSR_PKG_C7_RESIDENCY		0x3FA
-#define MSR_PKG_C8_RESIDENCY		0x630
-#define MSR_PKG_C9_RESIDENCY		0x631
-#define MSR_PKG_C10_RESIDENCY		0x632
-
-#define NUM_PC_STATES 7
-
-const char *res_msr_names[] = {
-	"PC2", "PC3", "PC6", "PC7", "PC8", "PC9", "PC10"
-};
-
-const uint32_t res_msr_addrs[] = {
-	MSR_PKG_C2_RESIDENCY,
-	MSR_PKG_C3_RESIDENCY,
-	MSR_PKG_C6_RESIDENCY,
-	MSR_PKG_C7_RESIDENCY,
-	MSR_PKG_C8_RESIDENCY,
-	MSR_PKG_C9_RESIDENCY,
-	MSR_PKG_C10_RESIDENCY,
-};
+struct igt_residency *residency;
 
-int msr_fd;
-
-uint32_t deepest_pc_state;
-uint64_t idle_res;
+enum igt_residency_counter deepest_pc_state;
+double idle_res;
 
 #define MAX_CONNECTORS 32
 #define MAX_PLANES 32
@@ -114,68 +79,16 @@ struct {
 	.test_name = NULL,
 };
 
-static uint64_t msr_read(uint32_t addr)
-{
-	int rc;
-	uint64_t ret;
-
-	rc = pread(msr_fd, &ret, sizeof(uint64_t), addr);
-	igt_assert(rc == sizeof(ret));
-
-	return ret;
-}
-
-static void setup_msr(void)
+static void setup_residency(void)
 {
-#if 0
-	uint64_t control;
-	const char *limit;
-#endif
-
-	/* Make sure our Kernel supports MSR and the module is loaded. */
-	igt_assert(system("modprobe -q msr > /dev/null 2>&1") != -1);
-
-	msr_fd = open("/dev/cpu/0/msr", O_RDONLY);
-	igt_assert_f(msr_fd >= 0,
-		     "Can't open /dev/cpu/0/msr.\n");
-
-#if 0
-	/* FIXME: why is this code not printing the truth? */
-	control = msr_read(MSR_PKG_CST_CONFIG_CONTROL);
-	printf("Control: 0x016%" PRIx64 "\n", control);
-	switch (control & PKG_CST_LIMIT_MASK) {
-	case PKG_CST_LIMIT_C0:
-		limit = "C0";
-		break;
-	case PKG_CST_LIMIT_C2:
-		limit = "C2";
-		break;
-	case PKG_CST_LIMIT_C3:
-		limit = "C3";
-		break;
-	case PKG_CST_LIMIT_C6:
-		limit = "C6";
-		break;
-	case PKG_CST_LIMIT_C7:
-		limit = "C7";
-		break;
-	case PKG_CST_LIMIT_C7s:
-		limit = "C7s";
-		break;
-	case PKG_CST_NO_LIMIT:
-		limit = "no limit";
-		break;
-	default:
-		limit = "unknown";
-		break;
-	}
-	printf("Package C state limit: %s\n", limit);
-#endif
+	residency = igt_residency_open(-1);
+	igt_require_f(residency,
+		      "Can't read the package C-state residencies.\n");
 }
 
-static void teardown_msr(void)
+static void teardown_residency(void)
 {
-	close(msr_fd);
+	igt_residency_close(residency);
 }
 
 static void setup_drm(void)
@@ -379,33 +292,32 @@ static void page_flip(void)
 
 static void wait_until_idle(void)
 {
-	uint64_t tsc, pc, res;
+	struct igt_residency_sample s0, s1;
+	double res;
 
 	do {
 		set_alarm(0, 500 * 1000);
 
-		tsc = msr_read(IA32_TIME_STAMP_COUNTER);
-		pc = msr_read(deepest_pc_state);
+		igt_residency_read(residency, &s0);
 
 		while (!alarm_received)
 			pause();
 
-		pc = msr_read(deepest_pc_state) - pc;
-		tsc = msr_read(IA32_TIME_STAMP_COUNTER) - tsc;
+		igt_residency_read(residency, &s1);
 
-		res = pc * 100 / tsc;
+		res = igt_residency_percent(&s0, &s1, deepest_pc_state);
 
-		/*printf("res:%02"PRIu64"\n", res);*/
+		/*printf("res:%02.0f\n", res);*/
 	} while (res < idle_res && idle_res - res > 3);
 
 	if (res > idle_res && res - idle_res > 3)
 		fprintf(stderr, "The calculated idle residency may be too low "
-			"(got %02"PRIu64"%%)\n", res);
+			"(got %02.0f%%)\n", res);
 }
 
-static uint64_t do_measurement(void (*callback)(void *ptr), void *ptr)
+static double do_measurement(void (*callback)(void *ptr), void *ptr)
 {
-	uint64_t tsc, pc;
+	struct igt_residency_sample s0, s1;
 
 	wait_until_idle();
 
@@ -414,21 +326,20 @@ static uint64_t do_measurement(void (*callback)(void *ptr), void *ptr)
 
 	set_alarm(opts.res_calc_time, 0);
 
-	tsc = msr_read(IA32_TIME_STAMP_COUNTER);
-	pc = msr_read(deepest_pc_state);
+	igt_residency_read(residency, &s0);
 
 	callback(ptr);
 
-	pc = msr_read(deepest_pc_state) - pc;
-	tsc = msr_read(IA32_TIME_STAMP_COUNTER) - tsc;
+	igt_residency_read(residency, &s1);
 
-	return pc * 100 / tsc;
+	return igt_residency_percent(&s0, &s1, deepest_pc_state);
 }
 
 static void setup_idle(void)
 {
-	uint64_t tsc, pc[NUM_PC_STATES], res, best_res;
+	struct igt_residency_sample s0, s1;
 	int pc_i, best_pc_i = 0, retries, consecutive_not_best;
+	double res, best_res;
 
 	for (retries = 0; ; retries++) {
 
@@ -438,23 +349,19 @@ static void setup_idle(void)
 
 		set_alarm(opts.res_calc_time, 0);
 
-		tsc = msr_read(IA32_TIME_STAMP_COUNTER);
-		for (pc_i = best_pc_i; pc_i < NUM_PC_STATES; pc_i++)
-			pc[pc_i] = msr_read(res_msr_addrs[pc_i]);
+		igt_residency_read(residency, &s0);
 
 		while (!alarm_received)
 			pause();
 
-		for (pc_i = best_pc_i; pc_i < NUM_PC_STATES; pc_i++)
-			pc[pc_i] = msr_read(res_msr_addrs[pc_i]) - pc[pc_i];
-		tsc = msr_read(IA32_TIME_STAMP_COUNTER) - tsc;
+		igt_residency_read(residency, &s1);
 
-		for (pc_i = NUM_PC_STATES -1; pc_i >= best_pc_i; pc_i--)
-			if (pc[pc_i] != 0)
+		for (pc_i = IGT_RESIDENCY_PC10; pc_i >= best_pc_i; pc_i--)
+			if (s1.counter[pc_i] != s0.counter[pc_i])
 				break;
 		igt_require_f(pc_i >= 0, "We're not reaching any PC states!\n");
 
-		res = pc[pc_i] * 100 / tsc;
+		res = igt_residency_percent(&s0, &s1, pc_i);
 
 		if (retries == 0 || pc_i > best_pc_i || res > best_res) {
 			best_pc_i = pc_i;
@@ -467,18 +374,18 @@ static void setup_idle(void)
 		}
 	}
 
-	deepest_pc_state = res_msr_addrs[best_pc_i];
+	deepest_pc_state = best_pc_i;
 	idle_res = best_res;
 
 	printf("Stable idle residency retries:\t%d\n", retries);
 	printf("Deepest PC state reached when idle:\t%s\n",
-	       res_msr_names[best_pc_i]);
-	printf("Idle residency for this state:\t%02"PRIu64"%%\n", idle_res);
+	       igt_residency_name(best_pc_i));
+	printf("Idle residency for this state:\t%02.0f%%\n", idle_res);
 }
 
-static void print_result(int ops, int vblanks, uint64_t res)
+static void print_result(int ops, int vblanks, double res)
 {
-	printf("- %02d ops every %02d vblanks:\t%02"PRIu64"%%\n",
+	printf("- %02d ops every %02d vblanks:\t%02.0f%%\n",
 	       ops, vblanks, res);
 	fflush(stdout);
 }
@@ -501,7 +408,7 @@ static void page_flip_test(void)
 {
 	struct page_flip_data data;
 	int n_vblanks;
-	uint64_t res;
+	double res;
 
 	printf("\nPage flip test:\n");
 
@@ -548,7 +455,7 @@ static void draw_test(void)
 	struct draw_data data;
 	enum igt_draw_method method;
 	int i;
-	uint64_t res;
+	double res;
 
 	for (method = 0; method < IGT_DRAW_METHOD_COUNT; method++) {
 		data.method = method;
@@ -591,7 +498,7 @@ static void draw_and_flip_test(void)
 	struct draw_data data;
 	enum igt_draw_method method;
 	int i;
-	uint64_t res;
+	double res;
 
 	for (method = 0; method < IGT_DRAW_METHOD_COUNT; method++) {
 		data.method = method;
@@ -686,7 +593,7 @@ int main(int argc, char *argv[])
 {
 	parse_opts(argc, argv);
 
-	setup_msr();
+	setup_residency();
 	setup_drm();
 	setup_modeset();
 	setup_vblank_interval();
@@ -710,6 +617,6 @@ int main(int argc, char *argv[])
 
 	teardown_modeset();
 	teardown_drm();
-	teardown_msr();
+	teardown_residency();
 	return 0;
 }
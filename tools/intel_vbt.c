@@ -0,0 +1,579 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * Parses a VBT once into the blocks it is made of and the panels and ports
+ * it describes, for tools only interested in some of its contents, and
+ * prints those as JSON.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intel_vbt.h"
+
+/* kernel types for intel_vbt_defs.h */
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+#define __packed __attribute__ ((packed))
+
+#define _INTEL_BIOS_PRIVATE
+#include "intel_vbt_defs.h"
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x) (sizeof(x)/sizeof(x[0]))
+#endif
+
+/* no bother to include "edid.h" */
+#define _H_ACTIVE(x) (x[2] + ((x[4] & 0xF0) << 4))
+#define _H_SYNC_OFF(x) (x[8] + ((x[11] & 0xC0) << 2))
+#define _H_SYNC_WIDTH(x) (x[9] + ((x[11] & 0x30) << 4))
+#define _H_BLANK(x) (x[3] + ((x[4] & 0x0F) << 8))
+#define _V_ACTIVE(x) (x[5] + ((x[7] & 0xF0) << 4))
+#define _V_SYNC_OFF(x) ((x[10] >> 4) + ((x[11] & 0x0C) << 2))
+#define _V_SYNC_WIDTH(x) ((x[10] & 0x0F) + ((x[11] & 0x03) << 4))
+#define _V_BLANK(x) (x[6] + ((x[7] & 0x0F) << 8))
+#define _PIXEL_CLOCK(x) (x[0] + (x[1] << 8)) * 10000
+
+static const struct {
+	unsigned char handle;
+	const char *name;
+} child_device_handles[] = {
+	{ DEVICE_HANDLE_CRT, "CRT" },
+	{ DEVICE_HANDLE_EFP1, "EFP 1 (HDMI/DVI/DP)" },
+	{ DEVICE_HANDLE_EFP2, "EFP 2 (HDMI/DVI/DP)" },
+	{ DEVICE_HANDLE_EFP3, "EFP 3 (HDMI/DVI/DP)" },
+	{ DEVICE_HANDLE_EFP4, "EFP 4 (HDMI/DVI/DP)" },
+	{ DEVICE_HANDLE_LPF1, "LFP 1 (eDP)" },
+	{ DEVICE_HANDLE_LFP2, "LFP 2 (eDP)" },
+};
+
+const char *intel_vbt_child_handle_name(uint16_t handle)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(child_device_handles); i++)
+		if (child_device_handles[i].handle == handle)
+			return child_device_handles[i].name;
+
+	return "unknown";
+}
+
+static const char *dvo_port_names[] = {
+	[DVO_PORT_HDMIA] = "HDMI-A",
+	[DVO_PORT_HDMIB] = "HDMI-B",
+	[DVO_PORT_HDMIC] = "HDMI-C",
+	[DVO_PORT_HDMID] = "HDMI-D",
+	[DVO_PORT_LVDS] = "LVDS",
+	[DVO_PORT_TV] = "TV",
+	[DVO_PORT_CRT] = "CRT",
+	[DVO_PORT_DPB] = "DP-B",
+	[DVO_PORT_DPC] = "DP-C",
+	[DVO_PORT_DPD] = "DP-D",
+	[DVO_PORT_DPA] = "DP-A",
+	[DVO_PORT_DPE] = "DP-E",
+	[DVO_PORT_HDMIE] = "HDMI-E",
+	[DVO_PORT_MIPIA] = "MIPI-A",
+	[DVO_PORT_MIPIB] = "MIPI-B",
+	[DVO_PORT_MIPIC] = "MIPI-C",
+	[DVO_PORT_MIPID] = "MIPI-D",
+};
+
+const char *intel_vbt_dvo_port_name(uint8_t port)
+{
+	if (port < ARRAY_SIZE(dvo_port_names) && dvo_port_names[port])
+		return dvo_port_names[port];
+	else
+		return "unknown";
+}
+
+/* Get BDB block size given a pointer to Block ID. */
+static uint32_t get_blocksize(const uint8_t *block_base)
+{
+	/* The MIPI Sequence Block v3+ has a separate size field. */
+	if (*block_base == BDB_MIPI_SEQUENCE && *(block_base + 3) >= 3)
+		return *((const uint32_t *)(block_base + 4));
+	else
+		return *((const uint16_t *)(block_base + 1));
+}
+
+/* Walk the blocks once, remembering the first of each id */
+static void index_blocks(struct intel_vbt *vbt, uint32_t length)
+{
+	const uint8_t *base = (const uint8_t *)vbt->bdb;
+	uint32_t index = vbt->bdb->header_size;
+	uint32_t total = vbt->bdb->bdb_size;
+
+	if (total > length)
+		total = length;
+
+	while (index + 3 < total) {
+		uint8_t id = base[index];
+		uint32_t size = get_blocksize(base + index);
+
+		index += 3;
+		if (index + size > total)
+			break;
+
+		if (!vbt->blocks[id].data) {
+			vbt->blocks[id].data = base + index;
+			vbt->blocks[id].size = size;
+		}
+
+		index += size;
+	}
+}
+
+/**
+ * intel_vbt_block:
+ * @vbt: a parsed VBT
+ * @id: the id of the block to look up
+ * @size: where to return the size of the block, or NULL
+ *
+ * Returns: The contents of the block, or NULL when @vbt does not have it.
+ */
+const void *intel_vbt_block(const struct intel_vbt *vbt, int id,
+			    uint32_t *size)
+{
+	if (id < 0 || id >= ARRAY_SIZE(vbt->blocks))
+		return NULL;
+
+	if (size)
+		*size = vbt->blocks[id].size;
+
+	return vbt->blocks[id].data;
+}
+
+static void parse_panels(struct intel_vbt *vbt)
+{
+	const struct bdb_lvds_lfp_data_ptrs *ptrs;
+	const struct bdb_lvds_lfp_data *lvds_data;
+	int lfp_data_size, dvo_offset;
+	uint32_t size;
+	int i, n;
+
+	ptrs = intel_vbt_block(vbt, BDB_LVDS_LFP_DATA_PTRS, NULL);
+	lvds_data = intel_vbt_block(vbt, BDB_LVDS_LFP_DATA, &size);
+	if (!ptrs || !lvds_data)
+		return;
+
+	lfp_data_size =
+	    ptrs->ptr[1].fp_timing_offset - ptrs->ptr[0].fp_timing_offset;
+	dvo_offset =
+	    ptrs->ptr[0].dvo_timing_offset - ptrs->ptr[0].fp_timing_offset;
+	if (lfp_data_size <= 0 || dvo_offset < 0 ||
+	    dvo_offset + 18 > lfp_data_size)
+		return;
+
+	n = size / lfp_data_size;
+	vbt->panels = calloc(n, sizeof(*vbt->panels));
+	if (!vbt->panels)
+		return;
+
+	for (i = 0; i < n; i++) {
+		const uint8_t *timing_data =
+		    (const uint8_t *)lvds_data->data + lfp_data_size * i +
+		    dvo_offset;
+		struct intel_vbt_panel *p = &vbt->panels[vbt->num_panels++];
+
+		p->index = i;
+		p->preferred = i == vbt->panel_type;
+
+		p->hdisplay = _H_ACTIVE(timing_data);
+		p->hsync_start = p->hdisplay + _H_SYNC_OFF(timing_data);
+		p->hsync_end = p->hsync_start + _H_SYNC_WIDTH(timing_data);
+		p->htotal = p->hdisplay + _H_BLANK(timing_data);
+
+		p->vdisplay = _V_ACTIVE(timing_data);
+		p->vsync_start = p->vdisplay + _V_SYNC_OFF(timing_data);
+		p->vsync_end = p->vsync_start + _V_SYNC_WIDTH(timing_data);
+		p->vtotal = p->vdisplay + _V_BLANK(timing_data);
+
+		p->clock = _PIXEL_CLOCK(timing_data) / 1000;
+	}
+}
+
+static void parse_ports(struct intel_vbt *vbt)
+{
+	const uint8_t *devices;
+	struct child_device_config *child;
+	uint32_t size;
+	int child_dev_size, i, n;
+
+	devices = intel_vbt_block(vbt, BDB_GENERAL_DEFINITIONS, &size);
+	if (devices && size >= sizeof(struct bdb_general_definitions)) {
+		const struct bdb_general_definitions *defs = (const void *)devices;
+
+		child_dev_size = defs->child_dev_size;
+		size -= sizeof(*defs);
+		devices = defs->devices;
+	} else {
+		const struct bdb_legacy_child_devices *defs;
+
+		defs = intel_vbt_block(vbt, BDB_CHILD_DEVICE_TABLE, &size);
+		if (!defs || size < sizeof(*defs))
+			return;
+
+		child_dev_size = defs->child_dev_size;
+		size -= sizeof(*defs);
+		devices = (const uint8_t *)defs->devices;
+	}
+
+	if (!child_dev_size)
+		return;
+
+	/* Zeroed past child_dev_size, as in the decoder */
+	child = calloc(1, sizeof(*child));
+	n = size / child_dev_size;
+	vbt->ports = calloc(n ?: 1, sizeof(*vbt->ports));
+	if (!child || !vbt->ports) {
+		free(child);
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct intel_vbt_port *p = &vbt->ports[vbt->num_ports];
+
+		memcpy(child, devices + i * child_dev_size,
+		       child_dev_size < sizeof(*child) ?
+		       child_dev_size : sizeof(*child));
+		if (!child->device_type)
+			continue;
+
+		memset(p, 0, sizeof(*p));
+		p->handle = child->handle;
+		p->device_type = child->device_type;
+		p->dvo_port = child->dvo_port;
+		p->ddc_pin = child->ddc_pin;
+
+		if (vbt->version >= 155) {
+			p->aux_channel = child->aux_channel;
+			p->hdmi = child->hdmi_support;
+			p->dp = child->dp_support;
+			p->tmds = child->tmds_support;
+			p->lane_reversal = child->lane_reversal;
+		}
+
+		if (vbt->version >= 195)
+			p->usb_type_c = child->dp_usb_type_c;
+
+		if (vbt->version >= 198) {
+			p->dsc = child->compression_enable;
+			p->dsc_cps = child->compression_method;
+			p->dsc_index = child->compression_structure_index;
+		}
+
+		vbt->num_ports++;
+	}
+
+	free(child);
+}
+
+/* Get panel type from lvds options block, or -1 if block not found */
+static int get_panel_type(const struct intel_vbt *vbt)
+{
+	const struct bdb_lvds_options *options;
+
+	options = intel_vbt_block(vbt, BDB_LVDS_OPTIONS, NULL);
+	if (!options)
+		return -1;
+
+	return options->panel_type;
+}
+
+/**
+ * intel_vbt_parse:
+ * @data: a VBT, or a video BIOS or OpRegion containing one
+ * @size: the size of @data
+ * @panel_type: the panel type to mark as preferred, or -1 to use the one
+ * the VBT sets
+ *
+ * Finds the VBT in @data and parses it. @data is referenced by the result
+ * and must stay around until it is freed.
+ *
+ * Returns: The parsed VBT, to be freed with intel_vbt_free(), or NULL with
+ * errno set when @data has no valid VBT.
+ */
+struct intel_vbt *intel_vbt_parse(const void *data, size_t size,
+				  int panel_type)
+{
+	const uint8_t *bytes = data;
+	const struct vbt_header *header = NULL;
+	struct intel_vbt *vbt;
+	size_t i, bdb_off;
+
+	/* Scour memory looking for the VBT signature */
+	for (i = 0; i + sizeof(*header) < size; i++) {
+		if (!memcmp(bytes + i, "$VBT", 4)) {
+			header = (const struct vbt_header *)(bytes + i);
+			break;
+		}
+	}
+
+	if (!header) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	bdb_off = i + header->bdb_offset;
+	if (header->bdb_offset >= size ||
+	    bdb_off + sizeof(struct bdb_header) >= size) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	vbt = calloc(1, sizeof(*vbt));
+	if (!vbt) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	vbt->vbt = header;
+	vbt->bdb = (const struct bdb_header *)(bytes + bdb_off);
+	vbt->version = vbt->bdb->version;
+
+	index_blocks(vbt, size - bdb_off);
+
+	vbt->panel_type = panel_type;
+	if (vbt->panel_type < 0)
+		vbt->panel_type = get_panel_type(vbt);
+	if (vbt->panel_type < 0)
+		vbt->panel_type = 0;
+
+	parse_panels(vbt);
+	parse_ports(vbt);
+
+	return vbt;
+}
+
+/**
+ * intel_vbt_free:
+ * @vbt: a parsed VBT
+ */
+void intel_vbt_free(struct intel_vbt *vbt)
+{
+	if (!vbt)
+		return;
+
+	free(vbt->panels);
+	free(vbt->ports);
+	free(vbt);
+}
+
+static const struct {
+	const char *name;
+	unsigned int query;
+} query_names[] = {
+	{ "header", INTEL_VBT_QUERY_HEADER },
+	{ "panels", INTEL_VBT_QUERY_PANELS },
+	{ "ports", INTEL_VBT_QUERY_PORTS },
+	{ "dsc", INTEL_VBT_QUERY_DSC },
+	{ "all", INTEL_VBT_QUERY_ALL },
+};
+
+/**
+ * intel_vbt_parse_queries:
+ * @s: comma separated list of query names
+ * @queries: where to return the mask of #intel_vbt_query
+ *
+ * Returns: 0 on success, -EINVAL when @s has an unknown query.
+ */
+int intel_vbt_parse_queries(const char *s, unsigned int *queries)
+{
+	*queries = 0;
+
+	while (*s) {
+		size_t len = strcspn(s, ",");
+		int i;
+
+		for (i = 0; i < ARRAY_SIZE(query_names); i++) {
+			if (strlen(query_names[i].name) == len &&
+			    !strncmp(s, query_names[i].name, len))
+				break;
+		}
+		if (i == ARRAY_SIZE(query_names))
+			return -EINVAL;
+
+		*queries |= query_names[i].query;
+		s += len;
+		if (*s)
+			s++;
+	}
+
+	return 0;
+}
+
+static void json_string(FILE *out, const char *s, size_t len)
+{
+	size_t i;
+
+	fputc('"', out);
+	for (i = 0; i < len && s[i]; i++) {
+		unsigned char c = s[i];
+
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20 || c >= 0x7f)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+static const char *json_bool(bool b)
+{
+	return b ? "true" : "false";
+}
+
+static void print_header(FILE *out, const struct intel_vbt *vbt)
+{
+	fprintf(out, "\"header\":{\"signature\":");
+	json_string(out, (const char *)vbt->vbt->signature,
+		    sizeof(vbt->vbt->signature));
+	fprintf(out, ",\"vbt_version\":%u,\"bdb_version\":%u,"
+		"\"panel_type\":%d}",
+		vbt->vbt->version, vbt->bdb->version, vbt->panel_type);
+}
+
+static void print_panels(FILE *out, const struct intel_vbt *vbt)
+{
+	int i;
+
+	fprintf(out, "\"panels\":[");
+	for (i = 0; i < vbt->num_panels; i++) {
+		const struct intel_vbt_panel *p = &vbt->panels[i];
+
+		fprintf(out, "%s{\"index\":%d,\"preferred\":%s,"
+			"\"hdisplay\":%d,\"hsync_start\":%d,\"hsync_end\":%d,"
+			"\"htotal\":%d,\"vdisplay\":%d,\"vsync_start\":%d,"
+			"\"vsync_end\":%d,\"vtotal\":%d,\"clock\":%d}",
+			i ? "," : "", p->index, json_bool(p->preferred),
+			p->hdisplay, p->hsync_start, p->hsync_end, p->htotal,
+			p->vdisplay, p->vsync_start, p->vsync_end, p->vtotal,
+			p->clock);
+	}
+	fputc(']', out);
+}
+
+static void print_port_id(FILE *out, const struct intel_vbt_port *p)
+{
+	fprintf(out, "\"handle\":%u,\"handle_name\":\"%s\","
+		"\"dvo_port\":%u,\"dvo_port_name\":\"%s\"",
+		p->handle, intel_vbt_child_handle_name(p->handle),
+		p->dvo_port, intel_vbt_dvo_port_name(p->dvo_port));
+}
+
+static void print_ports(FILE *out, const struct intel_vbt *vbt)
+{
+	int i;
+
+	fprintf(out, "\"ports\":[");
+	for (i = 0; i < vbt->num_ports; i++) {
+		const struct intel_vbt_port *p = &vbt->ports[i];
+
+		fprintf(out, "%s{", i ? "," : "");
+		print_port_id(out, p);
+		fprintf(out, ",\"device_type\":%u,\"ddc_pin\":%u",
+			p->device_type, p->ddc_pin);
+		if (vbt->version >= 155)
+			fprintf(out, ",\"aux_channel\":%u,\"hdmi\":%s,"
+				"\"dp\":%s,\"tmds\":%s,\"lane_reversal\":%s",
+				p->aux_channel, json_bool(p->hdmi),
+				json_bool(p->dp), json_bool(p->tmds),
+				json_bool(p->lane_reversal));
+		if (vbt->version >= 195)
+			fprintf(out, ",\"usb_type_c\":%s",
+				json_bool(p->usb_type_c));
+		fputc('}', out);
+	}
+	fputc(']', out);
+}
+
+static void print_dsc(FILE *out, const struct intel_vbt *vbt)
+{
+	int i, n = 0;
+
+	fprintf(out, "\"dsc\":[");
+	for (i = 0; vbt->version >= 198 && i < vbt->num_ports; i++) {
+		const struct intel_vbt_port *p = &vbt->ports[i];
+
+		fprintf(out, "%s{", n++ ? "," : "");
+		print_port_id(out, p);
+		fprintf(out, ",\"enabled\":%s,\"method_cps\":%s,"
+			"\"structure_index\":%u}",
+			json_bool(p->dsc), json_bool(p->dsc_cps),
+			p->dsc_index);
+	}
+	fputc(']', out);
+}
+
+/**
+ * intel_vbt_print_json:
+ * @out: where to print to
+ * @vbt: a parsed VBT
+ * @name: a name for @vbt, usually the file it came from, or NULL
+ * @mask: the #intel_vbt_query parts of @vbt to print
+ *
+ * Prints the parts of @vbt selected by @mask as a JSON object on a single
+ * line, so that the VBTs of many machines can be collected one per line.
+ */
+void intel_vbt_print_json(FILE *out, const struct intel_vbt *vbt,
+			  const char *name, unsigned int mask)
+{
+	static const struct {
+		unsigned int query;
+		void (*print)(FILE *out, const struct intel_vbt *vbt);
+	} printers[] = {
+		{ INTEL_VBT_QUERY_HEADER, print_header },
+		{ INTEL_VBT_QUERY_PANELS, print_panels },
+		{ INTEL_VBT_QUERY_PORTS, print_ports },
+		{ INTEL_VBT_QUERY_DSC, print_dsc },
+	};
+	bool first = true;
+	int i;
+
+	fputc('{', out);
+	if (name) {
+		fprintf(out, "\"name\":");
+		json_string(out, name, strlen(name));
+		first = false;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(printers); i++) {
+		if (!(mask & printers[i].query))
+			continue;
+
+		if (!first)
+			fputc(',', out);
+		printers[i].print(out, vbt);
+		first = false;
+	}
+
+	fprintf(out, "}\n");
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2020 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#ifndef __INTEL_VBT_H__
+#define __INTEL_VBT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct vbt_header;
+struct bdb_header;
+
+/* A panel timing of the LFP data block, in pixels and kHz */
+struct intel_vbt_panel {
+	int index;
+	bool preferred;
+
+	int hdisplay, hsync_start, hsync_end, htotal;
+	int vdisplay, vsync_start, vsync_end, vtotal;
+	int clock;
+};
+
+/* A child device, with the fields only valid from some BDB version on */
+struct intel_vbt_port {
+	uint16_t handle;
+	uint16_t device_type;
+	uint8_t dvo_port;
+	uint8_t ddc_pin;
+
+	/* 155+ */
+	uint8_t aux_channel;
+	bool hdmi, dp, tmds;
+	bool lane_reversal;
+
+	/* 195+ */
+	bool usb_type_c;
+
+	/* 198+ */
+	bool dsc;
+	bool dsc_cps;
+	uint8_t dsc_index;
+};
+
+struct intel_vbt_block {
+	const void *data;
+	uint32_t size;
+};
+
+struct intel_vbt {
+	const struct vbt_header *vbt;
+	const struct bdb_header *bdb;
+	int version;
+
+	/* indexed by block id, NULL data when the block is not present */
+	struct intel_vbt_block blocks[256];
+
+	int panel_type;
+	struct intel_vbt_panel *panels;
+	int num_panels;
+
+	struct intel_vbt_port *ports;
+	int num_ports;
+};
+
+/**
+ * intel_vbt_query:
+ * @INTEL_VBT_QUERY_HEADER: signature and versions of the VBT and BDB
+ * @INTEL_VBT_QUERY_PANELS: timings of the LFP panels
+ * @INTEL_VBT_QUERY_PORTS: child devices and the ports they are on
+ * @INTEL_VBT_QUERY_DSC: display stream compression of the child devices
+ */
+enum intel_vbt_query {
+	INTEL_VBT_QUERY_HEADER = 1 << 0,
+	INTEL_VBT_QUERY_PANELS = 1 << 1,
+	INTEL_VBT_QUERY_PORTS = 1 << 2,
+	INTEL_VBT_QUERY_DSC = 1 << 3,
+	INTEL_VBT_QUERY_ALL = (1 << 4) - 1,
+};
+
+struct intel_vbt *intel_vbt_parse(const void *data, size_t size,
+				  int panel_type);
+void intel_vbt_free(struct intel_vbt *vbt);
+
+const void *intel_vbt_block(const struct intel_vbt *vbt, int id,
+			    uint32_t *size);
+
+const char *intel_vbt_dvo_port_name(uint8_t port);
+const char *intel_vbt_child_handle_name(uint16_t handle);
+
+int intel_vbt_parse_queries(const char *s, unsigned int *queries);
+void intel_vbt_print_json(FILE *out, const struct intel_vbt *vbt,
+			  const char *name, unsigned int queries);
+
+#endif /* __INTEL_VBT_H__ */
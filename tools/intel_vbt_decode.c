@@ -51,6 +51,7 @@ typedef uint64_t u64;
 
 #define _INTEL_BIOS_PRIVATE
 #include "intel_vbt_defs.h"
+#include "intel_vbt.h"
 
 /* no bother to include "edid.h" */
 #define _H_ACTIVE(x) (x[2] + ((x[4] & 0xF0) << 4))
@@ -331,60 +332,6 @@ static void dump_child_device_type_bits(uint16_t type)
 	}
 }
 
-static const struct {
-	unsigned char handle;
-	const char *name;
-} child_device_handles[] = {
-	{ DEVICE_HANDLE_CRT, "CRT" },
-	{ DEVICE_HANDLE_EFP1, "EFP 1 (HDMI/DVI/DP)" },
-	{ DEVICE_HANDLE_EFP2, "EFP 2 (HDMI/DVI/DP)" },
-	{ DEVICE_HANDLE_EFP3, "EFP 3 (HDMI/DVI/DP)" },
-	{ DEVICE_HANDLE_EFP4, "EFP 4 (HDMI/DVI/DP)" },
-	{ DEVICE_HANDLE_LPF1, "LFP 1 (eDP)" },
-	{ DEVICE_HANDLE_LFP2, "LFP 2 (eDP)" },
-};
-static const int num_child_device_handles =
-	sizeof(child_device_handles) / sizeof(child_device_handles[0]);
-
-static const char *child_device_handle(unsigned char handle)
-{
-	int i;
-
-	for (i = 0; i < num_child_device_handles; i++)
-		if (child_device_handles[i].handle == handle)
-			return child_device_handles[i].name;
-
-	return "unknown";
-}
-
-static const char *dvo_port_names[] = {
-	[DVO_PORT_HDMIA] = "HDMI-A",
-	[DVO_PORT_HDMIB] = "HDMI-B",
-	[DVO_PORT_HDMIC] = "HDMI-C",
-	[DVO_PORT_HDMID] = "HDMI-D",
-	[DVO_PORT_LVDS] = "LVDS",
-	[DVO_PORT_TV] = "TV",
-	[DVO_PORT_CRT] = "CRT",
-	[DVO_PORT_DPB] = "DP-B",
-	[DVO_PORT_DPC] = "DP-C",
-	[DVO_PORT_DPD] = "DP-D",
-	[DVO_PORT_DPA] = "DP-A",
-	[DVO_PORT_DPE] = "DP-E",
-	[DVO_PORT_HDMIE] = "HDMI-E",
-	[DVO_PORT_MIPIA] = "MIPI-A",
-	[DVO_PORT_MIPIB] = "MIPI-B",
-	[DVO_PORT_MIPIC] = "MIPI-C",
-	[DVO_PORT_MIPID] = "MIPI-D",
-};
-
-static const char *dvo_port(uint8_t type)
-{
-	if (type < ARRAY_SIZE(dvo_port_names) && dvo_port_names[type])
-		return dvo_port_names[type];
-	else
-		return "unknown";
-}
-
 static const char *mipi_bridge_type(uint8_t type)
 {
 	switch (type) {
@@ -427,7 +374,7 @@ static void dump_child_device(struct context *context,
 
 	printf("\tChild device info:\n");
 	printf("\t\tDevice handle: 0x%04x (%s)\n", child->handle,
-	       child_device_handle(child->handle));
+	       intel_vbt_child_handle_name(child->handle));
 	printf("\t\tDevice type: 0x%04x (%s)\n", child->device_type,
 	       child_device_type(child->device_type));
 	dump_child_device_type_bits(child->device_type);
@@ -446,11 +393,11 @@ static void dump_child_device(struct context *context,
 		printf("\t\tCompression method CPS: %s\n", YESNO(child->compression_method));
 		printf("\t\tDual pipe ganged eDP: %s\n", YESNO(child->ganged_edp));
 		printf("\t\tCompression structure index: 0x%02x)\n", child->compression_structure_index);
-		printf("\t\tSlave DDI port: 0x%02x (%s)\n", child->slave_port, dvo_port(child->slave_port));
+		printf("\t\tSlave DDI port: 0x%02x (%s)\n", child->slave_port, intel_vbt_dvo_port_name(child->slave_port));
 	}
 
 	printf("\t\tAIM offset: %d\n", child->addin_offset);
-	printf("\t\tDVO Port: 0x%02x (%s)\n", child->dvo_port, dvo_port(child->dvo_port));
+	printf("\t\tDVO Port: 0x%02x (%s)\n", child->dvo_port, intel_vbt_dvo_port_name(child->dvo_port));
 
 	printf("\t\tAIM I2C pin: 0x%02x\n", child->i2c_pin);
 	printf("\t\tAIM Slave address: 0x%02x\n", child->slave_addr);
@@ -459,7 +406,7 @@ static void dump_child_device(struct context *context,
 	printf("\t\tDVO config: 0x%02x\n", child->dvo_cfg);
 
 	if (context->bdb->version < 155) {
-		printf("\t\tDVO2 Port: 0x%02x (%s)\n", child->dvo2_port, dvo_port(child->dvo2_port));
+		printf("\t\tDVO2 Port: 0x%02x (%s)\n", child->dvo2_port, intel_vbt_dvo_port_name(child->dvo2_port));
 		printf("\t\tI2C2 pin: 0x%02x\n", child->i2c2_pin);
 		printf("\t\tSlave2 address: 0x%02x\n", child->slave2_addr);
 		printf("\t\tDDC2 pin: 0x%02x\n", child->ddc2_pin);
@@ -1801,8 +1748,95 @@ enum opt {
 	OPT_USAGE,
 	OPT_HEADER,
 	OPT_DESCRIBE,
+	OPT_JSON,
 };
 
+static uint8_t *read_vbios(const char *filename, int *sizep, bool *mapped)
+{
+	uint8_t *VBIOS;
+	struct stat finfo;
+	int size;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "Couldn't open \"%s\": %s\n",
+			filename, strerror(errno));
+		return NULL;
+	}
+
+	if (stat(filename, &finfo)) {
+		fprintf(stderr, "Failed to stat \"%s\": %s\n",
+			filename, strerror(errno));
+		return NULL;
+	}
+	size = finfo.st_size;
+
+	if (size == 0) {
+		int len = 0, ret;
+		size = 8192;
+		VBIOS = malloc (size);
+		while ((ret = read(fd, VBIOS + len, size - len))) {
+			if (ret < 0) {
+				fprintf(stderr, "Failed to read \"%s\": %s\n",
+					filename, strerror(errno));
+				return NULL;
+			}
+
+			len += ret;
+			if (len == size) {
+				size *= 2;
+				VBIOS = realloc(VBIOS, size);
+			}
+		}
+		size = len;
+		*mapped = false;
+	} else {
+		VBIOS = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (VBIOS == MAP_FAILED) {
+			fprintf(stderr, "Failed to map \"%s\": %s\n",
+				filename, strerror(errno));
+			return NULL;
+		}
+		*mapped = true;
+	}
+
+	close(fd);
+	*sizep = size;
+
+	return VBIOS;
+}
+
+static int dump_json(const char *filename, int panel_type,
+		     unsigned int queries)
+{
+	struct intel_vbt *vbt;
+	uint8_t *VBIOS;
+	bool mapped;
+	int size;
+
+	VBIOS = read_vbios(filename, &size, &mapped);
+	if (!VBIOS)
+		return -1;
+
+	vbt = intel_vbt_parse(VBIOS, size, panel_type);
+	if (vbt) {
+		intel_vbt_print_json(stdout, vbt, filename, queries);
+		intel_vbt_free(vbt);
+	} else {
+		fprintf(stderr, "%s: %s\n", filename,
+			errno == ENOENT ? "VBT signature missing" :
+			"Invalid VBT found");
+	}
+
+	if (mapped)
+		munmap(VBIOS, size);
+	else
+		free(VBIOS);
+
+	return vbt ? 0 : -1;
+}
+
 static void usage(const char *toolname)
 {
 	fprintf(stderr, "usage: %s", toolname);
@@ -1814,6 +1848,7 @@ static void usage(const char *toolname)
 			" [--block=<block_no>]"
 			" [--header]"
 			" [--describe]"
+			" [--json[=header,panels,ports,dsc]]"
 			" [--help]\n");
 }
 
@@ -1822,12 +1857,10 @@ int main(int argc, char **argv)
 	uint8_t *VBIOS;
 	int index;
 	enum opt opt;
-	int fd;
 	struct vbt_header *vbt = NULL;
 	int vbt_off, bdb_off, i;
 	const char *filename = NULL;
 	const char *toolname = argv[0];
-	struct stat finfo;
 	int size;
 	struct context context = {
 		.panel_type = -1,
@@ -1835,6 +1868,8 @@ int main(int argc, char **argv)
 	char *endp;
 	int block_number = -1;
 	bool header_only = false, describe = false;
+	unsigned int json = 0;
+	bool mapped;
 
 	static struct option options[] = {
 		{ "file",	required_argument,	NULL,	OPT_FILE },
@@ -1845,6 +1880,7 @@ int main(int argc, char **argv)
 		{ "block",	required_argument,	NULL,	OPT_BLOCK },
 		{ "header",	no_argument,		NULL,	OPT_HEADER },
 		{ "describe",	no_argument,		NULL,	OPT_DESCRIBE },
+		{ "json",	optional_argument,	NULL,	OPT_JSON },
 		{ "help",	no_argument,		NULL,	OPT_USAGE },
 		{ 0 }
 	};
@@ -1891,6 +1927,14 @@ int main(int argc, char **argv)
 		case OPT_DESCRIBE:
 			describe = true;
 			break;
+		case OPT_JSON:
+			json = INTEL_VBT_QUERY_ALL;
+			if (optarg && intel_vbt_parse_queries(optarg, &json)) {
+				fprintf(stderr, "invalid queries '%s'\n",
+					optarg);
+				return EXIT_FAILURE;
+			}
+			break;
 		case OPT_END:
 			break;
 		case OPT_USAGE: /* fall-through */
@@ -1903,6 +1947,24 @@ int main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
+	/* One line of JSON for each of the files */
+	if (json) {
+		int ret = EXIT_SUCCESS;
+
+		if (!filename && !argc) {
+			usage(toolname);
+			return EXIT_FAILURE;
+		}
+
+		if (filename && dump_json(filename, context.panel_type, json))
+			ret = EXIT_FAILURE;
+		for (i = 0; i < argc; i++)
+			if (dump_json(argv[i], context.panel_type, json))
+				ret = EXIT_FAILURE;
+
+		return ret;
+	}
+
 	if (!filename) {
 		if (argc == 1) {
 			/* for backwards compatibility */
@@ -1913,45 +1975,9 @@ int main(int argc, char **argv)
 		}
 	}
 
-	fd = open(filename, O_RDONLY);
-	if (fd == -1) {
-		fprintf(stderr, "Couldn't open \"%s\": %s\n",
-			filename, strerror(errno));
-		return EXIT_FAILURE;
-	}
-
-	if (stat(filename, &finfo)) {
-		fprintf(stderr, "Failed to stat \"%s\": %s\n",
-			filename, strerror(errno));
+	VBIOS = read_vbios(filename, &size, &mapped);
+	if (!VBIOS)
 		return EXIT_FAILURE;
-	}
-	size = finfo.st_size;
-
-	if (size == 0) {
-		int len = 0, ret;
-		size = 8192;
-		VBIOS = malloc (size);
-		while ((ret = read(fd, VBIOS + len, size - len))) {
-			if (ret < 0) {
-				fprintf(stderr, "Failed to read \"%s\": %s\n",
-					filename, strerror(errno));
-				return EXIT_FAILURE;
-			}
-
-			len += ret;
-			if (len == size) {
-				size *= 2;
-				VBIOS = realloc(VBIOS, size);
-			}
-		}
-	} else {
-		VBIOS = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-		if (VBIOS == MAP_FAILED) {
-			fprintf(stderr, "Failed to map \"%s\": %s\n",
-				filename, strerror(errno));
-			return EXIT_FAILURE;
-		}
-	}
 
 	/* Scour memory looking for the VBT signature */
 	for (i = 0; i + 4 < size; i++) {
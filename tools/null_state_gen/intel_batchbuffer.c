@@ -120,6 +120,13 @@ struct intel_batchbuffer *intel_batchbuffer_create(void)
 	return batch;
 }
 
+void intel_batchbuffer_destroy(struct intel_batchbuffer *batch)
+{
+	free(batch->state);
+	free(batch->cmds);
+	free(batch);
+}
+
 static void bb_area_align(struct bb_area *a, unsigned align)
 {
 	if (align == 0)
@@ -181,8 +188,27 @@ struct bb_item *intel_batch_state_get(struct intel_batchbuffer *batch, unsigned
 
 uint32_t intel_batch_state_offset(struct intel_batchbuffer *batch, unsigned align)
 {
+	unsigned offset;
+
 	intel_batch_state_align(batch, align);
-	return bb_area_used(batch->state);
+	offset = bb_area_used(batch->state);
+
+	if (align > batch->state_align)
+		batch->state_align = align;
+
+	/* Every state offset handed out starts a new piece of state */
+	if (batch->num_blobs &&
+	    batch->blobs[batch->num_blobs - 1].offset == offset) {
+		if (align > batch->blobs[batch->num_blobs - 1].align)
+			batch->blobs[batch->num_blobs - 1].align = align;
+	} else {
+		assert(batch->num_blobs < MAX_BLOBS);
+		batch->blobs[batch->num_blobs].offset = offset;
+		batch->blobs[batch->num_blobs].align = align ?: 4;
+		batch->num_blobs++;
+	}
+
+	return offset;
 }
 
 uint32_t intel_batch_state_alloc(struct intel_batchbuffer *batch, unsigned bytes, unsigned align,
@@ -227,6 +253,127 @@ uint32_t intel_batch_state_copy(struct intel_batchbuffer *batch,
 	return offset;
 }
 
+static unsigned blob_end(struct intel_batchbuffer *batch, unsigned b)
+{
+	if (b + 1 < batch->num_blobs)
+		return batch->blobs[b + 1].offset;
+
+	return bb_area_used(batch->state);
+}
+
+/* Size of a piece of state, without the padding aligning the next one */
+static unsigned blob_size(struct intel_batchbuffer *batch, unsigned b)
+{
+	unsigned start = batch->blobs[b].offset / 4;
+	unsigned end = blob_end(batch, b) / 4;
+
+	while (end > start && batch->state->item[end - 1].type == PAD)
+		end--;
+
+	return (end - start) * 4;
+}
+
+/* Pieces of state pointing to other state can't be told apart by contents */
+static int blob_has_offsets(struct intel_batchbuffer *batch, unsigned b)
+{
+	unsigned i;
+
+	for (i = batch->blobs[b].offset / 4; i < blob_end(batch, b) / 4; i++)
+		if (batch->state->item[i].type == STATE_OFFSET)
+			return 1;
+
+	return 0;
+}
+
+static int blob_find(struct bb_area *a, const struct bb_item *item,
+		     unsigned bytes, unsigned align)
+{
+	unsigned offset, i;
+
+	for (offset = 0; offset + bytes <= bb_area_used(a); offset += align) {
+		for (i = 0; i < bytes / 4; i++) {
+			const struct bb_item *s = &a->item[offset / 4 + i];
+
+			if (s->type == STATE_OFFSET || s->data != item[i].data)
+				break;
+		}
+
+		if (i == bytes / 4)
+			return offset;
+	}
+
+	return -1;
+}
+
+static uint32_t blob_remap(struct intel_batchbuffer *batch,
+			   const unsigned *map, uint32_t offset)
+{
+	unsigned b;
+
+	for (b = 0; b < batch->num_blobs; b++)
+		if (offset >= batch->blobs[b].offset &&
+		    offset < blob_end(batch, b))
+			return map[b] + offset - batch->blobs[b].offset;
+
+	return offset;
+}
+
+/*
+ * Lays the indirect state out again, pointing every piece of state with the
+ * same contents as one placed before it at that one instead, and fixes up
+ * the state offsets in the commands and in the state accordingly.
+ */
+void intel_batch_dedupe_state(struct intel_batchbuffer *batch)
+{
+	unsigned map[MAX_BLOBS];
+	struct bb_area *state;
+	unsigned b, i;
+
+	assert(batch->state_start_offset == -1);
+
+	state = calloc(1, sizeof(*state));
+	assert(state);
+
+	for (b = 0; b < batch->num_blobs; b++) {
+		const struct bb_item *item =
+			&batch->state->item[batch->blobs[b].offset / 4];
+		unsigned bytes = blob_size(batch, b);
+		int offset = -1;
+
+		if (bytes && !blob_has_offsets(batch, b))
+			offset = blob_find(state, item, bytes,
+					   batch->blobs[b].align);
+
+		if (offset < 0) {
+			bb_area_align(state, batch->blobs[b].align);
+			offset = bb_area_used(state);
+			for (i = 0; i < bytes / 4; i++)
+				bb_area_emit(state, item[i].data,
+					     item[i].type, item[i].str);
+		}
+
+		map[b] = offset;
+	}
+
+	for (i = 0; i < bb_area_items(state); i++) {
+		struct bb_item *s = bb_area_get(state, i);
+
+		if (s->type == STATE_OFFSET)
+			s->data = blob_remap(batch, map, s->data);
+	}
+
+	for (i = 0; i < bb_area_items(batch->cmds); i++) {
+		struct bb_item *s = bb_area_get(batch->cmds, i);
+
+		if (s->type == STATE_OFFSET || s->type == RELOC_STATE)
+			s->data = blob_remap(batch, map, s->data);
+	}
+
+	free(batch->state);
+	batch->state = state;
+	batch->num_blobs = 0;
+}
+
 void intel_batch_relocate_state(struct intel_batchbuffer *batch)
 {
 	unsigned int i;
@@ -235,8 +382,8 @@ void intel_batch_relocate_state(struct intel_batchbuffer *batch)
 
 	batch->cmds_end_offset = bb_area_used(batch->cmds) - 4;
 
-	/* Hardcoded, could track max align done also */
-	intel_batch_cmd_align(batch, 64);
+	/* The state starts aligned as much as any piece of it */
+	intel_batch_cmd_align(batch, batch->state_align ?: 4);
 
 	batch->state_start_offset = bb_area_used(batch->cmds);
 
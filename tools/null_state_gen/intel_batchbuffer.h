@@ -36,6 +36,7 @@
 #define MAX_RELOCS 64
 #define MAX_ITEMS 1024
 #define MAX_STRLEN 256
+#define MAX_BLOBS 64
 
 #define ALIGN(x, y) (((x) + (y)-1) & ~((y)-1))
 
@@ -60,14 +61,25 @@ struct bb_area {
 	unsigned long num_items;
 };
 
+/* A piece of indirect state, starting at an intel_batch_state_offset() */
+struct bb_blob {
+	unsigned offset;
+	unsigned align;
+};
+
 struct intel_batchbuffer {
 	struct bb_area *cmds;
 	struct bb_area *state;
 	unsigned long cmds_end_offset;
 	unsigned long state_start_offset;
+
+	struct bb_blob blobs[MAX_BLOBS];
+	unsigned num_blobs;
+	unsigned state_align;
 };
 
 struct intel_batchbuffer *intel_batchbuffer_create(void);
+void intel_batchbuffer_destroy(struct intel_batchbuffer *batch);
 
 #define OUT_CMD_B(cmd, len, bias) intel_batch_cmd_emit_null(batch, (cmd), (len), (bias), #cmd " " #len)
 #define OUT_CMD(cmd, len) OUT_CMD_B(cmd, len, 2)
@@ -92,6 +104,7 @@ unsigned intel_batch_num_state(struct intel_batchbuffer *batch);
 struct bb_item *intel_batch_cmd_get(struct intel_batchbuffer *batch, unsigned i);
 int intel_batch_is_reloc(struct intel_batchbuffer *batch, unsigned i);
 
+void intel_batch_dedupe_state(struct intel_batchbuffer *batch);
 void intel_batch_relocate_state(struct intel_batchbuffer *batch);
 
 const char *intel_batch_type_as_str(const struct bb_item *item);
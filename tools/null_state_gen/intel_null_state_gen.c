@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <assert.h>
 
@@ -35,17 +36,21 @@
 
 static int debug = 0;
 
+static const int gens[] = { 6, 7, 8, 9, 10, 11 };
+
 static void print_usage(char *s)
 {
 	fprintf(stderr, "%s: <gen>\n"
-		"     gen:     gen to generate for (6,7,8,9)\n",
+		"     gen:     gen to generate for (6,7,8,9,10,11), or 'sizes'\n"
+		"              to list the batch sizes of all of them\n",
 		s);
 }
 
 /* Creates the intel_renderstate_genX.c file for the particular
  * GEN product
  */
-static int print_state(int gen, struct intel_batchbuffer *batch)
+static int print_state(int gen, struct intel_batchbuffer *batch,
+		       unsigned long state_items)
 {
 	int i;
 	unsigned long cmds;
@@ -99,7 +104,9 @@ static int print_state(int gen, struct intel_batchbuffer *batch)
 	printf("};\n\nRO_RENDERSTATE(%d);\n", gen);
 
 	fprintf(stderr, "Commands %lu (%lu bytes)\n", cmds, cmds * 4);
-	fprintf(stderr, "State    %lu (%lu bytes)\n", batch->state->num_items, batch->state->num_items * 4);
+	fprintf(stderr, "State    %lu (%lu bytes, %lu before dedupe)\n",
+		batch->state->num_items, batch->state->num_items * 4,
+		state_items * 4);
 	fprintf(stderr, "Total    %lu (%lu bytes)\n", batch->cmds->num_items, batch->cmds->num_items * 4);
 	fprintf(stderr, "\n");
 
@@ -107,16 +114,11 @@ static int print_state(int gen, struct intel_batchbuffer *batch)
 }
 
 /* Selects generator function for the given product and executes it. */
-static int do_generate(int gen)
+static struct intel_batchbuffer *generate(int gen, unsigned long *state_items)
 {
 	struct intel_batchbuffer *batch;
-	int ret = -EINVAL;
 	void (*null_state_gen)(struct intel_batchbuffer *batch) = NULL;
 
-	batch = intel_batchbuffer_create();
-	if (batch == NULL)
-		return -ENOMEM;
-
 	switch (gen) {
 	case 6:
 		null_state_gen = gen6_setup_null_render_state;
@@ -132,21 +134,76 @@ static int do_generate(int gen)
 	case 9:
 		null_state_gen = gen9_setup_null_render_state;
 		break;
+	case 10:
+		null_state_gen = gen10_setup_null_render_state;
+		break;
+	case 11:
+		null_state_gen = gen11_setup_null_render_state;
+		break;
 	}
 
 	if (null_state_gen == NULL) {
 		printf("no generator found for %d\n", gen);
-		return -EINVAL;
+		return NULL;
 	}
 
+	batch = intel_batchbuffer_create();
+	if (batch == NULL)
+		return NULL;
+
 	null_state_gen(batch);
+
+	/* Shared by every context, so keep only one copy of identical state */
+	*state_items = intel_batch_num_state(batch);
+	intel_batch_dedupe_state(batch);
 	intel_batch_relocate_state(batch);
 
-	ret = print_state(gen, batch);
+	return batch;
+}
+
+static int do_generate(int gen)
+{
+	struct intel_batchbuffer *batch;
+	unsigned long state_items;
+	int ret;
+
+	batch = generate(gen, &state_items);
+	if (batch == NULL)
+		return -EINVAL;
+
+	ret = print_state(gen, batch, state_items);
+	intel_batchbuffer_destroy(batch);
 
 	return ret;
 }
 
+/* Lists how large the golden context batch of every gen is */
+static int print_sizes(void)
+{
+	int i;
+
+	printf("gen  commands     state          total\n");
+	for (i = 0; i < sizeof(gens) / sizeof(gens[0]); i++) {
+		struct intel_batchbuffer *batch;
+		unsigned long state_items;
+		unsigned long cmds;
+
+		batch = generate(gens[i], &state_items);
+		if (batch == NULL)
+			return -EINVAL;
+
+		cmds = batch->cmds_end_offset / 4 + 1;
+		printf("%3d  %8lu  %4lu (%4lu)  %8lu\n", gens[i],
+		       cmds * 4,
+		       intel_batch_num_state(batch) * 4ul, state_items * 4,
+		       intel_batch_num_cmds(batch) * 4ul);
+
+		intel_batchbuffer_destroy(batch);
+	}
+
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	if (argc < 2) {
@@ -157,5 +214,8 @@ int main(int argc, char *argv[])
 	if (argc > 2)
 		debug = 1;
 
+	if (strcmp(argv[1], "sizes") == 0)
+		return print_sizes();
+
 	return do_generate(atoi(argv[1]));
 }
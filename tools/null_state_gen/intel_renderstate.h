@@ -30,5 +30,7 @@ void gen6_setup_null_render_state(struct intel_batchbuffer *batch);
 void gen7_setup_null_render_state(struct intel_batchbuffer *batch);
 void gen8_setup_null_render_state(struct intel_batchbuffer *batch);
 void gen9_setup_null_render_state(struct intel_batchbuffer *batch);
+void gen10_setup_null_render_state(struct intel_batchbuffer *batch);
+void gen11_setup_null_render_state(struct intel_batchbuffer *batch);
 
 #endif /* __INTEL_RENDERSTATE_H__ */
@@ -286,10 +286,11 @@ static void gen8_emit_primitive(struct intel_batchbuffer *batch)
 	OUT_BATCH(0);   /* index buffer offset, ignored */
 }
 
-static void gen9_emit_state_base_address(struct intel_batchbuffer *batch) {
+static void gen9_emit_state_base_address(struct intel_batchbuffer *batch,
+					 int gen) {
 	const unsigned offset = 0;
 	OUT_BATCH(GEN4_STATE_BASE_ADDRESS |
-		(19 - 2) /* DWORD count - 2 */);
+		((gen >= 10 ? 22 : 19) - 2) /* DWORD count - 2 */);
 
 	/* general state base address - requires BB address
 	 * added to state offset to be stored in this location
@@ -336,13 +337,23 @@ static void gen9_emit_state_base_address(struct intel_batchbuffer *batch) {
 	OUT_BATCH(0);
 	/* bindless surface state size */
 	OUT_BATCH(0);
+
+	if (gen >= 10) {
+		/* bindless sampler state base address */
+		OUT_BATCH(0);
+		OUT_BATCH(0);
+		/* bindless sampler state size */
+		OUT_BATCH(0);
+	}
 }
 
 /*
  * Generate the batch buffer commands needed to initialize the 3D engine
- * to its "golden state".
+ * to its "golden state". Gen10 and gen11 program the same state, with
+ * their longer STATE_BASE_ADDRESS.
  */
-void gen9_setup_null_render_state(struct intel_batchbuffer *batch)
+static void __gen9_setup_null_render_state(struct intel_batchbuffer *batch,
+					   int gen)
 {
 	int i;
 
@@ -412,7 +423,7 @@ void gen9_setup_null_render_state(struct intel_batchbuffer *batch)
 	}
 
 	/* State base addresses */
-	gen9_emit_state_base_address(batch);
+	gen9_emit_state_base_address(batch, gen);
 
 	OUT_CMD(GEN4_STATE_SIP, 3);
 	OUT_CMD(GEN4_3DSTATE_DRAWING_RECTANGLE, 4);
@@ -477,3 +488,18 @@ void gen9_setup_null_render_state(struct intel_batchbuffer *batch)
 
 	OUT_BATCH(MI_BATCH_BUFFER_END);
 }
+
+void gen9_setup_null_render_state(struct intel_batchbuffer *batch)
+{
+	__gen9_setup_null_render_state(batch, 9);
+}
+
+void gen10_setup_null_render_state(struct intel_batchbuffer *batch)
+{
+	__gen9_setup_null_render_state(batch, 10);
+}
+
+void gen11_setup_null_render_state(struct intel_batchbuffer *batch)
+{
+	__gen9_setup_null_render_state(batch, 11);
+}